@@ -24,6 +24,8 @@
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-filesystem-account-storage.h>
+#include <libinfinity/adopted/inf-adopted-request-log.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/inf-config.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -126,6 +128,36 @@ infinoted_config_reload(InfinotedRun* run,
     return FALSE;
   }
 
+#ifndef G_OS_WIN32
+  if(g_strcmp0(startup->options->local_socket,
+               run->startup->options->local_socket) != 0)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("INFINOTED_CONFIG_RELOAD_ERROR"),
+      0,
+      _("Changing the local socket at runtime is not supported")
+    );
+
+    infinoted_startup_free(startup);
+    return FALSE;
+  }
+
+  if(g_strcmp0(startup->options->handoff_socket,
+               run->startup->options->handoff_socket) != 0)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("INFINOTED_CONFIG_RELOAD_ERROR"),
+      0,
+      _("Changing the handoff socket at runtime is not supported")
+    );
+
+    infinoted_startup_free(startup);
+    return FALSE;
+  }
+#endif
+
   /* Find out the port we are currently running on */
   tcp4 = tcp6 = NULL;
   if(run->xmpp6)
@@ -315,6 +347,14 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp6);
 
+      g_object_set(
+        G_OBJECT(run->xmpp6),
+        "compression-level", startup->options->compression_level,
+        "kernel-tls", startup->options->kernel_tls,
+        "max-handshakes", startup->options->max_handshakes,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp6));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -338,6 +378,14 @@ infinoted_config_reload(InfinotedRun* run,
 
       g_object_unref(tcp4);
 
+      g_object_set(
+        G_OBJECT(run->xmpp4),
+        "compression-level", startup->options->compression_level,
+        "kernel-tls", startup->options->kernel_tls,
+        "max-handshakes", startup->options->max_handshakes,
+        NULL
+      );
+
       infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->xmpp4));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -360,6 +408,9 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp6),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "compression-level", startup->options->compression_level,
+        "kernel-tls", startup->options->kernel_tls,
+        "max-handshakes", startup->options->max_handshakes,
         NULL
       );
     }
@@ -370,6 +421,9 @@ infinoted_config_reload(InfinotedRun* run,
         G_OBJECT(run->xmpp4),
         "credentials", startup->credentials,
         "security-policy", startup->options->security_policy,
+        "compression-level", startup->options->compression_level,
+        "kernel-tls", startup->options->kernel_tls,
+        "max-handshakes", startup->options->max_handshakes,
         NULL
       );
     }
@@ -405,6 +459,14 @@ infinoted_config_reload(InfinotedRun* run,
     g_object_unref(filesystem_account_storage);
   }
 
+  g_object_get(G_OBJECT(run->directory), "storage", &storage, NULL);
+  infd_filesystem_storage_set_durability(
+    INFD_FILESYSTEM_STORAGE(storage),
+    startup->options->durability,
+    startup->options->commit_interval
+  );
+  g_object_unref(storage);
+
 #ifdef G_OS_WIN32
   module_path = g_win32_get_package_installation_directory_of_module(NULL);
   plugin_path = g_build_filename(module_path, "lib", PLUGIN_PATH, NULL);
@@ -451,6 +513,37 @@ infinoted_config_reload(InfinotedRun* run,
 
   run->plugin_manager = plugin_manager;
 
+  g_object_set(
+    G_OBJECT(run->directory),
+    "max-idle-sessions", startup->options->max_idle_sessions,
+    "retry-after", startup->options->retry_after * 1000,
+    NULL
+  );
+
+  if(startup->options->transformation_cache_limit == G_MAXUINT)
+  {
+    inf_adopted_request_log_set_global_cache_max_bytes(G_MAXSIZE);
+  }
+  else
+  {
+    inf_adopted_request_log_set_global_cache_max_bytes(
+      (gsize)startup->options->transformation_cache_limit << 20
+    );
+  }
+
+  inf_async_operation_set_max_threads(startup->options->worker_threads);
+
+  g_object_set(
+    G_OBJECT(run->io),
+    "busy-poll", startup->options->busy_poll,
+    NULL
+  );
+
+#ifdef LIBINFINITY_HAVE_PAM
+  /* The allowed users or the PAM service might have changed */
+  infinoted_pam_cache_clear();
+#endif
+
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   /* Remember whether we have been daemonized; this is not a config file
    * option, so not properly set in our newly created startup. */
@@ -477,6 +570,16 @@ infinoted_config_reload(InfinotedRun* run,
     );
   }
 
+  if(run->xmpp_local != NULL)
+  {
+    g_object_set(
+      G_OBJECT(run->xmpp_local),
+      "sasl-context",    startup->sasl_context,
+      "sasl-mechanisms", startup->sasl_context ? "PLAIN" : NULL,
+      NULL
+    );
+  }
+
   /* Give each connection the new sasl context. This is necessary even if the
    * connection already had a sasl context since that holds on to the old
    * startup object. This aborts authentications in progress and otherwise
@@ -0,0 +1,507 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+/*
+ * A server that is going to be replaced listens on the handoff socket. The
+ * new server connects to it and receives the listening sockets of the old
+ * one in a single message, with one byte per socket telling which server it
+ * belongs to. The old server then stops accepting connections and exits,
+ * writing all documents to disk. It keeps the handoff connection open until
+ * it is done, so that the new server starts reading documents only after
+ * they have been written. Connections arriving in the meanwhile are queued
+ * by the kernel and accepted by the new server when it opens.
+ */
+
+#include <infinoted/infinoted-handoff.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <string.h>
+
+#define INFINOTED_HANDOFF_MAX_SOCKETS 3
+
+#define INFINOTED_HANDOFF_SOCKET4 '4'
+#define INFINOTED_HANDOFF_SOCKET6 '6'
+#define INFINOTED_HANDOFF_SOCKET_LOCAL 'L'
+
+static gboolean
+infinoted_handoff_make_address(const gchar* path,
+                               struct sockaddr_un* addr,
+                               GError** error)
+{
+  if(strlen(path) >= sizeof(addr->sun_path))
+  {
+    inf_native_socket_make_error(ENAMETOOLONG, error);
+    return FALSE;
+  }
+
+  memset(addr, 0, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  return TRUE;
+}
+
+/* Adds the listening socket of xmpp to fds, if it is running */
+static void
+infinoted_handoff_add_socket(InfdXmppServer* xmpp,
+                             gchar kind,
+                             int* fds,
+                             gchar* kinds,
+                             guint* n_fds)
+{
+  InfdTcpServer* tcp;
+  InfNativeSocket socket;
+
+  if(xmpp == NULL)
+    return;
+
+  g_object_get(G_OBJECT(xmpp), "tcp-server", &tcp, NULL);
+  socket = infd_tcp_server_get_native_socket(tcp);
+  g_object_unref(tcp);
+
+  if(socket != INVALID_SOCKET)
+  {
+    fds[*n_fds] = socket;
+    kinds[*n_fds] = kind;
+    ++*n_fds;
+  }
+}
+
+/* Closes the server once its socket is in use by the new process */
+static void
+infinoted_handoff_hand_over_server(InfdXmppServer* xmpp)
+{
+  InfdTcpServer* tcp;
+  InfdTcpServerStatus status;
+
+  if(xmpp == NULL)
+    return;
+
+  g_object_get(G_OBJECT(xmpp), "tcp-server", &tcp, NULL);
+  g_object_get(G_OBJECT(tcp), "status", &status, NULL);
+
+  if(status != INFD_TCP_SERVER_CLOSED)
+    infd_tcp_server_hand_over(tcp);
+
+  g_object_unref(tcp);
+}
+
+static gboolean
+infinoted_handoff_send(InfinotedHandoff* handoff,
+                       InfNativeSocket connection,
+                       GError** error)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  union {
+    char buf[CMSG_SPACE(INFINOTED_HANDOFF_MAX_SOCKETS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  int fds[INFINOTED_HANDOFF_MAX_SOCKETS];
+  gchar kinds[INFINOTED_HANDOFF_MAX_SOCKETS];
+  guint n_fds;
+  ssize_t bytes;
+
+  n_fds = 0;
+
+  infinoted_handoff_add_socket(
+    handoff->run->xmpp6,
+    INFINOTED_HANDOFF_SOCKET6,
+    fds,
+    kinds,
+    &n_fds
+  );
+
+  infinoted_handoff_add_socket(
+    handoff->run->xmpp4,
+    INFINOTED_HANDOFF_SOCKET4,
+    fds,
+    kinds,
+    &n_fds
+  );
+
+  infinoted_handoff_add_socket(
+    handoff->run->xmpp_local,
+    INFINOTED_HANDOFF_SOCKET_LOCAL,
+    fds,
+    kinds,
+    &n_fds
+  );
+
+  /* We are always running at least one of the TCP servers */
+  g_assert(n_fds > 0);
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+
+  iov.iov_base = kinds;
+  iov.iov_len = n_fds;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(n_fds * sizeof(int));
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(n_fds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, n_fds * sizeof(int));
+
+  do
+  {
+    bytes = sendmsg(connection, &msg, 0);
+  } while(bytes == -1 && errno == EINTR);
+
+  if(bytes == -1)
+  {
+    inf_native_socket_make_error(errno, error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_handoff_io(InfNativeSocket* socket,
+                     InfIoEvent events,
+                     gpointer user_data)
+{
+  InfinotedHandoff* handoff;
+  InfNativeSocket connection;
+  GError* error;
+
+  handoff = (InfinotedHandoff*)user_data;
+
+  if(events & INF_IO_ERROR)
+  {
+    infinoted_log_error(
+      handoff->run->startup->log,
+      _("Error on the handoff socket; the server can no longer be replaced "
+        "without refusing connections")
+    );
+
+    inf_io_remove_watch(handoff->io, handoff->watch);
+    handoff->watch = NULL;
+    return;
+  }
+
+  do
+  {
+    connection = accept(handoff->socket, NULL, NULL);
+  } while(connection == INVALID_SOCKET && errno == EINTR);
+
+  if(connection == INVALID_SOCKET)
+    return;
+
+  error = NULL;
+  if(!infinoted_handoff_send(handoff, connection, &error))
+  {
+    infinoted_log_error(
+      handoff->run->startup->log,
+      _("Failed to hand over the listening sockets: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+    closesocket(connection);
+    return;
+  }
+
+  infinoted_log_info(
+    handoff->run->startup->log,
+    _("Handed over the listening sockets to a new server, shutting down")
+  );
+
+  /* The new server is listening on the handoff socket once it has started,
+   * so we must not remove it later. */
+  inf_io_remove_watch(handoff->io, handoff->watch);
+  handoff->watch = NULL;
+  closesocket(handoff->socket);
+  handoff->socket = INVALID_SOCKET;
+  unlink(handoff->path);
+
+  infinoted_handoff_hand_over_server(handoff->run->xmpp6);
+  infinoted_handoff_hand_over_server(handoff->run->xmpp4);
+  infinoted_handoff_hand_over_server(handoff->run->xmpp_local);
+
+  /* Closed in infinoted_handoff_free(), after the documents have been
+   * written when the server was shut down. */
+  handoff->connection = connection;
+  infinoted_run_stop(handoff->run);
+}
+
+/**
+ * infinoted_handoff_receive:
+ * @path: The path of the handoff socket.
+ * @socket4: Location to store the listening socket for IPv4.
+ * @socket6: Location to store the listening socket for IPv6.
+ * @socket_local: Location to store the listening Unix domain socket.
+ * @error: Location to store error information, if any.
+ *
+ * Takes over the listening sockets of a server running with a handoff
+ * socket at @path. This tells the running server to shut down, and only
+ * returns once it has exited, so that all of its documents have been
+ * written to disk. If the running server was not listening on one of the
+ * sockets, %INVALID_SOCKET is stored at the corresponding location. This
+ * is also the case for all of them if no server is running at @path, which
+ * is not an error.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurred.
+ */
+gboolean
+infinoted_handoff_receive(const gchar* path,
+                          InfNativeSocket* socket4,
+                          InfNativeSocket* socket6,
+                          InfNativeSocket* socket_local,
+                          GError** error)
+{
+  struct sockaddr_un addr;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  union {
+    char buf[CMSG_SPACE(INFINOTED_HANDOFF_MAX_SOCKETS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  int fds[INFINOTED_HANDOFF_MAX_SOCKETS];
+  gchar kinds[INFINOTED_HANDOFF_MAX_SOCKETS];
+  InfNativeSocket connection;
+  InfNativeSocket* target;
+  ssize_t bytes;
+  guint n_fds;
+  guint i;
+  gchar c;
+
+  *socket4 = INVALID_SOCKET;
+  *socket6 = INVALID_SOCKET;
+  *socket_local = INVALID_SOCKET;
+
+  if(!infinoted_handoff_make_address(path, &addr, error))
+    return FALSE;
+
+  connection = socket(PF_UNIX, SOCK_STREAM, 0);
+  if(connection == INVALID_SOCKET)
+  {
+    inf_native_socket_make_error(errno, error);
+    return FALSE;
+  }
+
+  if(connect(connection, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  {
+    closesocket(connection);
+
+    /* No server is running that could hand over its sockets */
+    if(errno == ENOENT || errno == ECONNREFUSED)
+      return TRUE;
+
+    inf_native_socket_make_error(errno, error);
+    return FALSE;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = kinds;
+  iov.iov_len = sizeof(kinds);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  do
+  {
+    bytes = recvmsg(connection, &msg, 0);
+  } while(bytes == -1 && errno == EINTR);
+
+  if(bytes <= 0)
+  {
+    if(bytes == 0)
+    {
+      g_set_error_literal(
+        error,
+        g_quark_from_static_string("INFINOTED_HANDOFF_ERROR"),
+        0,
+        _("The running server did not hand over its listening sockets")
+      );
+    }
+    else
+    {
+      inf_native_socket_make_error(errno, error);
+    }
+
+    closesocket(connection);
+    return FALSE;
+  }
+
+  n_fds = 0;
+  for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+      n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+      break;
+    }
+  }
+
+  for(i = 0; i < n_fds; ++i)
+  {
+    target = NULL;
+    if(i < (guint)bytes)
+    {
+      switch(kinds[i])
+      {
+      case INFINOTED_HANDOFF_SOCKET4:
+        target = socket4;
+        break;
+      case INFINOTED_HANDOFF_SOCKET6:
+        target = socket6;
+        break;
+      case INFINOTED_HANDOFF_SOCKET_LOCAL:
+        target = socket_local;
+        break;
+      }
+    }
+
+    /* Close sockets we do not know what to do with */
+    if(target != NULL && *target == INVALID_SOCKET)
+      *target = fds[i];
+    else
+      closesocket(fds[i]);
+  }
+
+  /* Wait for the running server to exit */
+  do
+  {
+    bytes = read(connection, &c, 1);
+  } while(bytes > 0 || (bytes == -1 && errno == EINTR));
+
+  closesocket(connection);
+  return TRUE;
+}
+
+/**
+ * infinoted_handoff_new:
+ * @run: A #InfinotedRun.
+ * @path: The path of the handoff socket.
+ * @error: Location to store error information, if any.
+ *
+ * Creates a handoff socket at @path, so that another server started with
+ * the same path can take over the listening sockets of @run with
+ * infinoted_handoff_receive(). When that happens, @run is stopped.
+ *
+ * Returns: A new #InfinotedHandoff, to be freed with
+ * infinoted_handoff_free() after @run has been freed. Or %NULL on error.
+ */
+InfinotedHandoff*
+infinoted_handoff_new(InfinotedRun* run,
+                      const gchar* path,
+                      GError** error)
+{
+  InfinotedHandoff* handoff;
+  struct sockaddr_un addr;
+  struct stat st;
+  InfNativeSocket socket_;
+
+  if(!infinoted_handoff_make_address(path, &addr, error))
+    return NULL;
+
+  /* Left behind by a server that did not exit cleanly */
+  if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  socket_ = socket(PF_UNIX, SOCK_STREAM, 0);
+  if(socket_ == INVALID_SOCKET)
+  {
+    inf_native_socket_make_error(errno, error);
+    return NULL;
+  }
+
+  /* Whoever can connect can shut down the server, so only allow our own
+   * user to do so. */
+  if(bind(socket_, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+     chmod(path, S_IRUSR | S_IWUSR) == -1 ||
+     listen(socket_, 1) == -1)
+  {
+    inf_native_socket_make_error(errno, error);
+    closesocket(socket_);
+    unlink(path);
+    return NULL;
+  }
+
+  handoff = g_slice_new(InfinotedHandoff);
+  handoff->run = run;
+  handoff->io = INF_IO(run->io);
+  handoff->path = g_strdup(path);
+  handoff->socket = socket_;
+  handoff->connection = INVALID_SOCKET;
+  g_object_ref(handoff->io);
+
+  handoff->watch = inf_io_add_watch(
+    handoff->io,
+    &handoff->socket,
+    INF_IO_INCOMING | INF_IO_ERROR,
+    infinoted_handoff_io,
+    handoff,
+    NULL
+  );
+
+  return handoff;
+}
+
+/**
+ * infinoted_handoff_free:
+ * @handoff: A #InfinotedHandoff.
+ *
+ * Removes the handoff socket. If the listening sockets have been handed
+ * over, this tells the new server that all documents have been written, so
+ * call this only after the #InfinotedRun has been freed.
+ */
+void
+infinoted_handoff_free(InfinotedHandoff* handoff)
+{
+  if(handoff->watch != NULL)
+    inf_io_remove_watch(handoff->io, handoff->watch);
+
+  if(handoff->socket != INVALID_SOCKET)
+  {
+    closesocket(handoff->socket);
+    unlink(handoff->path);
+  }
+
+  if(handoff->connection != INVALID_SOCKET)
+    closesocket(handoff->connection);
+
+  g_object_unref(handoff->io);
+  g_free(handoff->path);
+  g_slice_free(InfinotedHandoff, handoff);
+}
+
+/* vim:set et sw=2 ts=2: */
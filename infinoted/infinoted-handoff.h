@@ -0,0 +1,65 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef __INFINOTED_HANDOFF_H__
+#define __INFINOTED_HANDOFF_H__
+
+#include <infinoted/infinoted-run.h>
+
+#include <libinfinity/common/inf-native-socket.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InfinotedHandoff InfinotedHandoff;
+struct _InfinotedHandoff {
+  InfinotedRun* run;
+  InfIo* io;
+  gchar* path;
+
+  InfNativeSocket socket;
+  InfIoWatch* watch;
+
+  /* Connection to the server that took over, kept open until we are done */
+  InfNativeSocket connection;
+};
+
+gboolean
+infinoted_handoff_receive(const gchar* path,
+                          InfNativeSocket* socket4,
+                          InfNativeSocket* socket6,
+                          InfNativeSocket* socket_local,
+                          GError** error);
+
+InfinotedHandoff*
+infinoted_handoff_new(InfinotedRun* run,
+                      const gchar* path,
+                      GError** error);
+
+void
+infinoted_handoff_free(InfinotedHandoff* handoff);
+
+G_END_DECLS
+
+#endif /* __INFINOTED_HANDOFF_H__ */
+
+/* vim:set et sw=2 ts=2: */
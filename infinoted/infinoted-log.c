@@ -29,6 +29,13 @@
  * successfully opened, also a glib logging handler is installed which
  * redirects glib logging to this class. Log output is always shown on
  * stderr and, optionally, can be duplicated to a file as well.
+ *
+ * While the log is open, messages are formatted in the thread that logs
+ * them but written out by a background thread, so that a slow log file or
+ * syslog does not delay the caller. If messages are logged faster than they
+ * can be written, excess messages are dropped and their number is reported
+ * in the log. Use infinoted_log_flush() to wait until all messages have
+ * been written.
  **/
 
 #include <infinoted/infinoted-log.h>
@@ -38,6 +45,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <errno.h>
 
@@ -55,6 +63,24 @@
 # include <syslog.h>
 #endif
 
+/* The maximum number of messages waiting for the writer thread. Further
+ * messages are dropped until it catches up. */
+static const gint INFINOTED_LOG_QUEUE_SIZE = 8192;
+
+typedef struct _InfinotedLogEntry InfinotedLogEntry;
+struct _InfinotedLogEntry {
+  InfinotedLogEntry* next;
+  guint prio;
+  gchar* text;
+};
+
+typedef struct _InfinotedLogSampler InfinotedLogSampler;
+struct _InfinotedLogSampler {
+  gint64 window_start;
+  guint count;
+  guint suppressed;
+};
+
 typedef struct _InfinotedLogPrivate InfinotedLogPrivate;
 struct _InfinotedLogPrivate {
   gchar* file_path;
@@ -63,6 +89,24 @@ struct _InfinotedLogPrivate {
   GRecMutex mutex;
 
   guint recursion_depth;
+  InfinotedLogFormat format;
+
+  /* Formatted entries that have not been written yet, most recent first.
+   * Entries are pushed without locking, and the writer takes all of them
+   * at once. */
+  InfinotedLogEntry* queue;
+  gint queue_length;
+  gint dropped;
+
+  GThread* writer;
+  GMutex writer_mutex;
+  GCond writer_cond;
+  gboolean writer_quit;
+
+  /* Held while writing entries out, so that they are not interleaved */
+  GMutex output_mutex;
+
+  GHashTable* samplers;
 };
 
 enum {
@@ -120,53 +164,170 @@ infinoted_log_handler(const gchar* log_domain,
   }
 
   if(log_level & G_LOG_FLAG_FATAL)
+  {
+    infinoted_log_flush(log);
     abort();
+  }
 }
 
 static void
-infinoted_log_write(InfinotedLog* log,
-                    guint prio,
-                    guint depth,
-                    const gchar* text)
+infinoted_log_append_quoted(GString* str,
+                            const gchar* text)
 {
-  InfinotedLogPrivate* priv;
-  time_t cur_time;
-  struct tm* cur_tm;
-  char time_msg[128];
-  gchar* final_text;
+  const gchar* p;
 
-  priv = INFINOTED_LOG_PRIVATE(log);
-
-  if(depth == 0)
+  g_string_append_c(str, '"');
+  for(p = text; *p != '\0'; ++p)
   {
-    cur_time = time(NULL);
-    cur_tm = localtime(&cur_time);
-
-    switch(prio)
+    switch(*p)
     {
-    case LOG_ERR:
-      strftime(time_msg, 128, "[%c]   ERROR", cur_tm);
+    case '"':
+      g_string_append(str, "\\\"");
+      break;
+    case '\\':
+      g_string_append(str, "\\\\");
       break;
-    case LOG_WARNING:
-      strftime(time_msg, 128, "[%c] WARNING", cur_tm);
+    case '\n':
+      g_string_append(str, "\\n");
       break;
-    case LOG_INFO:
-      strftime(time_msg, 128, "[%c]    INFO", cur_tm);
+    case '\r':
+      g_string_append(str, "\\r");
+      break;
+    case '\t':
+      g_string_append(str, "\\t");
       break;
     default:
-      g_assert_not_reached();
+      if((guchar)*p < 0x20)
+        g_string_append_printf(str, "\\u%04x", (guint)(guchar)*p);
+      else
+        g_string_append_c(str, *p);
       break;
     }
+  }
+
+  g_string_append_c(str, '"');
+}
+
+static gchar*
+infinoted_log_format_structured(InfinotedLogFormat format,
+                                guint prio,
+                                guint depth,
+                                const gchar* text)
+{
+  GDateTime* now;
+  gchar* time_str;
+  const gchar* level;
+  GString* str;
 
-    final_text = g_strdup_printf("%s: %s", time_msg, text);
+  switch(prio)
+  {
+  case LOG_ERR:
+    level = "error";
+    break;
+  case LOG_WARNING:
+    level = "warning";
+    break;
+  case LOG_INFO:
+    level = "info";
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  now = g_date_time_new_now_utc();
+  time_str = g_date_time_format(now, "%Y-%m-%dT%H:%M:%S");
+
+  str = g_string_sized_new(64 + strlen(text));
+  if(format == INFINOTED_LOG_FORMAT_JSON)
+  {
+    g_string_append_printf(
+      str,
+      "{\"time\":\"%s.%06dZ\",\"level\":\"%s\",",
+      time_str,
+      g_date_time_get_microsecond(now),
+      level
+    );
+
+    if(depth > 0)
+      g_string_append_printf(str, "\"depth\":%u,", depth);
+
+    g_string_append(str, "\"msg\":");
+    infinoted_log_append_quoted(str, text);
+    g_string_append_c(str, '}');
   }
   else
   {
-    final_text = g_strdup_printf("\t%s", text);
+    g_string_append_printf(
+      str,
+      "time=%s.%06dZ level=%s ",
+      time_str,
+      g_date_time_get_microsecond(now),
+      level
+    );
+
+    if(depth > 0)
+      g_string_append_printf(str, "depth=%u ", depth);
+
+    g_string_append(str, "msg=");
+    infinoted_log_append_quoted(str, text);
   }
 
+  g_free(time_str);
+  g_date_time_unref(now);
+  return g_string_free(str, FALSE);
+}
+
+static gchar*
+infinoted_log_format(InfinotedLogFormat format,
+                     guint prio,
+                     guint depth,
+                     const gchar* text)
+{
+  time_t cur_time;
+  struct tm* cur_tm;
+  char time_msg[128];
+
+  if(format != INFINOTED_LOG_FORMAT_TEXT)
+    return infinoted_log_format_structured(format, prio, depth, text);
+
+  if(depth > 0)
+    return g_strdup_printf("\t%s", text);
+
+  cur_time = time(NULL);
+  cur_tm = localtime(&cur_time);
+
+  switch(prio)
+  {
+  case LOG_ERR:
+    strftime(time_msg, 128, "[%c]   ERROR", cur_tm);
+    break;
+  case LOG_WARNING:
+    strftime(time_msg, 128, "[%c] WARNING", cur_tm);
+    break;
+  case LOG_INFO:
+    strftime(time_msg, 128, "[%c]    INFO", cur_tm);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  return g_strdup_printf("%s: %s", time_msg, text);
+}
+
+/* Writes a formatted line to all log destinations. The caller needs to
+ * hold the output mutex. */
+static void
+infinoted_log_output(InfinotedLog* log,
+                     guint prio,
+                     const gchar* text)
+{
+  InfinotedLogPrivate* priv;
+  priv = INFINOTED_LOG_PRIVATE(log);
+
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
-  daemon_log(prio, "%s", final_text);
+  daemon_log(prio, "%s", text);
 #else
 #ifdef G_OS_WIN32
   /* On Windows, convert to the character set of the console */
@@ -174,23 +335,202 @@ infinoted_log_write(InfinotedLog* log,
   gchar* converted;
 
   codeset = g_strdup_printf("CP%u", (guint)GetConsoleOutputCP());
-  converted = g_convert(final_text, -1, codeset, "UTF-8", NULL, NULL, NULL);
+  converted = g_convert(text, -1, codeset, "UTF-8", NULL, NULL, NULL);
   g_free(codeset);
 
   fprintf(stderr, "%s\n", converted);
   g_free(converted);
 #else
-  fprintf(stderr, "%s\n", final_text);
+  fprintf(stderr, "%s\n", text);
 #endif /* !G_OS_WIN32 */
 #endif /* !LIBINFINITY_HAVE_LIBDAEMON */
 
   if(priv->log_file != NULL)
+    fprintf(priv->log_file, "%s\n", text);
+}
+
+/* Writes out all queued entries in the order in which they were logged.
+ * The caller needs to hold the output mutex. */
+static void
+infinoted_log_drain(InfinotedLog* log)
+{
+  InfinotedLogPrivate* priv;
+  InfinotedLogEntry* list;
+  InfinotedLogEntry* first;
+  InfinotedLogEntry* next;
+  gint count;
+  gint dropped;
+  gchar* text;
+  gchar* final_text;
+
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  do
+  {
+    list = g_atomic_pointer_get(&priv->queue);
+  } while(!g_atomic_pointer_compare_and_exchange(&priv->queue, list, NULL));
+
+  first = NULL;
+  count = 0;
+  while(list != NULL)
+  {
+    next = list->next;
+    list->next = first;
+    first = list;
+    list = next;
+    ++count;
+  }
+
+  g_atomic_int_add(&priv->queue_length, -count);
+
+  while(first != NULL)
   {
-    fprintf(priv->log_file, "%s\n", final_text);
+    next = first->next;
+    infinoted_log_output(log, first->prio, first->text);
+    g_free(first->text);
+    g_slice_free(InfinotedLogEntry, first);
+    first = next;
+  }
+
+  do
+  {
+    dropped = g_atomic_int_get(&priv->dropped);
+  } while(!g_atomic_int_compare_and_exchange(&priv->dropped, dropped, 0));
+
+  if(dropped > 0)
+  {
+    text = g_strdup_printf(
+      _("%d log messages were dropped because they could not be written "
+        "fast enough"),
+      dropped
+    );
+
+    final_text = infinoted_log_format(priv->format, LOG_WARNING, 0, text);
+    infinoted_log_output(log, LOG_WARNING, final_text);
+    g_free(final_text);
+    g_free(text);
+  }
+
+  if(priv->log_file != NULL)
     fflush(priv->log_file);
+}
+
+static gpointer
+infinoted_log_writer_thread_func(gpointer data)
+{
+  InfinotedLog* log;
+  InfinotedLogPrivate* priv;
+
+  log = INFINOTED_LOG(data);
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  g_mutex_lock(&priv->writer_mutex);
+  while(!priv->writer_quit)
+  {
+    if(g_atomic_pointer_get(&priv->queue) == NULL)
+    {
+      g_cond_wait(&priv->writer_cond, &priv->writer_mutex);
+    }
+    else
+    {
+      g_mutex_unlock(&priv->writer_mutex);
+
+      g_mutex_lock(&priv->output_mutex);
+      infinoted_log_drain(log);
+      g_mutex_unlock(&priv->output_mutex);
+
+      g_mutex_lock(&priv->writer_mutex);
+    }
   }
 
-  g_free(final_text);
+  g_mutex_unlock(&priv->writer_mutex);
+  return NULL;
+}
+
+static void
+infinoted_log_writer_stop(InfinotedLog* log)
+{
+  InfinotedLogPrivate* priv;
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  g_mutex_lock(&priv->writer_mutex);
+  priv->writer_quit = TRUE;
+  g_cond_signal(&priv->writer_cond);
+  g_mutex_unlock(&priv->writer_mutex);
+
+  g_thread_join(priv->writer);
+  priv->writer = NULL;
+
+  /* Write what has been queued after the writer's last round */
+  infinoted_log_flush(log);
+}
+
+static void
+infinoted_log_push(InfinotedLog* log,
+                   guint prio,
+                   gchar* text)
+{
+  InfinotedLogPrivate* priv;
+  InfinotedLogEntry* entry;
+  InfinotedLogEntry* head;
+
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  if(g_atomic_int_add(&priv->queue_length, 1) >= INFINOTED_LOG_QUEUE_SIZE)
+  {
+    g_atomic_int_add(&priv->queue_length, -1);
+    g_atomic_int_inc(&priv->dropped);
+    g_free(text);
+    return;
+  }
+
+  entry = g_slice_new(InfinotedLogEntry);
+  entry->prio = prio;
+  entry->text = text;
+
+  do
+  {
+    head = g_atomic_pointer_get(&priv->queue);
+    entry->next = head;
+  } while(!g_atomic_pointer_compare_and_exchange(&priv->queue, head, entry));
+
+  /* If there were entries already then the writer has been woken up for
+   * them and will pick up this one as well. */
+  if(head == NULL)
+  {
+    g_mutex_lock(&priv->writer_mutex);
+    g_cond_signal(&priv->writer_cond);
+    g_mutex_unlock(&priv->writer_mutex);
+  }
+}
+
+static void
+infinoted_log_write(InfinotedLog* log,
+                    guint prio,
+                    guint depth,
+                    const gchar* text)
+{
+  InfinotedLogPrivate* priv;
+  gchar* final_text;
+
+  priv = INFINOTED_LOG_PRIVATE(log);
+  final_text = infinoted_log_format(priv->format, prio, depth, text);
+
+  if(priv->writer != NULL)
+  {
+    /* Takes ownership of final_text */
+    infinoted_log_push(log, prio, final_text);
+  }
+  else
+  {
+    g_mutex_lock(&priv->output_mutex);
+    infinoted_log_output(log, prio, final_text);
+    if(priv->log_file != NULL)
+      fflush(priv->log_file);
+    g_mutex_unlock(&priv->output_mutex);
+
+    g_free(final_text);
+  }
 }
 
 static void
@@ -221,6 +561,12 @@ infinoted_log_entry(InfinotedLog* log,
   g_free(text);
 }
 
+static void
+infinoted_log_sampler_free(gpointer data)
+{
+  g_slice_free(InfinotedLogSampler, data);
+}
+
 static void
 infinoted_log_init(InfinotedLog* log)
 {
@@ -231,6 +577,24 @@ infinoted_log_init(InfinotedLog* log)
   priv->log_file = NULL;
   priv->prev_log_handler = NULL;
   priv->recursion_depth = 0;
+  priv->format = INFINOTED_LOG_FORMAT_TEXT;
+
+  priv->queue = NULL;
+  priv->queue_length = 0;
+  priv->dropped = 0;
+
+  priv->writer = NULL;
+  priv->writer_quit = FALSE;
+  g_mutex_init(&priv->writer_mutex);
+  g_cond_init(&priv->writer_cond);
+  g_mutex_init(&priv->output_mutex);
+
+  priv->samplers = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    infinoted_log_sampler_free
+  );
 
   g_rec_mutex_init(&priv->mutex);
 }
@@ -244,9 +608,16 @@ infinoted_log_finalize(GObject* object)
   log = INFINOTED_LOG(object);
   priv = INFINOTED_LOG_PRIVATE(log);
 
-  if(priv->log_file != NULL)
+  if(priv->prev_log_handler != NULL)
     infinoted_log_close(log);
 
+  g_assert(priv->writer == NULL);
+  g_assert(priv->queue == NULL);
+
+  g_hash_table_destroy(priv->samplers);
+  g_mutex_clear(&priv->output_mutex);
+  g_cond_clear(&priv->writer_cond);
+  g_mutex_clear(&priv->writer_mutex);
   g_rec_mutex_clear(&priv->mutex);
 
   G_OBJECT_CLASS(infinoted_log_parent_class)->finalize(object);
@@ -411,6 +782,7 @@ infinoted_log_open(InfinotedLog* log,
     if(priv->log_file == NULL)
     {
       infinoted_util_set_errno_error(error, errno, "Failed to open log file");
+      g_rec_mutex_unlock(&priv->mutex);
       return FALSE;
     }
 
@@ -423,6 +795,14 @@ infinoted_log_open(InfinotedLog* log,
     log
   );
 
+  g_assert(priv->writer == NULL);
+  priv->writer_quit = FALSE;
+  priv->writer = g_thread_new(
+    "infinoted-log",
+    infinoted_log_writer_thread_func,
+    log
+  );
+
   g_rec_mutex_unlock(&priv->mutex);
 
   if(path != NULL)
@@ -450,6 +830,8 @@ infinoted_log_close(InfinotedLog* log)
   g_rec_mutex_lock(&priv->mutex);
   g_assert(priv->prev_log_handler != NULL);
 
+  infinoted_log_writer_stop(log);
+
   if(priv->log_file != NULL)
   {
     g_assert(priv->file_path != NULL);
@@ -470,6 +852,140 @@ infinoted_log_close(InfinotedLog* log)
   g_object_notify(G_OBJECT(log), "file-path");
 }
 
+/**
+ * infinoted_log_set_format:
+ * @log: A #InfinotedLog.
+ * @format: The format in which to write log messages.
+ *
+ * Changes how messages are formatted for subsequent calls to the logging
+ * functions. Messages that were logged before but have not been written
+ * out yet keep their previous format.
+ */
+void
+infinoted_log_set_format(InfinotedLog* log,
+                         InfinotedLogFormat format)
+{
+  InfinotedLogPrivate* priv;
+
+  g_return_if_fail(INFINOTED_IS_LOG(log));
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  g_rec_mutex_lock(&priv->mutex);
+  priv->format = format;
+  g_rec_mutex_unlock(&priv->mutex);
+}
+
+/**
+ * infinoted_log_get_format:
+ * @log: A #InfinotedLog.
+ *
+ * Returns the format in which @log writes messages, as set with
+ * infinoted_log_set_format().
+ *
+ * Returns: The format of log messages.
+ */
+InfinotedLogFormat
+infinoted_log_get_format(InfinotedLog* log)
+{
+  g_return_val_if_fail(INFINOTED_IS_LOG(log), INFINOTED_LOG_FORMAT_TEXT);
+  return INFINOTED_LOG_PRIVATE(log)->format;
+}
+
+/**
+ * infinoted_log_flush:
+ * @log: A #InfinotedLog.
+ *
+ * Writes out all messages that have been logged but not yet written by the
+ * background writer, and waits until they have been written. This can be
+ * called from any thread.
+ */
+void
+infinoted_log_flush(InfinotedLog* log)
+{
+  InfinotedLogPrivate* priv;
+
+  g_return_if_fail(INFINOTED_IS_LOG(log));
+  priv = INFINOTED_LOG_PRIVATE(log);
+
+  g_mutex_lock(&priv->output_mutex);
+  infinoted_log_drain(log);
+  g_mutex_unlock(&priv->output_mutex);
+}
+
+/**
+ * infinoted_log_sample:
+ * @log: A #InfinotedLog.
+ * @event: An identifier for the kind of event to be logged.
+ * @rate: The maximum number of events of this kind to log per second, or
+ * 0 for no limit.
+ * @suppressed: (out) (allow-none): Location to store the number of events
+ * of this kind that were suppressed since the last one that was logged,
+ * or %NULL.
+ *
+ * Decides whether a message for a high-volume event should be logged,
+ * allowing at most @rate events with the same @event identifier per
+ * second. Callers should only log the message if the function returns
+ * %TRUE. If it does, @suppressed is set to the number of events for which
+ * the function returned %FALSE in the meanwhile, so that the message can
+ * mention them.
+ *
+ * Returns: %TRUE if the event should be logged, or %FALSE otherwise.
+ */
+gboolean
+infinoted_log_sample(InfinotedLog* log,
+                     const gchar* event,
+                     guint rate,
+                     guint* suppressed)
+{
+  InfinotedLogPrivate* priv;
+  InfinotedLogSampler* sampler;
+  gint64 now;
+  gboolean result;
+
+  g_return_val_if_fail(INFINOTED_IS_LOG(log), FALSE);
+  g_return_val_if_fail(event != NULL, FALSE);
+
+  priv = INFINOTED_LOG_PRIVATE(log);
+  if(suppressed != NULL) *suppressed = 0;
+  if(rate == 0) return TRUE;
+
+  g_rec_mutex_lock(&priv->mutex);
+
+  sampler = g_hash_table_lookup(priv->samplers, event);
+  if(sampler == NULL)
+  {
+    sampler = g_slice_new(InfinotedLogSampler);
+    sampler->window_start = 0;
+    sampler->count = 0;
+    sampler->suppressed = 0;
+    g_hash_table_insert(priv->samplers, g_strdup(event), sampler);
+  }
+
+  now = g_get_monotonic_time();
+  if(sampler->window_start == 0 ||
+     now - sampler->window_start >= G_USEC_PER_SEC)
+  {
+    sampler->window_start = now;
+    sampler->count = 0;
+  }
+
+  if(sampler->count < rate)
+  {
+    ++sampler->count;
+    if(suppressed != NULL) *suppressed = sampler->suppressed;
+    sampler->suppressed = 0;
+    result = TRUE;
+  }
+  else
+  {
+    ++sampler->suppressed;
+    result = FALSE;
+  }
+
+  g_rec_mutex_unlock(&priv->mutex);
+  return result;
+}
+
 /**
  * infinoted_log_log:
  * @log: A #InfinotedLog.
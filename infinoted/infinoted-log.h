@@ -34,6 +34,26 @@ G_BEGIN_DECLS
 typedef struct _InfinotedLog InfinotedLog;
 typedef struct _InfinotedLogClass InfinotedLogClass;
 
+/**
+ * InfinotedLogFormat:
+ * @INFINOTED_LOG_FORMAT_TEXT: Each message is written as a human-readable
+ * line with a local timestamp and the message priority.
+ * @INFINOTED_LOG_FORMAT_KEY_VALUE: Each message is written as a line of
+ * space-separated key=value pairs, with the fields <literal>time</literal>,
+ * <literal>level</literal>, <literal>msg</literal> and, for continuation
+ * lines, <literal>depth</literal>.
+ * @INFINOTED_LOG_FORMAT_JSON: Each message is written as a JSON object on
+ * its own line, with the same fields as for
+ * %INFINOTED_LOG_FORMAT_KEY_VALUE.
+ *
+ * Specifies how log messages are formatted when they are written out.
+ */
+typedef enum _InfinotedLogFormat {
+  INFINOTED_LOG_FORMAT_TEXT,
+  INFINOTED_LOG_FORMAT_KEY_VALUE,
+  INFINOTED_LOG_FORMAT_JSON
+} InfinotedLogFormat;
+
 /**
  * InfinotedLogClass:
  * @log_message: Default signal handler for the #InfinotedLog::log-message
@@ -77,6 +97,22 @@ infinoted_log_open(InfinotedLog* log,
 void
 infinoted_log_close(InfinotedLog* log);
 
+void
+infinoted_log_set_format(InfinotedLog* log,
+                         InfinotedLogFormat format);
+
+InfinotedLogFormat
+infinoted_log_get_format(InfinotedLog* log);
+
+void
+infinoted_log_flush(InfinotedLog* log);
+
+gboolean
+infinoted_log_sample(InfinotedLog* log,
+                     const gchar* event,
+                     guint rate,
+                     guint* suppressed);
+
 void
 infinoted_log_log(InfinotedLog* log,
                   guint prio,
@@ -21,6 +21,10 @@
 #include <infinoted/infinoted-run.h>
 #include <infinoted/infinoted-startup.h>
 #include <infinoted/infinoted-util.h>
+#ifndef G_OS_WIN32
+# include <infinoted/infinoted-handoff.h>
+# include <infinoted/infinoted-log.h>
+#endif
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-config.h>
@@ -44,6 +48,10 @@ infinoted_main_run(InfinotedStartup* startup,
 {
   InfinotedRun* run;
   InfinotedSignal* sig;
+#ifndef G_OS_WIN32
+  InfinotedHandoff* handoff;
+  GError* local_error;
+#endif
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
   mode_t prev_umask;
@@ -142,6 +150,32 @@ infinoted_main_run(InfinotedStartup* startup,
   }
 #endif
 
+#ifndef G_OS_WIN32
+  handoff = NULL;
+  if(run->startup->options->handoff_socket != NULL)
+  {
+    local_error = NULL;
+
+    handoff = infinoted_handoff_new(
+      run,
+      run->startup->options->handoff_socket,
+      &local_error
+    );
+
+    /* Not fatal, the server only cannot be replaced seamlessly */
+    if(handoff == NULL)
+    {
+      infinoted_log_error(
+        run->startup->log,
+        _("Failed to create handoff socket: %s"),
+        local_error->message
+      );
+
+      g_error_free(local_error);
+    }
+  }
+#endif
+
   sig = infinoted_signal_register(run);
 
   /* Now start the server. It can later be stopped by signals. */
@@ -157,6 +191,13 @@ infinoted_main_run(InfinotedStartup* startup,
 #endif
 
   infinoted_run_free(run);
+
+#ifndef G_OS_WIN32
+  /* Only after all documents have been written by infinoted_run_free() */
+  if(handoff != NULL)
+    infinoted_handoff_free(handoff);
+#endif
+
   return TRUE;
 }
 
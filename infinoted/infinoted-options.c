@@ -48,6 +48,18 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
     N_("If set, write the server log to the given file, "
        "in addition to stdout"),
     N_("LOG-FILE")
+  }, {
+    "log-format",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, log_format),
+    infinoted_parameter_convert_log_format,
+    0,
+    N_("How to format log messages. \"text\" writes human-readable lines, "
+       "\"key-value\" and \"json\" write one structured record per "
+       "message, with the fields time, level and msg, for processing by "
+       "log collectors. [Default=text]"),
+    N_("text|key-value|json")
   }, {
     "key-file",
     INFINOTED_PARAMETER_STRING,
@@ -101,6 +113,35 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
     0,
     N_("The IP address to listen on."),
     N_("ADDRESS"),
+#ifndef G_OS_WIN32
+  }, {
+    "local-socket",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, local_socket),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("Additionally accept connections on a Unix domain socket at the given "
+       "path. Connections on it do not use TLS, regardless of the security "
+       "policy, so access to it should be restricted with the permissions "
+       "of the directory that contains it. This is meant for tools running "
+       "on the same host as the server."),
+    N_("PATH"),
+  }, {
+    "handoff-socket",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, handoff_socket),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("Path of a Unix domain socket used to restart the server without "
+       "refusing connections. When a server is already running with the "
+       "same path, it passes its listening sockets to the newly started "
+       "one, writes all documents to disk and exits. Clients connected to "
+       "it need to reconnect, but no connection is refused while the "
+       "servers are being switched."),
+    N_("PATH"),
+#endif
   }, {
     "security-policy",
     INFINOTED_PARAMETER_STRING,
@@ -117,6 +158,44 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "TLS. It is strongly encouraged to always require TLS. "
        "[Default=require-tls]"),
     N_("no-tls|allow-tls|require-tls")
+  }, {
+    "compression-level",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, compression_level),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Offer zstd or zlib stream compression to clients, from level 1 "
+       "(fastest) to 9 (best compression). 0 disables compression. "
+       "[Default=0]"),
+    N_("LEVEL")
+  }, {
+    "kernel-tls",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedOptions, kernel_tls),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Let the kernel encrypt data sent to clients after the TLS handshake, "
+       "to save CPU time in the server process. This is only supported on "
+       "Linux with the tls kernel module loaded, and only with AES-GCM "
+       "ciphers; otherwise GnuTLS keeps encrypting as usual. "
+       "[Default=false]"),
+    NULL
+  }, {
+    "max-handshakes",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, max_handshakes),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Maximum number of clients performing their TLS and authentication "
+       "handshake at the same time. Further clients wait until a handshake "
+       "has finished, and clients that connected successfully before go "
+       "first, so that many clients connecting at once do not slow down "
+       "the editing of established clients. 0 means no limit. "
+       "[Default=64]"),
+    N_("NUMBER")
   }, {
     "root-directory",
     INFINOTED_PARAMETER_STRING,
@@ -128,6 +207,107 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "documents on the server, and where they are read from after a "
        "server restart. [Default=~/.infinote]"),
     N_("DIRECTORY")
+  }, {
+    "durability",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, durability),
+    infinoted_parameter_convert_durability,
+    0,
+    N_("How documents written to the root directory are flushed to disk. "
+       "\"write\" flushes every document on its own before it replaces "
+       "the previous version. \"interval\" collects the documents saved "
+       "within commit-interval and flushes them together, which is much "
+       "cheaper when many documents are saved. \"system\" leaves it to the "
+       "operating system, so a crash can lose recent changes. "
+       "[Default=write]"),
+    N_("write|interval|system")
+  }, {
+    "commit-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, commit_interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The time, in milliseconds, for which saved documents are collected "
+       "before they are flushed to disk together, if durability is set to "
+       "\"interval\". [Default=1000]"),
+    N_("MILLISECONDS")
+  }, {
+    "max-idle-sessions",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, max_idle_sessions),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of documents without subscribed users to keep in "
+       "memory. Documents are normally saved and unloaded 60 seconds after "
+       "the last user left; when more documents than this are waiting, the "
+       "ones waiting longest are saved and unloaded right away. "
+       "[Default=unlimited]"),
+    N_("NUMBER")
+  }, {
+    "shutdown-deadline",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, shutdown_deadline),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The time, in seconds, for which infinoted writes open documents in "
+       "parallel when shutting down. Documents that have not been written "
+       "when the time is up are written one after the other. If 0, all "
+       "documents are written one after the other. [Default=60]"),
+    N_("SECONDS")
+  }, {
+    "retry-after",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, retry_after),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The time, in seconds, over which clients spread their attempts to "
+       "reconnect when they lose their connection to the server, for "
+       "example because it is restarted. Clients that support it wait at "
+       "least half of this time, and at most all of it. Set it to roughly "
+       "the number of clients divided by the number of connections the "
+       "server can accept per second. 0 leaves it to the clients. "
+       "[Default=0]"),
+    N_("SECONDS")
+  }, {
+    "transformation-cache-limit",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, transformation_cache_limit),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum amount of text, in megabytes, that is kept in the "
+       "caches for transformed requests of all documents together. The "
+       "least recently used entries are dropped from the caches when the "
+       "limit is exceeded. [Default=unlimited]"),
+    N_("MEGABYTES")
+  }, {
+    "worker-threads",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, worker_threads),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of threads used for authentication and other "
+       "background work, such as writing documents to disk. When all of "
+       "them are busy, further work is queued. 0 chooses a built-in "
+       "default. [Default=0]"),
+    N_("NUMBER")
+  }, {
+    "busy-poll",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, busy_poll),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The time, in microseconds, for which the server keeps checking for "
+       "network events before it goes to sleep. This lowers latency at the "
+       "cost of CPU time. [Default=0]"),
+    N_("MICROSECONDS")
   }, {
     "plugins",
     INFINOTED_PARAMETER_STRING_LIST,
@@ -186,6 +366,19 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "connect to the server. This option can be given multiple times to "
        "allow multiple groups."),
     N_("GROUPS")
+  }, {
+    "pam-cache-time",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, pam_cache_time),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of seconds for which a successful PAM login is "
+       "remembered, so that logging in again with the same password does "
+       "not need to go through PAM and the group checks. The remembered "
+       "logins are forgotten when the configuration is reloaded. 0 means "
+       "that every login is checked. [Default=60]"),
+    N_("SECONDS")
 #endif
   }, {
     NULL,
@@ -239,6 +432,18 @@ infinoted_options_validate(InfinotedOptions* options,
   if(options->password != NULL)
     options->password_len = strlen(options->password);
 
+  if(options->compression_level > 9)
+  {
+    g_set_error_literal(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_NUMBER,
+      _("The compression level must be between 0 and 9.")
+    );
+
+    return FALSE;
+  }
+
   if(requires_password &&
      options->security_policy == INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
   {
@@ -965,6 +1170,7 @@ infinoted_options_new(const gchar* const* config_files,
 
   /* Default options */
   options->log_path = NULL;
+  options->log_format = INFINOTED_LOG_FORMAT_TEXT;
   options->key_file = NULL;
   options->certificate_file = NULL;
   options->certificate_chain_file = NULL;
@@ -972,9 +1178,24 @@ infinoted_options_new(const gchar* const* config_files,
   options->create_certificate = FALSE;
   options->port = inf_protocol_get_default_port();
   options->listen_address = NULL;
+#ifndef G_OS_WIN32
+  options->local_socket = NULL;
+  options->handoff_socket = NULL;
+#endif
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
+  options->compression_level = 0;
+  options->kernel_tls = FALSE;
+  options->max_handshakes = 64;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
+  options->durability = INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE;
+  options->commit_interval = 1000;
+  options->max_idle_sessions = G_MAXUINT;
+  options->shutdown_deadline = 60;
+  options->retry_after = 0;
+  options->transformation_cache_limit = G_MAXUINT;
+  options->worker_threads = 0;
+  options->busy_poll = 0;
   options->plugins = g_malloc(2 * sizeof(gchar*));
   options->plugins[0] = g_strdup("note-text");
   options->plugins[1] = NULL;
@@ -984,6 +1205,7 @@ infinoted_options_new(const gchar* const* config_files,
   options->pam_service = NULL;
   options->pam_allowed_users = NULL;
   options->pam_allowed_groups = NULL;
+  options->pam_cache_time = 60;
 #endif /* LIBINFINITY_HAVE_PAM */
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
@@ -1015,6 +1237,10 @@ infinoted_options_free(InfinotedOptions* options)
   g_free(options->root_directory);
   if(options->listen_address != NULL)
     inf_ip_address_free(options->listen_address);
+#ifndef G_OS_WIN32
+  g_free(options->local_socket);
+  g_free(options->handoff_socket);
+#endif
   g_strfreev(options->plugins);
   g_free(options->password);
 #ifdef LIBINFINITY_HAVE_PAM
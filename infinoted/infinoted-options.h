@@ -20,6 +20,9 @@
 #ifndef __INFINOTED_OPTIONS_H__
 #define __INFINOTED_OPTIONS_H__
 
+#include <infinoted/infinoted-log.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-config.h>
 
@@ -32,6 +35,7 @@ struct _InfinotedOptions {
   GKeyFile* config_key_file;
 
   gchar* log_path;
+  InfinotedLogFormat log_format;
 
   gchar* key_file;
   gchar* certificate_file;
@@ -40,8 +44,23 @@ struct _InfinotedOptions {
   gboolean create_certificate;
   guint port;
   InfIpAddress *listen_address;
+#ifndef G_OS_WIN32
+  gchar* local_socket;
+  gchar* handoff_socket;
+#endif
   InfXmppConnectionSecurityPolicy security_policy;
+  guint compression_level;
+  gboolean kernel_tls;
+  guint max_handshakes;
   gchar* root_directory;
+  InfdFilesystemStorageDurability durability;
+  guint commit_interval;
+  guint max_idle_sessions;
+  guint shutdown_deadline;
+  guint retry_after;
+  guint transformation_cache_limit;
+  guint worker_threads;
+  guint busy_poll;
 
   gchar** plugins;
 
@@ -51,6 +70,7 @@ struct _InfinotedOptions {
   gchar* pam_service;
   gchar** pam_allowed_users;
   gchar** pam_allowed_groups;
+  guint pam_cache_time;
 #endif /* LIBINFINITY_HAVE_PAM */
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
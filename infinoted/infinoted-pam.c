@@ -34,6 +34,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Maximum number of logins remembered at a time */
+#define INFINOTED_PAM_CACHE_MAX_ENTRIES 1024
+
+typedef struct _InfinotedPamCacheEntry InfinotedPamCacheEntry;
+struct _InfinotedPamCacheEntry {
+  gchar* digest;
+  gint64 expires;
+};
+
+/* Successful logins, by user name. SASL callbacks are made in the main
+ * thread, so this does not need to be locked. */
+static GHashTable* infinoted_pam_cache = NULL;
+
+/* So that the digests in memory cannot be looked up in a table of common
+ * passwords */
+static guint32 infinoted_pam_cache_salt[4];
+
 /* cannot use g_strdup because that requires its return value to be free'd
  * with g_free(), but pam is not aware of that. */
 
@@ -251,6 +268,187 @@ infinoted_pam_user_is_allowed(InfinotedStartup* startup,
   }
 }
 
+static void
+infinoted_pam_cache_entry_free(gpointer data)
+{
+  InfinotedPamCacheEntry* entry;
+  entry = (InfinotedPamCacheEntry*)data;
+
+  g_free(entry->digest);
+  g_slice_free(InfinotedPamCacheEntry, entry);
+}
+
+static gchar*
+infinoted_pam_cache_digest(const gchar* service,
+                           const gchar* password)
+{
+  GChecksum* checksum;
+  gchar* digest;
+
+  checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+  g_checksum_update(
+    checksum,
+    (const guchar*)infinoted_pam_cache_salt,
+    sizeof(infinoted_pam_cache_salt)
+  );
+
+  /* Including the terminating NUL character separates the two */
+  g_checksum_update(checksum, (const guchar*)service, strlen(service) + 1);
+  g_checksum_update(checksum, (const guchar*)password, strlen(password));
+
+  digest = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  return digest;
+}
+
+/* Makes room for a new entry by removing expired ones, or, if there are none,
+ * the one that would expire first. */
+static void
+infinoted_pam_cache_evict(gint64 now)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  InfinotedPamCacheEntry* entry;
+  gpointer first_key;
+  gint64 first_expires;
+
+  first_key = NULL;
+  first_expires = G_MAXINT64;
+
+  g_hash_table_iter_init(&iter, infinoted_pam_cache);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    entry = (InfinotedPamCacheEntry*)value;
+    if(entry->expires <= now)
+    {
+      g_hash_table_iter_remove(&iter);
+    }
+    else if(entry->expires < first_expires)
+    {
+      first_key = key;
+      first_expires = entry->expires;
+    }
+  }
+
+  if(g_hash_table_size(infinoted_pam_cache) >= INFINOTED_PAM_CACHE_MAX_ENTRIES)
+  {
+    g_assert(first_key != NULL);
+    g_hash_table_remove(infinoted_pam_cache, first_key);
+  }
+}
+
+/**
+ * infinoted_pam_cache_lookup:
+ * @service: The PAM service the login is made for.
+ * @username: The name of the user logging in.
+ * @password: The password given by the user.
+ *
+ * Checks whether @username has logged in with @password successfully a
+ * short time ago, as remembered with infinoted_pam_cache_insert(). In that
+ * case, neither infinoted_pam_authenticate() nor
+ * infinoted_pam_user_is_allowed() need to be called again.
+ *
+ * Returns: %TRUE if the login is known to be valid, or %FALSE otherwise.
+ */
+gboolean
+infinoted_pam_cache_lookup(const gchar* service,
+                           const gchar* username,
+                           const gchar* password)
+{
+  InfinotedPamCacheEntry* entry;
+  gchar* digest;
+  gboolean result;
+
+  if(infinoted_pam_cache == NULL || username == NULL || password == NULL)
+    return FALSE;
+
+  entry = g_hash_table_lookup(infinoted_pam_cache, username);
+  if(entry == NULL)
+    return FALSE;
+
+  if(entry->expires <= g_get_monotonic_time())
+  {
+    g_hash_table_remove(infinoted_pam_cache, username);
+    return FALSE;
+  }
+
+  digest = infinoted_pam_cache_digest(service, password);
+  result = (strcmp(digest, entry->digest) == 0);
+  g_free(digest);
+
+  return result;
+}
+
+/**
+ * infinoted_pam_cache_insert:
+ * @service: The PAM service the login was made for.
+ * @username: The name of the user that logged in.
+ * @password: The password given by the user.
+ * @seconds: The number of seconds for which to remember the login.
+ *
+ * Remembers that @username has logged in with @password successfully, and
+ * was allowed to do so, so that infinoted_pam_cache_lookup() returns %TRUE
+ * for the same login during the next @seconds seconds. Only a salted digest
+ * of @password is kept. If @seconds is 0, this function does nothing.
+ */
+void
+infinoted_pam_cache_insert(const gchar* service,
+                           const gchar* username,
+                           const gchar* password,
+                           guint seconds)
+{
+  InfinotedPamCacheEntry* entry;
+  gint64 now;
+  guint i;
+
+  if(seconds == 0 || username == NULL || password == NULL)
+    return;
+
+  now = g_get_monotonic_time();
+
+  if(infinoted_pam_cache == NULL)
+  {
+    for(i = 0; i < G_N_ELEMENTS(infinoted_pam_cache_salt); ++i)
+      infinoted_pam_cache_salt[i] = g_random_int();
+
+    infinoted_pam_cache = g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      g_free,
+      infinoted_pam_cache_entry_free
+    );
+  }
+
+  if(g_hash_table_size(infinoted_pam_cache) >= INFINOTED_PAM_CACHE_MAX_ENTRIES)
+    infinoted_pam_cache_evict(now);
+
+  entry = g_slice_new(InfinotedPamCacheEntry);
+  entry->digest = infinoted_pam_cache_digest(service, password);
+  entry->expires = now + (gint64)seconds * G_USEC_PER_SEC;
+
+  g_hash_table_insert(infinoted_pam_cache, g_strdup(username), entry);
+}
+
+/**
+ * infinoted_pam_cache_clear:
+ *
+ * Forgets all logins remembered with infinoted_pam_cache_insert(). This
+ * needs to be called when the configuration changes, since users might no
+ * longer be allowed to log in.
+ */
+void
+infinoted_pam_cache_clear(void)
+{
+  if(infinoted_pam_cache != NULL)
+  {
+    g_hash_table_destroy(infinoted_pam_cache);
+    infinoted_pam_cache = NULL;
+  }
+}
+
 gboolean
 infinoted_pam_authenticate(const char* service,
                            const char* username,
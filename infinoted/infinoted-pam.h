@@ -43,6 +43,20 @@ infinoted_pam_authenticate(const char* service,
                            const char* username,
                            const char* password);
 
+gboolean
+infinoted_pam_cache_lookup(const gchar* service,
+                           const gchar* username,
+                           const gchar* password);
+
+void
+infinoted_pam_cache_insert(const gchar* service,
+                           const gchar* username,
+                           const gchar* password,
+                           guint seconds);
+
+void
+infinoted_pam_cache_clear(void);
+
 G_END_DECLS
 
 #endif /* LIBINFINITY_HAVE_PAM */
@@ -705,6 +705,119 @@ infinoted_parameter_convert_security_policy(gpointer out,
   return TRUE;
 }
 
+/**
+ * infinoted_parameter_convert_log_format:
+ * @out: (type InfinotedLogFormat*) (out): The pointer to the output
+ * #InfinotedLogFormat.
+ * @in: (type gchar**) (in): The pointer to the input string location.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Converts the string that @in points to to an #InfinotedLogFormat value,
+ * by requiring that it is either "text", "key-value" or "json". If the
+ * string is none of these three the function fails and @error is set.
+ *
+ * This is a #InfinotedParameterConvertFunc function that can be used for
+ * fields of type #InfinotedLogFormat.
+ *
+ * Returns: %TRUE on success, or %FALSE otherwise.
+ */
+gboolean
+infinoted_parameter_convert_log_format(gpointer out,
+                                       gpointer in,
+                                       GError** error)
+{
+  gchar** in_str;
+  InfinotedLogFormat* out_val;
+
+  in_str = (gchar**)in;
+  out_val = (InfinotedLogFormat*)out;
+
+  if(strcmp(*in_str, "text") == 0)
+  {
+    *out_val = INFINOTED_LOG_FORMAT_TEXT;
+  }
+  else if(strcmp(*in_str, "key-value") == 0)
+  {
+    *out_val = INFINOTED_LOG_FORMAT_KEY_VALUE;
+  }
+  else if(strcmp(*in_str, "json") == 0)
+  {
+    *out_val = INFINOTED_LOG_FORMAT_JSON;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_parameter_error_quark(),
+      INFINOTED_PARAMETER_ERROR_INVALID_LOG_FORMAT,
+      _("\"%s\" is not a valid log format. Allowed values are "
+        "\"text\", \"key-value\" or \"json\""),
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * infinoted_parameter_convert_durability:
+ * @out: (type InfdFilesystemStorageDurability*) (out): The pointer to the
+ * output #InfdFilesystemStorageDurability.
+ * @in: (type gchar**) (in): The pointer to the input string location.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Converts the string that @in points to to an
+ * #InfdFilesystemStorageDurability value, by requiring that it is either
+ * "write", "interval" or "system". If the string is none of these three
+ * the function fails and @error is set.
+ *
+ * This is a #InfinotedParameterConvertFunc function that can be used for
+ * fields of type #InfdFilesystemStorageDurability.
+ *
+ * Returns: %TRUE on success, or %FALSE otherwise.
+ */
+gboolean
+infinoted_parameter_convert_durability(gpointer out,
+                                       gpointer in,
+                                       GError** error)
+{
+  gchar** in_str;
+  InfdFilesystemStorageDurability* out_val;
+
+  in_str = (gchar**)in;
+  out_val = (InfdFilesystemStorageDurability*)out;
+
+  if(strcmp(*in_str, "write") == 0)
+  {
+    *out_val = INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE;
+  }
+  else if(strcmp(*in_str, "interval") == 0)
+  {
+    *out_val = INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL;
+  }
+  else if(strcmp(*in_str, "system") == 0)
+  {
+    *out_val = INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_parameter_error_quark(),
+      INFINOTED_PARAMETER_ERROR_INVALID_DURABILITY,
+      _("\"%s\" is not a valid durability level. Allowed values are "
+        "\"write\", \"interval\" or \"system\""),
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * infinoted_parameter_convert_flags:
  * @out: (type gint*) (out): The pointer to the output flags (a #gint).
@@ -20,6 +20,9 @@
 #ifndef __INFINOTED_PARAMETER_H__
 #define __INFINOTED_PARAMETER_H__
 
+#include <infinoted/infinoted-log.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-config.h>
 
@@ -110,8 +113,10 @@ struct _InfinotedParameterTypedValue {
  * infinoted_parameter_convert_port(),
  * infinoted_parameter_convert_nonnegative(),
  * infinoted_parameter_convert_positive(),
- * infinoted_parameter_convert_security_policy() and
- * infinoted_parameter_convert_ip_address().
+ * infinoted_parameter_convert_security_policy(),
+ * infinoted_parameter_convert_ip_address(),
+ * infinoted_parameter_convert_log_format() and
+ * infinoted_parameter_convert_durability().
  *
  * Returns: %TRUE on success or %FALSE if an error occurred.
  */
@@ -163,6 +168,12 @@ struct _InfinotedParameterInfo {
  * &quot;no-tls&quot;, &quot;allow-tls&quot;, and &quot;require-tls&quot;.
  * @INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS: The value given as a
  * parameter is not a valid IP address.
+ * @INFINOTED_PARAMETER_ERROR_INVALID_LOG_FORMAT: A log format given as a
+ * parameter is not valid. The only allowed values are &quot;text&quot;,
+ * &quot;key-value&quot; and &quot;json&quot;.
+ * @INFINOTED_PARAMETER_ERROR_INVALID_DURABILITY: A durability level given as
+ * a parameter is not valid. The only allowed values are &quot;write&quot;,
+ * &quot;interval&quot; and &quot;system&quot;.
  *
  * Specifies the possible error conditions for errors in the
  * <literal>INFINOTED_PARAMETER_ERROR</literal> domain. These typically
@@ -173,7 +184,9 @@ typedef enum _InfinotedParameterError {
   INFINOTED_PARAMETER_ERROR_INVALID_NUMBER,
   INFINOTED_PARAMETER_ERROR_INVALID_FLAG,
   INFINOTED_PARAMETER_ERROR_INVALID_SECURITY_POLICY,
-  INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS
+  INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS,
+  INFINOTED_PARAMETER_ERROR_INVALID_LOG_FORMAT,
+  INFINOTED_PARAMETER_ERROR_INVALID_DURABILITY
 } InfinotedParameterError;
 
 GQuark
@@ -249,6 +262,16 @@ infinoted_parameter_convert_ip_address(gpointer out,
                                        gpointer in,
                                        GError** error);
 
+gboolean
+infinoted_parameter_convert_log_format(gpointer out,
+                                       gpointer in,
+                                       GError** error);
+
+gboolean
+infinoted_parameter_convert_durability(gpointer out,
+                                       gpointer in,
+                                       GError** error);
+
 G_END_DECLS
 
 #endif /* __INFINOTED_PARAMETER_H__ */
@@ -46,6 +46,12 @@ struct _InfinotedPluginManagerPrivate {
 
   GSList* plugins;
 
+  /* Subsets of plugins which need to be told about connections and
+   * sessions, respectively, so that the others are not even looked at when
+   * one is added or removed. */
+  GSList* connection_plugins;
+  GSList* session_plugins;
+
   GHashTable* connections; /* plugin + connection -> PluginConnectionInfo */
   GHashTable* sessions; /* plugin + session -> PluginSessionInfo */
 };
@@ -54,18 +60,12 @@ typedef struct _InfinotedPluginInstance InfinotedPluginInstance;
 struct _InfinotedPluginInstance {
   GModule* module;
   const InfinotedPlugin* plugin;
-};
-
-typedef struct _InfinotedPluginManagerForeachConnectionData
-  InfinotedPluginManagerForeachConnectionData;
-struct _InfinotedPluginManagerForeachConnectionData {
-  InfinotedPluginManager* manager;
-  InfinotedPluginInstance* instance;
+  /* Resolved from plugin->session_type once the type is registered */
+  GType session_type;
 };
 
 typedef void(*InfinotedPluginManagerWalkDirectoryFunc)(
   InfinotedPluginManager*,
-  InfinotedPluginInstance*,
   const InfBrowserIter*,
   InfSessionProxy*);
 
@@ -111,6 +111,7 @@ infinoted_plugin_manager_add_connection(InfinotedPluginManager* manager,
   hash = infinoted_plugin_manager_hash(plugin_info, connection);
   g_assert(g_hash_table_lookup(priv->connections, hash) == NULL);
 
+  connection_info = NULL;
   if(instance->plugin->connection_info_size > 0)
   {
     connection_info = g_slice_alloc(instance->plugin->connection_info_size);
@@ -166,33 +167,29 @@ infinoted_plugin_manager_remove_connection(InfinotedPluginManager* manager,
 
 static gboolean
 infinoted_plugin_manager_check_session_type(InfinotedPluginInstance* instance,
-                                            InfSessionProxy* proxy)
+                                            InfSession* session)
 {
-  GType session_type;
-  InfSession* session;
-  gboolean result;
-
   if(instance->plugin->session_type == NULL)
     return TRUE;
 
   /* If the type was not registered yet the passed session cannot have the
    * correct type. */
-  session_type = g_type_from_name(instance->plugin->session_type);
-  if(session_type == 0)
-    return FALSE;
-
-  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
-  result = g_type_is_a(G_TYPE_FROM_INSTANCE(session), session_type);
-  g_object_unref(session);
+  if(instance->session_type == 0)
+  {
+    instance->session_type = g_type_from_name(instance->plugin->session_type);
+    if(instance->session_type == 0)
+      return FALSE;
+  }
 
-  return result;
+  return g_type_is_a(G_TYPE_FROM_INSTANCE(session), instance->session_type);
 }
 
 static void
 infinoted_plugin_manager_add_session(InfinotedPluginManager* manager,
                                      InfinotedPluginInstance* instance,
                                      const InfBrowserIter* iter,
-                                     InfSessionProxy* proxy)
+                                     InfSessionProxy* proxy,
+                                     InfSession* session)
 {
   InfinotedPluginManagerPrivate* priv;
   gpointer plugin_info;
@@ -201,12 +198,13 @@ infinoted_plugin_manager_add_session(InfinotedPluginManager* manager,
 
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
 
-  if(infinoted_plugin_manager_check_session_type(instance, proxy))
+  if(infinoted_plugin_manager_check_session_type(instance, session))
   {
     plugin_info = instance+1;
     hash = infinoted_plugin_manager_hash(plugin_info, proxy);
     g_assert(g_hash_table_lookup(priv->sessions, hash) == NULL);
 
+    session_info = NULL;
     if(instance->plugin->session_info_size > 0)
     {
       session_info = g_slice_alloc(instance->plugin->session_info_size);
@@ -229,7 +227,8 @@ static void
 infinoted_plugin_manager_remove_session(InfinotedPluginManager* manager,
                                         InfinotedPluginInstance* instance,
                                         const InfBrowserIter* iter,
-                                        InfSessionProxy* proxy)
+                                        InfSessionProxy* proxy,
+                                        InfSession* session)
 {
   InfinotedPluginManagerPrivate* priv;
   gpointer plugin_info;
@@ -238,7 +237,7 @@ infinoted_plugin_manager_remove_session(InfinotedPluginManager* manager,
 
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
 
-  if(infinoted_plugin_manager_check_session_type(instance, proxy))
+  if(infinoted_plugin_manager_check_session_type(instance, session))
   {
     plugin_info = instance+1;
     hash = infinoted_plugin_manager_hash(plugin_info, proxy);
@@ -267,15 +266,73 @@ infinoted_plugin_manager_remove_session(InfinotedPluginManager* manager,
   }
 }
 
+/* Tells all plugins interested in sessions about a new session */
+static void
+infinoted_plugin_manager_add_session_all(InfinotedPluginManager* manager,
+                                         const InfBrowserIter* iter,
+                                         InfSessionProxy* proxy)
+{
+  InfinotedPluginManagerPrivate* priv;
+  InfSession* session;
+  GSList* item;
+
+  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
+  if(priv->session_plugins == NULL)
+    return;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  for(item = priv->session_plugins; item != NULL; item = item->next)
+  {
+    infinoted_plugin_manager_add_session(
+      manager,
+      (InfinotedPluginInstance*)item->data,
+      iter,
+      proxy,
+      session
+    );
+  }
+
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_manager_remove_session_all(InfinotedPluginManager* manager,
+                                            const InfBrowserIter* iter,
+                                            InfSessionProxy* proxy)
+{
+  InfinotedPluginManagerPrivate* priv;
+  InfSession* session;
+  GSList* item;
+
+  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
+  if(priv->session_plugins == NULL)
+    return;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  for(item = priv->session_plugins; item != NULL; item = item->next)
+  {
+    infinoted_plugin_manager_remove_session(
+      manager,
+      (InfinotedPluginInstance*)item->data,
+      iter,
+      proxy,
+      session
+    );
+  }
+
+  g_object_unref(session);
+}
+
 static void
 infinoted_plugin_manager_walk_directory(
   InfinotedPluginManager* manager,
   const InfBrowserIter* iter,
-  InfinotedPluginInstance* instance,
   InfinotedPluginManagerWalkDirectoryFunc func)
 {
-  /* This function walks the whole directory tree recursively and
-   * registers running sessions with the given plugin instance. */
+  /* This function walks the whole directory tree recursively and calls
+   * func for all running sessions. */
   InfinotedPluginManagerPrivate* priv;
   InfBrowser* browser;
   InfBrowserIter child;
@@ -292,12 +349,7 @@ infinoted_plugin_manager_walk_directory(
       {
         do
         {
-          infinoted_plugin_manager_walk_directory(
-            manager,
-            &child,
-            instance,
-            func
-          );
+          infinoted_plugin_manager_walk_directory(manager, &child, func);
         } while(inf_browser_get_next(browser, &child));
       }
     }
@@ -307,39 +359,83 @@ infinoted_plugin_manager_walk_directory(
     proxy = inf_browser_get_session(browser, iter);
     if(proxy != NULL)
     {
-      func(manager, instance, iter, proxy);
+      func(manager, iter, proxy);
     }
   }
 }
 
 static void
-infinoted_plugin_manager_load_plugin_foreach_connection_func(
-  InfXmlConnection* connection,
-  gpointer user_data)
+infinoted_plugin_manager_add_connection_all_func(InfXmlConnection* connection,
+                                                 gpointer user_data)
 {
-  InfinotedPluginManagerForeachConnectionData* data;
-  data = (InfinotedPluginManagerForeachConnectionData*)user_data;
+  InfinotedPluginManager* manager;
+  InfinotedPluginManagerPrivate* priv;
+  GSList* item;
 
-  infinoted_plugin_manager_add_connection(
-    data->manager,
-    data->instance,
-    connection
-  );
+  manager = (InfinotedPluginManager*)user_data;
+  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
+
+  for(item = priv->connection_plugins; item != NULL; item = item->next)
+  {
+    infinoted_plugin_manager_add_connection(
+      manager,
+      (InfinotedPluginInstance*)item->data,
+      connection
+    );
+  }
 }
 
 static void
-infinoted_plugin_manager_unload_plugin_foreach_connection_func(
+infinoted_plugin_manager_remove_connection_all_func(
   InfXmlConnection* connection,
   gpointer user_data)
 {
-  InfinotedPluginManagerForeachConnectionData* data;
-  data = (InfinotedPluginManagerForeachConnectionData*)user_data;
+  InfinotedPluginManager* manager;
+  InfinotedPluginManagerPrivate* priv;
+  GSList* item;
 
-  infinoted_plugin_manager_remove_connection(
-    data->manager,
-    data->instance,
-    connection
-  );
+  manager = (InfinotedPluginManager*)user_data;
+  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
+
+  for(item = priv->connection_plugins; item != NULL; item = item->next)
+  {
+    infinoted_plugin_manager_remove_connection(
+      manager,
+      (InfinotedPluginInstance*)item->data,
+      connection
+    );
+  }
+}
+
+/* Registers all existing connections and sessions with all loaded plugins.
+ * This is done once after all plugins have been loaded, so that the
+ * directory tree only needs to be walked once. */
+static void
+infinoted_plugin_manager_register_all(InfinotedPluginManager* manager)
+{
+  InfinotedPluginManagerPrivate* priv;
+  InfBrowserIter root;
+
+  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
+
+  if(priv->connection_plugins != NULL)
+  {
+    infd_directory_foreach_connection(
+      priv->directory,
+      infinoted_plugin_manager_add_connection_all_func,
+      manager
+    );
+  }
+
+  if(priv->session_plugins != NULL)
+  {
+    inf_browser_get_root(INF_BROWSER(priv->directory), &root);
+    infinoted_plugin_manager_walk_directory(
+      manager,
+      &root,
+      infinoted_plugin_manager_add_session_all
+    );
+  }
 }
 
 static gboolean
@@ -360,9 +456,6 @@ infinoted_plugin_manager_load_plugin(InfinotedPluginManager* manager,
   gboolean result;
   GError* local_error;
 
-  InfBrowserIter root;
-  InfinotedPluginManagerForeachConnectionData data;
-
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
 
   plugin_basename = g_strdup_printf(
@@ -406,6 +499,7 @@ infinoted_plugin_manager_load_plugin(InfinotedPluginManager* manager,
   instance = g_malloc(sizeof(InfinotedPluginInstance) + plugin->info_size);
   instance->module = module;
   instance->plugin = plugin;
+  instance->session_type = 0;
 
   /* Call on_info_initialize, allowing the plugin to set default values */
   if(plugin->on_info_initialize != NULL)
@@ -467,24 +561,6 @@ infinoted_plugin_manager_load_plugin(InfinotedPluginManager* manager,
     }
   }
 
-  /* Register initial connections with plugin */
-  data.manager = manager;
-  data.instance = instance;
-  infd_directory_foreach_connection(
-    priv->directory,
-    infinoted_plugin_manager_load_plugin_foreach_connection_func,
-    &data
-  );
-
-  /* Register initial sessions with plugin */
-  inf_browser_get_root(INF_BROWSER(priv->directory), &root);
-  infinoted_plugin_manager_walk_directory(
-    manager,
-    &root,
-    instance,
-    infinoted_plugin_manager_add_session
-  );
-
   infinoted_log_info(
     priv->log,
     _("Loaded plugin \"%s\" from \"%s\""),
@@ -494,37 +570,37 @@ infinoted_plugin_manager_load_plugin(InfinotedPluginManager* manager,
 
   priv->plugins = g_slist_prepend(priv->plugins, instance);
 
+  if(plugin->connection_info_size > 0 ||
+     plugin->on_connection_added != NULL ||
+     plugin->on_connection_removed != NULL)
+  {
+    priv->connection_plugins =
+      g_slist_prepend(priv->connection_plugins, instance);
+  }
+
+  if(plugin->session_info_size > 0 ||
+     plugin->on_session_added != NULL ||
+     plugin->on_session_removed != NULL)
+  {
+    priv->session_plugins = g_slist_prepend(priv->session_plugins, instance);
+  }
+
   return TRUE;
 }
 
+/* Deinitializes a plugin. Connections and sessions must have been
+ * unregistered from it before. */
 static void
 infinoted_plugin_manager_unload_plugin(InfinotedPluginManager* manager,
                                        InfinotedPluginInstance* instance)
 {
   InfinotedPluginManagerPrivate* priv;
-  InfinotedPluginManagerForeachConnectionData data;
-  InfBrowserIter root;
-
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
-  priv->plugins = g_slist_remove(priv->plugins, instance);
-
-  /* Unregister all sessions with the plugin */
-  inf_browser_get_root(INF_BROWSER(priv->directory), &root);
-  infinoted_plugin_manager_walk_directory(
-    manager,
-    &root,
-    instance,
-    infinoted_plugin_manager_remove_session
-  );
 
-  /* Unregister all connections with the plugin */
-  data.manager = manager;
-  data.instance = instance;
-  infd_directory_foreach_connection(
-    priv->directory,
-    infinoted_plugin_manager_unload_plugin_foreach_connection_func,
-    &data
-  );
+  priv->plugins = g_slist_remove(priv->plugins, instance);
+  priv->connection_plugins =
+    g_slist_remove(priv->connection_plugins, instance);
+  priv->session_plugins = g_slist_remove(priv->session_plugins, instance);
 
   if(instance->plugin->on_deinitialize != NULL)
     instance->plugin->on_deinitialize(instance+1);
@@ -541,47 +617,56 @@ infinoted_plugin_manager_unload_plugin(InfinotedPluginManager* manager,
 }
 
 static void
-infinoted_plugin_manager_connection_added_cb(InfdDirectory* directory,
-                                             InfXmlConnection* connection,
-                                             gpointer user_data)
+infinoted_plugin_manager_unload_all(InfinotedPluginManager* manager)
 {
-  InfinotedPluginManager* manager;
   InfinotedPluginManagerPrivate* priv;
-  GSList* item;
+  InfBrowserIter root;
 
-  manager = (InfinotedPluginManager*)user_data;
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
 
-  for(item = priv->plugins; item != NULL; item = item->next)
+  /* Unregister all sessions and connections with all plugins */
+  if(priv->session_plugins != NULL)
   {
-    infinoted_plugin_manager_add_connection(
+    inf_browser_get_root(INF_BROWSER(priv->directory), &root);
+    infinoted_plugin_manager_walk_directory(
       manager,
-      (InfinotedPluginInstance*)item->data,
-      connection
+      &root,
+      infinoted_plugin_manager_remove_session_all
+    );
+  }
+
+  if(priv->connection_plugins != NULL)
+  {
+    infd_directory_foreach_connection(
+      priv->directory,
+      infinoted_plugin_manager_remove_connection_all_func,
+      manager
+    );
+  }
+
+  while(priv->plugins != NULL)
+  {
+    infinoted_plugin_manager_unload_plugin(
+      manager,
+      (InfinotedPluginInstance*)priv->plugins->data
     );
   }
 }
 
+static void
+infinoted_plugin_manager_connection_added_cb(InfdDirectory* directory,
+                                             InfXmlConnection* connection,
+                                             gpointer user_data)
+{
+  infinoted_plugin_manager_add_connection_all_func(connection, user_data);
+}
+
 static void
 infinoted_plugin_manager_connection_removed_cb(InfdDirectory* directory,
                                                InfXmlConnection* connection,
                                                gpointer user_data)
 {
-  InfinotedPluginManager* manager;
-  InfinotedPluginManagerPrivate* priv;
-  GSList* item;
-
-  manager = (InfinotedPluginManager*)user_data;
-  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
-
-  for(item = priv->plugins; item != NULL; item = item->next)
-  {
-    infinoted_plugin_manager_remove_connection(
-      manager,
-      (InfinotedPluginInstance*)item->data,
-      connection
-    );
-  }
+  infinoted_plugin_manager_remove_connection_all_func(connection, user_data);
 }
 
 static void
@@ -591,22 +676,11 @@ infinoted_plugin_manager_subscribe_session_cb(InfBrowser* browser,
                                               InfRequest* request,
                                               gpointer user_data)
 {
-  InfinotedPluginManager* manager;
-  InfinotedPluginManagerPrivate* priv;
-  GSList* item;
-
-  manager = (InfinotedPluginManager*)user_data;
-  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
-
-  for(item = priv->plugins; item != NULL; item = item->next)
-  {
-    infinoted_plugin_manager_add_session(
-      manager,
-      (InfinotedPluginInstance*)item->data,
-      iter,
-      proxy
-    );
-  }
+  infinoted_plugin_manager_add_session_all(
+    INFINOTED_PLUGIN_MANAGER(user_data),
+    iter,
+    proxy
+  );
 }
 
 static void
@@ -616,22 +690,11 @@ infinoted_plugin_manager_unsubscribe_session_cb(InfBrowser* browser,
                                                 InfRequest* request,
                                                 gpointer user_data)
 {
-  InfinotedPluginManager* manager;
-  InfinotedPluginManagerPrivate* priv;
-  GSList* item;
-
-  manager = (InfinotedPluginManager*)user_data;
-  priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
-
-  for(item = priv->plugins; item != NULL; item = item->next)
-  {
-    infinoted_plugin_manager_remove_session(
-      manager,
-      (InfinotedPluginInstance*)item->data,
-      iter,
-      proxy
-    );
-  }
+  infinoted_plugin_manager_remove_session_all(
+    INFINOTED_PLUGIN_MANAGER(user_data),
+    iter,
+    proxy
+  );
 }
 
 static void
@@ -722,6 +785,8 @@ infinoted_plugin_manager_init(InfinotedPluginManager* manager)
   priv->credentials = NULL;
   priv->path = NULL;
   priv->plugins = NULL;
+  priv->connection_plugins = NULL;
+  priv->session_plugins = NULL;
   priv->connections = g_hash_table_new(NULL, NULL);
   priv->sessions = g_hash_table_new(NULL, NULL);
 }
@@ -735,13 +800,7 @@ infinoted_plugin_manager_dispose(GObject* object)
   manager = INFINOTED_PLUGIN_MANAGER(object);
   priv = INFINOTED_PLUGIN_MANAGER_PRIVATE(manager);
 
-  while(priv->plugins != NULL)
-  {
-    infinoted_plugin_manager_unload_plugin(
-      manager,
-      (InfinotedPluginInstance*)priv->plugins->data
-    );
-  }
+  infinoted_plugin_manager_unload_all(manager);
 
   if(priv->directory != NULL)
     infinoted_plugin_manager_set_directory(manager, NULL);
@@ -987,13 +1046,7 @@ infinoted_plugin_manager_load(InfinotedPluginManager* manager,
 
   /* Unload existing plugins */
   g_free(priv->path);
-  while(priv->plugins != NULL)
-  {
-    infinoted_plugin_manager_unload_plugin(
-      manager,
-      (InfinotedPluginInstance*)priv->plugins->data
-    );
-  }
+  infinoted_plugin_manager_unload_all(manager);
 
   /* Load new plugins */
   priv->path = g_strdup(plugin_path);
@@ -1012,6 +1065,8 @@ infinoted_plugin_manager_load(InfinotedPluginManager* manager,
 
       if(result == FALSE)
       {
+        /* None of the plugins loaded so far has been told about
+         * connections or sessions yet. */
         while(priv->plugins != NULL)
         {
           infinoted_plugin_manager_unload_plugin(
@@ -1023,6 +1078,8 @@ infinoted_plugin_manager_load(InfinotedPluginManager* manager,
         return FALSE;
       }
     }
+
+    infinoted_plugin_manager_register_all(manager);
   }
 
   return TRUE;
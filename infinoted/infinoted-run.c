@@ -20,6 +20,9 @@
 #include <infinoted/infinoted-run.h>
 #include <infinoted/infinoted-dh-params.h>
 #include <infinoted/infinoted-util.h>
+#ifndef G_OS_WIN32
+# include <infinoted/infinoted-handoff.h>
+#endif
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-filesystem-account-storage.h>
@@ -27,6 +30,8 @@
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 #include <libinfinity/common/inf-xmpp-manager.h>
+#include <libinfinity/adopted/inf-adopted-request-log.h>
+#include <libinfinity/common/inf-async-operation.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-config.h>
@@ -38,6 +43,14 @@
 static const guint8 INFINOTED_RUN_IPV6_ANY_ADDR[16] =
   { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+/* Stop reading from a client once this much data is waiting to be sent to
+ * it, either in the connection's send buffer or in the communication
+ * registry's queues, and resume once it has received most of it. Nothing is
+ * lost while reading is paused, the client's requests are only processed
+ * later. */
+static const guint INFINOTED_RUN_SEND_HIGH_WATERMARK = 4 * 1024 * 1024;
+static const guint INFINOTED_RUN_SEND_LOW_WATERMARK = 1024 * 1024;
+
 static gboolean
 infinoted_run_load_directory(InfinotedRun* run,
                              InfinotedStartup* startup,
@@ -55,6 +68,12 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   storage = infd_filesystem_storage_new(startup->options->root_directory);
 
+  infd_filesystem_storage_set_durability(
+    storage,
+    startup->options->durability,
+    startup->options->commit_interval
+  );
+
   communication_manager = inf_communication_manager_new();
 
   run->io = inf_standalone_io_new();
@@ -67,6 +86,32 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   infd_directory_enable_chat(run->directory, TRUE);
 
+  g_object_set(
+    G_OBJECT(run->directory),
+    "max-idle-sessions", startup->options->max_idle_sessions,
+    "retry-after", startup->options->retry_after * 1000,
+    NULL
+  );
+
+  if(startup->options->transformation_cache_limit == G_MAXUINT)
+  {
+    inf_adopted_request_log_set_global_cache_max_bytes(G_MAXSIZE);
+  }
+  else
+  {
+    inf_adopted_request_log_set_global_cache_max_bytes(
+      (gsize)startup->options->transformation_cache_limit << 20
+    );
+  }
+
+  inf_async_operation_set_max_threads(startup->options->worker_threads);
+
+  g_object_set(
+    G_OBJECT(run->io),
+    "busy-poll", startup->options->busy_poll,
+    NULL
+  );
+
   g_object_unref(communication_manager);
 
   /* Load server plugins via plugin manager */
@@ -152,10 +197,24 @@ infinoted_run_load_directory(InfinotedRun* run,
   return TRUE;
 }
 
+/* Binds tcp, using socket instead of a new one if it is valid. This takes
+ * ownership of socket. */
+static gboolean
+infinoted_run_bind(InfdTcpServer* tcp,
+                   InfNativeSocket socket,
+                   GError** error)
+{
+  if(socket != INVALID_SOCKET)
+    return infd_tcp_server_bind_native(tcp, socket, error);
+  else
+    return infd_tcp_server_bind(tcp, error);
+}
+
 static InfdXmppServer*
 infinoted_run_create_server(InfinotedRun* run,
                             InfinotedStartup* startup,
                             InfIpAddress* address,
+                            InfNativeSocket socket,
                             GError** error)
 {
   InfdTcpServer* tcp;
@@ -173,7 +232,13 @@ infinoted_run_create_server(InfinotedRun* run,
 
   infd_tcp_server_set_keepalive(tcp, &startup->keepalive);
 
-  if(!infd_tcp_server_bind(tcp, error))
+  infd_tcp_server_set_watermarks(
+    tcp,
+    INFINOTED_RUN_SEND_HIGH_WATERMARK,
+    INFINOTED_RUN_SEND_LOW_WATERMARK
+  );
+
+  if(!infinoted_run_bind(tcp, socket, error))
   {
     g_object_unref(tcp);
     return NULL;
@@ -187,6 +252,14 @@ infinoted_run_create_server(InfinotedRun* run,
     startup->sasl_context ? "PLAIN" : NULL
   );
 
+  g_object_set(
+    G_OBJECT(xmpp),
+    "compression-level", startup->options->compression_level,
+    "kernel-tls", startup->options->kernel_tls,
+    "max-handshakes", startup->options->max_handshakes,
+    NULL
+  );
+
   infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -201,6 +274,180 @@ infinoted_run_create_server(InfinotedRun* run,
   return xmpp;
 }
 
+#ifndef G_OS_WIN32
+static InfdXmppServer*
+infinoted_run_create_local_server(InfinotedRun* run,
+                                  InfinotedStartup* startup,
+                                  InfNativeSocket socket,
+                                  GError** error)
+{
+  InfdTcpServer* tcp;
+  InfdXmppServer* xmpp;
+
+  tcp = INFD_TCP_SERVER(
+    g_object_new(
+      INFD_TYPE_TCP_SERVER,
+      "io", INF_IO(run->io),
+      "local-path", startup->options->local_socket,
+      NULL
+    )
+  );
+
+  if(!infinoted_run_bind(tcp, socket, error))
+  {
+    g_object_unref(tcp);
+    return NULL;
+  }
+
+  /* The peer is on the same host, so TLS would only cost time. Who may
+   * connect is controlled by the file system permissions of the socket. */
+  xmpp = infd_xmpp_server_new(
+    tcp,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    startup->sasl_context,
+    startup->sasl_context ? "PLAIN" : NULL
+  );
+
+  infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
+
+  g_object_unref(tcp);
+  return xmpp;
+}
+#endif
+
+typedef struct _InfinotedRunShutdown InfinotedRunShutdown;
+struct _InfinotedRunShutdown {
+  InfinotedRun* run;
+  gboolean done;
+};
+
+static void
+infinoted_run_shutdown_flush_func(InfdDirectory* directory,
+                                  const gchar* path,
+                                  const GError* error,
+                                  guint n_written,
+                                  guint n_total,
+                                  gpointer user_data)
+{
+  InfinotedRunShutdown* state;
+  state = (InfinotedRunShutdown*)user_data;
+
+  if(error != NULL)
+  {
+    infinoted_log_error(
+      state->run->startup->log,
+      _("Failed to save document \"%s\": %s"),
+      path,
+      error->message
+    );
+  }
+
+  if(n_written == n_total)
+  {
+    state->done = TRUE;
+    if(inf_standalone_io_loop_running(state->run->io))
+      inf_standalone_io_loop_quit(state->run->io);
+  }
+}
+
+static void
+infinoted_run_shutdown_timeout_func(gpointer user_data)
+{
+  InfinotedRunShutdown* state;
+  state = (InfinotedRunShutdown*)user_data;
+
+  inf_standalone_io_loop_quit(state->run->io);
+}
+
+/* Writes all documents in parallel before the directory is disposed, which
+ * would write them one after the other. Waits at most shutdown-deadline
+ * seconds; sessions not written by then are saved on directory disposal. */
+static void
+infinoted_run_shutdown_flush(InfinotedRun* run)
+{
+  InfinotedRunShutdown state;
+  InfIoTimeout* timeout;
+  guint n_total;
+
+  if(run->startup->options->shutdown_deadline == 0)
+    return;
+
+  state.run = run;
+  state.done = FALSE;
+
+  n_total = infd_directory_flush_sessions(
+    run->directory,
+    TRUE,
+    infinoted_run_shutdown_flush_func,
+    &state
+  );
+
+  if(n_total == 0 || state.done == TRUE)
+    return;
+
+  infinoted_log_info(
+    run->startup->log,
+    _("Saving open documents (%u in total)..."),
+    n_total
+  );
+
+  timeout = inf_io_add_timeout(
+    INF_IO(run->io),
+    run->startup->options->shutdown_deadline * 1000,
+    infinoted_run_shutdown_timeout_func,
+    &state,
+    NULL
+  );
+
+  inf_standalone_io_loop(run->io);
+
+  if(state.done == TRUE)
+  {
+    inf_io_remove_timeout(INF_IO(run->io), timeout);
+  }
+  else
+  {
+    infinoted_log_error(
+      run->startup->log,
+      _("Not all documents could be saved within %u seconds; saving the "
+        "remaining ones one after the other"),
+      run->startup->options->shutdown_deadline
+    );
+  }
+}
+
+static void
+infinoted_run_flush_func(InfdDirectory* directory,
+                         const gchar* path,
+                         const GError* error,
+                         guint n_written,
+                         guint n_total,
+                         gpointer user_data)
+{
+  InfinotedRun* run;
+  run = (InfinotedRun*)user_data;
+
+  if(error != NULL)
+  {
+    infinoted_log_error(
+      run->startup->log,
+      _("Failed to save document \"%s\": %s"),
+      path,
+      error->message
+    );
+  }
+
+  if(n_written == n_total)
+  {
+    infinoted_log_info(
+      run->startup->log,
+      _("Saved open documents (%u in total)"),
+      n_total
+    );
+  }
+}
+
 /**
  * infinoted_run_new:
  * @startup: Startup parameters for the Infinote Server.
@@ -212,6 +459,10 @@ infinoted_run_create_server(InfinotedRun* run,
  *
  * Use infinoted_run_start() to start the server.
  *
+ * If the handoff-socket option is set and a server is running with the same
+ * handoff socket, then its listening sockets are taken over. This blocks
+ * until that server has exited.
+ *
  * Returns: A new #InfinotedRun, free with infinoted_run_free(). Or %NULL,
  * on error.
  */
@@ -226,13 +477,54 @@ infinoted_run_new(InfinotedStartup* startup,
 
   InfinotedRun* run;
   GError* local_error;
+  InfNativeSocket socket4;
+  InfNativeSocket socket6;
+  InfNativeSocket socket_local;
+#ifndef G_OS_WIN32
+  gboolean result;
+#endif
+
+  socket4 = INVALID_SOCKET;
+  socket6 = INVALID_SOCKET;
+  socket_local = INVALID_SOCKET;
+
+#ifndef G_OS_WIN32
+  /* Do this before loading anything, since the running server only writes
+   * its documents to disk when it exits. */
+  if(startup->options->handoff_socket != NULL)
+  {
+    result = infinoted_handoff_receive(
+      startup->options->handoff_socket,
+      &socket4,
+      &socket6,
+      &socket_local,
+      error
+    );
+
+    if(result == FALSE)
+      return NULL;
+
+    if(socket4 != INVALID_SOCKET || socket6 != INVALID_SOCKET ||
+       socket_local != INVALID_SOCKET)
+    {
+      infinoted_log_info(
+        startup->log,
+        _("Took over the listening sockets of the running server")
+      );
+    }
+  }
+#endif
 
   run = g_slice_new(InfinotedRun);
   run->startup = startup;
   run->dh_params = NULL;
+  run->xmpp_local = NULL;
 
   if(infinoted_run_load_directory(run, startup, error) == FALSE)
   {
+    if(socket4 != INVALID_SOCKET) closesocket(socket4);
+    if(socket6 != INVALID_SOCKET) closesocket(socket6);
+    if(socket_local != INVALID_SOCKET) closesocket(socket_local);
     g_slice_free(InfinotedRun, run);
     return NULL;
   }
@@ -263,12 +555,28 @@ infinoted_run_new(InfinotedStartup* startup,
     switch(inf_ip_address_get_family(address))
     {
     case INF_IP_ADDRESS_IPV4:
-      run->xmpp4 = infinoted_run_create_server(run, startup, address, &local_error);
+      run->xmpp4 = infinoted_run_create_server(
+        run,
+        startup,
+        address,
+        socket4,
+        &local_error
+      );
+
       run->xmpp6 = NULL;
+      socket4 = INVALID_SOCKET;
       break;
     case INF_IP_ADDRESS_IPV6:
       run->xmpp4 = NULL;
-      run->xmpp6 = infinoted_run_create_server(run, startup, address, &local_error);
+      run->xmpp6 = infinoted_run_create_server(
+        run,
+        startup,
+        address,
+        socket6,
+        &local_error
+      );
+
+      socket6 = INVALID_SOCKET;
       break;
     }
   }
@@ -276,10 +584,30 @@ infinoted_run_new(InfinotedStartup* startup,
   {
     address = inf_ip_address_new_raw6(INFINOTED_RUN_IPV6_ANY_ADDR);
 
-    run->xmpp6 = infinoted_run_create_server(run, startup, address, NULL);
-    run->xmpp4 = infinoted_run_create_server(run, startup, NULL, &local_error);
+    run->xmpp6 = infinoted_run_create_server(
+      run,
+      startup,
+      address,
+      socket6,
+      NULL
+    );
+
+    run->xmpp4 = infinoted_run_create_server(
+      run,
+      startup,
+      NULL,
+      socket4,
+      &local_error
+    );
+
+    socket4 = INVALID_SOCKET;
+    socket6 = INVALID_SOCKET;
   }
 
+  /* Not used with the current listen address */
+  if(socket4 != INVALID_SOCKET) closesocket(socket4);
+  if(socket6 != INVALID_SOCKET) closesocket(socket6);
+
   if(run->xmpp4 == NULL)
   {
     /* Ignore if we have an IPv6 server running */
@@ -304,6 +632,31 @@ infinoted_run_new(InfinotedStartup* startup,
 
   inf_ip_address_free(address);
 
+#ifndef G_OS_WIN32
+  if(run != NULL && startup->options->local_socket != NULL)
+  {
+    run->xmpp_local = infinoted_run_create_local_server(
+      run,
+      startup,
+      socket_local,
+      error
+    );
+
+    socket_local = INVALID_SOCKET;
+
+    if(run->xmpp_local == NULL)
+    {
+      /* The caller keeps ownership of startup if we fail */
+      run->startup = NULL;
+      infinoted_run_free(run);
+      run = NULL;
+    }
+  }
+#endif
+
+  /* The local socket is not used anymore, or we failed before */
+  if(socket_local != INVALID_SOCKET) closesocket(socket_local);
+
   return run;
 }
 
@@ -339,6 +692,18 @@ infinoted_run_free(InfinotedRun* run)
     g_object_unref(run->xmpp4);
   }
 
+  if(run->xmpp_local != NULL)
+  {
+    g_object_get(G_OBJECT(run->xmpp_local), "status", &status, NULL);
+    infd_server_pool_remove_server(
+      run->pool,
+      INFD_XML_SERVER(run->xmpp_local)
+    );
+    if(status != INFD_XML_SERVER_CLOSED)
+      infd_xml_server_close(INFD_XML_SERVER(run->xmpp_local));
+    g_object_unref(run->xmpp_local);
+  }
+
 #ifdef LIBINFINITY_HAVE_AVAHI
   g_object_unref(run->avahi);
 #endif
@@ -452,6 +817,41 @@ infinoted_run_start(InfinotedRun* run)
     g_object_unref(tcp);
   }
 
+  if(run->xmpp_local != NULL)
+  {
+    g_object_get(G_OBJECT(run->xmpp_local), "tcp-server", &tcp, NULL);
+    if(infd_tcp_server_open(tcp, &error) == TRUE)
+    {
+      infinoted_log_info(
+        run->startup->log,
+        _("Local server running on %s"),
+        run->startup->options->local_socket
+      );
+    }
+    else
+    {
+      infinoted_log_error(
+        run->startup->log,
+        _("Failed to start local server: %s"),
+        error->message
+      );
+
+      g_error_free(error);
+      error = NULL;
+
+      infd_server_pool_remove_server(
+        run->pool,
+        INFD_XML_SERVER(run->xmpp_local)
+      );
+
+      g_object_unref(run->xmpp_local);
+      run->xmpp_local = NULL;
+      infd_tcp_server_close(tcp);
+    }
+
+    g_object_unref(tcp);
+  }
+
   if(run->xmpp4 == NULL && run->xmpp6 == NULL)
   {
     g_assert(error4 != NULL || error6 != NULL);
@@ -485,6 +885,8 @@ infinoted_run_start(InfinotedRun* run)
       run->startup->log,
       _("Infinoted shutting down...")
     );
+
+    infinoted_run_shutdown_flush(run);
   }
 }
 
@@ -500,4 +902,24 @@ infinoted_run_stop(InfinotedRun* run)
   inf_standalone_io_loop_quit(run->io);
 }
 
+/**
+ * infinoted_run_flush:
+ * @run: A #InfinotedRun.
+ *
+ * Writes all open documents to disk in parallel, while the server keeps
+ * running. Errors and the completion are logged.
+ *
+ * Returns: The number of documents being written.
+ */
+guint
+infinoted_run_flush(InfinotedRun* run)
+{
+  return infd_directory_flush_sessions(
+    run->directory,
+    FALSE,
+    infinoted_run_flush_func,
+    run
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -46,6 +46,8 @@ struct _InfinotedRun {
 
   InfdXmppServer* xmpp4;
   InfdXmppServer* xmpp6;
+  /* Server on the Unix domain socket given by the local-socket option */
+  InfdXmppServer* xmpp_local;
   gnutls_dh_params_t dh_params;
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -66,6 +68,9 @@ infinoted_run_start(InfinotedRun* run);
 void
 infinoted_run_stop(InfinotedRun* run);
 
+guint
+infinoted_run_flush(InfinotedRun* run);
+
 G_END_DECLS
 
 #endif /* __INFINOTED_RUN_H__ */
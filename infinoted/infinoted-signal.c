@@ -21,6 +21,8 @@
 #include <infinoted/infinoted-config-reload.h>
 #include <infinoted/infinoted-util.h>
 #include <infinoted/infinoted-log.h>
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/adopted/inf-adopted-request-log.h>
 #include <libinfinity/inf-i18n.h>
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
@@ -33,6 +35,128 @@
 #endif
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
+/* Logs usage, prefixed by what it refers to */
+static void
+infinoted_signal_log_memory_usage(InfinotedLog* log,
+                                  const gchar* what,
+                                  const InfdSessionProxyMemoryUsage* usage)
+{
+  gchar* buffer_size;
+  gchar* request_log_size;
+  gchar* cache_size;
+  gchar* held_back_size;
+
+  buffer_size = g_format_size(usage->buffer_bytes);
+  request_log_size = g_format_size(usage->request_log_bytes);
+  cache_size = g_format_size(usage->transformation_cache_bytes);
+  held_back_size = g_format_size(usage->held_back_bytes);
+
+  infinoted_log_info(
+    log,
+    /* <What>: <Size> content, <Size> requests, ... */
+    _("%s: %s content, %s requests, %s cached transformations, "
+      "%s held back messages, %u synchronizations"),
+    what,
+    buffer_size,
+    request_log_size,
+    cache_size,
+    held_back_size,
+    usage->synchronizations
+  );
+
+  g_free(buffer_size);
+  g_free(request_log_size);
+  g_free(cache_size);
+  g_free(held_back_size);
+}
+
+/* Logs the memory usage of all sessions below iter, and adds it to total */
+static void
+infinoted_signal_report_memory_usage(InfBrowser* browser,
+                                     InfBrowserIter* iter,
+                                     InfinotedLog* log,
+                                     InfdSessionProxyMemoryUsage* total)
+{
+  InfBrowserIter child;
+  InfSessionProxy* proxy;
+  InfdSessionProxyMemoryUsage usage;
+  gchar* path;
+
+  if(inf_browser_is_subdirectory(browser, iter))
+  {
+    if(!inf_browser_get_explored(browser, iter))
+      return;
+
+    child = *iter;
+    if(inf_browser_get_child(browser, &child))
+    {
+      do
+      {
+        infinoted_signal_report_memory_usage(browser, &child, log, total);
+      } while(inf_browser_get_next(browser, &child));
+    }
+  }
+  else
+  {
+    proxy = inf_browser_get_session(browser, iter);
+    if(proxy == NULL)
+      return;
+
+    infd_session_proxy_get_memory_usage(INFD_SESSION_PROXY(proxy), &usage);
+
+    path = inf_browser_get_path(browser, iter);
+    infinoted_signal_log_memory_usage(log, path, &usage);
+    g_free(path);
+
+    total->buffer_bytes += usage.buffer_bytes;
+    total->request_log_bytes += usage.request_log_bytes;
+    total->transformation_cache_bytes += usage.transformation_cache_bytes;
+    total->held_back_bytes += usage.held_back_bytes;
+    total->synchronizations += usage.synchronizations;
+  }
+}
+
+static void
+infinoted_signal_report_memory(InfinotedRun* run)
+{
+  InfBrowserIter iter;
+  InfdSessionProxyMemoryUsage total;
+  gchar* cache_size;
+
+  total.buffer_bytes = 0;
+  total.request_log_bytes = 0;
+  total.transformation_cache_bytes = 0;
+  total.held_back_bytes = 0;
+  total.synchronizations = 0;
+
+  inf_browser_get_root(INF_BROWSER(run->directory), &iter);
+
+  infinoted_signal_report_memory_usage(
+    INF_BROWSER(run->directory),
+    &iter,
+    run->startup->log,
+    &total
+  );
+
+  infinoted_signal_log_memory_usage(
+    run->startup->log,
+    _("All open sessions"),
+    &total
+  );
+
+  /* This also includes caches of sessions that are not open anymore but
+   * still referenced from somewhere, so it can differ from the total. */
+  cache_size = g_format_size(inf_adopted_request_log_get_global_cache_bytes());
+
+  infinoted_log_info(
+    run->startup->log,
+    _("Cached transformations in all request logs: %s"),
+    cache_size
+  );
+
+  g_free(cache_size);
+}
+
 static void
 infinoted_signal_sig_func(InfNativeSocket* fd,
                           InfIoEvent event,
@@ -86,6 +210,12 @@ infinoted_signal_sig_func(InfNativeSocket* fd,
           _("Configuration reloaded")
         );
       }
+
+      infinoted_run_flush(sig->run);
+    }
+    else if(occured == SIGUSR1)
+    {
+      infinoted_signal_report_memory(sig->run);
     }
   }
 }
@@ -180,7 +310,9 @@ BOOL WINAPI infinoted_signal_console_handler(DWORD fdwCtrlType)
  *
  * Registers signal handlers for SIGINT and SIGTERM that terminate the given
  * infinote server. When you don't need the signal handlers anymore, you
- * must unregister them again using infinoted_signal_unregister().
+ * must unregister them again using infinoted_signal_unregister(). If
+ * libinfinity is compiled with libdaemon support, SIGHUP reloads the
+ * configuration and SIGUSR1 logs the memory usage of all open sessions.
  *
  * Returns: A #InfinotedSignal to unregister the signal handlers again later.
  */
@@ -195,7 +327,7 @@ infinoted_signal_register(InfinotedRun* run)
 
   /* TODO: Should we report when this fails? Should ideally happen before
    * actually forking then - are signal connections kept in fork()'s child? */
-  if(daemon_signal_init(SIGINT, SIGTERM, SIGQUIT, SIGHUP, 0) == 0)
+  if(daemon_signal_init(SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGUSR1, 0) == 0)
   {
     sig->signal_fd = daemon_signal_fd();
 
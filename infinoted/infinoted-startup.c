@@ -296,6 +296,7 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
 
 #ifdef LIBINFINITY_HAVE_PAM
   const gchar* pam_service;
+  gboolean cached;
   GError* error;
 #endif
   gchar* remote_id;
@@ -314,7 +315,10 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
     if(pam_service != NULL)
     {
       error = NULL;
-      if(!infinoted_pam_authenticate(pam_service, username, password))
+      cached = infinoted_pam_cache_lookup(pam_service, username, password);
+
+      if(!cached &&
+         !infinoted_pam_authenticate(pam_service, username, password))
       {
         infinoted_log_warning(
           startup->log,
@@ -334,7 +338,8 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
           GSASL_AUTHENTICATION_ERROR
         );
       }
-      else if(!infinoted_pam_user_is_allowed(startup, username, &error))
+      else if(!cached &&
+              !infinoted_pam_user_is_allowed(startup, username, &error))
       {
         infinoted_log_warning(
           startup->log,
@@ -356,6 +361,16 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
       }
       else
       {
+        if(!cached)
+        {
+          infinoted_pam_cache_insert(
+            pam_service,
+            username,
+            password,
+            startup->options->pam_cache_time
+          );
+        }
+
         infinoted_log_info(
           startup->log,
           _("User %s logged in from %s via PAM"),
@@ -439,6 +454,7 @@ infinoted_startup_load(InfinotedStartup* startup,
     return FALSE;
 
   startup->log = infinoted_log_new();
+  infinoted_log_set_format(startup->log, startup->options->log_format);
   if(!infinoted_log_open(startup->log, startup->options->log_path, error))
     return FALSE;
 
@@ -23,6 +23,7 @@
 
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
 
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
@@ -34,6 +35,14 @@ struct _InfinotedPluginAutosave {
   InfinotedPluginManager* manager;
   guint interval;
   gchar* hook;
+  gboolean binary;
+  guint max_saves;
+
+  /* Sessions with unsaved changes, and the timeout that saves the ones
+   * that are due, with the time at which it elapses. */
+  GList* scheduled;
+  InfIoTimeout* tick;
+  gint64 tick_due;
 };
 
 typedef struct _InfinotedPluginAutosaveSessionInfo
@@ -42,47 +51,126 @@ struct _InfinotedPluginAutosaveSessionInfo {
   InfinotedPluginAutosave* plugin;
   InfBrowserIter iter;
   InfSessionProxy* proxy;
-  InfIoTimeout* timeout;
+  gboolean saving;
+
+  /* Link in the plugin's scheduled list if the session is to be saved, and
+   * the time, in microseconds of the monotonic clock, at which it is due */
+  GList* link;
+  gint64 due;
+
+  /* Number of characters changed since the last save was started, and by
+   * the save that is running */
+  guint changes;
+  guint saving_changes;
 };
 
+/* By default, at most this many documents are saved per second */
+#define INFINOTED_PLUGIN_AUTOSAVE_DEFAULT_MAX_SAVES 10
+
 static void
-infinoted_plugin_autosave_timeout_cb(gpointer user_data);
+infinoted_plugin_autosave_tick_cb(gpointer user_data);
 
+/* Makes sure that the tick runs at the time due, or earlier, but not
+ * earlier than one second from now. */
 static void
-infinoted_plugin_autosave_start(InfinotedPluginAutosaveSessionInfo* info)
+infinoted_plugin_autosave_start_tick(InfinotedPluginAutosave* plugin,
+                                     gint64 due)
 {
   InfIo* io;
+  gint64 now;
 
-  io = infd_directory_get_io(
-    infinoted_plugin_manager_get_directory(info->plugin->manager)
-  );
+  io = infinoted_plugin_manager_get_io(plugin->manager);
+  now = g_get_monotonic_time();
+  due = MAX(due, now + G_USEC_PER_SEC);
 
-  g_assert(info->timeout == NULL);
+  if(plugin->tick != NULL)
+  {
+    if(plugin->tick_due <= due)
+      return;
 
-  info->timeout = inf_io_add_timeout(
+    inf_io_remove_timeout(io, plugin->tick);
+  }
+
+  plugin->tick_due = due;
+  plugin->tick = inf_io_add_timeout(
     io,
-    info->plugin->interval * 1000,
-    infinoted_plugin_autosave_timeout_cb,
-    info,
+    (due - now) / 1000,
+    infinoted_plugin_autosave_tick_cb,
+    plugin,
     NULL
   );
 }
 
+/* Schedules the session to be saved after the autosave interval. A random
+ * delay of up to a quarter of the interval is added on top, so that
+ * sessions that were modified at the same time are not all saved at the
+ * same time again. */
+static void
+infinoted_plugin_autosave_start(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfinotedPluginAutosave* plugin;
+  gint64 interval;
+
+  plugin = info->plugin;
+  g_assert(info->link == NULL);
+
+  interval = (gint64)plugin->interval * G_USEC_PER_SEC;
+  info->due = g_get_monotonic_time() + interval +
+    (gint64)(g_random_double() * (interval / 4));
+
+  plugin->scheduled = g_list_prepend(plugin->scheduled, info);
+  info->link = plugin->scheduled;
+
+  infinoted_plugin_autosave_start_tick(plugin, info->due);
+}
+
 static void
 infinoted_plugin_autosave_stop(InfinotedPluginAutosaveSessionInfo* info)
 {
-  InfIo* io;
+  InfinotedPluginAutosave* plugin;
 
-  io = infd_directory_get_io(
-    infinoted_plugin_manager_get_directory(info->plugin->manager)
-  );
+  plugin = info->plugin;
+  g_assert(info->link != NULL);
+
+  plugin->scheduled = g_list_delete_link(plugin->scheduled, info->link);
+  info->link = NULL;
 
-  g_assert(info->timeout != NULL);
+  if(plugin->scheduled == NULL && plugin->tick != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->tick
+    );
 
-  inf_io_remove_timeout(io, info->timeout);
-  info->timeout = NULL;
+    plugin->tick = NULL;
+  }
 }
 
+static void
+infinoted_plugin_autosave_buffer_text_inserted_cb(InfTextBuffer* buffer,
+                                                  guint pos,
+                                                  InfTextChunk* chunk,
+                                                  InfUser* user,
+                                                  gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+
+  info->changes += inf_text_chunk_get_length(chunk);
+}
+
+static void
+infinoted_plugin_autosave_buffer_text_erased_cb(InfTextBuffer* buffer,
+                                                guint pos,
+                                                InfTextChunk* chunk,
+                                                InfUser* user,
+                                                gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+
+  info->changes += inf_text_chunk_get_length(chunk);
+}
 
 static void
 infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
@@ -99,12 +187,12 @@ infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
 
   if(inf_buffer_get_modified(buffer) == TRUE)
   {
-    if(info->timeout == NULL)
+    if(info->link == NULL)
       infinoted_plugin_autosave_start(info);
   }
   else
   {
-    if(info->timeout != NULL)
+    if(info->link != NULL)
       infinoted_plugin_autosave_stop(info);
   }
 
@@ -112,26 +200,175 @@ infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
 }
 
 static void
-infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+infinoted_plugin_autosave_run_hook(InfinotedPluginAutosaveSessionInfo* info)
 {
   InfdDirectory* directory;
-  InfBrowserIter* iter;
   GError* error;
   gchar* path;
-  InfSession* session;
-  InfBuffer* buffer;
   gchar* root_directory;
   gchar* argv[4];
 
   directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
-  iter = &info->iter;
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
   error = NULL;
 
-  if(info->timeout != NULL)
+  g_object_get(
+    G_OBJECT(infd_directory_get_storage(directory)),
+    "root-directory",
+    &root_directory,
+    NULL
+  );
+
+  argv[0] = info->plugin->hook;
+  argv[1] = root_directory;
+  argv[2] = path;
+  argv[3] = NULL;
+
+  if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                    NULL, NULL, NULL, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("Could not execute autosave hook: \"%s\""),
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_free(path);
+  g_free(root_directory);
+}
+
+static void
+infinoted_plugin_autosave_failed(InfinotedPluginAutosaveSessionInfo* info,
+                                 const GError* error)
+{
+  InfdDirectory* directory;
+  gchar* path;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(info->plugin->manager),
+    _("Failed to auto-save session \"%s\": %s\n\n"
+      "Will retry in %u seconds."),
+    path,
+    error->message,
+    info->plugin->interval
+  );
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_autosave_write_cb(InfdFilesystemStorage* storage,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  InfSession* session;
+  InfBuffer* buffer;
+
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+  info->saving = FALSE;
+
+  if(error != NULL)
+  {
+    infinoted_plugin_autosave_failed(info, error);
+    info->changes += info->saving_changes;
+
+    /* The modified flag has been unset when the write was started, so set
+     * it again, which also schedules the next attempt. */
+    g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+    buffer = inf_session_get_buffer(session);
+    inf_buffer_set_modified(buffer, TRUE);
+    g_object_unref(session);
+
+    if(info->link == NULL)
+      infinoted_plugin_autosave_start(info);
+  }
+  else if(info->plugin->hook != NULL)
   {
-    inf_io_remove_timeout(infd_directory_get_io(directory), info->timeout);
-    info->timeout = NULL;
+    infinoted_plugin_autosave_run_hook(info);
   }
+}
+
+/* Writes text sessions in a worker thread, so that a slow disk does not
+ * block the server while a session is being saved. */
+static gboolean
+infinoted_plugin_autosave_save_async(InfinotedPluginAutosaveSessionInfo* info,
+                                     InfTextSession* session,
+                                     GError** error)
+{
+  InfdDirectory* directory;
+  InfBuffer* buffer;
+  gchar* path;
+  gboolean result;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+  buffer = inf_session_get_buffer(INF_SESSION(session));
+
+  if(info->plugin->binary)
+  {
+    result = inf_text_filesystem_format_write_binary_async(
+      INFD_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)),
+      infd_directory_get_io(directory),
+      path,
+      inf_session_get_user_table(INF_SESSION(session)),
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_autosave_write_cb,
+      info,
+      error
+    );
+  }
+  else
+  {
+    result = inf_text_filesystem_format_write_async(
+      INFD_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)),
+      infd_directory_get_io(directory),
+      path,
+      inf_session_get_user_table(INF_SESSION(session)),
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_autosave_write_cb,
+      info,
+      error
+    );
+  }
+
+  g_free(path);
+
+  if(result == FALSE)
+    return FALSE;
+
+  /* Changes made from now on need another save */
+  info->saving = TRUE;
+  info->saving_changes = info->changes;
+  info->changes = 0;
+  inf_buffer_set_modified(buffer, FALSE);
+  return TRUE;
+}
+
+static void
+infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  InfBrowserIter* iter;
+  GError* error;
+  InfSession* session;
+  InfBuffer* buffer;
+  gboolean result;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  iter = &info->iter;
+  error = NULL;
+
+  g_assert(info->saving == FALSE);
+
+  if(info->link != NULL)
+    infinoted_plugin_autosave_stop(info);
 
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
@@ -142,20 +379,27 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
     info
   );
 
-  if(infd_directory_iter_save_session(directory, iter, &error) == FALSE)
+  if(INF_TEXT_IS_SESSION(session) &&
+     INFD_IS_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)))
   {
-    path = inf_browser_get_path(INF_BROWSER(directory), iter);
-
-    infinoted_log_warning(
-      infinoted_plugin_manager_get_log(info->plugin->manager),
-      _("Failed to auto-save session \"%s\": %s\n\n"
-        "Will retry in %u seconds."),
-      path,
-      error->message,
-      info->plugin->interval
+    result = infinoted_plugin_autosave_save_async(
+      info,
+      INF_TEXT_SESSION(session),
+      &error
     );
 
-    g_free(path);
+    if(result == FALSE)
+    {
+      infinoted_plugin_autosave_failed(info, error);
+      g_error_free(error);
+      error = NULL;
+
+      infinoted_plugin_autosave_start(info);
+    }
+  }
+  else if(infd_directory_iter_save_session(directory, iter, &error) == FALSE)
+  {
+    infinoted_plugin_autosave_failed(info, error);
     g_error_free(error);
     error = NULL;
 
@@ -166,39 +410,10 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
     /* TODO: Remove this as soon as directory itself unsets modified flag
      * on session_write */
     inf_buffer_set_modified(INF_BUFFER(buffer), FALSE);
+    info->changes = 0;
 
     if(info->plugin->hook != NULL)
-    {
-      path = inf_browser_get_path(INF_BROWSER(directory), iter);
-
-      g_object_get(
-        G_OBJECT(infd_directory_get_storage(directory)),
-        "root-directory",
-        &root_directory,
-        NULL
-      );
-
-      argv[0] = info->plugin->hook;
-      argv[1] = root_directory;
-      argv[2] = path;
-      argv[3] = NULL;
-
-      if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
-                        NULL, NULL, NULL, &error))
-      {
-        infinoted_log_warning(
-          infinoted_plugin_manager_get_log(info->plugin->manager),
-          _("Could not execute autosave hook: \"%s\""),
-          error->message
-        );
-
-        g_error_free(error);
-        error = NULL;
-      }
-
-      g_free(path);
-      g_free(root_directory);
-    }
+      infinoted_plugin_autosave_run_hook(info);
   }
   
   inf_signal_handlers_unblock_by_func(
@@ -210,15 +425,73 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
   g_object_unref(session);
 }
 
+/* Sorts the sessions with the most unsaved changes first, and the ones
+ * that have been due for the longest time first among equal ones. */
+static gint
+infinoted_plugin_autosave_compare_due(gconstpointer a,
+                                      gconstpointer b)
+{
+  const InfinotedPluginAutosaveSessionInfo* info_a;
+  const InfinotedPluginAutosaveSessionInfo* info_b;
+
+  info_a = *(const InfinotedPluginAutosaveSessionInfo* const*)a;
+  info_b = *(const InfinotedPluginAutosaveSessionInfo* const*)b;
+
+  if(info_a->changes != info_b->changes)
+    return info_a->changes > info_b->changes ? -1 : 1;
+  if(info_a->due != info_b->due)
+    return info_a->due < info_b->due ? -1 : 1;
+  return 0;
+}
+
+/* Saves up to max-saves of the sessions that are due. The others stay
+ * scheduled and are saved one second later or after, so that after
+ * a busy period the saves are spread out instead of making the server
+ * wait for the disk all at once. */
 static void
-infinoted_plugin_autosave_timeout_cb(gpointer user_data)
+infinoted_plugin_autosave_tick_cb(gpointer user_data)
 {
+  InfinotedPluginAutosave* plugin;
   InfinotedPluginAutosaveSessionInfo* info;
+  GPtrArray* due;
+  GList* item;
+  gint64 now;
+  gint64 next;
+  guint i;
 
-  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
-  info->timeout = NULL;
+  plugin = (InfinotedPluginAutosave*)user_data;
+  plugin->tick = NULL;
+
+  now = g_get_monotonic_time();
+  due = g_ptr_array_new();
+
+  for(item = plugin->scheduled; item != NULL; item = item->next)
+  {
+    info = (InfinotedPluginAutosaveSessionInfo*)item->data;
 
-  infinoted_plugin_autosave_save(info);
+    /* If the previous save is still running, wait for it to finish */
+    if(info->due <= now && info->saving == FALSE)
+      g_ptr_array_add(due, info);
+  }
+
+  g_ptr_array_sort(due, infinoted_plugin_autosave_compare_due);
+
+  for(i = 0; i < due->len && i < plugin->max_saves; ++i)
+    infinoted_plugin_autosave_save(g_ptr_array_index(due, i));
+
+  g_ptr_array_free(due, TRUE);
+
+  if(plugin->scheduled != NULL)
+  {
+    next = G_MAXINT64;
+    for(item = plugin->scheduled; item != NULL; item = item->next)
+    {
+      info = (InfinotedPluginAutosaveSessionInfo*)item->data;
+      next = MIN(next, info->due);
+    }
+
+    infinoted_plugin_autosave_start_tick(plugin, next);
+  }
 }
 
 static void
@@ -230,6 +503,11 @@ infinoted_plugin_autosave_info_initialize(gpointer plugin_info)
   plugin->manager = NULL;
   plugin->interval = 0;
   plugin->hook = NULL;
+  plugin->binary = FALSE;
+  plugin->max_saves = INFINOTED_PLUGIN_AUTOSAVE_DEFAULT_MAX_SAVES;
+  plugin->scheduled = NULL;
+  plugin->tick = NULL;
+  plugin->tick_due = 0;
 }
 
 static gboolean
@@ -251,6 +529,10 @@ infinoted_plugin_autosave_deinitialize(gpointer plugin_info)
   InfinotedPluginAutosave* plugin;
   plugin = (InfinotedPluginAutosave*)plugin_info;
 
+  /* All sessions have been removed, and unscheduled with them */
+  g_assert(plugin->scheduled == NULL);
+  g_assert(plugin->tick == NULL);
+
   g_free(plugin->hook);
 }
 
@@ -268,7 +550,11 @@ infinoted_plugin_autosave_session_added(const InfBrowserIter* iter,
   info->plugin = (InfinotedPluginAutosave*)plugin_info;
   info->iter = *iter;
   info->proxy = proxy;
-  info->timeout = NULL;
+  info->saving = FALSE;
+  info->link = NULL;
+  info->due = 0;
+  info->changes = 0;
+  info->saving_changes = 0;
   g_object_ref(proxy);
 
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
@@ -281,6 +567,16 @@ infinoted_plugin_autosave_session_added(const InfBrowserIter* iter,
     info
   );
 
+  if(INF_TEXT_IS_BUFFER(buffer))
+  {
+    inf_text_buffer_add_observer(
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_autosave_buffer_text_inserted_cb,
+      infinoted_plugin_autosave_buffer_text_erased_cb,
+      info
+    );
+  }
+
   if(inf_buffer_get_modified(buffer) == TRUE)
     infinoted_plugin_autosave_start(info);
 
@@ -301,9 +597,23 @@ infinoted_plugin_autosave_session_removed(const InfBrowserIter* iter,
 
   /* Cancel autosave timeout even if session is modified. If the directory
    * removed the session, then it has already saved it anyway. */
-  if(info->timeout != NULL)
+  if(info->link != NULL)
     infinoted_plugin_autosave_stop(info);
 
+  /* A pending write is still completed, but we do not get notified */
+  if(info->saving)
+  {
+    infd_filesystem_storage_cancel_write(
+      INFD_FILESYSTEM_STORAGE(
+        infd_directory_get_storage(
+          infinoted_plugin_manager_get_directory(info->plugin->manager)
+        )
+      ),
+      infinoted_plugin_autosave_write_cb,
+      info
+    );
+  }
+
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
 
@@ -313,6 +623,16 @@ infinoted_plugin_autosave_session_removed(const InfBrowserIter* iter,
     info
   );
 
+  if(INF_TEXT_IS_BUFFER(buffer))
+  {
+    inf_text_buffer_remove_observer(
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_autosave_buffer_text_inserted_cb,
+      infinoted_plugin_autosave_buffer_text_erased_cb,
+      info
+    );
+  }
+
   g_object_unref(session);
   g_object_unref(info->proxy);
 }
@@ -326,8 +646,9 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_AUTOSAVE_OPTIONS[] = {
     infinoted_parameter_convert_positive,
     0,
     N_("Interval, in seconds, after which to save documents into the root "
-       "directory. Documents are also stored to disk when there has been "
-       "no user logged into them for 60 seconds."),
+       "directory. A random delay of up to a quarter of the interval is "
+       "added for each document. Documents are also stored to disk when "
+       "there has been no user logged into them for 60 seconds."),
     N_("SECONDS")
   }, {
     "hook",
@@ -338,6 +659,27 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_AUTOSAVE_OPTIONS[] = {
     0,
     N_("Command to run after having saved a document."),
     N_("PROGRAM")
+  }, {
+    "binary",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginAutosave, binary),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to save text documents in the compact binary format. This "
+       "should match the \"binary\" option of the note-text plugin."),
+    NULL
+  }, {
+    "max-saves",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginAutosave, max_saves),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The maximum number of documents to save per second. Documents that "
+       "are due when the limit is reached are saved in the following "
+       "seconds, those with the most changes first. The default is 10."),
+    N_("NUMBER")
   }, {
     NULL,
     0,
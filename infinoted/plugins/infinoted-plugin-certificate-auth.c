@@ -26,6 +26,14 @@
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <glib/gstdio.h>
+
+#include <errno.h>
+
+/* Maximum number of entries in the verification cache. When it is full,
+ * expired entries are dropped, and if that does not help, all of them. */
+#define INFINOTED_PLUGIN_CERTIFICATE_AUTH_MAX_CACHED 4096
+
 typedef enum _InfinotedPluginCertificateAuthError {
   INFINOTED_PLUGIN_CERTIFICATE_AUTH_ERROR_NO_CREDENTIALS,
   INFINOTED_PLUGIN_CERTIFICATE_AUTH_ERROR_NO_CAS,
@@ -41,12 +49,22 @@ struct _InfinotedPluginCertificateAuth {
   gchar* ca_key_file;
   gboolean accept_unauthenticated_clients;
   gchar* super_user;
+  gchar* crl_file;
+  guint cache_time;
 
   gnutls_x509_crt_t* cas;
   guint n_cas;
   gnutls_x509_privkey_t ca_key;
   guint ca_key_index;
 
+  gnutls_x509_crl_t* crls;
+  guint n_crls;
+  gint64 crl_mtime;
+
+  /* Chain fingerprint -> time until which the chain is known to be valid,
+   * as a gint64 in microseconds of real time. */
+  GHashTable* verified;
+
   gint verify_flags;
 
   InfAclAccountId super_id;
@@ -103,6 +121,206 @@ infinoted_plugin_certificate_auth_remove_acl_account_cb(
   }
 }
 
+static void
+infinoted_plugin_certificate_auth_free_crls(
+  InfinotedPluginCertificateAuth* plugin)
+{
+  guint i;
+
+  for(i = 0; i < plugin->n_crls; ++i)
+    gnutls_x509_crl_deinit(plugin->crls[i]);
+  gnutls_free(plugin->crls);
+
+  plugin->crls = NULL;
+  plugin->n_crls = 0;
+}
+
+static gboolean
+infinoted_plugin_certificate_auth_load_crls(
+  InfinotedPluginCertificateAuth* plugin,
+  GError** error)
+{
+  gchar* contents;
+  gsize length;
+  gnutls_datum_t data;
+  gnutls_x509_crl_t* crls;
+  unsigned int n_crls;
+  GStatBuf st;
+  int res;
+
+  if(g_stat(plugin->crl_file, &st) != 0)
+  {
+    g_set_error(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      _("Could not access CRL file \"%s\": %s"),
+      plugin->crl_file,
+      g_strerror(errno)
+    );
+
+    return FALSE;
+  }
+
+  /* Remember the modification time even if loading fails, so that a broken
+   * file is not re-read for every connection. */
+  plugin->crl_mtime = st.st_mtime;
+
+  if(!g_file_get_contents(plugin->crl_file, &contents, &length, error))
+    return FALSE;
+
+  data.data = (unsigned char*)contents;
+  data.size = length;
+
+  res = gnutls_x509_crl_list_import2(
+    &crls,
+    &n_crls,
+    &data,
+    GNUTLS_X509_FMT_PEM,
+    0
+  );
+
+  g_free(contents);
+
+  if(res < 0)
+  {
+    inf_gnutls_set_error(error, res);
+    return FALSE;
+  }
+
+  infinoted_plugin_certificate_auth_free_crls(plugin);
+  plugin->crls = crls;
+  plugin->n_crls = n_crls;
+  return TRUE;
+}
+
+/* Reloads the CRLs if the file has changed since they were read. Since a
+ * new CRL can revoke certificates that have been verified before, this
+ * also empties the verification cache. */
+static void
+infinoted_plugin_certificate_auth_check_crls(
+  InfinotedPluginCertificateAuth* plugin)
+{
+  GStatBuf st;
+  GError* error;
+
+  if(plugin->crl_file == NULL)
+    return;
+
+  if(g_stat(plugin->crl_file, &st) == 0 && st.st_mtime == plugin->crl_mtime)
+    return;
+
+  g_hash_table_remove_all(plugin->verified);
+
+  error = NULL;
+  if(!infinoted_plugin_certificate_auth_load_crls(plugin, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to reload certificate revocation lists, keeping the "
+        "previous ones: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+  }
+}
+
+static gchar*
+infinoted_plugin_certificate_auth_get_chain_fingerprint(
+  InfCertificateChain* chain)
+{
+  GString* str;
+  gchar* fingerprint;
+  guint i;
+
+  str = g_string_new(NULL);
+  for(i = 0; i < inf_certificate_chain_get_n_certificates(chain); ++i)
+  {
+    fingerprint = inf_cert_util_get_fingerprint(
+      inf_certificate_chain_get_nth_certificate(chain, i),
+      GNUTLS_DIG_SHA256
+    );
+
+    if(i > 0) g_string_append_c(str, '/');
+    g_string_append(str, fingerprint);
+    g_free(fingerprint);
+  }
+
+  return g_string_free(str, FALSE);
+}
+
+static gboolean
+infinoted_plugin_certificate_auth_remove_expired_func(gpointer key,
+                                                      gpointer value,
+                                                      gpointer user_data)
+{
+  return *(gint64*)value <= *(gint64*)user_data;
+}
+
+static gboolean
+infinoted_plugin_certificate_auth_lookup_verified(
+  InfinotedPluginCertificateAuth* plugin,
+  const gchar* fingerprint)
+{
+  gint64* valid_until;
+
+  valid_until = g_hash_table_lookup(plugin->verified, fingerprint);
+  if(valid_until == NULL)
+    return FALSE;
+
+  if(*valid_until <= g_get_real_time())
+  {
+    g_hash_table_remove(plugin->verified, fingerprint);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_certificate_auth_insert_verified(
+  InfinotedPluginCertificateAuth* plugin,
+  InfCertificateChain* chain,
+  gchar* fingerprint)
+{
+  gint64 now;
+  gint64* valid_until;
+  time_t expiration;
+
+  now = g_get_real_time();
+
+  if(g_hash_table_size(plugin->verified) >=
+     INFINOTED_PLUGIN_CERTIFICATE_AUTH_MAX_CACHED)
+  {
+    g_hash_table_foreach_remove(
+      plugin->verified,
+      infinoted_plugin_certificate_auth_remove_expired_func,
+      &now
+    );
+
+    if(g_hash_table_size(plugin->verified) >=
+       INFINOTED_PLUGIN_CERTIFICATE_AUTH_MAX_CACHED)
+    {
+      g_hash_table_remove_all(plugin->verified);
+    }
+  }
+
+  /* Never trust the result for longer than the client certificate is
+   * valid. */
+  valid_until = g_new(gint64, 1);
+  *valid_until = now + (gint64)plugin->cache_time * G_USEC_PER_SEC;
+
+  expiration = gnutls_x509_crt_get_expiration_time(
+    inf_certificate_chain_get_own_certificate(chain)
+  );
+
+  if(expiration != (time_t)-1)
+    *valid_until = MIN(*valid_until, (gint64)expiration * G_USEC_PER_SEC);
+
+  g_hash_table_insert(plugin->verified, fingerprint, valid_until);
+}
+
 static void
 infinoted_plugin_certificate_auth_certificate_func(InfXmppConnection* xmpp,
                                                    gnutls_session_t session,
@@ -113,18 +331,39 @@ infinoted_plugin_certificate_auth_certificate_func(InfXmppConnection* xmpp,
   int res;
   int verify_result;
   GError* error;
+  gchar* fingerprint;
 
   plugin = (InfinotedPluginCertificateAuth*)user_data;
 
   if(chain != NULL)
   {
+    infinoted_plugin_certificate_auth_check_crls(plugin);
+
+    /* Reconnecting clients present the same chain again, and its
+     * verification result does not change until the CRLs do, or until the
+     * certificate expires. */
+    fingerprint = NULL;
+    if(plugin->cache_time > 0)
+    {
+      fingerprint =
+        infinoted_plugin_certificate_auth_get_chain_fingerprint(chain);
+
+      if(infinoted_plugin_certificate_auth_lookup_verified(plugin,
+                                                           fingerprint))
+      {
+        g_free(fingerprint);
+        inf_xmpp_connection_certificate_verify_continue(xmpp);
+        return;
+      }
+    }
+
     res = gnutls_x509_crt_list_verify(
       inf_certificate_chain_get_raw(chain),
       inf_certificate_chain_get_n_certificates(chain),
       plugin->cas,
       plugin->n_cas,
-      NULL,
-      0,
+      plugin->crls,
+      plugin->n_crls,
       plugin->verify_flags,
       &verify_result
     );
@@ -138,11 +377,21 @@ infinoted_plugin_certificate_auth_certificate_func(InfXmppConnection* xmpp,
 
     if(error != NULL)
     {
+      g_free(fingerprint);
       inf_xmpp_connection_certificate_verify_cancel(xmpp, error);
       g_error_free(error);
     }
     else
     {
+      if(fingerprint != NULL)
+      {
+        infinoted_plugin_certificate_auth_insert_verified(
+          plugin,
+          chain,
+          fingerprint
+        );
+      }
+
       inf_xmpp_connection_certificate_verify_continue(xmpp);
     }
   }
@@ -168,12 +417,19 @@ infinoted_plugin_certificate_auth_info_initialize(gpointer plugin_info)
   plugin->ca_key_file = NULL;
   plugin->accept_unauthenticated_clients = FALSE;
   plugin->super_user = NULL;
+  plugin->crl_file = NULL;
+  plugin->cache_time = 3600;
 
   plugin->cas = NULL;
   plugin->n_cas = 0;
   plugin->ca_key = NULL;
   plugin->ca_key_index = G_MAXUINT;
 
+  plugin->crls = NULL;
+  plugin->n_crls = 0;
+  plugin->crl_mtime = 0;
+  plugin->verified = NULL;
+
   /* Note that we don't require client certificates to be signed by a CA,
    * by default. We only require them to be signed by one of the certificates
    * in our list, but we don't care whether that's a CA or not. A common use
@@ -216,6 +472,9 @@ infinoted_plugin_certificate_auth_initialize(InfinotedPluginManager* manager,
   plugin = (InfinotedPluginCertificateAuth*)plugin_info;
   plugin->manager = manager;
 
+  plugin->verified =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
   creds = infinoted_plugin_manager_get_credentials(manager);
   if(creds == NULL)
   {
@@ -251,6 +510,10 @@ infinoted_plugin_certificate_auth_initialize(InfinotedPluginManager* manager,
   plugin->n_cas = read_certs->len;
   plugin->cas = (gnutls_x509_crt_t*)g_ptr_array_free(read_certs, FALSE);
 
+  if(plugin->crl_file != NULL)
+    if(!infinoted_plugin_certificate_auth_load_crls(plugin, error))
+      return FALSE;
+
   res = gnutls_certificate_set_x509_trust(
     inf_certificate_credentials_get(creds),
     plugin->cas,
@@ -488,9 +751,13 @@ infinoted_plugin_certificate_auth_deinitialize(gpointer plugin_info)
   if(plugin->ca_key != NULL)
     gnutls_x509_privkey_deinit(plugin->ca_key);
 
+  infinoted_plugin_certificate_auth_free_crls(plugin);
+  g_hash_table_destroy(plugin->verified);
+
   g_free(plugin->ca_list_file);
   g_free(plugin->ca_key_file);
   g_free(plugin->super_user);
+  g_free(plugin->crl_file);
 }
 
 static void
@@ -635,6 +902,29 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_CERTIFICATE_AUTH_OPTIONS[]
        "or the plugin is re-loaded. This option can only be given when "
        "the \"ca-key\" parameter is set."),
     N_("FILENAME")
+  }, {
+    "crl-list",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedPluginCertificateAuth, crl_file),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("A file with certificate revocation lists. Clients presenting a "
+       "revoked certificate are rejected. The file is re-read when it "
+       "changes, and all cached verification results are dropped then."),
+    N_("CRL-LIST")
+  }, {
+    "verification-cache-time",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginCertificateAuth, cache_time),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Number of seconds for which a successfully verified client "
+       "certificate chain is remembered, so that the chain does not need "
+       "to be verified again when the client reconnects. 0 disables the "
+       "cache. [Default: 3600]"),
+    N_("SECONDS")
   }, {
     "verification-flags",
     INFINOTED_PARAMETER_STRING_LIST,
@@ -18,9 +18,18 @@
  */
 
 #include "util/infinoted-plugin-util-navigate-browser.h"
+#include "util/infinoted-plugin-util-search-index.h"
 
 #include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/adopted/inf-adopted-request-log.h>
+#include <libinfinity/communication/inf-communication-group.h>
+#include <libinfinity/server/infd-session-proxy.h>
 #include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
 #include <gio/gio.h>
@@ -58,6 +67,55 @@ static const gchar infinoted_plugin_dbus_introspection[] =
   "      <arg type='as' name='permissions' direction='in'/>"
   "      <arg type='a{sb}' name='sheet' direction='out'/>"
   "    </method>"
+  "    <method name='get_statistics'>"
+  "      <arg type='a{sa{st}}' name='sessions' direction='out'/>"
+  "      <arg type='a{sa{st}}' name='connections' direction='out'/>"
+  "    </method>"
+  "    <method name='explore_tree'>"
+  "      <arg type='s' name='node' direction='in'/>"
+  "      <arg type='u' name='depth' direction='in'/>"
+  "      <arg type='u' name='cookie' direction='in'/>"
+  "      <arg type='u' name='count' direction='out'/>"
+  "    </method>"
+  "    <method name='query_acl_tree'>"
+  "      <arg type='s' name='node' direction='in'/>"
+  "      <arg type='u' name='depth' direction='in'/>"
+  "      <arg type='s' name='account' direction='in'/>"
+  "      <arg type='u' name='cookie' direction='in'/>"
+  "      <arg type='u' name='count' direction='out'/>"
+  "    </method>"
+  "    <method name='set_acl_bulk'>"
+  "      <arg type='a{sa{sa{sb}}}' name='acls' direction='in'/>"
+  "      <arg type='a{ss}' name='errors' direction='out'/>"
+  "    </method>"
+  "    <method name='get_session_statistics'>"
+  "      <arg type='as' name='nodes' direction='in'/>"
+  "      <arg type='u' name='cookie' direction='in'/>"
+  "      <arg type='u' name='count' direction='out'/>"
+  "    </method>"
+  "    <method name='search'>"
+  "      <arg type='s' name='query' direction='in'/>"
+  "      <arg type='u' name='max_results' direction='in'/>"
+  "      <arg type='as' name='nodes' direction='out'/>"
+  "    </method>"
+  "    <method name='get_loop_statistics'>"
+  "      <arg type='a{s(tttat)}' name='histograms' direction='out'/>"
+  "    </method>"
+  "    <signal name='explore_tree_results'>"
+  "      <arg type='u' name='cookie'/>"
+  "      <arg type='a(ss)' name='nodelist'/>"
+  "    </signal>"
+  "    <signal name='query_acl_tree_results'>"
+  "      <arg type='u' name='cookie'/>"
+  "      <arg type='a{sa{sa{sb}}}' name='acls'/>"
+  "    </signal>"
+  "    <signal name='session_statistics_results'>"
+  "      <arg type='u' name='cookie'/>"
+  "      <arg type='a{sa{st}}' name='sessions'/>"
+  "    </signal>"
+  "    <signal name='nodes_changed'>"
+  "      <arg type='a{sas}' name='changes'/>"
+  "    </signal>"
   "  </interface>"
   "</node>";
 
@@ -73,10 +131,120 @@ struct _InfinotedPluginDbus {
   GMainContext* context;
   GMainLoop* loop;
   guint id;
+  GDBusConnection* connection; /* protected by mutex */
 
   GSList* invocations; /* invocations currently being processed */
+
+  /* Node changes since the last nodes_changed signal, path -> flags */
+  guint change_interval;
+  GHashTable* changes;
+  InfIoTimeout* change_timeout;
+
+  gchar* metrics_file;
+  guint metrics_interval;
+  InfIoTimeout* metrics_timeout;
+
+  GSList* sessions;
+  GSList* connections;
+};
+
+typedef struct _InfinotedPluginDbusSessionInfo InfinotedPluginDbusSessionInfo;
+struct _InfinotedPluginDbusSessionInfo {
+  InfinotedPluginDbus* plugin;
+  InfBrowserIter iter;
+  InfSessionProxy* proxy;
+  InfAdoptedAlgorithm* algorithm;
+
+  gint64 execute_begin;
+  guint64 requests_received;
+  guint64 requests_applied;
+  guint64 requests_failed;
+  guint64 execute_time;
+};
+
+typedef struct _InfinotedPluginDbusConnectionInfo
+  InfinotedPluginDbusConnectionInfo;
+struct _InfinotedPluginDbusConnectionInfo {
+  InfinotedPluginDbus* plugin;
+  InfXmlConnection* connection;
+
+  guint64 messages_received;
+  guint64 messages_sent;
+};
+
+typedef struct _InfinotedPluginDbusCounter InfinotedPluginDbusCounter;
+struct _InfinotedPluginDbusCounter {
+  const gchar* name;
+  const gchar* description;
+  gboolean monotonic;
+};
+
+static const InfinotedPluginDbusCounter
+INFINOTED_PLUGIN_DBUS_SESSION_COUNTERS[] = {
+  { "requests_received", "Requests received from clients", TRUE },
+  { "requests_applied", "Requests applied to the document", TRUE },
+  { "requests_failed", "Requests that failed to execute", TRUE },
+  { "execute_microseconds", "Time spent executing requests", TRUE },
+  { "transform_cache_hits", "Transformations served from the cache", TRUE },
+  { "transform_cache_misses", "Transformations not in the cache", TRUE },
+  { "request_log_length", "Requests kept in the request logs", FALSE },
+  { "subscriptions", "Connections subscribed to the session", FALSE },
+  { "queued_messages", "Messages waiting to be sent", FALSE },
+  { "buffer_bytes", "Size of the document content", FALSE },
+  { "request_log_bytes", "Content size of the request logs", FALSE },
+  { "transform_cache_bytes", "Content size of cached transformations",
+    FALSE },
+  { "held_back_bytes", "Size of messages held back by rate limits", FALSE },
+  { "synchronizations", "Synchronizations in progress", FALSE }
+};
+
+static const InfinotedPluginDbusCounter
+INFINOTED_PLUGIN_DBUS_CONNECTION_COUNTERS[] = {
+  { "messages_received", "Messages received from the connection", TRUE },
+  { "messages_sent", "Messages sent to the connection", TRUE },
+  { "subscriptions", "Sessions the connection is subscribed to", FALSE },
+  { "queued_messages", "Messages waiting to be sent", FALSE },
+  { "held_back_bytes", "Size of messages held back by rate limits", FALSE }
+};
+
+typedef struct _InfinotedPluginDbusHistogram InfinotedPluginDbusHistogram;
+struct _InfinotedPluginDbusHistogram {
+  InfStandaloneIoStatistic statistic;
+  const gchar* name;
+  const gchar* description;
+  gboolean microseconds;
+};
+
+static const InfinotedPluginDbusHistogram
+INFINOTED_PLUGIN_DBUS_LOOP_HISTOGRAMS[] = {
+  { INF_STANDALONE_IO_STATISTIC_TIMEOUT_LAG, "timeout_lag",
+    "Delay of timeouts behind their schedule", TRUE },
+  { INF_STANDALONE_IO_STATISTIC_TIMEOUT_TIME, "timeout_callback",
+    "Time spent in timeout callbacks", TRUE },
+  { INF_STANDALONE_IO_STATISTIC_WATCH_TIME, "watch_callback",
+    "Time spent in socket watch callbacks", TRUE },
+  { INF_STANDALONE_IO_STATISTIC_DISPATCH_TIME, "dispatch_callback",
+    "Time spent in one batch of dispatch callbacks", TRUE },
+  { INF_STANDALONE_IO_STATISTIC_DISPATCH_QUEUE_LENGTH,
+    "dispatch_queue_length", "Dispatches waiting to be run", FALSE },
+  { INF_STANDALONE_IO_STATISTIC_READY_EVENTS, "ready_events",
+    "Sockets with events per wakeup", FALSE }
 };
 
+/* Maximum number of entries in one signal when streaming results */
+#define INFINOTED_PLUGIN_DBUS_CHUNK_SIZE 1000
+
+typedef enum _InfinotedPluginDbusChange {
+  INFINOTED_PLUGIN_DBUS_CHANGE_ADDED = 1 << 0,
+  INFINOTED_PLUGIN_DBUS_CHANGE_REMOVED = 1 << 1,
+  INFINOTED_PLUGIN_DBUS_CHANGE_ACL = 1 << 2
+} InfinotedPluginDbusChange;
+
+#define INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS \
+  G_N_ELEMENTS(INFINOTED_PLUGIN_DBUS_SESSION_COUNTERS)
+#define INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS \
+  G_N_ELEMENTS(INFINOTED_PLUGIN_DBUS_CONNECTION_COUNTERS)
+
 typedef struct _InfinotedPluginDbusInvocation InfinotedPluginDbusInvocation;
 struct _InfinotedPluginDbusInvocation {
   InfinotedPluginDbus* plugin;
@@ -685,224 +853,1624 @@ infinoted_plugin_dbus_check_acl(InfinotedPluginDbus* plugin,
 }
 
 static void
-infinoted_plugin_dbus_navigate_done(InfBrowser* browser,
-                                    const InfBrowserIter* iter,
-                                    const GError* error,
-                                    gpointer user_data)
+infinoted_plugin_dbus_session_add_user_func(InfUser* user,
+                                            gpointer user_data)
 {
-  InfinotedPluginDbusInvocation* invocation;
-  invocation = (InfinotedPluginDbusInvocation*)user_data;
+  guint64* values;
+  InfAdoptedRequestLog* log;
+  guint hits;
+  guint misses;
+
+  values = (guint64*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+
+  inf_adopted_request_log_get_cache_statistics(log, &hits, &misses);
+  values[4] += hits;
+  values[5] += misses;
+  values[6] += inf_adopted_request_log_get_end(log) -
+    inf_adopted_request_log_get_begin(log);
+}
 
-  if(error != NULL)
-  {
-    g_dbus_method_invocation_return_error_literal(
-      invocation->invocation,
-      G_DBUS_ERROR,
-      G_DBUS_ERROR_FILE_NOT_FOUND,
-      error->message
-    );
+/* Returns the number of messages waiting to be sent to connection in the
+ * subscription group of the session, or -1 if connection is not subscribed
+ * to it. */
+static gint64
+infinoted_plugin_dbus_session_get_queued(InfinotedPluginDbusSessionInfo* info,
+                                         InfXmlConnection* connection)
+{
+  InfSession* session;
+  InfCommunicationGroup* group;
+  guint n_enqueued;
+  guint n_queued;
+  gint64 result;
 
-    infinoted_plugin_dbus_invocation_free(invocation->plugin, invocation);
-  }
-  else if(strcmp(invocation->method_name, "explore_node") == 0)
-  {
-    infinoted_plugin_dbus_explore_node(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
-    );
-  }
-  else if(strcmp(invocation->method_name, "add_node") == 0)
-  {
-    infinoted_plugin_dbus_add_node(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
-    );
-  }
-  else if(strcmp(invocation->method_name, "remove_node") == 0)
-  {
-    infinoted_plugin_dbus_remove_node(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
-    );
-  }
-  else if(strcmp(invocation->method_name, "query_acl") == 0)
-  {
-    infinoted_plugin_dbus_query_acl(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
-    );
-  }
-  else if(strcmp(invocation->method_name, "set_acl") == 0)
-  {
-    infinoted_plugin_dbus_set_acl(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
-    );
-  }
-  else if(strcmp(invocation->method_name, "check_acl") == 0)
+  g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+  group = inf_session_get_subscription_group(session);
+
+  result = -1;
+  if(group != NULL && inf_communication_group_is_member(group, connection))
   {
-    infinoted_plugin_dbus_check_acl(
-      invocation->plugin,
-      invocation,
-      browser,
-      iter
+    inf_communication_group_get_queue_status(
+      group,
+      connection,
+      &n_enqueued,
+      &n_queued
     );
+
+    result = n_enqueued + n_queued;
   }
-  else
-  {
-    g_assert_not_reached();
-  }
+
+  g_object_unref(session);
+  return result;
 }
 
 static void
-infinoted_plugin_dbus_main_invocation(gpointer user_data)
+infinoted_plugin_dbus_session_get_counters(
+  InfinotedPluginDbusSessionInfo* info,
+  guint64* values)
 {
-  /* Main thread invocation handler */
-  InfinotedPluginDbusInvocation* invocation;
-  const gchar* path;
-  gsize len;
-  InfinotedPluginUtilNavigateData* navigate;
+  InfSession* session;
+  InfinotedPluginDbusConnectionInfo* connection_info;
+  InfdSessionProxyMemoryUsage usage;
+  GSList* item;
+  gint64 queued;
+
+  values[0] = info->requests_received;
+  values[1] = info->requests_applied;
+  values[2] = info->requests_failed;
+  values[3] = info->execute_time;
+  values[4] = 0;
+  values[5] = 0;
+  values[6] = 0;
+  values[7] = 0;
+  values[8] = 0;
+
+  infd_session_proxy_get_memory_usage(INFD_SESSION_PROXY(info->proxy), &usage);
+  values[9] = usage.buffer_bytes;
+  values[10] = usage.request_log_bytes;
+  values[11] = usage.transformation_cache_bytes;
+  values[12] = usage.held_back_bytes;
+  values[13] = usage.synchronizations;
+
+  g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    infinoted_plugin_dbus_session_add_user_func,
+    values
+  );
 
-  invocation = (InfinotedPluginDbusInvocation*)user_data;
-  invocation->plugin->invocations =
-    g_slist_prepend(invocation->plugin->invocations, invocation);
-  g_atomic_int_inc(&invocation->ref_count);
+  g_object_unref(session);
 
-  /* These commands take a path as the first parameter and do not
-   * require that path to be explored. */
-  if(strcmp(invocation->method_name, "remove_node") == 0 ||
-     strcmp(invocation->method_name, "query_acl") == 0 ||
-     strcmp(invocation->method_name, "set_acl") == 0 ||
-     strcmp(invocation->method_name, "check_acl") == 0)
+  for(item = info->plugin->connections; item != NULL; item = item->next)
   {
-    path = g_variant_get_string(
-      g_variant_get_child_value(invocation->parameters, 0),
-      &len
+    connection_info = (InfinotedPluginDbusConnectionInfo*)item->data;
+    queued = infinoted_plugin_dbus_session_get_queued(
+      info,
+      connection_info->connection
     );
 
-    navigate = infinoted_plugin_util_navigate_to(
-      INF_BROWSER(infinoted_plugin_manager_get_directory(invocation->plugin->manager)),
-      path,
-      len,
-      FALSE,
-      infinoted_plugin_dbus_navigate_done,
-      invocation
-    );
-    
-    if(navigate != NULL)
-      invocation->navigate = navigate;
+    if(queued >= 0)
+    {
+      values[7] += 1;
+      values[8] += queued;
+    }
   }
-  /* These commands take a path as the first parameter and DO require that
-   * path to be explored. */
-  else if(strcmp(invocation->method_name, "explore_node") == 0 ||
-          strcmp(invocation->method_name, "add_node") == 0)
-  {
-    path = g_variant_get_string(
-      g_variant_get_child_value(invocation->parameters, 0),
-      &len
-    );
+}
 
-    navigate = infinoted_plugin_util_navigate_to(
-      INF_BROWSER(infinoted_plugin_manager_get_directory(invocation->plugin->manager)),
-      path,
-      len,
-      TRUE,
-      infinoted_plugin_dbus_navigate_done,
-      invocation
-    );
-    
-    if(navigate != NULL)
-      invocation->navigate = navigate;
-  }
-  else
+static void
+infinoted_plugin_dbus_connection_get_counters(
+  InfinotedPluginDbusConnectionInfo* info,
+  guint64* values)
+{
+  InfinotedPluginDbusSessionInfo* session_info;
+  GSList* item;
+  gint64 queued;
+
+  values[0] = info->messages_received;
+  values[1] = info->messages_sent;
+  values[2] = 0;
+  values[3] = 0;
+  values[4] = 0;
+
+  for(item = info->plugin->sessions; item != NULL; item = item->next)
   {
-    g_dbus_method_invocation_return_error_literal(
-      invocation->invocation,
-      G_DBUS_ERROR,
-      G_DBUS_ERROR_UNKNOWN_METHOD,
-      "Not implemented"
+    session_info = (InfinotedPluginDbusSessionInfo*)item->data;
+    queued = infinoted_plugin_dbus_session_get_queued(
+      session_info,
+      info->connection
     );
 
-    infinoted_plugin_dbus_invocation_free(invocation->plugin, invocation);
+    if(queued >= 0)
+    {
+      values[2] += 1;
+      values[3] += queued;
+    }
+
+    if(infd_session_proxy_is_subscribed(INFD_SESSION_PROXY(session_info->proxy),
+                                        info->connection))
+    {
+      values[4] += infd_session_proxy_get_held_back_bytes(
+        INFD_SESSION_PROXY(session_info->proxy),
+        info->connection
+      );
+    }
   }
 }
 
-static void
-infinoted_plugin_dbus_method_call_func(GDBusConnection* connection,
-                                       const gchar* sender,
-                                       const gchar* object_path,
-                                       const gchar* interface_name,
-                                       const gchar* method_name,
-                                       GVariant* parameters,
-                                       GDBusMethodInvocation* invocation,
-                                       gpointer user_data)
+static gchar*
+infinoted_plugin_dbus_session_get_path(InfinotedPluginDbusSessionInfo* info)
 {
-  /* Dispatch to the main thread */
-  InfinotedPluginDbus* plugin;
-  InfinotedPluginDbusInvocation* thread_invocation;
-  InfIo* io;
+  InfdDirectory* directory;
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
 
-  plugin = (InfinotedPluginDbus*)user_data;
-  thread_invocation = g_slice_new(InfinotedPluginDbusInvocation);
+  return inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+}
 
-  thread_invocation->plugin = plugin;
-  thread_invocation->ref_count = 1;
-  thread_invocation->method_name = g_strdup(method_name);
-  thread_invocation->parameters = g_variant_ref(parameters);
-  thread_invocation->invocation = g_object_ref(invocation);
-  thread_invocation->navigate = NULL;
-  thread_invocation->request = NULL;
-  thread_invocation->request_func = NULL;
+static gchar*
+infinoted_plugin_dbus_connection_get_id(
+  InfinotedPluginDbusConnectionInfo* info)
+{
+  gchar* remote_id;
+  g_object_get(G_OBJECT(info->connection), "remote-id", &remote_id, NULL);
+  return remote_id;
+}
 
-  io = infinoted_plugin_manager_get_io(plugin->manager);
+static GVariant*
+infinoted_plugin_dbus_counters_to_variant(
+  const InfinotedPluginDbusCounter* counters,
+  const guint64* values,
+  guint n_counters)
+{
+  GVariantBuilder builder;
+  guint i;
 
-  inf_io_add_dispatch(
-    io,
-    infinoted_plugin_dbus_main_invocation,
-    thread_invocation,
-    infinoted_plugin_dbus_invocation_unref
-  );
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+  for(i = 0; i < n_counters; ++i)
+    g_variant_builder_add(&builder, "{st}", counters[i].name, values[i]);
+
+  return g_variant_builder_end(&builder);
 }
 
 static void
-infinoted_plugin_dbus_bus_acquired_func(GDBusConnection* connection,
-                                        const gchar* name,
-                                        gpointer user_data)
+infinoted_plugin_dbus_get_statistics(InfinotedPluginDbus* plugin,
+                                     InfinotedPluginDbusInvocation* inv)
 {
-  GDBusNodeInfo* node_info;
-  GDBusInterfaceInfo* interface_info;
-  GDBusInterfaceVTable vtable;
-  GError* error;
+  GVariantBuilder sessions;
+  GVariantBuilder connections;
+  GSList* item;
+  guint64 session_values[INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS];
+  guint64 connection_values[INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS];
+  gchar* name;
+
+  g_variant_builder_init(&sessions, G_VARIANT_TYPE("a{sa{st}}"));
+  for(item = plugin->sessions; item != NULL; item = item->next)
+  {
+    infinoted_plugin_dbus_session_get_counters(item->data, session_values);
+    name = infinoted_plugin_dbus_session_get_path(item->data);
+
+    g_variant_builder_add(
+      &sessions,
+      "{s@a{st}}",
+      name,
+      infinoted_plugin_dbus_counters_to_variant(
+        INFINOTED_PLUGIN_DBUS_SESSION_COUNTERS,
+        session_values,
+        INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS
+      )
+    );
 
-  node_info = g_dbus_node_info_new_for_xml(
-    infinoted_plugin_dbus_introspection,
-    NULL
-  );
+    g_free(name);
+  }
 
-  g_assert(node_info != NULL);
+  g_variant_builder_init(&connections, G_VARIANT_TYPE("a{sa{st}}"));
+  for(item = plugin->connections; item != NULL; item = item->next)
+  {
+    infinoted_plugin_dbus_connection_get_counters(
+      item->data,
+      connection_values
+    );
 
-  interface_info = g_dbus_node_info_lookup_interface(
-    node_info,
-    "org.infinote.server"
+    name = infinoted_plugin_dbus_connection_get_id(item->data);
+
+    g_variant_builder_add(
+      &connections,
+      "{s@a{st}}",
+      name,
+      infinoted_plugin_dbus_counters_to_variant(
+        INFINOTED_PLUGIN_DBUS_CONNECTION_COUNTERS,
+        connection_values,
+        INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS
+      )
+    );
+
+    g_free(name);
+  }
+
+  g_dbus_method_invocation_return_value(
+    inv->invocation,
+    g_variant_new(
+      "(@a{sa{st}}@a{sa{st}})",
+      g_variant_builder_end(&sessions),
+      g_variant_builder_end(&connections)
+    )
   );
 
-  g_assert(interface_info != NULL);
+  infinoted_plugin_dbus_invocation_free(plugin, inv);
+}
 
-  vtable.method_call = infinoted_plugin_dbus_method_call_func;
-  vtable.get_property = NULL;
-  vtable.set_property = NULL;
+/* Results of bulk methods are sent to the caller in chunks, as signals
+ * addressed only to it, followed by the method reply with the total number
+ * of results. D-Bus delivers messages from one connection in order, so the
+ * caller has received all chunks when it receives the reply. The cookie
+ * passed by the caller is included in each chunk, to tell apart the results
+ * of concurrent calls. */
+typedef struct _InfinotedPluginDbusStream InfinotedPluginDbusStream;
+struct _InfinotedPluginDbusStream {
+  InfinotedPluginDbusInvocation* invocation;
+  const gchar* signal_name;
+  const GVariantType* type;
+  guint32 cookie;
 
-  error = NULL;
+  GVariantBuilder builder;
+  guint n_pending;
+  guint count;
+};
+
+static void
+infinoted_plugin_dbus_stream_init(InfinotedPluginDbusStream* stream,
+                                  InfinotedPluginDbusInvocation* invocation,
+                                  const gchar* signal_name,
+                                  const GVariantType* type,
+                                  guint32 cookie)
+{
+  stream->invocation = invocation;
+  stream->signal_name = signal_name;
+  stream->type = type;
+  stream->cookie = cookie;
+
+  g_variant_builder_init(&stream->builder, type);
+  stream->n_pending = 0;
+  stream->count = 0;
+}
+
+static void
+infinoted_plugin_dbus_stream_flush(InfinotedPluginDbusStream* stream)
+{
+  GDBusMethodInvocation* invocation;
+  GVariant* args[2];
+  GError* error;
+
+  if(stream->n_pending == 0)
+    return;
+
+  invocation = stream->invocation->invocation;
+  args[0] = g_variant_new_uint32(stream->cookie);
+  args[1] = g_variant_builder_end(&stream->builder);
+
+  error = NULL;
+  g_dbus_connection_emit_signal(
+    g_dbus_method_invocation_get_connection(invocation),
+    g_dbus_method_invocation_get_sender(invocation),
+    g_dbus_method_invocation_get_object_path(invocation),
+    g_dbus_method_invocation_get_interface_name(invocation),
+    stream->signal_name,
+    g_variant_new_tuple(args, 2),
+    &error
+  );
+
+  if(error != NULL)
+  {
+    g_warning("Failed to emit D-Bus signal: %s", error->message);
+    g_error_free(error);
+  }
+
+  g_variant_builder_init(&stream->builder, stream->type);
+  stream->n_pending = 0;
+}
+
+static void
+infinoted_plugin_dbus_stream_add(InfinotedPluginDbusStream* stream,
+                                 GVariant* value)
+{
+  g_variant_builder_add_value(&stream->builder, value);
+  ++stream->count;
+
+  if(++stream->n_pending >= INFINOTED_PLUGIN_DBUS_CHUNK_SIZE)
+    infinoted_plugin_dbus_stream_flush(stream);
+}
+
+/* Sends the remaining results and the method reply */
+static void
+infinoted_plugin_dbus_stream_finish(InfinotedPluginDbusStream* stream)
+{
+  infinoted_plugin_dbus_stream_flush(stream);
+  g_variant_builder_clear(&stream->builder);
+
+  g_dbus_method_invocation_return_value(
+    stream->invocation->invocation,
+    g_variant_new("(u)", stream->count)
+  );
+
+  infinoted_plugin_dbus_invocation_free(
+    stream->invocation->plugin,
+    stream->invocation
+  );
+}
+
+typedef void(*InfinotedPluginDbusWalkFunc)(InfBrowser* browser,
+                                           const InfBrowserIter* iter,
+                                           const gchar* path,
+                                           gpointer user_data);
+
+/* Makes sure the children of iter are available. InfdDirectory explores
+ * nodes synchronously, so this only fails if the storage cannot be read. */
+static gboolean
+infinoted_plugin_dbus_ensure_explored(InfBrowser* browser,
+                                      const InfBrowserIter* iter)
+{
+  if(!inf_browser_get_explored(browser, iter) &&
+     inf_browser_get_pending_request(browser, iter, "explore-node") == NULL)
+  {
+    inf_browser_explore(browser, iter, NULL, NULL);
+  }
+
+  return inf_browser_get_explored(browser, iter);
+}
+
+/* Calls func for all nodes below iter, up to depth levels deep, or without
+ * limit if depth is 0. path contains the path of iter, and is restored
+ * before the function returns. */
+static void
+infinoted_plugin_dbus_walk(InfBrowser* browser,
+                           const InfBrowserIter* iter,
+                           GString* path,
+                           guint depth,
+                           InfinotedPluginDbusWalkFunc func,
+                           gpointer user_data)
+{
+  InfBrowserIter child_iter;
+  gsize len;
+
+  if(!inf_browser_is_subdirectory(browser, iter))
+    return;
+  if(!infinoted_plugin_dbus_ensure_explored(browser, iter))
+    return;
+
+  len = path->len;
+  child_iter = *iter;
+  if(inf_browser_get_child(browser, &child_iter))
+  {
+    do
+    {
+      g_string_truncate(path, len);
+      if(len == 0 || path->str[len - 1] != '/')
+        g_string_append_c(path, '/');
+      g_string_append(path, inf_browser_get_node_name(browser, &child_iter));
+
+      func(browser, &child_iter, path->str, user_data);
+
+      if(depth != 1)
+      {
+        infinoted_plugin_dbus_walk(
+          browser,
+          &child_iter,
+          path,
+          depth == 0 ? 0 : depth - 1,
+          func,
+          user_data
+        );
+      }
+    } while(inf_browser_get_next(browser, &child_iter));
+  }
+
+  g_string_truncate(path, len);
+}
+
+static void
+infinoted_plugin_dbus_explore_tree_func(InfBrowser* browser,
+                                        const InfBrowserIter* iter,
+                                        const gchar* path,
+                                        gpointer user_data)
+{
+  const gchar* type;
+
+  if(inf_browser_is_subdirectory(browser, iter))
+    type = "InfSubdirectory";
+  else
+    type = inf_browser_get_node_type(browser, iter);
+
+  infinoted_plugin_dbus_stream_add(
+    (InfinotedPluginDbusStream*)user_data,
+    g_variant_new("(ss)", path, type)
+  );
+}
+
+static void
+infinoted_plugin_dbus_explore_tree(InfinotedPluginDbus* plugin,
+                                   InfinotedPluginDbusInvocation* invocation,
+                                   InfBrowser* browser,
+                                   const InfBrowserIter* iter)
+{
+  InfinotedPluginDbusStream stream;
+  guint32 depth;
+  guint32 cookie;
+  gchar* node_path;
+  GString* path;
+
+  g_variant_get_child(invocation->parameters, 1, "u", &depth);
+  g_variant_get_child(invocation->parameters, 2, "u", &cookie);
+
+  infinoted_plugin_dbus_stream_init(
+    &stream,
+    invocation,
+    "explore_tree_results",
+    G_VARIANT_TYPE("a(ss)"),
+    cookie
+  );
+
+  node_path = inf_browser_get_path(browser, iter);
+  path = g_string_new(node_path);
+  g_free(node_path);
+
+  infinoted_plugin_dbus_walk(
+    browser,
+    iter,
+    path,
+    depth,
+    infinoted_plugin_dbus_explore_tree_func,
+    &stream
+  );
+
+  g_string_free(path, TRUE);
+  infinoted_plugin_dbus_stream_finish(&stream);
+}
+
+typedef struct _InfinotedPluginDbusQueryAclTree
+  InfinotedPluginDbusQueryAclTree;
+struct _InfinotedPluginDbusQueryAclTree {
+  InfinotedPluginDbusStream stream;
+  const gchar* account;
+  InfAclAccountId account_id;
+};
+
+static void
+infinoted_plugin_dbus_query_acl_tree_func(InfBrowser* browser,
+                                          const InfBrowserIter* iter,
+                                          const gchar* path,
+                                          gpointer user_data)
+{
+  InfinotedPluginDbusQueryAclTree* query;
+  const InfAclSheetSet* sheet_set;
+  const InfAclSheet* sheet;
+  GVariantBuilder builder;
+
+  query = (InfinotedPluginDbusQueryAclTree*)user_data;
+  sheet_set = inf_browser_get_acl(browser, iter);
+
+  /* Only nodes with ACL sheets are reported */
+  if(sheet_set == NULL || sheet_set->n_sheets == 0)
+    return;
+
+  if(*query->account == '\0')
+  {
+    infinoted_plugin_dbus_stream_add(
+      &query->stream,
+      g_variant_new(
+        "{s@a{sa{sb}}}",
+        path,
+        infinoted_builder_dbus_sheet_set_to_variant(sheet_set)
+      )
+    );
+  }
+  else
+  {
+    sheet = inf_acl_sheet_set_find_const_sheet(sheet_set, query->account_id);
+    if(sheet == NULL)
+      return;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sa{sb}}"));
+    g_variant_builder_add(
+      &builder,
+      "{s@a{sb}}",
+      query->account,
+      infinoted_plugin_dbus_perms_to_variant(&sheet->mask, &sheet->perms)
+    );
+
+    infinoted_plugin_dbus_stream_add(
+      &query->stream,
+      g_variant_new("{s@a{sa{sb}}}", path, g_variant_builder_end(&builder))
+    );
+  }
+}
+
+static void
+infinoted_plugin_dbus_query_acl_tree(InfinotedPluginDbus* plugin,
+                                     InfinotedPluginDbusInvocation* inv,
+                                     InfBrowser* browser,
+                                     const InfBrowserIter* iter)
+{
+  InfinotedPluginDbusQueryAclTree query;
+  guint32 depth;
+  guint32 cookie;
+  gchar* path;
+  GString* str;
+
+  g_variant_get_child(inv->parameters, 1, "u", &depth);
+  g_variant_get_child(inv->parameters, 2, "&s", &query.account);
+  g_variant_get_child(inv->parameters, 3, "u", &cookie);
+
+  if(*query.account != '\0')
+    query.account_id = inf_acl_account_id_from_string(query.account);
+  else
+    query.account_id = 0;
+
+  infinoted_plugin_dbus_stream_init(
+    &query.stream,
+    inv,
+    "query_acl_tree_results",
+    G_VARIANT_TYPE("a{sa{sa{sb}}}"),
+    cookie
+  );
+
+  /* Unlike explore_tree, this includes the given node itself */
+  path = inf_browser_get_path(browser, iter);
+  infinoted_plugin_dbus_query_acl_tree_func(browser, iter, path, &query);
+
+  str = g_string_new(path);
+  g_free(path);
+
+  infinoted_plugin_dbus_walk(
+    browser,
+    iter,
+    str,
+    depth,
+    infinoted_plugin_dbus_query_acl_tree_func,
+    &query
+  );
+
+  g_string_free(str, TRUE);
+  infinoted_plugin_dbus_stream_finish(&query.stream);
+}
+
+/* Looks up the node at path without asynchronous navigation. The children
+ * of each directory that is visited are cached in dirs, so that looking
+ * up many nodes in the same directory does not scan it again for each
+ * of them. */
+static gboolean
+infinoted_plugin_dbus_lookup(InfBrowser* browser,
+                             GHashTable* dirs,
+                             const gchar* path,
+                             InfBrowserIter* iter)
+{
+  const gchar* sep;
+  gchar* parent_path;
+  InfBrowserIter parent_iter;
+  InfBrowserIter child_iter;
+  GHashTable* children;
+  InfBrowserIter* found;
+  gboolean result;
+
+  if(path[0] != '/')
+    return FALSE;
+
+  if(path[1] == '\0')
+  {
+    inf_browser_get_root(browser, iter);
+    return TRUE;
+  }
+
+  sep = strrchr(path, '/');
+  if(sep[1] == '\0')
+    return FALSE;
+
+  if(sep == path)
+    parent_path = g_strdup("/");
+  else
+    parent_path = g_strndup(path, sep - path);
+
+  children = g_hash_table_lookup(dirs, parent_path);
+  if(children == NULL)
+  {
+    result = infinoted_plugin_dbus_lookup(
+      browser,
+      dirs,
+      parent_path,
+      &parent_iter
+    );
+
+    if(!result ||
+       !inf_browser_is_subdirectory(browser, &parent_iter) ||
+       !infinoted_plugin_dbus_ensure_explored(browser, &parent_iter))
+    {
+      g_free(parent_path);
+      return FALSE;
+    }
+
+    children = g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      NULL,
+      (GDestroyNotify)inf_browser_iter_free
+    );
+
+    child_iter = parent_iter;
+    if(inf_browser_get_child(browser, &child_iter))
+    {
+      do
+      {
+        g_hash_table_insert(
+          children,
+          (gpointer)inf_browser_get_node_name(browser, &child_iter),
+          inf_browser_iter_copy(&child_iter)
+        );
+      } while(inf_browser_get_next(browser, &child_iter));
+    }
+
+    g_hash_table_insert(dirs, parent_path, children);
+  }
+  else
+  {
+    g_free(parent_path);
+  }
+
+  found = g_hash_table_lookup(children, sep + 1);
+  if(found == NULL)
+    return FALSE;
+
+  *iter = *found;
+  return TRUE;
+}
+
+static void
+infinoted_plugin_dbus_set_acl_bulk_finished_cb(InfRequest* request,
+                                               const InfRequestResult* res,
+                                               const GError* error,
+                                               gpointer user_data)
+{
+  GError** result;
+  result = (GError**)user_data;
+
+  if(error != NULL && *result == NULL)
+    *result = g_error_copy(error);
+}
+
+static void
+infinoted_plugin_dbus_set_acl_bulk(InfinotedPluginDbus* plugin,
+                                   InfinotedPluginDbusInvocation* invocation)
+{
+  InfdDirectory* directory;
+  InfBrowser* browser;
+  GHashTable* dirs;
+  GVariant* acls;
+  GVariantIter iter;
+  const gchar* path;
+  GVariant* sheet_set_variant;
+  InfAclSheetSet* sheet_set;
+  InfBrowserIter node_iter;
+  InfRequest* request;
+  GVariantBuilder errors;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(plugin->manager);
+  browser = INF_BROWSER(directory);
+
+  dirs = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)g_hash_table_destroy
+  );
+
+  g_variant_builder_init(&errors, G_VARIANT_TYPE("a{ss}"));
+  g_variant_get_child(invocation->parameters, 0, "@a{sa{sa{sb}}}", &acls);
+
+  /* Send out the changes to all connections once at the end */
+  infd_directory_begin_acl_batch(directory);
+
+  g_variant_iter_init(&iter, acls);
+  while(g_variant_iter_loop(&iter, "{&s@a{sa{sb}}}", &path,
+                            &sheet_set_variant))
+  {
+    if(!infinoted_plugin_dbus_lookup(browser, dirs, path, &node_iter))
+    {
+      g_variant_builder_add(&errors, "{ss}", path, "No such node");
+      continue;
+    }
+
+    error = NULL;
+    sheet_set = infinoted_plugin_dbus_sheet_set_from_variant(
+      sheet_set_variant,
+      &error
+    );
+
+    if(sheet_set != NULL)
+    {
+      /* InfdDirectory finishes the request right away, so error is set
+       * when this returns. */
+      request = inf_browser_set_acl(
+        browser,
+        &node_iter,
+        sheet_set,
+        infinoted_plugin_dbus_set_acl_bulk_finished_cb,
+        &error
+      );
+
+      if(request != NULL)
+      {
+        inf_signal_handlers_disconnect_by_func(
+          G_OBJECT(request),
+          G_CALLBACK(infinoted_plugin_dbus_set_acl_bulk_finished_cb),
+          &error
+        );
+      }
+
+      inf_acl_sheet_set_free(sheet_set);
+    }
+
+    if(error != NULL)
+    {
+      g_variant_builder_add(&errors, "{ss}", path, error->message);
+      g_error_free(error);
+    }
+  }
+
+  infd_directory_end_acl_batch(directory);
+
+  g_variant_unref(acls);
+  g_hash_table_destroy(dirs);
+
+  g_dbus_method_invocation_return_value(
+    invocation->invocation,
+    g_variant_new("(@a{ss})", g_variant_builder_end(&errors))
+  );
+
+  infinoted_plugin_dbus_invocation_free(plugin, invocation);
+}
+
+static void
+infinoted_plugin_dbus_get_session_statistics(
+  InfinotedPluginDbus* plugin,
+  InfinotedPluginDbusInvocation* inv)
+{
+  InfinotedPluginDbusStream stream;
+  GVariant* nodes;
+  GVariantIter iter;
+  const gchar* node;
+  guint32 cookie;
+  GHashTable* wanted;
+  GSList* item;
+  guint64 values[INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS];
+  gchar* name;
+
+  g_variant_get_child(inv->parameters, 0, "@as", &nodes);
+  g_variant_get_child(inv->parameters, 1, "u", &cookie);
+
+  /* An empty list means all sessions */
+  wanted = NULL;
+  if(g_variant_n_children(nodes) > 0)
+  {
+    wanted = g_hash_table_new(g_str_hash, g_str_equal);
+    g_variant_iter_init(&iter, nodes);
+    while(g_variant_iter_next(&iter, "&s", &node))
+      g_hash_table_add(wanted, (gpointer)node);
+  }
+
+  infinoted_plugin_dbus_stream_init(
+    &stream,
+    inv,
+    "session_statistics_results",
+    G_VARIANT_TYPE("a{sa{st}}"),
+    cookie
+  );
+
+  for(item = plugin->sessions; item != NULL; item = item->next)
+  {
+    name = infinoted_plugin_dbus_session_get_path(item->data);
+    if(wanted == NULL || g_hash_table_contains(wanted, name))
+    {
+      infinoted_plugin_dbus_session_get_counters(item->data, values);
+
+      infinoted_plugin_dbus_stream_add(
+        &stream,
+        g_variant_new(
+          "{s@a{st}}",
+          name,
+          infinoted_plugin_dbus_counters_to_variant(
+            INFINOTED_PLUGIN_DBUS_SESSION_COUNTERS,
+            values,
+            INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS
+          )
+        )
+      );
+    }
+
+    g_free(name);
+  }
+
+  if(wanted != NULL)
+    g_hash_table_destroy(wanted);
+  g_variant_unref(nodes);
+
+  infinoted_plugin_dbus_stream_finish(&stream);
+}
+
+static void
+infinoted_plugin_dbus_search(InfinotedPluginDbus* plugin,
+                             InfinotedPluginDbusInvocation* inv)
+{
+  InfinotedPluginUtilSearchIndex* index;
+  const gchar* query;
+  gsize len;
+  guint32 max_results;
+  GVariantBuilder builder;
+  GSList* results;
+  GSList* item;
+
+  index = infinoted_plugin_util_search_index_lookup(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  if(index == NULL)
+  {
+    g_dbus_method_invocation_return_error_literal(
+      inv->invocation,
+      G_DBUS_ERROR,
+      G_DBUS_ERROR_NOT_SUPPORTED,
+      _("The search plugin is not loaded")
+    );
+
+    infinoted_plugin_dbus_invocation_free(plugin, inv);
+    return;
+  }
+
+  g_variant_get_child(inv->parameters, 0, "&s", &query);
+  g_variant_get_child(inv->parameters, 1, "u", &max_results);
+  len = strlen(query);
+
+  results = infinoted_plugin_util_search_index_query(
+    index,
+    query,
+    len,
+    max_results
+  );
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+  for(item = results; item != NULL; item = item->next)
+    g_variant_builder_add(&builder, "s", item->data);
+  g_slist_free_full(results, g_free);
+
+  g_dbus_method_invocation_return_value(
+    inv->invocation,
+    g_variant_new("(@as)", g_variant_builder_end(&builder))
+  );
+
+  infinoted_plugin_dbus_invocation_free(plugin, inv);
+}
+
+static void
+infinoted_plugin_dbus_get_loop_statistics(InfinotedPluginDbus* plugin,
+                                          InfinotedPluginDbusInvocation* inv)
+{
+  const InfinotedPluginDbusHistogram* info;
+  InfStandaloneIoHistogram histogram;
+  GVariantBuilder builder;
+  InfIo* io;
+  guint i;
+
+  io = infinoted_plugin_manager_get_io(plugin->manager);
+
+  /* Only the standalone IO records statistics; with other InfIo
+   * implementations the result is empty. */
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{s(tttat)}"));
+  if(INF_IS_STANDALONE_IO(io))
+  {
+    for(i = 0; i < G_N_ELEMENTS(INFINOTED_PLUGIN_DBUS_LOOP_HISTOGRAMS); ++i)
+    {
+      info = &INFINOTED_PLUGIN_DBUS_LOOP_HISTOGRAMS[i];
+
+      inf_standalone_io_get_statistic(
+        INF_STANDALONE_IO(io),
+        info->statistic,
+        &histogram
+      );
+
+      g_variant_builder_add(
+        &builder,
+        "{s(ttt@at)}",
+        info->name,
+        histogram.count,
+        histogram.sum,
+        histogram.max,
+        g_variant_new_fixed_array(
+          G_VARIANT_TYPE_UINT64,
+          histogram.buckets,
+          INF_STANDALONE_IO_HISTOGRAM_BUCKETS,
+          sizeof(guint64)
+        )
+      );
+    }
+  }
+
+  g_dbus_method_invocation_return_value(
+    inv->invocation,
+    g_variant_new("(@a{s(tttat)})", g_variant_builder_end(&builder))
+  );
+
+  infinoted_plugin_dbus_invocation_free(plugin, inv);
+}
+
+static void
+infinoted_plugin_dbus_change_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginDbus* plugin;
+  GDBusConnection* connection;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  guint flags;
+  GError* error;
+
+  plugin = (InfinotedPluginDbus*)user_data;
+  plugin->change_timeout = NULL;
+
+  g_mutex_lock(&plugin->mutex);
+  connection = plugin->connection;
+  if(connection != NULL) g_object_ref(connection);
+  g_mutex_unlock(&plugin->mutex);
+
+  if(connection != NULL)
+  {
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sas}"));
+
+    g_hash_table_iter_init(&iter, plugin->changes);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      flags = GPOINTER_TO_UINT(value);
+
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("{sas}"));
+      g_variant_builder_add(&builder, "s", (const gchar*)key);
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("as"));
+      if(flags & INFINOTED_PLUGIN_DBUS_CHANGE_ADDED)
+        g_variant_builder_add(&builder, "s", "added");
+      if(flags & INFINOTED_PLUGIN_DBUS_CHANGE_REMOVED)
+        g_variant_builder_add(&builder, "s", "removed");
+      if(flags & INFINOTED_PLUGIN_DBUS_CHANGE_ACL)
+        g_variant_builder_add(&builder, "s", "acl-changed");
+      g_variant_builder_close(&builder);
+      g_variant_builder_close(&builder);
+    }
+
+    error = NULL;
+    g_dbus_connection_emit_signal(
+      connection,
+      NULL,
+      "/org/infinote/infinoted",
+      "org.infinote.server",
+      "nodes_changed",
+      g_variant_new("(@a{sas})", g_variant_builder_end(&builder)),
+      &error
+    );
+
+    if(error != NULL)
+    {
+      g_warning("Failed to emit D-Bus signal: %s", error->message);
+      g_error_free(error);
+    }
+
+    g_object_unref(connection);
+  }
+
+  g_hash_table_remove_all(plugin->changes);
+}
+
+/* Records a change of a node, to be reported with the next nodes_changed
+ * signal. All changes within the change interval are sent together, with
+ * several changes of the same node combined. */
+static void
+infinoted_plugin_dbus_add_change(InfinotedPluginDbus* plugin,
+                                 InfBrowser* browser,
+                                 const InfBrowserIter* iter,
+                                 InfinotedPluginDbusChange change)
+{
+  gchar* path;
+  guint flags;
+
+  path = inf_browser_get_path(browser, iter);
+  flags = GPOINTER_TO_UINT(g_hash_table_lookup(plugin->changes, path));
+  g_hash_table_replace(plugin->changes, path, GUINT_TO_POINTER(flags | change));
+
+  if(plugin->change_timeout == NULL)
+  {
+    plugin->change_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->change_interval,
+      infinoted_plugin_dbus_change_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_plugin_dbus_node_added_cb(InfBrowser* browser,
+                                    const InfBrowserIter* iter,
+                                    InfRequest* request,
+                                    gpointer user_data)
+{
+  infinoted_plugin_dbus_add_change(
+    (InfinotedPluginDbus*)user_data,
+    browser,
+    iter,
+    INFINOTED_PLUGIN_DBUS_CHANGE_ADDED
+  );
+}
+
+static void
+infinoted_plugin_dbus_node_removed_cb(InfBrowser* browser,
+                                      const InfBrowserIter* iter,
+                                      InfRequest* request,
+                                      gpointer user_data)
+{
+  infinoted_plugin_dbus_add_change(
+    (InfinotedPluginDbus*)user_data,
+    browser,
+    iter,
+    INFINOTED_PLUGIN_DBUS_CHANGE_REMOVED
+  );
+}
+
+static void
+infinoted_plugin_dbus_acl_changed_cb(InfBrowser* browser,
+                                     const InfBrowserIter* iter,
+                                     const InfAclSheetSet* sheet_set,
+                                     InfRequest* request,
+                                     gpointer user_data)
+{
+  infinoted_plugin_dbus_add_change(
+    (InfinotedPluginDbus*)user_data,
+    browser,
+    iter,
+    INFINOTED_PLUGIN_DBUS_CHANGE_ACL
+  );
+}
+
+static void
+infinoted_plugin_dbus_metrics_append_label(GString* str,
+                                           const gchar* label,
+                                           const gchar* value)
+{
+  const gchar* c;
+
+  g_string_append_printf(str, "{%s=\"", label);
+  for(c = value; *c != '\0'; ++c)
+  {
+    if(*c == '\\' || *c == '"')
+      g_string_append_c(str, '\\');
+
+    if(*c == '\n')
+      g_string_append(str, "\\n");
+    else
+      g_string_append_c(str, *c);
+  }
+
+  g_string_append(str, "\"}");
+}
+
+static void
+infinoted_plugin_dbus_metrics_append_header(
+  GString* str,
+  const gchar* prefix,
+  const InfinotedPluginDbusCounter* counter)
+{
+  g_string_append_printf(
+    str,
+    "# HELP infinoted_%s_%s%s %s\n"
+    "# TYPE infinoted_%s_%s%s %s\n",
+    prefix, counter->name, counter->monotonic ? "_total" : "",
+    counter->description,
+    prefix, counter->name, counter->monotonic ? "_total" : "",
+    counter->monotonic ? "counter" : "gauge"
+  );
+}
+
+/* Appends the event loop histograms of a standalone IO. Bucket i of
+ * InfStandaloneIoHistogram ends at 2^i - 1, and Prometheus expects
+ * cumulative buckets, with times in seconds. */
+static void
+infinoted_plugin_dbus_metrics_append_histograms(GString* str,
+                                                InfStandaloneIo* io)
+{
+  const InfinotedPluginDbusHistogram* info;
+  InfStandaloneIoHistogram histogram;
+  const gchar* suffix;
+  guint64 cumulative;
+  guint64 bound;
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  guint i;
+  guint j;
+
+  for(i = 0; i < G_N_ELEMENTS(INFINOTED_PLUGIN_DBUS_LOOP_HISTOGRAMS); ++i)
+  {
+    info = &INFINOTED_PLUGIN_DBUS_LOOP_HISTOGRAMS[i];
+    suffix = info->microseconds ? "_seconds" : "";
+
+    inf_standalone_io_get_statistic(io, info->statistic, &histogram);
+
+    g_string_append_printf(
+      str,
+      "# HELP infinoted_loop_%s%s %s\n"
+      "# TYPE infinoted_loop_%s%s histogram\n",
+      info->name, suffix, info->description,
+      info->name, suffix
+    );
+
+    cumulative = 0;
+    for(j = 0; j < INF_STANDALONE_IO_HISTOGRAM_BUCKETS - 1; ++j)
+    {
+      cumulative += histogram.buckets[j];
+      bound = (G_GUINT64_CONSTANT(1) << j) - 1;
+
+      if(info->microseconds)
+        g_ascii_dtostr(buf, sizeof(buf), bound / 1e6);
+      else
+        g_snprintf(buf, sizeof(buf), "%" G_GUINT64_FORMAT, bound);
+
+      g_string_append_printf(
+        str,
+        "infinoted_loop_%s%s_bucket{le=\"%s\"} %" G_GUINT64_FORMAT "\n",
+        info->name, suffix, buf, cumulative
+      );
+    }
+
+    g_string_append_printf(
+      str,
+      "infinoted_loop_%s%s_bucket{le=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+      info->name, suffix, histogram.count
+    );
+
+    if(info->microseconds)
+      g_ascii_dtostr(buf, sizeof(buf), histogram.sum / 1e6);
+    else
+      g_snprintf(buf, sizeof(buf), "%" G_GUINT64_FORMAT, histogram.sum);
+
+    g_string_append_printf(
+      str,
+      "infinoted_loop_%s%s_sum %s\n"
+      "infinoted_loop_%s%s_count %" G_GUINT64_FORMAT "\n",
+      info->name, suffix, buf,
+      info->name, suffix, histogram.count
+    );
+  }
+}
+
+/* Writes all counters in the Prometheus text exposition format, so that the
+ * file can be picked up by the textfile collector of node_exporter. */
+static void
+infinoted_plugin_dbus_write_metrics(InfinotedPluginDbus* plugin)
+{
+  GString* str;
+  GSList* item;
+  InfIo* io;
+  guint n_sessions;
+  guint n_connections;
+  guint64* session_values;
+  guint64* connection_values;
+  gchar** session_names;
+  gchar** connection_names;
+  const InfinotedPluginDbusCounter* counter;
+  guint i;
+  guint j;
+  GError* error;
+
+  n_sessions = g_slist_length(plugin->sessions);
+  n_connections = g_slist_length(plugin->connections);
+
+  session_values = g_new(
+    guint64,
+    n_sessions * INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS
+  );
+  connection_values = g_new(
+    guint64,
+    n_connections * INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS
+  );
+  session_names = g_new(gchar*, n_sessions);
+  connection_names = g_new(gchar*, n_connections);
+
+  for(item = plugin->sessions, j = 0; item != NULL; item = item->next, ++j)
+  {
+    infinoted_plugin_dbus_session_get_counters(
+      item->data,
+      session_values + j * INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS
+    );
+
+    session_names[j] = infinoted_plugin_dbus_session_get_path(item->data);
+  }
+
+  for(item = plugin->connections, j = 0; item != NULL; item = item->next, ++j)
+  {
+    infinoted_plugin_dbus_connection_get_counters(
+      item->data,
+      connection_values + j * INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS
+    );
+
+    connection_names[j] = infinoted_plugin_dbus_connection_get_id(item->data);
+  }
+
+  str = g_string_sized_new(1024);
+
+  for(i = 0; i < INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS; ++i)
+  {
+    counter = &INFINOTED_PLUGIN_DBUS_SESSION_COUNTERS[i];
+    infinoted_plugin_dbus_metrics_append_header(str, "session", counter);
+
+    for(j = 0; j < n_sessions; ++j)
+    {
+      g_string_append_printf(
+        str,
+        "infinoted_session_%s%s",
+        counter->name,
+        counter->monotonic ? "_total" : ""
+      );
+
+      infinoted_plugin_dbus_metrics_append_label(
+        str,
+        "document",
+        session_names[j]
+      );
+
+      g_string_append_printf(
+        str,
+        " %" G_GUINT64_FORMAT "\n",
+        session_values[j * INFINOTED_PLUGIN_DBUS_N_SESSION_COUNTERS + i]
+      );
+    }
+  }
+
+  for(i = 0; i < INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS; ++i)
+  {
+    counter = &INFINOTED_PLUGIN_DBUS_CONNECTION_COUNTERS[i];
+    infinoted_plugin_dbus_metrics_append_header(str, "connection", counter);
+
+    for(j = 0; j < n_connections; ++j)
+    {
+      g_string_append_printf(
+        str,
+        "infinoted_connection_%s%s",
+        counter->name,
+        counter->monotonic ? "_total" : ""
+      );
+
+      infinoted_plugin_dbus_metrics_append_label(
+        str,
+        "connection",
+        connection_names[j]
+      );
+
+      g_string_append_printf(
+        str,
+        " %" G_GUINT64_FORMAT "\n",
+        connection_values[j * INFINOTED_PLUGIN_DBUS_N_CONNECTION_COUNTERS + i]
+      );
+    }
+  }
+
+  io = infinoted_plugin_manager_get_io(plugin->manager);
+  if(INF_IS_STANDALONE_IO(io))
+  {
+    infinoted_plugin_dbus_metrics_append_histograms(
+      str,
+      INF_STANDALONE_IO(io)
+    );
+  }
+
+  error = NULL;
+  if(!g_file_set_contents(plugin->metrics_file, str->str, str->len, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to write metrics to \"%s\": %s"),
+      plugin->metrics_file,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_string_free(str, TRUE);
+
+  for(j = 0; j < n_sessions; ++j)
+    g_free(session_names[j]);
+  for(j = 0; j < n_connections; ++j)
+    g_free(connection_names[j]);
+
+  g_free(session_names);
+  g_free(connection_names);
+  g_free(session_values);
+  g_free(connection_values);
+}
+
+static void
+infinoted_plugin_dbus_metrics_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginDbus* plugin;
+  plugin = (InfinotedPluginDbus*)user_data;
+
+  infinoted_plugin_dbus_write_metrics(plugin);
+
+  plugin->metrics_timeout = inf_io_add_timeout(
+    infinoted_plugin_manager_get_io(plugin->manager),
+    plugin->metrics_interval * 1000,
+    infinoted_plugin_dbus_metrics_timeout_cb,
+    plugin,
+    NULL
+  );
+}
+
+static void
+infinoted_plugin_dbus_navigate_done(InfBrowser* browser,
+                                    const InfBrowserIter* iter,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  InfinotedPluginDbusInvocation* invocation;
+  invocation = (InfinotedPluginDbusInvocation*)user_data;
+
+  if(error != NULL)
+  {
+    g_dbus_method_invocation_return_error_literal(
+      invocation->invocation,
+      G_DBUS_ERROR,
+      G_DBUS_ERROR_FILE_NOT_FOUND,
+      error->message
+    );
+
+    infinoted_plugin_dbus_invocation_free(invocation->plugin, invocation);
+  }
+  else if(strcmp(invocation->method_name, "explore_node") == 0)
+  {
+    infinoted_plugin_dbus_explore_node(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "add_node") == 0)
+  {
+    infinoted_plugin_dbus_add_node(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "remove_node") == 0)
+  {
+    infinoted_plugin_dbus_remove_node(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "query_acl") == 0)
+  {
+    infinoted_plugin_dbus_query_acl(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "set_acl") == 0)
+  {
+    infinoted_plugin_dbus_set_acl(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "check_acl") == 0)
+  {
+    infinoted_plugin_dbus_check_acl(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "explore_tree") == 0)
+  {
+    infinoted_plugin_dbus_explore_tree(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else if(strcmp(invocation->method_name, "query_acl_tree") == 0)
+  {
+    infinoted_plugin_dbus_query_acl_tree(
+      invocation->plugin,
+      invocation,
+      browser,
+      iter
+    );
+  }
+  else
+  {
+    g_assert_not_reached();
+  }
+}
+
+static void
+infinoted_plugin_dbus_main_invocation(gpointer user_data)
+{
+  /* Main thread invocation handler */
+  InfinotedPluginDbusInvocation* invocation;
+  const gchar* path;
+  gsize len;
+  InfinotedPluginUtilNavigateData* navigate;
+
+  invocation = (InfinotedPluginDbusInvocation*)user_data;
+  invocation->plugin->invocations =
+    g_slist_prepend(invocation->plugin->invocations, invocation);
+  g_atomic_int_inc(&invocation->ref_count);
+
+  /* These commands take a path as the first parameter and do not
+   * require that path to be explored. */
+  if(strcmp(invocation->method_name, "remove_node") == 0 ||
+     strcmp(invocation->method_name, "query_acl") == 0 ||
+     strcmp(invocation->method_name, "set_acl") == 0 ||
+     strcmp(invocation->method_name, "check_acl") == 0 ||
+     strcmp(invocation->method_name, "explore_tree") == 0 ||
+     strcmp(invocation->method_name, "query_acl_tree") == 0)
+  {
+    path = g_variant_get_string(
+      g_variant_get_child_value(invocation->parameters, 0),
+      &len
+    );
+
+    navigate = infinoted_plugin_util_navigate_to(
+      INF_BROWSER(infinoted_plugin_manager_get_directory(invocation->plugin->manager)),
+      path,
+      len,
+      FALSE,
+      infinoted_plugin_dbus_navigate_done,
+      invocation
+    );
+    
+    if(navigate != NULL)
+      invocation->navigate = navigate;
+  }
+  /* These commands take a path as the first parameter and DO require that
+   * path to be explored. */
+  else if(strcmp(invocation->method_name, "explore_node") == 0 ||
+          strcmp(invocation->method_name, "add_node") == 0)
+  {
+    path = g_variant_get_string(
+      g_variant_get_child_value(invocation->parameters, 0),
+      &len
+    );
+
+    navigate = infinoted_plugin_util_navigate_to(
+      INF_BROWSER(infinoted_plugin_manager_get_directory(invocation->plugin->manager)),
+      path,
+      len,
+      TRUE,
+      infinoted_plugin_dbus_navigate_done,
+      invocation
+    );
+    
+    if(navigate != NULL)
+      invocation->navigate = navigate;
+  }
+  else if(strcmp(invocation->method_name, "get_statistics") == 0)
+  {
+    infinoted_plugin_dbus_get_statistics(invocation->plugin, invocation);
+  }
+  else if(strcmp(invocation->method_name, "get_session_statistics") == 0)
+  {
+    infinoted_plugin_dbus_get_session_statistics(
+      invocation->plugin,
+      invocation
+    );
+  }
+  else if(strcmp(invocation->method_name, "set_acl_bulk") == 0)
+  {
+    infinoted_plugin_dbus_set_acl_bulk(invocation->plugin, invocation);
+  }
+  else if(strcmp(invocation->method_name, "search") == 0)
+  {
+    infinoted_plugin_dbus_search(invocation->plugin, invocation);
+  }
+  else if(strcmp(invocation->method_name, "get_loop_statistics") == 0)
+  {
+    infinoted_plugin_dbus_get_loop_statistics(invocation->plugin, invocation);
+  }
+  else
+  {
+    g_dbus_method_invocation_return_error_literal(
+      invocation->invocation,
+      G_DBUS_ERROR,
+      G_DBUS_ERROR_UNKNOWN_METHOD,
+      "Not implemented"
+    );
+
+    infinoted_plugin_dbus_invocation_free(invocation->plugin, invocation);
+  }
+}
+
+static void
+infinoted_plugin_dbus_method_call_func(GDBusConnection* connection,
+                                       const gchar* sender,
+                                       const gchar* object_path,
+                                       const gchar* interface_name,
+                                       const gchar* method_name,
+                                       GVariant* parameters,
+                                       GDBusMethodInvocation* invocation,
+                                       gpointer user_data)
+{
+  /* Dispatch to the main thread */
+  InfinotedPluginDbus* plugin;
+  InfinotedPluginDbusInvocation* thread_invocation;
+  InfIo* io;
+
+  plugin = (InfinotedPluginDbus*)user_data;
+  thread_invocation = g_slice_new(InfinotedPluginDbusInvocation);
+
+  thread_invocation->plugin = plugin;
+  thread_invocation->ref_count = 1;
+  thread_invocation->method_name = g_strdup(method_name);
+  thread_invocation->parameters = g_variant_ref(parameters);
+  thread_invocation->invocation = g_object_ref(invocation);
+  thread_invocation->navigate = NULL;
+  thread_invocation->request = NULL;
+  thread_invocation->request_func = NULL;
+
+  io = infinoted_plugin_manager_get_io(plugin->manager);
+
+  inf_io_add_dispatch(
+    io,
+    infinoted_plugin_dbus_main_invocation,
+    thread_invocation,
+    infinoted_plugin_dbus_invocation_unref
+  );
+}
+
+static void
+infinoted_plugin_dbus_bus_acquired_func(GDBusConnection* connection,
+                                        const gchar* name,
+                                        gpointer user_data)
+{
+  InfinotedPluginDbus* plugin;
+  GDBusNodeInfo* node_info;
+  GDBusInterfaceInfo* interface_info;
+  GDBusInterfaceVTable vtable;
+  GError* error;
+
+  node_info = g_dbus_node_info_new_for_xml(
+    infinoted_plugin_dbus_introspection,
+    NULL
+  );
+
+  g_assert(node_info != NULL);
+
+  interface_info = g_dbus_node_info_lookup_interface(
+    node_info,
+    "org.infinote.server"
+  );
+
+  g_assert(interface_info != NULL);
+
+  vtable.method_call = infinoted_plugin_dbus_method_call_func;
+  vtable.get_property = NULL;
+  vtable.set_property = NULL;
+
+  error = NULL;
   g_dbus_connection_register_object(
     connection,
     "/org/infinote/infinoted",
@@ -919,6 +2487,15 @@ infinoted_plugin_dbus_bus_acquired_func(GDBusConnection* connection,
     g_error_free(error);
     error = NULL;
   }
+  else
+  {
+    plugin = (InfinotedPluginDbus*)user_data;
+
+    g_mutex_lock(&plugin->mutex);
+    if(plugin->connection == NULL)
+      plugin->connection = g_object_ref(connection);
+    g_mutex_unlock(&plugin->mutex);
+  }
 
   g_dbus_node_info_unref(node_info);
 }
@@ -982,6 +2559,14 @@ infinoted_plugin_dbus_thread_func(gpointer plugin_info)
   g_bus_unown_name(plugin->id);
   plugin->id = 0;
 
+  g_mutex_lock(&plugin->mutex);
+  if(plugin->connection != NULL)
+  {
+    g_object_unref(plugin->connection);
+    plugin->connection = NULL;
+  }
+  g_mutex_unlock(&plugin->mutex);
+
   /* TODO: This is an enormous hack. Apparently, g_bus_own_name starts some
    * thread internally, and that thread is not stopped by g_bus_unown_name.
    * When the plugin is then unloaded, it leads to a crash because the thread
@@ -1032,7 +2617,18 @@ infinoted_plugin_dbus_info_initialize(gpointer plugin_info)
   plugin->context = NULL;
   plugin->loop = NULL;
   plugin->id = 0;
+  plugin->connection = NULL;
   plugin->invocations = NULL;
+
+  plugin->change_interval = 500;
+  plugin->changes = NULL;
+  plugin->change_timeout = NULL;
+
+  plugin->metrics_file = NULL;
+  plugin->metrics_interval = 60;
+  plugin->metrics_timeout = NULL;
+  plugin->sessions = NULL;
+  plugin->connections = NULL;
 }
 
 static gboolean
@@ -1041,6 +2637,8 @@ infinoted_plugin_dbus_initialize(InfinotedPluginManager* manager,
                                  GError** error)
 {
   InfinotedPluginDbus* plugin;
+  InfdDirectory* directory;
+  InfIo* io;
   gchar* gio_path;
   GModule* gio_module;
 
@@ -1107,6 +2705,56 @@ infinoted_plugin_dbus_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
+  /* The statistics are cheap enough to keep them around for
+   * get_loop_statistics even without a metrics file. */
+  io = infinoted_plugin_manager_get_io(manager);
+  if(INF_IS_STANDALONE_IO(io))
+    g_object_set(G_OBJECT(io), "collect-statistics", TRUE, NULL);
+
+  if(plugin->metrics_file != NULL)
+  {
+    plugin->metrics_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(manager),
+      plugin->metrics_interval * 1000,
+      infinoted_plugin_dbus_metrics_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+
+  if(plugin->change_interval > 0)
+  {
+    plugin->changes = g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      g_free,
+      NULL
+    );
+
+    directory = infinoted_plugin_manager_get_directory(manager);
+
+    g_signal_connect(
+      G_OBJECT(directory),
+      "node-added",
+      G_CALLBACK(infinoted_plugin_dbus_node_added_cb),
+      plugin
+    );
+
+    g_signal_connect(
+      G_OBJECT(directory),
+      "node-removed",
+      G_CALLBACK(infinoted_plugin_dbus_node_removed_cb),
+      plugin
+    );
+
+    g_signal_connect(
+      G_OBJECT(directory),
+      "acl-changed",
+      G_CALLBACK(infinoted_plugin_dbus_acl_changed_cb),
+      plugin
+    );
+  }
+
   return TRUE;
 }
 
@@ -1114,12 +2762,67 @@ static void
 infinoted_plugin_dbus_deinitialize(gpointer plugin_info)
 {
   InfinotedPluginDbus* plugin;
+  InfdDirectory* directory;
+  InfIo* io;
   GMainContext* ctx;
   GSource* source;
   GThread* thread;
 
   plugin = (InfinotedPluginDbus*)plugin_info;
 
+  if(plugin->manager != NULL)
+  {
+    io = infinoted_plugin_manager_get_io(plugin->manager);
+    if(INF_IS_STANDALONE_IO(io))
+      g_object_set(G_OBJECT(io), "collect-statistics", FALSE, NULL);
+  }
+
+  if(plugin->metrics_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->metrics_timeout
+    );
+
+    plugin->metrics_timeout = NULL;
+  }
+
+  if(plugin->changes != NULL)
+  {
+    directory = infinoted_plugin_manager_get_directory(plugin->manager);
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(directory),
+      G_CALLBACK(infinoted_plugin_dbus_node_added_cb),
+      plugin
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(directory),
+      G_CALLBACK(infinoted_plugin_dbus_node_removed_cb),
+      plugin
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(directory),
+      G_CALLBACK(infinoted_plugin_dbus_acl_changed_cb),
+      plugin
+    );
+
+    if(plugin->change_timeout != NULL)
+    {
+      inf_io_remove_timeout(
+        infinoted_plugin_manager_get_io(plugin->manager),
+        plugin->change_timeout
+      );
+
+      plugin->change_timeout = NULL;
+    }
+
+    g_hash_table_destroy(plugin->changes);
+    plugin->changes = NULL;
+  }
+
   if(plugin->thread != NULL)
   {
     g_mutex_lock(&plugin->mutex);
@@ -1158,6 +2861,189 @@ infinoted_plugin_dbus_deinitialize(gpointer plugin_info)
   }
 
   g_free(plugin->bus_name);
+  g_free(plugin->metrics_file);
+}
+
+static void
+infinoted_plugin_dbus_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                               InfAdoptedUser* user,
+                                               InfAdoptedRequest* request,
+                                               gpointer user_data)
+{
+  InfinotedPluginDbusSessionInfo* info;
+  info = (InfinotedPluginDbusSessionInfo*)user_data;
+
+  ++info->requests_received;
+  info->execute_begin = g_get_monotonic_time();
+}
+
+static void
+infinoted_plugin_dbus_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                             InfAdoptedUser* user,
+                                             InfAdoptedRequest* request,
+                                             InfAdoptedRequest* translated,
+                                             const GError* error,
+                                             gpointer user_data)
+{
+  InfinotedPluginDbusSessionInfo* info;
+  info = (InfinotedPluginDbusSessionInfo*)user_data;
+
+  if(error == NULL)
+    ++info->requests_applied;
+  else
+    ++info->requests_failed;
+
+  info->execute_time += g_get_monotonic_time() - info->execute_begin;
+}
+
+static void
+infinoted_plugin_dbus_connection_received_cb(InfXmlConnection* connection,
+                                             xmlNodePtr xml,
+                                             gpointer user_data)
+{
+  ++((InfinotedPluginDbusConnectionInfo*)user_data)->messages_received;
+}
+
+static void
+infinoted_plugin_dbus_connection_sent_cb(InfXmlConnection* connection,
+                                         xmlNodePtr xml,
+                                         gpointer user_data)
+{
+  ++((InfinotedPluginDbusConnectionInfo*)user_data)->messages_sent;
+}
+
+static void
+infinoted_plugin_dbus_connection_added(InfXmlConnection* connection,
+                                       gpointer plugin_info,
+                                       gpointer connection_info)
+{
+  InfinotedPluginDbus* plugin;
+  InfinotedPluginDbusConnectionInfo* info;
+
+  plugin = (InfinotedPluginDbus*)plugin_info;
+  info = (InfinotedPluginDbusConnectionInfo*)connection_info;
+
+  info->plugin = plugin;
+  info->connection = connection;
+  info->messages_received = 0;
+  info->messages_sent = 0;
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(infinoted_plugin_dbus_connection_received_cb),
+    info
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "sent",
+    G_CALLBACK(infinoted_plugin_dbus_connection_sent_cb),
+    info
+  );
+
+  plugin->connections = g_slist_prepend(plugin->connections, info);
+}
+
+static void
+infinoted_plugin_dbus_connection_removed(InfXmlConnection* connection,
+                                         gpointer plugin_info,
+                                         gpointer connection_info)
+{
+  InfinotedPluginDbus* plugin;
+  InfinotedPluginDbusConnectionInfo* info;
+
+  plugin = (InfinotedPluginDbus*)plugin_info;
+  info = (InfinotedPluginDbusConnectionInfo*)connection_info;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(connection),
+    G_CALLBACK(infinoted_plugin_dbus_connection_received_cb),
+    info
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(connection),
+    G_CALLBACK(infinoted_plugin_dbus_connection_sent_cb),
+    info
+  );
+
+  plugin->connections = g_slist_remove(plugin->connections, info);
+}
+
+static void
+infinoted_plugin_dbus_session_added(const InfBrowserIter* iter,
+                                    InfSessionProxy* proxy,
+                                    gpointer plugin_info,
+                                    gpointer session_info)
+{
+  InfinotedPluginDbus* plugin;
+  InfinotedPluginDbusSessionInfo* info;
+  InfSession* session;
+
+  plugin = (InfinotedPluginDbus*)plugin_info;
+  info = (InfinotedPluginDbusSessionInfo*)session_info;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  g_assert(INF_ADOPTED_IS_SESSION(session));
+
+  info->plugin = plugin;
+  info->iter = *iter;
+  info->proxy = proxy;
+  info->algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+  g_object_ref(info->algorithm);
+
+  info->execute_begin = 0;
+  info->requests_received = 0;
+  info->requests_applied = 0;
+  info->requests_failed = 0;
+  info->execute_time = 0;
+
+  g_signal_connect(
+    G_OBJECT(info->algorithm),
+    "begin-execute-request",
+    G_CALLBACK(infinoted_plugin_dbus_begin_execute_request_cb),
+    info
+  );
+
+  g_signal_connect(
+    G_OBJECT(info->algorithm),
+    "end-execute-request",
+    G_CALLBACK(infinoted_plugin_dbus_end_execute_request_cb),
+    info
+  );
+
+  plugin->sessions = g_slist_prepend(plugin->sessions, info);
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_dbus_session_removed(const InfBrowserIter* iter,
+                                      InfSessionProxy* proxy,
+                                      gpointer plugin_info,
+                                      gpointer session_info)
+{
+  InfinotedPluginDbus* plugin;
+  InfinotedPluginDbusSessionInfo* info;
+
+  plugin = (InfinotedPluginDbus*)plugin_info;
+  info = (InfinotedPluginDbusSessionInfo*)session_info;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(info->algorithm),
+    G_CALLBACK(infinoted_plugin_dbus_begin_execute_request_cb),
+    info
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(info->algorithm),
+    G_CALLBACK(infinoted_plugin_dbus_end_execute_request_cb),
+    info
+  );
+
+  g_object_unref(info->algorithm);
+  plugin->sessions = g_slist_remove(plugin->sessions, info);
 }
 
 static gboolean
@@ -1216,6 +3102,37 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_DBUS_OPTIONS[] = {
     0,
     N_("The name to own on the bus. [default=org.infinote.infinoted]"),
     N_("NAME")
+  }, {
+    "metrics-file",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedPluginDbus, metrics_file),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("If given, the session and connection statistics are written to "
+       "this file periodically, in the Prometheus text format."),
+    N_("FILENAME")
+  }, {
+    "metrics-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDbus, metrics_interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Interval in seconds in which the metrics file is written. "
+       "[default=60]"),
+    N_("INTERVAL")
+  }, {
+    "change-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDbus, change_interval),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Interval in milliseconds in which changes to nodes are collected "
+       "before they are reported together with the nodes_changed signal. "
+       "0 disables the signal. [default=500]"),
+    N_("MILLISECONDS")
   }, {
     NULL,
     0,
@@ -1230,16 +3147,16 @@ const InfinotedPlugin INFINOTED_PLUGIN = {
   N_("Exports infinoted functionality on D-Bus"),
   INFINOTED_PLUGIN_DBUS_OPTIONS,
   sizeof(InfinotedPluginDbus),
-  0,
-  0,
-  NULL,
+  sizeof(InfinotedPluginDbusConnectionInfo),
+  sizeof(InfinotedPluginDbusSessionInfo),
+  "InfAdoptedSession",
   infinoted_plugin_dbus_info_initialize,
   infinoted_plugin_dbus_initialize,
   infinoted_plugin_dbus_deinitialize,
-  NULL,
-  NULL,
-  NULL,
-  NULL
+  infinoted_plugin_dbus_connection_added,
+  infinoted_plugin_dbus_connection_removed,
+  infinoted_plugin_dbus_session_added,
+  infinoted_plugin_dbus_session_removed
 };
 
 /* vim:set et sw=2 ts=2: */
@@ -25,11 +25,26 @@
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-buffer.h>
 
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-file-util.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <glib/gstdio.h>
+
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+
+#ifndef G_OS_WIN32
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#else
+# include <io.h>
+# include <fcntl.h>
+#endif
 
 typedef struct _InfinotedPluginDirectorySync InfinotedPluginDirectorySync;
 struct _InfinotedPluginDirectorySync {
@@ -37,8 +52,17 @@ struct _InfinotedPluginDirectorySync {
   gchar* directory;
   guint interval;
   gchar* hook;
+  gboolean patch;
+
+  /* Writes running in worker threads, and the write that was started last
+   * for each file name */
+  GSList* writes;
+  GHashTable* latest_writes;
 };
 
+typedef struct _InfinotedPluginDirectorySyncWrite
+  InfinotedPluginDirectorySyncWrite;
+
 typedef struct _InfinotedPluginDirectorySyncSessionInfo
   InfinotedPluginDirectorySyncSessionInfo;
 struct _InfinotedPluginDirectorySyncSessionInfo {
@@ -46,6 +70,39 @@ struct _InfinotedPluginDirectorySyncSessionInfo {
   InfBrowserIter iter;
   InfSessionProxy* proxy;
   InfIoTimeout* timeout;
+
+  /* The write running for this session, if any, and whether to start
+   * another one once it has finished */
+  InfinotedPluginDirectorySyncWrite* write;
+  gboolean resave;
+
+  /* Character offset of the first change since the last write was started,
+   * or G_MAXUINT if there was none, and the size of the file as it was
+   * written last, if known */
+  guint dirty_begin;
+  gboolean file_size_known;
+  gsize file_size;
+};
+
+struct _InfinotedPluginDirectorySyncWrite {
+  InfinotedPluginDirectorySync* plugin;
+  /* NULL when the session has been removed while writing */
+  InfinotedPluginDirectorySyncSessionInfo* info;
+  InfAsyncOperation* operation;
+
+  gchar* filename;
+  gchar* temp_path;
+  gchar* path;
+
+  gchar* content;
+  gsize bytes;
+
+  /* When patching the file in place, the file descriptor opened for it and
+   * the byte offset from which on to rewrite it */
+  int fd;
+  gsize offset;
+
+  GError* error;
 };
 
 static const gchar*
@@ -209,27 +266,185 @@ infinoted_plugin_directory_sync_remove(
   return result;
 }
 
+static void
+infinoted_plugin_directory_sync_set_errno(
+  InfinotedPluginDirectorySyncWrite* write,
+  int code)
+{
+  g_set_error_literal(
+    &write->error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
+/* Writes the content of write in the worker thread, or in the main thread
+ * when the document is saved synchronously. If write->fd is set, only the
+ * part of the file starting at write->offset is rewritten in place.
+ * Otherwise, the content is written to a temporary file, which is renamed
+ * over the target in the main thread by
+ * infinoted_plugin_directory_sync_finish_write(). */
+static void
+infinoted_plugin_directory_sync_write_file(
+  InfinotedPluginDirectorySyncWrite* write)
+{
+  gsize len;
+  FILE* file;
+  int fd;
+  int save_errno;
+
+  if(write->fd != -1)
+  {
+    fd = write->fd;
+    write->fd = -1;
+
+#ifndef G_OS_WIN32
+    if(lseek(fd, write->offset, SEEK_SET) == (off_t)-1)
+    {
+      save_errno = errno;
+      close(fd);
+      infinoted_plugin_directory_sync_set_errno(write, save_errno);
+      return;
+    }
+#endif
+  }
+  else
+  {
+    write->temp_path = g_strconcat(write->filename, ".tmp-XXXXXX", NULL);
+    fd = g_mkstemp_full(write->temp_path, O_WRONLY, 0644);
+    if(fd == -1)
+    {
+      save_errno = errno;
+      g_free(write->temp_path);
+      write->temp_path = NULL;
+      infinoted_plugin_directory_sync_set_errno(write, save_errno);
+      return;
+    }
+  }
+
+  file = fdopen(fd, "wb");
+  if(file == NULL)
+  {
+    save_errno = errno;
+    close(fd);
+    infinoted_plugin_directory_sync_set_errno(write, save_errno);
+    return;
+  }
+
+  len = write->bytes - write->offset;
+  if(fwrite(write->content + write->offset, 1, len, file) != len ||
+     fflush(file) != 0)
+  {
+    save_errno = errno;
+    fclose(file);
+    infinoted_plugin_directory_sync_set_errno(write, save_errno);
+    return;
+  }
+
+#ifndef G_OS_WIN32
+  /* Cut off what is left of the previous content if it was longer */
+  if(write->temp_path == NULL && ftruncate(fd, write->bytes) != 0)
+  {
+    save_errno = errno;
+    fclose(file);
+    infinoted_plugin_directory_sync_set_errno(write, save_errno);
+    return;
+  }
+#endif
+
+  if(fclose(file) != 0)
+  {
+    save_errno = errno;
+    infinoted_plugin_directory_sync_set_errno(write, save_errno);
+    return;
+  }
+}
+
+/* Runs in the worker thread if the write is cancelled while running, so
+ * this must not touch the plugin. */
+static void
+infinoted_plugin_directory_sync_write_free(gpointer data)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  write = (InfinotedPluginDirectorySyncWrite*)data;
+
+  /* The temporary file is still there if the write has
+   * failed, has been cancelled, or has been superseded. */
+  if(write->temp_path != NULL)
+  {
+    g_unlink(write->temp_path);
+    g_free(write->temp_path);
+  }
+
+  if(write->fd != -1)
+    close(write->fd);
+
+  if(write->error != NULL)
+    g_error_free(write->error);
+
+  g_free(write->filename);
+  g_free(write->content);
+  g_free(write->path);
+  g_slice_free(InfinotedPluginDirectorySyncWrite, write);
+}
+
+static gboolean
+infinoted_plugin_directory_sync_count_view_func(gconstpointer text,
+                                                gsize bytes,
+                                                guint length,
+                                                guint author,
+                                                gpointer user_data)
+{
+  ((InfinotedPluginDirectorySyncWrite*)user_data)->bytes += bytes;
+  return TRUE;
+}
+
 static gboolean
-infinoted_plugin_directory_sync_save(
+infinoted_plugin_directory_sync_copy_view_func(gconstpointer text,
+                                               gsize bytes,
+                                               guint length,
+                                               guint author,
+                                               gpointer user_data)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  write = (InfinotedPluginDirectorySyncWrite*)user_data;
+
+  memcpy(write->content + write->bytes, text, bytes);
+  write->bytes += bytes;
+  return TRUE;
+}
+
+/* Takes a snapshot of the document of info to be written into its file.
+ * The write is registered as the latest one of that file, so that writes
+ * still running for it do not replace it when they finish. If patch is
+ * TRUE and the file still has the content that was written last, only the
+ * part starting at the first change since then is rewritten. */
+static InfinotedPluginDirectorySyncWrite*
+infinoted_plugin_directory_sync_prepare_write(
   InfinotedPluginDirectorySyncSessionInfo* info,
+  gboolean patch,
   GError** error)
 {
+  InfinotedPluginDirectorySync* plugin;
+  InfinotedPluginDirectorySyncWrite* write;
   gchar* filename;
   gchar* utf8;
 
   InfSession* session;
   InfTextBuffer* buffer;
-  InfTextChunk* chunk;
-  gchar* content;
-  gsize bytes;
-  gchar* path;
-  gchar* argv[4];
+  guint length;
+#ifndef G_OS_WIN32
+  struct stat st;
+#endif
+
+  plugin = info->plugin;
 
   if(info->timeout != NULL)
   {
     inf_io_remove_timeout(
       infd_directory_get_io(
-        infinoted_plugin_manager_get_directory(info->plugin->manager)
+        infinoted_plugin_manager_get_directory(plugin->manager)
       ),
       info->timeout
     );
@@ -238,12 +453,12 @@ infinoted_plugin_directory_sync_save(
   }
 
   filename = infinoted_plugin_directory_sync_get_filename(
-    info->plugin,
+    plugin,
     &info->iter,
     error
   );
 
-  if(filename == NULL) return FALSE;
+  if(filename == NULL) return NULL;
 
   if(infinoted_util_create_dirname(filename, error) == FALSE)
   {
@@ -257,54 +472,149 @@ infinoted_plugin_directory_sync_save(
     );
 
     g_free(utf8);
-    return FALSE;
+    return NULL;
   }
 
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  length = inf_text_buffer_get_length(buffer);
+
+  write = g_slice_new(InfinotedPluginDirectorySyncWrite);
+  write->plugin = plugin;
+  write->info = info;
+  write->operation = NULL;
+  write->filename = filename;
+  write->temp_path = NULL;
+  write->offset = 0;
+  write->fd = -1;
+  write->error = NULL;
+
+  write->path = inf_browser_get_path(
+    INF_BROWSER(infinoted_plugin_manager_get_directory(plugin->manager)),
+    &info->iter
+  );
 
-  /* TODO: Use the iterator API here, which should be less expensive */
-  chunk = inf_text_buffer_get_slice(
+  /* The snapshot is written in a worker thread, so it needs to be copied.
+   * It is copied only once, directly from the buffer, instead of into a
+   * chunk first. */
+  write->bytes = 0;
+  inf_text_buffer_view(
     buffer,
     0,
-    inf_text_buffer_get_length(buffer)
+    length,
+    infinoted_plugin_directory_sync_count_view_func,
+    write
   );
 
-  content = inf_text_chunk_get_text(chunk, &bytes);
-  inf_text_chunk_free(chunk);
+  write->content = g_malloc(write->bytes);
+  write->bytes = 0;
+  inf_text_buffer_view(
+    buffer,
+    0,
+    length,
+    infinoted_plugin_directory_sync_copy_view_func,
+    write
+  );
 
-  if(!g_file_set_contents(filename, content, bytes, error))
+#ifndef G_OS_WIN32
+  /* The file can only be patched if nobody else has changed it since we
+   * wrote it, and the text before the first change is still the same. The
+   * byte offset of that change is only known for UTF-8. The file is opened
+   * here, so that the patch goes into this file even if it is replaced
+   * before the worker thread gets to it. */
+  if(patch == TRUE && info->file_size_known == TRUE &&
+     strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
   {
-    utf8 = infinoted_plugin_directory_sync_filename_to_utf8(filename);
-    g_free(filename);
+    write->fd = open(filename, O_WRONLY | O_NOFOLLOW);
+    if(write->fd != -1 &&
+       (fstat(write->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (gsize)st.st_size != info->file_size))
+    {
+      close(write->fd);
+      write->fd = -1;
+    }
 
-    g_prefix_error(
+    if(write->fd != -1)
+    {
+      write->offset = g_utf8_offset_to_pointer(
+        write->content,
+        MIN(info->dirty_begin, length)
+      ) - write->content;
+    }
+  }
+#endif
+
+  g_object_unref(session);
+
+  /* The changes up to now are part of this write */
+  info->dirty_begin = G_MAXUINT;
+
+  g_hash_table_replace(plugin->latest_writes, write->filename, write);
+  return write;
+}
+
+/* Completes write in the main thread. If it has written a temporary file,
+ * that replaces the document's file unless another write to the same file
+ * has been started in the meanwhile. Then the hook is run. */
+static gboolean
+infinoted_plugin_directory_sync_finish_write(
+  InfinotedPluginDirectorySyncWrite* write,
+  GError** error)
+{
+  InfinotedPluginDirectorySync* plugin;
+  gchar* utf8;
+  gchar* argv[4];
+  int save_errno;
+
+  plugin = write->plugin;
+
+  if(g_hash_table_lookup(plugin->latest_writes, write->filename) != write)
+  {
+    /* Superseded; the newer write reports any errors */
+    return TRUE;
+  }
+
+  g_hash_table_remove(plugin->latest_writes, write->filename);
+
+  if(write->error == NULL && write->temp_path != NULL)
+  {
+#ifdef G_OS_WIN32
+    /* rename() does not replace existing files on Windows */
+    g_unlink(write->filename);
+#endif
+    if(g_rename(write->temp_path, write->filename) == 0)
+    {
+      g_free(write->temp_path);
+      write->temp_path = NULL;
+    }
+    else
+    {
+      save_errno = errno;
+      infinoted_plugin_directory_sync_set_errno(write, save_errno);
+    }
+  }
+
+  if(write->error != NULL)
+  {
+    utf8 = infinoted_plugin_directory_sync_filename_to_utf8(write->filename);
+
+    g_propagate_prefixed_error(
       error,
+      write->error,
       _("Failed to write session for path \"%s\": "),
       utf8
     );
 
-    g_free(content);
-    g_object_unref(session);
+    write->error = NULL;
     g_free(utf8);
     return FALSE;
   }
 
-  g_free(content);
-  g_object_unref(session);
-
-  if(info->plugin->hook != NULL)
+  if(plugin->hook != NULL)
   {
-    path = inf_browser_get_path(
-      INF_BROWSER(
-        infinoted_plugin_manager_get_directory(info->plugin->manager)
-      ),
-      &info->iter
-    );
-
-    argv[0] = info->plugin->hook;
-    argv[1] = path;
-    argv[2] = filename;
+    argv[0] = plugin->hook;
+    argv[1] = write->path;
+    argv[2] = write->filename;
     argv[3] = NULL;
 
     if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
@@ -313,48 +623,89 @@ infinoted_plugin_directory_sync_save(
       g_prefix_error(
         error,
         _("Failed to execute hook \"%s\": "),
-        info->plugin->hook
+        plugin->hook
       );
 
-      g_free(path);
-      g_free(filename);
       return FALSE;
     }
-
-    g_free(path);
   }
 
-  g_free(filename);
   return TRUE;
 }
 
 static void
-infinoted_plugin_directory_sync_save_with_error(
+infinoted_plugin_directory_sync_report_error(
   InfinotedPluginDirectorySyncSessionInfo* info,
+  const GError* error,
   gboolean retry)
 {
+  if(retry)
+  {
+    /* TODO: Provide a simple error to write a secondary log message... we
+     * could also make use of such an API in the logging plugin. */
+    infinoted_log_error(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("%s\n\tWill retry in %u seconds"),
+      error->message,
+      info->plugin->interval
+    );
+
+    if(info->timeout == NULL)
+      infinoted_plugin_directory_sync_start(info);
+  }
+  else
+  {
+    infinoted_log_error(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("%s"),
+      error->message
+    );
+  }
+}
+
+static void
+infinoted_plugin_directory_sync_save_async(
+  InfinotedPluginDirectorySyncSessionInfo* info);
+
+static void
+infinoted_plugin_directory_sync_run_func(gpointer* run_data,
+                                         GDestroyNotify* run_notify,
+                                         gpointer user_data)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  write = (InfinotedPluginDirectorySyncWrite*)user_data;
+
+  *run_data = write;
+  *run_notify = infinoted_plugin_directory_sync_write_free;
+
+  infinoted_plugin_directory_sync_write_file(write);
+}
+
+static void
+infinoted_plugin_directory_sync_done_func(gpointer run_data,
+                                          gpointer user_data)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  InfinotedPluginDirectorySyncSessionInfo* info;
   GError* error;
 
+  write = (InfinotedPluginDirectorySyncWrite*)run_data;
+  info = write->info;
+
+  write->plugin->writes = g_slist_remove(write->plugin->writes, write);
+
   error = NULL;
-  if(!infinoted_plugin_directory_sync_save(info, &error))
+  if(!infinoted_plugin_directory_sync_finish_write(write, &error))
   {
-    if(retry)
+    if(info != NULL)
     {
-      /* TODO: Provide a simple error to write a secondary log message... we
-       * could also make use of such an API in the logging plugin. */
-      infinoted_log_error(
-        infinoted_plugin_manager_get_log(info->plugin->manager),
-        _("%s\n\tWill retry in %u seconds"),
-        error->message,
-        info->plugin->interval
-      );
-
-      infinoted_plugin_directory_sync_start(info);
+      info->file_size_known = FALSE;
+      infinoted_plugin_directory_sync_report_error(info, error, TRUE);
     }
     else
     {
       infinoted_log_error(
-        infinoted_plugin_manager_get_log(info->plugin->manager),
+        infinoted_plugin_manager_get_log(write->plugin->manager),
         _("%s"),
         error->message
       );
@@ -362,6 +713,97 @@ infinoted_plugin_directory_sync_save_with_error(
 
     g_error_free(error);
   }
+  else if(info != NULL)
+  {
+    info->file_size_known = TRUE;
+    info->file_size = write->bytes;
+  }
+
+  /* If the document has been changed and its save interval has expired
+   * while this write was running, then write it again right away. */
+  if(info != NULL)
+  {
+    info->write = NULL;
+    if(info->resave == TRUE && info->timeout == NULL)
+      infinoted_plugin_directory_sync_save_async(info);
+    info->resave = FALSE;
+  }
+}
+
+/* Writes the document of info into its file in a worker thread. If a write
+ * for it is still running, then it is written once more when that one has
+ * finished, so that there is only one write per document at a time. */
+static void
+infinoted_plugin_directory_sync_save_async(
+  InfinotedPluginDirectorySyncSessionInfo* info)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  GError* error;
+
+  if(info->write != NULL)
+  {
+    info->resave = TRUE;
+    return;
+  }
+
+  error = NULL;
+  write = infinoted_plugin_directory_sync_prepare_write(
+    info,
+    info->plugin->patch,
+    &error
+  );
+
+  if(write != NULL)
+  {
+    write->operation = inf_async_operation_new(
+      infinoted_plugin_manager_get_io(info->plugin->manager),
+      infinoted_plugin_directory_sync_run_func,
+      infinoted_plugin_directory_sync_done_func,
+      write
+    );
+
+    if(inf_async_operation_start(write->operation, &error))
+    {
+      info->write = write;
+      info->plugin->writes = g_slist_prepend(info->plugin->writes, write);
+      return;
+    }
+
+    g_hash_table_remove(info->plugin->latest_writes, write->filename);
+    inf_async_operation_free(write->operation);
+    infinoted_plugin_directory_sync_write_free(write);
+  }
+
+  info->file_size_known = FALSE;
+  infinoted_plugin_directory_sync_report_error(info, error, TRUE);
+  g_error_free(error);
+}
+
+/* Writes the document of info into its file right away. This replaces the
+ * file, so that a patch that is still being applied by a worker thread
+ * goes into the old file. */
+static void
+infinoted_plugin_directory_sync_save_sync(
+  InfinotedPluginDirectorySyncSessionInfo* info)
+{
+  InfinotedPluginDirectorySyncWrite* write;
+  GError* error;
+
+  error = NULL;
+  write = infinoted_plugin_directory_sync_prepare_write(info, FALSE, &error);
+
+  if(write != NULL)
+  {
+    infinoted_plugin_directory_sync_write_file(write);
+    infinoted_plugin_directory_sync_finish_write(write, &error);
+    infinoted_plugin_directory_sync_write_free(write);
+  }
+
+  if(error != NULL)
+  {
+    infinoted_plugin_directory_sync_report_error(info, error, FALSE);
+    g_error_free(error);
+  }
 }
 
 static void
@@ -372,7 +814,7 @@ infinoted_plugin_directory_sync_timeout_cb(gpointer user_data)
 
   info->timeout = NULL;
 
-  infinoted_plugin_directory_sync_save_with_error(info, TRUE);
+  infinoted_plugin_directory_sync_save_async(info);
 }
 
 static void
@@ -385,6 +827,9 @@ infinoted_plugin_directory_sync_buffer_text_inserted_cb(InfTextBuffer* buffer,
   InfinotedPluginDirectorySyncSessionInfo* info;
   info = (InfinotedPluginDirectorySyncSessionInfo*)user_data;
 
+  if(pos < info->dirty_begin)
+    info->dirty_begin = pos;
+
   if(info->timeout == NULL)
     infinoted_plugin_directory_sync_start(info);
 }
@@ -399,6 +844,9 @@ infinoted_plugin_directory_sync_buffer_text_erased_cb(InfTextBuffer* buffer,
   InfinotedPluginDirectorySyncSessionInfo* info;
   info = (InfinotedPluginDirectorySyncSessionInfo*)user_data;
 
+  if(pos < info->dirty_begin)
+    info->dirty_begin = pos;
+
   if(info->timeout == NULL)
     infinoted_plugin_directory_sync_start(info);
 }
@@ -437,6 +885,9 @@ infinoted_plugin_directory_sync_info_initialize(gpointer plugin_info)
   plugin->directory = NULL;
   plugin->interval = 0;
   plugin->hook = NULL;
+  plugin->patch = FALSE;
+  plugin->writes = NULL;
+  plugin->latest_writes = NULL;
 }
 
 static gboolean
@@ -448,6 +899,7 @@ infinoted_plugin_directory_sync_initialize(InfinotedPluginManager* manager,
   plugin = (InfinotedPluginDirectorySync*)plugin_info;
 
   plugin->manager = manager;
+  plugin->latest_writes = g_hash_table_new(g_str_hash, g_str_equal);
 
   if(inf_file_util_create_directory(plugin->directory, 0777, error) == FALSE)
     return FALSE;
@@ -466,8 +918,24 @@ static void
 infinoted_plugin_directory_sync_deinitialize(gpointer plugin_info)
 {
   InfinotedPluginDirectorySync* plugin;
+  InfinotedPluginDirectorySyncWrite* write;
+
   plugin = (InfinotedPluginDirectorySync*)plugin_info;
 
+  /* Sessions have been removed already, so that all documents have been
+   * saved, and remaining writes are superseded or failed anyway. */
+  while(plugin->writes != NULL)
+  {
+    write = (InfinotedPluginDirectorySyncWrite*)plugin->writes->data;
+    plugin->writes = g_slist_delete_link(plugin->writes, plugin->writes);
+
+    /* This might free the write already */
+    inf_async_operation_free(write->operation);
+  }
+
+  if(plugin->latest_writes != NULL)
+    g_hash_table_destroy(plugin->latest_writes);
+
   g_signal_handlers_disconnect_by_func(
     G_OBJECT(infinoted_plugin_manager_get_directory(plugin->manager)),
     G_CALLBACK(infinoted_plugin_directory_sync_node_removed_cb),
@@ -499,6 +967,11 @@ infinoted_plugin_directory_sync_session_added(const InfBrowserIter* iter,
   info->iter = *iter;
   info->proxy = proxy;
   info->timeout = NULL;
+  info->write = NULL;
+  info->resave = FALSE;
+  info->dirty_begin = G_MAXUINT;
+  info->file_size_known = FALSE;
+  info->file_size = 0;
   g_object_ref(proxy);
 
   name_okay = TRUE;
@@ -550,7 +1023,7 @@ infinoted_plugin_directory_sync_session_added(const InfBrowserIter* iter,
       info
     );
 
-    infinoted_plugin_directory_sync_save_with_error(info, TRUE);
+    infinoted_plugin_directory_sync_save_async(info);
 
     g_object_unref(session);
   }
@@ -568,9 +1041,18 @@ infinoted_plugin_directory_sync_session_removed(const InfBrowserIter* iter,
 
   info = (InfinotedPluginDirectorySyncSessionInfo*)session_info;
 
-  /* If a directory sync was scheduled for this session, then do it now */
-  if(info->timeout != NULL)
-    infinoted_plugin_directory_sync_save_with_error(info, FALSE);
+  /* If a directory sync was scheduled for this session, or the document
+   * has been changed while it was being written, then do it now. A write
+   * that is still running finishes on its own, but is replaced by this one
+   * since that is more recent. */
+  if(info->timeout != NULL || (info->write != NULL && info->resave == TRUE))
+    infinoted_plugin_directory_sync_save_sync(info);
+
+  if(info->write != NULL)
+  {
+    info->write->info = NULL;
+    info->write = NULL;
+  }
 
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
@@ -620,6 +1102,17 @@ INFINOTED_PLUGIN_DIRECTORY_SYNC_OPTIONS[] = {
     0,
     N_("Command to run after having saved a document."),
     N_("PROGRAM")
+  }, {
+    "patch",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginDirectorySync, patch),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Rewrite only the part of a file from the first change onwards, "
+       "instead of replacing the whole file. This is faster for large "
+       "documents, but other programs might see a partly written file."),
+    NULL
   }, {
     NULL,
     0,
@@ -18,6 +18,7 @@
  */
 
 #include "util/infinoted-plugin-util-navigate-browser.h"
+#include "util/infinoted-plugin-util-search-index.h"
 
 #include <infinoted/infinoted-plugin-manager.h>
 #include <infinoted/infinoted-parameter.h>
@@ -54,6 +55,10 @@ struct _InfinotedPluginDocumentStream {
   InfNativeSocket socket;
   InfIoWatch* watch;
   GSList* streams;
+
+  gint flush_interval;
+  gint flush_size;
+  gint max_queue_size;
 };
 
 typedef struct _InfinotedPluginDocumentStreamQueue
@@ -76,6 +81,20 @@ struct _InfinotedPluginDocumentStreamStream {
   InfinotedPluginDocumentStreamQueue send_queue;
   InfinotedPluginDocumentStreamQueue recv_queue;
 
+  /* Whether we wait for the socket to become writable again */
+  gboolean blocked;
+  /* Flushes the send queue when batching is enabled */
+  InfIoTimeout* flush_timeout;
+  /* Set when the send queue exceeded max-queue-size. Changes to the
+   * document are dropped until the queue has drained, and then the whole
+   * document is sent again. */
+  gboolean resync_pending;
+
+  /* Pending entries of a get-documents command */
+  GSList* fetches;
+  /* Number of fetches, plus one while the command is being processed */
+  guint n_fetches;
+
   gchar* username;
 
   /* set if either subscribe_request or proxy are set */
@@ -89,6 +108,16 @@ struct _InfinotedPluginDocumentStreamStream {
   InfBuffer* buffer;
 };
 
+typedef struct _InfinotedPluginDocumentStreamFetch
+  InfinotedPluginDocumentStreamFetch;
+struct _InfinotedPluginDocumentStreamFetch {
+  InfinotedPluginDocumentStreamStream* stream;
+  guint32 index;
+
+  InfinotedPluginUtilNavigateData* navigate_handle;
+  InfRequest* subscribe_request;
+};
+
 static void
 infinoted_plugin_document_stream_queue_initialize(
   InfinotedPluginDocumentStreamQueue* queue)
@@ -198,6 +227,28 @@ infinoted_plugin_document_stream_send(
   const void* data,
   gsize len);
 
+/* Returns FALSE if the change should not be sent because the send queue has
+ * grown too large. The document is sent again as a whole once the queue
+ * has drained. This is called only between two messages. */
+static gboolean
+infinoted_plugin_document_stream_check_queue(
+  InfinotedPluginDocumentStreamStream* stream)
+{
+  gint max_queue_size;
+
+  if(stream->resync_pending)
+    return FALSE;
+
+  max_queue_size = stream->plugin->max_queue_size;
+  if(max_queue_size > 0 && stream->send_queue.len > (gsize)max_queue_size)
+  {
+    stream->resync_pending = TRUE;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static void
 infinoted_plugin_document_stream_send_error(
   InfinotedPluginDocumentStreamStream* stream,
@@ -214,6 +265,29 @@ infinoted_plugin_document_stream_send_error(
   if(!infinoted_plugin_document_stream_send(stream, message, errlen)) return;
 }
 
+/* Sends each piece of text as it is, without copying it first. Stops as
+ * soon as the stream went away. */
+static gboolean
+infinoted_plugin_document_stream_send_view_func(gconstpointer text,
+                                                gsize bytes,
+                                                guint length,
+                                                guint author,
+                                                gpointer user_data)
+{
+  return infinoted_plugin_document_stream_send(user_data, text, bytes);
+}
+
+static gboolean
+infinoted_plugin_document_stream_count_view_func(gconstpointer text,
+                                                 gsize bytes,
+                                                 guint length,
+                                                 guint author,
+                                                 gpointer user_data)
+{
+  *(gsize*)user_data += bytes;
+  return TRUE;
+}
+
 static void
 infinoted_plugin_document_stream_text_inserted_cb(InfTextBuffer* buffer,
                                                   guint pos,
@@ -224,17 +298,16 @@ infinoted_plugin_document_stream_text_inserted_cb(InfTextBuffer* buffer,
   InfinotedPluginDocumentStreamStream* stream;
   guint32 comm;
   guint32 pos32;
-  gsize bytes;
   guint32 bytes32;
-  gpointer text;
   gboolean alive;
 
   stream = (InfinotedPluginDocumentStreamStream*)user_data;
-  text = inf_text_chunk_get_text(chunk, &bytes);
+  if(!infinoted_plugin_document_stream_check_queue(stream))
+    return;
 
   comm = 3; /* INSERT */
   pos32 = (guint32)pos;
-  bytes32 = (guint32)bytes;
+  bytes32 = (guint32)inf_text_chunk_get_bytes(chunk);
 
   alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
   if(alive)
@@ -242,9 +315,15 @@ infinoted_plugin_document_stream_text_inserted_cb(InfTextBuffer* buffer,
   if(alive)
     alive = infinoted_plugin_document_stream_send(stream, &bytes32, 4);
   if(alive)
-    alive = infinoted_plugin_document_stream_send(stream, text, bytes);
-
-  g_free(text);
+  {
+    inf_text_chunk_view(
+      chunk,
+      0,
+      inf_text_chunk_get_length(chunk),
+      infinoted_plugin_document_stream_send_view_func,
+      stream
+    );
+  }
 }
 
 static void
@@ -261,6 +340,8 @@ infinoted_plugin_document_stream_text_erased_cb(InfTextBuffer* buffer,
   gboolean alive;
 
   stream = (InfinotedPluginDocumentStreamStream*)user_data;
+  if(!infinoted_plugin_document_stream_check_queue(stream))
+    return;
 
   comm = 4; /* ERASE */
   pos32 = (guint32)pos;
@@ -314,7 +395,8 @@ infinoted_plugin_document_stream_chat_add_message_cb(InfChatBuffer* buffer,
   InfinotedPluginDocumentStreamStream* stream;
   stream = (InfinotedPluginDocumentStreamStream*)user_data;
 
-  infinoted_plugin_document_stream_chat_send_message(stream, ms);
+  if(infinoted_plugin_document_stream_check_queue(stream))
+    infinoted_plugin_document_stream_chat_send_message(stream, ms);
 }
 
 static void
@@ -367,47 +449,86 @@ infinoted_plugin_document_stream_sync_chat(
   }
 }
 
+static gboolean
+infinoted_plugin_document_stream_sync_text_view_func(gconstpointer text,
+                                                     gsize bytes,
+                                                     guint length,
+                                                     guint author,
+                                                     gpointer user_data)
+{
+  InfinotedPluginDocumentStreamStream* stream;
+  guint32 comm;
+  guint32 len;
+
+  stream = (InfinotedPluginDocumentStreamStream*)user_data;
+  comm = 1; /* SYNC */
+  len = (guint32)bytes;
+
+  if(!infinoted_plugin_document_stream_send(stream, &comm, 4))
+    return FALSE;
+  if(!infinoted_plugin_document_stream_send(stream, &len, 4))
+    return FALSE;
+  return infinoted_plugin_document_stream_send(stream, text, bytes);
+}
+
 static void
 infinoted_plugin_document_stream_sync_text(
   InfinotedPluginDocumentStreamStream* stream)
 {
   InfTextBuffer* buffer;
-  InfTextBufferIter* iter;
-  gpointer text;
   guint32 comm;
-  guint32 len;
   gboolean alive;
 
   buffer = INF_TEXT_BUFFER(stream->buffer);
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  alive = TRUE;
 
-  if(iter != NULL)
+  alive = inf_text_buffer_view(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer),
+    infinoted_plugin_document_stream_sync_text_view_func,
+    stream
+  );
+
+  if(alive)
   {
-    do
-    {
-      comm = 1; /* SYNC */
-      len = inf_text_buffer_iter_get_bytes(buffer, iter);
+    comm = 2; /* SYNC DONE */
+    alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
+  }
+}
 
-      alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
-      if(!alive) break;
+static void
+infinoted_plugin_document_stream_resync(
+  InfinotedPluginDocumentStreamStream* stream)
+{
+  guint32 comm;
 
-      alive = infinoted_plugin_document_stream_send(stream, &len, 4);
-      if(!alive) break;
+  g_assert(stream->resync_pending);
+  g_assert(stream->buffer != NULL);
 
-      text = inf_text_buffer_iter_get_text(buffer, iter);
-      alive = infinoted_plugin_document_stream_send(stream, text, len);
-      g_free(text);
-      if(!alive) break;
-    } while(inf_text_buffer_iter_next(buffer, iter));
+  stream->resync_pending = FALSE;
 
-    inf_text_buffer_destroy_iter(buffer, iter);
-  }
+  /* The client discards what it has and receives the document again, like
+   * when the stream was opened. For chats, this means all messages. */
+  comm = 7; /* RESYNC */
+  if(!infinoted_plugin_document_stream_send(stream, &comm, 4))
+    return;
 
-  if(alive)
+  if(INF_TEXT_IS_BUFFER(stream->buffer))
+    infinoted_plugin_document_stream_sync_text(stream);
+  else if(INF_IS_CHAT_BUFFER(stream->buffer))
+    infinoted_plugin_document_stream_sync_chat(stream);
+}
+
+/* Resynchronizes the document once the send queue has drained to half of
+ * the maximum size. */
+static void
+infinoted_plugin_document_stream_check_resync(
+  InfinotedPluginDocumentStreamStream* stream)
+{
+  if(stream->resync_pending &&
+     stream->send_queue.len <= (gsize)stream->plugin->max_queue_size / 2)
   {
-    comm = 2; /* SYNC DONE */
-    alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
+    infinoted_plugin_document_stream_resync(stream);
   }
 }
 
@@ -516,6 +637,7 @@ infinoted_plugin_document_stream_stop(
 
     g_object_unref(stream->buffer);
     stream->buffer = NULL;
+    stream->resync_pending = FALSE;
   }
 
   if(stream->subscribe_request != NULL)
@@ -800,6 +922,363 @@ infinoted_plugin_document_stream_process_get_document(
   return TRUE;
 }
 
+static void
+infinoted_plugin_document_stream_send_document_error(
+  InfinotedPluginDocumentStreamStream* stream,
+  guint32 index,
+  const gchar* message)
+{
+  guint32 comm;
+  guint16 errlen;
+
+  comm = 9; /* DOCUMENT ERROR */
+  errlen = strlen(message);
+
+  if(!infinoted_plugin_document_stream_send(stream, &comm, 4)) return;
+  if(!infinoted_plugin_document_stream_send(stream, &index, 4)) return;
+  if(!infinoted_plugin_document_stream_send(stream, &errlen, 2)) return;
+  if(!infinoted_plugin_document_stream_send(stream, message, errlen)) return;
+}
+
+static void
+infinoted_plugin_document_stream_send_document(
+  InfinotedPluginDocumentStreamStream* stream,
+  guint32 index,
+  InfSessionProxy* proxy)
+{
+  InfSession* session;
+  InfTextBuffer* buffer;
+  guint length;
+  gsize bytes;
+  guint32 comm;
+  guint32 bytes32;
+  gboolean alive;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  length = inf_text_buffer_get_length(buffer);
+
+  /* The size goes first, so look at the text twice instead of copying it */
+  bytes = 0;
+  inf_text_buffer_view(
+    buffer,
+    0,
+    length,
+    infinoted_plugin_document_stream_count_view_func,
+    &bytes
+  );
+
+  comm = 8; /* DOCUMENT */
+  bytes32 = (guint32)bytes;
+
+  alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
+  if(alive)
+    alive = infinoted_plugin_document_stream_send(stream, &index, 4);
+  if(alive)
+    alive = infinoted_plugin_document_stream_send(stream, &bytes32, 4);
+  if(alive)
+  {
+    inf_text_buffer_view(
+      buffer,
+      0,
+      length,
+      infinoted_plugin_document_stream_send_view_func,
+      stream
+    );
+  }
+
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_document_stream_fetch_unref(
+  InfinotedPluginDocumentStreamStream* stream)
+{
+  guint32 comm;
+
+  g_assert(stream->n_fetches > 0);
+  if(--stream->n_fetches == 0)
+  {
+    comm = 10; /* DOCUMENTS DONE */
+    infinoted_plugin_document_stream_send(stream, &comm, 4);
+  }
+}
+
+static void
+infinoted_plugin_document_stream_fetch_free(
+  InfinotedPluginDocumentStreamFetch* fetch)
+{
+  fetch->stream->fetches = g_slist_remove(fetch->stream->fetches, fetch);
+  g_slice_free(InfinotedPluginDocumentStreamFetch, fetch);
+}
+
+static void
+infinoted_plugin_document_stream_fetch_subscribe_func(
+  InfRequest* request,
+  const InfRequestResult* res,
+  const GError* error,
+  gpointer user_data)
+{
+  InfinotedPluginDocumentStreamFetch* fetch;
+  InfinotedPluginDocumentStreamStream* stream;
+  InfSessionProxy* proxy;
+
+  fetch = (InfinotedPluginDocumentStreamFetch*)user_data;
+  stream = fetch->stream;
+
+  if(error != NULL)
+  {
+    infinoted_plugin_document_stream_send_document_error(
+      stream,
+      fetch->index,
+      error->message
+    );
+  }
+  else
+  {
+    inf_request_result_get_subscribe_session(res, NULL, NULL, &proxy);
+    infinoted_plugin_document_stream_send_document(
+      stream,
+      fetch->index,
+      proxy
+    );
+  }
+
+  infinoted_plugin_document_stream_fetch_free(fetch);
+  infinoted_plugin_document_stream_fetch_unref(stream);
+}
+
+static void
+infinoted_plugin_document_stream_fetch_navigate_func(
+  InfBrowser* browser,
+  const InfBrowserIter* iter,
+  const GError* error,
+  gpointer user_data)
+{
+  InfinotedPluginDocumentStreamFetch* fetch;
+  InfinotedPluginDocumentStreamStream* stream;
+  InfSessionProxy* proxy;
+  InfRequest* request;
+
+  fetch = (InfinotedPluginDocumentStreamFetch*)user_data;
+  stream = fetch->stream;
+  fetch->navigate_handle = NULL;
+
+  if(error != NULL)
+  {
+    infinoted_plugin_document_stream_send_document_error(
+      stream,
+      fetch->index,
+      error->message
+    );
+  }
+  else if(inf_browser_is_subdirectory(browser, iter) ||
+          strcmp(inf_browser_get_node_type(browser, iter), "InfText") != 0)
+  {
+    infinoted_plugin_document_stream_send_document_error(
+      stream,
+      fetch->index,
+      _("Not a text node")
+    );
+  }
+  else
+  {
+    proxy = inf_browser_get_session(browser, iter);
+    if(proxy != NULL)
+    {
+      infinoted_plugin_document_stream_send_document(
+        stream,
+        fetch->index,
+        proxy
+      );
+    }
+    else
+    {
+      request = inf_browser_subscribe(
+        browser,
+        iter,
+        infinoted_plugin_document_stream_fetch_subscribe_func,
+        fetch
+      );
+
+      /* If the request has finished already, then fetch has been freed */
+      if(request != NULL)
+        fetch->subscribe_request = request;
+      return;
+    }
+  }
+
+  infinoted_plugin_document_stream_fetch_free(fetch);
+  infinoted_plugin_document_stream_fetch_unref(stream);
+}
+
+static gboolean
+infinoted_plugin_document_stream_process_get_documents(
+  InfinotedPluginDocumentStreamStream* stream,
+  const gchar** data,
+  gsize* len)
+{
+  guint16 n_docs;
+  guint16 doc_len;
+  const gchar* names;
+  const gchar* pos;
+  gsize remaining;
+  InfinotedPluginDocumentStreamFetch* fetch;
+  InfinotedPluginUtilNavigateData* handle;
+  guint i;
+
+  /* get number of documents */
+  if(*len < 2) return FALSE;
+  n_docs = *(guint16*)(*data);
+  names = *data + 2;
+
+  /* make sure all document names have been received */
+  pos = names;
+  remaining = *len - 2;
+  for(i = 0; i < n_docs; ++i)
+  {
+    if(remaining < 2) return FALSE;
+    doc_len = *(guint16*)pos;
+    pos += 2; remaining -= 2;
+
+    if(remaining < doc_len) return FALSE;
+    pos += doc_len; remaining -= doc_len;
+  }
+
+  *data = pos; *len = remaining;
+
+  if(stream->n_fetches > 0)
+  {
+    infinoted_plugin_document_stream_send_error(
+      stream,
+      "Documents are already being fetched"
+    );
+
+    return TRUE;
+  }
+
+  /* Hold a reference so that DOCUMENTS DONE is not sent before all
+   * documents have been looked up, or twice. */
+  stream->n_fetches = 1;
+
+  pos = names;
+  for(i = 0; i < n_docs; ++i)
+  {
+    doc_len = *(guint16*)pos;
+    pos += 2;
+
+    fetch = g_slice_new(InfinotedPluginDocumentStreamFetch);
+    fetch->stream = stream;
+    fetch->index = i;
+    fetch->navigate_handle = NULL;
+    fetch->subscribe_request = NULL;
+
+    stream->fetches = g_slist_prepend(stream->fetches, fetch);
+    ++stream->n_fetches;
+
+    handle = infinoted_plugin_util_navigate_to(
+      INF_BROWSER(
+        infinoted_plugin_manager_get_directory(stream->plugin->manager)
+      ),
+      pos,
+      doc_len,
+      FALSE,
+      infinoted_plugin_document_stream_fetch_navigate_func,
+      fetch
+    );
+
+    /* If navigation has finished already, then fetch has been freed */
+    if(handle != NULL)
+      fetch->navigate_handle = handle;
+
+    pos += doc_len;
+  }
+
+  infinoted_plugin_document_stream_fetch_unref(stream);
+  return TRUE;
+}
+
+static gboolean
+infinoted_plugin_document_stream_process_search(
+  InfinotedPluginDocumentStreamStream* stream,
+  const gchar** data,
+  gsize* len)
+{
+  guint16 query_len;
+  const gchar* query;
+  guint16 max_results;
+  InfinotedPluginUtilSearchIndex* index;
+  GSList* results;
+  GSList* item;
+  guint32 comm;
+  guint16 n_results;
+  guint16 path_len;
+  gboolean alive;
+
+  /* get size of query string */
+  if(*len < 2) return FALSE;
+  query_len = *(guint16*)(*data);
+  *data += 2; *len -= 2;
+
+  /* get query string */
+  if(*len < query_len) return FALSE;
+  query = *data;
+  *data += query_len; *len -= query_len;
+
+  /* get maximum number of results */
+  if(*len < 2) return FALSE;
+  max_results = *(guint16*)(*data);
+  *data += 2; *len -= 2;
+
+  index = infinoted_plugin_util_search_index_lookup(
+    infinoted_plugin_manager_get_directory(stream->plugin->manager)
+  );
+
+  if(index == NULL)
+  {
+    infinoted_plugin_document_stream_send_error(
+      stream,
+      "The search plugin is not loaded"
+    );
+
+    return TRUE;
+  }
+
+  /* A result count needs to fit into 16 bits */
+  if(max_results == 0) max_results = G_MAXUINT16;
+
+  results = infinoted_plugin_util_search_index_query(
+    index,
+    query,
+    query_len,
+    max_results
+  );
+
+  comm = 11; /* SEARCH RESULTS */
+  n_results = g_slist_length(results);
+
+  alive = infinoted_plugin_document_stream_send(stream, &comm, 4);
+  if(alive)
+    alive = infinoted_plugin_document_stream_send(stream, &n_results, 2);
+
+  for(item = results; item != NULL && alive; item = item->next)
+  {
+    path_len = strlen(item->data);
+
+    alive = infinoted_plugin_document_stream_send(stream, &path_len, 2);
+    if(alive)
+      alive = infinoted_plugin_document_stream_send(
+        stream,
+        item->data,
+        path_len
+      );
+  }
+
+  g_slist_free_full(results, g_free);
+  return TRUE;
+}
+
 static gboolean
 infinoted_plugin_document_stream_process(
   InfinotedPluginDocumentStreamStream* stream,
@@ -827,6 +1306,18 @@ infinoted_plugin_document_stream_process(
       data,
       len
     );
+  case 2: /* get documents */
+    return infinoted_plugin_document_stream_process_get_documents(
+      stream,
+      data,
+      len
+    );
+  case 3: /* search */
+    return infinoted_plugin_document_stream_process_search(
+      stream,
+      data,
+      len
+    );
   default:
     /* unrecognized command; don't know how to proceed, so disconnect */
     infinoted_plugin_document_stream_close_stream(stream);
@@ -921,16 +1412,87 @@ infinoted_plugin_document_stream_send_direct(
   return sent;
 }
 
+/* Writes as much of the send queue to the socket as possible without
+ * blocking, and waits for the socket to become writable for the rest. */
+static gboolean
+infinoted_plugin_document_stream_flush(
+  InfinotedPluginDocumentStreamStream* stream)
+{
+  GError* error;
+  gsize sent;
+
+  g_assert(!stream->blocked);
+  if(stream->send_queue.len == 0)
+    return TRUE;
+
+  error = NULL;
+  sent = infinoted_plugin_document_stream_send_direct(
+    stream,
+    stream->send_queue.data + stream->send_queue.pos,
+    stream->send_queue.len,
+    &error
+  );
+
+  if(error != NULL)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(stream->plugin->manager),
+      "Document stream error: %s",
+      error->message
+    );
+
+    g_error_free(error);
+    return FALSE;
+  }
+
+  infinoted_plugin_document_stream_queue_consume(&stream->send_queue, sent);
+
+  if(stream->send_queue.len > 0)
+  {
+    stream->blocked = TRUE;
+
+    inf_io_update_watch(
+      infinoted_plugin_manager_get_io(stream->plugin->manager),
+      stream->watch,
+      INF_IO_INCOMING | INF_IO_OUTGOING
+    );
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_document_stream_flush_timeout_func(gpointer user_data)
+{
+  InfinotedPluginDocumentStreamStream* stream;
+  stream = (InfinotedPluginDocumentStreamStream*)user_data;
+
+  stream->flush_timeout = NULL;
+
+  /* If the socket is blocked, then the queue is flushed as soon as it
+   * becomes writable again. */
+  if(!stream->blocked)
+  {
+    if(!infinoted_plugin_document_stream_flush(stream))
+      infinoted_plugin_document_stream_close_stream(stream);
+    else
+      infinoted_plugin_document_stream_check_resync(stream);
+  }
+}
+
 static gboolean
 infinoted_plugin_document_stream_send(
   InfinotedPluginDocumentStreamStream* stream,
   const void* data,
   gsize len)
 {
+  InfinotedPluginDocumentStream* plugin;
   GError* error;
   gsize sent;
 
-  if(stream->send_queue.len > 0)
+  plugin = stream->plugin;
+
+  if(stream->send_queue.len > 0 || plugin->flush_interval > 0)
   {
     infinoted_plugin_document_stream_queue_append(
       &stream->send_queue,
@@ -938,6 +1500,28 @@ infinoted_plugin_document_stream_send(
       len
     );
 
+    if(stream->blocked)
+      return TRUE;
+
+    /* Batch small messages, and send them all at once when the timeout
+     * elapses or when enough data has been queued. */
+    if(plugin->flush_interval == 0 ||
+       stream->send_queue.len >= (gsize)plugin->flush_size)
+    {
+      return infinoted_plugin_document_stream_flush(stream);
+    }
+
+    if(stream->flush_timeout == NULL)
+    {
+      stream->flush_timeout = inf_io_add_timeout(
+        infinoted_plugin_manager_get_io(plugin->manager),
+        plugin->flush_interval,
+        infinoted_plugin_document_stream_flush_timeout_func,
+        stream,
+        NULL
+      );
+    }
+
     return TRUE;
   }
   else
@@ -971,6 +1555,8 @@ infinoted_plugin_document_stream_send(
           len - sent
         );
 
+        stream->blocked = TRUE;
+
         inf_io_update_watch(
           infinoted_plugin_manager_get_io(stream->plugin->manager),
           stream->watch,
@@ -1065,6 +1651,7 @@ infinoted_plugin_document_stream_io_out(
   gsize sent;
 
   g_assert(stream->status == INFINOTED_PLUGIN_DOCUMENT_STREAM_NORMAL);
+  g_assert(stream->blocked);
   g_assert(stream->send_queue.len > 0);
 
   local_error = NULL;
@@ -1092,6 +1679,8 @@ infinoted_plugin_document_stream_io_out(
 
     if(stream->send_queue.len == 0)
     {
+      stream->blocked = FALSE;
+
       inf_io_update_watch(
         infinoted_plugin_manager_get_io(stream->plugin->manager),
         stream->watch,
@@ -1099,6 +1688,7 @@ infinoted_plugin_document_stream_io_out(
       );
     }
 
+    infinoted_plugin_document_stream_check_resync(stream);
     return TRUE;
   }
 }
@@ -1202,6 +1792,12 @@ infinoted_plugin_document_stream_add_stream(
   infinoted_plugin_document_stream_queue_initialize(&stream->send_queue);
   infinoted_plugin_document_stream_queue_initialize(&stream->recv_queue);
 
+  stream->blocked = FALSE;
+  stream->flush_timeout = NULL;
+  stream->resync_pending = FALSE;
+  stream->fetches = NULL;
+  stream->n_fetches = 0;
+
   stream->navigate_handle = NULL;
   stream->subscribe_request = NULL;
   stream->user_request = NULL;
@@ -1216,6 +1812,8 @@ static void
 infinoted_plugin_document_stream_close_stream(
   InfinotedPluginDocumentStreamStream* stream)
 {
+  InfinotedPluginDocumentStreamFetch* fetch;
+
   stream->plugin->streams = g_slist_remove(stream->plugin->streams, stream);
 
   if(stream->proxy != NULL || stream->subscribe_request != NULL)
@@ -1227,6 +1825,37 @@ infinoted_plugin_document_stream_close_stream(
     stream->navigate_handle = NULL;
   }
 
+  while(stream->fetches != NULL)
+  {
+    fetch = (InfinotedPluginDocumentStreamFetch*)stream->fetches->data;
+
+    if(fetch->navigate_handle != NULL)
+      infinoted_plugin_util_navigate_cancel(fetch->navigate_handle);
+
+    if(fetch->subscribe_request != NULL)
+    {
+      inf_signal_handlers_disconnect_by_func(
+        G_OBJECT(fetch->subscribe_request),
+        G_CALLBACK(infinoted_plugin_document_stream_fetch_subscribe_func),
+        fetch
+      );
+    }
+
+    infinoted_plugin_document_stream_fetch_free(fetch);
+  }
+
+  stream->n_fetches = 0;
+
+  if(stream->flush_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(stream->plugin->manager),
+      stream->flush_timeout
+    );
+
+    stream->flush_timeout = NULL;
+  }
+
   infinoted_plugin_document_stream_queue_finalize(&stream->send_queue);
   infinoted_plugin_document_stream_queue_finalize(&stream->recv_queue);
 
@@ -1387,6 +2016,10 @@ infinoted_plugin_document_stream_info_initialize(gpointer plugin_info)
   plugin->socket = -1;
   plugin->watch = NULL;
   plugin->streams = NULL;
+
+  plugin->flush_interval = 0;
+  plugin->flush_size = 65536;
+  plugin->max_queue_size = 0;
 }
 
 static gboolean
@@ -1490,6 +2123,39 @@ infinoted_plugin_document_stream_deinitialize(gpointer plugin_info)
 
 static const InfinotedParameterInfo INFINOTED_PLUGIN_DOCUMENT_STREAM_OPTIONS[] = {
   {
+    "flush-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDocumentStream, flush_interval),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Interval, in milliseconds, during which changes to a document are "
+       "collected before they are sent to the client together. If 0, every "
+       "change is sent immediately."),
+    N_("MILLISECONDS")
+  }, {
+    "flush-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDocumentStream, flush_size),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Number of bytes after which collected changes are sent before the "
+       "flush interval has elapsed."),
+    N_("BYTES")
+  }, {
+    "max-queue-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDocumentStream, max_queue_size),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Maximum number of bytes to queue for a client that does not read "
+       "fast enough. If more is queued, changes are dropped and the whole "
+       "document is sent again once the client has caught up. If 0, there "
+       "is no limit."),
+    N_("BYTES")
+  }, {
     NULL,
     0,
     0,
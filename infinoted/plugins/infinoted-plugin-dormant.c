@@ -0,0 +1,127 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/inf-i18n.h>
+
+typedef struct _InfinotedPluginDormant InfinotedPluginDormant;
+struct _InfinotedPluginDormant {
+  InfinotedPluginManager* manager;
+  guint timeout;
+};
+
+static void
+infinoted_plugin_dormant_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginDormant* plugin;
+  plugin = (InfinotedPluginDormant*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->timeout = 600;
+}
+
+static gboolean
+infinoted_plugin_dormant_initialize(InfinotedPluginManager* manager,
+                                    gpointer plugin_info,
+                                    GError** error)
+{
+  InfinotedPluginDormant* plugin;
+  plugin = (InfinotedPluginDormant*)plugin_info;
+
+  plugin->manager = manager;
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_dormant_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginDormant* plugin;
+  plugin = (InfinotedPluginDormant*)plugin_info;
+}
+
+static void
+infinoted_plugin_dormant_session_added(const InfBrowserIter* iter,
+                                       InfSessionProxy* proxy,
+                                       gpointer plugin_info,
+                                       gpointer session_info)
+{
+  InfinotedPluginDormant* plugin;
+  plugin = (InfinotedPluginDormant*)plugin_info;
+
+  g_object_set(G_OBJECT(proxy), "dormant-timeout", plugin->timeout, NULL);
+}
+
+static void
+infinoted_plugin_dormant_session_removed(const InfBrowserIter* iter,
+                                         InfSessionProxy* proxy,
+                                         gpointer plugin_info,
+                                         gpointer session_info)
+{
+  /* Stop demoting subscriptions when the plugin is unloaded at runtime */
+  g_object_set(G_OBJECT(proxy), "dormant-timeout", 0, NULL);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_DORMANT_OPTIONS[] = {
+  {
+    "timeout",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginDormant, timeout),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The number of seconds after which a connection that did not send "
+       "anything to a document it is subscribed to is demoted to a dormant "
+       "subscription. [Default=600]"),
+    N_("SECONDS")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "dormant",
+  N_("Demotes idle subscriptions to documents, such as a document left open "
+     "in a background tab, to dormant ones. Dormant clients stop receiving "
+     "the changes and caret moves of others, and their users leave the "
+     "document, so that they do not prevent old requests from being "
+     "discarded. Clients keep their copy of the document, and only fetch "
+     "the changes they missed when they subscribe again."),
+  INFINOTED_PLUGIN_DORMANT_OPTIONS,
+  sizeof(InfinotedPluginDormant),
+  0,
+  0,
+  NULL,
+  infinoted_plugin_dormant_info_initialize,
+  infinoted_plugin_dormant_initialize,
+  infinoted_plugin_dormant_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_dormant_session_added,
+  infinoted_plugin_dormant_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,435 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/inf-i18n.h>
+
+typedef struct _InfinotedPluginJournal InfinotedPluginJournal;
+struct _InfinotedPluginJournal {
+  InfinotedPluginManager* manager;
+  guint sync_interval;
+  guint max_size;
+  gboolean history;
+};
+
+typedef struct _InfinotedPluginJournalSessionInfo
+  InfinotedPluginJournalSessionInfo;
+struct _InfinotedPluginJournalSessionInfo {
+  InfinotedPluginJournal* plugin;
+  InfBrowserIter iter;
+  InfSessionProxy* proxy;
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemHistory* history;
+  InfIoTimeout* timeout;
+};
+
+static void
+infinoted_plugin_journal_warning(InfinotedPluginJournalSessionInfo* info,
+                                 const gchar* message,
+                                 const GError* error)
+{
+  InfdDirectory* directory;
+  gchar* path;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(info->plugin->manager),
+    message,
+    path,
+    error->message
+  );
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_journal_sync(InfinotedPluginJournalSessionInfo* info)
+{
+  InfdDirectory* directory;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  error = NULL;
+
+  if(!inf_text_filesystem_journal_sync(info->journal, &error))
+  {
+    infinoted_plugin_journal_warning(
+      info,
+      _("Failed to write journal of document \"%s\": %s"),
+      error
+    );
+
+    g_error_free(error);
+    return;
+  }
+
+  if(info->history != NULL &&
+     !inf_text_filesystem_history_sync(info->history, &error))
+  {
+    infinoted_plugin_journal_warning(
+      info,
+      _("Failed to write history of document \"%s\": %s"),
+      error
+    );
+
+    g_error_free(error);
+    error = NULL;
+  }
+
+  /* Compact the journal by writing the full document, which empties the
+   * journal again. */
+  if(inf_text_filesystem_journal_get_size(info->journal) >
+     (gsize)info->plugin->max_size * 1024)
+  {
+    if(!infd_directory_iter_save_session(directory, &info->iter, &error))
+    {
+      infinoted_plugin_journal_warning(
+        info,
+        _("Failed to save document \"%s\" to compact its journal: %s"),
+        error
+      );
+
+      g_error_free(error);
+    }
+  }
+}
+
+static void
+infinoted_plugin_journal_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginJournalSessionInfo* info;
+
+  info = (InfinotedPluginJournalSessionInfo*)user_data;
+  info->timeout = NULL;
+
+  infinoted_plugin_journal_sync(info);
+}
+
+static void
+infinoted_plugin_journal_schedule_sync(InfinotedPluginJournalSessionInfo* info)
+{
+  InfIo* io;
+
+  if(info->timeout == NULL)
+  {
+    io = infd_directory_get_io(
+      infinoted_plugin_manager_get_directory(info->plugin->manager)
+    );
+
+    info->timeout = inf_io_add_timeout(
+      io,
+      info->plugin->sync_interval * 1000,
+      infinoted_plugin_journal_timeout_cb,
+      info,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_plugin_journal_text_changed_cb(InfTextBuffer* buffer,
+                                         guint pos,
+                                         InfTextChunk* chunk,
+                                         InfUser* user,
+                                         gpointer user_data)
+{
+  InfinotedPluginJournalSessionInfo* info;
+  info = (InfinotedPluginJournalSessionInfo*)user_data;
+
+  infinoted_plugin_journal_schedule_sync(info);
+}
+
+static void
+infinoted_plugin_journal_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginJournal* plugin;
+  plugin = (InfinotedPluginJournal*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->sync_interval = 1;
+  plugin->max_size = 4096;
+  plugin->history = FALSE;
+}
+
+static gboolean
+infinoted_plugin_journal_initialize(InfinotedPluginManager* manager,
+                                    gpointer plugin_info,
+                                    GError** error)
+{
+  InfinotedPluginJournal* plugin;
+  InfdStorage* storage;
+
+  plugin = (InfinotedPluginJournal*)plugin_info;
+
+  plugin->manager = manager;
+
+  storage = infd_directory_get_storage(
+    infinoted_plugin_manager_get_directory(manager)
+  );
+
+  if(!INFD_IS_FILESYSTEM_STORAGE(storage))
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INFINOTED_PLUGIN_JOURNAL_ERROR"),
+      0,
+      "%s",
+      _("The journal plugin can only be used with the filesystem storage")
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_journal_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginJournal* plugin;
+  plugin = (InfinotedPluginJournal*)plugin_info;
+}
+
+static void
+infinoted_plugin_journal_session_added(const InfBrowserIter* iter,
+                                       InfSessionProxy* proxy,
+                                       gpointer plugin_info,
+                                       gpointer session_info)
+{
+  InfinotedPluginJournalSessionInfo* info;
+  InfdDirectory* directory;
+  InfSession* session;
+  InfBuffer* buffer;
+  gchar* path;
+  GError* error;
+
+  info = (InfinotedPluginJournalSessionInfo*)session_info;
+  info->plugin = (InfinotedPluginJournal*)plugin_info;
+  info->iter = *iter;
+  info->proxy = proxy;
+  info->journal = NULL;
+  info->history = NULL;
+  info->timeout = NULL;
+  g_object_ref(proxy);
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  path = inf_browser_get_path(INF_BROWSER(directory), iter);
+
+  error = NULL;
+  info->journal = inf_text_filesystem_journal_open(
+    INFD_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)),
+    path,
+    INF_TEXT_SESSION(session),
+    &error
+  );
+
+  if(info->journal == NULL)
+  {
+    infinoted_plugin_journal_warning(
+      info,
+      _("Failed to open journal of document \"%s\": %s"),
+      error
+    );
+
+    g_error_free(error);
+  }
+  else
+  {
+    if(info->plugin->history)
+    {
+      info->history = inf_text_filesystem_history_open(
+        INFD_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)),
+        path,
+        INF_TEXT_SESSION(session),
+        &error
+      );
+
+      /* The journal is still useful without the history */
+      if(info->history == NULL)
+      {
+        infinoted_plugin_journal_warning(
+          info,
+          _("Failed to open history of document \"%s\": %s"),
+          error
+        );
+
+        g_error_free(error);
+      }
+    }
+
+    buffer = inf_session_get_buffer(session);
+
+    inf_text_buffer_add_observer(
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_journal_text_changed_cb,
+      infinoted_plugin_journal_text_changed_cb,
+      info
+    );
+  }
+
+  g_free(path);
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_journal_session_removed(const InfBrowserIter* iter,
+                                         InfSessionProxy* proxy,
+                                         gpointer plugin_info,
+                                         gpointer session_info)
+{
+  InfinotedPluginJournalSessionInfo* info;
+  InfdDirectory* directory;
+  InfSession* session;
+  InfBuffer* buffer;
+  GError* error;
+
+  info = (InfinotedPluginJournalSessionInfo*)session_info;
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+
+  if(info->timeout != NULL)
+  {
+    inf_io_remove_timeout(infd_directory_get_io(directory), info->timeout);
+    info->timeout = NULL;
+  }
+
+  if(info->journal != NULL)
+  {
+    g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+    buffer = inf_session_get_buffer(session);
+
+    inf_text_buffer_remove_observer(
+      INF_TEXT_BUFFER(buffer),
+      infinoted_plugin_journal_text_changed_cb,
+      infinoted_plugin_journal_text_changed_cb,
+      info
+    );
+
+    g_object_unref(session);
+
+    error = NULL;
+    if(!inf_text_filesystem_journal_sync(info->journal, &error))
+    {
+      infinoted_plugin_journal_warning(
+        info,
+        _("Failed to write journal of document \"%s\": %s"),
+        error
+      );
+
+      g_error_free(error);
+    }
+
+    inf_text_filesystem_journal_close(info->journal);
+    info->journal = NULL;
+  }
+
+  if(info->history != NULL)
+  {
+    error = NULL;
+    if(!inf_text_filesystem_history_sync(info->history, &error))
+    {
+      infinoted_plugin_journal_warning(
+        info,
+        _("Failed to write history of document \"%s\": %s"),
+        error
+      );
+
+      g_error_free(error);
+    }
+
+    inf_text_filesystem_history_close(info->history);
+    info->history = NULL;
+  }
+
+  g_object_unref(info->proxy);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_JOURNAL_OPTIONS[] = {
+  {
+    "sync-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginJournal, sync_interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Maximum time, in seconds, after which changes to a document are "
+       "guaranteed to have reached the disk."),
+    N_("SECONDS")
+  }, {
+    "max-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginJournal, max_size),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Size of a journal, in KiB, after which the full document is saved "
+       "and the journal is emptied."),
+    N_("KIB")
+  }, {
+    "history",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginJournal, history),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to also keep the full history of each document, with the "
+       "time of every change, so that earlier versions of the document can "
+       "be looked at. Unlike the journal, the history is never emptied."),
+    NULL
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "journal",
+  N_("Writes all changes made to a document into a journal next to it in "
+     "the root directory, so that they are not lost even if the server "
+     "could not save the document. The changes are applied when the "
+     "document is loaded the next time. Only the journal is written for "
+     "each change, so this is much cheaper than the autosave plugin for "
+     "large documents."),
+  INFINOTED_PLUGIN_JOURNAL_OPTIONS,
+  sizeof(InfinotedPluginJournal),
+  0,
+  sizeof(InfinotedPluginJournalSessionInfo),
+  "InfTextSession",
+  infinoted_plugin_journal_info_initialize,
+  infinoted_plugin_journal_initialize,
+  infinoted_plugin_journal_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_journal_session_added,
+  infinoted_plugin_journal_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
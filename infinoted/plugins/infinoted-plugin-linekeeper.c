@@ -44,6 +44,10 @@ struct _InfinotedPluginLinekeeperSessionInfo {
   InfUser* user;
   InfTextBuffer* buffer;
   InfIoDispatch* dispatch;
+
+  /* Number of lines at the end of the document, kept up to date from the
+   * inserted and erased text while we have a user joined. */
+  guint n_trailing;
 };
 
 typedef struct _InfinotedPluginLinekeeperHasAvailableUsersData
@@ -73,59 +77,113 @@ infinoted_plugin_linekeeper_deinitialize(gpointer plugin_info)
   plugin = (InfinotedPluginLinekeeper*)plugin_info;
 }
 
+/* Counts the newline characters at the end of text. This assumes the
+ * buffer content is in UTF-8, which is currently hardcoded in infinoted. */
 static guint
-infinoted_plugin_linekeeper_count_lines(InfTextBuffer* buffer)
+infinoted_plugin_linekeeper_count_trailing(const gchar* text,
+                                           gsize bytes,
+                                           guint length)
 {
-  /* Count the number of lines at the end of the document. This assumes the
-   * buffer content is in UTF-8, which is currently hardcoded in infinoted. */
-  InfTextBufferIter* iter;
+  const gchar* pos;
+  const gchar* new_pos;
+  gunichar c;
   guint n_lines;
-  gboolean has_iter;
 
-  guint length;
-  gsize bytes;
-  gchar* text;
-  gchar* pos;
-  gchar* new_pos;
-  gunichar c;
+  n_lines = 0;
+  pos = text + bytes;
+
+  while(length > 0)
+  {
+    new_pos = g_utf8_prev_char(pos);
+    g_assert(bytes >= (pos - new_pos));
+
+    c = g_utf8_get_char(new_pos);
+    if(c != '\n' && g_unichar_type(c) != G_UNICODE_LINE_SEPARATOR)
+      break;
+
+    ++n_lines;
+    --length;
+    bytes -= (pos - new_pos);
+    pos = new_pos;
+  }
+
+  return n_lines;
+}
+
+/* Keeps track of the newlines at the end of the text seen so far, when
+ * looking at text segment by segment. A segment that consists only of
+ * newlines extends the count, any other one restarts it. */
+static gboolean
+infinoted_plugin_linekeeper_count_view_func(gconstpointer text,
+                                            gsize bytes,
+                                            guint length,
+                                            guint author,
+                                            gpointer user_data)
+{
+  guint* n_lines;
+  guint n;
+
+  n_lines = (guint*)user_data;
+  n = infinoted_plugin_linekeeper_count_trailing(text, bytes, length);
+
+  if(n == length)
+    *n_lines += n;
+  else
+    *n_lines = n;
+
+  return TRUE;
+}
+
+/* Counts the lines that end right before pos, looking at a window before
+ * pos that doubles in size until a character other than a newline is
+ * found. */
+static guint
+infinoted_plugin_linekeeper_count_lines_before(InfTextBuffer* buffer,
+                                               guint pos)
+{
+  guint window;
+  guint len;
+  guint n;
+  guint n_lines;
 
   g_assert(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0);
 
   n_lines = 0;
+  window = 16;
 
-  iter = inf_text_buffer_create_end_iter(buffer);
-  if(iter == NULL) return 0;
-
-  do
+  while(pos > 0)
   {
-    length = inf_text_buffer_iter_get_length(buffer, iter);
-    bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
-    text = inf_text_buffer_iter_get_text(buffer, iter);
-    pos = text + bytes;
+    len = MIN(window, pos);
+
+    n = 0;
+    inf_text_buffer_view(
+      buffer,
+      pos - len,
+      len,
+      infinoted_plugin_linekeeper_count_view_func,
+      &n
+    );
 
-    while(length > 0)
-    {
-      new_pos = g_utf8_prev_char(pos);
-      g_assert(bytes >= (pos - new_pos));
-
-      c = g_utf8_get_char(new_pos);
-      if(c == '\n' || g_unichar_type(c) == G_UNICODE_LINE_SEPARATOR)
-        ++n_lines;
-      else
-        break;
-
-      --length;
-      bytes -= (pos - new_pos);
-      pos = new_pos;
-    }
+    n_lines += n;
+    if(n < len) break;
 
-    g_free(text);
-  } while(length == 0 && inf_text_buffer_iter_prev(buffer, iter));
+    pos -= len;
+    window *= 2;
+  }
 
-  inf_text_buffer_destroy_iter(buffer, iter);
   return n_lines;
 }
 
+static guint
+infinoted_plugin_linekeeper_count_lines(InfTextBuffer* buffer)
+{
+  /* Count the number of lines at the end of the document */
+  return infinoted_plugin_linekeeper_count_lines_before(
+    buffer,
+    inf_text_buffer_get_length(buffer)
+  );
+}
+
 static void
 infinoted_plugin_linekeeper_run(InfinotedPluginLinekeeperSessionInfo* info)
 {
@@ -133,7 +191,12 @@ infinoted_plugin_linekeeper_run(InfinotedPluginLinekeeperSessionInfo* info)
   guint n;
   gchar* text;
 
-  cur_lines = infinoted_plugin_linekeeper_count_lines(info->buffer);
+  /* If our user has left in the meanwhile, then we have not seen the most
+   * recent changes. */
+  if(info->user == NULL)
+    info->n_trailing = infinoted_plugin_linekeeper_count_lines(info->buffer);
+
+  cur_lines = info->n_trailing;
 
   if(cur_lines > info->plugin->n_lines)
   {
@@ -183,10 +246,34 @@ infinoted_plugin_linekeeper_text_inserted_cb(InfTextBuffer* buffer,
 {
   InfinotedPluginLinekeeperSessionInfo* info;
   InfdDirectory* directory;
+  guint length;
+  guint old_length;
+  guint n;
 
   info = (InfinotedPluginLinekeeperSessionInfo*)user_data;
 
-  if(info->dispatch == NULL)
+  length = inf_text_chunk_get_length(chunk);
+  old_length = inf_text_buffer_get_length(buffer) - length;
+
+  /* Text inserted before the trailing lines does not change them */
+  if(pos >= old_length - info->n_trailing)
+  {
+    n = 0;
+    inf_text_chunk_view(
+      chunk,
+      0,
+      length,
+      infinoted_plugin_linekeeper_count_view_func,
+      &n
+    );
+
+    if(n == length)
+      info->n_trailing += length;
+    else
+      info->n_trailing = (old_length - pos) + n;
+  }
+
+  if(info->dispatch == NULL && info->n_trailing != info->plugin->n_lines)
   {
     directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
 
@@ -208,10 +295,29 @@ infinoted_plugin_linekeeper_text_erased_cb(InfTextBuffer* buffer,
 {
   InfinotedPluginLinekeeperSessionInfo* info;
   InfdDirectory* directory;
+  guint length;
+  guint old_length;
+  guint end;
 
   info = (InfinotedPluginLinekeeperSessionInfo*)user_data;
 
-  if(info->dispatch == NULL)
+  length = inf_text_chunk_get_length(chunk);
+  old_length = inf_text_buffer_get_length(buffer) + length;
+  end = pos + length;
+
+  if(pos >= old_length - info->n_trailing)
+  {
+    info->n_trailing -= length;
+  }
+  else if(end >= old_length - info->n_trailing)
+  {
+    /* The text before the erased range now joins the trailing lines, and
+     * might end with newlines itself. */
+    info->n_trailing = (old_length - end) +
+      infinoted_plugin_linekeeper_count_lines_before(buffer, pos);
+  }
+
+  if(info->dispatch == NULL && info->n_trailing != info->plugin->n_lines)
   {
     directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
 
@@ -325,8 +431,7 @@ infinoted_plugin_linekeeper_user_join_cb(InfRequest* request,
     info->user = user;
     g_object_ref(info->user);
 
-    /* Initial run */
-    infinoted_plugin_linekeeper_run(info);
+    info->n_trailing = infinoted_plugin_linekeeper_count_lines(info->buffer);
 
     g_signal_connect(
       G_OBJECT(info->buffer),
@@ -342,6 +447,9 @@ infinoted_plugin_linekeeper_user_join_cb(InfRequest* request,
       info
     );
 
+    /* Initial run */
+    infinoted_plugin_linekeeper_run(info);
+
     /* It can happen that while the request is being processed, the situation
      * changes again. */
     if(infinoted_plugin_linekeeper_has_available_users(info) == FALSE)
@@ -444,6 +552,7 @@ infinoted_plugin_linekeeper_session_added(const InfBrowserIter* iter,
   info->request = NULL;
   info->user = NULL;
   info->dispatch = NULL;
+  info->n_trailing = 0;
   g_object_ref(proxy);
 
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
@@ -25,6 +25,7 @@
 
 #include <libinfinity/adopted/inf-adopted-session-record.h>
 #include <libinfinity/common/inf-cert-util.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
@@ -41,6 +42,12 @@ struct _InfinotedPluginLogging {
   gboolean log_connection_errors;
   gboolean log_session_errors;
   gboolean log_session_request_extra;
+  gint slow_operation_threshold;
+  gint rate_limit;
+
+  /* Periodic timeout to detect when the main loop is blocked */
+  InfIoTimeout* stall_timeout;
+  gint64 stall_expected;
 
   /* TODO: Make this a hash table, and use the thread ID as a key */
   gchar* extra_message;
@@ -53,6 +60,9 @@ struct _InfinotedPluginLoggingSessionInfo {
   InfinotedPluginLogging* plugin;
   InfSessionProxy* proxy;
   InfBrowserIter iter;
+
+  gint64 execute_begin;
+  guint execute_vdiff;
 };
 
 static gchar*
@@ -93,6 +103,45 @@ infinoted_plugin_logging_connection_string(InfXmlConnection* connection)
   return result;
 }
 
+/* Logs an info message for a connection event, unless more than the
+ * configured number of events of the same kind occurred in the last
+ * second. */
+static void
+infinoted_plugin_logging_log_sampled(InfinotedPluginLogging* plugin,
+                                     const gchar* event,
+                                     const gchar* fmt,
+                                     ...)
+{
+  InfinotedLog* log;
+  guint suppressed;
+  va_list args;
+  gchar* text;
+
+  log = infinoted_plugin_manager_get_log(plugin->manager);
+  if(!infinoted_log_sample(log, event, plugin->rate_limit, &suppressed))
+    return;
+
+  va_start(args, fmt);
+  text = g_strdup_vprintf(fmt, args);
+  va_end(args);
+
+  if(suppressed > 0)
+  {
+    infinoted_log_info(
+      log,
+      _("%s (%u similar messages suppressed)"),
+      text,
+      suppressed
+    );
+  }
+  else
+  {
+    infinoted_log_info(log, "%s", text);
+  }
+
+  g_free(text);
+}
+
 static gchar*
 infinoted_plugin_logging_get_document_name(
   InfinotedPluginLoggingSessionInfo* info)
@@ -244,11 +293,32 @@ infinoted_plugin_logging_begin_execute_request_cb(InfAdoptedAlgorithm* algo,
                                                   gpointer user_data)
 {
   InfinotedPluginLoggingSessionInfo* info;
+  const InfAdoptedStateVector* vector;
+  const InfAdoptedStateVector* current;
+
   info = (InfinotedPluginLoggingSessionInfo*)user_data;
 
-  /* Don't need to ref this */
-  g_assert(info->plugin->current_session == NULL);
-  info->plugin->current_session = info->proxy;
+  if(info->plugin->log_session_request_extra)
+  {
+    /* Don't need to ref this */
+    g_assert(info->plugin->current_session == NULL);
+    info->plugin->current_session = info->proxy;
+  }
+
+  if(info->plugin->slow_operation_threshold > 0)
+  {
+    /* The distance from the request's state to the current state is
+     * roughly the number of requests it needs to be transformed against,
+     * which is usually what makes a request slow. */
+    vector = inf_adopted_request_get_vector(request);
+    current = inf_adopted_algorithm_get_current(algo);
+
+    info->execute_vdiff = 0;
+    if(inf_adopted_state_vector_causally_before(vector, current))
+      info->execute_vdiff = inf_adopted_state_vector_vdiff(vector, current);
+
+    info->execute_begin = g_get_monotonic_time();
+  }
 }
 
 static void
@@ -260,13 +330,83 @@ infinoted_plugin_logging_end_execute_request_cb(InfAdoptedAlgorithm* algo,
                                                 gpointer user_data)
 {
   InfinotedPluginLoggingSessionInfo* info;
+  gint64 elapsed;
+  const gchar* user_name;
+  gchar* document_name;
+
   info = (InfinotedPluginLoggingSessionInfo*)user_data;
 
   /* TODO: If error is set then log it here, so that the actual request that
    * caused the error is written in the log file. */
 
-  g_assert(info->plugin->current_session != NULL);
-  info->plugin->current_session = NULL;
+  if(info->plugin->log_session_request_extra)
+  {
+    g_assert(info->plugin->current_session != NULL);
+    info->plugin->current_session = NULL;
+  }
+
+  if(info->plugin->slow_operation_threshold > 0)
+  {
+    elapsed = (g_get_monotonic_time() - info->execute_begin) / 1000;
+    if(elapsed >= info->plugin->slow_operation_threshold)
+    {
+      user_name = "unknown";
+      if(user != NULL)
+        user_name = inf_user_get_name(INF_USER(user));
+
+      document_name = infinoted_plugin_logging_get_document_name(info);
+
+      infinoted_log_warning(
+        infinoted_plugin_manager_get_log(info->plugin->manager),
+        _("Executing a request from user %s in document %s took %u ms "
+          "(%u requests behind)"),
+        user_name,
+        document_name,
+        (guint)elapsed,
+        info->execute_vdiff
+      );
+
+      g_free(document_name);
+    }
+  }
+}
+
+static void
+infinoted_plugin_logging_stall_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginLogging* plugin;
+  InfIo* io;
+  gint64 now;
+  gint64 delay;
+
+  plugin = (InfinotedPluginLogging*)user_data;
+  io = infinoted_plugin_manager_get_io(plugin->manager);
+
+  /* If the timeout fires much later than it was scheduled, then something
+   * blocked the main loop in the meanwhile, such as a dispatch or watch
+   * callback, or a synchronous storage operation. */
+  now = g_get_monotonic_time();
+  delay = (now - plugin->stall_expected) / 1000;
+
+  if(delay >= plugin->slow_operation_threshold)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("The server did not process any events for at least %u ms"),
+      (guint)delay
+    );
+  }
+
+  plugin->stall_expected =
+    now + (gint64)plugin->slow_operation_threshold * 1000;
+
+  plugin->stall_timeout = inf_io_add_timeout(
+    io,
+    plugin->slow_operation_threshold,
+    infinoted_plugin_logging_stall_timeout_cb,
+    plugin,
+    NULL
+  );
 }
 
 static void
@@ -384,6 +524,8 @@ infinoted_plugin_logging_info_initialize(gpointer plugin_info)
   plugin->log_connection_errors = TRUE;
   plugin->log_session_errors = TRUE;
   plugin->log_session_request_extra = TRUE;
+  plugin->slow_operation_threshold = 0;
+  plugin->rate_limit = 0;
 }
 
 static gboolean
@@ -406,6 +548,21 @@ infinoted_plugin_logging_initialize(InfinotedPluginManager* manager,
   plugin->extra_message = NULL;
   plugin->current_session = NULL;
 
+  plugin->stall_timeout = NULL;
+  if(plugin->slow_operation_threshold > 0)
+  {
+    plugin->stall_expected = g_get_monotonic_time() +
+      (gint64)plugin->slow_operation_threshold * 1000;
+
+    plugin->stall_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(manager),
+      plugin->slow_operation_threshold,
+      infinoted_plugin_logging_stall_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+
   return TRUE;
 }
 
@@ -415,6 +572,14 @@ infinoted_plugin_logging_deinitialize(gpointer plugin_info)
   InfinotedPluginLogging* plugin;
   plugin = (InfinotedPluginLogging*)plugin_info;
 
+  if(plugin->stall_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->stall_timeout
+    );
+  }
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(infinoted_plugin_manager_get_log(plugin->manager)),
     G_CALLBACK(infinoted_plugin_logging_log_message_cb),
@@ -444,8 +609,9 @@ infinoted_plugin_logging_connection_notify_status_cb(GObject* object,
     connection_str =
       infinoted_plugin_logging_connection_string(INF_XML_CONNECTION(object));
 
-    infinoted_log_info(
-      infinoted_plugin_manager_get_log(plugin->manager),
+    infinoted_plugin_logging_log_sampled(
+      plugin,
+      "connected",
       _("%s connected"),
       connection_str
     );
@@ -512,8 +678,9 @@ infinoted_plugin_logging_connection_added(InfXmlConnection* connection,
        * connection attempt nevertheless. */
       connection_str = infinoted_plugin_logging_connection_string(connection);
 
-      infinoted_log_info(
-        infinoted_plugin_manager_get_log(plugin->manager),
+      infinoted_plugin_logging_log_sampled(
+        plugin,
+        "connected",
         _("%s connected"),
         connection_str
       );
@@ -561,16 +728,18 @@ infinoted_plugin_logging_connection_removed(InfXmlConnection* connection,
     if(n_connected > 0)
     {
       /* The connection went down before being fully functional */
-      infinoted_log_info(
-        infinoted_plugin_manager_get_log(plugin->manager),
+      infinoted_plugin_logging_log_sampled(
+        plugin,
+        "connection-attempt",
         _("Unsuccessful connection attempt from %s"),
         connection_str
       );
     }
     else
     {
-      infinoted_log_info(
-        infinoted_plugin_manager_get_log(plugin->manager),
+      infinoted_plugin_logging_log_sampled(
+        plugin,
+        "disconnected",
         _("%s disconnected"),
         connection_str
       );
@@ -609,7 +778,8 @@ infinoted_plugin_logging_session_added(const InfBrowserIter* iter,
   }
 
   if(INF_ADOPTED_IS_SESSION(session) &&
-     info->plugin->log_session_request_extra)
+     (info->plugin->log_session_request_extra ||
+      info->plugin->slow_operation_threshold > 0))
   {
     if(inf_session_get_status(session) == INF_SESSION_RUNNING)
     {
@@ -669,7 +839,8 @@ infinoted_plugin_logging_session_removed(const InfBrowserIter* iter,
   }
 
   if(INF_ADOPTED_IS_SESSION(session) &&
-     info->plugin->log_session_request_extra)
+     (info->plugin->log_session_request_extra ||
+      info->plugin->slow_operation_threshold > 0))
   {
     inf_signal_handlers_disconnect_by_func(
       G_OBJECT(session),
@@ -743,6 +914,30 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_LOGGING_OPTIONS[] = {
        "used for debugging purposes to find problems in the server "
        "implementation itself."),
     NULL
+  }, {
+    "slow-operation-threshold",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginLogging, slow_operation_threshold),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("If nonzero, write a log message when executing a request takes "
+       "longer than this many milliseconds, or when the server did not "
+       "process events for longer than that, for example because of a "
+       "slow save operation. A value of 0 disables it."),
+    N_("MILLISECONDS")
+  }, {
+    "rate-limit",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginLogging, rate_limit),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("If nonzero, write at most this many messages per second for each "
+       "kind of connection event. Further messages are suppressed, and "
+       "their number is mentioned in the next message that is written. A "
+       "value of 0 disables the limit."),
+    N_("MESSAGES")
   }, {
     NULL,
     0,
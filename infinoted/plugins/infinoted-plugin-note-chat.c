@@ -29,6 +29,12 @@
 typedef struct _InfinotedPluginNoteChat InfinotedPluginNoteChat;
 struct _InfinotedPluginNoteChat {
   InfinotedPluginManager* manager;
+  gint history_size;
+  gint sync_history;
+
+  /* A copy of INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN with user_data pointing to
+   * this structure */
+  InfdNotePlugin note_plugin;
   const InfdNotePlugin* plugin;
 };
 
@@ -47,10 +53,12 @@ infinoted_plugin_note_chat_session_new(InfIo* io,
                                        const gchar* path,
                                        gpointer user_data)
 {
+  InfinotedPluginNoteChat* plugin;
   InfChatBuffer* buffer;
   InfChatSession* session;
 
-  buffer = inf_chat_buffer_new(256);
+  plugin = (InfinotedPluginNoteChat*)user_data;
+  buffer = inf_chat_buffer_new(plugin->history_size);
 
   session = inf_chat_session_new(
     manager,
@@ -60,6 +68,13 @@ infinoted_plugin_note_chat_session_new(InfIo* io,
     sync_connection
   );
 
+  g_object_set(
+    G_OBJECT(session),
+    "io", io,
+    "sync-history", (guint)plugin->sync_history,
+    NULL
+  );
+
   g_object_unref(buffer);
   return INF_SESSION(session);
 }
@@ -72,13 +87,15 @@ infinoted_plugin_note_chat_session_read(InfdStorage* storage,
                                         gpointer user_data,
                                         GError** error)
 {
+  InfinotedPluginNoteChat* plugin;
   InfChatBuffer* buffer;
   gboolean result;
   InfChatSession* session;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
 
-  buffer = inf_chat_buffer_new(256);
+  plugin = (InfinotedPluginNoteChat*)user_data;
+  buffer = inf_chat_buffer_new(plugin->history_size);
 
   result = infd_chat_filesystem_format_read(
     INFD_FILESYSTEM_STORAGE(storage),
@@ -101,6 +118,13 @@ infinoted_plugin_note_chat_session_read(InfdStorage* storage,
     NULL
   );
 
+  g_object_set(
+    G_OBJECT(session),
+    "io", io,
+    "sync-history", (guint)plugin->sync_history,
+    NULL
+  );
+
   g_object_unref(buffer);
   return INF_SESSION(session);
 }
@@ -137,6 +161,8 @@ infinoted_plugin_note_chat_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginNoteChat*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->history_size = 256;
+  plugin->sync_history = 0;
   plugin->plugin = NULL;
 }
 
@@ -152,9 +178,12 @@ infinoted_plugin_note_chat_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  plugin->note_plugin = INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN;
+  plugin->note_plugin.user_data = plugin;
+
   result = infd_directory_add_plugin(
     infinoted_plugin_manager_get_directory(manager),
-    &INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN
+    &plugin->note_plugin
   );
 
   if(result != TRUE)
@@ -170,7 +199,7 @@ infinoted_plugin_note_chat_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
-  plugin->plugin = &INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN;
+  plugin->plugin = &plugin->note_plugin;
   return TRUE;
 }
 
@@ -198,6 +227,27 @@ infinoted_plugin_note_chat_deinitialize(gpointer plugin_info)
 
 static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_CHAT_OPTIONS[] = {
   {
+    "history-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteChat, history_size),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The number of messages to keep in a chat document. Older messages "
+       "are removed when new ones are written. The default is 256."),
+    N_("MESSAGES")
+  }, {
+    "sync-history",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteChat, sync_history),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of most recent messages that are sent to clients "
+       "joining a chat document. Clients can request older messages "
+       "later. 0 means to send all messages, which is the default."),
+    N_("MESSAGES")
+  }, {
     NULL,
     0,
     0,
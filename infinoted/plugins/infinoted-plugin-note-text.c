@@ -29,9 +29,19 @@
 typedef struct _InfinotedPluginNoteText InfinotedPluginNoteText;
 struct _InfinotedPluginNoteText {
   InfinotedPluginManager* manager;
+  gboolean binary;
+  guint translation_budget;
+
+  InfdNotePlugin note_plugin;
   const InfdNotePlugin* plugin;
 };
 
+typedef struct _InfinotedPluginNoteTextWrite InfinotedPluginNoteTextWrite;
+struct _InfinotedPluginNoteTextWrite {
+  InfdNotePluginWriteFunc func;
+  gpointer user_data;
+};
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -42,9 +52,11 @@ infinoted_plugin_note_text_session_new(InfIo* io,
                                        const gchar* path,
                                        gpointer user_data)
 {
+  InfinotedPluginNoteText* plugin;
   InfTextSession* session;
   InfTextBuffer* buffer;
 
+  plugin = (InfinotedPluginNoteText*)user_data;
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
 
   session = inf_text_session_new(
@@ -56,6 +68,12 @@ infinoted_plugin_note_text_session_new(InfIo* io,
     sync_connection
   );
 
+  g_object_set(
+    G_OBJECT(session),
+    "translation-budget", plugin->translation_budget,
+    NULL
+  );
+
   g_object_unref(buffer);
 
   return INF_SESSION(session);
@@ -69,12 +87,14 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
                                         gpointer user_data,
                                         GError** error)
 {
+  InfinotedPluginNoteText* plugin;
   InfUserTable* user_table;
   InfTextBuffer* buffer;
   gboolean result;
   InfTextSession* session;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
+  plugin = (InfinotedPluginNoteText*)user_data;
 
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
@@ -104,6 +124,12 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
     NULL
   );
 
+  g_object_set(
+    G_OBJECT(session),
+    "translation-budget", plugin->translation_budget,
+    NULL
+  );
+
   g_object_unref(user_table);
   g_object_unref(buffer);
 
@@ -117,6 +143,20 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          gpointer user_data,
                                          GError** error)
 {
+  InfinotedPluginNoteText* plugin;
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  if(plugin->binary)
+  {
+    return inf_text_filesystem_format_write_binary(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      error
+    );
+  }
+
   return inf_text_filesystem_format_write(
     INFD_FILESYSTEM_STORAGE(storage),
     path,
@@ -126,13 +166,79 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
   );
 }
 
+static void
+infinoted_plugin_note_text_session_write_func(InfdFilesystemStorage* storage,
+                                              const GError* error,
+                                              gpointer user_data)
+{
+  InfinotedPluginNoteTextWrite* write;
+  write = (InfinotedPluginNoteTextWrite*)user_data;
+
+  write->func(error, write->user_data);
+  g_slice_free(InfinotedPluginNoteTextWrite, write);
+}
+
+static gboolean
+infinoted_plugin_note_text_session_write_async(InfdStorage* storage,
+                                               InfIo* io,
+                                               InfSession* session,
+                                               const gchar* path,
+                                               gpointer user_data,
+                                               InfdNotePluginWriteFunc func,
+                                               gpointer func_data,
+                                               GError** error)
+{
+  InfinotedPluginNoteText* plugin;
+  InfinotedPluginNoteTextWrite* write;
+  gboolean result;
+
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  write = g_slice_new(InfinotedPluginNoteTextWrite);
+  write->func = func;
+  write->user_data = func_data;
+
+  if(plugin->binary)
+  {
+    result = inf_text_filesystem_format_write_binary_async(
+      INFD_FILESYSTEM_STORAGE(storage),
+      io,
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      infinoted_plugin_note_text_session_write_func,
+      write,
+      error
+    );
+  }
+  else
+  {
+    result = inf_text_filesystem_format_write_async(
+      INFD_FILESYSTEM_STORAGE(storage),
+      io,
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      infinoted_plugin_note_text_session_write_func,
+      write,
+      error
+    );
+  }
+
+  if(result == FALSE)
+    g_slice_free(InfinotedPluginNoteTextWrite, write);
+
+  return result;
+}
+
 const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   NULL,
   "InfdFilesystemStorage",
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  infinoted_plugin_note_text_session_write_async
 };
 
 /* Infinoted plugin glue */
@@ -143,6 +249,8 @@ infinoted_plugin_note_text_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginNoteText*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->binary = FALSE;
+  plugin->translation_budget = 0;
   plugin->plugin = NULL;
 }
 
@@ -158,9 +266,13 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  /* The plugin parameters are passed to the note plugin functions */
+  plugin->note_plugin = INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->note_plugin.user_data = plugin;
+
   result = infd_directory_add_plugin(
     infinoted_plugin_manager_get_directory(manager),
-    &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN
+    &plugin->note_plugin
   );
 
   if(result != TRUE)
@@ -176,7 +288,7 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
-  plugin->plugin = &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->plugin = &plugin->note_plugin;
   return TRUE;
 }
 
@@ -204,6 +316,31 @@ infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
 
 static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
   {
+    "binary",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, binary),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to store documents in a compact binary format instead of "
+       "XML, which is much faster to load. Documents in either format can "
+       "be read regardless of this setting. If the autosave plugin is used, "
+       "its \"binary\" option should be set to the same value."),
+    NULL
+  }, {
+    "translation-budget",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteText, translation_budget),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Maximum number of concurrent changes a change received from a "
+       "client is transformed against within one main loop iteration. "
+       "Changes made after a long offline period are then transformed in "
+       "several steps, so that other documents stay responsive in the "
+       "meanwhile. 0 transforms every change in one go. [Default: 0]"),
+    N_("REQUESTS")
+  }, {
     NULL,
     0,
     0,
@@ -0,0 +1,161 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/inf-i18n.h>
+
+typedef struct _InfinotedPluginRateLimit InfinotedPluginRateLimit;
+struct _InfinotedPluginRateLimit {
+  InfinotedPluginManager* manager;
+  guint rate;
+  guint user_rate;
+  guint burst;
+};
+
+static void
+infinoted_plugin_rate_limit_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginRateLimit* plugin;
+  plugin = (InfinotedPluginRateLimit*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->rate = 0;
+  plugin->user_rate = 0;
+  plugin->burst = 0;
+}
+
+static gboolean
+infinoted_plugin_rate_limit_initialize(InfinotedPluginManager* manager,
+                                       gpointer plugin_info,
+                                       GError** error)
+{
+  InfinotedPluginRateLimit* plugin;
+  plugin = (InfinotedPluginRateLimit*)plugin_info;
+
+  plugin->manager = manager;
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_rate_limit_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginRateLimit* plugin;
+  plugin = (InfinotedPluginRateLimit*)plugin_info;
+}
+
+static void
+infinoted_plugin_rate_limit_session_added(const InfBrowserIter* iter,
+                                          InfSessionProxy* proxy,
+                                          gpointer plugin_info,
+                                          gpointer session_info)
+{
+  InfinotedPluginRateLimit* plugin;
+  plugin = (InfinotedPluginRateLimit*)plugin_info;
+
+  g_object_set(
+    G_OBJECT(proxy),
+    "rate-limit", plugin->rate,
+    "user-rate-limit", plugin->user_rate,
+    "rate-burst", plugin->burst,
+    NULL
+  );
+}
+
+static void
+infinoted_plugin_rate_limit_session_removed(const InfBrowserIter* iter,
+                                            InfSessionProxy* proxy,
+                                            gpointer plugin_info,
+                                            gpointer session_info)
+{
+  /* Lift the limits, so that nothing is held back when the plugin is
+   * unloaded at runtime. */
+  g_object_set(
+    G_OBJECT(proxy),
+    "rate-limit", 0,
+    "user-rate-limit", 0,
+    NULL
+  );
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_RATE_LIMIT_OPTIONS[] = {
+  {
+    "rate",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginRateLimit, rate),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of messages per second that are processed from each "
+       "connection subscribed to a document. 0 means no limit."),
+    N_("MESSAGES")
+  }, {
+    "user-rate",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginRateLimit, user_rate),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of messages per second that are processed on behalf of "
+       "each user in a document. 0 means no limit."),
+    N_("MESSAGES")
+  }, {
+    "burst",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginRateLimit, burst),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of messages that can be processed at once before the "
+       "limits apply. 0 means as many as are allowed per second."),
+    N_("MESSAGES")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "rate-limit",
+  N_("Limits the rate at which messages from clients are processed, so that "
+     "a single client flooding a document cannot starve the others. "
+     "Messages beyond the limit are not rejected, but held back and "
+     "processed later, taking turns with the other connections. Clients "
+     "are never disconnected by this plugin."),
+  INFINOTED_PLUGIN_RATE_LIMIT_OPTIONS,
+  sizeof(InfinotedPluginRateLimit),
+  0,
+  0,
+  NULL,
+  infinoted_plugin_rate_limit_info_initialize,
+  infinoted_plugin_rate_limit_initialize,
+  infinoted_plugin_rate_limit_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_rate_limit_session_added,
+  infinoted_plugin_rate_limit_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
@@ -30,6 +30,7 @@
 typedef struct _InfinotedPluginRecord InfinotedPluginRecord;
 struct _InfinotedPluginRecord {
   InfinotedPluginManager* manager;
+  guint checkpoint_interval;
 };
 
 typedef struct _InfinotedPluginRecordSessionInfo
@@ -96,6 +97,13 @@ infinoted_plugin_record_start(InfinotedPluginRecord* plugin,
     else
     {
       record = inf_adopted_session_record_new(session);
+
+      g_object_set(
+        G_OBJECT(record),
+        "checkpoint-interval", plugin->checkpoint_interval,
+        NULL
+      );
+
       inf_adopted_session_record_start_recording(record, filename, &error);
       if(error != NULL)
       {
@@ -125,6 +133,7 @@ infinoted_plugin_record_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginRecord*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->checkpoint_interval = 0;
 }
 
 static gboolean
@@ -208,6 +217,17 @@ infinoted_plugin_record_session_removed(const InfBrowserIter* iter,
 
 static const InfinotedParameterInfo INFINOTED_PLUGIN_RECORD_OPTIONS[] = {
   {
+    "checkpoint-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginRecord, checkpoint_interval),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of requests after which to write a snapshot of the "
+       "session into the record, so that replays can seek to a position "
+       "without playing the whole record. 0 means no snapshots are written."),
+    N_("REQUESTS")
+  }, {
     NULL,
     0,
     0,
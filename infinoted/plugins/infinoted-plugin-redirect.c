@@ -0,0 +1,161 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+typedef struct _InfinotedPluginRedirect InfinotedPluginRedirect;
+struct _InfinotedPluginRedirect {
+  InfinotedPluginManager* manager;
+  gchar** redirects;
+};
+
+static void
+infinoted_plugin_redirect_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginRedirect* plugin;
+  plugin = (InfinotedPluginRedirect*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->redirects = NULL;
+}
+
+static gboolean
+infinoted_plugin_redirect_initialize(InfinotedPluginManager* manager,
+                                     gpointer plugin_info,
+                                     GError** error)
+{
+  InfinotedPluginRedirect* plugin;
+  InfdDirectory* directory;
+  gchar** redirect;
+  gchar* separator;
+
+  plugin = (InfinotedPluginRedirect*)plugin_info;
+
+  if(plugin->redirects == NULL)
+    return TRUE;
+
+  /* Validate all entries before applying any of them */
+  for(redirect = plugin->redirects; *redirect != NULL; ++redirect)
+  {
+    separator = strchr(*redirect, '=');
+    if((*redirect)[0] != '/' || separator == NULL ||
+       separator == *redirect + 1 || separator[1] == '\0')
+    {
+      g_set_error(
+        error,
+        infinoted_parameter_error_quark(),
+        INFINOTED_PARAMETER_ERROR_INVALID_FLAG,
+        _("\"%s\" is not a valid redirect. Redirects need to be given in "
+          "the form \"/path/to/subdirectory=location\""),
+        *redirect
+      );
+
+      return FALSE;
+    }
+  }
+
+  plugin->manager = manager;
+
+  directory = infinoted_plugin_manager_get_directory(manager);
+  for(redirect = plugin->redirects; *redirect != NULL; ++redirect)
+  {
+    separator = strchr(*redirect, '=');
+    *separator = '\0';
+    infd_directory_set_redirect(directory, *redirect, separator + 1);
+    *separator = '=';
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_redirect_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginRedirect* plugin;
+  InfdDirectory* directory;
+  gchar** redirect;
+  gchar* separator;
+
+  plugin = (InfinotedPluginRedirect*)plugin_info;
+
+  /* The manager is only set once the redirects have been applied */
+  if(plugin->manager != NULL)
+  {
+    directory = infinoted_plugin_manager_get_directory(plugin->manager);
+    for(redirect = plugin->redirects; *redirect != NULL; ++redirect)
+    {
+      separator = strchr(*redirect, '=');
+      *separator = '\0';
+      infd_directory_set_redirect(directory, *redirect, NULL);
+      *separator = '=';
+    }
+  }
+
+  g_strfreev(plugin->redirects);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_REDIRECT_OPTIONS[] = {
+  {
+    "redirects",
+    INFINOTED_PARAMETER_STRING_LIST,
+    0,
+    offsetof(InfinotedPluginRedirect, redirects),
+    infinoted_parameter_convert_string_list,
+    0,
+    N_("A list of subdirectories whose content is hosted on other servers, "
+       "together with the location of the server hosting them, such as "
+       "\"/projects/large=host.example.com:6524\"."),
+    N_("PATH=LOCATION;PATH=LOCATION;[...]")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "redirect",
+  N_("Splits the document tree among several servers. Clients listing the "
+     "parent of a redirected subdirectory are told which server hosts its "
+     "content, and requests to explore it or to add documents to it are "
+     "refused. The subdirectories still need to exist on this server, for "
+     "example as empty directories, in order to be listed."),
+  INFINOTED_PLUGIN_REDIRECT_OPTIONS,
+  sizeof(InfinotedPluginRedirect),
+  0,
+  0,
+  NULL,
+  infinoted_plugin_redirect_info_initialize,
+  infinoted_plugin_redirect_initialize,
+  infinoted_plugin_redirect_deinitialize,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,1458 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-name-resolver.h>
+#include <libinfinity/common/inf-protocol.h>
+#include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-error.h>
+#include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+typedef struct _InfinotedPluginReplica InfinotedPluginReplica;
+struct _InfinotedPluginReplica {
+  InfinotedPluginManager* manager;
+  gchar* primary;
+  guint port;
+  guint reconnect_interval;
+  gboolean relay;
+  gboolean takeover;
+
+  InfCommunicationManager* communication_manager;
+  InfcBrowser* browser;
+  InfIoTimeout* reconnect_timeout;
+
+  /* Whether the connection to the primary has been established */
+  gboolean connected;
+
+  /* Warm copies of the primary's text documents, mapping from the path of
+   * a document to InfinotedPluginReplicaDocument. The documents are kept
+   * after the connection is lost, which is when they are needed. */
+  GHashTable* documents;
+};
+
+typedef struct _InfinotedPluginReplicaDocument InfinotedPluginReplicaDocument;
+struct _InfinotedPluginReplicaDocument {
+  InfinotedPluginReplica* plugin;
+  gchar* path;
+  InfSession* session;
+  gboolean synchronized;
+
+  /* In relay mode, the session through which the document is served to
+   * local clients, and the local users that repeat the changes of the
+   * primary's users in it, mapping from the user ID at the primary to the
+   * local InfUser. */
+  InfSessionProxy* local;
+  InfTextBuffer* local_buffer;
+  GHashTable* users;
+};
+
+typedef struct _InfinotedPluginReplicaJoin InfinotedPluginReplicaJoin;
+struct _InfinotedPluginReplicaJoin {
+  InfUser* user;
+  GError* error;
+};
+
+static void
+infinoted_plugin_replica_connect(InfinotedPluginReplica* plugin);
+
+static InfSession*
+infinoted_plugin_replica_session_new(InfIo* io,
+                                     InfCommunicationManager* manager,
+                                     InfSessionStatus status,
+                                     InfCommunicationGroup* sync_group,
+                                     InfXmlConnection* sync_connection,
+                                     const gchar* path,
+                                     gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INFINOTED_PLUGIN_REPLICA_TEXT_PLUGIN = {
+  NULL,
+  "InfText",
+  infinoted_plugin_replica_session_new
+};
+
+/*
+ * Local copies
+ */
+
+static void
+infinoted_plugin_replica_request_finished_cb(InfRequest* request,
+                                             const InfRequestResult* result,
+                                             const GError* error,
+                                             gpointer user_data)
+{
+  GError** out;
+  out = (GError**)user_data;
+
+  if(error != NULL && *out == NULL)
+    *out = g_error_copy(error);
+}
+
+/* Looks up the child of parent called name in the local directory. All
+ * operations on the local directory finish immediately. */
+static gboolean
+infinoted_plugin_replica_find_child(InfBrowser* browser,
+                                    const InfBrowserIter* parent,
+                                    const gchar* name,
+                                    InfBrowserIter* child)
+{
+  if(!inf_browser_get_explored(browser, parent))
+    inf_browser_explore(browser, parent, NULL, NULL);
+
+  *child = *parent;
+  if(!inf_browser_get_child(browser, child))
+    return FALSE;
+
+  do
+  {
+    if(strcmp(inf_browser_get_node_name(browser, child), name) == 0)
+      return TRUE;
+  } while(inf_browser_get_next(browser, child));
+
+  return FALSE;
+}
+
+/* Looks up the node at path in the local directory, without creating
+ * anything that does not exist. */
+static gboolean
+infinoted_plugin_replica_find_path(InfBrowser* browser,
+                                   const gchar* path,
+                                   InfBrowserIter* iter)
+{
+  InfBrowserIter parent;
+  gchar** components;
+  gboolean found;
+  guint i;
+
+  inf_browser_get_root(browser, iter);
+  components = g_strsplit(path + 1, "/", -1);
+  found = TRUE;
+
+  for(i = 0; found && components[i] != NULL; ++i)
+  {
+    parent = *iter;
+    if(!inf_browser_is_subdirectory(browser, &parent))
+    {
+      found = FALSE;
+    }
+    else
+    {
+      found = infinoted_plugin_replica_find_child(
+        browser,
+        &parent,
+        components[i],
+        iter
+      );
+    }
+  }
+
+  g_strfreev(components);
+  return found;
+}
+
+static void
+infinoted_plugin_replica_copy_user_func(InfUser* user,
+                                        gpointer user_data)
+{
+  InfUserTable* user_table;
+  InfUser* copy;
+  gdouble hue;
+
+  user_table = (InfUserTable*)user_data;
+  g_object_get(G_OBJECT(user), "hue", &hue, NULL);
+
+  /* Only the attributes that are stored with a document are copied. The
+   * users are not available anymore after the takeover. */
+  copy = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", inf_user_get_id(user),
+      "name", inf_user_get_name(user),
+      "hue", hue,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, copy);
+  g_object_unref(copy);
+}
+
+/* Creates a new session for the local directory with the content of
+ * session, a session that was synchronized from the primary. */
+static InfSession*
+infinoted_plugin_replica_copy_session(InfinotedPluginReplica* plugin,
+                                      InfSession* session)
+{
+  InfdDirectory* directory;
+  InfTextBuffer* warm_buffer;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  InfUserTable* user_table;
+  InfTextSession* copy;
+
+  directory = infinoted_plugin_manager_get_directory(plugin->manager);
+  warm_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+
+  buffer = INF_TEXT_BUFFER(
+    inf_text_default_buffer_new(inf_text_buffer_get_encoding(warm_buffer))
+  );
+
+  chunk = inf_text_buffer_get_slice(
+    warm_buffer,
+    0,
+    inf_text_buffer_get_length(warm_buffer)
+  );
+
+  inf_text_buffer_insert_chunk(buffer, 0, chunk, NULL);
+  inf_text_chunk_free(chunk);
+
+  user_table = inf_user_table_new();
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    infinoted_plugin_replica_copy_user_func,
+    user_table
+  );
+
+  copy = inf_text_session_new_with_user_table(
+    infd_directory_get_communication_manager(directory),
+    buffer,
+    infd_directory_get_io(directory),
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+
+  return INF_SESSION(copy);
+}
+
+/* Makes the warm copy of the document at path available in the local
+ * directory, creating its parent directories as required. A document
+ * which already exists at path is replaced, since the warm copy is more
+ * recent than anything this server has stored. If read_only is set, local
+ * clients cannot join users into the new document. If proxy is not NULL,
+ * it is set to the session proxy of the new document. */
+static gboolean
+infinoted_plugin_replica_promote_document(InfinotedPluginReplica* plugin,
+                                          const gchar* path,
+                                          InfSession* session,
+                                          gboolean read_only,
+                                          InfSessionProxy** proxy,
+                                          GError** error)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfBrowserIter child;
+  InfSession* copy;
+  InfAclSheet sheet;
+  InfAclSheetSet* sheet_set;
+  GError* local_error;
+  gchar** components;
+  gboolean found;
+  guint i;
+
+  browser = INF_BROWSER(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  inf_browser_get_root(browser, &iter);
+  components = g_strsplit(path + 1, "/", -1);
+  local_error = NULL;
+
+  for(i = 0; components[i + 1] != NULL; ++i)
+  {
+    found = infinoted_plugin_replica_find_child(
+      browser,
+      &iter,
+      components[i],
+      &child
+    );
+
+    if(!found)
+    {
+      inf_browser_add_subdirectory(
+        browser,
+        &iter,
+        components[i],
+        NULL,
+        infinoted_plugin_replica_request_finished_cb,
+        &local_error
+      );
+
+      if(local_error != NULL)
+        break;
+
+      infinoted_plugin_replica_find_child(
+        browser,
+        &iter,
+        components[i],
+        &child
+      );
+    }
+    else if(!inf_browser_is_subdirectory(browser, &child))
+    {
+      g_set_error_literal(
+        &local_error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY)
+      );
+
+      break;
+    }
+
+    iter = child;
+  }
+
+  if(local_error == NULL)
+  {
+    found = infinoted_plugin_replica_find_child(
+      browser,
+      &iter,
+      components[i],
+      &child
+    );
+  }
+
+  if(local_error == NULL && found)
+  {
+    inf_browser_remove_node(
+      browser,
+      &child,
+      infinoted_plugin_replica_request_finished_cb,
+      &local_error
+    );
+  }
+
+  if(local_error == NULL)
+  {
+    sheet_set = NULL;
+    if(read_only)
+    {
+      sheet.account = inf_acl_account_id_from_string("default");
+      inf_acl_mask_set1(&sheet.mask, INF_ACL_CAN_JOIN_USER);
+      inf_acl_mask_clear(&sheet.perms);
+      sheet_set = inf_acl_sheet_set_new_external(&sheet, 1);
+    }
+
+    copy = infinoted_plugin_replica_copy_session(plugin, session);
+
+    inf_browser_add_note(
+      browser,
+      &iter,
+      components[i],
+      "InfText",
+      sheet_set,
+      copy,
+      FALSE,
+      infinoted_plugin_replica_request_finished_cb,
+      &local_error
+    );
+
+    g_object_unref(copy);
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+  }
+
+  if(local_error == NULL && proxy != NULL)
+  {
+    infinoted_plugin_replica_find_child(browser, &iter, components[i], &child);
+    *proxy = inf_browser_get_session(browser, &child);
+    g_object_ref(*proxy);
+  }
+
+  g_strfreev(components);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Relay
+ */
+
+static void
+infinoted_plugin_replica_join_finished_cb(InfRequest* request,
+                                          const InfRequestResult* result,
+                                          const GError* error,
+                                          gpointer user_data)
+{
+  InfinotedPluginReplicaJoin* join;
+  join = (InfinotedPluginReplicaJoin*)user_data;
+
+  if(error != NULL)
+  {
+    join->error = g_error_copy(error);
+  }
+  else
+  {
+    inf_request_result_get_join_user(result, NULL, &join->user);
+    g_object_ref(join->user);
+  }
+}
+
+/* Returns the local user that makes the changes of user, a user of the
+ * primary, in the local copy of doc. Since the local users are the only
+ * ones modifying the local copy, the local buffer always has the same
+ * content as the one of the primary when a change is repeated. */
+static InfUser*
+infinoted_plugin_replica_get_local_user(InfinotedPluginReplicaDocument* doc,
+                                        InfUser* user,
+                                        GError** error)
+{
+  InfinotedPluginReplicaJoin join;
+  InfUser* local_user;
+  gdouble hue;
+
+  local_user = g_hash_table_lookup(
+    doc->users,
+    GUINT_TO_POINTER(inf_user_get_id(user))
+  );
+
+  if(local_user != NULL)
+    return local_user;
+
+  g_object_get(G_OBJECT(user), "hue", &hue, NULL);
+
+  /* Joins of local users finish immediately. If the document was stored
+   * with the user, then this rejoins it. */
+  join.user = NULL;
+  join.error = NULL;
+
+  inf_text_session_join_user(
+    doc->local,
+    inf_user_get_name(user),
+    INF_USER_ACTIVE,
+    hue,
+    0,
+    0,
+    infinoted_plugin_replica_join_finished_cb,
+    &join
+  );
+
+  if(join.error != NULL)
+  {
+    g_propagate_error(error, join.error);
+    return NULL;
+  }
+
+  g_assert(join.user != NULL);
+
+  g_hash_table_insert(
+    doc->users,
+    GUINT_TO_POINTER(inf_user_get_id(user)),
+    join.user
+  );
+
+  return join.user;
+}
+
+static void
+infinoted_plugin_replica_stop_relay(InfinotedPluginReplicaDocument* doc,
+                                    gboolean remove);
+
+static void
+infinoted_plugin_replica_relay_failed(InfinotedPluginReplicaDocument* doc,
+                                      const GError* error)
+{
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(doc->plugin->manager),
+    _("Failed to relay changes to document \"%s\": %s"),
+    doc->path,
+    error->message
+  );
+
+  /* Do not serve a copy that would get out of date */
+  infinoted_plugin_replica_stop_relay(doc, TRUE);
+}
+
+static void
+infinoted_plugin_replica_text_inserted_cb(InfTextBuffer* buffer,
+                                          guint pos,
+                                          InfTextChunk* chunk,
+                                          InfUser* user,
+                                          gpointer user_data)
+{
+  InfinotedPluginReplicaDocument* doc;
+  InfUser* local_user;
+  GError* error;
+
+  doc = (InfinotedPluginReplicaDocument*)user_data;
+  error = NULL;
+
+  local_user = infinoted_plugin_replica_get_local_user(doc, user, &error);
+  if(local_user == NULL)
+  {
+    infinoted_plugin_replica_relay_failed(doc, error);
+    g_error_free(error);
+    return;
+  }
+
+  inf_text_buffer_insert_chunk(doc->local_buffer, pos, chunk, local_user);
+}
+
+static void
+infinoted_plugin_replica_text_erased_cb(InfTextBuffer* buffer,
+                                        guint pos,
+                                        InfTextChunk* chunk,
+                                        InfUser* user,
+                                        gpointer user_data)
+{
+  InfinotedPluginReplicaDocument* doc;
+  InfUser* local_user;
+  GError* error;
+
+  doc = (InfinotedPluginReplicaDocument*)user_data;
+  error = NULL;
+
+  local_user = infinoted_plugin_replica_get_local_user(doc, user, &error);
+  if(local_user == NULL)
+  {
+    infinoted_plugin_replica_relay_failed(doc, error);
+    g_error_free(error);
+    return;
+  }
+
+  inf_text_buffer_erase_text(
+    doc->local_buffer,
+    pos,
+    inf_text_chunk_get_length(chunk),
+    local_user
+  );
+}
+
+/* Serves doc to local clients, read-only, and keeps repeating the changes
+ * made at the primary. This way, viewers of a document only cost resources
+ * on this server, while the primary sends each change only once. */
+static void
+infinoted_plugin_replica_start_relay(InfinotedPluginReplicaDocument* doc)
+{
+  InfSession* local_session;
+  InfBuffer* buffer;
+  GError* error;
+  gboolean result;
+
+  g_assert(doc->local == NULL);
+
+  error = NULL;
+  result = infinoted_plugin_replica_promote_document(
+    doc->plugin,
+    doc->path,
+    doc->session,
+    TRUE,
+    &doc->local,
+    &error
+  );
+
+  if(!result)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(doc->plugin->manager),
+      _("Failed to relay document \"%s\": %s"),
+      doc->path,
+      error->message
+    );
+
+    g_error_free(error);
+    return;
+  }
+
+  g_object_get(G_OBJECT(doc->local), "session", &local_session, NULL);
+  doc->local_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(local_session));
+  g_object_ref(doc->local_buffer);
+  g_object_unref(local_session);
+
+  doc->users = g_hash_table_new_full(NULL, NULL, NULL, g_object_unref);
+
+  buffer = inf_session_get_buffer(doc->session);
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(infinoted_plugin_replica_text_inserted_cb),
+    doc
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(infinoted_plugin_replica_text_erased_cb),
+    doc
+  );
+}
+
+/* Stops repeating changes of the primary in the local copy of doc. If
+ * remove is set, the local copy is removed as well, otherwise the local
+ * users leave the session, and local clients may modify it from now on. */
+static void
+infinoted_plugin_replica_stop_relay(InfinotedPluginReplicaDocument* doc,
+                                    gboolean remove)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfSession* local_session;
+  InfBuffer* buffer;
+  GHashTableIter hash_iter;
+  gpointer value;
+  InfAclSheet sheet;
+  InfAclSheetSet* sheet_set;
+
+  if(doc->local == NULL)
+    return;
+
+  buffer = inf_session_get_buffer(doc->session);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(buffer),
+    G_CALLBACK(infinoted_plugin_replica_text_inserted_cb),
+    doc
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(buffer),
+    G_CALLBACK(infinoted_plugin_replica_text_erased_cb),
+    doc
+  );
+
+  browser = INF_BROWSER(
+    infinoted_plugin_manager_get_directory(doc->plugin->manager)
+  );
+
+  g_object_get(G_OBJECT(doc->local), "session", &local_session, NULL);
+
+  g_hash_table_iter_init(&hash_iter, doc->users);
+  while(g_hash_table_iter_next(&hash_iter, NULL, &value))
+  {
+    if(inf_user_get_status(INF_USER(value)) != INF_USER_UNAVAILABLE)
+    {
+      inf_session_set_user_status(
+        local_session,
+        INF_USER(value),
+        INF_USER_UNAVAILABLE
+      );
+    }
+  }
+
+  g_object_unref(local_session);
+
+  g_hash_table_destroy(doc->users);
+  doc->users = NULL;
+  g_object_unref(doc->local_buffer);
+  doc->local_buffer = NULL;
+  g_object_unref(doc->local);
+  doc->local = NULL;
+
+  if(infinoted_plugin_replica_find_path(browser, doc->path, &iter))
+  {
+    if(remove)
+    {
+      inf_browser_remove_node(browser, &iter, NULL, NULL);
+    }
+    else
+    {
+      /* Lift the restriction to viewers */
+      sheet.account = inf_acl_account_id_from_string("default");
+      inf_acl_mask_clear(&sheet.mask);
+      inf_acl_mask_clear(&sheet.perms);
+      sheet_set = inf_acl_sheet_set_new_external(&sheet, 1);
+      inf_browser_set_acl(browser, &iter, sheet_set, NULL, NULL);
+      inf_acl_sheet_set_free(sheet_set);
+    }
+  }
+}
+
+/*
+ * Documents
+ */
+
+static void
+infinoted_plugin_replica_synchronization_complete_cb(InfSession* session,
+                                                     InfXmlConnection* conn,
+                                                     gpointer user_data)
+{
+  InfinotedPluginReplicaDocument* doc;
+  doc = (InfinotedPluginReplicaDocument*)user_data;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infinoted_plugin_replica_synchronization_complete_cb),
+    doc
+  );
+
+  doc->synchronized = TRUE;
+  if(doc->plugin->relay)
+    infinoted_plugin_replica_start_relay(doc);
+}
+
+static InfinotedPluginReplicaDocument*
+infinoted_plugin_replica_document_new(InfinotedPluginReplica* plugin,
+                                      gchar* path,
+                                      InfSession* session)
+{
+  InfinotedPluginReplicaDocument* doc;
+
+  doc = g_slice_new(InfinotedPluginReplicaDocument);
+  doc->plugin = plugin;
+  doc->path = path;
+  doc->session = session;
+  doc->synchronized = FALSE;
+  doc->local = NULL;
+  doc->local_buffer = NULL;
+  doc->users = NULL;
+
+  if(inf_session_get_status(session) == INF_SESSION_RUNNING)
+  {
+    doc->synchronized = TRUE;
+    if(plugin->relay)
+      infinoted_plugin_replica_start_relay(doc);
+  }
+  else
+  {
+    g_signal_connect_after(
+      G_OBJECT(session),
+      "synchronization-complete",
+      G_CALLBACK(infinoted_plugin_replica_synchronization_complete_cb),
+      doc
+    );
+  }
+
+  return doc;
+}
+
+static void
+infinoted_plugin_replica_document_free(gpointer data)
+{
+  InfinotedPluginReplicaDocument* doc;
+  doc = (InfinotedPluginReplicaDocument*)data;
+
+  /* Keep the local copy, which is replaced when the relay starts again */
+  infinoted_plugin_replica_stop_relay(doc, FALSE);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(doc->session),
+    G_CALLBACK(infinoted_plugin_replica_synchronization_complete_cb),
+    doc
+  );
+
+  g_object_unref(doc->session);
+  g_free(doc->path);
+  g_slice_free(InfinotedPluginReplicaDocument, doc);
+}
+
+/* Forgets about a document that is no longer available at the primary,
+ * including the local copy that is served by the relay. */
+static void
+infinoted_plugin_replica_document_drop(InfinotedPluginReplicaDocument* doc)
+{
+  infinoted_plugin_replica_stop_relay(doc, TRUE);
+  g_hash_table_remove(doc->plugin->documents, doc->path);
+}
+
+/*
+ * Takeover
+ */
+
+/* Called when the connection to the primary is lost. From now on, this
+ * server is responsible for the documents. */
+static void
+infinoted_plugin_replica_takeover(InfinotedPluginReplica* plugin)
+{
+  InfinotedPluginReplicaDocument* doc;
+  InfinotedLog* log;
+  GHashTableIter iter;
+  gpointer value;
+  guint count;
+  GError* error;
+  gboolean result;
+
+  log = infinoted_plugin_manager_get_log(plugin->manager);
+  count = 0;
+
+  g_hash_table_iter_init(&iter, plugin->documents);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    doc = (InfinotedPluginReplicaDocument*)value;
+    error = NULL;
+
+    if(doc->local != NULL)
+    {
+      /* The relayed copy is up to date already */
+      infinoted_plugin_replica_stop_relay(doc, FALSE);
+      ++count;
+    }
+    else if(!doc->synchronized)
+    {
+      /* Only part of the document has been received */
+      infinoted_log_warning(
+        log,
+        _("Document \"%s\" was not completely received from the primary "
+          "server and is not taken over"),
+        doc->path
+      );
+    }
+    else
+    {
+      result = infinoted_plugin_replica_promote_document(
+        plugin,
+        doc->path,
+        doc->session,
+        FALSE,
+        NULL,
+        &error
+      );
+
+      if(result)
+      {
+        ++count;
+      }
+      else
+      {
+        infinoted_log_warning(
+          log,
+          _("Failed to take over document \"%s\": %s"),
+          doc->path,
+          error->message
+        );
+
+        g_error_free(error);
+      }
+    }
+  }
+
+  g_hash_table_remove_all(plugin->documents);
+
+  infinoted_log_info(
+    log,
+    _("Lost connection to primary server \"%s\", took over %u documents"),
+    plugin->primary,
+    count
+  );
+}
+
+/* Called when the connection to the primary is lost without taking over.
+ * The local copies would get out of date, so they are removed, and the
+ * documents are replicated again once the primary can be reached. */
+static void
+infinoted_plugin_replica_forget(InfinotedPluginReplica* plugin)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init(&iter, plugin->documents);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    infinoted_plugin_replica_stop_relay(
+      (InfinotedPluginReplicaDocument*)value,
+      TRUE
+    );
+  }
+
+  g_hash_table_remove_all(plugin->documents);
+  plugin->connected = FALSE;
+
+  infinoted_log_info(
+    infinoted_plugin_manager_get_log(plugin->manager),
+    _("Lost connection to primary server \"%s\", reconnecting"),
+    plugin->primary
+  );
+}
+
+/*
+ * Replication
+ */
+
+/* Explores subdirectories and subscribes to text documents of the primary
+ * as they become known, so that all of its documents are kept in memory. */
+static void
+infinoted_plugin_replica_follow(InfinotedPluginReplica* plugin,
+                                const InfBrowserIter* iter)
+{
+  InfBrowser* browser;
+  InfRequest* request;
+
+  browser = INF_BROWSER(plugin->browser);
+
+  if(inf_browser_is_subdirectory(browser, iter))
+  {
+    request = inf_browser_get_pending_request(browser, iter, "explore-node");
+
+    /* Subdirectories hosted elsewhere need their own replica */
+    if(!inf_browser_get_explored(browser, iter) && request == NULL &&
+       infc_browser_iter_get_redirect(plugin->browser, iter) == NULL)
+    {
+      inf_browser_explore(browser, iter, NULL, NULL);
+    }
+  }
+  else if(strcmp(inf_browser_get_node_type(browser, iter), "InfText") == 0)
+  {
+    request = inf_browser_get_pending_request(
+      browser,
+      iter,
+      "subscribe-session"
+    );
+
+    if(inf_browser_get_session(browser, iter) == NULL && request == NULL)
+      inf_browser_subscribe(browser, iter, NULL, NULL);
+  }
+}
+
+static gboolean
+infinoted_plugin_replica_is_disconnecting(InfinotedPluginReplica* plugin)
+{
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+
+  connection = infc_browser_get_connection(plugin->browser);
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+  return status != INF_XML_CONNECTION_OPEN;
+}
+
+static void
+infinoted_plugin_replica_node_added_cb(InfBrowser* browser,
+                                       const InfBrowserIter* iter,
+                                       InfRequest* request,
+                                       gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  plugin = (InfinotedPluginReplica*)user_data;
+
+  infinoted_plugin_replica_follow(plugin, iter);
+}
+
+static void
+infinoted_plugin_replica_node_removed_cb(InfBrowser* browser,
+                                         const InfBrowserIter* iter,
+                                         InfRequest* request,
+                                         gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  InfinotedPluginReplicaDocument* doc;
+  GHashTableIter hash_iter;
+  gpointer value;
+  gchar* path;
+  gsize len;
+
+  plugin = (InfinotedPluginReplica*)user_data;
+
+  /* When the connection is lost, the browser forgets about all nodes, but
+   * the documents still exist on the primary. */
+  if(infinoted_plugin_replica_is_disconnecting(plugin))
+    return;
+
+  path = inf_browser_get_path(browser, iter);
+  len = strlen(path);
+
+  /* Removing a subdirectory removes all documents below it */
+  g_hash_table_iter_init(&hash_iter, plugin->documents);
+  while(g_hash_table_iter_next(&hash_iter, NULL, &value))
+  {
+    doc = (InfinotedPluginReplicaDocument*)value;
+    if(strncmp(doc->path, path, len) == 0 &&
+       (doc->path[len] == '\0' || doc->path[len] == '/'))
+    {
+      infinoted_plugin_replica_stop_relay(doc, TRUE);
+      g_hash_table_iter_remove(&hash_iter);
+    }
+  }
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_replica_subscribe_session_cb(InfBrowser* browser,
+                                              const InfBrowserIter* iter,
+                                              InfSessionProxy* proxy,
+                                              InfRequest* request,
+                                              gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  InfinotedPluginReplicaDocument* doc;
+  InfSession* session;
+  gchar* path;
+
+  plugin = (InfinotedPluginReplica*)user_data;
+
+  /* Ignore the chat */
+  if(iter == NULL) return;
+
+  /* Release a copy from a previous connection before replacing it */
+  path = inf_browser_get_path(browser, iter);
+  g_hash_table_remove(plugin->documents, path);
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  doc = infinoted_plugin_replica_document_new(plugin, path, session);
+  g_hash_table_insert(plugin->documents, doc->path, doc);
+}
+
+static void
+infinoted_plugin_replica_unsubscribe_session_cb(InfBrowser* browser,
+                                                const InfBrowserIter* iter,
+                                                InfSessionProxy* proxy,
+                                                InfRequest* request,
+                                                gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  InfinotedPluginReplicaDocument* doc;
+  gchar* path;
+
+  plugin = (InfinotedPluginReplica*)user_data;
+  if(iter == NULL) return;
+
+  /* Keep the warm copy if the connection to the primary is lost, but not
+   * when the primary unsubscribed us, since the copy would get stale. */
+  if(infinoted_plugin_replica_is_disconnecting(plugin))
+    return;
+
+  path = inf_browser_get_path(browser, iter);
+  doc = g_hash_table_lookup(plugin->documents, path);
+  g_free(path);
+
+  if(doc != NULL)
+    infinoted_plugin_replica_document_drop(doc);
+}
+
+static void
+infinoted_plugin_replica_error_cb(InfBrowser* browser,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  plugin = (InfinotedPluginReplica*)user_data;
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(plugin->manager),
+    _("Error from primary server \"%s\": %s"),
+    plugin->primary,
+    error->message
+  );
+}
+
+static void
+infinoted_plugin_replica_reconnect_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  plugin = (InfinotedPluginReplica*)user_data;
+
+  plugin->reconnect_timeout = NULL;
+  infinoted_plugin_replica_connect(plugin);
+}
+
+static void
+infinoted_plugin_replica_schedule_reconnect(InfinotedPluginReplica* plugin)
+{
+  InfIo* io;
+
+  if(plugin->reconnect_timeout == NULL)
+  {
+    io = infd_directory_get_io(
+      infinoted_plugin_manager_get_directory(plugin->manager)
+    );
+
+    plugin->reconnect_timeout = inf_io_add_timeout(
+      io,
+      plugin->reconnect_interval * 1000,
+      infinoted_plugin_replica_reconnect_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_plugin_replica_notify_status_cb(GObject* object,
+                                          GParamSpec* pspec,
+                                          gpointer user_data)
+{
+  InfinotedPluginReplica* plugin;
+  InfBrowserStatus status;
+  InfBrowserIter iter;
+
+  plugin = (InfinotedPluginReplica*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_BROWSER_OPENING:
+    break;
+  case INF_BROWSER_OPEN:
+    plugin->connected = TRUE;
+
+    infinoted_log_info(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Connected to primary server \"%s\", replicating its documents"),
+      plugin->primary
+    );
+
+    inf_browser_get_root(INF_BROWSER(plugin->browser), &iter);
+    infinoted_plugin_replica_follow(plugin, &iter);
+    break;
+  case INF_BROWSER_CLOSED:
+    /* Until the primary has been reached once, keep trying, since both
+     * servers are usually started at the same time. */
+    if(plugin->connected && plugin->takeover)
+    {
+      infinoted_plugin_replica_takeover(plugin);
+    }
+    else
+    {
+      if(plugin->connected)
+        infinoted_plugin_replica_forget(plugin);
+      infinoted_plugin_replica_schedule_reconnect(plugin);
+    }
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+infinoted_plugin_replica_disconnect(InfinotedPluginReplica* plugin)
+{
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+
+  if(plugin->browser != NULL)
+  {
+    g_signal_handlers_disconnect_matched(
+      G_OBJECT(plugin->browser),
+      G_SIGNAL_MATCH_DATA,
+      0,
+      0,
+      NULL,
+      NULL,
+      plugin
+    );
+
+    connection = infc_browser_get_connection(plugin->browser);
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+    if(status == INF_XML_CONNECTION_OPENING ||
+       status == INF_XML_CONNECTION_OPEN)
+    {
+      inf_xml_connection_close(connection);
+    }
+
+    g_object_unref(plugin->browser);
+    plugin->browser = NULL;
+  }
+}
+
+static void
+infinoted_plugin_replica_connect(InfinotedPluginReplica* plugin)
+{
+  InfIo* io;
+  InfNameResolver* resolver;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  gchar* service;
+  GError* error;
+
+  infinoted_plugin_replica_disconnect(plugin);
+
+  io = infd_directory_get_io(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  service = g_strdup_printf("%u", plugin->port);
+  resolver = inf_name_resolver_new(io, plugin->primary, service, NULL);
+  g_free(service);
+
+  tcp = inf_tcp_connection_new_resolve(io, resolver);
+  g_object_unref(resolver);
+
+  xmpp = inf_xmpp_connection_new(
+    tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    NULL,
+    plugin->primary,
+    INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  plugin->browser = infc_browser_new(
+    io,
+    plugin->communication_manager,
+    INF_XML_CONNECTION(xmpp)
+  );
+
+  g_object_unref(xmpp);
+
+  infc_browser_add_plugin(
+    plugin->browser,
+    &INFINOTED_PLUGIN_REPLICA_TEXT_PLUGIN
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "notify::status",
+    G_CALLBACK(infinoted_plugin_replica_notify_status_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "node-added",
+    G_CALLBACK(infinoted_plugin_replica_node_added_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "node-removed",
+    G_CALLBACK(infinoted_plugin_replica_node_removed_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "subscribe-session",
+    G_CALLBACK(infinoted_plugin_replica_subscribe_session_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "unsubscribe-session",
+    G_CALLBACK(infinoted_plugin_replica_unsubscribe_session_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(plugin->browser),
+    "error",
+    G_CALLBACK(infinoted_plugin_replica_error_cb),
+    plugin
+  );
+
+  error = NULL;
+  if(!inf_tcp_connection_open(tcp, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to connect to primary server \"%s\": %s"),
+      plugin->primary,
+      error->message
+    );
+
+    g_error_free(error);
+    infinoted_plugin_replica_schedule_reconnect(plugin);
+  }
+
+  g_object_unref(tcp);
+}
+
+/*
+ * Plugin interface
+ */
+
+static void
+infinoted_plugin_replica_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginReplica* plugin;
+  plugin = (InfinotedPluginReplica*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->primary = NULL;
+  plugin->port = inf_protocol_get_default_port();
+  plugin->reconnect_interval = 5;
+  plugin->relay = FALSE;
+  plugin->takeover = TRUE;
+
+  plugin->communication_manager = NULL;
+  plugin->browser = NULL;
+  plugin->reconnect_timeout = NULL;
+  plugin->connected = FALSE;
+  plugin->documents = NULL;
+}
+
+static gboolean
+infinoted_plugin_replica_initialize(InfinotedPluginManager* manager,
+                                    gpointer plugin_info,
+                                    GError** error)
+{
+  InfinotedPluginReplica* plugin;
+  plugin = (InfinotedPluginReplica*)plugin_info;
+
+  plugin->manager = manager;
+  plugin->communication_manager = inf_communication_manager_new();
+
+  plugin->documents = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    NULL,
+    infinoted_plugin_replica_document_free
+  );
+
+  infinoted_plugin_replica_connect(plugin);
+  return TRUE;
+}
+
+static void
+infinoted_plugin_replica_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginReplica* plugin;
+  InfIo* io;
+
+  plugin = (InfinotedPluginReplica*)plugin_info;
+
+  if(plugin->reconnect_timeout != NULL)
+  {
+    io = infd_directory_get_io(
+      infinoted_plugin_manager_get_directory(plugin->manager)
+    );
+
+    inf_io_remove_timeout(io, plugin->reconnect_timeout);
+    plugin->reconnect_timeout = NULL;
+  }
+
+  infinoted_plugin_replica_disconnect(plugin);
+
+  if(plugin->documents != NULL)
+    g_hash_table_destroy(plugin->documents);
+  if(plugin->communication_manager != NULL)
+    g_object_unref(plugin->communication_manager);
+
+  g_free(plugin->primary);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_REPLICA_OPTIONS[] = {
+  {
+    "primary",
+    INFINOTED_PARAMETER_STRING,
+    INFINOTED_PARAMETER_REQUIRED,
+    offsetof(InfinotedPluginReplica, primary),
+    infinoted_parameter_convert_string,
+    0,
+    N_("The host name of the primary server whose documents to replicate."),
+    N_("HOSTNAME")
+  }, {
+    "port",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginReplica, port),
+    infinoted_parameter_convert_port,
+    0,
+    N_("The port number on which the primary server accepts connections."),
+    N_("PORT")
+  }, {
+    "reconnect-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginReplica, reconnect_interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Interval, in seconds, in which to retry connecting to the primary "
+       "server until it is reached for the first time."),
+    N_("SECONDS")
+  }, {
+    "relay",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginReplica, relay),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Serve the documents of the primary server read-only to clients of "
+       "this server while connected to it, so that viewers do not need to "
+       "connect to the primary."),
+    NULL
+  }, {
+    "takeover",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginReplica, takeover),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Take over the documents of the primary server when the connection "
+       "to it is lost. If disabled, relayed documents are removed instead, "
+       "and the connection is retried. [Default: true]"),
+    NULL
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "replica",
+  N_("Runs this server as a hot standby or a read-only relay of a primary "
+     "server. All text documents of the primary are subscribed to, so that "
+     "every change is streamed to this server and kept in memory. When the "
+     "connection to the primary is lost, the documents are added to this "
+     "server's directory, replacing any stored versions, and it takes over "
+     "without loading anything from disk. In relay mode, the documents are "
+     "also served to clients of this server while the primary is "
+     "reachable, but these clients can only view them."),
+  INFINOTED_PLUGIN_REPLICA_OPTIONS,
+  sizeof(InfinotedPluginReplica),
+  0,
+  0,
+  NULL,
+  infinoted_plugin_replica_info_initialize,
+  infinoted_plugin_replica_initialize,
+  infinoted_plugin_replica_deinitialize,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+/* vim:set et sw=2 ts=2: */
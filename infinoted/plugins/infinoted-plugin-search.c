@@ -0,0 +1,557 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include "util/infinoted-plugin-util-search-index.h"
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-buffer.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+#include <errno.h>
+
+/* The index is stored as ".search-index" in the root directory */
+#define INFINOTED_PLUGIN_SEARCH_IDENTIFIER "search-index"
+#define INFINOTED_PLUGIN_SEARCH_PATH "/"
+
+typedef struct _InfinotedPluginSearch InfinotedPluginSearch;
+struct _InfinotedPluginSearch {
+  InfinotedPluginManager* manager;
+  guint save_interval;
+
+  InfinotedPluginUtilSearchIndex* index;
+  InfIoTimeout* save_timeout;
+  gboolean modified;
+  gboolean saving;
+};
+
+typedef struct _InfinotedPluginSearchSessionInfo
+  InfinotedPluginSearchSessionInfo;
+struct _InfinotedPluginSearchSessionInfo {
+  InfinotedPluginSearch* plugin;
+  InfSessionProxy* proxy;
+  InfTextBuffer* buffer;
+  gchar* path;
+};
+
+static InfdFilesystemStorage*
+infinoted_plugin_search_get_storage(InfinotedPluginSearch* plugin)
+{
+  return INFD_FILESYSTEM_STORAGE(
+    infd_directory_get_storage(
+      infinoted_plugin_manager_get_directory(plugin->manager)
+    )
+  );
+}
+
+static void
+infinoted_plugin_search_write_cb(InfdFilesystemStorage* storage,
+                                 const GError* error,
+                                 gpointer user_data)
+{
+  InfinotedPluginSearch* plugin;
+  plugin = (InfinotedPluginSearch*)user_data;
+
+  plugin->saving = FALSE;
+
+  if(error != NULL)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to save the search index: %s"),
+      error->message
+    );
+
+    /* Try again with the next change */
+    plugin->modified = TRUE;
+  }
+}
+
+static void
+infinoted_plugin_search_save(InfinotedPluginSearch* plugin)
+{
+  gchar* data;
+  gsize len;
+  GError* error;
+
+  data = infinoted_plugin_util_search_index_serialize(plugin->index, &len);
+  error = NULL;
+
+  plugin->modified = FALSE;
+  plugin->saving = infd_filesystem_storage_write_file_async(
+    infinoted_plugin_search_get_storage(plugin),
+    infinoted_plugin_manager_get_io(plugin->manager),
+    INFINOTED_PLUGIN_SEARCH_IDENTIFIER,
+    INFINOTED_PLUGIN_SEARCH_PATH,
+    data,
+    len,
+    infinoted_plugin_search_write_cb,
+    plugin,
+    &error
+  );
+
+  if(!plugin->saving)
+  {
+    infinoted_plugin_search_write_cb(
+      infinoted_plugin_search_get_storage(plugin),
+      error,
+      plugin
+    );
+
+    g_error_free(error);
+  }
+}
+
+static void
+infinoted_plugin_search_save_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginSearch* plugin;
+  plugin = (InfinotedPluginSearch*)user_data;
+
+  plugin->save_timeout = NULL;
+
+  /* If the previous write has not finished yet, wait for another interval
+   * instead of having two writes of the same file in flight. */
+  if(plugin->saving)
+  {
+    plugin->save_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->save_interval * 1000,
+      infinoted_plugin_search_save_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+  else
+  {
+    infinoted_plugin_search_save(plugin);
+  }
+}
+
+static void
+infinoted_plugin_search_changed(InfinotedPluginSearch* plugin)
+{
+  plugin->modified = TRUE;
+
+  if(plugin->save_timeout == NULL)
+  {
+    plugin->save_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->save_interval * 1000,
+      infinoted_plugin_search_save_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+}
+
+static void
+infinoted_plugin_search_load(InfinotedPluginSearch* plugin)
+{
+  gchar* full_path;
+  gchar* data;
+  gsize len;
+  GError* error;
+
+  error = NULL;
+  full_path = infd_filesystem_storage_get_path(
+    infinoted_plugin_search_get_storage(plugin),
+    INFINOTED_PLUGIN_SEARCH_IDENTIFIER,
+    INFINOTED_PLUGIN_SEARCH_PATH,
+    &error
+  );
+
+  if(full_path != NULL)
+  {
+    if(g_file_get_contents(full_path, &data, &len, &error))
+    {
+      infinoted_plugin_util_search_index_deserialize(
+        plugin->index,
+        data,
+        len,
+        &error
+      );
+
+      g_free(data);
+    }
+
+    g_free(full_path);
+  }
+
+  /* Not having an index yet is fine, it starts empty then. Documents are
+   * indexed the next time they are opened. */
+  if(error != NULL)
+  {
+    if(error->domain != G_FILE_ERROR || error->code != G_FILE_ERROR_NOENT)
+    {
+      infinoted_log_warning(
+        infinoted_plugin_manager_get_log(plugin->manager),
+        _("Failed to load the search index, starting with an empty "
+          "one: %s"),
+        error->message
+      );
+    }
+
+    g_error_free(error);
+  }
+}
+
+static void
+infinoted_plugin_search_write_sync(InfinotedPluginSearch* plugin)
+{
+  gchar* data;
+  gsize len;
+  FILE* file;
+  GError* error;
+
+  error = NULL;
+  file = infd_filesystem_storage_open(
+    infinoted_plugin_search_get_storage(plugin),
+    INFINOTED_PLUGIN_SEARCH_IDENTIFIER,
+    INFINOTED_PLUGIN_SEARCH_PATH,
+    "wb",
+    NULL,
+    &error
+  );
+
+  if(file == NULL)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to save the search index: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+    return;
+  }
+
+  data = infinoted_plugin_util_search_index_serialize(plugin->index, &len);
+
+  if(infd_filesystem_storage_stream_write(file, data, len) != len ||
+     infd_filesystem_storage_stream_close(file) != 0)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to save the search index: %s"),
+      g_strerror(errno)
+    );
+  }
+
+  g_free(data);
+}
+
+static void
+infinoted_plugin_search_text_inserted_cb(InfTextBuffer* buffer,
+                                         guint pos,
+                                         InfTextChunk* chunk,
+                                         InfUser* user,
+                                         gpointer user_data)
+{
+  InfinotedPluginSearchSessionInfo* info;
+  info = (InfinotedPluginSearchSessionInfo*)user_data;
+
+  infinoted_plugin_util_search_index_text_inserted(
+    info->plugin->index,
+    info->path,
+    buffer,
+    pos,
+    inf_text_chunk_get_length(chunk)
+  );
+
+  infinoted_plugin_search_changed(info->plugin);
+}
+
+static void
+infinoted_plugin_search_text_erased_cb(InfTextBuffer* buffer,
+                                       guint pos,
+                                       InfTextChunk* chunk,
+                                       InfUser* user,
+                                       gpointer user_data)
+{
+  InfinotedPluginSearchSessionInfo* info;
+  info = (InfinotedPluginSearchSessionInfo*)user_data;
+
+  infinoted_plugin_util_search_index_text_erased(
+    info->plugin->index,
+    info->path,
+    buffer,
+    pos,
+    chunk
+  );
+
+  infinoted_plugin_search_changed(info->plugin);
+}
+
+static void
+infinoted_plugin_search_node_removed_cb(InfBrowser* browser,
+                                        InfBrowserIter* iter,
+                                        InfRequest* request,
+                                        gpointer user_data)
+{
+  InfinotedPluginSearch* plugin;
+  gchar* path;
+
+  plugin = (InfinotedPluginSearch*)user_data;
+  path = inf_browser_get_path(browser, iter);
+
+  infinoted_plugin_util_search_index_remove_document(plugin->index, path);
+  infinoted_plugin_search_changed(plugin);
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_search_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginSearch* plugin;
+  plugin = (InfinotedPluginSearch*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->save_interval = 60;
+
+  plugin->index = NULL;
+  plugin->save_timeout = NULL;
+  plugin->modified = FALSE;
+  plugin->saving = FALSE;
+}
+
+static gboolean
+infinoted_plugin_search_initialize(InfinotedPluginManager* manager,
+                                   gpointer plugin_info,
+                                   GError** error)
+{
+  InfinotedPluginSearch* plugin;
+  InfdDirectory* directory;
+
+  plugin = (InfinotedPluginSearch*)plugin_info;
+
+  plugin->manager = manager;
+  directory = infinoted_plugin_manager_get_directory(manager);
+
+  if(!INFD_IS_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)))
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INFINOTED_PLUGIN_SEARCH_ERROR"),
+      0,
+      "%s",
+      _("The search plugin can only be used with the filesystem storage")
+    );
+
+    return FALSE;
+  }
+
+  if(infinoted_plugin_util_search_index_lookup(directory) != NULL)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INFINOTED_PLUGIN_SEARCH_ERROR"),
+      1,
+      "%s",
+      _("The search plugin can only be loaded once")
+    );
+
+    return FALSE;
+  }
+
+  plugin->index = infinoted_plugin_util_search_index_new();
+  infinoted_plugin_search_load(plugin);
+  infinoted_plugin_util_search_index_publish(plugin->index, directory);
+
+  g_signal_connect(
+    G_OBJECT(directory),
+    "node-removed",
+    G_CALLBACK(infinoted_plugin_search_node_removed_cb),
+    plugin
+  );
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_search_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginSearch* plugin;
+  InfdDirectory* directory;
+
+  plugin = (InfinotedPluginSearch*)plugin_info;
+  if(plugin->index == NULL) return;
+
+  directory = infinoted_plugin_manager_get_directory(plugin->manager);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(directory),
+    G_CALLBACK(infinoted_plugin_search_node_removed_cb),
+    plugin
+  );
+
+  if(plugin->save_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->save_timeout
+    );
+  }
+
+  /* A pending write is still completed, but we do not get notified. It
+   * cannot be overtaken by a synchronous one, so changes made since are
+   * only picked up once the affected documents are opened again. */
+  if(plugin->saving)
+  {
+    infd_filesystem_storage_cancel_write(
+      infinoted_plugin_search_get_storage(plugin),
+      infinoted_plugin_search_write_cb,
+      plugin
+    );
+  }
+  else if(plugin->modified)
+  {
+    infinoted_plugin_search_write_sync(plugin);
+  }
+
+  infinoted_plugin_util_search_index_publish(NULL, directory);
+  infinoted_plugin_util_search_index_free(plugin->index);
+}
+
+static void
+infinoted_plugin_search_session_added(const InfBrowserIter* iter,
+                                      InfSessionProxy* proxy,
+                                      gpointer plugin_info,
+                                      gpointer session_info)
+{
+  InfinotedPluginSearchSessionInfo* info;
+  InfdDirectory* directory;
+  InfSession* session;
+
+  info = (InfinotedPluginSearchSessionInfo*)session_info;
+  info->plugin = (InfinotedPluginSearch*)plugin_info;
+  info->proxy = proxy;
+  g_object_ref(proxy);
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  info->buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  info->path = inf_browser_get_path(INF_BROWSER(directory), iter);
+  g_object_ref(info->buffer);
+
+  /* The document might have been changed while it was not indexed, so
+   * index it from scratch once, and incrementally from then on. */
+  infinoted_plugin_util_search_index_set_document(
+    info->plugin->index,
+    info->path,
+    info->buffer
+  );
+
+  infinoted_plugin_search_changed(info->plugin);
+
+  g_signal_connect_after(
+    G_OBJECT(info->buffer),
+    "text-inserted",
+    G_CALLBACK(infinoted_plugin_search_text_inserted_cb),
+    info
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(info->buffer),
+    "text-erased",
+    G_CALLBACK(infinoted_plugin_search_text_erased_cb),
+    info
+  );
+
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_search_session_removed(const InfBrowserIter* iter,
+                                        InfSessionProxy* proxy,
+                                        gpointer plugin_info,
+                                        gpointer session_info)
+{
+  InfinotedPluginSearchSessionInfo* info;
+  info = (InfinotedPluginSearchSessionInfo*)session_info;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(info->buffer),
+    G_CALLBACK(infinoted_plugin_search_text_inserted_cb),
+    info
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(info->buffer),
+    G_CALLBACK(infinoted_plugin_search_text_erased_cb),
+    info
+  );
+
+  /* The document stays in the index, so that it can still be found */
+  g_object_unref(info->buffer);
+  g_object_unref(info->proxy);
+  g_free(info->path);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_SEARCH_OPTIONS[] = {
+  {
+    "save-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginSearch, save_interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Interval, in seconds, after which changes to the search index are "
+       "written to disk."),
+    N_("SECONDS")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "search",
+  N_("Maintains a full-text index of all text documents, so that they can "
+     "be searched without loading them. The index is updated with every "
+     "change and stored in the root directory. Documents are added to the "
+     "index the first time they are opened while the plugin is loaded. "
+     "Searches can be made with the dbus and document-stream plugins."),
+  INFINOTED_PLUGIN_SEARCH_OPTIONS,
+  sizeof(InfinotedPluginSearch),
+  0,
+  sizeof(InfinotedPluginSearchSessionInfo),
+  "InfTextSession",
+  infinoted_plugin_search_info_initialize,
+  infinoted_plugin_search_initialize,
+  infinoted_plugin_search_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_search_session_added,
+  infinoted_plugin_search_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
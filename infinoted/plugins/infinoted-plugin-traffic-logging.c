@@ -29,10 +29,44 @@
 #include <string.h>
 #include <errno.h>
 
+/* Binary capture files start with the eight bytes "INFTRAF1". Each record
+ * then consists of a one-byte record type, the time at which it was captured
+ * as a 64-bit big-endian number of microseconds since the epoch, the length
+ * of the payload as a 32-bit big-endian number, and the payload itself. The
+ * record type is one of the INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_*
+ * values. The payload is the serialized XML for sent and received messages,
+ * and a human-readable description for the other records. */
+static const gchar INFINOTED_PLUGIN_TRAFFIC_LOGGING_MAGIC[8] = "INFTRAF1";
+
+#define INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_SIZE 65536
+#define INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_INTERVAL 1000
+
+typedef enum _InfinotedPluginTrafficLoggingRecord {
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_RECEIVED = '<',
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_SENT = '>',
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_CONNECTED = 'C',
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_CLOSED = 'D',
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_ERROR = 'E'
+} InfinotedPluginTrafficLoggingRecord;
+
+typedef enum _InfinotedPluginTrafficLoggingFormat {
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_TEXT,
+  INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_BINARY
+} InfinotedPluginTrafficLoggingFormat;
+
 typedef struct _InfinotedPluginTrafficLogging InfinotedPluginTrafficLogging;
 struct _InfinotedPluginTrafficLogging {
   InfinotedPluginManager* manager;
   gchar* path;
+  InfinotedPluginTrafficLoggingFormat format;
+  gchar** connections;
+  guint sample_rate;
+
+  /* Number of connections matching the filter so far, for sampling */
+  guint n_matched;
+
+  GThread* thread;
+  GAsyncQueue* queue;
 };
 
 typedef struct _InfinotedPluginTrafficLoggingConnectionInfo
@@ -42,35 +76,261 @@ struct _InfinotedPluginTrafficLoggingConnectionInfo {
   InfXmlConnection* connection;
   gchar* filename;
   FILE* file;
+
+  /* Data that has not been passed to the writer thread yet */
+  GString* pending;
+  InfIoTimeout* flush_timeout;
 };
 
+/* A piece of work for the writer thread. If data is NULL, the file is
+ * closed. */
+typedef struct _InfinotedPluginTrafficLoggingJob
+  InfinotedPluginTrafficLoggingJob;
+struct _InfinotedPluginTrafficLoggingJob {
+  FILE* file;
+  GString* data;
+  gchar* filename;
+};
+
+static gchar infinoted_plugin_traffic_logging_stop_marker;
+
+static gpointer
+infinoted_plugin_traffic_logging_thread_func(gpointer data)
+{
+  InfinotedPluginTrafficLogging* plugin;
+  InfinotedPluginTrafficLoggingJob* job;
+  gpointer item;
+
+  plugin = (InfinotedPluginTrafficLogging*)data;
+
+  while( (item = g_async_queue_pop(plugin->queue)) !=
+         &infinoted_plugin_traffic_logging_stop_marker)
+  {
+    job = (InfinotedPluginTrafficLoggingJob*)item;
+
+    if(job->data != NULL)
+    {
+      fwrite(job->data->str, 1, job->data->len, job->file);
+      fflush(job->file);
+      g_string_free(job->data, TRUE);
+    }
+    else
+    {
+      if(fclose(job->file) == -1)
+      {
+        infinoted_log_warning(
+          infinoted_plugin_manager_get_log(plugin->manager),
+          "Failed to close file \"%s\": %s",
+          job->filename,
+          strerror(errno)
+        );
+      }
+
+      g_free(job->filename);
+    }
+
+    g_slice_free(InfinotedPluginTrafficLoggingJob, job);
+  }
+
+  return NULL;
+}
+
+static void
+infinoted_plugin_traffic_logging_push_job(
+  InfinotedPluginTrafficLogging* plugin,
+  FILE* file,
+  GString* data,
+  const gchar* filename)
+{
+  InfinotedPluginTrafficLoggingJob* job;
+
+  job = g_slice_new(InfinotedPluginTrafficLoggingJob);
+  job->file = file;
+  job->data = data;
+  job->filename = g_strdup(filename);
+  g_async_queue_push(plugin->queue, job);
+}
+
+/* Passes all pending data of the connection to the writer thread */
+static void
+infinoted_plugin_traffic_logging_hand_off(
+  InfinotedPluginTrafficLoggingConnectionInfo* info)
+{
+  if(info->flush_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(info->plugin->manager),
+      info->flush_timeout
+    );
+
+    info->flush_timeout = NULL;
+  }
+
+  if(info->pending->len > 0)
+  {
+    infinoted_plugin_traffic_logging_push_job(
+      info->plugin,
+      info->file,
+      info->pending,
+      NULL
+    );
+
+    info->pending =
+      g_string_sized_new(INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_SIZE);
+  }
+}
+
+static void
+infinoted_plugin_traffic_logging_flush_timeout_func(gpointer user_data)
+{
+  InfinotedPluginTrafficLoggingConnectionInfo* info;
+
+  info = (InfinotedPluginTrafficLoggingConnectionInfo*)user_data;
+  info->flush_timeout = NULL;
+
+  infinoted_plugin_traffic_logging_hand_off(info);
+}
+
 static void
 infinoted_plugin_traffic_logging_write(
   InfinotedPluginTrafficLoggingConnectionInfo* info,
-  const gchar* fmt,
-  ...)
+  InfinotedPluginTrafficLoggingRecord record,
+  const gchar* text)
 {
-  GTimeVal cur_timeval;
+  gint64 now;
   time_t cur_time;
   struct tm* cur_tm;
   char time_msg[128];
-  va_list arglist;
+  guint64 timestamp_be;
+  guint32 len_be;
+  gsize len;
 
   g_assert(info->file != NULL);
 
-  g_get_current_time(&cur_timeval);
-  cur_time = cur_timeval.tv_sec;
-  cur_tm = localtime(&cur_time);
-  strftime(time_msg, 128, "[%c ", cur_tm);
-  fputs(time_msg, info->file);
-  fprintf(info->file, ".%06ld] ", cur_timeval.tv_usec);
+  now = g_get_real_time();
+  len = strlen(text);
+
+  switch(info->plugin->format)
+  {
+  case INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_TEXT:
+    cur_time = now / G_USEC_PER_SEC;
+    cur_tm = localtime(&cur_time);
+    strftime(time_msg, 128, "[%c ", cur_tm);
+    g_string_append(info->pending, time_msg);
+    g_string_append_printf(
+      info->pending,
+      ".%06ld] ",
+      (long)(now % G_USEC_PER_SEC)
+    );
+
+    switch(record)
+    {
+    case INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_RECEIVED:
+      g_string_append(info->pending, "<<< ");
+      break;
+    case INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_SENT:
+      g_string_append(info->pending, ">>> ");
+      break;
+    default:
+      g_string_append(info->pending, "!!! ");
+      break;
+    }
+
+    g_string_append_len(info->pending, text, len);
+    g_string_append_c(info->pending, '\n');
+    break;
+  case INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_BINARY:
+    timestamp_be = GUINT64_TO_BE((guint64)now);
+    len_be = GUINT32_TO_BE((guint32)len);
+
+    g_string_append_c(info->pending, (gchar)record);
+    g_string_append_len(info->pending, (const gchar*)&timestamp_be, 8);
+    g_string_append_len(info->pending, (const gchar*)&len_be, 4);
+    g_string_append_len(info->pending, text, len);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  if(info->pending->len >= INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_SIZE)
+  {
+    infinoted_plugin_traffic_logging_hand_off(info);
+  }
+  else if(info->flush_timeout == NULL)
+  {
+    info->flush_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(info->plugin->manager),
+      INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_INTERVAL,
+      infinoted_plugin_traffic_logging_flush_timeout_func,
+      info,
+      NULL
+    );
+  }
+}
+
+static gboolean
+infinoted_plugin_traffic_logging_convert_format(gpointer out,
+                                                gpointer in,
+                                                GError** error)
+{
+  gchar** in_str;
+  InfinotedPluginTrafficLoggingFormat* out_val;
 
-  va_start(arglist, fmt);
-  vfprintf(info->file, fmt, arglist);
-  va_end(arglist);
-  fputc('\n', info->file);
+  in_str = (gchar**)in;
+  out_val = (InfinotedPluginTrafficLoggingFormat*)out;
 
-  fflush(info->file);
+  if(strcmp(*in_str, "text") == 0)
+  {
+    *out_val = INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_TEXT;
+  }
+  else if(strcmp(*in_str, "binary") == 0)
+  {
+    *out_val = INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_BINARY;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_parameter_error_quark(),
+      INFINOTED_PARAMETER_ERROR_INVALID_FLAG,
+      _("\"%s\" is not a valid capture format. Allowed values are "
+        "\"text\" or \"binary\""),
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns whether traffic of the connection with the given remote ID should
+ * be captured, according to the connection filter and the sample rate. */
+static gboolean
+infinoted_plugin_traffic_logging_should_capture(
+  InfinotedPluginTrafficLogging* plugin,
+  const gchar* remote_id)
+{
+  gchar** pattern;
+  gboolean matched;
+
+  if(plugin->connections != NULL && plugin->connections[0] != NULL)
+  {
+    matched = FALSE;
+    for(pattern = plugin->connections; *pattern != NULL; ++pattern)
+    {
+      if(g_pattern_match_simple(*pattern, remote_id))
+      {
+        matched = TRUE;
+        break;
+      }
+    }
+
+    if(!matched) return FALSE;
+  }
+
+  return (plugin->n_matched++ % plugin->sample_rate) == 0;
 }
 
 static void
@@ -91,7 +351,7 @@ infinoted_plugin_traffic_logging_received_cb(InfXmlConnection* conn,
 
   infinoted_plugin_traffic_logging_write(
     info,
-    "<<< %s",
+    INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_RECEIVED,
     (const gchar*)xmlBufferContent(buffer)
   );
 
@@ -116,7 +376,7 @@ infinoted_plugin_traffic_logging_sent_cb(InfXmlConnection* conn,
 
   infinoted_plugin_traffic_logging_write(
     info,
-    ">>> %s",
+    INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_SENT,
     (const gchar*)xmlBufferContent(buffer)
   );
 
@@ -134,7 +394,12 @@ infinoted_plugin_traffic_logging_error_cb(InfXmlConnection* conn,
   info = (InfinotedPluginTrafficLoggingConnectionInfo*)user_data;
 
   text = g_strdup_printf(_("Connection error: %s"), error->message);
-  infinoted_plugin_traffic_logging_write(info, "!!! %s", text);
+  infinoted_plugin_traffic_logging_write(
+    info,
+    INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_ERROR,
+    text
+  );
+
   g_free(text);
 }
 
@@ -146,6 +411,12 @@ infinoted_plugin_traffic_logging_info_initialize(gpointer plugin_info)
 
   plugin->manager = NULL;
   plugin->path = NULL;
+  plugin->format = INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_TEXT;
+  plugin->connections = NULL;
+  plugin->sample_rate = 1;
+  plugin->n_matched = 0;
+  plugin->thread = NULL;
+  plugin->queue = NULL;
 }
 
 static gboolean
@@ -158,6 +429,21 @@ infinoted_plugin_traffic_logging_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  plugin->queue = g_async_queue_new();
+  plugin->thread = g_thread_try_new(
+    "traffic-logging",
+    infinoted_plugin_traffic_logging_thread_func,
+    plugin,
+    error
+  );
+
+  if(plugin->thread == NULL)
+  {
+    g_async_queue_unref(plugin->queue);
+    plugin->queue = NULL;
+    return FALSE;
+  }
+
   return TRUE;
 }
 
@@ -167,6 +453,20 @@ infinoted_plugin_traffic_logging_deinitialize(gpointer plugin_info)
   InfinotedPluginTrafficLogging* plugin;
   plugin = (InfinotedPluginTrafficLogging*)plugin_info;
 
+  /* All connections have been removed at this point, so this only waits
+   * for data that is still being written. */
+  if(plugin->thread != NULL)
+  {
+    g_async_queue_push(
+      plugin->queue,
+      &infinoted_plugin_traffic_logging_stop_marker
+    );
+
+    g_thread_join(plugin->thread);
+    g_async_queue_unref(plugin->queue);
+  }
+
+  g_strfreev(plugin->connections);
   g_free(plugin->path);
 }
 
@@ -191,10 +491,22 @@ infinoted_plugin_traffic_logging_connection_added(
   info->connection = connection;
   info->filename = NULL;
   info->file = NULL;
+  info->pending = NULL;
+  info->flush_timeout = NULL;
 
   g_object_get(G_OBJECT(connection), "remote-id", &remote_id, NULL);
 
-  basename = g_strdup(remote_id);
+  if(!infinoted_plugin_traffic_logging_should_capture(plugin, remote_id))
+  {
+    g_free(remote_id);
+    return;
+  }
+
+  if(plugin->format == INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_BINARY)
+    basename = g_strdup_printf("%s.cap", remote_id);
+  else
+    basename = g_strdup(remote_id);
+
   for(c = basename; *c != '\0'; ++c)
     if(*c == '[' || *c == ']')
       *c = '_';
@@ -220,7 +532,7 @@ infinoted_plugin_traffic_logging_connection_added(
   }
   else
   {
-    info->file = fopen(info->filename, "a");
+    info->file = fopen(info->filename, "ab");
     if(info->file == NULL)
     {
       infinoted_log_warning(
@@ -234,8 +546,28 @@ infinoted_plugin_traffic_logging_connection_added(
     }
     else
     {
+      info->pending =
+        g_string_sized_new(INFINOTED_PLUGIN_TRAFFIC_LOGGING_FLUSH_SIZE);
+
+      /* Binary captures of several connections from the same host are
+       * appended to the same file, with a single header at its start. */
+      if(plugin->format == INFINOTED_PLUGIN_TRAFFIC_LOGGING_FORMAT_BINARY &&
+         fseek(info->file, 0, SEEK_END) == 0 && ftell(info->file) == 0)
+      {
+        g_string_append_len(
+          info->pending,
+          INFINOTED_PLUGIN_TRAFFIC_LOGGING_MAGIC,
+          sizeof(INFINOTED_PLUGIN_TRAFFIC_LOGGING_MAGIC)
+        );
+      }
+
       text = g_strdup_printf(_("%s connected"), remote_id);
-      infinoted_plugin_traffic_logging_write(info, "!!! %s", text);
+      infinoted_plugin_traffic_logging_write(
+        info,
+        INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_CONNECTED,
+        text
+      );
+
       g_free(text);
 
       g_signal_connect(
@@ -297,17 +629,22 @@ infinoted_plugin_traffic_logging_connection_removed(
       info
     );
 
-    infinoted_plugin_traffic_logging_write(info, "!!! %s", _("Log closed"));
+    infinoted_plugin_traffic_logging_write(
+      info,
+      INFINOTED_PLUGIN_TRAFFIC_LOGGING_RECORD_CLOSED,
+      _("Log closed")
+    );
 
-    if(fclose(info->file) == -1)
-    {
-      infinoted_log_warning(
-        infinoted_plugin_manager_get_log(plugin->manager),
-        "Failed to close file \"%s\": %s",
-        info->filename,
-        strerror(errno)
-      );
-    }
+    /* The writer thread closes the file after writing everything */
+    infinoted_plugin_traffic_logging_hand_off(info);
+    infinoted_plugin_traffic_logging_push_job(
+      plugin,
+      info->file,
+      NULL,
+      info->filename
+    );
+
+    g_string_free(info->pending, TRUE);
   }
 
   g_free(info->filename);
@@ -324,6 +661,39 @@ INFINOTED_PLUGIN_TRAFFIC_LOGGING_OPTIONS[] = {
     0,
     N_("The directory into which to write the log files."),
     N_("DIRECTORY")
+  }, {
+    "format",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedPluginTrafficLogging, format),
+    infinoted_plugin_traffic_logging_convert_format,
+    0,
+    N_("Either \"text\" to write human-readable log files, or \"binary\" "
+       "to write compact capture files with a \".cap\" suffix, which can "
+       "be replayed with inf-test-traffic-replay. [Default=text]"),
+    N_("text|binary")
+  }, {
+    "connections",
+    INFINOTED_PARAMETER_STRING_LIST,
+    0,
+    offsetof(InfinotedPluginTrafficLogging, connections),
+    infinoted_parameter_convert_string_list,
+    0,
+    N_("If set, only capture the traffic of connections whose remote ID "
+       "matches one of these patterns, which can contain the wildcards "
+       "'*' and '?'. By default, all connections are captured."),
+    N_("PATTERN")
+  }, {
+    "sample-rate",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginTrafficLogging, sample_rate),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("Only capture every n-th connection which matches the connection "
+       "filter. All traffic of a captured connection is written, so that "
+       "it can be replayed. [Default=1]"),
+    N_("N")
   }, {
     NULL,
     0,
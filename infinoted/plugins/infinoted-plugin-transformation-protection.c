@@ -43,13 +43,15 @@ struct _InfinotedPluginTransformationProtectionSessionInfo {
   InfBrowserIter iter;
 };
 
+/* Rejects a request made in the given state if it would need to be
+ * transformed against too many other requests. */
 static gboolean
-infinoted_plugin_transformation_protection_check_request_cb(InfAdoptedSession* session,
-                                                            InfAdoptedRequest* request,
-                                                            InfAdoptedUser* user,
-                                                            gpointer user_data)
+infinoted_plugin_transformation_protection_check_vector(
+  InfinotedPluginTransformationProtectionSessionInfo* info,
+  InfAdoptedSession* session,
+  InfAdoptedStateVector* vector,
+  InfAdoptedUser* user)
 {
-  InfinotedPluginTransformationProtectionSessionInfo* info;
   guint vdiff;
   InfXmlConnection* connection;
   gchar* request_str;
@@ -57,10 +59,8 @@ infinoted_plugin_transformation_protection_check_request_cb(InfAdoptedSession* s
   gchar* remote_id;
   gchar* path;
 
-  info = (InfinotedPluginTransformationProtectionSessionInfo*)user_data;
-
   vdiff = inf_adopted_state_vector_vdiff(
-    inf_adopted_request_get_vector(request),
+    vector,
     inf_adopted_algorithm_get_current(
       inf_adopted_session_get_algorithm(session)
     )
@@ -88,9 +88,7 @@ infinoted_plugin_transformation_protection_check_request_cb(InfAdoptedSession* s
       &info->iter
     );
 
-    request_str = inf_adopted_state_vector_to_string(
-      inf_adopted_request_get_vector(request)
-    );
+    request_str = inf_adopted_state_vector_to_string(vector);
 
     current_str = inf_adopted_state_vector_to_string(
       inf_adopted_algorithm_get_current(
@@ -127,6 +125,39 @@ infinoted_plugin_transformation_protection_check_request_cb(InfAdoptedSession* s
   return FALSE;
 }
 
+/* This is emitted before the request is parsed, so that far-behind requests
+ * do not even cost the creation of their operation. */
+static gboolean
+infinoted_plugin_transformation_protection_check_request_vector_cb(
+  InfAdoptedSession* session,
+  InfAdoptedStateVector* vector,
+  InfAdoptedUser* user,
+  gpointer user_data)
+{
+  return infinoted_plugin_transformation_protection_check_vector(
+    (InfinotedPluginTransformationProtectionSessionInfo*)user_data,
+    session,
+    vector,
+    user
+  );
+}
+
+/* Requests that could not be processed right away when they were received
+ * are only checked when they are processed later. */
+static gboolean
+infinoted_plugin_transformation_protection_check_request_cb(InfAdoptedSession* session,
+                                                            InfAdoptedRequest* request,
+                                                            InfAdoptedUser* user,
+                                                            gpointer user_data)
+{
+  return infinoted_plugin_transformation_protection_check_vector(
+    (InfinotedPluginTransformationProtectionSessionInfo*)user_data,
+    session,
+    inf_adopted_request_get_vector(request),
+    user
+  );
+}
+
 static gboolean
 infinoted_plugin_transformation_protection_initialize(
   InfinotedPluginManager* manager,
@@ -170,6 +201,15 @@ infinoted_plugin_transformation_protection_session_added(
   /* TODO: Check that the subscription group of 
      session uses the central method */
 
+  g_signal_connect(
+    G_OBJECT(session),
+    "check-request-vector",
+    G_CALLBACK(
+      infinoted_plugin_transformation_protection_check_request_vector_cb
+    ),
+    info
+  );
+
   g_signal_connect(
     G_OBJECT(session),
     "check-request",
@@ -194,6 +234,14 @@ infinoted_plugin_transformation_protection_session_removed(
   
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
 
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(
+      infinoted_plugin_transformation_protection_check_request_vector_cb
+    ),
+    info
+  );
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(session),
     G_CALLBACK(infinoted_plugin_transformation_protection_check_request_cb),
@@ -0,0 +1,458 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/plugins/util/infinoted-plugin-util-navigate-browser.h>
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+typedef struct _InfinotedPluginWarmup InfinotedPluginWarmup;
+struct _InfinotedPluginWarmup {
+  InfinotedPluginManager* manager;
+  gchar* file;
+  guint max_sessions;
+  guint interval;
+
+  /* Paths of the most recently used documents, most recent first, and the
+   * link of each of them in that queue. */
+  GQueue paths;
+  GHashTable* links;
+
+  /* The documents from the list that remain to be loaded */
+  gchar** pending;
+  guint pending_index;
+  InfIoTimeout* timeout;
+  InfinotedPluginUtilNavigateData* navigate;
+  gboolean loading;
+};
+
+typedef struct _InfinotedPluginWarmupSessionInfo
+  InfinotedPluginWarmupSessionInfo;
+struct _InfinotedPluginWarmupSessionInfo {
+  gchar* path;
+};
+
+static void
+infinoted_plugin_warmup_timeout_cb(gpointer user_data);
+
+/* Records that the document at path has been used. If it is being used
+ * right now, it becomes the most recently used one, otherwise it is
+ * appended as the least recently used one. */
+static void
+infinoted_plugin_warmup_touch(InfinotedPluginWarmup* plugin,
+                              const gchar* path,
+                              gboolean now)
+{
+  GList* link;
+
+  link = g_hash_table_lookup(plugin->links, path);
+  if(link != NULL)
+  {
+    if(now == TRUE)
+    {
+      g_queue_unlink(&plugin->paths, link);
+      g_queue_push_head_link(&plugin->paths, link);
+    }
+
+    return;
+  }
+
+  if(now == TRUE)
+  {
+    g_queue_push_head(&plugin->paths, g_strdup(path));
+    link = g_queue_peek_head_link(&plugin->paths);
+  }
+  else
+  {
+    g_queue_push_tail(&plugin->paths, g_strdup(path));
+    link = g_queue_peek_tail_link(&plugin->paths);
+  }
+
+  g_hash_table_insert(plugin->links, link->data, link);
+
+  while(g_queue_get_length(&plugin->paths) > plugin->max_sessions)
+  {
+    link = g_queue_peek_tail_link(&plugin->paths);
+    g_hash_table_remove(plugin->links, link->data);
+    g_free(g_queue_pop_tail(&plugin->paths));
+  }
+}
+
+static void
+infinoted_plugin_warmup_read_list(InfinotedPluginWarmup* plugin)
+{
+  gchar* content;
+  gchar** lines;
+  gchar** line;
+  GList* item;
+  guint i;
+  GError* error;
+
+  error = NULL;
+  if(!g_file_get_contents(plugin->file, &content, NULL, &error))
+  {
+    /* There is no list before the server has been shut down once */
+    if(error->domain != G_FILE_ERROR || error->code != G_FILE_ERROR_NOENT)
+    {
+      infinoted_log_warning(
+        infinoted_plugin_manager_get_log(plugin->manager),
+        _("Failed to read the list of documents to load from \"%s\": %s"),
+        plugin->file,
+        error->message
+      );
+    }
+
+    g_error_free(error);
+    return;
+  }
+
+  lines = g_strsplit(content, "\n", -1);
+  g_free(content);
+
+  for(line = lines; *line != NULL; ++line)
+    if(**line != '\0')
+      infinoted_plugin_warmup_touch(plugin, *line, FALSE);
+  g_strfreev(lines);
+
+  plugin->pending = g_new(gchar*, g_queue_get_length(&plugin->paths) + 1);
+  plugin->pending_index = 0;
+
+  i = 0;
+  for(item = plugin->paths.head; item != NULL; item = item->next)
+    plugin->pending[i++] = g_strdup(item->data);
+  plugin->pending[i] = NULL;
+}
+
+static void
+infinoted_plugin_warmup_write_list(InfinotedPluginWarmup* plugin)
+{
+  GString* content;
+  GList* item;
+  GError* error;
+
+  content = g_string_new(NULL);
+  for(item = plugin->paths.head; item != NULL; item = item->next)
+  {
+    g_string_append(content, item->data);
+    g_string_append_c(content, '\n');
+  }
+
+  error = NULL;
+  if(!g_file_set_contents(plugin->file, content->str, content->len, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to write the list of recently used documents to \"%s\": %s"),
+      plugin->file,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_string_free(content, TRUE);
+}
+
+/* Loads the next pending document after the configured interval, so that
+ * the server keeps processing its connections in between. */
+static void
+infinoted_plugin_warmup_schedule(InfinotedPluginWarmup* plugin)
+{
+  g_assert(plugin->timeout == NULL);
+  g_assert(plugin->navigate == NULL);
+
+  if(plugin->pending == NULL ||
+     plugin->pending[plugin->pending_index] == NULL)
+  {
+    g_strfreev(plugin->pending);
+    plugin->pending = NULL;
+    return;
+  }
+
+  plugin->timeout = inf_io_add_timeout(
+    infinoted_plugin_manager_get_io(plugin->manager),
+    plugin->interval,
+    infinoted_plugin_warmup_timeout_cb,
+    plugin,
+    NULL
+  );
+}
+
+/* Documents that have been removed in the meanwhile are skipped, and so are
+ * documents that are loaded already or that cannot be loaded. */
+static gboolean
+infinoted_plugin_warmup_can_load(InfinotedPluginWarmup* plugin,
+                                 InfBrowser* browser,
+                                 const InfBrowserIter* iter)
+{
+  InfRequest* request;
+  InfdDirectory* directory;
+  const gchar* type;
+
+  if(inf_browser_is_subdirectory(browser, iter))
+    return FALSE;
+  if(inf_browser_get_session(browser, iter) != NULL)
+    return FALSE;
+
+  request =
+    inf_browser_get_pending_request(browser, iter, "subscribe-session");
+  if(request != NULL)
+    return FALSE;
+
+  directory = infinoted_plugin_manager_get_directory(plugin->manager);
+  type = inf_browser_get_node_type(browser, iter);
+
+  return infd_directory_lookup_plugin(directory, type) != NULL;
+}
+
+static void
+infinoted_plugin_warmup_navigate_func(InfBrowser* browser,
+                                      const InfBrowserIter* iter,
+                                      const GError* error,
+                                      gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  gboolean finished_later;
+
+  /* If navigating finishes right away, this is called before
+   * infinoted_plugin_util_navigate_to() returns the handle, and
+   * infinoted_plugin_warmup_timeout_cb() schedules the next document. */
+  plugin = (InfinotedPluginWarmup*)user_data;
+  finished_later = plugin->navigate != NULL;
+  plugin->navigate = NULL;
+
+  if(error == NULL &&
+     infinoted_plugin_warmup_can_load(plugin, browser, iter))
+  {
+    /* Errors are reported to the clients subscribing to the document */
+    plugin->loading = TRUE;
+    inf_browser_subscribe(browser, iter, NULL, NULL);
+    plugin->loading = FALSE;
+  }
+
+  if(finished_later)
+    infinoted_plugin_warmup_schedule(plugin);
+}
+
+static void
+infinoted_plugin_warmup_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  const gchar* path;
+
+  plugin = (InfinotedPluginWarmup*)user_data;
+  plugin->timeout = NULL;
+
+  path = plugin->pending[plugin->pending_index++];
+
+  plugin->navigate = infinoted_plugin_util_navigate_to(
+    INF_BROWSER(infinoted_plugin_manager_get_directory(plugin->manager)),
+    path,
+    strlen(path),
+    FALSE,
+    infinoted_plugin_warmup_navigate_func,
+    plugin
+  );
+
+  if(plugin->navigate == NULL)
+    infinoted_plugin_warmup_schedule(plugin);
+}
+
+static void
+infinoted_plugin_warmup_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->file = NULL;
+  plugin->max_sessions = 100;
+  plugin->interval = 50;
+
+  g_queue_init(&plugin->paths);
+  plugin->links = NULL;
+
+  plugin->pending = NULL;
+  plugin->pending_index = 0;
+  plugin->timeout = NULL;
+  plugin->navigate = NULL;
+  plugin->loading = FALSE;
+}
+
+static gboolean
+infinoted_plugin_warmup_initialize(InfinotedPluginManager* manager,
+                                   gpointer plugin_info,
+                                   GError** error)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+
+  plugin->manager = manager;
+
+  if(plugin->file == NULL)
+  {
+    plugin->file =
+      g_build_filename(g_get_home_dir(), ".infinoted-warmup", NULL);
+  }
+
+  plugin->links = g_hash_table_new(g_str_hash, g_str_equal);
+
+  infinoted_plugin_warmup_read_list(plugin);
+  infinoted_plugin_warmup_schedule(plugin);
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_warmup_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+
+  if(plugin->timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      plugin->timeout
+    );
+  }
+
+  if(plugin->navigate != NULL)
+    infinoted_plugin_util_navigate_cancel(plugin->navigate);
+
+  /* Not initialized if another plugin failed to initialize before */
+  if(plugin->links != NULL)
+  {
+    infinoted_plugin_warmup_write_list(plugin);
+    g_hash_table_destroy(plugin->links);
+  }
+
+  g_queue_foreach(&plugin->paths, (GFunc)g_free, NULL);
+  g_queue_clear(&plugin->paths);
+  g_strfreev(plugin->pending);
+  g_free(plugin->file);
+}
+
+static void
+infinoted_plugin_warmup_session_added(const InfBrowserIter* iter,
+                                      InfSessionProxy* proxy,
+                                      gpointer plugin_info,
+                                      gpointer session_info)
+{
+  InfinotedPluginWarmup* plugin;
+  InfinotedPluginWarmupSessionInfo* info;
+
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+  info = (InfinotedPluginWarmupSessionInfo*)session_info;
+
+  info->path = inf_browser_get_path(
+    INF_BROWSER(infinoted_plugin_manager_get_directory(plugin->manager)),
+    iter
+  );
+
+  /* Documents loaded from the list keep their position in it */
+  if(plugin->loading == FALSE)
+    infinoted_plugin_warmup_touch(plugin, info->path, TRUE);
+}
+
+static void
+infinoted_plugin_warmup_session_removed(const InfBrowserIter* iter,
+                                        InfSessionProxy* proxy,
+                                        gpointer plugin_info,
+                                        gpointer session_info)
+{
+  InfinotedPluginWarmup* plugin;
+  InfinotedPluginWarmupSessionInfo* info;
+
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+  info = (InfinotedPluginWarmupSessionInfo*)session_info;
+
+  /* A session is removed when it has not been used for a while, or when
+   * the server shuts down, so it has been in use until recently. */
+  infinoted_plugin_warmup_touch(plugin, info->path, TRUE);
+  g_free(info->path);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_WARMUP_OPTIONS[] = {
+  {
+    "file",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedPluginWarmup, file),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("The file into which to write the list of recently used documents "
+       "when the server shuts down, and from which to read it at startup. "
+       "The default is ~/.infinoted-warmup."),
+    N_("FILE")
+  }, {
+    "max-sessions",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginWarmup, max_sessions),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The maximum number of documents to remember and to load at startup. "
+       "The default is 100."),
+    N_("NUMBER")
+  }, {
+    "interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginWarmup, interval),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The time, in milliseconds, to wait after loading one document "
+       "before loading the next one, so that the server can process its "
+       "connections meanwhile. The default is 50."),
+    N_("MILLISECONDS")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "warmup",
+  N_("Remembers the most recently used documents when the server shuts "
+     "down, and loads them one by one at the next start, so that they are "
+     "in memory already when clients reconnect."),
+  INFINOTED_PLUGIN_WARMUP_OPTIONS,
+  sizeof(InfinotedPluginWarmup),
+  0,
+  sizeof(InfinotedPluginWarmupSessionInfo),
+  NULL,
+  infinoted_plugin_warmup_info_initialize,
+  infinoted_plugin_warmup_initialize,
+  infinoted_plugin_warmup_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_warmup_session_added,
+  infinoted_plugin_warmup_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,904 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* The index maps each trigram, that is each sequence of three consecutive
+ * characters, to the documents containing it. Characters are converted to
+ * lower case first, so that searches are case-insensitive. Every document
+ * also counts how often it contains each trigram, so that the index can be
+ * updated incrementally: an insertion or erasure only changes the trigrams
+ * at most two characters around the changed region. */
+
+#include <infinoted/plugins/util/infinoted-plugin-util-search-index.h>
+
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+/* Object data on the InfdDirectory under which the index is published */
+#define INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_KEY \
+  "infinoted-plugin-util-search-index"
+
+static const gchar INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_MAGIC[8] = "INFSRCH1";
+
+typedef struct _InfinotedPluginUtilSearchDocument
+  InfinotedPluginUtilSearchDocument;
+struct _InfinotedPluginUtilSearchDocument {
+  gchar* path;
+  /* trigram -> number of occurrences. The keys are owned by the postings
+   * table of the index. */
+  GHashTable* trigrams;
+};
+
+struct _InfinotedPluginUtilSearchIndex {
+  /* path -> InfinotedPluginUtilSearchDocument */
+  GHashTable* documents;
+  /* trigram -> set of InfinotedPluginUtilSearchDocument */
+  GHashTable* postings;
+};
+
+typedef struct _InfinotedPluginUtilSearchWindow
+  InfinotedPluginUtilSearchWindow;
+struct _InfinotedPluginUtilSearchWindow {
+  InfinotedPluginUtilSearchIndex* index;
+  InfinotedPluginUtilSearchDocument* document;
+  gboolean add;
+
+  gunichar chars[2];
+  guint n_chars;
+};
+
+typedef struct _InfinotedPluginUtilSearchReader
+  InfinotedPluginUtilSearchReader;
+struct _InfinotedPluginUtilSearchReader {
+  const gchar* data;
+  gsize len;
+};
+
+static void
+infinoted_plugin_util_search_index_adjust(
+  InfinotedPluginUtilSearchIndex* index,
+  InfinotedPluginUtilSearchDocument* document,
+  const gchar* trigram,
+  gboolean add,
+  guint amount)
+{
+  gpointer key;
+  gpointer value;
+  GHashTable* posting;
+  guint count;
+
+  if(g_hash_table_lookup_extended(index->postings, trigram, &key, &value))
+  {
+    posting = (GHashTable*)value;
+    count = GPOINTER_TO_UINT(g_hash_table_lookup(document->trigrams, key));
+  }
+  else
+  {
+    posting = NULL;
+    count = 0;
+  }
+
+  if(add)
+  {
+    if(posting == NULL)
+    {
+      key = g_strdup(trigram);
+      posting = g_hash_table_new(NULL, NULL);
+      g_hash_table_insert(index->postings, key, posting);
+    }
+
+    if(count == 0)
+      g_hash_table_add(posting, document);
+
+    g_hash_table_insert(
+      document->trigrams,
+      key,
+      GUINT_TO_POINTER(count + amount)
+    );
+  }
+  else if(count > amount)
+  {
+    g_hash_table_insert(
+      document->trigrams,
+      key,
+      GUINT_TO_POINTER(count - amount)
+    );
+  }
+  else if(count > 0)
+  {
+    g_hash_table_remove(document->trigrams, key);
+    g_hash_table_remove(posting, document);
+
+    /* This frees key as well */
+    if(g_hash_table_size(posting) == 0)
+      g_hash_table_remove(index->postings, key);
+  }
+
+  /* If a trigram to be removed is not there at all, then the document has
+   * been changed without the index noticing, for example when its session
+   * was not loaded while this plugin was. It will be corrected when the
+   * document is indexed again. */
+}
+
+static void
+infinoted_plugin_util_search_index_clear_document(
+  InfinotedPluginUtilSearchIndex* index,
+  InfinotedPluginUtilSearchDocument* document)
+{
+  GHashTableIter iter;
+  gpointer key;
+  GHashTable* posting;
+
+  g_hash_table_iter_init(&iter, document->trigrams);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    posting = g_hash_table_lookup(index->postings, key);
+    g_hash_table_remove(posting, document);
+
+    if(g_hash_table_size(posting) == 0)
+      g_hash_table_remove(index->postings, key);
+
+    /* key has possibly been freed now, so steal it from the table */
+    g_hash_table_iter_steal(&iter);
+  }
+}
+
+static void
+infinoted_plugin_util_search_index_document_free(gpointer data)
+{
+  InfinotedPluginUtilSearchDocument* document;
+  document = (InfinotedPluginUtilSearchDocument*)data;
+
+  g_hash_table_destroy(document->trigrams);
+  g_free(document->path);
+  g_slice_free(InfinotedPluginUtilSearchDocument, document);
+}
+
+static InfinotedPluginUtilSearchDocument*
+infinoted_plugin_util_search_index_ensure_document(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  gsize len)
+{
+  InfinotedPluginUtilSearchDocument* document;
+  gchar* copy;
+
+  copy = g_strndup(path, len);
+  document = g_hash_table_lookup(index->documents, copy);
+
+  if(document == NULL)
+  {
+    document = g_slice_new(InfinotedPluginUtilSearchDocument);
+    document->path = copy;
+    document->trigrams = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(index->documents, document->path, document);
+  }
+  else
+  {
+    g_free(copy);
+  }
+
+  return document;
+}
+
+static void
+infinoted_plugin_util_search_index_remove_document_internal(
+  InfinotedPluginUtilSearchIndex* index,
+  InfinotedPluginUtilSearchDocument* document)
+{
+  infinoted_plugin_util_search_index_clear_document(index, document);
+  g_hash_table_remove(index->documents, document->path);
+}
+
+static void
+infinoted_plugin_util_search_index_clear(InfinotedPluginUtilSearchIndex* index)
+{
+  /* This frees the keys of the trigram tables of all documents, but they
+   * are not accessed anymore when the documents are freed. */
+  g_hash_table_remove_all(index->postings);
+  g_hash_table_remove_all(index->documents);
+}
+
+static void
+infinoted_plugin_util_search_window_init(
+  InfinotedPluginUtilSearchWindow* window,
+  InfinotedPluginUtilSearchIndex* index,
+  InfinotedPluginUtilSearchDocument* document,
+  gboolean add)
+{
+  window->index = index;
+  window->document = document;
+  window->add = add;
+  window->n_chars = 0;
+}
+
+static gsize
+infinoted_plugin_util_search_make_trigram(gchar* trigram,
+                                          gunichar c1,
+                                          gunichar c2,
+                                          gunichar c3)
+{
+  gsize len;
+
+  len = g_unichar_to_utf8(c1, trigram);
+  len += g_unichar_to_utf8(c2, trigram + len);
+  len += g_unichar_to_utf8(c3, trigram + len);
+  trigram[len] = '\0';
+
+  return len;
+}
+
+static gboolean
+infinoted_plugin_util_search_window_view_func(gconstpointer text,
+                                              gsize bytes,
+                                              guint length,
+                                              guint author,
+                                              gpointer user_data)
+{
+  InfinotedPluginUtilSearchWindow* window;
+  const gchar* pos;
+  gunichar c;
+  gchar trigram[3 * 6 + 1];
+
+  window = (InfinotedPluginUtilSearchWindow*)user_data;
+
+  for(pos = text; length > 0; pos = g_utf8_next_char(pos), --length)
+  {
+    c = g_unichar_tolower(g_utf8_get_char(pos));
+
+    if(window->n_chars == 2)
+    {
+      infinoted_plugin_util_search_make_trigram(
+        trigram,
+        window->chars[0],
+        window->chars[1],
+        c
+      );
+
+      infinoted_plugin_util_search_index_adjust(
+        window->index,
+        window->document,
+        trigram,
+        window->add,
+        1
+      );
+
+      window->chars[0] = window->chars[1];
+      window->chars[1] = c;
+    }
+    else
+    {
+      window->chars[window->n_chars++] = c;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_util_search_window_feed(
+  InfinotedPluginUtilSearchWindow* window,
+  InfTextBuffer* buffer,
+  guint begin,
+  guint end)
+{
+  if(end > begin)
+  {
+    inf_text_buffer_view(
+      buffer,
+      begin,
+      end - begin,
+      infinoted_plugin_util_search_window_view_func,
+      window
+    );
+  }
+}
+
+static gboolean
+infinoted_plugin_util_search_reader_read(
+  InfinotedPluginUtilSearchReader* reader,
+  gpointer buffer,
+  gsize len,
+  GError** error)
+{
+  if(reader->len < len)
+  {
+    g_set_error_literal(
+      error,
+      infinoted_plugin_util_search_index_error_quark(),
+      INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT,
+      _("The search index is truncated")
+    );
+
+    return FALSE;
+  }
+
+  memcpy(buffer, reader->data, len);
+  reader->data += len;
+  reader->len -= len;
+  return TRUE;
+}
+
+static gboolean
+infinoted_plugin_util_search_reader_read_string(
+  InfinotedPluginUtilSearchReader* reader,
+  gsize len,
+  const gchar** str,
+  GError** error)
+{
+  if(reader->len < len)
+  {
+    g_set_error_literal(
+      error,
+      infinoted_plugin_util_search_index_error_quark(),
+      INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT,
+      _("The search index is truncated")
+    );
+
+    return FALSE;
+  }
+
+  if(!g_utf8_validate(reader->data, len, NULL))
+  {
+    g_set_error_literal(
+      error,
+      infinoted_plugin_util_search_index_error_quark(),
+      INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT,
+      _("The search index contains invalid UTF-8")
+    );
+
+    return FALSE;
+  }
+
+  *str = reader->data;
+  reader->data += len;
+  reader->len -= len;
+  return TRUE;
+}
+
+GQuark
+infinoted_plugin_util_search_index_error_quark(void)
+{
+  return g_quark_from_static_string(
+    "INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR"
+  );
+}
+
+InfinotedPluginUtilSearchIndex*
+infinoted_plugin_util_search_index_new(void)
+{
+  InfinotedPluginUtilSearchIndex* index;
+
+  index = g_slice_new(InfinotedPluginUtilSearchIndex);
+
+  index->documents = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    NULL,
+    infinoted_plugin_util_search_index_document_free
+  );
+
+  index->postings = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)g_hash_table_destroy
+  );
+
+  return index;
+}
+
+void
+infinoted_plugin_util_search_index_free(InfinotedPluginUtilSearchIndex* index)
+{
+  infinoted_plugin_util_search_index_clear(index);
+
+  g_hash_table_destroy(index->postings);
+  g_hash_table_destroy(index->documents);
+  g_slice_free(InfinotedPluginUtilSearchIndex, index);
+}
+
+/* Makes index available to other plugins through
+ * infinoted_plugin_util_search_index_lookup(). Pass NULL to withdraw it
+ * again before it is freed. */
+void
+infinoted_plugin_util_search_index_publish(
+  InfinotedPluginUtilSearchIndex* index,
+  InfdDirectory* directory)
+{
+  g_object_set_data(
+    G_OBJECT(directory),
+    INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_KEY,
+    index
+  );
+}
+
+/* Returns NULL if the search plugin is not loaded */
+InfinotedPluginUtilSearchIndex*
+infinoted_plugin_util_search_index_lookup(InfdDirectory* directory)
+{
+  return g_object_get_data(
+    G_OBJECT(directory),
+    INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_KEY
+  );
+}
+
+/* Indexes the full content of buffer, replacing what was indexed for path
+ * before. Documents not in UTF-8 are not indexed. */
+void
+infinoted_plugin_util_search_index_set_document(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer)
+{
+  InfinotedPluginUtilSearchDocument* document;
+  InfinotedPluginUtilSearchWindow window;
+
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+  {
+    document = g_hash_table_lookup(index->documents, path);
+    if(document != NULL)
+    {
+      infinoted_plugin_util_search_index_remove_document_internal(
+        index,
+        document
+      );
+    }
+
+    return;
+  }
+
+  document = infinoted_plugin_util_search_index_ensure_document(
+    index,
+    path,
+    strlen(path)
+  );
+
+  infinoted_plugin_util_search_index_clear_document(index, document);
+  infinoted_plugin_util_search_window_init(&window, index, document, TRUE);
+
+  infinoted_plugin_util_search_window_feed(
+    &window,
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+}
+
+/* Removes path and, if it is a subdirectory, everything below it */
+void
+infinoted_plugin_util_search_index_remove_document(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path)
+{
+  GHashTableIter iter;
+  gpointer value;
+  InfinotedPluginUtilSearchDocument* document;
+  GSList* removed;
+  GSList* item;
+  gsize len;
+
+  len = strlen(path);
+  removed = NULL;
+
+  g_hash_table_iter_init(&iter, index->documents);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    document = (InfinotedPluginUtilSearchDocument*)value;
+
+    if(strncmp(document->path, path, len) == 0 &&
+       (document->path[len] == '\0' ||
+        document->path[len] == '/' ||
+        (len > 0 && path[len - 1] == '/')))
+    {
+      removed = g_slist_prepend(removed, document);
+    }
+  }
+
+  for(item = removed; item != NULL; item = item->next)
+  {
+    infinoted_plugin_util_search_index_remove_document_internal(
+      index,
+      item->data
+    );
+  }
+
+  g_slist_free(removed);
+}
+
+/* To be called after len characters have been inserted at pos */
+void
+infinoted_plugin_util_search_index_text_inserted(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer,
+  guint pos,
+  guint len)
+{
+  InfinotedPluginUtilSearchDocument* document;
+  InfinotedPluginUtilSearchWindow window;
+  guint begin;
+  guint end;
+
+  document = g_hash_table_lookup(index->documents, path);
+  if(document == NULL) return;
+
+  begin = (pos >= 2) ? pos - 2 : 0;
+  end = MIN(pos + len + 2, inf_text_buffer_get_length(buffer));
+
+  /* The trigrams that spanned the insertion point before */
+  infinoted_plugin_util_search_window_init(&window, index, document, FALSE);
+  infinoted_plugin_util_search_window_feed(&window, buffer, begin, pos);
+  infinoted_plugin_util_search_window_feed(&window, buffer, pos + len, end);
+
+  infinoted_plugin_util_search_window_init(&window, index, document, TRUE);
+  infinoted_plugin_util_search_window_feed(&window, buffer, begin, end);
+}
+
+/* To be called after chunk has been erased at pos */
+void
+infinoted_plugin_util_search_index_text_erased(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer,
+  guint pos,
+  InfTextChunk* chunk)
+{
+  InfinotedPluginUtilSearchDocument* document;
+  InfinotedPluginUtilSearchWindow window;
+  guint begin;
+  guint end;
+
+  document = g_hash_table_lookup(index->documents, path);
+  if(document == NULL) return;
+
+  begin = (pos >= 2) ? pos - 2 : 0;
+  end = MIN(pos + 2, inf_text_buffer_get_length(buffer));
+
+  /* The trigrams that overlapped the erased text before */
+  infinoted_plugin_util_search_window_init(&window, index, document, FALSE);
+  infinoted_plugin_util_search_window_feed(&window, buffer, begin, pos);
+
+  inf_text_chunk_view(
+    chunk,
+    0,
+    inf_text_chunk_get_length(chunk),
+    infinoted_plugin_util_search_window_view_func,
+    &window
+  );
+
+  infinoted_plugin_util_search_window_feed(&window, buffer, pos, end);
+
+  infinoted_plugin_util_search_window_init(&window, index, document, TRUE);
+  infinoted_plugin_util_search_window_feed(&window, buffer, begin, end);
+}
+
+/* Returns the paths of the documents that contain all trigrams of query,
+ * sorted, as a list of strings to be freed with g_slist_free_full().
+ * Queries shorter than three characters match documents with a trigram
+ * containing them. If max_results is not 0, at most that many paths are
+ * returned. The index is not exact, so there can be false positives if
+ * all trigrams of query occur in a document, but not next to each other. */
+GSList*
+infinoted_plugin_util_search_index_query(InfinotedPluginUtilSearchIndex* index,
+                                         const gchar* query,
+                                         gsize len,
+                                         guint max_results)
+{
+  GString* folded;
+  gunichar* chars;
+  glong n_chars;
+  GHashTable* matches;
+  GHashTable* smallest;
+  GPtrArray* postings;
+  GHashTable* posting;
+  GHashTableIter iter;
+  GHashTableIter doc_iter;
+  gpointer key;
+  gpointer value;
+  InfinotedPluginUtilSearchDocument* document;
+  gchar trigram[3 * 6 + 1];
+  GSList* result;
+  GSList* item;
+  glong i;
+  guint j;
+
+  if(!g_utf8_validate(query, len, NULL))
+    return NULL;
+
+  chars = g_utf8_to_ucs4_fast(query, len, &n_chars);
+  result = NULL;
+
+  if(n_chars > 0 && n_chars < 3)
+  {
+    folded = g_string_sized_new(len);
+    for(i = 0; i < n_chars; ++i)
+      g_string_append_unichar(folded, g_unichar_tolower(chars[i]));
+
+    matches = g_hash_table_new(NULL, NULL);
+    g_hash_table_iter_init(&iter, index->postings);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      if(strstr(key, folded->str) != NULL)
+      {
+        g_hash_table_iter_init(&doc_iter, (GHashTable*)value);
+        while(g_hash_table_iter_next(&doc_iter, &key, NULL))
+          g_hash_table_add(matches, key);
+      }
+    }
+
+    g_hash_table_iter_init(&iter, matches);
+    while(g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      document = (InfinotedPluginUtilSearchDocument*)key;
+      result = g_slist_prepend(result, g_strdup(document->path));
+    }
+
+    g_hash_table_destroy(matches);
+    g_string_free(folded, TRUE);
+  }
+  else if(n_chars >= 3)
+  {
+    for(i = 0; i < n_chars; ++i)
+      chars[i] = g_unichar_tolower(chars[i]);
+
+    postings = g_ptr_array_new();
+    smallest = NULL;
+
+    for(i = 0; i + 2 < n_chars; ++i)
+    {
+      infinoted_plugin_util_search_make_trigram(
+        trigram,
+        chars[i],
+        chars[i + 1],
+        chars[i + 2]
+      );
+
+      /* A trigram that no document contains means there are no matches */
+      posting = g_hash_table_lookup(index->postings, trigram);
+      if(posting == NULL)
+      {
+        smallest = NULL;
+        break;
+      }
+
+      g_ptr_array_add(postings, posting);
+      if(smallest == NULL ||
+         g_hash_table_size(posting) < g_hash_table_size(smallest))
+      {
+        smallest = posting;
+      }
+    }
+
+    if(smallest != NULL)
+    {
+      g_hash_table_iter_init(&iter, smallest);
+      while(g_hash_table_iter_next(&iter, &key, NULL))
+      {
+        for(j = 0; j < postings->len; ++j)
+          if(!g_hash_table_contains(g_ptr_array_index(postings, j), key))
+            break;
+
+        if(j == postings->len)
+        {
+          document = (InfinotedPluginUtilSearchDocument*)key;
+          result = g_slist_prepend(result, g_strdup(document->path));
+        }
+      }
+    }
+
+    g_ptr_array_free(postings, TRUE);
+  }
+
+  g_free(chars);
+
+  result = g_slist_sort(result, (GCompareFunc)strcmp);
+  if(max_results > 0 && g_slist_length(result) > max_results)
+  {
+    item = g_slist_nth(result, max_results - 1);
+    g_slist_free_full(item->next, g_free);
+    item->next = NULL;
+  }
+
+  return result;
+}
+
+/* Returns the index in a binary format to be read back with
+ * infinoted_plugin_util_search_index_deserialize(). */
+gchar*
+infinoted_plugin_util_search_index_serialize(
+  InfinotedPluginUtilSearchIndex* index,
+  gsize* len)
+{
+  GByteArray* array;
+  GHashTableIter doc_iter;
+  GHashTableIter trigram_iter;
+  gpointer key;
+  gpointer value;
+  InfinotedPluginUtilSearchDocument* document;
+  guint32 n32;
+  guint16 n16;
+  guint8 n8;
+
+  array = g_byte_array_new();
+
+  g_byte_array_append(
+    array,
+    (const guint8*)INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_MAGIC,
+    sizeof(INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_MAGIC)
+  );
+
+  n32 = GUINT32_TO_LE(g_hash_table_size(index->documents));
+  g_byte_array_append(array, (const guint8*)&n32, 4);
+
+  g_hash_table_iter_init(&doc_iter, index->documents);
+  while(g_hash_table_iter_next(&doc_iter, NULL, &value))
+  {
+    document = (InfinotedPluginUtilSearchDocument*)value;
+
+    n16 = GUINT16_TO_LE(strlen(document->path));
+    g_byte_array_append(array, (const guint8*)&n16, 2);
+    g_byte_array_append(
+      array,
+      (const guint8*)document->path,
+      strlen(document->path)
+    );
+
+    n32 = GUINT32_TO_LE(g_hash_table_size(document->trigrams));
+    g_byte_array_append(array, (const guint8*)&n32, 4);
+
+    g_hash_table_iter_init(&trigram_iter, document->trigrams);
+    while(g_hash_table_iter_next(&trigram_iter, &key, &value))
+    {
+      n8 = strlen(key);
+      g_byte_array_append(array, &n8, 1);
+      g_byte_array_append(array, key, n8);
+
+      n32 = GUINT32_TO_LE(GPOINTER_TO_UINT(value));
+      g_byte_array_append(array, (const guint8*)&n32, 4);
+    }
+  }
+
+  *len = array->len;
+  return (gchar*)g_byte_array_free(array, FALSE);
+}
+
+/* Replaces the content of index by what was previously serialized with
+ * infinoted_plugin_util_search_index_serialize(). If data is invalid, the
+ * index is left empty and error is set. */
+gboolean
+infinoted_plugin_util_search_index_deserialize(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* data,
+  gsize len,
+  GError** error)
+{
+  InfinotedPluginUtilSearchReader reader;
+  InfinotedPluginUtilSearchDocument* document;
+  gchar magic[sizeof(INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_MAGIC)];
+  gchar trigram[3 * 6 + 1];
+  const gchar* str;
+  guint32 n_documents;
+  guint32 n_trigrams;
+  guint32 count;
+  guint16 path_len;
+  guint8 trigram_len;
+
+  infinoted_plugin_util_search_index_clear(index);
+
+  reader.data = data;
+  reader.len = len;
+
+  if(!infinoted_plugin_util_search_reader_read(
+       &reader, magic, sizeof(magic), error))
+  {
+    return FALSE;
+  }
+
+  if(memcmp(magic, INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_MAGIC,
+            sizeof(magic)) != 0)
+  {
+    g_set_error_literal(
+      error,
+      infinoted_plugin_util_search_index_error_quark(),
+      INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT,
+      _("The file is not a search index")
+    );
+
+    return FALSE;
+  }
+
+  if(!infinoted_plugin_util_search_reader_read(&reader, &n_documents, 4,
+                                               error))
+  {
+    return FALSE;
+  }
+
+  for(n_documents = GUINT32_FROM_LE(n_documents); n_documents > 0;
+      --n_documents)
+  {
+    if(!infinoted_plugin_util_search_reader_read(&reader, &path_len, 2,
+                                                 error) ||
+       !infinoted_plugin_util_search_reader_read_string(
+         &reader, GUINT16_FROM_LE(path_len), &str, error) ||
+       !infinoted_plugin_util_search_reader_read(&reader, &n_trigrams, 4,
+                                                 error))
+    {
+      infinoted_plugin_util_search_index_clear(index);
+      return FALSE;
+    }
+
+    document = infinoted_plugin_util_search_index_ensure_document(
+      index,
+      str,
+      GUINT16_FROM_LE(path_len)
+    );
+
+    for(n_trigrams = GUINT32_FROM_LE(n_trigrams); n_trigrams > 0;
+        --n_trigrams)
+    {
+      if(!infinoted_plugin_util_search_reader_read(&reader, &trigram_len, 1,
+                                                   error))
+      {
+        infinoted_plugin_util_search_index_clear(index);
+        return FALSE;
+      }
+
+      if(trigram_len >= sizeof(trigram))
+      {
+        g_set_error_literal(
+          error,
+          infinoted_plugin_util_search_index_error_quark(),
+          INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT,
+          _("The search index contains an invalid trigram")
+        );
+
+        infinoted_plugin_util_search_index_clear(index);
+        return FALSE;
+      }
+
+      if(!infinoted_plugin_util_search_reader_read_string(
+           &reader, trigram_len, &str, error) ||
+         !infinoted_plugin_util_search_reader_read(&reader, &count, 4,
+                                                   error))
+      {
+        infinoted_plugin_util_search_index_clear(index);
+        return FALSE;
+      }
+
+      memcpy(trigram, str, trigram_len);
+      trigram[trigram_len] = '\0';
+
+      if(GUINT32_FROM_LE(count) > 0)
+      {
+        infinoted_plugin_util_search_index_adjust(
+          index,
+          document,
+          trigram,
+          TRUE,
+          GUINT32_FROM_LE(count)
+        );
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/* vim:set et sw=2 ts=2: */
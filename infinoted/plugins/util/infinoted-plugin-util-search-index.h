@@ -0,0 +1,104 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_H__
+#define __INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_H__
+
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinfinity/server/infd-directory.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InfinotedPluginUtilSearchIndex InfinotedPluginUtilSearchIndex;
+
+typedef enum _InfinotedPluginUtilSearchIndexError
+{
+  INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_ERROR_INVALID_FORMAT
+} InfinotedPluginUtilSearchIndexError;
+
+GQuark
+infinoted_plugin_util_search_index_error_quark(void);
+
+InfinotedPluginUtilSearchIndex*
+infinoted_plugin_util_search_index_new(void);
+
+void
+infinoted_plugin_util_search_index_free(InfinotedPluginUtilSearchIndex* index);
+
+void
+infinoted_plugin_util_search_index_publish(
+  InfinotedPluginUtilSearchIndex* index,
+  InfdDirectory* directory);
+
+InfinotedPluginUtilSearchIndex*
+infinoted_plugin_util_search_index_lookup(InfdDirectory* directory);
+
+void
+infinoted_plugin_util_search_index_set_document(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer);
+
+void
+infinoted_plugin_util_search_index_remove_document(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path);
+
+void
+infinoted_plugin_util_search_index_text_inserted(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer,
+  guint pos,
+  guint len);
+
+void
+infinoted_plugin_util_search_index_text_erased(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* path,
+  InfTextBuffer* buffer,
+  guint pos,
+  InfTextChunk* chunk);
+
+GSList*
+infinoted_plugin_util_search_index_query(InfinotedPluginUtilSearchIndex* index,
+                                         const gchar* query,
+                                         gsize len,
+                                         guint max_results);
+
+gchar*
+infinoted_plugin_util_search_index_serialize(
+  InfinotedPluginUtilSearchIndex* index,
+  gsize* len);
+
+gboolean
+infinoted_plugin_util_search_index_deserialize(
+  InfinotedPluginUtilSearchIndex* index,
+  const gchar* data,
+  gsize len,
+  GError** error);
+
+G_END_DECLS
+
+#endif /* __INFINOTED_PLUGIN_UTIL_SEARCH_INDEX_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -50,6 +50,16 @@ struct _InfGtkBrowserStoreItem {
    * wasn't present anymore. */
   gpointer missing;
 
+  /* Position of the most recently looked up node among its siblings.
+   * Finding the index of a node, or the node at an index, requires walking
+   * the sibling list. With this, looking up neighbouring nodes one after
+   * the other, as happens when a directory with many entries is explored
+   * or displayed, does not need to start from the first child each time. */
+  gboolean cache_valid;
+  guint cache_parent_id;
+  InfBrowserIter cache_iter;
+  guint cache_index;
+
   /* Running requests */
   GSList* requests;
   /* Saved node errors (during exploration/subscription) */
@@ -164,6 +174,86 @@ inf_gtk_browser_store_find_item_by_discovery_info(InfGtkBrowserStore* store,
  * Callback declarations
  */
 
+static void
+inf_gtk_browser_store_item_cache_set(InfGtkBrowserStoreItem* item,
+                                     guint parent_id,
+                                     const InfBrowserIter* iter,
+                                     guint index)
+{
+  /* The cache would have to account for the missing node otherwise */
+  if(item->missing == NULL)
+  {
+    item->cache_valid = TRUE;
+    item->cache_parent_id = parent_id;
+    item->cache_iter = *iter;
+    item->cache_index = index;
+  }
+}
+
+/* Returns the index of iter among the children of parent, skipping the
+ * missing node. */
+static guint
+inf_gtk_browser_store_item_get_child_index(InfGtkBrowserStoreItem* item,
+                                           const InfBrowserIter* parent,
+                                           const InfBrowserIter* iter)
+{
+  InfBrowserIter cur_iter;
+  gboolean result;
+  guint n;
+
+  if(item->missing == NULL && item->cache_valid &&
+     item->cache_parent_id == parent->node_id)
+  {
+    cur_iter = item->cache_iter;
+    n = item->cache_index;
+
+    result = TRUE;
+    while(result && cur_iter.node_id != iter->node_id)
+    {
+      result = inf_browser_get_next(item->browser, &cur_iter);
+      ++n;
+    }
+
+    if(result)
+    {
+      inf_gtk_browser_store_item_cache_set(item, parent->node_id, iter, n);
+      return n;
+    }
+
+    /* The node is before the cached one, fall back to a full search */
+  }
+
+  cur_iter = *parent;
+  result = inf_browser_get_child(item->browser, &cur_iter);
+  g_assert(result == TRUE);
+
+  /* skip missing */
+  if(cur_iter.node == item->missing)
+  {
+    result = inf_browser_get_next(item->browser, &cur_iter);
+    g_assert(result == TRUE);
+  }
+
+  n = 0;
+  while(cur_iter.node_id != iter->node_id)
+  {
+    result = inf_browser_get_next(item->browser, &cur_iter);
+    g_assert(result == TRUE);
+
+    /* skip missing */
+    if(cur_iter.node == item->missing)
+    {
+      result = inf_browser_get_next(item->browser, &cur_iter);
+      g_assert(result == TRUE);
+    }
+
+    ++n;
+  }
+
+  inf_gtk_browser_store_item_cache_set(item, parent->node_id, iter, n);
+  return n;
+}
+
 static void
 inf_gtk_browser_store_browser_notify_status_cb(GObject* object,
                                                GParamSpec* pspec,
@@ -397,6 +487,7 @@ inf_gtk_browser_store_add_item_by_browser(InfGtkBrowserStore* store,
     item->status = INF_GTK_BROWSER_MODEL_DISCOVERED;
   item->browser = NULL;
   item->missing = NULL;
+  item->cache_valid = FALSE;
   item->node_errors = g_hash_table_new_full(
     NULL,
     NULL,
@@ -732,6 +823,25 @@ inf_gtk_browser_store_node_added_cb(InfBrowser* browser,
   tree_iter.user_data2 = GUINT_TO_POINTER(iter->node_id);
   tree_iter.user_data3 = iter->node;
 
+  /* The cached position stays valid if the node was added in another
+   * directory, or right after the cached node. Otherwise it might have
+   * shifted. */
+  if(item->cache_valid)
+  {
+    test_iter = *iter;
+    inf_browser_get_parent(browser, &test_iter);
+
+    if(test_iter.node_id == item->cache_parent_id)
+    {
+      test_iter = item->cache_iter;
+      if(!inf_browser_get_next(browser, &test_iter) ||
+         test_iter.node_id != iter->node_id)
+      {
+        item->cache_valid = FALSE;
+      }
+    }
+  }
+
   if(iter->node_id != 0)
   {
     path = gtk_tree_model_get_path(GTK_TREE_MODEL(store), &tree_iter);
@@ -789,6 +899,7 @@ inf_gtk_browser_store_node_removed_cb(InfBrowser* browser,
   item = inf_gtk_browser_store_find_item_by_browser(store, browser);
 
   g_assert(item->missing == NULL);
+  item->cache_valid = FALSE;
 
   tree_iter.stamp = priv->stamp;
   tree_iter.user_data = item;
@@ -867,6 +978,7 @@ inf_gtk_browser_store_node_removed_cb(InfBrowser* browser,
   }
 
   item->missing = NULL;
+  item->cache_valid = FALSE;
   gtk_tree_path_free(path);
 }
 
@@ -1313,7 +1425,6 @@ inf_gtk_browser_store_tree_model_get_path_impl(InfGtkBrowserStore* store,
   InfGtkBrowserStorePrivate* priv;
   InfBrowserIter cur_iter;
   InfGtkBrowserStoreItem* cur;
-  gboolean result;
   guint n;
 
   cur_iter = *iter;
@@ -1337,32 +1448,7 @@ inf_gtk_browser_store_tree_model_get_path_impl(InfGtkBrowserStore* store,
       path
     );
 
-    result = inf_browser_get_child(item->browser, &cur_iter);
-    g_assert(result == TRUE);
-
-    /* skip missing */
-    if(cur_iter.node == item->missing)
-    {
-      result = inf_browser_get_next(item->browser, &cur_iter);
-      g_assert(result == TRUE);
-    }
-
-    n = 0;
-    while(cur_iter.node_id != iter->node_id)
-    {
-      result = inf_browser_get_next(item->browser, &cur_iter);
-      g_assert(result == TRUE);
-
-      /* skip missing */
-      if(cur_iter.node == item->missing)
-      {
-        result = inf_browser_get_next(item->browser, &cur_iter);
-        g_assert(result == TRUE);
-      }
-
-      ++n;
-    }
-
+    n = inf_gtk_browser_store_item_get_child_index(item, &cur_iter, iter);
     gtk_tree_path_append_index(path, n);
   }
 }
@@ -1777,6 +1863,7 @@ inf_gtk_browser_store_tree_model_iter_nth_child(GtkTreeModel* model,
   InfGtkBrowserStoreItem* item;
   InfGtkBrowserStoreItem* cur;
   InfBrowserIter browser_iter;
+  guint parent_id;
   guint i;
 
   priv = INF_GTK_BROWSER_STORE_PRIVATE(model);
@@ -1824,14 +1911,28 @@ inf_gtk_browser_store_tree_model_iter_nth_child(GtkTreeModel* model,
     if(inf_browser_get_explored(item->browser, &browser_iter) == FALSE)
       return FALSE;
 
-    if(inf_browser_get_child(item->browser, &browser_iter) == FALSE)
-      return FALSE;
+    parent_id = browser_iter.node_id;
 
-    /* skip missing */
-    if(browser_iter.node == item->missing)
-      ++n;
+    if(item->missing == NULL && item->cache_valid &&
+       item->cache_parent_id == parent_id && (guint)n >= item->cache_index)
+    {
+      /* Continue from the cached position */
+      browser_iter = item->cache_iter;
+      i = item->cache_index;
+    }
+    else
+    {
+      if(inf_browser_get_child(item->browser, &browser_iter) == FALSE)
+        return FALSE;
 
-    for(i = 0; i < (guint)n; ++ i)
+      /* skip missing */
+      if(browser_iter.node == item->missing)
+        ++n;
+
+      i = 0;
+    }
+
+    for(; i < (guint)n; ++ i)
     {
       if(inf_browser_get_next(item->browser, &browser_iter) == FALSE)
         return FALSE;
@@ -1840,6 +1941,8 @@ inf_gtk_browser_store_tree_model_iter_nth_child(GtkTreeModel* model,
         ++n;
     }
 
+    inf_gtk_browser_store_item_cache_set(item, parent_id, &browser_iter, n);
+
     iter->stamp = priv->stamp;
     iter->user_data = item;
     iter->user_data2 = GUINT_TO_POINTER(browser_iter.node_id);
@@ -1999,6 +2102,7 @@ inf_gtk_browser_store_browser_model_set_browser(InfGtkBrowserModel* model,
 
   /* Set up new browser */
   item->browser = new_browser;
+  item->cache_valid = FALSE;
 
   if(new_browser != NULL)
   {
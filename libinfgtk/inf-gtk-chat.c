@@ -37,8 +37,21 @@
  * in the widget. If you have a local user in the session you can also call
  * inf_gtk_chat_set_active_user(). In this case the input text entry is made
  * available and messages are sent via that user.
+ *
+ * Only the most recent messages of the session are shown initially. Older
+ * ones are added when the conversation is scrolled to the top, so that
+ * sessions with a long history open quickly.
  **/
 
+/* Only a window of the chat history is kept in the textview. Opening a
+ * session shows this many of the most recent messages, and the same number
+ * of older ones is added whenever the view is scrolled to the top. */
+#define INF_GTK_CHAT_HISTORY_BATCH 100
+
+/* While the view is at the bottom, the oldest messages are removed from the
+ * textview again once it holds more than this many. */
+#define INF_GTK_CHAT_MAX_SHOWN 500
+
 /* This is a small hack to get the scrolling in the textview right */
 typedef enum _InfGtkChatVMode {
   /* VMode is disabled, always keep bottom row constant */
@@ -74,6 +87,11 @@ struct _InfGtkChatPrivate {
   gdouble voffset;
   InfGtkChatVMode vmode;
 
+  /* Number of textview lines of each message shown, oldest first. The
+   * messages shown are the most recent ones of the chat buffer. */
+  GQueue shown_lines;
+  guint history_idle;
+
   GtkTextTag* tag_normal;
   GtkTextTag* tag_system;
   GtkTextTag* tag_emote;
@@ -134,13 +152,12 @@ inf_gtk_chat_strdup_strftime(const char* format,
   return str;
 }
 
-static void
-inf_gtk_chat_add_message(InfGtkChat* chat,
-                         const InfChatBufferMessage* message)
+static gchar*
+inf_gtk_chat_format_message(InfGtkChat* chat,
+                            const InfChatBufferMessage* message,
+                            GtkTextTag** tag)
 {
   InfGtkChatPrivate* priv;
-  GtkTextBuffer* buffer;
-  GtkTextIter insert_pos;
 
   const gchar* formatter;
   time_t cur_time;
@@ -149,14 +166,8 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
   gchar* time_str;
   gchar* loc_text;
   gchar* text;
-  GtkTextTag* tag;
-
-  gdouble scroll_val;
-  gdouble scroll_upper;
-  gdouble scroll_page_size;
 
   priv = INF_GTK_CHAT_PRIVATE(chat);
-  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(priv->chat_view));
 
   cur_time = time(NULL);
   cur_time_tm = *localtime(&cur_time);
@@ -177,7 +188,7 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
   switch(message->type)
   {
   case INF_CHAT_BUFFER_MESSAGE_NORMAL:
-    tag = priv->tag_normal;
+    *tag = priv->tag_normal;
     text = g_strdup_printf(
       "[%s] <%s> %.*s",
       time_str,
@@ -187,7 +198,7 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
     );
     break;
   case INF_CHAT_BUFFER_MESSAGE_EMOTE:
-    tag = priv->tag_emote;
+    *tag = priv->tag_emote;
     text = g_strdup_printf(
       "[%s] * %s %.*s",
       time_str,
@@ -197,14 +208,14 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
     );
     break;
   case INF_CHAT_BUFFER_MESSAGE_USERJOIN:
-    tag = priv->tag_system;
+    *tag = priv->tag_system;
     loc_text =
       g_strdup_printf(_("%s has joined"), inf_user_get_name(message->user));
     text = g_strdup_printf("[%s] %s", time_str, loc_text);
     g_free(loc_text);
     break;
   case INF_CHAT_BUFFER_MESSAGE_USERPART:
-    tag = priv->tag_system;
+    *tag = priv->tag_system;
     loc_text =
       g_strdup_printf(_("%s has left"), inf_user_get_name(message->user));
     text = g_strdup_printf("[%s] %s", time_str, loc_text);
@@ -219,7 +230,174 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
 
   /* Always apply backlog tag if it's a backlog message */
   if(message->flags & INF_CHAT_BUFFER_MESSAGE_BACKLOG)
-    tag = priv->tag_backlog;
+    *tag = priv->tag_backlog;
+
+  return text;
+}
+
+/* Inserts message at iter, and returns the number of lines it takes */
+static guint
+inf_gtk_chat_insert_message(InfGtkChat* chat,
+                            const InfChatBufferMessage* message,
+                            GtkTextIter* iter)
+{
+  InfGtkChatPrivate* priv;
+  GtkTextBuffer* buffer;
+  GtkTextTag* tag;
+  gchar* text;
+  const gchar* pos;
+  guint n_lines;
+
+  priv = INF_GTK_CHAT_PRIVATE(chat);
+  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(priv->chat_view));
+
+  text = inf_gtk_chat_format_message(chat, message, &tag);
+
+  n_lines = 1;
+  for(pos = strchr(text, '\n'); pos != NULL; pos = strchr(pos + 1, '\n'))
+    ++n_lines;
+
+  gtk_text_buffer_insert_with_tags(buffer, iter, text, -1, tag, NULL);
+  gtk_text_buffer_insert(buffer, iter, "\n", 1);
+
+  g_free(text);
+  return n_lines;
+}
+
+/* Removes the oldest messages from the textview, down to
+ * INF_GTK_CHAT_MAX_SHOWN. */
+static void
+inf_gtk_chat_trim_history(InfGtkChat* chat)
+{
+  InfGtkChatPrivate* priv;
+  GtkTextBuffer* buffer;
+  GtkTextIter begin;
+  GtkTextIter end;
+  guint n_lines;
+
+  priv = INF_GTK_CHAT_PRIVATE(chat);
+  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(priv->chat_view));
+
+  n_lines = 0;
+  while(g_queue_get_length(&priv->shown_lines) > INF_GTK_CHAT_MAX_SHOWN)
+    n_lines += GPOINTER_TO_UINT(g_queue_pop_head(&priv->shown_lines));
+
+  if(n_lines > 0)
+  {
+    gtk_text_buffer_get_start_iter(buffer, &begin);
+    gtk_text_buffer_get_iter_at_line(buffer, &end, n_lines);
+    gtk_text_buffer_delete(buffer, &begin, &end);
+  }
+}
+
+/* Adds the next INF_GTK_CHAT_HISTORY_BATCH older messages at the top of the
+ * textview. The distance to the bottom of the view is kept constant by
+ * inf_gtk_chat_adjustment_changed_cb(), so the visible part does not move.
+ * Returns FALSE if there were no older messages. */
+static gboolean
+inf_gtk_chat_load_history(InfGtkChat* chat)
+{
+  InfGtkChatPrivate* priv;
+  GtkTextBuffer* buffer;
+  GtkTextIter iter;
+  guint n_messages;
+  guint n_shown;
+  guint i;
+
+  priv = INF_GTK_CHAT_PRIVATE(chat);
+  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(priv->chat_view));
+
+  /* The chat buffer drops its oldest messages when it is full, so we might
+   * have shown more than it still has. */
+  n_messages = inf_chat_buffer_get_n_messages(priv->buffer);
+  n_shown = MIN(g_queue_get_length(&priv->shown_lines), n_messages);
+  if(n_shown == n_messages)
+    return FALSE;
+
+  /* Insert from newest to oldest, always at the very beginning */
+  for(i = 0; i < INF_GTK_CHAT_HISTORY_BATCH && n_shown + i < n_messages; ++i)
+  {
+    gtk_text_buffer_get_start_iter(buffer, &iter);
+
+    g_queue_push_head(
+      &priv->shown_lines,
+      GUINT_TO_POINTER(
+        inf_gtk_chat_insert_message(
+          chat,
+          inf_chat_buffer_get_message(
+            priv->buffer,
+            n_messages - n_shown - i - 1
+          ),
+          &iter
+        )
+      )
+    );
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_gtk_chat_history_idle_func(gpointer user_data)
+{
+  InfGtkChatPrivate* priv;
+  priv = INF_GTK_CHAT_PRIVATE(user_data);
+
+  priv->history_idle = 0;
+  inf_gtk_chat_load_history(INF_GTK_CHAT(user_data));
+
+  return FALSE;
+}
+
+/* Loads more history as soon as the view has reached its top, or when the
+ * messages shown do not even fill it. This is done in an idle handler,
+ * because it is triggered by adjustment changes, and adding text changes
+ * the adjustment again. */
+static void
+inf_gtk_chat_check_history(InfGtkChat* chat,
+                           GtkAdjustment* adjustment)
+{
+  InfGtkChatPrivate* priv;
+  priv = INF_GTK_CHAT_PRIVATE(chat);
+
+  if(priv->buffer == NULL || priv->history_idle != 0)
+    return;
+
+  /* Not allocated yet */
+  if(gtk_adjustment_get_page_size(adjustment) == 0.0)
+    return;
+
+  if(gtk_adjustment_get_value(adjustment) > 0.0 &&
+     gtk_adjustment_get_upper(adjustment) >
+     gtk_adjustment_get_page_size(adjustment))
+  {
+    return;
+  }
+
+  if(g_queue_get_length(&priv->shown_lines) >=
+     inf_chat_buffer_get_n_messages(priv->buffer))
+  {
+    return;
+  }
+
+  priv->history_idle = g_idle_add(inf_gtk_chat_history_idle_func, chat);
+}
+
+static void
+inf_gtk_chat_add_message(InfGtkChat* chat,
+                         const InfChatBufferMessage* message)
+{
+  InfGtkChatPrivate* priv;
+  GtkTextBuffer* buffer;
+  GtkTextIter insert_pos;
+  guint n_lines;
+
+  gdouble scroll_val;
+  gdouble scroll_upper;
+  gdouble scroll_page_size;
+
+  priv = INF_GTK_CHAT_PRIVATE(chat);
+  buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(priv->chat_view));
 
   g_object_get(
     G_OBJECT(priv->scroll_vadj),
@@ -230,8 +408,8 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
   );
 
   gtk_text_buffer_get_end_iter(buffer, &insert_pos);
-  gtk_text_buffer_insert_with_tags(buffer, &insert_pos, text, -1, tag, NULL);
-  gtk_text_buffer_insert(buffer, &insert_pos, "\n", 1);
+  n_lines = inf_gtk_chat_insert_message(chat, message, &insert_pos);
+  g_queue_push_tail(&priv->shown_lines, GUINT_TO_POINTER(n_lines));
 
   if(scroll_val != scroll_upper - scroll_page_size &&
      scroll_upper - scroll_page_size > 0 &&
@@ -243,6 +421,12 @@ inf_gtk_chat_add_message(InfGtkChat* chat,
      * added row. */
     priv->vmode = INF_GTK_CHAT_VMODE_SET;
   }
+  else
+  {
+    /* The view follows new messages, so nobody is looking at the oldest
+     * ones. */
+    inf_gtk_chat_trim_history(chat);
+  }
 }
 
 /* like the g_utf8_next_char macro, but without the cast to char* at the end
@@ -630,6 +814,8 @@ inf_gtk_chat_adjustment_changed_cb(GObject* object,
     priv->voffset = (max > value) ? (max - value) : 0.0;
     priv->vmode = INF_GTK_CHAT_VMODE_ENABLED;
   }
+
+  inf_gtk_chat_check_history(INF_GTK_CHAT(user_data), GTK_ADJUSTMENT(object));
 }
 
 static void
@@ -663,6 +849,8 @@ inf_gtk_chat_adjustment_value_changed_cb(GObject* object,
    * moved away from the very bottom of the view. */
   if(priv->vmode == INF_GTK_CHAT_VMODE_DISABLED)
     priv->vmode = INF_GTK_CHAT_VMODE_ENABLED;
+
+  inf_gtk_chat_check_history(INF_GTK_CHAT(user_data), GTK_ADJUSTMENT(object));
 }
 
 static gboolean
@@ -731,6 +919,9 @@ inf_gtk_chat_init(InfGtkChat* chat)
   priv->voffset = 0.0;
   priv->vmode = INF_GTK_CHAT_VMODE_DISABLED;
 
+  g_queue_init(&priv->shown_lines);
+  priv->history_idle = 0;
+
   /* Actually they are invalid as long as completion_text is NULL, but
    * let's be sure */
   priv->completion_text = NULL;
@@ -1005,7 +1196,6 @@ inf_gtk_chat_set_session(InfGtkChat* chat,
                          InfChatSession* session)
 {
   InfGtkChatPrivate* priv;
-  guint i;
 
   g_return_if_fail(INF_GTK_IS_CHAT(chat));
   g_return_if_fail(session == NULL || INF_IS_CHAT_SESSION(session));
@@ -1029,6 +1219,12 @@ inf_gtk_chat_set_session(InfGtkChat* chat,
       chat
     );
 
+    if(priv->history_idle != 0)
+    {
+      g_source_remove(priv->history_idle);
+      priv->history_idle = 0;
+    }
+
     g_object_unref(priv->session);
     g_object_unref(priv->buffer);
 
@@ -1037,6 +1233,8 @@ inf_gtk_chat_set_session(InfGtkChat* chat,
       "",
       0
     );
+
+    g_queue_clear(&priv->shown_lines);
   }
 
   priv->session = session;
@@ -1056,14 +1254,9 @@ inf_gtk_chat_set_session(InfGtkChat* chat,
       chat
     );
 
-    /* Show messages from oldest to newest */
-    for(i = 0; i < inf_chat_buffer_get_n_messages(priv->buffer); ++i)
-    {
-      inf_gtk_chat_add_message(
-        chat,
-        inf_chat_buffer_get_message(priv->buffer, i)
-      );
-    }
+    /* Show only the most recent messages, older ones are added when the
+     * user scrolls up. */
+    inf_gtk_chat_load_history(chat);
   }
   else
   {
@@ -19,6 +19,7 @@
 
 #include <libinfgtk/inf-gtk-io.h>
 #include <libinfinity/common/inf-io.h>
+#include <libinfinity/common/inf-io-private.h>
 
 struct _InfIoWatch {
   InfGtkIo* io;
@@ -42,13 +43,9 @@ struct _InfIoTimeout {
   GDestroyNotify notify;
 };
 
-struct _InfIoDispatch {
-  InfGtkIo* io;
-  guint id;
-  InfIoDispatchFunc func;
-  gpointer user_data;
-  GDestroyNotify notify;
-};
+/* Maximum number of dispatches run per main loop iteration, so that a
+ * flood of dispatches from worker threads does not starve other sources */
+#define INF_GTK_IO_DISPATCH_BATCH_SIZE 64
 
 typedef struct _InfGtkIoSharedMutex InfGtkIoSharedMutex;
 struct _InfGtkIoSharedMutex {
@@ -61,12 +58,21 @@ struct _InfGtkIoUserdata {
   union {
     InfIoWatch* watch;
     InfIoTimeout* timeout;
-    InfIoDispatch* dispatch;
   } shared;
 
   InfGtkIoSharedMutex* mutex;
 };
 
+/* A single source running all dispatches of an InfGtkIo. It is made ready
+ * by setting its ready time, which wakes up the main context and can be
+ * done from any thread. */
+typedef struct _InfGtkIoDispatchSource InfGtkIoDispatchSource;
+struct _InfGtkIoDispatchSource {
+  GSource source;
+  InfGtkIoSharedMutex* mutex;
+  InfGtkIo* io;
+};
+
 typedef struct _InfGtkIoPrivate InfGtkIoPrivate;
 struct _InfGtkIoPrivate {
   /* TODO: GMainContext */
@@ -75,7 +81,9 @@ struct _InfGtkIoPrivate {
 
   GSList* watches;
   GSList* timeouts;
-  GSList* dispatchs;
+
+  InfIoDispatchQueue dispatchs;
+  GSource* dispatch_source;
 };
 
 #define INF_GTK_IO_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_GTK_TYPE_IO, InfGtkIoPrivate))
@@ -161,32 +169,65 @@ inf_gtk_io_timeout_free(InfIoTimeout* timeout)
   g_slice_free(InfIoTimeout, timeout);
 }
 
-static InfIoDispatch*
-inf_gtk_io_dispatch_new(InfGtkIo* io,
-                        InfIoDispatchFunc func,
-                        gpointer user_data,
-                        GDestroyNotify notify)
+static gboolean
+inf_gtk_io_dispatch_source_dispatch(GSource* source,
+                                    GSourceFunc callback,
+                                    gpointer user_data)
 {
-  InfIoDispatch* dispatch;
-  dispatch = g_slice_new(InfIoDispatch);
-
-  dispatch->io = io;
-  dispatch->id = 0;
-  dispatch->func = func;
-  dispatch->user_data = user_data;
-  dispatch->notify = notify;
-  return dispatch;
+  InfGtkIoDispatchSource* dispatch_source;
+  InfGtkIo* io;
+  InfGtkIoPrivate* priv;
+
+  dispatch_source = (InfGtkIoDispatchSource*)source;
+  g_mutex_lock(&dispatch_source->mutex->mutex);
+  if(g_source_is_destroyed(source))
+  {
+    g_mutex_unlock(&dispatch_source->mutex->mutex);
+    return TRUE;
+  }
+
+  /* At this point we know that InfGtkIo is still alive because otherwise
+   * the source would have been destroyed in _finalize. */
+  io = dispatch_source->io;
+  g_object_ref(io);
+  g_mutex_unlock(&dispatch_source->mutex->mutex);
+
+  priv = INF_GTK_IO_PRIVATE(io);
+
+  /* Reset the ready time before taking the queued dispatches, so that a
+   * dispatch added while we are running makes the source ready again. */
+  g_source_set_ready_time(source, -1);
+
+  if(_inf_io_dispatch_queue_drain(&priv->dispatchs,
+                                  INF_GTK_IO_DISPATCH_BATCH_SIZE))
+  {
+    g_source_set_ready_time(source, 0);
+  }
+
+  g_object_unref(io);
+  return TRUE;
 }
 
 static void
-inf_gtk_io_dispatch_free(InfIoDispatch* dispatch)
+inf_gtk_io_dispatch_source_finalize(GSource* source)
 {
-  if(dispatch->notify)
-    dispatch->notify(dispatch->user_data);
+  InfGtkIoDispatchSource* dispatch_source;
+  dispatch_source = (InfGtkIoDispatchSource*)source;
 
-  g_slice_free(InfIoDispatch, dispatch);
+  if(g_atomic_int_dec_and_test(&dispatch_source->mutex->ref) == TRUE)
+  {
+    g_mutex_clear(&dispatch_source->mutex->mutex);
+    g_slice_free(InfGtkIoSharedMutex, dispatch_source->mutex);
+  }
 }
 
+static GSourceFuncs inf_gtk_io_dispatch_source_funcs = {
+  NULL,
+  NULL,
+  inf_gtk_io_dispatch_source_dispatch,
+  inf_gtk_io_dispatch_source_finalize
+};
+
 static InfIoWatch*
 inf_gtk_io_watch_lookup(InfGtkIo* io,
                         InfNativeSocket* socket)
@@ -215,7 +256,20 @@ inf_gtk_io_init(InfGtkIo* io)
 
   priv->watches = NULL;
   priv->timeouts = NULL;
-  priv->dispatchs = NULL;
+
+  _inf_io_dispatch_queue_init(&priv->dispatchs);
+
+  priv->dispatch_source = g_source_new(
+    &inf_gtk_io_dispatch_source_funcs,
+    sizeof(InfGtkIoDispatchSource)
+  );
+
+  ((InfGtkIoDispatchSource*)priv->dispatch_source)->mutex = priv->mutex;
+  ((InfGtkIoDispatchSource*)priv->dispatch_source)->io = io;
+  g_atomic_int_inc(&priv->mutex->ref);
+
+  g_source_set_priority(priv->dispatch_source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_attach(priv->dispatch_source, NULL);
 }
 
 static void
@@ -249,15 +303,12 @@ inf_gtk_io_finalize(GObject* object)
   }
   g_slist_free(priv->timeouts);
 
-  for(item = priv->dispatchs; item != NULL; item = g_slist_next(item))
-  {
-    if( ((InfIoDispatch*)item->data)->id != 0)
-      g_source_remove( ((InfIoDispatch*)item->data)->id);
-    inf_gtk_io_dispatch_free((InfIoDispatch*)item->data);
-  }
-  g_slist_free(priv->dispatchs);
+  g_source_destroy(priv->dispatch_source);
+  g_source_unref(priv->dispatch_source);
   g_mutex_unlock(&priv->mutex->mutex);
 
+  _inf_io_dispatch_queue_clear(&priv->dispatchs);
+
   /* some callback userdata might still have a reference to the mutex, and
    * wait for the callback function to be called until it is released. The
    * callback function will do nothing since g_source_is_destroyed() will
@@ -393,38 +444,6 @@ inf_gtk_io_timeout_func(gpointer user_data)
   return FALSE;
 }
 
-static gboolean
-inf_gtk_io_dispatch_func(gpointer user_data)
-{
-  InfIoDispatch* dispatch;
-  InfGtkIoPrivate* priv;
-  InfGtkIoUserdata* userdata;
-
-  userdata = (InfGtkIoUserdata*)user_data;
-  g_mutex_lock(&userdata->mutex->mutex);
-  if(!g_source_is_destroyed(g_main_current_source()))
-  {
-    /* At this point we know that InfGtkIo is still alive because otherwise
-     * the source would have been destroyed in _finalize. */
-    dispatch = userdata->shared.dispatch;
-    priv = INF_GTK_IO_PRIVATE(dispatch->io);
-
-    g_assert(priv->mutex->ref > 1); /* Both InfGtkIo and we have a reference */
-    g_assert(g_slist_find(priv->dispatchs, dispatch) != NULL);
-    priv->dispatchs = g_slist_remove(priv->dispatchs, dispatch);
-    g_mutex_unlock(&userdata->mutex->mutex);
-
-    dispatch->func(dispatch->user_data);
-    inf_gtk_io_dispatch_free(dispatch);
-  }
-  else
-  {
-    g_mutex_unlock(&userdata->mutex->mutex);
-  }
-
-  return FALSE;
-}
-
 static InfIoWatch*
 inf_gtk_io_io_add_watch(InfIo* io,
                         InfNativeSocket* socket,
@@ -617,6 +636,33 @@ inf_gtk_io_io_remove_timeout(InfIo* io,
   inf_gtk_io_timeout_free(timeout);
 }
 
+static void
+inf_gtk_io_io_reset_timeout(InfIo* io,
+                            InfIoTimeout* timeout,
+                            guint msecs)
+{
+  InfGtkIoPrivate* priv;
+  GSource* source;
+
+  priv = INF_GTK_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex->mutex);
+  g_assert(g_slist_find(priv->timeouts, timeout) != NULL);
+
+  /* The timeout source is attached to the default main context, see
+   * inf_gtk_io_io_add_timeout(). Moving its ready time is enough to
+   * reschedule it. */
+  source = g_main_context_find_source_by_id(NULL, timeout->id);
+  g_assert(source != NULL);
+
+  g_source_set_ready_time(
+    source,
+    g_source_get_time(source) + (gint64)msecs * 1000
+  );
+
+  g_mutex_unlock(&priv->mutex->mutex);
+}
+
 static InfIoDispatch*
 inf_gtk_io_io_add_dispatch(InfIo* io,
                            InfIoDispatchFunc func,
@@ -624,30 +670,24 @@ inf_gtk_io_io_add_dispatch(InfIo* io,
                            GDestroyNotify notify)
 {
   InfGtkIoPrivate* priv;
-  InfIoDispatch* dispatch;
-  InfGtkIoUserdata* data;
+  InfIoDispatchQueueEntry* entry;
+  gboolean was_empty;
 
   priv = INF_GTK_IO_PRIVATE(io);
-  dispatch = inf_gtk_io_dispatch_new(INF_GTK_IO(io), func, user_data, notify);
 
-  data = g_slice_new(InfGtkIoUserdata);
-  data->shared.dispatch = dispatch;
-  data->mutex = priv->mutex;
-
-  g_mutex_lock(&priv->mutex->mutex);
-  g_atomic_int_inc(&data->mutex->ref);
-
-  dispatch->id = g_idle_add_full(
-    G_PRIORITY_DEFAULT_IDLE,
-    inf_gtk_io_dispatch_func,
-    data,
-    inf_gtk_io_userdata_free
+  entry = _inf_io_dispatch_queue_push(
+    &priv->dispatchs,
+    func,
+    user_data,
+    notify,
+    &was_empty
   );
 
-  priv->dispatchs = g_slist_prepend(priv->dispatchs, dispatch);
-  g_mutex_unlock(&priv->mutex->mutex);
+  /* If the queue was not empty, the source is already scheduled */
+  if(was_empty)
+    g_source_set_ready_time(priv->dispatch_source, 0);
 
-  return dispatch;
+  return (InfIoDispatch*)entry;
 }
 
 static void
@@ -655,20 +695,13 @@ inf_gtk_io_io_remove_dispatch(InfIo* io,
                               InfIoDispatch* dispatch)
 {
   InfGtkIoPrivate* priv;
-
   priv = INF_GTK_IO_PRIVATE(io);
 
-  g_mutex_lock(&priv->mutex->mutex);
-  g_assert(g_slist_find(priv->dispatchs, dispatch) != NULL);
-  priv->dispatchs = g_slist_remove(priv->dispatchs, dispatch);
-  g_mutex_unlock(&priv->mutex->mutex);
-
-  /* Note that we can do this safely without having locked the mutex because
-   * if the callback function is currently being invoked then its user_data
-   * will not be destroyed immediately. */
-  g_source_remove(dispatch->id);
-
-  inf_gtk_io_dispatch_free(dispatch);
+  /* The entry is freed when the dispatch source reaches it */
+  _inf_io_dispatch_queue_cancel(
+    &priv->dispatchs,
+    (InfIoDispatchQueueEntry*)dispatch
+  );
 }
 
 static void
@@ -688,6 +721,7 @@ inf_gtk_io_io_iface_init(InfIoInterface* iface)
   iface->remove_watch = inf_gtk_io_io_remove_watch;
   iface->add_timeout = inf_gtk_io_io_add_timeout;
   iface->remove_timeout = inf_gtk_io_io_remove_timeout;
+  iface->reset_timeout = inf_gtk_io_io_reset_timeout;
   iface->add_dispatch = inf_gtk_io_io_add_dispatch;
   iface->remove_dispatch = inf_gtk_io_io_remove_dispatch;
 }
@@ -74,7 +74,9 @@ struct _InfGtkPermissionsDialogPrivate {
   /* If accounts is NULL, then the account list is not available. Note that we
    * only need the account list when the user adds a new sheet, to present her
    * the available users to choose from. If the list is not available, we
-   * perform a reverse lookup. */
+   * perform a reverse lookup. Before querying the list, we count the
+   * accounts, and do not query it at all if there are too many of them. */
+  InfRequest* query_acl_accounts_request;
   InfRequest* query_acl_account_list_request;
   gboolean account_list_queried;
   InfAclAccount* accounts;
@@ -107,6 +109,10 @@ enum {
   PROP_BROWSER_ITER
 };
 
+/* If the server has more accounts than this, we do not query the full
+ * account list, and let the user type in the account name instead. */
+#define INF_GTK_PERMISSIONS_DIALOG_MAX_LISTED_ACCOUNTS 250
+
 #define INF_GTK_PERMISSIONS_DIALOG_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_GTK_TYPE_PERMISSIONS_DIALOG, InfGtkPermissionsDialogPrivate))
 
 G_DEFINE_TYPE_WITH_CODE(InfGtkPermissionsDialog, inf_gtk_permissions_dialog, GTK_TYPE_DIALOG,
@@ -2255,6 +2261,72 @@ inf_gtk_permissions_dialog_query_acl_account_list_finished_cb(
   }
 }
 
+static void
+inf_gtk_permissions_dialog_query_account_list(InfGtkPermissionsDialog* dialog)
+{
+  InfGtkPermissionsDialogPrivate* priv;
+  priv = INF_GTK_PERMISSIONS_DIALOG_PRIVATE(dialog);
+
+  priv->query_acl_account_list_request = inf_browser_get_pending_request(
+    priv->browser,
+    NULL,
+    "query-acl-account-list"
+  );
+
+  if(priv->query_acl_account_list_request == NULL)
+  {
+    priv->query_acl_account_list_request =
+      inf_browser_query_acl_account_list(
+        priv->browser,
+        inf_gtk_permissions_dialog_query_acl_account_list_finished_cb,
+        dialog
+      );
+  }
+  else
+  {
+    g_signal_connect(
+      G_OBJECT(priv->query_acl_account_list_request),
+      "finished",
+      G_CALLBACK(
+        inf_gtk_permissions_dialog_query_acl_account_list_finished_cb
+      ),
+      dialog
+    );
+  }
+}
+
+static void
+inf_gtk_permissions_dialog_query_acl_accounts_finished_cb(
+  InfRequest* request,
+  const InfRequestResult* res,
+  const GError* error,
+  gpointer user_data)
+{
+  InfGtkPermissionsDialog* dialog;
+  InfGtkPermissionsDialogPrivate* priv;
+  guint n_total;
+
+  dialog = INF_GTK_PERMISSIONS_DIALOG(user_data);
+  priv = INF_GTK_PERMISSIONS_DIALOG_PRIVATE(dialog);
+
+  priv->query_acl_accounts_request = NULL;
+
+  /* If counting the accounts fails, for example because the server does not
+   * support it, then query the full list anyway. */
+  if(error == NULL)
+  {
+    inf_request_result_get_query_acl_accounts(res, NULL, NULL, NULL, &n_total);
+    if(n_total > INF_GTK_PERMISSIONS_DIALOG_MAX_LISTED_ACCOUNTS)
+    {
+      /* Leave the account list unavailable */
+      priv->account_list_queried = TRUE;
+      return;
+    }
+  }
+
+  inf_gtk_permissions_dialog_query_account_list(dialog);
+}
+
 static void
 inf_gtk_permissions_dialog_query_acl_finished_cb(InfRequest* request,
                                                  const InfRequestResult* res,
@@ -2298,6 +2370,7 @@ inf_gtk_permissions_dialog_update(InfGtkPermissionsDialog* dialog,
   InfGtkPermissionsDialogPendingSheet* pending;
   GtkTreePath* pending_path;
 
+  InfRequest* pending_request;
   const gchar* query_acl_str;
   const gchar* set_acl_str;
   gchar* error_str;
@@ -2334,35 +2407,33 @@ inf_gtk_permissions_dialog_update(InfGtkPermissionsDialog* dialog,
   );
 
   /* Request account list */
-  if(priv->query_acl_account_list_request == NULL &&
+  if(priv->query_acl_accounts_request == NULL &&
+     priv->query_acl_account_list_request == NULL &&
      priv->account_list_queried == FALSE)
   {
     if(inf_acl_mask_has(&perms, INF_ACL_CAN_QUERY_ACCOUNT_LIST) &&
        inf_acl_mask_has(&perms, INF_ACL_CAN_SET_ACL))
     {
-      priv->query_acl_account_list_request = inf_browser_get_pending_request(
+      /* If someone else is querying the full list already, use that, and
+       * otherwise only count the accounts first. */
+      pending_request = inf_browser_get_pending_request(
         priv->browser,
         NULL,
         "query-acl-account-list"
       );
 
-      if(priv->query_acl_account_list_request == NULL)
+      if(pending_request != NULL)
       {
-        priv->query_acl_account_list_request =
-          inf_browser_query_acl_account_list(
-            priv->browser,
-            inf_gtk_permissions_dialog_query_acl_account_list_finished_cb,
-            dialog
-          );
+        inf_gtk_permissions_dialog_query_account_list(dialog);
       }
       else
       {
-        g_signal_connect(
-          G_OBJECT(priv->query_acl_account_list_request),
-          "finished",
-          G_CALLBACK(
-            inf_gtk_permissions_dialog_query_acl_account_list_finished_cb
-          ),
+        priv->query_acl_accounts_request = inf_browser_query_acl_accounts(
+          priv->browser,
+          NULL,
+          0,
+          0,
+          inf_gtk_permissions_dialog_query_acl_accounts_finished_cb,
           dialog
         );
       }
@@ -2640,6 +2711,7 @@ inf_gtk_permissions_dialog_init(InfGtkPermissionsDialog* dialog)
   InfGtkPermissionsDialogPrivate* priv;
   priv = INF_GTK_PERMISSIONS_DIALOG_PRIVATE(dialog);
 
+  priv->query_acl_accounts_request = NULL;
   priv->query_acl_account_list_request = NULL;
   priv->account_list_queried = FALSE;
   priv->accounts = NULL;
@@ -3029,6 +3101,17 @@ inf_gtk_permissions_dialog_set_node(InfGtkPermissionsDialog* dialog,
 
   if(priv->browser != NULL)
   {
+    if(priv->query_acl_accounts_request != NULL)
+    {
+      inf_signal_handlers_disconnect_by_func(
+        priv->query_acl_accounts_request,
+        G_CALLBACK(inf_gtk_permissions_dialog_query_acl_accounts_finished_cb),
+        dialog
+      );
+
+      priv->query_acl_accounts_request = NULL;
+    }
+
     if(priv->query_acl_account_list_request != NULL)
     {
       inf_signal_handlers_disconnect_by_func(
@@ -58,18 +58,25 @@
  * is achieved.
  */
 
-/* TODO: Do only cleanup if too much entries in cache? */
-
-/* TODO: If users are not issuing any requests for some time, and we can be
- * sure that we do not need to transform any requests, then remove them from
- * the users array (users_begin, users_end). Readd users as soon as they
- * issue buffer-altering requests. This way we keep the asymptotic complexity
- * dynamically as O(active users^2). */
+/* Users that are unavailable and whose requests have all been removed from
+ * their request log by cleanup are moved to the back of the users array,
+ * behind users_active_end. No request needs to be transformed against such
+ * a user's requests anymore, since every state that is still relevant
+ * contains all of them, so the loops that run for every translation or
+ * cleanup only iterate over the active users. Users are made active again
+ * as soon as they become available or issue a buffer-altering request. This
+ * way documents that collected many users over time do not have to pay for
+ * users that left a long time ago. Note that the users' components remain in
+ * the state vectors, since they are part of the state vectors exchanged with
+ * other sites. */
 
 #include <libinfinity/adopted/inf-adopted-algorithm.h>
 #include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-trace.h>
 #include <libinfinity/inf-i18n.h>
 
+#include "config.h"
+
 typedef struct _InfAdoptedAlgorithmLocalUser InfAdoptedAlgorithmLocalUser;
 struct _InfAdoptedAlgorithmLocalUser {
   InfAdoptedUser* user;
@@ -87,12 +94,31 @@ struct _InfAdoptedAlgorithmPrivate {
 
   InfAdoptedRequest* execute_request;
 
+  /* A request whose translation to the current state is being spread over
+   * several calls to inf_adopted_algorithm_prepare_request(), and how far
+   * it has been translated so far. */
+  InfAdoptedRequest* prepare_request;
+  InfAdoptedRequest* prepare_translated;
+
+  /* Set during inf_adopted_algorithm_execute_requests(). The can-undo and
+   * can-redo state of local users is only updated at the end of the batch
+   * then, or when it is needed to execute an undo or redo request. */
+  gboolean in_batch;
+  gboolean undo_redo_pending;
+
+  /* Executed requests, and how many of them did not need to be
+   * translated, see inf_adopted_algorithm_get_statistics() */
+  guint n_executed;
+  guint n_untranslated;
+
   InfUserTable* user_table;
   InfBuffer* buffer;
 
   /* Users in user table. We need to iterate over them very often, so we
-   * keep them as array here. */
+   * keep them as array here. The active users are in front of
+   * users_active_end. */
   InfAdoptedUser** users_begin;
+  InfAdoptedUser** users_active_end;
   InfAdoptedUser** users_end;
 
   GSList* local_users;
@@ -129,78 +155,6 @@ static guint algorithm_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedAlgorithm, inf_adopted_algorithm, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedAlgorithm))
 
-/* Returns a new state vector v so that both first and second are causally
- * before v and so that there is no other state vector with the same property
- * that is causally before v. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
-                                             InfAdoptedStateVector* first,
-                                             InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MAX(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  g_assert(inf_adopted_state_vector_causally_before(first, result));
-  g_assert(inf_adopted_state_vector_causally_before(second, result));
-  return result;
-}
-
-/* Returns a new state vector v so that v is both causally before first and
- * second and so that there is no other state vector with the same property
- * so that v is causally before that vector. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-/* TODO: A version modifying first instead of returning a new result,
- * use in inf_adopted_algorithm_cleanup(). */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
-                                               InfAdoptedStateVector* first,
-                                               InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MIN(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  return result;
-}
-
 /* Checks whether the given request can be undone (or redone if it is an
  * undo request). In general, a user can perform an undo when
  * there is a request to undo in the request log. However, if there are too
@@ -267,6 +221,11 @@ inf_adopted_algorithm_update_undo_redo(InfAdoptedAlgorithm* algorithm)
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
+  /* Without a request log, nobody can ever undo or redo, so the flags stay
+   * at their initial FALSE value and there is nothing to update. */
+  if(priv->max_total_log_size == 0)
+    return;
+
   for(item = priv->local_users; item != NULL; item = g_slist_next(item))
   {
     local = item->data;
@@ -339,6 +298,64 @@ inf_adopted_algorithm_local_user_free(InfAdoptedAlgorithm* algorithm,
   g_slice_free(InfAdoptedAlgorithmLocalUser, local);
 }
 
+static gboolean
+inf_adopted_algorithm_user_is_idle(InfAdoptedUser* user)
+{
+  InfAdoptedRequestLog* log;
+
+  if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+    return FALSE;
+
+  log = inf_adopted_user_get_request_log(user);
+  return inf_adopted_request_log_is_empty(log);
+}
+
+static void
+inf_adopted_algorithm_swap_users(InfAdoptedUser** first,
+                                 InfAdoptedUser** second)
+{
+  InfAdoptedUser* user;
+
+  user = *first;
+  *first = *second;
+  *second = user;
+}
+
+/* Moves an inactive user into the active part of the users array */
+static void
+inf_adopted_algorithm_activate_user(InfAdoptedAlgorithm* algorithm,
+                                    InfAdoptedUser* user)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user_it;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  for(user_it = priv->users_active_end; user_it != priv->users_end; ++user_it)
+  {
+    if(*user_it == user)
+    {
+      inf_adopted_algorithm_swap_users(user_it, priv->users_active_end);
+      ++priv->users_active_end;
+      return;
+    }
+  }
+}
+
+static void
+inf_adopted_algorithm_user_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  if(inf_user_get_status(INF_USER(object)) != INF_USER_UNAVAILABLE)
+  {
+    inf_adopted_algorithm_activate_user(
+      INF_ADOPTED_ALGORITHM(user_data),
+      INF_ADOPTED_USER(object)
+    );
+  }
+}
+
 static void
 inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user)
@@ -347,6 +364,7 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
   InfAdoptedRequestLog* log;
   InfAdoptedStateVector* time;
   guint user_count;
+  guint active_count;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
@@ -360,10 +378,31 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
   );
 
   user_count = (priv->users_end - priv->users_begin) + 1;
+  active_count = priv->users_active_end - priv->users_begin;
   priv->users_begin =
     g_realloc(priv->users_begin, sizeof(InfAdoptedUser*) * user_count);
+  priv->users_active_end = priv->users_begin + active_count;
   priv->users_end = priv->users_begin + user_count;
   priv->users_begin[user_count - 1] = user;
+
+  /* Users that are added during synchronization usually left the session
+   * a long time ago, so they do not need to become active at all. */
+  if(!inf_adopted_algorithm_user_is_idle(user))
+  {
+    inf_adopted_algorithm_swap_users(
+      priv->users_end - 1,
+      priv->users_active_end
+    );
+
+    ++priv->users_active_end;
+  }
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::status",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+    algorithm
+  );
 }
 
 static void
@@ -485,10 +524,7 @@ inf_adopted_algorithm_buffer_states_equivalent(InfAdoptedAlgorithm* algorithm,
       {
         request = inf_adopted_request_log_prev_associated(log, request);
 
-        second_n = inf_adopted_state_vector_get(
-          inf_adopted_request_get_vector(request),
-          user_id
-        );
+        second_n = inf_adopted_request_get_index(request);
       }
     }
 
@@ -607,7 +643,7 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
   InfAdoptedRequest* request_at;
   InfAdoptedRequest* against_at;
   InfAdoptedConcurrencyId concurrency_id;
-  InfAdoptedStateVector* lcs;
+  InfAdoptedStateVector lcs;
   InfAdoptedRequest* lcs_against;
   InfAdoptedRequest* lcs_request;
   InfAdoptedRequest* result;
@@ -640,26 +676,33 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
   concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
   if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
   {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
-      inf_adopted_request_get_vector(request),
+    /* The least common successor is only needed temporarily, so keep it
+     * on the stack. */
+    inf_adopted_state_vector_init(&lcs);
+    inf_adopted_state_vector_assign(
+      &lcs,
+      inf_adopted_request_get_vector(request)
+    );
+
+    inf_adopted_state_vector_max(
+      &lcs,
       inf_adopted_request_get_vector(against)
     );
 
-    g_assert(inf_adopted_state_vector_causally_before(lcs, at));
+    g_assert(inf_adopted_state_vector_causally_before(&lcs, at));
 
-    if(inf_adopted_state_vector_compare(lcs, at) != 0)
+    if(inf_adopted_state_vector_compare(&lcs, at) != 0)
     {
       lcs_against = inf_adopted_algorithm_translate_request(
         algorithm,
         against,
-        lcs
+        &lcs
       );
 
       lcs_request = inf_adopted_algorithm_translate_request(
         algorithm,
         request,
-        lcs
+        &lcs
       );
     }
     else
@@ -671,7 +714,7 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
       g_object_ref(lcs_request);
     }
 
-    inf_adopted_state_vector_free(lcs);
+    inf_adopted_state_vector_clear(&lcs);
   }
   else
   {
@@ -719,9 +762,38 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
   guint from_n;
   guint to_n;
   guint associated_index;
+  InfAdoptedRequestLog* request_log;
+  gboolean cache_all;
+  gboolean transformed;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
+  /* Intermediate requests on the way to the target state that result from
+   * a transformation against another user's request are cached, too. A
+   * translation only depends on the request's user and its target vector,
+   * so when the same request later shows up as the concurrent partner in
+   * another user's translation, the pairwise transformations made here do
+   * not have to be repeated. The cache is bounded by the request log's
+   * cache size and by the global byte budget.
+   *
+   * While an undo or redo request is executed, the intermediate requests
+   * reached by folds and mirrors are cached as well. Undoing a chain of
+   * requests translates through mostly the same region of the state space
+   * with many folds and mirrors, so successive undos can then reuse the
+   * intermediate requests in their recursive translations. */
+  user = INF_ADOPTED_USER(
+    inf_user_table_lookup_user_by_id(
+      priv->user_table,
+      inf_adopted_request_get_user_id(request)
+    )
+  );
+
+  request_log = inf_adopted_user_get_request_log(user);
+
+  cache_all = priv->execute_request != NULL &&
+    inf_adopted_request_get_request_type(priv->execute_request) !=
+      INF_ADOPTED_REQUEST_DO;
+
   cur_req = request;
   vector = inf_adopted_request_get_vector(cur_req);
   g_object_ref(cur_req);
@@ -729,9 +801,12 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
   while(inf_adopted_state_vector_compare(vector, to) != 0)
   {
     next_req = NULL;
+    transformed = FALSE;
 
     g_assert(inf_adopted_state_vector_causally_before(vector, to) == TRUE);
-    for(user_it = priv->users_begin; user_it != priv->users_end; ++user_it)
+    for(user_it = priv->users_begin;
+        user_it != priv->users_active_end;
+        ++user_it)
     {
       user = *user_it;
       user_id = inf_user_get_id(INF_USER(user));
@@ -782,6 +857,7 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
           );
 
           g_object_unref(translated);
+          transformed = TRUE;
           break;
         }
       }
@@ -840,11 +916,99 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
     g_object_unref(cur_req);
     cur_req = next_req;
     vector = inf_adopted_request_get_vector(cur_req);
+
+    /* The final request is cached by the caller */
+    if((cache_all || transformed) &&
+       inf_adopted_state_vector_compare(vector, to) != 0 &&
+       inf_adopted_algorithm_can_cache(cur_req) &&
+       !inf_adopted_request_log_has_cached_request(request_log, vector))
+    {
+      inf_adopted_request_log_add_cached_request(request_log, cur_req);
+    }
   }
 
   return cur_req;
 }
 
+static void
+inf_adopted_algorithm_clear_prepared(InfAdoptedAlgorithm* algorithm)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  if(priv->prepare_request != NULL)
+  {
+    g_object_unref(priv->prepare_request);
+    g_object_unref(priv->prepare_translated);
+
+    priv->prepare_request = NULL;
+    priv->prepare_translated = NULL;
+  }
+}
+
+/* Advances vec towards the current state by up to max_steps requests, such
+ * that it stays a reachable point in the state space, i.e. all requests
+ * included in vec only depend on requests which are included as well.
+ * Only DO requests of other users are stepped over; the translation across
+ * undos and redos is left to the final translation to the current state.
+ * Returns the number of steps made. */
+static guint
+inf_adopted_algorithm_advance_vector(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedStateVector* vec,
+                                     guint request_user_id,
+                                     guint max_steps)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user_it;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* next;
+  guint user_id;
+  guint n;
+  guint steps;
+  gboolean progress;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  steps = 0;
+
+  do
+  {
+    progress = FALSE;
+
+    for(user_it = priv->users_begin;
+        user_it != priv->users_end && steps < max_steps;
+        ++user_it)
+    {
+      user_id = inf_user_get_id(INF_USER(*user_it));
+      if(user_id == request_user_id) continue;
+
+      n = inf_adopted_state_vector_get(vec, user_id);
+      if(n == inf_adopted_state_vector_get(priv->current, user_id)) continue;
+
+      log = inf_adopted_user_get_request_log(*user_it);
+      next = inf_adopted_request_log_get_request(log, n);
+
+      if(inf_adopted_request_get_request_type(next) !=
+         INF_ADOPTED_REQUEST_DO)
+      {
+        continue;
+      }
+
+      if(!inf_adopted_state_vector_causally_before(
+           inf_adopted_request_get_vector(next),
+           vec))
+      {
+        continue;
+      }
+
+      inf_adopted_state_vector_add(vec, user_id, 1);
+      ++steps;
+      progress = TRUE;
+    }
+  } while(progress && steps < max_steps);
+
+  return steps;
+}
+
 static void
 inf_adopted_algorithm_log_request(InfAdoptedAlgorithm* algorithm,
                                   InfAdoptedUser* user,
@@ -869,6 +1033,11 @@ inf_adopted_algorithm_log_request(InfAdoptedAlgorithm* algorithm,
    * request is buffer-altering. */
   if(inf_adopted_request_affects_buffer(request))
   {
+    /* Other requests need to be transformed against this one, so the user
+     * has to be active. */
+    if(inf_adopted_request_log_is_empty(log))
+      inf_adopted_algorithm_activate_user(algorithm, user);
+
     /* First, add to request log */
     inf_adopted_request_log_add_request(log, request);
     /* Update current document state */
@@ -934,6 +1103,8 @@ inf_adopted_algorithm_apply_request(InfAdoptedAlgorithm* algorithm,
   local_error = NULL;
   log_request = NULL;
 
+  INF_TRACE1(apply_begin, inf_adopted_request_get_user_id(request));
+
   /* Apply the operation to the buffer. If this originated from a DO request,
    * make the operation reversible before adding it to the request log. */
   if(inf_adopted_request_get_request_type(request) == INF_ADOPTED_REQUEST_DO)
@@ -995,6 +1166,8 @@ inf_adopted_algorithm_apply_request(InfAdoptedAlgorithm* algorithm,
     }
   }
 
+  INF_TRACE1(apply_end, inf_adopted_request_get_user_id(request));
+
   if(local_error != NULL)
   {
     g_assert(log_request == NULL);
@@ -1035,6 +1208,13 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
 
   priv->max_total_log_size = 2048;
   priv->execute_request = NULL;
+  priv->prepare_request = NULL;
+  priv->prepare_translated = NULL;
+  priv->in_batch = FALSE;
+  priv->undo_redo_pending = FALSE;
+
+  priv->n_executed = 0;
+  priv->n_untranslated = 0;
 
   priv->current = inf_adopted_state_vector_new();
   priv->buffer_modified_time = NULL;
@@ -1044,6 +1224,7 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
   /* Lookup by user, user is not refed because the request log holds a 
    * reference anyway. */
   priv->users_begin = NULL;
+  priv->users_active_end = NULL;
   priv->users_end = NULL;
 
   priv->local_users = NULL;
@@ -1106,6 +1287,7 @@ inf_adopted_algorithm_dispose(GObject* object)
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user_it;
   GList* item;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
@@ -1114,7 +1296,21 @@ inf_adopted_algorithm_dispose(GObject* object)
   while(priv->local_users != NULL)
     inf_adopted_algorithm_local_user_free(algorithm, priv->local_users->data);
 
+  inf_adopted_algorithm_clear_prepared(algorithm);
+
+  for(user_it = priv->users_begin; user_it != priv->users_end; ++user_it)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user_it),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+      algorithm
+    );
+  }
+
   g_free(priv->users_begin);
+  priv->users_begin = NULL;
+  priv->users_active_end = NULL;
+  priv->users_end = NULL;
 
   if(priv->buffer != NULL)
   {
@@ -1553,6 +1749,13 @@ inf_adopted_algorithm_new(InfUserTable* user_table,
  * this issues a huge amount of data that needs to be synchronized on user
  * join and is too expensive to compute anyway.
  *
+ * Set to 0 for sites that never undo, such as bots or indexers. Then no
+ * request is kept longer than necessary to transform concurrent requests,
+ * and no undo bookkeeping is performed at all. Since undo requests can only
+ * be processed if enough requests are available in the log, undo is not
+ * possible for any user in the session then, so all sites of the session
+ * need to use the same value.
+ *
  * The default value is 2048.
  *
  * Returns: (transfer full): A new #InfAdoptedAlgorithm.
@@ -1745,17 +1948,20 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
     result = inf_adopted_request_log_lookup_cached_request(log, to);
     if(result != NULL)
     {
+      INF_TRACE1(transform_cached, user_id);
       g_object_ref(result);
       return result;
     }
   }
 
   /* New algorithm */
+  INF_TRACE1(transform_begin, user_id);
   result = inf_adopted_algorithm_translate_request_forward(
     algorithm,
     request,
     to
   );
+  INF_TRACE1(transform_end, user_id);
 
   g_assert(
     inf_adopted_state_vector_compare(
@@ -1769,6 +1975,104 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
   return result;
 }
 
+/**
+ * inf_adopted_algorithm_prepare_request:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @request: A %INF_ADOPTED_REQUEST_DO request that is about to be executed.
+ * @max_steps: The maximum number of requests to translate @request across.
+ *
+ * Translates @request part of the way towards the current state of
+ * @algorithm, across at most @max_steps concurrent requests, and remembers
+ * the result. When @request is executed with
+ * inf_adopted_algorithm_execute_request() later, then the translation
+ * continues from there instead of starting from scratch.
+ *
+ * This allows to spread the translation of a request which is concurrent to
+ * very many other requests, such as one made after a long offline period,
+ * over several main loop iterations, by calling this function repeatedly
+ * until it returns %TRUE. In the meanwhile, other requests can be executed,
+ * but @request's user must not issue any further requests before @request
+ * has been executed. Only one request can be prepared at a time; preparing
+ * another request discards the partial translation of the previous one.
+ *
+ * Translation across undo and redo requests of other users is not split up.
+ * If the remaining path towards the current state starts with such requests,
+ * the function returns %TRUE, and the rest of the translation is made when
+ * @request is executed.
+ *
+ * Returns: %TRUE if there is no more translation work that could be split
+ * off, or %FALSE if the function should be called again.
+ */
+gboolean
+inf_adopted_algorithm_prepare_request(InfAdoptedAlgorithm* algorithm,
+                                      InfAdoptedRequest* request,
+                                      guint max_steps)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequest* translated;
+  guint steps;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), FALSE);
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), FALSE);
+  g_return_val_if_fail(max_steps > 0, FALSE);
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  g_return_val_if_fail(
+    inf_adopted_request_get_request_type(request) == INF_ADOPTED_REQUEST_DO,
+    FALSE
+  );
+
+  g_return_val_if_fail(
+    inf_adopted_state_vector_causally_before(
+      inf_adopted_request_get_vector(request),
+      priv->current
+    ),
+    FALSE
+  );
+
+  g_return_val_if_fail(priv->execute_request == NULL, FALSE);
+
+  if(priv->prepare_request != request)
+  {
+    inf_adopted_algorithm_clear_prepared(algorithm);
+
+    priv->prepare_request = request;
+    priv->prepare_translated = request;
+    g_object_ref(request);
+    g_object_ref(request);
+  }
+
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_request_get_vector(priv->prepare_translated)
+  );
+
+  steps = inf_adopted_algorithm_advance_vector(
+    algorithm,
+    vector,
+    inf_adopted_request_get_user_id(request),
+    max_steps
+  );
+
+  if(steps > 0)
+  {
+    translated = inf_adopted_algorithm_translate_request(
+      algorithm,
+      priv->prepare_translated,
+      vector
+    );
+
+    g_object_unref(priv->prepare_translated);
+    priv->prepare_translated = translated;
+  }
+
+  inf_adopted_state_vector_free(vector);
+
+  /* We are done if no more steps can be made from here */
+  return steps < max_steps;
+}
+
 /**
  * inf_adopted_algorithm_execute_request:
  * @algorithm: A #InfAdoptedAlgorithm.
@@ -1869,6 +2173,12 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   g_return_val_if_fail(priv->execute_request == NULL, FALSE);
   priv->execute_request = request;
 
+  INF_TRACE2(
+    request_execute,
+    inf_adopted_request_get_user_id(request),
+    inf_adopted_request_get_request_type(request)
+  );
+
   inf_adopted_request_set_execute_time(request, g_get_real_time());
 
   g_signal_emit(
@@ -1879,6 +2189,15 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     request
   );
 
+  /* The checks below need the can-undo and can-redo state of the user to be
+   * up to date. */
+  if(priv->undo_redo_pending &&
+     inf_adopted_request_get_request_type(request) != INF_ADOPTED_REQUEST_DO)
+  {
+    priv->undo_redo_pending = FALSE;
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
+
   local_error = NULL;
   switch(inf_adopted_request_get_request_type(request))
   {
@@ -1956,11 +2275,40 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     inf_adopted_request_get_request_type(original) == INF_ADOPTED_REQUEST_DO
   );
 
-  translated = inf_adopted_algorithm_translate_request(
-    algorithm,
-    original,
-    priv->current
-  );
+  /* Most requests have been made at the current state, when there are no
+   * concurrent requests. These can be applied as they are, so there is no
+   * need to go through the cache or to add them to it. */
+  ++priv->n_executed;
+  if(original == request &&
+     inf_adopted_state_vector_compare(
+       inf_adopted_request_get_vector(request),
+       priv->current
+     ) == 0)
+  {
+    ++priv->n_untranslated;
+    translated = request;
+    g_object_ref(translated);
+  }
+  else if(original == priv->prepare_request)
+  {
+    /* Continue from where inf_adopted_algorithm_prepare_request() left */
+    translated = inf_adopted_algorithm_translate_request(
+      algorithm,
+      priv->prepare_translated,
+      priv->current
+    );
+  }
+  else
+  {
+    translated = inf_adopted_algorithm_translate_request(
+      algorithm,
+      original,
+      priv->current
+    );
+  }
+
+  if(request == priv->prepare_request)
+    inf_adopted_algorithm_clear_prepared(algorithm);
 
   g_assert(
     inf_adopted_request_get_request_type(translated) == INF_ADOPTED_REQUEST_DO
@@ -2025,7 +2373,10 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     algorithm
   );
 
-  inf_adopted_algorithm_update_undo_redo(algorithm);
+  if(priv->in_batch)
+    priv->undo_redo_pending = TRUE;
+  else
+    inf_adopted_algorithm_update_undo_redo(algorithm);
 
   g_signal_emit(
     G_OBJECT(algorithm),
@@ -2044,6 +2395,85 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   return TRUE;
 }
 
+/**
+ * inf_adopted_algorithm_execute_requests:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @requests: (array length=n_requests): The requests to execute.
+ * @n_requests: The number of elements in @requests.
+ * @apply: Whether to apply the requests to the buffer.
+ * @n_executed: (out) (allow-none): Location to store the number of requests
+ * that have been executed successfully, or %NULL.
+ * @error: Location to store error information, if any.
+ *
+ * Executes all requests in @requests in order, as if
+ * inf_adopted_algorithm_execute_request() was called for each of them. This
+ * is more efficient when many requests arrive at once, for example when a
+ * connection has been stalled for a while: the
+ * #InfAdoptedAlgorithm::can-undo-changed and
+ * #InfAdoptedAlgorithm::can-redo-changed signals are only emitted once at
+ * the end, instead of being re-evaluated after every request. Note that
+ * this also means that inf_adopted_algorithm_can_undo() and
+ * inf_adopted_algorithm_can_redo() might return outdated values for local
+ * users while the requests are being executed.
+ *
+ * The function does not call inf_adopted_algorithm_cleanup(); call it once
+ * after the batch has been executed.
+ *
+ * If one of the requests fails to execute, the function returns %FALSE,
+ * @error is set and the remaining requests are not executed. @n_executed
+ * can be used to find out which request failed.
+ *
+ * Returns: %TRUE if all requests were executed successfully, or %FALSE on
+ * error.
+ */
+gboolean
+inf_adopted_algorithm_execute_requests(InfAdoptedAlgorithm* algorithm,
+                                       InfAdoptedRequest** requests,
+                                       guint n_requests,
+                                       gboolean apply,
+                                       guint* n_executed,
+                                       GError** error)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  gboolean result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), FALSE);
+  g_return_val_if_fail(requests != NULL || n_requests == 0, FALSE);
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  /* not re-entrant */
+  g_return_val_if_fail(priv->in_batch == FALSE, FALSE);
+  priv->in_batch = TRUE;
+
+  result = TRUE;
+  for(i = 0; i < n_requests; ++i)
+  {
+    result = inf_adopted_algorithm_execute_request(
+      algorithm,
+      requests[i],
+      apply,
+      error
+    );
+
+    if(result == FALSE)
+      break;
+  }
+
+  priv->in_batch = FALSE;
+  if(priv->undo_redo_pending)
+  {
+    priv->undo_redo_pending = FALSE;
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
+
+  if(n_executed != NULL)
+    *n_executed = i;
+
+  return result;
+}
+
 /**
  * inf_adopted_algorithm_cleanup:
  * @algorithm: A #InfAdoptedAlgorithm.
@@ -2061,8 +2491,7 @@ void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedStateVector* temp;
-  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector lcp;
   InfAdoptedUser** user;
   InfAdoptedRequestLog* log;
   InfAdoptedRequest* req;
@@ -2102,23 +2531,15 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
    * are additional conditions. However, in the current case, some requests
    * are just kept a bit longer than necessary, in favor of simplicity. */
 
-  lcp = inf_adopted_state_vector_copy(priv->current);
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  inf_adopted_state_vector_init(&lcp);
+  inf_adopted_state_vector_assign(&lcp, priv->current);
+  for(user = priv->users_begin; user != priv->users_active_end; ++ user)
   {
     if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
-    {
-      temp = inf_adopted_algorithm_least_common_predecessor(
-        algorithm,
-        lcp,
-        inf_adopted_user_get_vector(*user)
-      );
-
-      inf_adopted_state_vector_free(lcp);
-      lcp = temp;
-    }
+      inf_adopted_state_vector_min(&lcp, inf_adopted_user_get_vector(*user));
   }
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  for(user = priv->users_begin; user != priv->users_active_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
     log = inf_adopted_user_get_request_log(*user);
@@ -2138,7 +2559,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
        * the request needs to be available to reach its target vector time. */
       req_before_lcp = inf_adopted_state_vector_causally_before_inc(
         req_vec,
-        lcp,
+        &lcp,
         id
       );
 
@@ -2153,7 +2574,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
         inf_adopted_request_log_get_request(log, n)
       );
 
-      vdiff = inf_adopted_state_vector_vdiff(low_vec, lcp);
+      vdiff = inf_adopted_state_vector_vdiff(low_vec, &lcp);
 
       /* TODO: Again, I experimentally changed <= to < here. If the vdiff is
        * equal to the log size, then nobody can do anything with the request
@@ -2166,13 +2587,29 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
         break;
 
       /* Check next set of related requests */
-      n = inf_adopted_state_vector_get(req_vec, id) + 1;
+      n = inf_adopted_request_get_index(req) + 1;
     }
 
     inf_adopted_request_log_remove_requests(log, n);
   }
 
-  inf_adopted_state_vector_free(lcp);
+  /* Move users that have nothing left in their request log and are not
+   * going to issue new requests out of the active part of the array */
+  user = priv->users_begin;
+  while(user != priv->users_active_end)
+  {
+    if(inf_adopted_algorithm_user_is_idle(*user))
+    {
+      --priv->users_active_end;
+      inf_adopted_algorithm_swap_users(user, priv->users_active_end);
+    }
+    else
+    {
+      ++user;
+    }
+  }
+
+  inf_adopted_state_vector_clear(&lcp);
 }
 
 /**
@@ -2257,4 +2694,32 @@ inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
   }
 }
 
+/**
+ * inf_adopted_algorithm_get_statistics:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @n_executed: (out) (allow-none): Location to store the number of executed
+ * requests, or %NULL.
+ * @n_untranslated: (out) (allow-none): Location to store the number of
+ * executed requests that did not need to be translated, or %NULL.
+ *
+ * Returns how many requests inf_adopted_algorithm_execute_request() has
+ * executed since @algorithm was created, and how many of them had been made
+ * at the current state, so that they could be applied without any
+ * transformation. The difference is the number of requests that had
+ * concurrent requests, or that were undo or redo requests.
+ */
+void
+inf_adopted_algorithm_get_statistics(InfAdoptedAlgorithm* algorithm,
+                                     guint* n_executed,
+                                     guint* n_untranslated)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm));
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  if(n_executed != NULL) *n_executed = priv->n_executed;
+  if(n_untranslated != NULL) *n_untranslated = priv->n_untranslated;
+}
+
 /* vim:set et sw=2 ts=2: */
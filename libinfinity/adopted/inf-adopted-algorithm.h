@@ -137,12 +137,25 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
                                         InfAdoptedRequest* request,
                                         InfAdoptedStateVector* to);
 
+gboolean
+inf_adopted_algorithm_prepare_request(InfAdoptedAlgorithm* algorithm,
+                                      InfAdoptedRequest* request,
+                                      guint max_steps);
+
 gboolean
 inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
                                       InfAdoptedRequest* request,
                                       gboolean apply,
                                       GError** error);
 
+gboolean
+inf_adopted_algorithm_execute_requests(InfAdoptedAlgorithm* algorithm,
+                                       InfAdoptedRequest** requests,
+                                       guint n_requests,
+                                       gboolean apply,
+                                       guint* n_executed,
+                                       GError** error);
+
 void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm);
 
@@ -154,6 +167,11 @@ gboolean
 inf_adopted_algorithm_can_redo(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user);
 
+void
+inf_adopted_algorithm_get_statistics(InfAdoptedAlgorithm* algorithm,
+                                     guint* n_executed,
+                                     guint* n_untranslated);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_ALGORITHM_H__ */
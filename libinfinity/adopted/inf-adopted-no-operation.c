@@ -110,6 +110,7 @@ inf_adopted_no_operation_operation_iface_init(
   iface->apply = inf_adopted_no_operation_apply;
   iface->apply_transformed = NULL;
   iface->revert = inf_adopted_no_operation_revert;
+  iface->get_size = NULL;
 }
 
 /**
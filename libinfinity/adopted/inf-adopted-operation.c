@@ -144,6 +144,12 @@ inf_adopted_operation_need_concurrency_id(InfAdoptedOperation* operation,
  * Usually, this is derived from the user IDs of the users who issued the two
  * conflicting operations.
  *
+ * If inf_adopted_operation_get_range() shows that @operation only depends on
+ * positions in the buffer before the ones that @against depends on, then the
+ * transformation leaves @operation unchanged, and @operation itself is
+ * returned with its reference count increased, without calling the
+ * transform virtual function.
+ *
  * Returns: (transfer full) (allow-none): The transformed
  * #InfAdoptedOperation, or %NULL if the transformation failed.
  **/
@@ -155,10 +161,25 @@ inf_adopted_operation_transform(InfAdoptedOperation* operation,
                                 InfAdoptedConcurrencyId concurrency_id)
 {
   InfAdoptedOperationInterface* iface;
+  guint begin;
+  guint end;
+  guint against_begin;
+  guint against_end;
 
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(against), NULL);
 
+  /* Most concurrent edits are far apart in the document. If operation lies
+   * entirely before against, against does not change it, so avoid creating
+   * an identical copy of it. */
+  if(inf_adopted_operation_get_range(operation, &begin, &end) &&
+     inf_adopted_operation_get_range(against, &against_begin, &against_end) &&
+     end < against_begin)
+  {
+    g_object_ref(operation);
+    return operation;
+  }
+
   /* Transform against both parts of split operation if we are transforming
    * against split operation. */
   if(INF_ADOPTED_IS_SPLIT_OPERATION(against))
@@ -409,4 +430,68 @@ inf_adopted_operation_revert(InfAdoptedOperation* operation)
   return (*iface->revert)(operation);
 }
 
+/**
+ * inf_adopted_operation_get_size:
+ * @operation: A #InfAdoptedOperation.
+ *
+ * Returns the number of bytes of content, such as inserted or deleted text,
+ * that @operation holds. This is meant for memory accounting, for example
+ * to bound the size of the transformation cache of #InfAdoptedRequestLog.
+ * It does not include the size of the operation object itself, and it is
+ * zero for operations that do not implement the get_size virtual function.
+ *
+ * Returns: The number of bytes of content in @operation.
+ **/
+gsize
+inf_adopted_operation_get_size(InfAdoptedOperation* operation)
+{
+  InfAdoptedOperationInterface* iface;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), 0);
+
+  iface = INF_ADOPTED_OPERATION_GET_IFACE(operation);
+
+  if(iface->get_size != NULL)
+    return (*iface->get_size)(operation);
+  else
+    return 0;
+}
+
+/**
+ * inf_adopted_operation_get_range:
+ * @operation: A #InfAdoptedOperation.
+ * @begin: (out): Location to store the first position @operation depends on.
+ * @end: (out): Location to store the last position @operation depends on.
+ *
+ * Queries the range of positions in the buffer that @operation depends on.
+ * If this range ends before the range of another operation begins, then
+ * transforming @operation against the other operation leaves @operation
+ * unchanged. For text, this is the position of an insertion, or the
+ * position and the end of a deletion.
+ *
+ * Operations that do not implement the get_range virtual function, such as
+ * #InfAdoptedSplitOperation, return %FALSE, and are always transformed
+ * with the transform virtual function.
+ *
+ * Returns: %TRUE if @begin and @end have been set, or %FALSE otherwise.
+ **/
+gboolean
+inf_adopted_operation_get_range(InfAdoptedOperation* operation,
+                                guint* begin,
+                                guint* end)
+{
+  InfAdoptedOperationInterface* iface;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), FALSE);
+  g_return_val_if_fail(begin != NULL, FALSE);
+  g_return_val_if_fail(end != NULL, FALSE);
+
+  iface = INF_ADOPTED_OPERATION_GET_IFACE(operation);
+
+  if(iface->get_range != NULL)
+    return (*iface->get_range)(operation, begin, end);
+  else
+    return FALSE;
+}
+
 /* vim:set et sw=2 ts=2: */
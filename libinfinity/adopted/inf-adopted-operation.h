@@ -96,6 +96,13 @@ typedef enum _InfAdoptedOperationFlags {
  * effect of the operation. If @get_flags does never return the
  * %INF_ADOPTED_OPERATION_REVERSIBLE flag set, then this is allowed to be
  * %NULL.
+ * @get_size: Virtual function that returns the number of bytes of content,
+ * such as text, that the operation holds. The implementation of this
+ * function is optional; operations without it count as zero bytes.
+ * @get_range: Virtual function that stores the first and the last position
+ * in the buffer that the operation depends on in @begin and @end, and
+ * returns %TRUE, or returns %FALSE if it cannot tell. The implementation of
+ * this function is optional, see inf_adopted_operation_get_range().
  *
  * The virtual methods that need to be implemented by an operation to be used
  * with #InfAdoptedAlgorithm.
@@ -130,6 +137,12 @@ struct _InfAdoptedOperationInterface {
                                             GError** error);
 
   InfAdoptedOperation* (*revert)(InfAdoptedOperation* operation);
+
+  gsize (*get_size)(InfAdoptedOperation* operation);
+
+  gboolean (*get_range)(InfAdoptedOperation* operation,
+                        guint* begin,
+                        guint* end);
 };
 
 /**
@@ -184,6 +197,14 @@ inf_adopted_operation_is_reversible(InfAdoptedOperation* operation);
 InfAdoptedOperation*
 inf_adopted_operation_revert(InfAdoptedOperation* operation);
 
+gsize
+inf_adopted_operation_get_size(InfAdoptedOperation* operation);
+
+gboolean
+inf_adopted_operation_get_range(InfAdoptedOperation* operation,
+                                guint* begin,
+                                guint* end);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_OPERATION_H__ */
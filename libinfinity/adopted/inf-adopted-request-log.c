@@ -38,41 +38,69 @@
 
 #include <libinfinity/adopted/inf-adopted-request-log.h>
 
-#include <string.h> /* For (g_)memmove */
-
-typedef struct _InfAdoptedRequestLogCleanupCacheData
-  InfAdoptedRequestLogCleanupCacheData;
-struct _InfAdoptedRequestLogCleanupCacheData {
-  guint user_id;
-  guint up_to;
-  GSList* requests_to_remove;
+#include <string.h> /* For memmove */
+
+/* The transformation cache is a hash table keyed by the state vector of the
+ * cached request. Every entry is also linked into a queue ordered by last
+ * use, so that the least recently used entries can be dropped once the cache
+ * grows beyond its size limit. Since all requests in a request log belong
+ * to the same user, the vector alone identifies the request. */
+typedef struct _InfAdoptedRequestLogCacheEntry InfAdoptedRequestLogCacheEntry;
+struct _InfAdoptedRequestLogCacheEntry {
+  InfAdoptedRequest* request;
+  GList link; /* in priv->cache_queue, most recently used first */
+  gsize size; /* see inf_adopted_operation_get_size() */
 };
 
+/* Links between entries are stored as distances between request indices
+ * instead of as pointers, which makes an entry a third smaller. Original,
+ * previous associated and lower related requests always come before the
+ * entry, and next associated and upper related requests after it. A
+ * distance of 0 refers to the entry itself, or to no entry at all for the
+ * associated requests. */
 typedef struct _InfAdoptedRequestLogEntry InfAdoptedRequestLogEntry;
 struct _InfAdoptedRequestLogEntry {
   InfAdoptedRequest* request;
-  InfAdoptedRequestLogEntry* original;
+  guint index; /* same as the request's index, cached */
 
-  InfAdoptedRequestLogEntry* next_associated;
-  InfAdoptedRequestLogEntry* prev_associated;
+  guint32 original;
+  guint32 next_associated;
+  guint32 prev_associated;
 
-  InfAdoptedRequestLogEntry* lower_related;
-  InfAdoptedRequestLogEntry* upper_related;
+  guint32 lower_related;
+  guint32 upper_related;
 };
 
+/* The entries are stored in blocks of INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE
+ * entries each. New blocks are appended when the log grows, and blocks are
+ * freed from the front when old requests are removed, so entries never move
+ * in memory and the pointers between them stay valid. Only the (much
+ * smaller) array of block pointers is ever reallocated or moved.
+ * Since entries in different blocks are not contiguous, entries need to be
+ * compared and iterated by request index, not by pointer. */
 typedef struct _InfAdoptedRequestLogPrivate InfAdoptedRequestLogPrivate;
 struct _InfAdoptedRequestLogPrivate {
   guint user_id;
-  InfAdoptedRequestLogEntry* entries;
-  GTree* cache;
+  InfAdoptedRequestLogEntry** blocks;
+  guint n_blocks;
+  guint alloc_blocks;
+
+  GHashTable* cache;
+  GQueue cache_queue;
+  guint cache_size;
+  gsize cache_bytes;
+  guint cache_max_bytes;
+  guint cache_hits;
+  guint cache_misses;
 
   InfAdoptedRequestLogEntry* next_undo;
   InfAdoptedRequestLogEntry* next_redo;
 
-  gsize offset;
+  gsize bytes; /* content size of the requests in the log */
+
+  gsize offset; /* position of the begin entry within the first block */
   guint begin;
   guint end;
-  gsize alloc;
 };
 
 enum {
@@ -85,7 +113,10 @@ enum {
   PROP_END,
 
   PROP_NEXT_UNDO,
-  PROP_NEXT_REDO
+  PROP_NEXT_REDO,
+
+  PROP_CACHE_SIZE,
+  PROP_CACHE_MAX_BYTES
 };
 
 enum {
@@ -97,51 +128,194 @@ enum {
 #define INF_ADOPTED_REQUEST_LOG_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_REQUEST_LOG, InfAdoptedRequestLogPrivate))
 #define INF_ADOPTED_REQUEST_LOG_PRIVATE(obj)     ((InfAdoptedRequestLogPrivate*)(obj)->priv)
 
-static const guint INF_ADOPTED_REQUEST_LOG_INC = 0x80;
+#define INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE 0x80
+#define INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE 4096
+#define INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_MAX_BYTES (16 << 20)
 static guint request_log_signals[LAST_SIGNAL];
 
+/* Content size of the cached requests of all request logs, and its limit,
+ * see inf_adopted_request_log_set_global_cache_max_bytes(). */
+static gsize inf_adopted_request_log_global_cache_bytes = 0;
+static gsize inf_adopted_request_log_global_cache_max_bytes = G_MAXSIZE;
+
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedRequestLog, inf_adopted_request_log, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedRequestLog))
 
+/* Returns the entry for the request with index n, which must be in the log,
+ * or be priv->end if room for it has been reserved with
+ * inf_adopted_request_log_reserve_entry(). */
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_get_entry(InfAdoptedRequestLogPrivate* priv,
+                                  guint n)
+{
+  gsize position;
+
+  g_assert(n >= priv->begin && n <= priv->end);
+
+  position = priv->offset + (n - priv->begin);
+  return priv->blocks[position / INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE] +
+    position % INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE;
+}
+
+static guint
+inf_adopted_request_log_entry_index(InfAdoptedRequestLogEntry* entry)
+{
+  return entry->index;
+}
+
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_entry_original(InfAdoptedRequestLogPrivate* priv,
+                                       InfAdoptedRequestLogEntry* entry)
+{
+  return inf_adopted_request_log_get_entry(
+    priv,
+    entry->index - entry->original
+  );
+}
+
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_entry_next_associated(
+  InfAdoptedRequestLogPrivate* priv,
+  InfAdoptedRequestLogEntry* entry)
+{
+  if(entry->next_associated == 0) return NULL;
+
+  return inf_adopted_request_log_get_entry(
+    priv,
+    entry->index + entry->next_associated
+  );
+}
+
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_entry_prev_associated(
+  InfAdoptedRequestLogPrivate* priv,
+  InfAdoptedRequestLogEntry* entry)
+{
+  if(entry->prev_associated == 0) return NULL;
+
+  return inf_adopted_request_log_get_entry(
+    priv,
+    entry->index - entry->prev_associated
+  );
+}
+
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_entry_lower_related(InfAdoptedRequestLogPrivate* priv,
+                                            InfAdoptedRequestLogEntry* entry)
+{
+  return inf_adopted_request_log_get_entry(
+    priv,
+    entry->index - entry->lower_related
+  );
+}
+
+static InfAdoptedRequestLogEntry*
+inf_adopted_request_log_entry_upper_related(InfAdoptedRequestLogPrivate* priv,
+                                            InfAdoptedRequestLogEntry* entry)
+{
+  return inf_adopted_request_log_get_entry(
+    priv,
+    entry->index + entry->upper_related
+  );
+}
+
+/* Makes sure there is room for the entry with index priv->end */
+static void
+inf_adopted_request_log_reserve_entry(InfAdoptedRequestLogPrivate* priv)
+{
+  gsize position;
+
+  position = priv->offset + (priv->end - priv->begin);
+  if(position == priv->n_blocks * INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE)
+  {
+    if(priv->n_blocks == priv->alloc_blocks)
+    {
+      priv->alloc_blocks = MAX(priv->alloc_blocks * 2, 4);
+      priv->blocks = g_renew(
+        InfAdoptedRequestLogEntry*,
+        priv->blocks,
+        priv->alloc_blocks
+      );
+    }
+
+    priv->blocks[priv->n_blocks] = g_new(
+      InfAdoptedRequestLogEntry,
+      INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE
+    );
+
+    ++priv->n_blocks;
+  }
+}
+
+/* Frees the blocks in front of priv->offset, which are no longer in use */
+static void
+inf_adopted_request_log_release_blocks(InfAdoptedRequestLogPrivate* priv)
+{
+  guint n_free;
+  guint i;
+
+  n_free = priv->offset / INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE;
+  if(n_free > 0)
+  {
+    for(i = 0; i < n_free; ++i)
+      g_free(priv->blocks[i]);
+
+    memmove(
+      priv->blocks,
+      priv->blocks + n_free,
+      (priv->n_blocks - n_free) * sizeof(InfAdoptedRequestLogEntry*)
+    );
+
+    priv->n_blocks -= n_free;
+    priv->offset -= n_free * INF_ADOPTED_REQUEST_LOG_BLOCK_SIZE;
+  }
+}
+
 #ifdef INF_ADOPTED_REQUEST_LOG_CHECK_RELATED
 static void
 inf_adopted_request_log_verify_related(InfAdoptedRequestLog* log)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedRequestLogEntry* begin;
-  InfAdoptedRequestLogEntry* end;
   InfAdoptedRequestLogEntry* current;
+  guint n;
 
   InfAdoptedRequestLogEntry* lower_related;
   InfAdoptedRequestLogEntry* upper_related;
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  begin = priv->entries + priv->offset;
-  end = begin + (priv->end - priv->begin);
-
   lower_related = NULL;
   upper_related = NULL;
-  for(current = begin; current != end; ++current)
+  for(n = priv->begin; n != priv->end; ++n)
   {
+    current = inf_adopted_request_log_get_entry(priv, n);
+    g_assert(current->index == n);
+
     g_assert( (lower_related == NULL && upper_related == NULL) ||
               (lower_related != NULL && upper_related != NULL));
 
     if(lower_related == NULL)
     {
-      g_assert(current->lower_related == current);
-      g_assert(current->upper_related >= current);
+      g_assert(current->lower_related == 0);
 
-      if(current->upper_related > current)
+      if(current->upper_related != 0)
       {
-        lower_related = current->lower_related;
-        upper_related = current->upper_related;
+        lower_related = current;
+        upper_related =
+          inf_adopted_request_log_entry_upper_related(priv, current);
       }
     }
     else
     {
-      g_assert(current->lower_related == lower_related);
-      g_assert(current->upper_related == upper_related);
+      g_assert(
+        inf_adopted_request_log_entry_lower_related(priv, current) ==
+        lower_related
+      );
+
+      g_assert(
+        inf_adopted_request_log_entry_upper_related(priv, current) ==
+        upper_related
+      );
 
       if(current == upper_related)
       {
@@ -155,67 +329,88 @@ inf_adopted_request_log_verify_related(InfAdoptedRequestLog* log)
 # define inf_adopted_request_log_verify_related(log)
 #endif
 
+/* Returns the content size of request's operation, which is zero for undo
+ * and redo requests since they do not hold an operation. */
+static gsize
+inf_adopted_request_log_request_size(InfAdoptedRequest* request)
+{
+  if(inf_adopted_request_get_request_type(request) != INF_ADOPTED_REQUEST_DO)
+    return 0;
+
+  return inf_adopted_operation_get_size(
+    inf_adopted_request_get_operation(request)
+  );
+}
+
 /*
  * Transformation cache
  */
 
-static int
-inf_adopted_request_log_cache_key_cmp(gconstpointer a,
-                                      gconstpointer b,
-                                      gpointer user_data)
+static guint
+inf_adopted_request_log_cache_hash(gconstpointer key)
 {
-  InfAdoptedRequestLog* log;
-  InfAdoptedRequestLogPrivate* priv;
-  const InfAdoptedStateVector* key_a;
-  const InfAdoptedStateVector* key_b;
-  guint n_a, n_b;
+  return inf_adopted_state_vector_hash((const InfAdoptedStateVector*)key);
+}
 
-  key_a = (const InfAdoptedStateVector*)a;
-  key_b = (const InfAdoptedStateVector*)b;
+static gboolean
+inf_adopted_request_log_cache_equal(gconstpointer a,
+                                    gconstpointer b)
+{
+  return inf_adopted_state_vector_compare(
+    (const InfAdoptedStateVector*)a,
+    (const InfAdoptedStateVector*)b
+  ) == 0;
+}
 
-  log = (InfAdoptedRequestLog*)user_data;
-  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+static void
+inf_adopted_request_log_cache_remove(InfAdoptedRequestLogPrivate* priv,
+                                     InfAdoptedRequestLogCacheEntry* entry)
+{
+  g_queue_unlink(&priv->cache_queue, &entry->link);
 
-  /* Primary, order by component of user ID -- this makes cleanup very
-   * efficient. */
-  n_a = inf_adopted_state_vector_get(key_a, priv->user_id);
-  n_b = inf_adopted_state_vector_get(key_b, priv->user_id);
+  priv->cache_bytes -= entry->size;
+  inf_adopted_request_log_global_cache_bytes -= entry->size;
 
-  if(n_a < n_b)
-    return -1;
-  if(n_a > n_b)
-    return 1;
+  g_hash_table_remove(
+    priv->cache,
+    inf_adopted_request_get_vector(entry->request)
+  );
 
-  /* If user ID component is equal, go by other components. */
-  return inf_adopted_state_vector_compare(key_a, key_b);
+  g_object_unref(entry->request);
+  g_slice_free(InfAdoptedRequestLogCacheEntry, entry);
 }
 
-static gboolean
-inf_adopted_request_log_remove_requests_cache_foreach_func(gpointer key,
-                                                           gpointer value,
-                                                           gpointer user_data)
+/* Drops the least recently used entries until the cache holds at most
+ * max_size entries, and until both the cache's and the global content size
+ * are within their limits. Since only this log's entries can be dropped
+ * here, the global limit can be exceeded by the caches of other logs until
+ * they add a request the next time. */
+static void
+inf_adopted_request_log_cache_trim(InfAdoptedRequestLogPrivate* priv,
+                                   guint max_size)
 {
-  InfAdoptedStateVector* vector;
-  InfAdoptedRequestLogCleanupCacheData* data;
-
-  vector = (InfAdoptedStateVector*)key;
-  data = (InfAdoptedRequestLogCleanupCacheData*)user_data;
-
-  /* Remove all requests which are a cached translation of one of the requests
-   * that have been removed, i.e. have a user component smaller than up_to. */
-  if(inf_adopted_state_vector_get(vector, data->user_id) < data->up_to)
+  while(priv->cache_queue.length > max_size ||
+        (priv->cache_queue.length > 0 &&
+         (priv->cache_bytes > priv->cache_max_bytes ||
+          inf_adopted_request_log_global_cache_bytes >
+            inf_adopted_request_log_global_cache_max_bytes)))
   {
-    data->requests_to_remove =
-      g_slist_prepend(data->requests_to_remove, vector);
-    return FALSE;
+    inf_adopted_request_log_cache_remove(
+      priv,
+      (InfAdoptedRequestLogCacheEntry*)priv->cache_queue.tail->data
+    );
   }
-  else
+}
+
+static void
+inf_adopted_request_log_cache_clear(InfAdoptedRequestLogPrivate* priv)
+{
+  inf_adopted_request_log_cache_trim(priv, 0);
+
+  if(priv->cache != NULL)
   {
-    /* Stop traversal. The tree is traversed in sorted order, and the primary
-     * sort criteria of the tree is the vector component of the user. So if
-     * we have reached this point, all other elements in the tree will have
-     * a higher user component and are not scheduled for removal. */
-    return TRUE;
+    g_hash_table_destroy(priv->cache);
+    priv->cache = NULL;
   }
 }
 
@@ -231,15 +426,18 @@ inf_adopted_request_log_find_associated(InfAdoptedRequestLog* log,
 {
   InfAdoptedRequestLogPrivate* priv;
   InfAdoptedRequestLogEntry* entry;
+  guint n;
 
   g_assert(type != INF_ADOPTED_REQUEST_DO);
   
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  entry = priv->entries + priv->offset + (priv->end - priv->begin) - 1;
+  n = priv->end;
 
-  while(entry >= priv->entries + priv->offset)
+  while(n > priv->begin)
   {
+    entry = inf_adopted_request_log_get_entry(priv, n - 1);
+
     switch(inf_adopted_request_get_request_type(entry->request))
     {
     case INF_ADOPTED_REQUEST_DO:
@@ -251,8 +449,8 @@ inf_adopted_request_log_find_associated(InfAdoptedRequestLog* log,
     case INF_ADOPTED_REQUEST_UNDO:
       if(type == INF_ADOPTED_REQUEST_UNDO)
       {
-        g_assert(entry->prev_associated != NULL);
-        entry = entry->prev_associated - 1;
+        g_assert(entry->prev_associated != 0);
+        n = entry->index - entry->prev_associated;
       }
       else
       {
@@ -263,8 +461,8 @@ inf_adopted_request_log_find_associated(InfAdoptedRequestLog* log,
     case INF_ADOPTED_REQUEST_REDO:
       if(type == INF_ADOPTED_REQUEST_REDO)
       {
-        g_assert(entry->prev_associated != NULL);
-        entry = entry->prev_associated - 1;
+        g_assert(entry->prev_associated != 0);
+        n = entry->index - entry->prev_associated;
       }
       else
       {
@@ -294,15 +492,24 @@ inf_adopted_request_log_init(InfAdoptedRequestLog* log)
 
   priv->user_id = 0;
 
-  priv->alloc = INF_ADOPTED_REQUEST_LOG_INC;
-  priv->entries = g_malloc(priv->alloc * sizeof(InfAdoptedRequestLogEntry));
+  priv->blocks = NULL;
+  priv->n_blocks = 0;
+  priv->alloc_blocks = 0;
+
   priv->cache = NULL;
+  g_queue_init(&priv->cache_queue);
+  priv->cache_size = INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE;
+  priv->cache_bytes = 0;
+  priv->cache_max_bytes = INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_MAX_BYTES;
+  priv->cache_hits = 0;
+  priv->cache_misses = 0;
   priv->begin = 0;
   priv->end = 0;
   priv->offset = 0;
 
   priv->next_undo = NULL;
   priv->next_redo = NULL;
+  priv->bytes = 0;
 }
 
 static void
@@ -310,19 +517,22 @@ inf_adopted_request_log_dispose(GObject* object)
 {
   InfAdoptedRequestLog* log;
   InfAdoptedRequestLogPrivate* priv;
-  guint i;
+  guint n;
 
   log = INF_ADOPTED_REQUEST_LOG(object);
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  if(priv->cache != NULL)
+  inf_adopted_request_log_cache_clear(priv);
+
+  for(n = priv->begin; n < priv->end; ++n)
   {
-    g_tree_destroy(priv->cache);
-    priv->cache = NULL;
+    g_object_unref(
+      G_OBJECT(inf_adopted_request_log_get_entry(priv, n)->request)
+    );
   }
 
-  for(i = priv->offset; i < priv->offset + (priv->end - priv->begin); ++ i)
-    g_object_unref(G_OBJECT(priv->entries[i].request));
+  priv->next_undo = NULL;
+  priv->next_redo = NULL;
 
   priv->begin = 0;
   priv->end = 0;
@@ -336,11 +546,14 @@ inf_adopted_request_log_finalize(GObject* object)
 {
   InfAdoptedRequestLog* log;
   InfAdoptedRequestLogPrivate* priv;
+  guint i;
 
   log = INF_ADOPTED_REQUEST_LOG(object);
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  g_free(priv->entries);
+  for(i = 0; i < priv->n_blocks; ++i)
+    g_free(priv->blocks[i]);
+  g_free(priv->blocks);
 
   G_OBJECT_CLASS(inf_adopted_request_log_parent_class)->finalize(object);
 }
@@ -369,6 +582,14 @@ inf_adopted_request_log_set_property(GObject* object,
     priv->begin = g_value_get_uint(value);
     priv->end = priv->begin;
     break;
+  case PROP_CACHE_SIZE:
+    priv->cache_size = g_value_get_uint(value);
+    inf_adopted_request_log_cache_trim(priv, priv->cache_size);
+    break;
+  case PROP_CACHE_MAX_BYTES:
+    priv->cache_max_bytes = g_value_get_uint(value);
+    inf_adopted_request_log_cache_trim(priv, priv->cache_size);
+    break;
   case PROP_END:
   case PROP_NEXT_UNDO:
   case PROP_NEXT_REDO:
@@ -415,6 +636,12 @@ inf_adopted_request_log_get_property(GObject* object,
     else
       g_value_set_object(value, NULL);
 
+    break;
+  case PROP_CACHE_SIZE:
+    g_value_set_uint(value, priv->cache_size);
+    break;
+  case PROP_CACHE_MAX_BYTES:
+    g_value_set_uint(value, priv->cache_max_bytes);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -422,15 +649,43 @@ inf_adopted_request_log_get_property(GObject* object,
   }
 }
 
+/* Links the new entry for an undo or redo request to the request it
+ * undoes or redoes, and makes all requests inbetween related to it. */
+static void
+inf_adopted_request_log_add_associated(InfAdoptedRequestLogPrivate* priv,
+                                       InfAdoptedRequestLogEntry* entry,
+                                       InfAdoptedRequestLogEntry* prev)
+{
+  InfAdoptedRequestLogEntry* original;
+  InfAdoptedRequestLogEntry* current;
+  guint lower_related;
+  guint n;
+
+  entry->next_associated = 0;
+  entry->prev_associated = entry->index - prev->index;
+  prev->next_associated = entry->index - prev->index;
+
+  original = inf_adopted_request_log_entry_original(priv, prev);
+  entry->original = entry->index - original->index;
+
+  lower_related = original->index - original->lower_related;
+  entry->lower_related = entry->index - lower_related;
+  entry->upper_related = 0;
+
+  for(n = lower_related; n < entry->index; ++n)
+  {
+    current = inf_adopted_request_log_get_entry(priv, n);
+    current->lower_related = n - lower_related;
+    current->upper_related = entry->index - n;
+  }
+}
+
 static void
 inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
                                             InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
   InfAdoptedRequestLogEntry* entry;
-  InfAdoptedRequestLogEntry* old_entries;
-  InfAdoptedRequestLogEntry* current;
-  guint i;
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
@@ -438,115 +693,39 @@ inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
 
   g_assert(
     priv->begin == priv->end ||
-    inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    ) == priv->end
+    inf_adopted_request_get_index(request) == priv->end
   );
 
-  if(priv->offset + (priv->end - priv->begin) == priv->alloc)
-  {
-    if(priv->offset > 0)
-    {
-      g_memmove(
-        priv->entries,
-        priv->entries + priv->offset,
-        (priv->end - priv->begin) * sizeof(InfAdoptedRequestLogEntry)
-      );
-
-      /* We now corrupted several pointers in our entries because of
-       * moving memory around. */
-      for(i = 0; i < priv->end - priv->begin; ++ i)
-      {
-        g_assert(priv->entries[i].original != NULL);
-        priv->entries[i].original -= priv->offset;
-
-        if(priv->entries[i].next_associated != NULL)
-          priv->entries[i].next_associated -= priv->offset;
-        if(priv->entries[i].prev_associated != NULL)
-          priv->entries[i].prev_associated -= priv->offset;
-        priv->entries[i].lower_related -= priv->offset;
-        priv->entries[i].upper_related -= priv->offset;
-      }
-
-      if(priv->next_undo != NULL) priv->next_undo -= priv->offset;
-      if(priv->next_redo != NULL) priv->next_redo -= priv->offset;
-
-      priv->offset = 0;
-    }
-    else
-    {
-      old_entries = priv->entries;
-      priv->alloc += INF_ADOPTED_REQUEST_LOG_INC;
-
-      priv->entries = g_realloc(
-        priv->entries,
-        priv->alloc * sizeof(InfAdoptedRequestLogEntry)
-      );
-
-      if(priv->entries != old_entries)
-      {
-        /* The realloc above could have invalidated several pointers */
-        for(i = 0; i < priv->end - priv->begin; ++ i)
-        {
-          g_assert(priv->entries[i].original != NULL);
-          priv->entries[i].original =
-            priv->entries + (priv->entries[i].original - old_entries);
-
-          if(priv->entries[i].next_associated != NULL)
-          {
-            priv->entries[i].next_associated = priv->entries +
-              (priv->entries[i].next_associated - old_entries);
-          }
-
-          if(priv->entries[i].prev_associated != NULL)
-          {
-            priv->entries[i].prev_associated = priv->entries +
-              (priv->entries[i].prev_associated - old_entries);
-          }
-
-          priv->entries[i].lower_related = priv->entries +
-            (priv->entries[i].lower_related - old_entries);
-          priv->entries[i].upper_related = priv->entries +
-            (priv->entries[i].upper_related - old_entries);
-        }
-
-        if(priv->next_undo != NULL)
-          priv->next_undo = priv->entries + (priv->next_undo - old_entries);
-        if(priv->next_redo != NULL)
-          priv->next_redo = priv->entries + (priv->next_redo - old_entries);
-      }
-    }
-  }
+  inf_adopted_request_log_reserve_entry(priv);
 
   g_object_freeze_notify(G_OBJECT(log));
 
   if(priv->begin == priv->end)
   {
-    priv->begin = inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    );
+    priv->begin = inf_adopted_request_get_index(request);
 
     priv->end = priv->begin;
   }
 
-  entry = &priv->entries[priv->offset + (priv->end - priv->begin)];
+  entry = inf_adopted_request_log_get_entry(priv, priv->end);
   ++ priv->end;
 
   g_object_notify(G_OBJECT(log), "end");
 
   entry->request = request;
+  entry->index = priv->end - 1;
   g_object_ref(G_OBJECT(request));
 
+  priv->bytes += inf_adopted_request_log_request_size(request);
+
   switch(inf_adopted_request_get_request_type(request))
   {
   case INF_ADOPTED_REQUEST_DO:
-    entry->original = entry;
-    entry->next_associated = NULL;
-    entry->prev_associated = NULL;
-    entry->lower_related = entry;
-    entry->upper_related = entry;
+    entry->original = 0;
+    entry->next_associated = 0;
+    entry->prev_associated = 0;
+    entry->lower_related = 0;
+    entry->upper_related = 0;
     priv->next_undo = entry;
     g_object_notify(G_OBJECT(log), "next-undo");
 
@@ -560,19 +739,7 @@ inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
   case INF_ADOPTED_REQUEST_UNDO:
     g_assert(priv->next_undo != NULL);
 
-    entry->next_associated = NULL;
-    entry->prev_associated = priv->next_undo;
-
-    entry->prev_associated->next_associated = entry;
-    entry->original = entry->prev_associated->original;
-
-    entry->lower_related = entry->original->lower_related;
-    entry->upper_related = entry;
-    for(current = entry->lower_related; current != entry; ++current)
-    {
-      current->lower_related = entry->lower_related;
-      current->upper_related = entry;
-    }
+    inf_adopted_request_log_add_associated(priv, entry, priv->next_undo);
 
     priv->next_undo =
       inf_adopted_request_log_find_associated(log, INF_ADOPTED_REQUEST_UNDO);
@@ -591,19 +758,7 @@ inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
   case INF_ADOPTED_REQUEST_REDO:
     g_assert(priv->next_redo != NULL);
 
-    entry->next_associated = NULL;
-    entry->prev_associated = priv->next_redo;
-
-    entry->prev_associated->next_associated = entry;
-    entry->original = entry->prev_associated->original;
-
-    entry->lower_related = entry->original->lower_related;
-    entry->upper_related = entry;
-    for(current = entry->lower_related; current != entry; ++current)
-    {
-      current->lower_related = entry->lower_related;
-      current->upper_related = entry;
-    }
+    inf_adopted_request_log_add_associated(priv, entry, priv->next_redo);
 
     priv->next_undo = entry;
     g_object_notify(G_OBJECT(log), "next-undo");
@@ -706,6 +861,34 @@ inf_adopted_request_log_class_init(
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_CACHE_SIZE,
+    g_param_spec_uint(
+      "cache-size",
+      "Cache size",
+      "The maximum number of translated requests kept in the cache",
+      0,
+      G_MAXUINT,
+      INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_CACHE_MAX_BYTES,
+    g_param_spec_uint(
+      "cache-max-bytes",
+      "Cache maximum bytes",
+      "The maximum content size of the translated requests in the cache",
+      0,
+      G_MAXUINT,
+      INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_MAX_BYTES,
+      G_PARAM_READWRITE
+    )
+  );
+
   /**
    * InfAdoptedRequestLog::add-request:
    * @log: The #InfAdoptedRequestLog to which a new request is added.
@@ -891,7 +1074,7 @@ inf_adopted_request_log_get_request(InfAdoptedRequestLog* log,
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
   g_return_val_if_fail(n >= priv->begin && n < priv->end, NULL);
 
-  return priv->entries[priv->offset + n - priv->begin].request;
+  return inf_adopted_request_log_get_entry(priv, n)->request;
 }
 
 /**
@@ -919,10 +1102,7 @@ inf_adopted_request_log_add_request(InfAdoptedRequestLog* log,
 
   g_return_if_fail(
     priv->begin == priv->end ||
-    inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    ) == priv->end
+    inf_adopted_request_get_index(request) == priv->end
   );
 
   g_signal_emit(G_OBJECT(log), request_log_signals[ADD_REQUEST], 0, request);
@@ -943,9 +1123,11 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
                                         guint up_to)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedRequestLogCleanupCacheData data;
-  guint i;
-  GSList* item;
+  InfAdoptedRequestLogEntry* entry;
+  InfAdoptedRequestLogCacheEntry* cache_entry;
+  GList* item;
+  GList* next;
+  guint n;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
 
@@ -953,14 +1135,11 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
 
   g_return_if_fail(up_to >= priv->begin && up_to <= priv->end);
 
-  g_return_if_fail(
-    up_to == priv->begin ||
-    priv->entries[priv->offset + up_to - priv->begin - 1].upper_related ==
-    &priv->entries[priv->offset + up_to - priv->begin - 1]
-  );
-
-  for(i = priv->offset; i < priv->offset + (up_to - priv->begin); ++i)
-    g_object_unref(G_OBJECT(priv->entries[i].request));
+  if(up_to > priv->begin)
+  {
+    entry = inf_adopted_request_log_get_entry(priv, up_to - 1);
+    g_return_if_fail(entry->upper_related == 0);
+  }
 
   g_object_freeze_notify(G_OBJECT(log));
 
@@ -969,7 +1148,7 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
    * newest one in the log */
   if(priv->next_undo != NULL)
   {
-    if(priv->next_undo < priv->entries + priv->offset + (up_to - priv->begin))
+    if(inf_adopted_request_log_entry_index(priv->next_undo) < up_to)
     {
       priv->next_undo = NULL;
       g_object_notify(G_OBJECT(log), "next-undo");
@@ -978,32 +1157,41 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
 
   if(priv->next_redo != NULL)
   {
-    if(priv->next_redo < priv->entries + priv->offset + (up_to - priv->begin))
+    if(inf_adopted_request_log_entry_index(priv->next_redo) < up_to)
     {
       priv->next_redo = NULL;
       g_object_notify(G_OBJECT(log), "next-redo");
     }
   }
 
+  for(n = priv->begin; n < up_to; ++n)
+  {
+    entry = inf_adopted_request_log_get_entry(priv, n);
+    priv->bytes -= inf_adopted_request_log_request_size(entry->request);
+    g_object_unref(G_OBJECT(entry->request));
+  }
+
   priv->offset += (up_to - priv->begin);
   priv->begin = up_to;
+  inf_adopted_request_log_release_blocks(priv);
   g_object_notify(G_OBJECT(log), "begin");
 
-  if(priv->cache != NULL)
+  /* Remove all requests which are a cached translation of one of the
+   * requests that have been removed, i.e. have a user component smaller
+   * than up_to. The cache is bounded in size, so this does not take
+   * long. */
+  for(item = priv->cache_queue.head; item != NULL; item = next)
   {
-    data.user_id = priv->user_id;
-    data.up_to = up_to;
-    data.requests_to_remove = NULL;
-
-    g_tree_foreach(
-      priv->cache,
-      inf_adopted_request_log_remove_requests_cache_foreach_func,
-      &data
+    next = item->next;
+    cache_entry = (InfAdoptedRequestLogCacheEntry*)item->data;
+
+    n = inf_adopted_state_vector_get(
+      inf_adopted_request_get_vector(cache_entry->request),
+      priv->user_id
     );
-    
-    for(item = data.requests_to_remove; item != NULL; item = item->next)
-      g_tree_remove(priv->cache, (InfAdoptedStateVector*)item->data);
-    g_slist_free(data.requests_to_remove);
+
+    if(n < up_to)
+      inf_adopted_request_log_cache_remove(priv, cache_entry);
   }
 
   inf_adopted_request_log_verify_related(log);
@@ -1028,7 +1216,6 @@ inf_adopted_request_log_next_associated(InfAdoptedRequestLog* log,
                                         InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1037,16 +1224,19 @@ inf_adopted_request_log_next_associated(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n < priv->end, NULL);
 
-  entry =  priv->entries + priv->offset + n - priv->begin;
-  if(entry->next_associated == NULL) return NULL;
-  return entry->next_associated->request;
+  entry = inf_adopted_request_log_entry_next_associated(
+    priv,
+    inf_adopted_request_log_get_entry(priv, n)
+  );
+
+  if(entry == NULL) return NULL;
+  return entry->request;
 }
 
 /**
@@ -1071,7 +1261,6 @@ inf_adopted_request_log_prev_associated(InfAdoptedRequestLog* log,
                                         InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1080,9 +1269,8 @@ inf_adopted_request_log_prev_associated(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n <= priv->end, NULL);
@@ -1112,9 +1300,13 @@ inf_adopted_request_log_prev_associated(InfAdoptedRequestLog* log,
   }
   else
   {
-    entry =  priv->entries + priv->offset + n - priv->begin;
-    if(entry->prev_associated == NULL) return NULL;
-    return entry->prev_associated->request;
+    entry = inf_adopted_request_log_entry_prev_associated(
+      priv,
+      inf_adopted_request_log_get_entry(priv, n)
+    );
+
+    if(entry == NULL) return NULL;
+    return entry->request;
   }
 }
 
@@ -1140,7 +1332,6 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
                                          InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1149,9 +1340,8 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n <= priv->end, NULL);
@@ -1175,7 +1365,7 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
     }
 
     if(entry != NULL)
-      return entry->original->request;
+      return inf_adopted_request_log_entry_original(priv, entry)->request;
     else
       return request;
   }
@@ -1190,9 +1380,8 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
     if(inf_adopted_request_get_request_type(request) == INF_ADOPTED_REQUEST_DO)
       return request;
 
-    entry = priv->entries + priv->offset + n - priv->begin;
-    g_assert(entry->original != NULL);
-    return entry->original->request;
+    entry = inf_adopted_request_log_get_entry(priv, n);
+    return inf_adopted_request_log_entry_original(priv, entry)->request;
   }
 }
 
@@ -1272,8 +1461,8 @@ inf_adopted_request_log_upper_related(InfAdoptedRequestLog* log,
 
   inf_adopted_request_log_verify_related(log);
 
-  current = priv->entries + priv->offset + n - priv->begin;
-  return current->upper_related->request;
+  current = inf_adopted_request_log_get_entry(priv, n);
+  return inf_adopted_request_log_entry_upper_related(priv, current)->request;
 }
 
 /**
@@ -1306,8 +1495,8 @@ inf_adopted_request_log_lower_related(InfAdoptedRequestLog* log,
 
   inf_adopted_request_log_verify_related(log);
 
-  current = priv->entries + priv->offset + n - priv->begin;
-  return current->lower_related->request;
+  current = inf_adopted_request_log_get_entry(priv, n);
+  return inf_adopted_request_log_entry_lower_related(priv, current)->request;
 }
 
 /**
@@ -1322,9 +1511,12 @@ inf_adopted_request_log_lower_related(InfAdoptedRequestLog* log,
  * requests are removed from the log the cache is automatically updated
  * accordingly.
  *
- * The data structure of the cache is optimized for quick lookup of entries
- * by the state vector and cleaning up entries in an efficient manner also
- * when the cache has grown very big.
+ * The cache is a hash table indexed by the state vector of the cached
+ * requests. It holds at most #InfAdoptedRequestLog:cache-size requests,
+ * whose operations hold at most #InfAdoptedRequestLog:cache-max-bytes of
+ * content as reported by inf_adopted_operation_get_size(). When it is full,
+ * the least recently used requests are dropped from it. See also
+ * inf_adopted_request_log_set_global_cache_max_bytes().
  *
  * The request cache is mainly used by #InfAdoptedAlgorithm to efficiently
  * handle big transformations.
@@ -1337,6 +1529,7 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
                                            InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
   InfAdoptedStateVector* vector;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
@@ -1345,26 +1538,37 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
   g_return_if_fail(inf_adopted_request_get_user_id(request) == priv->user_id);
 
+  if(priv->cache_size == 0)
+    return;
+
   vector = inf_adopted_request_get_vector(request);
 
   if(priv->cache == NULL)
   {
-    priv->cache = g_tree_new_full(
-      inf_adopted_request_log_cache_key_cmp,
-      log,
-      NULL,
-      g_object_unref
+    priv->cache = g_hash_table_new(
+      inf_adopted_request_log_cache_hash,
+      inf_adopted_request_log_cache_equal
     );
   }
 
-  g_return_if_fail(g_tree_lookup(priv->cache, vector) == NULL);
+  g_return_if_fail(g_hash_table_lookup(priv->cache, vector) == NULL);
 
-  g_tree_insert(priv->cache, vector, request);
+  entry = g_slice_new(InfAdoptedRequestLogCacheEntry);
+  entry->request = request;
+  entry->link.data = entry;
+  entry->link.prev = NULL;
+  entry->link.next = NULL;
   g_object_ref(request);
 
-  /* Implement lookup_cached_request */
-  /* Use this implementation in InfAdoptedAlgorithm */
-  /* Make the performance tests */
+  entry->size = inf_adopted_request_log_request_size(request);
+  priv->cache_bytes += entry->size;
+  inf_adopted_request_log_global_cache_bytes += entry->size;
+
+  /* The vector is owned by the request, which the entry keeps alive */
+  g_hash_table_insert(priv->cache, vector, entry);
+  g_queue_push_head_link(&priv->cache_queue, &entry->link);
+
+  inf_adopted_request_log_cache_trim(priv, priv->cache_size);
 }
 
 /**
@@ -1386,14 +1590,149 @@ inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec)
 {
   InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), NULL);
   g_return_val_if_fail(vec != NULL, NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  if(priv->cache == NULL) return NULL;
 
-  return INF_ADOPTED_REQUEST(g_tree_lookup(priv->cache, vec));
+  entry = NULL;
+  if(priv->cache != NULL)
+    entry = g_hash_table_lookup(priv->cache, vec);
+
+  if(entry == NULL)
+  {
+    ++priv->cache_misses;
+    return NULL;
+  }
+
+  ++priv->cache_hits;
+
+  /* Mark as most recently used */
+  g_queue_unlink(&priv->cache_queue, &entry->link);
+  g_queue_push_head_link(&priv->cache_queue, &entry->link);
+
+  return entry->request;
+}
+
+/**
+ * inf_adopted_request_log_has_cached_request:
+ * @log: A #InfAdoptedRequestLog.
+ * @vec: The state vector at which to look up the request.
+ *
+ * Returns whether the cache of the request log contains a request at @vec.
+ * Unlike inf_adopted_request_log_lookup_cached_request(), this does not
+ * count as a cache hit or miss and does not mark the request as recently
+ * used. It can be used to check whether a request can be added with
+ * inf_adopted_request_log_add_cached_request().
+ *
+ * Returns: Whether a request at @vec is cached.
+ */
+gboolean
+inf_adopted_request_log_has_cached_request(InfAdoptedRequestLog* log,
+                                           InfAdoptedStateVector* vec)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), FALSE);
+  g_return_val_if_fail(vec != NULL, FALSE);
+
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+  if(priv->cache == NULL)
+    return FALSE;
+
+  return g_hash_table_lookup(priv->cache, vec) != NULL;
+}
+
+/**
+ * inf_adopted_request_log_get_cache_statistics:
+ * @log: A #InfAdoptedRequestLog.
+ * @hits: (out) (allow-none): Location to store the number of cache hits,
+ * or %NULL.
+ * @misses: (out) (allow-none): Location to store the number of cache misses,
+ * or %NULL.
+ *
+ * Returns how many calls to inf_adopted_request_log_lookup_cached_request()
+ * found a request in the cache, and how many did not, since @log was
+ * created. This can be used to tune #InfAdoptedRequestLog:cache-size.
+ */
+void
+inf_adopted_request_log_get_cache_statistics(InfAdoptedRequestLog* log,
+                                             guint* hits,
+                                             guint* misses)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  if(hits != NULL) *hits = priv->cache_hits;
+  if(misses != NULL) *misses = priv->cache_misses;
+}
+
+/**
+ * inf_adopted_request_log_get_memory_usage:
+ * @log: A #InfAdoptedRequestLog.
+ * @log_bytes: (out) (allow-none): Location to store the content size of the
+ * requests in @log, or %NULL.
+ * @cache_bytes: (out) (allow-none): Location to store the content size of
+ * the cached requests, or %NULL.
+ *
+ * Returns how many bytes of content, as reported by
+ * inf_adopted_operation_get_size(), the requests in @log and in its
+ * transformation cache hold. Operations referenced by both count twice,
+ * and the request objects themselves are not included, so the values are
+ * an estimate that is mainly meant to find out which logs use a lot of
+ * memory.
+ */
+void
+inf_adopted_request_log_get_memory_usage(InfAdoptedRequestLog* log,
+                                         gsize* log_bytes,
+                                         gsize* cache_bytes)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  if(log_bytes != NULL) *log_bytes = priv->bytes;
+  if(cache_bytes != NULL) *cache_bytes = priv->cache_bytes;
+}
+
+/**
+ * inf_adopted_request_log_set_global_cache_max_bytes:
+ * @max_bytes: The maximum content size of all request caches together.
+ *
+ * Limits the content size of the cached requests of all
+ * #InfAdoptedRequestLog<!-- -->s in the process together, in addition to
+ * the #InfAdoptedRequestLog:cache-max-bytes limit of each request log.
+ * When the limit is exceeded, a request log drops the least recently used
+ * requests from its cache the next time a request is added to it. The
+ * default is %G_MAXSIZE, meaning no global limit.
+ *
+ * A server which hosts many sessions can use this to bound the memory used
+ * by the caches of all of them.
+ */
+void
+inf_adopted_request_log_set_global_cache_max_bytes(gsize max_bytes)
+{
+  inf_adopted_request_log_global_cache_max_bytes = max_bytes;
+}
+
+/**
+ * inf_adopted_request_log_get_global_cache_bytes:
+ *
+ * Returns the content size of the cached requests of all
+ * #InfAdoptedRequestLog<!-- -->s in the process, as reported by
+ * inf_adopted_operation_get_size().
+ *
+ * Returns: The number of bytes of content in all request caches.
+ */
+gsize
+inf_adopted_request_log_get_global_cache_bytes(void)
+{
+  return inf_adopted_request_log_global_cache_bytes;
 }
 
 /* vim:set et sw=2 ts=2: */
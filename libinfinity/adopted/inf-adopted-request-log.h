@@ -133,6 +133,26 @@ InfAdoptedRequest*
 inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec);
 
+gboolean
+inf_adopted_request_log_has_cached_request(InfAdoptedRequestLog* log,
+                                           InfAdoptedStateVector* vec);
+
+void
+inf_adopted_request_log_get_cache_statistics(InfAdoptedRequestLog* log,
+                                             guint* hits,
+                                             guint* misses);
+
+void
+inf_adopted_request_log_get_memory_usage(InfAdoptedRequestLog* log,
+                                         gsize* log_bytes,
+                                         gsize* cache_bytes);
+
+void
+inf_adopted_request_log_set_global_cache_max_bytes(gsize max_bytes);
+
+gsize
+inf_adopted_request_log_get_global_cache_bytes(void);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_REQUEST_LOG_H__ */
@@ -63,6 +63,7 @@ struct _InfAdoptedRequestPrivate {
   InfAdoptedRequestType type;
   InfAdoptedStateVector* vector;
   guint user_id;
+  guint index; /* vector[user_id], cached since it is required often */
   InfAdoptedOperation* operation;
   gint64 received;
   gint64 executed;
@@ -99,12 +100,27 @@ inf_adopted_request_init(InfAdoptedRequest* request)
   priv->type = INF_ADOPTED_REQUEST_DO;
   priv->vector = NULL;
   priv->user_id = 0;
+  priv->index = 0;
   priv->operation = NULL;
 
   priv->received = 0;
   priv->executed = 0;
 }
 
+static void
+inf_adopted_request_constructed(GObject* object)
+{
+  InfAdoptedRequestPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
+
+  G_OBJECT_CLASS(inf_adopted_request_parent_class)->constructed(object);
+
+  /* Only set if the request was constructed via properties. Requests
+   * created by inf_adopted_request_new_internal() set the index there. */
+  if(priv->vector != NULL)
+    priv->index = inf_adopted_state_vector_get(priv->vector, priv->user_id);
+}
+
 static void
 inf_adopted_request_dispose(GObject* object)
 {
@@ -225,6 +241,7 @@ inf_adopted_request_class_init(InfAdoptedRequestClass* request_class)
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(request_class);
 
+  object_class->constructed = inf_adopted_request_constructed;
   object_class->dispose = inf_adopted_request_dispose;
   object_class->finalize = inf_adopted_request_finalize;
   object_class->set_property = inf_adopted_request_set_property;
@@ -310,6 +327,40 @@ inf_adopted_request_class_init(InfAdoptedRequestClass* request_class)
   );
 }
 
+/* Creates a new request and sets its fields directly instead of passing
+ * them as construct properties to g_object_new(). Requests are created for
+ * nearly every step of a transformation, and the property machinery showed
+ * up prominently in profiles. The properties are still available for
+ * bindings. The function takes ownership of vector. */
+static InfAdoptedRequest*
+inf_adopted_request_new_internal(InfAdoptedRequestType type,
+                                 InfAdoptedStateVector* vector,
+                                 guint user_id,
+                                 InfAdoptedOperation* operation,
+                                 gint64 received,
+                                 gint64 executed)
+{
+  InfAdoptedRequest* request;
+  InfAdoptedRequestPrivate* priv;
+
+  g_assert(user_id != 0); /* 0 is invalid ID */
+
+  request = INF_ADOPTED_REQUEST(g_object_new(INF_ADOPTED_TYPE_REQUEST, NULL));
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  priv->type = type;
+  priv->vector = vector;
+  priv->user_id = user_id;
+  priv->index = inf_adopted_state_vector_get(vector, user_id);
+  priv->received = received;
+  priv->executed = executed;
+
+  if(operation != NULL)
+    priv->operation = g_object_ref(operation);
+
+  return request;
+}
+
 /**
  * inf_adopted_request_new_do: (constructor)
  * @vector: The vector time at which the request was made.
@@ -327,23 +378,18 @@ inf_adopted_request_new_do(InfAdoptedStateVector* vector,
                            InfAdoptedOperation* operation,
                            gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_DO,
-    "vector", vector,
-    "user-id", user_id,
-    "operation", operation,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    operation,
+    received,
+    0
   );
-
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -364,21 +410,17 @@ inf_adopted_request_new_undo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_UNDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_UNDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -399,21 +441,17 @@ inf_adopted_request_new_redo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-  
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_REDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_REDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -428,39 +466,18 @@ InfAdoptedRequest*
 inf_adopted_request_copy(InfAdoptedRequest* request)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
-  GObject* object;
-  
+
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "operation", priv->operation,
-      "received", priv->received,
-      NULL
-    );
-  }
-  else
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "received", priv->received,
-      NULL
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
-  new_priv->executed = priv->executed;
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_internal(
+    priv->type,
+    inf_adopted_state_vector_copy(priv->vector),
+    priv->user_id,
+    priv->type == INF_ADOPTED_REQUEST_DO ? priv->operation : NULL,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -541,19 +558,17 @@ inf_adopted_request_get_operation(InfAdoptedRequest* request)
  * @request: A #InfAdoptedRequest.
  *
  * Returns the vector time component of the request's own users. This
- * corresponds to the request index by that user.
+ * corresponds to the request index by that user. The value is determined
+ * when the request is created, so this function is cheaper than looking
+ * up the component in the request's vector.
  *
  * Returns: The vector time component of the request's own user.
  */
 guint
 inf_adopted_request_get_index(InfAdoptedRequest* request)
 {
-  InfAdoptedRequestPrivate* priv;
-
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), 0);
-
-  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
-  return inf_adopted_state_vector_get(priv->vector, priv->user_id);
+  return INF_ADOPTED_REQUEST_PRIVATE(request)->index;
 }
 
 /**
@@ -700,7 +715,6 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   InfAdoptedRequestPrivate* against_priv;
   InfAdoptedRequestPrivate* request_lcs_priv;
   InfAdoptedRequestPrivate* against_lcs_priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
   InfAdoptedRequest* new_request;
@@ -794,18 +808,16 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(request_priv->vector);
   inf_adopted_state_vector_add(new_vector, against_priv->user_id, 1);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     request_priv->user_id,
     new_operation,
-    request_priv->received
+    request_priv->received,
+    request_priv->executed
   );
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = request_priv->executed;
-
   g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
   return new_request;
 }
 
@@ -832,7 +844,6 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
                            guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
   InfAdoptedRequest* new_request;
@@ -851,18 +862,16 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, priv->user_id, by);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     priv->user_id,
     new_operation,
-    priv->received
+    priv->received,
+    priv->executed
   );
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
-
   g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
   return new_request;
 }
 
@@ -889,9 +898,7 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
                          guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(into != 0, NULL);
@@ -903,39 +910,14 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, into, by);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "operation", priv->operation,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-  else
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
-
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
+  return inf_adopted_request_new_internal(
+    priv->type,
+    new_vector,
+    priv->user_id,
+    priv->type == INF_ADOPTED_REQUEST_DO ? priv->operation : NULL,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
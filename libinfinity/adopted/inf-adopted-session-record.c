@@ -18,9 +18,7 @@
  */
 
 /* TODO: Better error handling; we should have a proper InfErrnoError
- * (or InfSystemError or something), and we should check the fflush error
- * codes. */
-/* TODO: Or just use GIOChannel here... */
+ * (or InfSystemError or something). */
 
 /**
  * SECTION:inf-adopted-session-record
@@ -39,6 +37,15 @@
  * to make it easy to reproduce bugs in libinfinity. However, it might be
  * extended in the future.
  *
+ * The record is not written to disk immediately for every request. Instead,
+ * it is collected in memory and written by a separate thread at least once
+ * per second, so that recording does not block the main loop.
+ *
+ * If #InfAdoptedSessionRecord:checkpoint-interval is set, then a snapshot
+ * of the complete session state is written into the record every so many
+ * requests, so that inf_adopted_session_replay_seek() can start replaying
+ * from the closest snapshot instead of from the beginning of the record.
+ *
  * To replay a record, use #InfAdoptedSessionReplay or the tool
  * <literal>inf-test-text-replay</literal> in the infinote test suite.
  */
@@ -60,18 +67,41 @@ typedef struct _InfAdoptedSessionRecordPrivate InfAdoptedSessionRecordPrivate;
 struct _InfAdoptedSessionRecordPrivate {
   InfAdoptedSession* session;
   xmlTextWriterPtr writer;
-  FILE* file;
   gchar* filename;
 
+  /* Data written by the writer that has not yet been passed to the thread */
+  GString* pending;
+  InfIoTimeout* flush_timeout;
+
+  /* These are owned by the writer thread while recording */
+  GThread* thread;
+  GAsyncQueue* queue;
+  FILE* file;
+  int write_errno;
+
   GHashTable* last_send_table;
+
+  guint checkpoint_interval;
+  guint n_requests;
 };
 
+/* Pending data is passed to the writer thread when it reaches this size, or
+ * after this many milliseconds. */
+#define INF_ADOPTED_SESSION_RECORD_FLUSH_SIZE 65536
+#define INF_ADOPTED_SESSION_RECORD_FLUSH_INTERVAL 1000
+
+/* Pushed into the queue to make the writer thread exit. */
+static gchar inf_adopted_session_record_stop_marker;
+
 enum {
   PROP_0,
 
   /* construct only */
   PROP_SESSION,
-  PROP_FILENAME
+  PROP_FILENAME,
+
+  /* read/write */
+  PROP_CHECKPOINT_INTERVAL
 };
 
 #define INF_ADOPTED_SESSION_RECORD_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_SESSION_RECORD, InfAdoptedSessionRecordPrivate))
@@ -98,6 +128,117 @@ inf_adopted_session_record_handle_xml_error(InfAdoptedSessionRecord* record)
   );
 }
 
+static int
+inf_adopted_session_record_write_func(void* context,
+                                      const char* buffer,
+                                      int len)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  priv = (InfAdoptedSessionRecordPrivate*)context;
+
+  g_string_append_len(priv->pending, buffer, len);
+  return len;
+}
+
+static gpointer
+inf_adopted_session_record_thread_func(gpointer data)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  gpointer item;
+  GString* chunk;
+  gboolean failed;
+
+  priv = (InfAdoptedSessionRecordPrivate*)data;
+  failed = FALSE;
+
+  while( (item = g_async_queue_pop(priv->queue)) !=
+         &inf_adopted_session_record_stop_marker)
+  {
+    chunk = (GString*)item;
+
+    /* Write each chunk to the disk right away, so that the record is as
+     * complete as possible if the process crashes. */
+    if(!failed)
+    {
+      if(fwrite(chunk->str, 1, chunk->len, priv->file) != chunk->len ||
+         fflush(priv->file) != 0)
+      {
+        priv->write_errno = errno;
+        failed = TRUE;
+      }
+    }
+
+    g_string_free(chunk, TRUE);
+  }
+
+  return NULL;
+}
+
+/* Passes all pending data to the writer thread */
+static void
+inf_adopted_session_record_hand_off(InfAdoptedSessionRecord* record)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+
+  if(priv->flush_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      inf_adopted_session_get_io(priv->session),
+      priv->flush_timeout
+    );
+
+    priv->flush_timeout = NULL;
+  }
+
+  if(priv->pending->len > 0)
+  {
+    g_async_queue_push(priv->queue, priv->pending);
+    priv->pending = g_string_sized_new(INF_ADOPTED_SESSION_RECORD_FLUSH_SIZE);
+  }
+}
+
+static void
+inf_adopted_session_record_flush_timeout_func(gpointer user_data)
+{
+  InfAdoptedSessionRecord* record;
+  InfAdoptedSessionRecordPrivate* priv;
+
+  record = INF_ADOPTED_SESSION_RECORD(user_data);
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+  priv->flush_timeout = NULL;
+
+  inf_adopted_session_record_hand_off(record);
+}
+
+/* Makes sure that everything written so far reaches the disk soon */
+static void
+inf_adopted_session_record_flush(InfAdoptedSessionRecord* record)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  int result;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+
+  result = xmlTextWriterFlush(priv->writer);
+  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
+
+  if(priv->pending->len >= INF_ADOPTED_SESSION_RECORD_FLUSH_SIZE)
+  {
+    inf_adopted_session_record_hand_off(record);
+  }
+  else if(priv->pending->len > 0 && priv->flush_timeout == NULL)
+  {
+    priv->flush_timeout = inf_io_add_timeout(
+      inf_adopted_session_get_io(priv->session),
+      INF_ADOPTED_SESSION_RECORD_FLUSH_INTERVAL,
+      inf_adopted_session_record_flush_timeout_func,
+      record,
+      NULL
+    );
+  }
+}
+
 static void
 inf_adopted_session_record_write_node(InfAdoptedSessionRecord* record,
                                       xmlNodePtr xml)
@@ -140,6 +281,35 @@ inf_adopted_session_record_write_node(InfAdoptedSessionRecord* record,
   if(result < 0) inf_adopted_session_record_handle_xml_error(record);
 }
 
+/* Writes the complete current session state, in the form of a
+ * synchronization, as the children of xml, and then xml into the record. */
+static void
+inf_adopted_session_record_write_state(InfAdoptedSessionRecord* record,
+                                       xmlNodePtr xml)
+{
+  InfAdoptedSessionRecordPrivate* priv;
+  InfSessionClass* session_class;
+  xmlNodePtr child;
+  xmlNodePtr cur;
+  guint total;
+
+  priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
+  session_class = INF_SESSION_GET_CLASS(priv->session);
+
+  /* TODO: Have someone else inserting sync-begin and sync-end... that's quite
+   * hacky here. */
+  child = xmlNewChild(xml, NULL, (const xmlChar*)"sync-begin", NULL);
+  session_class->to_xml_sync(INF_SESSION(priv->session), xml);
+  xmlNewChild(xml, NULL, (const xmlChar*)"sync-end", NULL);
+
+  total = 0;
+  for(cur = child; cur != NULL; cur = cur->next)
+    ++ total;
+  inf_xml_util_set_attribute_uint(child, "num-messages", total - 2);
+
+  inf_adopted_session_record_write_node(record, xml);
+}
+
 static void
 inf_adopted_session_record_user_joined(InfAdoptedSessionRecord* record,
                                        InfAdoptedUser* user)
@@ -165,12 +335,23 @@ inf_adopted_session_record_begin_execute_request_cb(InfAdoptedAlgorithm* algo,
   InfAdoptedSessionClass* session_class;
   InfAdoptedStateVector* previous;
   xmlNodePtr xml;
-  int result;
 
   record = INF_ADOPTED_SESSION_RECORD(user_data);
   priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
   session_class = INF_ADOPTED_SESSION_GET_CLASS(priv->session);
 
+  /* The checkpoint is written before the request, since the request has not
+   * been applied to the session yet. The "requests" attribute needs to come
+   * first, InfAdoptedSessionReplay looks for it without parsing the XML. */
+  if(priv->checkpoint_interval > 0 && priv->n_requests > 0 &&
+     priv->n_requests % priv->checkpoint_interval == 0)
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"checkpoint");
+    inf_xml_util_set_attribute_uint(xml, "requests", priv->n_requests);
+    inf_adopted_session_record_write_state(record, xml);
+    xmlFreeNode(xml);
+  }
+
   xml = xmlNewNode(NULL, (const xmlChar*)"request");
   previous = g_hash_table_lookup(priv->last_send_table, user);
   g_assert(previous != NULL);
@@ -192,9 +373,8 @@ inf_adopted_session_record_begin_execute_request_cb(InfAdoptedAlgorithm* algo,
   inf_adopted_session_record_write_node(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
+  ++priv->n_requests;
 
   /* Update last send entry */
   previous =
@@ -234,9 +414,7 @@ inf_adopted_session_record_add_user_cb(InfUserTable* user_table,
   inf_adopted_session_record_write_node(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
 }
 
 static void
@@ -256,17 +434,11 @@ inf_adopted_session_record_real_start(InfAdoptedSessionRecord* record)
   InfAdoptedAlgorithm* algorithm;
   InfUserTable* user_table;
   xmlNodePtr xml;
-  xmlNodePtr child;
-  xmlNodePtr cur;
   int result;
-  guint total;
-
-  InfSessionClass* session_class;
 
   priv = INF_ADOPTED_SESSION_RECORD_PRIVATE(record);
   algorithm = inf_adopted_session_get_algorithm(priv->session);
   user_table = inf_session_get_user_table(INF_SESSION(priv->session));
-  session_class = INF_SESSION_GET_CLASS(priv->session);
 
   g_signal_connect(
     G_OBJECT(algorithm),
@@ -304,24 +476,13 @@ inf_adopted_session_record_real_start(InfAdoptedSessionRecord* record)
   );
   if(result < 0) inf_adopted_session_record_handle_xml_error(record);
 
-  /* TODO: Have someone else inserting sync-begin and sync-end... that's quite
-   * hacky here. */
-  xml = xmlNewNode(NULL, (const xmlChar*)"initial");
-  child = xmlNewChild(xml, NULL, (const xmlChar*)"sync-begin", NULL);
-  session_class->to_xml_sync(INF_SESSION(priv->session), xml);
-  xmlNewChild(xml, NULL, (const xmlChar*)"sync-end", NULL);
-
-  total = 0;
-  for(cur = child; cur != NULL; cur = cur->next)
-    ++ total;
-  inf_xml_util_set_attribute_uint(child, "num-messages", total - 2);
+  priv->n_requests = 0;
 
-  inf_adopted_session_record_write_node(record, xml);
+  xml = xmlNewNode(NULL, (const xmlChar*)"initial");
+  inf_adopted_session_record_write_state(record, xml);
   xmlFreeNode(xml);
 
-  result = xmlTextWriterFlush(priv->writer);
-  if(result < 0) inf_adopted_session_record_handle_xml_error(record);
-  fflush(priv->file);
+  inf_adopted_session_record_flush(record);
 }
 
 static void
@@ -353,9 +514,20 @@ inf_adopted_session_record_init(InfAdoptedSessionRecord* record)
 
   priv->session = NULL;
   priv->writer = NULL;
-  priv->file = NULL;
   priv->filename = NULL;
+
+  priv->pending = NULL;
+  priv->flush_timeout = NULL;
+
+  priv->thread = NULL;
+  priv->queue = NULL;
+  priv->file = NULL;
+  priv->write_errno = 0;
+
   priv->last_send_table = NULL;
+
+  priv->checkpoint_interval = 0;
+  priv->n_requests = 0;
 }
 
 static void
@@ -428,6 +600,9 @@ inf_adopted_session_record_set_property(GObject* object,
     g_assert(priv->session == NULL); /* construct only */
     priv->session = INF_ADOPTED_SESSION(g_value_dup_object(value));
     break;
+  case PROP_CHECKPOINT_INTERVAL:
+    priv->checkpoint_interval = g_value_get_uint(value);
+    break;
   case PROP_FILENAME:
     /* read only */
   default:
@@ -456,6 +631,9 @@ inf_adopted_session_record_get_property(GObject* object,
   case PROP_FILENAME:
     g_value_set_string(value, priv->filename);
     break;
+  case PROP_CHECKPOINT_INTERVAL:
+    g_value_set_uint(value, priv->checkpoint_interval);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -504,6 +682,21 @@ inf_adopted_session_record_class_init(
       G_PARAM_READABLE
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_CHECKPOINT_INTERVAL,
+    g_param_spec_uint(
+      "checkpoint-interval",
+      "Checkpoint interval",
+      "The number of requests after which to write a snapshot of the "
+      "session into the record, or 0 to write no snapshots",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 /*
@@ -584,7 +777,15 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
     return FALSE;
   }
 
-  buffer = xmlOutputBufferCreateFile(priv->file, NULL);
+  /* The writer only writes into memory. The data is then passed to a
+   * separate thread which writes it into the file. */
+  buffer = xmlOutputBufferCreateIO(
+    inf_adopted_session_record_write_func,
+    NULL,
+    priv,
+    NULL
+  );
+
   if(buffer == NULL)
   {
     fclose(priv->file);
@@ -605,8 +806,8 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
   priv->writer = xmlNewTextWriter(buffer);
   if(priv->writer == NULL)
   {
-    /* TODO: Does this also fclose our file? */
     xmlOutputBufferClose(buffer);
+    fclose(priv->file);
     priv->file = NULL;
 
     xmlerror = xmlGetLastError();
@@ -621,6 +822,32 @@ inf_adopted_session_record_start_recording(InfAdoptedSessionRecord* record,
     return FALSE;
   }
 
+  priv->pending = g_string_sized_new(INF_ADOPTED_SESSION_RECORD_FLUSH_SIZE);
+  priv->queue = g_async_queue_new();
+  priv->write_errno = 0;
+
+  priv->thread = g_thread_try_new(
+    "InfAdoptedSessionRecord",
+    inf_adopted_session_record_thread_func,
+    priv,
+    error
+  );
+
+  if(priv->thread == NULL)
+  {
+    xmlFreeTextWriter(priv->writer);
+    priv->writer = NULL;
+
+    g_string_free(priv->pending, TRUE);
+    priv->pending = NULL;
+    g_async_queue_unref(priv->queue);
+    priv->queue = NULL;
+
+    fclose(priv->file);
+    priv->file = NULL;
+    return FALSE;
+  }
+
   xmlTextWriterSetIndent(priv->writer, 1);
 
   switch(status)
@@ -728,15 +955,39 @@ inf_adopted_session_record_stop_recording(InfAdoptedSessionRecord* record,
       xmlerror->code,
       xmlerror->message
     );
-
-    return FALSE;
   }
 
-  /* TODO: Does this fclose our file? */
+  /* This writes the remaining data into priv->pending */
   xmlFreeTextWriter(priv->writer);
   priv->writer = NULL;
+
+  /* Wait for the writer thread to write everything */
+  inf_adopted_session_record_hand_off(record);
+  g_async_queue_push(priv->queue, &inf_adopted_session_record_stop_marker);
+  g_thread_join(priv->thread);
+  priv->thread = NULL;
+
+  g_async_queue_unref(priv->queue);
+  priv->queue = NULL;
+  g_string_free(priv->pending, TRUE);
+  priv->pending = NULL;
+
+  if(fclose(priv->file) != 0 && priv->write_errno == 0)
+    priv->write_errno = errno;
   priv->file = NULL;
 
+  if(priv->write_errno != 0 && result >= 0)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("ERRNO_ERROR"),
+      priv->write_errno,
+      strerror(priv->write_errno)
+    );
+
+    result = -1;
+  }
+
   g_free(priv->filename);
   priv->filename = NULL;
 
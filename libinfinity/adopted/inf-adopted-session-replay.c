@@ -33,6 +33,11 @@
  * Use inf_adopted_session_replay_set_record() to specify the recording to
  * replay, and then use inf_adopted_session_replay_get_session() to obtain
  * the replayed session.
+ *
+ * If the record contains checkpoints, which #InfAdoptedSessionRecord writes
+ * when #InfAdoptedSessionRecord:checkpoint-interval is set, then
+ * inf_adopted_session_replay_seek() can be used to jump to a position in the
+ * record without playing all requests before it.
  */
 
 #include <libinfinity/adopted/inf-adopted-session-replay.h>
@@ -43,6 +48,8 @@
 
 #include <libxml/xmlreader.h>
 
+#include <stdio.h>
+#include <errno.h>
 #include <string.h>
 
 /* cf.
@@ -53,12 +60,40 @@
 #define XML_READER_TYPE_SIGNIFICANT_WHITESPACE 14
 #define XML_READER_TYPE_END_ELEMENT 15
 
+/* A checkpoint in the record, at which the complete session state after
+ * the given number of requests is stored. */
+typedef struct _InfAdoptedSessionReplayCheckpoint
+  InfAdoptedSessionReplayCheckpoint;
+struct _InfAdoptedSessionReplayCheckpoint {
+  guint position;
+  goffset offset;
+};
+
+/* Reads the record from a checkpoint on. The XML reader is given the root
+ * element first, so that the rest of the file is a well-formed document. */
+typedef struct _InfAdoptedSessionReplayStream InfAdoptedSessionReplayStream;
+struct _InfAdoptedSessionReplayStream {
+  FILE* file;
+  gsize prefix_pos;
+};
+
+static const char inf_adopted_session_replay_stream_prefix[] =
+  "<infinote-adopted-session-record>";
+
+static const char inf_adopted_session_replay_checkpoint_tag[] =
+  "<checkpoint requests=\"";
+
 typedef struct _InfAdoptedSessionReplayPrivate InfAdoptedSessionReplayPrivate;
 struct _InfAdoptedSessionReplayPrivate {
   gchar* filename;
   xmlTextReaderPtr reader;
   GError* error;
 
+  InfcNotePlugin plugin;
+  guint position;
+  /* Only looked up at the first seek */
+  GArray* checkpoints;
+
   InfCommunicationManager* publisher_manager;
   InfCommunicationHostedGroup* publisher_group;
   InfSimulatedConnection* publisher_conn;
@@ -253,6 +288,14 @@ inf_adopted_session_replay_clear(InfAdoptedSessionReplay* replay)
     g_object_notify(G_OBJECT(replay), "filename");
   }
 
+  if(priv->checkpoints != NULL)
+  {
+    g_array_free(priv->checkpoints, TRUE);
+    priv->checkpoints = NULL;
+  }
+
+  priv->position = 0;
+
   if(priv->reader != NULL)
   {
     if(xmlTextReaderClose(priv->reader) == -1)
@@ -326,9 +369,12 @@ inf_adopted_session_replay_synchronization_failed_cb(InfSession* session,
   priv->error = g_error_copy(error);
 }
 
+/* Plays the session state in the element called state_name, which is
+ * either the initial or a checkpoint. */
 static gboolean
 inf_adopted_session_replay_play_initial(InfAdoptedSessionReplay* replay,
                                         const InfcNotePlugin* plugin,
+                                        const gchar* state_name,
                                         GError** error)
 {
   InfAdoptedSessionReplayPrivate* priv;
@@ -382,14 +428,26 @@ inf_adopted_session_replay_play_initial(InfAdoptedSessionReplay* replay,
     return FALSE;
 
   name = xmlTextReaderConstName(reader);
-  if(strcmp((const char*)name, "initial") != 0)
+  if(strcmp((const char*)name, state_name) != 0)
   {
-    g_set_error_literal(
-      error,
-      session_replay_error_quark,
-      INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FORMAT,
-      _("Initial session state missing in recording")
-    );
+    if(strcmp(state_name, "initial") == 0)
+    {
+      g_set_error_literal(
+        error,
+        session_replay_error_quark,
+        INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FORMAT,
+        _("Initial session state missing in recording")
+      );
+    }
+    else
+    {
+      g_set_error_literal(
+        error,
+        session_replay_error_quark,
+        INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FORMAT,
+        _("Session state missing at checkpoint in recording")
+      );
+    }
 
     return FALSE;
   }
@@ -513,6 +571,297 @@ inf_adopted_session_replay_play_initial(InfAdoptedSessionReplay* replay,
   return TRUE;
 }
 
+static int
+inf_adopted_session_replay_stream_read(void* context,
+                                       char* buffer,
+                                       int len)
+{
+  InfAdoptedSessionReplayStream* stream;
+  gsize prefix_len;
+  gsize n;
+
+  stream = (InfAdoptedSessionReplayStream*)context;
+  prefix_len = sizeof(inf_adopted_session_replay_stream_prefix) - 1;
+
+  if(stream->prefix_pos < prefix_len)
+  {
+    n = MIN((gsize)len, prefix_len - stream->prefix_pos);
+    memcpy(
+      buffer,
+      inf_adopted_session_replay_stream_prefix + stream->prefix_pos,
+      n
+    );
+
+    stream->prefix_pos += n;
+    return n;
+  }
+
+  n = fread(buffer, 1, len, stream->file);
+  if(n == 0 && ferror(stream->file))
+    return -1;
+
+  return n;
+}
+
+static int
+inf_adopted_session_replay_stream_close(void* context)
+{
+  InfAdoptedSessionReplayStream* stream;
+  stream = (InfAdoptedSessionReplayStream*)context;
+
+  fclose(stream->file);
+  g_slice_free(InfAdoptedSessionReplayStream, stream);
+  return 0;
+}
+
+/* Creates a reader for the record in filename. If checkpoint is not NULL,
+ * then the reader starts at that checkpoint instead of at the beginning of
+ * the file. */
+static xmlTextReaderPtr
+inf_adopted_session_replay_open(
+  const gchar* filename,
+  const InfAdoptedSessionReplayCheckpoint* checkpoint,
+  GError** error)
+{
+  InfAdoptedSessionReplayStream* stream;
+  xmlTextReaderPtr reader;
+  xmlErrorPtr xml_error;
+  FILE* file;
+  int errcode;
+
+  if(checkpoint == NULL)
+  {
+    reader = xmlReaderForFile(
+      filename,
+      NULL,
+      XML_PARSE_NOERROR | XML_PARSE_NOWARNING
+    );
+  }
+  else
+  {
+    file = fopen(filename, "r");
+    if(file == NULL || fseek(file, checkpoint->offset, SEEK_SET) != 0)
+    {
+      errcode = errno;
+      if(file != NULL) fclose(file);
+
+      g_set_error_literal(
+        error,
+        session_replay_error_quark,
+        INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FILE,
+        strerror(errcode)
+      );
+
+      return NULL;
+    }
+
+    stream = g_slice_new(InfAdoptedSessionReplayStream);
+    stream->file = file;
+    stream->prefix_pos = 0;
+
+    /* This closes the stream also if it fails */
+    reader = xmlReaderForIO(
+      inf_adopted_session_replay_stream_read,
+      inf_adopted_session_replay_stream_close,
+      stream,
+      filename,
+      NULL,
+      XML_PARSE_NOERROR | XML_PARSE_NOWARNING
+    );
+  }
+
+  if(!reader)
+  {
+    xml_error = xmlGetLastError();
+
+    g_set_error_literal(
+      error,
+      session_replay_error_quark,
+      INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FILE,
+      xml_error->message
+    );
+
+    return NULL;
+  }
+
+  return reader;
+}
+
+/* Finds all checkpoints in the record file. This only looks for the
+ * checkpoint start tags, without parsing the XML, which is much faster than
+ * reading the whole record. Text content cannot contain the start tag, since
+ * < is always escaped in it. */
+static GArray*
+inf_adopted_session_replay_find_checkpoints(const gchar* filename,
+                                            GError** error)
+{
+  GMappedFile* mapped;
+  GArray* checkpoints;
+  InfAdoptedSessionReplayCheckpoint checkpoint;
+  const gchar* contents;
+  const gchar* end;
+  const gchar* pos;
+  const gchar* digit;
+  gsize tag_len;
+  guint64 position;
+
+  mapped = g_mapped_file_new(filename, FALSE, error);
+  if(mapped == NULL)
+    return NULL;
+
+  checkpoints = g_array_new(
+    FALSE,
+    FALSE,
+    sizeof(InfAdoptedSessionReplayCheckpoint)
+  );
+
+  contents = g_mapped_file_get_contents(mapped);
+  end = contents + g_mapped_file_get_length(mapped);
+  tag_len = sizeof(inf_adopted_session_replay_checkpoint_tag) - 1;
+
+  /* An empty file is not mapped at all */
+  pos = contents;
+  while(pos != NULL && (gsize)(end - pos) > tag_len)
+  {
+    pos = memchr(pos, '<', end - pos - tag_len);
+    if(pos == NULL) break;
+
+    if(memcmp(pos, inf_adopted_session_replay_checkpoint_tag, tag_len) == 0)
+    {
+      position = 0;
+      for(digit = pos + tag_len;
+          digit < end && *digit >= '0' && *digit <= '9' &&
+          position <= G_MAXUINT;
+          ++digit)
+      {
+        position = position * 10 + (*digit - '0');
+      }
+
+      if(digit < end && *digit == '"' && digit > pos + tag_len &&
+         position <= G_MAXUINT)
+      {
+        checkpoint.position = position;
+        checkpoint.offset = pos - contents;
+        g_array_append_val(checkpoints, checkpoint);
+      }
+    }
+
+    ++pos;
+  }
+
+  g_mapped_file_unref(mapped);
+  return checkpoints;
+}
+
+/* Sets up a new session and plays the session state at the position of
+ * reader into it, which is the initial if checkpoint is NULL. */
+static gboolean
+inf_adopted_session_replay_load(
+  InfAdoptedSessionReplay* replay,
+  const gchar* filename,
+  xmlTextReaderPtr reader,
+  const InfcNotePlugin* plugin,
+  const InfAdoptedSessionReplayCheckpoint* checkpoint,
+  GError** error)
+{
+  InfAdoptedSessionReplayPrivate* priv;
+  InfIo* io;
+  gboolean result;
+
+  priv = INF_ADOPTED_SESSION_REPLAY_PRIVATE(replay);
+
+  /* TODO: Keep current staet if playing the initial fails */
+
+  g_object_freeze_notify(G_OBJECT(replay));
+
+  inf_adopted_session_replay_clear(replay);
+
+  priv->filename = g_strdup(filename);
+  priv->reader = reader;
+  priv->plugin = *plugin;
+
+  priv->publisher_conn = inf_simulated_connection_new();
+  priv->client_conn = inf_simulated_connection_new();
+  inf_simulated_connection_connect(priv->publisher_conn, priv->client_conn);
+
+  inf_simulated_connection_set_mode(
+    priv->publisher_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    priv->client_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  priv->publisher_manager = inf_communication_manager_new();
+  priv->publisher_group = inf_communication_manager_open_group(
+    priv->publisher_manager,
+    "InfAdoptedSessionReplay",
+    NULL
+  );
+  inf_communication_hosted_group_add_member(
+    priv->publisher_group,
+    INF_XML_CONNECTION(priv->publisher_conn)
+  );
+
+  priv->client_manager = inf_communication_manager_new();
+  priv->client_group = inf_communication_manager_join_group(
+    priv->client_manager,
+    "InfAdoptedSessionReplay",
+    INF_XML_CONNECTION(priv->client_conn),
+    "central"
+  );
+
+  /* This is not used anyway, but it needs to be present: */
+  io = INF_IO(inf_standalone_io_new());
+
+  priv->session = INF_ADOPTED_SESSION(
+    plugin->session_new(
+      io,
+      priv->client_manager,
+      INF_SESSION_SYNCHRONIZING,
+      INF_COMMUNICATION_GROUP(priv->client_group),
+      INF_XML_CONNECTION(priv->client_conn),
+      NULL,
+      plugin->user_data
+    )
+  );
+
+  g_object_unref(io);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(priv->client_group),
+    INF_COMMUNICATION_OBJECT(priv->session)
+  );
+
+  inf_simulated_connection_flush(priv->publisher_conn);
+  inf_simulated_connection_flush(priv->client_conn);
+
+  if(!inf_adopted_session_replay_play_initial(
+       replay,
+       plugin,
+       checkpoint != NULL ? "checkpoint" : "initial",
+       error))
+  {
+    inf_adopted_session_replay_clear(replay);
+    result = FALSE;
+  }
+  else
+  {
+    g_object_notify(G_OBJECT(replay), "filename");
+    g_object_notify(G_OBJECT(replay), "session");
+
+    if(checkpoint != NULL)
+      priv->position = checkpoint->position;
+    result = TRUE;
+  }
+
+  g_object_thaw_notify(G_OBJECT(replay));
+
+  return result;
+}
+
 /*
  * GObject overrides.
  */
@@ -527,6 +876,9 @@ inf_adopted_session_replay_init(InfAdoptedSessionReplay* replay)
   priv->reader = NULL;
   priv->error = NULL;
 
+  priv->position = 0;
+  priv->checkpoints = NULL;
+
   priv->publisher_manager = NULL;
   priv->publisher_group = NULL;
   priv->publisher_conn = NULL;
@@ -693,6 +1045,10 @@ inf_adopted_session_replay_new(void)
  * #InfAdoptedSessionRecord. @plugin should match the type of the recorded
  * session. If an error occurs, the function returns %FALSE and @error is set.
  *
+ * @plugin is copied, but its note type and user data are used again by
+ * inf_adopted_session_replay_seek(), so they need to stay valid as long as
+ * the record is set.
+ *
  * Returns: %TRUE on success, or %FALSE if the record file could not be set.
  */
 gboolean
@@ -701,121 +1057,25 @@ inf_adopted_session_replay_set_record(InfAdoptedSessionReplay* replay,
                                       const InfcNotePlugin* plugin,
                                       GError** error)
 {
-  InfAdoptedSessionReplayPrivate* priv;
   xmlTextReaderPtr reader;
-  InfIo* io;
-  gboolean result;
-  xmlErrorPtr xml_error;
 
   g_return_val_if_fail(INF_ADOPTED_IS_SESSION_REPLAY(replay), FALSE);
   g_return_val_if_fail(filename != NULL, FALSE);
   g_return_val_if_fail(plugin != NULL, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  priv = INF_ADOPTED_SESSION_REPLAY_PRIVATE(replay);
-
-  reader = xmlReaderForFile(
-    filename,
-    NULL,
-    XML_PARSE_NOERROR | XML_PARSE_NOWARNING
-  );
-
+  reader = inf_adopted_session_replay_open(filename, NULL, error);
   if(!reader)
-  {
-    xml_error = xmlGetLastError();
-
-    g_set_error_literal(
-      error,
-      session_replay_error_quark,
-      INF_ADOPTED_SESSION_REPLAY_ERROR_BAD_FILE,
-      xml_error->message
-    );
-
     return FALSE;
-  }
-
-  /* TODO: Keep current staet if playing the initial fails */
-
-  g_object_freeze_notify(G_OBJECT(replay));
 
-  inf_adopted_session_replay_clear(replay);
-
-  priv->filename = g_strdup(filename);
-  priv->reader = reader;
-
-  priv->publisher_conn = inf_simulated_connection_new();
-  priv->client_conn = inf_simulated_connection_new();
-  inf_simulated_connection_connect(priv->publisher_conn, priv->client_conn);
-
-  inf_simulated_connection_set_mode(
-    priv->publisher_conn,
-    INF_SIMULATED_CONNECTION_DELAYED
-  );
-
-  inf_simulated_connection_set_mode(
-    priv->client_conn,
-    INF_SIMULATED_CONNECTION_DELAYED
-  );
-
-  priv->publisher_manager = inf_communication_manager_new();
-  priv->publisher_group = inf_communication_manager_open_group(
-    priv->publisher_manager,
-    "InfAdoptedSessionReplay",
-    NULL
-  );
-  inf_communication_hosted_group_add_member(
-    priv->publisher_group,
-    INF_XML_CONNECTION(priv->publisher_conn)
-  );
-
-  priv->client_manager = inf_communication_manager_new();
-  priv->client_group = inf_communication_manager_join_group(
-    priv->client_manager,
-    "InfAdoptedSessionReplay",
-    INF_XML_CONNECTION(priv->client_conn),
-    "central"
-  );
-
-  /* This is not used anyway, but it needs to be present: */
-  io = INF_IO(inf_standalone_io_new());
-
-  priv->session = INF_ADOPTED_SESSION(
-    plugin->session_new(
-      io,
-      priv->client_manager,
-      INF_SESSION_SYNCHRONIZING,
-      INF_COMMUNICATION_GROUP(priv->client_group),
-      INF_XML_CONNECTION(priv->client_conn),
-      NULL,
-      plugin->user_data
-    )
-  );
-
-  g_object_unref(io);
-
-  inf_communication_group_set_target(
-    INF_COMMUNICATION_GROUP(priv->client_group),
-    INF_COMMUNICATION_OBJECT(priv->session)
+  return inf_adopted_session_replay_load(
+    replay,
+    filename,
+    reader,
+    plugin,
+    NULL,
+    error
   );
-
-  inf_simulated_connection_flush(priv->publisher_conn);
-  inf_simulated_connection_flush(priv->client_conn);
-
-  if(!inf_adopted_session_replay_play_initial(replay, plugin, error))
-  {
-    inf_adopted_session_replay_clear(replay);
-    result = FALSE;
-  }
-  else
-  {
-    g_object_notify(G_OBJECT(replay), "filename");
-    g_object_notify(G_OBJECT(replay), "session");
-    result = TRUE;
-  }
-
-  g_object_thaw_notify(G_OBJECT(replay));
-
-  return result;
 }
 
 /**
@@ -895,6 +1155,18 @@ inf_adopted_session_replay_play_next(InfAdoptedSessionReplay* replay,
     return FALSE;
   }
 
+  /* Checkpoints are only needed for seeking, the session already has the
+   * state stored in them when playing the record sequentially. */
+  if(strcmp((const char*)xmlTextReaderConstName(reader), "checkpoint") == 0)
+  {
+    if(!inf_adopted_session_replay_advance_subtree_required(reader, error))
+      return FALSE;
+    if(!inf_adopted_session_replay_skip_whitespace(reader, error))
+      return FALSE;
+
+    return inf_adopted_session_replay_play_next(replay, error);
+  }
+
   cur = inf_adopted_session_replay_read_current(reader, error);
   if(cur == NULL) return FALSE;
 
@@ -942,6 +1214,7 @@ inf_adopted_session_replay_play_next(InfAdoptedSessionReplay* replay,
      * error signal for InfCommunicationGroup, delegating
      * inf_net_object_received's error. */
     inf_simulated_connection_flush(priv->publisher_conn);
+    ++priv->position;
   }
   else if(strcmp((const char*)cur->name, "user") == 0)
   {
@@ -1047,4 +1320,156 @@ inf_adopted_session_replay_play_to_end(InfAdoptedSessionReplay* replay,
   return TRUE;
 }
 
+/**
+ * inf_adopted_session_replay_get_position:
+ * @replay: A #InfAdoptedSessionReplay.
+ *
+ * Returns the number of requests of the record that have been played so
+ * far, either with inf_adopted_session_replay_play_next() or by seeking with
+ * inf_adopted_session_replay_seek().
+ *
+ * Returns: The number of requests played.
+ */
+guint
+inf_adopted_session_replay_get_position(InfAdoptedSessionReplay* replay)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION_REPLAY(replay), 0);
+  return INF_ADOPTED_SESSION_REPLAY_PRIVATE(replay)->position;
+}
+
+/**
+ * inf_adopted_session_replay_seek:
+ * @replay: A #InfAdoptedSessionReplay.
+ * @position: The number of requests that should have been played.
+ * @error: Location to store error information, if any.
+ *
+ * Brings the replay's session into the state it had after the first
+ * @position requests of the record have been executed. Instead of playing
+ * all requests from the beginning, this starts from the closest checkpoint
+ * before @position, if the record contains checkpoints, or from the current
+ * position if that is closer. Going backwards always starts over from a
+ * checkpoint or the beginning of the record.
+ *
+ * When the replay starts from a checkpoint, then the session returned by
+ * inf_adopted_session_replay_get_session() is replaced by a new one, which
+ * is notified via the #GObject::notify signal of the
+ * #InfAdoptedSessionReplay:session property.
+ *
+ * If an error occurs, or if the record has less than @position requests,
+ * then the function returns %FALSE and @error is set. In that case the
+ * session may be left at any position, or be unset when starting from a
+ * checkpoint failed.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurs.
+ */
+gboolean
+inf_adopted_session_replay_seek(InfAdoptedSessionReplay* replay,
+                                guint position,
+                                GError** error)
+{
+  InfAdoptedSessionReplayPrivate* priv;
+  InfAdoptedSessionReplayCheckpoint* checkpoint;
+  InfAdoptedSessionReplayCheckpoint* cur;
+  InfcNotePlugin plugin;
+  xmlTextReaderPtr reader;
+  GArray* checkpoints;
+  GError* local_error;
+  gchar* filename;
+  gboolean result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION_REPLAY(replay), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_ADOPTED_SESSION_REPLAY_PRIVATE(replay);
+  g_return_val_if_fail(priv->filename != NULL, FALSE);
+
+  if(priv->checkpoints == NULL)
+  {
+    priv->checkpoints =
+      inf_adopted_session_replay_find_checkpoints(priv->filename, error);
+    if(priv->checkpoints == NULL)
+      return FALSE;
+  }
+
+  /* Checkpoints are written in order, so the last one not after position
+   * is the closest one. */
+  checkpoint = NULL;
+  for(i = 0; i < priv->checkpoints->len; ++i)
+  {
+    cur = &g_array_index(
+      priv->checkpoints,
+      InfAdoptedSessionReplayCheckpoint,
+      i
+    );
+
+    if(cur->position > position) break;
+    checkpoint = cur;
+  }
+
+  if(position < priv->position ||
+     (checkpoint != NULL && checkpoint->position > priv->position))
+  {
+    /* Loading the new session clears these, but the checkpoints stay the
+     * same for the same file. */
+    filename = g_strdup(priv->filename);
+    plugin = priv->plugin;
+    checkpoints = priv->checkpoints;
+    priv->checkpoints = NULL;
+
+    reader = inf_adopted_session_replay_open(filename, checkpoint, error);
+    if(reader == NULL)
+    {
+      result = FALSE;
+    }
+    else
+    {
+      result = inf_adopted_session_replay_load(
+        replay,
+        filename,
+        reader,
+        &plugin,
+        checkpoint,
+        error
+      );
+    }
+
+    g_free(filename);
+
+    if(result == FALSE)
+    {
+      g_array_free(checkpoints, TRUE);
+      return FALSE;
+    }
+
+    priv->checkpoints = checkpoints;
+  }
+
+  while(priv->position < position)
+  {
+    local_error = NULL;
+    if(!inf_adopted_session_replay_play_next(replay, &local_error))
+    {
+      if(local_error != NULL)
+      {
+        g_propagate_error(error, local_error);
+      }
+      else
+      {
+        g_set_error(
+          error,
+          session_replay_error_quark,
+          INF_ADOPTED_SESSION_REPLAY_ERROR_UNEXPECTED_EOF,
+          _("The recording ends after %u requests"),
+          priv->position
+        );
+      }
+
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 /* vim:set et sw=2 ts=2: */
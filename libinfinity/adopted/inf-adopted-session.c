@@ -45,7 +45,6 @@
 #include <libinfinity/inf-signals.h>
 
 #include <string.h>
-#include <time.h>
 
 typedef struct _InfAdoptedSessionToXmlSyncForeachData
   InfAdoptedSessionToXmlSyncForeachData;
@@ -54,11 +53,33 @@ struct _InfAdoptedSessionToXmlSyncForeachData {
   xmlNodePtr parent_xml;
 };
 
+/* Serialized requests of one user's request log, for the requests
+ * from begin to end. Since requests in the log never change, only the
+ * requests added or removed since the previous synchronization need to be
+ * serialized or dropped when the next one happens. */
+typedef struct _InfAdoptedSessionSyncCache InfAdoptedSessionSyncCache;
+struct _InfAdoptedSessionSyncCache {
+  guint begin;
+  guint end;
+  /* <sync-request> children for the requests from begin to end */
+  xmlNodePtr container;
+};
+
+typedef struct _InfAdoptedSessionCanResyncForeachData
+  InfAdoptedSessionCanResyncForeachData;
+struct _InfAdoptedSessionCanResyncForeachData {
+  const InfAdoptedStateVector* vector;
+  gboolean result;
+};
+
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
 struct _InfAdoptedSessionLocalUser {
   InfAdoptedUser* user;
   InfAdoptedStateVector* last_send_vector;
-  time_t noop_time; /* TODO: should be monotonic time */
+  /* Monotonic time since when the user is not up to date anymore, or 0 */
+  gint64 noop_time;
+  /* Number of requests by others executed since noop_time */
+  guint noop_pressure;
 };
 
 typedef struct _InfAdoptedSessionPrivate InfAdoptedSessionPrivate;
@@ -75,6 +96,23 @@ struct _InfAdoptedSessionPrivate {
   InfAdoptedSessionLocalUser* next_noop_user;
   /* Buffer for requests that are not ready to be executed yet */
   GPtrArray* request_buffer;
+
+  /* Outgoing requests made within send_delay milliseconds of the previous
+   * one are deferred until send_timeout elapses. */
+  guint send_delay;
+  InfIoTimeout* send_timeout;
+
+  /* Maximum number of concurrent requests to translate a received request
+   * across within one main loop iteration, or 0 for no limit. */
+  guint translation_budget;
+  /* Received request whose translation is spread over several dispatches,
+   * and requests received after it which wait for it to be executed. */
+  InfAdoptedRequest* translate_request;
+  GQueue held_requests;
+  InfIoDispatch* translate_dispatch;
+
+  /* User ID -> InfAdoptedSessionSyncCache, created on first sync */
+  GHashTable* sync_cache;
 };
 
 enum {
@@ -84,12 +122,17 @@ enum {
   PROP_IO,
   PROP_MAX_TOTAL_LOG_SIZE,
 
+  /* read/write */
+  PROP_SEND_DELAY,
+  PROP_TRANSLATION_BUDGET,
+
   /* read only */
   PROP_ALGORITHM
 };
 
 enum {
   CHECK_REQUEST,
+  CHECK_REQUEST_VECTOR,
 
   LAST_SIGNAL
 };
@@ -101,6 +144,13 @@ static guint session_signals[LAST_SIGNAL];
 static GQuark inf_adopted_session_error_quark;
 /* TODO: This should perhaps be a property: */
 static const int INF_ADOPTED_SESSION_NOOP_INTERVAL = 30;
+/* The noop interval is shortened in this many steps down to the minimum
+ * interval (both in seconds) the more requests have been executed since the
+ * last request we sent. Others can only remove these requests from their
+ * logs once they know that we have processed them. The minimum is reached
+ * when a quarter of max-total-log-size requests is waiting for us. */
+static const int INF_ADOPTED_SESSION_NOOP_MIN_INTERVAL = 1;
+static const int INF_ADOPTED_SESSION_NOOP_LEVELS = 8;
 
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedSession, inf_adopted_session, INF_TYPE_SESSION,
   G_ADD_PRIVATE(InfAdoptedSession))
@@ -135,16 +185,14 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
                                      InfAdoptedRequest* request,
                                      GError** error)
 {
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
 
   guint begin;
   guint end;
 
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
   
   begin = inf_adopted_request_log_get_begin(log);
   end = inf_adopted_request_log_get_end(log);
@@ -283,6 +331,35 @@ inf_adopted_session_noop_timeout_func(gpointer user_data)
   g_object_unref(request);
 }
 
+static guint
+inf_adopted_session_get_noop_level(InfAdoptedSession* session,
+                                   InfAdoptedSessionLocalUser* local)
+{
+  InfAdoptedSessionPrivate* priv;
+  guint threshold;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  threshold = MAX(priv->max_total_log_size / 4, 1);
+
+  return (guint64)MIN(local->noop_pressure, threshold) *
+    INF_ADOPTED_SESSION_NOOP_LEVELS / threshold;
+}
+
+static gint64
+inf_adopted_session_get_noop_deadline(InfAdoptedSession* session,
+                                      InfAdoptedSessionLocalUser* local)
+{
+  gint64 interval;
+
+  interval = INF_ADOPTED_SESSION_NOOP_INTERVAL -
+    (gint64)(INF_ADOPTED_SESSION_NOOP_INTERVAL -
+             INF_ADOPTED_SESSION_NOOP_MIN_INTERVAL) *
+    inf_adopted_session_get_noop_level(session, local) /
+    INF_ADOPTED_SESSION_NOOP_LEVELS;
+
+  return local->noop_time + interval * G_USEC_PER_SEC;
+}
+
 static InfAdoptedSessionLocalUser*
 inf_adopted_session_find_next_noop_user(InfAdoptedSession* session)
 {
@@ -290,16 +367,25 @@ inf_adopted_session_find_next_noop_user(InfAdoptedSession* session)
   GSList* item;
   InfAdoptedSessionLocalUser* local;
   InfAdoptedSessionLocalUser* next_user;
+  gint64 deadline;
+  gint64 next_deadline;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
   next_user = NULL;
+  next_deadline = 0;
 
   for(item = priv->local_users; item != NULL; item = g_slist_next(item))
   {
     local = (InfAdoptedSessionLocalUser*)item->data;
     if(local->noop_time != 0)
-      if(next_user == NULL || local->noop_time < next_user->noop_time)
+    {
+      deadline = inf_adopted_session_get_noop_deadline(session, local);
+      if(next_user == NULL || deadline < next_deadline)
+      {
         next_user = local;
+        next_deadline = deadline;
+      }
+    }
   }
 
   return next_user;
@@ -309,8 +395,8 @@ static void
 inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session)
 {
   InfAdoptedSessionPrivate* priv;
-  time_t current;
-  time_t sched;
+  gint64 current;
+  gint64 sched;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
@@ -322,9 +408,11 @@ inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session)
 
   if(priv->next_noop_user != NULL)
   {
-    current = time(NULL);
-    sched =
-      priv->next_noop_user->noop_time + INF_ADOPTED_SESSION_NOOP_INTERVAL;
+    current = g_get_monotonic_time();
+    sched = inf_adopted_session_get_noop_deadline(
+      session,
+      priv->next_noop_user
+    );
 
     if(sched >= current)
       sched -= current;
@@ -333,7 +421,7 @@ inf_adopted_session_schedule_noop_timer(InfAdoptedSession* session)
 
     priv->noop_timeout = inf_io_add_timeout(
       priv->io,
-      sched * 1000,
+      sched / 1000,
       inf_adopted_session_noop_timeout_func,
       session,
       NULL
@@ -349,7 +437,8 @@ inf_adopted_session_start_noop_timer(InfAdoptedSession* session,
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
   g_assert(local->noop_time == 0);
-  local->noop_time = time(NULL);
+  local->noop_time = g_get_monotonic_time();
+  local->noop_pressure = 0;
 
   if(priv->noop_timeout == NULL)
   {
@@ -382,6 +471,106 @@ inf_adopted_session_stop_noop_timer(InfAdoptedSession* session,
   }
 }
 
+/* Called when a request by another user has been executed, to send a noop
+ * for local earlier the more requests it has not yet acknowledged. */
+static void
+inf_adopted_session_add_noop_pressure(InfAdoptedSession* session,
+                                      InfAdoptedSessionLocalUser* local)
+{
+  InfAdoptedSessionPrivate* priv;
+  guint level;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(local->noop_time == 0)
+    inf_adopted_session_start_noop_timer(session, local);
+
+  level = inf_adopted_session_get_noop_level(session, local);
+  if(local->noop_pressure < G_MAXUINT) ++local->noop_pressure;
+
+  /* Only reschedule when the interval actually changes, not for every
+   * single request. */
+  if(inf_adopted_session_get_noop_level(session, local) != level)
+  {
+    priv->next_noop_user = inf_adopted_session_find_next_noop_user(session);
+    inf_adopted_session_schedule_noop_timer(session);
+  }
+}
+
+/*
+ * Send delay
+ */
+
+static void
+inf_adopted_session_send_timeout_func(gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  priv->send_timeout = NULL;
+
+  /* If requests have been made since the last one was sent, then send them
+   * all now and keep deferring the following ones for another interval.
+   * Otherwise, the next request is sent right away again. */
+  if(inf_session_flush_subscriptions(INF_SESSION(session)))
+  {
+    priv->send_timeout = inf_io_add_timeout(
+      priv->io,
+      priv->send_delay,
+      inf_adopted_session_send_timeout_func,
+      session,
+      NULL
+    );
+  }
+}
+
+static void
+inf_adopted_session_cancel_send_timeout(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->send_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->send_timeout);
+    priv->send_timeout = NULL;
+  }
+}
+
+/* Sends a request message, unless it was made shortly after the previous
+ * one, in which case it is deferred so that subsequent requests are sent
+ * together. A single request thus does not see any additional latency. */
+static void
+inf_adopted_session_send_request_xml(InfAdoptedSession* session,
+                                     xmlNodePtr xml)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->send_delay == 0)
+  {
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  }
+  else if(priv->send_timeout != NULL)
+  {
+    inf_session_defer_to_subscriptions(INF_SESSION(session), xml);
+  }
+  else
+  {
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+
+    priv->send_timeout = inf_io_add_timeout(
+      priv->io,
+      priv->send_delay,
+      inf_adopted_session_send_timeout_func,
+      session,
+      NULL
+    );
+  }
+}
+
 /* Breadcasts a request N times - makes only sense for undo and redo requests,
  * so that's the only thing we offer API for. */
 static void
@@ -423,7 +612,7 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   );
 
   if(n > 1) inf_xml_util_set_attribute_uint(xml, "num", n);
-  inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  inf_adopted_session_send_request_xml(session, xml);
 
   inf_adopted_state_vector_free(local->last_send_vector);
   local->last_send_vector = inf_adopted_state_vector_copy(
@@ -438,116 +627,273 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   inf_adopted_session_stop_noop_timer(session, local);
 }
 
+/* Emits InfAdoptedSession::check-request for a request that is about to be
+ * executed, and sets error if it is rejected */
 static gboolean
-inf_adopted_session_process_request(InfAdoptedSession* session,
+inf_adopted_session_check_request(InfAdoptedSession* session,
+                                  InfAdoptedRequest* request,
+                                  InfAdoptedUser* user,
+                                  GError** error)
+{
+  gboolean reject_request;
+
+  g_signal_emit(
+    G_OBJECT(session),
+    session_signals[CHECK_REQUEST],
+    0,
+    request,
+    user,
+    &reject_request
+  );
+
+  if(reject_request)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark,
+      INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+      _("The request was rejected via the API")
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Sends a message back to where the request came from, to let them know we
+ * couldn't handle this. Note that at the moment this is not explicitly
+ * handled, but it can aid in debugging. */
+static void
+inf_adopted_session_report_invalid_request(InfAdoptedSession* session,
+                                           InfAdoptedRequest* request,
+                                           InfAdoptedUser* user,
+                                           const GError* error)
+{
+  InfAdoptedSessionPrivate* priv;
+  xmlNodePtr reply_xml;
+  gchar* request_str;
+  gchar* current_str;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(inf_user_get_connection(INF_USER(user)) != NULL)
+  {
+    request_str = inf_adopted_state_vector_to_string(
+      inf_adopted_request_get_vector(request)
+    );
+
+    current_str = inf_adopted_state_vector_to_string(
+      inf_adopted_algorithm_get_current(priv->algorithm)
+    );
+
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"invalid-request");
+
+    inf_xml_util_set_attribute(
+      reply_xml,
+      "request",
+      request_str
+    );
+
+    inf_xml_util_set_attribute(
+      reply_xml,
+      "state",
+      current_str
+    );
+
+    inf_xml_util_set_attribute_uint(
+      reply_xml,
+      "user",
+      inf_user_get_id(INF_USER(user))
+    );
+
+    xmlNewChild(
+      reply_xml,
+      NULL,
+      (const xmlChar*)"reason",
+      (const xmlChar*)error->message
+    );
+
+    g_free(request_str);
+    g_free(current_str);
+
+    inf_communication_group_send_message(
+      inf_session_get_subscription_group(INF_SESSION(session)),
+      inf_user_get_connection(INF_USER(user)),
+      reply_xml
+    );
+  }
+}
+
+/* Executes a request that is causally ready */
+static gboolean
+inf_adopted_session_execute_request(InfAdoptedSession* session,
                                     InfAdoptedRequest* request,
                                     InfAdoptedUser* user,
                                     GError** error)
 {
   InfAdoptedSessionPrivate* priv;
-  InfAdoptedStateVector* request_vector;
-  InfAdoptedStateVector* current_vector;
-  gboolean reject_request;
   GError* local_error;
   gboolean execute_result;
 
-  xmlNodePtr reply_xml;
-  gchar* request_str;
-  gchar* current_str;
-
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
-  request_vector = inf_adopted_request_get_vector(request);
-  current_vector = inf_adopted_algorithm_get_current(priv->algorithm);
 
-  if(inf_adopted_state_vector_causally_before(request_vector, current_vector))
+  g_assert(
+    inf_adopted_state_vector_causally_before(
+      inf_adopted_request_get_vector(request),
+      inf_adopted_algorithm_get_current(priv->algorithm)
+    )
+  );
+
+  local_error = NULL;
+
+  if(!inf_adopted_session_check_request(session, request, user, &local_error))
   {
-    g_signal_emit(
-      G_OBJECT(session),
-      session_signals[CHECK_REQUEST],
-      0,
+    execute_result = FALSE;
+  }
+  else
+  {
+    execute_result = inf_adopted_algorithm_execute_request(
+      priv->algorithm,
+      request,
+      TRUE,
+      &local_error
+    );
+  }
+
+  if(local_error != NULL)
+  {
+    inf_adopted_session_report_invalid_request(
+      session,
       request,
       user,
-      &reject_request
+      local_error
     );
 
-    local_error = NULL;
-    
-    if(reject_request)
-    {
-      g_set_error_literal(
-        &local_error,
-        inf_adopted_session_error_quark,
-        INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
-        _("The request was rejected via the API")
-      );
+    g_propagate_error(error, local_error);
+  }
+
+  return execute_result;
+}
+
+/* Executes requests that are all causally ready at once, in one batch of
+ * the algorithm. All of them are checked before the first one is executed.
+ * As for a single buffered request, errors are only reported back to the
+ * connection of the user who issued the failed request, and via the
+ * InfAdoptedAlgorithm::end-execute-request signal. */
+static void
+inf_adopted_session_execute_requests(InfAdoptedSession* session,
+                                     GPtrArray* requests)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfUserTable* user_table;
+  InfAdoptedRequest** accepted;
+  InfAdoptedRequest* request;
+  InfUser* user;
+  GError* error;
+  guint n_accepted;
+  guint n_executed;
+  guint i;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  user_table = inf_session_get_user_table(INF_SESSION(session));
 
-      execute_result = FALSE;
+  accepted = g_new(InfAdoptedRequest*, requests->len);
+  n_accepted = 0;
+
+  for(i = 0; i < requests->len; ++i)
+  {
+    request = INF_ADOPTED_REQUEST(g_ptr_array_index(requests, i));
+
+    user = inf_user_table_lookup_user_by_id(
+      user_table,
+      inf_adopted_request_get_user_id(request)
+    );
+
+    g_assert(INF_ADOPTED_IS_USER(user));
+
+    error = NULL;
+    if(inf_adopted_session_check_request(session, request,
+                                         INF_ADOPTED_USER(user), &error))
+    {
+      accepted[n_accepted++] = request;
     }
     else
     {
-      execute_result = inf_adopted_algorithm_execute_request(
-        priv->algorithm,
+      inf_adopted_session_report_invalid_request(
+        session,
         request,
-        TRUE,
-        &local_error
+        INF_ADOPTED_USER(user),
+        error
       );
+
+      g_error_free(error);
     }
+  }
 
-    if(local_error != NULL)
+  /* A failed request does not keep the others from being executed */
+  i = 0;
+  while(i < n_accepted)
+  {
+    error = NULL;
+
+    if(inf_adopted_algorithm_execute_requests(priv->algorithm,
+                                              accepted + i,
+                                              n_accepted - i,
+                                              TRUE,
+                                              &n_executed,
+                                              &error))
     {
-      /* Send a message back to where the request came from, to let them
-       * know we couldn't handle this. Note that at the moment this is not
-       * explicitly handled, but it can aid in debugging. */
-      if(inf_user_get_connection(INF_USER(user)) != NULL)
-      {
-        /* Send a message back to where we got this request from, to inform
-         * them that the request cannot be handled. */
-        request_str = inf_adopted_state_vector_to_string(request_vector);
-        current_str = inf_adopted_state_vector_to_string(current_vector);
+      break;
+    }
 
-        reply_xml = xmlNewNode(NULL, (const xmlChar*)"invalid-request");
+    request = accepted[i + n_executed];
 
-        inf_xml_util_set_attribute(
-          reply_xml,
-          "request",
-          request_str
-        );
+    user = inf_user_table_lookup_user_by_id(
+      user_table,
+      inf_adopted_request_get_user_id(request)
+    );
 
-        inf_xml_util_set_attribute(
-          reply_xml,
-          "state",
-          current_str
-        );
+    inf_adopted_session_report_invalid_request(
+      session,
+      request,
+      INF_ADOPTED_USER(user),
+      error
+    );
 
-        inf_xml_util_set_attribute_uint(
-          reply_xml,
-          "user",
-          inf_user_get_id(INF_USER(user))
-        );
+    g_error_free(error);
+    i += n_executed + 1;
+  }
 
-        xmlNewChild(
-          reply_xml,
-          NULL,
-          (const xmlChar*)"reason",
-          (const xmlChar*)local_error->message
-        );
+  g_free(accepted);
+}
 
-        g_free(request_str);
-        g_free(current_str);
+static void
+inf_adopted_session_translate_func(gpointer user_data);
 
-        inf_communication_group_send_message(
-          inf_session_get_subscription_group(INF_SESSION(session)),
-          inf_user_get_connection(INF_USER(user)),
-          reply_xml
-        );
-      }
+static gboolean
+inf_adopted_session_process_request(InfAdoptedSession* session,
+                                    InfAdoptedRequest* request,
+                                    InfAdoptedUser* user,
+                                    GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedStateVector* request_vector;
+  InfAdoptedStateVector* current_vector;
 
-      g_propagate_error(error, local_error);
-    }
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  request_vector = inf_adopted_request_get_vector(request);
+  current_vector = inf_adopted_algorithm_get_current(priv->algorithm);
 
-    return execute_result;
+  if(priv->translate_request != NULL)
+  {
+    /* Keep the order of requests while one is being translated */
+    g_queue_push_tail(&priv->held_requests, request);
+    g_object_ref(request);
+    return TRUE;
   }
-  else
+  else if(!inf_adopted_state_vector_causally_before(request_vector,
+                                                    current_vector))
   {
     if(priv->request_buffer == NULL)
       priv->request_buffer = g_ptr_array_new();
@@ -555,6 +901,197 @@ inf_adopted_session_process_request(InfAdoptedSession* session,
     g_object_ref(request);
     return TRUE;
   }
+  else if(priv->translation_budget > 0 &&
+          inf_adopted_request_get_request_type(request) ==
+            INF_ADOPTED_REQUEST_DO &&
+          inf_adopted_state_vector_vdiff(request_vector, current_vector) >
+            priv->translation_budget)
+  {
+    /* The request is concurrent to so many others that translating it in
+     * one go would block the main loop for a noticeable time. Spread the
+     * translation over several main loop iterations instead. */
+    priv->translate_request = request;
+    g_object_ref(request);
+
+    priv->translate_dispatch = inf_io_add_dispatch(
+      priv->io,
+      inf_adopted_session_translate_func,
+      session,
+      NULL
+    );
+
+    return TRUE;
+  }
+  else
+  {
+    return inf_adopted_session_execute_request(session, request, user, error);
+  }
+}
+
+/* Processes requests that have been held back while another request was
+ * being translated, until they are all processed or one of them needs to be
+ * translated over several main loop iterations again. */
+static void
+inf_adopted_session_process_held_requests(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfUserTable* user_table;
+  InfAdoptedRequest* request;
+  InfUser* user;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+
+  while(priv->translate_request == NULL &&
+        !g_queue_is_empty(&priv->held_requests))
+  {
+    request = INF_ADOPTED_REQUEST(g_queue_pop_head(&priv->held_requests));
+
+    user = inf_user_table_lookup_user_by_id(
+      user_table,
+      inf_adopted_request_get_user_id(request)
+    );
+
+    g_assert(INF_ADOPTED_IS_USER(user));
+
+    /* As for buffered requests, errors are reported via the
+     * InfAdoptedAlgorithm::end-execute-request signal only. */
+    inf_adopted_session_process_request(
+      session,
+      request,
+      INF_ADOPTED_USER(user),
+      NULL
+    );
+
+    g_object_unref(request);
+  }
+}
+
+/* Executes the request that is being translated right away, without
+ * spreading the rest of its translation any further. */
+static void
+inf_adopted_session_finish_translation(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedRequest* request;
+  InfUser* user;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->translate_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->translate_dispatch);
+    priv->translate_dispatch = NULL;
+  }
+
+  request = priv->translate_request;
+  priv->translate_request = NULL;
+  g_assert(request != NULL);
+
+  user = inf_user_table_lookup_user_by_id(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_adopted_request_get_user_id(request)
+  );
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  inf_adopted_session_execute_request(
+    session,
+    request,
+    INF_ADOPTED_USER(user),
+    NULL
+  );
+
+  g_object_unref(request);
+}
+
+static void
+inf_adopted_session_process_buffered_requests(InfAdoptedSession* session);
+
+static void
+inf_adopted_session_translate_func(gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+  gboolean done;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  priv->translate_dispatch = NULL;
+
+  done = inf_adopted_algorithm_prepare_request(
+    priv->algorithm,
+    priv->translate_request,
+    priv->translation_budget
+  );
+
+  if(!done)
+  {
+    /* Let other sessions and connections run before continuing */
+    priv->translate_dispatch = inf_io_add_dispatch(
+      priv->io,
+      inf_adopted_session_translate_func,
+      session,
+      NULL
+    );
+  }
+  else
+  {
+    inf_adopted_session_finish_translation(session);
+    inf_adopted_session_process_held_requests(session);
+    inf_adopted_session_process_buffered_requests(session);
+    inf_adopted_algorithm_cleanup(priv->algorithm);
+  }
+}
+
+/* Executes all requests that are held back right away. This is done before
+ * the session state is synchronized to someone else, since the held
+ * requests have already been forwarded to the other members of the group,
+ * but not to the site which is being synchronized. */
+static void
+inf_adopted_session_flush_held_requests(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->translate_request != NULL)
+  {
+    do
+    {
+      inf_adopted_session_finish_translation(session);
+      inf_adopted_session_process_held_requests(session);
+    } while(priv->translate_request != NULL);
+
+    inf_adopted_session_process_buffered_requests(session);
+
+    /* Processing buffered requests could have started a new translation */
+    if(priv->translate_request != NULL)
+      inf_adopted_session_flush_held_requests(session);
+
+    inf_adopted_algorithm_cleanup(priv->algorithm);
+  }
+}
+
+static void
+inf_adopted_session_clear_held_requests(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->translate_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->translate_dispatch);
+    priv->translate_dispatch = NULL;
+  }
+
+  if(priv->translate_request != NULL)
+  {
+    g_object_unref(priv->translate_request);
+    priv->translate_request = NULL;
+  }
+
+  while(!g_queue_is_empty(&priv->held_requests))
+    g_object_unref(g_queue_pop_head(&priv->held_requests));
 }
 
 static void
@@ -565,6 +1102,8 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
   InfAdoptedStateVector* current;
 
   guint i;
+  gboolean progress;
+  GPtrArray* ready;
   InfAdoptedRequest* request;
   InfAdoptedStateVector* vector;
 
@@ -576,36 +1115,74 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
   if(priv->request_buffer != NULL)
   {
     user_table = inf_session_get_user_table(INF_SESSION(session));
-    current = inf_adopted_algorithm_get_current(priv->algorithm);
-    for(i = 0; i < priv->request_buffer->len; ++i)
+    ready = g_ptr_array_new();
+
+    /* Executing a request can make other buffered requests ready, so
+     * repeat until no more requests can be executed. Each pass executes all
+     * requests that are ready at that point, so that a large backlog does
+     * not need as many passes over the buffer as it has requests. Since
+     * each user can have only one request ready at a time, they can be
+     * executed in any order. */
+    do
     {
-      request =
-        INF_ADOPTED_REQUEST(g_ptr_array_index(priv->request_buffer, i));
-      vector = inf_adopted_request_get_vector(request);
+      current = inf_adopted_algorithm_get_current(priv->algorithm);
 
-      if(inf_adopted_state_vector_causally_before(vector, current))
+      i = 0;
+      while(i < priv->request_buffer->len)
       {
-        g_ptr_array_remove_index_fast(priv->request_buffer, i);
-
-        user_id = inf_adopted_request_get_user_id(request);
-        user = inf_user_table_lookup_user_by_id(user_table, user_id);
-        g_assert(INF_ADOPTED_IS_USER(user));
-
-        /* Note that there is no error handling here, since the buffered
-         * requests are not related to the request which has currently been
-         * received. In order to handle a failure here, the
-         * InfAdoptedAlgorithm::end-execute-request signal should be used. */
-        inf_adopted_session_process_request(
-          session,
-          request,
-          INF_ADOPTED_USER(user),
-          NULL
-        );
+        request =
+          INF_ADOPTED_REQUEST(g_ptr_array_index(priv->request_buffer, i));
+        vector = inf_adopted_request_get_vector(request);
 
-        g_object_unref(request);
-        return inf_adopted_session_process_buffered_requests(session);
+        if(inf_adopted_state_vector_causally_before(vector, current))
+        {
+          /* This moves the last element to position i, so do not increment
+           * i here. */
+          g_ptr_array_remove_index_fast(priv->request_buffer, i);
+          g_ptr_array_add(ready, request);
+        }
+        else
+        {
+          ++i;
+        }
       }
-    }
+
+      if(priv->translate_request == NULL && priv->translation_budget == 0)
+      {
+        inf_adopted_session_execute_requests(session, ready);
+      }
+      else
+      {
+        for(i = 0; i < ready->len; ++i)
+        {
+          request = INF_ADOPTED_REQUEST(g_ptr_array_index(ready, i));
+          user_id = inf_adopted_request_get_user_id(request);
+          user = inf_user_table_lookup_user_by_id(user_table, user_id);
+          g_assert(INF_ADOPTED_IS_USER(user));
+
+          /* Note that there is no error handling here, since the buffered
+           * requests are not related to the request which has currently
+           * been received. In order to handle a failure here, the
+           * InfAdoptedAlgorithm::end-execute-request signal should be
+           * used. Requests might need to be held back for translation, so
+           * they cannot be executed as a batch. */
+          inf_adopted_session_process_request(
+            session,
+            request,
+            INF_ADOPTED_USER(user),
+            NULL
+          );
+        }
+      }
+
+      progress = ready->len > 0;
+
+      for(i = 0; i < ready->len; ++i)
+        g_object_unref(g_ptr_array_index(ready, i));
+      g_ptr_array_set_size(ready, 0);
+    } while(progress);
+
+    g_ptr_array_free(ready, TRUE);
   }
 }
 
@@ -645,6 +1222,7 @@ inf_adopted_session_local_user_added(InfAdoptedSession* session,
   );
 
   local->noop_time = 0;
+  local->noop_pressure = 0;
 
   priv->local_users = g_slist_prepend(priv->local_users, local);
 
@@ -728,14 +1306,15 @@ inf_adopted_session_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
       id = inf_adopted_request_get_user_id(translated);
 
       /* A request has been executed, meaning we are no longer up to date. Send
-       * a noop in some time, so that others know what we already processed. */
+       * a noop in some time, so that others know what we already processed,
+       * unless we send another request before, which carries our vector as
+       * well. */
       for(item = priv->local_users; item != NULL; item = g_slist_next(item))
       {
         local = (InfAdoptedSessionLocalUser*)item->data;
-        if(local->noop_time == 0)
-          /* Except we issued the request ourselves, of course. */
-          if(inf_user_get_id(INF_USER(local->user)) != id)
-            inf_adopted_session_start_noop_timer(session, local);
+        /* Except we issued the request ourselves, of course. */
+        if(inf_user_get_id(INF_USER(local->user)) != id)
+          inf_adopted_session_add_noop_pressure(session, local);
       }
     }
 
@@ -804,6 +1383,15 @@ inf_adopted_session_init(InfAdoptedSession* session)
   priv->noop_timeout = NULL;
   priv->next_noop_user = NULL;
   priv->request_buffer = NULL;
+  priv->sync_cache = NULL;
+
+  priv->send_delay = 0;
+  priv->send_timeout = NULL;
+
+  priv->translation_budget = 0;
+  priv->translate_request = NULL;
+  g_queue_init(&priv->held_requests);
+  priv->translate_dispatch = NULL;
 }
 
 static void
@@ -897,6 +1485,9 @@ inf_adopted_session_dispose(GObject* object)
     priv->noop_timeout = NULL;
   }
 
+  inf_adopted_session_cancel_send_timeout(session);
+  inf_adopted_session_clear_held_requests(session);
+
   /* This calls the close vfunc if the session is running, in which we
    * free the local users. */
   G_OBJECT_CLASS(inf_adopted_session_parent_class)->dispose(object);
@@ -911,6 +1502,12 @@ inf_adopted_session_dispose(GObject* object)
     priv->request_buffer = NULL;
   }
 
+  if(priv->sync_cache != NULL)
+  {
+    g_hash_table_destroy(priv->sync_cache);
+    priv->sync_cache = NULL;
+  }
+
   if(priv->algorithm != NULL)
   {
     inf_signal_handlers_disconnect_by_func(
@@ -966,6 +1563,19 @@ inf_adopted_session_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_SEND_DELAY:
+    priv->send_delay = g_value_get_uint(value);
+    if(priv->send_delay == 0 && priv->send_timeout != NULL)
+    {
+      inf_adopted_session_cancel_send_timeout(session);
+      inf_session_flush_subscriptions(INF_SESSION(session));
+    }
+    break;
+  case PROP_TRANSLATION_BUDGET:
+    priv->translation_budget = g_value_get_uint(value);
+    if(priv->translation_budget == 0)
+      inf_adopted_session_flush_held_requests(session);
+    break;
   case PROP_ALGORITHM:
     /* read only */
   default:
@@ -983,56 +1593,395 @@ inf_adopted_session_get_property(GObject* object,
   InfAdoptedSession* session;
   InfAdoptedSessionPrivate* priv;
 
-  session = INF_ADOPTED_SESSION(object);
-  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  session = INF_ADOPTED_SESSION(object);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, G_OBJECT(priv->io));
+    break;
+  case PROP_MAX_TOTAL_LOG_SIZE:
+    g_value_set_uint(value, priv->max_total_log_size);
+    break;
+  case PROP_SEND_DELAY:
+    g_value_set_uint(value, priv->send_delay);
+    break;
+  case PROP_TRANSLATION_BUDGET:
+    g_value_set_uint(value, priv->translation_budget);
+    break;
+  case PROP_ALGORITHM:
+    g_value_set_object(value, G_OBJECT(priv->algorithm));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * Resynchronization
+ */
+
+static void
+inf_adopted_session_can_resync_foreach_func(InfUser* user,
+                                            gpointer user_data)
+{
+  InfAdoptedSessionCanResyncForeachData* data;
+  InfAdoptedRequestLog* log;
+  guint n;
+
+  data = (InfAdoptedSessionCanResyncForeachData*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  n = inf_adopted_state_vector_get(data->vector, inf_user_get_id(user));
+
+  /* The remote site misses requests which have been removed from the log
+   * already. */
+  if(n < inf_adopted_request_log_get_end(log) &&
+     n < inf_adopted_request_log_get_begin(log))
+  {
+    data->result = FALSE;
+  }
+}
+
+static void
+inf_adopted_session_resync_to_xml_foreach_func(InfUser* user,
+                                               gpointer user_data)
+{
+  g_ptr_array_add(
+    (GPtrArray*)user_data,
+    inf_adopted_user_get_request_log(INF_ADOPTED_USER(user))
+  );
+}
+
+/* Handles a <sync-user> child of a resync message. Before the requests have
+ * been replayed, this only adds users that we do not know yet, with our
+ * current state as their vector, because the algorithm takes the own
+ * component of a new user's vector as the number of requests it has
+ * executed from that user already. Afterwards, the properties of all users
+ * are updated, including the vectors and caret positions, which the
+ * replayed requests would otherwise have changed again. */
+static gboolean
+inf_adopted_session_resync_user(InfAdoptedSession* session,
+                                InfXmlConnection* connection,
+                                xmlNodePtr xml,
+                                gboolean replayed,
+                                GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfSessionClass* session_class;
+  GArray* array;
+  const GParameter* param;
+  GParameter* user_param;
+  InfUser* user;
+  gboolean result;
+  guint i;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  session_class = INF_SESSION_GET_CLASS(session);
+
+  array = session_class->get_xml_user_props(
+    INF_SESSION(session),
+    connection,
+    xml
+  );
+
+  user = NULL;
+  param = inf_session_lookup_user_property(
+    (const GParameter*)array->data,
+    array->len,
+    "id"
+  );
+
+  if(param != NULL)
+  {
+    user = inf_user_table_lookup_user_by_id(
+      inf_session_get_user_table(INF_SESSION(session)),
+      g_value_get_uint(&param->value)
+    );
+  }
+
+  /* As in the initial synchronization, available users are assumed to be
+   * joined via the connection the resync comes from. */
+  param = inf_session_lookup_user_property(
+    (const GParameter*)array->data,
+    array->len,
+    "status"
+  );
+
+  if(param != NULL &&
+     g_value_get_enum(&param->value) != INF_USER_UNAVAILABLE)
+  {
+    user_param = inf_session_get_user_property(array, "connection");
+    if(!G_IS_VALUE(&user_param->value))
+    {
+      g_value_init(&user_param->value, INF_TYPE_XML_CONNECTION);
+      g_value_set_object(&user_param->value, G_OBJECT(connection));
+    }
+  }
+
+  result = TRUE;
+  if(replayed == FALSE)
+  {
+    if(user == NULL)
+    {
+      user_param = inf_session_get_user_property(array, "vector");
+      if(G_IS_VALUE(&user_param->value))
+      {
+        g_value_take_boxed(
+          &user_param->value,
+          inf_adopted_state_vector_copy(
+            inf_adopted_algorithm_get_current(priv->algorithm)
+          )
+        );
+      }
+
+      result = session_class->validate_user_props(
+        INF_SESSION(session),
+        (const GParameter*)array->data,
+        array->len,
+        NULL,
+        error
+      );
+
+      if(result == TRUE)
+      {
+        inf_session_add_user(
+          INF_SESSION(session),
+          (const GParameter*)array->data,
+          array->len
+        );
+      }
+    }
+  }
+  else
+  {
+    /* All users have been added before replaying the requests */
+    g_assert(user != NULL);
+
+    result = session_class->validate_user_props(
+      INF_SESSION(session),
+      (const GParameter*)array->data,
+      array->len,
+      user,
+      error
+    );
+
+    if(result == TRUE)
+    {
+      g_object_freeze_notify(G_OBJECT(user));
+
+      for(i = 0; i < array->len; ++ i)
+      {
+        user_param = &g_array_index(array, GParameter, i);
+        if(strcmp(user_param->name, "id") == 0)
+          continue;
+
+        /* Our own users have left the session when the connection was
+         * lost. They need to be rejoined explicitly, even if the server
+         * has not noticed yet. */
+        if((inf_user_get_flags(user) & INF_USER_LOCAL) != 0 &&
+           (strcmp(user_param->name, "status") == 0 ||
+            strcmp(user_param->name, "connection") == 0))
+        {
+          continue;
+        }
+
+        g_object_set_property(
+          G_OBJECT(user),
+          user_param->name,
+          &user_param->value
+        );
+      }
+
+      g_object_thaw_notify(G_OBJECT(user));
+    }
+  }
+
+  for(i = 0; i < array->len; ++ i)
+    g_value_unset(&g_array_index(array, GParameter, i).value);
+  g_array_free(array, TRUE);
+
+  return result;
+}
+
+/* Handles a <sync-request> child of a resync message */
+static gboolean
+inf_adopted_session_resync_request(InfAdoptedSession* session,
+                                   xmlNodePtr xml,
+                                   GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  InfAdoptedStateVector* current;
+  guint user_id;
+  gboolean result;
+
+  gchar* request_str;
+  gchar* current_str;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->xml_to_request != NULL);
+
+  request = session_class->xml_to_request(session, xml, NULL, TRUE, error);
+  if(request == NULL) return FALSE;
+
+  user_id = inf_adopted_request_get_user_id(request);
+  user = INF_ADOPTED_USER(
+    inf_user_table_lookup_user_by_id(
+      inf_session_get_user_table(INF_SESSION(session)),
+      user_id
+    )
+  );
+
+  /* The requests are sent in an order in which each of them can be
+   * executed right away, see inf_adopted_session_resync_to_xml(). */
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+  if(inf_adopted_request_get_index(request) !=
+     inf_adopted_state_vector_get(current, user_id) ||
+     !inf_adopted_state_vector_causally_before(
+       inf_adopted_request_get_vector(request),
+       current))
+  {
+    request_str = inf_adopted_state_vector_to_string(
+      inf_adopted_request_get_vector(request)
+    );
+
+    current_str = inf_adopted_state_vector_to_string(current);
+
+    g_set_error(
+      error,
+      inf_adopted_session_error_quark,
+      INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+      _("Request \"%s\" by user \"%s\" cannot be executed in state \"%s\""),
+      request_str,
+      inf_user_get_name(INF_USER(user)),
+      current_str
+    );
+
+    g_free(request_str);
+    g_free(current_str);
+    g_object_unref(request);
+    return FALSE;
+  }
 
-  switch(prop_id)
+  result = inf_adopted_session_validate_request(
+    inf_adopted_user_get_request_log(user),
+    request,
+    error
+  );
+
+  /* The request is executed right away, even if it would exceed the
+   * translation budget, since the next request of the resync relies on
+   * it having been executed already. */
+  if(result == TRUE)
   {
-  case PROP_IO:
-    g_value_set_object(value, G_OBJECT(priv->io));
-    break;
-  case PROP_MAX_TOTAL_LOG_SIZE:
-    g_value_set_uint(value, priv->max_total_log_size);
-    break;
-  case PROP_ALGORITHM:
-    g_value_set_object(value, G_OBJECT(priv->algorithm));
-    break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-    break;
+    result = inf_adopted_session_execute_request(
+      session,
+      request,
+      user,
+      error
+    );
   }
+
+  g_object_unref(request);
+  return result;
 }
 
 /*
  * VFunc implementations.
  */
 
+static void
+inf_adopted_session_sync_cache_free(gpointer data)
+{
+  InfAdoptedSessionSyncCache* cache;
+  cache = (InfAdoptedSessionSyncCache*)data;
+
+  xmlFreeNode(cache->container);
+  g_slice_free(InfAdoptedSessionSyncCache, cache);
+}
+
 static void
 inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
                                                   gpointer user_data)
 {
   InfAdoptedRequestLog* log;
   InfAdoptedSessionToXmlSyncForeachData* data;
+  InfAdoptedSessionPrivate* priv;
   InfAdoptedSessionClass* session_class;
+  InfAdoptedSessionSyncCache* cache;
   guint i;
+  guint begin;
   guint end;
   xmlNodePtr xml;
+  xmlNodePtr next;
   InfAdoptedRequest* request;
 
   g_assert(INF_ADOPTED_IS_USER(user));
 
   data = (InfAdoptedSessionToXmlSyncForeachData*)user_data;
+  priv = INF_ADOPTED_SESSION_PRIVATE(data->session);
   log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  begin = inf_adopted_request_log_get_begin(log);
   end = inf_adopted_request_log_get_end(log);
   session_class = INF_ADOPTED_SESSION_GET_CLASS(data->session);
   g_assert(session_class->request_to_xml != NULL);
 
-  for(i = inf_adopted_request_log_get_begin(log); i < end; ++ i)
+  cache = g_hash_table_lookup(
+    priv->sync_cache,
+    GUINT_TO_POINTER(inf_user_get_id(user))
+  );
+
+  if(cache == NULL)
+  {
+    cache = g_slice_new(InfAdoptedSessionSyncCache);
+    cache->begin = begin;
+    cache->end = begin;
+    cache->container = xmlNewNode(NULL, (const xmlChar*)"sync-cache");
+
+    g_hash_table_insert(
+      priv->sync_cache,
+      GUINT_TO_POINTER(inf_user_get_id(user)),
+      cache
+    );
+  }
+
+  /* The log only grows at its end and shrinks at its beginning, so this
+   * should not happen. Start over if it does anyway. */
+  if(cache->begin > begin || cache->end > end)
+  {
+    xmlFreeNode(cache->container);
+    cache->begin = begin;
+    cache->end = begin;
+    cache->container = xmlNewNode(NULL, (const xmlChar*)"sync-cache");
+  }
+
+  /* Drop requests that have been removed from the log */
+  for(xml = cache->container->children;
+      xml != NULL && cache->begin < MIN(begin, cache->end);
+      xml = next)
+  {
+    next = xml->next;
+    xmlUnlinkNode(xml);
+    xmlFreeNode(xml);
+    ++cache->begin;
+  }
+
+  cache->begin = begin;
+  if(cache->end < begin)
+    cache->end = begin;
+
+  /* Serialize requests that have been added since the previous sync */
+  for(i = cache->end; i < end; ++ i)
   {
     request = inf_adopted_request_log_get_request(log, i);
 
     xml = xmlNewChild(
-      data->parent_xml,
+      cache->container,
       NULL,
       (const xmlChar*)"sync-request",
       NULL
@@ -1040,8 +1989,12 @@ inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
 
     /* TODO: Diff to previous request? */
     session_class->request_to_xml(data->session, xml, request, NULL, TRUE);
-    xmlAddChild(data->parent_xml, xml);
   }
+
+  cache->end = end;
+
+  for(xml = cache->container->children; xml != NULL; xml = xml->next)
+    xmlAddChild(data->parent_xml, xmlCopyNode(xml, 1));
 }
 
 static void
@@ -1054,11 +2007,23 @@ inf_adopted_session_to_xml_sync(InfSession* session,
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
   g_assert(priv->algorithm != NULL);
 
+  inf_adopted_session_flush_held_requests(INF_ADOPTED_SESSION(session));
+
   INF_SESSION_CLASS(inf_adopted_session_parent_class)->to_xml_sync(
     session,
     parent
   );
 
+  if(priv->sync_cache == NULL)
+  {
+    priv->sync_cache = g_hash_table_new_full(
+      NULL,
+      NULL,
+      NULL,
+      inf_adopted_session_sync_cache_free
+    );
+  }
+
   foreach_data.session = INF_ADOPTED_SESSION(session);
   foreach_data.parent_xml = parent;
 
@@ -1120,6 +2085,11 @@ inf_adopted_session_process_xml_sync(InfSession* session,
   return parent_class->process_xml_sync(session, connection, xml, error);
 }
 
+static gboolean
+inf_adopted_session_check_request_vector(InfAdoptedSession* session,
+                                         InfAdoptedStateVector* vector,
+                                         InfAdoptedUser* user);
+
 static InfCommunicationScope
 inf_adopted_session_process_xml_run(InfSession* session,
                                     InfXmlConnection* connection,
@@ -1137,6 +2107,7 @@ inf_adopted_session_process_xml_run(InfSession* session,
 
   gboolean has_num;
   gboolean process_request;
+  gboolean reject_request;
   guint num;
   GError* local_error;
   InfAdoptedRequest* copy_req;
@@ -1190,6 +2161,59 @@ inf_adopted_session_process_xml_run(InfSession* session,
     user_id = inf_user_get_id(INF_USER(user));
     user_vector = inf_adopted_user_get_vector(user);
 
+    /* Only read the state vector of the request at first, so that requests
+     * can be rejected without parsing their operation. This is only done if
+     * someone is interested, since the vector is read again below. */
+    if(session_class->check_request_vector !=
+         inf_adopted_session_check_request_vector ||
+       g_signal_has_handler_pending(
+         session,
+         session_signals[CHECK_REQUEST_VECTOR],
+         0,
+         FALSE
+       ))
+    {
+      if(!inf_adopted_session_read_request_info(INF_ADOPTED_SESSION(session),
+                                                xml,
+                                                user_vector,
+                                                NULL,
+                                                &request_vector,
+                                                NULL,
+                                                error))
+      {
+        return INF_COMMUNICATION_SCOPE_PTP;
+      }
+
+      reject_request = FALSE;
+      if(inf_adopted_state_vector_causally_before(
+           request_vector,
+           inf_adopted_algorithm_get_current(priv->algorithm)))
+      {
+        g_signal_emit(
+          G_OBJECT(session),
+          session_signals[CHECK_REQUEST_VECTOR],
+          0,
+          request_vector,
+          user,
+          &reject_request
+        );
+      }
+
+      inf_adopted_state_vector_free(request_vector);
+
+      if(reject_request)
+      {
+        g_set_error_literal(
+          error,
+          inf_adopted_session_error_quark,
+          INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+          _("The request was rejected via the API")
+        );
+
+        return INF_COMMUNICATION_SCOPE_PTP;
+      }
+    }
+
     request = session_class->xml_to_request(
       INF_ADOPTED_SESSION(session),
       xml,
@@ -1233,6 +2257,11 @@ inf_adopted_session_process_xml_run(InfSession* session,
       return INF_COMMUNICATION_SCOPE_PTP;
     }
 
+    /* The user's vector changes with every request processed from here on.
+     * Collect the notifications, so that only one is emitted after all of
+     * the requests have been processed. */
+    g_object_freeze_notify(G_OBJECT(user));
+
     /* Update the user vector to the state of the request. */
     user_vector = inf_adopted_state_vector_copy(request_vector);
     /* Note that this function takes ownership of user_vector */
@@ -1305,6 +2334,8 @@ inf_adopted_session_process_xml_run(InfSession* session,
       inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
     );
 
+    g_object_thaw_notify(G_OBJECT(user));
+
     /* Requests can always be forwarded since user is given. Explicitly allow
      * forwarding if the request could not be applied... maybe others are more
      * lucky? In the worst case it will just fail for them as well. */
@@ -1462,6 +2493,10 @@ inf_adopted_session_close(InfSession* session)
   g_slist_free(priv->local_users);
   priv->local_users = NULL;
 
+  /* Deferred requests are sent by the parent class */
+  inf_adopted_session_cancel_send_timeout(INF_ADOPTED_SESSION(session));
+  inf_adopted_session_clear_held_requests(INF_ADOPTED_SESSION(session));
+
   INF_SESSION_CLASS(inf_adopted_session_parent_class)->close(session);
 }
 
@@ -1528,6 +2563,14 @@ inf_adopted_session_check_request(InfAdoptedSession* session,
   return FALSE;
 }
 
+static gboolean
+inf_adopted_session_check_request_vector(InfAdoptedSession* session,
+                                         InfAdoptedStateVector* vector,
+                                         InfAdoptedUser* user)
+{
+  return FALSE;
+}
+
 /*
  * Gype registration.
  */
@@ -1563,6 +2606,8 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   adopted_session_class->xml_to_request = NULL;
   adopted_session_class->request_to_xml = NULL;
   adopted_session_class->check_request = inf_adopted_session_check_request;
+  adopted_session_class->check_request_vector =
+    inf_adopted_session_check_request_vector;
 
   inf_adopted_session_error_quark = g_quark_from_static_string(
     "INF_ADOPTED_SESSION_ERROR"
@@ -1597,6 +2642,40 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
     INF_ADOPTED_TYPE_USER
   );
 
+  /**
+   * InfAdoptedSession::check-request-vector:
+   * @session: The #InfAdoptedSession which received a request.
+   * @vector: The state in which the request was made.
+   * @user: The user who issued the request.
+   *
+   * This signal is emitted whenever the session received a request from a
+   * non-local user that needs to be transformed, before the request itself
+   * is read. It allows to reject requests based on the state they were
+   * made in, without the cost of parsing their operation, such as requests
+   * that would need to be transformed against many others. Like
+   * #InfAdoptedSession::check-request, a request is rejected if one of the
+   * signal handlers returns %TRUE.
+   *
+   * The user remains in the state before the rejected request, so further
+   * requests of that user cannot be processed either. Usually, the user's
+   * connection should be unsubscribed from the session when rejecting a
+   * request. The same considerations as for
+   * #InfAdoptedSession::check-request apply regarding loss of
+   * synchronization.
+   */
+  session_signals[CHECK_REQUEST_VECTOR] = g_signal_new(
+    "check-request-vector",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfAdoptedSessionClass, check_request_vector),
+    g_signal_accumulator_true_handled, NULL,
+    NULL,
+    G_TYPE_BOOLEAN,
+    2,
+    INF_ADOPTED_TYPE_STATE_VECTOR | G_SIGNAL_TYPE_STATIC_SCOPE,
+    INF_ADOPTED_TYPE_USER
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_IO,
@@ -1623,6 +2702,55 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
     )
   );
 
+  /**
+   * InfAdoptedSession:send-delay:
+   *
+   * The time, in milliseconds, for which requests made shortly after the
+   * previous one are held back, so that requests made in quick succession,
+   * such as while typing, are handed to the network in batches. The first
+   * request after a pause is always sent right away. 0 sends every request
+   * immediately.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_SEND_DELAY,
+    g_param_spec_uint(
+      "send-delay",
+      "Send delay",
+      "Time in milliseconds to hold back requests made in quick succession",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfAdoptedSession:translation-budget:
+   *
+   * The maximum number of concurrent requests a received request is
+   * translated across within one main loop iteration. A request that is
+   * concurrent to more requests than this, for example one that was made
+   * after a long offline period, is translated bit by bit from several
+   * #InfIo dispatches, so that other sessions stay responsive in the
+   * meanwhile. Requests received after it are held back until it has been
+   * executed. 0 translates every request in one go.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_TRANSLATION_BUDGET,
+    g_param_spec_uint(
+      "translation-budget",
+      "Translation budget",
+      "Maximum number of concurrent requests to translate a received request "
+      "across per main loop iteration, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_ALGORITHM,
@@ -1941,4 +3069,264 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
     xmlAddChild(xml, operation);
 }
 
+/**
+ * inf_adopted_session_can_resync:
+ * @session: A #InfAdoptedSession.
+ * @vector: The state of a remote copy of @session.
+ *
+ * Returns whether a remote site whose copy of @session is at state @vector
+ * can be brought up to date with inf_adopted_session_resync_to_xml(),
+ * instead of synchronizing the whole session again. This is not possible
+ * if the remote site has executed requests that @session does not know
+ * about, or if the requests it is missing have been removed from the
+ * request logs already, see #InfAdoptedSession:max-total-log-size.
+ * Requests that are held back because of
+ * #InfAdoptedSession:translation-budget are executed before the check.
+ *
+ * Note that state vectors are only meaningful for the same instance of a
+ * session. The caller needs to make sure that the remote copy was
+ * synchronized from @session in the first place, and not from an earlier
+ * instance of it that was stored and loaded again.
+ *
+ * Returns: Whether the remote site can be resynchronized.
+ */
+gboolean
+inf_adopted_session_can_resync(InfAdoptedSession* session,
+                               const InfAdoptedStateVector* vector)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionCanResyncForeachData data;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(session), FALSE);
+  g_return_val_if_fail(vector != NULL, FALSE);
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  if(priv->algorithm == NULL) return FALSE;
+
+  /* Held requests have already been forwarded to the other group members,
+   * so the remote site might have them in its state already. Executing
+   * them also makes sure that the check below and the subsequent
+   * inf_adopted_session_resync_to_xml() see the same logs. */
+  inf_adopted_session_flush_held_requests(session);
+
+  /* This also fails for requests of users that we do not know */
+  if(!inf_adopted_state_vector_causally_before(
+       vector,
+       inf_adopted_algorithm_get_current(priv->algorithm)))
+  {
+    return FALSE;
+  }
+
+  data.vector = vector;
+  data.result = TRUE;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_adopted_session_can_resync_foreach_func,
+    &data
+  );
+
+  return data.result;
+}
+
+/**
+ * inf_adopted_session_resync_to_xml:
+ * @session: A #InfAdoptedSession.
+ * @vector: The state of a remote copy of @session.
+ * @parent: The XML node to write the data into.
+ *
+ * Writes the users of @session, and the requests that a remote site at
+ * state @vector has not executed yet, into @parent, in the same format as
+ * the initial synchronization. The buffer content is not written, since the
+ * remote site applies the requests to its own copy of it. The remote site
+ * can process the data with inf_adopted_session_resync_from_xml().
+ *
+ * The requests are written in an order in which each of them can be
+ * executed when the ones before it have been. The remote site can
+ * therefore verify them one by one, and does not need to buffer any of
+ * them. This may only be called if inf_adopted_session_can_resync()
+ * returns %TRUE for @vector.
+ */
+void
+inf_adopted_session_resync_to_xml(InfAdoptedSession* session,
+                                  const InfAdoptedStateVector* vector,
+                                  xmlNodePtr parent)
+{
+  InfAdoptedSessionClass* session_class;
+  GPtrArray* logs;
+  InfAdoptedStateVector* state;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  gboolean progress;
+  guint user_id;
+  guint end;
+  guint i;
+  guint n;
+  xmlNodePtr xml;
+
+  g_return_if_fail(INF_ADOPTED_IS_SESSION(session));
+  g_return_if_fail(vector != NULL);
+  g_return_if_fail(parent != NULL);
+  g_return_if_fail(inf_adopted_session_can_resync(session, vector));
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  /* Normally a no-op, since inf_adopted_session_can_resync() has flushed
+   * the held requests already */
+  inf_adopted_session_flush_held_requests(session);
+
+  /* This writes the users only, not the buffer content that subclasses add
+   * in their to_xml_sync implementation. */
+  INF_SESSION_CLASS(inf_adopted_session_parent_class)->to_xml_sync(
+    INF_SESSION(session),
+    parent
+  );
+
+  logs = g_ptr_array_new();
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_adopted_session_resync_to_xml_foreach_func,
+    logs
+  );
+
+  /* Go through the logs repeatedly, and write each request as soon as all
+   * requests it depends on have been written. */
+  state = inf_adopted_state_vector_copy((InfAdoptedStateVector*)vector);
+
+  do
+  {
+    progress = FALSE;
+
+    for(i = 0; i < logs->len; ++ i)
+    {
+      log = INF_ADOPTED_REQUEST_LOG(g_ptr_array_index(logs, i));
+      user_id = inf_adopted_request_log_get_user_id(log);
+      end = inf_adopted_request_log_get_end(log);
+
+      for(n = inf_adopted_state_vector_get(state, user_id); n < end; ++ n)
+      {
+        request = inf_adopted_request_log_get_request(log, n);
+
+        if(!inf_adopted_state_vector_causally_before(
+             inf_adopted_request_get_vector(request),
+             state))
+        {
+          break;
+        }
+
+        xml = xmlNewChild(parent, NULL, (const xmlChar*)"sync-request", NULL);
+        session_class->request_to_xml(session, xml, request, NULL, TRUE);
+
+        inf_adopted_state_vector_add(state, user_id, 1);
+        progress = TRUE;
+      }
+    }
+  } while(progress);
+
+  inf_adopted_state_vector_free(state);
+  g_ptr_array_free(logs, TRUE);
+}
+
+/**
+ * inf_adopted_session_resync_from_xml:
+ * @session: A #InfAdoptedSession in %INF_SESSION_RUNNING status.
+ * @connection: The connection the data comes from.
+ * @xml: The XML node written by inf_adopted_session_resync_to_xml().
+ * @error: Location to store error information, if any.
+ *
+ * Brings @session up to date with a remote copy of it, from the data
+ * that the remote site has written with inf_adopted_session_resync_to_xml()
+ * for the current state of @session. Users that @session does not know yet
+ * are added, the missing requests are executed, and then the properties of
+ * all users are updated. Available users that are not local are assumed to
+ * be joined via @connection. Local users are not made available again, they
+ * need to rejoin explicitly.
+ *
+ * If an error occurs, then @session has executed only part of the requests,
+ * and cannot be resynchronized again. It should then be synchronized from
+ * scratch.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurred.
+ */
+gboolean
+inf_adopted_session_resync_from_xml(InfAdoptedSession* session,
+                                    InfXmlConnection* connection,
+                                    xmlNodePtr xml,
+                                    GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  xmlNodePtr child;
+  gboolean result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(session), FALSE);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+  g_return_val_if_fail(xml != NULL, FALSE);
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_return_val_if_fail(priv->algorithm != NULL, FALSE);
+
+  /* Requests that we received, but could not execute yet, are not part of
+   * our state, so they are included in the resync again. This includes
+   * requests held back while another one is being translated. */
+  inf_adopted_session_clear_held_requests(session);
+
+  if(priv->request_buffer != NULL)
+  {
+    for(i = 0; i < priv->request_buffer->len; ++i)
+      g_object_unref(g_ptr_array_index(priv->request_buffer, i));
+    g_ptr_array_free(priv->request_buffer, TRUE);
+    priv->request_buffer = NULL;
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const char*)child->name, "sync-user") == 0)
+    {
+      result = inf_adopted_session_resync_user(
+        session,
+        connection,
+        child,
+        FALSE,
+        error
+      );
+
+      if(result == FALSE) return FALSE;
+    }
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const char*)child->name, "sync-request") == 0)
+    {
+      result = inf_adopted_session_resync_request(session, child, error);
+      if(result == FALSE) return FALSE;
+    }
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const char*)child->name, "sync-user") == 0)
+    {
+      result = inf_adopted_session_resync_user(
+        session,
+        connection,
+        child,
+        TRUE,
+        error
+      );
+
+      if(result == FALSE) return FALSE;
+    }
+  }
+
+  inf_adopted_algorithm_cleanup(priv->algorithm);
+  return TRUE;
+}
+
 /* vim:set et sw=2 ts=2: */
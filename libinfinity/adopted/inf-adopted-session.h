@@ -77,6 +77,8 @@ typedef enum _InfAdoptedSessionError {
  * common info.
  * @check_request: Default signal handler of the
  * InfAdoptedSession::check-request signal.
+ * @check_request_vector: Default signal handler of the
+ * InfAdoptedSession::check-request-vector signal.
  *
  * Virtual functions and default signal handlers for #InfAdoptedSession.
  */
@@ -104,6 +106,10 @@ struct _InfAdoptedSessionClass {
   gboolean(*check_request)(InfAdoptedSession* session,
                            InfAdoptedRequest* request,
                            InfAdoptedUser* user);
+
+  gboolean(*check_request_vector)(InfAdoptedSession* session,
+                                  InfAdoptedStateVector* vector,
+                                  InfAdoptedUser* user);
 };
 
 /**
@@ -156,6 +162,21 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
                                        xmlNodePtr xml,
                                        xmlNodePtr operation);
 
+gboolean
+inf_adopted_session_can_resync(InfAdoptedSession* session,
+                               const InfAdoptedStateVector* vector);
+
+void
+inf_adopted_session_resync_to_xml(InfAdoptedSession* session,
+                                  const InfAdoptedStateVector* vector,
+                                  xmlNodePtr parent);
+
+gboolean
+inf_adopted_session_resync_from_xml(InfAdoptedSession* session,
+                                    InfXmlConnection* connection,
+                                    xmlNodePtr xml,
+                                    GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_SESSION_H__ */
@@ -43,15 +43,43 @@
  * inf_adopted_operation_transform() and
  * inf_adopted_split_operation_transform_other() perform these three
  * operations, respectively.
+ *
+ * Since (A, (B, C)) and ((A, B), C) are equivalent, a split operation
+ * containing other split operations is stored as a flat sequence of the
+ * operations that are not split operations themselves. This also applies
+ * to the results of transformation: when a delete operation is transformed
+ * against many concurrent insertions into the deleted range, the result is
+ * a single split operation with one part per range still to be deleted
+ * instead of a deeply nested tree, and it is transformed further in time
+ * linear in the number of parts.
  **/
 
 #include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/adopted/inf-adopted-operation.h>
 
+/* The group of a part is the index of the part of the split operation as
+ * it was originally created that it originates from by transformation.
+ * Transforming a part can split it further, and all the resulting parts
+ * keep its group. This allows finding the corresponding parts of the same
+ * split operation at a different state. */
+typedef struct _InfAdoptedSplitOperationPart InfAdoptedSplitOperationPart;
+struct _InfAdoptedSplitOperationPart {
+  InfAdoptedOperation* operation;
+  guint group;
+};
+
 typedef struct _InfAdoptedSplitOperationPrivate InfAdoptedSplitOperationPrivate;
 struct _InfAdoptedSplitOperationPrivate {
+  InfAdoptedSplitOperationPart* parts;
+  guint n_parts;
+
+  /* Only used during construction via the properties */
   InfAdoptedOperation* first;
   InfAdoptedOperation* second;
+
+  /* Split operation of all parts but the first one, created when the
+   * "second" property is queried for more than two parts */
+  InfAdoptedOperation* rest;
 };
 
 enum {
@@ -68,39 +96,122 @@ G_DEFINE_TYPE_WITH_CODE(InfAdoptedSplitOperation, inf_adopted_split_operation, G
   G_ADD_PRIVATE(InfAdoptedSplitOperation)
   G_IMPLEMENT_INTERFACE(INF_ADOPTED_TYPE_OPERATION, inf_adopted_split_operation_operation_iface_init))
 
+/* Appends operation to parts, or its parts if it is a split operation
+ * itself. All of them are assigned the given group. */
 static void
-inf_adopted_split_operation_unsplit_impl(InfAdoptedSplitOperation* operation,
-                                         GSList** list)
+inf_adopted_split_operation_append(GArray* parts,
+                                   InfAdoptedOperation* operation,
+                                   guint group)
 {
   InfAdoptedSplitOperationPrivate* priv;
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  InfAdoptedSplitOperationPart part;
+  guint i;
 
-  /* Since we prepend the entries to the list, we begin with the second
-   * operation so that the list actually contains the operations in order. */
+  part.group = group;
 
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(priv->second))
+  if(INF_ADOPTED_IS_SPLIT_OPERATION(operation))
   {
-    inf_adopted_split_operation_unsplit_impl(
-      INF_ADOPTED_SPLIT_OPERATION(priv->second),
-      list
-    );
+    priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+    for(i = 0; i < priv->n_parts; ++i)
+    {
+      part.operation = priv->parts[i].operation;
+      g_object_ref(part.operation);
+      g_array_append_val(parts, part);
+    }
   }
   else
   {
-    *list = g_slist_prepend(*list, priv->second);
+    part.operation = operation;
+    g_object_ref(part.operation);
+    g_array_append_val(parts, part);
   }
+}
+
+static GArray*
+inf_adopted_split_operation_parts_new(guint reserve)
+{
+  return g_array_sized_new(
+    FALSE,
+    FALSE,
+    sizeof(InfAdoptedSplitOperationPart),
+    reserve
+  );
+}
+
+static void
+inf_adopted_split_operation_parts_free(GArray* parts)
+{
+  guint i;
 
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(priv->first))
+  for(i = 0; i < parts->len; ++i)
   {
-    inf_adopted_split_operation_unsplit_impl(
-      INF_ADOPTED_SPLIT_OPERATION(priv->first),
-      list
+    g_object_unref(
+      g_array_index(parts, InfAdoptedSplitOperationPart, i).operation
     );
   }
-  else
+
+  g_array_free(parts, TRUE);
+}
+
+/* Creates a split operation from parts, taking ownership of it. */
+static InfAdoptedOperation*
+inf_adopted_split_operation_new_from_parts(GArray* parts)
+{
+  GObject* object;
+  InfAdoptedSplitOperationPrivate* priv;
+
+  g_assert(parts->len >= 2);
+
+  object = g_object_new(INF_ADOPTED_TYPE_SPLIT_OPERATION, NULL);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(object);
+
+  priv->n_parts = parts->len;
+  priv->parts = (InfAdoptedSplitOperationPart*)g_array_free(parts, FALSE);
+
+  return INF_ADOPTED_OPERATION(object);
+}
+
+/* Returns the part of lcs corresponding to the part of its split operation
+ * at the current state in the given group, and transforms *lcs_against
+ * against all parts of lcs before that one which have not been
+ * incorporated into it yet. *lcs_index is the index of the first such
+ * part. If lcs is not a split operation, it corresponds to all parts. */
+static InfAdoptedOperation*
+inf_adopted_split_operation_lcs_part(InfAdoptedOperation* lcs,
+                                     guint group,
+                                     guint* lcs_index,
+                                     InfAdoptedOperation** lcs_against,
+                                     InfAdoptedConcurrencyId concurrency_id)
+{
+  InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation* part;
+  InfAdoptedOperation* new_against;
+
+  if(!INF_ADOPTED_IS_SPLIT_OPERATION(lcs))
+    return lcs;
+
+  g_assert(*lcs_against != NULL);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(lcs);
+
+  while(*lcs_index + 1 < priv->n_parts &&
+        priv->parts[*lcs_index].group < group)
   {
-    *list = g_slist_prepend(*list, priv->first);
+    part = priv->parts[*lcs_index].operation;
+
+    new_against = inf_adopted_operation_transform(
+      *lcs_against,
+      part,
+      *lcs_against,
+      part,
+      concurrency_id
+    );
+
+    g_object_unref(*lcs_against);
+    *lcs_against = new_against;
+    ++*lcs_index;
   }
+
+  return priv->parts[*lcs_index].operation;
 }
 
 static void
@@ -109,8 +220,44 @@ inf_adopted_split_operation_init(InfAdoptedSplitOperation* operation)
   InfAdoptedSplitOperationPrivate* priv;
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
+  priv->parts = NULL;
+  priv->n_parts = 0;
   priv->first = NULL;
   priv->second = NULL;
+  priv->rest = NULL;
+}
+
+static void
+inf_adopted_split_operation_constructed(GObject* object)
+{
+  InfAdoptedSplitOperationPrivate* priv;
+  GArray* parts;
+  guint i;
+
+  G_OBJECT_CLASS(inf_adopted_split_operation_parent_class)->
+    constructed(object);
+
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(object);
+
+  /* Parts are set directly when created from within this file */
+  if(priv->first != NULL && priv->second != NULL)
+  {
+    parts = inf_adopted_split_operation_parts_new(2);
+    inf_adopted_split_operation_append(parts, priv->first, 0);
+    inf_adopted_split_operation_append(parts, priv->second, 0);
+
+    g_object_unref(priv->first);
+    g_object_unref(priv->second);
+    priv->first = NULL;
+    priv->second = NULL;
+
+    /* The parts of a new split operation originate from themselves */
+    for(i = 0; i < parts->len; ++i)
+      g_array_index(parts, InfAdoptedSplitOperationPart, i).group = i;
+
+    priv->n_parts = parts->len;
+    priv->parts = (InfAdoptedSplitOperationPart*)g_array_free(parts, FALSE);
+  }
 }
 
 static void
@@ -118,10 +265,18 @@ inf_adopted_split_operation_dispose(GObject* object)
 {
   InfAdoptedSplitOperation* operation;
   InfAdoptedSplitOperationPrivate* priv;
+  guint i;
 
   operation = INF_ADOPTED_SPLIT_OPERATION(object);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
+  for(i = 0; i < priv->n_parts; ++i)
+    g_object_unref(priv->parts[i].operation);
+
+  g_free(priv->parts);
+  priv->parts = NULL;
+  priv->n_parts = 0;
+
   if(priv->first != NULL)
   {
     g_object_unref(priv->first);
@@ -134,6 +289,12 @@ inf_adopted_split_operation_dispose(GObject* object)
     priv->second = NULL;
   }
 
+  if(priv->rest != NULL)
+  {
+    g_object_unref(priv->rest);
+    priv->rest = NULL;
+  }
+
   G_OBJECT_CLASS(inf_adopted_split_operation_parent_class)->dispose(object);
 }
 
@@ -175,6 +336,8 @@ inf_adopted_split_operation_get_property(GObject* object,
 {
   InfAdoptedSplitOperation* operation;
   InfAdoptedSplitOperationPrivate* priv;
+  GArray* parts;
+  guint i;
 
   operation = INF_ADOPTED_SPLIT_OPERATION(object);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
@@ -182,10 +345,32 @@ inf_adopted_split_operation_get_property(GObject* object,
   switch(prop_id)
   {
   case PROP_FIRST:
-    g_value_set_object(value, G_OBJECT(priv->first));
+    g_value_set_object(value, G_OBJECT(priv->parts[0].operation));
     break;
   case PROP_SECOND:
-    g_value_set_object(value, G_OBJECT(priv->second));
+    if(priv->n_parts == 2)
+    {
+      g_value_set_object(value, G_OBJECT(priv->parts[1].operation));
+    }
+    else
+    {
+      if(priv->rest == NULL)
+      {
+        parts = inf_adopted_split_operation_parts_new(priv->n_parts - 1);
+        for(i = 1; i < priv->n_parts; ++i)
+        {
+          inf_adopted_split_operation_append(
+            parts,
+            priv->parts[i].operation,
+            i - 1
+          );
+        }
+
+        priv->rest = inf_adopted_split_operation_new_from_parts(parts);
+      }
+
+      g_value_set_object(value, G_OBJECT(priv->rest));
+    }
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -200,6 +385,7 @@ inf_adopted_split_operation_class_init(
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(split_operation_class);
 
+  object_class->constructed = inf_adopted_split_operation_constructed;
   object_class->dispose = inf_adopted_split_operation_dispose;
   object_class->set_property = inf_adopted_split_operation_set_property;
   object_class->get_property = inf_adopted_split_operation_get_property;
@@ -222,7 +408,9 @@ inf_adopted_split_operation_class_init(
     g_param_spec_object(
       "second",
       "Second operation",
-      "The second operation of the split operation",
+      "The second operation of the split operation. If the split operation "
+      "consists of more than two operations, this is a split operation of "
+      "all of them but the first one",
       INF_ADOPTED_TYPE_OPERATION,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
@@ -233,33 +421,40 @@ static gboolean
 inf_adopted_split_operation_need_concurrency_id(InfAdoptedOperation* op,
                                                 InfAdoptedOperation* against)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-
   InfAdoptedOperation* new_against;
   gboolean result;
+  guint i;
 
-  split = INF_ADOPTED_SPLIT_OPERATION(op);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
-
-  if(inf_adopted_operation_need_concurrency_id(priv->first, against) == TRUE)
-    return TRUE;
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(op);
+  result = FALSE;
 
-  /* Note that for this transformation there is no concurrency ID required */
-  new_against = inf_adopted_operation_transform(
-    against,
-    priv->first,
-    NULL,
-    NULL,
-    INF_ADOPTED_CONCURRENCY_NONE
-  );
+  g_object_ref(against);
+  for(i = 0; i < priv->n_parts && result == FALSE; ++i)
+  {
+    result = inf_adopted_operation_need_concurrency_id(
+      priv->parts[i].operation,
+      against
+    );
 
-  result = inf_adopted_operation_need_concurrency_id(
-    priv->second,
-    new_against
-  );
+    if(result == FALSE && i + 1 < priv->n_parts)
+    {
+      /* Note that for this transformation there is no concurrency ID
+       * required */
+      new_against = inf_adopted_operation_transform(
+        against,
+        priv->parts[i].operation,
+        NULL,
+        NULL,
+        INF_ADOPTED_CONCURRENCY_NONE
+      );
+
+      g_object_unref(against);
+      against = new_against;
+    }
+  }
 
-  g_object_unref(new_against);
+  g_object_unref(against);
   return result;
 }
 
@@ -270,140 +465,128 @@ inf_adopted_split_operation_transform(InfAdoptedOperation* operation,
                                       InfAdoptedOperation* against_lcs,
                                       InfAdoptedConcurrencyId concurrency_id)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-
-  InfAdoptedOperation* new_first;
+  InfAdoptedSplitOperationPart* part;
+  InfAdoptedOperation* part_lcs;
+  InfAdoptedOperation* new_part;
   InfAdoptedOperation* new_against;
-  InfAdoptedOperation* new_second;
-  InfAdoptedOperation* result;
-  
-  InfAdoptedSplitOperationPrivate* priv_lcs;
-  InfAdoptedOperation* first_lcs;
-  InfAdoptedOperation* second_lcs;
   InfAdoptedOperation* new_against_lcs;
+  GArray* parts;
+  guint lcs_index;
+  guint i;
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
-  
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(operation_lcs))
-  {
-    g_assert(against_lcs != NULL);
-
-    priv_lcs = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation_lcs);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
-    first_lcs = priv_lcs->first;
-    second_lcs = priv_lcs->second;
+  g_assert(!INF_ADOPTED_IS_SPLIT_OPERATION(operation_lcs) ||
+           against_lcs != NULL);
 
-    new_against_lcs = inf_adopted_operation_transform(
-      against_lcs,
-      first_lcs,
-      against_lcs,
-      first_lcs,
-      -concurrency_id
-    );
-  }
-  else if(operation_lcs != NULL)
-  {
-    first_lcs = operation_lcs;
-    second_lcs = operation_lcs;
+  /* (A1, A2, ..., An) transformed against T is (T A1, (A1 T) A2, ...),
+   * where each part is transformed against T with the effect of all
+   * previous parts included. */
+  new_against = against;
+  g_object_ref(new_against);
 
-    new_against_lcs = against_lcs;
+  new_against_lcs = against_lcs;
+  if(new_against_lcs != NULL)
     g_object_ref(new_against_lcs);
-  }
-  else
-  {
-    first_lcs = NULL;
-    second_lcs = NULL;
-    new_against_lcs = NULL;
-  }
 
-  new_first = inf_adopted_operation_transform(
-    priv->first,
-    against,
-    first_lcs,
-    against_lcs,
-    concurrency_id
-  );
+  parts = inf_adopted_split_operation_parts_new(priv->n_parts);
+  lcs_index = 0;
 
-  new_against = inf_adopted_operation_transform(
-    against,
-    priv->first,
-    against_lcs,
-    first_lcs,
-    -concurrency_id
-  );
+  for(i = 0; i < priv->n_parts; ++i)
+  {
+    part = &priv->parts[i];
+
+    part_lcs = NULL;
+    if(operation_lcs != NULL)
+    {
+      part_lcs = inf_adopted_split_operation_lcs_part(
+        operation_lcs,
+        part->group,
+        &lcs_index,
+        &new_against_lcs,
+        -concurrency_id
+      );
+    }
+
+    new_part = inf_adopted_operation_transform(
+      part->operation,
+      new_against,
+      part_lcs,
+      new_against_lcs,
+      concurrency_id
+    );
 
-  new_second = inf_adopted_operation_transform(
-    priv->second,
-    new_against,
-    second_lcs,
-    new_against_lcs,
-    concurrency_id
-  );
+    /* If the part is split by the transformation, then its parts are
+     * added right here instead of nesting split operations. */
+    inf_adopted_split_operation_append(parts, new_part, part->group);
+    g_object_unref(new_part);
+
+    if(i + 1 < priv->n_parts)
+    {
+      new_part = inf_adopted_operation_transform(
+        new_against,
+        part->operation,
+        new_against_lcs,
+        part_lcs,
+        -concurrency_id
+      );
+
+      g_object_unref(new_against);
+      new_against = new_part;
+    }
+  }
 
+  g_object_unref(new_against);
   if(new_against_lcs != NULL)
     g_object_unref(new_against_lcs);
 
-  g_object_unref(new_against);
-
-  /* Note that even if one of the two is a no-op, we keep the split operation
-   * at this point. Parts of the split operation implementation relies on the
-   * fact that a split operation is never un-split during transformation. */
-
-  result = INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(new_first, new_second)
-  );
-
-  g_object_unref(G_OBJECT(new_first));
-  g_object_unref(G_OBJECT(new_second));
-
-  return result;
+  /* Note that even if some parts are no-ops, we keep them at this point.
+   * Parts of the split operation implementation rely on the fact that a
+   * split operation is never un-split during transformation. */
+  return inf_adopted_split_operation_new_from_parts(parts);
 }
 
 static InfAdoptedOperation*
 inf_adopted_split_operation_copy(InfAdoptedOperation* operation)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation* copy;
+  GArray* parts;
+  guint i;
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  parts = inf_adopted_split_operation_parts_new(priv->n_parts);
 
-  return INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(
-      inf_adopted_operation_copy(priv->first),
-      inf_adopted_operation_copy(priv->second)
-    )
-  );
+  for(i = 0; i < priv->n_parts; ++i)
+  {
+    copy = inf_adopted_operation_copy(priv->parts[i].operation);
+    inf_adopted_split_operation_append(parts, copy, priv->parts[i].group);
+    g_object_unref(copy);
+  }
+
+  return inf_adopted_split_operation_new_from_parts(parts);
 }
 
 static InfAdoptedOperationFlags
 inf_adopted_split_operation_get_flags(InfAdoptedOperation* operation)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedOperationFlags flags1;
-  InfAdoptedOperationFlags flags2;
+  InfAdoptedOperationFlags flags;
   InfAdoptedOperationFlags result;
+  guint i;
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
-
-  flags1 = inf_adopted_operation_get_flags(priv->first);
-  flags2 = inf_adopted_operation_get_flags(priv->second);
-  result = 0;
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  result = INF_ADOPTED_OPERATION_REVERSIBLE;
 
-  if( (flags1 & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0 ||
-      (flags2 & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0)
+  for(i = 0; i < priv->n_parts; ++i)
   {
-    result |= INF_ADOPTED_OPERATION_AFFECTS_BUFFER;
-  }
+    flags = inf_adopted_operation_get_flags(priv->parts[i].operation);
 
-  if( (flags1 & INF_ADOPTED_OPERATION_REVERSIBLE) != 0 &&
-      (flags2 & INF_ADOPTED_OPERATION_REVERSIBLE) != 0)
-  {
-    result |= INF_ADOPTED_OPERATION_REVERSIBLE;
+    if( (flags & INF_ADOPTED_OPERATION_AFFECTS_BUFFER) != 0)
+      result |= INF_ADOPTED_OPERATION_AFFECTS_BUFFER;
+    if( (flags & INF_ADOPTED_OPERATION_REVERSIBLE) == 0)
+      result &= ~INF_ADOPTED_OPERATION_REVERSIBLE;
   }
 
   return result;
@@ -415,16 +598,20 @@ inf_adopted_split_operation_apply(InfAdoptedOperation* operation,
                                   InfBuffer* buffer,
                                   GError** error)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
+  guint i;
+
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
+  for(i = 0; i < priv->n_parts; ++i)
+  {
+    if(!inf_adopted_operation_apply(priv->parts[i].operation, by, buffer,
+                                    error))
+    {
+      return FALSE;
+    }
+  }
 
-  if(!inf_adopted_operation_apply(priv->first, by, buffer, error))
-    return FALSE;
-  if(!inf_adopted_operation_apply(priv->second, by, buffer, error))
-    return FALSE;
   return TRUE;
 }
 
@@ -435,94 +622,137 @@ inf_adopted_split_operation_apply_transformed(InfAdoptedOperation* operation,
                                               InfBuffer* buffer,
                                               GError** error)
 {
-  InfAdoptedSplitOperation* split;
-  InfAdoptedSplitOperation* trans_split;
-
   InfAdoptedSplitOperationPrivate* priv;
   InfAdoptedSplitOperationPrivate* trans_priv;
+  InfAdoptedSplitOperationPart* part;
 
-  InfAdoptedOperation* ret_first;
-  InfAdoptedOperation* ret_second;
-  InfAdoptedSplitOperation* result;
+  GArray* trans_parts;
+  InfAdoptedOperation* trans_part;
+  InfAdoptedOperation* ret_part;
+  GArray* result;
+  gboolean modified;
+  guint begin;
+  guint end;
+  guint i;
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
 
   /* The transformed operation must be a split operation, too,
    * since we do no never unsplit operations when transforming */
   g_assert(INF_ADOPTED_IS_SPLIT_OPERATION(transformed));
-  trans_split = INF_ADOPTED_SPLIT_OPERATION(transformed);
-  trans_priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(trans_split);
-
-  ret_first = inf_adopted_operation_apply_transformed(
-    priv->first,
-    trans_priv->first,
-    by,
-    buffer,
-    error
-  );
+  trans_priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(transformed);
 
-  if(ret_first == NULL)
-    return NULL;
-
-  ret_second = inf_adopted_operation_apply_transformed(
-    priv->second,
-    trans_priv->second,
-    by,
-    buffer,
-    error
-  );
+  result = inf_adopted_split_operation_parts_new(priv->n_parts);
+  modified = FALSE;
+  end = 0;
 
-  if(ret_second == NULL)
+  for(i = 0; i < priv->n_parts; ++i)
   {
-    g_object_unref(ret_first);
-    return NULL;
+    part = &priv->parts[i];
+
+    /* Find the parts of the transformed operation originating from this
+     * one. The groups are in ascending order in both operations. */
+    begin = end;
+    while(end < trans_priv->n_parts &&
+          trans_priv->parts[end].group == part->group)
+    {
+      ++end;
+    }
+
+    g_assert(end > begin);
+
+    if(end - begin == 1)
+    {
+      trans_part = trans_priv->parts[begin].operation;
+      g_object_ref(trans_part);
+    }
+    else
+    {
+      trans_parts = inf_adopted_split_operation_parts_new(end - begin);
+      for(; begin < end; ++begin)
+      {
+        inf_adopted_split_operation_append(
+          trans_parts,
+          trans_priv->parts[begin].operation,
+          trans_parts->len
+        );
+      }
+
+      trans_part = inf_adopted_split_operation_new_from_parts(trans_parts);
+    }
+
+    ret_part = inf_adopted_operation_apply_transformed(
+      part->operation,
+      trans_part,
+      by,
+      buffer,
+      error
+    );
+
+    g_object_unref(trans_part);
+
+    if(ret_part == NULL)
+    {
+      inf_adopted_split_operation_parts_free(result);
+      return NULL;
+    }
+
+    if(ret_part != part->operation)
+      modified = TRUE;
+
+    inf_adopted_split_operation_append(result, ret_part, result->len);
+    g_object_unref(ret_part);
   }
 
-  if(ret_first == priv->first && ret_second == priv->second)
+  if(modified == FALSE)
   {
     /* No operation was modified to be reversible; skip this case */
-    g_object_unref(ret_first);
-    g_object_unref(ret_second);
+    inf_adopted_split_operation_parts_free(result);
+    g_object_ref(operation);
     return operation;
   }
   else
   {
     /* Otherwise create a new operation */
-    result = inf_adopted_split_operation_new(
-      ret_first,
-      ret_second
-    );
-
-    g_object_unref(ret_first);
-    g_object_unref(ret_second);
-
-    return INF_ADOPTED_OPERATION(result);
+    return inf_adopted_split_operation_new_from_parts(result);
   }
 }
 
 static InfAdoptedOperation*
 inf_adopted_split_operation_revert(InfAdoptedOperation* operation)
 {
-  InfAdoptedSplitOperation* split;
   InfAdoptedSplitOperationPrivate* priv;
+  InfAdoptedOperation* revert_part;
+  GArray* parts;
+  guint i;
 
-  InfAdoptedOperation* revert_first;
-  InfAdoptedOperation* revert_second;
-  InfAdoptedSplitOperation* result;
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  parts = inf_adopted_split_operation_parts_new(priv->n_parts);
 
-  split = INF_ADOPTED_SPLIT_OPERATION(operation);
-  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
+  for(i = priv->n_parts; i > 0; --i)
+  {
+    revert_part = inf_adopted_operation_revert(priv->parts[i - 1].operation);
+    inf_adopted_split_operation_append(parts, revert_part, parts->len);
+    g_object_unref(revert_part);
+  }
 
-  revert_first = inf_adopted_operation_revert(priv->first);
-  revert_second = inf_adopted_operation_revert(priv->second);
+  return inf_adopted_split_operation_new_from_parts(parts);
+}
+
+static gsize
+inf_adopted_split_operation_get_size(InfAdoptedOperation* operation)
+{
+  InfAdoptedSplitOperationPrivate* priv;
+  gsize size;
+  guint i;
 
-  result = inf_adopted_split_operation_new(revert_second, revert_first);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
+  size = 0;
 
-  g_object_unref(revert_first);
-  g_object_unref(revert_second);
+  for(i = 0; i < priv->n_parts; ++i)
+    size += inf_adopted_operation_get_size(priv->parts[i].operation);
 
-  return INF_ADOPTED_OPERATION(result);
+  return size;
 }
 
 static void
@@ -537,6 +767,7 @@ inf_adopted_split_operation_operation_iface_init(
   iface->apply = inf_adopted_split_operation_apply;
   iface->apply_transformed = inf_adopted_split_operation_apply_transformed;
   iface->revert = inf_adopted_split_operation_revert;
+  iface->get_size = inf_adopted_split_operation_get_size;
 }
 
 /**
@@ -568,6 +799,44 @@ inf_adopted_split_operation_new(InfAdoptedOperation* first,
   return INF_ADOPTED_SPLIT_OPERATION(object);
 }
 
+/**
+ * inf_adopted_split_operation_new_multiple:
+ * @operations: (array length=n_operations): The operations to wrap.
+ * @n_operations: The number of operations in @operations, at least two.
+ *
+ * Creates a new #InfAdoptedSplitOperation which applies all operations in
+ * @operations in order. This is equivalent to nesting split operations
+ * created with inf_adopted_split_operation_new(), but does not create the
+ * intermediate split operations.
+ *
+ * Returns: (transfer full): A new #InfAdoptedSplitOperation.
+ **/
+InfAdoptedSplitOperation*
+inf_adopted_split_operation_new_multiple(InfAdoptedOperation** operations,
+                                         guint n_operations)
+{
+  GArray* parts;
+  guint i;
+
+  g_return_val_if_fail(operations != NULL, NULL);
+  g_return_val_if_fail(n_operations >= 2, NULL);
+
+  for(i = 0; i < n_operations; ++i)
+    g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operations[i]), NULL);
+
+  parts = inf_adopted_split_operation_parts_new(n_operations);
+  for(i = 0; i < n_operations; ++i)
+    inf_adopted_split_operation_append(parts, operations[i], 0);
+
+  /* The parts of a new split operation originate from themselves */
+  for(i = 0; i < parts->len; ++i)
+    g_array_index(parts, InfAdoptedSplitOperationPart, i).group = i;
+
+  return INF_ADOPTED_SPLIT_OPERATION(
+    inf_adopted_split_operation_new_from_parts(parts)
+  );
+}
+
 /**
  * inf_adopted_split_operation_unsplit:
  * @operation: A #InfAdoptedSplitOperation.
@@ -583,10 +852,20 @@ inf_adopted_split_operation_new(InfAdoptedOperation* first,
 GSList*
 inf_adopted_split_operation_unsplit(InfAdoptedSplitOperation* operation)
 {
+  InfAdoptedSplitOperationPrivate* priv;
   GSList* result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SPLIT_OPERATION(operation), NULL);
 
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(operation);
   result = NULL;
-  inf_adopted_split_operation_unsplit_impl(operation, &result);
+
+  /* Since we prepend the entries to the list, we begin with the last
+   * operation so that the list actually contains the operations in order. */
+  for(i = priv->n_parts; i > 0; --i)
+    result = g_slist_prepend(result, priv->parts[i - 1].operation);
+
   return result;
 }
 
@@ -611,72 +890,61 @@ inf_adopted_split_operation_transform_other(InfAdoptedSplitOperation* op,
                                             gint concurrency_id)
 {
   InfAdoptedSplitOperationPrivate* priv;
-  InfAdoptedSplitOperationPrivate* priv_lcs;
-  InfAdoptedOperation* tmp;
+  InfAdoptedSplitOperationPart* part;
+  InfAdoptedOperation* part_lcs;
   InfAdoptedOperation* result;
-
-  InfAdoptedOperation* first_lcs;
-  InfAdoptedOperation* second_lcs;
-  InfAdoptedOperation* tmp_lcs;
+  InfAdoptedOperation* result_lcs;
+  InfAdoptedOperation* tmp;
+  guint lcs_index;
+  guint i;
 
   g_return_val_if_fail(INF_ADOPTED_IS_SPLIT_OPERATION(op), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(other), NULL);
 
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(op);
-  
-  if(INF_ADOPTED_IS_SPLIT_OPERATION(op_lcs))
-  {
-    g_assert(other_lcs != NULL);
+  g_assert(op_lcs == NULL || other_lcs != NULL);
 
-    priv_lcs = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(op_lcs);
-    first_lcs = priv_lcs->first;
-    second_lcs = priv_lcs->second;
+  /* other transformed against (A1, A2, ..., An) is An (... (A2 (A1 other))) */
+  result = other;
+  g_object_ref(result);
 
-    tmp_lcs = inf_adopted_operation_transform(
-      other_lcs,
-      first_lcs,
-      other_lcs,
-      first_lcs,
-      concurrency_id
-    );
-  }
-  else if(op_lcs != NULL)
-  {
-    g_assert(other_lcs != NULL);
+  result_lcs = other_lcs;
+  if(result_lcs != NULL)
+    g_object_ref(result_lcs);
 
-    first_lcs = op_lcs;
-    second_lcs = op_lcs;
+  lcs_index = 0;
 
-    tmp_lcs = other_lcs;
-    g_object_ref(tmp_lcs);
-  }
-  else
+  for(i = 0; i < priv->n_parts; ++i)
   {
-    first_lcs = NULL;
-    second_lcs = NULL;
-    tmp_lcs = NULL;
-  }
-
-  tmp = inf_adopted_operation_transform(
-    other,
-    priv->first,
-    other_lcs,
-    first_lcs,
-    concurrency_id
-  );
+    part = &priv->parts[i];
+
+    part_lcs = NULL;
+    if(op_lcs != NULL)
+    {
+      part_lcs = inf_adopted_split_operation_lcs_part(
+        op_lcs,
+        part->group,
+        &lcs_index,
+        &result_lcs,
+        concurrency_id
+      );
+    }
+
+    tmp = inf_adopted_operation_transform(
+      result,
+      part->operation,
+      result_lcs,
+      part_lcs,
+      concurrency_id
+    );
 
-  result = inf_adopted_operation_transform(
-    tmp,
-    priv->second,
-    tmp_lcs,
-    second_lcs,
-    concurrency_id
-  );
+    g_object_unref(result);
+    result = tmp;
+  }
 
-  if(tmp_lcs != NULL)
-    g_object_unref(tmp_lcs);
+  if(result_lcs != NULL)
+    g_object_unref(result_lcs);
 
-  g_object_unref(tmp);
   return result;
 }
 
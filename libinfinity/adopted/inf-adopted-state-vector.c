@@ -43,12 +43,6 @@ G_DEFINE_BOXED_TYPE(InfAdoptedStateVector, inf_adopted_state_vector, inf_adopted
  * performed by each user. This number is called a timestamp, although it has
  * nothing to do with actual time. */
 
-typedef struct _InfAdoptedStateVectorComponent InfAdoptedStateVectorComponent;
-struct _InfAdoptedStateVectorComponent {
-  guint id;
-  guint n; /* timestamp */
-};
-
 typedef struct _InfAdoptedStateVectorForeachData
   InfAdoptedStateVectorForeachData;
 struct _InfAdoptedStateVectorForeachData {
@@ -56,11 +50,39 @@ struct _InfAdoptedStateVectorForeachData {
   gpointer user_data;
 };
 
-struct _InfAdoptedStateVector {
-  gsize size;
-  gsize max_size;
-  InfAdoptedStateVectorComponent* data;
-};
+/* Vectors with up to INF_ADOPTED_STATE_VECTOR_INLINE_SIZE components keep
+ * them in inline_data, so that data points into the structure itself. Only
+ * larger vectors allocate a separate component array on the heap. Most
+ * sessions have only a few users, so this saves an allocation for nearly
+ * every copy. */
+
+static void
+inf_adopted_state_vector_reserve(InfAdoptedStateVector* vec,
+                                 gsize size)
+{
+  gsize new_size;
+
+  if(size <= vec->max_size)
+    return;
+
+  new_size = vec->max_size * 2;
+  if(new_size < size)
+    new_size = size;
+
+  if(vec->data == vec->inline_data)
+  {
+    vec->data = g_malloc(new_size * sizeof(InfAdoptedStateVectorComponent));
+    memcpy(vec->data, vec->inline_data,
+           vec->size * sizeof(InfAdoptedStateVectorComponent));
+  }
+  else
+  {
+    vec->data = g_realloc(vec->data,
+                new_size * sizeof(InfAdoptedStateVectorComponent));
+  }
+
+  vec->max_size = new_size;
+}
 
 static gsize
 inf_adopted_state_vector_find_insert_pos(const InfAdoptedStateVector* vec,
@@ -118,12 +140,7 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
 {
   InfAdoptedStateVectorComponent* comp;
 
-  if(vec->max_size <= vec->size)
-  {
-    vec->max_size += 5;
-    vec->data = g_realloc(vec->data,
-                vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-  }
+  inf_adopted_state_vector_reserve(vec, vec->size + 1);
 
   comp = vec->data + insert_pos;
   if(insert_pos < vec->size)
@@ -144,6 +161,129 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
   return comp;
 }
 
+/* Appends "id:n" to str, separated with ';' from a previous component.
+ * This is called for every component of every request that is sent, so it
+ * avoids the printf machinery. */
+static void
+inf_adopted_state_vector_append_component(GString* str,
+                                          guint id,
+                                          guint n)
+{
+  /* Two numbers with up to 10 digits each, ':' and ';' */
+  gchar buf[22];
+  gchar* pos;
+
+  pos = buf + sizeof(buf);
+
+  do
+  {
+    *--pos = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+
+  *--pos = ':';
+
+  do
+  {
+    *--pos = '0' + id % 10;
+    id /= 10;
+  } while(id > 0);
+
+  if(str->len > 0) *--pos = ';';
+
+  g_string_append_len(str, pos, buf + sizeof(buf) - pos);
+}
+
+static guint
+inf_adopted_state_vector_parse_uint(const gchar* str,
+                                    const gchar** endpos)
+{
+  guint value;
+
+  value = 0;
+  while(*str >= '0' && *str <= '9')
+  {
+    value = value * 10 + (*str - '0');
+    ++str;
+  }
+
+  *endpos = str;
+  return value;
+}
+
+/* Parses the string representation of a state vector into vec, which
+ * must be empty. */
+static gboolean
+inf_adopted_state_vector_parse(InfAdoptedStateVector* vec,
+                               const gchar* str,
+                               GError** error)
+{
+  const gchar* strpos;
+  const gchar* endpos;
+  gsize pos;
+  guint id;
+  guint n;
+
+  strpos = str;
+
+  while(*strpos)
+  {
+    id = inf_adopted_state_vector_parse_uint(strpos, &endpos);
+    if(*endpos != ':')
+    {
+      g_set_error_literal(
+        error,
+        inf_adopted_state_vector_error_quark(),
+        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
+        _("Expected \":\" after ID")
+      );
+
+      return FALSE;
+    }
+
+    /* Components are normally ordered by ID, so try appending first */
+    if(vec->size == 0 || vec->data[vec->size - 1].id < id)
+      pos = vec->size;
+    else
+      pos = inf_adopted_state_vector_find_insert_pos(vec, id);
+
+    if(pos < vec->size && vec->data[pos].id == id)
+    {
+      g_set_error(
+        error,
+        inf_adopted_state_vector_error_quark(),
+        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
+        _("ID '%u' already occurred before"),
+        id
+      );
+
+      return FALSE;
+    }
+
+    strpos = endpos + 1; /* step over ':' */
+    n = inf_adopted_state_vector_parse_uint(strpos, &endpos);
+
+    if(*endpos != ';' && *endpos != '\0')
+    {
+      g_set_error(
+        error,
+        inf_adopted_state_vector_error_quark(),
+        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
+        _("Expected ';' or end of string after component of ID '%u'"),
+        id
+      );
+
+      return FALSE;
+    }
+
+    inf_adopted_state_vector_insert(vec, id, n, pos);
+    strpos = endpos;
+    if(*strpos != '\0') ++ strpos; /* step over ';' */
+  }
+
+  return TRUE;
+}
+
 /**
  * inf_adopted_state_vector_error_quark:
  *
@@ -170,9 +310,7 @@ inf_adopted_state_vector_new(void)
   InfAdoptedStateVector* vec;
 
   vec = g_slice_new(InfAdoptedStateVector);
-  vec->size = 0;
-  vec->max_size = 0;
-  vec->data = NULL;
+  inf_adopted_state_vector_init(vec);
 
   return vec;
 }
@@ -193,20 +331,8 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec)
   g_return_val_if_fail(vec != NULL, NULL);
 
   new_vec = g_slice_new(InfAdoptedStateVector);
-  new_vec->size = vec->size;
-  new_vec->max_size = vec->max_size;
-
-  if(new_vec->max_size == 0)
-  {
-    new_vec->data = NULL;
-  }
-  else
-  {
-    new_vec->data =
-      g_malloc(new_vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-    memcpy(new_vec->data, vec->data,
-           new_vec->size * sizeof(InfAdoptedStateVectorComponent));
-  }
+  inf_adopted_state_vector_init(new_vec);
+  inf_adopted_state_vector_assign(new_vec, vec);
 
   return new_vec;
 }
@@ -223,10 +349,87 @@ inf_adopted_state_vector_free(InfAdoptedStateVector* vec)
 {
   g_return_if_fail(vec != NULL);
 
-  g_free(vec->data);
+  if(vec->data != vec->inline_data)
+    g_free(vec->data);
   g_slice_free(InfAdoptedStateVector, vec);
 }
 
+/**
+ * inf_adopted_state_vector_init:
+ * @vec: Uninitialized memory for a #InfAdoptedStateVector.
+ *
+ * Initializes @vec so that all of its components are zero. This is meant
+ * for temporary state vectors which are allocated on the stack, in order to
+ * avoid a heap allocation for transient results:
+ *
+ * |[
+ * InfAdoptedStateVector scratch;
+ * inf_adopted_state_vector_init(&scratch);
+ * inf_adopted_state_vector_assign(&scratch, first);
+ * inf_adopted_state_vector_max(&scratch, second);
+ * ...
+ * inf_adopted_state_vector_clear(&scratch);
+ * ]|
+ *
+ * A vector initialized with this function must be released with
+ * inf_adopted_state_vector_clear(), not with inf_adopted_state_vector_free().
+ * Use inf_adopted_state_vector_copy() to keep its value beyond that.
+ **/
+void
+inf_adopted_state_vector_init(InfAdoptedStateVector* vec)
+{
+  g_return_if_fail(vec != NULL);
+
+  vec->size = 0;
+  vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+  vec->data = vec->inline_data;
+}
+
+/**
+ * inf_adopted_state_vector_clear:
+ * @vec: A #InfAdoptedStateVector initialized with
+ * inf_adopted_state_vector_init().
+ *
+ * Releases all memory @vec has allocated, and resets all of its components
+ * to zero. The memory for @vec itself is not freed, and @vec can be used
+ * again afterwards.
+ **/
+void
+inf_adopted_state_vector_clear(InfAdoptedStateVector* vec)
+{
+  g_return_if_fail(vec != NULL);
+
+  if(vec->data != vec->inline_data)
+    g_free(vec->data);
+  inf_adopted_state_vector_init(vec);
+}
+
+/**
+ * inf_adopted_state_vector_assign:
+ * @vec: A #InfAdoptedStateVector.
+ * @src: The #InfAdoptedStateVector to copy from.
+ *
+ * Sets all components of @vec to the values they have in @src. Memory
+ * already allocated by @vec is reused if possible.
+ **/
+void
+inf_adopted_state_vector_assign(InfAdoptedStateVector* vec,
+                                const InfAdoptedStateVector* src)
+{
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(src != NULL);
+
+  if(vec == src)
+    return;
+
+  vec->size = 0;
+  inf_adopted_state_vector_reserve(vec, src->size);
+
+  memcpy(vec->data, src->data,
+         src->size * sizeof(InfAdoptedStateVectorComponent));
+  vec->size = src->size;
+}
+
 /**
  * inf_adopted_state_vector_get:
  * @vec: A #InfAdoptedStateVector.
@@ -431,6 +634,39 @@ inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
   }
 }
 
+/**
+ * inf_adopted_state_vector_hash:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Computes a hash value for @vec. Two state vectors which compare equal with
+ * inf_adopted_state_vector_compare() have the same hash value, so this
+ * function can be used together with inf_adopted_state_vector_compare() to
+ * use state vectors as keys in a #GHashTable.
+ *
+ * Returns: A hash value for @vec.
+ **/
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec)
+{
+  gsize pos;
+  guint hash;
+
+  g_return_val_if_fail(vec != NULL, 0);
+
+  hash = 5381;
+  for(pos = 0; pos < vec->size; ++pos)
+  {
+    /* Components with value zero compare equal to missing ones */
+    if(vec->data[pos].n > 0)
+    {
+      hash = hash * 33 + vec->data[pos].id;
+      hash = hash * 33 + vec->data[pos].n;
+    }
+  }
+
+  return hash;
+}
+
 /**
  * inf_adopted_state_vector_causally_before:
  * @first: A #InfAdoptedStateVector.
@@ -635,25 +871,250 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second)
 {
-  gsize n;
-  guint first_sum;
-  guint second_sum;
+  gsize first_pos;
+  gsize second_pos;
+  InfAdoptedStateVectorComponent* first_comp;
+  InfAdoptedStateVectorComponent* second_comp;
+  guint diff;
 
-  g_return_val_if_fail(
-    inf_adopted_state_vector_causally_before(first, second) == TRUE,
-    0
-  );
+  g_return_val_if_fail(first != NULL, 0);
+  g_return_val_if_fail(second != NULL, 0);
+
+  first_pos = 0;
+  second_pos = 0;
+  diff = 0;
+
+  /* Both vectors are sorted by ID, so walk them in parallel. This checks
+   * the causality requirement and computes the difference in one pass. */
+  while(first_pos < first->size)
+  {
+    first_comp = first->data + first_pos;
+
+    while(second_pos < second->size &&
+          second->data[second_pos].id < first_comp->id)
+    {
+      diff += second->data[second_pos].n;
+      ++second_pos;
+    }
 
-  first_sum = 0;
-  second_sum = 0;
+    if(second_pos < second->size &&
+       second->data[second_pos].id == first_comp->id)
+    {
+      second_comp = second->data + second_pos;
+      g_return_val_if_fail(first_comp->n <= second_comp->n, 0);
 
-  for(n = 0; n < first->size; ++ n)
-    first_sum += first->data[n].n;
-  for(n = 0; n < second->size; ++ n)
-    second_sum += second->data[n].n;
+      diff += second_comp->n - first_comp->n;
+      ++second_pos;
+    }
+    else
+    {
+      /* Not contained in second, so its value there is 0 */
+      g_return_val_if_fail(first_comp->n == 0, 0);
+    }
 
-  g_assert(second_sum >= first_sum);
-  return second_sum - first_sum;
+    ++first_pos;
+  }
+
+  while(second_pos < second->size)
+  {
+    diff += second->data[second_pos].n;
+    ++second_pos;
+  }
+
+  return diff;
+}
+
+/**
+ * inf_adopted_state_vector_least_common_successor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector so that both @first and @second are causally
+ * before it, and so that there is no other state vector with the same
+ * property which is causally before it. Each component of the result is the
+ * maximum of the corresponding components of @first and @second.
+ *
+ * This runs in time linear in the number of components of @first and
+ * @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector. Free with
+ * inf_adopted_state_vector_free() when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  InfAdoptedStateVector* result;
+
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
+
+  result = inf_adopted_state_vector_copy((InfAdoptedStateVector*)first);
+  inf_adopted_state_vector_max(result, second);
+  return result;
+}
+
+/**
+ * inf_adopted_state_vector_least_common_predecessor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector which is causally before both @first and
+ * @second, and so that there is no other state vector with the same
+ * property that it is causally before. Each component of the result is the
+ * minimum of the corresponding components of @first and @second.
+ *
+ * This runs in time linear in the number of components of @first and
+ * @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector. Free with
+ * inf_adopted_state_vector_free() when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  InfAdoptedStateVector* result;
+
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
+
+  result = inf_adopted_state_vector_copy((InfAdoptedStateVector*)first);
+  inf_adopted_state_vector_min(result, second);
+  return result;
+}
+
+/**
+ * inf_adopted_state_vector_max:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the maximum of itself and the
+ * corresponding component of @other. Afterwards, @vec is the least common
+ * successor of its previous value and @other. Memory is only allocated if
+ * the result has more components than fit into the space @vec has already
+ * reserved.
+ **/
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  gsize vec_pos;
+  gsize other_pos;
+  gsize missing;
+  gsize pos;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+
+  /* Count the components of other that vec does not have yet */
+  vec_pos = 0;
+  missing = 0;
+  for(other_pos = 0; other_pos < other->size; ++other_pos)
+  {
+    while(vec_pos < vec->size &&
+          vec->data[vec_pos].id < other->data[other_pos].id)
+    {
+      ++vec_pos;
+    }
+
+    if(vec_pos < vec->size &&
+       vec->data[vec_pos].id == other->data[other_pos].id)
+    {
+      if(other->data[other_pos].n > vec->data[vec_pos].n)
+        vec->data[vec_pos].n = other->data[other_pos].n;
+      ++vec_pos;
+    }
+    else if(other->data[other_pos].n > 0)
+    {
+      ++missing;
+    }
+  }
+
+  if(missing == 0)
+    return;
+
+  /* Merge the missing components in from the back, so that components of
+   * vec are only moved after their new position has been vacated. Existing
+   * components already hold the maximum from the first pass. */
+  inf_adopted_state_vector_reserve(vec, vec->size + missing);
+
+  vec_pos = vec->size;
+  other_pos = other->size;
+  pos = vec->size + missing;
+
+  while(other_pos > 0)
+  {
+    if(vec_pos > 0 &&
+       vec->data[vec_pos - 1].id >= other->data[other_pos - 1].id)
+    {
+      if(vec->data[vec_pos - 1].id == other->data[other_pos - 1].id)
+        --other_pos;
+
+      --vec_pos;
+      --pos;
+      vec->data[pos] = vec->data[vec_pos];
+    }
+    else
+    {
+      --other_pos;
+      if(other->data[other_pos].n > 0)
+      {
+        --pos;
+        vec->data[pos] = other->data[other_pos];
+      }
+    }
+  }
+
+  /* The remaining components of vec are already in place */
+  g_assert(pos == vec_pos);
+  vec->size += missing;
+}
+
+/**
+ * inf_adopted_state_vector_min:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the minimum of itself and the
+ * corresponding component of @other. Afterwards, @vec is the least common
+ * predecessor of its previous value and @other. This function never
+ * allocates memory.
+ **/
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  gsize vec_pos;
+  gsize other_pos;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+
+  other_pos = 0;
+  for(vec_pos = 0; vec_pos < vec->size; ++vec_pos)
+  {
+    while(other_pos < other->size &&
+          other->data[other_pos].id < vec->data[vec_pos].id)
+    {
+      ++other_pos;
+    }
+
+    if(other_pos < other->size &&
+       other->data[other_pos].id == vec->data[vec_pos].id)
+    {
+      if(other->data[other_pos].n < vec->data[vec_pos].n)
+        vec->data[vec_pos].n = other->data[other_pos].n;
+      ++other_pos;
+    }
+    else
+    {
+      /* Not contained in other, so its value there is 0 */
+      vec->data[vec_pos].n = 0;
+    }
+  }
 }
 
 /**
@@ -682,10 +1143,11 @@ inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec)
 
     if(component->n > 0)
     {
-      if(str->len > 0)
-        g_string_append_c(str, ';');
-
-      g_string_append_printf(str, "%u:%u", component->id, component->n);
+      inf_adopted_state_vector_append_component(
+        str,
+        component->id,
+        component->n
+      );
     }
   }
 
@@ -707,68 +1169,14 @@ inf_adopted_state_vector_from_string(const gchar* str,
                                      GError** error)
 {
   InfAdoptedStateVector* vec;
-  const char* strpos;
-  char* endpos;
-  gsize pos;
-  guint id;
-  guint n;
 
   g_return_val_if_fail(str != NULL, NULL);
 
   vec = inf_adopted_state_vector_new();
-  strpos = str;
-
-  while(*strpos)
+  if(!inf_adopted_state_vector_parse(vec, str, error))
   {
-    id = strtoul(strpos, &endpos, 10);
-    if(*endpos != ':')
-    {
-      g_set_error_literal(
-        error,
-        inf_adopted_state_vector_error_quark(),
-        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
-        _("Expected \":\" after ID")
-      );
-
-      inf_adopted_state_vector_free(vec);
-      return NULL;
-    }
-
-    pos = inf_adopted_state_vector_find_insert_pos(vec, id);
-    if(pos < vec->size && vec->data[pos].id == id)
-    {
-      g_set_error(
-        error,
-        inf_adopted_state_vector_error_quark(),
-        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
-        _("ID '%u' already occurred before"),
-        id
-      );
-
-      inf_adopted_state_vector_free(vec);
-      return NULL;
-    }
-
-    strpos = endpos + 1; /* step over ':' */
-    n = strtoul(strpos, &endpos, 10);
-
-    if(*endpos != ';' && *endpos != '\0')
-    {
-      g_set_error(
-        error,
-        inf_adopted_state_vector_error_quark(),
-        INF_ADOPTED_STATE_VECTOR_BAD_FORMAT,
-        _("Expected ';' or end of string after component of ID '%u'"),
-        id
-      );
-
-      inf_adopted_state_vector_free(vec);
-      return NULL;
-    }
-
-    inf_adopted_state_vector_insert(vec, id, n, pos);
-    strpos = endpos;
-    if(*strpos != '\0') ++ strpos; /* step over ';' */
+    inf_adopted_state_vector_free(vec);
+    return NULL;
   }
 
   return vec;
@@ -822,8 +1230,11 @@ inf_adopted_state_vector_to_string_diff(const InfAdoptedStateVector* vec,
     {
       /* There does not seem to be a corresponding entry in orig_comp, so
        * it is implicitely zero. */
-      if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(str, "%u:%u", vec_comp->id, vec_comp->n);
+      inf_adopted_state_vector_append_component(
+        str,
+        vec_comp->id,
+        vec_comp->n
+      );
 
       ++vec_pos;
 
@@ -838,10 +1249,8 @@ inf_adopted_state_vector_to_string_diff(const InfAdoptedStateVector* vec,
 
     if(vec_comp->n > orig_comp->n)
     {
-      if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(
+      inf_adopted_state_vector_append_component(
         str,
-        "%u:%u",
         vec_comp->id,
         vec_comp->n - orig_comp->n
       );
@@ -857,8 +1266,11 @@ inf_adopted_state_vector_to_string_diff(const InfAdoptedStateVector* vec,
     vec_comp = vec->data + vec_pos;
     if (vec_comp->n > 0)
     {
-      if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(str, "%u:%u", vec_comp->id, vec_comp->n);
+      inf_adopted_state_vector_append_component(
+        str,
+        vec_comp->id,
+        vec_comp->n
+      );
     }
 
     ++vec_pos;
@@ -885,67 +1297,57 @@ inf_adopted_state_vector_from_string_diff(const gchar* str,
                                           const InfAdoptedStateVector* orig,
                                           GError** error)
 {
+  InfAdoptedStateVector diff;
   InfAdoptedStateVector* vec;
-  gsize vec_pos;
+  InfAdoptedStateVectorComponent* comp;
+  gsize diff_pos;
   gsize orig_pos;
-  InfAdoptedStateVectorComponent* vec_comp;
-  InfAdoptedStateVectorComponent* orig_comp;
 
   g_return_val_if_fail(str != NULL, NULL);
   g_return_val_if_fail(orig != NULL, NULL);
 
-  vec = inf_adopted_state_vector_from_string(str, error);
-  if(vec == NULL) return NULL;
+  /* The diff usually only has a few components, so it is parsed on the
+   * stack, and then merged with orig in a single pass. */
+  inf_adopted_state_vector_init(&diff);
+  if(!inf_adopted_state_vector_parse(&diff, str, error))
+  {
+    inf_adopted_state_vector_clear(&diff);
+    return NULL;
+  }
 
-  vec_pos = 0;
+  vec = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_reserve(vec, diff.size + orig->size);
 
-  for(orig_pos = 0; orig_pos < orig->size; ++orig_pos)
+  diff_pos = 0;
+  orig_pos = 0;
+
+  while(diff_pos < diff.size || orig_pos < orig->size)
   {
-    orig_comp = orig->data + orig_pos;
-    if(orig_comp->n == 0) continue;
+    comp = vec->data + vec->size;
 
-    if(vec_pos == vec->size)
+    if(orig_pos == orig->size ||
+       (diff_pos < diff.size &&
+        diff.data[diff_pos].id < orig->data[orig_pos].id))
     {
-      inf_adopted_state_vector_insert(
-        vec,
-        orig_comp->id,
-        orig_comp->n,
-        vec_pos
-      );
+      *comp = diff.data[diff_pos++];
+    }
+    else if(diff_pos == diff.size ||
+            orig->data[orig_pos].id < diff.data[diff_pos].id)
+    {
+      *comp = orig->data[orig_pos++];
     }
     else
     {
-      vec_comp = vec->data + vec_pos;
-      while(vec_comp->id < orig_comp->id)
-      {
-        ++vec_pos;
-        if(vec_pos < vec->size)
-        {
-          vec_comp = vec->data + vec_pos;
-        }
-        else
-        {
-          break;
-        }
-      }
-
-      if(vec_comp->id == orig_comp->id)
-      {
-        vec_comp->n += orig_comp->n;
-        ++vec_pos;
-      }
-      else
-      {
-        inf_adopted_state_vector_insert(
-          vec,
-          orig_comp->id,
-          orig_comp->n,
-          vec_pos
-        );
-      }
+      comp->id = diff.data[diff_pos].id;
+      comp->n = diff.data[diff_pos].n + orig->data[orig_pos].n;
+      ++diff_pos;
+      ++orig_pos;
     }
+
+    ++vec->size;
   }
 
+  inf_adopted_state_vector_clear(&diff);
   return vec;
 }
 
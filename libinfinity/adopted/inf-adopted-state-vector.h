@@ -26,13 +26,38 @@ G_BEGIN_DECLS
 
 #define INF_ADOPTED_TYPE_STATE_VECTOR            (inf_adopted_state_vector_get_type())
 
+/**
+ * INF_ADOPTED_STATE_VECTOR_INLINE_SIZE:
+ *
+ * The number of components an #InfAdoptedStateVector can hold without
+ * allocating memory on the heap.
+ */
+#define INF_ADOPTED_STATE_VECTOR_INLINE_SIZE 8
+
+typedef struct _InfAdoptedStateVectorComponent InfAdoptedStateVectorComponent;
+struct _InfAdoptedStateVectorComponent {
+  /*< private >*/
+  guint id;
+  guint n; /* timestamp */
+};
+
 /**
  * InfAdoptedStateVector:
  *
  * #InfAdoptedStateVector is an opaque data type. You should only access it
- * via the public API functions.
+ * via the public API functions. The structure is only declared publicly so
+ * that temporary state vectors can be placed on the stack, see
+ * inf_adopted_state_vector_init(). It must not be copied by value.
  */
 typedef struct _InfAdoptedStateVector InfAdoptedStateVector;
+struct _InfAdoptedStateVector {
+  /*< private >*/
+  gsize size;
+  gsize max_size;
+  InfAdoptedStateVectorComponent* data;
+  InfAdoptedStateVectorComponent
+    inline_data[INF_ADOPTED_STATE_VECTOR_INLINE_SIZE];
+};
 
 /**
  * InfAdoptedStateVectorError:
@@ -78,6 +103,16 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec);
 void
 inf_adopted_state_vector_free(InfAdoptedStateVector* vec);
 
+void
+inf_adopted_state_vector_init(InfAdoptedStateVector* vec);
+
+void
+inf_adopted_state_vector_clear(InfAdoptedStateVector* vec);
+
+void
+inf_adopted_state_vector_assign(InfAdoptedStateVector* vec,
+                                const InfAdoptedStateVector* src);
+
 guint
 inf_adopted_state_vector_get(const InfAdoptedStateVector* vec,
                              guint id);
@@ -101,6 +136,9 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second);
 
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec);
+
 gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second);
@@ -115,6 +153,24 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second);
 
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
 gchar*
 inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec);
 
@@ -51,6 +51,15 @@ typedef struct _InfAdoptedUndoGroupingItem InfAdoptedUndoGroupingItem;
 struct _InfAdoptedUndoGroupingItem {
   InfAdoptedRequest* request;
   gboolean in_group;
+
+  /* Number of items before this one in the same group. This can be larger
+   * than the actual number if the beginning of the group has been removed
+   * from the buffer, so it needs to be clamped to the item position. */
+  guint group_offset;
+  /* For the first item of a group, the number of items in the group, or 0
+   * if the group is the last one and further requests can still be added
+   * to it. Unused for other items. */
+  guint group_length;
 };
 
 typedef enum __InfAdoptedUndoGroupingFlags {
@@ -68,6 +77,7 @@ typedef struct _InfAdoptedUndoGroupingPrivate InfAdoptedUndoGroupingPrivate;
 struct _InfAdoptedUndoGroupingPrivate {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedUser* user;
+  guint max_total_log_size; /* cached, construct-only in algorithm */
 
   InfAdoptedUndoGroupingItem* items;
   guint n_items;
@@ -100,12 +110,80 @@ static guint undo_grouping_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedUndoGrouping, inf_adopted_undo_grouping, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedUndoGrouping))
 
+/* pos is relative to first_item */
+static InfAdoptedUndoGroupingItem*
+inf_adopted_undo_grouping_get_item(InfAdoptedUndoGroupingPrivate* priv,
+                                   guint pos)
+{
+  return &priv->items[(priv->first_item + pos) % priv->n_alloc];
+}
+
+/* Returns the position of the first item of the group the item at pos
+ * belongs to. */
+static guint
+inf_adopted_undo_grouping_get_group_begin(InfAdoptedUndoGroupingPrivate* priv,
+                                          guint pos)
+{
+  InfAdoptedUndoGroupingItem* item;
+  item = inf_adopted_undo_grouping_get_item(priv, pos);
+
+  if(item->group_offset > pos)
+    return 0;
+  return pos - item->group_offset;
+}
+
+/* Returns the position after the last item of the group the item at pos
+ * belongs to. */
+static guint
+inf_adopted_undo_grouping_get_group_end(InfAdoptedUndoGroupingPrivate* priv,
+                                        guint pos)
+{
+  InfAdoptedUndoGroupingItem* first;
+  guint begin;
+
+  begin = inf_adopted_undo_grouping_get_group_begin(priv, pos);
+  first = inf_adopted_undo_grouping_get_item(priv, begin);
+
+  if(first->group_length == 0)
+    return priv->n_items;
+  return begin + first->group_length;
+}
+
+/* Returns whether the request at pos can still be undone or redone when
+ * count other requests are undone or redone before it. */
+static gboolean
+inf_adopted_undo_grouping_can_reach(InfAdoptedUndoGroupingPrivate* priv,
+                                    guint pos,
+                                    guint count)
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* lower_related;
+  guint vdiff;
+
+  log = inf_adopted_user_get_request_log(priv->user);
+
+  lower_related = inf_adopted_request_log_lower_related(
+    log,
+    inf_adopted_request_get_index(
+      inf_adopted_undo_grouping_get_item(priv, pos)->request
+    )
+  );
+
+  vdiff = inf_adopted_state_vector_vdiff(
+    inf_adopted_request_get_vector(lower_related),
+    inf_adopted_user_get_vector(priv->user)
+  );
+
+  return vdiff + count < priv->max_total_log_size;
+}
+
 static void
 inf_adopted_undo_grouping_add_request(InfAdoptedUndoGrouping* grouping,
                                       InfAdoptedRequest* request)
 {
   InfAdoptedUndoGroupingPrivate* priv;
   guint max;
+  guint begin;
   InfAdoptedUndoGroupingItem* item;
   InfAdoptedUndoGroupingItem* prev_item;
 
@@ -126,12 +204,7 @@ inf_adopted_undo_grouping_add_request(InfAdoptedUndoGrouping* grouping,
        * the algorithm's max total log size, since undoing one of the requests
        * in the log takes another request. We add +1 because we add the new
        * request before removing the old one. */
-      g_object_get(
-        G_OBJECT(priv->algorithm),
-        "max-total-log-size", &max,
-        NULL
-      );
-
+      max = priv->max_total_log_size;
       if(max != G_MAXUINT)
       {
         max = (max/2) + 1;
@@ -160,10 +233,19 @@ inf_adopted_undo_grouping_add_request(InfAdoptedUndoGrouping* grouping,
       }
     }
 
-    /* Cut redo possibilities */
+    /* Cut redo possibilities. The last remaining group can grow again. */
     priv->n_items = priv->item_pos;
     g_assert(priv->n_items < priv->n_alloc);
-    item = &priv->items[(priv->first_item + priv->item_pos) % priv->n_alloc];
+
+    if(priv->item_pos > 0)
+    {
+      inf_adopted_undo_grouping_get_item(
+        priv,
+        inf_adopted_undo_grouping_get_group_begin(priv, priv->item_pos - 1)
+      )->group_length = 0;
+    }
+
+    item = inf_adopted_undo_grouping_get_item(priv, priv->item_pos);
 
     item->request = request;
     g_object_ref(request);
@@ -195,9 +277,10 @@ inf_adopted_undo_grouping_add_request(InfAdoptedUndoGrouping* grouping,
       }
       else
       {
-        prev_item = &priv->items[
-          (priv->first_item + priv->item_pos - 1) % priv->n_alloc
-        ];
+        prev_item = inf_adopted_undo_grouping_get_item(
+          priv,
+          priv->item_pos - 1
+        );
 
         g_signal_emit(
           G_OBJECT(grouping),
@@ -215,6 +298,33 @@ inf_adopted_undo_grouping_add_request(InfAdoptedUndoGrouping* grouping,
       item->in_group = FALSE;
     }
 
+    item->group_length = 0;
+    if(item->in_group)
+    {
+      prev_item = inf_adopted_undo_grouping_get_item(
+        priv,
+        priv->item_pos - 1
+      );
+
+      item->group_offset = prev_item->group_offset + 1;
+    }
+    else
+    {
+      /* Close the previous group */
+      if(priv->item_pos > 0)
+      {
+        begin = inf_adopted_undo_grouping_get_group_begin(
+          priv,
+          priv->item_pos - 1
+        );
+
+        inf_adopted_undo_grouping_get_item(priv, begin)->group_length =
+          priv->item_pos - begin;
+      }
+
+      item->group_offset = 0;
+    }
+
     priv->group_flags &= ~(INF_ADOPTED_UNDO_GROUPING_FIRST_IN_GROUP |
                            INF_ADOPTED_UNDO_GROUPING_FIRST_AFTER_GROUP);
 
@@ -238,6 +348,7 @@ inf_adopted_undo_grouping_cleanup(InfAdoptedUndoGrouping* grouping)
 {
   InfAdoptedUndoGroupingPrivate* priv;
   InfAdoptedUndoGroupingItem* item;
+  InfAdoptedUndoGroupingItem* next;
   guint max_total_log_size;
   guint vdiff;
   guint i;
@@ -245,12 +356,7 @@ inf_adopted_undo_grouping_cleanup(InfAdoptedUndoGrouping* grouping)
   priv = INF_ADOPTED_UNDO_GROUPING_PRIVATE(grouping);
   g_assert(priv->user != NULL);
 
-  g_object_get(
-    priv->algorithm,
-    "max-total-log-size", &max_total_log_size,
-    NULL
-  );
-
+  max_total_log_size = priv->max_total_log_size;
   if(max_total_log_size != G_MAXUINT)
   {
     while(priv->n_items > 0)
@@ -286,9 +392,20 @@ inf_adopted_undo_grouping_cleanup(InfAdoptedUndoGrouping* grouping)
 
           /* Reuse buffer if we drop to zero */
           if(priv->n_items == 0)
+          {
             priv->first_item = 0;
+          }
           else
-            priv->items[priv->first_item].in_group = FALSE;
+          {
+            /* The next item takes over the rest of the group */
+            next = &priv->items[priv->first_item];
+            if(next->in_group && item->group_length > 0)
+              next->group_length = item->group_length - 1;
+            else if(next->in_group)
+              next->group_length = 0;
+
+            next->in_group = FALSE;
+          }
         }
       }
       else
@@ -356,7 +473,6 @@ inf_adopted_undo_grouping_init_user(InfAdoptedUndoGrouping* grouping)
   InfAdoptedUndoGroupingPrivate* priv;
   InfAdoptedRequestLog* log;
   InfAdoptedRequest* request;
-  guint max_total_log_size;
   guint end;
   guint i;
 
@@ -371,12 +487,6 @@ inf_adopted_undo_grouping_init_user(InfAdoptedUndoGrouping* grouping)
     grouping
   );
 
-  g_object_get(
-    priv->algorithm,
-    "max-total-log-size", &max_total_log_size,
-    NULL
-  );
-
   /* Add initial requests from request log */
   log = inf_adopted_user_get_request_log(priv->user);
   end = inf_adopted_request_log_get_end(log);
@@ -440,6 +550,7 @@ inf_adopted_undo_grouping_init(InfAdoptedUndoGrouping* grouping)
 
   priv->algorithm = NULL;
   priv->user = NULL;
+  priv->max_total_log_size = G_MAXUINT;
 
   priv->items = NULL;
   priv->n_items = 0;
@@ -699,6 +810,12 @@ inf_adopted_undo_grouping_set_algorithm(InfAdoptedUndoGrouping* grouping,
     {
       g_object_ref(algorithm);
 
+      g_object_get(
+        G_OBJECT(algorithm),
+        "max-total-log-size", &priv->max_total_log_size,
+        NULL
+      );
+
       g_signal_connect(
         G_OBJECT(priv->algorithm),
         "end-execute-request",
@@ -806,45 +923,33 @@ guint
 inf_adopted_undo_grouping_get_undo_size(InfAdoptedUndoGrouping* grouping)
 {
   InfAdoptedUndoGroupingPrivate* priv;
-  guint max_total_log_size;
-  InfAdoptedRequestLog* log;
-  InfAdoptedStateVector* current;
+  guint begin;
   guint pos;
-  guint index;
-  InfAdoptedRequest* lower_related;
-  InfAdoptedStateVector* vector;
-  guint vdiff;
 
   g_return_val_if_fail(INF_ADOPTED_IS_UNDO_GROUPING(grouping), 0);
 
   priv = INF_ADOPTED_UNDO_GROUPING_PRIVATE(grouping);
   if(priv->item_pos == 0) return 0;
 
-  g_object_get(
-    G_OBJECT(priv->algorithm),
-    "max-total-log-size",
-    &max_total_log_size,
-    NULL
-  );
-
-  log = inf_adopted_user_get_request_log(priv->user);
-  current = inf_adopted_user_get_vector(priv->user);
+  begin = inf_adopted_undo_grouping_get_group_begin(priv, priv->item_pos - 1);
 
-  pos = priv->item_pos;
-  do
+  /* Older requests are further away from the current state, so if the
+   * oldest request of the group can still be undone, then all of them can
+   * be. Otherwise, find out how much of the group can be undone. */
+  if(inf_adopted_undo_grouping_can_reach(priv, begin,
+                                         priv->item_pos - begin - 1))
   {
-    g_assert(pos > 0);
-
-    index = inf_adopted_request_get_index(priv->items[pos-1].request);
-    lower_related = inf_adopted_request_log_lower_related(log, index);
-    vector = inf_adopted_request_get_vector(lower_related);
-    vdiff = inf_adopted_state_vector_vdiff(vector, current);
-
-    if(vdiff + priv->item_pos - pos >= max_total_log_size)
-      return priv->item_pos - pos;
+    return priv->item_pos - begin;
+  }
 
-    --pos;
-  } while(priv->items[(priv->first_item + pos) % priv->n_alloc].in_group);
+  for(pos = priv->item_pos; pos > begin; --pos)
+  {
+    if(!inf_adopted_undo_grouping_can_reach(priv, pos - 1,
+                                            priv->item_pos - pos))
+    {
+      break;
+    }
+  }
 
   return priv->item_pos - pos;
 }
@@ -863,46 +968,28 @@ guint
 inf_adopted_undo_grouping_get_redo_size(InfAdoptedUndoGrouping* grouping)
 {
   InfAdoptedUndoGroupingPrivate* priv;
-  guint max_total_log_size;
-  InfAdoptedRequestLog* log;
-  InfAdoptedStateVector* current;
+  guint end;
   guint pos;
-  guint index;
-  InfAdoptedRequest* lower_related;
-  InfAdoptedStateVector* vector;
-  guint vdiff;
 
   g_return_val_if_fail(INF_ADOPTED_IS_UNDO_GROUPING(grouping), 0);
 
   priv = INF_ADOPTED_UNDO_GROUPING_PRIVATE(grouping);
   if(priv->item_pos == priv->n_items) return 0;
 
-  g_object_get(
-    G_OBJECT(priv->algorithm),
-    "max-total-log-size",
-    &max_total_log_size,
-    NULL
-  );
-
-  log = inf_adopted_user_get_request_log(priv->user);
-  current = inf_adopted_user_get_vector(priv->user);
+  end = inf_adopted_undo_grouping_get_group_end(priv, priv->item_pos);
 
-  pos = priv->item_pos;
-  do
+  /* The oldest request is furthest away from the current state, but the
+   * newest one is only redone after all the others. If the oldest one could
+   * be redone that late, then all of them can be. */
+  if(inf_adopted_undo_grouping_can_reach(priv, priv->item_pos,
+                                         end - priv->item_pos - 1))
   {
-    g_assert(pos < priv->n_items);
-
-    index = inf_adopted_request_get_index(priv->items[pos].request);
-    lower_related = inf_adopted_request_log_lower_related(log, index);
-    vector = inf_adopted_request_get_vector(lower_related);
-    vdiff = inf_adopted_state_vector_vdiff(vector, current);
-
-    if(vdiff + pos - priv->item_pos >= max_total_log_size)
-      return pos - priv->item_pos;
+    return end - priv->item_pos;
+  }
 
-    ++pos;
-  } while(pos < priv->n_items &&
-          priv->items[(priv->first_item + pos) % priv->n_alloc].in_group);
+  for(pos = priv->item_pos; pos < end; ++pos)
+    if(!inf_adopted_undo_grouping_can_reach(priv, pos, pos - priv->item_pos))
+      break;
 
   return pos - priv->item_pos;
 }
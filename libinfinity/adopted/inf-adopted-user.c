@@ -47,7 +47,9 @@ enum {
   PROP_0,
 
   PROP_VECTOR,
-  PROP_REQUEST_LOG
+  PROP_REQUEST_LOG,
+
+  LAST_PROP
 };
 
 #define INF_ADOPTED_USER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_USER, InfAdoptedUserPrivate))
@@ -56,6 +58,10 @@ enum {
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedUser, inf_adopted_user, INF_TYPE_USER,
   G_ADD_PRIVATE(InfAdoptedUser))
 
+/* The vector changes for every request, so its notification does not look
+ * up the property by name. */
+static GParamSpec* user_properties[LAST_PROP] = { NULL };
+
 static void
 inf_adopted_user_init(InfAdoptedUser* user)
 {
@@ -194,16 +200,18 @@ inf_adopted_user_class_init(InfAdoptedUserClass* user_class)
   object_class->set_property = inf_adopted_user_set_property;
   object_class->get_property = inf_adopted_user_get_property;
 
+  user_properties[PROP_VECTOR] = g_param_spec_boxed(
+    "vector",
+    "State vector",
+    "The state this user is currently at",
+    INF_ADOPTED_TYPE_STATE_VECTOR,
+    G_PARAM_READWRITE
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_VECTOR,
-    g_param_spec_boxed(
-      "vector",
-      "State vector",
-      "The state this user is currently at",
-      INF_ADOPTED_TYPE_STATE_VECTOR,
-      G_PARAM_READWRITE
-    )
+    user_properties[PROP_VECTOR]
   );
 
   g_object_class_install_property(
@@ -278,7 +286,7 @@ inf_adopted_user_set_vector(InfAdoptedUser* user,
   inf_adopted_state_vector_free(priv->vector);
   priv->vector = vec;
 
-  g_object_notify(G_OBJECT(user), "vector");
+  g_object_notify_by_pspec(G_OBJECT(user), user_properties[PROP_VECTOR]);
 }
 
 /**
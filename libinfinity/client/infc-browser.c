@@ -35,14 +35,19 @@
 
 #include <libinfinity/common/inf-request-result.h>
 #include <libinfinity/common/inf-chat-session.h>
+#include <libinfinity/common/inf-certificate-chain.h>
 #include <libinfinity/common/inf-cert-util.h>
+#include <libinfinity/common/inf-file-util.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
+#include <libxml/parser.h>
+
 #include <string.h>
 
 /* Some Windows header #defines error for no good */
@@ -81,6 +86,44 @@ struct _InfcBrowserListPendingRequestsForeachData {
   GSList* result;
 };
 
+/* Bookkeeping for infc_browser_subscribe_sessions() */
+typedef struct _InfcBrowserSubscribeSessionsData
+  InfcBrowserSubscribeSessionsData;
+struct _InfcBrowserSubscribeSessionsData {
+  InfcProgressRequest* request;
+  guint pending;
+  GError* error;
+};
+
+/* Bookkeeping for infc_browser_add_notes_with_content() */
+typedef struct _InfcBrowserAddNotesData InfcBrowserAddNotesData;
+
+typedef struct _InfcBrowserAddNotesNote InfcBrowserAddNotesNote;
+struct _InfcBrowserAddNotesNote {
+  InfcBrowserAddNotesData* data;
+  InfBrowserIter parent;
+  gchar* name;
+  gchar* type;
+  InfSession* session;
+
+  /* The add-node request while it is running */
+  InfRequest* request;
+  /* The connection the session is synchronized to while it is in flight */
+  InfXmlConnection* connection;
+};
+
+struct _InfcBrowserAddNotesData {
+  InfcBrowser* browser;
+  InfcProgressRequest* request;
+  InfcBrowserAddNotesNote* notes;
+  guint n_notes;
+  guint n_sent;
+  guint n_done;
+  guint in_flight;
+  guint max_in_flight;
+  GError* error;
+};
+
 typedef struct _InfcBrowserIterGetChatRequestForeachData
   InfcBrowserIterGetChatRequestForeachData;
 struct _InfcBrowserIterGetChatRequestForeachData {
@@ -122,10 +165,17 @@ struct _InfcBrowserNode {
     struct {
       /* First child node */
       InfcBrowserNode* child;
+      /* Child nodes by name, for infc_browser_lookup_child() */
+      GHashTable* children;
       /* Whether we requested the node already from the server.
        * This is required because the child field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
       gboolean explored;
+      /* The generation of the children as reported by the server when the
+       * node was explored, or NULL if the server does not support it */
+      gchar* generation;
+      /* Where the subdirectory is hosted if not on this server, or NULL */
+      gchar* redirect;
     } subdir;
   } shared;
 };
@@ -163,6 +213,11 @@ struct _InfcBrowserSubreq {
       InfcBrowserNode* node;
       InfcRequest* request;
       InfCommunicationJoinedGroup* subscription_group;
+      /* The proxy to reuse if the server brings it up to date instead of
+       * synchronizing the whole session, or NULL */
+      InfcSessionProxy* resync;
+      /* Instance of the server-side session proxy, or NULL */
+      gchar* instance;
     } session;
 
     /* TODO: It would simplify some code if we merge the add_node
@@ -211,6 +266,7 @@ struct _InfcBrowserPrivate {
   InfBrowserStatus status;
   GHashTable* nodes; /* Mapping from id to node */
   InfcBrowserNode* root;
+  GHashTable* path_cache; /* Mapping from path to node */
 
   GHashTable* accounts; /* known accounts, id -> InfAclAccount* */
   const InfAclAccount* local_account;
@@ -220,8 +276,37 @@ struct _InfcBrowserPrivate {
   GSList* subscription_requests;
 
   InfcSessionProxy* chat_session;
+
+  /* Cached listings of explored subdirectories, see
+   * infc_browser_cache_load() */
+  gchar* cache_directory;
+  gchar* cache_filename;
+  xmlDocPtr cache;
+  GHashTable* cache_folders; /* node ID -> <folder> element in cache */
+  gboolean cache_modified;
+
+  /* Automatic reconnection, see infc_browser_schedule_reconnect() */
+  gboolean reconnect;
+  guint reconnect_interval;
+  guint reconnect_max_interval;
+  guint reconnect_attempts;
+  guint retry_after; /* as advertised by the server in the welcome */
+  InfIoTimeout* reconnect_timeout;
+
+  /* subscribe-session messages of resubscriptions that wait to be sent */
+  guint resubscribe_interval;
+  GQueue resubscriptions;
+  InfIoTimeout* resubscribe_timeout;
 };
 
+/* Maximum number of nodes that the server is asked to send in one
+ * <node-list> message when exploring a subdirectory */
+static const guint INFC_BROWSER_NODE_LIST_SIZE = 256;
+
+/* Maximum number of entries in the path cache used by
+ * infc_browser_lookup_path(). The cache is cleared when it is full. */
+static const guint INFC_BROWSER_PATH_CACHE_SIZE = 1024;
+
 #define INFC_BROWSER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFC_TYPE_BROWSER, InfcBrowserPrivate))
 
 enum {
@@ -230,6 +315,11 @@ enum {
   PROP_IO,
   PROP_COMMUNICATION_MANAGER,
   PROP_CONNECTION,
+  PROP_CACHE_DIRECTORY,
+  PROP_RECONNECT,
+  PROP_RECONNECT_INTERVAL,
+  PROP_RECONNECT_MAX_INTERVAL,
+  PROP_RESUBSCRIBE_INTERVAL,
 
   /* read only */
   PROP_STATUS,
@@ -271,6 +361,8 @@ enum {
 static GQuark infc_browser_session_proxy_quark;
 static GQuark infc_browser_sync_in_session_quark;
 static GQuark infc_browser_sync_in_plugin_quark;
+static GQuark infc_browser_resync_proxy_quark;
+static GQuark infc_browser_session_instance_quark;
 static GQuark infc_browser_lookup_acl_accounts_ids_quark;
 static GQuark infc_browser_lookup_acl_accounts_n_ids_quark;
 static GQuark infc_browser_lookup_acl_accounts_name_quark;
@@ -478,6 +570,8 @@ infc_browser_node_link(InfcBrowserNode* node,
   }
 
   parent->shared.subdir.child = node;
+
+  g_hash_table_insert(parent->shared.subdir.children, node->name, node);
 }
 
 static void
@@ -493,6 +587,14 @@ infc_browser_node_unlink(InfcBrowserNode* node)
 
   if(node->next != NULL)
     node->next->prev = node->prev;
+
+  /* The server does not allow two nodes with the same name in one
+   * subdirectory, but be robust in case it sends one anyway */
+  if(g_hash_table_lookup(node->parent->shared.subdir.children, node->name) ==
+     node)
+  {
+    g_hash_table_remove(node->parent->shared.subdir.children, node->name);
+  }
 }
 
 static InfcBrowserNode*
@@ -545,7 +647,8 @@ infc_browser_node_new_subdirectory(InfcBrowser* browser,
                                    InfcBrowserNode* parent,
                                    guint id,
                                    const gchar* name,
-                                   const InfAclSheetSet* sheet_set)
+                                   const InfAclSheetSet* sheet_set,
+                                   const gchar* redirect)
 {
   InfcBrowserNode* node;
   node = infc_browser_node_new_common(
@@ -559,6 +662,9 @@ infc_browser_node_new_subdirectory(InfcBrowser* browser,
 
   node->shared.subdir.explored = FALSE;
   node->shared.subdir.child = NULL;
+  node->shared.subdir.children = g_hash_table_new(g_str_hash, g_str_equal);
+  node->shared.subdir.generation = NULL;
+  node->shared.subdir.redirect = g_strdup(redirect);
 
   return node;
 }
@@ -724,6 +830,7 @@ infc_browser_node_free(InfcBrowser* browser,
 
   InfBrowserIter iter;
   GError* error;
+  gchar* path;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -735,6 +842,9 @@ infc_browser_node_free(InfcBrowser* browser,
     while(node->shared.subdir.child != NULL)
       infc_browser_node_free(browser, node->shared.subdir.child);
 
+    g_hash_table_destroy(node->shared.subdir.children);
+    g_free(node->shared.subdir.generation);
+    g_free(node->shared.subdir.redirect);
     break;
   case INFC_BROWSER_NODE_NOTE_KNOWN:
     /* Is first unlinked with remove_child_sessions */
@@ -859,6 +969,15 @@ infc_browser_node_free(InfcBrowser* browser,
     }
   }
 
+  /* Nodes are never moved or renamed, so this is the only place where a
+   * cached path can become stale. */
+  if(g_hash_table_size(priv->path_cache) > 0)
+  {
+    infc_browser_node_get_path(node, &path, NULL);
+    g_hash_table_remove(priv->path_cache, path);
+    g_free(path);
+  }
+
   if(node->parent != NULL)
     infc_browser_node_unlink(node);
 
@@ -1244,6 +1363,348 @@ infc_browser_enforce_acl(InfcBrowser* browser,
    * anymore from now on. */
 }
 
+/*
+ * Directory cache
+ */
+
+/* Returns the file in which explored directory listings for the current
+ * connection are cached, or NULL if there is none. The file is named after
+ * the fingerprint of the server's certificate, so without TLS there is no
+ * cache, because we could not tell which server we are talking to. */
+static gchar*
+infc_browser_cache_get_filename(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  InfCertificateChain* chain;
+  gchar* fingerprint;
+  gchar* basename;
+  gchar* filename;
+  gchar* src;
+  gchar* dest;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache_directory == NULL || priv->connection == NULL)
+    return NULL;
+
+  g_object_get(
+    G_OBJECT(priv->connection),
+    "remote-certificate", &chain,
+    NULL
+  );
+
+  if(chain == NULL)
+    return NULL;
+
+  fingerprint = inf_cert_util_get_fingerprint(
+    inf_certificate_chain_get_own_certificate(chain),
+    GNUTLS_DIG_SHA256
+  );
+
+  inf_certificate_chain_unref(chain);
+  if(fingerprint == NULL)
+    return NULL;
+
+  /* Strip the colons */
+  for(src = dest = fingerprint; *src != '\0'; ++src)
+    if(g_ascii_isxdigit(*src))
+      *dest++ = g_ascii_tolower(*src);
+  *dest = '\0';
+
+  basename = g_strconcat(fingerprint, ".xml", NULL);
+  filename = g_build_filename(priv->cache_directory, basename, NULL);
+  g_free(basename);
+  g_free(fingerprint);
+
+  return filename;
+}
+
+static void
+infc_browser_cache_free(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  if(priv->cache != NULL)
+  {
+    g_hash_table_destroy(priv->cache_folders);
+    priv->cache_folders = NULL;
+
+    xmlFreeDoc(priv->cache);
+    priv->cache = NULL;
+
+    g_free(priv->cache_filename);
+    priv->cache_filename = NULL;
+
+    priv->cache_modified = FALSE;
+  }
+}
+
+/* Reads the cached listings for the current connection, if any. Listings
+ * that were cached for another account are dropped, since the ACL sheets
+ * that are sent along depend on the account. The local account must be
+ * known when this is called. */
+static void
+infc_browser_cache_load(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  const gchar* account;
+  gchar* filename;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  xmlChar* cached_account;
+  guint id;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  g_assert(priv->cache == NULL);
+  g_assert(priv->local_account != NULL);
+
+  filename = infc_browser_cache_get_filename(browser);
+  if(filename == NULL) return;
+
+  account = inf_acl_account_id_to_string(priv->local_account->id);
+
+  priv->cache_filename = filename;
+  priv->cache_folders = g_hash_table_new(NULL, NULL);
+  priv->cache_modified = FALSE;
+
+  if(g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    priv->cache = xmlReadFile(filename, "UTF-8", XML_PARSE_NONET);
+    if(priv->cache != NULL)
+    {
+      root = xmlDocGetRootElement(priv->cache);
+      cached_account = NULL;
+      if(root != NULL &&
+         strcmp((const char*)root->name, "infc-browser-cache") == 0)
+      {
+        cached_account = inf_xml_util_get_attribute(root, "account");
+      }
+
+      if(cached_account == NULL ||
+         strcmp((const char*)cached_account, account) != 0)
+      {
+        xmlFreeDoc(priv->cache);
+        priv->cache = NULL;
+      }
+
+      if(cached_account != NULL)
+        xmlFree(cached_account);
+    }
+  }
+
+  if(priv->cache == NULL)
+  {
+    priv->cache = xmlNewDoc((const xmlChar*)"1.0");
+    root = xmlNewNode(NULL, (const xmlChar*)"infc-browser-cache");
+    inf_xml_util_set_attribute(root, "account", account);
+    xmlDocSetRootElement(priv->cache, root);
+  }
+  else
+  {
+    root = xmlDocGetRootElement(priv->cache);
+    for(child = root->children; child != NULL; child = child->next)
+    {
+      if(child->type != XML_ELEMENT_NODE) continue;
+      if(strcmp((const char*)child->name, "folder") != 0) continue;
+      if(!inf_xml_util_get_attribute_uint(child, "id", &id, NULL)) continue;
+
+      g_hash_table_insert(
+        priv->cache_folders,
+        GUINT_TO_POINTER(id),
+        child
+      );
+    }
+  }
+}
+
+static void
+infc_browser_cache_save(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  gchar* dirname;
+  GError* error;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache == NULL || priv->cache_modified == FALSE)
+    return;
+
+  /* This is only a cache, so failing to write it is not fatal */
+  dirname = g_path_get_dirname(priv->cache_filename);
+  error = NULL;
+
+  if(!inf_file_util_create_directory(dirname, 0700, &error))
+  {
+    g_warning(
+      _("Failed to write directory cache \"%s\": %s"),
+      priv->cache_filename,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+  else if(xmlSaveFormatFileEnc(priv->cache_filename,
+                               priv->cache,
+                               "UTF-8",
+                               1) < 0)
+  {
+    g_warning(
+      _("Failed to write directory cache \"%s\""),
+      priv->cache_filename
+    );
+  }
+
+  g_free(dirname);
+  priv->cache_modified = FALSE;
+}
+
+/* Drops all cached listings, for example because the local account has
+ * changed. */
+static void
+infc_browser_cache_reset(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  xmlNodePtr root;
+  xmlNodePtr child;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache == NULL) return;
+
+  root = xmlDocGetRootElement(priv->cache);
+  while((child = root->children) != NULL)
+  {
+    xmlUnlinkNode(child);
+    xmlFreeNode(child);
+  }
+
+  inf_xml_util_set_attribute(
+    root,
+    "account",
+    inf_acl_account_id_to_string(priv->local_account->id)
+  );
+
+  g_hash_table_remove_all(priv->cache_folders);
+  priv->cache_modified = TRUE;
+}
+
+static void
+infc_browser_cache_remove_folder(InfcBrowser* browser,
+                                 guint id)
+{
+  InfcBrowserPrivate* priv;
+  xmlNodePtr folder;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache == NULL) return;
+
+  folder = g_hash_table_lookup(priv->cache_folders, GUINT_TO_POINTER(id));
+  if(folder != NULL)
+  {
+    g_hash_table_remove(priv->cache_folders, GUINT_TO_POINTER(id));
+    xmlUnlinkNode(folder);
+    xmlFreeNode(folder);
+    priv->cache_modified = TRUE;
+  }
+}
+
+/* Returns the cached listing of the subdirectory with the given ID if its
+ * generation matches. If generation is NULL, returns the listing with any
+ * generation. */
+static xmlNodePtr
+infc_browser_cache_lookup_folder(InfcBrowser* browser,
+                                 guint id,
+                                 const gchar* generation)
+{
+  InfcBrowserPrivate* priv;
+  xmlNodePtr folder;
+  xmlChar* cached_generation;
+  gboolean result;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache == NULL) return NULL;
+
+  folder = g_hash_table_lookup(priv->cache_folders, GUINT_TO_POINTER(id));
+  if(folder == NULL || generation == NULL) return folder;
+
+  cached_generation = inf_xml_util_get_attribute(folder, "generation");
+  if(cached_generation == NULL) return NULL;
+
+  result = (strcmp((const char*)cached_generation, generation) == 0);
+  xmlFree(cached_generation);
+
+  if(result == FALSE) return NULL;
+  return folder;
+}
+
+/* Stores the children of node, which has just been explored, in the cache.
+ * The listing has the same format as a <node-list> message. */
+static void
+infc_browser_cache_store_folder(InfcBrowser* browser,
+                                InfcBrowserNode* node)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* child;
+  xmlNodePtr folder;
+  xmlNodePtr xml;
+  const gchar* type;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->cache == NULL) return;
+
+  g_assert(node->type == INFC_BROWSER_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.generation != NULL);
+
+  infc_browser_cache_remove_folder(browser, node->id);
+
+  folder = xmlNewChild(
+    xmlDocGetRootElement(priv->cache),
+    NULL,
+    (const xmlChar*)"folder",
+    NULL
+  );
+
+  inf_xml_util_set_attribute_uint(folder, "id", node->id);
+  inf_xml_util_set_attribute(
+    folder,
+    "generation",
+    node->shared.subdir.generation
+  );
+
+  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+  {
+    switch(child->type)
+    {
+    case INFC_BROWSER_NODE_SUBDIRECTORY:
+      type = "InfSubdirectory";
+      break;
+    case INFC_BROWSER_NODE_NOTE_KNOWN:
+      type = child->shared.known.plugin->note_type;
+      break;
+    case INFC_BROWSER_NODE_NOTE_UNKNOWN:
+      type = child->shared.unknown.type;
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+
+    xml = xmlNewChild(folder, NULL, (const xmlChar*)"node", NULL);
+    inf_xml_util_set_attribute_uint(xml, "id", child->id);
+    inf_xml_util_set_attribute(xml, "name", child->name);
+    inf_xml_util_set_attribute(xml, "type", type);
+
+    if(child->acl != NULL && child->acl->n_sheets > 0)
+      inf_acl_sheet_set_to_xml(child->acl, xml);
+  }
+
+  g_hash_table_insert(
+    priv->cache_folders,
+    GUINT_TO_POINTER(node->id),
+    folder
+  );
+
+  priv->cache_modified = TRUE;
+}
+
 /*
  * Signal handlers
  */
@@ -1365,76 +1826,252 @@ infc_browser_welcome_timeout_func(gpointer user_data)
   g_object_notify(G_OBJECT(browser), "status");
 }
 
-/* Required by infc_browser_disconnected */
 static void
-infc_browser_member_removed_cb(InfCommunicationGroup* group,
-                               InfXmlConnection* connection,
-                               gpointer user_data);
+infc_browser_schedule_reconnect(InfcBrowser* browser);
+
+/* Returns a random time between half of and the full interval, so that
+ * clients that lost their connection at the same time do not all come back
+ * at the same time. */
+static guint
+infc_browser_jitter(guint interval)
+{
+  if(interval < 2) return interval;
+  return interval / 2 + (guint)(g_random_double() * (interval / 2));
+}
 
 static void
-infc_browser_connected(InfcBrowser* browser)
+infc_browser_reconnect_timeout_func(gpointer user_data)
 {
+  InfcBrowser* browser;
   InfcBrowserPrivate* priv;
+  InfXmlConnectionStatus status;
+  GError* error;
+
+  browser = INFC_BROWSER(user_data);
   priv = INFC_BROWSER_PRIVATE(browser);
+  priv->reconnect_timeout = NULL;
 
-  g_assert(priv->group == NULL);
+  g_object_get(G_OBJECT(priv->connection), "status", &status, NULL);
+  if(status != INF_XML_CONNECTION_CLOSED)
+    return;
 
-  /* Join directory group of server */
-  /* directory group always uses central method */
-  priv->group = inf_communication_manager_join_group(
-    priv->communication_manager,
-    "InfDirectory",
-    priv->connection,
-    "central"
-  );
+  ++priv->reconnect_attempts;
 
-  /* "central" method should always be available */
-  g_assert(priv->group != NULL);
+  error = NULL;
+  if(!inf_xml_connection_open(priv->connection, &error))
+  {
+    inf_browser_error(INF_BROWSER(browser), error);
+    g_error_free(error);
 
-  inf_communication_group_set_target(
-    INF_COMMUNICATION_GROUP(priv->group),
-    INF_COMMUNICATION_OBJECT(browser)
-  );
+    /* The status does not change in this case, so try again later */
+    infc_browser_schedule_reconnect(browser);
+  }
+}
 
-  g_signal_connect(
-    priv->group,
-    "member-removed",
-    G_CALLBACK(infc_browser_member_removed_cb),
-    browser
-  );
+/* Schedules opening the connection again after it was closed, if
+ * reconnection is enabled. The delay doubles with every failed attempt up to
+ * reconnect-max-interval, and is at least the retry-after time the server
+ * advertised last, which allows the server to spread the reconnections of
+ * all of its clients after a restart. */
+static void
+infc_browser_schedule_reconnect(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  guint interval;
+  guint i;
 
-  /* Wait for welcome message */
-  if(priv->status != INF_BROWSER_OPENING)
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  if(priv->reconnect == FALSE || priv->connection == NULL ||
+     priv->reconnect_timeout != NULL)
   {
-    priv->status = INF_BROWSER_OPENING;
-    g_object_notify(G_OBJECT(browser), "status");
+    return;
   }
 
-  /* TODO: We have a relatively low timeout here to easily recognize when
-   * we try to connect to a server which does not yet send a welcome
-   * message. We can set it somewhat higher later when there are fewer
-   * old servers around. */
-  g_assert(priv->welcome_timeout == NULL);
-  priv->welcome_timeout = inf_io_add_timeout(
+  interval = priv->reconnect_interval;
+  for(i = 0; i < priv->reconnect_attempts; ++i)
+  {
+    if(interval >= priv->reconnect_max_interval / 2)
+    {
+      interval = priv->reconnect_max_interval;
+      break;
+    }
+
+    interval *= 2;
+  }
+
+  interval = MIN(interval, priv->reconnect_max_interval);
+  interval = MAX(interval, priv->retry_after);
+
+  priv->reconnect_timeout = inf_io_add_timeout(
     priv->io,
-    5*1000,
-    infc_browser_welcome_timeout_func,
+    infc_browser_jitter(interval),
+    infc_browser_reconnect_timeout_func,
     browser,
     NULL
   );
 }
 
 static void
-infc_browser_disconnected(InfcBrowser* browser)
+infc_browser_resubscribe_timeout_func(gpointer user_data)
 {
+  InfcBrowser* browser;
   InfcBrowserPrivate* priv;
-  InfcBrowserNode* child;
+
+  browser = INFC_BROWSER(user_data);
+  priv = INFC_BROWSER_PRIVATE(browser);
+  priv->resubscribe_timeout = NULL;
+
+  g_assert(priv->group != NULL);
+  if(g_queue_is_empty(&priv->resubscriptions))
+    return;
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    priv->connection,
+    g_queue_pop_head(&priv->resubscriptions)
+  );
+
+  if(!g_queue_is_empty(&priv->resubscriptions))
+  {
+    priv->resubscribe_timeout = inf_io_add_timeout(
+      priv->io,
+      infc_browser_jitter(priv->resubscribe_interval),
+      infc_browser_resubscribe_timeout_func,
+      browser,
+      NULL
+    );
+  }
+}
+
+/* Sends a subscribe-session message for a resubscription, spacing them by
+ * resubscribe-interval, so that a client that reconnects with many open
+ * documents does not ask the server to bring them all up to date at once. */
+static void
+infc_browser_send_resubscription(InfcBrowser* browser,
+                                 xmlNodePtr xml)
+{
+  InfcBrowserPrivate* priv;
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  if(priv->resubscribe_interval == 0 ||
+     (priv->resubscribe_timeout == NULL &&
+      g_queue_is_empty(&priv->resubscriptions)))
+  {
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      priv->connection,
+      xml
+    );
+
+    /* Hold back the next ones for a while */
+    if(priv->resubscribe_interval > 0)
+    {
+      priv->resubscribe_timeout = inf_io_add_timeout(
+        priv->io,
+        infc_browser_jitter(priv->resubscribe_interval),
+        infc_browser_resubscribe_timeout_func,
+        browser,
+        NULL
+      );
+    }
+  }
+  else
+  {
+    g_queue_push_tail(&priv->resubscriptions, xml);
+  }
+}
+
+static void
+infc_browser_clear_resubscriptions(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  /* The corresponding requests are dropped with the request manager */
+  while(!g_queue_is_empty(&priv->resubscriptions))
+    xmlFreeNode(g_queue_pop_head(&priv->resubscriptions));
+
+  if(priv->resubscribe_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->resubscribe_timeout);
+    priv->resubscribe_timeout = NULL;
+  }
+}
+
+/* Required by infc_browser_disconnected */
+static void
+infc_browser_member_removed_cb(InfCommunicationGroup* group,
+                               InfXmlConnection* connection,
+                               gpointer user_data);
+
+static void
+infc_browser_connected(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  g_assert(priv->group == NULL);
+
+  /* Join directory group of server */
+  /* directory group always uses central method */
+  priv->group = inf_communication_manager_join_group(
+    priv->communication_manager,
+    "InfDirectory",
+    priv->connection,
+    "central"
+  );
+
+  /* "central" method should always be available */
+  g_assert(priv->group != NULL);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(priv->group),
+    INF_COMMUNICATION_OBJECT(browser)
+  );
+
+  g_signal_connect(
+    priv->group,
+    "member-removed",
+    G_CALLBACK(infc_browser_member_removed_cb),
+    browser
+  );
+
+  /* Wait for welcome message */
+  if(priv->status != INF_BROWSER_OPENING)
+  {
+    priv->status = INF_BROWSER_OPENING;
+    g_object_notify(G_OBJECT(browser), "status");
+  }
+
+  /* TODO: We have a relatively low timeout here to easily recognize when
+   * we try to connect to a server which does not yet send a welcome
+   * message. We can set it somewhat higher later when there are fewer
+   * old servers around. */
+  g_assert(priv->welcome_timeout == NULL);
+  priv->welcome_timeout = inf_io_add_timeout(
+    priv->io,
+    5*1000,
+    infc_browser_welcome_timeout_func,
+    browser,
+    NULL
+  );
+}
+
+static void
+infc_browser_disconnected(InfcBrowser* browser)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* child;
   InfcBrowserNode* next;
   InfSession* session;
   InfBrowserIter iter;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
+  infc_browser_cache_save(browser);
+  infc_browser_cache_free(browser);
+
   /* Note that we do not remove the corresponding node that we sync in. We
    * lost the connection to the server anyway, so we do not care whether
    * that node exists on the server or not. */
@@ -1444,6 +2081,8 @@ infc_browser_disconnected(InfcBrowser* browser)
   while(priv->subscription_requests != NULL)
     infc_browser_remove_subreq(browser, priv->subscription_requests->data);
 
+  infc_browser_clear_resubscriptions(browser);
+
   /* TODO: Emit failed signal with some "disconnected" error */
   if(priv->request_manager)
   {
@@ -1578,6 +2217,9 @@ infc_browser_connection_notify_status_cb(GObject* object,
       g_object_notify(G_OBJECT(browser), "status");
     }
 
+    if(status == INF_XML_CONNECTION_CLOSED)
+      infc_browser_schedule_reconnect(browser);
+
     break;
   default:
     g_assert_not_reached();
@@ -1664,6 +2306,8 @@ infc_browser_init(InfcBrowser* browser)
   priv->status = INF_BROWSER_CLOSED;
   priv->nodes = g_hash_table_new(NULL, NULL);
   priv->root = NULL;
+  priv->path_cache =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
   priv->accounts = NULL;
   priv->local_account = NULL;
@@ -1672,6 +2316,23 @@ infc_browser_init(InfcBrowser* browser)
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
   priv->chat_session = NULL;
+
+  priv->cache_directory = NULL;
+  priv->cache_filename = NULL;
+  priv->cache = NULL;
+  priv->cache_folders = NULL;
+  priv->cache_modified = FALSE;
+
+  priv->reconnect = FALSE;
+  priv->reconnect_interval = 1000;
+  priv->reconnect_max_interval = 60000;
+  priv->reconnect_attempts = 0;
+  priv->retry_after = 0;
+  priv->reconnect_timeout = NULL;
+
+  priv->resubscribe_interval = 0;
+  g_queue_init(&priv->resubscriptions);
+  priv->resubscribe_timeout = NULL;
 }
 
 static void
@@ -1742,6 +2403,15 @@ infc_browser_dispose(GObject* object)
     priv->welcome_timeout = NULL;
   }
 
+  if(priv->reconnect_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->reconnect_timeout);
+    priv->reconnect_timeout = NULL;
+  }
+
+  g_assert(g_queue_is_empty(&priv->resubscriptions));
+  g_assert(priv->resubscribe_timeout == NULL);
+
   if(priv->io != NULL)
   {
     g_object_unref(G_OBJECT(priv->io));
@@ -1763,6 +2433,12 @@ infc_browser_finalize(GObject* object)
   g_hash_table_destroy(priv->nodes);
   priv->nodes = NULL;
 
+  g_hash_table_destroy(priv->path_cache);
+  priv->path_cache = NULL;
+
+  g_assert(priv->cache == NULL);
+  g_free(priv->cache_directory);
+
   G_OBJECT_CLASS(infc_browser_parent_class)->finalize(object);
 }
 
@@ -1866,6 +2542,35 @@ infc_browser_set_property(GObject* object,
       }
     }
 
+    break;
+  case PROP_CACHE_DIRECTORY:
+    /* Takes effect with the next connection */
+    g_free(priv->cache_directory);
+    priv->cache_directory = g_value_dup_string(value);
+    break;
+  case PROP_RECONNECT:
+    priv->reconnect = g_value_get_boolean(value);
+    if(priv->reconnect == FALSE && priv->reconnect_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, priv->reconnect_timeout);
+      priv->reconnect_timeout = NULL;
+    }
+    else if(priv->reconnect == TRUE && priv->connection != NULL)
+    {
+      g_object_get(G_OBJECT(priv->connection), "status", &status, NULL);
+      if(status == INF_XML_CONNECTION_CLOSED)
+        infc_browser_schedule_reconnect(browser);
+    }
+
+    break;
+  case PROP_RECONNECT_INTERVAL:
+    priv->reconnect_interval = g_value_get_uint(value);
+    break;
+  case PROP_RECONNECT_MAX_INTERVAL:
+    priv->reconnect_max_interval = g_value_get_uint(value);
+    break;
+  case PROP_RESUBSCRIBE_INTERVAL:
+    priv->resubscribe_interval = g_value_get_uint(value);
     break;
   case PROP_STATUS:
   case PROP_CHAT_SESSION:
@@ -1899,6 +2604,21 @@ infc_browser_get_property(GObject* object,
   case PROP_CONNECTION:
     g_value_set_object(value, G_OBJECT(priv->connection));
     break;
+  case PROP_CACHE_DIRECTORY:
+    g_value_set_string(value, priv->cache_directory);
+    break;
+  case PROP_RECONNECT:
+    g_value_set_boolean(value, priv->reconnect);
+    break;
+  case PROP_RECONNECT_INTERVAL:
+    g_value_set_uint(value, priv->reconnect_interval);
+    break;
+  case PROP_RECONNECT_MAX_INTERVAL:
+    g_value_set_uint(value, priv->reconnect_max_interval);
+    break;
+  case PROP_RESUBSCRIBE_INTERVAL:
+    g_value_set_uint(value, priv->resubscribe_interval);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, priv->status);
     break;
@@ -1964,7 +2684,9 @@ static InfcBrowserSubreq*
 infc_browser_add_subreq_session(InfcBrowser* browser,
                                 InfcBrowserNode* node,
                                 InfcRequest* request,
-                                InfCommunicationJoinedGroup* group)
+                                InfCommunicationJoinedGroup* group,
+                                InfcSessionProxy* resync,
+                                gchar* instance)
 {
   InfcBrowserSubreq* subreq;
 
@@ -1977,6 +2699,8 @@ infc_browser_add_subreq_session(InfcBrowser* browser,
   subreq->shared.session.node = node;
   subreq->shared.session.request = request;
   subreq->shared.session.subscription_group = group;
+  subreq->shared.session.resync = resync; /* take ownership */
+  subreq->shared.session.instance = instance; /* take ownership */
 
   /* TODO: Document in what case request can be NULL, or assert if it can't */
   if(request != NULL)
@@ -2086,6 +2810,9 @@ infc_browser_free_subreq(InfcBrowserSubreq* request)
 
     if(request->shared.session.request != NULL)
       g_object_unref(request->shared.session.request);
+    if(request->shared.session.resync != NULL)
+      g_object_unref(request->shared.session.resync);
+    g_free(request->shared.session.instance);
 
     break;
   case INFC_BROWSER_SUBREQ_ADD_NODE:
@@ -2307,24 +3034,32 @@ infc_browser_node_add_subdirectory(InfcBrowser* browser,
                                    InfcRequest* request,
                                    guint id,
                                    const gchar* name,
-                                   const InfAclSheetSet* sheet_set)
+                                   const InfAclSheetSet* sheet_set,
+                                   const xmlNodePtr xml)
 {
   InfcBrowserPrivate* priv;
   InfcBrowserNode* node;
+  xmlChar* redirect;
 
   g_assert(parent->type == INFC_BROWSER_NODE_SUBDIRECTORY);
   g_assert(parent->shared.subdir.explored == TRUE);
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
+  /* Set by servers that host the subdirectory's content elsewhere */
+  redirect = inf_xml_util_get_attribute(xml, "redirect");
+
   node = infc_browser_node_new_subdirectory(
     browser,
     parent,
     id,
     name,
-    sheet_set
+    sheet_set,
+    (const gchar*)redirect
   );
 
+  if(redirect != NULL) xmlFree(redirect);
+
   infc_browser_node_register(browser, node, request);
 
   return node;
@@ -2775,6 +3510,43 @@ infc_browser_subscribe_session(InfcBrowser* browser,
   g_object_unref(proxy);
 }
 
+/* Subscribes to node with an existing proxy whose session the server brings
+ * up to date with a <session-resync> message, see
+ * infc_browser_iter_resubscribe_session(). */
+static void
+infc_browser_resubscribe_session(InfcBrowser* browser,
+                                 InfcBrowserNode* node,
+                                 InfcRequest* request,
+                                 InfCommunicationJoinedGroup* group,
+                                 InfXmlConnection* connection,
+                                 InfcSessionProxy* proxy)
+{
+  InfcBrowserPrivate* priv;
+  InfBrowserIter iter;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  g_assert(node->type == INFC_BROWSER_NODE_NOTE_KNOWN);
+  g_assert(node->shared.known.session == NULL);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(group),
+    INF_COMMUNICATION_OBJECT(proxy)
+  );
+
+  infc_session_proxy_set_connection(proxy, group, connection, priv->seq_id);
+
+  iter.node_id = node->id;
+  iter.node = node;
+
+  inf_browser_subscribe_session(
+    INF_BROWSER(browser),
+    &iter,
+    INF_SESSION_PROXY(proxy),
+    INF_REQUEST(request)
+  );
+}
+
 static gboolean
 infc_browser_handle_welcome(InfcBrowser* browser,
                             InfXmlConnection* connection,
@@ -2796,6 +3568,7 @@ infc_browser_handle_welcome(InfcBrowser* browser,
   GError* local_error;
   InfAclSheet* sheet;
   InfAclMask default_mask;
+  guint retry_after;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -2857,6 +3630,15 @@ infc_browser_handle_welcome(InfcBrowser* browser,
 
   if(!result) return FALSE;
 
+  /* How long to wait at least before reconnecting if the connection is
+   * lost. Older servers do not send it; it is only a hint, so ignore it if
+   * it is malformed. */
+  if(!inf_xml_util_get_attribute_uint(xml, "retry-after", &retry_after,
+                                      NULL))
+  {
+    retry_after = 0;
+  }
+
   /* Load ACL accounts */
   g_assert(priv->accounts == NULL);
   g_assert(priv->local_account == NULL);
@@ -2937,7 +3719,8 @@ infc_browser_handle_welcome(InfcBrowser* browser,
     NULL,
     0,
     NULL,
-    sheet_set
+    sheet_set,
+    NULL
   );
 
   inf_acl_sheet_set_free(sheet_set);
@@ -2945,6 +3728,10 @@ infc_browser_handle_welcome(InfcBrowser* browser,
   g_assert(priv->request_manager == NULL);
   priv->request_manager = infc_request_manager_new(priv->seq_id);
 
+  infc_browser_cache_load(browser);
+
+  priv->retry_after = retry_after;
+  priv->reconnect_attempts = 0;
   priv->status = INF_BROWSER_OPEN;
   g_object_notify(G_OBJECT(browser), "status");
 
@@ -2961,66 +3748,206 @@ infc_browser_handle_welcome(InfcBrowser* browser,
   return TRUE;
 }
 
+/* Adds one <node> child of a <node-list> message to parent. */
 static gboolean
-infc_browser_handle_explore_begin(InfcBrowser* browser,
-                                  InfXmlConnection* connection,
-                                  xmlNodePtr xml,
-                                  GError** error)
+infc_browser_handle_node_list_item(InfcBrowser* browser,
+                                   InfcBrowserNode* parent,
+                                   InfcRequest* request,
+                                   xmlNodePtr xml,
+                                   GError** error)
 {
   InfcBrowserPrivate* priv;
-  InfcRequest* request;
-  guint total;
-
-  guint node_id;
   InfcBrowserNode* node;
+  guint id;
+  xmlChar* name;
+  xmlChar* type;
+  InfAclSheetSet* sheet_set;
+  GError* local_error;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
-  /* TODO: Allow exploration without us asking. We should then create a
-   * request here, and correctly handle the case when there is already one. */
-  request = infc_request_manager_get_request_by_xml_required(
-    priv->request_manager,
-    "explore-node",
-    xml,
-    error
-  );
-
-  if(request == NULL) return FALSE;
-  g_assert(INFC_IS_PROGRESS_REQUEST(request));
-
-  if(!inf_xml_util_get_attribute_uint_required(xml, "total", &total, error))
+  if(!infc_browser_validate_progress_request(
+       browser,
+       INFC_PROGRESS_REQUEST(request),
+       error))
+  {
     return FALSE;
+  }
 
-  g_object_get(G_OBJECT(request), "node-id", &node_id, NULL);
-  g_assert(node_id != G_MAXUINT);
-
-  node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
+  if(inf_xml_util_get_attribute_uint_required(xml, "id", &id, error) == FALSE)
+    return FALSE;
 
-  if(node == NULL)
+  if(g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(id)) != NULL ||
+     infc_browser_find_subreq(browser, id) != NULL)
   {
-    g_set_error_literal(
+    g_set_error(
       error,
       inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
-      _("Node to explore does no longer exist")
+      INF_DIRECTORY_ERROR_NODE_EXISTS,
+      _("Node with ID \"%u\" exists already"),
+      id
     );
 
     return FALSE;
   }
-  else if(node->type != INFC_BROWSER_NODE_SUBDIRECTORY)
+
+  type = inf_xml_util_get_attribute_required(xml, "type", error);
+  if(type == NULL) return FALSE;
+
+  name = inf_xml_util_get_attribute_required(xml, "name", error);
+  if(name == NULL)
   {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY,
-      _("Node to explore is not a subdirectory")
-    );
+    xmlFree(type);
+    return FALSE;
+  }
 
+  local_error = NULL;
+  sheet_set = inf_acl_sheet_set_from_xml(xml, &local_error);
+
+  if(local_error != NULL)
+  {
+    xmlFree(type);
+    xmlFree(name);
+    g_propagate_error(error, local_error);
     return FALSE;
   }
-  else if(node->shared.subdir.explored == TRUE)
+
+  if(strcmp((const gchar*)type, "InfSubdirectory") == 0)
   {
-    g_set_error_literal(
+    node = infc_browser_node_add_subdirectory(
+      browser,
+      parent,
+      request,
+      id,
+      (const gchar*)name,
+      sheet_set,
+      xml
+    );
+  }
+  else
+  {
+    node = infc_browser_node_add_note(
+      browser,
+      parent,
+      request,
+      id,
+      (const gchar*)name,
+      (const gchar*)type,
+      sheet_set,
+      NULL
+    );
+  }
+
+  infc_browser_process_add_node_request(browser, request, node);
+
+  if(sheet_set != NULL)
+    inf_acl_sheet_set_free(sheet_set);
+
+  xmlFree(type);
+  xmlFree(name);
+
+  return TRUE;
+}
+
+/* Adds the <node> children of xml to parent, as part of the explore
+ * request. Each node still emits InfBrowser::node-added, but the progress
+ * of the request is only notified once for all of them. */
+static gboolean
+infc_browser_add_node_list(InfcBrowser* browser,
+                           InfcBrowserNode* parent,
+                           InfcRequest* request,
+                           xmlNodePtr xml,
+                           GError** error)
+{
+  xmlNodePtr child;
+  gboolean result;
+
+  g_object_ref(request);
+  g_object_freeze_notify(G_OBJECT(request));
+
+  result = TRUE;
+  for(child = xml->children; child != NULL && result; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "node") != 0) continue;
+
+    result = infc_browser_handle_node_list_item(
+      browser,
+      parent,
+      request,
+      child,
+      error
+    );
+  }
+
+  g_object_thaw_notify(G_OBJECT(request));
+  g_object_unref(request);
+
+  return result;
+}
+
+static gboolean
+infc_browser_handle_explore_begin(InfcBrowser* browser,
+                                  InfXmlConnection* connection,
+                                  xmlNodePtr xml,
+                                  GError** error)
+{
+  InfcBrowserPrivate* priv;
+  InfcRequest* request;
+  guint total;
+  xmlChar* generation;
+  xmlNodePtr cached;
+
+  guint node_id;
+  InfcBrowserNode* node;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  /* TODO: Allow exploration without us asking. We should then create a
+   * request here, and correctly handle the case when there is already one. */
+  request = infc_request_manager_get_request_by_xml_required(
+    priv->request_manager,
+    "explore-node",
+    xml,
+    error
+  );
+
+  if(request == NULL) return FALSE;
+  g_assert(INFC_IS_PROGRESS_REQUEST(request));
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "total", &total, error))
+    return FALSE;
+
+  g_object_get(G_OBJECT(request), "node-id", &node_id, NULL);
+  g_assert(node_id != G_MAXUINT);
+
+  node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
+
+  if(node == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+      _("Node to explore does no longer exist")
+    );
+
+    return FALSE;
+  }
+  else if(node->type != INFC_BROWSER_NODE_SUBDIRECTORY)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY,
+      _("Node to explore is not a subdirectory")
+    );
+
+    return FALSE;
+  }
+  else if(node->shared.subdir.explored == TRUE)
+  {
+    g_set_error_literal(
       error,
       inf_directory_error_quark(),
       INF_DIRECTORY_ERROR_ALREADY_EXPLORED,
@@ -3033,6 +3960,30 @@ infc_browser_handle_explore_begin(InfcBrowser* browser,
   {
     node->shared.subdir.explored = TRUE;
     infc_progress_request_initiated(INFC_PROGRESS_REQUEST(request), total);
+
+    generation = inf_xml_util_get_attribute(xml, "generation");
+    if(generation == NULL) return TRUE;
+
+    g_free(node->shared.subdir.generation);
+    node->shared.subdir.generation = g_strdup((const gchar*)generation);
+    xmlFree(generation);
+
+    /* The server leaves out the children if the generation we sent along
+     * with the explore-node request is still the current one. */
+    cached = infc_browser_cache_lookup_folder(
+      browser,
+      node->id,
+      node->shared.subdir.generation
+    );
+
+    if(cached == NULL) return TRUE;
+
+    if(!infc_browser_add_node_list(browser, node, request, cached, error))
+    {
+      infc_browser_cache_remove_folder(browser, node->id);
+      return FALSE;
+    }
+
     return TRUE;
   }
 }
@@ -3048,6 +3999,7 @@ infc_browser_handle_explore_end(InfcBrowser* browser,
   guint current;
   guint total;
   InfBrowserIter iter;
+  InfcBrowserNode* node;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -3087,6 +4039,10 @@ infc_browser_handle_explore_end(InfcBrowser* browser,
      * cancelled before. */
     g_assert(iter.node != NULL);
 
+    node = (InfcBrowserNode*)iter.node;
+    if(node->shared.subdir.generation != NULL)
+      infc_browser_cache_store_folder(browser, node);
+
     infc_request_manager_finish_request(
       priv->request_manager,
       request,
@@ -3197,7 +4153,8 @@ infc_browser_handle_add_node(InfcBrowser* browser,
       request,
       id,
       (const gchar*)name,
-      sheet_set
+      sheet_set,
+      xml
     );
 
     if(request != NULL)
@@ -3321,6 +4278,55 @@ infc_browser_handle_add_node(InfcBrowser* browser,
   return result;
 }
 
+/* A <node-list> carries many children of an explored subdirectory at once,
+ * instead of one <add-node> message per child. */
+static gboolean
+infc_browser_handle_node_list(InfcBrowser* browser,
+                              InfXmlConnection* connection,
+                              xmlNodePtr xml,
+                              GError** error)
+{
+  InfcBrowserPrivate* priv;
+  InfcRequest* request;
+  InfcBrowserNode* parent;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  request = infc_request_manager_get_request_by_xml_required(
+    priv->request_manager,
+    "explore-node",
+    xml,
+    error
+  );
+
+  if(request == NULL) return FALSE;
+  g_assert(INFC_IS_PROGRESS_REQUEST(request));
+
+  parent = infc_browser_get_node_from_xml_typed(
+    browser,
+    xml,
+    "parent",
+    INFC_BROWSER_NODE_SUBDIRECTORY,
+    error
+  );
+
+  if(parent == NULL) return FALSE;
+
+  if(parent->shared.subdir.explored == FALSE)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NOT_EXPLORED,
+      _("The parent node has not been explored yet")
+    );
+
+    return FALSE;
+  }
+
+  return infc_browser_add_node_list(browser, parent, request, xml, error);
+}
+
 static gboolean
 infc_browser_handle_sync_in(InfcBrowser* browser,
                             InfXmlConnection* connection,
@@ -3554,6 +4560,10 @@ infc_browser_handle_subscribe_session(InfcBrowser* browser,
   InfcRequest* request;
   InfCommunicationJoinedGroup* group;
   InfcBrowserSubreq* subreq;
+  InfcSessionProxy* resync;
+  xmlChar* resync_attr;
+  xmlChar* instance_attr;
+  gchar* instance;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -3618,7 +4628,45 @@ infc_browser_handle_subscribe_session(InfcBrowser* browser,
     NULL
   );
 
-  subreq = infc_browser_add_subreq_session(browser, node, request, group);
+  /* Only reuse the proxy if the server agreed to resynchronize it. Older
+   * servers do not know about resynchronization and send the whole session
+   * instead. */
+  resync = NULL;
+  if(request != NULL)
+  {
+    resync = g_object_steal_qdata(
+      G_OBJECT(request),
+      infc_browser_resync_proxy_quark
+    );
+
+    resync_attr = inf_xml_util_get_attribute(xml, "resync");
+    if(resync != NULL && resync_attr == NULL)
+    {
+      g_object_unref(resync);
+      resync = NULL;
+    }
+
+    if(resync_attr != NULL)
+      xmlFree(resync_attr);
+  }
+
+  instance = NULL;
+  instance_attr = inf_xml_util_get_attribute(xml, "instance");
+  if(instance_attr != NULL)
+  {
+    instance = g_strdup((const gchar*)instance_attr);
+    xmlFree(instance_attr);
+  }
+
+  subreq = infc_browser_add_subreq_session(
+    browser,
+    node,
+    request,
+    group,
+    resync,
+    instance
+  );
+
   g_object_unref(group);
 
   infc_browser_subscribe_ack(browser, connection, subreq);
@@ -4058,6 +5106,67 @@ infc_browser_handle_add_acl_account(InfcBrowser* browser,
   return TRUE;
 }
 
+/* Adds account, which was received from the server in reply to request, to
+ * the local account cache, or updates the cached entry. Takes ownership of
+ * account, and returns the cached account. */
+static InfAclAccount*
+infc_browser_cache_account(InfcBrowser* browser,
+                           InfAclAccount* account,
+                           InfcRequest* request,
+                           const gchar* request_type)
+{
+  InfcBrowserPrivate* priv;
+  InfAclAccount* existing_account;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  existing_account = g_hash_table_lookup(
+    priv->accounts,
+    INF_ACL_ACCOUNT_ID_TO_POINTER(account->id)
+  );
+
+  if(existing_account != NULL)
+  {
+    /* Update account name, if it has changed */
+    if(strcmp(existing_account->name, account->name) != 0)
+    {
+      g_free(existing_account->name);
+      existing_account->name = g_strdup(account->name);
+    }
+
+    inf_acl_account_free(account);
+    return existing_account;
+  }
+
+  /* Should not happen, as we should have served this from our cache. If
+   * this happens, the server lied to us. */
+  if(priv->account_list_status == INFC_BROWSER_ACCOUNT_LIST_NOTIFICATIONS)
+  {
+    g_warning(
+      _("Unknown account ID \"%s\" in server reply of "
+        "\"%s\". Typically, this means the server claimed it notified us "
+        "about new connections as soon as they are available, but it "
+        "did not do so."),
+      inf_acl_account_id_to_string(account->id),
+      request_type
+    );
+  }
+
+  g_hash_table_insert(
+    priv->accounts,
+    INF_ACL_ACCOUNT_ID_TO_POINTER(account->id),
+    account
+  );
+
+  inf_browser_acl_account_added(
+    INF_BROWSER(browser),
+    account,
+    INF_REQUEST(request)
+  );
+
+  return account;
+}
+
 static gboolean
 infc_browser_handle_lookup_acl_accounts(InfcBrowser* browser,
                                         InfXmlConnection* connection,
@@ -4071,7 +5180,6 @@ infc_browser_handle_lookup_acl_accounts(InfcBrowser* browser,
 
   GPtrArray* accounts;
   InfAclAccount* account;
-  InfAclAccount* existing_account;
   InfAclAccount req_account;
   InfcBrowserLookupAclAccountByByNameData lookup_data;
   GArray* req_accounts;
@@ -4121,52 +5229,12 @@ infc_browser_handle_lookup_acl_accounts(InfcBrowser* browser,
   /* Update local account table */
   for(i = 0; i < accounts->len; ++i)
   {
-    account = (InfAclAccount*)accounts->pdata[i];
-
-    existing_account = g_hash_table_lookup(
-      priv->accounts,
-      INF_ACL_ACCOUNT_ID_TO_POINTER(account->id)
+    infc_browser_cache_account(
+      browser,
+      (InfAclAccount*)accounts->pdata[i],
+      request,
+      "lookup-acl-accounts"
     );
-
-    if(existing_account != NULL)
-    {
-      /* Update account name, if it has changed */
-      if(strcmp(existing_account->name, account->name) != 0)
-      {
-        g_free(existing_account->name);
-        existing_account->name = g_strdup(account->name);
-      }
-
-      inf_acl_account_free(account);
-    }
-    else
-    {
-      /* Should not happen, as we should have served this from our cache. If
-       * this happens, the server lied to us. */
-      if(priv->account_list_status == INFC_BROWSER_ACCOUNT_LIST_NOTIFICATIONS)
-      {
-        g_warning(
-          _("Unknown account ID \"%s\" in server reply of "
-            "\"%s\". Typically, this means the server claimed it notified us "
-            "about new connections as soon as they are available, but it "
-            "did not do so."),
-          inf_acl_account_id_to_string(account->id),
-          "lookup-acl-accounts"
-        );
-      }
-
-      g_hash_table_insert(
-        priv->accounts,
-        INF_ACL_ACCOUNT_ID_TO_POINTER(account->id),
-        account
-      );
-
-      inf_browser_acl_account_added(
-        INF_BROWSER(browser),
-        account,
-        INF_REQUEST(request)
-      );
-    }
   }
 
   g_ptr_array_free(accounts, TRUE);
@@ -4261,15 +5329,119 @@ infc_browser_handle_lookup_acl_accounts(InfcBrowser* browser,
 }
 
 static gboolean
-infc_browser_handle_change_acl_account(InfcBrowser* browser,
+infc_browser_handle_query_acl_accounts(InfcBrowser* browser,
                                        InfXmlConnection* connection,
                                        xmlNodePtr xml,
                                        GError** error)
 {
   InfcBrowserPrivate* priv;
-  InfAclAccount* account;
-  InfAclAccount* existing_account;
-  GHashTable* new_acls;
+  InfcRequest* request;
+  xmlNodePtr child;
+  guint n_total;
+
+  GPtrArray* accounts;
+  InfAclAccount* account;
+  GArray* req_accounts;
+  guint i;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  request = infc_request_manager_get_request_by_xml_required(
+    priv->request_manager,
+    "query-acl-accounts",
+    xml,
+    error
+  );
+
+  if(request == NULL) return FALSE;
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "total", &n_total, error))
+    return FALSE;
+
+  /* Read accounts from XML structure */
+  accounts = g_ptr_array_new();
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const gchar*)child->name, "account") == 0)
+    {
+      account = inf_acl_account_from_xml(child, error);
+      if(account == NULL)
+      {
+        for(i = 0; i < accounts->len; ++i)
+          inf_acl_account_free(accounts->pdata[i]);
+        g_ptr_array_free(accounts, TRUE);
+        return FALSE;
+      }
+
+      g_ptr_array_add(accounts, account);
+    }
+  }
+
+  if(accounts->len > n_total)
+  {
+    for(i = 0; i < accounts->len; ++i)
+      inf_acl_account_free(accounts->pdata[i]);
+    g_ptr_array_free(accounts, TRUE);
+
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_UNEXPECTED_MESSAGE,
+      _("The server sent more accounts than it claims to exist")
+    );
+
+    return FALSE;
+  }
+
+  /* Cache the accounts, and put the cached entries into the result, so that
+   * they stay valid until the request has finished. */
+  req_accounts = g_array_sized_new(
+    FALSE,
+    FALSE,
+    sizeof(InfAclAccount),
+    accounts->len
+  );
+
+  for(i = 0; i < accounts->len; ++i)
+  {
+    account = infc_browser_cache_account(
+      browser,
+      (InfAclAccount*)accounts->pdata[i],
+      request,
+      "query-acl-accounts"
+    );
+
+    g_array_append_val(req_accounts, *account);
+  }
+
+  g_ptr_array_free(accounts, TRUE);
+
+  infc_request_manager_finish_request(
+    priv->request_manager,
+    request,
+    inf_request_result_make_query_acl_accounts(
+      INF_BROWSER(browser),
+      (InfAclAccount*)req_accounts->data,
+      req_accounts->len,
+      n_total
+    )
+  );
+
+  g_array_free(req_accounts, TRUE);
+  return TRUE;
+}
+
+static gboolean
+infc_browser_handle_change_acl_account(InfcBrowser* browser,
+                                       InfXmlConnection* connection,
+                                       xmlNodePtr xml,
+                                       GError** error)
+{
+  InfcBrowserPrivate* priv;
+  InfAclAccount* account;
+  InfAclAccount* existing_account;
+  GHashTable* new_acls;
   xmlNodePtr child;
   gboolean res;
   InfAclSheet* sheet;
@@ -4364,6 +5536,7 @@ infc_browser_handle_change_acl_account(InfcBrowser* browser,
   }
 
   priv->local_account = account;
+  infc_browser_cache_reset(browser);
   infc_browser_enforce_acl(browser, priv->root, NULL, new_acls);
   g_hash_table_destroy(new_acls);
 
@@ -4655,6 +5828,7 @@ infc_browser_handle_remove_acl_account(InfcBrowser* browser,
     );
 
     g_assert(priv->local_account != NULL);
+    infc_browser_cache_reset(browser);
     infc_browser_enforce_acl(browser, priv->root, NULL, NULL);
 
     inf_browser_acl_local_account_changed(
@@ -5058,6 +6232,15 @@ infc_browser_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const gchar*)node->name, "node-list") == 0)
+  {
+    infc_browser_handle_node_list(
+      browser,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else if(strcmp((const gchar*)node->name, "sync-in") == 0)
   {
     infc_browser_handle_sync_in(
@@ -5148,6 +6331,15 @@ infc_browser_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const gchar*)node->name, "query-acl-accounts") == 0)
+  {
+    infc_browser_handle_query_acl_accounts(
+      browser,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else if(strcmp((const gchar*)node->name, "change-acl-account") == 0)
   {
     infc_browser_handle_change_acl_account(
@@ -5345,27 +6537,53 @@ infc_browser_communication_object_sent(InfCommunicationObject* object,
       {
         g_assert(subreq->shared.session.node->id == node_id);
 
-        infc_browser_subscribe_session(
-          browser,
-          subreq->shared.session.node,
-          subreq->shared.session.request,
-          subreq->shared.session.subscription_group,
-          connection,
-          TRUE
+        if(subreq->shared.session.resync != NULL)
+        {
+          infc_browser_resubscribe_session(
+            browser,
+            subreq->shared.session.node,
+            subreq->shared.session.request,
+            subreq->shared.session.subscription_group,
+            connection,
+            subreq->shared.session.resync
+          );
+        }
+        else
+        {
+          infc_browser_subscribe_session(
+            browser,
+            subreq->shared.session.node,
+            subreq->shared.session.request,
+            subreq->shared.session.subscription_group,
+            connection,
+            TRUE
+          );
+        }
+
+        g_assert(
+          subreq->shared.session.node->type == INFC_BROWSER_NODE_NOTE_KNOWN
         );
 
+        proxy = subreq->shared.session.node->shared.known.session;
+        g_assert(proxy != NULL);
+
+        /* Remember which server-side proxy the session belongs to, so that
+         * it can be resynchronized after reconnecting. */
+        if(subreq->shared.session.instance != NULL)
+        {
+          g_object_set_qdata_full(
+            G_OBJECT(proxy),
+            infc_browser_session_instance_quark,
+            g_strdup(subreq->shared.session.instance),
+            g_free
+          );
+        }
+
         if(subreq->shared.session.request != NULL)
         {
           iter.node = subreq->shared.session.node;
           iter.node_id = node_id;
 
-          g_assert(
-            subreq->shared.session.node->type == INFC_BROWSER_NODE_NOTE_KNOWN
-          );
-
-          proxy = subreq->shared.session.node->shared.known.session;
-          g_assert(proxy != NULL);
-
           infc_request_manager_finish_request(
             priv->request_manager,
             subreq->shared.session.request,
@@ -5735,6 +6953,8 @@ infc_browser_browser_explore(InfBrowser* browser,
   InfcBrowserNode* node;
   InfcRequest* request;
   xmlNodePtr xml;
+  xmlNodePtr cached;
+  xmlChar* generation;
 
   g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
   infc_browser_return_val_if_iter_fail(browser, iter, NULL);
@@ -5766,6 +6986,32 @@ infc_browser_browser_explore(InfBrowser* browser,
   xml = infc_browser_request_to_xml(request);
   inf_xml_util_set_attribute_uint(xml, "id", node->id);
 
+  /* Let the server send the children in <node-list> messages. Servers that
+   * do not know about them ignore this and send <add-node> messages. */
+  inf_xml_util_set_attribute_uint(
+    xml,
+    "node-list",
+    INFC_BROWSER_NODE_LIST_SIZE
+  );
+
+  /* If we have a listing from an earlier connection, ask the server to only
+   * confirm it if it is still up to date. */
+  cached = infc_browser_cache_lookup_folder(
+    INFC_BROWSER(browser),
+    node->id,
+    NULL
+  );
+
+  if(cached != NULL)
+  {
+    generation = inf_xml_util_get_attribute(cached, "generation");
+    if(generation != NULL)
+    {
+      inf_xml_util_set_attribute(xml, "generation", (const char*)generation);
+      xmlFree(generation);
+    }
+  }
+
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
     priv->connection,
@@ -6044,6 +7290,95 @@ infc_browser_browser_get_node_type(InfBrowser* infbrowser,
   }
 }
 
+/* Sends a subscribe-session request for iter. If resync is not NULL, then
+ * the server is asked to bring the session of resync up to date instead of
+ * synchronizing the whole session. */
+static InfRequest*
+infc_browser_send_subscribe_session(InfcBrowser* browser,
+                                    const InfBrowserIter* iter,
+                                    InfcSessionProxy* resync,
+                                    InfRequestFunc func,
+                                    gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfcRequest* request;
+  const gchar* instance;
+  InfSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  gchar* vector;
+  xmlNodePtr xml;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  node = (InfcBrowserNode*)iter->node;
+
+  request = infc_request_manager_add_request(
+    priv->request_manager,
+    INFC_TYPE_REQUEST,
+    "subscribe-session",
+    G_CALLBACK(func),
+    user_data,
+    "node-id", iter->node_id,
+    NULL
+  );
+
+  inf_browser_begin_request(INF_BROWSER(browser), iter, INF_REQUEST(request));
+
+  xml = infc_browser_request_to_xml(request);
+  inf_xml_util_set_attribute_uint(xml, "id", node->id);
+
+  /* Without the instance of the server-side proxy the server cannot tell
+   * whether the session's state is meaningful to it, so fall back to a full
+   * synchronization then. */
+  instance = NULL;
+  if(resync != NULL)
+  {
+    instance = g_object_get_qdata(
+      G_OBJECT(resync),
+      infc_browser_session_instance_quark
+    );
+  }
+
+  if(instance != NULL)
+  {
+    g_object_set_qdata_full(
+      G_OBJECT(request),
+      infc_browser_resync_proxy_quark,
+      g_object_ref(resync),
+      g_object_unref
+    );
+
+    g_object_get(G_OBJECT(resync), "session", &session, NULL);
+    algorithm = inf_adopted_session_get_algorithm(
+      INF_ADOPTED_SESSION(session)
+    );
+    vector = inf_adopted_state_vector_to_string(
+      inf_adopted_algorithm_get_current(algorithm)
+    );
+
+    inf_xml_util_set_attribute(xml, "resync", vector);
+    inf_xml_util_set_attribute(xml, "instance", instance);
+
+    g_free(vector);
+    g_object_unref(session);
+  }
+
+  if(resync != NULL)
+  {
+    infc_browser_send_resubscription(browser, xml);
+  }
+  else
+  {
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      priv->connection,
+      xml
+    );
+  }
+
+  return INF_REQUEST(request);
+}
+
 static InfRequest*
 infc_browser_browser_subscribe(InfBrowser* browser,
                                const InfBrowserIter* iter,
@@ -6052,8 +7387,6 @@ infc_browser_browser_subscribe(InfBrowser* browser,
 {
   InfcBrowserPrivate* priv;
   InfcBrowserNode* node;
-  InfcRequest* request;
-  xmlNodePtr xml;
 
   g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
 
@@ -6076,28 +7409,13 @@ infc_browser_browser_subscribe(InfBrowser* browser,
     NULL
   );
 
-  request = infc_request_manager_add_request(
-    priv->request_manager,
-    INFC_TYPE_REQUEST,
-    "subscribe-session",
-    G_CALLBACK(func),
-    user_data,
-    "node-id", iter->node_id,
-    NULL
-  );
-
-  inf_browser_begin_request(browser, iter, INF_REQUEST(request));
-
-  xml = infc_browser_request_to_xml(request);
-  inf_xml_util_set_attribute_uint(xml, "id", node->id);
-
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    priv->connection,
-    xml
+  return infc_browser_send_subscribe_session(
+    INFC_BROWSER(browser),
+    iter,
+    NULL,
+    func,
+    user_data
   );
-
-  return INF_REQUEST(request);
 }
 
 static InfSessionProxy*
@@ -6523,6 +7841,47 @@ infc_browser_browser_lookup_acl_account_by_name(InfBrowser* infbrowser,
   return INF_REQUEST(request);
 }
 
+static InfRequest*
+infc_browser_browser_query_acl_accounts(InfBrowser* browser,
+                                        const gchar* prefix,
+                                        guint offset,
+                                        guint limit,
+                                        InfRequestFunc func,
+                                        gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcRequest* request;
+  xmlNodePtr xml;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  request = infc_request_manager_add_request(
+    priv->request_manager,
+    INFC_TYPE_REQUEST,
+    "query-acl-accounts",
+    G_CALLBACK(func),
+    user_data,
+    NULL
+  );
+
+  inf_browser_begin_request(browser, NULL, INF_REQUEST(request));
+
+  xml = infc_browser_request_to_xml(request);
+  if(prefix != NULL && *prefix != '\0')
+    inf_xml_util_set_attribute(xml, "prefix", prefix);
+  if(offset > 0)
+    inf_xml_util_set_attribute_uint(xml, "offset", offset);
+  inf_xml_util_set_attribute_uint(xml, "limit", limit);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    priv->connection,
+    xml
+  );
+
+  return INF_REQUEST(request);
+}
+
 static InfRequest*
 infc_browser_browser_create_acl_account(InfBrowser* browser,
                                         gnutls_x509_crq_t crq,
@@ -6807,6 +8166,14 @@ infc_browser_class_init(InfcBrowserClass* browser_class)
     "infc-browser-sync-in-plugin-quark"
   );
 
+  infc_browser_resync_proxy_quark = g_quark_from_static_string(
+    "infc-browser-resync-proxy-quark"
+  );
+
+  infc_browser_session_instance_quark = g_quark_from_static_string(
+    "infc-browser-session-instance-quark"
+  );
+
   infc_browser_lookup_acl_accounts_ids_quark = g_quark_from_static_string(
     "infc-browser-lookup-acl-accounts-ids-quark"
   );
@@ -6860,14 +8227,115 @@ infc_browser_class_init(InfcBrowserClass* browser_class)
     )
   );
 
+  /**
+   * InfcBrowser:cache-directory:
+   *
+   * A directory in which listings of explored subdirectories are kept
+   * between connections, one file per server certificate, or %NULL to not
+   * keep any. When a subdirectory is explored again and the server reports
+   * that its content has not changed since, the children are taken from the
+   * cache instead of being transferred again. Only connections with a
+   * server certificate use the cache. A change of this property takes
+   * effect with the next connection to the server.
+   */
   g_object_class_install_property(
     object_class,
-    PROP_CHAT_SESSION,
-    g_param_spec_object(
-      "chat-session",
-      "Chat session",
-      "Active chat session",
-      INFC_TYPE_SESSION_PROXY,
+    PROP_CACHE_DIRECTORY,
+    g_param_spec_string(
+      "cache-directory",
+      "Cache directory",
+      "Directory to cache explored subdirectories in",
+      NULL,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfcBrowser:reconnect:
+   *
+   * Whether to open the connection again automatically when it has been
+   * closed, for example because the server was restarted. Attempts are made
+   * after #InfcBrowser:reconnect-interval at first, doubling the time with
+   * every failed attempt up to #InfcBrowser:reconnect-max-interval. Each
+   * delay is randomized between half of and the full time, so that the
+   * clients of a server do not all come back at the same moment. If the
+   * server advertised a retry-after time, the delay is at least that long.
+   *
+   * Set this to %FALSE before closing the connection deliberately.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_RECONNECT,
+    g_param_spec_boolean(
+      "reconnect",
+      "Reconnect",
+      "Whether to reopen the connection automatically when it was closed",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_RECONNECT_INTERVAL,
+    g_param_spec_uint(
+      "reconnect-interval",
+      "Reconnect interval",
+      "Milliseconds to wait before the first attempt to reconnect",
+      0,
+      G_MAXUINT,
+      1000,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_RECONNECT_MAX_INTERVAL,
+    g_param_spec_uint(
+      "reconnect-max-interval",
+      "Reconnect maximum interval",
+      "The maximum number of milliseconds to wait between two attempts to "
+      "reconnect",
+      0,
+      G_MAXUINT,
+      60000,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfcBrowser:resubscribe-interval:
+   *
+   * The number of milliseconds between two resubscriptions made with
+   * infc_browser_iter_resubscribe_session(), randomized between half of and
+   * the full time. If a client reconnects with many documents open,
+   * resubscribing to all of them at once makes the server bring them all up
+   * to date at the same time. With a non-zero interval the requests are
+   * queued and sent one after the other instead. 0 sends them right away.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_RESUBSCRIBE_INTERVAL,
+    g_param_spec_uint(
+      "resubscribe-interval",
+      "Resubscribe interval",
+      "Milliseconds between two resubscriptions to sessions",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_CHAT_SESSION,
+    g_param_spec_object(
+      "chat-session",
+      "Chat session",
+      "Active chat session",
+      INFC_TYPE_SESSION_PROXY,
       G_PARAM_READABLE
     )
   );
@@ -6921,6 +8389,7 @@ infc_browser_browser_iface_init(InfBrowserInterface* iface)
   iface->lookup_acl_accounts = infc_browser_browser_lookup_acl_accounts;
   iface->lookup_acl_account_by_name =
     infc_browser_browser_lookup_acl_account_by_name;
+  iface->query_acl_accounts = infc_browser_browser_query_acl_accounts;
   iface->create_acl_account = infc_browser_browser_create_acl_account;
   iface->remove_acl_account = infc_browser_browser_remove_acl_account;
   iface->query_acl = infc_browser_browser_query_acl;
@@ -7129,6 +8598,101 @@ infc_browser_iter_save_session(InfcBrowser* browser,
   return INF_REQUEST(request);
 }
 
+/**
+ * infc_browser_iter_resubscribe_session:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to a note in @browser.
+ * @proxy: A #InfcSessionProxy from an earlier subscription to the note.
+ * @func: (scope async): The function to be called when the request finishes,
+ * or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Subscribes to the note @iter points to, like inf_browser_subscribe(), but
+ * tries to reuse the session of @proxy instead of having the server
+ * synchronize the whole session again. This is meant for reconnecting after
+ * the connection to the server was lost: in that case @proxy is not
+ * subscribed anymore, but its session still has the content it had at that
+ * time. The server then only sends the users and requests that the session
+ * has missed in the meanwhile.
+ *
+ * @proxy must not be subscribed to any connection anymore, and its session
+ * must be a running #InfAdoptedSession that has been subscribed to the same
+ * note before with @browser. Local users of the session stay unavailable,
+ * they need to be rejoined with inf_session_proxy_join_user() after the
+ * request finished.
+ *
+ * If the server can not resynchronize the session, for example because it
+ * does not support resynchronization, because it has been restarted in the
+ * meanwhile, or because some of the requests that the session misses are not
+ * available anymore, then the session is synchronized as usual into a new
+ * #InfcSessionProxy. When the request finishes, the #InfRequestResult
+ * contains the proxy that is being used, which is either @proxy or a new
+ * one.
+ *
+ * The request might either finish during the call to this function, in which
+ * case @func will be called and %NULL being returned. If the request does not
+ * finish within the function call, a #InfRequest object is returned,
+ * where @func has been installed for the #InfRequest::finished signal,
+ * so that it is called as soon as the request finishes.
+ *
+ * Returns: (transfer none) (allow-none): A #InfRequest that may be used to
+ * get notified when the request finishes or fails.
+ **/
+InfRequest*
+infc_browser_iter_resubscribe_session(InfcBrowser* browser,
+                                      const InfBrowserIter* iter,
+                                      InfcSessionProxy* proxy,
+                                      InfRequestFunc func,
+                                      gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfSession* session;
+  gboolean is_adopted;
+  InfSessionStatus status;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  infc_browser_return_val_if_iter_fail(browser, iter, NULL);
+  g_return_val_if_fail(INFC_IS_SESSION_PROXY(proxy), NULL);
+  g_return_val_if_fail(
+    infc_session_proxy_get_connection(proxy) == NULL,
+    NULL
+  );
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  node = (InfcBrowserNode*)iter->node;
+
+  g_return_val_if_fail(priv->connection != NULL, NULL);
+  g_return_val_if_fail(priv->status == INF_BROWSER_OPEN, NULL);
+  g_return_val_if_fail(node->type == INFC_BROWSER_NODE_NOTE_KNOWN, NULL);
+  g_return_val_if_fail(node->shared.known.session == NULL, NULL);
+
+  g_return_val_if_fail(
+    inf_browser_get_pending_request(
+      INF_BROWSER(browser),
+      iter,
+      "subscribe-session"
+    ) == NULL,
+    NULL
+  );
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  is_adopted = INF_ADOPTED_IS_SESSION(session);
+  status = inf_session_get_status(session);
+  g_object_unref(session);
+
+  g_return_val_if_fail(is_adopted, NULL);
+  g_return_val_if_fail(status == INF_SESSION_RUNNING, NULL);
+
+  return infc_browser_send_subscribe_session(
+    browser,
+    iter,
+    proxy,
+    func,
+    user_data
+  );
+}
+
 /**
  * infc_browser_iter_get_sync_in:
  * @browser: A #InfcBrowser.
@@ -7213,6 +8777,38 @@ infc_browser_iter_get_sync_in_requests(InfcBrowser* browser,
   return data.result;
 }
 
+/**
+ * infc_browser_iter_get_redirect:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to a subdirectory node in @browser.
+ *
+ * Returns the location of the server that hosts the content of the
+ * subdirectory @iter points to, if the server @browser is connected to has
+ * delegated it to another server. In that case, exploring the node or adding
+ * nodes to it fails with %INF_DIRECTORY_ERROR_REDIRECTED, and the
+ * application should connect to the returned location instead. The format of
+ * the location is chosen by the server administrator, typically it is a host
+ * name, optionally followed by a colon and a port number.
+ *
+ * Returns: (allow-none): The location of the server hosting the
+ * subdirectory, or %NULL if it is hosted by the server @browser is connected
+ * to.
+ */
+const gchar*
+infc_browser_iter_get_redirect(InfcBrowser* browser,
+                               const InfBrowserIter* iter)
+{
+  InfcBrowserNode* node;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  infc_browser_return_val_if_iter_fail(browser, iter, NULL);
+
+  node = (InfcBrowserNode*)iter->node;
+  infc_browser_return_val_if_subdir_fail(node, NULL);
+
+  return node->shared.subdir.redirect;
+}
+
 /**
  * infc_browser_iter_is_valid:
  * @browser: A #InfcBrowser.
@@ -7240,6 +8836,680 @@ infc_browser_iter_is_valid(InfcBrowser* browser,
   return node != NULL && node == iter->node;
 }
 
+/**
+ * infc_browser_lookup_child:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to an explored subdirectory in @browser.
+ * @name: The name of the child node to look up.
+ * @child: (out) (allow-none): Location to store the child node, or %NULL.
+ *
+ * Looks up the child node of @iter called @name. If there is such a node
+ * and @child is non-%NULL, then @child is set to point to it. Unlike
+ * walking through the children with inf_browser_get_child() and
+ * inf_browser_get_next(), this does not depend on the number of nodes in
+ * the subdirectory.
+ *
+ * Returns: %TRUE if @iter has a child called @name, or %FALSE otherwise.
+ */
+gboolean
+infc_browser_lookup_child(InfcBrowser* browser,
+                          const InfBrowserIter* iter,
+                          const gchar* name,
+                          InfBrowserIter* child)
+{
+  InfcBrowserNode* node;
+  InfcBrowserNode* child_node;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), FALSE);
+  infc_browser_return_val_if_iter_fail(browser, iter, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+
+  node = (InfcBrowserNode*)iter->node;
+  infc_browser_return_val_if_subdir_fail(node, FALSE);
+  g_return_val_if_fail(node->shared.subdir.explored == TRUE, FALSE);
+
+  child_node = g_hash_table_lookup(node->shared.subdir.children, name);
+  if(child_node == NULL) return FALSE;
+
+  if(child != NULL)
+  {
+    child->node_id = child_node->id;
+    child->node = child_node;
+  }
+
+  return TRUE;
+}
+
+/**
+ * infc_browser_lookup_path:
+ * @browser: A #InfcBrowser.
+ * @path: An absolute path such as "/folder/note".
+ * @iter: (out) (allow-none): Location to store the node, or %NULL.
+ *
+ * Looks up the node with the given path, as returned by
+ * inf_browser_get_path(). All subdirectories on the way need to be explored
+ * already, otherwise the node cannot be found. Results are cached, so that
+ * looking up the same path repeatedly is cheap.
+ *
+ * Returns: %TRUE if there is a node at @path, or %FALSE otherwise.
+ */
+gboolean
+infc_browser_lookup_path(InfcBrowser* browser,
+                         const gchar* path,
+                         InfBrowserIter* iter)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  gchar** components;
+  gchar** component;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  if(priv->root == NULL || path[0] != '/') return FALSE;
+
+  node = g_hash_table_lookup(priv->path_cache, path);
+  if(node == NULL)
+  {
+    node = priv->root;
+    if(path[1] != '\0')
+    {
+      components = g_strsplit(path + 1, "/", -1);
+      for(component = components; *component != NULL; ++component)
+      {
+        if(node->type != INFC_BROWSER_NODE_SUBDIRECTORY ||
+           node->shared.subdir.explored == FALSE)
+        {
+          node = NULL;
+          break;
+        }
+
+        /* Empty components never match since all nodes have a name */
+        node = g_hash_table_lookup(node->shared.subdir.children, *component);
+        if(node == NULL) break;
+      }
+
+      g_strfreev(components);
+      if(node == NULL) return FALSE;
+    }
+
+    if(g_hash_table_size(priv->path_cache) >= INFC_BROWSER_PATH_CACHE_SIZE)
+      g_hash_table_remove_all(priv->path_cache);
+    g_hash_table_insert(priv->path_cache, g_strdup(path), node);
+  }
+
+  if(iter != NULL)
+  {
+    iter->node_id = node->id;
+    iter->node = node;
+  }
+
+  return TRUE;
+}
+
+static void
+infc_browser_add_notes_request_cb(InfRequest* request,
+                                  const InfRequestResult* result,
+                                  const GError* error,
+                                  gpointer user_data);
+
+static void
+infc_browser_add_notes_synchronization_complete_cb(InfSession* session,
+                                                   InfXmlConnection* conn,
+                                                   gpointer user_data);
+
+static void
+infc_browser_add_notes_synchronization_failed_cb(InfSession* session,
+                                                 InfXmlConnection* conn,
+                                                 const GError* error,
+                                                 gpointer user_data);
+
+static void
+infc_browser_add_notes_notify_status_cb(GObject* object,
+                                        GParamSpec* pspec,
+                                        gpointer user_data);
+
+static void
+infc_browser_add_notes_complete(InfcBrowserAddNotesData* data)
+{
+  guint i;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(data->browser),
+    G_CALLBACK(infc_browser_add_notes_notify_status_cb),
+    data
+  );
+
+  if(data->error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(data->request), data->error);
+    g_error_free(data->error);
+  }
+  else
+  {
+    inf_request_finish(
+      INF_REQUEST(data->request),
+      inf_request_result_new(NULL, 0)
+    );
+  }
+
+  for(i = 0; i < data->n_notes; ++i)
+  {
+    g_free(data->notes[i].name);
+    g_free(data->notes[i].type);
+    g_object_unref(data->notes[i].session);
+  }
+
+  g_free(data->notes);
+  g_object_unref(data->request);
+  g_object_unref(data->browser);
+  g_slice_free(InfcBrowserAddNotesData, data);
+}
+
+/* Releases everything that is held while note is being added */
+static void
+infc_browser_add_notes_note_done(InfcBrowserAddNotesNote* note,
+                                 const GError* error)
+{
+  InfcBrowserAddNotesData* data;
+  data = note->data;
+
+  if(note->request != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(note->request),
+      G_CALLBACK(infc_browser_add_notes_request_cb),
+      note
+    );
+
+    g_object_unref(note->request);
+    note->request = NULL;
+  }
+
+  if(note->connection != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(note->session),
+      G_CALLBACK(infc_browser_add_notes_synchronization_complete_cb),
+      note
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(note->session),
+      G_CALLBACK(infc_browser_add_notes_synchronization_failed_cb),
+      note
+    );
+
+    g_object_unref(note->connection);
+    note->connection = NULL;
+
+    g_assert(data->in_flight > 0);
+    --data->in_flight;
+  }
+
+  if(error != NULL && data->error == NULL)
+    data->error = g_error_copy(error);
+
+  ++data->n_done;
+  infc_progress_request_progress(data->request);
+}
+
+/* Starts adding more notes until max_in_flight are being synchronized, or
+ * completes the request if all notes have been added. */
+static void
+infc_browser_add_notes_next(InfcBrowserAddNotesData* data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserAddNotesNote* note;
+  GError* error;
+
+  priv = INFC_BROWSER_PRIVATE(data->browser);
+
+  /* If the connection is going down, then the remaining notes are failed
+   * as soon as the browser's status changes. */
+  while(priv->status == INF_BROWSER_OPEN &&
+        data->in_flight < data->max_in_flight &&
+        data->n_sent < data->n_notes)
+  {
+    note = &data->notes[data->n_sent++];
+
+    if(!infc_browser_iter_is_valid(data->browser, &note->parent))
+    {
+      error = g_error_new_literal(
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+        _("The node to add the note to has been removed")
+      );
+
+      infc_browser_add_notes_note_done(note, error);
+      g_error_free(error);
+      continue;
+    }
+
+    /* The note counts as being in flight until its session has been
+     * synchronized to the server, which is when the synchronization
+     * messages have been processed and are no longer kept in memory. */
+    note->connection = priv->connection;
+    g_object_ref(note->connection);
+    ++data->in_flight;
+
+    g_signal_connect(
+      G_OBJECT(note->session),
+      "synchronization-complete",
+      G_CALLBACK(infc_browser_add_notes_synchronization_complete_cb),
+      note
+    );
+
+    g_signal_connect(
+      G_OBJECT(note->session),
+      "synchronization-failed",
+      G_CALLBACK(infc_browser_add_notes_synchronization_failed_cb),
+      note
+    );
+
+    note->request = inf_browser_add_note(
+      INF_BROWSER(data->browser),
+      &note->parent,
+      note->name,
+      note->type,
+      NULL,
+      note->session,
+      FALSE,
+      infc_browser_add_notes_request_cb,
+      note
+    );
+
+    g_assert(note->request != NULL);
+    g_object_ref(note->request);
+  }
+
+  if(data->n_done == data->n_notes)
+    infc_browser_add_notes_complete(data);
+}
+
+static void
+infc_browser_add_notes_request_cb(InfRequest* request,
+                                  const InfRequestResult* result,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfcBrowserAddNotesNote* note;
+  note = (InfcBrowserAddNotesNote*)user_data;
+
+  g_object_unref(note->request);
+  note->request = NULL;
+
+  /* On success, wait for the synchronization to finish */
+  if(error != NULL)
+  {
+    infc_browser_add_notes_note_done(note, error);
+    infc_browser_add_notes_next(note->data);
+  }
+}
+
+static void
+infc_browser_add_notes_synchronization_complete_cb(InfSession* session,
+                                                   InfXmlConnection* conn,
+                                                   gpointer user_data)
+{
+  InfcBrowserAddNotesNote* note;
+  note = (InfcBrowserAddNotesNote*)user_data;
+
+  if(conn != note->connection) return;
+
+  infc_browser_add_notes_note_done(note, NULL);
+  infc_browser_add_notes_next(note->data);
+}
+
+static void
+infc_browser_add_notes_synchronization_failed_cb(InfSession* session,
+                                                 InfXmlConnection* conn,
+                                                 const GError* error,
+                                                 gpointer user_data)
+{
+  InfcBrowserAddNotesNote* note;
+  note = (InfcBrowserAddNotesNote*)user_data;
+
+  if(conn != note->connection) return;
+
+  infc_browser_add_notes_note_done(note, error);
+  infc_browser_add_notes_next(note->data);
+}
+
+static void
+infc_browser_add_notes_notify_status_cb(GObject* object,
+                                        GParamSpec* pspec,
+                                        gpointer user_data)
+{
+  InfcBrowserAddNotesData* data;
+  GError* error;
+  guint i;
+
+  data = (InfcBrowserAddNotesData*)user_data;
+
+  if(INFC_BROWSER_PRIVATE(data->browser)->status == INF_BROWSER_OPEN)
+    return;
+
+  /* Requests are dropped without being finished when the connection goes
+   * down, so fail all notes that have not been added yet. */
+  error = g_error_new_literal(
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_FAILED,
+    _("The connection to the server was closed")
+  );
+
+  for(i = 0; i < data->n_notes; ++i)
+  {
+    if(i >= data->n_sent || data->notes[i].connection != NULL)
+      infc_browser_add_notes_note_done(&data->notes[i], error);
+  }
+
+  g_error_free(error);
+
+  data->n_sent = data->n_notes;
+  infc_browser_add_notes_complete(data);
+}
+
+/**
+ * infc_browser_add_notes_with_content:
+ * @browser: A #InfcBrowser.
+ * @notes: (array length=n_notes): The notes to add.
+ * @n_notes: The number of elements in @notes, must be non-zero.
+ * @max_in_flight: The maximum number of notes to upload at the same time,
+ * must be non-zero.
+ * @func: (scope async): The function to be called when all notes have been
+ * added, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Adds many notes with content to the server, as with one call to
+ * inf_browser_add_note() with a session for each of them. This is meant
+ * for importing many local documents at once.
+ *
+ * Each session's content is synchronized to the server, for which all of
+ * its synchronization messages are created at once. Therefore, only up to
+ * @max_in_flight notes are added at the same time, and the next note is
+ * only added once the synchronization of a previous one has finished. This
+ * still keeps several synchronizations going at a time so that the round
+ * trips to the server overlap, but bounds the memory needed for the
+ * messages that are waiting to be sent.
+ *
+ * The returned request finishes when all notes have been added. Its
+ * #InfcProgressRequest:current property counts the notes that are done.
+ * If adding any of the notes fails, then the request fails with the first
+ * error that occurred, but the notes that could be added stay on the
+ * server. The sessions do not need to stay alive after this call.
+ *
+ * Each parent node must be an explored subdirectory, there must be a plugin
+ * for each note type, and each session must be running.
+ *
+ * The request might finish during the call to this function if none of the
+ * notes can be added, in which case @func is called and %NULL is returned.
+ *
+ * Returns: (transfer none) (allow-none): A #InfRequest that may be used to
+ * get notified when all notes have been added.
+ */
+InfRequest*
+infc_browser_add_notes_with_content(InfcBrowser* browser,
+                                    const InfcBrowserNoteContent* notes,
+                                    guint n_notes,
+                                    guint max_in_flight,
+                                    InfRequestFunc func,
+                                    gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfcBrowserAddNotesData* data;
+  InfcBrowserAddNotesNote* note;
+  InfcProgressRequest* request;
+  guint n_done;
+  guint i;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  g_return_val_if_fail(notes != NULL, NULL);
+  g_return_val_if_fail(n_notes > 0, NULL);
+  g_return_val_if_fail(max_in_flight > 0, NULL);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  g_return_val_if_fail(priv->connection != NULL, NULL);
+  g_return_val_if_fail(priv->status == INF_BROWSER_OPEN, NULL);
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    infc_browser_return_val_if_iter_fail(browser, &notes[i].parent, NULL);
+
+    node = (InfcBrowserNode*)notes[i].parent.node;
+    infc_browser_return_val_if_subdir_fail(node, NULL);
+    g_return_val_if_fail(node->shared.subdir.explored == TRUE, NULL);
+
+    g_return_val_if_fail(notes[i].name != NULL, NULL);
+    g_return_val_if_fail(
+      infc_browser_lookup_plugin(browser, notes[i].type) != NULL,
+      NULL
+    );
+
+    g_return_val_if_fail(INF_IS_SESSION(notes[i].session), NULL);
+    g_return_val_if_fail(
+      inf_session_get_status(notes[i].session) == INF_SESSION_RUNNING,
+      NULL
+    );
+  }
+
+  data = g_slice_new(InfcBrowserAddNotesData);
+  data->browser = browser;
+  g_object_ref(browser);
+
+  /* This request is not sent to the server itself, so it is not managed by
+   * the request manager. */
+  data->request = INFC_PROGRESS_REQUEST(
+    g_object_new(
+      INFC_TYPE_PROGRESS_REQUEST,
+      "type", "add-notes",
+      NULL
+    )
+  );
+
+  if(func != NULL)
+  {
+    g_signal_connect_after(
+      G_OBJECT(data->request),
+      "finished",
+      G_CALLBACK(func),
+      user_data
+    );
+  }
+
+  infc_progress_request_initiated(data->request, n_notes);
+
+  data->notes = g_new(InfcBrowserAddNotesNote, n_notes);
+  data->n_notes = n_notes;
+  data->n_sent = 0;
+  data->n_done = 0;
+  data->in_flight = 0;
+  data->max_in_flight = max_in_flight;
+  data->error = NULL;
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    note = &data->notes[i];
+    note->data = data;
+    note->parent = notes[i].parent;
+    note->name = g_strdup(notes[i].name);
+    note->type = g_strdup(notes[i].type);
+    note->session = notes[i].session;
+    g_object_ref(note->session);
+    note->request = NULL;
+    note->connection = NULL;
+  }
+
+  g_signal_connect(
+    G_OBJECT(browser),
+    "notify::status",
+    G_CALLBACK(infc_browser_add_notes_notify_status_cb),
+    data
+  );
+
+  request = data->request;
+  g_object_ref(request);
+
+  infc_browser_add_notes_next(data);
+
+  /* All notes might have failed right away, in which case the request has
+   * finished already. */
+  g_object_get(G_OBJECT(request), "current", &n_done, NULL);
+  g_object_unref(request);
+
+  if(n_done == n_notes)
+    return NULL;
+  return INF_REQUEST(request);
+}
+
+static void
+infc_browser_subscribe_sessions_cb(InfRequest* request,
+                                   const InfRequestResult* result,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfcBrowserSubscribeSessionsData* data;
+  data = (InfcBrowserSubscribeSessionsData*)user_data;
+
+  if(error != NULL && data->error == NULL)
+    data->error = g_error_copy(error);
+
+  infc_progress_request_progress(data->request);
+
+  g_assert(data->pending > 0);
+  if(--data->pending == 0)
+  {
+    if(data->error != NULL)
+    {
+      inf_request_fail(INF_REQUEST(data->request), data->error);
+      g_error_free(data->error);
+    }
+    else
+    {
+      inf_request_finish(
+        INF_REQUEST(data->request),
+        inf_request_result_new(NULL, 0)
+      );
+    }
+
+    g_object_unref(data->request);
+    g_slice_free(InfcBrowserSubscribeSessionsData, data);
+  }
+}
+
+/**
+ * infc_browser_subscribe_sessions:
+ * @browser: A #InfcBrowser.
+ * @iters: (array length=n_iters): The nodes to subscribe to.
+ * @n_iters: The number of elements in @iters, must be non-zero.
+ * @func: (scope async): The function to be called when all subscriptions
+ * have finished, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Subscribes to the sessions of all nodes in @iters at once, as with one
+ * call to inf_browser_subscribe() for each of them. All subscription
+ * requests are sent to the server in one go, and the returned request
+ * finishes when each of them has finished. Its #InfcProgressRequest:current
+ * property counts the subscriptions that have finished so far, and the
+ * #InfBrowser::subscribe-session signal is emitted for each session as
+ * usual. If any of the subscriptions fails, the returned request fails
+ * with the first error that occurred, but the other sessions stay
+ * subscribed.
+ *
+ * Each of the nodes must be a note of a known type which is neither
+ * subscribed to nor has a subscription request pending.
+ *
+ * Returns: (transfer none): A #InfRequest that may be used to get notified
+ * when all subscriptions have finished.
+ */
+InfRequest*
+infc_browser_subscribe_sessions(InfcBrowser* browser,
+                                const InfBrowserIter* iters,
+                                guint n_iters,
+                                InfRequestFunc func,
+                                gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfcBrowserSubscribeSessionsData* data;
+  InfcProgressRequest* request;
+  guint i;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  g_return_val_if_fail(iters != NULL, NULL);
+  g_return_val_if_fail(n_iters > 0, NULL);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  g_return_val_if_fail(priv->connection != NULL, NULL);
+  g_return_val_if_fail(priv->status == INF_BROWSER_OPEN, NULL);
+
+  for(i = 0; i < n_iters; ++i)
+  {
+    infc_browser_return_val_if_iter_fail(browser, &iters[i], NULL);
+
+    node = (InfcBrowserNode*)iters[i].node;
+    g_return_val_if_fail(node->type == INFC_BROWSER_NODE_NOTE_KNOWN, NULL);
+    g_return_val_if_fail(node->shared.known.session == NULL, NULL);
+
+    g_return_val_if_fail(
+      inf_browser_get_pending_request(
+        INF_BROWSER(browser),
+        &iters[i],
+        "subscribe-session"
+      ) == NULL,
+      NULL
+    );
+  }
+
+  /* This request is not sent to the server itself, so it is not managed by
+   * the request manager. It finishes when the last of the subscription
+   * requests has finished, be it successfully or with an error, for
+   * example because the connection was lost. */
+  request = INFC_PROGRESS_REQUEST(
+    g_object_new(
+      INFC_TYPE_PROGRESS_REQUEST,
+      "type", "subscribe-sessions",
+      NULL
+    )
+  );
+
+  if(func != NULL)
+  {
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(func),
+      user_data
+    );
+  }
+
+  infc_progress_request_initiated(request, n_iters);
+
+  data = g_slice_new(InfcBrowserSubscribeSessionsData);
+  data->request = request;
+  data->pending = n_iters;
+  data->error = NULL;
+
+  /* The messages are queued and sent to the server together, and the
+   * server processes them in one go. */
+  for(i = 0; i < n_iters; ++i)
+  {
+    infc_browser_send_subscribe_session(
+      browser,
+      &iters[i],
+      NULL,
+      infc_browser_subscribe_sessions_cb,
+      data
+    );
+  }
+
+  return INF_REQUEST(request);
+}
+
 /**
  * infc_browser_subscribe_chat:
  * @browser: A #InfcBrowser.
@@ -63,6 +63,24 @@ struct _InfcBrowser {
   GObject parent;
 };
 
+/**
+ * InfcBrowserNoteContent:
+ * @parent: The subdirectory in which to add the note.
+ * @name: The name of the new note.
+ * @type: The type of the new note.
+ * @session: A running session with the content of the new note.
+ *
+ * This structure describes one of the notes added with
+ * infc_browser_add_notes_with_content().
+ */
+typedef struct _InfcBrowserNoteContent InfcBrowserNoteContent;
+struct _InfcBrowserNoteContent {
+  InfBrowserIter parent;
+  const gchar* name;
+  const gchar* type;
+  InfSession* session;
+};
+
 GType
 infc_browser_get_type(void) G_GNUC_CONST;
 
@@ -91,6 +109,13 @@ infc_browser_iter_save_session(InfcBrowser* browser,
                                InfRequestFunc func,
                                gpointer user_data);
 
+InfRequest*
+infc_browser_iter_resubscribe_session(InfcBrowser* browser,
+                                      const InfBrowserIter* iter,
+                                      InfcSessionProxy* proxy,
+                                      InfRequestFunc func,
+                                      gpointer user_data);
+
 InfcSessionProxy*
 infc_browser_iter_get_sync_in(InfcBrowser* browser,
                               const InfBrowserIter* iter);
@@ -99,10 +124,40 @@ GSList*
 infc_browser_iter_get_sync_in_requests(InfcBrowser* browser,
                                        const InfBrowserIter* iter);
 
+const gchar*
+infc_browser_iter_get_redirect(InfcBrowser* browser,
+                               const InfBrowserIter* iter);
+
 gboolean
 infc_browser_iter_is_valid(InfcBrowser* browser,
                            const InfBrowserIter* iter);
 
+gboolean
+infc_browser_lookup_child(InfcBrowser* browser,
+                          const InfBrowserIter* iter,
+                          const gchar* name,
+                          InfBrowserIter* child);
+
+gboolean
+infc_browser_lookup_path(InfcBrowser* browser,
+                         const gchar* path,
+                         InfBrowserIter* iter);
+
+InfRequest*
+infc_browser_add_notes_with_content(InfcBrowser* browser,
+                                    const InfcBrowserNoteContent* notes,
+                                    guint n_notes,
+                                    guint max_in_flight,
+                                    InfRequestFunc func,
+                                    gpointer user_data);
+
+InfRequest*
+infc_browser_subscribe_sessions(InfcBrowser* browser,
+                                const InfBrowserIter* iters,
+                                guint n_iters,
+                                InfRequestFunc func,
+                                gpointer user_data);
+
 InfRequest*
 infc_browser_subscribe_chat(InfcBrowser* browser,
                             InfRequestFunc func,
@@ -30,6 +30,7 @@
  */
 
 #include <libinfinity/client/infc-progress-request.h>
+#include <libinfinity/inf-signals.h>
 
 typedef struct _InfcProgressRequestPrivate InfcProgressRequestPrivate;
 struct _InfcProgressRequestPrivate {
@@ -197,9 +198,9 @@ infc_progress_request_initiated(InfcProgressRequest* request,
   priv->total = total;
   priv->initiated = TRUE;
 
-  g_object_notify(G_OBJECT(request), "total");
+  inf_signal_notify_if_connected(request, "total");
   if(priv->total == 0)
-    g_object_notify(G_OBJECT(request), "progress");
+    inf_signal_notify_if_connected(request, "progress");
 }
 
 /**
@@ -237,8 +238,8 @@ infc_progress_request_progress(InfcProgressRequest* request)
   g_return_if_fail(priv->current < priv->total);
 
   ++priv->current;
-  g_object_notify(G_OBJECT(request), "current");
-  g_object_notify(G_OBJECT(request), "progress");
+  inf_signal_notify_if_connected(request, "current");
+  inf_signal_notify_if_connected(request, "progress");
 }
 
 /* vim:set et sw=2 ts=2: */
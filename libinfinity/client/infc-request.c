@@ -31,10 +31,12 @@
 
 #include <libinfinity/client/infc-request.h>
 #include <libinfinity/common/inf-request.h>
+#include <libinfinity/inf-signals.h>
 
 typedef struct _InfcRequestPrivate InfcRequestPrivate;
 struct _InfcRequestPrivate {
-  gchar* type;
+  /* Interned, since there are only a handful of request types */
+  const gchar* type;
   guint seq;
   guint node_id;
   gboolean finished;
@@ -68,20 +70,6 @@ infc_request_init(InfcRequest* request)
   priv->finished = FALSE;
 }
 
-static void
-infc_request_finalize(GObject* object)
-{
-  InfcRequest* request;
-  InfcRequestPrivate* priv;
-
-  request = INFC_REQUEST(object);
-  priv = INFC_REQUEST_PRIVATE(request);
-
-  g_free(priv->type);
-
-  G_OBJECT_CLASS(infc_request_parent_class)->finalize(object);
-}
-
 static void
 infc_request_set_property(GObject* object,
                           guint prop_id,
@@ -98,7 +86,7 @@ infc_request_set_property(GObject* object,
   {
   case PROP_TYPE:
     g_assert(priv->type == NULL); /* construct only */
-    priv->type = g_value_dup_string(value);
+    priv->type = g_intern_string(g_value_get_string(value));
     break;
   case PROP_SEQ:
     g_assert(priv->seq == G_MAXUINT); /* construct only */
@@ -131,7 +119,7 @@ infc_request_get_property(GObject* object,
   switch(prop_id)
   {
   case PROP_TYPE:
-    g_value_set_string(value, priv->type);
+    g_value_set_static_string(value, priv->type);
     break;
   case PROP_SEQ:
     g_value_set_uint(value, priv->seq);
@@ -172,7 +160,7 @@ infc_request_finished(InfRequest* request,
   priv = INFC_REQUEST_PRIVATE(request);
 
   priv->finished = TRUE;
-  g_object_notify(G_OBJECT(request), "progress");
+  inf_signal_notify_if_connected(request, "progress");
 }
 
 static void
@@ -181,7 +169,6 @@ infc_request_class_init(InfcRequestClass* request_class)
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(request_class);
 
-  object_class->finalize = infc_request_finalize;
   object_class->set_property = infc_request_set_property;
   object_class->get_property = infc_request_get_property;
 
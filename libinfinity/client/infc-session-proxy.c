@@ -40,6 +40,7 @@
 
 #include <libinfinity/client/infc-session-proxy.h>
 #include <libinfinity/client/infc-request-manager.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/common/inf-session-proxy.h>
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-request-result.h>
@@ -57,6 +58,9 @@ struct _InfcSessionProxyPrivate {
   InfCommunicationJoinedGroup* subscription_group;
   InfXmlConnection* connection;
   InfcRequestManager* request_manager;
+
+  /* Whether the server demoted the subscription */
+  gboolean dormant;
 };
 
 enum {
@@ -65,7 +69,8 @@ enum {
   PROP_SESSION,
   PROP_SUBSCRIPTION_GROUP,
   PROP_SEQUENCE_ID,
-  PROP_CONNECTION
+  PROP_CONNECTION,
+  PROP_DORMANT
 };
 
 #define INFC_SESSION_PROXY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFC_TYPE_SESSION_PROXY, InfcSessionProxyPrivate))
@@ -116,6 +121,8 @@ infc_session_proxy_unsubscribe_connection(InfcSessionProxy* proxy)
   if(conn_status == INF_XML_CONNECTION_OPEN &&
      sync_status != INF_SESSION_SYNC_IN_PROGRESS)
   {
+    /* Send requests still held back by the session before unsubscribing */
+    inf_session_flush_subscriptions(priv->session);
     xml = xmlNewNode(NULL, (const xmlChar*)"session-unsubscribe");
 
     inf_communication_group_send_message(
@@ -371,6 +378,7 @@ infc_session_proxy_init(InfcSessionProxy* proxy)
   priv->subscription_group = NULL;
   priv->connection = NULL;
   priv->request_manager = NULL;
+  priv->dormant = FALSE;
 }
 
 static void
@@ -456,6 +464,7 @@ infc_session_proxy_set_property(GObject* object,
     break;
   case PROP_SUBSCRIPTION_GROUP:
   case PROP_CONNECTION:
+  case PROP_DORMANT:
     /* these are read-only because they can only be changed both at once,
      * refer to infc_session_proxy_set_connection(). */
   default:
@@ -487,6 +496,9 @@ infc_session_proxy_get_property(GObject* object,
   case PROP_CONNECTION:
     g_value_set_object(value, G_OBJECT(priv->connection));
     break;
+  case PROP_DORMANT:
+    g_value_set_boolean(value, priv->dormant);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -826,9 +838,23 @@ infc_session_proxy_handle_session_close(InfcSessionProxy* proxy,
                                         GError** error)
 {
   InfcSessionProxyPrivate* priv;
-  priv = INFC_SESSION_PROXY_PRIVATE(proxy);
+  xmlChar* reason;
 
+  priv = INFC_SESSION_PROXY_PRIVATE(proxy);
   g_assert(priv->connection != NULL);
+
+  /* Set before the connection is released, so that it is known when the
+   * browser announces the unsubscription. */
+  reason = xmlGetProp(xml, (const xmlChar*)"reason");
+  if(reason != NULL && strcmp((const char*)reason, "dormant") == 0)
+  {
+    priv->dormant = TRUE;
+    g_object_notify(G_OBJECT(proxy), "dormant");
+  }
+
+  if(reason != NULL)
+    xmlFree(reason);
+
   infc_session_proxy_release_connection(proxy);
 
   /* Do not call inf_session_close so the session can be reused by
@@ -837,6 +863,41 @@ infc_session_proxy_handle_session_close(InfcSessionProxy* proxy,
   return TRUE;
 }
 
+static gboolean
+infc_session_proxy_handle_session_resync(InfcSessionProxy* proxy,
+                                         InfXmlConnection* connection,
+                                         xmlNodePtr xml,
+                                         GError** error)
+{
+  InfcSessionProxyPrivate* priv;
+  priv = INFC_SESSION_PROXY_PRIVATE(proxy);
+
+  if(!INF_ADOPTED_IS_SESSION(priv->session))
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_FAILED,
+      _("Session cannot be resynchronized")
+    );
+
+    return FALSE;
+  }
+
+  if(!inf_adopted_session_resync_from_xml(INF_ADOPTED_SESSION(priv->session),
+                                          connection,
+                                          xml,
+                                          error))
+  {
+    /* The session might have been changed partly, so it is not in sync with
+     * the server anymore. Close it, which also unsubscribes. */
+    inf_session_close(priv->session);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 /*
  * InfNetObject implementation
  */
@@ -955,6 +1016,15 @@ infc_session_proxy_communication_object_received(InfCommunicationObject* obj,
         &local_error
       );
     }
+    else if(strcmp((const char*)node->name, "session-resync") == 0)
+    {
+      infc_session_proxy_handle_session_resync(
+        proxy,
+        connection,
+        node,
+        &local_error
+      );
+    }
     else
     {
       /* forward to session */
@@ -969,13 +1039,19 @@ infc_session_proxy_communication_object_received(InfCommunicationObject* obj,
   if(local_error != NULL)
   {
     /* If the request had a (valid) seq set, we cancel the corresponding
-     * request because the reply could not be processed. */
-    request = infc_request_manager_get_request_by_xml(
-      priv->request_manager,
-      NULL,
-      node,
-      NULL
-    );
+     * request because the reply could not be processed. The handler might
+     * have released the connection already, in which case all requests
+     * have been dropped. */
+    request = NULL;
+    if(priv->request_manager != NULL)
+    {
+      request = infc_request_manager_get_request_by_xml(
+        priv->request_manager,
+        NULL,
+        node,
+        NULL
+      );
+    }
 
     if(request != NULL)
     {
@@ -1052,6 +1128,7 @@ infc_session_proxy_session_proxy_join_user(InfSessionProxy* proxy,
   g_assert(session_class->set_xml_user_props != NULL);
   session_class->set_xml_user_props(priv->session, params, n_params, xml);
 
+  inf_session_flush_subscriptions(priv->session);
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->subscription_group),
     priv->connection,
@@ -1101,6 +1178,19 @@ infc_session_proxy_class_init(InfcSessionProxyClass* proxy_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_DORMANT,
+    g_param_spec_boolean(
+      "dormant",
+      "Dormant",
+      "Whether the server has demoted the subscription because it was idle, "
+      "see infc_session_proxy_is_dormant()",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_SESSION, "session");
 }
 
@@ -1181,6 +1271,7 @@ infc_session_proxy_set_connection(InfcSessionProxy* proxy,
   {
     /* Unsubscribe from running session. Always send the unsubscribe request
      * because synchronizations are not cancelled through this call. */
+    inf_session_flush_subscriptions(priv->session);
     xml = xmlNewNode(NULL, (const xmlChar*)"session-unsubscribe");
 
     inf_communication_group_send_message(
@@ -1215,6 +1306,12 @@ infc_session_proxy_set_connection(InfcSessionProxy* proxy,
 
     g_assert(priv->request_manager == NULL);
     priv->request_manager = infc_request_manager_new(seq_id);
+
+    if(priv->dormant == TRUE)
+    {
+      priv->dormant = FALSE;
+      g_object_notify(G_OBJECT(proxy), "dormant");
+    }
   }
 
   inf_session_set_subscription_group(
@@ -1260,4 +1357,28 @@ infc_session_proxy_get_subscription_group(InfcSessionProxy* proxy)
   return INFC_SESSION_PROXY_PRIVATE(proxy)->subscription_group;
 }
 
+/**
+ * infc_session_proxy_is_dormant:
+ * @proxy: A #InfcSessionProxy.
+ *
+ * Returns whether the server has demoted the subscription of @proxy to a
+ * dormant one, because it did not send anything to the session for a
+ * while, see infd_session_proxy_demote(). In that case @proxy is not
+ * subscribed anymore, and does not receive changes made by others, but its
+ * session keeps running with the content it had at that time.
+ *
+ * Once the user works on the document again, the session can be brought
+ * up to date with infc_browser_iter_resubscribe_session(), which only
+ * transfers the requests the session has missed if possible. This flag is
+ * reset when @proxy is subscribed again.
+ *
+ * Returns: Whether the subscription of @proxy is dormant.
+ **/
+gboolean
+infc_session_proxy_is_dormant(InfcSessionProxy* proxy)
+{
+  g_return_val_if_fail(INFC_IS_SESSION_PROXY(proxy), FALSE);
+  return INFC_SESSION_PROXY_PRIVATE(proxy)->dormant;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -83,6 +83,9 @@ infc_session_proxy_get_connection(InfcSessionProxy* proxy);
 InfCommunicationJoinedGroup*
 infc_session_proxy_get_subscription_group(InfcSessionProxy* proxy);
 
+gboolean
+infc_session_proxy_is_dormant(InfcSessionProxy* proxy);
+
 G_END_DECLS
 
 #endif /* __INFC_SESSION_PROXY_H__ */
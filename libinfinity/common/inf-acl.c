@@ -49,6 +49,7 @@
 #include <libinfinity/inf-define-enum.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 #define MAKE_MASK(x) ((guint64)1 << (guint64)((x) & ((1 << 6) - 1)))
@@ -605,6 +606,115 @@ inf_acl_mask_or1(InfAclMask* mask,
   return mask;
 }
 
+/**
+ * inf_acl_mask_andn:
+ * @lhs: First mask.
+ * @rhs: Second mask.
+ * @out: (out): Output mask.
+ *
+ * Computes the bitwise AND of @lhs and the negation of @rhs, i.e. clears all
+ * bits of @lhs that are set in @rhs, and writes the result to @out. @out is
+ * allowed to be equivalent to @lhs and/or @rhs.
+ *
+ * Returns: (transfer none): The output mask.
+ */
+InfAclMask*
+inf_acl_mask_andn(const InfAclMask* lhs,
+                  const InfAclMask* rhs,
+                  InfAclMask* out)
+{
+  g_return_val_if_fail(lhs != NULL, NULL);
+  g_return_val_if_fail(rhs != NULL, NULL);
+  g_return_val_if_fail(out != NULL, NULL);
+
+  out->mask[0] = lhs->mask[0] & ~rhs->mask[0];
+  out->mask[1] = lhs->mask[1] & ~rhs->mask[1];
+  out->mask[2] = lhs->mask[2] & ~rhs->mask[2];
+  out->mask[3] = lhs->mask[3] & ~rhs->mask[3];
+
+  return out;
+}
+
+/**
+ * inf_acl_mask_andv:
+ * @masks: (array length=n_masks): An array of #InfAclMask<!-- -->s.
+ * @n_masks: The number of masks in @masks.
+ * @out: (out): Output mask.
+ *
+ * Computes the bitwise AND of all masks in @masks and writes the result to
+ * @out. If @n_masks is 0, then @out is set to %INF_ACL_MASK_ALL. @out is
+ * allowed to point into @masks.
+ *
+ * This is faster than calling inf_acl_mask_and() for each mask, and the
+ * loop can be vectorized by the compiler.
+ *
+ * Returns: (transfer none): The output mask.
+ */
+InfAclMask*
+inf_acl_mask_andv(const InfAclMask* masks,
+                  guint n_masks,
+                  InfAclMask* out)
+{
+  guint64 result[G_N_ELEMENTS(out->mask)];
+  guint i;
+  guint j;
+
+  g_return_val_if_fail(masks != NULL || n_masks == 0, NULL);
+  g_return_val_if_fail(out != NULL, NULL);
+
+  for(j = 0; j < G_N_ELEMENTS(result); ++j)
+    result[j] = INF_ACL_MASK_ALL.mask[j];
+
+  for(i = 0; i < n_masks; ++i)
+    for(j = 0; j < G_N_ELEMENTS(result); ++j)
+      result[j] &= masks[i].mask[j];
+
+  for(j = 0; j < G_N_ELEMENTS(result); ++j)
+    out->mask[j] = result[j];
+
+  return out;
+}
+
+/**
+ * inf_acl_mask_orv:
+ * @masks: (array length=n_masks): An array of #InfAclMask<!-- -->s.
+ * @n_masks: The number of masks in @masks.
+ * @out: (out): Output mask.
+ *
+ * Computes the bitwise OR of all masks in @masks and writes the result to
+ * @out. If @n_masks is 0, then @out is cleared. @out is allowed to point
+ * into @masks.
+ *
+ * This is faster than calling inf_acl_mask_or() for each mask, and the
+ * loop can be vectorized by the compiler.
+ *
+ * Returns: (transfer none): The output mask.
+ */
+InfAclMask*
+inf_acl_mask_orv(const InfAclMask* masks,
+                 guint n_masks,
+                 InfAclMask* out)
+{
+  guint64 result[G_N_ELEMENTS(out->mask)];
+  guint i;
+  guint j;
+
+  g_return_val_if_fail(masks != NULL || n_masks == 0, NULL);
+  g_return_val_if_fail(out != NULL, NULL);
+
+  for(j = 0; j < G_N_ELEMENTS(result); ++j)
+    result[j] = 0;
+
+  for(i = 0; i < n_masks; ++i)
+    for(j = 0; j < G_N_ELEMENTS(result); ++j)
+      result[j] |= masks[i].mask[j];
+
+  for(j = 0; j < G_N_ELEMENTS(result); ++j)
+    out->mask[j] = result[j];
+
+  return out;
+}
+
 /**
  * inf_acl_mask_neg:
  * @mask: The mask to negate.
@@ -810,6 +920,56 @@ inf_acl_sheet_perms_to_xml(const InfAclMask* mask,
   g_type_class_unref(enum_class);
 }
 
+static int
+inf_acl_sheet_compare_func(const void* first,
+                           const void* second)
+{
+  InfAclAccountId first_account;
+  InfAclAccountId second_account;
+
+  first_account = ((const InfAclSheet*)first)->account;
+  second_account = ((const InfAclSheet*)second)->account;
+
+  if(first_account < second_account) return -1;
+  if(first_account > second_account) return 1;
+  return 0;
+}
+
+/* Looks up the sheet for account in sheets, which must be sorted by account
+ * ID. If there is no such sheet, *index is set to the position at which it
+ * would need to be inserted. */
+static gboolean
+inf_acl_sheet_set_lookup(const InfAclSheet* sheets,
+                         guint n_sheets,
+                         InfAclAccountId account,
+                         guint* index)
+{
+  guint begin;
+  guint end;
+  guint middle;
+
+  begin = 0;
+  end = n_sheets;
+
+  while(begin < end)
+  {
+    middle = begin + (end - begin) / 2;
+    if(sheets[middle].account == account)
+    {
+      *index = middle;
+      return TRUE;
+    }
+
+    if(sheets[middle].account < account)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+
+  *index = begin;
+  return FALSE;
+}
+
 /**
  * inf_acl_sheet_set_new:
  *
@@ -928,6 +1088,15 @@ inf_acl_sheet_set_sink(InfAclSheetSet* sheet_set)
       sheet_set->n_sheets * sizeof(InfAclSheet)
     );
 
+    /* Sheets owned by the set are kept sorted by account ID, but external
+     * ones can come in any order. */
+    qsort(
+      sheet_set->own_sheets,
+      sheet_set->n_sheets,
+      sizeof(InfAclSheet),
+      inf_acl_sheet_compare_func
+    );
+
     sheet_set->sheets = sheet_set->own_sheets;
   }
 }
@@ -965,6 +1134,7 @@ InfAclSheet*
 inf_acl_sheet_set_add_sheet(InfAclSheetSet* sheet_set,
                             InfAclAccountId account)
 {
+  InfAclSheet* sheet;
   guint i;
 
   g_return_val_if_fail(sheet_set != NULL, NULL);
@@ -975,9 +1145,13 @@ inf_acl_sheet_set_add_sheet(InfAclSheetSet* sheet_set,
     NULL
   );
 
-  for(i = 0; i < sheet_set->n_sheets; ++i)
-    if(sheet_set->own_sheets[i].account == account)
-      return &sheet_set->own_sheets[i];
+  if(inf_acl_sheet_set_lookup(sheet_set->own_sheets,
+                              sheet_set->n_sheets,
+                              account,
+                              &i))
+  {
+    return &sheet_set->own_sheets[i];
+  }
 
   ++sheet_set->n_sheets;
   sheet_set->own_sheets = g_realloc(
@@ -987,10 +1161,17 @@ inf_acl_sheet_set_add_sheet(InfAclSheetSet* sheet_set,
 
   sheet_set->sheets = sheet_set->own_sheets;
 
-  sheet_set->own_sheets[i].account = account;
-  inf_acl_mask_clear(&sheet_set->own_sheets[i].mask);
-  inf_acl_mask_clear(&sheet_set->own_sheets[i].perms); /* not strictly required */
-  return &sheet_set->own_sheets[i];
+  memmove(
+    sheet_set->own_sheets + i + 1,
+    sheet_set->own_sheets + i,
+    (sheet_set->n_sheets - i - 1) * sizeof(InfAclSheet)
+  );
+
+  sheet = &sheet_set->own_sheets[i];
+  sheet->account = account;
+  inf_acl_mask_clear(&sheet->mask);
+  inf_acl_mask_clear(&sheet->perms); /* not strictly required */
+  return sheet;
 }
 
 /**
@@ -999,8 +1180,8 @@ inf_acl_sheet_set_add_sheet(InfAclSheetSet* sheet_set,
  * @sheet: The sheet to remove.
  *
  * Removes a sheet from @sheet_set. @sheet must be one of the sheets inside
- * @sheet_set. The sheet is removed by replacing it with the last sheet in
- * the set, so the order of sheets is not preserved.
+ * @sheet_set. The sheets following it are moved up by one, so that the
+ * order of the remaining sheets is preserved.
  *
  * This function can only be used if the sheet set has not been created with
  * the inf_acl_sheet_set_new_external() function.
@@ -1016,8 +1197,12 @@ inf_acl_sheet_set_remove_sheet(InfAclSheetSet* sheet_set,
   g_return_if_fail(sheet >= sheet_set->own_sheets);
   g_return_if_fail(sheet < sheet_set->own_sheets + sheet_set->n_sheets);
 
-  if(sheet != &sheet_set->own_sheets[sheet_set->n_sheets - 1])
-    *sheet = sheet_set->own_sheets[sheet_set->n_sheets - 1];
+  memmove(
+    sheet,
+    sheet + 1,
+    (sheet_set->own_sheets + sheet_set->n_sheets - sheet - 1) *
+      sizeof(InfAclSheet)
+  );
 
   --sheet_set->n_sheets;
 
@@ -1138,6 +1323,16 @@ inf_acl_sheet_set_get_clear_sheets(const InfAclSheetSet* sheet_set)
     );
   }
 
+  if(sheet_set->own_sheets == NULL)
+  {
+    qsort(
+      set->own_sheets,
+      set->n_sheets,
+      sizeof(InfAclSheet),
+      inf_acl_sheet_compare_func
+    );
+  }
+
   set->sheets = set->own_sheets;
   return set;
 }
@@ -1170,9 +1365,13 @@ inf_acl_sheet_set_find_sheet(InfAclSheetSet* sheet_set,
     NULL
   );
 
-  for(i = 0; i < sheet_set->n_sheets; ++i)
-    if(sheet_set->own_sheets[i].account == account)
-      return &sheet_set->own_sheets[i];
+  if(inf_acl_sheet_set_lookup(sheet_set->own_sheets,
+                              sheet_set->n_sheets,
+                              account,
+                              &i))
+  {
+    return &sheet_set->own_sheets[i];
+  }
 
   return NULL;
 }
@@ -1189,7 +1388,9 @@ inf_acl_sheet_set_find_sheet(InfAclSheetSet* sheet_set,
  * The difference between this function and
  * inf_acl_sheet_set_find_sheet() is that this function returns a sheet
  * that cannot be modified, but it can also be used on a sheet set created
- * with the inf_acl_sheet_set_new_external() function.
+ * with the inf_acl_sheet_set_new_external() function. The sheets of such a
+ * set are not necessarily sorted, so they are searched linearly, while
+ * lookups in other sets take logarithmic time.
  *
  * Returns: (transfer none): A #InfAclSheet for @account, or %NULL.
  */
@@ -1202,6 +1403,19 @@ inf_acl_sheet_set_find_const_sheet(const InfAclSheetSet* sheet_set,
   g_return_val_if_fail(sheet_set != NULL, NULL);
   g_return_val_if_fail(account != 0, NULL);
 
+  if(sheet_set->own_sheets != NULL)
+  {
+    if(inf_acl_sheet_set_lookup(sheet_set->own_sheets,
+                                sheet_set->n_sheets,
+                                account,
+                                &i))
+    {
+      return &sheet_set->own_sheets[i];
+    }
+
+    return NULL;
+  }
+
   for(i = 0; i < sheet_set->n_sheets; ++i)
     if(sheet_set->sheets[i].account == account)
       return &sheet_set->sheets[i];
@@ -1232,6 +1446,7 @@ inf_acl_sheet_set_from_xml(xmlNodePtr xml,
   InfAclSheet read_sheet;
 
   xmlChar* account_id;
+  InfAclAccountId account;
   guint i;
   gboolean result;
 
@@ -1262,23 +1477,6 @@ inf_acl_sheet_set_from_xml(xmlNodePtr xml,
 
       xmlFree(account_id);
 
-      for(i = 0; i < array->len; ++i)
-      {
-        if(g_array_index(array, InfAclSheet, i).account == read_sheet.account)
-        {
-          g_set_error(
-            error,
-            inf_request_error_quark(),
-            INF_REQUEST_ERROR_INVALID_ATTRIBUTE,
-            _("Permissions for account ID \"%s\" defined more than once"),
-            g_quark_to_string(read_sheet.account)
-          );
-
-          g_array_free(array, TRUE);
-          return FALSE;
-        }
-      }
-
       result = inf_acl_sheet_perms_from_xml(
         sheet,
         &read_sheet.mask,
@@ -1301,6 +1499,28 @@ inf_acl_sheet_set_from_xml(xmlNodePtr xml,
       return NULL;
     }
 
+    /* Sort the sheets by account ID, which also brings duplicates next to
+     * each other. */
+    g_array_sort(array, inf_acl_sheet_compare_func);
+
+    for(i = 1; i < array->len; ++i)
+    {
+      account = g_array_index(array, InfAclSheet, i).account;
+      if(g_array_index(array, InfAclSheet, i - 1).account == account)
+      {
+        g_set_error(
+          error,
+          inf_request_error_quark(),
+          INF_REQUEST_ERROR_INVALID_ATTRIBUTE,
+          _("Permissions for account ID \"%s\" defined more than once"),
+          g_quark_to_string(account)
+        );
+
+        g_array_free(array, TRUE);
+        return NULL;
+      }
+    }
+
     sheet_set = inf_acl_sheet_set_new();
     sheet_set->n_sheets = array->len;
     sheet_set->own_sheets = (InfAclSheet*)g_array_free(array, FALSE);
@@ -166,7 +166,9 @@ struct _InfAclSheet {
  * @sheets: An array of #InfAclSheet objects.
  * @n_sheets: The number of elements in the @sheets array.
  *
- * A set of #InfAclSheet<!-- -->s, one for each user.
+ * A set of #InfAclSheet<!-- -->s, one for each user. Unless the set was
+ * created with inf_acl_sheet_set_new_external(), the sheets are sorted by
+ * account ID, so that the sheet for an account can be found quickly.
  */
 typedef struct _InfAclSheetSet InfAclSheetSet;
 struct _InfAclSheetSet {
@@ -269,6 +271,21 @@ InfAclMask*
 inf_acl_mask_or1(InfAclMask* mask,
                  InfAclSetting setting);
 
+InfAclMask*
+inf_acl_mask_andn(const InfAclMask* lhs,
+                  const InfAclMask* rhs,
+                  InfAclMask* out);
+
+InfAclMask*
+inf_acl_mask_andv(const InfAclMask* masks,
+                  guint n_masks,
+                  InfAclMask* out);
+
+InfAclMask*
+inf_acl_mask_orv(const InfAclMask* masks,
+                 guint n_masks,
+                 InfAclMask* out);
+
 InfAclMask*
 inf_acl_mask_neg(const InfAclMask* mask,
                  InfAclMask* out);
@@ -27,15 +27,22 @@
  * #InfAsyncOperation is a simple mechanism to run some code in a separate
  * worker thread and then, once the result is computed, notify the main thread
  * about the result.
+ *
+ * All asynchronous operations share one pool of worker threads. If more
+ * operations are started than there are threads in the pool, the remaining
+ * ones are queued until a thread becomes available. The maximum number of
+ * threads can be changed with inf_async_operation_set_max_threads().
  **/
 
 #include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-async-operation-private.h>
 #include <libinfinity/inf-i18n.h>
 
 struct _InfAsyncOperation {
   InfIo* io;
   InfIoDispatch* dispatch;
-  GThread* thread;
+  /* Set from inf_async_operation_start() until the dispatch has run */
+  gboolean running;
   GMutex mutex;
 
   InfAsyncOperationRunFunc run_func;
@@ -46,6 +53,65 @@ struct _InfAsyncOperation {
   GDestroyNotify run_notify;
 };
 
+typedef struct _InfAsyncOperationJob InfAsyncOperationJob;
+struct _InfAsyncOperationJob {
+  InfAsyncOperationJobFunc func;
+  gpointer data;
+};
+
+#define INF_ASYNC_OPERATION_DEFAULT_MAX_THREADS 16
+
+G_LOCK_DEFINE_STATIC(inf_async_operation_pool);
+static GThreadPool* inf_async_operation_pool;
+static guint inf_async_operation_max_threads =
+  INF_ASYNC_OPERATION_DEFAULT_MAX_THREADS;
+
+static void
+inf_async_operation_pool_func(gpointer data,
+                              gpointer user_data)
+{
+  InfAsyncOperationJob* job;
+  job = (InfAsyncOperationJob*)data;
+
+  job->func(job->data);
+  g_slice_free(InfAsyncOperationJob, job);
+}
+
+/* Queues func to be run in the shared worker pool. The pool is not
+ * exclusive, so its threads come from GLib's shared thread cache and are
+ * reused rather than created and destroyed for every job. */
+void
+_inf_async_operation_push_job(InfAsyncOperationJobFunc func,
+                              gpointer data)
+{
+  InfAsyncOperationJob* job;
+
+  G_LOCK(inf_async_operation_pool);
+
+  /* Creating a non-exclusive pool cannot fail */
+  if(inf_async_operation_pool == NULL)
+  {
+    inf_async_operation_pool = g_thread_pool_new(
+      inf_async_operation_pool_func,
+      NULL,
+      inf_async_operation_max_threads,
+      FALSE,
+      NULL
+    );
+  }
+
+  job = g_slice_new(InfAsyncOperationJob);
+  job->func = func;
+  job->data = data;
+
+  /* If no new thread can be created, the job is still queued, and run as
+   * soon as one of the existing threads becomes available. Therefore, it
+   * must not be treated as failure. */
+  g_thread_pool_push(inf_async_operation_pool, job, NULL);
+
+  G_UNLOCK(inf_async_operation_pool);
+}
+
 static void
 inf_async_operation_dispatch(gpointer data)
 {
@@ -64,18 +130,22 @@ inf_async_operation_dispatch(gpointer data)
 
   op->run_data = NULL;
   op->run_notify = NULL;
-  op->thread = NULL;
+  op->running = FALSE;
   g_mutex_clear(&op->mutex);
 
   inf_async_operation_free(op);
 }
 
-static gpointer
+static void
 inf_async_operation_thread_start(gpointer data)
 {
   InfAsyncOperation* op;
   op = (InfAsyncOperation*)data;
 
+  /* The operation is run even if it has been cancelled while it was still
+   * waiting in the queue: run_func might own user_data, or perform work
+   * such as writing to disk which must not be dropped silently. Only the
+   * done callback is suppressed in that case. */
   op->run_func(&op->run_data, &op->run_notify, op->user_data);
 
   g_mutex_lock(&op->mutex);
@@ -99,11 +169,8 @@ inf_async_operation_thread_start(gpointer data)
 
     g_mutex_unlock(&op->mutex);
     g_mutex_clear(&op->mutex);
-    g_thread_unref(op->thread);
     g_slice_free(InfAsyncOperation, op);
   }
-
-  return NULL;
 }
 
 static void
@@ -131,7 +198,8 @@ inf_async_operation_io_unref_func(gpointer user_data,
  * @user_data: Additional user data to pass to both functions.
  *
  * This function creates a new #InfAsyncOperation. The function given by
- * @run_func will be run asynchronously in a worker thread. Once the function
+ * @run_func will be run asynchronously in a thread of the shared worker
+ * pool. Once the function
  * finishes, its result is passed back to the main thread defined by @io, and
  * @done_func is called with the computed result in the main thread.
  *
@@ -169,7 +237,7 @@ inf_async_operation_new(InfIo* io,
 
   op->io = io;
   op->dispatch = NULL;
-  op->thread = NULL;
+  op->running = FALSE;
 
   op->run_func = run_func;
   op->done_func = done_func;
@@ -193,9 +261,12 @@ inf_async_operation_new(InfIo* io,
  * @error: Location to store error information, if any.
  *
  * Starts the operation given in @op. The operation must have been created
- * before with inf_async_operation_new(). If the operation cannot be started,
- * @error is set and %FALSE is returned. In that case, the operation must not
- * be used anymore since it will be automatically freed.
+ * before with inf_async_operation_new(). If all threads of the worker pool
+ * are busy, the operation is queued until one becomes available. If the
+ * operation cannot be started, @error is set and %FALSE is returned. In that
+ * case, the operation must not be used anymore since it will be
+ * automatically freed. Since operations are queued in the worker pool, this
+ * currently never happens.
  *
  * Returns: %TRUE on success or %FALSE if the operation could not be started.
  */
@@ -204,25 +275,13 @@ inf_async_operation_start(InfAsyncOperation* op,
                           GError** error)
 {
   g_return_val_if_fail(op != NULL, FALSE);
-  g_return_val_if_fail(op->thread == NULL, FALSE);
+  g_return_val_if_fail(op->running == FALSE, FALSE);
 
   g_mutex_init(&op->mutex);
   g_mutex_lock(&op->mutex);
 
-  op->thread = g_thread_try_new(
-    "InfAsyncOperation",
-    inf_async_operation_thread_start,
-    op,
-    error
-  );
-
-  if(op->thread == NULL)
-  {
-    g_mutex_unlock(&op->mutex);
-    g_mutex_clear(&op->mutex);
-    inf_async_operation_free(op);
-    return FALSE;
-  }
+  op->running = TRUE;
+  _inf_async_operation_push_job(inf_async_operation_thread_start, op);
 
   g_mutex_unlock(&op->mutex);
   return TRUE;
@@ -242,7 +301,7 @@ inf_async_operation_free(InfAsyncOperation* op)
 {
   g_return_if_fail(op != NULL);
 
-  if(op->thread == NULL)
+  if(op->running == FALSE)
   {
     /* The async operation has not started yet,
      * or it has finished (dispatched) already. */
@@ -263,11 +322,12 @@ inf_async_operation_free(InfAsyncOperation* op)
 
     if(op->dispatch == NULL)
     {
-      /* We have not dispatched yet, i.e. the worker thread is still running.
-       * We keep the object alive, but remove the IO object, so that the
-       * worker thread does not attempt to dispatch. This also allows to
-       * unreference the IO object from this point onwards. The operation
-       * object is deleted when the thread finishes. */
+      /* We have not dispatched yet, i.e. the operation is still queued or
+       * the worker thread is still running. We keep the object alive, but
+       * remove the IO object, so that the worker thread does not attempt to
+       * dispatch. This also allows to unreference the IO object from this
+       * point onwards. The operation object is deleted when the
+       * worker thread is done with it. */
       g_object_weak_unref(
         G_OBJECT(op->io),
         inf_async_operation_io_unref_func,
@@ -287,10 +347,65 @@ inf_async_operation_free(InfAsyncOperation* op)
 
       g_mutex_unlock(&op->mutex);
       g_mutex_clear(&op->mutex);
-      g_thread_unref(op->thread);
       g_slice_free(InfAsyncOperation, op);
     }
   }
 }
 
+/**
+ * inf_async_operation_set_max_threads:
+ * @max_threads: The maximum number of worker threads, or 0 for the default.
+ *
+ * Sets the maximum number of threads in the worker pool that is shared by
+ * all asynchronous operations, including the authentication sessions of
+ * #InfSaslContext. Operations that are started while all threads are busy
+ * are queued until a thread becomes available. Restricting the number of
+ * threads avoids creating a large number of them when many operations are
+ * started at once, for example when many users log in at the same time.
+ *
+ * If the limit is lowered below the number of currently busy threads, the
+ * superfluous threads exit once they have finished their current operation.
+ */
+void
+inf_async_operation_set_max_threads(guint max_threads)
+{
+  if(max_threads == 0)
+    max_threads = INF_ASYNC_OPERATION_DEFAULT_MAX_THREADS;
+  g_return_if_fail(max_threads <= G_MAXINT);
+
+  G_LOCK(inf_async_operation_pool);
+  inf_async_operation_max_threads = max_threads;
+
+  if(inf_async_operation_pool != NULL)
+  {
+    g_thread_pool_set_max_threads(
+      inf_async_operation_pool,
+      max_threads,
+      NULL
+    );
+  }
+
+  G_UNLOCK(inf_async_operation_pool);
+}
+
+/**
+ * inf_async_operation_get_max_threads:
+ *
+ * Returns the maximum number of threads in the worker pool shared by all
+ * asynchronous operations, see inf_async_operation_set_max_threads().
+ *
+ * Returns: The maximum number of worker threads.
+ */
+guint
+inf_async_operation_get_max_threads(void)
+{
+  guint max_threads;
+
+  G_LOCK(inf_async_operation_pool);
+  max_threads = inf_async_operation_max_threads;
+  G_UNLOCK(inf_async_operation_pool);
+
+  return max_threads;
+}
+
 /* vim:set et sw=2 ts=2: */
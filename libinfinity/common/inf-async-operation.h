@@ -73,6 +73,12 @@ inf_async_operation_start(InfAsyncOperation* op,
 void
 inf_async_operation_free(InfAsyncOperation* op);
 
+void
+inf_async_operation_set_max_threads(guint max_threads);
+
+guint
+inf_async_operation_get_max_threads(void);
+
 G_END_DECLS
 
 #endif /* __INF_ASYNC_OPERATION_H__ */
@@ -1285,6 +1285,65 @@ inf_browser_lookup_acl_account_by_name(InfBrowser* browser,
   return iface->lookup_acl_account_by_name(browser, name, func, user_data);
 }
 
+/**
+ * inf_browser_query_acl_accounts:
+ * @browser: A #InfBrowser.
+ * @prefix: (allow-none): Only query accounts whose name starts with this
+ * string, or %NULL to query all accounts.
+ * @offset: The number of matching accounts to skip.
+ * @limit: The maximum number of accounts to query.
+ * @func: (scope async): The function to be called when the request finishes,
+ * or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Queries a range of the accounts whose name starts with @prefix. The
+ * matching accounts are ordered by name, and at most @limit of them are
+ * returned, starting with the one at position @offset. Unlike
+ * inf_browser_query_acl_account_list(), this does not transfer all accounts
+ * at once, which makes it suitable for presenting a large number of accounts
+ * page by page, or for completing account names while they are typed. The
+ * &quot;default&quot; account has no name and is never part of the result.
+ *
+ * The request result contains the requested range of accounts and the total
+ * number of accounts matching @prefix, so that @limit can be 0 to only count
+ * the matching accounts. Browsers that cache accounts add the returned ones
+ * to their cache, but unlike with inf_browser_query_acl_account_list(), no
+ * notifications about added or removed accounts are enabled by this call.
+ *
+ * The request might either finish during the call to this function, in which
+ * case @func will be called and %NULL being returned. If the request does not
+ * finish within the function call, a #InfRequest object is returned, where
+ * @func has been installed for the #InfRequest::finished signal, so that it
+ * is called as soon as the request finishes.
+ *
+ * Returns: (transfer none) (allow-none): A #InfRequest that can be used to
+ * be notified when the request finishes, or %NULL.
+ */
+InfRequest*
+inf_browser_query_acl_accounts(InfBrowser* browser,
+                               const gchar* prefix,
+                               guint offset,
+                               guint limit,
+                               InfRequestFunc func,
+                               gpointer user_data)
+{
+  InfBrowserInterface* iface;
+
+  g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
+
+  iface = INF_BROWSER_GET_IFACE(browser);
+  g_return_val_if_fail(iface->query_acl_accounts != NULL, NULL);
+
+  return iface->query_acl_accounts(
+    browser,
+    prefix,
+    offset,
+    limit,
+    func,
+    user_data
+  );
+}
+
 /**
  * inf_browser_create_acl_account:
  * @browser: A #InfBrowser.
@@ -1596,8 +1655,7 @@ inf_browser_check_acl(InfBrowser* browser,
         inf_acl_mask_or(&sheet->perms, &temp_mask, &temp_mask);
         inf_acl_mask_and(&perms, &temp_mask, &perms);
         
-        inf_acl_mask_neg(&sheet->mask, &temp_mask);
-        inf_acl_mask_and(&remaining_mask, &temp_mask, &remaining_mask);
+        inf_acl_mask_andn(&remaining_mask, &sheet->mask, &remaining_mask);
       }
 
       if(!inf_acl_mask_empty(&remaining_mask) && default_account != NULL)
@@ -1614,8 +1672,11 @@ inf_browser_check_acl(InfBrowser* browser,
           inf_acl_mask_or(&sheet->perms, &temp_mask, &temp_mask);
           inf_acl_mask_and(&perms, &temp_mask, &perms);
         
-          inf_acl_mask_neg(&sheet->mask, &temp_mask);
-          inf_acl_mask_and(&remaining_mask, &temp_mask, &remaining_mask);
+          inf_acl_mask_andn(
+            &remaining_mask,
+            &sheet->mask,
+            &remaining_mask
+          );
         }
       }
     }
@@ -117,6 +117,8 @@ typedef enum _InfBrowserStatus {
  * @lookup_acl_accounts: Virtual function to find accounts by their ID.
  * @lookup_acl_account_by_name: Virtual function to find an account by its
  * name.
+ * @query_acl_accounts: Virtual function to query a range of the accounts
+ * whose name starts with a given prefix.
  * @create_acl_account: Virtual function to create a new account.
  * @remove_acl_account: Virtual function to remove an account.
  * @query_acl: Virtual function for querying the ACL for a node for all
@@ -255,6 +257,13 @@ struct _InfBrowserInterface {
                                             InfRequestFunc func,
                                             gpointer user_data);
 
+  InfRequest* (*query_acl_accounts)(InfBrowser* browser,
+                                    const gchar* prefix,
+                                    guint offset,
+                                    guint limit,
+                                    InfRequestFunc func,
+                                    gpointer user_data);
+
   InfRequest* (*create_acl_account)(InfBrowser* browser,
                                     gnutls_x509_crq_t crq,
                                     InfRequestFunc func,
@@ -415,6 +424,14 @@ inf_browser_lookup_acl_account_by_name(InfBrowser* browser,
                                        InfRequestFunc func,
                                        gpointer user_data);
 
+InfRequest*
+inf_browser_query_acl_accounts(InfBrowser* browser,
+                               const gchar* prefix,
+                               guint offset,
+                               guint limit,
+                               InfRequestFunc func,
+                               gpointer user_data);
+
 InfRequest*
 inf_browser_create_acl_account(InfBrowser* browser,
                                gnutls_x509_crq_t crq,
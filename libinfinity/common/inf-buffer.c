@@ -111,4 +111,29 @@ inf_buffer_set_modified(InfBuffer* buffer,
   }
 }
 
+/**
+ * inf_buffer_get_size:
+ * @buffer: A #InfBuffer.
+ *
+ * Returns the approximate number of bytes of memory that the content of
+ * @buffer occupies, for example the text of a text buffer. This is meant
+ * for memory accounting, to find out which documents use a lot of memory.
+ * Buffers that do not implement the get_size virtual function report 0.
+ *
+ * Returns: The size of the content of @buffer, in bytes.
+ */
+gsize
+inf_buffer_get_size(InfBuffer* buffer)
+{
+  InfBufferInterface* iface;
+
+  g_return_val_if_fail(INF_IS_BUFFER(buffer), 0);
+
+  iface = INF_BUFFER_GET_IFACE(buffer);
+  if(iface->get_size != NULL)
+    return iface->get_size(buffer);
+  else
+    return 0;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -37,6 +37,8 @@ typedef struct _InfBufferInterface InfBufferInterface;
  * @get_modified: Returns whether the buffer has been modified since the last
  * call to @set_modified set modified flag to %FALSE.
  * @set_modified: Set the current modified state of the buffer.
+ * @get_size: Returns the approximate number of bytes of memory that the
+ * content of the buffer occupies. This is optional.
  *
  * The virtual methods of #InfBuffer.
  */
@@ -49,6 +51,8 @@ struct _InfBufferInterface {
 
   void (*set_modified)(InfBuffer* buffer,
                        gboolean modified);
+
+  gsize (*get_size)(InfBuffer* buffer);
 };
 
 /**
@@ -68,6 +72,9 @@ void
 inf_buffer_set_modified(InfBuffer* buffer,
                         gboolean modified);
 
+gsize
+inf_buffer_get_size(InfBuffer* buffer);
+
 G_END_DECLS
 
 #endif /* __INF_BUFFER_H__ */
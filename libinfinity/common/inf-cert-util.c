@@ -41,7 +41,9 @@
 
 #include <gnutls/x509.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
 
 #define X509_BEGIN_1 "-----BEGIN CERTIFICATE-----"
 #define X509_BEGIN_2 "-----BEGIN X509 CERTIFICATE-----"
@@ -1204,6 +1206,49 @@ inf_cert_util_read_certificate_map(const gchar* filename,
   return table;
 }
 
+/* Appends the line for hostname and cert in a certificate map file to
+ * string. */
+static gboolean
+inf_cert_util_append_certificate_map_entry(GString* string,
+                                           const gchar* hostname,
+                                           gnutls_x509_crt_t cert,
+                                           GError** error)
+{
+  size_t size;
+  int res;
+  gchar* buffer;
+  gchar* encoded_cert;
+
+  size = 0;
+  res = gnutls_x509_crt_export(cert, GNUTLS_X509_FMT_DER, NULL, &size);
+  g_assert(res != GNUTLS_E_SUCCESS);
+
+  buffer = NULL;
+  if(res == GNUTLS_E_SHORT_MEMORY_BUFFER)
+  {
+    buffer = g_malloc(size);
+    res = gnutls_x509_crt_export(cert, GNUTLS_X509_FMT_DER, buffer, &size);
+  }
+
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    g_free(buffer);
+    inf_gnutls_set_error(error, res);
+    return FALSE;
+  }
+
+  encoded_cert = g_base64_encode(buffer, size);
+  g_free(buffer);
+
+  g_string_append(string, hostname);
+  g_string_append_c(string, ':');
+  g_string_append(string, encoded_cert);
+  g_string_append_c(string, '\n');
+
+  g_free(encoded_cert);
+  return TRUE;
+}
+
 /**
  * inf_cert_util_write_certificate_map:
  * @cert_map: (transfer none) (element-type string gnutls_x509_crt_t): A
@@ -1226,65 +1271,108 @@ inf_cert_util_write_certificate_map(GHashTable* cert_map,
                                     const gchar* filename,
                                     GError** error)
 {
-  gchar* dirname;
   GString* string;
-
   GHashTableIter iter;
   gpointer key;
   gpointer value;
-  const gchar* hostname;
-  gnutls_x509_crt_t cert;
-
-  size_t size;
-  int res;
-  gchar* buffer;
-  gchar* encoded_cert;
+  gboolean result;
 
   string = g_string_sized_new(4096 * g_hash_table_size(cert_map));
 
   g_hash_table_iter_init(&iter, cert_map);
   while(g_hash_table_iter_next(&iter, &key, &value))
   {
-    hostname = (const gchar*)key;
-    cert = (gnutls_x509_crt_t)value;
-
-    size = 0;
-    res = gnutls_x509_crt_export(cert, GNUTLS_X509_FMT_DER, NULL, &size);
-    g_assert(res != GNUTLS_E_SUCCESS);
-
-    buffer = NULL;
-    if(res == GNUTLS_E_SHORT_MEMORY_BUFFER)
-    {
-      buffer = g_malloc(size);
-      res = gnutls_x509_crt_export(cert, GNUTLS_X509_FMT_DER, buffer, &size);
-    }
+    result = inf_cert_util_append_certificate_map_entry(
+      string,
+      (const gchar*)key,
+      (gnutls_x509_crt_t)value,
+      error
+    );
 
-    if(res != GNUTLS_E_SUCCESS)
+    if(result == FALSE)
     {
-      g_free(buffer);
       g_string_free(string, TRUE);
-      inf_gnutls_set_error(error, res);
       return FALSE;
     }
-
-    encoded_cert = g_base64_encode(buffer, size);
-    g_free(buffer);
-    
-    g_string_append(string, hostname);
-    g_string_append_c(string, ':');
-    g_string_append(string, encoded_cert);
-    g_string_append_c(string, '\n');
-
-    g_free(encoded_cert);
   }
 
-  g_file_set_contents(
+  result = g_file_set_contents(
     filename,
     string->str,
     string->len,
     error
   );
 
+  g_string_free(string, TRUE);
+  return result;
+}
+
+/**
+ * inf_cert_util_append_certificate_map:
+ * @filename: The name of a file containing a certificate map.
+ * @hostname: The hostname to add to the map.
+ * @cert: (transfer none): The certificate for @hostname.
+ * @error: Location to store error information, if any.
+ *
+ * Adds an entry for @hostname to the certificate map in the file with the
+ * given filename, without rewriting the entries that are already in there.
+ * See inf_cert_util_read_certificate_map() for the format of the file. If
+ * the file does not exist, it is created. The file must not contain an
+ * entry for @hostname already, since reading it back fails otherwise. If an
+ * error occurs, @error is set and the function returns %FALSE.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_cert_util_append_certificate_map(const gchar* filename,
+                                     const gchar* hostname,
+                                     gnutls_x509_crt_t cert,
+                                     GError** error)
+{
+  GString* string;
+  FILE* file;
+  int save_errno;
+
+  string = g_string_sized_new(4096);
+  if(!inf_cert_util_append_certificate_map_entry(string, hostname, cert,
+                                                 error))
+  {
+    g_string_free(string, TRUE);
+    return FALSE;
+  }
+
+  file = g_fopen(filename, "ab");
+  if(file == NULL)
+  {
+    save_errno = errno;
+    g_string_free(string, TRUE);
+
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      g_strerror(save_errno)
+    );
+
+    return FALSE;
+  }
+
+  if(fwrite(string->str, 1, string->len, file) != string->len ||
+     fclose(file) != 0)
+  {
+    save_errno = errno;
+    g_string_free(string, TRUE);
+
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      g_strerror(save_errno)
+    );
+
+    return FALSE;
+  }
+
   g_string_free(string, TRUE);
   return TRUE;
 }
@@ -127,6 +127,12 @@ inf_cert_util_write_certificate_map(GHashTable* cert_map,
                                     const gchar* filename,
                                     GError** error);
 
+gboolean
+inf_cert_util_append_certificate_map(const gchar* filename,
+                                     const gchar* hostname,
+                                     gnutls_x509_crt_t cert,
+                                     GError** error);
+
 gboolean
 inf_cert_util_check_certificate_key(gnutls_x509_crt_t cert,
                                     gnutls_x509_privkey_t key);
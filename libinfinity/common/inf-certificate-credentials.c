@@ -31,11 +31,14 @@
 
 #include <libinfinity/common/inf-certificate-credentials.h>
 
+#include <string.h>
+
 G_DEFINE_BOXED_TYPE(InfCertificateCredentials, inf_certificate_credentials, inf_certificate_credentials_ref, inf_certificate_credentials_unref)
 
 struct _InfCertificateCredentials {
   guint ref_count;
   gnutls_certificate_credentials_t creds;
+  gnutls_datum_t ticket_key;
 };
 
 /**
@@ -56,6 +59,8 @@ inf_certificate_credentials_new(void)
 
   creds->ref_count = 1;
   gnutls_certificate_allocate_credentials(&creds->creds);
+  creds->ticket_key.data = NULL;
+  creds->ticket_key.size = 0;
 
   return creds;
 }
@@ -90,6 +95,12 @@ inf_certificate_credentials_unref(InfCertificateCredentials* creds)
   if(!--creds->ref_count)
   {
     gnutls_certificate_free_credentials(creds->creds);
+    if(creds->ticket_key.data != NULL)
+    {
+      memset(creds->ticket_key.data, 0, creds->ticket_key.size);
+      gnutls_free(creds->ticket_key.data);
+    }
+
     g_slice_free(InfCertificateCredentials, creds);
   }
 }
@@ -110,4 +121,29 @@ inf_certificate_credentials_get(InfCertificateCredentials* creds)
   return creds->creds;
 }
 
+/**
+ * inf_certificate_credentials_get_session_ticket_key:
+ * @creds: A #InfCertificateCredentials.
+ *
+ * Returns the key with which server-side TLS sessions using @creds encrypt
+ * their session tickets. Clients can present such a ticket when they
+ * reconnect, to resume their previous session without a full handshake.
+ * The key is generated randomly when this function is first called, so all
+ * sessions sharing the same credentials can resume each other's sessions,
+ * and tickets become invalid when @creds is freed.
+ *
+ * Returns: The session ticket key for @creds, owned by @creds.
+ */
+const gnutls_datum_t*
+inf_certificate_credentials_get_session_ticket_key(
+  InfCertificateCredentials* creds)
+{
+  g_return_val_if_fail(creds != NULL, NULL);
+
+  if(creds->ticket_key.data == NULL)
+    gnutls_session_ticket_key_generate(&creds->ticket_key);
+
+  return &creds->ticket_key;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -52,6 +52,10 @@ inf_certificate_credentials_unref(InfCertificateCredentials* creds);
 gnutls_certificate_credentials_t
 inf_certificate_credentials_get(InfCertificateCredentials* creds);
 
+const gnutls_datum_t*
+inf_certificate_credentials_get_session_ticket_key(
+  InfCertificateCredentials* creds);
+
 G_END_DECLS
 
 #endif /* __INF_CERTIFICATE_CREDENTIALS_H__ */
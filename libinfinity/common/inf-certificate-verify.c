@@ -66,6 +66,8 @@
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <glib/gstdio.h>
+
 #include <gnutls/x509.h>
 
 static const GFlagsValue inf_certificate_verify_flags_values[] = {
@@ -119,6 +121,25 @@ enum {
 
 static guint certificate_verify_signals[LAST_SIGNAL];
 
+/* The content of a known hosts file, and the modification time, size and
+ * inode of the file when it was read or written, to notice when it has been
+ * modified by someone else. exists is FALSE if there was no file. */
+typedef struct _InfCertificateVerifyKnownHosts InfCertificateVerifyKnownHosts;
+struct _InfCertificateVerifyKnownHosts {
+  GHashTable* table;
+  gboolean exists;
+  gint64 mtime;
+  gint64 size;
+  guint64 inode;
+};
+
+/* Maps known hosts filenames to InfCertificateVerifyKnownHosts, so that the
+ * file is only parsed again if it has changed, even if there are many
+ * InfCertificateVerify objects using the same file. Protected by a lock
+ * since they can live in different threads. */
+static GHashTable* inf_certificate_verify_known_hosts_cache;
+G_LOCK_DEFINE_STATIC(inf_certificate_verify_known_hosts_cache);
+
 #define INF_CERTIFICATE_VERIFY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_CERTIFICATE_VERIFY, InfCertificateVerifyPrivate))
 
 INF_DEFINE_FLAGS_TYPE(InfCertificateVerifyFlags, inf_certificate_verify_flags, inf_certificate_verify_flags_values)
@@ -197,27 +218,156 @@ inf_certificate_verify_set_known_hosts(InfCertificateVerify* verify,
   priv->known_hosts_filename = g_strdup(known_hosts_filename);
 }
 
+static void
+inf_certificate_verify_known_hosts_free(gpointer data)
+{
+  InfCertificateVerifyKnownHosts* known_hosts;
+  known_hosts = (InfCertificateVerifyKnownHosts*)data;
+
+  g_hash_table_unref(known_hosts->table);
+  g_slice_free(InfCertificateVerifyKnownHosts, known_hosts);
+}
+
+static void
+inf_certificate_verify_known_hosts_stat(
+  const gchar* filename,
+  InfCertificateVerifyKnownHosts* known_hosts)
+{
+  GStatBuf st;
+
+  if(g_stat(filename, &st) == 0)
+  {
+    known_hosts->exists = TRUE;
+    known_hosts->mtime = st.st_mtime;
+    known_hosts->size = st.st_size;
+    known_hosts->inode = st.st_ino;
+  }
+  else
+  {
+    known_hosts->exists = FALSE;
+    known_hosts->mtime = 0;
+    known_hosts->size = 0;
+    known_hosts->inode = 0;
+  }
+}
+
+/* Returns whether the file has not been changed since the cache entry for
+ * it was made. Must be called with the cache lock held. */
+static gboolean
+inf_certificate_verify_known_hosts_is_current(
+  const gchar* filename,
+  const InfCertificateVerifyKnownHosts* known_hosts)
+{
+  InfCertificateVerifyKnownHosts current;
+  inf_certificate_verify_known_hosts_stat(filename, &current);
+
+  return current.exists == known_hosts->exists &&
+         current.mtime == known_hosts->mtime &&
+         current.size == known_hosts->size &&
+         current.inode == known_hosts->inode;
+}
+
+/* Remembers that the file has the content of table, as of the time stamp
+ * in stamp, or as of now if stamp is NULL. Must be called with the cache
+ * lock held. */
+static void
+inf_certificate_verify_known_hosts_update(
+  const gchar* filename,
+  GHashTable* table,
+  const InfCertificateVerifyKnownHosts* stamp)
+{
+  InfCertificateVerifyKnownHosts* known_hosts;
+
+  if(inf_certificate_verify_known_hosts_cache == NULL)
+  {
+    inf_certificate_verify_known_hosts_cache = g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      g_free,
+      inf_certificate_verify_known_hosts_free
+    );
+  }
+
+  known_hosts = g_slice_new(InfCertificateVerifyKnownHosts);
+  known_hosts->table = g_hash_table_ref(table);
+
+  if(stamp != NULL)
+  {
+    known_hosts->exists = stamp->exists;
+    known_hosts->mtime = stamp->mtime;
+    known_hosts->size = stamp->size;
+    known_hosts->inode = stamp->inode;
+  }
+  else
+  {
+    inf_certificate_verify_known_hosts_stat(filename, known_hosts);
+  }
+
+  g_hash_table_replace(
+    inf_certificate_verify_known_hosts_cache,
+    g_strdup(filename),
+    known_hosts
+  );
+}
+
+/* Returns the known hosts table, which is shared with all other
+ * InfCertificateVerify objects using the same file. The file is only read
+ * if it has changed since the last time it was read or written. */
 static GHashTable*
 inf_certificate_verify_ref_known_hosts(InfCertificateVerify* verify,
                                        GError** error)
 {
   InfCertificateVerifyPrivate* priv;
-  InfCertificateVerifyQuery* query;
+  InfCertificateVerifyKnownHosts* known_hosts;
+  GHashTable* table;
+  InfCertificateVerifyKnownHosts stamp;
 
   priv = INF_CERTIFICATE_VERIFY_PRIVATE(verify);
-  if(priv->queries != NULL)
+
+  G_LOCK(inf_certificate_verify_known_hosts_cache);
+
+  known_hosts = NULL;
+  if(inf_certificate_verify_known_hosts_cache != NULL)
   {
-    query = (InfCertificateVerifyQuery*)priv->queries->data;
-    g_hash_table_ref(query->known_hosts);
-    return query->known_hosts;
+    known_hosts = g_hash_table_lookup(
+      inf_certificate_verify_known_hosts_cache,
+      priv->known_hosts_filename
+    );
+  }
+
+  if(known_hosts != NULL &&
+     inf_certificate_verify_known_hosts_is_current(
+       priv->known_hosts_filename,
+       known_hosts))
+  {
+    table = g_hash_table_ref(known_hosts->table);
   }
   else
   {
-    return inf_cert_util_read_certificate_map(
+    /* Take the file's time stamp before reading it, so that if it is
+     * changed while being read, it is read again next time. */
+    inf_certificate_verify_known_hosts_stat(
+      priv->known_hosts_filename,
+      &stamp
+    );
+
+    table = inf_cert_util_read_certificate_map(
       priv->known_hosts_filename,
       error
     );
+
+    if(table != NULL)
+    {
+      inf_certificate_verify_known_hosts_update(
+        priv->known_hosts_filename,
+        table,
+        &stamp
+      );
+    }
   }
+
+  G_UNLOCK(inf_certificate_verify_known_hosts_cache);
+  return table;
 }
 
 static gboolean
@@ -249,17 +399,98 @@ inf_certificate_verify_write_known_hosts(InfCertificateVerify* verify,
 
   g_free(dirname);
 
-  return inf_cert_util_write_certificate_map(
-    table,
+  if(!inf_cert_util_write_certificate_map(table, priv->known_hosts_filename,
+                                          error))
+  {
+    return FALSE;
+  }
+
+  G_LOCK(inf_certificate_verify_known_hosts_cache);
+  inf_certificate_verify_known_hosts_update(
     priv->known_hosts_filename,
-    error
+    table,
+    NULL
   );
+  G_UNLOCK(inf_certificate_verify_known_hosts_cache);
+
+  return TRUE;
+}
+
+/* Writes the entry for hostname, which has just been added to table, to the
+ * known hosts file. If the file has the content of table otherwise, the
+ * entry is appended to it, or else the whole file is written again. */
+static gboolean
+inf_certificate_verify_add_known_host(InfCertificateVerify* verify,
+                                      GHashTable* table,
+                                      const gchar* hostname,
+                                      GError** error)
+{
+  InfCertificateVerifyPrivate* priv;
+  InfCertificateVerifyKnownHosts* known_hosts;
+  gboolean append;
+  gboolean result;
+
+  priv = INF_CERTIFICATE_VERIFY_PRIVATE(verify);
+
+  G_LOCK(inf_certificate_verify_known_hosts_cache);
+
+  known_hosts = NULL;
+  if(inf_certificate_verify_known_hosts_cache != NULL)
+  {
+    known_hosts = g_hash_table_lookup(
+      inf_certificate_verify_known_hosts_cache,
+      priv->known_hosts_filename
+    );
+  }
+
+  append = known_hosts != NULL && known_hosts->table == table &&
+    known_hosts->exists &&
+    inf_certificate_verify_known_hosts_is_current(
+      priv->known_hosts_filename,
+      known_hosts
+    );
+
+  if(append)
+  {
+    result = inf_cert_util_append_certificate_map(
+      priv->known_hosts_filename,
+      hostname,
+      g_hash_table_lookup(table, hostname),
+      error
+    );
+
+    /* If only part of the entry was written, the file needs to be read
+     * again, which then probably fails, instead of trusting the cache. */
+    if(result == TRUE)
+    {
+      inf_certificate_verify_known_hosts_update(
+        priv->known_hosts_filename,
+        table,
+        NULL
+      );
+    }
+    else
+    {
+      g_hash_table_remove(
+        inf_certificate_verify_known_hosts_cache,
+        priv->known_hosts_filename
+      );
+    }
+  }
+
+  G_UNLOCK(inf_certificate_verify_known_hosts_cache);
+
+  if(append)
+    return result;
+
+  return inf_certificate_verify_write_known_hosts(verify, table, error);
 }
 
 static void
 inf_certificate_verify_write_known_hosts_with_warning(
   InfCertificateVerify* verify,
-  GHashTable* table)
+  GHashTable* table,
+  const gchar* added_hostname)
 {
   InfCertificateVerifyPrivate* priv;
   GError* error;
@@ -268,7 +499,19 @@ inf_certificate_verify_write_known_hosts_with_warning(
   priv = INF_CERTIFICATE_VERIFY_PRIVATE(verify);
   error = NULL;
 
-  result = inf_certificate_verify_write_known_hosts(verify, table, &error);
+  if(added_hostname != NULL)
+  {
+    result = inf_certificate_verify_add_known_host(
+      verify,
+      table,
+      added_hostname,
+      &error
+    );
+  }
+  else
+  {
+    result = inf_certificate_verify_write_known_hosts(verify, table, &error);
+  }
 
   if(error != NULL)
   {
@@ -460,7 +703,8 @@ inf_certificate_verify_certificate_func(InfXmppConnection* connection,
         {
           inf_certificate_verify_write_known_hosts_with_warning(
             verify,
-            table
+            table,
+            NULL
           );
         }
       }
@@ -869,9 +1113,12 @@ inf_certificate_verify_checked(InfCertificateVerify* verify,
       cert = inf_cert_util_copy_certificate(cert, &error);
       g_hash_table_insert(query->known_hosts, hostname, cert);
 
+      /* A new host can be appended to the file, but if the certificate of
+       * a known host changed, the old entry needs to be replaced. */
       inf_certificate_verify_write_known_hosts_with_warning(
         query->verify,
-        query->known_hosts
+        query->known_hosts,
+        known_cert == NULL ? hostname : NULL
       );
     }
     else
@@ -136,6 +136,16 @@ inf_chat_buffer_reserve_message(InfChatBuffer* buffer,
   begin = 0;
   end = priv->num_messages;
 
+  /* Most messages are added in order, both when they are received and when
+   * the history is synchronized, so check the newest message first before
+   * searching the whole buffer. */
+  if(end > 0)
+  {
+    message = &priv->messages[(priv->first_message + end - 1) % priv->size];
+    if(message->time <= time)
+      begin = end;
+  }
+
   /* Find the place at which to insert the new message */
   while(begin != end)
   {
@@ -447,6 +457,22 @@ inf_chat_buffer_buffer_set_modified(InfBuffer* buffer,
   }
 }
 
+static gsize
+inf_chat_buffer_buffer_get_size(InfBuffer* buffer)
+{
+  InfChatBufferPrivate* priv;
+  gsize size;
+  guint i;
+
+  priv = INF_CHAT_BUFFER_PRIVATE(buffer);
+  size = priv->alloc_messages * sizeof(InfChatBufferMessage);
+
+  for(i = 0; i < priv->num_messages; ++i)
+    size += priv->messages[(priv->first_message + i) % priv->size].length;
+
+  return size;
+}
+
 /*
  * GType registration
  */
@@ -504,6 +530,7 @@ inf_chat_buffer_buffer_iface_init(InfBufferInterface* iface)
 {
   iface->get_modified = inf_chat_buffer_buffer_get_modified;
   iface->set_modified = inf_chat_buffer_buffer_set_modified;
+  iface->get_size = inf_chat_buffer_buffer_get_size;
 }
 
 /*
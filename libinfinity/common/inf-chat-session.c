@@ -32,6 +32,7 @@
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -51,12 +52,26 @@ typedef struct _InfChatSessionPrivate InfChatSessionPrivate;
 struct _InfChatSessionPrivate {
   gchar* log_filename;
   FILE* log_file;
+
+  /* Messages sent and logged within one main loop iteration are flushed
+   * together from this dispatch, if an InfIo is set */
+  InfIo* io;
+  InfIoDispatch* flush_dispatch;
+  gboolean log_dirty;
+
+  guint sync_history;
+
+  guint history_requests;
+  gboolean history_complete;
 };
 
 enum {
   PROP_0,
 
-  PROP_LOG_FILE
+  PROP_LOG_FILE,
+  PROP_IO,
+  PROP_SYNC_HISTORY,
+  PROP_HISTORY_COMPLETE
 };
 
 enum {
@@ -295,10 +310,96 @@ inf_chat_session_message_from_xml(InfChatSession* session,
   return TRUE;
 }
 
+/*
+ * Coalescing
+ */
+
+static void
+inf_chat_session_flush(InfChatSession* session)
+{
+  InfChatSessionPrivate* priv;
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  if(inf_session_get_subscription_group(INF_SESSION(session)) != NULL)
+    inf_session_flush_subscriptions(INF_SESSION(session));
+
+  if(priv->log_dirty)
+  {
+    if(priv->log_file != NULL)
+      fflush(priv->log_file);
+    priv->log_dirty = FALSE;
+  }
+}
+
+static void
+inf_chat_session_flush_func(gpointer user_data)
+{
+  InfChatSession* session;
+  InfChatSessionPrivate* priv;
+
+  session = INF_CHAT_SESSION(user_data);
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+  priv->flush_dispatch = NULL;
+
+  inf_chat_session_flush(session);
+}
+
+static void
+inf_chat_session_schedule_flush(InfChatSession* session)
+{
+  InfChatSessionPrivate* priv;
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  g_assert(priv->io != NULL);
+
+  if(priv->flush_dispatch == NULL)
+  {
+    priv->flush_dispatch = inf_io_add_dispatch(
+      priv->io,
+      inf_chat_session_flush_func,
+      session,
+      NULL
+    );
+  }
+}
+
+static void
+inf_chat_session_cancel_flush(InfChatSession* session)
+{
+  InfChatSessionPrivate* priv;
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  if(priv->flush_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->flush_dispatch);
+    priv->flush_dispatch = NULL;
+  }
+}
+
 /*
  * Logging functions
  */
 
+/* Flushes the log file, or, if there is an InfIo, defers this until the end
+ * of the current main loop iteration, so that a burst of messages is written
+ * to the log in one go. */
+static void
+inf_chat_session_flush_log(InfChatSession* session)
+{
+  InfChatSessionPrivate* priv;
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  if(priv->io != NULL)
+  {
+    priv->log_dirty = TRUE;
+    inf_chat_session_schedule_flush(session);
+  }
+  else
+  {
+    fflush(priv->log_file);
+  }
+}
+
 static gchar*
 inf_chat_session_strdup_strftime(const char* format,
                                  const struct tm* tm,
@@ -368,7 +469,7 @@ inf_chat_session_log_message(InfChatSession* session,
     }
 
     g_free(time_str);
-    fflush(priv->log_file);
+    inf_chat_session_flush_log(session);
   }
 }
 
@@ -436,23 +537,10 @@ static gboolean
 inf_chat_session_receive_message(InfChatSession* session,
                                  InfXmlConnection* connection,
                                  xmlNodePtr xml,
+                                 gboolean sync,
                                  GError** error)
 {
-  InfChatSessionPrivate* priv;
   InfChatBufferMessage message;
-  gboolean sync;
-
-  priv = INF_CHAT_SESSION_PRIVATE(session);
-
-  if(inf_session_get_status(INF_SESSION(session)) ==
-     INF_SESSION_SYNCHRONIZING)
-  {
-    sync = TRUE;
-  }
-  else
-  {
-    sync = FALSE;
-  }
 
   if(!inf_chat_session_message_from_xml(session, &message, xml, sync, error))
     return FALSE;
@@ -483,6 +571,193 @@ inf_chat_session_receive_message(InfChatSession* session,
   return TRUE;
 }
 
+static gboolean
+inf_chat_session_receive_history(InfChatSession* session,
+                                 InfXmlConnection* connection,
+                                 xmlNodePtr xml,
+                                 GError** error)
+{
+  InfChatSessionPrivate* priv;
+  InfChatBuffer* buffer;
+  xmlNodePtr child;
+  guint n_free;
+  guint n_history;
+  guint skip;
+  guint complete;
+  GError* local_error;
+
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  /* Only accept history that we have asked for, so that a remote site
+   * cannot inject backlog messages by itself. */
+  if(priv->history_requests == 0)
+  {
+    g_set_error_literal(
+      error,
+      inf_chat_session_error_quark,
+      INF_CHAT_SESSION_ERROR_FAILED,
+      _("Received chat history that was not requested")
+    );
+
+    return FALSE;
+  }
+
+  --priv->history_requests;
+
+  /* All messages in the history are older than the ones in the buffer, so
+   * only as many of the most recent ones as there is space left are added.
+   * More would make the buffer drop newer messages again, and once it is
+   * full, it might have dropped only some of its oldest messages with the
+   * same time already, so that the history would not fit in anymore. */
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  n_free = inf_chat_buffer_get_size(buffer) -
+    inf_chat_buffer_get_n_messages(buffer);
+
+  n_history = 0;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "message") != 0) continue;
+    ++n_history;
+  }
+
+  skip = n_history > n_free ? n_history - n_free : 0;
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "message") != 0) continue;
+
+    if(skip > 0)
+    {
+      --skip;
+      continue;
+    }
+
+    if(!inf_chat_session_receive_message(session, connection, child, TRUE,
+                                         error))
+    {
+      return FALSE;
+    }
+  }
+
+  local_error = NULL;
+  if(!inf_xml_util_get_attribute_uint(xml, "complete", &complete,
+                                      &local_error))
+  {
+    if(local_error != NULL)
+    {
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    complete = 0;
+  }
+
+  if(complete != 0 && !priv->history_complete)
+  {
+    priv->history_complete = TRUE;
+    g_object_notify(G_OBJECT(session), "history-complete");
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_chat_session_send_history(InfChatSession* session,
+                              InfXmlConnection* connection,
+                              xmlNodePtr xml,
+                              GError** error)
+{
+  InfChatBuffer* buffer;
+  InfCommunicationGroup* group;
+  const InfChatBufferMessage* message;
+  glong before;
+  guint skip;
+  guint count;
+  guint begin;
+  guint end;
+  gboolean has_before;
+  GError* local_error;
+  xmlNodePtr reply;
+  xmlNodePtr child;
+
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  g_assert(group != NULL);
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "count", &count, error))
+    return FALSE;
+
+  local_error = NULL;
+  has_before = inf_xml_util_get_attribute_long(
+    xml,
+    "before",
+    &before,
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if(!inf_xml_util_get_attribute_uint(xml, "skip", &skip, &local_error))
+  {
+    if(local_error != NULL)
+    {
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    skip = 0;
+  }
+
+  /* Find the newest message that the requestor does not have yet: Skip all
+   * messages newer than the requestor's oldest one, and then the ones which
+   * have the same time as that and which it already has. */
+  end = inf_chat_buffer_get_n_messages(buffer);
+  if(has_before)
+  {
+    while(end > 0)
+    {
+      message = inf_chat_buffer_get_message(buffer, end - 1);
+      if(message->time < before) break;
+      if(message->time == before && skip == 0) break;
+
+      if(message->time == before) --skip;
+      --end;
+    }
+  }
+
+  begin = end > count ? end - count : 0;
+
+  /* The requestor's buffer inserts a message after all messages with the
+   * same time, so a page must not end in the middle of messages with the
+   * same time, or the next page would get them out of order. */
+  while(begin > 0 &&
+        inf_chat_buffer_get_message(buffer, begin - 1)->time ==
+        inf_chat_buffer_get_message(buffer, begin)->time)
+  {
+    --begin;
+  }
+
+  reply = xmlNewNode(NULL, (const xmlChar*)"history");
+  if(begin == 0)
+    inf_xml_util_set_attribute_uint(reply, "complete", 1);
+
+  for(; begin < end; ++begin)
+  {
+    message = inf_chat_buffer_get_message(buffer, begin);
+    child = inf_chat_session_message_to_xml(session, message, TRUE);
+    xmlAddChild(reply, child);
+  }
+
+  inf_communication_group_send_message(group, connection, reply);
+  return TRUE;
+}
+
 static void
 inf_chat_session_user_join(InfChatSession* session,
                            InfUser* user)
@@ -606,6 +881,15 @@ inf_chat_session_init(InfChatSession* session)
 
   priv->log_filename = NULL;
   priv->log_file = NULL;
+
+  priv->io = NULL;
+  priv->flush_dispatch = NULL;
+  priv->log_dirty = FALSE;
+
+  priv->sync_history = 0;
+
+  priv->history_requests = 0;
+  priv->history_complete = FALSE;
 }
 
 static void
@@ -675,10 +959,12 @@ static void
 inf_chat_session_dispose(GObject* object)
 {
   InfChatSession* session;
+  InfChatSessionPrivate* priv;
   InfChatBuffer* buffer;
   InfUserTable* user_table;
 
   session = INF_CHAT_SESSION(object);
+  priv = INF_CHAT_SESSION_PRIVATE(session);
   user_table = inf_session_get_user_table(INF_SESSION(session));
   buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
 
@@ -706,6 +992,16 @@ inf_chat_session_dispose(GObject* object)
     session
   );
 
+  /* Deferred messages are sent when the session is closed by the parent
+   * class, and the log file is flushed when it is closed on finalization. */
+  inf_chat_session_cancel_flush(session);
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
   G_OBJECT_CLASS(inf_chat_session_parent_class)->dispose(object);
 }
 
@@ -750,6 +1046,21 @@ inf_chat_session_set_property(GObject* object,
     }
 
     break;
+  case PROP_IO:
+    if(priv->flush_dispatch != NULL)
+    {
+      inf_chat_session_cancel_flush(session);
+      inf_chat_session_flush(session);
+    }
+
+    if(priv->io != NULL) g_object_unref(priv->io);
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_SYNC_HISTORY:
+    priv->sync_history = g_value_get_uint(value);
+    break;
+  case PROP_HISTORY_COMPLETE:
+    /* read only */
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -773,6 +1084,15 @@ inf_chat_session_get_property(GObject* object,
   case PROP_LOG_FILE:
     g_value_set_string(value, priv->log_filename);
     break;
+  case PROP_IO:
+    g_value_set_object(value, priv->io);
+    break;
+  case PROP_SYNC_HISTORY:
+    g_value_set_uint(value, priv->sync_history);
+    break;
+  case PROP_HISTORY_COMPLETE:
+    g_value_set_boolean(value, priv->history_complete);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -787,19 +1107,39 @@ static void
 inf_chat_session_to_xml_sync(InfSession* session,
                              xmlNodePtr parent)
 {
+  InfChatSessionPrivate* priv;
   InfChatBuffer* buffer;
   InfSessionClass* parent_class;
   const InfChatBufferMessage* message;
   xmlNodePtr child;
+  guint n_messages;
   guint i;
 
+  priv = INF_CHAT_SESSION_PRIVATE(session);
   buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
   parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
 
   g_assert(parent_class->to_xml_sync != NULL);
   parent_class->to_xml_sync(session, parent);
 
-  for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
+  /* Only synchronize the most recent messages if a window is set. Older
+   * ones can be requested later with inf_chat_session_request_history(). */
+  n_messages = inf_chat_buffer_get_n_messages(buffer);
+  if(priv->sync_history > 0 && n_messages > priv->sync_history)
+    i = n_messages - priv->sync_history;
+  else
+    i = 0;
+
+  /* Do not split messages with the same time, see
+   * inf_chat_session_send_history(). */
+  while(i > 0 &&
+        inf_chat_buffer_get_message(buffer, i - 1)->time ==
+        inf_chat_buffer_get_message(buffer, i)->time)
+  {
+    --i;
+  }
+
+  for(; i < n_messages; ++i)
   {
     message = inf_chat_buffer_get_message(buffer, i);
 
@@ -827,6 +1167,7 @@ inf_chat_session_process_xml_sync(InfSession* session,
       INF_CHAT_SESSION(session),
       connection,
       xml,
+      TRUE,
       error
     );
   }
@@ -853,6 +1194,7 @@ inf_chat_session_process_xml_run(InfSession* session,
       INF_CHAT_SESSION(session),
       connection,
       xml,
+      FALSE,
       error
     );
 
@@ -861,6 +1203,30 @@ inf_chat_session_process_xml_run(InfSession* session,
     else
       return INF_COMMUNICATION_SCOPE_GROUP;
   }
+  else if(strcmp((const char*)xml->name, "request-history") == 0)
+  {
+    /* The reply goes to the requestor only, and the request itself is not
+     * forwarded to the rest of the group either. */
+    inf_chat_session_send_history(
+      INF_CHAT_SESSION(session),
+      connection,
+      xml,
+      error
+    );
+
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+  else if(strcmp((const char*)xml->name, "history") == 0)
+  {
+    inf_chat_session_receive_history(
+      INF_CHAT_SESSION(session),
+      connection,
+      xml,
+      error
+    );
+
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
   else
   {
     parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
@@ -991,22 +1357,39 @@ inf_chat_session_receive_message_handler(InfChatSession* session,
     session
   );
 
-  /* Backlog messages (received during synchronization) are not yet logged.
-   * We will need to parse the last messages in the log first and check
-   * whether they have already been logged. */
-  if(inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING)
+  /* Backlog messages (received during synchronization or requested with
+   * inf_chat_session_request_history()) are not yet logged. We will need to
+   * parse the last messages in the log first and check whether they have
+   * already been logged. */
+  if(inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING &&
+     (message->flags & INF_CHAT_BUFFER_MESSAGE_BACKLOG) == 0)
+  {
     inf_chat_session_log_message(session, message);
+  }
 }
 
 static void
 inf_chat_session_send_message_handler(InfChatSession* session,
                                       const InfChatBufferMessage* message)
 {
+  InfChatSessionPrivate* priv;
   xmlNodePtr xml;
 
-  /* Actually send the message over the network */
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+
+  /* Actually send the message over the network. If we have an InfIo, then
+   * messages sent within the same main loop iteration are handed to the
+   * group together. */
   xml = inf_chat_session_message_to_xml(session, message, FALSE);
-  inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  if(priv->io != NULL)
+  {
+    inf_session_defer_to_subscriptions(INF_SESSION(session), xml);
+    inf_chat_session_schedule_flush(session);
+  }
+  else
+  {
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  }
 
   inf_chat_session_log_message(session, message);
 }
@@ -1060,14 +1443,56 @@ inf_chat_session_class_init(InfChatSessionClass* chat_session_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The InfIo object used to coalesce messages sent and logged within "
+      "one main loop iteration, or NULL to send and log them immediately",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SYNC_HISTORY,
+    g_param_spec_uint(
+      "sync-history",
+      "Synchronized history",
+      "The number of most recent messages to synchronize to "
+      "joining sites, or 0 to synchronize all of them",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_HISTORY_COMPLETE,
+    g_param_spec_boolean(
+      "history-complete",
+      "History complete",
+      "Whether all older messages have been retrieved with "
+      "inf_chat_session_request_history()",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfChatSession::receive-message:
    * @session: The #InfChatSession that is receiving a message.
    * @message: The #InfChatBufferMessage that was received.
    *
    * This signal is emitted whenever a message has been received. If the
-   * session is in %INF_SESSION_SYNCHRONIZING state the received message was
-   * a backlog message.
+   * session is in %INF_SESSION_SYNCHRONIZING state, or if the message has
+   * the %INF_CHAT_BUFFER_MESSAGE_BACKLOG flag set, then the received message
+   * was a backlog message.
    */
   chat_session_signals[RECEIVE_MESSAGE] = g_signal_new(
     "receive-message",
@@ -1273,4 +1698,72 @@ inf_chat_session_set_log_file(InfChatSession* session,
   return TRUE;
 }
 
+/**
+ * inf_chat_session_request_history:
+ * @session: A #InfChatSession in status %INF_SESSION_RUNNING.
+ * @count: The number of messages to request.
+ *
+ * Requests @count messages that are older than the oldest message in the
+ * session's buffer from the publisher of the session. This is useful if the
+ * publisher only synchronizes the most recent messages to joining sites,
+ * see #InfChatSession:sync-history. Fewer messages are sent if the
+ * publisher does not have as many, and more if the oldest one of them has
+ * the same time as even older ones, since messages with the same time are
+ * always sent together.
+ *
+ * The messages are added to the buffer as backlog messages when they
+ * arrive, as far as there is space left in the buffer, so that no newer
+ * messages are dropped for them. Once the publisher has no more older
+ * messages, #InfChatSession:history-complete is set to %TRUE. The session
+ * must have a subscription group.
+ */
+void
+inf_chat_session_request_history(InfChatSession* session,
+                                 guint count)
+{
+  InfChatSessionPrivate* priv;
+  InfChatBuffer* buffer;
+  const InfChatBufferMessage* message;
+  time_t before;
+  guint skip;
+  guint n_messages;
+  xmlNodePtr xml;
+
+  g_return_if_fail(INF_IS_CHAT_SESSION(session));
+  g_return_if_fail(count > 0);
+
+  g_return_if_fail(
+    inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING
+  );
+
+  g_return_if_fail(
+    inf_session_get_subscription_group(INF_SESSION(session)) != NULL
+  );
+
+  priv = INF_CHAT_SESSION_PRIVATE(session);
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  n_messages = inf_chat_buffer_get_n_messages(buffer);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request-history");
+  inf_xml_util_set_attribute_uint(xml, "count", count);
+
+  if(n_messages > 0)
+  {
+    /* Messages only have a resolution of one second, so also tell how many
+     * messages we already have with the same time as the oldest one. */
+    before = inf_chat_buffer_get_message(buffer, 0)->time;
+    for(skip = 0; skip < n_messages; ++skip)
+    {
+      message = inf_chat_buffer_get_message(buffer, skip);
+      if(message->time != before) break;
+    }
+
+    inf_xml_util_set_attribute_long(xml, "before", (long)before);
+    inf_xml_util_set_attribute_uint(xml, "skip", skip);
+  }
+
+  ++priv->history_requests;
+  inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -101,6 +101,10 @@ inf_chat_session_set_log_file(InfChatSession* session,
                               const gchar* log_file,
                               GError** error);
 
+void
+inf_chat_session_request_history(InfChatSession* session,
+                                 guint count);
+
 G_END_DECLS
 
 #endif /* __INF_CHAT_SESSION_H__ */
@@ -0,0 +1,63 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_COMPRESSION_PRIVATE_H__
+#define __INF_COMPRESSION_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Compression state of a stream in both directions, as used by XEP-0138
+ * stream compression in InfXmppConnection. */
+typedef struct _InfCompression InfCompression;
+
+const gchar* const*
+_inf_compression_get_methods(void);
+
+InfCompression*
+_inf_compression_new(const gchar* method,
+                     guint level);
+
+void
+_inf_compression_free(InfCompression* compression);
+
+const gchar*
+_inf_compression_get_method(InfCompression* compression);
+
+gboolean
+_inf_compression_compress(InfCompression* compression,
+                          gconstpointer data,
+                          gsize len,
+                          GByteArray* out);
+
+void
+_inf_compression_decompress_begin(InfCompression* compression,
+                                  gconstpointer data,
+                                  gsize len);
+
+gssize
+_inf_compression_decompress_next(InfCompression* compression,
+                                 gconstpointer* out);
+
+G_END_DECLS
+
+#endif /* __INF_COMPRESSION_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,433 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinfinity/common/inf-compression-private.h>
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include <string.h>
+
+/* The amount of data that is produced at once by compression or
+ * decompression. Decompressed data is handed out in chunks of at most this
+ * size, so that a small amount of input cannot expand to an arbitrary
+ * amount of memory. */
+static const gsize INF_COMPRESSION_CHUNK_SIZE = 16384;
+
+typedef struct _InfCompressionMethod InfCompressionMethod;
+struct _InfCompressionMethod {
+  const gchar* name;
+
+  gboolean(*init)(InfCompression* compression,
+                  guint level);
+  void(*finalize)(InfCompression* compression);
+
+  gboolean(*compress)(InfCompression* compression,
+                      gconstpointer data,
+                      gsize len,
+                      GByteArray* out);
+  gssize(*decompress_next)(InfCompression* compression);
+};
+
+struct _InfCompression {
+  const InfCompressionMethod* method;
+
+  gpointer compress_state;
+  gpointer decompress_state;
+
+  gconstpointer in_data;
+  gsize in_len;
+  gsize in_pos;
+
+  guint8* out_buf;
+  /* Whether the last call to decompress_next() filled the whole output
+   * buffer, so that there might be more output without further input. */
+  gboolean out_full;
+};
+
+#ifdef HAVE_ZSTD
+static gboolean
+inf_compression_zstd_init(InfCompression* compression,
+                          guint level)
+{
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+
+  cctx = ZSTD_createCCtx();
+  dctx = ZSTD_createDCtx();
+
+  if(cctx == NULL || dctx == NULL ||
+     ZSTD_isError(ZSTD_CCtx_setParameter(cctx,
+                                         ZSTD_c_compressionLevel,
+                                         level)))
+  {
+    if(cctx != NULL) ZSTD_freeCCtx(cctx);
+    if(dctx != NULL) ZSTD_freeDCtx(dctx);
+    return FALSE;
+  }
+
+  compression->compress_state = cctx;
+  compression->decompress_state = dctx;
+  return TRUE;
+}
+
+static void
+inf_compression_zstd_finalize(InfCompression* compression)
+{
+  ZSTD_freeCCtx(compression->compress_state);
+  ZSTD_freeDCtx(compression->decompress_state);
+}
+
+static gboolean
+inf_compression_zstd_compress(InfCompression* compression,
+                              gconstpointer data,
+                              gsize len,
+                              GByteArray* out)
+{
+  ZSTD_inBuffer in_buffer;
+  ZSTD_outBuffer out_buffer;
+  guint out_len;
+  size_t remaining;
+
+  in_buffer.src = data;
+  in_buffer.size = len;
+  in_buffer.pos = 0;
+
+  /* Flush at the end of each call, so that the remote site can parse
+   * everything that was sent so far. */
+  do
+  {
+    out_len = out->len;
+    g_byte_array_set_size(out, out_len + INF_COMPRESSION_CHUNK_SIZE);
+
+    out_buffer.dst = out->data + out_len;
+    out_buffer.size = INF_COMPRESSION_CHUNK_SIZE;
+    out_buffer.pos = 0;
+
+    remaining = ZSTD_compressStream2(
+      compression->compress_state,
+      &out_buffer,
+      &in_buffer,
+      ZSTD_e_flush
+    );
+
+    g_byte_array_set_size(out, out_len + out_buffer.pos);
+    if(ZSTD_isError(remaining))
+      return FALSE;
+  } while(remaining > 0);
+
+  return TRUE;
+}
+
+static gssize
+inf_compression_zstd_decompress_next(InfCompression* compression)
+{
+  ZSTD_inBuffer in_buffer;
+  ZSTD_outBuffer out_buffer;
+  size_t ret;
+
+  in_buffer.src = compression->in_data;
+  in_buffer.size = compression->in_len;
+  in_buffer.pos = compression->in_pos;
+
+  out_buffer.dst = compression->out_buf;
+  out_buffer.size = INF_COMPRESSION_CHUNK_SIZE;
+  out_buffer.pos = 0;
+
+  ret = ZSTD_decompressStream(
+    compression->decompress_state,
+    &out_buffer,
+    &in_buffer
+  );
+
+  compression->in_pos = in_buffer.pos;
+  if(ZSTD_isError(ret))
+    return -1;
+
+  compression->out_full = (out_buffer.pos == out_buffer.size);
+  return out_buffer.pos;
+}
+
+static const InfCompressionMethod inf_compression_zstd = {
+  "zstd",
+  inf_compression_zstd_init,
+  inf_compression_zstd_finalize,
+  inf_compression_zstd_compress,
+  inf_compression_zstd_decompress_next
+};
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_ZLIB
+static gboolean
+inf_compression_zlib_init(InfCompression* compression,
+                          guint level)
+{
+  z_stream* deflate_stream;
+  z_stream* inflate_stream;
+
+  deflate_stream = g_slice_new0(z_stream);
+  if(deflateInit(deflate_stream, level) != Z_OK)
+  {
+    g_slice_free(z_stream, deflate_stream);
+    return FALSE;
+  }
+
+  inflate_stream = g_slice_new0(z_stream);
+  if(inflateInit(inflate_stream) != Z_OK)
+  {
+    deflateEnd(deflate_stream);
+    g_slice_free(z_stream, deflate_stream);
+    g_slice_free(z_stream, inflate_stream);
+    return FALSE;
+  }
+
+  compression->compress_state = deflate_stream;
+  compression->decompress_state = inflate_stream;
+  return TRUE;
+}
+
+static void
+inf_compression_zlib_finalize(InfCompression* compression)
+{
+  deflateEnd(compression->compress_state);
+  inflateEnd(compression->decompress_state);
+
+  g_slice_free(z_stream, compression->compress_state);
+  g_slice_free(z_stream, compression->decompress_state);
+}
+
+static gboolean
+inf_compression_zlib_compress(InfCompression* compression,
+                              gconstpointer data,
+                              gsize len,
+                              GByteArray* out)
+{
+  z_stream* stream;
+  guint out_len;
+  int ret;
+
+  stream = compression->compress_state;
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+
+  /* XEP-0138 requires a Z_SYNC_FLUSH after each stanza. We do it for
+   * everything that is sent in one go, which is the same or less often. */
+  do
+  {
+    out_len = out->len;
+    g_byte_array_set_size(out, out_len + INF_COMPRESSION_CHUNK_SIZE);
+
+    stream->next_out = out->data + out_len;
+    stream->avail_out = INF_COMPRESSION_CHUNK_SIZE;
+
+    ret = deflate(stream, Z_SYNC_FLUSH);
+    g_byte_array_set_size(
+      out,
+      out_len + INF_COMPRESSION_CHUNK_SIZE - stream->avail_out
+    );
+
+    if(ret != Z_OK && ret != Z_BUF_ERROR)
+      return FALSE;
+  } while(stream->avail_out == 0);
+
+  return TRUE;
+}
+
+static gssize
+inf_compression_zlib_decompress_next(InfCompression* compression)
+{
+  z_stream* stream;
+  int ret;
+
+  stream = compression->decompress_state;
+  stream->next_in = (Bytef*)compression->in_data + compression->in_pos;
+  stream->avail_in = compression->in_len - compression->in_pos;
+  stream->next_out = compression->out_buf;
+  stream->avail_out = INF_COMPRESSION_CHUNK_SIZE;
+
+  ret = inflate(stream, Z_SYNC_FLUSH);
+  compression->in_pos = compression->in_len - stream->avail_in;
+
+  /* Z_BUF_ERROR only means that no progress could be made */
+  if(ret != Z_OK && ret != Z_BUF_ERROR)
+    return -1;
+
+  compression->out_full = (stream->avail_out == 0);
+  return INF_COMPRESSION_CHUNK_SIZE - stream->avail_out;
+}
+
+static const InfCompressionMethod inf_compression_zlib = {
+  "zlib",
+  inf_compression_zlib_init,
+  inf_compression_zlib_finalize,
+  inf_compression_zlib_compress,
+  inf_compression_zlib_decompress_next
+};
+#endif /* HAVE_ZLIB */
+
+/* In order of preference */
+static const InfCompressionMethod* const inf_compression_methods[] = {
+#ifdef HAVE_ZSTD
+  &inf_compression_zstd,
+#endif
+#ifdef HAVE_ZLIB
+  &inf_compression_zlib,
+#endif
+  NULL
+};
+
+static const gchar* const inf_compression_method_names[] = {
+#ifdef HAVE_ZSTD
+  "zstd",
+#endif
+#ifdef HAVE_ZLIB
+  "zlib",
+#endif
+  NULL
+};
+
+/* Returns the names of the supported compression methods, in order of
+ * preference. The list is empty if libinfinity was built without any. */
+const gchar* const*
+_inf_compression_get_methods(void)
+{
+  return inf_compression_method_names;
+}
+
+/* Returns NULL if method is not supported. level ranges from 1 (fastest) to
+ * 9 (best compression). */
+InfCompression*
+_inf_compression_new(const gchar* method,
+                     guint level)
+{
+  const InfCompressionMethod* const* iter;
+  InfCompression* compression;
+
+  g_return_val_if_fail(method != NULL, NULL);
+  g_return_val_if_fail(level >= 1 && level <= 9, NULL);
+
+  for(iter = inf_compression_methods; *iter != NULL; ++iter)
+    if(strcmp((*iter)->name, method) == 0)
+      break;
+
+  if(*iter == NULL)
+    return NULL;
+
+  compression = g_slice_new(InfCompression);
+  compression->method = *iter;
+  compression->compress_state = NULL;
+  compression->decompress_state = NULL;
+  compression->in_data = NULL;
+  compression->in_len = 0;
+  compression->in_pos = 0;
+  compression->out_buf = NULL;
+  compression->out_full = FALSE;
+
+  if(!compression->method->init(compression, level))
+  {
+    g_slice_free(InfCompression, compression);
+    return NULL;
+  }
+
+  compression->out_buf = g_malloc(INF_COMPRESSION_CHUNK_SIZE);
+  return compression;
+}
+
+void
+_inf_compression_free(InfCompression* compression)
+{
+  compression->method->finalize(compression);
+  g_free(compression->out_buf);
+  g_slice_free(InfCompression, compression);
+}
+
+const gchar*
+_inf_compression_get_method(InfCompression* compression)
+{
+  return compression->method->name;
+}
+
+/* Appends the compressed data to out, including everything that is
+ * necessary for the remote site to decompress all of it. */
+gboolean
+_inf_compression_compress(InfCompression* compression,
+                          gconstpointer data,
+                          gsize len,
+                          GByteArray* out)
+{
+  return compression->method->compress(compression, data, len, out);
+}
+
+/* Sets the input for subsequent calls to
+ * _inf_compression_decompress_next(). data needs to stay alive until that
+ * has returned 0. */
+void
+_inf_compression_decompress_begin(InfCompression* compression,
+                                  gconstpointer data,
+                                  gsize len)
+{
+  compression->in_data = data;
+  compression->in_len = len;
+  compression->in_pos = 0;
+}
+
+/* Returns the size of the next chunk of decompressed data, which is stored
+ * in out until the next call. Returns 0 once everything has been
+ * decompressed, and -1 if the input is corrupt. */
+gssize
+_inf_compression_decompress_next(InfCompression* compression,
+                                 gconstpointer* out)
+{
+  gsize in_pos;
+  gssize len;
+
+  do
+  {
+    if(compression->in_pos == compression->in_len &&
+       !compression->out_full)
+    {
+      compression->in_data = NULL;
+      compression->in_len = 0;
+      compression->in_pos = 0;
+      return 0;
+    }
+
+    in_pos = compression->in_pos;
+    len = compression->method->decompress_next(compression);
+    if(len < 0) return -1;
+
+    /* Input that is neither consumed nor produces output, for example
+     * garbage after the end of a zlib stream, cannot be processed at all.
+     * Input can also be consumed without producing any output though, if
+     * it only contains part of a block. */
+    if(len == 0 && compression->in_pos == in_pos) return -1;
+  } while(len == 0);
+
+  *out = compression->out_buf;
+  return len;
+}
+
+/* vim:set et sw=2 ts=2: */
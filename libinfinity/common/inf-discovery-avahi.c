@@ -52,6 +52,19 @@
 #include <net/if.h> /* For if_indextoname */
 #include <string.h>
 
+/* How long the address of a resolved service is used for new connections
+ * before the service is resolved again. This is the TTL avahi uses for
+ * address records. */
+#define INF_DISCOVERY_AVAHI_RESOLVE_TTL 120
+
+/* Newly discovered services are announced in batches after this many
+ * milliseconds, and services which disappear are only reported as
+ * undiscovered if they do not come back within
+ * INF_DISCOVERY_AVAHI_REMOVE_DELAY milliseconds. This avoids signal
+ * emissions for services that briefly flap. */
+#define INF_DISCOVERY_AVAHI_ANNOUNCE_DELAY 250
+#define INF_DISCOVERY_AVAHI_REMOVE_DELAY 2000
+
 struct AvahiWatch {
   InfDiscoveryAvahi* avahi;
   InfIoWatch* watch;
@@ -77,6 +90,7 @@ struct _InfDiscoveryAvahiInfoResolv {
 };
 
 struct _InfDiscoveryInfo {
+  InfDiscoveryAvahi* avahi;
   gchar* service_name;
   /* pointing to InfDiscoveryAvahiDiscoverInfo.type: */
   const gchar* service_type;
@@ -88,6 +102,17 @@ struct _InfDiscoveryInfo {
   AvahiServiceResolver* service_resolver;
   InfXmppConnection* resolved;
 
+  /* Result of the last resolution, valid until cached_until */
+  InfIpAddress* cached_address;
+  guint cached_port;
+  gchar* cached_host_name;
+  gint64 cached_until;
+
+  /* Whether the discovered signal has been emitted for this info, and the
+   * timeout for removing it if it has disappeared. */
+  gboolean announced;
+  InfIoTimeout* remove_timeout;
+
   GSList* resolv;
 };
 
@@ -123,6 +148,7 @@ struct _InfDiscoveryAvahiPrivate {
 
   GSList* published;
   GHashTable* discovered; /* type -> InfDiscoveryAvahiDiscoverInfo */
+  InfIoTimeout* announce_timeout;
 };
 
 enum {
@@ -215,9 +241,19 @@ inf_discovery_avahi_info_resolv_error(InfDiscoveryInfo* info,
 static void
 inf_discovery_avahi_discovery_info_free(InfDiscoveryInfo* info)
 {
+  InfDiscoveryAvahiPrivate* priv;
+  priv = INF_DISCOVERY_AVAHI_PRIVATE(info->avahi);
+
   g_free(info->service_name);
   g_free(info->domain);
-  
+
+  if(info->cached_address != NULL)
+    inf_ip_address_free(info->cached_address);
+  g_free(info->cached_host_name);
+
+  if(info->remove_timeout != NULL)
+    inf_io_remove_timeout(priv->io, info->remove_timeout);
+
   if(info->service_resolver != NULL)
     avahi_service_resolver_free(info->service_resolver);
 
@@ -275,6 +311,124 @@ inf_discovery_avahi_discover_info_free(gpointer data)
  * Avahi callbacks and utilities
  */
 
+/* Connects to the cached address of info, or reuses an existing connection
+ * to it, and reports the result to the pending resolvs. */
+static void
+inf_discovery_avahi_info_connect(InfDiscoveryAvahi* avahi,
+                                 InfDiscoveryInfo* info)
+{
+  InfDiscoveryAvahiPrivate* priv;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  InfXmlConnectionStatus status;
+  GError* error;
+
+  priv = INF_DISCOVERY_AVAHI_PRIVATE(avahi);
+  g_assert(info->resolved == NULL);
+  g_assert(info->cached_address != NULL);
+
+  xmpp = inf_xmpp_manager_lookup_connection_by_address(
+    priv->xmpp_manager,
+    info->cached_address,
+    info->cached_port
+  );
+
+  if(xmpp == NULL)
+  {
+    tcp = inf_tcp_connection_new(
+      priv->io,
+      info->cached_address,
+      info->cached_port
+    );
+
+    g_object_set(
+      G_OBJECT(tcp),
+      "device-index", info->interface,
+      NULL
+    );
+
+    error = NULL;
+    if(!inf_tcp_connection_set_keepalive(tcp, &priv->keepalive, &error) ||
+       !inf_tcp_connection_open(tcp, &error))
+    {
+      /* The address might be outdated, so resolve again next time */
+      info->cached_until = 0;
+
+      inf_discovery_avahi_info_resolv_error(info, error);
+      g_error_free(error);
+
+      g_object_unref(tcp);
+    }
+    else
+    {
+      xmpp = inf_xmpp_connection_new(
+        tcp,
+        INF_XMPP_CONNECTION_CLIENT,
+        NULL,
+        info->cached_host_name,
+        priv->security_policy,
+        priv->creds,
+        priv->sasl_context,
+        priv->sasl_context == NULL ? NULL : priv->sasl_mechanisms
+      );
+
+      g_object_unref(tcp);
+
+      inf_xmpp_manager_add_connection(priv->xmpp_manager, xmpp);
+
+      info->resolved = xmpp;
+
+      g_object_weak_ref(
+        G_OBJECT(xmpp),
+        inf_discovery_avahi_discovery_info_resolved_destroy_cb,
+        info
+      );
+
+      inf_discovery_avahi_info_resolv_complete(info);
+
+      g_object_unref(xmpp);
+    }
+  }
+  else
+  {
+    info->resolved = xmpp;
+
+    g_object_weak_ref(
+      G_OBJECT(xmpp),
+      inf_discovery_avahi_discovery_info_resolved_destroy_cb,
+      info
+    );
+
+    g_object_get(G_OBJECT(xmpp), "status", &status, NULL);
+
+    /* TODO: There is similar code in inf_discovery_avahi_resolve; should
+     * probably go into an extra function. */
+    if(status == INF_XML_CONNECTION_CLOSING)
+    {
+      /* TODO: That's a bit a sad case here. We should wait for the
+       * connection being closed, and then reopen it: */
+      inf_discovery_avahi_info_resolv_error(info, NULL);
+    }
+    else if(status == INF_XML_CONNECTION_CLOSED)
+    {
+      error = NULL;
+      if(!inf_xml_connection_open(INF_XML_CONNECTION(xmpp), &error))
+      {
+        inf_discovery_avahi_info_resolv_error(info, error);
+        g_error_free(error);
+      }
+      else
+      {
+        inf_discovery_avahi_info_resolv_complete(info);
+      }
+    }
+    else
+    {
+      inf_discovery_avahi_info_resolv_complete(info);
+    }
+  }
+}
+
 static void
 inf_discovery_avahi_service_resolver_callback(AvahiServiceResolver* resolver,
                                               AvahiIfIndex interface,
@@ -297,9 +451,6 @@ inf_discovery_avahi_service_resolver_callback(AvahiServiceResolver* resolver,
   GSList* item;
 
   InfIpAddress* inf_addr;
-  InfTcpConnection* tcp;
-  InfXmppConnection* xmpp;
-  InfXmlConnectionStatus status;
   GError* error;
   
   avahi = INF_DISCOVERY_AVAHI(userdata);
@@ -344,101 +495,19 @@ inf_discovery_avahi_service_resolver_callback(AvahiServiceResolver* resolver,
       break;
     }
 
-    xmpp = inf_xmpp_manager_lookup_connection_by_address(
-      priv->xmpp_manager,
-      inf_addr,
-      port
-    );
+    /* Remember the result, so that reconnecting to this service soon does
+     * not cause another round of mDNS queries. */
+    if(discovery_info->cached_address != NULL)
+      inf_ip_address_free(discovery_info->cached_address);
+    g_free(discovery_info->cached_host_name);
 
-    if(xmpp == NULL)
-    {
-      tcp = inf_tcp_connection_new(priv->io, inf_addr, port);
+    discovery_info->cached_address = inf_addr;
+    discovery_info->cached_port = port;
+    discovery_info->cached_host_name = g_strdup(host_name);
+    discovery_info->cached_until = g_get_monotonic_time() +
+      (gint64)INF_DISCOVERY_AVAHI_RESOLVE_TTL * G_USEC_PER_SEC;
 
-      g_object_set(
-        G_OBJECT(tcp),
-        "device-index", discovery_info->interface,
-        NULL
-      );
-
-      error = NULL;
-      if(!inf_tcp_connection_set_keepalive(tcp, &priv->keepalive, &error) ||
-         !inf_tcp_connection_open(tcp, &error))
-      {
-        inf_discovery_avahi_info_resolv_error(discovery_info, error);
-        g_error_free(error);
-
-        g_object_unref(tcp);
-      }
-      else
-      {
-        xmpp = inf_xmpp_connection_new(
-          tcp,
-          INF_XMPP_CONNECTION_CLIENT,
-          NULL,
-          host_name,
-          priv->security_policy,
-          priv->creds,
-          priv->sasl_context,
-          priv->sasl_context == NULL ? NULL : priv->sasl_mechanisms
-        );
-
-        g_object_unref(tcp);
-
-        inf_xmpp_manager_add_connection(priv->xmpp_manager, xmpp);
-
-        discovery_info->resolved = xmpp;
-
-        g_object_weak_ref(
-          G_OBJECT(xmpp),
-          inf_discovery_avahi_discovery_info_resolved_destroy_cb,
-          discovery_info
-        );
-
-        inf_discovery_avahi_info_resolv_complete(discovery_info);
-
-        g_object_unref(xmpp);
-      }
-    }
-    else
-    {
-      discovery_info->resolved = xmpp;
-
-      g_object_weak_ref(
-        G_OBJECT(xmpp),
-        inf_discovery_avahi_discovery_info_resolved_destroy_cb,
-        discovery_info
-      );
-
-      g_object_get(G_OBJECT(xmpp), "status", &status, NULL);
-
-      /* TODO: There is similar code in inf_discovery_avahi_resolve; should
-       * probably go into an extra function. */
-      if(status == INF_XML_CONNECTION_CLOSING)
-      {
-        /* TODO: That's a bit a sad case here. We should wait for the
-         * connection being closed, and then reopen it: */
-        inf_discovery_avahi_info_resolv_error(discovery_info, NULL);
-      }
-      else if(status == INF_XML_CONNECTION_CLOSED)
-      {
-        error = NULL;
-        if(!inf_xml_connection_open(INF_XML_CONNECTION(xmpp), &error))
-        {
-          inf_discovery_avahi_info_resolv_error(discovery_info, error);
-          g_error_free(error);
-        }
-        else
-        {
-          inf_discovery_avahi_info_resolv_complete(discovery_info);
-        }
-      }
-      else
-      {
-        inf_discovery_avahi_info_resolv_complete(discovery_info);
-      }
-    }
-    
-    inf_ip_address_free(inf_addr);
+    inf_discovery_avahi_info_connect(avahi, discovery_info);
     break;
   case AVAHI_RESOLVER_FAILURE:
     error = NULL;
@@ -468,6 +537,110 @@ inf_discovery_avahi_perform_undiscover(InfDiscoveryAvahi* avahi,
 static void
 inf_discovery_avahi_perform_unpublish_item(InfLocalPublisherItem* item);
 
+static void
+inf_discovery_avahi_announce_timeout_func_foreach_func(gpointer key,
+                                                       gpointer value,
+                                                       gpointer user_data)
+{
+  InfDiscoveryAvahiDiscoverInfo* info;
+  InfDiscoveryInfo* discovery_info;
+  GSList* item;
+
+  info = (InfDiscoveryAvahiDiscoverInfo*)value;
+
+  /* Collect first, since signal handlers might resolve or remove infos */
+  for(item = info->discovered; item != NULL; item = g_slist_next(item))
+  {
+    discovery_info = (InfDiscoveryInfo*)item->data;
+    if(!discovery_info->announced)
+    {
+      discovery_info->announced = TRUE;
+      *(GSList**)user_data = g_slist_prepend(
+        *(GSList**)user_data,
+        discovery_info
+      );
+    }
+  }
+}
+
+static void
+inf_discovery_avahi_announce_timeout_func(gpointer user_data)
+{
+  InfDiscoveryAvahi* avahi;
+  InfDiscoveryAvahiPrivate* priv;
+  GSList* announce;
+  GSList* item;
+
+  avahi = INF_DISCOVERY_AVAHI(user_data);
+  priv = INF_DISCOVERY_AVAHI_PRIVATE(avahi);
+
+  priv->announce_timeout = NULL;
+
+  announce = NULL;
+  g_hash_table_foreach(
+    priv->discovered,
+    inf_discovery_avahi_announce_timeout_func_foreach_func,
+    &announce
+  );
+
+  /* Announce in the order of discovery */
+  announce = g_slist_reverse(announce);
+  for(item = announce; item != NULL; item = g_slist_next(item))
+    inf_discovery_discovered(INF_DISCOVERY(avahi), item->data);
+
+  g_slist_free(announce);
+}
+
+static void
+inf_discovery_avahi_remove_timeout_func(gpointer user_data)
+{
+  InfDiscoveryInfo* discovery_info;
+  InfDiscoveryAvahi* avahi;
+  InfDiscoveryAvahiPrivate* priv;
+  InfDiscoveryAvahiDiscoverInfo* info;
+
+  discovery_info = (InfDiscoveryInfo*)user_data;
+  avahi = discovery_info->avahi;
+  priv = INF_DISCOVERY_AVAHI_PRIVATE(avahi);
+
+  discovery_info->remove_timeout = NULL;
+
+  info = g_hash_table_lookup(priv->discovered, discovery_info->service_type);
+  g_assert(info != NULL);
+
+  if(discovery_info->announced)
+    inf_discovery_undiscovered(INF_DISCOVERY(avahi), discovery_info);
+
+  info->discovered = g_slist_remove(info->discovered, discovery_info);
+  inf_discovery_avahi_discovery_info_free(discovery_info);
+}
+
+static InfDiscoveryInfo*
+inf_discovery_avahi_find_discovery_info(InfDiscoveryAvahiDiscoverInfo* info,
+                                        AvahiIfIndex interface,
+                                        AvahiProtocol protocol,
+                                        const char* name)
+{
+  InfDiscoveryInfo* discovery_info;
+  GSList* item;
+
+  for(item = info->discovered; item != NULL; item = g_slist_next(item))
+  {
+    discovery_info = (InfDiscoveryInfo*)item->data;
+    g_assert(strcmp(discovery_info->service_type, info->type) == 0);
+
+    /* TODO: Do we need to compare domain? */
+    if(strcmp(discovery_info->service_name, name) == 0 &&
+       discovery_info->interface == interface &&
+       discovery_info->protocol == protocol)
+    {
+      return discovery_info;
+    }
+  }
+
+  return NULL;
+}
+
 static void
 inf_discovery_avahi_service_browser_callback(AvahiServiceBrowser* browser,
                                              AvahiIfIndex interface,
@@ -483,7 +656,6 @@ inf_discovery_avahi_service_browser_callback(AvahiServiceBrowser* browser,
   InfDiscoveryAvahiPrivate* priv;
   InfDiscoveryAvahiDiscoverInfo* info;
   InfDiscoveryInfo* discovery_info;
-  GSList* item;
 
   avahi = INF_DISCOVERY_AVAHI(userdata);
   priv = INF_DISCOVERY_AVAHI_PRIVATE(avahi);
@@ -494,9 +666,29 @@ inf_discovery_avahi_service_browser_callback(AvahiServiceBrowser* browser,
   {
   case AVAHI_BROWSER_NEW:
     /* Ignore what we published ourselves */
-    if((flags & AVAHI_LOOKUP_RESULT_OUR_OWN) == 0)
+    if((flags & AVAHI_LOOKUP_RESULT_OUR_OWN) != 0)
+      break;
+
+    /* If the service was removed a moment ago, just keep it */
+    discovery_info = inf_discovery_avahi_find_discovery_info(
+      info,
+      interface,
+      protocol,
+      name
+    );
+
+    if(discovery_info != NULL)
+    {
+      if(discovery_info->remove_timeout != NULL)
+      {
+        inf_io_remove_timeout(priv->io, discovery_info->remove_timeout);
+        discovery_info->remove_timeout = NULL;
+      }
+    }
+    else
     {
       discovery_info = g_slice_new(InfDiscoveryInfo);
+      discovery_info->avahi = avahi;
       discovery_info->service_name = g_strdup(name);
       discovery_info->service_type = info->type;
       discovery_info->domain = g_strdup(domain);
@@ -507,27 +699,48 @@ inf_discovery_avahi_service_browser_callback(AvahiServiceBrowser* browser,
       discovery_info->resolved = NULL;
       discovery_info->resolv = NULL;
 
+      discovery_info->cached_address = NULL;
+      discovery_info->cached_port = 0;
+      discovery_info->cached_host_name = NULL;
+      discovery_info->cached_until = 0;
+
+      discovery_info->announced = FALSE;
+      discovery_info->remove_timeout = NULL;
+
       info->discovered = g_slist_prepend(info->discovered, discovery_info);
-      inf_discovery_discovered(INF_DISCOVERY(avahi), discovery_info);
+
+      /* The service is not resolved here; this only happens when somebody
+       * actually wants to connect to it, in inf_discovery_resolve(). */
+      if(priv->announce_timeout == NULL)
+      {
+        priv->announce_timeout = inf_io_add_timeout(
+          priv->io,
+          INF_DISCOVERY_AVAHI_ANNOUNCE_DELAY,
+          inf_discovery_avahi_announce_timeout_func,
+          avahi,
+          NULL
+        );
+      }
     }
 
     break;
   case AVAHI_BROWSER_REMOVE:
-    for(item = info->discovered; item != NULL; item = g_slist_next(item))
-    {
-      discovery_info = (InfDiscoveryInfo*)item->data;
-      g_assert(strcmp(discovery_info->service_type, type) == 0);
+    discovery_info = inf_discovery_avahi_find_discovery_info(
+      info,
+      interface,
+      protocol,
+      name
+    );
 
-      /* TODO: Do we need to compare domain? */
-      if(strcmp(discovery_info->service_name, name) == 0 &&
-         discovery_info->interface == interface &&
-         discovery_info->protocol == protocol)
-      {
-        inf_discovery_undiscovered(INF_DISCOVERY(avahi), discovery_info);
-        info->discovered = g_slist_remove(info->discovered, discovery_info);
-        inf_discovery_avahi_discovery_info_free(discovery_info);
-        break;
-      }
+    if(discovery_info != NULL && discovery_info->remove_timeout == NULL)
+    {
+      discovery_info->remove_timeout = inf_io_add_timeout(
+        priv->io,
+        INF_DISCOVERY_AVAHI_REMOVE_DELAY,
+        inf_discovery_avahi_remove_timeout_func,
+        discovery_info,
+        NULL
+      );
     }
 
     break;
@@ -745,7 +958,8 @@ inf_discovery_avahi_perform_undiscover(InfDiscoveryAvahi* avahi,
     next = info->discovered->next;
     discovery_info = (InfDiscoveryInfo*)info->discovered->data;
 
-    inf_discovery_undiscovered(INF_DISCOVERY(avahi), discovery_info);
+    if(discovery_info->announced)
+      inf_discovery_undiscovered(INF_DISCOVERY(avahi), discovery_info);
     inf_discovery_avahi_discovery_info_free(discovery_info);
 
     info->discovered = g_slist_delete_link(
@@ -1122,6 +1336,7 @@ inf_discovery_avahi_init(InfDiscoveryAvahi* avahi)
 
   priv->client = NULL;
   priv->published = NULL;
+  priv->announce_timeout = NULL;
 
   priv->discovered = g_hash_table_new_full(
     g_str_hash,
@@ -1156,6 +1371,12 @@ inf_discovery_avahi_dispose(GObject* object)
   avahi = INF_DISCOVERY_AVAHI(object);
   priv = INF_DISCOVERY_AVAHI_PRIVATE(avahi);
 
+  if(priv->announce_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->announce_timeout);
+    priv->announce_timeout = NULL;
+  }
+
   g_hash_table_destroy(priv->discovered);
   priv->discovered = NULL;
 
@@ -1338,12 +1559,20 @@ inf_discovery_avahi_get_discovered(InfDiscovery* discovery,
 {
   InfDiscoveryAvahiPrivate* priv;
   InfDiscoveryAvahiDiscoverInfo* info;
+  GSList* result;
+  GSList* item;
 
   priv = INF_DISCOVERY_AVAHI_PRIVATE(discovery);
   info = g_hash_table_lookup(priv->discovered, type);
   if(info == NULL) return NULL;
 
-  return g_slist_copy(info->discovered);
+  /* Only report infos for which the discovered signal has been emitted */
+  result = NULL;
+  for(item = info->discovered; item != NULL; item = g_slist_next(item))
+    if( ((InfDiscoveryInfo*)item->data)->announced)
+      result = g_slist_prepend(result, item->data);
+
+  return g_slist_reverse(result);
 }
 
 static void
@@ -1413,7 +1642,14 @@ inf_discovery_avahi_resolve(InfDiscovery* discovery,
     resolv->user_data = user_data;
     info->resolv = g_slist_prepend(info->resolv, resolv);
 
-    if(info->service_resolver == NULL)
+    if(info->service_resolver == NULL &&
+       info->cached_address != NULL &&
+       g_get_monotonic_time() < info->cached_until)
+    {
+      /* Resolved recently, so skip asking the network again */
+      inf_discovery_avahi_info_connect(INF_DISCOVERY_AVAHI(discovery), info);
+    }
+    else if(info->service_resolver == NULL)
     {
       info->service_resolver = avahi_service_resolver_new(
         priv->client,
@@ -228,6 +228,8 @@ inf_directory_strerror(InfDirectoryError code)
     return _("The ACL has already been queried");
   case INF_DIRECTORY_ERROR_ACL_NOT_QUERIED:
     return _("The ACL has not been queried");
+  case INF_DIRECTORY_ERROR_REDIRECTED:
+    return _("The subdirectory is hosted on a different server");
   case INF_DIRECTORY_ERROR_FAILED:
     return _("An unknown directory error has occurred");
   default:
@@ -168,6 +168,8 @@ typedef enum _InfUserError {
  * already been queried before.
  * @INF_DIRECTORY_ERROR_ACL_NOT_QUERIED: The ACL for a node has
  * not yet been queried, but is required to perform the operation.
+ * @INF_DIRECTORY_ERROR_REDIRECTED: The content of a subdirectory is hosted
+ * on a different server.
  * @INF_DIRECTORY_ERROR_FAILED: Generic error code when no further reason of
  * failure is known.
  *
@@ -208,6 +210,7 @@ typedef enum _InfDirectoryError {
   INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
   INF_DIRECTORY_ERROR_ACL_ALREADY_QUERIED,
   INF_DIRECTORY_ERROR_ACL_NOT_QUERIED,
+  INF_DIRECTORY_ERROR_REDIRECTED,
 
   INF_DIRECTORY_ERROR_FAILED
 } InfDirectoryError;
@@ -0,0 +1,86 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef __INF_IO_PRIVATE_H__
+#define __INF_IO_PRIVATE_H__
+
+#include <libinfinity/common/inf-io.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A queue of dispatches that can be pushed to from any thread without
+ * locking, and is drained by the thread running the main loop. InfIo
+ * implementations using it hand out the queue entries as #InfIoDispatch
+ * handles. */
+typedef struct _InfIoDispatchQueueEntry InfIoDispatchQueueEntry;
+struct _InfIoDispatchQueueEntry {
+  InfIoDispatchQueueEntry* next;
+  InfIoDispatchFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+  gint cancelled;
+};
+
+typedef struct _InfIoDispatchQueue InfIoDispatchQueue;
+struct _InfIoDispatchQueue {
+  /* Stack of newly pushed entries, most recent first. Modified atomically
+   * by producers, and taken as a whole by the consumer. */
+  InfIoDispatchQueueEntry* incoming;
+
+  /* Entries taken from the stack, in push order. Only accessed by the
+   * consumer. */
+  InfIoDispatchQueueEntry* head;
+  InfIoDispatchQueueEntry* tail;
+};
+
+void
+_inf_io_dispatch_queue_init(InfIoDispatchQueue* queue);
+
+void
+_inf_io_dispatch_queue_clear(InfIoDispatchQueue* queue);
+
+InfIoDispatchQueueEntry*
+_inf_io_dispatch_queue_push(InfIoDispatchQueue* queue,
+                            InfIoDispatchFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify,
+                            gboolean* was_empty);
+
+void
+_inf_io_dispatch_queue_cancel(InfIoDispatchQueue* queue,
+                              InfIoDispatchQueueEntry* entry);
+
+gboolean
+_inf_io_dispatch_queue_is_empty(InfIoDispatchQueue* queue);
+
+gboolean
+_inf_io_dispatch_queue_drain(InfIoDispatchQueue* queue,
+                             guint max_dispatches);
+
+guint
+_inf_io_dispatch_queue_get_length(InfIoDispatchQueue* queue);
+
+G_END_DECLS
+
+#endif /* __INF_IO_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -41,6 +41,7 @@
  **/
 
 #include <libinfinity/common/inf-io.h>
+#include <libinfinity/common/inf-io-private.h>
 #include <libinfinity/inf-define-enum.h>
 
 typedef struct _InfIoWatchUnix InfIoWatchUnix;
@@ -99,7 +100,9 @@ inf_io_default_init(InfIoInterface* iface)
  * needed, or %NULL.
  *
  * Monitors the given socket for activity and calls @func if one of the
- * events specified in @events occurs.
+ * events specified in @events occurs. Events are level-triggered: @func is
+ * called again in the next iteration for as long as the condition holds,
+ * so it does not need to read or write until the operation would block.
  *
  * Returns: (transfer none): A #InfIoWatch that can be used to update or
  * remove the watch.
@@ -275,6 +278,35 @@ inf_io_remove_timeout(InfIo* io,
   iface->remove_timeout(io, timeout);
 }
 
+/**
+ * inf_io_reset_timeout:
+ * @io: A #InfIo.
+ * @timeout: A timeout handle obtained from inf_io_add_timeout().
+ * @msecs: Number of milliseconds from now after which the timeout should
+ * be elapsed.
+ *
+ * Reschedules @timeout so that its function is called after at least
+ * @msecs milliseconds from now, instead of at the time it was originally
+ * scheduled for. This is cheaper than removing the timeout and adding a
+ * new one, and should be preferred for timers that are re-armed often,
+ * such as keepalives. @timeout must not have elapsed yet.
+ **/
+void
+inf_io_reset_timeout(InfIo* io,
+                     InfIoTimeout* timeout,
+                     guint msecs)
+{
+  InfIoInterface* iface;
+
+  g_return_if_fail(INF_IS_IO(io));
+  g_return_if_fail(timeout != NULL);
+
+  iface = INF_IO_GET_IFACE(io);
+  g_return_if_fail(iface->reset_timeout != NULL);
+
+  iface->reset_timeout(io, timeout, msecs);
+}
+
 /**
  * inf_io_add_dispatch:
  * @io: A #InfIo.
@@ -328,4 +360,177 @@ inf_io_remove_dispatch(InfIo* io,
   iface->remove_dispatch(io, dispatch);
 }
 
+/* Moves all entries from the incoming stack to the end of the consumer's
+ * list, restoring the order in which they were pushed. */
+static void
+inf_io_dispatch_queue_take(InfIoDispatchQueue* queue)
+{
+  InfIoDispatchQueueEntry* list;
+  InfIoDispatchQueueEntry* first;
+  InfIoDispatchQueueEntry* last;
+  InfIoDispatchQueueEntry* next;
+
+  do
+  {
+    list = g_atomic_pointer_get(&queue->incoming);
+    if(list == NULL) return;
+  } while(!g_atomic_pointer_compare_and_exchange(&queue->incoming,
+                                                  list,
+                                                  NULL));
+
+  first = NULL;
+  last = list;
+  while(list != NULL)
+  {
+    next = list->next;
+    list->next = first;
+    first = list;
+    list = next;
+  }
+
+  if(queue->tail != NULL)
+    queue->tail->next = first;
+  else
+    queue->head = first;
+  queue->tail = last;
+}
+
+void
+_inf_io_dispatch_queue_init(InfIoDispatchQueue* queue)
+{
+  queue->incoming = NULL;
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+/* Frees all entries that are still queued, without running them. Must not
+ * be called concurrently with any other function on the queue. */
+void
+_inf_io_dispatch_queue_clear(InfIoDispatchQueue* queue)
+{
+  InfIoDispatchQueueEntry* entry;
+
+  inf_io_dispatch_queue_take(queue);
+  while(queue->head != NULL)
+  {
+    entry = queue->head;
+    queue->head = entry->next;
+
+    if(!g_atomic_int_get(&entry->cancelled) && entry->notify != NULL)
+      entry->notify(entry->user_data);
+    g_slice_free(InfIoDispatchQueueEntry, entry);
+  }
+
+  queue->tail = NULL;
+}
+
+/* Can be called from any thread. was_empty is set to TRUE if the consumer
+ * might not have seen a pending entry before, in which case the caller
+ * needs to wake it up. */
+InfIoDispatchQueueEntry*
+_inf_io_dispatch_queue_push(InfIoDispatchQueue* queue,
+                            InfIoDispatchFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify,
+                            gboolean* was_empty)
+{
+  InfIoDispatchQueueEntry* entry;
+  InfIoDispatchQueueEntry* head;
+
+  entry = g_slice_new(InfIoDispatchQueueEntry);
+  entry->func = func;
+  entry->user_data = user_data;
+  entry->notify = notify;
+  entry->cancelled = 0;
+
+  do
+  {
+    head = g_atomic_pointer_get(&queue->incoming);
+    entry->next = head;
+  } while(!g_atomic_pointer_compare_and_exchange(&queue->incoming,
+                                                  head,
+                                                  entry));
+
+  if(was_empty != NULL)
+    *was_empty = (head == NULL);
+
+  return entry;
+}
+
+/* Marks the entry as cancelled and releases its user data. The entry itself
+ * stays in the queue and is freed by the consumer when it reaches it, so
+ * this must not be called once the entry has started to run. */
+void
+_inf_io_dispatch_queue_cancel(InfIoDispatchQueue* queue,
+                              InfIoDispatchQueueEntry* entry)
+{
+  g_assert(g_atomic_int_get(&entry->cancelled) == 0);
+  g_atomic_int_set(&entry->cancelled, 1);
+
+  if(entry->notify != NULL)
+    entry->notify(entry->user_data);
+}
+
+/* Only to be called by the consumer */
+gboolean
+_inf_io_dispatch_queue_is_empty(InfIoDispatchQueue* queue)
+{
+  return queue->head == NULL &&
+    g_atomic_pointer_get(&queue->incoming) == NULL;
+}
+
+/* Runs up to max_dispatches entries in the order they were pushed, and
+ * returns whether there are more left. Only to be called by the
+ * consumer. */
+gboolean
+_inf_io_dispatch_queue_drain(InfIoDispatchQueue* queue,
+                             guint max_dispatches)
+{
+  InfIoDispatchQueueEntry* entry;
+  guint n_dispatches;
+
+  inf_io_dispatch_queue_take(queue);
+  n_dispatches = 0;
+
+  while(queue->head != NULL && n_dispatches < max_dispatches)
+  {
+    /* Unlink the entry before running it, in case the callback runs the
+     * queue recursively */
+    entry = queue->head;
+    queue->head = entry->next;
+    if(queue->head == NULL)
+      queue->tail = NULL;
+
+    if(!g_atomic_int_get(&entry->cancelled))
+    {
+      entry->func(entry->user_data);
+      if(entry->notify != NULL)
+        entry->notify(entry->user_data);
+      ++n_dispatches;
+    }
+
+    g_slice_free(InfIoDispatchQueueEntry, entry);
+  }
+
+  return !_inf_io_dispatch_queue_is_empty(queue);
+}
+
+/* Returns the number of entries in the queue, including cancelled ones
+ * that have not been removed yet. This takes time linear in the length of
+ * the queue, and it may only be called by the consumer. */
+guint
+_inf_io_dispatch_queue_get_length(InfIoDispatchQueue* queue)
+{
+  InfIoDispatchQueueEntry* entry;
+  guint length;
+
+  inf_io_dispatch_queue_take(queue);
+
+  length = 0;
+  for(entry = queue->head; entry != NULL; entry = entry->next)
+    ++length;
+
+  return length;
+}
+
 /* vim:set et sw=2 ts=2: */
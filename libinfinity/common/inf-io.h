@@ -127,6 +127,8 @@ typedef void(*InfIoDispatchFunc)(gpointer user_data);
  * @remove_timeout: Removes a scheduled timeout again. The timeout is
  * removed automatically when it has elapsed, so there is no need to call
  * this function in that case.
+ * @reset_timeout: Reschedules a timeout that has not yet elapsed so that it
+ * elapses @msecs milliseconds from now.
  * @add_dispatch: Schedules @func to be called by the thread the #InfIo
  * runs in.
  * @remove_dispatch: Removes a scheduled dispatch. This can be called as long
@@ -164,6 +166,10 @@ struct _InfIoInterface {
   void (*remove_timeout)(InfIo* io,
                          InfIoTimeout* timeout);
 
+  void (*reset_timeout)(InfIo* io,
+                        InfIoTimeout* timeout,
+                        guint msecs);
+
   InfIoDispatch* (*add_dispatch)(InfIo* io,
                                  InfIoDispatchFunc func,
                                  gpointer user_data,
@@ -217,6 +223,11 @@ void
 inf_io_remove_timeout(InfIo* io,
                       InfIoTimeout* timeout);
 
+void
+inf_io_reset_timeout(InfIo* io,
+                     InfIoTimeout* timeout,
+                     guint msecs);
+
 InfIoDispatch*
 inf_io_add_dispatch(InfIo* io,
                     InfIoDispatchFunc func,
@@ -304,7 +304,7 @@ inf_keepalive_apply_linux(const InfKeepalive* keepalive,
     }
   }
 
-  if(keepalive->interval & INF_KEEPALIVE_INTERVAL)
+  if(keepalive->mask & INF_KEEPALIVE_INTERVAL)
   {
     optval = keepalive->interval;
     if(setsockopt(*socket, SOL_TCP, TCP_KEEPINTVL, &optval, len) != 0)
@@ -351,7 +351,7 @@ inf_keepalive_load_default_linux(InfKeepalive* keepalive,
   {
     inf_keepalive_read_proc_file(
       "/proc/sys/net/ipv4/tcp_keepalive_intvl",
-      &keepalive->time,
+      &keepalive->interval,
       &error
     );
 
@@ -34,6 +34,10 @@
  *
  * There can at most be one hostname lookup at a time. If you need more than
  * one concurrent hostname lookup, use multiple #InfNameResolver objects.
+ *
+ * Successful lookups are cached for a minute, shared between all
+ * #InfNameResolver objects, so that reconnecting to the same host does
+ * not need to wait for DNS again.
  **/
 
 #include <libinfinity/common/inf-name-resolver.h>
@@ -103,6 +107,8 @@ struct _InfNameResolverPrivate {
   gchar* srv;
 
   InfAsyncOperation* operation;
+  /* Emits the resolved signal for a result taken from the cache */
+  InfIoDispatch* cache_dispatch;
 
   /* Output */
   InfNameResolverResult result;
@@ -127,6 +133,22 @@ enum {
 
 static guint name_resolver_signals[LAST_SIGNAL];
 
+/* getaddrinfo() does not report the TTL of the records it found, so all
+ * entries are kept for the same time, in seconds. */
+static const gint64 INF_NAME_RESOLVER_CACHE_LIFETIME = 60;
+
+typedef struct _InfNameResolverCacheEntry InfNameResolverCacheEntry;
+struct _InfNameResolverCacheEntry {
+  InfNameResolverResult result;
+  gint64 expiry;
+};
+
+/* Maps hostname, service and SRV to InfNameResolverCacheEntry. Protected by
+ * a lock since resolvers can live in different threads with different
+ * InfIo objects. */
+static GHashTable* inf_name_resolver_cache;
+G_LOCK_DEFINE_STATIC(inf_name_resolver_cache);
+
 G_DEFINE_TYPE_WITH_CODE(InfNameResolver, inf_name_resolver, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfNameResolver))
 
@@ -157,6 +179,31 @@ inf_name_resolver_result_cleanup(InfNameResolverResult* result)
     g_error_free(result->error);
 }
 
+static void
+inf_name_resolver_result_copy(InfNameResolverResult* dest,
+                              const InfNameResolverResult* src)
+{
+  guint i;
+
+  dest->entries = g_malloc(sizeof(InfNameResolverEntry) * src->n_entries);
+  dest->n_entries = src->n_entries;
+  for(i = 0; i < src->n_entries; ++i)
+  {
+    dest->entries[i].address = inf_ip_address_copy(src->entries[i].address);
+    dest->entries[i].port = src->entries[i].port;
+  }
+
+  dest->srvs = g_malloc(sizeof(InfNameResolverSRV) * src->n_srvs);
+  dest->n_srvs = src->n_srvs;
+  for(i = 0; i < src->n_srvs; ++i)
+  {
+    dest->srvs[i] = src->srvs[i];
+    dest->srvs[i].address = g_strdup(src->srvs[i].address);
+  }
+
+  dest->error = NULL;
+}
+
 static void
 inf_name_resolver_result_free(gpointer result_ptr)
 {
@@ -850,6 +897,132 @@ inf_name_resolver_backup_run_func(gpointer* run_data,
 
 /* Main thread */
 
+static gchar*
+inf_name_resolver_make_cache_key(InfNameResolverPrivate* priv)
+{
+  /* SRV and service are prefixed with a marker so that NULL and the empty
+   * string yield different keys. */
+  return g_strdup_printf(
+    "%s\n%c%s\n%c%s",
+    priv->hostname,
+    priv->service != NULL ? '+' : '-',
+    priv->service != NULL ? priv->service : "",
+    priv->srv != NULL ? '+' : '-',
+    priv->srv != NULL ? priv->srv : ""
+  );
+}
+
+static void
+inf_name_resolver_cache_entry_free(gpointer entry_ptr)
+{
+  InfNameResolverCacheEntry* entry;
+  entry = (InfNameResolverCacheEntry*)entry_ptr;
+
+  inf_name_resolver_result_cleanup(&entry->result);
+  g_slice_free(InfNameResolverCacheEntry, entry);
+}
+
+static gboolean
+inf_name_resolver_cache_entry_expired_func(gpointer key,
+                                           gpointer value,
+                                           gpointer user_data)
+{
+  return ((InfNameResolverCacheEntry*)value)->expiry <= *(gint64*)user_data;
+}
+
+static void
+inf_name_resolver_cache_store(InfNameResolverPrivate* priv)
+{
+  InfNameResolverCacheEntry* entry;
+  gint64 now;
+
+  entry = g_slice_new(InfNameResolverCacheEntry);
+  inf_name_resolver_result_copy(&entry->result, &priv->result);
+
+  now = g_get_monotonic_time();
+  entry->expiry = now + INF_NAME_RESOLVER_CACHE_LIFETIME * G_USEC_PER_SEC;
+
+  G_LOCK(inf_name_resolver_cache);
+
+  if(inf_name_resolver_cache == NULL)
+  {
+    inf_name_resolver_cache = g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      g_free,
+      inf_name_resolver_cache_entry_free
+    );
+  }
+  else
+  {
+    g_hash_table_foreach_remove(
+      inf_name_resolver_cache,
+      inf_name_resolver_cache_entry_expired_func,
+      &now
+    );
+  }
+
+  g_hash_table_replace(
+    inf_name_resolver_cache,
+    inf_name_resolver_make_cache_key(priv),
+    entry
+  );
+
+  G_UNLOCK(inf_name_resolver_cache);
+}
+
+/* Fills in the result from the cache, and returns whether there was a
+ * valid entry. */
+static gboolean
+inf_name_resolver_cache_lookup(InfNameResolverPrivate* priv)
+{
+  InfNameResolverCacheEntry* entry;
+  gchar* key;
+  gboolean found;
+
+  found = FALSE;
+  G_LOCK(inf_name_resolver_cache);
+
+  if(inf_name_resolver_cache != NULL)
+  {
+    key = inf_name_resolver_make_cache_key(priv);
+    entry = g_hash_table_lookup(inf_name_resolver_cache, key);
+
+    if(entry != NULL && entry->expiry <= g_get_monotonic_time())
+    {
+      g_hash_table_remove(inf_name_resolver_cache, key);
+    }
+    else if(entry != NULL)
+    {
+      inf_name_resolver_result_copy(&priv->result, &entry->result);
+      found = TRUE;
+    }
+
+    g_free(key);
+  }
+
+  G_UNLOCK(inf_name_resolver_cache);
+  return found;
+}
+
+static void
+inf_name_resolver_cache_dispatch_func(gpointer user_data)
+{
+  InfNameResolver* resolver;
+  InfNameResolverPrivate* priv;
+
+  resolver = INF_NAME_RESOLVER(user_data);
+  priv = INF_NAME_RESOLVER_PRIVATE(resolver);
+  priv->cache_dispatch = NULL;
+
+  g_signal_emit(
+    G_OBJECT(resolver),
+    name_resolver_signals[RESOLVED],
+    0,
+    NULL
+  );
+}
+
 static void
 inf_name_resolver_done_func(gpointer run_data,
                             gpointer user_data)
@@ -872,6 +1045,9 @@ inf_name_resolver_done_func(gpointer run_data,
   /* Nullify this so that the destroy notify lets the data alive */
   inf_name_resolver_result_nullify(result);
 
+  if(priv->result.error == NULL && priv->result.n_entries > 0)
+    inf_name_resolver_cache_store(priv);
+
   g_signal_emit(
     G_OBJECT(resolver),
     name_resolver_signals[RESOLVED],
@@ -940,6 +1116,7 @@ inf_name_resolver_init(InfNameResolver* resolver)
   priv->srv = NULL;
 
   priv->operation = NULL;
+  priv->cache_dispatch = NULL;
 
   inf_name_resolver_result_nullify(&priv->result);
 }
@@ -959,6 +1136,12 @@ inf_name_resolver_dispose(GObject* object)
     priv->operation = NULL;
   }
 
+  if(priv->cache_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->cache_dispatch);
+    priv->cache_dispatch = NULL;
+  }
+
   if(priv->io != NULL)
   {
     g_object_unref(G_OBJECT(priv->io));
@@ -1268,10 +1451,25 @@ inf_name_resolver_start(InfNameResolver* resolver,
 
   priv = INF_NAME_RESOLVER_PRIVATE(resolver);
   g_return_val_if_fail(priv->operation == NULL, FALSE);
+  g_return_val_if_fail(priv->cache_dispatch == NULL, FALSE);
 
   inf_name_resolver_result_cleanup(&priv->result);
   inf_name_resolver_result_nullify(&priv->result);
 
+  /* The signal is still emitted asynchronously for a cached result, as
+   * callers expect. */
+  if(inf_name_resolver_cache_lookup(priv))
+  {
+    priv->cache_dispatch = inf_io_add_dispatch(
+      priv->io,
+      inf_name_resolver_cache_dispatch_func,
+      resolver,
+      NULL
+    );
+
+    return TRUE;
+  }
+
   priv->operation = inf_async_operation_new(
     priv->io,
     inf_name_resolver_run_func,
@@ -1320,6 +1518,7 @@ inf_name_resolver_lookup_backup(InfNameResolver* resolver,
 
   priv = INF_NAME_RESOLVER_PRIVATE(resolver);
   g_return_val_if_fail(priv->operation == NULL, FALSE);
+  g_return_val_if_fail(priv->cache_dispatch == NULL, FALSE);
 
   if(priv->result.n_srvs == 0)
     return FALSE;
@@ -1369,7 +1568,7 @@ inf_name_resolver_finished(InfNameResolver* resolver)
 
   priv = INF_NAME_RESOLVER_PRIVATE(resolver);
 
-  if(priv->operation != NULL)
+  if(priv->operation != NULL || priv->cache_dispatch != NULL)
     return FALSE;
 
   return TRUE;
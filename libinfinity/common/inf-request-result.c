@@ -35,13 +35,82 @@
 
 #include <libinfinity/common/inf-request-result.h>
 
+#include <string.h>
+
 G_DEFINE_BOXED_TYPE(InfRequestResult, inf_request_result, inf_request_result_copy, inf_request_result_free)
 
+/* Number of released InfRequestResult structures that are kept around for
+ * reuse. Request results are short-lived, typically only existing for the
+ * emission of the InfRequest::finished signal, so a small pool suffices. */
+#define INF_REQUEST_RESULT_POOL_SIZE 64
+
 struct _InfRequestResult {
   gpointer data;
   gsize len;
+
+  /* Inline storage for the result data, large enough for all the results
+   * created by the inf_request_result_make_*() functions, so that these
+   * do not need a separate allocation. */
+  gpointer storage[4];
 };
 
+/* Released results, chained via their data field */
+G_LOCK_DEFINE_STATIC(inf_request_result_pool);
+static InfRequestResult* inf_request_result_pool;
+static guint inf_request_result_pool_size;
+
+static InfRequestResult*
+inf_request_result_alloc(void)
+{
+  InfRequestResult* result;
+
+  G_LOCK(inf_request_result_pool);
+  result = inf_request_result_pool;
+  if(result != NULL)
+  {
+    inf_request_result_pool = result->data;
+    --inf_request_result_pool_size;
+  }
+  G_UNLOCK(inf_request_result_pool);
+
+  if(result == NULL)
+    result = g_slice_new(InfRequestResult);
+
+  return result;
+}
+
+static void
+inf_request_result_release(InfRequestResult* result)
+{
+  G_LOCK(inf_request_result_pool);
+  if(inf_request_result_pool_size < INF_REQUEST_RESULT_POOL_SIZE)
+  {
+    result->data = inf_request_result_pool;
+    inf_request_result_pool = result;
+    ++inf_request_result_pool_size;
+    result = NULL;
+  }
+  G_UNLOCK(inf_request_result_pool);
+
+  if(result != NULL)
+    g_slice_free(InfRequestResult, result);
+}
+
+static InfRequestResult*
+inf_request_result_new_sized(gsize len)
+{
+  InfRequestResult* result;
+  result = inf_request_result_alloc();
+
+  if(len <= sizeof(result->storage))
+    result->data = result->storage;
+  else
+    result->data = g_malloc(len);
+
+  result->len = len;
+  return result;
+}
+
 /**
  * inf_request_result_new: (constructor)
  * @data: The data representing the result of the request.
@@ -63,7 +132,7 @@ inf_request_result_new(gpointer data,
                        gsize len)
 {
   InfRequestResult* result;
-  result = g_slice_new(InfRequestResult);
+  result = inf_request_result_alloc();
   result->data = data;
   result->len = len;
   return result;
@@ -85,9 +154,8 @@ inf_request_result_copy(const InfRequestResult* result)
 
   g_return_val_if_fail(result != NULL, NULL);
 
-  new_result = g_slice_new(InfRequestResult);
-  new_result->data = g_memdup(result->data, result->len);
-  new_result->len = result->len;
+  new_result = inf_request_result_new_sized(result->len);
+  memcpy(new_result->data, result->data, result->len);
   return new_result;
 }
 
@@ -102,8 +170,10 @@ inf_request_result_free(InfRequestResult* result)
 {
   g_return_if_fail(result != NULL);
 
-  g_free(result->data);
-  g_slice_free(InfRequestResult, result);
+  if(result->data != result->storage)
+    g_free(result->data);
+
+  inf_request_result_release(result);
 }
 
 /**
@@ -156,19 +226,21 @@ inf_request_result_make_add_node(InfBrowser* browser,
                                  const InfBrowserIter* iter,
                                  const InfBrowserIter* new_node)
 {
+  InfRequestResult* result;
   InfRequestResultAddNode* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
   g_return_val_if_fail(new_node != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultAddNode));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultAddNode*)result->data;
 
   data->browser = browser;
   data->iter = iter;
   data->new_node = new_node;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -223,17 +295,19 @@ InfRequestResult*
 inf_request_result_make_remove_node(InfBrowser* browser,
                                     const InfBrowserIter* iter)
 {
+  InfRequestResult* result;
   InfRequestResultRemoveNode* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultRemoveNode));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultRemoveNode*)result->data;
 
   data->browser = browser;
   data->iter = iter;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -284,17 +358,19 @@ InfRequestResult*
 inf_request_result_make_explore_node(InfBrowser* browser,
                                      const InfBrowserIter* iter)
 {
+  InfRequestResult* result;
   InfRequestResultExploreNode* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultExploreNode));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultExploreNode*)result->data;
 
   data->browser = browser;
   data->iter = iter;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -345,17 +421,19 @@ InfRequestResult*
 inf_request_result_make_save_session(InfBrowser* browser,
                                      const InfBrowserIter* iter)
 {
+  InfRequestResult* result;
   InfRequestResultSaveSession* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultSaveSession));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultSaveSession*)result->data;
 
   data->browser = browser;
   data->iter = iter;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -410,19 +488,21 @@ inf_request_result_make_subscribe_session(InfBrowser* browser,
                                           const InfBrowserIter* iter,
                                           InfSessionProxy* proxy)
 {
+  InfRequestResult* result;
   InfRequestResultSubscribeSession* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
   g_return_val_if_fail(INF_IS_SESSION_PROXY(proxy), NULL);
 
-  data = g_malloc(sizeof(InfRequestResultSubscribeSession));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultSubscribeSession*)result->data;
 
   data->browser = browser;
   data->iter = iter;
   data->proxy = proxy;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -477,17 +557,19 @@ InfRequestResult*
 inf_request_result_make_subscribe_chat(InfBrowser* browser,
                                        InfSessionProxy* proxy)
 {
+  InfRequestResult* result;
   InfRequestResultSubscribeChat* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(INF_IS_SESSION_PROXY(proxy), NULL);
 
-  data = g_malloc(sizeof(InfRequestResultSubscribeChat));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultSubscribeChat*)result->data;
 
   data->browser = browser;
   data->proxy = proxy;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -546,18 +628,20 @@ inf_request_result_make_query_acl_account_list(InfBrowser* browser,
                                                guint n_accounts,
                                                gboolean does_notifications)
 {
+  InfRequestResult* result;
   InfRequestResultQueryAclAccountList* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
 
-  data = g_malloc(sizeof(InfRequestResultQueryAclAccountList));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultQueryAclAccountList*)result->data;
 
   data->browser = browser;
   data->accounts = accounts;
   data->n_accounts = n_accounts;
   data->does_notifications = does_notifications;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -624,17 +708,19 @@ inf_request_result_make_lookup_acl_accounts(InfBrowser* browser,
                                             const InfAclAccount* accounts,
                                             guint n_accounts)
 {
+  InfRequestResult* result;
   InfRequestResultLookupAclAccounts* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
 
-  data = g_malloc(sizeof(InfRequestResultLookupAclAccounts));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultLookupAclAccounts*)result->data;
 
   data->browser = browser;
   data->accounts = accounts;
   data->n_accounts = n_accounts;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -670,6 +756,89 @@ inf_request_result_get_lookup_acl_accounts(const InfRequestResult* result,
   if(n_accounts != NULL) *n_accounts = data->n_accounts;
 }
 
+typedef struct _InfRequestResultQueryAclAccounts
+  InfRequestResultQueryAclAccounts;
+struct _InfRequestResultQueryAclAccounts {
+  InfBrowser* browser;
+  const InfAclAccount* accounts;
+  guint n_accounts;
+  guint n_total;
+};
+
+/**
+ * inf_request_result_make_query_acl_accounts:
+ * @browser: A #InfBrowser.
+ * @accounts: (array length=n_accounts): The requested range of accounts.
+ * @n_accounts: The number of entries in the account list.
+ * @n_total: The total number of accounts matching the query.
+ *
+ * Creates a new #InfRequestResult for a "query-acl-accounts" request, see
+ * inf_browser_query_acl_accounts(). The #InfRequestResult object is only
+ * valid as long as the caller maintains a reference to @browser.
+ *
+ * Returns: (transfer full): A new #InfRequestResult. Free with
+ * inf_request_result_free().
+ */
+InfRequestResult*
+inf_request_result_make_query_acl_accounts(InfBrowser* browser,
+                                           const InfAclAccount* accounts,
+                                           guint n_accounts,
+                                           guint n_total)
+{
+  InfRequestResult* result;
+  InfRequestResultQueryAclAccounts* data;
+
+  g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
+  g_return_val_if_fail(n_accounts <= n_total, NULL);
+
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultQueryAclAccounts*)result->data;
+
+  data->browser = browser;
+  data->accounts = accounts;
+  data->n_accounts = n_accounts;
+  data->n_total = n_total;
+
+  return result;
+}
+
+/**
+ * inf_request_result_get_query_acl_accounts:
+ * @result: A #InfRequestResult:
+ * @browser: (out) (transfer none) (allow-none): Output value of the browser
+ * that made the request, or %NULL.
+ * @accounts: (out) (transfer none) (allow-none) (array length=n_accounts):
+ * Output value for the requested range of accounts, or %NULL.
+ * @n_accounts: (out) (transfer none) (allow-none): Output value for the size
+ * of the account list, or %NULL.
+ * @n_total: (out) (transfer none) (allow-none): Output value for the total
+ * number of accounts matching the query, or %NULL.
+ *
+ * Decomposes @result into its components. The object must have been created
+ * with inf_request_result_make_query_acl_accounts().
+ */
+void
+inf_request_result_get_query_acl_accounts(const InfRequestResult* result,
+                                          InfBrowser** browser,
+                                          const InfAclAccount** accounts,
+                                          guint* n_accounts,
+                                          guint* n_total)
+{
+  const InfRequestResultQueryAclAccounts* data;
+
+  g_return_if_fail(result != NULL);
+  g_return_if_fail(
+    result->len == sizeof(InfRequestResultQueryAclAccounts)
+  );
+
+  data = (const InfRequestResultQueryAclAccounts*)result->data;
+
+  if(browser != NULL) *browser = data->browser;
+  if(accounts != NULL) *accounts = data->accounts;
+  if(n_accounts != NULL) *n_accounts = data->n_accounts;
+  if(n_total != NULL) *n_total = data->n_total;
+}
+
 typedef struct _InfRequestResultCreateAclAccount
   InfRequestResultCreateAclAccount;
 struct _InfRequestResultCreateAclAccount {
@@ -696,18 +865,20 @@ inf_request_result_make_create_acl_account(InfBrowser* browser,
                                            const InfAclAccount* account,
                                            InfCertificateChain* certificate)
 {
+  InfRequestResult* result;
   InfRequestResultCreateAclAccount* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(certificate != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultCreateAclAccount));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultCreateAclAccount*)result->data;
 
   data->browser = browser;
   data->account = account;
   data->certificate = certificate;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -764,17 +935,19 @@ InfRequestResult*
 inf_request_result_make_remove_acl_account(InfBrowser* browser,
                                            const InfAclAccount* account)
 {
+  InfRequestResult* result;
   InfRequestResultRemoveAclAccount* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(account != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultRemoveAclAccount));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultRemoveAclAccount*)result->data;
 
   data->browser = browser;
   data->account = account;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -829,18 +1002,20 @@ inf_request_result_make_query_acl(InfBrowser* browser,
                                   const InfBrowserIter* iter,
                                   const InfAclSheetSet* sheet_set)
 {
+  InfRequestResult* result;
   InfRequestResultQueryAcl* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultQueryAcl));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultQueryAcl*)result->data;
 
   data->browser = browser;
   data->iter = iter;
   data->sheet_set = sheet_set;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -896,17 +1071,19 @@ InfRequestResult*
 inf_request_result_make_set_acl(InfBrowser* browser,
                                 const InfBrowserIter* iter)
 {
+  InfRequestResult* result;
   InfRequestResultSetAcl* data;
 
   g_return_val_if_fail(INF_IS_BROWSER(browser), NULL);
   g_return_val_if_fail(iter != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultSetAcl));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultSetAcl*)result->data;
 
   data->browser = browser;
   data->iter = iter;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
@@ -958,17 +1135,19 @@ InfRequestResult*
 inf_request_result_make_join_user(InfSessionProxy* proxy,
                                   InfUser* user)
 {
+  InfRequestResult* result;
   InfRequestResultJoinUser* data;
 
   g_return_val_if_fail(INF_IS_SESSION_PROXY(proxy), NULL);
   g_return_val_if_fail(user != NULL, NULL);
 
-  data = g_malloc(sizeof(InfRequestResultJoinUser));
+  result = inf_request_result_new_sized(sizeof(*data));
+  data = (InfRequestResultJoinUser*)result->data;
 
   data->proxy = proxy;
   data->user = user;
 
-  return inf_request_result_new(data, sizeof(*data));
+  return result;
 }
 
 /**
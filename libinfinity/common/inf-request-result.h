@@ -129,6 +129,19 @@ inf_request_result_get_lookup_acl_accounts(const InfRequestResult* result,
                                            const InfAclAccount** accounts,
                                            guint* n_accounts);
 
+InfRequestResult*
+inf_request_result_make_query_acl_accounts(InfBrowser* browser,
+                                           const InfAclAccount* accounts,
+                                           guint n_accounts,
+                                           guint n_total);
+
+void
+inf_request_result_get_query_acl_accounts(const InfRequestResult* result,
+                                          InfBrowser** browser,
+                                          const InfAclAccount** accounts,
+                                          guint* n_accounts,
+                                          guint* n_total);
+
 InfRequestResult*
 inf_request_result_make_create_acl_account(InfBrowser* browser,
                                            const InfAclAccount* account,
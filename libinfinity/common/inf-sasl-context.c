@@ -32,7 +32,11 @@
  * to give control back to a main loop while waiting for user input.
  *
  * This wrapper makes sure the callback is called in another thread so that it
- * can block without affecting the rest of the program.
+ * can block without affecting the rest of the program. The processing is
+ * done in the worker pool shared with #InfAsyncOperation, so a thread is
+ * only occupied while data fed to a session is being processed, and the
+ * number of sessions processing data at the same time is bounded by
+ * inf_async_operation_set_max_threads().
  * Use inf_sasl_context_session_feed() as a replacement for gsasl_step64().
  * Instead of returning the result data directly, the function calls a
  * callback once all properties requested have been provided.
@@ -44,6 +48,7 @@
  **/
 
 #include <libinfinity/common/inf-sasl-context.h>
+#include <libinfinity/common/inf-async-operation-private.h>
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-error.h>
 
@@ -55,7 +60,6 @@ typedef enum _InfSaslContextMessageType {
   /* main -> session */
   INF_SASL_CONTEXT_MESSAGE_TERMINATE,
   INF_SASL_CONTEXT_MESSAGE_CONTINUE,
-  INF_SASL_CONTEXT_MESSAGE_STEP,
 
   /* session -> main */
   INF_SASL_CONTEXT_MESSAGE_QUERY, /* invoke callback to query a property */
@@ -80,13 +84,18 @@ struct _InfSaslContextSession {
    * need the mutex for this if InfIo would allow to set the
    * InfIoDispatch pointer before executing the dispatch. */
   InfIoDispatch* dispatch;
-  GThread* thread;
+  /* Number of step jobs waiting in the worker pool queue, number of step
+   * jobs currently running, and whether the session has been stopped. These
+   * are protected by inf_sasl_context_pool_mutex. */
+  guint n_queued;
+  guint n_running;
+  gboolean cancelled;
   /* This flag tells whether we are currently processing user data in the
    * helper thread. It is meant as a simple indicator in the main thread
    * whether more data can be given to the context or not. */
   gboolean stepping;
 
-  /* used in session thread only */
+  /* used in the step job only */
   gchar* step64;
   InfSaslContextSessionFeedFunc feed_func;
   gpointer feed_user_data;
@@ -105,12 +114,6 @@ struct _InfSaslContextMessage {
       int retval;
     } cont;
 
-    struct {
-      gchar* data;
-      InfSaslContextSessionFeedFunc func;
-      gpointer user_data;
-    } step;
-
     struct {
       Gsasl_property prop;
     } query;
@@ -140,6 +143,10 @@ struct _InfSaslContext {
   GMutex mutex;
 };
 
+/* Used to wait for step jobs of a session to finish when stopping it */
+static GMutex inf_sasl_context_pool_mutex;
+static GCond inf_sasl_context_pool_cond;
+
 /*
  * Message handling
  */
@@ -166,22 +173,6 @@ inf_sasl_context_message_continue(InfSaslContextSession* session,
   return message;
 }
 
-static InfSaslContextMessage*
-inf_sasl_context_message_step(InfSaslContextSession* session,
-                              const char* data,
-                              InfSaslContextSessionFeedFunc func,
-                              gpointer user_data)
-{
-  InfSaslContextMessage* message;
-  message = g_slice_new(InfSaslContextMessage);
-  message->type = INF_SASL_CONTEXT_MESSAGE_STEP;
-  message->session = session;
-  message->shared.step.data = data ? g_strdup(data) : NULL;
-  message->shared.step.func = func;
-  message->shared.step.user_data = user_data;
-  return message;
-}
-
 static InfSaslContextMessage*
 inf_sasl_context_message_query(InfSaslContextSession* session,
                                Gsasl_property prop)
@@ -224,9 +215,6 @@ inf_sasl_context_message_free(gpointer message_)
   case INF_SASL_CONTEXT_MESSAGE_CONTINUE:
     /* nothing to do */
     break;
-  case INF_SASL_CONTEXT_MESSAGE_STEP:
-    g_free(message->shared.step.data);
-    break;
   case INF_SASL_CONTEXT_MESSAGE_QUERY:
     /* nothing to do */
     break;
@@ -243,7 +231,7 @@ inf_sasl_context_message_free(gpointer message_)
 }
 
 /*
- * Session thread and gsasl callback
+ * Step job and gsasl callback
  */
 
 static void
@@ -260,26 +248,14 @@ inf_sasl_context_session_message_func(gpointer user_data)
   switch(message->type)
   {
   case INF_SASL_CONTEXT_MESSAGE_TERMINATE:
-    /* session thread */
+    /* step job */
     message->session->status = INF_SASL_CONTEXT_SESSION_TERMINATE;
     break;
   case INF_SASL_CONTEXT_MESSAGE_CONTINUE:
-    /* session thread */
+    /* step job */
     g_assert(message->session->status == INF_SASL_CONTEXT_SESSION_INNER);
     message->session->retval = message->shared.cont.retval;
     break;
-  case INF_SASL_CONTEXT_MESSAGE_STEP:
-    /* session thread */
-    g_assert(message->session->status == INF_SASL_CONTEXT_SESSION_OUTER);
-    g_assert(message->shared.step.func != NULL);
-
-    message->session->step64 = message->shared.step.data;
-    message->session->feed_func = message->shared.step.func;
-    message->session->feed_user_data = message->shared.step.user_data;
-    message->shared.step.data = NULL; /* prevent deletion */
-
-    message->session->status = INF_SASL_CONTEXT_SESSION_INNER;
-    break;
   case INF_SASL_CONTEXT_MESSAGE_QUERY:
     /* main thread */
     g_mutex_lock(&message->session->context->mutex);
@@ -388,94 +364,104 @@ inf_sasl_context_gsasl_callback(Gsasl* gsasl,
   return session->retval;
 }
 
-static void*
-inf_sasl_context_thread_func(gpointer data)
+static void
+inf_sasl_context_session_free(InfSaslContextSession* session)
 {
-  InfSaslContextSession* session;
-  InfSaslContextMessage* message;
+  g_free(session->step64);
+  g_slice_free(InfSaslContextSession, session);
+}
 
-  session = (InfSaslContextSession*)data;
+static void
+inf_sasl_context_step_func(gpointer data)
+{
+  InfSaslContextSession* session;
+  gboolean cancelled;
+  gboolean is_last;
 
   int retval;
   char* output;
   InfSaslContextSessionFeedFunc feed_func;
   gpointer feed_user_data;
 
-  /* Wait for something to do */
-  while(session->status != INF_SASL_CONTEXT_SESSION_TERMINATE)
+  session = (InfSaslContextSession*)data;
+
+  /* If the session was stopped while this job was still queued, then the
+   * last job to run frees the session structure. */
+  g_mutex_lock(&inf_sasl_context_pool_mutex);
+  --session->n_queued;
+  cancelled = session->cancelled;
+  is_last = session->n_queued == 0;
+  if(!cancelled) ++session->n_running;
+  g_mutex_unlock(&inf_sasl_context_pool_mutex);
+
+  if(cancelled)
   {
-    switch(session->status)
-    {
-    case INF_SASL_CONTEXT_SESSION_OUTER:
-      message = g_async_queue_pop(session->session_queue);
-      inf_sasl_context_session_message_func(message);
-      inf_sasl_context_message_free(message);
-      break;
-    case INF_SASL_CONTEXT_SESSION_INNER:
-      g_mutex_lock(&session->context->mutex);
+    if(is_last)
+      inf_sasl_context_session_free(session);
+    return;
+  }
 
-      g_assert(session->dispatch == NULL);
+  g_assert(session->status == INF_SASL_CONTEXT_SESSION_INNER);
 
-      /* This might call the gsasl callback once or more in which we wait
-       * for input from the main thread. */
-      retval = gsasl_step64(
-        session->session,
-        session->step64,
-        &output
-      );
+  g_mutex_lock(&session->context->mutex);
 
-      g_mutex_unlock(&session->context->mutex);
-
-      g_free(session->step64);
-      session->step64 = NULL;
-
-      if(retval != GSASL_OK && retval != GSASL_NEEDS_MORE)
-        output = NULL;
-
-      /* Only process the result when we were not requested to terminate
-       * within the gsasl callback. */
-      if(session->status != INF_SASL_CONTEXT_SESSION_TERMINATE)
-      {
-        feed_func = session->feed_func;
-        feed_user_data = session->feed_user_data;
-        session->feed_func = NULL; /* clear, so that feed can be called again */
-
-        session->status = INF_SASL_CONTEXT_SESSION_OUTER;
-
-        g_mutex_lock(&session->context->mutex);
-
-        g_assert(session->dispatch == NULL);
-
-        session->dispatch = inf_io_add_dispatch(
-          INF_IO(session->main_io),
-          inf_sasl_context_session_message_func,
-          inf_sasl_context_message_stepped(
-            session,
-            output,
-            retval,
-            feed_func,
-            feed_user_data
-          ),
-          inf_sasl_context_message_free
-        );
-
-        g_mutex_unlock(&session->context->mutex);
-      }
-      else
-      {
-        session->feed_func = NULL;
-        if(output) gsasl_free(output);
-      }
+  g_assert(session->dispatch == NULL);
 
-      break;
-    case INF_SASL_CONTEXT_SESSION_TERMINATE:
-    default:
-      g_assert_not_reached();
-      break;
-    }
+  /* This might call the gsasl callback once or more in which we wait
+   * for input from the main thread. */
+  retval = gsasl_step64(
+    session->session,
+    session->step64,
+    &output
+  );
+
+  g_mutex_unlock(&session->context->mutex);
+
+  g_free(session->step64);
+  session->step64 = NULL;
+
+  if(retval != GSASL_OK && retval != GSASL_NEEDS_MORE)
+    output = NULL;
+
+  /* Only process the result when we were not requested to terminate
+   * within the gsasl callback. */
+  if(session->status != INF_SASL_CONTEXT_SESSION_TERMINATE)
+  {
+    feed_func = session->feed_func;
+    feed_user_data = session->feed_user_data;
+    session->feed_func = NULL; /* clear, so that feed can be called again */
+
+    session->status = INF_SASL_CONTEXT_SESSION_OUTER;
+
+    g_mutex_lock(&session->context->mutex);
+
+    g_assert(session->dispatch == NULL);
+
+    session->dispatch = inf_io_add_dispatch(
+      INF_IO(session->main_io),
+      inf_sasl_context_session_message_func,
+      inf_sasl_context_message_stepped(
+        session,
+        output,
+        retval,
+        feed_func,
+        feed_user_data
+      ),
+      inf_sasl_context_message_free
+    );
+
+    g_mutex_unlock(&session->context->mutex);
+  }
+  else
+  {
+    session->feed_func = NULL;
+    if(output) gsasl_free(output);
   }
 
-  return NULL;
+  g_mutex_lock(&inf_sasl_context_pool_mutex);
+  --session->n_running;
+  g_cond_broadcast(&inf_sasl_context_pool_cond);
+  g_mutex_unlock(&inf_sasl_context_pool_mutex);
 }
 
 /*
@@ -486,8 +472,7 @@ static InfSaslContextSession*
 inf_sasl_context_start_session(InfSaslContext* context,
                                InfIo* io,
                                Gsasl_session* gsasl_session,
-                               gpointer session_data,
-                               GError** error)
+                               gpointer session_data)
 {
   InfSaslContextSession* session;
   session = g_slice_new(InfSaslContextSession);
@@ -500,7 +485,9 @@ inf_sasl_context_start_session(InfSaslContext* context,
   session->session_queue =
     g_async_queue_new_full(inf_sasl_context_message_free);
   session->dispatch = NULL;
-  session->thread = NULL;
+  session->n_queued = 0;
+  session->n_running = 0;
+  session->cancelled = FALSE;
   session->stepping = FALSE;
 
   session->status = INF_SASL_CONTEXT_SESSION_OUTER;
@@ -512,22 +499,6 @@ inf_sasl_context_start_session(InfSaslContext* context,
   context->sessions = g_slist_prepend(context->sessions, session);
   gsasl_session_hook_set(gsasl_session, session);
 
-  session->thread = g_thread_try_new(
-    "InfSaslContext",
-    inf_sasl_context_thread_func,
-    session,
-    error
-  );
-
-  if(session->thread == NULL)
-  {
-    context->sessions = g_slist_remove(context->sessions, session);
-    g_async_queue_unref(session->session_queue);
-    g_object_unref(session->main_io);
-    g_slice_free(InfSaslContextSession, session);
-    return NULL;
-  }
-
   return session;
 }
 
@@ -615,7 +586,7 @@ inf_sasl_context_unref(InfSaslContext* context)
   {
     /* Note that we don't need to lock the mutex here since if nobody has a
      * reference anymore then they cannot access the session list concurrently
-     * anyway. Also, the session threads do not access the list at all. */
+     * anyway. Also, the step jobs do not access the list at all. */
     while(context->sessions != NULL)
     {
       inf_sasl_context_stop_session(
@@ -624,8 +595,8 @@ inf_sasl_context_unref(InfSaslContext* context)
       );
     }
 
-    /* Again we don't need to lock the mutex for this since all session
-     * threads have been stopped at this point. */
+    /* Again we don't need to lock the mutex for this since no step job
+     * is running anymore at this point. */
     gsasl_done(context->gsasl);
     g_mutex_clear(&context->mutex);
 
@@ -720,17 +691,9 @@ inf_sasl_context_client_start_session(InfSaslContext* context,
     context,
     io,
     gsasl_session,
-    session_data,
-    error
+    session_data
   );
 
-  if(session == NULL)
-  {
-    gsasl_finish(gsasl_session);
-    g_mutex_unlock(&context->mutex);
-    return NULL;
-  }
-
   g_mutex_unlock(&context->mutex);
   return session;
 }
@@ -872,17 +835,9 @@ inf_sasl_context_server_start_session(InfSaslContext* context,
     context,
     io,
     gsasl_session,
-    session_data,
-    error
+    session_data
   );
 
-  if(session == NULL)
-  {
-    gsasl_finish(gsasl_session);
-    g_mutex_unlock(&context->mutex);
-    return NULL;
-  }
-
   g_mutex_unlock(&context->mutex);
   return session;
 }
@@ -967,6 +922,8 @@ void
 inf_sasl_context_stop_session(InfSaslContext* context,
                               InfSaslContextSession* session)
 {
+  gboolean is_queued;
+
   g_return_if_fail(context != NULL);
   g_return_if_fail(session != NULL);
 
@@ -975,13 +932,20 @@ inf_sasl_context_stop_session(InfSaslContext* context,
   g_return_if_fail(session->context == context);
   g_mutex_unlock(&context->mutex);
 
-  /* Tell client thread to terminate */
+  /* Tell a running step job to terminate, and wait for it to finish. A
+   * job that is still queued does not touch the session anymore when it
+   * runs, except for freeing the session structure. */
   g_async_queue_push(
     session->session_queue,
     inf_sasl_context_message_terminate(session)
   );
 
-  g_thread_join(session->thread);
+  g_mutex_lock(&inf_sasl_context_pool_mutex);
+  session->cancelled = TRUE;
+  while(session->n_running > 0)
+    g_cond_wait(&inf_sasl_context_pool_cond, &inf_sasl_context_pool_mutex);
+  is_queued = session->n_queued > 0;
+  g_mutex_unlock(&inf_sasl_context_pool_mutex);
 
   g_mutex_lock(&context->mutex);
   if(session->dispatch != NULL)
@@ -998,8 +962,8 @@ inf_sasl_context_stop_session(InfSaslContext* context,
 
   g_object_unref(session->main_io);
 
-  g_free(session->step64);
-  g_slice_free(InfSaslContextSession, session);
+  if(!is_queued)
+    inf_sasl_context_session_free(session);
 }
 
 /**
@@ -1105,10 +1069,17 @@ inf_sasl_context_session_feed(InfSaslContextSession* session,
 
   session->stepping = TRUE;
 
-  g_async_queue_push(
-    session->session_queue,
-    inf_sasl_context_message_step(session, data, func, user_data)
-  );
+  g_assert(session->status == INF_SASL_CONTEXT_SESSION_OUTER);
+  session->step64 = data ? g_strdup(data) : NULL;
+  session->feed_func = func;
+  session->feed_user_data = user_data;
+  session->status = INF_SASL_CONTEXT_SESSION_INNER;
+
+  g_mutex_lock(&inf_sasl_context_pool_mutex);
+  ++session->n_queued;
+  g_mutex_unlock(&inf_sasl_context_pool_mutex);
+
+  _inf_async_operation_push_job(inf_sasl_context_step_func, session);
 }
 
 /**
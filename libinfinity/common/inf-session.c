@@ -114,6 +114,9 @@ struct _InfSessionPrivate {
 
   /* Group of subscribed connections */
   InfCommunicationGroup* subscription_group;
+  /* Messages for the subscription group that are held back, see
+   * inf_session_defer_to_subscriptions() */
+  GQueue deferred;
 
   union {
     /* INF_SESSION_PRESYNC */
@@ -457,6 +460,7 @@ inf_session_init(InfSession* session)
   priv->buffer = NULL;
   priv->user_table = NULL;
   priv->status = INF_SESSION_RUNNING;
+  g_queue_init(&priv->deferred);
 
   priv->shared.run.syncs = NULL;
 }
@@ -523,6 +527,8 @@ inf_session_dispose(GObject* object)
     inf_session_close(session);
   }
 
+  g_assert(g_queue_is_empty(&priv->deferred));
+
   g_object_unref(G_OBJECT(priv->user_table));
   priv->user_table = NULL;
 
@@ -1689,6 +1695,8 @@ inf_session_close_handler(InfSession* session)
 
   if(priv->subscription_group != NULL)
   {
+    inf_session_flush_subscriptions(session);
+
     g_object_unref(priv->subscription_group);
     priv->subscription_group = NULL;
 
@@ -1763,7 +1771,15 @@ inf_session_synchronization_begin_handler(InfSession* session,
 
   inf_communication_group_send_message(sync->group, connection, xml);
 
-  /* TODO: Add a function that can send multiple messages */
+  /* All messages are handed to the group at once, even though the
+   * registry only passes a few of them at a time to the connection, and
+   * only serializes them when it does so. Producing them lazily as the
+   * connection drains is not possible: requests made after this point are
+   * sent to the group and would overtake the remaining synchronization
+   * messages, and the messages must reflect the state of the session at
+   * sync-begin time, which is also what num-messages counts. The progress
+   * is reported as the registry actually sends the messages, see
+   * inf_session_communication_object_sent(). */
   for(xml = messages->children; xml != NULL; xml = next)
   {
     next = xml->next;
@@ -2842,7 +2858,11 @@ inf_session_set_subscription_group(InfSession* session,
   if(priv->subscription_group != group)
   {
     if(priv->subscription_group != NULL)
+    {
+      /* Deferred messages were meant for the previous group */
+      inf_session_flush_subscriptions(session);
       g_object_unref(priv->subscription_group);
+    }
 
     priv->subscription_group = group;
 
@@ -2874,7 +2894,77 @@ inf_session_send_to_subscriptions(InfSession* session,
   priv = INF_SESSION_PRIVATE(session);
   g_return_if_fail(priv->subscription_group != NULL);
 
+  inf_session_flush_subscriptions(session);
   inf_communication_group_send_group_message(priv->subscription_group, xml);
 }
 
+/**
+ * inf_session_defer_to_subscriptions:
+ * @session: A #InfSession.
+ * @xml: (transfer full): The message to send.
+ *
+ * Queues a XML message for the members of @session's subscription group,
+ * without sending it yet. Deferred messages are sent, in order, by the next
+ * call to inf_session_flush_subscriptions() or
+ * inf_session_send_to_subscriptions(), so that they always reach the group
+ * before any later message of the session. They are also sent when the
+ * subscription group changes or the session is closed.
+ *
+ * This allows to hand several messages to the network layer in one go, for
+ * example requests made in quick succession. Code that sends messages for
+ * the session's subscription group other than through @session, such as a
+ * session proxy, should call inf_session_flush_subscriptions() first. This
+ * function can only be called if the subscription group is non-%NULL. It
+ * takes ownership of @xml.
+ **/
+void
+inf_session_defer_to_subscriptions(InfSession* session,
+                                   xmlNodePtr xml)
+{
+  InfSessionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SESSION(session));
+  g_return_if_fail(xml != NULL);
+
+  priv = INF_SESSION_PRIVATE(session);
+  g_return_if_fail(priv->subscription_group != NULL);
+
+  g_queue_push_tail(&priv->deferred, xml);
+}
+
+/**
+ * inf_session_flush_subscriptions:
+ * @session: A #InfSession.
+ *
+ * Sends all messages queued with inf_session_defer_to_subscriptions() to
+ * @session's subscription group.
+ *
+ * Returns: %TRUE if there were deferred messages, or %FALSE otherwise.
+ **/
+gboolean
+inf_session_flush_subscriptions(InfSession* session)
+{
+  InfSessionPrivate* priv;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(INF_IS_SESSION(session), FALSE);
+  priv = INF_SESSION_PRIVATE(session);
+
+  if(g_queue_is_empty(&priv->deferred))
+    return FALSE;
+
+  g_assert(priv->subscription_group != NULL);
+  while(!g_queue_is_empty(&priv->deferred))
+  {
+    xml = g_queue_pop_head(&priv->deferred);
+
+    inf_communication_group_send_group_message(
+      priv->subscription_group,
+      xml
+    );
+  }
+
+  return TRUE;
+}
+
 /* vim:set et sw=2 ts=2: */
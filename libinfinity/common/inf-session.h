@@ -344,6 +344,13 @@ void
 inf_session_send_to_subscriptions(InfSession* session,
                                   xmlNodePtr xml);
 
+void
+inf_session_defer_to_subscriptions(InfSession* session,
+                                   xmlNodePtr xml);
+
+gboolean
+inf_session_flush_subscriptions(InfSession* session);
+
 G_END_DECLS
 
 #endif /* __INF_SESSION_H__ */
@@ -28,6 +28,12 @@
  * where a #InfXmlConnection is expected. Use
  * inf_simulated_connection_connect() to connect two such connections so that
  * data sent through one is received by the other.
+ *
+ * In %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, the connection can also
+ * simulate the conditions of a real network, with latency, jitter, limited
+ * bandwidth and batching of messages, see
+ * inf_simulated_connection_set_network_conditions(). This allows to test the
+ * behaviour of code using the connection under realistic conditions.
  */
 
 #include <libinfinity/common/inf-simulated-connection.h>
@@ -54,16 +60,36 @@ static const GEnumValue inf_simulated_connection_mode_values[] = {
   }
 };
 
+typedef struct _InfSimulatedConnectionMessage InfSimulatedConnectionMessage;
+struct _InfSimulatedConnectionMessage {
+  xmlNodePtr xml;
+  /* Monotonic time at which the message arrives at the target, in
+   * IO_CONTROLLED mode */
+  gint64 delivery_time;
+};
+
 typedef struct _InfSimulatedConnectionPrivate InfSimulatedConnectionPrivate;
 struct _InfSimulatedConnectionPrivate {
   InfIo* io;
   InfIoDispatch* io_handler;
+  InfIoTimeout* timeout;
 
   InfSimulatedConnection* target;
   InfSimulatedConnectionMode mode;
 
-  xmlNodePtr queue;
-  xmlNodePtr queue_last_item;
+  /* Network conditions */
+  guint latency;
+  guint jitter;
+  guint bandwidth;
+  guint batch_interval;
+
+  GRand* rand;
+  /* Time at which the simulated link has finished transmitting all queued
+   * messages, and delivery time of the last queued message. */
+  gint64 link_free_time;
+  gint64 last_delivery_time;
+
+  GQueue queue;
 };
 
 enum {
@@ -74,6 +100,11 @@ enum {
   PROP_TARGET,
   PROP_MODE,
 
+  PROP_LATENCY,
+  PROP_JITTER,
+  PROP_BANDWIDTH,
+  PROP_BATCH_INTERVAL,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -92,11 +123,9 @@ G_DEFINE_TYPE_WITH_CODE(InfSimulatedConnection, inf_simulated_connection, G_TYPE
   G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, inf_simulated_connection_xml_connection_iface_init))
 
 static void
-inf_simulated_connection_clear_queue(InfSimulatedConnection* connection)
+inf_simulated_connection_remove_handlers(InfSimulatedConnection* connection)
 {
   InfSimulatedConnectionPrivate* priv;
-  xmlNodePtr next;
-
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
   if(priv->io_handler != NULL)
@@ -107,14 +136,194 @@ inf_simulated_connection_clear_queue(InfSimulatedConnection* connection)
     priv->io_handler = NULL;
   }
 
-  while(priv->queue != NULL)
+  if(priv->timeout != NULL)
+  {
+    g_assert(priv->io != NULL);
+
+    inf_io_remove_timeout(priv->io, priv->timeout);
+    priv->timeout = NULL;
+  }
+}
+
+static void
+inf_simulated_connection_free_message(InfSimulatedConnectionMessage* message)
+{
+  xmlFreeNode(message->xml);
+  g_slice_free(InfSimulatedConnectionMessage, message);
+}
+
+static void
+inf_simulated_connection_clear_queue(InfSimulatedConnection* connection)
+{
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+  inf_simulated_connection_remove_handlers(connection);
+
+  while(!g_queue_is_empty(&priv->queue))
+  {
+    message = g_queue_pop_head(&priv->queue);
+    inf_simulated_connection_free_message(message);
+  }
+
+  priv->link_free_time = 0;
+  priv->last_delivery_time = 0;
+}
+
+/* Makes the target receive the first message in the queue. */
+static void
+inf_simulated_connection_deliver(InfSimulatedConnection* connection)
+{
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  /* Remove the message from the queue before emitting the signals, in case
+   * a signal handler closes the connection, which clears the queue. */
+  message = g_queue_pop_head(&priv->queue);
+
+  inf_xml_connection_sent(INF_XML_CONNECTION(connection), message->xml);
+
+  if(priv->target != NULL)
+  {
+    inf_xml_connection_received(
+      INF_XML_CONNECTION(priv->target),
+      message->xml
+    );
+  }
+
+  inf_simulated_connection_free_message(message);
+}
+
+/* Computes when a message of the given size that is sent now arrives at the
+ * target, according to the network conditions. Messages never overtake
+ * each other, like on a TCP connection. */
+static gint64
+inf_simulated_connection_get_delivery_time(InfSimulatedConnection* conn,
+                                           xmlNodePtr xml)
+{
+  InfSimulatedConnectionPrivate* priv;
+  xmlBufferPtr buffer;
+  gint64 now;
+  gint64 time;
+  gint64 interval;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(conn);
+  now = g_get_monotonic_time();
+
+  /* The message can only be put on the link when the previous ones have
+   * been transmitted. */
+  time = MAX(now, priv->link_free_time);
+  if(priv->bandwidth > 0)
+  {
+    buffer = xmlBufferCreate();
+    xmlNodeDump(buffer, NULL, xml, 0, 0);
+    time += (gint64)xmlBufferLength(buffer) * G_USEC_PER_SEC /
+      priv->bandwidth;
+    xmlBufferFree(buffer);
+  }
+
+  priv->link_free_time = time;
+
+  time += (gint64)priv->latency * 1000;
+  if(priv->jitter > 0)
+  {
+    if(priv->rand == NULL)
+      priv->rand = g_rand_new_with_seed(0);
+    time += (gint64)g_rand_int_range(priv->rand, 0, priv->jitter + 1) * 1000;
+  }
+
+  /* Messages arrive in batches, at multiples of the batch interval */
+  if(priv->batch_interval > 0)
   {
-    next = priv->queue->next;
-    xmlFreeNode(priv->queue);
-    priv->queue = next;
+    interval = (gint64)priv->batch_interval * 1000;
+    time = (time + interval - 1) / interval * interval;
   }
 
-  priv->queue_last_item = NULL;
+  time = MAX(time, priv->last_delivery_time);
+  priv->last_delivery_time = time;
+  return time;
+}
+
+static void
+inf_simulated_connection_schedule(InfSimulatedConnection* connection);
+
+static void
+inf_simulated_connection_dispatch_func(gpointer user_data)
+{
+  InfSimulatedConnection* connection;
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+  gint64 now;
+
+  connection = INF_SIMULATED_CONNECTION(user_data);
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  priv->io_handler = NULL;
+  priv->timeout = NULL;
+
+  g_object_ref(connection);
+
+  now = g_get_monotonic_time();
+  while(!g_queue_is_empty(&priv->queue))
+  {
+    message = g_queue_peek_head(&priv->queue);
+    if(message->delivery_time > now)
+      break;
+
+    inf_simulated_connection_deliver(connection);
+  }
+
+  /* Wait for the remaining messages to arrive, unless the connection was
+   * closed or the mode was changed by a signal handler. */
+  if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED &&
+     priv->io_handler == NULL && priv->timeout == NULL)
+  {
+    inf_simulated_connection_schedule(connection);
+  }
+
+  g_object_unref(connection);
+}
+
+/* Makes sure the first message in the queue is delivered when it is due. */
+static void
+inf_simulated_connection_schedule(InfSimulatedConnection* connection)
+{
+  InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+  gint64 now;
+
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+  g_assert(priv->io != NULL);
+  g_assert(priv->io_handler == NULL && priv->timeout == NULL);
+
+  if(g_queue_is_empty(&priv->queue))
+    return;
+
+  message = g_queue_peek_head(&priv->queue);
+  now = g_get_monotonic_time();
+
+  if(message->delivery_time <= now)
+  {
+    priv->io_handler = inf_io_add_dispatch(
+      priv->io,
+      inf_simulated_connection_dispatch_func,
+      connection,
+      NULL
+    );
+  }
+  else
+  {
+    priv->timeout = inf_io_add_timeout(
+      priv->io,
+      (message->delivery_time - now + 999) / 1000,
+      inf_simulated_connection_dispatch_func,
+      connection,
+      NULL
+    );
+  }
 }
 
 static void
@@ -185,8 +394,22 @@ inf_simulated_connection_init(InfSimulatedConnection* connection)
 
   priv->io = NULL;
 
+  priv->io_handler = NULL;
+  priv->timeout = NULL;
+
   priv->target = NULL;
   priv->mode = INF_SIMULATED_CONNECTION_IMMEDIATE;
+
+  priv->latency = 0;
+  priv->jitter = 0;
+  priv->bandwidth = 0;
+  priv->batch_interval = 0;
+
+  priv->rand = NULL;
+  priv->link_free_time = 0;
+  priv->last_delivery_time = 0;
+
+  g_queue_init(&priv->queue);
 }
 
 static void
@@ -199,7 +422,8 @@ inf_simulated_connection_dispose(GObject* object)
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
   inf_simulated_connection_unset_target(connection);
-  g_assert(priv->io_handler == NULL);
+  inf_simulated_connection_clear_queue(connection);
+  g_assert(priv->io_handler == NULL && priv->timeout == NULL);
 
   if(priv->io != NULL)
   {
@@ -210,6 +434,18 @@ inf_simulated_connection_dispose(GObject* object)
   G_OBJECT_CLASS(inf_simulated_connection_parent_class)->dispose(object);
 }
 
+static void
+inf_simulated_connection_finalize(GObject* object)
+{
+  InfSimulatedConnectionPrivate* priv;
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(object);
+
+  if(priv->rand != NULL)
+    g_rand_free(priv->rand);
+
+  G_OBJECT_CLASS(inf_simulated_connection_parent_class)->finalize(object);
+}
+
 static void
 inf_simulated_connection_set_property(GObject* object,
                                       guint prop_id,
@@ -239,6 +475,18 @@ inf_simulated_connection_set_property(GObject* object,
   case PROP_MODE:
     inf_simulated_connection_set_mode(sim, g_value_get_enum(value));
     break;
+  case PROP_LATENCY:
+    priv->latency = g_value_get_uint(value);
+    break;
+  case PROP_JITTER:
+    priv->jitter = g_value_get_uint(value);
+    break;
+  case PROP_BANDWIDTH:
+    priv->bandwidth = g_value_get_uint(value);
+    break;
+  case PROP_BATCH_INTERVAL:
+    priv->batch_interval = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -269,6 +517,18 @@ inf_simulated_connection_get_property(GObject* object,
   case PROP_MODE:
     g_value_set_enum(value, priv->mode);
     break;
+  case PROP_LATENCY:
+    g_value_set_uint(value, priv->latency);
+    break;
+  case PROP_JITTER:
+    g_value_set_uint(value, priv->jitter);
+    break;
+  case PROP_BANDWIDTH:
+    g_value_set_uint(value, priv->bandwidth);
+    break;
+  case PROP_BATCH_INTERVAL:
+    g_value_set_uint(value, priv->batch_interval);
+    break;
   case PROP_STATUS:
     if(priv->target != NULL)
       g_value_set_enum(value, INF_XML_CONNECTION_OPEN);
@@ -314,24 +574,13 @@ inf_simulated_connection_xml_connection_close(InfXmlConnection* connection)
   inf_simulated_connection_unset_target(INF_SIMULATED_CONNECTION(connection));
 }
 
-static void
-inf_simulated_connection_dispatch_func(gpointer user_data)
-{
-  InfSimulatedConnection* connection;
-  InfSimulatedConnectionPrivate* priv;
-
-  connection = INF_SIMULATED_CONNECTION(user_data);
-  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
-
-  priv->io_handler = NULL;
-  inf_simulated_connection_flush(connection);
-}
-
 static void
 inf_simulated_connection_xml_connection_send(InfXmlConnection* connection,
                                              xmlNodePtr xml)
 {
   InfSimulatedConnectionPrivate* priv;
+  InfSimulatedConnectionMessage* message;
+
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
 
   g_assert(priv->target != NULL);
@@ -346,30 +595,29 @@ inf_simulated_connection_xml_connection_send(InfXmlConnection* connection,
   case INF_SIMULATED_CONNECTION_DELAYED:
   case INF_SIMULATED_CONNECTION_IO_CONTROLLED:
     xmlUnlinkNode(xml);
-    if(priv->queue == NULL)
-    {
-      priv->queue = xml;
-      priv->queue_last_item = xml;
-    }
-    else
+
+    message = g_slice_new(InfSimulatedConnectionMessage);
+    message->xml = xml;
+    message->delivery_time = 0;
+
+    if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED)
     {
-      priv->queue_last_item->next = xml;
-      priv->queue_last_item = xml;
+      message->delivery_time = inf_simulated_connection_get_delivery_time(
+        INF_SIMULATED_CONNECTION(connection),
+        xml
+      );
     }
 
-    if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED)
+    g_queue_push_tail(&priv->queue, message);
+
+    /* If there are other messages in the queue, then the first one is
+     * already scheduled, and this one is delivered after it. */
+    if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED &&
+       priv->io_handler == NULL && priv->timeout == NULL)
     {
-      if(priv->io_handler == NULL)
-      {
-        g_assert(priv->io != NULL);
-
-        priv->io_handler = inf_io_add_dispatch(
-          priv->io,
-          inf_simulated_connection_dispatch_func,
-          connection,
-          NULL
-        );
-      }
+      inf_simulated_connection_schedule(
+        INF_SIMULATED_CONNECTION(connection)
+      );
     }
 
     break;
@@ -391,6 +639,7 @@ inf_simulated_connection_class_init(
   object_class = G_OBJECT_CLASS(connection_class);
 
   object_class->dispose = inf_simulated_connection_dispose;
+  object_class->finalize = inf_simulated_connection_finalize;
   object_class->set_property = inf_simulated_connection_set_property;
   object_class->get_property = inf_simulated_connection_get_property;
 
@@ -431,6 +680,66 @@ inf_simulated_connection_class_init(
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_LATENCY,
+    g_param_spec_uint(
+      "latency",
+      "Latency",
+      "Time in milliseconds it takes a message to reach the target in "
+      "IO_CONTROLLED mode",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_JITTER,
+    g_param_spec_uint(
+      "jitter",
+      "Jitter",
+      "Maximum random time in milliseconds that is added to the latency "
+      "of each message",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BANDWIDTH,
+    g_param_spec_uint(
+      "bandwidth",
+      "Bandwidth",
+      "Number of bytes per second that can be transmitted in IO_CONTROLLED "
+      "mode, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BATCH_INTERVAL,
+    g_param_spec_uint(
+      "batch-interval",
+      "Batch interval",
+      "Interval in milliseconds at which messages are delivered together "
+      "in IO_CONTROLLED mode, or 0 to deliver each message on its own",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -538,7 +847,10 @@ inf_simulated_connection_connect(InfSimulatedConnection* connection,
  *
  * In %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode, messages are queued and
  * received by the target as soon as a dispatch handler (see
- * inf_io_add_dispatch()) installed on the main loop is called.
+ * inf_io_add_dispatch()) installed on the main loop is called, or, if
+ * network conditions have been set with
+ * inf_simulated_connection_set_network_conditions(), by a timeout once the
+ * simulated transmission has finished.
  *
  * When changing the mode from %INF_SIMULATED_CONNECTION_DELAYED or
  * %INF_SIMULATED_CONNECTION_IO_CONTROLLED to
@@ -558,6 +870,8 @@ inf_simulated_connection_set_mode(InfSimulatedConnection* connection,
   {
     if(mode == INF_SIMULATED_CONNECTION_IMMEDIATE)
       inf_simulated_connection_flush(connection);
+    else if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED)
+      inf_simulated_connection_remove_handlers(connection);
 
     priv->mode = mode;
     g_object_notify(G_OBJECT(connection), "mode");
@@ -576,40 +890,87 @@ void
 inf_simulated_connection_flush(InfSimulatedConnection* connection)
 {
   InfSimulatedConnectionPrivate* priv;
-  xmlNodePtr next;
 
   priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
   g_return_if_fail(priv->target != NULL);
 
-  if(priv->mode == INF_SIMULATED_CONNECTION_IO_CONTROLLED)
-  {
-    g_assert(priv->io != NULL);
+  inf_simulated_connection_remove_handlers(connection);
 
-    if(priv->io_handler != NULL)
-    {
-      inf_io_remove_dispatch(priv->io, priv->io_handler);
-      priv->io_handler = NULL;
-    }
+  while(!g_queue_is_empty(&priv->queue))
+    inf_simulated_connection_deliver(connection);
+
+  /* Messages that are sent later can be delivered right away */
+  priv->link_free_time = 0;
+  priv->last_delivery_time = 0;
+}
+
+/**
+ * inf_simulated_connection_set_network_conditions:
+ * @connection: A #InfSimulatedConnection.
+ * @latency: Time in milliseconds it takes for a message to arrive.
+ * @jitter: Maximum random time in milliseconds that is added to @latency.
+ * @bandwidth: Number of bytes per second that can be transmitted, or 0.
+ * @batch_interval: Interval in milliseconds at which messages arrive, or 0.
+ *
+ * Sets the network conditions that are simulated in
+ * %INF_SIMULATED_CONNECTION_IO_CONTROLLED mode. A message sent through
+ * @connection is first transmitted with the given @bandwidth, after all
+ * previously sent messages have been transmitted, and then arrives at the
+ * target after @latency plus a random time of up to @jitter milliseconds.
+ * If @batch_interval is not 0, then messages only arrive at multiples of
+ * @batch_interval, so that messages which become due within one interval
+ * are received together. Messages are always received in the order in which
+ * they were sent.
+ *
+ * The new conditions only apply to messages that are sent after this call.
+ * They only apply for the direction from @connection to its target, so to
+ * simulate a symmetric network, call this function for both connections.
+ * With all values set to 0, which is the default, messages are delivered as
+ * soon as the main loop regains control.
+ *
+ * The random jitter is generated with a fixed seed, so that a test run is
+ * reproducible for the same sequence of messages and timing.
+ */
+void
+inf_simulated_connection_set_network_conditions(
+  InfSimulatedConnection* connection,
+  guint latency,
+  guint jitter,
+  guint bandwidth,
+  guint batch_interval)
+{
+  InfSimulatedConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SIMULATED_CONNECTION(connection));
+  priv = INF_SIMULATED_CONNECTION_PRIVATE(connection);
+
+  g_object_freeze_notify(G_OBJECT(connection));
+
+  if(priv->latency != latency)
+  {
+    priv->latency = latency;
+    g_object_notify(G_OBJECT(connection), "latency");
   }
 
-  while(priv->queue != NULL)
+  if(priv->jitter != jitter)
   {
-    inf_xml_connection_sent(
-      INF_XML_CONNECTION(connection),
-      priv->queue
-    );
+    priv->jitter = jitter;
+    g_object_notify(G_OBJECT(connection), "jitter");
+  }
 
-    inf_xml_connection_received(
-      INF_XML_CONNECTION(priv->target),
-      priv->queue
-    );
+  if(priv->bandwidth != bandwidth)
+  {
+    priv->bandwidth = bandwidth;
+    g_object_notify(G_OBJECT(connection), "bandwidth");
+  }
 
-    next = priv->queue->next;
-    xmlFreeNode(priv->queue);
-    priv->queue = next;
+  if(priv->batch_interval != batch_interval)
+  {
+    priv->batch_interval = batch_interval;
+    g_object_notify(G_OBJECT(connection), "batch-interval");
   }
 
-  priv->queue_last_item = NULL;
+  g_object_thaw_notify(G_OBJECT(connection));
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -103,6 +103,14 @@ inf_simulated_connection_set_mode(InfSimulatedConnection* connection,
 void
 inf_simulated_connection_flush(InfSimulatedConnection* connection);
 
+void
+inf_simulated_connection_set_network_conditions(
+  InfSimulatedConnection* connection,
+  guint latency,
+  guint jitter,
+  guint bandwidth,
+  guint batch_interval);
+
 G_END_DECLS
 
 #endif /* __INF_SIMULATED_CONNECTION_H__ */
@@ -37,12 +37,37 @@
  * instead which implements the #InfIo interface. For the GTK+ toolkit, there
  * is #InfGtkIo in the libinfgtk library, to integrate with the Glib main
  * loop.
+ *
+ * On Unix-like systems, the mechanism used to wait for socket events can be
+ * chosen with the #InfStandaloneIo:backend property. By default, epoll is
+ * used on Linux and kqueue on BSD and Mac OS X, so that the cost of one
+ * iteration only depends on the number of sockets that are ready, not on
+ * the total number of sockets watched. poll() is used as a fallback if
+ * neither is available. On Windows, WSAPoll() is used, so that the number of
+ * sockets is not limited to the 64 events WSAWaitForMultipleEvents() can
+ * wait for.
+ *
+ * Setting the #InfStandaloneIo:busy-poll property makes the loop check for
+ * events without blocking for a short while before it goes to sleep. This
+ * trades CPU time for latency when new events typically arrive shortly
+ * after the previous ones.
  */
 
+/* For WSAPoll() */
+#ifdef _WIN32
+# if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+#  undef _WIN32_WINNT
+#  define _WIN32_WINNT 0x0600
+# endif
+#endif
+
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
+#include <libinfinity/common/inf-io-private.h>
+#include <libinfinity/inf-define-enum.h>
+#include <libinfinity/inf-trace.h>
 
-/* TODO: Modularize the FD handling, then add epoll support */
+#include "config.h"
 
 #ifdef G_OS_WIN32
 # include <winsock2.h>
@@ -50,38 +75,85 @@
 # include <poll.h>
 # include <errno.h>
 # include <unistd.h>
+# ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+# endif
+# ifdef HAVE_EVENTFD
+#  include <sys/eventfd.h>
+#  include <stdint.h>
+# endif
+# ifdef HAVE_KQUEUE
+#  include <sys/types.h>
+#  include <sys/event.h>
+#  include <sys/time.h>
+# endif
 #endif /* !G_OS_WIN32 */
 
 #include <string.h>
 
 #ifdef G_OS_WIN32
-typedef WSAEVENT InfStandaloneIoNativeEvent;
-typedef DWORD InfStandaloneIoPollTimeout;
-typedef DWORD InfStandaloneIoPollResult;
-static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT =
-  WSA_WAIT_TIMEOUT;
-static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE =
-  WSA_INFINITE;
-#define inf_standalone_io_poll(events, num_events, timeout) \
-  ((num_events) == 0 ? \
-    (Sleep(timeout), WSA_WAIT_TIMEOUT) : \
-    (WSAWaitForMultipleEvents(num_events, events, FALSE, timeout, TRUE)))
+typedef WSAPOLLFD InfStandaloneIoNativeEvent;
 #else
 typedef struct pollfd InfStandaloneIoNativeEvent;
+#endif
+
 typedef int InfStandaloneIoPollTimeout;
 typedef int InfStandaloneIoPollResult;
 static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT = 0;
 static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE = -1;
-#define inf_standalone_io_poll(events, num_events, timeout) \
-  (poll(events, (nfds_t)num_events, timeout))
+#define inf_standalone_io_poll(priv, timeout) \
+  ((priv)->funcs->wait((priv), (timeout)))
+
+#ifndef G_OS_WIN32
+/* Maximum number of events retrieved from the kernel with one epoll_wait()
+ * or kevent() call. Events not processed in one iteration are kept for the
+ * following iterations. */
+#define INF_STANDALONE_IO_MAX_READY 64
 #endif
 
+/* Maximum number of dispatches run in one iteration */
+#define INF_STANDALONE_IO_DISPATCH_BATCH_SIZE 64
+
+/* Maximum number of iterations in a row that do not check for socket
+ * events because dispatches or elapsed timeouts are pending */
+#define INF_STANDALONE_IO_MAX_POLL_SKIPS 8
+
+static const GEnumValue inf_standalone_io_backend_values[] = {
+  {
+    INF_STANDALONE_IO_BACKEND_AUTO,
+    "INF_STANDALONE_IO_BACKEND_AUTO",
+    "auto"
+  }, {
+    INF_STANDALONE_IO_BACKEND_POLL,
+    "INF_STANDALONE_IO_BACKEND_POLL",
+    "poll"
+  }, {
+    INF_STANDALONE_IO_BACKEND_EPOLL,
+    "INF_STANDALONE_IO_BACKEND_EPOLL",
+    "epoll"
+  }, {
+    INF_STANDALONE_IO_BACKEND_KQUEUE,
+    "INF_STANDALONE_IO_BACKEND_KQUEUE",
+    "kqueue"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
 struct _InfIoWatch {
   /* TODO: Do we actually need this? We can access the event by
    * priv->events[watchindex+1]. */
   InfStandaloneIoNativeEvent* event;
 
   InfNativeSocket* socket;
+#ifndef G_OS_WIN32
+  /* The file descriptor as it was when the watch was added, since the
+   * socket might already be closed when the watch is removed. */
+  int fd;
+#endif
+  InfIoEvent events;
   InfIoWatchFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -93,20 +165,46 @@ struct _InfIoWatch {
 };
 
 struct _InfIoTimeout {
-  GTimeVal begin;
-  guint msecs;
+  /* Monotonic time at which the timeout elapses, in microseconds */
+  gint64 expiration;
+  /* Position in the timeout heap, or G_MAXUINT if not in the heap */
+  guint heap_index;
   InfIoTimeoutFunc func;
   gpointer user_data;
   GDestroyNotify notify;
 };
 
-struct _InfIoDispatch {
-  InfIoDispatchFunc func;
-  gpointer user_data;
-  GDestroyNotify notify;
+typedef struct _InfStandaloneIoPrivate InfStandaloneIoPrivate;
+
+/* The operations an event backend needs to provide. The pollfd array in
+ * the private struct is always kept up to date, so that the poll backend
+ * does not need to do anything when watches change. The other backends
+ * mirror watch changes into a kernel object. All functions except wait
+ * are called with the mutex locked. */
+typedef struct _InfStandaloneIoBackendFuncs InfStandaloneIoBackendFuncs;
+struct _InfStandaloneIoBackendFuncs {
+  gboolean (*open)(InfStandaloneIoPrivate* priv);
+  void (*close)(InfStandaloneIoPrivate* priv);
+
+  gboolean (*add)(InfStandaloneIoPrivate* priv,
+                  InfIoWatch* watch);
+  void (*modify)(InfStandaloneIoPrivate* priv,
+                 InfIoWatch* watch,
+                 InfIoEvent old_events);
+  void (*remove)(InfStandaloneIoPrivate* priv,
+                 InfIoWatch* watch);
+
+  /* Returns whether there are events left from a previous wait call */
+  gboolean (*pending)(InfStandaloneIoPrivate* priv);
+  int (*wait)(InfStandaloneIoPrivate* priv,
+              int timeout);
+  /* Returns the next event from the previous wait call. watch is set to
+   * NULL for the wakeup pipe. */
+  gboolean (*next)(InfStandaloneIoPrivate* priv,
+                   InfIoWatch** watch,
+                   InfIoEvent* events);
 };
 
-typedef struct _InfStandaloneIoPrivate InfStandaloneIoPrivate;
 struct _InfStandaloneIoPrivate {
   InfStandaloneIoNativeEvent* events;
   GMutex mutex;
@@ -117,55 +215,918 @@ struct _InfStandaloneIoPrivate {
   /* this array has fd_size-1 entries and fd_alloc-1 allocations: */
   InfIoWatch** watches;
 
-  GList* timeouts;
-  GList* dispatchs;
+  /* Binary min-heap of InfIoTimeout*, ordered by expiration time */
+  GPtrArray* timeouts;
+  /* The timeouts in the heap. This allows to check whether a timeout is
+   * still pending without dereferencing it, since it is freed once it has
+   * elapsed. */
+  GHashTable* timeout_set;
+  InfIoDispatchQueue dispatchs;
+
+  InfStandaloneIoBackend backend;
+
+  /* If eventfd is available, both entries are the same eventfd. On
+   * Windows, both are the same UDP socket, connected to itself, since
+   * WSAPoll() cannot wait for anything else. */
+  InfNativeSocket wakeup_pipe[2];
+
+  const InfStandaloneIoBackendFuncs* funcs;
 
 #ifndef G_OS_WIN32
-  int wakeup_pipe[2];
+  /* epoll or kqueue file descriptor, and a fd -> InfIoWatch* map to find
+   * the watch for a reported event. */
+  int backend_fd;
+  GHashTable* fd_table;
 #endif
 
+  /* Events returned by the last wait call: struct epoll_event or struct
+   * kevent for the epoll or kqueue backend, respectively. For the poll
+   * backend, ready_index is the position in the pollfd array. */
+  gpointer ready;
+  guint n_ready;
+  guint ready_index;
+
   gboolean polling;
   gboolean loop_running;
-};
 
-#ifdef G_OS_WIN32
-/* Mapping between WSAEventSelect's FD_ flags and libinfinity's
- * INF_IO flags */
-typedef struct _InfStandaloneIoEventTableEntry InfStandaloneIoEventTableEntry;
-struct _InfStandaloneIoEventTableEntry {
-  guint flag_val;
-  guint flag_bit;
-  guint io_val;
+  guint busy_poll;
+  guint poll_skips;
+
+  gboolean collect_statistics;
+  InfStandaloneIoHistogram statistics[INF_STANDALONE_IO_N_STATISTICS];
 };
 
-static const InfStandaloneIoEventTableEntry inf_standalone_io_event_table[] =
-  {
-    { FD_READ,    FD_READ_BIT,    INF_IO_INCOMING },
-    { FD_CLOSE,   FD_CLOSE_BIT,   INF_IO_INCOMING },
-    { FD_ACCEPT,  FD_ACCEPT_BIT,  INF_IO_INCOMING },
-    { FD_WRITE,   FD_WRITE_BIT,   INF_IO_OUTGOING },
-    { FD_CONNECT, FD_CONNECT_BIT, INF_IO_OUTGOING }
-  };
-#endif
+enum {
+  PROP_0,
+
+  PROP_BACKEND,
+  PROP_BUSY_POLL,
+  PROP_COLLECT_STATISTICS
+};
 
 #define INF_STANDALONE_IO_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_STANDALONE_IO, InfStandaloneIoPrivate))
 
 static void inf_standalone_io_io_iface_init(InfIoInterface* iface);
+INF_DEFINE_ENUM_TYPE(InfStandaloneIoBackend, inf_standalone_io_backend, inf_standalone_io_backend_values)
 G_DEFINE_TYPE_WITH_CODE(InfStandaloneIo, inf_standalone_io, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfStandaloneIo)
   G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_standalone_io_io_iface_init))
 
-static guint
-inf_standalone_io_timeval_diff(GTimeVal* first,
-                               GTimeVal* second)
+static short
+inf_standalone_io_events_to_poll(InfIoEvent events)
+{
+  short pevents;
+
+  pevents = 0;
+#ifdef G_OS_WIN32
+  /* WSAPoll() fails with WSAEINVAL for any other flags. Errors are
+   * reported regardless. */
+  if(events & INF_IO_INCOMING)
+    pevents |= POLLRDNORM;
+  if(events & INF_IO_OUTGOING)
+    pevents |= POLLWRNORM;
+#else
+  if(events & INF_IO_INCOMING)
+    pevents |= POLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= POLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#endif
+
+  return pevents;
+}
+
+/*
+ * poll() backend, using WSAPoll() on Windows
+ */
+
+static gboolean
+inf_standalone_io_poll_open(InfStandaloneIoPrivate* priv)
+{
+  priv->ready_index = 0;
+  return TRUE;
+}
+
+static void
+inf_standalone_io_poll_close(InfStandaloneIoPrivate* priv)
+{
+}
+
+static gboolean
+inf_standalone_io_poll_add(InfStandaloneIoPrivate* priv,
+                           InfIoWatch* watch)
+{
+  /* The pollfd array is already set up */
+  return TRUE;
+}
+
+static void
+inf_standalone_io_poll_modify(InfStandaloneIoPrivate* priv,
+                              InfIoWatch* watch,
+                              InfIoEvent old_events)
+{
+}
+
+static void
+inf_standalone_io_poll_remove(InfStandaloneIoPrivate* priv,
+                              InfIoWatch* watch)
+{
+}
+
+static gboolean
+inf_standalone_io_poll_pending(InfStandaloneIoPrivate* priv)
+{
+  /* The pollfd array might change between iterations, so we always poll
+   * again instead of remembering previous results. */
+  return FALSE;
+}
+
+static int
+inf_standalone_io_poll_wait(InfStandaloneIoPrivate* priv,
+                            int timeout)
+{
+  priv->ready_index = 0;
+#ifdef G_OS_WIN32
+  return WSAPoll(priv->events, (ULONG)priv->fd_size, timeout);
+#else
+  return poll(priv->events, (nfds_t)priv->fd_size, timeout);
+#endif
+}
+
+static gboolean
+inf_standalone_io_poll_next(InfStandaloneIoPrivate* priv,
+                            InfIoWatch** watch,
+                            InfIoEvent* events)
+{
+  guint i;
+  short revents;
+
+  for(i = priv->ready_index; i < priv->fd_size; ++i)
+  {
+    revents = priv->events[i].revents;
+    if(revents != 0)
+    {
+      *events = 0;
+      if(revents & POLLIN)
+        *events |= INF_IO_INCOMING;
+      if(revents & POLLOUT)
+        *events |= INF_IO_OUTGOING;
+      /* We treat POLLPRI as error because it should not occur in
+       * infinote. */
+      if(revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
+        *events |= INF_IO_ERROR;
+
+      priv->events[i].revents = 0;
+      priv->ready_index = i + 1;
+
+      if(i == 0)
+        *watch = NULL;
+      else
+        *watch = priv->watches[i - 1];
+
+      return TRUE;
+    }
+  }
+
+  priv->ready_index = priv->fd_size;
+  return FALSE;
+}
+
+static const InfStandaloneIoBackendFuncs inf_standalone_io_poll_funcs = {
+  inf_standalone_io_poll_open,
+  inf_standalone_io_poll_close,
+  inf_standalone_io_poll_add,
+  inf_standalone_io_poll_modify,
+  inf_standalone_io_poll_remove,
+  inf_standalone_io_poll_pending,
+  inf_standalone_io_poll_wait,
+  inf_standalone_io_poll_next
+};
+
+/*
+ * Shared between the epoll and kqueue backends
+ */
+
+#if defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
+static gboolean
+inf_standalone_io_ready_pending(InfStandaloneIoPrivate* priv)
+{
+  return priv->ready_index < priv->n_ready;
+}
+
+/* Maps a file descriptor reported by the kernel to the watch for it. The
+ * watch for a reported descriptor might have been removed, or even been
+ * replaced by another one, while we were waiting, since watches can be
+ * removed from other threads. Looking up by descriptor instead of storing
+ * a pointer to the watch in the kernel object makes this safe: the worst
+ * case is a spurious event, which the socket code needs to handle anyway.
+ * Returns FALSE if the event is stale. */
+static gboolean
+inf_standalone_io_ready_lookup(InfStandaloneIoPrivate* priv,
+                               int fd,
+                               InfIoWatch** watch,
+                               InfIoEvent* events)
+{
+  if(fd == priv->wakeup_pipe[0])
+  {
+    *watch = NULL;
+    return TRUE;
+  }
+
+  *watch = g_hash_table_lookup(priv->fd_table, GINT_TO_POINTER(fd));
+  if(*watch == NULL) return FALSE;
+
+  /* Filter out events the watch is no longer interested in */
+  *events &= ((*watch)->events | INF_IO_ERROR);
+  return *events != 0;
+}
+#endif
+
+/*
+ * epoll backend
+ */
+
+#ifdef HAVE_EPOLL
+static guint32
+inf_standalone_io_events_to_epoll(InfIoEvent events)
+{
+  guint32 eevents;
+
+  /* EPOLLERR and EPOLLHUP are always reported */
+  eevents = 0;
+  if(events & INF_IO_INCOMING)
+    eevents |= EPOLLIN;
+  if(events & INF_IO_OUTGOING)
+    eevents |= EPOLLOUT;
+  if(events & INF_IO_ERROR)
+    eevents |= EPOLLPRI;
+
+  return eevents;
+}
+
+static gboolean
+inf_standalone_io_epoll_open(InfStandaloneIoPrivate* priv)
+{
+  struct epoll_event event;
+
+  priv->backend_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(priv->backend_fd == -1)
+  {
+    g_warning("epoll_create1() failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = priv->wakeup_pipe[0];
+
+  if(epoll_ctl(priv->backend_fd, EPOLL_CTL_ADD, priv->wakeup_pipe[0],
+               &event) == -1)
+  {
+    g_warning("epoll_ctl() failed for wakeup pipe: %s", strerror(errno));
+    close(priv->backend_fd);
+    priv->backend_fd = -1;
+    return FALSE;
+  }
+
+  priv->fd_table = g_hash_table_new(NULL, NULL);
+  priv->ready =
+    g_malloc(sizeof(struct epoll_event) * INF_STANDALONE_IO_MAX_READY);
+  priv->n_ready = 0;
+  priv->ready_index = 0;
+  return TRUE;
+}
+
+static void
+inf_standalone_io_epoll_close(InfStandaloneIoPrivate* priv)
+{
+  if(close(priv->backend_fd) == -1)
+    g_warning("Failed to close epoll descriptor: %s", strerror(errno));
+
+  g_hash_table_destroy(priv->fd_table);
+  g_free(priv->ready);
+
+  priv->backend_fd = -1;
+  priv->fd_table = NULL;
+  priv->ready = NULL;
+}
+
+static gboolean
+inf_standalone_io_epoll_add(InfStandaloneIoPrivate* priv,
+                            InfIoWatch* watch)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = inf_standalone_io_events_to_epoll(watch->events);
+  event.data.fd = watch->fd;
+
+  if(epoll_ctl(priv->backend_fd, EPOLL_CTL_ADD, watch->fd, &event) == -1)
+  {
+    g_warning("epoll_ctl() failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  g_hash_table_insert(priv->fd_table, GINT_TO_POINTER(watch->fd), watch);
+  return TRUE;
+}
+
+static void
+inf_standalone_io_epoll_modify(InfStandaloneIoPrivate* priv,
+                               InfIoWatch* watch,
+                               InfIoEvent old_events)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = inf_standalone_io_events_to_epoll(watch->events);
+  event.data.fd = watch->fd;
+
+  if(epoll_ctl(priv->backend_fd, EPOLL_CTL_MOD, watch->fd, &event) == -1)
+    g_warning("epoll_ctl() failed: %s", strerror(errno));
+}
+
+static void
+inf_standalone_io_epoll_remove(InfStandaloneIoPrivate* priv,
+                               InfIoWatch* watch)
+{
+  struct epoll_event event;
+
+  /* A non-NULL event is required by kernels before 2.6.9. If the socket
+   * has already been closed, the kernel has removed it from the epoll set
+   * automatically, so do not complain about EBADF or ENOENT. */
+  if(epoll_ctl(priv->backend_fd, EPOLL_CTL_DEL, watch->fd, &event) == -1)
+    if(errno != EBADF && errno != ENOENT)
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+
+  g_hash_table_remove(priv->fd_table, GINT_TO_POINTER(watch->fd));
+}
+
+static int
+inf_standalone_io_epoll_wait(InfStandaloneIoPrivate* priv,
+                             int timeout)
+{
+  int result;
+
+  result = epoll_wait(
+    priv->backend_fd,
+    priv->ready,
+    INF_STANDALONE_IO_MAX_READY,
+    timeout
+  );
+
+  priv->n_ready = (result > 0) ? result : 0;
+  priv->ready_index = 0;
+  return result;
+}
+
+static gboolean
+inf_standalone_io_epoll_next(InfStandaloneIoPrivate* priv,
+                             InfIoWatch** watch,
+                             InfIoEvent* events)
+{
+  struct epoll_event* event;
+
+  while(priv->ready_index < priv->n_ready)
+  {
+    event = &((struct epoll_event*)priv->ready)[priv->ready_index++];
+
+    *events = 0;
+    if(event->events & EPOLLIN)
+      *events |= INF_IO_INCOMING;
+    if(event->events & EPOLLOUT)
+      *events |= INF_IO_OUTGOING;
+    if(event->events & (EPOLLERR | EPOLLHUP | EPOLLPRI))
+      *events |= INF_IO_ERROR;
+
+    if(inf_standalone_io_ready_lookup(priv, event->data.fd, watch, events))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static const InfStandaloneIoBackendFuncs inf_standalone_io_epoll_funcs = {
+  inf_standalone_io_epoll_open,
+  inf_standalone_io_epoll_close,
+  inf_standalone_io_epoll_add,
+  inf_standalone_io_epoll_modify,
+  inf_standalone_io_epoll_remove,
+  inf_standalone_io_ready_pending,
+  inf_standalone_io_epoll_wait,
+  inf_standalone_io_epoll_next
+};
+#endif /* HAVE_EPOLL */
+
+/*
+ * kqueue backend
+ */
+
+#ifdef HAVE_KQUEUE
+/* Registers or unregisters the read and write filters of watch so that they
+ * match new_events, given that old_events are currently registered. */
+static gboolean
+inf_standalone_io_kqueue_change(InfStandaloneIoPrivate* priv,
+                                InfIoWatch* watch,
+                                InfIoEvent old_events,
+                                InfIoEvent new_events)
+{
+  struct kevent changes[2];
+  int n_changes;
+  int result;
+
+  n_changes = 0;
+
+  if((old_events ^ new_events) & INF_IO_INCOMING)
+  {
+    EV_SET(
+      &changes[n_changes++],
+      watch->fd,
+      EVFILT_READ,
+      (new_events & INF_IO_INCOMING) ? EV_ADD : EV_DELETE,
+      0,
+      0,
+      NULL
+    );
+  }
+
+  if((old_events ^ new_events) & INF_IO_OUTGOING)
+  {
+    EV_SET(
+      &changes[n_changes++],
+      watch->fd,
+      EVFILT_WRITE,
+      (new_events & INF_IO_OUTGOING) ? EV_ADD : EV_DELETE,
+      0,
+      0,
+      NULL
+    );
+  }
+
+  if(n_changes == 0)
+    return TRUE;
+
+  result = kevent(priv->backend_fd, changes, n_changes, NULL, 0, NULL);
+  if(result == -1)
+  {
+    /* Filters of closed sockets are removed by the kernel automatically */
+    if(new_events != 0 || (errno != EBADF && errno != ENOENT))
+      g_warning("kevent() failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_standalone_io_kqueue_open(InfStandaloneIoPrivate* priv)
+{
+  struct kevent change;
+
+  priv->backend_fd = kqueue();
+  if(priv->backend_fd == -1)
+  {
+    g_warning("kqueue() failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  EV_SET(&change, priv->wakeup_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+  if(kevent(priv->backend_fd, &change, 1, NULL, 0, NULL) == -1)
+  {
+    g_warning("kevent() failed for wakeup pipe: %s", strerror(errno));
+    close(priv->backend_fd);
+    priv->backend_fd = -1;
+    return FALSE;
+  }
+
+  priv->fd_table = g_hash_table_new(NULL, NULL);
+  priv->ready = g_malloc(sizeof(struct kevent) * INF_STANDALONE_IO_MAX_READY);
+  priv->n_ready = 0;
+  priv->ready_index = 0;
+  return TRUE;
+}
+
+static void
+inf_standalone_io_kqueue_close(InfStandaloneIoPrivate* priv)
+{
+  if(close(priv->backend_fd) == -1)
+    g_warning("Failed to close kqueue descriptor: %s", strerror(errno));
+
+  g_hash_table_destroy(priv->fd_table);
+  g_free(priv->ready);
+
+  priv->backend_fd = -1;
+  priv->fd_table = NULL;
+  priv->ready = NULL;
+}
+
+static gboolean
+inf_standalone_io_kqueue_add(InfStandaloneIoPrivate* priv,
+                             InfIoWatch* watch)
+{
+  if(!inf_standalone_io_kqueue_change(priv, watch, 0, watch->events))
+    return FALSE;
+
+  g_hash_table_insert(priv->fd_table, GINT_TO_POINTER(watch->fd), watch);
+  return TRUE;
+}
+
+static void
+inf_standalone_io_kqueue_modify(InfStandaloneIoPrivate* priv,
+                                InfIoWatch* watch,
+                                InfIoEvent old_events)
+{
+  inf_standalone_io_kqueue_change(priv, watch, old_events, watch->events);
+}
+
+static void
+inf_standalone_io_kqueue_remove(InfStandaloneIoPrivate* priv,
+                                InfIoWatch* watch)
+{
+  inf_standalone_io_kqueue_change(priv, watch, watch->events, 0);
+  g_hash_table_remove(priv->fd_table, GINT_TO_POINTER(watch->fd));
+}
+
+static int
+inf_standalone_io_kqueue_wait(InfStandaloneIoPrivate* priv,
+                              int timeout)
+{
+  struct timespec timespec;
+  int result;
+
+  if(timeout >= 0)
+  {
+    timespec.tv_sec = timeout / 1000;
+    timespec.tv_nsec = (timeout % 1000) * 1000000;
+  }
+
+  result = kevent(
+    priv->backend_fd,
+    NULL,
+    0,
+    priv->ready,
+    INF_STANDALONE_IO_MAX_READY,
+    timeout >= 0 ? &timespec : NULL
+  );
+
+  priv->n_ready = (result > 0) ? result : 0;
+  priv->ready_index = 0;
+  return result;
+}
+
+static gboolean
+inf_standalone_io_kqueue_next(InfStandaloneIoPrivate* priv,
+                              InfIoWatch** watch,
+                              InfIoEvent* events)
+{
+  struct kevent* event;
+
+  while(priv->ready_index < priv->n_ready)
+  {
+    event = &((struct kevent*)priv->ready)[priv->ready_index++];
+
+    *events = 0;
+    if(event->flags & EV_ERROR)
+    {
+      *events |= INF_IO_ERROR;
+    }
+    else if(event->filter == EVFILT_READ)
+    {
+      /* EOF without error is reported as incoming data, so that recv()
+       * returns 0, as with poll(). */
+      *events |= INF_IO_INCOMING;
+      if((event->flags & EV_EOF) && event->fflags != 0)
+        *events |= INF_IO_ERROR;
+    }
+    else if(event->filter == EVFILT_WRITE)
+    {
+      *events |= INF_IO_OUTGOING;
+      if(event->flags & EV_EOF)
+        *events |= INF_IO_ERROR;
+    }
+
+    if(inf_standalone_io_ready_lookup(priv, (int)event->ident, watch, events))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static const InfStandaloneIoBackendFuncs inf_standalone_io_kqueue_funcs = {
+  inf_standalone_io_kqueue_open,
+  inf_standalone_io_kqueue_close,
+  inf_standalone_io_kqueue_add,
+  inf_standalone_io_kqueue_modify,
+  inf_standalone_io_kqueue_remove,
+  inf_standalone_io_ready_pending,
+  inf_standalone_io_kqueue_wait,
+  inf_standalone_io_kqueue_next
+};
+#endif /* HAVE_KQUEUE */
+
+/* Tries to set up the given backend. Returns FALSE if the backend is not
+ * available on this system. */
+static gboolean
+inf_standalone_io_open_backend(InfStandaloneIoPrivate* priv,
+                               InfStandaloneIoBackend backend)
+{
+  const InfStandaloneIoBackendFuncs* funcs;
+
+  switch(backend)
+  {
+  case INF_STANDALONE_IO_BACKEND_POLL:
+    funcs = &inf_standalone_io_poll_funcs;
+    break;
+#ifdef HAVE_EPOLL
+  case INF_STANDALONE_IO_BACKEND_EPOLL:
+    funcs = &inf_standalone_io_epoll_funcs;
+    break;
+#endif
+#ifdef HAVE_KQUEUE
+  case INF_STANDALONE_IO_BACKEND_KQUEUE:
+    funcs = &inf_standalone_io_kqueue_funcs;
+    break;
+#endif
+  default:
+    return FALSE;
+  }
+
+  if(!funcs->open(priv))
+    return FALSE;
+
+  priv->funcs = funcs;
+  priv->backend = backend;
+  return TRUE;
+}
+
+#ifdef G_OS_WIN32
+static void
+inf_standalone_io_handle_wakeup(InfStandaloneIoPrivate* priv,
+                                InfIoEvent events)
+{
+  char buf[16];
+  int ret;
+  int code;
+  gchar* error_message;
+
+  g_assert(~events & INF_IO_OUTGOING);
+
+  /* Several wakeup calls might have been made since the last iteration,
+   * each of which is a datagram of its own. */
+  do
+  {
+    ret = recv(priv->wakeup_pipe[0], buf, sizeof(buf), 0);
+  } while(ret > 0);
+
+  code = WSAGetLastError();
+  if(ret == SOCKET_ERROR && code != WSAEWOULDBLOCK)
+  {
+    error_message = g_win32_error_message(code);
+    g_warning("recv() on wakeup socket failed: %s", error_message);
+    g_free(error_message);
+  }
+}
+#else
+static void
+inf_standalone_io_handle_wakeup(InfStandaloneIoPrivate* priv,
+                                InfIoEvent events)
+{
+  ssize_t ret;
+#ifdef HAVE_EVENTFD
+  uint64_t buf[1];
+#else
+  char buf[1];
+#endif
+
+  /* we were not polling for outgoing */
+  g_assert(~events & INF_IO_OUTGOING);
+  if(events & INF_IO_ERROR)
+  {
+    /* TODO: Read error from FD? */
+    g_warning("Error condition on wakeup pipe");
+    /* TODO: Is there anything we could do here?
+     * Try to re-establish pipe? */
+  }
+  else
+  {
+    ret = read(priv->wakeup_pipe[0], &buf, sizeof(buf));
+    if(ret == -1)
+    {
+      g_warning(
+        "read() on wakeup pipe failed: %s",
+        strerror(errno)
+      );
+
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else if(ret == 0)
+    {
+      g_warning("Wakeup pipe received EOF");
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else
+    {
+      /* this is what we send as wakeup call. An eventfd adds up all
+       * wakeup calls made since the last read. */
+#ifdef HAVE_EVENTFD
+      g_assert(buf[0] > 0);
+#else
+      g_assert(buf[0] == 'c');
+#endif
+    }
+  }
+}
+#endif
+
+static void
+inf_standalone_io_timeout_heap_set(GPtrArray* heap,
+                                   guint index,
+                                   InfIoTimeout* timeout)
+{
+  g_ptr_array_index(heap, index) = timeout;
+  timeout->heap_index = index;
+}
+
+static void
+inf_standalone_io_timeout_heap_sift_up(GPtrArray* heap,
+                                       guint index)
+{
+  InfIoTimeout* timeout;
+  InfIoTimeout* parent;
+
+  timeout = g_ptr_array_index(heap, index);
+  while(index > 0)
+  {
+    parent = g_ptr_array_index(heap, (index - 1) / 2);
+    if(parent->expiration <= timeout->expiration)
+      break;
+
+    inf_standalone_io_timeout_heap_set(heap, index, parent);
+    index = (index - 1) / 2;
+  }
+
+  inf_standalone_io_timeout_heap_set(heap, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_sift_down(GPtrArray* heap,
+                                         guint index)
+{
+  InfIoTimeout* timeout;
+  InfIoTimeout* child;
+  guint child_index;
+
+  timeout = g_ptr_array_index(heap, index);
+  for(;;)
+  {
+    child_index = 2 * index + 1;
+    if(child_index >= heap->len)
+      break;
+
+    child = g_ptr_array_index(heap, child_index);
+    if(child_index + 1 < heap->len &&
+       ((InfIoTimeout*)g_ptr_array_index(heap, child_index + 1))->expiration <
+       child->expiration)
+    {
+      ++child_index;
+      child = g_ptr_array_index(heap, child_index);
+    }
+
+    if(timeout->expiration <= child->expiration)
+      break;
+
+    inf_standalone_io_timeout_heap_set(heap, index, child);
+    index = child_index;
+  }
+
+  inf_standalone_io_timeout_heap_set(heap, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_insert(GPtrArray* heap,
+                                      InfIoTimeout* timeout)
+{
+  g_ptr_array_add(heap, timeout);
+  timeout->heap_index = heap->len - 1;
+  inf_standalone_io_timeout_heap_sift_up(heap, heap->len - 1);
+}
+
+static void
+inf_standalone_io_timeout_heap_remove(GPtrArray* heap,
+                                      InfIoTimeout* timeout)
 {
-  g_assert(first->tv_sec > second->tv_sec ||
-           (first->tv_sec == second->tv_sec &&
-            first->tv_usec >= second->tv_usec));
+  InfIoTimeout* last;
+  guint index;
 
-  /* Don't risk overflow, don't need to convert to signed int */
-  return (first->tv_sec - second->tv_sec) * 1000 +
-         (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
+  index = timeout->heap_index;
+  g_assert(index < heap->len && g_ptr_array_index(heap, index) == timeout);
+
+  last = g_ptr_array_index(heap, heap->len - 1);
+  g_ptr_array_set_size(heap, heap->len - 1);
+  timeout->heap_index = G_MAXUINT;
+
+  if(last != timeout)
+  {
+    /* Move the last element into the gap, and restore the heap property */
+    inf_standalone_io_timeout_heap_set(heap, index, last);
+    inf_standalone_io_timeout_heap_sift_up(heap, index);
+    inf_standalone_io_timeout_heap_sift_down(heap, last->heap_index);
+  }
+}
+
+/* Returns whether timeout has neither elapsed nor been removed yet. Call
+ * this only with the mutex locked. */
+static gboolean
+inf_standalone_io_timeout_pending(InfStandaloneIoPrivate* priv,
+                                  InfIoTimeout* timeout)
+{
+  return g_hash_table_contains(priv->timeout_set, timeout);
+}
+
+/* Adds value to the histogram for statistic. Call this only with the
+ * mutex locked. */
+static void
+inf_standalone_io_record(InfStandaloneIoPrivate* priv,
+                         InfStandaloneIoStatistic statistic,
+                         gint64 value)
+{
+  InfStandaloneIoHistogram* histogram;
+  guint bucket;
+
+  histogram = &priv->statistics[statistic];
+  if(value < 0) value = 0;
+
+  bucket = 0;
+  if(value > 0)
+  {
+    bucket = g_bit_storage((guint64)value);
+    if(bucket >= INF_STANDALONE_IO_HISTOGRAM_BUCKETS)
+      bucket = INF_STANDALONE_IO_HISTOGRAM_BUCKETS - 1;
+  }
+
+  ++histogram->count;
+  histogram->sum += (guint64)value;
+  if((guint64)value > histogram->max)
+    histogram->max = (guint64)value;
+  ++histogram->buckets[bucket];
+}
+
+/* Returns whether a dispatch or an elapsed timeout can be run without
+ * waiting for events. */
+static gboolean
+inf_standalone_io_has_immediate_work(InfStandaloneIoPrivate* priv)
+{
+  InfIoTimeout* timeout;
+
+  if(!_inf_io_dispatch_queue_is_empty(&priv->dispatchs))
+    return TRUE;
+
+  if(priv->timeouts->len > 0)
+  {
+    timeout = g_ptr_array_index(priv->timeouts, 0);
+    if(timeout->expiration <= g_get_monotonic_time())
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Waits for events like inf_standalone_io_poll(), but if busy_poll is
+ * non-zero, checks for events without blocking for up to busy_poll
+ * microseconds first. */
+static InfStandaloneIoPollResult
+inf_standalone_io_poll_busy(InfStandaloneIoPrivate* priv,
+                            guint busy_poll,
+                            InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPollResult result;
+  gint64 start;
+  gint64 elapsed;
+
+  if(busy_poll == 0 || timeout == 0)
+    return inf_standalone_io_poll(priv, timeout);
+
+  start = g_get_monotonic_time();
+  do
+  {
+    result = inf_standalone_io_poll(priv, 0);
+    if(result != INF_STANDALONE_IO_POLL_TIMEOUT)
+      return result;
+
+    elapsed = g_get_monotonic_time() - start;
+  } while(elapsed < (gint64)busy_poll);
+
+  if(timeout != INF_STANDALONE_IO_POLL_INFINITE)
+  {
+    if(elapsed / 1000 >= (gint64)timeout)
+      return INF_STANDALONE_IO_POLL_TIMEOUT;
+    timeout -= (InfStandaloneIoPollTimeout)(elapsed / 1000);
+  }
+
+  return inf_standalone_io_poll(priv, timeout);
 }
 
 /* Run one iteration of the main loop. Call this only with the mutex locked
@@ -177,101 +1138,127 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   InfStandaloneIoPrivate* priv;
   InfIoEvent events;
   InfStandaloneIoPollResult result;
-  guint i;
 
-  GList* item;
-  GTimeVal current;
+  gint64 current;
   InfIoWatch* watch;
   InfIoTimeout* cur_timeout;
-  InfIoDispatch* dispatch;
-  guint elapsed;
+  gint64 remaining;
+
+  gboolean collect;
+  gint64 start;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
-  WSANETWORKEVENTS wsa_events;
-  const InfStandaloneIoEventTableEntry* entry;
-#else
-  ssize_t ret;
-  char buf[1];
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
+  collect = priv->collect_statistics;
+  start = 0;
 
-  /* Find number of milliseconds to wait */
-  if(priv->dispatchs != NULL)
+  /* If there are still events left from a previous wait, process them
+   * before waiting again. */
+  if(priv->funcs->pending(priv))
+  {
+    result = 1;
+  }
+  else if(priv->poll_skips < INF_STANDALONE_IO_MAX_POLL_SKIPS &&
+     inf_standalone_io_has_immediate_work(priv))
   {
-    /* TODO: Don't even poll */
-    timeout = 0;
+    /* There is something to do right away, so there is no point in asking
+     * the kernel for socket events. Only skip a few times in a row, so that
+     * sockets do not starve while dispatches keep coming in. */
+    ++priv->poll_skips;
+    result = INF_STANDALONE_IO_POLL_TIMEOUT;
   }
   else
   {
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    priv->poll_skips = 0;
+
+    /* Find number of milliseconds to wait */
+    if(!_inf_io_dispatch_queue_is_empty(&priv->dispatchs))
+    {
+      timeout = 0;
+    }
+    else if(priv->timeouts->len > 0)
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
+      /* Only the earliest timeout matters */
+      cur_timeout = g_ptr_array_index(priv->timeouts, 0);
+      current = g_get_monotonic_time();
 
-      if(elapsed >= cur_timeout->msecs)
+      if(cur_timeout->expiration <= current)
       {
         /* already elapsed */
-        /* TODO: Don't even poll */
         timeout = 0;
-        /* no need to check other timeouts */
-        break;
       }
       else
       {
+        /* Round up, so that we do not wake up too early */
+        remaining = (cur_timeout->expiration - current + 999) / 1000;
+        if(remaining >= G_MAXINT)
+          remaining = G_MAXINT - 1;
+
         if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
-           cur_timeout->msecs - elapsed < (guint)timeout)
+           (guint)remaining < (guint)timeout)
         {
-          timeout = cur_timeout->msecs - elapsed;
+          timeout = (InfStandaloneIoPollTimeout)remaining;
         }
       }
     }
-  }
 
-  priv->polling = TRUE;
-  g_mutex_unlock(&priv->mutex);
+    priv->polling = TRUE;
+    g_mutex_unlock(&priv->mutex);
 
-  result = inf_standalone_io_poll(priv->events, priv->fd_size, timeout);
+    INF_TRACE1(io_iteration, timeout);
+    result = inf_standalone_io_poll_busy(priv, priv->busy_poll, timeout);
+    INF_TRACE1(io_poll_done, result);
 
-  g_mutex_lock(&priv->mutex);
-  priv->polling = FALSE;
+    g_mutex_lock(&priv->mutex);
+    priv->polling = FALSE;
 
-#ifdef G_OS_WIN32
-  switch(result)
+    if(collect && result >= 0)
+    {
+      inf_standalone_io_record(
+        priv,
+        INF_STANDALONE_IO_STATISTIC_READY_EVENTS,
+        result
+      );
+    }
+  }
+
+  if(result == -1)
   {
-  case WSA_WAIT_FAILED:
+#ifdef G_OS_WIN32
     error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSAWaitForMultipleEvents() failed: %s\n", error_message);
+    g_warning("Waiting for events failed: %s\n", error_message);
     g_free(error_message);
-    return;
-  case WSA_WAIT_IO_COMPLETION:
-    return;
-  default:
-    break;
-  }
 #else
-  if(result == -1)
-  {
     if(errno != EINTR)
-      g_warning("poll() failed: %s\n", strerror(errno));
+      g_warning("Waiting for events failed: %s\n", strerror(errno));
+#endif
 
     return;
   }
-#endif
 
   if(result == INF_STANDALONE_IO_POLL_TIMEOUT)
   {
     /* No file descriptor is active, so check whether a timeout elapsed */
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    if(priv->timeouts->len > 0)
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-      if(elapsed >= cur_timeout->msecs)
+      cur_timeout = g_ptr_array_index(priv->timeouts, 0);
+      current = g_get_monotonic_time();
+      if(cur_timeout->expiration <= current)
       {
-        priv->timeouts = g_list_delete_link(priv->timeouts, item);
+        if(collect)
+        {
+          inf_standalone_io_record(
+            priv,
+            INF_STANDALONE_IO_STATISTIC_TIMEOUT_LAG,
+            current - cur_timeout->expiration
+          );
+        }
+
+        inf_standalone_io_timeout_heap_remove(priv->timeouts, cur_timeout);
+        g_hash_table_remove(priv->timeout_set, cur_timeout);
         g_mutex_unlock(&priv->mutex);
 
         cur_timeout->func(cur_timeout->user_data);
@@ -280,172 +1267,134 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
         g_slice_free(InfIoTimeout, cur_timeout);
 
         g_mutex_lock(&priv->mutex);
+
+        if(collect)
+        {
+          inf_standalone_io_record(
+            priv,
+            INF_STANDALONE_IO_STATISTIC_TIMEOUT_TIME,
+            g_get_monotonic_time() - current
+          );
+        }
+
         return;
       }
     }
   }
-#ifdef G_OS_WIN32
-  else if(result >= WSA_WAIT_EVENT_0 &&
-          result < WSA_WAIT_EVENT_0 + priv->fd_size)
+  else if(result > 0)
   {
-    if(result == WSA_WAIT_EVENT_0)
-    {
-      /* wakeup call */
-      WSAResetEvent(priv->events[0]);
-    }
-    else
+    while(priv->funcs->next(priv, &watch, &events))
     {
-      watch = priv->watches[result - WSA_WAIT_EVENT_0 - 1];
-
-      if(WSAEnumNetworkEvents(*watch->socket, *watch->event, &wsa_events) ==
-         SOCKET_ERROR)
+      if(watch == NULL)
       {
-        error_message = g_win32_error_message(WSAGetLastError());
-        g_warning("WSAEnumNetworkEvents failed: %s\n", error_message);
-        g_free(error_message);
-
-        events = INF_IO_ERROR;
+        /* wakeup call */
+        inf_standalone_io_handle_wakeup(priv, events);
       }
       else
       {
-        events = 0;
-        for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_event_table); ++ i)
-        {
-          entry = &inf_standalone_io_event_table[i];
-          if(wsa_events.lNetworkEvents & entry->flag_val)
-          {
-            events |= entry->io_val;
-            if(wsa_events.iErrorCode[entry->flag_bit])
-              events |= INF_IO_ERROR;
-          }
-        }
-      }
-
-      /* protect from removing the watch object via
-       * inf_io_remove_watch() when running the callback. */
-      watch->executing = TRUE;
-      g_mutex_unlock(&priv->mutex);
+        /* protect from removing the watch object via
+         * inf_io_remove_watch() when running the callback. */
+        watch->executing = TRUE;
+        g_mutex_unlock(&priv->mutex);
 
-      watch->func(watch->socket, events, watch->user_data);
+        if(collect) start = g_get_monotonic_time();
+        watch->func(watch->socket, events, watch->user_data);
 
-      g_mutex_lock(&priv->mutex);
-      watch->executing = FALSE;
-      if(watch->disposed == TRUE)
-      {
-        g_mutex_unlock(&priv->mutex);
-        if(watch->notify) watch->notify(watch->user_data);
-        g_slice_free(InfIoWatch, watch);
         g_mutex_lock(&priv->mutex);
-      }
 
-      return;
-    }
-  }
-#else
-  else if(result > 0)
-  {
-    while(result--)
-    {
-      for(i = 0; i < priv->fd_size; ++ i)
-      {
-        if(priv->events[i].revents != 0)
+        if(collect)
         {
-          events = 0;
-          if(priv->events[i].revents & POLLIN)
-            events |= INF_IO_INCOMING;
-          if(priv->events[i].revents & POLLOUT)
-            events |= INF_IO_OUTGOING;
-          /* We treat POLLPRI as error because it should not occur in
-           * infinote. */
-          if(priv->events[i].revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
-            events |= INF_IO_ERROR;
-
-          priv->events[i].revents = 0;
-
-          if(i == 0)
-          {
-            /* wakeup call */
-
-            /* we were not polling for outgoing */
-            g_assert(~events & INF_IO_OUTGOING);
-            if(events & INF_IO_ERROR)
-            {
-              /* TODO: Read error from FD? */
-              g_warning("Error condition on wakeup pipe");
-              /* TODO: Is there anything we could do here?
-               * Try to re-establish pipe? */
-            }
-            else
-            {
-              ret = read(priv->events[0].fd, &buf, 1);
-              if(ret == -1)
-              {
-                g_warning(
-                  "read() on wakeup pipe failed: %s",
-                  strerror(errno)
-                );
-
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else if(ret == 0)
-              {
-                g_warning("Wakeup pipe received EOF");
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else
-              {
-                /* this is what we send as wakeup call */
-                g_assert(buf[0] == 'c');
-              }
-            }
-          }
-          else
-          {
-            watch = priv->watches[i-1];
-
-            /* protect from removing the watch object via
-             * inf_io_remove_watch() when running the callback. */
-            watch->executing = TRUE;
-            g_mutex_unlock(&priv->mutex);
-
-            watch->func(watch->socket, events, watch->user_data);
-
-            g_mutex_lock(&priv->mutex);
-            watch->executing = FALSE;
-            if(watch->disposed == TRUE)
-            {
-              g_mutex_unlock(&priv->mutex);
-              if(watch->notify) watch->notify(watch->user_data);
-              g_slice_free(InfIoWatch, watch);
-              g_mutex_lock(&priv->mutex);
-            }
-
-            return;
-          }
+          inf_standalone_io_record(
+            priv,
+            INF_STANDALONE_IO_STATISTIC_WATCH_TIME,
+            g_get_monotonic_time() - start
+          );
         }
+
+        watch->executing = FALSE;
+        if(watch->disposed == TRUE)
+        {
+          g_mutex_unlock(&priv->mutex);
+          if(watch->notify) watch->notify(watch->user_data);
+          g_slice_free(InfIoWatch, watch);
+          g_mutex_lock(&priv->mutex);
+        }
+
+        return;
       }
     }
   }
-#endif
 
-  /* neither timeout nor IO fired, so try a dispatched message */
-  if(priv->dispatchs != NULL)
+  /* neither timeout nor IO fired, so run a batch of dispatched messages */
+  if(!_inf_io_dispatch_queue_is_empty(&priv->dispatchs))
   {
-    dispatch = (InfIoDispatch*)priv->dispatchs->data;
-    priv->dispatchs = g_list_delete_link(priv->dispatchs, priv->dispatchs);
+    if(collect)
+    {
+      inf_standalone_io_record(
+        priv,
+        INF_STANDALONE_IO_STATISTIC_DISPATCH_QUEUE_LENGTH,
+        _inf_io_dispatch_queue_get_length(&priv->dispatchs)
+      );
+    }
+
     g_mutex_unlock(&priv->mutex);
 
-    dispatch->func(dispatch->user_data);
-    if(dispatch->notify)
-      dispatch->notify(dispatch->user_data);
-    g_slice_free(InfIoDispatch, dispatch);
+    if(collect) start = g_get_monotonic_time();
+    _inf_io_dispatch_queue_drain(
+      &priv->dispatchs,
+      INF_STANDALONE_IO_DISPATCH_BATCH_SIZE
+    );
 
     g_mutex_lock(&priv->mutex);
+
+    if(collect)
+    {
+      inf_standalone_io_record(
+        priv,
+        INF_STANDALONE_IO_STATISTIC_DISPATCH_TIME,
+        g_get_monotonic_time() - start
+      );
+    }
   }
 }
 
+#ifdef G_OS_WIN32
+/* Creates a UDP socket on the loopback interface that is connected to
+ * itself, so that the main loop can be woken up by sending a datagram to
+ * it. */
+static InfNativeSocket
+inf_standalone_io_create_wakeup_socket(void)
+{
+  InfNativeSocket sock;
+  struct sockaddr_in addr;
+  int len;
+  u_long argp;
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if(sock == INVALID_SOCKET)
+    return INVALID_SOCKET;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  len = sizeof(addr);
+  argp = 1;
+
+  if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+     getsockname(sock, (struct sockaddr*)&addr, &len) == SOCKET_ERROR ||
+     connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+     ioctlsocket(sock, FIONBIO, &argp) == SOCKET_ERROR)
+  {
+    closesocket(sock);
+    return INVALID_SOCKET;
+  }
+
+  return sock;
+}
+#endif
+
 static void
 inf_standalone_io_init(InfStandaloneIo* io)
 {
@@ -466,37 +1415,112 @@ inf_standalone_io_init(InfStandaloneIo* io)
     g_malloc(sizeof(InfStandaloneIoNativeEvent) * priv->fd_alloc);
 
 #ifdef G_OS_WIN32
-  priv->events[0] = WSACreateEvent();
-  if(priv->events[0] == WSA_INVALID_EVENT)
+  priv->wakeup_pipe[0] = inf_standalone_io_create_wakeup_socket();
+  priv->wakeup_pipe[1] = priv->wakeup_pipe[0];
+  if(priv->wakeup_pipe[0] == INVALID_SOCKET)
   {
     error_message = g_win32_error_message(WSAGetLastError());
-    g_error("Failed to create wakeup event: %s", error_message);
+    g_error("Failed to create wakeup socket: %s", error_message);
     g_free(error_message); /* will not be called since g_error abort()s */
   }
   else
   {
-    ++priv->fd_size;
+    priv->events[0].fd = priv->wakeup_pipe[0];
+    priv->events[0].events = POLLRDNORM;
+    priv->events[0].revents = 0;
+    ++priv->fd_size;
+  }
+#else
+#ifdef HAVE_EVENTFD
+  priv->wakeup_pipe[0] = eventfd(0, EFD_CLOEXEC);
+  priv->wakeup_pipe[1] = priv->wakeup_pipe[0];
+  if(priv->wakeup_pipe[0] == -1)
+#else
+  if(pipe(priv->wakeup_pipe) == -1)
+#endif
+  {
+    g_error("Failed to create wakeup pipe: %s", strerror(errno));
+  }
+  else
+  {
+    priv->events[0].fd = priv->wakeup_pipe[0];
+    priv->events[0].events = POLLIN | POLLERR;
+    priv->events[0].revents = 0;
+    ++priv->fd_size;
+  }
+#endif
+
+  priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
+  priv->timeouts = g_ptr_array_new();
+  priv->timeout_set = g_hash_table_new(NULL, NULL);
+  _inf_io_dispatch_queue_init(&priv->dispatchs);
+
+  priv->backend = INF_STANDALONE_IO_BACKEND_AUTO;
+
+  priv->funcs = NULL;
+#ifndef G_OS_WIN32
+  priv->backend_fd = -1;
+  priv->fd_table = NULL;
+#endif
+  priv->ready = NULL;
+  priv->n_ready = 0;
+  priv->ready_index = 0;
+
+  priv->polling = FALSE;
+  priv->loop_running = FALSE;
+
+  priv->busy_poll = 0;
+  priv->poll_skips = 0;
+
+  priv->collect_statistics = FALSE;
+  memset(priv->statistics, 0, sizeof(priv->statistics));
+}
+
+static void
+inf_standalone_io_constructed(GObject* object)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoBackend requested;
+
+  G_OBJECT_CLASS(inf_standalone_io_parent_class)->constructed(object);
+  priv = INF_STANDALONE_IO_PRIVATE(object);
+
+  requested = priv->backend;
+
+#ifdef G_OS_WIN32
+  if(requested != INF_STANDALONE_IO_BACKEND_AUTO &&
+     requested != INF_STANDALONE_IO_BACKEND_POLL)
+  {
+    g_warning("Requested event backend is not available on Windows");
   }
+
+  /* Cannot fail */
+  inf_standalone_io_open_backend(priv, INF_STANDALONE_IO_BACKEND_POLL);
 #else
-  if(pipe(priv->wakeup_pipe) == -1)
+  if(requested == INF_STANDALONE_IO_BACKEND_AUTO)
   {
-    g_error("Failed to create wakeup pipe: %s", strerror(errno));
+    if(inf_standalone_io_open_backend(priv, INF_STANDALONE_IO_BACKEND_EPOLL))
+      return;
+    if(inf_standalone_io_open_backend(priv, INF_STANDALONE_IO_BACKEND_KQUEUE))
+      return;
   }
-  else
+  else if(requested != INF_STANDALONE_IO_BACKEND_POLL)
   {
-    priv->events[0].fd = priv->wakeup_pipe[0];
-    priv->events[0].events = POLLIN | POLLERR;
-    priv->events[0].revents = 0;
-    ++priv->fd_size;
-  }
-#endif
+    if(inf_standalone_io_open_backend(priv, requested))
+      return;
 
-  priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
-  priv->timeouts = NULL;
-  priv->dispatchs = NULL;
+    g_warning(
+      "Event backend \"%s\" is not available, falling back to poll()",
+      g_enum_get_value(
+        g_type_class_peek(INF_TYPE_STANDALONE_IO_BACKEND),
+        requested
+      )->value_nick
+    );
+  }
 
-  priv->polling = FALSE;
-  priv->loop_running = FALSE;
+  /* Cannot fail */
+  inf_standalone_io_open_backend(priv, INF_STANDALONE_IO_BACKEND_POLL);
+#endif
 }
 
 static void
@@ -505,10 +1529,8 @@ inf_standalone_io_finalize(GObject* object)
   InfStandaloneIo* io;
   InfStandaloneIoPrivate* priv;
   guint i;
-  GList* item;
   InfIoWatch* watch;
   InfIoTimeout* timeout;
-  InfIoDispatch* dispatch;
 #ifdef G_OS_WIN32
   gchar* error_message;
 #endif
@@ -526,55 +1548,36 @@ inf_standalone_io_finalize(GObject* object)
      * reffed on the stack. */
     g_assert(watch->executing == FALSE);
 
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) ==
-       SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
-#endif
-
     if(watch->notify)
       watch->notify(watch->user_data);
     g_slice_free(InfIoWatch, watch);
   }
 
-  for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+  for(i = 0; i < priv->timeouts->len; ++i)
   {
-    timeout = (InfIoTimeout*)item->data;
+    timeout = g_ptr_array_index(priv->timeouts, i);
     if(timeout->notify)
       timeout->notify(timeout->user_data);
     g_slice_free(InfIoTimeout, timeout);
   }
 
-  for(item = priv->dispatchs; item != NULL; item = g_list_next(item))
-  {
-    dispatch = (InfIoDispatch*)item->data;
-    if(dispatch->notify)
-      dispatch->notify(dispatch->user_data);
-    g_slice_free(InfIoDispatch, dispatch);
-  }
-
-#ifdef G_OS_WIN32
-  for(i = 0; i < priv->fd_size; ++ i)
-  {
-    if(WSACloseEvent(priv->events[i]) == FALSE)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSACloseEvent() failed: %s", error_message);
-      g_free(error_message);
-    }
-  }
-#endif
+  _inf_io_dispatch_queue_clear(&priv->dispatchs);
 
   g_free(priv->events);
   g_free(priv->watches);
-  g_list_free(priv->timeouts);
-  g_list_free(priv->dispatchs);
+  g_ptr_array_free(priv->timeouts, TRUE);
+  g_hash_table_destroy(priv->timeout_set);
 
-#ifndef G_OS_WIN32
+  priv->funcs->close(priv);
+
+#ifdef G_OS_WIN32
+  if(closesocket(priv->wakeup_pipe[0]) == SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("Failed to close wakeup socket: %s", error_message);
+    g_free(error_message);
+  }
+#else
   if(close(priv->wakeup_pipe[0]) == -1)
   {
     g_warning(
@@ -583,6 +1586,7 @@ inf_standalone_io_finalize(GObject* object)
     );
   }
 
+#ifndef HAVE_EVENTFD
   if(close(priv->wakeup_pipe[1]) == -1)
   {
     g_warning(
@@ -590,6 +1594,7 @@ inf_standalone_io_finalize(GObject* object)
       strerror(errno)
     );
   }
+#endif
 #endif
 
   g_mutex_unlock(&priv->mutex);
@@ -641,9 +1646,14 @@ inf_standalone_io_wakeup(InfStandaloneIo* io)
 
   InfStandaloneIoPrivate* priv;
 #ifndef G_OS_WIN32
+#ifdef HAVE_EVENTFD
+  uint64_t c;
+#else
   char c;
+#endif
   ssize_t ret;
 #else
+  char c;
   gchar* error_message;
 #endif
   priv = INF_STANDALONE_IO_PRIVATE(io);
@@ -651,20 +1661,25 @@ inf_standalone_io_wakeup(InfStandaloneIo* io)
   if(priv->polling)
   {
 #ifdef G_OS_WIN32
-    if(WSASetEvent(priv->events[0]) == FALSE)
+    c = 'c';
+    if(send(priv->wakeup_pipe[1], &c, 1, 0) == SOCKET_ERROR)
     {
       error_message = g_win32_error_message(WSAGetLastError());
 
       g_warning(
-        "WSASetEvent() failed when attempting to wake up the main loop: %s",
+        "send() failed when attempting to wake up the main loop: %s",
         error_message
       );
 
       g_free(error_message);
     }
+#else
+#ifdef HAVE_EVENTFD
+    c = 1;
 #else
     c = 'c';
-    ret = write(priv->wakeup_pipe[1], &c, 1);
+#endif
+    ret = write(priv->wakeup_pipe[1], &c, sizeof(c));
     if(ret == -1)
     {
       g_warning(
@@ -699,36 +1714,16 @@ inf_standalone_io_io_add_watch(InfIo* io,
 {
   InfStandaloneIoPrivate* priv;
   InfIoWatch* watch;
-  long pevents;
+  short pevents;
   guint i;
 
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
-
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
+  pevents = inf_standalone_io_events_to_poll(events);
 
   g_mutex_lock(&priv->mutex);
 
-  /* Watching the same socket for different events at least won't work on
-   * Windows since WSAEventSelect cancels the effect of previous
-   * WSAEventSelect calls for the same socket. */
+  /* Watching the same socket for different events does not work with the
+   * epoll and kqueue backends, which register each descriptor only once. */
   if(inf_standalone_io_find_watch_by_socket(INF_STANDALONE_IO(io), socket))
   {
     g_mutex_unlock(&priv->mutex);
@@ -759,44 +1754,30 @@ inf_standalone_io_io_add_watch(InfIo* io,
       priv->watches[i-1]->event = &priv->events[i];
   }
 
-#ifdef G_OS_WIN32
-  priv->events[priv->fd_size] = WSACreateEvent();
-  if(priv->events[priv->fd_size] == WSA_INVALID_EVENT)
-  {
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSACreateEvent() failed: %s", error_message);
-    g_free(error_message);
-
-    g_mutex_unlock(&priv->mutex);
-    return NULL;
-  }
-
-  if(WSAEventSelect(*socket, priv->events[priv->fd_size], pevents) ==
-     SOCKET_ERROR)
-  {
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSAEventSelect() failed: %s", error_message);
-    g_free(error_message);
-
-    WSACloseEvent(priv->events[priv->fd_size]);
-    g_mutex_unlock(&priv->mutex);
-    return NULL;
-  }
-#else
   priv->events[priv->fd_size].fd = *socket;
   priv->events[priv->fd_size].events = pevents;
   priv->events[priv->fd_size].revents = 0;
-#endif
 
   watch = g_slice_new(InfIoWatch);
   watch->event = &priv->events[priv->fd_size];
   watch->socket = socket;
+#ifndef G_OS_WIN32
+  watch->fd = *socket;
+#endif
+  watch->events = events;
   watch->func = func;
   watch->user_data = user_data;
   watch->notify = notify;
   watch->executing = FALSE;
   watch->disposed = FALSE;
 
+  if(!priv->funcs->add(priv, watch))
+  {
+    g_slice_free(InfIoWatch, watch);
+    g_mutex_unlock(&priv->mutex);
+    return NULL;
+  }
+
   priv->watches[priv->fd_size-1] = watch;
   ++priv->fd_size;
 
@@ -813,29 +1794,11 @@ inf_standalone_io_io_update_watch(InfIo* io,
 {
   InfStandaloneIoPrivate* priv;
   InfIoWatch** watch_iter;
-  long pevents;
-
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
+  short pevents;
+  InfIoEvent old_events;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
-
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
+  pevents = inf_standalone_io_events_to_poll(events);
 
   g_mutex_lock(&priv->mutex);
 
@@ -846,16 +1809,11 @@ inf_standalone_io_io_update_watch(InfIo* io,
      * array but do this after wakeup directly after the poll call. */
 
     /* Update */
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, pevents) == SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
-#else
     watch->event->events = pevents;
-#endif
+
+    old_events = watch->events;
+    watch->events = events;
+    priv->funcs->modify(priv, watch, old_events);
 
     inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   }
@@ -871,10 +1829,6 @@ inf_standalone_io_io_remove_watch(InfIo* io,
   InfIoWatch** watch_iter;
   guint index;
 
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
@@ -882,21 +1836,7 @@ inf_standalone_io_io_remove_watch(InfIo* io,
   watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
   if(watch_iter != NULL)
   {
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) == SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
-
-    if(WSACloseEvent(*watch->event) == FALSE)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSACloseEvent() failed: %s", error_message);
-      g_free(error_message);
-    }
-#endif
+    priv->funcs->remove(priv, watch);
 
     /* TODO: If we are currently polling we should not modify the fds array
      * array but do this after wakeup directly after the poll call. */
@@ -956,15 +1896,20 @@ inf_standalone_io_io_add_timeout(InfIo* io,
   priv = INF_STANDALONE_IO_PRIVATE(io);
   timeout = g_slice_new(InfIoTimeout);
 
-  g_get_current_time(&timeout->begin);
-  timeout->msecs = msecs;
+  timeout->expiration = g_get_monotonic_time() + (gint64)msecs * 1000;
+  timeout->heap_index = G_MAXUINT;
   timeout->func = func;
   timeout->user_data = user_data;
   timeout->notify = notify;
 
   g_mutex_lock(&priv->mutex);
-  priv->timeouts = g_list_prepend(priv->timeouts, timeout);
-  inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+  inf_standalone_io_timeout_heap_insert(priv->timeouts, timeout);
+  g_hash_table_add(priv->timeout_set, timeout);
+
+  /* Only need to wake up the main loop if it needs to wake up earlier
+   * than before. */
+  if(timeout->heap_index == 0)
+    inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
 
   return timeout;
@@ -975,16 +1920,15 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
                                     InfIoTimeout* timeout)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  item = g_list_find(priv->timeouts, timeout);
-  if(item != NULL)
+  if(inf_standalone_io_timeout_pending(priv, timeout))
   {
-    priv->timeouts = g_list_delete_link(priv->timeouts, item);
+    inf_standalone_io_timeout_heap_remove(priv->timeouts, timeout);
+    g_hash_table_remove(priv->timeout_set, timeout);
     g_mutex_unlock(&priv->mutex);
 
     if(timeout->notify)
@@ -1001,6 +1945,47 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
   }
 }
 
+static void
+inf_standalone_io_io_reset_timeout(InfIo* io,
+                                   InfIoTimeout* timeout,
+                                   guint msecs)
+{
+  InfStandaloneIoPrivate* priv;
+  gint64 expiration;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  expiration = g_get_monotonic_time() + (gint64)msecs * 1000;
+
+  g_mutex_lock(&priv->mutex);
+
+  if(inf_standalone_io_timeout_pending(priv, timeout))
+  {
+    if(expiration < timeout->expiration)
+    {
+      timeout->expiration = expiration;
+      inf_standalone_io_timeout_heap_sift_up(
+        priv->timeouts,
+        timeout->heap_index
+      );
+
+      if(timeout->heap_index == 0)
+        inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+    }
+    else
+    {
+      /* No need to wake up the main loop; it might run into its timeout
+       * sooner than necessary now, but that's OK. */
+      timeout->expiration = expiration;
+      inf_standalone_io_timeout_heap_sift_down(
+        priv->timeouts,
+        timeout->heap_index
+      );
+    }
+  }
+
+  g_mutex_unlock(&priv->mutex);
+}
+
 static InfIoDispatch*
 inf_standalone_io_io_add_dispatch(InfIo* io,
                                   InfIoDispatchFunc func,
@@ -1008,21 +1993,28 @@ inf_standalone_io_io_add_dispatch(InfIo* io,
                                   GDestroyNotify notify)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoDispatch* dispatch;
+  InfIoDispatchQueueEntry* entry;
+  gboolean was_empty;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
-  dispatch = g_slice_new(InfIoDispatch);
 
-  dispatch->func = func;
-  dispatch->user_data = user_data;
-  dispatch->notify = notify;
+  entry = _inf_io_dispatch_queue_push(
+    &priv->dispatchs,
+    func,
+    user_data,
+    notify,
+    &was_empty
+  );
 
-  g_mutex_lock(&priv->mutex);
-  priv->dispatchs = g_list_prepend(priv->dispatchs, dispatch);
-  inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
-  g_mutex_unlock(&priv->mutex);
+  /* If the queue was not empty, the loop does not block in poll anyway */
+  if(was_empty)
+  {
+    g_mutex_lock(&priv->mutex);
+    inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+    g_mutex_unlock(&priv->mutex);
+  }
 
-  return dispatch;
+  return (InfIoDispatch*)entry;
 }
 
 static void
@@ -1030,29 +2022,76 @@ inf_standalone_io_io_remove_dispatch(InfIo* io,
                                      InfIoDispatch* dispatch)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
-  g_mutex_lock(&priv->mutex);
+  /* The entry is freed when the loop reaches it. No need to wake up the
+   * main loop; it might run into its timeout sooner than necessary now, but
+   * that's OK. */
+  _inf_io_dispatch_queue_cancel(
+    &priv->dispatchs,
+    (InfIoDispatchQueueEntry*)dispatch
+  );
+}
+
+static void
+inf_standalone_io_set_property(GObject* object,
+                               guint prop_id,
+                               const GValue* value,
+                               GParamSpec* pspec)
+{
+  InfStandaloneIo* io;
+  InfStandaloneIoPrivate* priv;
+
+  io = INF_STANDALONE_IO(object);
+  priv = INF_STANDALONE_IO_PRIVATE(io);
 
-  item = g_list_find(priv->dispatchs, dispatch);
-  if(item != NULL)
+  switch(prop_id)
   {
-    priv->dispatchs = g_list_delete_link(priv->dispatchs, item);
+  case PROP_BACKEND:
+    priv->backend = g_value_get_enum(value);
+    break;
+  case PROP_BUSY_POLL:
+    g_mutex_lock(&priv->mutex);
+    priv->busy_poll = g_value_get_uint(value);
+    g_mutex_unlock(&priv->mutex);
+    break;
+  case PROP_COLLECT_STATISTICS:
+    g_mutex_lock(&priv->mutex);
+    priv->collect_statistics = g_value_get_boolean(value);
     g_mutex_unlock(&priv->mutex);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
 
-    if(dispatch->notify)
-      dispatch->notify(dispatch->user_data);
+static void
+inf_standalone_io_get_property(GObject* object,
+                               guint prop_id,
+                               GValue* value,
+                               GParamSpec* pspec)
+{
+  InfStandaloneIo* io;
+  InfStandaloneIoPrivate* priv;
 
-    g_slice_free(InfIoDispatch, dispatch);
+  io = INF_STANDALONE_IO(object);
+  priv = INF_STANDALONE_IO_PRIVATE(io);
 
-    /* No need to wake up the main loop; it might run into its timeout sooner
-     * than necessary now, but that's OK. */
-  }
-  else
+  switch(prop_id)
   {
-    g_mutex_unlock(&priv->mutex);
+  case PROP_BACKEND:
+    g_value_set_enum(value, priv->backend);
+    break;
+  case PROP_BUSY_POLL:
+    g_value_set_uint(value, priv->busy_poll);
+    break;
+  case PROP_COLLECT_STATISTICS:
+    g_value_set_boolean(value, priv->collect_statistics);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
   }
 }
 
@@ -1062,7 +2101,74 @@ inf_standalone_io_class_init(InfStandaloneIoClass* io_class)
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(io_class);
 
+  object_class->constructed = inf_standalone_io_constructed;
   object_class->finalize = inf_standalone_io_finalize;
+  object_class->set_property = inf_standalone_io_set_property;
+  object_class->get_property = inf_standalone_io_get_property;
+
+  /**
+   * InfStandaloneIo:backend:
+   *
+   * The mechanism used to wait for events on sockets. When set to
+   * %INF_STANDALONE_IO_BACKEND_AUTO at construction time, the most
+   * efficient backend available is chosen. If the requested backend is not
+   * available, poll() is used instead. After construction, the property
+   * reflects the backend that is actually in use.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_BACKEND,
+    g_param_spec_enum(
+      "backend",
+      "Backend",
+      "The mechanism used to wait for socket events",
+      INF_TYPE_STANDALONE_IO_BACKEND,
+      INF_STANDALONE_IO_BACKEND_AUTO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  /**
+   * InfStandaloneIo:busy-poll:
+   *
+   * The time, in microseconds, for which the loop keeps checking for
+   * events without blocking before it goes to sleep. This lowers the
+   * latency for handling events that arrive in quick succession, at the
+   * cost of CPU time. 0 disables busy polling.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_BUSY_POLL,
+    g_param_spec_uint(
+      "busy-poll",
+      "Busy poll",
+      "Time in microseconds to check for events before sleeping",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfStandaloneIo:collect-statistics:
+   *
+   * Whether to record how long callbacks take, how late timeouts run and
+   * how many events and dispatches are waiting, see
+   * inf_standalone_io_get_statistic(). This costs a few clock reads per
+   * iteration of the loop, so it is disabled by default.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_COLLECT_STATISTICS,
+    g_param_spec_boolean(
+      "collect-statistics",
+      "Collect statistics",
+      "Whether to record timing statistics of the loop",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 static void
@@ -1073,6 +2179,7 @@ inf_standalone_io_io_iface_init(InfIoInterface* iface)
   iface->remove_watch = inf_standalone_io_io_remove_watch;
   iface->add_timeout = inf_standalone_io_io_add_timeout;
   iface->remove_timeout = inf_standalone_io_io_remove_timeout;
+  iface->reset_timeout = inf_standalone_io_io_reset_timeout;
   iface->add_dispatch = inf_standalone_io_io_add_dispatch;
   iface->remove_dispatch = inf_standalone_io_io_remove_dispatch;
 }
@@ -1093,6 +2200,47 @@ inf_standalone_io_new(void)
   return INF_STANDALONE_IO(object);
 }
 
+/**
+ * inf_standalone_io_new_with_backend: (constructor)
+ * @backend: The event backend to use.
+ *
+ * Creates a new #InfStandaloneIo which uses @backend to wait for events on
+ * sockets. If @backend is not available on this system, poll() is used
+ * instead. Use inf_standalone_io_get_backend() to find out which backend is
+ * actually in use.
+ *
+ * Returns: (transfer full): A new #InfStandaloneIo. Free with
+ * g_object_unref() when no longer needed.
+ **/
+InfStandaloneIo*
+inf_standalone_io_new_with_backend(InfStandaloneIoBackend backend)
+{
+  GObject* object;
+
+  object = g_object_new(INF_TYPE_STANDALONE_IO, "backend", backend, NULL);
+  return INF_STANDALONE_IO(object);
+}
+
+/**
+ * inf_standalone_io_get_backend:
+ * @io: A #InfStandaloneIo.
+ *
+ * Returns the mechanism that @io uses to wait for events on sockets. This
+ * is never %INF_STANDALONE_IO_BACKEND_AUTO.
+ *
+ * Returns: The backend in use by @io.
+ **/
+InfStandaloneIoBackend
+inf_standalone_io_get_backend(InfStandaloneIo* io)
+{
+  g_return_val_if_fail(
+    INF_IS_STANDALONE_IO(io),
+    INF_STANDALONE_IO_BACKEND_POLL
+  );
+
+  return INF_STANDALONE_IO_PRIVATE(io)->backend;
+}
+
 /**
  * inf_standalone_io_iteration:
  * @io: A #InfStandaloneIo.
@@ -1236,4 +2384,33 @@ inf_standalone_io_loop_running(InfStandaloneIo* io)
   return running;
 }
 
+/**
+ * inf_standalone_io_get_statistic:
+ * @io: A #InfStandaloneIo.
+ * @statistic: The statistic to retrieve.
+ * @histogram: (out caller-allocates): Location to store the histogram.
+ *
+ * Copies the histogram of all values recorded for @statistic into
+ * @histogram. Values are only recorded while
+ * #InfStandaloneIo:collect-statistics is set. The histograms are never
+ * reset, so rates can be computed from the difference between two calls.
+ */
+void
+inf_standalone_io_get_statistic(InfStandaloneIo* io,
+                                InfStandaloneIoStatistic statistic,
+                                InfStandaloneIoHistogram* histogram)
+{
+  InfStandaloneIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_STANDALONE_IO(io));
+  g_return_if_fail(statistic < INF_STANDALONE_IO_N_STATISTICS);
+  g_return_if_fail(histogram != NULL);
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+  *histogram = priv->statistics[statistic];
+  g_mutex_unlock(&priv->mutex);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -31,9 +31,90 @@ G_BEGIN_DECLS
 #define INF_IS_STANDALONE_IO_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TYPE_STANDALONE_IO))
 #define INF_STANDALONE_IO_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TYPE_STANDALONE_IO, InfStandaloneIoClass))
 
+#define INF_TYPE_STANDALONE_IO_BACKEND         (inf_standalone_io_backend_get_type())
+
 typedef struct _InfStandaloneIo InfStandaloneIo;
 typedef struct _InfStandaloneIoClass InfStandaloneIoClass;
 
+/**
+ * InfStandaloneIoBackend:
+ * @INF_STANDALONE_IO_BACKEND_AUTO: Use the most efficient backend
+ * available on the system.
+ * @INF_STANDALONE_IO_BACKEND_POLL: Use poll(), or WSAPoll() on Windows.
+ * This backend is available everywhere, but the cost of one iteration grows
+ * linearly with the number of watched sockets.
+ * @INF_STANDALONE_IO_BACKEND_EPOLL: Use epoll, available on Linux.
+ * @INF_STANDALONE_IO_BACKEND_KQUEUE: Use kqueue, available on BSD and Mac
+ * OS X.
+ *
+ * The mechanism used by #InfStandaloneIo to wait for events on sockets.
+ */
+typedef enum _InfStandaloneIoBackend {
+  INF_STANDALONE_IO_BACKEND_AUTO,
+  INF_STANDALONE_IO_BACKEND_POLL,
+  INF_STANDALONE_IO_BACKEND_EPOLL,
+  INF_STANDALONE_IO_BACKEND_KQUEUE
+} InfStandaloneIoBackend;
+
+/**
+ * InfStandaloneIoStatistic:
+ * @INF_STANDALONE_IO_STATISTIC_TIMEOUT_LAG: The time, in microseconds, by
+ * which timeouts ran later than they were scheduled for. This shows how
+ * busy the loop is.
+ * @INF_STANDALONE_IO_STATISTIC_TIMEOUT_TIME: The time, in microseconds,
+ * spent in timeout callbacks.
+ * @INF_STANDALONE_IO_STATISTIC_WATCH_TIME: The time, in microseconds, spent
+ * in watch callbacks.
+ * @INF_STANDALONE_IO_STATISTIC_DISPATCH_TIME: The time, in microseconds,
+ * spent in one batch of dispatch callbacks.
+ * @INF_STANDALONE_IO_STATISTIC_DISPATCH_QUEUE_LENGTH: The number of
+ * dispatches waiting whenever a batch of them is run.
+ * @INF_STANDALONE_IO_STATISTIC_READY_EVENTS: The number of sockets with
+ * events whenever the loop has waited for them.
+ * @INF_STANDALONE_IO_N_STATISTICS: The number of statistics.
+ *
+ * The statistics that #InfStandaloneIo records when
+ * #InfStandaloneIo:collect-statistics is set, see
+ * inf_standalone_io_get_statistic().
+ */
+typedef enum _InfStandaloneIoStatistic {
+  INF_STANDALONE_IO_STATISTIC_TIMEOUT_LAG,
+  INF_STANDALONE_IO_STATISTIC_TIMEOUT_TIME,
+  INF_STANDALONE_IO_STATISTIC_WATCH_TIME,
+  INF_STANDALONE_IO_STATISTIC_DISPATCH_TIME,
+  INF_STANDALONE_IO_STATISTIC_DISPATCH_QUEUE_LENGTH,
+  INF_STANDALONE_IO_STATISTIC_READY_EVENTS,
+
+  INF_STANDALONE_IO_N_STATISTICS
+} InfStandaloneIoStatistic;
+
+/**
+ * INF_STANDALONE_IO_HISTOGRAM_BUCKETS:
+ *
+ * The number of buckets in a #InfStandaloneIoHistogram.
+ */
+#define INF_STANDALONE_IO_HISTOGRAM_BUCKETS 32
+
+/**
+ * InfStandaloneIoHistogram:
+ * @count: The number of recorded values.
+ * @sum: The sum of all recorded values.
+ * @max: The largest recorded value.
+ * @buckets: The number of recorded values per bucket. The first bucket
+ * counts values of 0, and bucket i counts values from 2^(i-1) to 2^i - 1.
+ * The last bucket also counts all values that are even larger.
+ *
+ * A histogram of the values recorded for one #InfStandaloneIoStatistic
+ * since @io was created.
+ */
+typedef struct _InfStandaloneIoHistogram InfStandaloneIoHistogram;
+struct _InfStandaloneIoHistogram {
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+  guint64 buckets[INF_STANDALONE_IO_HISTOGRAM_BUCKETS];
+};
+
 /**
  * InfStandaloneIoClass:
  *
@@ -55,12 +136,21 @@ struct _InfStandaloneIo {
   GObject parent;
 };
 
+GType
+inf_standalone_io_backend_get_type(void) G_GNUC_CONST;
+
 GType
 inf_standalone_io_get_type(void) G_GNUC_CONST;
 
 InfStandaloneIo*
 inf_standalone_io_new(void);
 
+InfStandaloneIo*
+inf_standalone_io_new_with_backend(InfStandaloneIoBackend backend);
+
+InfStandaloneIoBackend
+inf_standalone_io_get_backend(InfStandaloneIo* io);
+
 void
 inf_standalone_io_iteration(InfStandaloneIo* io);
 
@@ -77,6 +167,11 @@ inf_standalone_io_loop_quit(InfStandaloneIo* io);
 gboolean
 inf_standalone_io_loop_running(InfStandaloneIo* io);
 
+void
+inf_standalone_io_get_statistic(InfStandaloneIo* io,
+                                InfStandaloneIoStatistic statistic,
+                                InfStandaloneIoHistogram* histogram);
+
 G_END_DECLS
 
 #endif /* __INF_STANDALONE_IO_H__ */
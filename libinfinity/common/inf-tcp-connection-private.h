@@ -33,8 +33,20 @@ _inf_tcp_connection_accepted(InfIo* io,
                              InfIpAddress* address,
                              guint port,
                              const InfKeepalive* keepalive,
+                             gboolean configured,
                              GError** error);
 
+InfNativeSocket
+_inf_tcp_connection_get_idle_socket(InfTcpConnection* connection);
+
+void
+_inf_tcp_connection_set_held(InfTcpConnection* connection,
+                             gboolean held);
+
+void
+_inf_tcp_connection_set_backlog(InfTcpConnection* connection,
+                                gsize backlog);
+
 G_END_DECLS
 
 #endif /* __INF_TCP_CONNECTION_PRIVATE_H__ */
@@ -38,6 +38,19 @@
  * When the hostname has been resolved and a connection has been made, the
  * #InfTcpConnection:remote-address and #InfTcpConnection:remote-port
  * properties are updated to reflect the address actually connected to.
+ *
+ * If the hostname resolves to several addresses, they are tried with
+ * alternating address families, and if an attempt takes longer than 250
+ * milliseconds, the next one is started in parallel. The first connection
+ * to be established is used. This avoids long delays in case one of IPv4
+ * or IPv6 does not work.
+ *
+ * If the remote host does not read data as fast as it is sent, the send
+ * buffer grows. inf_tcp_connection_set_watermarks() can be used to bound it:
+ * once more than the high watermark is buffered, no more data is read from
+ * the connection until the buffer has drained to the low watermark. Since
+ * incoming data is typically what causes data to be sent in response, this
+ * throttles a peer that sends requests but does not read the replies.
  **/
 
 #include <libinfinity/common/inf-tcp-connection.h>
@@ -89,6 +102,20 @@ static const GEnumValue inf_tcp_connection_status_values[] = {
   }
 };
 
+/* Delay in milliseconds after which the next connection attempt is started
+ * in parallel if the previous one has neither succeeded nor failed yet, as
+ * recommended by RFC 8305 ("Happy Eyeballs"). The first attempt to succeed
+ * is used. */
+static const guint INF_TCP_CONNECTION_ATTEMPT_DELAY = 250;
+
+typedef struct _InfTcpConnectionAttempt InfTcpConnectionAttempt;
+struct _InfTcpConnectionAttempt {
+  InfTcpConnection* connection;
+  InfNativeSocket socket;
+  InfIoWatch* watch;
+  guint index;
+};
+
 typedef struct _InfTcpConnectionPrivate InfTcpConnectionPrivate;
 struct _InfTcpConnectionPrivate {
   InfIo* io;
@@ -98,6 +125,12 @@ struct _InfTcpConnectionPrivate {
   InfNameResolver* resolver;
   guint resolver_index;
 
+  /* Running connection attempts to resolved addresses */
+  GSList* attempts;
+  InfIoTimeout* attempt_timeout;
+  GArray* attempted; /* indices of addresses tried already */
+  GError* attempt_error;
+
   InfTcpConnectionStatus status;
   InfNativeSocket socket;
   InfKeepalive keepalive;
@@ -110,6 +143,22 @@ struct _InfTcpConnectionPrivate {
   gsize front_pos;
   gsize back_pos;
   gsize alloc;
+
+  /* Reading is paused while at least high_watermark bytes are queued, until
+   * the queue has drained to low_watermark. 0 means no limit. */
+  guint high_watermark;
+  guint low_watermark;
+
+  /* Reading is also paused while the connection is held, see
+   * _inf_tcp_connection_set_held(). */
+  gboolean held;
+
+  /* Data queued for this connection by a higher layer, which counts
+   * towards the watermarks, see _inf_tcp_connection_set_backlog(). */
+  gsize backlog;
+
+  gchar* recv_buf;
+  gsize recv_alloc;
 };
 
 enum {
@@ -127,7 +176,10 @@ enum {
   PROP_LOCAL_PORT,
 
   PROP_DEVICE_INDEX,
-  PROP_DEVICE_NAME
+  PROP_DEVICE_NAME,
+
+  PROP_HIGH_WATERMARK,
+  PROP_LOW_WATERMARK
 };
 
 enum {
@@ -275,6 +327,31 @@ inf_tcp_connection_io(InfNativeSocket* socket,
                       gpointer user_data);
 
 
+/* Adds or removes INF_IO_INCOMING from the watched events, depending on how
+ * much data is queued for sending and whether the connection is held.
+ * Returns TRUE if the events have changed, in which case the caller needs
+ * to update the watch. */
+static gboolean
+inf_tcp_connection_apply_watermarks(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  InfIoEvent events;
+  gsize queued;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  events = priv->events;
+  queued = priv->front_pos - priv->back_pos + priv->backlog;
+
+  if(priv->held)
+    priv->events &= ~INF_IO_INCOMING;
+  else if(priv->high_watermark > 0 && queued >= priv->high_watermark)
+    priv->events &= ~INF_IO_INCOMING;
+  else if(priv->high_watermark == 0 || queued <= priv->low_watermark)
+    priv->events |= INF_IO_INCOMING;
+
+  return priv->events != events;
+}
+
 static void
 inf_tcp_connection_connected(InfTcpConnection* connection)
 {
@@ -330,14 +407,10 @@ inf_tcp_connection_connected(InfTcpConnection* connection)
   g_object_thaw_notify(G_OBJECT(connection));
 }
 
-static gboolean
-inf_tcp_connection_open_with_resolver(InfTcpConnection* connection,
-                                      GError** error);
-
-/* Handles when an error occurred during connection. Returns FALSE when the
- * error was fatal. In this case, it has already emitted the "error" signal.
- * Returns TRUE, if another connection attempt is made. */
-static gboolean
+/* Handles when an error occurred while connecting to a fixed address, i.e.
+ * without resolver. Connection attempts with a resolver are handled
+ * separately below. */
+static void
 inf_tcp_connection_connection_error(InfTcpConnection* connection,
                                     const GError* error)
 {
@@ -359,36 +432,26 @@ inf_tcp_connection_connection_error(InfTcpConnection* connection,
     priv->watch = NULL;
   }
 
-  if(priv->resolver != NULL)
-  {
-    /* Try next address, if there is one */
-    if(priv->resolver_index <
-       inf_name_resolver_get_n_addresses(priv->resolver))
-    {
-      ++priv->resolver_index;
-      if(inf_tcp_connection_open_with_resolver(connection, NULL) == TRUE)
-        return TRUE;
-    }
-
-    /* No new addresses available */
-    priv->resolver_index = 0;
-  }
-
   g_signal_emit(
     G_OBJECT(connection),
     tcp_connection_signals[ERROR_],
     0,
     error
   );
-
-  return FALSE;
 }
 
-static gboolean
-inf_tcp_connection_open_real(InfTcpConnection* connection,
-                             const InfIpAddress* address,
-                             guint port,
-                             GError** error)
+/* Creates a non-blocking socket and starts connecting it to the given
+ * address. Returns INVALID_SOCKET on error, in which case connect_failed is
+ * set to whether the error occurred when connecting, as opposed to when
+ * creating the socket. Otherwise, in_progress is set to whether the
+ * connection is still being established. */
+static InfNativeSocket
+inf_tcp_connection_start_connect(InfTcpConnection* connection,
+                                 const InfIpAddress* address,
+                                 guint port,
+                                 gboolean* in_progress,
+                                 gboolean* connect_failed,
+                                 GError** error)
 {
   InfTcpConnectionPrivate* priv;
 
@@ -399,24 +462,17 @@ inf_tcp_connection_open_real(InfTcpConnection* connection,
 
   struct sockaddr* addr;
   socklen_t addrlen;
+  InfNativeSocket sock;
   int result;
   int errcode;
-  const InfKeepalive* keepalive;
-  GError* local_error;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
-
-  g_assert(priv->status == INF_TCP_CONNECTION_CLOSED ||
-           priv->status == INF_TCP_CONNECTION_CONNECTING);
-
-  /* Close previous socket */
-  if(priv->socket != INVALID_SOCKET)
-    closesocket(priv->socket);
+  *connect_failed = FALSE;
 
   switch(inf_ip_address_get_family(address))
   {
   case INF_IP_ADDRESS_IPV4:
-    priv->socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
     addr = (struct sockaddr*)&native_address.in;
     addrlen = sizeof(struct sockaddr_in);
 
@@ -431,7 +487,7 @@ inf_tcp_connection_open_real(InfTcpConnection* connection,
 
     break;
   case INF_IP_ADDRESS_IPV6:
-    priv->socket = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+    sock = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
     addr = (struct sockaddr*)&native_address.in6;
     addrlen = sizeof(struct sockaddr_in6);
 
@@ -452,46 +508,80 @@ inf_tcp_connection_open_real(InfTcpConnection* connection,
     break;
   }
 
-  if(priv->socket == INVALID_SOCKET)
+  if(sock == INVALID_SOCKET)
   {
     inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
-    return FALSE;
+    return INVALID_SOCKET;
   }
 
   /* Set socket non-blocking and keepalive */
-  keepalive = &priv->keepalive;
-  if(!inf_tcp_connection_configure_socket(priv->socket, keepalive, error))
+  if(!inf_tcp_connection_configure_socket(sock, &priv->keepalive, error))
   {
-    closesocket(priv->socket);
-    priv->socket = INVALID_SOCKET;
-    return FALSE;
+    closesocket(sock);
+    return INVALID_SOCKET;
   }
 
   /* Connect */
   do
   {
-    result = connect(priv->socket, addr, addrlen);
+    result = connect(sock, addr, addrlen);
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
     if(result == -1 &&
        errcode != INF_NATIVE_SOCKET_EINTR &&
        errcode != INF_NATIVE_SOCKET_EINPROGRESS)
     {
-      local_error = NULL;
-      inf_native_socket_make_error(errcode, &local_error);
-      if(inf_tcp_connection_connection_error(connection, local_error) == TRUE)
-      {
-        /* In this case, we could recover from the error by connecting to a
-         * different address. */
-        g_error_free(local_error);
-        return TRUE;
-      }
+      inf_native_socket_make_error(errcode, error);
+      closesocket(sock);
 
-      g_propagate_error(error, local_error);
-      return FALSE;
+      *connect_failed = TRUE;
+      return INVALID_SOCKET;
     }
   } while(result == -1 && errcode != INF_NATIVE_SOCKET_EINPROGRESS);
 
-  if(result == 0)
+  *in_progress = (result != 0);
+  return sock;
+}
+
+static gboolean
+inf_tcp_connection_open_real(InfTcpConnection* connection,
+                             const InfIpAddress* address,
+                             guint port,
+                             GError** error)
+{
+  InfTcpConnectionPrivate* priv;
+  gboolean in_progress;
+  gboolean connect_failed;
+  GError* local_error;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_TCP_CONNECTION_CLOSED ||
+           priv->status == INF_TCP_CONNECTION_CONNECTING);
+
+  /* Close previous socket */
+  if(priv->socket != INVALID_SOCKET)
+    closesocket(priv->socket);
+
+  local_error = NULL;
+  priv->socket = inf_tcp_connection_start_connect(
+    connection,
+    address,
+    port,
+    &in_progress,
+    &connect_failed,
+    &local_error
+  );
+
+  if(priv->socket == INVALID_SOCKET)
+  {
+    if(connect_failed)
+      inf_tcp_connection_connection_error(connection, local_error);
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if(!in_progress)
   {
     /* Connection fully established */
     inf_tcp_connection_connected(connection);
@@ -522,54 +612,385 @@ inf_tcp_connection_open_real(InfTcpConnection* connection,
   return TRUE;
 }
 
+/*
+ * Connection attempts with a resolver
+ */
+
+static void
+inf_tcp_connection_attempt_free(InfTcpConnectionAttempt* attempt)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(attempt->connection);
+
+  if(attempt->watch != NULL)
+    inf_io_remove_watch(priv->io, attempt->watch);
+  if(attempt->socket != INVALID_SOCKET)
+    closesocket(attempt->socket);
+
+  g_slice_free(InfTcpConnectionAttempt, attempt);
+}
+
+static void
+inf_tcp_connection_abort_attempts(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->attempt_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->attempt_timeout);
+    priv->attempt_timeout = NULL;
+  }
+
+  while(priv->attempts != NULL)
+  {
+    inf_tcp_connection_attempt_free(priv->attempts->data);
+    priv->attempts = g_slist_delete_link(priv->attempts, priv->attempts);
+  }
+
+  g_array_set_size(priv->attempted, 0);
+
+  if(priv->attempt_error != NULL)
+  {
+    g_error_free(priv->attempt_error);
+    priv->attempt_error = NULL;
+  }
+}
+
+static void
+inf_tcp_connection_set_attempt_error(InfTcpConnection* connection,
+                                     GError* error)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->attempt_error != NULL)
+    g_error_free(priv->attempt_error);
+  priv->attempt_error = error;
+}
+
+/* Uses the socket of a successful connection attempt as the connection's
+ * socket, and cancels all other attempts. */
+static void
+inf_tcp_connection_attempt_succeeded(InfTcpConnection* connection,
+                                     InfNativeSocket socket,
+                                     guint index)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->socket != INVALID_SOCKET)
+    closesocket(priv->socket);
+
+  priv->socket = socket;
+  priv->resolver_index = index;
+
+  inf_tcp_connection_abort_attempts(connection);
+  inf_tcp_connection_connected(connection);
+}
+
+/* Reports the error of the last connection attempt when all of them have
+ * failed. */
+static void
+inf_tcp_connection_attempts_failed(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  GError* error;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_assert(priv->attempts == NULL);
+
+  error = priv->attempt_error;
+  priv->attempt_error = NULL;
+
+  if(error == NULL)
+  {
+    g_set_error_literal(
+      &error,
+      g_quark_from_static_string("INF_TCP_CONNECTION_ERROR"),
+      0,
+      _("The host name did not resolve to any address")
+    );
+  }
+
+  inf_tcp_connection_abort_attempts(connection);
+  priv->resolver_index = 0;
+
+  g_signal_emit(
+    G_OBJECT(connection),
+    tcp_connection_signals[ERROR_],
+    0,
+    error
+  );
+
+  g_error_free(error);
+}
+
+/* Returns the index of the resolved address to try next. Addresses are
+ * tried in the order of the resolver, except that the address family
+ * alternates as long as there are addresses of both families left, as
+ * recommended by RFC 8305. */
 static gboolean
-inf_tcp_connection_open_with_resolver(InfTcpConnection* connection,
-                                      GError** error)
+inf_tcp_connection_next_attempt_index(InfTcpConnection* connection,
+                                      guint* index)
 {
   InfTcpConnectionPrivate* priv;
+  InfIpAddressFamily last_family;
+  gboolean found;
+  guint n_addresses;
+  guint i;
+  guint j;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  n_addresses = inf_name_resolver_get_n_addresses(priv->resolver);
+  last_family = INF_IP_ADDRESS_IPV4;
+  found = FALSE;
+
+  if(priv->attempted->len > 0)
+  {
+    last_family = inf_ip_address_get_family(
+      inf_name_resolver_get_address(
+        priv->resolver,
+        g_array_index(priv->attempted, guint, priv->attempted->len - 1)
+      )
+    );
+  }
+
+  for(i = 0; i < n_addresses; ++i)
+  {
+    for(j = 0; j < priv->attempted->len; ++j)
+      if(g_array_index(priv->attempted, guint, j) == i)
+        break;
+
+    if(j < priv->attempted->len)
+      continue;
+
+    if(!found)
+    {
+      *index = i;
+      found = TRUE;
+
+      if(priv->attempted->len == 0)
+        break;
+    }
+
+    if(inf_ip_address_get_family(
+         inf_name_resolver_get_address(priv->resolver, i)) != last_family)
+    {
+      *index = i;
+      break;
+    }
+  }
+
+  return found;
+}
+
+static void
+inf_tcp_connection_attempt_io(InfNativeSocket* socket,
+                              InfIoEvent events,
+                              gpointer user_data);
+
+static void
+inf_tcp_connection_attempt_timeout_func(gpointer user_data);
+
+/* Starts a connection attempt to the next resolved address that has not
+ * been tried yet. If none is left, backup addresses are looked up, and if
+ * there are none either and no attempt is running anymore, the connection
+ * fails. */
+static void
+inf_tcp_connection_start_attempt(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  InfTcpConnectionAttempt* attempt;
+  InfNativeSocket sock;
+  gboolean in_progress;
+  gboolean connect_failed;
   GError* local_error;
-  gboolean success;
+  guint index;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_assert(priv->status == INF_TCP_CONNECTION_CONNECTING);
 
-  g_assert(priv->status == INF_TCP_CONNECTION_CLOSED ||
-           priv->status == INF_TCP_CONNECTION_CONNECTING);
+  if(priv->attempt_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->attempt_timeout);
+    priv->attempt_timeout = NULL;
+  }
 
-  if(inf_name_resolver_finished(priv->resolver))
+  while(inf_tcp_connection_next_attempt_index(connection, &index))
   {
-    if(priv->resolver_index < 
-       inf_name_resolver_get_n_addresses(priv->resolver))
+    g_array_append_val(priv->attempted, index);
+
+    local_error = NULL;
+    sock = inf_tcp_connection_start_connect(
+      connection,
+      inf_name_resolver_get_address(priv->resolver, index),
+      inf_name_resolver_get_port(priv->resolver, index),
+      &in_progress,
+      &connect_failed,
+      &local_error
+    );
+
+    if(sock == INVALID_SOCKET)
+    {
+      /* Try the next address right away */
+      inf_tcp_connection_set_attempt_error(connection, local_error);
+    }
+    else if(!in_progress)
+    {
+      inf_tcp_connection_attempt_succeeded(connection, sock, index);
+      return;
+    }
+    else
     {
-      return inf_tcp_connection_open_real(
+      attempt = g_slice_new(InfTcpConnectionAttempt);
+      attempt->connection = connection;
+      attempt->socket = sock;
+      attempt->index = index;
+
+      attempt->watch = inf_io_add_watch(
+        priv->io,
+        &attempt->socket,
+        INF_IO_OUTGOING | INF_IO_ERROR,
+        inf_tcp_connection_attempt_io,
+        attempt,
+        NULL
+      );
+
+      priv->attempts = g_slist_prepend(priv->attempts, attempt);
+
+      /* Start the next attempt if this one takes too long */
+      priv->attempt_timeout = inf_io_add_timeout(
+        priv->io,
+        INF_TCP_CONNECTION_ATTEMPT_DELAY,
+        inf_tcp_connection_attempt_timeout_func,
         connection,
-        inf_name_resolver_get_address(priv->resolver, priv->resolver_index),
-        inf_name_resolver_get_port(priv->resolver, priv->resolver_index),
-        error
+        NULL
       );
+
+      return;
     }
+  }
 
-    /* We need to look up more addresses */
-    g_object_freeze_notify(G_OBJECT(connection));
-    if(priv->status != INF_TCP_CONNECTION_CONNECTING)
+  /* All addresses are being tried already, so look up the remaining SRV
+   * targets, in parallel to the running attempts. If the resolver is busy,
+   * we continue when it has finished. */
+  if(!inf_name_resolver_finished(priv->resolver))
+    return;
+
+  local_error = NULL;
+  if(inf_name_resolver_lookup_backup(priv->resolver, &local_error))
+    return;
+
+  if(local_error != NULL)
+    inf_tcp_connection_set_attempt_error(connection, local_error);
+
+  if(priv->attempts == NULL)
+    inf_tcp_connection_attempts_failed(connection);
+}
+
+static void
+inf_tcp_connection_attempt_io(InfNativeSocket* socket,
+                              InfIoEvent events,
+                              gpointer user_data)
+{
+  InfTcpConnectionAttempt* attempt;
+  InfTcpConnection* connection;
+  InfTcpConnectionPrivate* priv;
+  InfNativeSocket new_socket;
+  GError* error;
+  socklen_t len;
+  int errcode;
+  guint index;
+
+  attempt = (InfTcpConnectionAttempt*)user_data;
+  connection = attempt->connection;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_object_ref(connection);
+
+  len = sizeof(int);
+#ifdef G_OS_WIN32
+  getsockopt(attempt->socket, SOL_SOCKET, SO_ERROR, (char*)&errcode, &len);
+#else
+  getsockopt(attempt->socket, SOL_SOCKET, SO_ERROR, &errcode, &len);
+#endif
+
+  priv->attempts = g_slist_remove(priv->attempts, attempt);
+
+  if(errcode == 0 && (events & INF_IO_ERROR) == 0)
+  {
+    new_socket = attempt->socket;
+    attempt->socket = INVALID_SOCKET;
+    index = attempt->index;
+    inf_tcp_connection_attempt_free(attempt);
+
+    inf_tcp_connection_attempt_succeeded(connection, new_socket, index);
+  }
+  else
+  {
+    if(errcode != 0)
     {
-      priv->status = INF_TCP_CONNECTION_CONNECTING;
-      g_object_notify(G_OBJECT(connection), "status");
+      error = NULL;
+      inf_native_socket_make_error(errcode, &error);
+      inf_tcp_connection_set_attempt_error(connection, error);
     }
 
-    local_error = NULL;
-    if(priv->resolver_index == 0)
-      success = inf_name_resolver_start(priv->resolver, &local_error);
-    else
-      success = inf_name_resolver_lookup_backup(priv->resolver, &local_error);
+    inf_tcp_connection_attempt_free(attempt);
+    inf_tcp_connection_start_attempt(connection);
+  }
 
-    if(local_error != NULL)
+  g_object_unref(connection);
+}
+
+static void
+inf_tcp_connection_attempt_timeout_func(gpointer user_data)
+{
+  InfTcpConnection* connection;
+  InfTcpConnectionPrivate* priv;
+
+  connection = INF_TCP_CONNECTION(user_data);
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  priv->attempt_timeout = NULL;
+
+  g_object_ref(connection);
+  inf_tcp_connection_start_attempt(connection);
+  g_object_unref(connection);
+}
+
+static gboolean
+inf_tcp_connection_open_with_resolver(InfTcpConnection* connection,
+                                      GError** error)
+{
+  InfTcpConnectionPrivate* priv;
+  GError* local_error;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_assert(priv->status == INF_TCP_CONNECTION_CLOSED);
+
+  priv->status = INF_TCP_CONNECTION_CONNECTING;
+  g_object_notify(G_OBJECT(connection), "status");
+
+  if(inf_name_resolver_finished(priv->resolver))
+  {
+    /* Reuse a previous lookup result if there is one */
+    if(inf_name_resolver_get_n_addresses(priv->resolver) > 0)
     {
-      inf_tcp_connection_connection_error(connection, local_error);
-      g_propagate_error(error, local_error);
+      inf_tcp_connection_start_attempt(connection);
+      return TRUE;
     }
 
-    g_object_thaw_notify(G_OBJECT(connection));
-    return success;
+    local_error = NULL;
+    if(!inf_name_resolver_start(priv->resolver, &local_error))
+    {
+      inf_tcp_connection_set_attempt_error(
+        connection,
+        g_error_copy(local_error)
+      );
+
+      inf_tcp_connection_attempts_failed(connection);
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
   }
 
   /* The resolver is currently doing something. Wait until it finishes, and
@@ -577,6 +998,11 @@ inf_tcp_connection_open_with_resolver(InfTcpConnection* connection,
   return TRUE;
 }
 
+/* The receive buffer starts small and is grown up to this size if the
+ * remote side sends more data at once, such as during synchronization. */
+static const gsize INF_TCP_CONNECTION_RECV_BUFFER_INITIAL_SIZE = 2048;
+static const gsize INF_TCP_CONNECTION_RECV_BUFFER_MAX_SIZE = 65536;
+
 static gboolean
 inf_tcp_connection_send_real(InfTcpConnection* connection,
                              gconstpointer data,
@@ -626,8 +1052,12 @@ inf_tcp_connection_send_real(InfTcpConnection* connection,
       send_data = (const char*)send_data + result;
       send_len -= result;
     }
+
+    /* A short write means that the send buffer of the socket is full, so
+     * trying again would only fail with EAGAIN. The remaining data is
+     * queued and sent once the socket becomes writable. */
   } while( (send_len > 0) &&
-           (result > 0 || errcode == INF_NATIVE_SOCKET_EINTR) &&
+           (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR) &&
            (priv->socket != INVALID_SOCKET) );
 
   *len -= send_len;
@@ -638,9 +1068,9 @@ static void
 inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 {
   InfTcpConnectionPrivate* priv;
-  gchar buf[2048];
   int errcode;
   ssize_t result;
+  gboolean full;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
 
@@ -648,7 +1078,15 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 
   do
   {
-    result = recv(priv->socket, buf, 2048, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    full = FALSE;
+
+    result = recv(
+      priv->socket,
+      priv->recv_buf,
+      priv->recv_alloc,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
     if(result < 0 &&
@@ -667,12 +1105,26 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
         G_OBJECT(connection),
         tcp_connection_signals[RECEIVED],
         0,
-        buf,
+        priv->recv_buf,
         (guint)result
       );
+
+      /* If the buffer was filled completely then there is probably more
+       * data waiting, so read more of it at once next time. */
+      full = ((gsize)result == priv->recv_alloc);
+      if(full && priv->recv_alloc < INF_TCP_CONNECTION_RECV_BUFFER_MAX_SIZE)
+      {
+        priv->recv_alloc *= 2;
+        priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+      }
     }
-  } while( ((result > 0) ||
-            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
+
+    /* If less than a full buffer was read, then the socket has been drained
+     * and another recv() would only fail with EAGAIN. Watches are
+     * level-triggered, so if more data arrives in the meanwhile we are
+     * notified again in the next iteration. This saves one system call for
+     * each batch of incoming data. */
+  } while( (full || (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
            (priv->status != INF_TCP_CONNECTION_CLOSED));
 }
 
@@ -686,6 +1138,7 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
 
   gconstpointer data;
   guint data_len;
+  gboolean update;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
   switch(priv->status)
@@ -717,6 +1170,7 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
     if(inf_tcp_connection_send_real(connection, data, &data_len) == TRUE)
     {
       priv->back_pos += data_len;
+      update = FALSE;
 
       if(priv->front_pos == priv->back_pos)
       {
@@ -725,9 +1179,15 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
         priv->back_pos = 0;
 
         priv->events &= ~INF_IO_OUTGOING;
+        update = TRUE;
+      }
+
+      /* Resume reading if enough has been sent */
+      if(inf_tcp_connection_apply_watermarks(connection))
+        update = TRUE;
 
+      if(update)
         inf_io_update_watch(priv->io, priv->watch, priv->events);
-      }
 
       g_signal_emit(
         G_OBJECT(connection),
@@ -842,18 +1302,17 @@ inf_tcp_connection_resolved_cb(InfNameResolver* resolver,
   {
     if(error != NULL)
     {
-      /* If there was an error, no additional addresses are available */
-      g_assert(
-        priv->resolver_index == inf_name_resolver_get_n_addresses(resolver)
-      );
-
-      inf_tcp_connection_connection_error(connection, error);
+      /* If there was an error, no additional addresses are available. Fail
+       * unless one of the running attempts still succeeds. */
+      inf_tcp_connection_set_attempt_error(connection, g_error_copy(error));
+      if(priv->attempts == NULL)
+        inf_tcp_connection_attempts_failed(connection);
     }
-    else
+    else if(priv->attempts == NULL || priv->attempt_timeout == NULL)
     {
-      /* If there was no error, try opening a connection to the resolved
-       * address(es). */
-      inf_tcp_connection_open_with_resolver(connection, NULL);
+      /* If there was no error, try connecting to the new address(es),
+       * unless the running attempt is still within its delay. */
+      inf_tcp_connection_start_attempt(connection);
     }
   }
 }
@@ -902,6 +1361,10 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->watch = NULL;
   priv->resolver = NULL;
   priv->resolver_index = 0;
+  priv->attempts = NULL;
+  priv->attempt_timeout = NULL;
+  priv->attempted = g_array_new(FALSE, FALSE, sizeof(guint));
+  priv->attempt_error = NULL;
   priv->status = INF_TCP_CONNECTION_CLOSED;
   priv->socket = INVALID_SOCKET;
   priv->keepalive.mask = 0;
@@ -914,6 +1377,14 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->front_pos = 0;
   priv->back_pos = 0;
   priv->alloc = 1024;
+
+  priv->high_watermark = 0;
+  priv->held = FALSE;
+  priv->backlog = 0;
+  priv->low_watermark = 0;
+
+  priv->recv_buf = g_malloc(INF_TCP_CONNECTION_RECV_BUFFER_INITIAL_SIZE);
+  priv->recv_alloc = INF_TCP_CONNECTION_RECV_BUFFER_INITIAL_SIZE;
 }
 
 static void
@@ -954,7 +1425,11 @@ inf_tcp_connection_finalize(GObject* object)
   if(priv->socket != INVALID_SOCKET)
     closesocket(priv->socket);
 
+  g_assert(priv->attempts == NULL);
+  g_array_free(priv->attempted, TRUE);
+
   g_free(priv->queue);
+  g_free(priv->recv_buf);
 
   G_OBJECT_CLASS(inf_tcp_connection_parent_class)->finalize(object);
 }
@@ -1128,6 +1603,12 @@ inf_tcp_connection_get_property(GObject* object,
   case PROP_DEVICE_INDEX:
     g_value_set_uint(value, priv->device_index);
     break;
+  case PROP_HIGH_WATERMARK:
+    g_value_set_uint(value, priv->high_watermark);
+    break;
+  case PROP_LOW_WATERMARK:
+    g_value_set_uint(value, priv->low_watermark);
+    break;
   case PROP_DEVICE_NAME:
 #ifdef G_OS_WIN32
     /* TODO: We can probably implement this using GetInterfaceInfo() */
@@ -1331,6 +1812,35 @@ inf_tcp_connection_class_init(InfTcpConnectionClass* tcp_connection_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_HIGH_WATERMARK,
+    g_param_spec_uint(
+      "high-watermark",
+      "High watermark",
+      "The number of bytes in the send buffer at which reading is paused, "
+      "or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_LOW_WATERMARK,
+    g_param_spec_uint(
+      "low-watermark",
+      "Low watermark",
+      "The number of bytes in the send buffer at which reading is resumed",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfTcpConnection::sent:
    * @connection: The #InfTcpConnection through which the data has been sent.
@@ -1588,6 +2098,9 @@ inf_tcp_connection_close(InfTcpConnection* connection)
     priv->watch = NULL;
   }
 
+  inf_tcp_connection_abort_attempts(connection);
+  priv->resolver_index = 0;
+
   priv->front_pos = 0;
   priv->back_pos = 0;
 
@@ -1614,6 +2127,7 @@ inf_tcp_connection_send(InfTcpConnection* connection,
   InfTcpConnectionPrivate* priv;
   gconstpointer sent_data;
   guint sent_len;
+  InfIoEvent events;
 
   g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
   g_return_if_fail(len == 0 || data != NULL);
@@ -1687,11 +2201,14 @@ inf_tcp_connection_send(InfTcpConnection* connection,
     memcpy(priv->queue + priv->front_pos, data, len);
     priv->front_pos += len;
 
-    if(~priv->events & INF_IO_OUTGOING)
-    {
-      priv->events |= INF_IO_OUTGOING;
+    events = priv->events;
+    priv->events |= INF_IO_OUTGOING;
+
+    /* Stop reading if too much data is queued */
+    inf_tcp_connection_apply_watermarks(connection);
+
+    if(priv->events != events)
       inf_io_update_watch(priv->io, priv->watch, priv->events);
-    }
   }
 
   if(sent_len > 0)
@@ -1797,15 +2314,74 @@ inf_tcp_connection_get_keepalive(InfTcpConnection* connection)
   return &INF_TCP_CONNECTION_PRIVATE(connection)->keepalive;
 }
 
+/**
+ * inf_tcp_connection_set_watermarks:
+ * @connection: A #InfTcpConnection.
+ * @high_watermark: The number of buffered bytes at which to stop reading, or
+ * 0 for no limit.
+ * @low_watermark: The number of buffered bytes at which to resume reading.
+ *
+ * Bounds the amount of data that is buffered for sending on @connection.
+ * When at least @high_watermark bytes are waiting to be sent, then no more
+ * data is read from the connection, and #InfTcpConnection::received is not
+ * emitted, until the buffer has drained to @low_watermark bytes or less.
+ * The data that would have been received then stays in the kernel, and
+ * eventually TCP flow control makes the remote host stop sending. Messages
+ * that a #InfCommunicationRegistry holds back for an #InfXmppConnection on
+ * top of @connection count towards the watermarks as well.
+ *
+ * This can be used to keep a remote host that does not read its data from
+ * making the local host buffer replies without limit. @low_watermark must be
+ * smaller than @high_watermark unless @high_watermark is 0.
+ */
+void
+inf_tcp_connection_set_watermarks(InfTcpConnection* connection,
+                                  guint high_watermark,
+                                  guint low_watermark)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  g_return_if_fail(high_watermark == 0 || low_watermark < high_watermark);
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_object_freeze_notify(G_OBJECT(connection));
+
+  if(priv->high_watermark != high_watermark)
+  {
+    priv->high_watermark = high_watermark;
+    g_object_notify(G_OBJECT(connection), "high-watermark");
+  }
+
+  if(priv->low_watermark != low_watermark)
+  {
+    priv->low_watermark = low_watermark;
+    g_object_notify(G_OBJECT(connection), "low-watermark");
+  }
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED &&
+     inf_tcp_connection_apply_watermarks(connection))
+  {
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+
+  g_object_thaw_notify(G_OBJECT(connection));
+}
+
 /* Creates a new TCP connection from an accepted socket. This is only used
  * by InfdTcpServer and should not be considered regular API. Do not call
- * this function. Language bindings should not wrap it. */
+ * this function. Language bindings should not wrap it. If configured is
+ * TRUE, then the socket is already non-blocking and has keepalive set
+ * according to keepalive. port is 0 for connections accepted on a Unix
+ * domain socket. */
 InfTcpConnection*
 _inf_tcp_connection_accepted(InfIo* io,
                              InfNativeSocket socket,
                              InfIpAddress* address,
                              guint port,
                              const InfKeepalive* keepalive,
+                             gboolean configured,
                              GError** error)
 {
   InfTcpConnection* connection;
@@ -1817,11 +2393,11 @@ _inf_tcp_connection_accepted(InfIo* io,
   g_return_val_if_fail(address != NULL, NULL);
   g_return_val_if_fail(keepalive != NULL, NULL);
 
-  if(inf_tcp_connection_configure_socket(socket, keepalive, error) != TRUE)
-    return NULL;
+  if(!configured)
+    if(inf_tcp_connection_configure_socket(socket, keepalive, error) != TRUE)
+      return NULL;
 
   g_return_val_if_fail(address != NULL, NULL);
-  g_return_val_if_fail(port != 0, NULL);
 
   connection = inf_tcp_connection_new(io, address, port);
 
@@ -1835,4 +2411,71 @@ _inf_tcp_connection_accepted(InfIo* io,
   return connection;
 }
 
+/* Returns the socket of a connected connection, so that InfXmppConnection
+ * can configure kernel TLS on it. If data is still waiting in the send
+ * buffer, INVALID_SOCKET is returned instead, since that data would
+ * otherwise end up being processed by the newly configured socket. This is
+ * not regular API either. */
+InfNativeSocket
+_inf_tcp_connection_get_idle_socket(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_TCP_CONNECTION(connection), INVALID_SOCKET);
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->status != INF_TCP_CONNECTION_CONNECTED)
+    return INVALID_SOCKET;
+  if(priv->front_pos != priv->back_pos)
+    return INVALID_SOCKET;
+
+  return priv->socket;
+}
+
+/* Stops or resumes reading from a connected connection. While held, the
+ * incoming data stays in the kernel and #InfTcpConnection::received is not
+ * emitted, but errors and disconnection are still noticed. InfdXmppServer
+ * uses this to make accepted connections wait before their handshake
+ * starts. This is not regular API either. */
+void
+_inf_tcp_connection_set_held(InfTcpConnection* connection,
+                             gboolean held)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  priv->held = held;
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED &&
+     inf_tcp_connection_apply_watermarks(connection))
+  {
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+}
+
+/* Sets the number of bytes that a higher layer has queued for the
+ * connection, but not yet passed to inf_tcp_connection_send(). They count
+ * towards the watermarks in addition to the send buffer.
+ * InfCommunicationRegistry uses this for the messages it holds back until
+ * earlier ones have been sent. This is not regular API either. */
+void
+_inf_tcp_connection_set_backlog(InfTcpConnection* connection,
+                                gsize backlog)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  priv->backlog = backlog;
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED &&
+     inf_tcp_connection_apply_watermarks(connection))
+  {
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+}
+
 /* vim:set et sw=2 ts=2: */
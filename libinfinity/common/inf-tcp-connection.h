@@ -145,6 +145,11 @@ inf_tcp_connection_set_keepalive(InfTcpConnection* connection,
 const InfKeepalive*
 inf_tcp_connection_get_keepalive(InfTcpConnection* connection);
 
+void
+inf_tcp_connection_set_watermarks(InfTcpConnection* connection,
+                                  guint high_watermark,
+                                  guint low_watermark);
+
 G_END_DECLS
 
 #endif /* __INF_TCP_CONNECTION_H__ */
@@ -20,8 +20,6 @@
 #include <libinfinity/common/inf-user-table.h>
 #include <libinfinity/inf-signals.h>
 
-#include <string.h>
-
 /**
  * SECTION:inf-user-table
  * @title: InfUserTable
@@ -42,13 +40,28 @@ struct _InfUserTableForeachUserData {
   gpointer user_data;
 };
 
+/* Bookkeeping for a user in the table, so that changes of the user's
+ * availability and locality can be handled without searching lists. */
+typedef struct _InfUserTableEntry InfUserTableEntry;
+struct _InfUserTableEntry {
+  InfUser* user;
+  /* The name the entry is stored under in the name index. This is updated
+   * when the user's name changes. */
+  gchar* name;
+  gboolean available;
+  /* Link in the list of local users, or NULL if the user is not local */
+  GList* local_link;
+};
+
 typedef struct _InfUserTablePrivate InfUserTablePrivate;
 struct _InfUserTablePrivate {
+  /* user ID -> InfUserTableEntry */
   GHashTable* table;
-  /* TODO: It would be smarter to map the hash table to a helper struct
-   * which stores the user availability, locality and the InfUser object */
-  GSList* availables;
-  GSList* locals;
+  /* user name -> GQueue of InfUserTableEntry with that name. Usually
+   * there is only one, but the table does not enforce unique names. */
+  GHashTable* names;
+  /* InfUser, in the order in which they became local */
+  GQueue locals;
 };
 
 enum {
@@ -81,26 +94,44 @@ inf_user_table_is_local(InfUser* user)
   return TRUE;
 }
 
+static InfUserTableEntry*
+inf_user_table_lookup_entry(InfUserTable* user_table,
+                            InfUser* user)
+{
+  InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
+
+  priv = INF_USER_TABLE_PRIVATE(user_table);
+
+  entry = g_hash_table_lookup(
+    priv->table,
+    GUINT_TO_POINTER(inf_user_get_id(user))
+  );
+
+  g_assert(entry != NULL && entry->user == user);
+  return entry;
+}
+
 static void
 inf_user_table_check_local_cb(GObject* object,
                               GParamSpec* pspec,
                               gpointer user_data)
 {
   InfUserTable* user_table;
-  InfUserTablePrivate* priv;
   InfUser* user;
-  GSList* available_item;
-  GSList* local_item;
+  InfUserTableEntry* entry;
+  gboolean was_available;
+  gboolean was_local;
 
   user_table = INF_USER_TABLE(user_data);
-  priv = INF_USER_TABLE_PRIVATE(user_table);
   user = INF_USER(object);
+  entry = inf_user_table_lookup_entry(user_table, user);
 
-  available_item = g_slist_find(priv->availables, user);
-  local_item = g_slist_find(priv->locals, user);
+  was_available = entry->available;
+  was_local = (entry->local_link != NULL);
 
   if(inf_user_get_status(user) != INF_USER_UNAVAILABLE &&
-     available_item == NULL)
+     was_available == FALSE)
   {
     g_signal_emit(
       G_OBJECT(user_table),
@@ -110,7 +141,7 @@ inf_user_table_check_local_cb(GObject* object,
     );
   }
 
-  if(inf_user_table_is_local(INF_USER(object)) && local_item == NULL)
+  if(inf_user_table_is_local(INF_USER(object)) && was_local == FALSE)
   {
     g_signal_emit(
       G_OBJECT(user_table),
@@ -120,7 +151,7 @@ inf_user_table_check_local_cb(GObject* object,
     );
   }
   
-  if(!inf_user_table_is_local(INF_USER(object)) && local_item != NULL)
+  if(!inf_user_table_is_local(INF_USER(object)) && was_local == TRUE)
   {
     g_signal_emit(
       G_OBJECT(user_table),
@@ -131,7 +162,7 @@ inf_user_table_check_local_cb(GObject* object,
   }
 
   if(inf_user_get_status(user) == INF_USER_UNAVAILABLE &&
-     available_item != NULL)
+     was_available == TRUE)
   {
     g_signal_emit(
       G_OBJECT(user_table),
@@ -143,16 +174,80 @@ inf_user_table_check_local_cb(GObject* object,
 }
 
 static void
-inf_user_table_unref_user(InfUserTable* user_table,
-                          InfUser* user)
+inf_user_table_add_name(InfUserTable* user_table,
+                        InfUserTableEntry* entry)
+{
+  InfUserTablePrivate* priv;
+  GQueue* entries;
+
+  priv = INF_USER_TABLE_PRIVATE(user_table);
+  entries = g_hash_table_lookup(priv->names, entry->name);
+
+  if(entries == NULL)
+  {
+    entries = g_queue_new();
+    g_hash_table_insert(priv->names, g_strdup(entry->name), entries);
+  }
+
+  g_queue_push_tail(entries, entry);
+}
+
+static void
+inf_user_table_remove_name(InfUserTable* user_table,
+                           InfUserTableEntry* entry)
+{
+  InfUserTablePrivate* priv;
+  GQueue* entries;
+
+  priv = INF_USER_TABLE_PRIVATE(user_table);
+  entries = g_hash_table_lookup(priv->names, entry->name);
+  g_assert(entries != NULL);
+
+  g_queue_remove(entries, entry);
+
+  /* Keep the name as long as another user still has it */
+  if(g_queue_is_empty(entries))
+    g_hash_table_remove(priv->names, entry->name);
+}
+
+static void
+inf_user_table_notify_name_cb(GObject* object,
+                              GParamSpec* pspec,
+                              gpointer user_data)
+{
+  InfUserTable* user_table;
+  InfUserTableEntry* entry;
+
+  user_table = INF_USER_TABLE(user_data);
+  entry = inf_user_table_lookup_entry(user_table, INF_USER(object));
+
+  inf_user_table_remove_name(user_table, entry);
+
+  g_free(entry->name);
+  entry->name = g_strdup(inf_user_get_name(entry->user));
+
+  inf_user_table_add_name(user_table, entry);
+}
+
+static void
+inf_user_table_free_entry(InfUserTable* user_table,
+                          InfUserTableEntry* entry)
 {
   inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(user),
+    G_OBJECT(entry->user),
     G_CALLBACK(inf_user_table_check_local_cb),
     user_table
   );
 
-  g_object_unref(user);
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(entry->user),
+    G_CALLBACK(inf_user_table_notify_name_cb),
+    user_table
+  );
+
+  g_object_unref(entry->user);
+  g_free(entry->name);
+  g_slice_free(InfUserTableEntry, entry);
 }
 
 static void
@@ -160,25 +255,16 @@ inf_user_table_dispose_foreach_func(gpointer key,
                                     gpointer value,
                                     gpointer user_data)
 {
-  inf_user_table_unref_user(INF_USER_TABLE(user_data), INF_USER(value));
+  inf_user_table_free_entry(
+    INF_USER_TABLE(user_data),
+    (InfUserTableEntry*)value
+  );
 }
 
 /*
  * User table callbacks.
  */
 
-static gboolean
-inf_user_table_lookup_user_by_name_func(gpointer key,
-                                        gpointer value,
-                                        gpointer data)
-{
-  const gchar* user_name;
-  user_name = inf_user_get_name(INF_USER(value));
-
-  if(strcmp(user_name, (const gchar*)data) == 0) return TRUE;
-  return FALSE;
-}
-
 static void
 inf_user_table_foreach_user_func(gpointer key,
                                  gpointer value,
@@ -187,7 +273,7 @@ inf_user_table_foreach_user_func(gpointer key,
   InfUserTableForeachUserData* data;
   data = (InfUserTableForeachUserData*)user_data;
 
-  data->func(INF_USER(value), data->user_data);
+  data->func(((InfUserTableEntry*)value)->user, data->user_data);
 }
 
 static void
@@ -197,8 +283,13 @@ inf_user_table_init(InfUserTable* user_table)
   priv = INF_USER_TABLE_PRIVATE(user_table);
 
   priv->table = g_hash_table_new_full(NULL, NULL, NULL, NULL);
-  priv->availables = NULL;
-  priv->locals = NULL;
+  priv->names = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)g_queue_free
+  );
+  g_queue_init(&priv->locals);
 }
 
 static void
@@ -210,11 +301,8 @@ inf_user_table_dispose(GObject* object)
   user_table = INF_USER_TABLE(object);
   priv = INF_USER_TABLE_PRIVATE(user_table);
 
-  g_slist_free(priv->locals);
-  priv->locals = NULL;
-
-  g_slist_free(priv->availables);
-  priv->availables = NULL;
+  g_queue_clear(&priv->locals);
+  g_hash_table_remove_all(priv->names);
 
   g_hash_table_foreach(
     priv->table,
@@ -235,6 +323,7 @@ inf_user_table_finalize(GObject* object)
   user_table = INF_USER_TABLE(object);
   priv = INF_USER_TABLE_PRIVATE(user_table);
 
+  g_hash_table_destroy(priv->names);
   g_hash_table_destroy(priv->table);
 
   G_OBJECT_CLASS(inf_user_table_parent_class)->finalize(object);
@@ -245,6 +334,7 @@ inf_user_table_add_user_handler(InfUserTable* user_table,
                                 InfUser* user)
 {
   InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
   guint id;
 
   priv = INF_USER_TABLE_PRIVATE(user_table);
@@ -253,7 +343,14 @@ inf_user_table_add_user_handler(InfUserTable* user_table,
   g_assert(id > 0);
   g_assert(g_hash_table_lookup(priv->table, GUINT_TO_POINTER(id)) == NULL);
 
-  g_hash_table_insert(priv->table, GUINT_TO_POINTER(id), user);
+  entry = g_slice_new(InfUserTableEntry);
+  entry->user = user;
+  entry->name = g_strdup(inf_user_get_name(user));
+  entry->available = FALSE;
+  entry->local_link = NULL;
+
+  g_hash_table_insert(priv->table, GUINT_TO_POINTER(id), entry);
+  inf_user_table_add_name(user_table, entry);
   g_object_ref(user);
 
   g_signal_connect(
@@ -263,6 +360,13 @@ inf_user_table_add_user_handler(InfUserTable* user_table,
     user_table
   );
 
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::name",
+    G_CALLBACK(inf_user_table_notify_name_cb),
+    user_table
+  );
+
   if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
   {
     g_signal_emit(
@@ -289,6 +393,7 @@ inf_user_table_remove_user_handler(InfUserTable* user_table,
                                    InfUser* user)
 {
   InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
   guint id;
 
   priv = INF_USER_TABLE_PRIVATE(user_table);
@@ -314,31 +419,33 @@ inf_user_table_remove_user_handler(InfUserTable* user_table,
     );
   }
 
-  inf_user_table_unref_user(user_table, user);
-  g_assert(g_hash_table_lookup(priv->table, GUINT_TO_POINTER(id)) == user);
+  entry = inf_user_table_lookup_entry(user_table, user);
   g_hash_table_remove(priv->table, GUINT_TO_POINTER(id));
+  inf_user_table_remove_name(user_table, entry);
+
+  inf_user_table_free_entry(user_table, entry);
 }
 
 static void
 inf_user_table_add_available_user(InfUserTable* user_table,
                                   InfUser* user)
 {
-  InfUserTablePrivate* priv;
-  priv = INF_USER_TABLE_PRIVATE(user_table);
+  InfUserTableEntry* entry;
+  entry = inf_user_table_lookup_entry(user_table, user);
 
-  g_assert(g_slist_find(priv->availables, user) == NULL);
-  priv->availables = g_slist_prepend(priv->availables, user);
+  g_assert(entry->available == FALSE);
+  entry->available = TRUE;
 }
 
 static void
 inf_user_table_remove_available_user(InfUserTable* user_table,
                                      InfUser* user)
 {
-  InfUserTablePrivate* priv;
-  priv = INF_USER_TABLE_PRIVATE(user_table);
+  InfUserTableEntry* entry;
+  entry = inf_user_table_lookup_entry(user_table, user);
 
-  g_assert(g_slist_find(priv->availables, user) != NULL);
-  priv->availables = g_slist_remove(priv->availables, user);
+  g_assert(entry->available == TRUE);
+  entry->available = FALSE;
 }
 
 static void
@@ -346,10 +453,14 @@ inf_user_table_add_local_user(InfUserTable* user_table,
                               InfUser* user)
 {
   InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
+
   priv = INF_USER_TABLE_PRIVATE(user_table);
+  entry = inf_user_table_lookup_entry(user_table, user);
 
-  g_assert(g_slist_find(priv->locals, user) == NULL);
-  priv->locals = g_slist_prepend(priv->locals, user);
+  g_assert(entry->local_link == NULL);
+  g_queue_push_head(&priv->locals, user);
+  entry->local_link = priv->locals.head;
 }
 
 static void
@@ -357,10 +468,14 @@ inf_user_table_remove_local_user(InfUserTable* user_table,
                                  InfUser* user)
 {
   InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
+
   priv = INF_USER_TABLE_PRIVATE(user_table);
+  entry = inf_user_table_lookup_entry(user_table, user);
 
-  g_assert(g_slist_find(priv->locals, user) != NULL);
-  priv->locals = g_slist_remove(priv->locals, user);
+  g_assert(entry->local_link != NULL);
+  g_queue_delete_link(&priv->locals, entry->local_link);
+  entry->local_link = NULL;
 }
 
 static void
@@ -593,12 +708,16 @@ inf_user_table_lookup_user_by_id(InfUserTable* user_table,
                                  guint id)
 {
   InfUserTablePrivate* priv;
+  InfUserTableEntry* entry;
 
   g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
 
   priv = INF_USER_TABLE_PRIVATE(user_table);
 
-  return INF_USER(g_hash_table_lookup(priv->table, GUINT_TO_POINTER(id)));
+  entry = g_hash_table_lookup(priv->table, GUINT_TO_POINTER(id));
+  if(entry == NULL) return NULL;
+
+  return entry->user;
 }
 
 /**
@@ -615,20 +734,17 @@ inf_user_table_lookup_user_by_name(InfUserTable* user_table,
                                    const gchar* name)
 {
   InfUserTablePrivate* priv;
-  InfUser* user;
+  GQueue* entries;
 
   g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
   g_return_val_if_fail(name != NULL, NULL);
 
   priv = INF_USER_TABLE_PRIVATE(user_table);
 
-  user = g_hash_table_find(
-    priv->table,
-    inf_user_table_lookup_user_by_name_func,
-    *(gpointer*) (gpointer) &name /* cast const away without warning */
-  );
+  entries = g_hash_table_lookup(priv->names, name);
+  if(entries == NULL) return NULL;
 
-  return user;
+  return ((InfUserTableEntry*)g_queue_peek_head(entries))->user;
 }
 
 /**
@@ -680,14 +796,14 @@ inf_user_table_foreach_local_user(InfUserTable* user_table,
                                   gpointer user_data)
 {
   InfUserTablePrivate* priv;
-  GSList* item;
+  GList* item;
 
   g_return_if_fail(INF_IS_USER_TABLE(user_table));
   g_return_if_fail(func != NULL);
 
   priv = INF_USER_TABLE_PRIVATE(user_table);
   
-  for(item = priv->locals; item != NULL; item = g_slist_next(item))
+  for(item = priv->locals.head; item != NULL; item = g_list_next(item))
     func(INF_USER(item->data), user_data);
 }
 
@@ -337,6 +337,73 @@ inf_xml_util_add_child_text(xmlNodePtr xml,
     xmlNodeAddContentLen(xml, (const xmlChar*) text, p - text);
 }
 
+/**
+ * inf_xml_util_write_child_text:
+ * @writer: A #xmlTextWriterPtr.
+ * @text: (array length=bytes): The child text to write.
+ * @bytes: The number of bytes of @text.
+ *
+ * Writes the given text as child text of the current element of @writer.
+ * Like inf_xml_util_add_child_text(), characters that are not valid in XML
+ * text are written as &lt;uchar /&gt; elements, so that the result can be
+ * read back with inf_xml_util_get_child_text().
+ *
+ * Returns: -1 on error, as for xmlTextWriterWriteString(), or 0 otherwise.
+ */
+int
+inf_xml_util_write_child_text(xmlTextWriterPtr writer,
+                              const gchar* text,
+                              gsize bytes)
+{
+  const gchar* p;
+  const gchar* next;
+  gchar* chunk;
+  gunichar ch;
+  gsize i;
+  int result;
+
+  result = 0;
+  for(i = 0, p = text; i < bytes && result >= 0; i += next - p, p = next)
+  {
+    next = inf_utf8_next_char(p);
+    ch = g_utf8_get_char(p);
+    if(!inf_xml_util_valid_xml_char(ch))
+    {
+      if(p != text)
+      {
+        chunk = g_strndup(text, p - text);
+        result = xmlTextWriterWriteString(writer, (const xmlChar*)chunk);
+        g_free(chunk);
+      }
+
+      if(result >= 0)
+        result = xmlTextWriterStartElement(writer, (const xmlChar*)"uchar");
+      if(result >= 0)
+      {
+        result = xmlTextWriterWriteFormatAttribute(
+          writer,
+          (const xmlChar*)"codepoint",
+          "%"G_GUINT32_FORMAT,
+          ch
+        );
+      }
+      if(result >= 0)
+        result = xmlTextWriterEndElement(writer);
+
+      text = next;
+    }
+  }
+
+  if(result >= 0 && p != text)
+  {
+    chunk = g_strndup(text, p - text);
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)chunk);
+    g_free(chunk);
+  }
+
+  return result < 0 ? -1 : 0;
+}
+
 /**
  * inf_xml_util_get_child_text:
  * @xml: A #xmlNodePtr
@@ -404,6 +471,100 @@ inf_xml_util_get_child_text(xmlNodePtr xml,
   return g_string_free(result, FALSE);
 }
 
+static void
+inf_xml_util_set_no_such_attribute_error(xmlNodePtr xml,
+                                         const gchar* attribute,
+                                         GError** error)
+{
+  g_set_error(
+    error,
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
+    _("Request '%s' does not contain required attribute '%s'"),
+    (const gchar*)xml->name,
+    attribute
+  );
+}
+
+/* Writes the decimal representation of value into the buffer ending at
+ * end, backwards, and returns a pointer to its first digit. The result is
+ * zero-terminated at end. This is cheaper than going through sprintf() for
+ * each number in an outgoing message. */
+static gchar*
+inf_xml_util_format_ulong(gchar* end,
+                          gulong value)
+{
+  *end = '\0';
+
+  do
+  {
+    *--end = '0' + value % 10;
+    value /= 10;
+  } while(value > 0);
+
+  return end;
+}
+
+static gchar*
+inf_xml_util_format_long(gchar* end,
+                         glong value)
+{
+  gchar* result;
+
+  if(value >= 0)
+    return inf_xml_util_format_ulong(end, value);
+
+  /* Written like this so that it also works for G_MINLONG */
+  result = inf_xml_util_format_ulong(end, (gulong)-(value + 1) + 1);
+  *--result = '-';
+  return result;
+}
+
+/* Returns the value of the attribute without copying it if it consists of a
+ * single text node, which is the case for all attributes of received
+ * messages. Otherwise, the value is copied and also stored in copy, which
+ * must then be freed with xmlFree(). This saves an allocation for each
+ * number read from a message. */
+static const xmlChar*
+inf_xml_util_peek_attribute(xmlNodePtr xml,
+                            const gchar* attribute,
+                            xmlChar** copy)
+{
+  xmlAttrPtr attr;
+
+  *copy = NULL;
+
+  attr = xmlHasProp(xml, (const xmlChar*)attribute);
+  if(attr == NULL) return NULL;
+
+  if(attr->type == XML_ATTRIBUTE_NODE &&
+     attr->children != NULL &&
+     attr->children->next == NULL &&
+     attr->children->type == XML_TEXT_NODE &&
+     attr->children->content != NULL)
+  {
+    return attr->children->content;
+  }
+
+  *copy = xmlGetProp(xml, (const xmlChar*)attribute);
+  return *copy;
+}
+
+static const xmlChar*
+inf_xml_util_peek_attribute_required(xmlNodePtr xml,
+                                     const gchar* attribute,
+                                     xmlChar** copy,
+                                     GError** error)
+{
+  const xmlChar* value;
+  value = inf_xml_util_peek_attribute(xml, attribute, copy);
+
+  if(value == NULL)
+    inf_xml_util_set_no_such_attribute_error(xml, attribute, error);
+
+  return value;
+}
+
 /**
  * inf_xml_util_get_attribute:
  * @xml: A #xmlNodePtr.
@@ -446,16 +607,7 @@ inf_xml_util_get_attribute_required(xmlNodePtr xml,
   value = xmlGetProp(xml, (const xmlChar*)attribute);
 
   if(value == NULL)
-  {
-    g_set_error(
-      error,
-      inf_request_error_quark(),
-      INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
-      _("Request '%s' does not contain required attribute '%s'"),
-      (const gchar*)xml->name,
-      attribute
-    );
-  }
+    inf_xml_util_set_no_such_attribute_error(xml, attribute, error);
 
   return value;
 }
@@ -486,14 +638,15 @@ inf_xml_util_get_attribute_int(xmlNodePtr xml,
                                gint* result,
                                GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_int(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -521,14 +674,15 @@ inf_xml_util_get_attribute_int_required(xmlNodePtr xml,
                                         gint* result,
                                         GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_int(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -550,14 +704,15 @@ inf_xml_util_get_attribute_long(xmlNodePtr xml,
                                 glong* result,
                                 GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_long(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -579,14 +734,15 @@ inf_xml_util_get_attribute_long_required(xmlNodePtr xml,
                                          glong* result,
                                          GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_long(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -608,14 +764,15 @@ inf_xml_util_get_attribute_uint(xmlNodePtr xml,
                                 guint* result,
                                 GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_uint(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -637,14 +794,15 @@ inf_xml_util_get_attribute_uint_required(xmlNodePtr xml,
                                          guint* result,
                                          GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_uint(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -666,14 +824,15 @@ inf_xml_util_get_attribute_ulong(xmlNodePtr xml,
                                  gulong* result,
                                  GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_ulong(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -695,14 +854,15 @@ inf_xml_util_get_attribute_ulong_required(xmlNodePtr xml,
                                           gulong* result,
                                           GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_ulong(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -724,14 +884,15 @@ inf_xml_util_get_attribute_double(xmlNodePtr xml,
                                   gdouble* result,
                                   GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = xmlGetProp(xml, (const xmlChar*)attribute);
+  value = inf_xml_util_peek_attribute(xml, attribute, &copy);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_double(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -754,14 +915,15 @@ inf_xml_util_get_attribute_double_required(xmlNodePtr xml,
                                            gdouble* result,
                                            GError** error)
 {
-  xmlChar* value;
+  const xmlChar* value;
+  xmlChar* copy;
   gboolean retval;
 
-  value = inf_xml_util_get_attribute_required(xml, attribute, error);
+  value = inf_xml_util_peek_attribute_required(xml, attribute, &copy, error);
   if(value == NULL) return FALSE;
 
   retval = inf_xml_util_string_to_double(attribute, value, result, error);
-  xmlFree(value);
+  if(copy != NULL) xmlFree(copy);
   return retval;
 }
 
@@ -797,10 +959,11 @@ inf_xml_util_set_attribute_int(xmlNodePtr xml,
                                const gchar* attribute,
                                gint value)
 {
-  char buffer[sizeof(gint) * 3 + 1];
-  sprintf(buffer, "%d", value);
+  gchar buffer[sizeof(gint) * 3 + 2];
+  gchar* str;
 
-  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)buffer);
+  str = inf_xml_util_format_long(buffer + sizeof(buffer) - 1, value);
+  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)str);
 }
 
 /**
@@ -817,10 +980,11 @@ inf_xml_util_set_attribute_long(xmlNodePtr xml,
                                 const gchar* attribute,
                                 glong value)
 {
-  char buffer[sizeof(glong) * 3 + 1];
-  sprintf(buffer, "%ld", value);
+  gchar buffer[sizeof(glong) * 3 + 2];
+  gchar* str;
 
-  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)buffer);
+  str = inf_xml_util_format_long(buffer + sizeof(buffer) - 1, value);
+  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)str);
 }
 
 /**
@@ -837,10 +1001,11 @@ inf_xml_util_set_attribute_uint(xmlNodePtr xml,
                                 const gchar* attribute,
                                 guint value)
 {
-  char buffer[sizeof(guint) * 3 + 1];
-  sprintf(buffer, "%u", value);
+  gchar buffer[sizeof(guint) * 3 + 1];
+  gchar* str;
 
-  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)buffer);
+  str = inf_xml_util_format_ulong(buffer + sizeof(buffer) - 1, value);
+  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)str);
 }
 
 /**
@@ -857,10 +1022,11 @@ inf_xml_util_set_attribute_ulong(xmlNodePtr xml,
                                  const gchar* attribute,
                                  gulong value)
 {
-  char buffer[sizeof(gulong) * 3 + 1];
-  sprintf(buffer, "%lu", value);
+  gchar buffer[sizeof(gulong) * 3 + 1];
+  gchar* str;
 
-  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)buffer);
+  str = inf_xml_util_format_ulong(buffer + sizeof(buffer) - 1, value);
+  xmlSetProp(xml, (const xmlChar*)attribute, (const xmlChar*)str);
 }
 
 /**
@@ -40,10 +40,12 @@
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-compression-private.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-define-enum.h>
+#include <libinfinity/inf-trace.h>
 
 #include <gnutls/x509.h>
 
@@ -53,6 +55,16 @@
 
 #include "config.h"
 
+#ifdef HAVE_KTLS
+# include <libinfinity/common/inf-tcp-connection-private.h>
+# include <sys/socket.h>
+# include <netinet/tcp.h>
+# include <linux/tls.h>
+# ifndef SOL_TLS
+#  define SOL_TLS 282
+# endif
+#endif
+
 static const GEnumValue inf_xmpp_connection_site_values[] = {
   {
     INF_XMPP_CONNECTION_CLIENT,
@@ -118,6 +130,8 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES,
   /* <starttls> request has been sent (client only) */
   INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED,
+  /* <compress> request has been sent (client only) */
+  INF_XMPP_CONNECTION_COMPRESSION_REQUESTED,
   /* TLS handshake is being performed */
   INF_XMPP_CONNECTION_HANDSHAKING,
   /* SASL authentication is in progress */
@@ -176,19 +190,40 @@ struct _InfXmppConnectionPrivate {
   InfXmppConnectionMessage* messages;
   InfXmppConnectionMessage* last_message;
 
+  /* Messages that are serialized into buf but not yet given to the TCP
+   * connection, and the dispatch that is going to do so. */
+  xmlNodePtr pending_begin;
+  xmlNodePtr pending_end;
+  InfIo* flush_io;
+  InfIoDispatch* flush_dispatch;
+
   /* XML parsing */
   guint parsing; /* Whether we are currently in an XML parser or GnuTLS callback */
   xmlParserCtxtPtr parser;
   xmlNodePtr root;
   xmlNodePtr cur;
+  /* Received messages belong to this document, which has no root element,
+   * so that element and attribute names are interned in its dictionary
+   * instead of being allocated for every message. */
+  xmlDocPtr recv_doc;
 
   /* Transport layer security */
   gnutls_session_t session;
   InfCertificateCredentials* creds;
   gnutls_x509_crt_t own_cert;
   InfCertificateChain* peer_cert;
+  /* Client only: parameters of the last TLS session, to resume it with an
+   * abbreviated handshake when the connection is reopened. */
+  gnutls_datum_t resume_data;
   const gchar* pull_data;
   gsize pull_len;
+  gchar* recv_buf;
+  gsize recv_alloc;
+  /* Whether to let the kernel encrypt outgoing records, and whether it does
+   * so for the current session. Incoming records are always decrypted by
+   * GnuTLS. */
+  gboolean kernel_tls;
+  gboolean kernel_tls_tx;
 
   /* SASL */
   InfSaslContext* sasl_context;
@@ -196,8 +231,34 @@ struct _InfXmppConnectionPrivate {
   InfSaslContextSession* sasl_session;
   gchar* sasl_local_mechanisms;
   gchar* sasl_remote_mechanisms;
+  /* Client only: Whether the server accepts an initial response in <auth>,
+   * and the <auth> element waiting for it to be computed, if any. */
+  gboolean sasl_remote_initial_response;
+  xmlNodePtr sasl_auth;
 
   GError* sasl_error;
+
+  /* Stream compression (XEP-0138). The compression is set up after TLS and
+   * before authentication, and stays in place for the rest of the
+   * connection. */
+  guint compression_level;
+  InfCompression* compression;
+  /* The method in use, kept after the connection was closed, as are the
+   * statistics below. */
+  const gchar* compression_method;
+  GByteArray* compression_buf;
+  /* Set if the stream needs to be restarted with a new XML parser once the
+   * current chunk of input has been parsed. */
+  gboolean compression_restart;
+  /* Client only: The features that the server offered when we requested
+   * compression, to go on with authentication if the server declines. */
+  xmlNodePtr compression_features;
+  gboolean compression_failed;
+
+  guint64 bytes_sent;
+  guint64 bytes_sent_compressed;
+  guint64 bytes_received;
+  guint64 bytes_received_compressed;
 };
 
 enum {
@@ -211,10 +272,14 @@ enum {
 
   PROP_TLS_ENABLED,
   PROP_CREDENTIALS,
+  PROP_KERNEL_TLS,
 
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
+  PROP_COMPRESSION_LEVEL,
+  PROP_COMPRESSION_METHOD,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -226,6 +291,34 @@ enum {
 
 #define INF_XMPP_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_XMPP_CONNECTION, InfXmppConnectionPrivate))
 
+/* Number of bytes of coalesced messages after which they are sent without
+ * waiting for the flush dispatch. This is the maximum size of a TLS
+ * record. */
+static const gsize INF_XMPP_CONNECTION_FLUSH_THRESHOLD = 16384;
+
+/* Size of the buffer that decrypted data is read into. It is grown up to
+ * the maximum TLS record size, so that a full record can be passed to the
+ * XML parser at once. */
+static const gsize INF_XMPP_CONNECTION_RECV_BUFFER_INITIAL_SIZE = 2048;
+static const gsize INF_XMPP_CONNECTION_RECV_BUFFER_MAX_SIZE = 16384;
+
+/* Number of names in the dictionary for received messages after which it
+ * is replaced by an empty one, so that a remote host sending arbitrary
+ * names cannot make it grow without bounds. The protocol itself uses far
+ * fewer names. */
+static const int INF_XMPP_CONNECTION_RECV_DICT_MAX_SIZE = 1024;
+
+/* Namespace of the stream feature with which the server announces that it
+ * accepts a SASL initial response in <auth>. */
+static const gchar INF_XMPP_CONNECTION_SASL_IR_NS[] =
+  "http://infinote.0x539.de/protocol/sasl-ir";
+
+/* Namespaces for stream compression, see XEP-0138 */
+static const gchar INF_XMPP_CONNECTION_COMPRESS_FEATURE_NS[] =
+  "http://jabber.org/features/compress";
+static const gchar INF_XMPP_CONNECTION_COMPRESS_NS[] =
+  "http://jabber.org/protocol/compress";
+
 static GQuark inf_xmpp_connection_stream_error_quark;
 static GQuark inf_xmpp_connection_auth_error_quark;
 
@@ -610,6 +703,25 @@ inf_xmpp_connection_pop_message(InfXmppConnection* connection)
   g_slice_free(InfXmppConnectionMessage, message);
 }
 
+static void
+inf_xmpp_connection_cancel_flush(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->flush_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->flush_io, priv->flush_dispatch);
+    priv->flush_dispatch = NULL;
+  }
+
+  if(priv->flush_io != NULL)
+  {
+    g_object_unref(priv->flush_io);
+    priv->flush_io = NULL;
+  }
+}
+
 /* Note that this function does not change the state of xmpp, so it might
  * rest in a state where it expects to actually have the resources available
  * that are cleared here. Be sure to adjust state after having called
@@ -634,6 +746,12 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     priv->sasl_remote_mechanisms = NULL;
   }
 
+  if(priv->sasl_auth != NULL)
+  {
+    xmlFreeNode(priv->sasl_auth);
+    priv->sasl_auth = NULL;
+  }
+
   /* Keep the certificates alive, in case they still need to be accessed after
    * the connection was closed. They are reset before a new connection is
    * made. */
@@ -657,8 +775,16 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
 
   if(priv->session != NULL)
   {
+    /* Refresh the resumption data if the handshake went through */
+    if(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
+       priv->resume_data.data != NULL)
+    {
+      inf_xmpp_connection_tls_store_resume_data(xmpp);
+    }
+
     gnutls_deinit(priv->session);
     priv->session = NULL;
+    priv->kernel_tls_tx = FALSE;
 
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
   }
@@ -676,9 +802,25 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     }
   }
 
+  if(priv->recv_doc != NULL)
+  {
+    /* This also frees the dictionary */
+    xmlFreeDoc(priv->recv_doc);
+    priv->recv_doc = NULL;
+  }
+
   while(priv->messages != NULL)
     inf_xmpp_connection_pop_message(xmpp);
 
+  inf_xmpp_connection_cancel_flush(xmpp);
+
+  if(priv->pending_begin != NULL)
+  {
+    xmlFreeNodeList(priv->pending_begin);
+    priv->pending_begin = NULL;
+    priv->pending_end = NULL;
+  }
+
   if(priv->buf != NULL)
   {
     g_assert(priv->doc != NULL);
@@ -693,15 +835,31 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  if(priv->compression != NULL)
+  {
+    _inf_compression_free(priv->compression);
+    priv->compression = NULL;
+  }
+
+  if(priv->compression_features != NULL)
+  {
+    xmlFreeNode(priv->compression_features);
+    priv->compression_features = NULL;
+  }
+
+  priv->compression_restart = FALSE;
+  priv->compression_failed = FALSE;
+
   g_object_thaw_notify(G_OBJECT(xmpp));
 }
 
 static void
-inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
-                               gconstpointer data,
-                               guint len)
+inf_xmpp_connection_send_chars_real(InfXmppConnection* xmpp,
+                                    gconstpointer data,
+                                    guint len)
 {
   InfXmppConnectionPrivate* priv;
+  GByteArray* compressed;
   ssize_t cur_bytes;
   GError* error;
 
@@ -713,17 +871,56 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
     printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
 
+  /* Compress before encrypting. The whole chunk is flushed out of the
+   * compressor, so that the positions of the messages refer to data that
+   * was actually handed to the TCP connection. The buffer is taken out of
+   * priv while in use, in case this is re-entered from a callback. */
+  compressed = NULL;
+  if(priv->compression != NULL)
+  {
+    compressed = priv->compression_buf;
+    priv->compression_buf = NULL;
+    if(compressed == NULL)
+      compressed = g_byte_array_sized_new(len);
+
+    if(!_inf_compression_compress(priv->compression, data, len, compressed))
+    {
+      g_byte_array_free(compressed, TRUE);
+
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark(),
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+        _("Failed to compress data to be sent")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      inf_tcp_connection_close(priv->tcp);
+      return;
+    }
+
+    priv->bytes_sent += len;
+    priv->bytes_sent_compressed += compressed->len;
+
+    data = compressed->data;
+    len = compressed->len;
+  }
+
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
    * down from a GnuTLS callback then we keep the GnuTLS context around
    * until the gntuls_record_send() call finishes. */
   ++priv->parsing;
 
-  if(priv->session != NULL)
+  /* With kernel TLS, plain data is written to the socket and the kernel
+   * encrypts it. */
+  if(priv->session != NULL && !priv->kernel_tls_tx)
   {
     do
     {
       cur_bytes = gnutls_record_send(priv->session, data, len);
+      INF_TRACE2(tls_record_send, xmpp, cur_bytes);
 
       if(cur_bytes < 0)
       {
@@ -758,6 +955,15 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
     inf_tcp_connection_send(priv->tcp, data, len);
   }
 
+  if(compressed != NULL)
+  {
+    g_byte_array_set_size(compressed, 0);
+    if(priv->compression_buf == NULL)
+      priv->compression_buf = compressed;
+    else
+      g_byte_array_free(compressed, TRUE);
+  }
+
   g_assert(priv->parsing > 0);
   if(--priv->parsing == 0)
   {
@@ -773,40 +979,143 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+/* Required by inf_xmpp_connection_flush */
 static void
-inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
-                             xmlNodePtr xml)
+inf_xmpp_connection_xml_connection_send_sent(InfXmppConnection* xmpp,
+                                             gpointer xml);
+
+static void
+inf_xmpp_connection_xml_connection_send_free(InfXmppConnection* xmpp,
+                                             gpointer xml);
+
+/* Sends everything that has been serialized into the XML buffer, and
+ * enqueues the pending messages so that the sent signal is emitted for them
+ * once the data has actually been sent. Since all of them are handed to the
+ * TCP connection in one go, they end up in a single TLS record and send()
+ * call. */
+static void
+inf_xmpp_connection_flush(InfXmppConnection* xmpp)
 {
   InfXmppConnectionPrivate* priv;
+  xmlNodePtr pending;
+  xmlNodePtr next;
+
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  g_return_if_fail(priv->doc != NULL);
-  g_return_if_fail(priv->buf != NULL);
+  inf_xmpp_connection_cancel_flush(xmpp);
+  if(priv->buf == NULL || xmlBufferLength(priv->buf) == 0)
+  {
+    g_assert(priv->pending_begin == NULL);
+    return;
+  }
 
-  xmlDocSetRootElement(priv->doc, xml);
-  xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
-  xmlUnlinkNode(xml);
-  xmlSetListDoc(xml, NULL);
+  pending = priv->pending_begin;
+  priv->pending_begin = NULL;
+  priv->pending_end = NULL;
 
   /* Keep the object alive during the send_chars call, so that we can check
    * the buffer variable afterwards. */
   g_object_ref(xmpp);
 
-  inf_xmpp_connection_send_chars(
+  inf_xmpp_connection_send_chars_real(
     xmpp,
     xmlBufferContent(priv->buf),
     xmlBufferLength(priv->buf)
   );
 
   /* The connection might be closed & cleared as a result from
-   * inf_xmpp_connection_send_chars(), so make sure the buffer still
+   * inf_xmpp_connection_send_chars_real(), so make sure the buffer still
    * exists before emptying it. */
   if(priv->buf != NULL)
     xmlBufferEmpty(priv->buf);
 
+  for(; pending != NULL; pending = next)
+  {
+    next = pending->next;
+    pending->next = NULL;
+
+    /* Only proceed with sent notification if the connection is still up
+     * and we could actually send the thing. */
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+    {
+      inf_xmpp_connection_push_message(
+        xmpp,
+        inf_xmpp_connection_xml_connection_send_sent,
+        inf_xmpp_connection_xml_connection_send_free,
+        pending
+      );
+    }
+    else
+    {
+      xmlFreeNode(pending);
+    }
+  }
+
   g_object_unref(xmpp);
 }
 
+static void
+inf_xmpp_connection_flush_func(gpointer user_data)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+
+  xmpp = INF_XMPP_CONNECTION(user_data);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* The dispatch is gone after this call */
+  priv->flush_dispatch = NULL;
+  inf_xmpp_connection_flush(xmpp);
+}
+
+static void
+inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* Keep the order with messages that are still waiting to be flushed */
+  if(priv->pending_begin != NULL)
+  {
+    inf_xmpp_connection_flush(xmpp);
+    if(priv->status == INF_XMPP_CONNECTION_CLOSED)
+      return;
+  }
+
+  inf_xmpp_connection_send_chars_real(xmpp, data, len);
+}
+
+static void
+inf_xmpp_connection_serialize_xml(InfXmppConnection* xmpp,
+                                  xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  xmlDocSetRootElement(priv->doc, xml);
+  xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
+  xmlUnlinkNode(xml);
+  xmlSetListDoc(xml, NULL);
+}
+
+static void
+inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
+                             xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_return_if_fail(priv->doc != NULL);
+  g_return_if_fail(priv->buf != NULL);
+
+  /* Any pending messages are in the buffer before this one, so they are
+   * sent along with it. */
+  inf_xmpp_connection_serialize_xml(xmpp, xml);
+  inf_xmpp_connection_flush(xmpp);
+}
+
 /*
  * Helper functions
  */
@@ -847,6 +1156,25 @@ inf_xmpp_connection_node_new_sasl(const gchar* name)
   );
 }
 
+static xmlNodePtr
+inf_xmpp_connection_node_new_compress(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(name, INF_XMPP_CONNECTION_COMPRESS_NS);
+}
+
+/* Returns whether we can offer (or request, as a client) stream
+ * compression at this point. */
+static gboolean
+inf_xmpp_connection_compression_available(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  return priv->compression == NULL &&
+    priv->compression_level > 0 &&
+    _inf_compression_get_methods()[0] != NULL;
+}
+
 /*
  * XMPP deinitialization
  */
@@ -867,9 +1195,11 @@ inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
            priv->status != INF_XMPP_CONNECTION_CONNECTING);
 
   /* We cannot send </stream:stream> or a gnutls bye in these states
-   * because it would interfere with the handshake. */
+   * because it would interfere with the handshake, or the remote site
+   * might already expect compressed data, respectively. */
   if(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
-     priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED)
+     priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+     priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED)
   {
     /* Session termination is not required in these states because the session
      * did not yet even begin or </stream:stream> has already been sent,
@@ -899,9 +1229,16 @@ inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
       }
     }
 
-    /* One of the send() calls above might have caused status update */
-    if(priv->status != INF_XMPP_CONNECTION_CLOSED && priv->session != NULL)
+    /* One of the send() calls above might have caused status update. If
+     * the kernel encrypts outgoing records, GnuTLS can no longer send the
+     * closure alert. This is not a problem, since the end of the session
+     * is already marked by </stream:stream>, and a remote site in the
+     * CLOSING_GNUTLS state does not read any further anyway. */
+    if(priv->status != INF_XMPP_CONNECTION_CLOSED &&
+       priv->session != NULL && !priv->kernel_tls_tx)
+    {
       gnutls_bye(priv->session, GNUTLS_SHUT_WR);
+    }
   }
 
   /* Clear resources such as GnuTLS session and XML parser */
@@ -998,7 +1335,8 @@ inf_xmpp_connection_terminate_error(InfXmppConnection* xmpp,
   g_assert(priv->parser != NULL);
 
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
-           priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED);
+           priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+           priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
 
   error = NULL;
   g_set_error_literal(
@@ -1064,8 +1402,10 @@ inf_xmpp_connection_deinitiate(InfXmppConnection* xmpp)
   if(priv->status == INF_XMPP_CONNECTION_AUTHENTICATING)
   {
     /* If the SASL session is NULL then we have already aborted the
-     * authentication but are still waiting for the server to acknowledge. */
-    if(priv->sasl_session != NULL)
+     * authentication but are still waiting for the server to acknowledge.
+     * If the <auth> element is still pending, then the server does not know
+     * about the authentication yet, so there is nothing to abort. */
+    if(priv->sasl_session != NULL && priv->sasl_auth == NULL)
     {
       /* Abort authentication before sending </stream:stream>. */
       /* TODO: Wait for response of the abort before sending </stream:stream> */
@@ -1088,6 +1428,40 @@ inf_xmpp_connection_deinitiate(InfXmppConnection* xmpp)
  * GnuTLS setup
  */
 
+static void
+inf_xmpp_connection_tls_clear_resume_data(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->resume_data.data != NULL)
+  {
+    gnutls_free(priv->resume_data.data);
+    priv->resume_data.data = NULL;
+    priv->resume_data.size = 0;
+  }
+}
+
+static void
+inf_xmpp_connection_tls_store_resume_data(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  gnutls_datum_t data;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->session != NULL);
+
+  /* With TLS 1.3, the server sends the session ticket after the handshake,
+   * so this is called both after the handshake and before the session is
+   * closed, to pick up the ticket in the latter case. */
+  if(priv->site == INF_XMPP_CONNECTION_CLIENT &&
+     gnutls_session_get_data2(priv->session, &data) == 0)
+  {
+    inf_xmpp_connection_tls_clear_resume_data(xmpp);
+    priv->resume_data = data;
+  }
+}
+
 /* Required by inf_xmpp_connection_tls_handshake */
 static void
 inf_xmpp_connection_initiate(InfXmppConnection* xmpp);
@@ -1114,6 +1488,15 @@ inf_xmpp_connection_tls_push(gnutls_transport_ptr_t ptr,
   xmpp = INF_XMPP_CONNECTION(ptr);
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
+  /* The kernel keeps the sequence number of outgoing records, so GnuTLS
+   * cannot send records of its own anymore, such as a TLS 1.3 key update.
+   * Let the GnuTLS call fail, which brings down the connection. */
+  if(priv->kernel_tls_tx)
+  {
+    gnutls_transport_set_errno(priv->session, EIO);
+    return -1;
+  }
+
   priv->position += len;
   inf_tcp_connection_send(priv->tcp, data, len);
 
@@ -1261,6 +1644,144 @@ inf_xmpp_connection_tls_import_peer_certificate(InfXmppConnection* xmpp,
   return inf_certificate_chain_new(certs, list_size);
 }
 
+static void
+#ifdef HAVE_KTLS
+/* Hands the encryption of outgoing records over to the kernel, using the
+ * keys that GnuTLS negotiated. Returns FALSE if this is not possible, in
+ * which case GnuTLS goes on to encrypt in userspace as before. */
+static gboolean
+inf_xmpp_connection_tls_enable_kernel_tx(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  InfNativeSocket socket;
+  gnutls_protocol_t protocol;
+  gnutls_cipher_algorithm_t cipher;
+  gnutls_datum_t mac_key;
+  gnutls_datum_t iv;
+  gnutls_datum_t cipher_key;
+  unsigned char seq_number[8];
+  struct tls12_crypto_info_aes_gcm_128 info128;
+  struct tls12_crypto_info_aes_gcm_256 info256;
+  struct tls_crypto_info* info;
+  unsigned char* info_iv;
+  unsigned char* info_key;
+  unsigned char* info_salt;
+  unsigned char* info_rec_seq;
+  socklen_t info_size;
+  gsize key_size;
+  int ret;
+
+  /* The salt and the explicit IV have the same size for both key sizes */
+  G_STATIC_ASSERT(
+    TLS_CIPHER_AES_GCM_128_SALT_SIZE == TLS_CIPHER_AES_GCM_256_SALT_SIZE
+  );
+  G_STATIC_ASSERT(
+    TLS_CIPHER_AES_GCM_128_IV_SIZE == TLS_CIPHER_AES_GCM_256_IV_SIZE
+  );
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  cipher = gnutls_cipher_get(priv->session);
+  switch(cipher)
+  {
+  case GNUTLS_CIPHER_AES_128_GCM:
+    memset(&info128, 0, sizeof(info128));
+    info128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    info = &info128.info;
+    info_iv = info128.iv;
+    info_key = info128.key;
+    info_salt = info128.salt;
+    info_rec_seq = info128.rec_seq;
+    info_size = sizeof(info128);
+    key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+    break;
+  case GNUTLS_CIPHER_AES_256_GCM:
+    memset(&info256, 0, sizeof(info256));
+    info256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+    info = &info256.info;
+    info_iv = info256.iv;
+    info_key = info256.key;
+    info_salt = info256.salt;
+    info_rec_seq = info256.rec_seq;
+    info_size = sizeof(info256);
+    key_size = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+    break;
+  default:
+    return FALSE;
+  }
+
+  protocol = gnutls_protocol_get_version(priv->session);
+  switch(protocol)
+  {
+  case GNUTLS_TLS1_2:
+    info->version = TLS_1_2_VERSION;
+    break;
+#if defined(TLS_1_3_VERSION) && GNUTLS_VERSION_NUMBER >= 0x030603
+  case GNUTLS_TLS1_3:
+    info->version = TLS_1_3_VERSION;
+    break;
+#endif
+  default:
+    return FALSE;
+  }
+
+  /* Records that GnuTLS encrypted already must not be encrypted again */
+  socket = _inf_tcp_connection_get_idle_socket(priv->tcp);
+  if(socket == INVALID_SOCKET)
+    return FALSE;
+
+  ret = gnutls_record_get_state(
+    priv->session,
+    0,
+    &mac_key,
+    &iv,
+    &cipher_key,
+    seq_number
+  );
+
+  if(ret != GNUTLS_E_SUCCESS || cipher_key.size != key_size ||
+     iv.size < TLS_CIPHER_AES_GCM_128_SALT_SIZE)
+  {
+    return FALSE;
+  }
+
+  /* With TLS 1.2, the explicit part of the nonce is the sequence number,
+   * with TLS 1.3 it is the rest of the IV. */
+  memcpy(info_salt, iv.data, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+  if(protocol == GNUTLS_TLS1_2)
+  {
+    memcpy(info_iv, seq_number, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+  }
+  else
+  {
+    if(iv.size < TLS_CIPHER_AES_GCM_128_SALT_SIZE +
+                 TLS_CIPHER_AES_GCM_128_IV_SIZE)
+    {
+      return FALSE;
+    }
+
+    memcpy(
+      info_iv,
+      iv.data + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+      TLS_CIPHER_AES_GCM_128_IV_SIZE
+    );
+  }
+
+  memcpy(info_key, cipher_key.data, key_size);
+  memcpy(info_rec_seq, seq_number, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+
+  /* If the kernel does not support the TLS ULP, this fails, and nothing
+   * has changed. If only setting the keys fails, the ULP stays in place but
+   * passes data through unmodified. */
+  ret = setsockopt(socket, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+  if(ret == 0)
+    ret = setsockopt(socket, SOL_TLS, TLS_TX, info, info_size);
+
+  gnutls_memset(info_key, 0, key_size);
+  return ret == 0;
+}
+#endif
+
 static void
 inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
 {
@@ -1285,6 +1806,13 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
     priv->status = INF_XMPP_CONNECTION_CONNECTED;
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
 
+    inf_xmpp_connection_tls_store_resume_data(xmpp);
+
+#ifdef HAVE_KTLS
+    if(priv->kernel_tls)
+      priv->kernel_tls_tx = inf_xmpp_connection_tls_enable_kernel_tx(xmpp);
+#endif
+
     error = NULL;
 
     /* Extract own certificate */
@@ -1357,6 +1885,9 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
     inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
     g_error_free(error);
 
+    /* Do not try to resume a session that led to a failed handshake */
+    inf_xmpp_connection_tls_clear_resume_data(xmpp);
+
     gnutls_deinit(priv->session);
     priv->session = NULL;
 
@@ -1410,10 +1941,33 @@ inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
   {
   case INF_XMPP_CONNECTION_CLIENT:
     gnutls_init(&priv->session, GNUTLS_CLIENT);
+#if GNUTLS_VERSION_NUMBER < 0x030000
+    /* Enabled by default in GnuTLS 3 */
+    gnutls_session_ticket_enable_client(priv->session);
+#endif
+
+    /* If we have been connected before, then try to resume the previous
+     * session, which saves the certificate exchange and key agreement. If
+     * the server does not accept it, GnuTLS falls back to a full
+     * handshake. */
+    if(priv->resume_data.data != NULL)
+    {
+      gnutls_session_set_data(
+        priv->session,
+        priv->resume_data.data,
+        priv->resume_data.size
+      );
+    }
+
     break;
   case INF_XMPP_CONNECTION_SERVER:
     gnutls_init(&priv->session, GNUTLS_SERVER);
 
+    gnutls_session_ticket_enable_server(
+      priv->session,
+      inf_certificate_credentials_get_session_ticket_key(priv->creds)
+    );
+
     /* If the user wants to check the client's certificate, then require
      * that the client sends one. */
     if(priv->certificate_callback != NULL)
@@ -1504,6 +2058,12 @@ inf_xmpp_connection_sasl_finish(InfXmppConnection* xmpp,
     priv->sasl_session = NULL;
   }
 
+  if(priv->sasl_auth != NULL)
+  {
+    xmlFreeNode(priv->sasl_auth);
+    priv->sasl_auth = NULL;
+  }
+
   if(success)
   {
     if(priv->sasl_error != NULL)
@@ -1671,6 +2231,56 @@ inf_xmpp_connection_sasl_ensure(InfXmppConnection* xmpp)
   return TRUE;
 }
 
+/* Returns whether the client sends the first message in mechanism, so that
+ * it can be sent along with <auth> if the server supports that. */
+static gboolean
+inf_xmpp_connection_sasl_is_client_first(const gchar* mechanism)
+{
+  return g_ascii_strcasecmp(mechanism, "ANONYMOUS") == 0 ||
+         g_ascii_strcasecmp(mechanism, "PLAIN") == 0 ||
+         g_ascii_strcasecmp(mechanism, "EXTERNAL") == 0;
+}
+
+static void
+inf_xmpp_connection_sasl_initial_feed_func(InfSaslContextSession* session,
+                                           const char* data,
+                                           gboolean needs_more,
+                                           const GError* error,
+                                           gpointer user_data)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+
+  xmpp = INF_XMPP_CONNECTION(user_data);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_AUTHENTICATING);
+  g_assert(priv->sasl_auth != NULL);
+
+  if(error)
+  {
+    inf_xmpp_connection_sasl_error(xmpp, error);
+  }
+  else
+  {
+    /* An empty initial response is sent as "=", RFC 6120, 6.4.2. No
+     * content at all means that there is no initial response. */
+    if(data != NULL)
+    {
+      if(*data == '\0')
+        xmlNodeAddContent(priv->sasl_auth, (const xmlChar*)"=");
+      else
+        xmlNodeAddContent(priv->sasl_auth, (const xmlChar*)data);
+    }
+
+    inf_xmpp_connection_send_xml(xmpp, priv->sasl_auth);
+    xmlFreeNode(priv->sasl_auth);
+    priv->sasl_auth = NULL;
+
+    /* Wait for <success> or <challenge> from server */
+  }
+}
+
 static void
 inf_xmpp_connection_sasl_request_feed_func(InfSaslContextSession* session,
                                            const char* data,
@@ -1778,7 +2388,8 @@ inf_xmpp_connection_sasl_request(InfXmppConnection* xmpp,
 
 static void
 inf_xmpp_connection_sasl_init(InfXmppConnection* xmpp,
-                              const gchar* mechanism)
+                              const gchar* mechanism,
+                              const gchar* initial_response)
 {
   InfXmppConnectionPrivate* priv;
   InfIo* io;
@@ -1812,8 +2423,20 @@ inf_xmpp_connection_sasl_init(InfXmppConnection* xmpp,
       (const xmlChar*)mechanism
     );
 
-    inf_xmpp_connection_send_xml(xmpp, auth);
-    xmlFreeNode(auth);
+    /* If possible, compute the first response before sending <auth>, and
+     * send it along, to save the round trip for the initial challenge.
+     * Otherwise wait for the server to start. */
+    if(priv->sasl_remote_initial_response &&
+       inf_xmpp_connection_sasl_is_client_first(mechanism))
+    {
+      g_assert(priv->sasl_auth == NULL);
+      priv->sasl_auth = auth;
+    }
+    else
+    {
+      inf_xmpp_connection_send_xml(xmpp, auth);
+      xmlFreeNode(auth);
+    }
 
     g_assert(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES);
 
@@ -1856,9 +2479,21 @@ inf_xmpp_connection_sasl_init(InfXmppConnection* xmpp,
   {
     priv->status = INF_XMPP_CONNECTION_AUTHENTICATING;
 
-    /* Begin on server site */
+    /* Begin on server site, with the client's initial response if it sent
+     * one. */
     if(priv->site == INF_XMPP_CONNECTION_SERVER)
-      inf_xmpp_connection_sasl_request(xmpp, NULL);
+    {
+      inf_xmpp_connection_sasl_request(xmpp, initial_response);
+    }
+    else if(priv->sasl_auth != NULL)
+    {
+      inf_sasl_context_session_feed(
+        priv->sasl_session,
+        NULL,
+        inf_xmpp_connection_sasl_initial_feed_func,
+        xmpp
+      );
+    }
   }
 }
 
@@ -1881,7 +2516,7 @@ inf_xmpp_connection_process_start_element(InfXmppConnection* xmpp,
   const xmlChar* attr_value;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
-  node = xmlNewNode(NULL, name);
+  node = xmlNewDocNode(priv->recv_doc, NULL, name, NULL);
 
   if(attrs != NULL)
   {
@@ -1932,6 +2567,9 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   xmlNodePtr starttls;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
+  xmlNodePtr sasl_ir;
+  xmlNodePtr compression;
+  const gchar* const* method;
   gchar* mechanism_dup;
   GError* error;
 
@@ -1966,8 +2604,10 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   features = xmlNewNode(NULL, (const xmlChar*)"stream:features");
 
-  /* Don't offer TLS if we have already authenticated. It's pointless now. */
-  if(priv->session == NULL &&
+  /* Don't offer TLS if we have already authenticated. It's pointless now.
+   * Also don't offer it once compression is enabled, since TLS needs to
+   * be below the compression layer. */
+  if(priv->session == NULL && priv->compression == NULL &&
      priv->status != INF_XMPP_CONNECTION_AUTH_INITIATED)
   {
     if(priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
@@ -2049,12 +2689,45 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
           xmlNodeAddContentLen(mechanism, (const xmlChar*)begin, end - begin);
         }
 
-        g_free(mechanism_dup);
-        begin = end + 1;
+        g_free(mechanism_dup);
+        begin = end + 1;
+      }
+
+      if(priv->sasl_local_mechanisms == NULL)
+        g_free(mech_list);
+    }
+
+    /* Let the client know that it can send an initial response along with
+     * <auth>. RFC 6120 allows this anyway, but older versions of
+     * libinfinity ignore it, so clients only do it when this is set. */
+    sasl_ir = inf_xmpp_connection_node_new(
+      "initial-response",
+      INF_XMPP_CONNECTION_SASL_IR_NS
+    );
+
+    xmlAddChild(features, sasl_ir);
+
+    /* Compression can be negotiated only before authentication, so that
+     * there is no need to wait for the client after having sent the
+     * features in the authenticated stream. */
+    if(inf_xmpp_connection_compression_available(xmpp))
+    {
+      compression = inf_xmpp_connection_node_new(
+        "compression",
+        INF_XMPP_CONNECTION_COMPRESS_FEATURE_NS
+      );
+
+      for(method = _inf_compression_get_methods(); *method != NULL; ++method)
+      {
+        xmlNewTextChild(
+          compression,
+          NULL,
+          (const xmlChar*)"method",
+          (const xmlChar*)*method
+        );
       }
 
-      if(priv->sasl_local_mechanisms == NULL)
-        g_free(mech_list);
+      xmlAddChild(features, compression);
     }
   }
 
@@ -2069,6 +2742,88 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr child;
+  xmlChar* method;
+  InfCompression* compression;
+  xmlNodePtr reply;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_INITIATED);
+
+  compression = NULL;
+  reply = NULL;
+
+  if(!inf_xmpp_connection_compression_available(xmpp))
+  {
+    reply = inf_xmpp_connection_node_new_compress("failure");
+    xmlNewChild(reply, NULL, (const xmlChar*)"setup-failed", NULL);
+  }
+  else
+  {
+    for(child = xml->children; child != NULL; child = child->next)
+      if(strcmp((const gchar*)child->name, "method") == 0)
+        break;
+
+    method = NULL;
+    if(child != NULL)
+      method = xmlNodeGetContent(child);
+
+    if(method != NULL)
+    {
+      compression = _inf_compression_new(
+        (const gchar*)method,
+        priv->compression_level
+      );
+
+      xmlFree(method);
+    }
+
+    if(compression == NULL)
+    {
+      reply = inf_xmpp_connection_node_new_compress("failure");
+      xmlNewChild(reply, NULL, (const xmlChar*)"unsupported-method", NULL);
+    }
+  }
+
+  if(compression == NULL)
+  {
+    /* Keep state for the client to go on without compression */
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+  }
+  else
+  {
+    reply = inf_xmpp_connection_node_new_compress("compressed");
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+
+    /* inf_xmpp_connection_send_xml() might have caused a status change */
+    if(priv->status != INF_XMPP_CONNECTION_INITIATED)
+    {
+      _inf_compression_free(compression);
+      return;
+    }
+
+    /* Everything sent from now on is compressed, and the client restarts
+     * the stream with compressed data after having seen <compressed/>, so
+     * it does not send anything else until then. */
+    priv->compression = compression;
+    priv->compression_method = _inf_compression_get_method(compression);
+    priv->bytes_sent = priv->bytes_sent_compressed = 0;
+    priv->bytes_received = priv->bytes_received_compressed = 0;
+
+    priv->status = INF_XMPP_CONNECTION_CONNECTED;
+    priv->compression_restart = TRUE;
+    g_object_notify(G_OBJECT(xmpp), "compression-method");
+  }
+}
+
 static void
 inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
                                       xmlNodePtr xml)
@@ -2076,6 +2831,7 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
   InfXmppConnectionPrivate* priv;
   xmlNodePtr proceed;
   xmlChar* mech;
+  xmlChar* initial_response;
   gboolean has_mechanism;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -2090,7 +2846,7 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
 
   /* I'm not totally sure how to do this in full compliance with the RFC.
    * Maybe we can ship with a simple self-signed ad-hoc certificate. */
-  if(priv->session == NULL &&
+  if(priv->session == NULL && priv->compression == NULL &&
      priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
   {
     if(strcmp((const gchar*)xml->name, "starttls") == 0)
@@ -2118,7 +2874,11 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
     /* This should already have been allocated before having sent the list
      * of mechanisms to the client. */
     g_assert(priv->sasl_context != NULL);
-    if(strcmp((const gchar*)xml->name, "auth") == 0)
+    if(strcmp((const gchar*)xml->name, "compress") == 0)
+    {
+      inf_xmpp_connection_process_compress(xmpp, xml);
+    }
+    else if(strcmp((const gchar*)xml->name, "auth") == 0)
     {
       mech = xmlGetProp(xml, (const xmlChar*)"mechanism");
 
@@ -2148,7 +2908,28 @@ inf_xmpp_connection_process_initiated(InfXmppConnection* xmpp,
 
       if(has_mechanism)
       {
-        inf_xmpp_connection_sasl_init(xmpp, (const gchar*)mech);
+        /* "=" stands for an empty initial response, and no content for
+         * none at all. */
+        initial_response = xmlNodeGetContent(xml);
+        if(initial_response != NULL && *initial_response == '\0')
+        {
+          xmlFree(initial_response);
+          initial_response = NULL;
+        }
+        else if(initial_response != NULL &&
+                strcmp((const char*)initial_response, "=") == 0)
+        {
+          *initial_response = '\0';
+        }
+
+        inf_xmpp_connection_sasl_init(
+          xmpp,
+          (const gchar*)mech,
+          (const gchar*)initial_response
+        );
+
+        if(initial_response != NULL)
+          xmlFree(initial_response);
       }
       else
       {
@@ -2308,6 +3089,47 @@ inf_xmpp_connection_sasl_suggest_mechanism(InfXmppConnection* xmpp,
   return suggestion;
 }
 
+/* Returns our most preferred compression method among the ones offered in
+ * the given <stream:features>, or NULL if there is none. */
+static const gchar*
+inf_xmpp_connection_compression_suggest_method(xmlNodePtr features)
+{
+  const gchar* const* method;
+  xmlNodePtr compression;
+  xmlNodePtr child;
+  xmlChar* content;
+  gboolean found;
+
+  for(compression = features->children;
+      compression != NULL;
+      compression = compression->next)
+  {
+    if(strcmp((const gchar*)compression->name, "compression") == 0)
+      break;
+  }
+
+  if(compression == NULL)
+    return NULL;
+
+  for(method = _inf_compression_get_methods(); *method != NULL; ++method)
+  {
+    for(child = compression->children; child != NULL; child = child->next)
+    {
+      if(strcmp((const gchar*)child->name, "method") == 0)
+      {
+        content = xmlNodeGetContent(child);
+        found = content != NULL && strcmp((const char*)content, *method) == 0;
+        if(content != NULL) xmlFree(content);
+
+        if(found)
+          return *method;
+      }
+    }
+  }
+
+  return NULL;
+}
+
 static void
 inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
                                      xmlNodePtr xml)
@@ -2316,6 +3138,8 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   xmlNodePtr child;
   xmlNodePtr req;
   xmlNodePtr starttls;
+  xmlNodePtr compress;
+  const gchar* method;
   const char* suggestion;
   GError* error;
 
@@ -2390,7 +3214,37 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     }
   }
 
-  /* If we did not request TLS above, then go on with authentication */
+  /* If we did not request TLS above, then request compression if the
+   * server supports it. The server only offers it before authentication. */
+  if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES &&
+     !priv->compression_failed &&
+     inf_xmpp_connection_compression_available(xmpp))
+  {
+    method = inf_xmpp_connection_compression_suggest_method(xml);
+    if(method != NULL)
+    {
+      compress = inf_xmpp_connection_node_new_compress("compress");
+      xmlNewTextChild(
+        compress,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)method
+      );
+
+      inf_xmpp_connection_send_xml(xmpp, compress);
+      xmlFreeNode(compress);
+
+      if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
+      {
+        g_assert(priv->compression_features == NULL);
+        priv->compression_features = xmlCopyNode(xml, 1);
+        priv->status = INF_XMPP_CONNECTION_COMPRESSION_REQUESTED;
+      }
+    }
+  }
+
+  /* If we did not request TLS or compression above, then go on with
+   * authentication */
   if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
   {
     for(child = xml->children; child != NULL; child = child->next)
@@ -2415,6 +3269,11 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     {
       inf_xmpp_connection_load_sasl_remote_mechanisms(xmpp, child);
 
+      priv->sasl_remote_initial_response = FALSE;
+      for(child = xml->children; child != NULL; child = child->next)
+        if(strcmp((const gchar*)child->name, "initial-response") == 0)
+          priv->sasl_remote_initial_response = TRUE;
+
       error = NULL;
       suggestion = inf_xmpp_connection_sasl_suggest_mechanism(xmpp, &error);
 
@@ -2429,7 +3288,7 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
       }
       else
       {
-        inf_xmpp_connection_sasl_init(xmpp, suggestion);
+        inf_xmpp_connection_sasl_init(xmpp, suggestion, NULL);
       }
     }
   }
@@ -2479,6 +3338,83 @@ inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compression(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr features;
+  const gchar* method;
+  InfCompression* compression;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
+  g_assert(priv->compression_features != NULL);
+
+  features = priv->compression_features;
+
+  if(strcmp((const gchar*)xml->name, "compressed") == 0)
+  {
+    priv->compression_features = NULL;
+
+    method = inf_xmpp_connection_compression_suggest_method(features);
+    g_assert(method != NULL);
+    xmlFreeNode(features);
+
+    compression = _inf_compression_new(
+      method,
+      MAX(priv->compression_level, 1)
+    );
+
+    if(compression == NULL)
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark(),
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+        _("Failed to set up stream compression")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      /* The server expects compressed data from now on, so we cannot
+       * send </stream:stream> anymore */
+      inf_tcp_connection_close(priv->tcp);
+    }
+    else
+    {
+      priv->compression = compression;
+      priv->compression_method = method;
+      priv->bytes_sent = priv->bytes_sent_compressed = 0;
+      priv->bytes_received = priv->bytes_received_compressed = 0;
+
+      /* Restart the stream with compressed data once the XML parser
+       * returns */
+      priv->status = INF_XMPP_CONNECTION_CONNECTED;
+      priv->compression_restart = TRUE;
+      g_object_notify(G_OBJECT(xmpp), "compression-method");
+    }
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    /* The stream goes on uncompressed, so proceed with the features that
+     * were offered before. */
+    priv->compression_features = NULL;
+    priv->compression_failed = TRUE;
+    priv->status = INF_XMPP_CONNECTION_AWAITING_FEATURES;
+
+    inf_xmpp_connection_process_features(xmpp, features);
+    xmlFreeNode(features);
+  }
+  else
+  {
+    /* We got neither 'compressed' nor 'failure'. Ignore and wait for either
+     * of them. */
+  }
+}
+
 static void
 inf_xmpp_connection_process_authentication_error(
   InfXmppConnection* xmpp,
@@ -2699,6 +3635,11 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
         inf_xmpp_connection_process_encryption(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+        /* This is a client-only state */
+        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+        inf_xmpp_connection_process_compression(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AUTHENTICATING:
         inf_xmpp_connection_process_authentication(xmpp, priv->root);
         break;
@@ -2730,6 +3671,14 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
     xmlFreeNode(priv->root);
     priv->root = NULL;
     priv->cur = NULL;
+
+    /* No received node refers to the dictionary anymore at this point */
+    if(xmlDictSize(priv->recv_doc->dict) >
+       INF_XMPP_CONNECTION_RECV_DICT_MAX_SIZE)
+    {
+      xmlDictFree(priv->recv_doc->dict);
+      priv->recv_doc->dict = xmlDictCreate();
+    }
   }
 }
 
@@ -2804,6 +3753,7 @@ inf_xmpp_connection_sax_start_element(void* context,
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_process_start_element(xmpp, name, attrs);
@@ -2869,6 +3819,7 @@ inf_xmpp_connection_sax_end_element(void* context,
     case INF_XMPP_CONNECTION_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+    case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
     case INF_XMPP_CONNECTION_READY:
       /* Also terminate stream in these states */
       inf_xmpp_connection_terminate(xmpp);
@@ -2977,6 +3928,7 @@ inf_xmpp_connection_sax_error(void* context,
    * handshake, so we cannot send arbitrary XML here. Also cannot
    * send <stream:error> without having sent <stream:stream>. */
   if(priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+     priv->status != INF_XMPP_CONNECTION_COMPRESSION_REQUESTED &&
      priv->status != INF_XMPP_CONNECTION_CONNECTED &&
      priv->status != INF_XMPP_CONNECTION_AUTH_CONNECTED)
   {
@@ -3065,10 +4017,20 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
     NULL
   );
 
-  /* Create XML buffer for outgoing data */
+  if(priv->recv_doc == NULL)
+  {
+    priv->recv_doc = xmlNewDoc((const xmlChar*)"1.0");
+    priv->recv_doc->dict = xmlDictCreate();
+  }
+
+  /* Create XML buffer for outgoing data. Messages are serialized into it
+   * directly, and it is also where they are coalesced until flushed, so
+   * make it large enough for that from the beginning. Emptying it keeps
+   * the memory, so it is reused for all messages on this connection. */
   if(priv->buf == NULL)
   {
-    priv->buf = xmlBufferCreate();
+    priv->buf = xmlBufferCreateSize(INF_XMPP_CONNECTION_FLUSH_THRESHOLD);
+    xmlBufferSetAllocationScheme(priv->buf, XML_BUFFER_ALLOC_DOUBLEIT);
     priv->doc = xmlNewDoc((const xmlChar*)"1.0");
   }
 
@@ -3101,6 +4063,68 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
  * Signal handlers.
  */
 
+/* Feeds received data into the XML parser, after having decompressed it
+ * if stream compression is enabled. */
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  gconstpointer decompressed;
+  gssize res;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->compression == NULL)
+  {
+    xmlParseChunk(priv->parser, data, len, 0);
+  }
+  else
+  {
+    priv->bytes_received_compressed += len;
+    _inf_compression_decompress_begin(priv->compression, data, len);
+
+    while((res = _inf_compression_decompress_next(priv->compression,
+                                                  &decompressed)) > 0)
+    {
+      priv->bytes_received += res;
+      xmlParseChunk(priv->parser, decompressed, res, 0);
+
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        return;
+      }
+    }
+
+    if(res < 0)
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark(),
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
+        _("Failed to decompress data received from the remote site")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      inf_xmpp_connection_terminate(xmpp);
+      return;
+    }
+  }
+
+  /* Compression has been negotiated, so restart the stream right away,
+   * before any further (compressed) data is parsed. */
+  if(priv->compression_restart &&
+     priv->status == INF_XMPP_CONNECTION_CONNECTED)
+  {
+    priv->compression_restart = FALSE;
+    inf_xmpp_connection_initiate(xmpp);
+  }
+}
+
 static void
 inf_xmpp_connection_received_cb_sent_func(InfXmppConnection* xmpp,
                                           gpointer user_data)
@@ -3180,7 +4204,6 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
 {
   InfXmppConnection* xmpp;
   InfXmppConnectionPrivate* priv;
-  gchar buffer[2048];
   ssize_t res;
   GError* error;
   gboolean receiving;
@@ -3230,7 +4253,14 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
       while(receiving && (priv->pull_len > 0 ||
                           gnutls_record_check_pending(priv->session) > 0))
       {
-        res = gnutls_record_recv(priv->session, buffer, 2048);
+        res = gnutls_record_recv(
+          priv->session,
+          priv->recv_buf,
+          priv->recv_alloc
+        );
+
+        INF_TRACE2(tls_record_recv, xmpp, res);
+
         if(res < 0)
         {
           /* Just try again if we were interrupted */
@@ -3259,8 +4289,17 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         {
           /* Feed decoded data into XML parser */
           if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, priv->recv_buf);
+          inf_xmpp_connection_parse(xmpp, priv->recv_buf, res);
+
+          /* If the record did not fit into the buffer, then make room for
+           * the full record next time. */
+          if((gsize)res == priv->recv_alloc &&
+             priv->recv_alloc < INF_XMPP_CONNECTION_RECV_BUFFER_MAX_SIZE)
+          {
+            priv->recv_alloc *= 2;
+            priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+          }
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3277,7 +4316,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
       /* Feed input directly into XML parser */
       if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
         printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_parse(xmpp, data, len);
     }
   }
 
@@ -3400,6 +4439,15 @@ inf_xmpp_connection_notify_status_cb(InfTcpConnection* tcp,
       g_object_notify(G_OBJECT(xmpp), "remote-certificate");
     }
 
+    if(priv->compression_method != NULL)
+    {
+      priv->compression_method = NULL;
+      g_object_notify(G_OBJECT(xmpp), "compression-method");
+    }
+
+    priv->bytes_sent = priv->bytes_sent_compressed = 0;
+    priv->bytes_received = priv->bytes_received_compressed = 0;
+
     g_assert(priv->status == INF_XMPP_CONNECTION_CONNECTING);
     /* No notify required, because it does not change the xml status */
     priv->status = INF_XMPP_CONNECTION_CONNECTED;
@@ -3543,6 +4591,7 @@ inf_xmpp_connection_get_xml_status(InfXmppConnection* xmpp)
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     return INF_XML_CONNECTION_OPENING;
@@ -3614,23 +4663,50 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->parser = NULL;
   priv->root = NULL;
   priv->cur = NULL;
+  priv->recv_doc = NULL;
 
   priv->doc = NULL;
   priv->buf = NULL;
 
+  priv->pending_begin = NULL;
+  priv->pending_end = NULL;
+  priv->flush_io = NULL;
+  priv->flush_dispatch = NULL;
+
   priv->session = NULL;
   priv->creds = NULL;
   priv->own_cert = NULL;
   priv->peer_cert = NULL;
+  priv->resume_data.data = NULL;
+  priv->resume_data.size = 0;
   priv->pull_data = NULL;
   priv->pull_len = 0;
+  priv->recv_buf = g_malloc(INF_XMPP_CONNECTION_RECV_BUFFER_INITIAL_SIZE);
+  priv->recv_alloc = INF_XMPP_CONNECTION_RECV_BUFFER_INITIAL_SIZE;
+  priv->kernel_tls = FALSE;
+  priv->kernel_tls_tx = FALSE;
 
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_session = NULL;
   priv->sasl_local_mechanisms = NULL;
   priv->sasl_remote_mechanisms = NULL;
+  priv->sasl_remote_initial_response = FALSE;
+  priv->sasl_auth = NULL;
   priv->sasl_error = NULL;
+
+  priv->compression_level = 0;
+  priv->compression = NULL;
+  priv->compression_method = NULL;
+  priv->compression_buf = NULL;
+  priv->compression_restart = FALSE;
+  priv->compression_features = NULL;
+  priv->compression_failed = FALSE;
+
+  priv->bytes_sent = 0;
+  priv->bytes_sent_compressed = 0;
+  priv->bytes_received = 0;
+  priv->bytes_received_compressed = 0;
 }
 
 static void
@@ -3677,6 +4753,7 @@ inf_xmpp_connection_dispose(GObject* object)
 
   g_assert(priv->session == NULL);
   g_assert(priv->sasl_session == NULL);
+  g_assert(priv->flush_dispatch == NULL);
 
   if(priv->own_cert != NULL)
   {
@@ -3728,6 +4805,13 @@ inf_xmpp_connection_finalize(GObject* object)
   g_free(priv->remote_hostname);
   g_free(priv->sasl_local_mechanisms);
   g_free(priv->sasl_remote_mechanisms);
+  g_free(priv->recv_buf);
+
+  if(priv->compression_buf != NULL)
+    g_byte_array_free(priv->compression_buf, TRUE);
+
+  if(priv->resume_data.data != NULL)
+    gnutls_free(priv->resume_data.data);
 
   if(priv->certificate_callback_notify != NULL)
     priv->certificate_callback_notify(priv->certificate_callback_user_data);
@@ -3826,6 +4910,12 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_KERNEL_TLS:
+    priv->kernel_tls = g_value_get_boolean(value);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3870,12 +4960,21 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_CREDENTIALS:
     g_value_set_boxed(value, priv->creds);
     break;
+  case PROP_KERNEL_TLS:
+    g_value_set_boolean(value, priv->kernel_tls);
+    break;
   case PROP_SASL_CONTEXT:
     g_value_set_boxed(value, priv->sasl_context);
     break;
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_uint(value, priv->compression_level);
+    break;
+  case PROP_COMPRESSION_METHOD:
+    g_value_set_static_string(value, priv->compression_method);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -3992,6 +5091,11 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
      * the xmpp status */
     inf_tcp_connection_close(priv->tcp);
     break;
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+    /* The server might already be waiting for a compressed stream, so
+     * just terminate. */
+    inf_xmpp_connection_terminate(INF_XMPP_CONNECTION(connection));
+    break;
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     /* TODO: I think we should send an <abort/> request here and then
      * wait on either successful or unsuccessful authentication result,
@@ -4024,23 +5128,32 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
 
   g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  /* Messages sent in the same main loop iteration, for example a request
+   * broadcast to many groups, are only serialized here, and given to the
+   * TCP connection all at once from a dispatch. */
+  inf_xmpp_connection_serialize_xml(INF_XMPP_CONNECTION(connection), xml);
+
+  if(priv->pending_end == NULL)
+    priv->pending_begin = xml;
+  else
+    priv->pending_end->next = xml;
+  priv->pending_end = xml;
 
-  /* It can happen that while calling inf_xmpp_connection_send_xml we
-   * notice that the connection is down. Only proceed with sent notification
-   * if the connection is still up and we could actually send the thing. */
-  if(priv->status == INF_XMPP_CONNECTION_READY)
+  if(xmlBufferLength(priv->buf) >= INF_XMPP_CONNECTION_FLUSH_THRESHOLD)
   {
-    inf_xmpp_connection_push_message(
-      INF_XMPP_CONNECTION(connection),
-      inf_xmpp_connection_xml_connection_send_sent,
-      inf_xmpp_connection_xml_connection_send_free,
-      xml
-    );
+    inf_xmpp_connection_flush(INF_XMPP_CONNECTION(connection));
   }
-  else
+  else if(priv->flush_dispatch == NULL)
   {
-    xmlFreeNode(xml);
+    g_object_get(G_OBJECT(priv->tcp), "io", &priv->flush_io, NULL);
+    g_assert(priv->flush_io != NULL);
+
+    priv->flush_dispatch = inf_io_add_dispatch(
+      priv->flush_io,
+      inf_xmpp_connection_flush_func,
+      connection,
+      NULL
+    );
   }
 }
 
@@ -4154,6 +5267,20 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_KERNEL_TLS,
+    g_param_spec_boolean(
+      "kernel-tls",
+      "Kernel TLS",
+      "Whether to let the kernel encrypt outgoing data once the TLS "
+      "handshake has finished, if the platform and the negotiated cipher "
+      "support it",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_SASL_CONTEXT,
@@ -4178,6 +5305,34 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_uint(
+      "compression-level",
+      "Compression level",
+      "Level of stream compression to request (or offer, as a server), "
+      "from 1 (fastest) to 9 (best), or 0 to disable compression",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_METHOD,
+    g_param_spec_string(
+      "compression-method",
+      "Compression method",
+      "The stream compression method in use, or NULL if the stream is not "
+      "compressed",
+      NULL,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4497,6 +5652,71 @@ inf_xmpp_connection_get_dh_prime_bits(InfXmppConnection* xmpp)
   return (guint)bits;
 }
 
+/**
+ * inf_xmpp_connection_get_compression_method:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns the name of the stream compression method that was negotiated
+ * with the remote host, such as "zstd" or "zlib", or %NULL if the stream is
+ * not compressed. Compression is only negotiated if both sites have the
+ * #InfXmppConnection:compression-level property set to a non-zero value.
+ * The method is still available after the connection has been closed,
+ * until it is reopened.
+ *
+ * Returns: (transfer none) (allow-none): The compression method, or %NULL.
+ */
+const gchar*
+inf_xmpp_connection_get_compression_method(InfXmppConnection* xmpp)
+{
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), NULL);
+  return INF_XMPP_CONNECTION_PRIVATE(xmpp)->compression_method;
+}
+
+/**
+ * inf_xmpp_connection_get_compression_stats:
+ * @xmpp: A #InfXmppConnection.
+ * @bytes_sent: (out) (allow-none): Location to store the number of bytes
+ * sent before compression, or %NULL.
+ * @bytes_sent_compressed: (out) (allow-none): Location to store the number
+ * of bytes sent after compression, or %NULL.
+ * @bytes_received: (out) (allow-none): Location to store the number of
+ * bytes received after decompression, or %NULL.
+ * @bytes_received_compressed: (out) (allow-none): Location to store the
+ * number of bytes received before decompression, or %NULL.
+ *
+ * Returns how much data has been transferred through the stream compression
+ * of @xmpp, from which the compression ratio in both directions can be
+ * computed. The numbers do not include the data that was transferred
+ * before compression was negotiated, and they are reset when the
+ * connection is reopened.
+ *
+ * Returns: %TRUE if stream compression has been used on the connection, or
+ * %FALSE otherwise, in which case all numbers are 0.
+ */
+gboolean
+inf_xmpp_connection_get_compression_stats(InfXmppConnection* xmpp,
+                                          guint64* bytes_sent,
+                                          guint64* bytes_sent_compressed,
+                                          guint64* bytes_received,
+                                          guint64* bytes_received_compressed)
+{
+  InfXmppConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(bytes_sent != NULL)
+    *bytes_sent = priv->bytes_sent;
+  if(bytes_sent_compressed != NULL)
+    *bytes_sent_compressed = priv->bytes_sent_compressed;
+  if(bytes_received != NULL)
+    *bytes_received = priv->bytes_received;
+  if(bytes_received_compressed != NULL)
+    *bytes_received_compressed = priv->bytes_received_compressed;
+
+  return priv->compression_method != NULL;
+}
+
 /**
  * inf_xmpp_connection_set_certificate_callback:
  * @xmpp: A #InfXmppConnection.
@@ -4791,7 +6011,7 @@ inf_xmpp_connection_retry_sasl_authentication(InfXmppConnection* xmpp,
   if(suggestion == NULL)
     return FALSE;
 
-  inf_xmpp_connection_sasl_init(xmpp, suggestion);
+  inf_xmpp_connection_sasl_init(xmpp, suggestion, NULL);
   return TRUE;
 }
 
@@ -107,6 +107,8 @@ typedef enum _InfXmppConnectionSecurityPolicy {
  * provide any authentication mechanisms.
  * @INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM: The server does not offer
  * a suitable authentication mechanism that is accepted by the client.
+ * @INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED: Stream compression could
+ * not be set up, or data could not be compressed or decompressed.
  * @INF_XMPP_CONNECTION_ERROR_FAILED: General error code for otherwise
  * unknown errors.
  *
@@ -121,6 +123,7 @@ typedef enum _InfXmppConnectionError {
   INF_XMPP_CONNECTION_ERROR_CERTIFICATE_NOT_TRUSTED,
   INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
   INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM,
+  INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILED,
 
   INF_XMPP_CONNECTION_ERROR_FAILED
 } InfXmppConnectionError;
@@ -350,6 +353,16 @@ inf_xmpp_connection_get_tls_protocol(InfXmppConnection* xmpp);
 guint
 inf_xmpp_connection_get_dh_prime_bits(InfXmppConnection* xmpp);
 
+const gchar*
+inf_xmpp_connection_get_compression_method(InfXmppConnection* xmpp);
+
+gboolean
+inf_xmpp_connection_get_compression_stats(InfXmppConnection* xmpp,
+                                          guint64* bytes_sent,
+                                          guint64* bytes_sent_compressed,
+                                          guint64* bytes_received,
+                                          guint64* bytes_received_compressed);
+
 void
 inf_xmpp_connection_set_certificate_callback(InfXmppConnection* xmpp,
                                              gnutls_certificate_request_t req,
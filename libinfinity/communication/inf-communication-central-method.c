@@ -41,7 +41,11 @@ struct _InfCommunicationCentralMethodPrivate {
   InfCommunicationGroup* group;
   gboolean is_publisher; /* Whether the local host is publisher of group */
 
-  GSList* connections;
+  /* Members in a dense array for broadcasting, and their index in it plus
+   * one, so that membership can be looked up and removed in constant time
+   * also for groups with many members. */
+  GPtrArray* connections;
+  GHashTable* connection_indices;
 };
 
 enum {
@@ -67,8 +71,9 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   InfCommunicationCentralMethodPrivate* priv;
   InfCommunicationRegistry* registry;
   InfCommunicationGroup* group;
-  GSList* connections;
-  GSList* item;
+  InfXmlConnection** connections;
+  guint n_connections;
+  guint i;
   InfXmlConnection* connection;
   gboolean is_registered;
   InfXmlConnectionStatus status;
@@ -82,13 +87,18 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   registry = g_object_ref(priv->registry);
   group = g_object_ref(priv->group);
 
-  connections = g_slist_copy(priv->connections);
-  for(item = connections; item != NULL; item = item->next)
-    g_object_ref(item->data);
+  n_connections = priv->connections->len;
+  connections = g_new(InfXmlConnection*, n_connections);
+  for(i = 0; i < n_connections; ++i)
+  {
+    connections[i] = INF_XML_CONNECTION(
+      g_object_ref(g_ptr_array_index(priv->connections, i))
+    );
+  }
 
-  while(connections)
+  for(i = 0; i < n_connections; ++i)
   {
-    connection = INF_XML_CONNECTION(connections->data);
+    connection = connections[i];
 
     /* A callback from a prior iteration might have unregistered the
      * connection. */
@@ -106,7 +116,7 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
        status == INF_XML_CONNECTION_OPEN &&
        connection != except)
     {
-      if(connections->next != NULL)
+      if(i + 1 < n_connections)
       {
         /* Keep ownership of XML if there might be more connections we should
          * send it to. */
@@ -127,9 +137,10 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
     }
 
     g_object_unref(connection);
-    connections = g_slist_delete_link(connections, connections);
   }
 
+  g_free(connections);
+
   g_object_unref(method);
   g_object_unref(registry);
   g_object_unref(group);
@@ -194,7 +205,12 @@ inf_communication_central_method_add_member(InfCommunicationMethod* method,
   g_assert(status != INF_XML_CONNECTION_CLOSING && 
            status != INF_XML_CONNECTION_CLOSED);
 
-  priv->connections = g_slist_prepend(priv->connections, connection);
+  g_ptr_array_add(priv->connections, connection);
+  g_hash_table_insert(
+    priv->connection_indices,
+    connection,
+    GUINT_TO_POINTER(priv->connections->len)
+  );
 
   g_signal_connect(
     connection,
@@ -221,6 +237,7 @@ inf_communication_central_method_remove_member(InfCommunicationMethod* method,
   InfCommunicationCentralMethodPrivate* priv;
   InfXmlConnectionStatus status;
   gboolean is_registered;
+  guint index;
 
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
 
@@ -251,7 +268,23 @@ inf_communication_central_method_remove_member(InfCommunicationMethod* method,
     method
   );
 
-  priv->connections = g_slist_remove(priv->connections, connection);
+  index = GPOINTER_TO_UINT(
+    g_hash_table_lookup(priv->connection_indices, connection)
+  );
+
+  g_assert(index > 0);
+  g_hash_table_remove(priv->connection_indices, connection);
+
+  /* Move the last member into the gap */
+  g_ptr_array_remove_index_fast(priv->connections, index - 1);
+  if(index - 1 < priv->connections->len)
+  {
+    g_hash_table_insert(
+      priv->connection_indices,
+      g_ptr_array_index(priv->connections, index - 1),
+      GUINT_TO_POINTER(index)
+    );
+  }
 }
 
 static gboolean
@@ -261,9 +294,7 @@ inf_communication_central_method_is_member(InfCommunicationMethod* method,
   InfCommunicationCentralMethodPrivate* priv;
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
 
-  if(g_slist_find(priv->connections, connection) == NULL)
-    return FALSE;
-  return TRUE;
+  return g_hash_table_contains(priv->connection_indices, connection);
 }
 
 static void
@@ -500,7 +531,8 @@ inf_communication_central_method_init(InfCommunicationCentralMethod* method)
   priv->group = NULL;
   priv->registry = NULL;
   priv->is_publisher = FALSE;
-  priv->connections = NULL;
+  priv->connections = g_ptr_array_new();
+  priv->connection_indices = g_hash_table_new(NULL, NULL);
 }
 
 static void
@@ -512,11 +544,13 @@ inf_communication_central_method_dispose(GObject* object)
   method = INF_COMMUNICATION_CENTRAL_METHOD(object);
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
 
-  while(priv->connections != NULL)
+  while(priv->connections->len > 0)
   {
     inf_communication_method_remove_member(
       INF_COMMUNICATION_METHOD(method),
-      INF_XML_CONNECTION(priv->connections->data)
+      INF_XML_CONNECTION(
+        g_ptr_array_index(priv->connections, priv->connections->len - 1)
+      )
     );
   }
 
@@ -526,6 +560,23 @@ inf_communication_central_method_dispose(GObject* object)
   G_OBJECT_CLASS(inf_communication_central_method_parent_class)->dispose(object);
 }
 
+static void
+inf_communication_central_method_finalize(GObject* object)
+{
+  InfCommunicationCentralMethod* method;
+  InfCommunicationCentralMethodPrivate* priv;
+
+  method = INF_COMMUNICATION_CENTRAL_METHOD(object);
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  g_ptr_array_free(priv->connections, TRUE);
+  g_hash_table_destroy(priv->connection_indices);
+
+  G_OBJECT_CLASS(inf_communication_central_method_parent_class)->finalize(
+    object
+  );
+}
+
 static void
 inf_communication_central_method_set_property(GObject* object,
                                               guint prop_id,
@@ -602,6 +653,7 @@ inf_communication_central_method_class_init(
   object_class = G_OBJECT_CLASS(method_class);
 
   object_class->dispose = inf_communication_central_method_dispose;
+  object_class->finalize = inf_communication_central_method_finalize;
   object_class->set_property = inf_communication_central_method_set_property;
   object_class->get_property = inf_communication_central_method_get_property;
 
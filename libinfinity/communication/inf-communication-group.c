@@ -778,6 +778,53 @@ inf_communication_group_cancel_messages(InfCommunicationGroup* group,
   inf_communication_method_cancel_messages(method, connection);
 }
 
+/**
+ * inf_communication_group_get_queue_status:
+ * @group: A #InfCommunicationGroup.
+ * @connection: A member of @group.
+ * @n_enqueued: (out) (allow-none): Location to store the number of messages
+ * that have been given to @connection but were not yet sent, or %NULL.
+ * @n_queued: (out) (allow-none): Location to store the number of messages
+ * waiting to be given to @connection, or %NULL.
+ *
+ * Returns how many messages sent in @group are still waiting to be sent to
+ * @connection. See inf_communication_registry_get_queue_status() for
+ * details. If @connection is not registered with the group's registry,
+ * for example because it is still being opened, both numbers are zero.
+ */
+void
+inf_communication_group_get_queue_status(InfCommunicationGroup* group,
+                                         InfXmlConnection* connection,
+                                         guint* n_enqueued,
+                                         guint* n_queued)
+{
+  InfCommunicationGroupPrivate* priv;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  if(n_enqueued != NULL) *n_enqueued = 0;
+  if(n_queued != NULL) *n_queued = 0;
+
+  if(priv->communication_registry != NULL &&
+     inf_communication_registry_is_registered(
+       priv->communication_registry,
+       group,
+       connection))
+  {
+    inf_communication_registry_get_queue_status(
+      priv->communication_registry,
+      group,
+      connection,
+      NULL,
+      n_enqueued,
+      n_queued
+    );
+  }
+}
+
 /**
  * inf_communication_group_get_method_for_network:
  * @group: A #InfCommunicationGroup.
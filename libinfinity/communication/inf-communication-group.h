@@ -112,6 +112,12 @@ void
 inf_communication_group_cancel_messages(InfCommunicationGroup* group,
                                         InfXmlConnection* connection);
 
+void
+inf_communication_group_get_queue_status(InfCommunicationGroup* group,
+                                         InfXmlConnection* connection,
+                                         guint* n_enqueued,
+                                         guint* n_queued);
+
 const gchar*
 inf_communication_group_get_method_for_network(InfCommunicationGroup* group,
                                                const gchar* network);
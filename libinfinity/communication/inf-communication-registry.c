@@ -34,17 +34,74 @@
  * inf_communication_method_enqueued() when sending the message cannot be
  * cancelled anymore via inf_communication_registry_cancel_messages() and
  * inf_communication_method_sent() when the message has been sent.
+ *
+ * All groups using the same connection share one outgoing queue. Only a
+ * limited number of messages is given to the connection at a time, and
+ * when there is room for more, the groups with messages waiting take turns,
+ * each getting an equal share. This way a group sending a lot of data, for
+ * example while synchronizing a large document, does not delay the
+ * messages of other groups on the same connection by more than one round.
+ *
+ * In addition, bulk messages, which are synchronization messages
+ * (&lt;sync-*&gt;) and directory listings (&lt;explore-begin&gt;,
+ * &lt;add-node&gt;, &lt;node-list&gt; and &lt;explore-end&gt;), are only
+ * sent when no group has other messages waiting, and they never take up all
+ * of the connection's limit. Interactive messages, such as requests and caret
+ * movements, are therefore passed on right away even under bulk load.
+ * Messages within the same group are always sent in order.
  **/
 
 #include <libinfinity/communication/inf-communication-registry.h>
 #include <libinfinity/communication/inf-communication-group-private.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-trace.h>
 
 #include <string.h>
 
-/* TODO: Store connection->InfCommunicationRegistryConnection hashtable,
- * store network and remote_id there, only point to in key. */
+#include "config.h"
+
+/* TODO: Store network and remote_id in InfCommunicationRegistryConnection,
+ * only point to it in key. */
+
+typedef struct _InfCommunicationRegistryEntry InfCommunicationRegistryEntry;
+
+/* Outgoing queue shared by all entries for the same connection */
+typedef struct _InfCommunicationRegistryConnection
+  InfCommunicationRegistryConnection;
+struct _InfCommunicationRegistryConnection {
+  InfCommunicationRegistry* registry;
+  InfXmlConnection* connection;
+
+  guint registration_count;
+  guint n_entries;
+
+  /* Messages of all entries given to the connection but not yet sent,
+   * and how many of them are bulk messages */
+  guint inner_count;
+  guint inner_bulk;
+  guint inner_limit;
+
+  /* Estimated size of the messages of all entries that have not yet been
+   * given to the connection. If the connection runs on top of an
+   * InfTcpConnection, then it is reported to it, so that its watermarks
+   * take these messages into account. */
+  gsize queue_size;
+  InfTcpConnection* tcp;
+
+  /* Entries with queued messages, in the order in which they are served.
+   * Entries whose next message is a bulk message wait in ready_bulk,
+   * which is only served when ready is empty. */
+  GQueue ready;
+  GQueue ready_bulk;
+
+  /* Whether inf_communication_registry_connection_schedule() is running,
+   * and the entry it is currently sending messages for. */
+  gboolean scheduling;
+  InfCommunicationRegistryEntry* current;
+};
 
 typedef struct _InfCommunicationRegistryKey InfCommunicationRegistryKey;
 struct _InfCommunicationRegistryKey {
@@ -53,17 +110,20 @@ struct _InfCommunicationRegistryKey {
   const gchar* group_name;
 };
 
-typedef struct _InfCommunicationRegistryEntry InfCommunicationRegistryEntry;
 struct _InfCommunicationRegistryEntry {
   InfCommunicationRegistry* registry;
   InfCommunicationRegistryKey key;
   const gchar* publisher_string;
+  InfCommunicationRegistryConnection* conn;
 
   InfCommunicationGroup* group;
   InfCommunicationMethod* method;
 
   /* Queue of messages to send */
   guint inner_count;
+  guint inner_bulk;
+  GQueue* ready; /* conn->ready or conn->ready_bulk, if queued there */
+  guint queue_length;
   xmlNodePtr queue_begin;
   xmlNodePtr queue_end;
 
@@ -85,7 +145,7 @@ struct _InfCommunicationRegistryForeachMethodData {
 typedef struct _InfCommunicationRegistryPrivate
   InfCommunicationRegistryPrivate;
 struct _InfCommunicationRegistryPrivate {
-  GHashTable* connections;
+  GHashTable* connections; /* InfXmlConnection -> Connection */
   GHashTable* entries;
 };
 
@@ -94,8 +154,66 @@ struct _InfCommunicationRegistryPrivate {
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationRegistry, inf_communication_registry, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfCommunicationRegistry))
 
-/* Maximum number of messages enqueued at the same time */
-static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT = 5;
+/* Bounds for the number of messages enqueued at the same time. The actual
+ * limit of a connection starts at the minimum. It is doubled each time the
+ * connection has sent all enqueued messages while more were waiting, and
+ * halved again each time it runs out of messages, so that it adapts to
+ * how fast the connection drains. */
+static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT_MIN = 5;
+static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT_MAX = 320;
+
+/* Part of a connection's limit that bulk messages cannot take up, so that
+ * interactive messages can always be sent immediately: 1/n of the limit. */
+static const guint INF_COMMUNICATION_REGISTRY_INTERACTIVE_RESERVE = 4;
+
+/* Returns approximately the number of bytes xml takes when serialized */
+static gsize
+inf_communication_registry_message_size(xmlNodePtr xml)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  gsize size;
+
+  if(xml->type != XML_ELEMENT_NODE)
+    return xml->content != NULL ? strlen((const char*)xml->content) : 0;
+
+  /* <name></name> */
+  size = 2 * strlen((const char*)xml->name) + 5;
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    /* name="value" */
+    size += strlen((const char*)attr->name) + 4;
+    for(child = attr->children; child != NULL; child = child->next)
+      size += inf_communication_registry_message_size(child);
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+    size += inf_communication_registry_message_size(child);
+
+  return size;
+}
+
+static void
+inf_communication_registry_connection_update_backlog(
+  InfCommunicationRegistryConnection* conn)
+{
+  if(conn->tcp != NULL)
+    _inf_tcp_connection_set_backlog(conn->tcp, conn->queue_size);
+}
+
+static gboolean
+inf_communication_registry_is_bulk_message(xmlNodePtr xml)
+{
+  const gchar* name;
+  name = (const gchar*)xml->name;
+
+  return strncmp(name, "sync-", 5) == 0 ||
+         strcmp(name, "explore-begin") == 0 ||
+         strcmp(name, "explore-end") == 0 ||
+         strcmp(name, "add-node") == 0 ||
+         strcmp(name, "node-list") == 0;
+}
 
 static void
 inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
@@ -126,11 +244,22 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
     entry->queue_begin = entry->queue_begin->next;
     if(entry->queue_begin == NULL) entry->queue_end = NULL;
     ++ entry->inner_count;
+    -- entry->queue_length;
+    entry->conn->queue_size -= inf_communication_registry_message_size(xml);
+
+    ++ entry->conn->inner_count;
+    if(inf_communication_registry_is_bulk_message(xml))
+    {
+      ++ entry->inner_bulk;
+      ++ entry->conn->inner_bulk;
+    }
 
     xmlUnlinkNode(xml);
     xmlAddChild(container, xml);
   }
 
+  inf_communication_registry_connection_update_backlog(entry->conn);
+
   /* Keep order of enqueued() calls and inf_xml_connection_send() calls
    * intact even if this function is run recursively in one of the
    * functions mentioned above. */
@@ -192,6 +321,149 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
   }
 }
 
+static void
+inf_communication_registry_connection_free(
+  InfCommunicationRegistryConnection* conn)
+{
+  InfCommunicationRegistryPrivate* priv;
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(conn->registry);
+
+  g_assert(conn->registration_count == 0);
+  g_assert(conn->n_entries == 0);
+  g_assert(g_queue_is_empty(&conn->ready));
+  g_assert(g_queue_is_empty(&conn->ready_bulk));
+
+  if(conn->tcp != NULL)
+  {
+    _inf_tcp_connection_set_backlog(conn->tcp, 0);
+    g_object_unref(conn->tcp);
+  }
+
+  g_hash_table_remove(priv->connections, conn->connection);
+  g_slice_free(InfCommunicationRegistryConnection, conn);
+}
+
+/* Frees conn if it is no longer used by anything */
+static void
+inf_communication_registry_connection_release(
+  InfCommunicationRegistryConnection* conn)
+{
+  if(conn->registration_count == 0 && conn->n_entries == 0 &&
+     conn->scheduling == FALSE)
+  {
+    inf_communication_registry_connection_free(conn);
+  }
+}
+
+/* Queues entry to be served by its connection, according to the class of
+ * the next message it has to send, if it is not queued already. */
+static void
+inf_communication_registry_entry_make_ready(
+  InfCommunicationRegistryEntry* entry)
+{
+  if(entry->ready == NULL && entry->queue_begin != NULL)
+  {
+    if(inf_communication_registry_is_bulk_message(entry->queue_begin))
+      entry->ready = &entry->conn->ready_bulk;
+    else
+      entry->ready = &entry->conn->ready;
+
+    g_queue_push_tail(entry->ready, entry);
+  }
+}
+
+static void
+inf_communication_registry_entry_unmake_ready(
+  InfCommunicationRegistryEntry* entry)
+{
+  if(entry->ready != NULL)
+  {
+    g_queue_remove(entry->ready, entry);
+    entry->ready = NULL;
+  }
+}
+
+/* Gives messages of the entries waiting in conn->ready and conn->ready_bulk
+ * to the connection, as long as the connection's limit allows. The limit is
+ * split evenly between the waiting entries, and entries that still have
+ * messages afterwards wait for their next turn at the end of the queue. */
+static void
+inf_communication_registry_connection_schedule(
+  InfCommunicationRegistryConnection* conn)
+{
+  InfCommunicationRegistryEntry* entry;
+  InfXmlConnectionStatus status;
+  GQueue* queue;
+  guint bulk_limit;
+  guint room;
+  guint share;
+
+  /* This can be called recursively when sending a message causes another
+   * one to be sent or to be reported as sent. The outermost call keeps on
+   * sending while there is room. */
+  if(conn->scheduling == TRUE)
+    return;
+
+  conn->scheduling = TRUE;
+
+  for(;;)
+  {
+    if(!g_queue_is_empty(&conn->ready))
+    {
+      queue = &conn->ready;
+      if(conn->inner_count >= conn->inner_limit)
+        break;
+
+      room = conn->inner_limit - conn->inner_count;
+    }
+    else if(!g_queue_is_empty(&conn->ready_bulk))
+    {
+      queue = &conn->ready_bulk;
+
+      bulk_limit = conn->inner_limit -
+        MAX(conn->inner_limit / INF_COMMUNICATION_REGISTRY_INTERACTIVE_RESERVE,
+            1);
+
+      if(conn->inner_count >= conn->inner_limit ||
+         conn->inner_bulk >= bulk_limit)
+      {
+        break;
+      }
+
+      room = MIN(
+        conn->inner_limit - conn->inner_count,
+        bulk_limit - conn->inner_bulk
+      );
+    }
+    else
+    {
+      break;
+    }
+
+    g_object_get(G_OBJECT(conn->connection), "status", &status, NULL);
+    if(status != INF_XML_CONNECTION_OPEN)
+      break;
+
+    share = room / g_queue_get_length(queue);
+    if(share == 0) share = 1;
+
+    entry = g_queue_pop_head(queue);
+    entry->ready = NULL;
+
+    conn->current = entry;
+    inf_communication_registry_send_real(entry, share);
+
+    /* The entry might have been freed while sending */
+    if(conn->current == entry)
+      inf_communication_registry_entry_make_ready(entry);
+
+    conn->current = NULL;
+  }
+
+  conn->scheduling = FALSE;
+  inf_communication_registry_connection_release(conn);
+}
+
 /* Required by inf_communication_registry_entry_free() */
 static void
 inf_communication_registry_group_unrefed(gpointer user_data,
@@ -203,6 +475,7 @@ inf_communication_registry_entry_free(gpointer data)
 {
   InfCommunicationRegistryEntry* entry;
   InfXmlConnectionStatus status;
+  xmlNodePtr xml;
 
   entry = (InfCommunicationRegistryEntry*)data;
 
@@ -228,6 +501,10 @@ inf_communication_registry_entry_free(gpointer data)
       inf_communication_registry_send_real(entry, G_MAXUINT);
   }
 
+  /* Messages that could not be sent anymore do not count as backlog */
+  for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
+    entry->conn->queue_size -= inf_communication_registry_message_size(xml);
+
   if(entry->group)
   {
     g_object_weak_unref(
@@ -237,6 +514,21 @@ inf_communication_registry_entry_free(gpointer data)
     );
   }
 
+  /* Messages of this entry which are still in flight are no longer
+   * accounted for when they are sent, so don't count them for the
+   * connection either. */
+  inf_communication_registry_entry_unmake_ready(entry);
+  if(entry->conn->current == entry)
+    entry->conn->current = NULL;
+
+  g_assert(entry->conn->inner_count >= entry->inner_count);
+  g_assert(entry->conn->inner_bulk >= entry->inner_bulk);
+  entry->conn->inner_count -= entry->inner_count;
+  entry->conn->inner_bulk -= entry->inner_bulk;
+
+  -- entry->conn->n_entries;
+  inf_communication_registry_connection_release(entry->conn);
+
   if(!entry->registered)
     g_object_unref(entry->key.connection);
 
@@ -388,11 +680,13 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
   InfCommunicationRegistry* registry;
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistryConnection* conn;
   InfCommunicationRegistryKey key;
   xmlChar* publisher;
   xmlChar* group_name;
   xmlNodePtr child;
   xmlNodePtr cur;
+  gboolean was_scheduling;
 
   registry = INF_COMMUNICATION_REGISTRY(user_data);
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
@@ -428,6 +722,8 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
   entry = g_hash_table_lookup(priv->entries, &key);
   if(entry != NULL)
   {
+    INF_TRACE2(message_sent, connection, xmlChildElementCount(xml));
+
     if(entry->sent_list != NULL)
     {
       entry->sent_list->next = xmlCopyNode(xml, 1);
@@ -469,6 +765,14 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
           }
 
           -- entry->inner_count;
+          -- entry->conn->inner_count;
+
+          if(inf_communication_registry_is_bulk_message(cur))
+          {
+            g_assert(entry->inner_bulk > 0);
+            -- entry->inner_bulk;
+            -- entry->conn->inner_bulk;
+          }
         }
 
         cur = child;
@@ -479,22 +783,57 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
       }
     }
 
+    conn = entry->conn;
+
+    /* Free the entry in case all scheduled messages have been sent after
+     * unregistration. */
+    if(entry->registered == FALSE && entry->activation_count == 0)
+    {
+      /* Keep the connection alive for scheduling below */
+      was_scheduling = conn->scheduling;
+      conn->scheduling = TRUE;
+      g_hash_table_remove(priv->entries, &key);
+      conn->scheduling = was_scheduling;
+    }
+
     /* Messages have been sent, meaning the number of queued messages has
      * decreased, so we can send more messages now. */
     /* Send next bunch of messages if inner_count reached zero, meaning no
      * more messages have been enqueued, for better packing. */
-    if(entry->inner_count == 0 && entry->queue_end != NULL)
+    if(conn->inner_count == 0 &&
+       (!g_queue_is_empty(&conn->ready) ||
+        !g_queue_is_empty(&conn->ready_bulk)))
     {
-      inf_communication_registry_send_real(
-        entry,
-        INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
+      /* The connection was faster than the limit allowed, so allow more
+       * messages at once. */
+      conn->inner_limit = MIN(
+        conn->inner_limit * 2,
+        INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT_MAX
       );
+
+      inf_communication_registry_connection_schedule(conn);
     }
+    else
+    {
+      if(conn->inner_count == 0)
+      {
+        conn->inner_limit = MAX(
+          conn->inner_limit / 2,
+          INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT_MIN
+        );
+      }
 
-    /* Free the entry in case all scheduled messages have been sent after
-     * unregistration. */
-    if(entry->registered == FALSE && entry->activation_count == 0)
-      g_hash_table_remove(priv->entries, &key);
+      /* Interactive messages only wait for other interactive messages */
+      if(!g_queue_is_empty(&conn->ready) &&
+         conn->inner_count == conn->inner_bulk)
+      {
+        inf_communication_registry_connection_schedule(conn);
+      }
+      else
+      {
+        inf_communication_registry_connection_release(conn);
+      }
+    }
   }
 
   if(publisher == NULL)
@@ -548,25 +887,47 @@ inf_communication_registry_notify_status_cb(GObject* object,
   }
 }
 
-static void
+static InfCommunicationRegistryConnection*
 inf_communication_registry_add_connection(InfCommunicationRegistry* registry,
                                           InfXmlConnection* connection)
 {
   InfCommunicationRegistryPrivate* priv;
-  gpointer reg;
+  InfCommunicationRegistryConnection* conn;
 
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
-  reg = g_hash_table_lookup(priv->connections, connection);
-  g_hash_table_steal(priv->connections, connection);
+  conn = g_hash_table_lookup(priv->connections, connection);
 
-  if(reg == NULL)
+  if(conn == NULL)
   {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(1)
-    );
+    conn = g_slice_new(InfCommunicationRegistryConnection);
+    conn->registry = registry;
+    conn->connection = connection;
+    conn->registration_count = 0;
+    conn->n_entries = 0;
+    conn->inner_count = 0;
+    conn->inner_bulk = 0;
+    conn->inner_limit = INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT_MIN;
+    conn->queue_size = 0;
+    conn->tcp = NULL;
+    if(INF_IS_XMPP_CONNECTION(connection))
+    {
+      g_object_get(
+        G_OBJECT(connection),
+        "tcp-connection", &conn->tcp,
+        NULL
+      );
+    }
+
+    g_queue_init(&conn->ready);
+    g_queue_init(&conn->ready_bulk);
+    conn->scheduling = FALSE;
+    conn->current = NULL;
+
+    g_hash_table_insert(priv->connections, connection, conn);
+  }
 
+  if(conn->registration_count++ == 0)
+  {
     g_object_ref(connection);
 
     g_signal_connect_after(
@@ -590,14 +951,8 @@ inf_communication_registry_add_connection(InfCommunicationRegistry* registry,
       registry
     );
   }
-  else
-  {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(1+GPOINTER_TO_UINT(reg))
-    );
-  }
+
+  return conn;
 }
 
 static void
@@ -605,25 +960,13 @@ inf_communication_registry_remove_connection(InfCommunicationRegistry* rgstry,
                                              InfXmlConnection* connection)
 {
   InfCommunicationRegistryPrivate* priv;
-  gpointer reg;
-  guint count;
+  InfCommunicationRegistryConnection* conn;
 
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(rgstry);
-  reg = g_hash_table_lookup(priv->connections, connection);
-  g_assert(reg != NULL);
+  conn = g_hash_table_lookup(priv->connections, connection);
+  g_assert(conn != NULL && conn->registration_count > 0);
 
-  g_hash_table_steal(priv->connections, connection);
-
-  count = GPOINTER_TO_UINT(reg);
-  if(--count > 0)
-  {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(count)
-    );
-  }
-  else
+  if(--conn->registration_count == 0)
   {
     inf_signal_handlers_disconnect_by_func(
       G_OBJECT(connection),
@@ -643,6 +986,7 @@ inf_communication_registry_remove_connection(InfCommunicationRegistry* rgstry,
       rgstry
     );
 
+    inf_communication_registry_connection_release(conn);
     g_object_unref(connection);
   }
 }
@@ -658,7 +1002,9 @@ inf_communication_registry_group_unrefed(gpointer user_data,
   gpointer value;
 
   InfXmlConnection* connection;
+  InfCommunicationRegistryConnection* conn;
   gboolean registered;
+  gboolean was_scheduling;
 
   entry = (InfCommunicationRegistryEntry*)user_data;
   registry = entry->registry;
@@ -678,11 +1024,15 @@ inf_communication_registry_group_unrefed(gpointer user_data,
     {
       connection = entry->key.connection;
       registered = entry->registered;
+      conn = entry->conn;
 
       /* So inf_communication_registry_entry_free() does not try to weak unref
        * the non-existing group: */
       entry->group = NULL;
 
+      was_scheduling = conn->scheduling;
+      conn->scheduling = TRUE;
+
       /* TODO: This relies on entry->key.group_name being still valid.
        * valgrind suggests it is. However, I don't feel confident with this.
        * I this can be properly fixed when we keep the group alive for
@@ -693,6 +1043,15 @@ inf_communication_registry_group_unrefed(gpointer user_data,
       if(registered == TRUE)
         inf_communication_registry_remove_connection(registry, connection);
 
+      conn->scheduling = was_scheduling;
+
+      /* The entry's messages in flight are no longer counted, so other
+       * entries might be able to send again. */
+      if(conn->registration_count > 0 && conn->inner_count == 0)
+        inf_communication_registry_connection_schedule(conn);
+      else
+        inf_communication_registry_connection_release(conn);
+
       break;
     }
   }
@@ -723,25 +1082,29 @@ inf_communication_registry_dispose(GObject* object)
 {
   InfCommunicationRegistry* registry;
   InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryConnection* conn;
   GHashTableIter iter;
   gpointer key;
+  gpointer value;
 
   registry = INF_COMMUNICATION_REGISTRY(object);
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
 
-  if(g_hash_table_size(priv->connections))
+  g_hash_table_iter_init(&iter, priv->connections);
+  while(g_hash_table_iter_next(&iter, &key, &value))
   {
-    g_warning(
-      "There are still registered connections on communication "
-      "registry dispose"
-    );
+    conn = (InfCommunicationRegistryConnection*)value;
 
-    /* Release all connections. We can't rely on a key FreeFunc since
-     * the signal handlers cannot be disconnected easily this way as we
-     * don't have access to the registry in the FreeFunc. */
-    g_hash_table_iter_init(&iter, priv->connections);
-    while(g_hash_table_iter_next(&iter, &key, NULL))
+    if(conn->registration_count > 0)
     {
+      g_warning(
+        "There are still registered connections on communication "
+        "registry dispose"
+      );
+
+      /* Release all connections. We can't rely on a key FreeFunc since
+       * the signal handlers cannot be disconnected easily this way as we
+       * don't have access to the registry in the FreeFunc. */
       inf_signal_handlers_disconnect_by_func(
         G_OBJECT(key),
         G_CALLBACK(inf_communication_registry_received_cb),
@@ -760,12 +1123,16 @@ inf_communication_registry_dispose(GObject* object)
         registry
       );
 
+      conn->registration_count = 0;
       g_object_unref(key);
     }
   }
 
-  g_hash_table_unref(priv->connections);
+  /* This frees the remaining connection records, as
+   * the last entry of each is removed. */
   g_hash_table_unref(priv->entries);
+  g_assert(g_hash_table_size(priv->connections) == 0);
+  g_hash_table_unref(priv->connections);
 
   G_OBJECT_CLASS(inf_communication_registry_parent_class)->dispose(object);
 }
@@ -802,6 +1169,7 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistryConnection* conn;
   InfXmlConnectionStatus status;
   gchar* local_id;
   gchar* remote_id;
@@ -820,7 +1188,7 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     inf_communication_group_get_publisher_id(group, connection);
   key.group_name = inf_communication_group_get_name(group);
 
-  inf_communication_registry_add_connection(registry, connection);
+  conn = inf_communication_registry_add_connection(registry, connection);
 
   entry = g_hash_table_lookup(priv->entries, &key);
   if(entry != NULL)
@@ -834,6 +1202,8 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     entry = g_slice_new(InfCommunicationRegistryEntry);
     entry->registry = registry;
     entry->key = key;
+    entry->conn = conn;
+    ++ conn->n_entries;
 
     g_object_get(
       G_OBJECT(connection),
@@ -856,6 +1226,9 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     entry->method = method;
 
     entry->inner_count = 0;
+    entry->inner_bulk = 0;
+    entry->ready = NULL;
+    entry->queue_length = 0;
     entry->queue_begin = NULL;
     entry->queue_end = NULL;
 
@@ -1000,6 +1373,7 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistryConnection* conn;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
@@ -1027,16 +1401,26 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
     entry->queue_end = xml;
   }
 
+  ++ entry->queue_length;
+  INF_TRACE2(message_enqueue, connection, entry->queue_length);
+
+  conn = entry->conn;
+  conn->queue_size += inf_communication_registry_message_size(xml);
+
+  inf_communication_registry_entry_make_ready(entry);
+
   /* If there is something in the inner queue, don't send directly but wait
-   * until the message has been sent, for better packing. */
-  if(entry->inner_count == 0)
+   * until the message has been sent, for better packing. Bulk messages in
+   * the inner queue don't count for interactive messages though, so that
+   * these do not need to wait for them. */
+  if(conn->inner_count == 0 ||
+     (entry->ready == &conn->ready && conn->inner_count == conn->inner_bulk))
   {
-    inf_communication_registry_send_real(
-      entry,
-      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-    );
+    inf_communication_registry_connection_schedule(conn);
   }
 
+  inf_communication_registry_connection_update_backlog(conn);
+
   g_free(key.publisher_id);
 }
 
@@ -1057,6 +1441,7 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
+  xmlNodePtr xml;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
@@ -1071,12 +1456,70 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   entry = g_hash_table_lookup(priv->entries, &key);
   g_assert(entry != NULL && entry->registered == TRUE);
 
+  for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
+    entry->conn->queue_size -= inf_communication_registry_message_size(xml);
+  inf_communication_registry_connection_update_backlog(entry->conn);
+
   /* TODO: Don't cancel messages prior activation? */
   xmlFreeNodeList(entry->queue_begin);
   entry->queue_begin = NULL;
   entry->queue_end = NULL;
+  entry->queue_length = 0;
+
+  inf_communication_registry_entry_unmake_ready(entry);
 
   g_free(key.publisher_id);
 }
 
+/**
+ * inf_communication_registry_get_queue_status:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to query the queue status.
+ * @connection: A registered #InfXmlConnection.
+ * @limit: (out) (allow-none): Location to store the number of messages that
+ * can currently be given to @connection at the same time, or %NULL.
+ * @n_enqueued: (out) (allow-none): Location to store the number of messages
+ * that have been given to @connection but were not yet sent, or %NULL.
+ * @n_queued: (out) (allow-none): Location to store the number of messages
+ * waiting to be given to @connection, or %NULL.
+ *
+ * Returns information about the messages scheduled to be sent to
+ * @connection in @group. The registry gives only a limited number of
+ * messages to the connection at a time, and keeps the others queued until
+ * these have been sent. The limit adapts to how fast @connection sends out
+ * the messages, and is shared by all groups using @connection. This
+ * function can be used to monitor the outgoing traffic.
+ */
+void
+inf_communication_registry_get_queue_status(InfCommunicationRegistry* registry,
+                                            InfCommunicationGroup* group,
+                                            InfXmlConnection* connection,
+                                            guint* limit,
+                                            guint* n_enqueued,
+                                            guint* n_queued)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_free(key.publisher_id);
+
+  g_return_if_fail(entry != NULL && entry->registered == TRUE);
+
+  if(limit != NULL) *limit = entry->conn->inner_limit;
+  if(n_enqueued != NULL) *n_enqueued = entry->inner_count;
+  if(n_queued != NULL) *n_queued = entry->queue_length;
+}
+
 /* vim:set et sw=2 ts=2: */
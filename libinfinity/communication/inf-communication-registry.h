@@ -88,6 +88,14 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
                                            InfXmlConnection* connection);
 
+void
+inf_communication_registry_get_queue_status(InfCommunicationRegistry* registry,
+                                            InfCommunicationGroup* group,
+                                            InfXmlConnection* connection,
+                                            guint* limit,
+                                            guint* n_enqueued,
+                                            guint* n_queued);
+
 G_END_DECLS
 
 #endif /* __INF_COMMUNICATION_REGISTRY_H__ */
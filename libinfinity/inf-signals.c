@@ -19,6 +19,18 @@
 
 #include <libinfinity/inf-signals.h>
 
+/**
+ * SECTION:inf-signals
+ * @title: Signal utility functions
+ * @short_description: Helper functions for connecting to and emitting signals
+ * @include: libinfinity/inf-signals.h
+ * @stability: Unstable
+ *
+ * These functions wrap some GObject signal functions, so that they can be
+ * used without compiler warnings, and add a few shortcuts that are used
+ * throughout libinfinity.
+ **/
+
 /**
  * inf_signal_handlers_disconnect_by_func:
  * @instance: The instance to remove handlers from.
@@ -88,4 +100,34 @@ inf_signal_handlers_unblock_by_func(gpointer instance,
                                            data);
 }
 
+/**
+ * inf_signal_notify_if_connected:
+ * @instance: A #GObject.
+ * @property_name: The name of a property of @instance.
+ *
+ * Emits the #GObject::notify signal for @property_name, but only if there
+ * is an unblocked handler that would receive it. This is basically
+ * g_object_notify(), except that it does not look up the property and
+ * queue the notification for objects that nobody watches, such as most
+ * requests.
+ */
+void
+inf_signal_notify_if_connected(gpointer instance,
+                               const gchar* property_name)
+{
+  static guint notify_id = 0;
+  GQuark detail;
+
+  if(notify_id == 0)
+    notify_id = g_signal_lookup("notify", G_TYPE_OBJECT);
+
+  /* If the quark does not exist yet, then nobody can have connected to
+   * notify::property_name, but there might still be handlers for all
+   * notifications, which are matched by a detail of 0. */
+  detail = g_quark_try_string(property_name);
+
+  if(g_signal_has_handler_pending(instance, notify_id, detail, FALSE))
+    g_object_notify(G_OBJECT(instance), property_name);
+}
+
 /* vim:set et sw=2 ts=2: */
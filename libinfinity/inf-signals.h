@@ -37,6 +37,10 @@ inf_signal_handlers_unblock_by_func(gpointer instance,
                                     GCallback func,
                                     gpointer data);
 
+void
+inf_signal_notify_if_connected(gpointer instance,
+                               const gchar* property_name);
+
 G_END_DECLS
 
 #endif /* __INF_SIGNALS_H__ */
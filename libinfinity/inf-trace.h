@@ -0,0 +1,65 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TRACE_H__
+#define __INF_TRACE_H__
+
+/* Static tracepoints for SystemTap, perf or bpftrace. They are only compiled
+ * in when configure was run with --enable-trace-probes, and expand to
+ * nothing otherwise. When enabled, each probe is a single nop instruction
+ * until a tracer attaches to it. The probes are in the "libinfinity"
+ * provider, and can be listed with "perf list sdt_libinfinity:*" or
+ * "bpftrace -l 'usdt:libinfinity.so:*'":
+ *
+ * request_execute(user_id, type): InfAdoptedAlgorithm starts executing a
+ *   request, with type being a #InfAdoptedRequestType.
+ * transform_begin(user_id), transform_end(user_id): A request is being
+ *   transformed to another state. Not fired for cached transformations.
+ * transform_cached(user_id): A transformation was found in the cache.
+ * apply_begin(user_id), apply_end(user_id): A transformed request is being
+ *   applied to the buffer.
+ * message_enqueue(connection, queue_length): InfCommunicationRegistry
+ *   queues a message for connection.
+ * message_sent(connection, n_messages): InfCommunicationRegistry has been
+ *   notified that n_messages messages were sent to connection.
+ * tls_record_send(connection, bytes), tls_record_recv(connection, bytes):
+ *   InfXmppConnection encrypted or decrypted a TLS record.
+ * io_iteration(timeout), io_poll_done(result): InfStandaloneIo starts to
+ *   wait for events with the given timeout in milliseconds (-1 for
+ *   infinite), and has finished waiting.
+ */
+
+/* Source files include config.h last, so pull it in here already for
+ * ENABLE_TRACE_PROBES. This header is not installed. */
+#include "config.h"
+
+#ifdef ENABLE_TRACE_PROBES
+# include <sys/sdt.h>
+# define INF_TRACE1(name, a) \
+   DTRACE_PROBE1(libinfinity, name, a)
+# define INF_TRACE2(name, a, b) \
+   DTRACE_PROBE2(libinfinity, name, a, b)
+#else
+# define INF_TRACE1(name, a) do { } while(0)
+# define INF_TRACE2(name, a, b) do { } while(0)
+#endif
+
+#endif /* __INF_TRACE_H__ */
+
+/* vim:set et sw=2 ts=2: */
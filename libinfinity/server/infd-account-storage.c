@@ -56,6 +56,9 @@
 #include <libinfinity/inf-define-enum.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 static const GFlagsValue infd_account_storage_support_values[] = {
   {
     INFD_ACCOUNT_STORAGE_SUPPORT_NOTIFICATION,
@@ -339,6 +342,159 @@ infd_account_storage_list_accounts(InfdAccountStorage* storage,
   return iface->list_accounts(storage, n_accounts, error);
 }
 
+static int
+infd_account_storage_query_accounts_cmp(gconstpointer first,
+                                        gconstpointer second)
+{
+  const InfAclAccount* first_account;
+  const InfAclAccount* second_account;
+  int res;
+
+  first_account = (const InfAclAccount*)first;
+  second_account = (const InfAclAccount*)second;
+
+  res = strcmp(first_account->name, second_account->name);
+  if(res != 0) return res;
+
+  if(first_account->id < second_account->id) return -1;
+  if(first_account->id > second_account->id) return 1;
+  return 0;
+}
+
+/**
+ * infd_account_storage_query_accounts:
+ * @storage: A #InfdAccountStorage.
+ * @prefix: (allow-none): Only return accounts whose name starts with this
+ * string, or %NULL to consider all accounts.
+ * @offset: The number of matching accounts to skip.
+ * @limit: The maximum number of accounts to return.
+ * @n_accounts: (out): An output parameter holding the number of returned
+ * accounts.
+ * @n_total: (out) (allow-none): An output parameter holding the number of
+ * accounts matching @prefix, or %NULL.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Returns a range of the accounts in @storage whose name starts with
+ * @prefix. The matching accounts are ordered by their name, and at most
+ * @limit of them are returned, starting with the one at position @offset.
+ * This allows to present a large number of accounts page by page, without
+ * ever transferring all of them. Accounts without a name are never
+ * returned.
+ *
+ * If the backend does not implement this operation directly, the result is
+ * computed by filtering the full list of accounts, as obtained with
+ * infd_account_storage_list_accounts(). In that case, this function fails if
+ * account listing is not supported by the backend either.
+ *
+ * As with infd_account_storage_list_accounts(), %NULL is returned and
+ * @n_accounts is set to 0 if no accounts are in the requested range, and
+ * an error pointer should be passed to reliably detect errors.
+ *
+ * Returns: (array length=n_accounts) (allow-none) (transfer full): An array
+ * of #InfAclAccount structures with length @n_accounts, or %NULL if
+ * @n_accounts is 0 or @error is set. Free with
+ * inf_acl_account_array_free().
+ */
+InfAclAccount*
+infd_account_storage_query_accounts(InfdAccountStorage* storage,
+                                    const gchar* prefix,
+                                    guint offset,
+                                    guint limit,
+                                    guint* n_accounts,
+                                    guint* n_total,
+                                    GError** error)
+{
+  InfdAccountStorageInterface* iface;
+  InfAclAccount* accounts;
+  guint n_listed;
+  guint n_matching;
+  guint i;
+
+  g_return_val_if_fail(INFD_IS_ACCOUNT_STORAGE(storage), NULL);
+  g_return_val_if_fail(n_accounts != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  if(prefix == NULL) prefix = "";
+  if(n_total == NULL) n_total = &n_matching;
+
+  iface = INFD_ACCOUNT_STORAGE_GET_IFACE(storage);
+  if(iface->query_accounts != NULL)
+  {
+    return iface->query_accounts(
+      storage,
+      prefix,
+      offset,
+      limit,
+      n_accounts,
+      n_total,
+      error
+    );
+  }
+
+  if(iface->list_accounts == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("The account backend does not support acount listing")
+    );
+
+    return NULL;
+  }
+
+  accounts = iface->list_accounts(storage, &n_listed, error);
+  if(accounts == NULL)
+  {
+    *n_accounts = 0;
+    *n_total = 0;
+    return NULL;
+  }
+
+  /* Move the matching accounts to the front */
+  n_matching = 0;
+  for(i = 0; i < n_listed; ++i)
+  {
+    if(accounts[i].name != NULL &&
+       g_str_has_prefix(accounts[i].name, prefix))
+    {
+      accounts[n_matching++] = accounts[i];
+    }
+    else
+    {
+      g_free(accounts[i].name);
+    }
+  }
+
+  qsort(
+    accounts,
+    n_matching,
+    sizeof(InfAclAccount),
+    infd_account_storage_query_accounts_cmp
+  );
+
+  *n_total = n_matching;
+
+  if(offset > n_matching) offset = n_matching;
+  *n_accounts = MIN(limit, n_matching - offset);
+
+  /* Free everything outside of the requested range */
+  for(i = 0; i < offset; ++i)
+    g_free(accounts[i].name);
+  for(i = offset + *n_accounts; i < n_matching; ++i)
+    g_free(accounts[i].name);
+
+  if(*n_accounts == 0)
+  {
+    g_free(accounts);
+    return NULL;
+  }
+
+  memmove(accounts, accounts + offset, *n_accounts * sizeof(InfAclAccount));
+
+  return g_realloc(accounts, *n_accounts * sizeof(InfAclAccount));
+}
+
 /**
  * infd_account_storage_add_account:
  * @storage: A #InfdAccountStorage.
@@ -83,6 +83,9 @@ typedef enum _InfdAccountStorageSupport {
  * on the backend.
  * @list_accounts: Virtual function to obtain a list of all available accounts.
  * Can be %NULL if not supported by the backend.
+ * @query_accounts: Virtual function to obtain a range of the accounts whose
+ * name starts with a given prefix, ordered by name. Can be %NULL, in which
+ * case the result is computed from @list_accounts.
  * @lookup_accounts: Virtual function to look up account by their identifier.
  * @lookup_accounts_by_name: Virtual function to reverse-lookup an account
  * identifier when given the account name.
@@ -130,6 +133,14 @@ struct _InfdAccountStorageInterface {
                                   guint* n_accounts,
                                   GError** error);
 
+  InfAclAccount* (*query_accounts)(InfdAccountStorage* storage,
+                                   const gchar* prefix,
+                                   guint offset,
+                                   guint limit,
+                                   guint* n_accounts,
+                                   guint* n_total,
+                                   GError** error);
+
   InfAclAccountId (*add_account)(InfdAccountStorage* storage,
                                  const gchar* name,
                                  gnutls_x509_crt_t* certs,
@@ -199,6 +210,15 @@ infd_account_storage_list_accounts(InfdAccountStorage* storage,
                                    guint* n_accounts,
                                    GError** error);
 
+InfAclAccount*
+infd_account_storage_query_accounts(InfdAccountStorage* storage,
+                                    const gchar* prefix,
+                                    guint offset,
+                                    guint limit,
+                                    guint* n_accounts,
+                                    guint* n_total,
+                                    GError** error);
+
 InfAclAccountId
 infd_account_storage_add_account(InfdAccountStorage* storage,
                                  const gchar* name,
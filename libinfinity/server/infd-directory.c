@@ -45,6 +45,7 @@
 #include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-cert-util.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/communication/inf-communication-object.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -67,6 +68,10 @@ struct _InfdDirectoryNode {
 
   InfAclSheetSet* acl;
   GSList* acl_connections;
+  /* Serialized acl, valid as long as the ACL cache generation matches, see
+   * infd_directory_node_acl_to_xml_for_connection() */
+  xmlNodePtr acl_xml;
+  guint acl_xml_generation;
 
   InfdDirectoryNodeType type;
   guint id;
@@ -80,6 +85,10 @@ struct _InfdDirectoryNode {
       const InfdNotePlugin* plugin;
       /* Timeout to save the session when inactive for some time */
       InfIoTimeout* save_timeout;
+      /* Position in the directory's idle_sessions queue while the save
+       * timeout is pending, or NULL if the session is over the budget and
+       * the timeout has been shortened. */
+      GList* idle_link;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
     } note;
@@ -95,10 +104,20 @@ struct _InfdDirectoryNode {
       GSList* connections;
       /* First child node */
       InfdDirectoryNode* child;
+      /* Child nodes by infd_directory_node_name_key() of their name. If
+       * several children have the same key, which can happen for nodes
+       * read from a case-sensitive storage, only one of them is in the
+       * table, and n_clashing_names counts the others. */
+      GHashTable* children_by_name;
+      guint n_clashing_names;
       /* Whether we requested the node already from the background storage.
        * This is required because the nodes field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
       gboolean explored;
+      /* Value of priv->generation when the list of children, or the ACL
+       * of one of them, last changed. Clients send this back when they
+       * explore the node again to avoid receiving the same list twice. */
+      guint generation;
     } subdir;
   } shared;
 };
@@ -142,6 +161,9 @@ struct _InfdDirectorySubreq {
     struct {
       InfdSessionProxy* session;
       InfdRequest* request;
+      /* State of the client's copy of the session if it only needs to be
+       * sent what it missed, or NULL for a full synchronization */
+      InfAdoptedStateVector* resync;
     } session;
 
     struct {
@@ -181,6 +203,44 @@ struct _InfdDirectoryTransientAccount {
   gchar* dn;
 };
 
+/* A create-acl-account request from a client whose certificate is being
+ * signed in a worker thread. */
+typedef struct _InfdDirectoryCertificateRequest
+  InfdDirectoryCertificateRequest;
+struct _InfdDirectoryCertificateRequest {
+  InfdDirectory* directory;
+  InfXmlConnection* connection;
+  gchar* seq;
+  InfAsyncOperation* operation;
+
+  /* Owned by the worker thread while the operation is running */
+  gnutls_x509_crq_t crq;
+  InfCertificateChain* certificate;
+  gnutls_x509_privkey_t private_key;
+  gnutls_x509_crt_t cert;
+  GError* error;
+};
+
+/* Sessions being written with infd_directory_flush_sessions() */
+typedef struct _InfdDirectoryFlush InfdDirectoryFlush;
+struct _InfdDirectoryFlush {
+  /* NULL once the directory has been disposed */
+  InfdDirectory* directory;
+  gboolean close_sessions;
+  guint n_written;
+  guint n_total;
+
+  InfdDirectoryFlushFunc func;
+  gpointer user_data;
+};
+
+typedef struct _InfdDirectoryFlushWrite InfdDirectoryFlushWrite;
+struct _InfdDirectoryFlushWrite {
+  InfdDirectoryFlush* flush;
+  guint node_id;
+  gchar* path;
+};
+
 typedef struct _InfdDirectoryPrivate InfdDirectoryPrivate;
 struct _InfdDirectoryPrivate {
   InfIo* io;
@@ -203,8 +263,47 @@ struct _InfdDirectoryPrivate {
   InfdDirectoryNode* root;
   InfAclSheetSet* orig_root_acl; /* in case root->acl is altered */
 
+  /* Effective permissions per node and account, see
+   * infd_directory_check_acl(). Entries from an older generation are
+   * outdated; the generation is increased whenever any ACL changes. */
+  GHashTable* acl_cache;
+  guint acl_cache_generation;
+
+  /* ACL changes that are held back until the end of a batch, see
+   * infd_directory_begin_acl_batch(). Mapping from node ID to
+   * InfdDirectoryAclBatch. */
+  guint acl_batch_depth;
+  GHashTable* acl_batch;
+
+  /* Generation counter for subdirectory contents, see
+   * infd_directory_node_touch(). The epoch is chosen randomly, and changed
+   * whenever all generations become invalid, so that a client cannot
+   * mistake a listing from an earlier server instance for a current one. */
+  guint32 epoch;
+  guint generation;
+
+  /* Subdirectories hosted on other servers, see
+   * infd_directory_set_redirect(). Mapping from path to location. */
+  GHashTable* redirects;
+
+  /* Sessions waiting for their save timeout, oldest first */
+  GQueue idle_sessions;
+  guint max_idle_sessions;
+
+  /* Advertised to clients in the welcome message */
+  guint retry_after;
+
   GSList* sync_ins;
   GSList* subscription_requests;
+  GSList* certificate_requests;
+
+  /* Removed nodes whose memory is released in the background, see
+   * infd_directory_node_free_deferred(). */
+  GQueue removed_nodes;
+  InfIoTimeout* reclaim_timeout;
+
+  /* Running infd_directory_flush_sessions() calls */
+  GSList* flushes;
 
   InfdSessionProxy* chat_session;
 };
@@ -219,6 +318,8 @@ enum {
 
   PROP_PRIVATE_KEY,
   PROP_CERTIFICATE,
+  PROP_MAX_IDLE_SESSIONS,
+  PROP_RETRY_AFTER,
 
   /* read only */
   PROP_CHAT_SESSION,
@@ -234,6 +335,41 @@ enum {
 
 static const unsigned int DAYS = 24 * 60 * 60;
 
+/* Maximum number of entries in the ACL cache before it is cleared */
+static const guint INFD_DIRECTORY_ACL_CACHE_MAX = 65536;
+
+/* Maximum number of nodes sent in one <node-list> message when a client
+ * explores a subdirectory */
+static const guint INFD_DIRECTORY_NODE_LIST_MAX = 256;
+
+/* Maximum number of removed nodes whose memory is released in one main
+ * loop iteration */
+static const guint INFD_DIRECTORY_RECLAIM_NODES = 512;
+
+typedef struct _InfdDirectoryAclCacheEntry InfdDirectoryAclCacheEntry;
+struct _InfdDirectoryAclCacheEntry {
+  gint64 key; /* node ID in the upper, account ID in the lower 32 bits */
+  guint generation;
+  InfAclMask perms;
+};
+
+/* Pending ACL changes for one node during a batch */
+typedef struct _InfdDirectoryAclBatch InfdDirectoryAclBatch;
+struct _InfdDirectoryAclBatch {
+  guint node_id;
+
+  /* All changed sheets, with later changes replacing earlier ones, or NULL
+   * if the ACL has not changed. */
+  InfAclSheetSet* sheets;
+  /* Whether the changes are sent to clients or only signalled locally */
+  gboolean announce;
+  InfdRequest* request;
+  InfXmlConnection* except;
+
+  /* Whether the ACL needs to be written to storage */
+  gboolean write;
+};
+
 #define INFD_DIRECTORY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_DIRECTORY, InfdDirectoryPrivate))
 
 /* These make sure that the node iter points to is contained in directory */
@@ -340,6 +476,141 @@ infd_directory_node_get_path(InfdDirectoryNode* node,
   g_string_free(str, FALSE);
 }
 
+/*
+ * Redirects.
+ */
+
+/* Returns the location node has been redirected to, or NULL if node is
+ * hosted locally. Redirects of node's ancestors are not considered. */
+static const gchar*
+infd_directory_node_get_redirect(InfdDirectory* directory,
+                                 InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  const gchar* location;
+  gchar* path;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Avoid building the path in the common case of no redirects */
+  if(g_hash_table_size(priv->redirects) == 0) return NULL;
+  if(node->type != INFD_DIRECTORY_NODE_SUBDIRECTORY) return NULL;
+
+  infd_directory_node_get_path(node, &path, NULL);
+  location = g_hash_table_lookup(priv->redirects, path);
+  g_free(path);
+
+  return location;
+}
+
+/* Announces the location a subdirectory has been redirected to in xml,
+ * which describes node. */
+static void
+infd_directory_node_redirect_to_xml(InfdDirectory* directory,
+                                    InfdDirectoryNode* node,
+                                    xmlNodePtr xml)
+{
+  const gchar* location;
+
+  location = infd_directory_node_get_redirect(directory, node);
+  if(location != NULL)
+    inf_xml_util_set_attribute(xml, "redirect", location);
+}
+
+/* Fails with INF_DIRECTORY_ERROR_REDIRECTED if node or one of its
+ * ancestors is hosted on a different server. */
+static gboolean
+infd_directory_check_redirect(InfdDirectory* directory,
+                              InfdDirectoryNode* node,
+                              GError** error)
+{
+  const gchar* location;
+
+  for(; node != NULL; node = node->parent)
+  {
+    location = infd_directory_node_get_redirect(directory, node);
+    if(location != NULL)
+    {
+      g_set_error(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_REDIRECTED,
+        _("The subdirectory \"%s\" is hosted on \"%s\""),
+        node->name,
+        location
+      );
+
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+infd_directory_acl_cache_entry_free(gpointer data)
+{
+  g_slice_free(InfdDirectoryAclCacheEntry, data);
+}
+
+/* Must be called whenever the ACL of any node changes, or a node with an
+ * ACL is removed. Since permissions are inherited, it affects the effective
+ * permissions of the whole subtree, so we simply outdate all entries. */
+static void
+infd_directory_invalidate_acl_cache(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  ++priv->acl_cache_generation;
+}
+
+/* Behaves like inf_browser_check_acl(), but remembers the effective
+ * permissions of account at iter, so that the path to the root node does
+ * not need to be walked again for the next check. */
+static gboolean
+infd_directory_check_acl(InfdDirectory* directory,
+                         const InfBrowserIter* iter,
+                         InfAclAccountId account,
+                         const InfAclMask* mask)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryAclCacheEntry* entry;
+  gint64 key;
+  InfAclMask result;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  key = ((gint64)iter->node_id << 32) | (guint32)account;
+  entry = g_hash_table_lookup(priv->acl_cache, &key);
+
+  if(entry == NULL || entry->generation != priv->acl_cache_generation)
+  {
+    if(entry == NULL)
+    {
+      if(g_hash_table_size(priv->acl_cache) >= INFD_DIRECTORY_ACL_CACHE_MAX)
+        g_hash_table_remove_all(priv->acl_cache);
+
+      entry = g_slice_new(InfdDirectoryAclCacheEntry);
+      entry->key = key;
+      g_hash_table_insert(priv->acl_cache, &entry->key, entry);
+    }
+
+    inf_browser_check_acl(
+      INF_BROWSER(directory),
+      iter,
+      account,
+      &INF_ACL_MASK_ALL,
+      &entry->perms
+    );
+
+    entry->generation = priv->acl_cache_generation;
+  }
+
+  inf_acl_mask_and(&entry->perms, mask, &result);
+  return inf_acl_mask_equal(&result, mask);
+}
+
 static void
 infd_directory_node_make_path(InfdDirectoryNode* node,
                               const gchar* name,
@@ -400,6 +671,16 @@ infd_directory_session_save_timeout_func(gpointer user_data)
   priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
   error = NULL;
 
+  if(timeout_data->node->shared.note.idle_link != NULL)
+  {
+    g_queue_delete_link(
+      &priv->idle_sessions,
+      timeout_data->node->shared.note.idle_link
+    );
+
+    timeout_data->node->shared.note.idle_link = NULL;
+  }
+
   infd_directory_node_get_path(timeout_data->node, &path, NULL);
 
   g_object_get(
@@ -449,8 +730,9 @@ infd_directory_session_save_timeout_func(gpointer user_data)
 }
 
 static void
-infd_directory_start_session_save_timeout(InfdDirectory* directory,
-                                          InfdDirectoryNode* node)
+infd_directory_add_session_save_timeout(InfdDirectory* directory,
+                                        InfdDirectoryNode* node,
+                                        guint msecs)
 {
   InfdDirectoryPrivate* priv;
   InfdDirectorySessionSaveTimeoutData* timeout_data;
@@ -460,15 +742,79 @@ infd_directory_start_session_save_timeout(InfdDirectory* directory,
   timeout_data->directory = directory;
   timeout_data->node = node;
 
+  node->shared.note.save_timeout = inf_io_add_timeout(
+    priv->io,
+    msecs,
+    infd_directory_session_save_timeout_func,
+    timeout_data,
+    infd_directory_session_save_timeout_data_free
+  );
+}
+
+/* Makes sure that no more than max-idle-sessions sessions are kept in
+ * memory while waiting for their save timeout. The oldest ones are saved
+ * right away instead; this is done from a new timeout so that we do not
+ * unlink a session from within a signal emission of one of its neighbours. */
+static void
+infd_directory_enforce_idle_session_budget(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  while(g_queue_get_length(&priv->idle_sessions) > priv->max_idle_sessions)
+  {
+    node = (InfdDirectoryNode*)g_queue_pop_head(&priv->idle_sessions);
+    node->shared.note.idle_link = NULL;
+
+    g_assert(node->shared.note.save_timeout != NULL);
+    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+    infd_directory_add_session_save_timeout(directory, node, 0);
+  }
+}
+
+static void
+infd_directory_start_session_save_timeout(InfdDirectory* directory,
+                                          InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
   if(priv->storage != NULL)
   {
-    node->shared.note.save_timeout = inf_io_add_timeout(
-      priv->io,
-      INFD_DIRECTORY_SAVE_TIMEOUT,
-      infd_directory_session_save_timeout_func,
-      timeout_data,
-      infd_directory_session_save_timeout_data_free
+    infd_directory_add_session_save_timeout(
+      directory,
+      node,
+      INFD_DIRECTORY_SAVE_TIMEOUT
     );
+
+    g_queue_push_tail(&priv->idle_sessions, node);
+    node->shared.note.idle_link = g_queue_peek_tail_link(&priv->idle_sessions);
+
+    infd_directory_enforce_idle_session_budget(directory);
+  }
+}
+
+static void
+infd_directory_stop_session_save_timeout(InfdDirectory* directory,
+                                         InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->shared.note.save_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+    node->shared.note.save_timeout = NULL;
+  }
+
+  if(node->shared.note.idle_link != NULL)
+  {
+    g_queue_delete_link(&priv->idle_sessions, node->shared.note.idle_link);
+    node->shared.note.idle_link = NULL;
   }
 }
 
@@ -527,10 +873,9 @@ infd_directory_session_idle_notify_cb(GObject* object,
         node
       );
     }
-    else if(node->shared.note.save_timeout != NULL)
+    else
     {
-      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-      node->shared.note.save_timeout = NULL;
+      infd_directory_stop_session_save_timeout(directory, node);
     }
   }
 }
@@ -569,12 +914,11 @@ infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
 
     inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
 
-    result = inf_browser_check_acl(
-      INF_BROWSER(directory),
+    result = infd_directory_check_acl(
+      directory,
       &iter,
       info->account_id,
-      &check_mask,
-      NULL
+      &check_mask
     );
 
     /* Reject the user join if the permission is not set. */
@@ -597,18 +941,10 @@ infd_directory_release_session(InfdDirectory* directory,
                                InfdDirectoryNode* node,
                                InfdSessionProxy* session)
 {
-  InfdDirectoryPrivate* priv;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-
   g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
   g_assert(node->shared.note.session == session);
 
-  if(node->shared.note.save_timeout != NULL)
-  {
-    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-    node->shared.note.save_timeout = NULL;
-  }
+  infd_directory_stop_session_save_timeout(directory, node);
 
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(session),
@@ -655,7 +991,6 @@ infd_directory_announce_acl_account(InfdDirectory* directory,
                                     InfXmlConnection* except)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowser* browser;
   xmlNodePtr xml;
   InfBrowserIter iter;
   InfAclMask mask;
@@ -669,7 +1004,6 @@ infd_directory_announce_acl_account(InfdDirectory* directory,
   InfAclAccountId account_id;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  browser = INF_BROWSER(directory);
 
   xml = xmlNewNode(NULL, (const xmlChar*)"add-acl-account");
   inf_acl_account_to_xml(account, xml);
@@ -688,7 +1022,7 @@ infd_directory_announce_acl_account(InfdDirectory* directory,
     account_id = conn_info->account_id;
     g_assert(account_id != 0);
 
-    if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL) &&
+    if(infd_directory_check_acl(directory, &iter, account_id, &mask) &&
        connection != except)
     {
       inf_communication_group_send_message(
@@ -704,6 +1038,19 @@ infd_directory_announce_acl_account(InfdDirectory* directory,
   xmlFreeNode(xml);
 }
 
+/* Marks that the children of node, a subdirectory, or the ACL of one of
+ * them, have changed, so that cached listings of the node are outdated. */
+static void
+infd_directory_node_touch(InfdDirectory* directory,
+                          InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  node->shared.subdir.generation = ++priv->generation;
+}
+
 /* acl_connections is a list of connections which have queried the full ACL.
  * It can be NULL in which case only the default sheet and the sheet for that
  * particular connection are sent. */
@@ -764,6 +1111,83 @@ infd_directory_acl_sheets_to_xml_for_connection(InfdDirectory* directory,
   return TRUE;
 }
 
+/* Like infd_directory_acl_sheets_to_xml_for_connection() for the ACL of
+ * node itself. The sheets are only serialized once for all connections
+ * that explore the node, and again when any ACL changes. Connections that
+ * may not see the full ACL get copies of the sheets for their own account
+ * and the default account. */
+static gboolean
+infd_directory_node_acl_to_xml_for_connection(InfdDirectory* directory,
+                                              InfdDirectoryNode* node,
+                                              InfXmlConnection* connection,
+                                              xmlNodePtr xml)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryConnectionInfo* info;
+  InfAclAccountId default_id;
+  xmlNodePtr container;
+  xmlNodePtr sheet_xml;
+  xmlNodePtr acl;
+  guint written_sheets;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->acl == NULL || node->acl->n_sheets == 0)
+    return FALSE;
+
+  if(node->acl_xml == NULL ||
+     node->acl_xml_generation != priv->acl_cache_generation)
+  {
+    if(node->acl_xml != NULL)
+      xmlFreeNode(node->acl_xml);
+
+    container = xmlNewNode(NULL, (const xmlChar*)"container");
+    inf_acl_sheet_set_to_xml(node->acl, container);
+
+    node->acl_xml = container->children;
+    xmlUnlinkNode(node->acl_xml);
+    xmlFreeNode(container);
+
+    node->acl_xml_generation = priv->acl_cache_generation;
+  }
+
+  if(g_slist_find(node->acl_connections, connection) != NULL)
+  {
+    xmlAddChild(xml, xmlCopyNode(node->acl_xml, 1));
+    return TRUE;
+  }
+
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
+
+  default_id = inf_acl_account_id_from_string("default");
+
+  /* The <sheet> children are in the same order as the sheets */
+  acl = NULL;
+  written_sheets = 0;
+  sheet_xml = node->acl_xml->children;
+  for(i = 0; i < node->acl->n_sheets && written_sheets < 2; ++i)
+  {
+    g_assert(sheet_xml != NULL);
+
+    if(node->acl->sheets[i].account == default_id ||
+       node->acl->sheets[i].account == info->account_id)
+    {
+      if(acl == NULL)
+        acl = xmlNewChild(xml, NULL, (const xmlChar*)"acl", NULL);
+      xmlAddChild(acl, xmlCopyNode(sheet_xml, 1));
+      ++written_sheets;
+    }
+
+    sheet_xml = sheet_xml->next;
+  }
+
+  if(written_sheets == 0)
+    return FALSE;
+  return TRUE;
+}
+
 static void
 infd_directory_announce_acl_sheets_for_connection(InfdDirectory* directory,
                                                   const InfdDirectoryNode* nd,
@@ -804,11 +1228,11 @@ infd_directory_announce_acl_sheets_for_connection(InfdDirectory* directory,
 }
 
 static void
-infd_directory_announce_acl_sheets(InfdDirectory* directory,
-                                   InfdDirectoryNode* node,
-                                   InfdRequest* request,
-                                   const InfAclSheetSet* sheet_set,
-                                   InfXmlConnection* except)
+infd_directory_announce_acl_sheets_now(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfdRequest* request,
+                                       const InfAclSheetSet* sheet_set,
+                                       InfXmlConnection* except)
 {
   InfdDirectoryPrivate* priv;
   xmlNodePtr xml;
@@ -872,33 +1296,341 @@ infd_directory_announce_acl_sheets(InfdDirectory* directory,
   );
 }
 
-static InfAclAccountId
-infd_directory_get_account_for_certificate(InfdDirectory* directory,
-                                           gnutls_x509_crt_t cert,
-                                           GError** error)
+static void
+infd_directory_acl_batch_free(gpointer data)
+{
+  InfdDirectoryAclBatch* batch;
+  batch = (InfdDirectoryAclBatch*)data;
+
+  if(batch->sheets != NULL)
+    inf_acl_sheet_set_free(batch->sheets);
+  if(batch->request != NULL)
+    g_object_unref(batch->request);
+  if(batch->except != NULL)
+    g_object_unref(batch->except);
+
+  g_slice_free(InfdDirectoryAclBatch, batch);
+}
+
+static InfdDirectoryAclBatch*
+infd_directory_acl_batch_lookup(InfdDirectory* directory,
+                                InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
-  gboolean supports_login_by_certificate;
+  InfdDirectoryAclBatch* batch;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_assert(priv->acl_batch_depth > 0);
 
-  supports_login_by_certificate = FALSE;
-  if(priv->account_storage != NULL)
+  batch = g_hash_table_lookup(priv->acl_batch, GUINT_TO_POINTER(node->id));
+  if(batch == NULL)
   {
-    supports_login_by_certificate = infd_account_storage_supports(
-      priv->account_storage,
-      INFD_ACCOUNT_STORAGE_SUPPORT_CERTIFICATE_LOGIN
-    );
+    batch = g_slice_new(InfdDirectoryAclBatch);
+    batch->node_id = node->id;
+    batch->sheets = NULL;
+    batch->announce = FALSE;
+    batch->request = NULL;
+    batch->except = NULL;
+    batch->write = FALSE;
+
+    g_hash_table_insert(priv->acl_batch, GUINT_TO_POINTER(node->id), batch);
   }
 
-  /* Don't create an error */
-  if(!supports_login_by_certificate)
-    return 0;
+  return batch;
+}
 
-  return infd_account_storage_login_by_certificate(
-    priv->account_storage,
-    cert,
-    error
+/* Sends out or signals the changes collected in batch */
+static void
+infd_directory_acl_batch_flush_changes(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfdDirectoryAclBatch* batch)
+{
+  InfBrowserIter iter;
+
+  if(batch->sheets != NULL)
+  {
+    if(batch->announce)
+    {
+      infd_directory_announce_acl_sheets_now(
+        directory,
+        node,
+        batch->request,
+        batch->sheets,
+        batch->except
+      );
+    }
+    else
+    {
+      iter.node_id = node->id;
+      iter.node = node;
+
+      inf_browser_acl_changed(
+        INF_BROWSER(directory),
+        &iter,
+        batch->sheets,
+        INF_REQUEST(batch->request)
+      );
+    }
+
+    inf_acl_sheet_set_free(batch->sheets);
+    batch->sheets = NULL;
+  }
+
+  if(batch->request != NULL)
+  {
+    g_object_unref(batch->request);
+    batch->request = NULL;
+  }
+
+  if(batch->except != NULL)
+  {
+    g_object_unref(batch->except);
+    batch->except = NULL;
+  }
+}
+
+/* Records an ACL change of node, which is sent to clients if announce is
+ * TRUE, and otherwise only signalled locally. If there is already a batch
+ * in progress, the change is merged with other changes of the same node, so
+ * that every connection receives only one message for the node at the end
+ * of the batch. */
+static void
+infd_directory_add_acl_change(InfdDirectory* directory,
+                              InfdDirectoryNode* node,
+                              InfdRequest* request,
+                              const InfAclSheetSet* sheet_set,
+                              gboolean announce,
+                              InfXmlConnection* except)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryAclBatch* batch;
+  InfAclSheet* sheet;
+  InfBrowserIter iter;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->acl_batch_depth == 0)
+  {
+    if(announce)
+    {
+      infd_directory_announce_acl_sheets_now(
+        directory,
+        node,
+        request,
+        sheet_set,
+        except
+      );
+    }
+    else
+    {
+      iter.node_id = node->id;
+      iter.node = node;
+
+      inf_browser_acl_changed(
+        INF_BROWSER(directory),
+        &iter,
+        sheet_set,
+        INF_REQUEST(request)
+      );
+    }
+
+    return;
+  }
+
+  batch = infd_directory_acl_batch_lookup(directory, node);
+
+  /* Changes that are made for different requests, or that go to different
+   * connections, cannot be merged. Emit the previous ones first, so that
+   * the order is kept. */
+  if(batch->sheets != NULL &&
+     (batch->announce != announce || batch->request != request ||
+      batch->except != except))
+  {
+    infd_directory_acl_batch_flush_changes(directory, node, batch);
+  }
+
+  if(batch->sheets == NULL)
+  {
+    batch->sheets = inf_acl_sheet_set_new();
+    batch->announce = announce;
+
+    if(request != NULL)
+      batch->request = g_object_ref(request);
+    if(except != NULL)
+      batch->except = g_object_ref(except);
+  }
+
+  /* Unlike inf_acl_sheet_set_merge_sheets(), keep sheets with all
+   * permissions masked out, since they tell clients to drop the sheet. */
+  for(i = 0; i < sheet_set->n_sheets; ++i)
+  {
+    sheet = inf_acl_sheet_set_add_sheet(
+      batch->sheets,
+      sheet_set->sheets[i].account
+    );
+
+    sheet->mask = sheet_set->sheets[i].mask;
+    sheet->perms = sheet_set->sheets[i].perms;
+  }
+}
+
+static void
+infd_directory_announce_acl_sheets(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   InfdRequest* request,
+                                   const InfAclSheetSet* sheet_set,
+                                   InfXmlConnection* except)
+{
+  /* The ACL of a node is part of the listing of its parent. The root
+   * node's ACL is sent in the welcome message instead. */
+  if(node->parent != NULL)
+    infd_directory_node_touch(directory, node->parent);
+
+  infd_directory_add_acl_change(
+    directory,
+    node,
+    request,
+    sheet_set,
+    TRUE,
+    except
+  );
+}
+
+/**
+ * infd_directory_begin_acl_batch:
+ * @directory: A #InfdDirectory.
+ *
+ * Starts a batch of ACL changes. Until the matching call to
+ * infd_directory_end_acl_batch(), ACL changes are collected per node
+ * instead of being sent to each connection one by one, and each node's
+ * ACL is written to storage only once. This is useful when changing the
+ * ACLs of many nodes at once. Batches can be nested.
+ */
+void
+infd_directory_begin_acl_batch(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  ++priv->acl_batch_depth;
+}
+
+static void
+infd_directory_write_acl_now(InfdDirectory* directory,
+                             InfdDirectoryNode* node);
+
+static gint
+infd_directory_acl_batch_compare_func(gconstpointer first,
+                                      gconstpointer second)
+{
+  const InfdDirectoryAclBatch* first_batch;
+  const InfdDirectoryAclBatch* second_batch;
+
+  first_batch = *(const InfdDirectoryAclBatch* const*)first;
+  second_batch = *(const InfdDirectoryAclBatch* const*)second;
+
+  if(first_batch->node_id < second_batch->node_id) return -1;
+  if(first_batch->node_id > second_batch->node_id) return 1;
+  return 0;
+}
+
+/**
+ * infd_directory_end_acl_batch:
+ * @directory: A #InfdDirectory.
+ *
+ * Ends a batch of ACL changes started with infd_directory_begin_acl_batch().
+ * When the outermost batch ends, the collected changes are sent to the
+ * connections and written to storage.
+ */
+void
+infd_directory_end_acl_batch(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  GHashTable* acl_batch;
+  GHashTableIter iter;
+  gpointer value;
+  GPtrArray* batches;
+  InfdDirectoryAclBatch* batch;
+  InfdDirectoryNode* node;
+  guint i;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_return_if_fail(priv->acl_batch_depth > 0);
+
+  if(--priv->acl_batch_depth > 0)
+    return;
+
+  /* Signal handlers might start a new batch, so take the current one out
+   * before processing it. */
+  acl_batch = priv->acl_batch;
+  priv->acl_batch = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    infd_directory_acl_batch_free
+  );
+
+  /* Process nodes in the order of their IDs, so that parents are handled
+   * before the nodes that were created in them. */
+  batches = g_ptr_array_sized_new(g_hash_table_size(acl_batch));
+  g_hash_table_iter_init(&iter, acl_batch);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+    g_ptr_array_add(batches, value);
+  g_ptr_array_sort(batches, infd_directory_acl_batch_compare_func);
+
+  for(i = 0; i < batches->len; ++i)
+  {
+    batch = (InfdDirectoryAclBatch*)g_ptr_array_index(batches, i);
+
+    /* Nodes that have been removed in the meanwhile are skipped */
+    node = g_hash_table_lookup(
+      priv->nodes,
+      GUINT_TO_POINTER(batch->node_id)
+    );
+
+    if(node != NULL)
+    {
+      infd_directory_acl_batch_flush_changes(directory, node, batch);
+      if(batch->write)
+        infd_directory_write_acl_now(directory, node);
+    }
+  }
+
+  g_ptr_array_free(batches, TRUE);
+  g_hash_table_destroy(acl_batch);
+}
+
+static InfAclAccountId
+infd_directory_get_account_for_certificate(InfdDirectory* directory,
+                                           gnutls_x509_crt_t cert,
+                                           GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  gboolean supports_login_by_certificate;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  supports_login_by_certificate = FALSE;
+  if(priv->account_storage != NULL)
+  {
+    supports_login_by_certificate = infd_account_storage_supports(
+      priv->account_storage,
+      INFD_ACCOUNT_STORAGE_SUPPORT_CERTIFICATE_LOGIN
+    );
+  }
+
+  /* Don't create an error */
+  if(!supports_login_by_certificate)
+    return 0;
+
+  return infd_account_storage_login_by_certificate(
+    priv->account_storage,
+    cert,
+    error
   );
 }
 
@@ -1010,8 +1742,8 @@ infd_directory_write_acl_at_path(InfdDirectory* directory,
 }
 
 static void
-infd_directory_write_acl(InfdDirectory* directory,
-                         InfdDirectoryNode* node)
+infd_directory_write_acl_now(InfdDirectory* directory,
+                             InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
   InfBrowserIter iter;
@@ -1037,6 +1769,26 @@ infd_directory_write_acl(InfdDirectory* directory,
   }
 }
 
+static void
+infd_directory_write_acl(InfdDirectory* directory,
+                         InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryAclBatch* batch;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->acl_batch_depth > 0)
+  {
+    batch = infd_directory_acl_batch_lookup(directory, node);
+    batch->write = TRUE;
+  }
+  else
+  {
+    infd_directory_write_acl_now(directory, node);
+  }
+}
+
 /* This function removes ACL sheets from sheet_set that do not belong to
  * any known user. Known users are given in the verify_accounts hash table,
  * and if lookup_if_not_cached is set to TRUE, then accounts not found in
@@ -1165,6 +1917,8 @@ infd_directory_verify_acl(InfdDirectory* directory,
               &sheet_set->own_sheets[i]
             );
 
+            infd_directory_invalidate_acl_cache(directory);
+
             if(report_changed_sheets)
             {
               if(changed_sheets == NULL)
@@ -1264,7 +2018,6 @@ infd_directory_verify_acl_for_node(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* child;
   InfAclSheetSet* removed_sheets;
-  InfBrowserIter iter;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
@@ -1305,13 +2058,16 @@ infd_directory_verify_acl_for_node(InfdDirectory* directory,
 
     if(removed_sheets != NULL)
     {
-      iter.node = node;
-      iter.node_id = node->id;
+      infd_directory_invalidate_acl_cache(directory);
 
-      inf_browser_acl_changed(
-        INF_BROWSER(directory),
-        &iter,
+      /* Clients drop the sheets themselves when they are told that the
+       * account was removed, so this is only signalled locally. */
+      infd_directory_add_acl_change(
+        directory,
+        node,
+        NULL,
         removed_sheets,
+        FALSE,
         NULL
       );
 
@@ -1635,6 +2391,7 @@ infd_directory_update_root_acl(InfdDirectory* directory)
   {
     inf_acl_sheet_set_free(priv->root->acl);
     priv->root->acl = copy_set;
+    infd_directory_invalidate_acl_cache(directory);
 
     infd_directory_announce_acl_sheets(
       directory,
@@ -1714,6 +2471,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    infd_directory_invalidate_acl_cache(directory);
+
     if(priv->root->acl != NULL)
       priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
     else
@@ -1764,6 +2523,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    infd_directory_invalidate_acl_cache(directory);
+
     infd_directory_announce_acl_sheets(
       directory,
       priv->root,
@@ -2109,14 +2870,42 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
   }
 }
 
+/* Returns a string that is the same for two names exactly if
+ * infd_directory_node_name_equal() considers them equal. */
+static gchar*
+infd_directory_node_name_key(const gchar* name)
+{
+  gchar* folded;
+  gchar* key;
+
+  folded = g_utf8_casefold(name, -1);
+  key = g_utf8_collate_key(folded, -1);
+  g_free(folded);
+
+  return key;
+}
+
 static void
 infd_directory_node_link(InfdDirectoryNode* node,
                          InfdDirectoryNode* parent)
 {
+  gchar* key;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(parent != NULL);
   infd_directory_return_if_subdir_fail(parent);
 
+  key = infd_directory_node_name_key(node->name);
+  if(g_hash_table_contains(parent->shared.subdir.children_by_name, key))
+  {
+    ++parent->shared.subdir.n_clashing_names;
+    g_free(key);
+  }
+  else
+  {
+    g_hash_table_insert(parent->shared.subdir.children_by_name, key, node);
+  }
+
   node->prev = NULL;
   if(parent->shared.subdir.child != NULL)
   {
@@ -2134,9 +2923,55 @@ infd_directory_node_link(InfdDirectoryNode* node,
 static void
 infd_directory_node_unlink(InfdDirectoryNode* node)
 {
+  InfdDirectoryNode* parent;
+  InfdDirectoryNode* sibling;
+  gchar* key;
+  gchar* sibling_key;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(node->parent != NULL);
 
+  parent = node->parent;
+  key = infd_directory_node_name_key(node->name);
+
+  if(g_hash_table_lookup(parent->shared.subdir.children_by_name, key) != node)
+  {
+    g_assert(parent->shared.subdir.n_clashing_names > 0);
+    --parent->shared.subdir.n_clashing_names;
+  }
+  else
+  {
+    g_hash_table_remove(parent->shared.subdir.children_by_name, key);
+
+    /* Let another child with the same name take over, if there is one */
+    if(parent->shared.subdir.n_clashing_names > 0)
+    {
+      for(sibling = parent->shared.subdir.child;
+          sibling != NULL;
+          sibling = sibling->next)
+      {
+        if(sibling == node) continue;
+
+        sibling_key = infd_directory_node_name_key(sibling->name);
+        if(strcmp(sibling_key, key) == 0)
+        {
+          g_hash_table_insert(
+            parent->shared.subdir.children_by_name,
+            sibling_key,
+            sibling
+          );
+
+          --parent->shared.subdir.n_clashing_names;
+          break;
+        }
+
+        g_free(sibling_key);
+      }
+    }
+  }
+
+  g_free(key);
+
   if(node->prev != NULL)
   {
     node->prev->next = node->next;
@@ -2181,10 +3016,13 @@ infd_directory_node_new_common(InfdDirectory* directory,
   node->name = name;
   node->acl = NULL;
   node->acl_connections = NULL;
+  node->acl_xml = NULL;
+  node->acl_xml_generation = 0;
 
   if(sheet_set != NULL)
   {
     node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+    infd_directory_invalidate_acl_cache(directory);
     if(write_acl == TRUE)
       infd_directory_write_acl(directory, node);
   }
@@ -2225,7 +3063,11 @@ infd_directory_node_new_subdirectory(InfdDirectory* directory,
 
   node->shared.subdir.connections = NULL;
   node->shared.subdir.child = NULL;
+  node->shared.subdir.children_by_name =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  node->shared.subdir.n_clashing_names = 0;
   node->shared.subdir.explored = FALSE;
+  node->shared.subdir.generation = 0;
 
   return node;
 }
@@ -2254,6 +3096,7 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.session = NULL;
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
+  node->shared.note.idle_link = NULL;
   node->shared.note.weakref = FALSE;
 
   return node;
@@ -2295,12 +3138,16 @@ static void
 infd_directory_remove_subreq(InfdDirectory* directory,
                              InfdDirectorySubreq* request);
 
+/* Removes node and, if it is an explored subdirectory, all of its children
+ * from the directory, so that they can no longer be looked up and nothing
+ * refers to them anymore. The memory of the nodes is not released, and
+ * the children stay linked to node, see infd_directory_node_release(). */
 static void
-infd_directory_node_free(InfdDirectory* directory,
-                         InfdDirectoryNode* node)
+infd_directory_node_detach(InfdDirectory* directory,
+                           InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
+  InfdDirectoryNode* child;
   gboolean removed;
 
   GSList* item;
@@ -2308,23 +3155,18 @@ infd_directory_node_free(InfdDirectory* directory,
   InfdDirectorySyncIn* sync_in;
   InfdDirectorySubreq* request;
 
-  g_return_if_fail(INFD_IS_DIRECTORY(directory));
-  g_return_if_fail(node != NULL);
-
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
   switch(node->type)
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
     g_slist_free(node->shared.subdir.connections);
+    node->shared.subdir.connections = NULL;
 
-    /* Free child nodes */
     if(node->shared.subdir.explored == TRUE)
     {
-      while(node->shared.subdir.child != NULL)
-      {
-        infd_directory_node_free(directory, node->shared.subdir.child);
-      }
+      for(child = node->shared.subdir.child; child != NULL; child = child->next)
+        infd_directory_node_detach(directory, child);
     }
 
     break;
@@ -2352,14 +3194,12 @@ infd_directory_node_free(InfdDirectory* directory,
     break;
   }
 
-  if(node->parent != NULL)
-    infd_directory_node_unlink(node);
   g_slist_free(node->acl_connections);
+  node->acl_connections = NULL;
 
-  /* Only clear ACL table after unlink, so that ACL has effect until the very
-   * moment where the node does not exist anymore, to avoid possible races. */
+  /* The ACL of the node has no effect anymore */
   if(node->acl != NULL)
-    inf_acl_sheet_set_free(node->acl);
+    infd_directory_invalidate_acl_cache(directory);
 
   /* Remove sync-ins whose parent is gone */
   for(item = priv->sync_ins; item != NULL; item = next)
@@ -2402,11 +3242,144 @@ infd_directory_node_free(InfdDirectory* directory,
 
   removed = g_hash_table_remove(priv->nodes, GUINT_TO_POINTER(node->id));
   g_assert(removed == TRUE);
+}
+
+/* Releases the memory of a node that has been detached with
+ * infd_directory_node_detach(). Its children are not released; the
+ * caller needs to take them from node->shared.subdir.child before. */
+static void
+infd_directory_node_release(InfdDirectoryNode* node)
+{
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
+    g_hash_table_destroy(node->shared.subdir.children_by_name);
+
+  if(node->acl != NULL)
+    inf_acl_sheet_set_free(node->acl);
+  if(node->acl_xml != NULL)
+    xmlFreeNode(node->acl_xml);
 
   g_free(node->name);
   g_slice_free(InfdDirectoryNode, node);
 }
 
+/* Releases up to max_nodes of the detached nodes in priv->removed_nodes,
+ * or all of them if max_nodes is 0. Children of a released subdirectory
+ * are queued in its place. Returns whether there are nodes left. */
+static gboolean
+infd_directory_reclaim_removed_nodes(InfdDirectory* directory,
+                                     guint max_nodes)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectoryNode* child;
+  guint n_nodes;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  for(n_nodes = 0; max_nodes == 0 || n_nodes < max_nodes; ++n_nodes)
+  {
+    node = g_queue_pop_head(&priv->removed_nodes);
+    if(node == NULL) break;
+
+    if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+       node->shared.subdir.explored == TRUE)
+    {
+      for(child = node->shared.subdir.child; child != NULL; child = child->next)
+        g_queue_push_tail(&priv->removed_nodes, child);
+    }
+
+    infd_directory_node_release(node);
+  }
+
+  return !g_queue_is_empty(&priv->removed_nodes);
+}
+
+static void
+infd_directory_reclaim_timeout_func(gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->reclaim_timeout = NULL;
+
+  if(infd_directory_reclaim_removed_nodes(directory,
+                                          INFD_DIRECTORY_RECLAIM_NODES))
+  {
+    priv->reclaim_timeout = inf_io_add_timeout(
+      priv->io,
+      0,
+      infd_directory_reclaim_timeout_func,
+      directory,
+      NULL
+    );
+  }
+}
+
+/* Removes node and its children from the directory right away, and
+ * releases their memory in the background, a few nodes at a time, so that
+ * removing a large subtree does not block the main loop. The caller needs
+ * to have unlinked the sessions in the subtree and told connections about
+ * the removal before. */
+static void
+infd_directory_node_free_deferred(InfdDirectory* directory,
+                                  InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->parent != NULL);
+
+  infd_directory_node_unlink(node);
+  infd_directory_node_detach(directory, node);
+  g_queue_push_tail(&priv->removed_nodes, node);
+
+  if(priv->reclaim_timeout == NULL)
+  {
+    priv->reclaim_timeout = inf_io_add_timeout(
+      priv->io,
+      0,
+      infd_directory_reclaim_timeout_func,
+      directory,
+      NULL
+    );
+  }
+}
+
+static void
+infd_directory_node_free(InfdDirectory* directory,
+                         InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  g_return_if_fail(node != NULL);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Only clear ACL table after unlink, so that ACL has effect until the very
+   * moment where the node does not exist anymore, to avoid possible races. */
+  if(node->parent != NULL)
+    infd_directory_node_unlink(node);
+  infd_directory_node_detach(directory, node);
+
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explored == TRUE)
+  {
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      g_queue_push_tail(&priv->removed_nodes, child);
+    node->shared.subdir.child = NULL;
+
+    /* Other removed nodes that are still queued are released as well */
+    infd_directory_reclaim_removed_nodes(directory, 0);
+  }
+
+  infd_directory_node_release(node);
+}
+
 static void
 infd_directory_node_remove_connection(InfdDirectoryNode* node,
                                       InfXmlConnection* connection)
@@ -2462,6 +3435,28 @@ infd_directory_node_remove_connection(InfdDirectoryNode* node,
   }
 }
 
+/* Makes the directory forget which connections have explored node and its
+ * children, or queried their ACL, for example because the connections have
+ * been told that node was removed. */
+static void
+infd_directory_node_forget_connections(InfdDirectoryNode* node)
+{
+  InfdDirectoryNode* child;
+
+  g_slist_free(node->acl_connections);
+  node->acl_connections = NULL;
+
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explored == TRUE)
+  {
+    g_slist_free(node->shared.subdir.connections);
+    node->shared.subdir.connections = NULL;
+
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      infd_directory_node_forget_connections(child);
+  }
+}
+
 /*
  * Permission enforcement
  */
@@ -2505,7 +3500,6 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   InfdDirectoryConnectionInfo* info;
   InfAclAccountId account;
 
-  InfBrowser* browser;
   InfBrowserIter iter;
   InfAclMask mask;
   xmlNodePtr child_xml;
@@ -2523,7 +3517,6 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   g_assert(info != NULL);
   account = info->account_id;
 
-  browser = INF_BROWSER(directory);
   iter.node = node;
   iter.node_id = node->id;
 
@@ -2536,7 +3529,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
        * if one of the parent folders is no longer explored */
       inf_acl_mask_set1(&mask, INF_ACL_CAN_EXPLORE_NODE);
       if(!is_explored ||
-         !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+         !infd_directory_check_acl(directory, &iter, account, &mask))
       {
         node->shared.subdir.connections =
           g_slist_remove(node->shared.subdir.connections, connection);
@@ -2625,7 +3618,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
            * is no longer explored */
           inf_acl_mask_set1(&mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
           if(!is_explored ||
-             !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+             !infd_directory_check_acl(directory, &iter, account, &mask))
           {
             infd_session_proxy_unsubscribe(proxy, connection);
           }
@@ -2643,7 +3636,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   {
     inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACL);
     if(!is_explored ||
-       !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+       !infd_directory_check_acl(directory, &iter, account, &mask))
     {
       node->acl_connections =
         g_slist_remove(node->acl_connections, connection);
@@ -2830,6 +3823,111 @@ infd_directory_lookup_account_by_name(InfdDirectory* directory,
   return account_id;
 }
 
+static int
+infd_directory_query_accounts_cmp(gconstpointer first,
+                                  gconstpointer second)
+{
+  const InfAclAccount* first_account;
+  const InfAclAccount* second_account;
+  int res;
+
+  first_account = (const InfAclAccount*)first;
+  second_account = (const InfAclAccount*)second;
+
+  res = strcmp(first_account->name, second_account->name);
+  if(res != 0) return res;
+
+  if(first_account->id < second_account->id) return -1;
+  if(first_account->id > second_account->id) return 1;
+  return 0;
+}
+
+/* Returns the accounts whose name starts with prefix, including transient
+ * accounts, in the same order as infd_account_storage_query_accounts(). */
+static InfAclAccount*
+infd_directory_query_accounts(InfdDirectory* directory,
+                              const gchar* prefix,
+                              guint offset,
+                              guint limit,
+                              guint* n_accounts,
+                              guint* n_total,
+                              GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  GArray* accounts;
+  InfAclAccount* stored;
+  guint n_stored;
+  guint n_stored_total;
+  InfAclAccount account;
+  GError* local_error;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  if(prefix == NULL) prefix = "";
+
+  accounts = g_array_new(FALSE, FALSE, sizeof(InfAclAccount));
+
+  /* Whatever is in the requested range is among the first offset + limit
+   * accounts of the storage, or among the transient accounts. */
+  n_stored_total = 0;
+  if(priv->account_storage != NULL)
+  {
+    local_error = NULL;
+
+    stored = infd_account_storage_query_accounts(
+      priv->account_storage,
+      prefix,
+      0,
+      (limit > G_MAXUINT - offset) ? G_MAXUINT : offset + limit,
+      &n_stored,
+      &n_stored_total,
+      &local_error
+    );
+
+    if(local_error != NULL)
+    {
+      g_propagate_error(error, local_error);
+      g_array_free(accounts, TRUE);
+      return NULL;
+    }
+
+    /* Take over the names from the storage result */
+    g_array_append_vals(accounts, stored, n_stored);
+    g_free(stored);
+  }
+
+  for(i = 0; i < priv->n_transient_accounts; ++i)
+  {
+    account = priv->transient_accounts[i].account;
+    if(account.name != NULL && g_str_has_prefix(account.name, prefix))
+    {
+      account.name = g_strdup(account.name);
+      g_array_append_val(accounts, account);
+      ++n_stored_total;
+    }
+  }
+
+  g_array_sort(accounts, infd_directory_query_accounts_cmp);
+
+  *n_total = n_stored_total;
+  if(offset > accounts->len) offset = accounts->len;
+  *n_accounts = MIN(limit, accounts->len - offset);
+
+  for(i = 0; i < accounts->len; ++i)
+    if(i < offset || i >= offset + *n_accounts)
+      g_free(g_array_index(accounts, InfAclAccount, i).name);
+
+  if(*n_accounts == 0)
+  {
+    g_array_free(accounts, TRUE);
+    return NULL;
+  }
+
+  g_array_remove_range(accounts, 0, offset);
+  g_array_set_size(accounts, *n_accounts);
+  return (InfAclAccount*)g_array_free(accounts, FALSE);
+}
+
 static void
 infd_directory_change_acl_account(InfdDirectory* directory,
                                   InfXmlConnection* connection,
@@ -2878,21 +3976,21 @@ infd_directory_change_acl_account(InfdDirectory* directory,
   );
 }
 
+/* This does not access the directory, so that it can be called from a
+ * worker thread, see infd_directory_handle_create_acl_account(). */
 static gnutls_x509_crt_t
-infd_directory_create_certificate_from_crq(InfdDirectory* directory,
+infd_directory_create_certificate_from_crq(InfCertificateChain* certificate,
+                                           gnutls_x509_privkey_t private_key,
                                            gnutls_x509_crq_t crq,
                                            guint64 validity,
                                            GError** error)
 {
-  InfdDirectoryPrivate* priv;
   gnutls_x509_crt_t cert;
   int res;
   guint64 timestamp;
   gchar serial_buffer[5];
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-
-  if(priv->certificate == NULL || priv->private_key == NULL)
+  if(certificate == NULL || private_key == NULL)
   {
     g_set_error_literal(
       error,
@@ -2980,8 +4078,8 @@ infd_directory_create_certificate_from_crq(InfdDirectory* directory,
   /* The certificate is now set up, we can sign it. */
   res = gnutls_x509_crt_sign2(
     cert,
-    inf_certificate_chain_get_own_certificate(priv->certificate),
-    priv->private_key,
+    inf_certificate_chain_get_own_certificate(certificate),
+    private_key,
     GNUTLS_DIG_SHA256,
     0
   );
@@ -3156,7 +4254,6 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
   InfAclAccountId account_id;
   InfAclAccountId default_id;
 
-  InfBrowser* browser;
   InfBrowserIter iter;
   InfAclMask mask;
 
@@ -3175,7 +4272,10 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
   default_id = inf_acl_account_id_from_string("default");
   g_assert(account_id != default_id);
 
-  browser = INF_BROWSER(directory);
+  /* Sheets for this account might be removed from any node, so rather than
+   * finding all of them, invalidate all cached listings at once. */
+  priv->epoch = g_random_int();
+
   iter.node = priv->root;
   iter.node_id = priv->root->id;
   inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
@@ -3203,7 +4303,7 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
     }
     else
     {
-      if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL))
+      if(infd_directory_check_acl(directory, &iter, account_id, &mask))
       {
         /* Notify if CAN_QUERY_ACCOUNT_LIST permission is set */
         notify_connections = g_slist_prepend(notify_connections, key);
@@ -3428,40 +4528,78 @@ infd_directory_node_desc_register_to_xml(const gchar* node_name,
   return xml;
 }
 
-/* Creates XML request to tell someone about a new node */
-static xmlNodePtr
-infd_directory_node_register_to_xml(InfdDirectoryNode* node)
+/* Returns an opaque string identifying the current contents of node as
+ * seen by clients. */
+static gchar*
+infd_directory_node_get_generation(InfdDirectory* directory,
+                                   InfdDirectoryNode* node)
 {
-  const InfdNotePlugin* plugin;
-  const gchar* plugin_type;
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(node->parent != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+
+  return g_strdup_printf(
+    "%08x.%u",
+    (unsigned int)priv->epoch,
+    node->shared.subdir.generation
+  );
+}
 
+static const gchar*
+infd_directory_node_get_type_string(InfdDirectoryNode* node)
+{
   switch(node->type)
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
-    plugin_type = "InfSubdirectory";
-    break;
+    return "InfSubdirectory";
   case INFD_DIRECTORY_NODE_NOTE:
-    plugin_type = node->shared.note.plugin->note_type;
-    break;
+    return node->shared.note.plugin->note_type;
   case INFD_DIRECTORY_NODE_UNKNOWN:
-    plugin_type = g_quark_to_string(node->shared.unknown.type);
-    break;
+    return g_quark_to_string(node->shared.unknown.type);
   default:
     g_assert_not_reached();
-    break;
+    return NULL;
   }
+}
+
+/* Creates XML request to tell someone about a new node */
+static xmlNodePtr
+infd_directory_node_register_to_xml(InfdDirectoryNode* node)
+{
+  g_assert(node->parent != NULL);
 
   return infd_directory_node_desc_register_to_xml(
     "add-node",
     node->id,
     node->parent,
-    plugin_type,
+    infd_directory_node_get_type_string(node),
     node->name
   );
 }
 
+/* Adds a child to a <node-list> message which describes node. This is the
+ * same as an <add-node> message, without the parent and seq attributes,
+ * which are set on the <node-list> for all its children. */
+static xmlNodePtr
+infd_directory_node_list_add_node(xmlNodePtr list,
+                                  InfdDirectoryNode* node)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewChild(list, NULL, (const xmlChar*)"node", NULL);
+  inf_xml_util_set_attribute_uint(xml, "id", node->id);
+  inf_xml_util_set_attribute(xml, "name", node->name);
+
+  inf_xml_util_set_attribute(
+    xml,
+    "type",
+    infd_directory_node_get_type_string(node)
+  );
+
+  return xml;
+}
+
 /* Creates XML request to tell someone about a removed node */
 static xmlNodePtr
 infd_directory_node_unregister_to_xml(InfdDirectoryNode* node)
@@ -3532,6 +4670,8 @@ infd_directory_node_register(InfdDirectory* directory,
   iter.node_id = node->id;
   iter.node = node;
 
+  infd_directory_node_touch(directory, node->parent);
+
   inf_browser_node_added(
     INF_BROWSER(directory),
     &iter,
@@ -3539,6 +4679,7 @@ infd_directory_node_register(InfdDirectory* directory,
   );
 
   xml = infd_directory_node_register_to_xml(node);
+  infd_directory_node_redirect_to_xml(directory, node, xml);
   if(seq != NULL)
    inf_xml_util_set_attribute(xml, "seq", seq);
 
@@ -3553,16 +4694,12 @@ infd_directory_node_register(InfdDirectory* directory,
 
       copy_xml = xmlCopyNode(xml, 1);
 
-      if(node->acl != NULL)
-      {
-        infd_directory_acl_sheets_to_xml_for_connection(
-          directory,
-          node->acl_connections,
-          node->acl,
-          INF_XML_CONNECTION(item->data),
-          copy_xml
-        );
-      }
+      infd_directory_node_acl_to_xml_for_connection(
+        directory,
+        node,
+        INF_XML_CONNECTION(item->data),
+        copy_xml
+      );
 
       inf_communication_group_send_message(
         INF_COMMUNICATION_GROUP(priv->group),
@@ -3593,6 +4730,8 @@ infd_directory_node_unregister(InfdDirectory* directory,
   iter.node_id = node->id;
   iter.node = node;
 
+  infd_directory_node_touch(directory, node->parent);
+
   inf_browser_node_removed(
     INF_BROWSER(directory),
     &iter,
@@ -3918,7 +5057,8 @@ infd_directory_add_subreq_session(InfdDirectory* directory,
                                   InfXmlConnection* connection,
                                   InfdRequest* request,
                                   guint node_id,
-                                  InfdSessionProxy* proxy)
+                                  InfdSessionProxy* proxy,
+                                  InfAdoptedStateVector* resync)
 {
   InfdDirectorySubreq* subreq;
 
@@ -3931,6 +5071,7 @@ infd_directory_add_subreq_session(InfdDirectory* directory,
 
   subreq->shared.session.session = proxy; /* take ownership */
   subreq->shared.session.request = request;
+  subreq->shared.session.resync = resync; /* take ownership */
 
   if(request != NULL)
     g_object_ref(request);
@@ -4100,6 +5241,8 @@ infd_directory_free_subreq(InfdDirectorySubreq* request)
     g_object_unref(request->shared.session.session);
     if(request->shared.session.request != NULL)
       g_object_unref(request->shared.session.request);
+    if(request->shared.session.resync != NULL)
+      inf_adopted_state_vector_free(request->shared.session.resync);
     break;
   case INFD_DIRECTORY_SUBREQ_ADD_NODE:
     g_free(request->shared.add_node.name);
@@ -4224,14 +5367,15 @@ infd_directory_node_find_child_by_name(InfdDirectoryNode* parent,
                                        const gchar* name)
 {
   InfdDirectoryNode* node;
+  gchar* key;
 
   infd_directory_return_val_if_subdir_fail(parent, NULL);
 
-  for(node = parent->shared.subdir.child; node != NULL; node = node->next)
-    if(infd_directory_node_name_equal(node->name, name))
-      return node;
+  key = infd_directory_node_name_key(name);
+  node = g_hash_table_lookup(parent->shared.subdir.children_by_name, key);
+  g_free(key);
 
-  return NULL;
+  return node;
 }
 
 /* Checks whether a node with the given name can be created in the given
@@ -5030,7 +6174,7 @@ infd_directory_node_remove(InfdDirectory* directory,
     );
 
     infd_directory_node_unregister(directory, node, request, seq);
-    infd_directory_node_free(directory, node);
+    infd_directory_node_free_deferred(directory, node);
 
     return TRUE;
   }
@@ -5206,12 +6350,11 @@ infd_directory_check_auth(InfdDirectory* directory,
   iter.node_id = node->id;
   iter.node = node;
 
-  result = inf_browser_check_acl(
-    INF_BROWSER(directory),
+  result = infd_directory_check_acl(
+    directory,
     &iter,
     info->account_id,
-    mask,
-    NULL
+    mask
   );
 
   if(result == FALSE)
@@ -5340,6 +6483,8 @@ infd_directory_send_welcome_message(InfdDirectory* directory,
   g_assert(info != NULL);
 
   inf_xml_util_set_attribute_uint(xml, "sequence-id", info->seq_id);
+  if(priv->retry_after > 0)
+    inf_xml_util_set_attribute_uint(xml, "retry-after", priv->retry_after);
 
   plugins = xmlNewChild(xml, NULL, (const xmlChar*) "note-plugins", NULL);
 
@@ -5387,10 +6532,9 @@ infd_directory_send_welcome_message(InfdDirectory* directory,
   }
 
   /* Add default ACL for the root node */
-  infd_directory_acl_sheets_to_xml_for_connection(
+  infd_directory_node_acl_to_xml_for_connection(
     directory,
-    priv->root->acl_connections,
-    priv->root->acl,
+    priv->root,
     connection,
     xml
   );
@@ -5579,6 +6723,12 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   GError* local_error;
   InfdDirectoryNode* child;
   xmlNodePtr reply_xml;
+  xmlNodePtr list_xml;
+  guint list_size;
+  guint list_count;
+  gchar* generation;
+  xmlChar* client_generation;
+  gboolean unchanged;
   gchar* seq;
   guint total;
   const InfAclSheetSet* sheet_set;
@@ -5595,21 +6745,16 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
 
   if(node == NULL) return FALSE;
 
+  if(!infd_directory_check_redirect(directory, node, error))
+    return FALSE;
+
   inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
   if(node->shared.subdir.explored == FALSE)
   {
-    request = INFD_PROGRESS_REQUEST(
-      g_object_new(
-        INFD_TYPE_PROGRESS_REQUEST,
-        "type", "explore-node",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
-    );
+    request = infd_progress_request_new("explore-node", node->id, connection);
 
     iter.node_id = node->id;
     iter.node = node;
@@ -5649,10 +6794,26 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   for(child = node->shared.subdir.child; child != NULL; child = child->next)
     ++ total;
 
+  /* If the client still has the listing from a previous exploration of this
+   * node, and nothing changed since then, then only tell it so, and leave
+   * out the children. */
+  generation = infd_directory_node_get_generation(directory, node);
+  client_generation = inf_xml_util_get_attribute(xml, "generation");
+
+  unchanged = FALSE;
+  if(client_generation != NULL)
+  {
+    if(strcmp((const char*)client_generation, generation) == 0)
+      unchanged = TRUE;
+    xmlFree(client_generation);
+  }
+
   reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-begin");
   inf_xml_util_set_attribute_uint(reply_xml, "total", total);
+  inf_xml_util_set_attribute(reply_xml, "generation", generation);
   if(seq != NULL)
     inf_xml_util_set_attribute(reply_xml, "seq", seq);
+  g_free(generation);
 
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
@@ -5660,38 +6821,84 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     reply_xml
   );
 
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+  /* Clients that understand <node-list> say so in the explore-node
+   * request, together with the maximum number of nodes per message. Older
+   * clients get one <add-node> per child. */
+  list_size = 0;
+  inf_xml_util_get_attribute_uint(xml, "node-list", &list_size, NULL);
+  if(list_size > INFD_DIRECTORY_NODE_LIST_MAX)
+    list_size = INFD_DIRECTORY_NODE_LIST_MAX;
+
+  list_xml = NULL;
+  list_count = 0;
+
+  child = NULL;
+  if(!unchanged)
+    child = node->shared.subdir.child;
+
+  for(; child != NULL; child = child->next)
   {
-    reply_xml = infd_directory_node_register_to_xml(child);
-    if(seq != NULL)
-      inf_xml_util_set_attribute(reply_xml, "seq", seq);
+    if(list_size > 0)
+    {
+      if(list_xml == NULL)
+      {
+        list_xml = xmlNewNode(NULL, (const xmlChar*)"node-list");
+        inf_xml_util_set_attribute_uint(list_xml, "parent", node->id);
+        if(seq != NULL)
+          inf_xml_util_set_attribute(list_xml, "seq", seq);
+      }
 
-    if(child->acl != NULL)
+      reply_xml = infd_directory_node_list_add_node(list_xml, child);
+    }
+    else
     {
-      infd_directory_acl_sheets_to_xml_for_connection(
-        directory,
-        child->acl_connections,
-        child->acl,
-        connection,
-        reply_xml
-      );
+      reply_xml = infd_directory_node_register_to_xml(child);
+      if(seq != NULL)
+        inf_xml_util_set_attribute(reply_xml, "seq", seq);
     }
 
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
+    infd_directory_node_redirect_to_xml(directory, child, reply_xml);
+
+    infd_directory_node_acl_to_xml_for_connection(
+      directory,
+      child,
       connection,
       reply_xml
     );
-  }
-
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
 
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+    if(list_size > 0)
+    {
+      ++list_count;
+      if(list_count == list_size || child->next == NULL)
+      {
+        reply_xml = list_xml;
+        list_xml = NULL;
+        list_count = 0;
+      }
+      else
+      {
+        reply_xml = NULL;
+      }
+    }
 
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
+    if(reply_xml != NULL)
+    {
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        connection,
+        reply_xml
+      );
+    }
+  }
+
+  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
   );
 
   /* Remember that this connection explored that node so that it gets
@@ -5743,6 +6950,9 @@ infd_directory_handle_add_node(InfdDirectory* directory,
   if(parent == NULL)
     return FALSE;
 
+  if(!infd_directory_check_redirect(directory, parent, error))
+    return FALSE;
+
   local_error = NULL;
   sheet_set = infd_directory_sheet_set_from_xml(directory, xml, &local_error);
 
@@ -5838,15 +7048,7 @@ infd_directory_handle_add_node(InfdDirectory* directory,
     return FALSE;
   }
 
-  request = INFD_REQUEST(
-    g_object_new(
-      INFD_TYPE_REQUEST,
-      "type", "add-node",
-      "node-id", parent->id,
-      "requestor", connection,
-      NULL
-    )
-  );
+  request = infd_request_new("add-node", parent->id, connection);
 
   parent_iter.node_id = parent->id;
   parent_iter.node = parent;
@@ -5963,15 +7165,7 @@ infd_directory_handle_remove_node(InfdDirectory* directory,
     if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
       return FALSE;
 
-    request = INFD_REQUEST(
-      g_object_new(
-        INFD_TYPE_REQUEST,
-        "type", "remove-node",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
-    );
+    request = infd_request_new("remove-node", node->id, connection);
 
     iter.node_id = node->id;
     iter.node = node;
@@ -6004,6 +7198,10 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   InfCommunicationGroup* group;
   const gchar* method;
   gchar* seq;
+  xmlChar* resync_attr;
+  guint instance;
+  InfAdoptedStateVector* resync;
+  gchar* resync_str;
   xmlNodePtr reply_xml;
   GError* local_error;
 
@@ -6070,15 +7268,7 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
    * storage. */
   if(request == NULL && proxy == NULL)
   {
-    request = INFD_REQUEST(
-      g_object_new(
-        INFD_TYPE_REQUEST,
-        "type", "subscribe-session",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
-    );
+    request = infd_request_new("subscribe-session", node->id, connection);
 
     iter.node_id = node->id;
     iter.node = node;
@@ -6123,6 +7313,33 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   /* We should always be able to fallback to "central" */
   g_assert(method != NULL);
 
+  /* A client that still has a copy of the session from an earlier
+   * subscription to the same proxy can ask to be sent only what it has
+   * missed since then. If that is not possible, for example because the
+   * session was reloaded from storage in the meanwhile, it is synchronized
+   * as usual. */
+  resync = NULL;
+  resync_attr = inf_xml_util_get_attribute(xml, "resync");
+  if(resync_attr != NULL)
+  {
+    if(inf_xml_util_get_attribute_uint(xml, "instance", &instance, NULL) &&
+       instance == infd_session_proxy_get_instance(proxy))
+    {
+      resync = inf_adopted_state_vector_from_string(
+        (const gchar*)resync_attr,
+        NULL
+      );
+
+      if(resync != NULL && !infd_session_proxy_can_resync(proxy, resync))
+      {
+        inf_adopted_state_vector_free(resync);
+        resync = NULL;
+      }
+    }
+
+    xmlFree(resync_attr);
+  }
+
   /* Reply that subscription was successful (so far, synchronization may
    * still fail) and tell identifier. */
   reply_xml = xmlNewNode(NULL, (const xmlChar*)"subscribe-session");
@@ -6143,13 +7360,27 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   inf_xml_util_set_attribute_uint(reply_xml, "id", node->id);
   if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-  /* This gives ownership of proxy to the subscription request */
+  inf_xml_util_set_attribute_uint(
+    reply_xml,
+    "instance",
+    infd_session_proxy_get_instance(proxy)
+  );
+
+  if(resync != NULL)
+  {
+    resync_str = inf_adopted_state_vector_to_string(resync);
+    inf_xml_util_set_attribute(reply_xml, "resync", resync_str);
+    g_free(resync_str);
+  }
+
+  /* This gives ownership of proxy and resync to the subscription request */
   infd_directory_add_subreq_session(
     directory,
     connection,
     request,
     node->id,
-    proxy
+    proxy,
+    resync
   );
 
   if(request != NULL)
@@ -6369,133 +7600,123 @@ infd_directory_handle_subscribe_chat(InfdDirectory* directory,
   return TRUE;
 }
 
-static gboolean
-infd_directory_handle_create_acl_account(InfdDirectory* directory,
-                                         InfXmlConnection* connection,
-                                         xmlNodePtr xml,
-                                         GError** error)
+static void
+infd_directory_send_request_failed(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const gchar* seq,
+                                   GError* error)
 {
   InfdDirectoryPrivate* priv;
-  xmlNodePtr child;
-  int res;
-
-  gnutls_datum_t crq_text;
-  gnutls_x509_crq_t crq;
-
-  gnutls_x509_crt_t cert;
-  gnutls_x509_crt_t* certs;
-  guint n_certs;
-  guint i;
-  gchar* cert_buffer;
-
-  gchar* seq;
   xmlNodePtr reply_xml;
 
-  gchar* name;
-  InfAclAccountId account_id;
-  InfAclAccount account;
-
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  crq_text.data = NULL;
-  for(child = xml->children; child != NULL; child = child->next)
-  {
-    if(child->type != XML_ELEMENT_NODE) continue;
+  reply_xml = inf_xml_util_new_node_from_error(error, NULL, "request-failed");
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-    if(strcmp((const char*)child->name, "crq") == 0)
-    {
-      if(child->children != NULL && child->children->type == XML_TEXT_NODE)
-      {
-        crq_text.data = (char*)child->children->content;
-        crq_text.size = strlen(crq_text.data);
-      }
-    }
-  }
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
+}
 
-  if(crq_text.data == NULL)
-  {
-    g_set_error_literal(
-      error,
-      inf_request_error_quark(),
-      INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
-      _("No certificate request provided")
-    );
+/* Runs in the worker thread, or in the main thread if the request is
+ * cancelled after the worker thread has finished. */
+static void
+infd_directory_certificate_request_free(gpointer data)
+{
+  InfdDirectoryCertificateRequest* request;
+  request = (InfdDirectoryCertificateRequest*)data;
 
-    return FALSE;
-  }
+  if(request->cert != NULL)
+    gnutls_x509_crt_deinit(request->cert);
+  if(request->error != NULL)
+    g_error_free(request->error);
 
-  /* TODO: Some of the code below should be moved to inf-cert-util */
-  
-  res = gnutls_x509_crq_init(&crq);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    inf_gnutls_set_error(error, res);
-    return FALSE;
-  }
+  gnutls_x509_privkey_deinit(request->private_key);
+  inf_certificate_chain_unref(request->certificate);
+  gnutls_x509_crq_deinit(request->crq);
 
-  res = gnutls_x509_crq_import(crq, &crq_text, GNUTLS_X509_FMT_PEM);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    gnutls_x509_crq_deinit(crq);
-    inf_gnutls_set_error(error, res);
-    return FALSE;
-  }
+  g_free(request->seq);
+  g_slice_free(InfdDirectoryCertificateRequest, request);
+}
+
+static void
+infd_directory_certificate_request_run_func(gpointer* run_data,
+                                            GDestroyNotify* run_notify,
+                                            gpointer user_data)
+{
+  InfdDirectoryCertificateRequest* request;
+  int res;
+
+  request = (InfdDirectoryCertificateRequest*)user_data;
+  *run_data = request;
+  *run_notify = infd_directory_certificate_request_free;
 
-  res = gnutls_x509_crq_verify(crq, 0);
+  res = gnutls_x509_crq_verify(request->crq, 0);
   if(res != GNUTLS_E_SUCCESS)
   {
-    gnutls_x509_crq_deinit(crq);
-    inf_gnutls_set_error(error, res);
-    return FALSE;
+    inf_gnutls_set_error(&request->error, res);
+    return;
   }
 
   /* OK, so now we have a good certificate request in front of us. Now, go
    * ahead, create the certificate and sign it with the server's key. */
-
-  cert = infd_directory_create_certificate_from_crq(
-    directory,
-    crq,
+  request->cert = infd_directory_create_certificate_from_crq(
+    request->certificate,
+    request->private_key,
+    request->crq,
     365 * DAYS,
-    error
+    &request->error
   );
+}
+
+/* Sends the signed certificate in request back to the client, after having
+ * created the account for it. */
+static gboolean
+infd_directory_certificate_request_finish(
+  InfdDirectoryCertificateRequest* request,
+  GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
+  xmlNodePtr child;
+
+  gnutls_x509_crt_t* certs;
+  guint n_certs;
+  guint i;
+  gchar* cert_buffer;
 
-  gnutls_x509_crq_deinit(crq);
-  if(cert == NULL) return FALSE;
+  gchar* name;
+  InfAclAccountId account_id;
+  InfAclAccount account;
 
-  /* Export the certificate to PEM format and send it back to the client */
-  g_assert(priv->certificate != NULL);
+  priv = INFD_DIRECTORY_PRIVATE(request->directory);
 
-  n_certs = inf_certificate_chain_get_n_certificates(priv->certificate) + 1;
-  certs = g_malloc(n_certs * sizeof(gnutls_x509_crt_t));
+  /* Export the certificate to PEM format, together with the chain it has
+   * been signed with, and send it back to the client. */
+  n_certs = inf_certificate_chain_get_n_certificates(request->certificate);
+  certs = g_malloc((n_certs + 1) * sizeof(gnutls_x509_crt_t));
 
-  for(i = 0; i < n_certs - 1; ++i)
+  for(i = 0; i < n_certs; ++i)
   {
     certs[i + 1] =
-      inf_certificate_chain_get_nth_certificate(priv->certificate, i);
+      inf_certificate_chain_get_nth_certificate(request->certificate, i);
   }
-  certs[0] = cert;
+  certs[0] = request->cert;
 
-  cert_buffer = inf_cert_util_write_certificate_mem(certs, n_certs, error);
+  cert_buffer = inf_cert_util_write_certificate_mem(certs, n_certs + 1, error);
   g_free(certs);
 
   if(cert_buffer == NULL)
     return FALSE;
 
-  /* Create seq */
-  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
-  {
-    g_free(cert_buffer);
-    gnutls_x509_crt_deinit(cert);
-    return FALSE;
-  }
-
   /* Check permissions */
-  name = infd_directory_account_name_from_certificate(cert, error);
+  name = infd_directory_account_name_from_certificate(request->cert, error);
   if(name == NULL)
   {
     g_free(cert_buffer);
-    gnutls_x509_crt_deinit(cert);
-    g_free(seq);
     return FALSE;
   }
 
@@ -6504,19 +7725,16 @@ infd_directory_handle_create_acl_account(InfdDirectory* directory,
 
   /* Create account. This function checks permissions of the connection. */
   account_id = infd_directory_create_acl_account_with_certificate(
-    directory,
+    request->directory,
     name,
-    cert,
-    connection,
+    request->cert,
+    request->connection,
     error
   );
 
-  gnutls_x509_crt_deinit(cert);
-
   if(account_id == 0)
   {
     g_free(name);
-    g_free(seq);
     g_free(cert_buffer);
     return FALSE;
   }
@@ -6526,8 +7744,8 @@ infd_directory_handle_create_acl_account(InfdDirectory* directory,
   xmlNodeAddContent(child, (const xmlChar*)cert_buffer);
   g_free(cert_buffer);
 
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
-  g_free(seq);
+  if(request->seq != NULL)
+    inf_xml_util_set_attribute(reply_xml, "seq", request->seq);
 
   account.id = account_id;
   account.name = name;
@@ -6537,88 +7755,276 @@ infd_directory_handle_create_acl_account(InfdDirectory* directory,
 
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
-    connection,
+    request->connection,
     reply_xml
   );
 
   return TRUE;
 }
 
-static gboolean
-infd_directory_handle_remove_acl_account(InfdDirectory* directory,
-                                         InfXmlConnection* connection,
-                                         xmlNodePtr xml,
-                                         GError** error)
+static void
+infd_directory_certificate_request_done_func(gpointer run_data,
+                                             gpointer user_data)
 {
+  InfdDirectoryCertificateRequest* request;
   InfdDirectoryPrivate* priv;
-  xmlChar* xml_id;
-  InfAclAccountId account_id;
-  gchar* seq;
-  gboolean result;
-
-  InfdDirectoryNode* node;
-  InfAclMask perms;
+  GError* error;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  request = (InfdDirectoryCertificateRequest*)run_data;
+  priv = INFD_DIRECTORY_PRIVATE(request->directory);
 
-  node = priv->root;
-  inf_acl_mask_set1(&perms, INF_ACL_CAN_REMOVE_ACCOUNT);
-  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
-    return FALSE;
+  priv->certificate_requests =
+    g_slist_remove(priv->certificate_requests, request);
 
-  xml_id = inf_xml_util_get_attribute_required(xml, "id", error);
-  if(xml_id == NULL) return FALSE;
+  if(request->error != NULL)
+  {
+    infd_directory_send_request_failed(
+      request->directory,
+      request->connection,
+      request->seq,
+      request->error
+    );
+  }
+  else
+  {
+    error = NULL;
+    if(!infd_directory_certificate_request_finish(request, &error))
+    {
+      infd_directory_send_request_failed(
+        request->directory,
+        request->connection,
+        request->seq,
+        error
+      );
 
-  account_id = inf_acl_account_id_from_string((const gchar*)xml_id);
-  xmlFree(xml_id);
+      g_error_free(error);
+    }
+  }
 
-  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
-    return FALSE;
+  /* The request itself is freed by the async operation */
+}
 
-  result = infd_directory_remove_acl_account(
-    directory,
-    account_id,
-    connection,
-    seq,
-    NULL,
-    error
-  );
+static void
+infd_directory_remove_cert_request(
+  InfdDirectory* directory,
+  InfdDirectoryCertificateRequest* request)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_free(seq);
+  priv->certificate_requests =
+    g_slist_remove(priv->certificate_requests, request);
 
-  return result;
+  /* This frees the request, or lets the worker thread
+   * free it if it is still running. */
+  inf_async_operation_free(request->operation);
 }
 
 static gboolean
-infd_directory_handle_query_acl_account_list(InfdDirectory* directory,
-                                             InfXmlConnection* connection,
-                                             const xmlNodePtr xml,
-                                             GError** error)
+infd_directory_handle_create_acl_account(InfdDirectory* directory,
+                                         InfXmlConnection* connection,
+                                         xmlNodePtr xml,
+                                         GError** error)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  InfdDirectoryConnectionInfo* conn_info;
-  InfAclMask perms;
-  gchar* seq;
-  GError* local_error;
-  GSList* item;
-  xmlNodePtr reply_xml;
-  gboolean notifications_enabled;
-  guint known_accounts;
+  InfdDirectoryCertificateRequest* request;
+  xmlNodePtr child;
+  int res;
 
-  InfAclAccount* accounts;
-  guint n_accounts;
-  InfAclAccountId default_id;
-  const InfAclAccount* account;
-  guint i;
+  gnutls_datum_t crq_text;
+  gnutls_x509_crq_t crq;
+  gnutls_x509_privkey_t private_key;
+  gchar* seq;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  conn_info = g_hash_table_lookup(priv->connections, connection);
-  g_assert(conn_info != NULL);
+  crq_text.data = NULL;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
 
-  node = priv->root;
-  inf_acl_mask_set1(&perms, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+    if(strcmp((const char*)child->name, "crq") == 0)
+    {
+      if(child->children != NULL && child->children->type == XML_TEXT_NODE)
+      {
+        crq_text.data = (char*)child->children->content;
+        crq_text.size = strlen(crq_text.data);
+      }
+    }
+  }
+
+  if(crq_text.data == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
+      _("No certificate request provided")
+    );
+
+    return FALSE;
+  }
+
+  if(priv->certificate == NULL || priv->private_key == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("Server does not support issuing certificates")
+    );
+
+    return FALSE;
+  }
+
+  /* TODO: Some of the code below should be moved to inf-cert-util */
+  
+  res = gnutls_x509_crq_init(&crq);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    inf_gnutls_set_error(error, res);
+    return FALSE;
+  }
+
+  res = gnutls_x509_crq_import(crq, &crq_text, GNUTLS_X509_FMT_PEM);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crq_deinit(crq);
+    inf_gnutls_set_error(error, res);
+    return FALSE;
+  }
+
+  /* The private key is not reference-counted, and it can be replaced while
+   * the worker thread is signing, so the worker gets its own copy. */
+  res = gnutls_x509_privkey_init(&private_key);
+  if(res == GNUTLS_E_SUCCESS)
+  {
+    res = gnutls_x509_privkey_cpy(private_key, priv->private_key);
+    if(res != GNUTLS_E_SUCCESS)
+      gnutls_x509_privkey_deinit(private_key);
+  }
+
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crq_deinit(crq);
+    inf_gnutls_set_error(error, res);
+    return FALSE;
+  }
+
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+  {
+    gnutls_x509_privkey_deinit(private_key);
+    gnutls_x509_crq_deinit(crq);
+    return FALSE;
+  }
+
+  /* Verifying and signing the request is done in a worker thread, so that
+   * the server keeps processing other connections' requests meanwhile. The
+   * reply is sent in infd_directory_certificate_request_done_func(). */
+  request = g_slice_new(InfdDirectoryCertificateRequest);
+  request->directory = directory;
+  request->connection = connection;
+  request->seq = seq;
+  request->crq = crq;
+  request->certificate = inf_certificate_chain_ref(priv->certificate);
+  request->private_key = private_key;
+  request->cert = NULL;
+  request->error = NULL;
+
+  request->operation = inf_async_operation_new(
+    priv->io,
+    infd_directory_certificate_request_run_func,
+    infd_directory_certificate_request_done_func,
+    request
+  );
+
+  if(!inf_async_operation_start(request->operation, error))
+  {
+    infd_directory_certificate_request_free(request);
+    return FALSE;
+  }
+
+  priv->certificate_requests =
+    g_slist_prepend(priv->certificate_requests, request);
+
+  return TRUE;
+}
+
+static gboolean
+infd_directory_handle_remove_acl_account(InfdDirectory* directory,
+                                         InfXmlConnection* connection,
+                                         xmlNodePtr xml,
+                                         GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  xmlChar* xml_id;
+  InfAclAccountId account_id;
+  gchar* seq;
+  gboolean result;
+
+  InfdDirectoryNode* node;
+  InfAclMask perms;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  node = priv->root;
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_REMOVE_ACCOUNT);
+  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
+    return FALSE;
+
+  xml_id = inf_xml_util_get_attribute_required(xml, "id", error);
+  if(xml_id == NULL) return FALSE;
+
+  account_id = inf_acl_account_id_from_string((const gchar*)xml_id);
+  xmlFree(xml_id);
+
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+    return FALSE;
+
+  result = infd_directory_remove_acl_account(
+    directory,
+    account_id,
+    connection,
+    seq,
+    NULL,
+    error
+  );
+
+  g_free(seq);
+
+  return result;
+}
+
+static gboolean
+infd_directory_handle_query_acl_account_list(InfdDirectory* directory,
+                                             InfXmlConnection* connection,
+                                             const xmlNodePtr xml,
+                                             GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectoryConnectionInfo* conn_info;
+  InfAclMask perms;
+  gchar* seq;
+  GError* local_error;
+  GSList* item;
+  xmlNodePtr reply_xml;
+  gboolean notifications_enabled;
+  guint known_accounts;
+
+  InfAclAccount* accounts;
+  guint n_accounts;
+  InfAclAccountId default_id;
+  const InfAclAccount* account;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  conn_info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(conn_info != NULL);
+
+  node = priv->root;
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
@@ -6727,6 +8133,103 @@ infd_directory_handle_query_acl_account_list(InfdDirectory* directory,
   return TRUE;
 }
 
+static gboolean
+infd_directory_handle_query_acl_accounts(InfdDirectory* directory,
+                                         InfXmlConnection* connection,
+                                         const xmlNodePtr xml,
+                                         GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfAclMask perms;
+  xmlChar* prefix;
+  guint offset;
+  guint limit;
+  gchar* seq;
+  GError* local_error;
+
+  InfAclAccount* accounts;
+  guint n_accounts;
+  guint n_total;
+  xmlNodePtr reply_xml;
+  xmlNodePtr reply_child;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Like the full account list, this needs INF_ACL_CAN_QUERY_ACCOUNT_LIST
+   * permissions. */
+  node = priv->root;
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
+    return FALSE;
+
+  offset = 0;
+  local_error = NULL;
+  if(!inf_xml_util_get_attribute_uint(xml, "offset", &offset, &local_error))
+  {
+    if(local_error != NULL)
+    {
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "limit", &limit, error))
+    return FALSE;
+
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+    return FALSE;
+
+  prefix = inf_xml_util_get_attribute(xml, "prefix");
+
+  accounts = infd_directory_query_accounts(
+    directory,
+    (const gchar*)prefix,
+    offset,
+    limit,
+    &n_accounts,
+    &n_total,
+    &local_error
+  );
+
+  if(prefix != NULL) xmlFree(prefix);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    g_free(seq);
+    return FALSE;
+  }
+
+  reply_xml = xmlNewNode(NULL, (const xmlChar*)"query-acl-accounts");
+  inf_xml_util_set_attribute_uint(reply_xml, "total", n_total);
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+  g_free(seq);
+
+  for(i = 0; i < n_accounts; ++i)
+  {
+    reply_child = xmlNewChild(
+      reply_xml,
+      NULL,
+      (const xmlChar*)"account",
+      NULL
+    );
+
+    inf_acl_account_to_xml(&accounts[i], reply_child);
+  }
+
+  inf_acl_account_array_free(accounts, n_accounts);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
+
+  return TRUE;
+}
+
 static gboolean
 infd_directory_handle_lookup_acl_accounts(InfdDirectory* directory,
                                           InfXmlConnection* connection,
@@ -6971,16 +8474,12 @@ infd_directory_handle_query_acl(InfdDirectory* directory,
   inf_xml_util_set_attribute_uint(reply_xml, "id", node->id);
   if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-  if(node->acl != NULL)
-  {
-    infd_directory_acl_sheets_to_xml_for_connection(
-      directory,
-      node->acl_connections,
-      node->acl,
-      connection,
-      reply_xml
-    );
-  }
+  infd_directory_node_acl_to_xml_for_connection(
+    directory,
+    node,
+    connection,
+    reply_xml
+  );
 
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
@@ -7092,15 +8591,7 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
     return FALSE;
   }
 
-  request = INFD_REQUEST(
-    g_object_new(
-      INFD_TYPE_REQUEST,
-      "type", "set-acl",
-      "node-id", node->id,
-      "requestor", connection,
-      NULL
-    )
-  );
+  request = infd_request_new("set-acl", node->id, connection);
 
   iter.node_id = node->id;
   iter.node = node;
@@ -7111,6 +8602,7 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   );
 
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  infd_directory_invalidate_acl_cache(directory);
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -7359,20 +8851,35 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
         g_error_free(local_error);
     }
 
-    infd_session_proxy_subscribe_to(
-      subreq->shared.session.session,
-      connection,
-      info->seq_id,
-      TRUE
-    );
-
-    break;
-  case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-    g_assert(subreq->shared.add_node.request != NULL);
-    node = subreq->shared.add_node.parent;
-
-    /* The parent node might have been removed meanwhile, also check that the
-     * permissions are still granted. */
+    /* If the request log does not cover the client's state anymore, then
+     * this sends session-close to the client, which needs to subscribe
+     * again then. */
+    if(subreq->shared.session.resync != NULL)
+    {
+      infd_session_proxy_resubscribe_to(
+        subreq->shared.session.session,
+        connection,
+        info->seq_id,
+        subreq->shared.session.resync
+      );
+    }
+    else
+    {
+      infd_session_proxy_subscribe_to(
+        subreq->shared.session.session,
+        connection,
+        info->seq_id,
+        TRUE
+      );
+    }
+
+    break;
+  case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+    g_assert(subreq->shared.add_node.request != NULL);
+    node = subreq->shared.add_node.parent;
+
+    /* The parent node might have been removed meanwhile, also check that the
+     * permissions are still granted. */
     local_error = NULL;
     conn = connection;
     infd_directory_get_add_node_permissions(
@@ -7817,6 +9324,7 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   InfdDirectorySyncIn* sync_in;
   InfXmlConnection* sync_in_connection;
   InfdDirectorySubreq* request;
+  InfdDirectoryCertificateRequest* cert_request;
   InfdDirectoryConnectionInfo* info;
 
   directory = INFD_DIRECTORY(user_data);
@@ -7854,6 +9362,17 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
       infd_directory_remove_subreq(directory, request);
   }
 
+  /* Cancel certificate signing for this connection */
+  item = priv->certificate_requests;
+  while(item != NULL)
+  {
+    cert_request = (InfdDirectoryCertificateRequest*)item->data;
+    item = item->next;
+
+    if(cert_request->connection == connection)
+      infd_directory_remove_cert_request(directory, cert_request);
+  }
+
   if(priv->root != NULL)
   {
     if(priv->root->shared.subdir.explored == TRUE)
@@ -7966,6 +9485,10 @@ infd_directory_set_storage(InfdDirectory* directory,
 
   if(storage != NULL)
   {
+    /* The nodes of the previous storage are gone, so are any listings
+     * that clients cached of them. */
+    priv->epoch = g_random_int();
+
     /* Read user list from new storage, and new ACL for the root node. This
      * overwrites the current ACL for the root node. If no new storage is set,
      * then we keep the previous ACL for the root node. */
@@ -8455,6 +9978,11 @@ infd_directory_set_account_storage(InfdDirectory* directory,
   prev_account_storage = priv->account_storage;
   priv->account_storage = account_storage;
 
+  /* Accounts that are no longer available are removed one after the other,
+   * and each of them can change the ACL of every node. Collect the changes,
+   * so that each node is written and announced only once. */
+  infd_directory_begin_acl_batch(directory);
+
   /* Fix all client accounts */
   infd_directory_relogin_clients(directory);
 
@@ -8470,6 +9998,8 @@ infd_directory_set_account_storage(InfdDirectory* directory,
     infd_directory_verify_all_acls(directory, verify_table, TRUE);
   g_hash_table_destroy(verify_table);
 
+  infd_directory_end_acl_batch(directory);
+
   /* Connect new storage, and release previous one */
   if(priv->account_storage != NULL)
   {
@@ -8545,6 +10075,31 @@ infd_directory_init(InfdDirectory* directory)
 
   priv->node_counter = 1;
   priv->nodes = g_hash_table_new(NULL, NULL);
+  priv->acl_cache = g_hash_table_new_full(
+    g_int64_hash,
+    g_int64_equal,
+    NULL,
+    infd_directory_acl_cache_entry_free
+  );
+  priv->acl_cache_generation = 0;
+
+  priv->acl_batch_depth = 0;
+  priv->acl_batch = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    infd_directory_acl_batch_free
+  );
+
+  priv->epoch = g_random_int();
+  priv->generation = 0;
+
+  priv->redirects = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    g_free
+  );
 
   /* The root node has no name. At this point we also create the root node
    * with no ACL. The ACL is read from storage in the constructor, or if no
@@ -8559,8 +10114,17 @@ infd_directory_init(InfdDirectory* directory)
   );
 
   priv->orig_root_acl = NULL;
+  g_queue_init(&priv->idle_sessions);
+  priv->max_idle_sessions = G_MAXUINT;
+  priv->retry_after = 0;
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
+  priv->certificate_requests = NULL;
+
+  g_queue_init(&priv->removed_nodes);
+  priv->reclaim_timeout = NULL;
+
+  priv->flushes = NULL;
 
   priv->chat_session = NULL;
 }
@@ -8623,6 +10187,7 @@ infd_directory_constructed(GObject* object)
 
     priv->root->acl =
       inf_acl_sheet_set_merge_sheets(priv->root->acl, &sheet_set);
+    infd_directory_invalidate_acl_cache(directory);
   }
 
   /* Note that if storage is non-NULL the root ACL has already been loaded
@@ -8638,6 +10203,7 @@ infd_directory_dispose(GObject* object)
   InfdDirectoryPrivate* priv;
   GHashTableIter iter;
   gpointer key;
+  GSList* item;
 
   directory = INFD_DIRECTORY(object);
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -8655,8 +10221,15 @@ infd_directory_dispose(GObject* object)
   
   g_assert(g_hash_table_size(priv->connections) == 0);
   g_assert(priv->subscription_requests == NULL);
+  g_assert(priv->certificate_requests == NULL);
   g_assert(priv->sync_ins == NULL);
 
+  /* Writes that are still running do not report back anymore */
+  for(item = priv->flushes; item != NULL; item = item->next)
+    ((InfdDirectoryFlush*)item->data)->directory = NULL;
+  g_slist_free(priv->flushes);
+  priv->flushes = NULL;
+
   /* We have dropped all references to connections now, so these do not try
    * to tell anyone that the directory tree has gone or whatever. */
   inf_signal_handlers_disconnect_by_func(
@@ -8685,6 +10258,15 @@ infd_directory_dispose(GObject* object)
   infd_directory_node_free(directory, priv->root);
   priv->root = NULL;
 
+  if(priv->reclaim_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->reclaim_timeout);
+    priv->reclaim_timeout = NULL;
+  }
+
+  /* Freeing the root has released all other removed nodes already */
+  g_assert(g_queue_is_empty(&priv->removed_nodes));
+
   /* Can be NULL, for example when no storage is set */
   if(priv->orig_root_acl != NULL)
   {
@@ -8695,6 +10277,16 @@ infd_directory_dispose(GObject* object)
   g_hash_table_destroy(priv->nodes);
   priv->nodes = NULL;
 
+  g_hash_table_destroy(priv->acl_cache);
+  priv->acl_cache = NULL;
+
+  g_assert(priv->acl_batch_depth == 0);
+  g_hash_table_destroy(priv->acl_batch);
+  priv->acl_batch = NULL;
+
+  g_hash_table_destroy(priv->redirects);
+  priv->redirects = NULL;
+
   g_object_unref(priv->group);
   g_object_unref(priv->communication_manager);
 
@@ -8784,6 +10376,14 @@ infd_directory_set_property(GObject* object,
   case PROP_CERTIFICATE:
     priv->certificate = (InfCertificateChain*)g_value_dup_boxed(value);
     break;
+  case PROP_MAX_IDLE_SESSIONS:
+    priv->max_idle_sessions = g_value_get_uint(value);
+    infd_directory_enforce_idle_session_budget(directory);
+    break;
+  case PROP_RETRY_AFTER:
+    /* Takes effect for connections made afterwards */
+    priv->retry_after = g_value_get_uint(value);
+    break;
   case PROP_CHAT_SESSION:
   case PROP_STATUS:
     /* read only */
@@ -8825,6 +10425,12 @@ infd_directory_get_property(GObject* object,
   case PROP_CERTIFICATE:
     g_value_set_boxed(value, priv->certificate);
     break;
+  case PROP_MAX_IDLE_SESSIONS:
+    g_value_set_uint(value, priv->max_idle_sessions);
+    break;
+  case PROP_RETRY_AFTER:
+    g_value_set_uint(value, priv->retry_after);
+    break;
   case PROP_CHAT_SESSION:
     g_value_set_object(value, G_OBJECT(priv->chat_session));
     break;
@@ -8847,13 +10453,10 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
                                              const xmlNodePtr node)
 {
   InfdDirectory* directory;
-  InfdDirectoryPrivate* priv;
   GError* local_error;
-  xmlNodePtr reply_xml;
   gchar* seq;
 
   directory = INFD_DIRECTORY(object);
-  priv = INFD_DIRECTORY_PRIVATE(directory);
   local_error = NULL;
 
   if(strcmp((const char*)node->name, "explore-node") == 0)
@@ -8946,6 +10549,15 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const char*)node->name, "query-acl-accounts") == 0)
+  {
+    infd_directory_handle_query_acl_accounts(
+      directory,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else if(strcmp((const char*)node->name, "query-acl") == 0)
   {
     infd_directory_handle_query_acl(
@@ -9005,19 +10617,9 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
 
     /* An error happened, so tell the client that the request failed and
      * what has gone wrong. */
-    reply_xml = inf_xml_util_new_node_from_error(local_error,
-                                                 NULL,
-                                                 "request-failed");
-
-    if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+    infd_directory_send_request_failed(directory, connection, seq, local_error);
     g_free(seq);
 
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      connection,
-      reply_xml
-    );
-
     g_error_free(local_error);
   }
 
@@ -9106,11 +10708,9 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
                                            InfRequest* request)
 {
   InfdDirectory* directory;
-  InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
 
   directory = INFD_DIRECTORY(browser);
-  priv = INFD_DIRECTORY_PRIVATE(directory);
 
   /* If iter is NULL then we are linking the global chat session, which is
    * already taken care of directly by infd_directory_enable_chat(), and
@@ -9129,11 +10729,7 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
      * in order to be able to re-use it when it is requested again and if
      * someone else is going to keep it around anyway, but in all other regards
      * we behave like we have dropped the session fully from memory. */
-    if(node->shared.note.save_timeout != NULL)
-    {
-      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-      node->shared.note.save_timeout = NULL;
-    }
+    infd_directory_stop_session_save_timeout(directory, node);
 
     g_object_weak_ref(
       G_OBJECT(node->shared.note.session),
@@ -9275,13 +10871,7 @@ infd_directory_browser_explore(InfBrowser* browser,
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY, NULL);
   g_return_val_if_fail(node->shared.subdir.explored == FALSE, NULL);
 
-  request = g_object_new(
-    INFD_TYPE_PROGRESS_REQUEST,
-    "type", "explore-node",
-    "node-id", node->id,
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_progress_request_new("explore-node", node->id, NULL);
 
   if(func != NULL)
   {
@@ -9372,13 +10962,7 @@ infd_directory_browser_add_note(InfBrowser* browser,
   plugin = infd_directory_lookup_plugin(directory, type);
   g_return_val_if_fail(plugin != NULL, NULL);
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "add-node",
-    "node-id", node->id,
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_request_new("add-node", node->id, NULL);
 
   if(func != NULL)
   {
@@ -9432,13 +11016,7 @@ infd_directory_browser_add_subdirectory(InfBrowser* browser,
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY, NULL);
   g_return_val_if_fail(node->shared.subdir.explored == TRUE, NULL);
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "add-node",
-    "node-id", node->id,
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_request_new("add-node", node->id, NULL);
 
   if(func != NULL)
   {
@@ -9485,13 +11063,7 @@ infd_directory_browser_remove_node(InfBrowser* browser,
 
   node = (InfdDirectoryNode*)iter->node;
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "remove-node",
-    "node-id", node->id,
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_request_new("remove-node", node->id, NULL);
 
   if(func != NULL)
   {
@@ -9622,13 +11194,7 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   }
   else
   {
-    request = g_object_new(
-      INFD_TYPE_REQUEST,
-      "type", "subscribe-session",
-      "node-id", node->id,
-      "requestor", NULL,
-      NULL
-    );
+    request = infd_request_new("subscribe-session", node->id, NULL);
   }
 
   if(func != NULL)
@@ -9877,11 +11443,8 @@ infd_directory_browser_query_acl_account_list(InfBrowser* browser,
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  request = g_object_new(
-    INFD_TYPE_PROGRESS_REQUEST,
-    "type", "query-acl-account-list",
-    "requestor", NULL,
-    NULL
+  request = INF_REQUEST(
+    infd_progress_request_new("query-acl-account-list", G_MAXUINT, NULL)
   );
 
   if(func != NULL)
@@ -9974,11 +11537,8 @@ infd_directory_browser_lookup_acl_accounts(InfBrowser* browser,
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "lookup-acl-accounts",
-    "requestor", NULL,
-    NULL
+  request = INF_REQUEST(
+    infd_request_new("lookup-acl-accounts", G_MAXUINT, NULL)
   );
 
   if(func != NULL)
@@ -10101,11 +11661,8 @@ infd_directory_browser_lookup_acl_account_by_name(InfBrowser* browser,
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "lookup-acl-accounts",
-    "requestor", NULL,
-    NULL
+  request = INF_REQUEST(
+    infd_request_new("lookup-acl-accounts", G_MAXUINT, NULL)
   );
 
   if(func != NULL)
@@ -10184,6 +11741,73 @@ infd_directory_browser_lookup_acl_account_by_name(InfBrowser* browser,
   return NULL;
 }
 
+static InfRequest*
+infd_directory_browser_query_acl_accounts(InfBrowser* browser,
+                                          const gchar* prefix,
+                                          guint offset,
+                                          guint limit,
+                                          InfRequestFunc func,
+                                          gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfRequest* request;
+  InfAclAccount* accounts;
+  guint n_accounts;
+  guint n_total;
+  GError* error;
+
+  directory = INFD_DIRECTORY(browser);
+
+  request = INF_REQUEST(
+    infd_request_new("query-acl-accounts", G_MAXUINT, NULL)
+  );
+
+  if(func != NULL)
+  {
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(func),
+      user_data
+    );
+  }
+
+  inf_browser_begin_request(browser, NULL, INF_REQUEST(request));
+
+  error = NULL;
+  accounts = infd_directory_query_accounts(
+    directory,
+    prefix,
+    offset,
+    limit,
+    &n_accounts,
+    &n_total,
+    &error
+  );
+
+  if(error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), error);
+    g_error_free(error);
+    g_object_unref(request);
+    return NULL;
+  }
+
+  inf_request_finish(
+    request,
+    inf_request_result_make_query_acl_accounts(
+      browser,
+      accounts,
+      n_accounts,
+      n_total
+    )
+  );
+
+  g_object_unref(request);
+  inf_acl_account_array_free(accounts, n_accounts);
+  return NULL;
+}
+
 static InfRequest*
 infd_directory_browser_create_acl_account(InfBrowser* browser,
                                           gnutls_x509_crq_t crq,
@@ -10201,11 +11825,8 @@ infd_directory_browser_create_acl_account(InfBrowser* browser,
   gchar* account_name;
   gboolean ret;
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "create-acl-account",
-    "requestor", NULL,
-    NULL
+  request = INF_REQUEST(
+    infd_request_new("create-acl-account", G_MAXUINT, NULL)
   );
 
   if(func != NULL)
@@ -10223,7 +11844,8 @@ infd_directory_browser_create_acl_account(InfBrowser* browser,
   error = NULL;
 
   cert = infd_directory_create_certificate_from_crq(
-    INFD_DIRECTORY(browser),
+    INFD_DIRECTORY_PRIVATE(browser)->certificate,
+    INFD_DIRECTORY_PRIVATE(browser)->private_key,
     crq,
     365 * DAYS,
     &error
@@ -10304,12 +11926,7 @@ infd_directory_browser_remove_acl_account(InfBrowser* browser,
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "remove-acl-account",
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_request_new("remove-acl-account", G_MAXUINT, NULL);
 
   if(func != NULL)
   {
@@ -10411,13 +12028,7 @@ infd_directory_browser_set_acl(InfBrowser* browser,
 
   node = (InfdDirectoryNode*)iter->node;
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "set-acl",
-    "node-id", node->id,
-    "requestor", NULL,
-    NULL
-  );
+  request = infd_request_new("set-acl", node->id, NULL);
 
   if(func != NULL)
   {
@@ -10468,6 +12079,7 @@ infd_directory_browser_set_acl(InfBrowser* browser,
   }
 
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  infd_directory_invalidate_acl_cache(directory);
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -10587,6 +12199,56 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
     )
   );
 
+  /**
+   * InfdDirectory:max-idle-sessions:
+   *
+   * The maximum number of sessions without subscriptions which are kept in
+   * memory while waiting to be saved and unloaded. Normally a session is
+   * kept for a minute after its last subscription ended, so that it does not
+   * need to be read from storage again if somebody subscribes again soon.
+   * If more sessions than this are idle at a time, the ones which have been
+   * idle the longest are saved and unloaded right away.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_IDLE_SESSIONS,
+    g_param_spec_uint(
+      "max-idle-sessions",
+      "Maximum idle sessions",
+      "The maximum number of idle sessions to keep in memory",
+      0,
+      G_MAXUINT,
+      G_MAXUINT,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfdDirectory:retry-after:
+   *
+   * The number of milliseconds over which clients should spread their
+   * attempts to reconnect when they lose their connection to the server, or
+   * 0 to not advertise a time. It is sent to clients in the welcome message.
+   * Clients that reconnect automatically wait between half of and the full
+   * time, see #InfcBrowser:reconnect. This allows the server to pace the
+   * clients that come back after it has been restarted: with N clients and a
+   * time of T, about 2N/T clients connect per millisecond. A change of this
+   * property only applies to connections made afterwards.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_RETRY_AFTER,
+    g_param_spec_uint(
+      "retry-after",
+      "Retry after",
+      "Milliseconds over which clients spread their reconnection attempts",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CHAT_SESSION,
@@ -10691,6 +12353,7 @@ infd_directory_browser_iface_init(InfBrowserInterface* iface)
   iface->lookup_acl_accounts = infd_directory_browser_lookup_acl_accounts;
   iface->lookup_acl_account_by_name =
     infd_directory_browser_lookup_acl_account_by_name;
+  iface->query_acl_accounts = infd_directory_browser_query_acl_accounts;
   iface->create_acl_account = infd_directory_browser_create_acl_account;
   iface->remove_acl_account = infd_directory_browser_remove_acl_account;
   iface->query_acl = infd_directory_browser_query_acl;
@@ -10905,6 +12568,7 @@ infd_directory_add_plugin(InfdDirectory* directory,
       node->shared.note.session = NULL;
       node->shared.note.plugin = plugin;
       node->shared.note.save_timeout = NULL;
+      node->shared.note.idle_link = NULL;
       node->shared.note.weakref = FALSE;
     }
   }
@@ -11358,6 +13022,497 @@ infd_directory_iter_save_session(InfdDirectory* directory,
   return result;
 }
 
+static void
+infd_directory_flush_write_done(InfdDirectoryFlushWrite* write,
+                                const GError* error)
+{
+  InfdDirectoryFlush* flush;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+
+  flush = write->flush;
+  ++flush->n_written;
+
+  if(flush->directory != NULL)
+  {
+    priv = INFD_DIRECTORY_PRIVATE(flush->directory);
+
+    /* Only close the session if its content is safe */
+    if(flush->close_sessions == TRUE && error == NULL)
+    {
+      node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(write->node_id));
+      if(node != NULL && node->type == INFD_DIRECTORY_NODE_NOTE &&
+         node->shared.note.session != NULL &&
+         node->shared.note.weakref == FALSE)
+      {
+        infd_directory_node_unlink_session(flush->directory, node, NULL);
+      }
+    }
+
+    if(flush->func != NULL)
+    {
+      flush->func(
+        flush->directory,
+        write->path,
+        error,
+        flush->n_written,
+        flush->n_total,
+        flush->user_data
+      );
+    }
+
+    if(flush->n_written == flush->n_total)
+      priv->flushes = g_slist_remove(priv->flushes, flush);
+  }
+
+  if(flush->n_written == flush->n_total)
+    g_slice_free(InfdDirectoryFlush, flush);
+
+  g_free(write->path);
+  g_slice_free(InfdDirectoryFlushWrite, write);
+}
+
+static void
+infd_directory_flush_write_func(const GError* error,
+                                gpointer user_data)
+{
+  infd_directory_flush_write_done(
+    (InfdDirectoryFlushWrite*)user_data,
+    error
+  );
+}
+
+/**
+ * infd_directory_flush_sessions:
+ * @directory: A #InfdDirectory.
+ * @close_sessions: Whether to close the sessions once they have been
+ * written.
+ * @func: (scope async) (allow-none): Function to be called for every
+ * session that has been written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Writes all open sessions of @directory into the background storage. For
+ * note types whose #InfdNotePlugin provides session_write_async, a
+ * snapshot of the session is taken right away, and written by a worker
+ * thread, so that many sessions are written in parallel and the main loop
+ * keeps running meanwhile. Other sessions are written synchronously before
+ * this function returns.
+ *
+ * @func is called in the thread of the directory's #InfIo for every
+ * session, with the number of sessions written so far, and can be used to
+ * report progress. It is not called anymore once @directory has been
+ * disposed; writes that have been started are still completed by the
+ * storage then.
+ *
+ * If @close_sessions is %TRUE, every session is closed after it has been
+ * written successfully, so that it is not written again when the
+ * directory is disposed. This can be used to write all documents quickly
+ * before shutting down, when no more changes are expected. Sessions that
+ * could not be written stay open.
+ *
+ * Returns: The number of sessions being written, which is the number of
+ * times @func is going to be called. If this is 0, @func is not called.
+ */
+guint
+infd_directory_flush_sessions(InfdDirectory* directory,
+                              gboolean close_sessions,
+                              InfdDirectoryFlushFunc func,
+                              gpointer user_data)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryFlush* flush;
+  InfdDirectoryFlushWrite* write;
+  InfdDirectoryNode* node;
+  const InfdNotePlugin* plugin;
+  InfSession* session;
+  GHashTableIter iter;
+  gpointer value;
+  GSList* node_ids;
+  GSList* item;
+  guint n_total;
+  GError* error;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), 0);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->storage == NULL)
+    return 0;
+
+  /* Collect the sessions first, so that the total is known when the first
+   * of them has been written. */
+  node_ids = NULL;
+  g_hash_table_iter_init(&iter, priv->nodes);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    node = (InfdDirectoryNode*)value;
+    if(node->type == INFD_DIRECTORY_NODE_NOTE &&
+       node->shared.note.session != NULL)
+    {
+      node_ids = g_slist_prepend(node_ids, GUINT_TO_POINTER(node->id));
+    }
+  }
+
+  n_total = g_slist_length(node_ids);
+  if(n_total == 0)
+    return 0;
+
+  flush = g_slice_new(InfdDirectoryFlush);
+  flush->directory = directory;
+  flush->close_sessions = close_sessions;
+  flush->n_written = 0;
+  flush->n_total = n_total;
+  flush->func = func;
+  flush->user_data = user_data;
+  priv->flushes = g_slist_prepend(priv->flushes, flush);
+
+  /* Keep the flush alive if all sessions are written synchronously */
+  g_object_ref(directory);
+
+  for(item = node_ids; item != NULL; item = item->next)
+  {
+    node = g_hash_table_lookup(priv->nodes, item->data);
+
+    write = g_slice_new(InfdDirectoryFlushWrite);
+    write->flush = flush;
+    write->node_id = GPOINTER_TO_UINT(item->data);
+
+    error = NULL;
+    if(node == NULL || node->shared.note.session == NULL)
+    {
+      /* Closed by an earlier callback, so it has been written already */
+      write->path = NULL;
+      infd_directory_flush_write_done(write, NULL);
+      continue;
+    }
+
+    infd_directory_node_get_path(node, &write->path, NULL);
+    plugin = node->shared.note.plugin;
+
+    g_object_get(
+      G_OBJECT(node->shared.note.session),
+      "session", &session,
+      NULL
+    );
+
+    if(plugin->session_write_async != NULL)
+    {
+      result = plugin->session_write_async(
+        priv->storage,
+        priv->io,
+        session,
+        write->path,
+        plugin->user_data,
+        infd_directory_flush_write_func,
+        write,
+        &error
+      );
+
+      if(result == FALSE)
+        infd_directory_flush_write_done(write, error);
+    }
+    else
+    {
+      plugin->session_write(
+        priv->storage,
+        session,
+        write->path,
+        plugin->user_data,
+        &error
+      );
+
+      infd_directory_flush_write_done(write, error);
+    }
+
+    if(error != NULL)
+      g_error_free(error);
+
+    g_object_unref(session);
+  }
+
+  g_slist_free(node_ids);
+  g_object_unref(directory);
+
+  return n_total;
+}
+
+/**
+ * infd_directory_iter_move_node:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a node in @directory.
+ * @parent: A #InfBrowserIter pointing to an explored subdirectory in
+ * @directory.
+ * @name: The new name of the node.
+ * @error: Location to store error information.
+ *
+ * Moves the node @iter points to into @parent, under the name @name. This
+ * can also be used to rename a node, by giving its current parent as
+ * @parent. The node is moved in the background storage without rewriting
+ * its content, and keeps its ACL and, if it is a subdirectory, all of its
+ * children. The background storage needs to support
+ * infd_storage_move_node() for this.
+ *
+ * Sessions of notes within the moved node are saved and closed first,
+ * since their subscribers are told that the node has been removed and a new
+ * node has been added at the new location. Clients that have explored a
+ * moved subdirectory need to explore it again. Redirects set with
+ * infd_directory_set_redirect() refer to paths, and are not moved.
+ *
+ * On success, @iter keeps pointing to the moved node.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE otherwise.
+ */
+gboolean
+infd_directory_iter_move_node(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              const InfBrowserIter* parent,
+                              const gchar* name,
+                              GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectoryNode* parent_node;
+  InfdDirectoryNode* ancestor;
+  const gchar* identifier;
+  gchar* path;
+  gchar* new_path;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+  infd_directory_return_val_if_iter_fail(directory, parent, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = (InfdDirectoryNode*)iter->node;
+  parent_node = (InfdDirectoryNode*)parent->node;
+
+  g_return_val_if_fail(node->parent != NULL, FALSE);
+  infd_directory_return_val_if_subdir_fail(parent_node, FALSE);
+
+  if(parent_node->shared.subdir.explored == FALSE)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NOT_EXPLORED,
+      _("The subdirectory to move the node to has not been explored")
+    );
+
+    return FALSE;
+  }
+
+  for(ancestor = parent_node; ancestor != NULL; ancestor = ancestor->parent)
+  {
+    if(ancestor == node)
+    {
+      g_set_error_literal(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_FAILED,
+        _("A subdirectory cannot be moved into itself")
+      );
+
+      return FALSE;
+    }
+  }
+
+  if(parent_node == node->parent && strcmp(name, node->name) == 0)
+    return TRUE;
+
+  /* Changing only the case of the name is allowed */
+  if(infd_directory_node_find_child_by_name(parent_node, name) != node &&
+     !infd_directory_node_is_name_available(directory, parent_node, name,
+                                            error))
+  {
+    return FALSE;
+  }
+
+  if(priv->storage == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      _("No background storage available")
+    );
+
+    return FALSE;
+  }
+
+  switch(node->type)
+  {
+  case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    identifier = NULL;
+    break;
+  case INFD_DIRECTORY_NODE_NOTE:
+    identifier = node->shared.note.plugin->note_type;
+    break;
+  case INFD_DIRECTORY_NODE_UNKNOWN:
+    identifier = g_quark_to_string(node->shared.unknown.type);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  /* Sessions are written to the old location, before it is moved */
+  infd_directory_node_unlink_child_sessions(directory, node, NULL, TRUE);
+
+  infd_directory_node_get_path(node, &path, NULL);
+  infd_directory_node_make_path(parent_node, name, &new_path, NULL);
+
+  result = infd_storage_move_node(
+    priv->storage,
+    identifier,
+    path,
+    new_path,
+    error
+  );
+
+  g_free(path);
+  g_free(new_path);
+
+  if(result == FALSE)
+    return FALSE;
+
+  infd_directory_node_unregister(directory, node, NULL, NULL);
+  infd_directory_node_unlink(node);
+  infd_directory_node_forget_connections(node);
+
+  g_free(node->name);
+  node->name = g_strdup(name);
+  node->parent = parent_node;
+  infd_directory_node_link(node, parent_node);
+
+  /* The node inherits permissions from its new ancestors now */
+  infd_directory_invalidate_acl_cache(directory);
+  infd_directory_node_register(directory, node, NULL, NULL, NULL);
+
+  return TRUE;
+}
+
+/**
+ * infd_directory_iter_copy_note:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a note in @directory.
+ * @parent: A #InfBrowserIter pointing to an explored subdirectory in
+ * @directory.
+ * @name: The name of the copy.
+ * @new_iter: (out) (allow-none): Location to store an iterator pointing to
+ * the copy, or %NULL.
+ * @error: Location to store error information.
+ *
+ * Creates a copy of the note @iter points to in @parent, under the name
+ * @name. The copy is made by the background storage with
+ * infd_storage_copy_node(), without creating a session for either note and
+ * without parsing its content. #InfdFilesystemStorage lets the copy share
+ * its data with the original if the filesystem supports it. The copy gets
+ * the same ACL as the original.
+ *
+ * The copy is made from the content the note has in the storage. If a
+ * session is open for the note, changes that have not been saved with
+ * infd_directory_iter_save_session() yet are not part of the copy.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE otherwise.
+ */
+gboolean
+infd_directory_iter_copy_note(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              const InfBrowserIter* parent,
+                              const gchar* name,
+                              InfBrowserIter* new_iter,
+                              GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectoryNode* parent_node;
+  InfdDirectoryNode* new_node;
+  gchar* path;
+  gchar* new_path;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+  infd_directory_return_val_if_iter_fail(directory, parent, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = (InfdDirectoryNode*)iter->node;
+  parent_node = (InfdDirectoryNode*)parent->node;
+
+  g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_NOTE, FALSE);
+  infd_directory_return_val_if_subdir_fail(parent_node, FALSE);
+
+  if(parent_node->shared.subdir.explored == FALSE)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NOT_EXPLORED,
+      _("The subdirectory to copy the note to has not been explored")
+    );
+
+    return FALSE;
+  }
+
+  if(!infd_directory_node_is_name_available(directory, parent_node, name,
+                                            error))
+  {
+    return FALSE;
+  }
+
+  if(priv->storage == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      _("No background storage available")
+    );
+
+    return FALSE;
+  }
+
+  infd_directory_node_get_path(node, &path, NULL);
+  infd_directory_node_make_path(parent_node, name, &new_path, NULL);
+
+  result = infd_storage_copy_node(
+    priv->storage,
+    node->shared.note.plugin->note_type,
+    path,
+    new_path,
+    error
+  );
+
+  g_free(path);
+  g_free(new_path);
+
+  if(result == FALSE)
+    return FALSE;
+
+  /* The storage has copied the ACL already, so it is not written again */
+  new_node = infd_directory_node_new_note(
+    directory,
+    parent_node,
+    priv->node_counter++,
+    g_strdup(name),
+    node->acl,
+    FALSE,
+    node->shared.note.plugin
+  );
+
+  infd_directory_node_register(directory, new_node, NULL, NULL, NULL);
+
+  if(new_iter != NULL)
+  {
+    new_iter->node_id = new_node->id;
+    new_iter->node = new_node;
+  }
+
+  return TRUE;
+}
+
 /**
  * infd_directory_enable_chat:
  * @directory: A #InfdDirectory.
@@ -11407,6 +13562,8 @@ infd_directory_enable_chat(InfdDirectory* directory,
         NULL
       );
 
+      g_object_set(G_OBJECT(chat_session), "io", priv->io, NULL);
+
       g_object_unref(chat_buffer);
 
       priv->chat_session = INFD_SESSION_PROXY(
@@ -11481,6 +13638,76 @@ infd_directory_get_chat_session(InfdDirectory* directory)
   return INFD_DIRECTORY_PRIVATE(directory)->chat_session;
 }
 
+/**
+ * infd_directory_set_redirect:
+ * @directory: A #InfdDirectory.
+ * @path: The path of a subdirectory in @directory, such as "/foo/bar".
+ * @location: (allow-none): Where the content of the subdirectory is hosted,
+ * or %NULL.
+ *
+ * Announces to clients that the subdirectory at @path is hosted on a
+ * different server, identified by @location, so that the content of
+ * a large directory can be split among several servers. The format of
+ * @location is not interpreted by @directory; typically it is a host name,
+ * optionally followed by a colon and a port number. Clients see it with
+ * infc_browser_iter_get_redirect().
+ *
+ * Clients can no longer explore the subdirectory, or any subdirectory below
+ * it, nor add nodes to them; such requests fail with
+ * %INF_DIRECTORY_ERROR_REDIRECTED. Local access to the subdirectory via the
+ * #InfBrowser API is not affected. The subdirectory still needs to exist in
+ * the storage of @directory in order to be listed, for example as an empty
+ * directory.
+ *
+ * The redirect is only announced to clients which explore the parent of
+ * the subdirectory after this call. If @location is %NULL, a previously set
+ * redirect for @path is removed.
+ */
+void
+infd_directory_set_redirect(InfdDirectory* directory,
+                            const gchar* path,
+                            const gchar* location)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  g_return_if_fail(path != NULL && path[0] == '/' && path[1] != '\0');
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(location != NULL)
+    g_hash_table_insert(priv->redirects, g_strdup(path), g_strdup(location));
+  else
+    g_hash_table_remove(priv->redirects, path);
+
+  /* Listings cached by clients do not yet reflect the change */
+  priv->epoch = g_random_int();
+}
+
+/**
+ * infd_directory_get_redirect:
+ * @directory: A #InfdDirectory.
+ * @path: The path of a subdirectory in @directory.
+ *
+ * Returns the location set with infd_directory_set_redirect() for the
+ * subdirectory at @path.
+ *
+ * Returns: (allow-none): The location of the server hosting the content of
+ * the subdirectory, or %NULL if it is hosted by @directory.
+ */
+const gchar*
+infd_directory_get_redirect(InfdDirectory* directory,
+                            const gchar* path)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  return g_hash_table_lookup(priv->redirects, path);
+}
+
 /**
  * infd_directory_create_acl_account:
  * @directory: A #InfdDirectory.
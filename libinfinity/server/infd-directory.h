@@ -86,6 +86,26 @@ struct _InfdDirectory {
 typedef void(*InfdDirectoryForeachConnectionFunc)(InfXmlConnection* conn,
                                                   gpointer user_data);
 
+/**
+ * InfdDirectoryFlushFunc:
+ * @directory: The #InfdDirectory whose sessions are being written.
+ * @path: The path of the note whose session has been written.
+ * @error: Reason why writing the session failed, or %NULL on success.
+ * @n_written: The number of sessions written so far, including this one.
+ * @n_total: The number of sessions being written.
+ * @user_data: Additional data passed to infd_directory_flush_sessions().
+ *
+ * This is the signature of the callback function passed to
+ * infd_directory_flush_sessions(). It is called once for every session,
+ * whether writing it has succeeded or not.
+ */
+typedef void(*InfdDirectoryFlushFunc)(InfdDirectory* directory,
+                                      const gchar* path,
+                                      const GError* error,
+                                      guint n_written,
+                                      guint n_total,
+                                      gpointer user_data);
+
 GType
 infd_directory_get_type(void) G_GNUC_CONST;
 
@@ -129,6 +149,12 @@ void
 infd_directory_get_support_mask(InfdDirectory* directory,
                                 InfAclMask* mask);
 
+void
+infd_directory_begin_acl_batch(InfdDirectory* directory);
+
+void
+infd_directory_end_acl_batch(InfdDirectory* directory);
+
 InfAclAccountId
 infd_directory_get_acl_account_for_connection(InfdDirectory* directory,
                                               InfXmlConnection* connection);
@@ -149,6 +175,27 @@ infd_directory_iter_save_session(InfdDirectory* directory,
                                  const InfBrowserIter* iter,
                                  GError** error);
 
+guint
+infd_directory_flush_sessions(InfdDirectory* directory,
+                              gboolean close_sessions,
+                              InfdDirectoryFlushFunc func,
+                              gpointer user_data);
+
+gboolean
+infd_directory_iter_move_node(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              const InfBrowserIter* parent,
+                              const gchar* name,
+                              GError** error);
+
+gboolean
+infd_directory_iter_copy_note(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              const InfBrowserIter* parent,
+                              const gchar* name,
+                              InfBrowserIter* new_iter,
+                              GError** error);
+
 void
 infd_directory_enable_chat(InfdDirectory* directory,
                            gboolean enable);
@@ -156,6 +203,15 @@ infd_directory_enable_chat(InfdDirectory* directory,
 InfdSessionProxy*
 infd_directory_get_chat_session(InfdDirectory* directory);
 
+void
+infd_directory_set_redirect(InfdDirectory* directory,
+                            const gchar* path,
+                            const gchar* location);
+
+const gchar*
+infd_directory_get_redirect(InfdDirectory* directory,
+                            const gchar* path);
+
 InfAclAccountId
 infd_directory_create_acl_account(InfdDirectory* directory,
                                   const gchar* account_name,
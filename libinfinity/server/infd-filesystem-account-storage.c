@@ -33,6 +33,12 @@
  * accounts read from the file in memory. When you have more than a thousand
  * accounts or so you should start thinking of using a more sophisticated
  * account storage, for example a database backend.
+ *
+ * Changes to single accounts, such as a new account or the time of the last
+ * login, are appended to a log file next to the account file instead of
+ * rewriting the whole account file. The log is replayed when the account
+ * file is read, and merged into the account file once it has grown larger
+ * than the account list itself.
  **/
 
 #include <libinfinity/server/infd-filesystem-account-storage.h>
@@ -42,10 +48,13 @@
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <libxml/parser.h>
+
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 
 #include <string.h>
+#include <errno.h>
 
 typedef struct _InfdFilesystemAccountStorageAccountInfo
   InfdFilesystemAccountStorageAccountInfo;
@@ -60,6 +69,20 @@ struct _InfdFilesystemAccountStorageAccountInfo {
   gint64 last_seen;
 };
 
+/* State of the change log next to the account file */
+typedef struct _InfdFilesystemAccountStorageLog
+  InfdFilesystemAccountStorageLog;
+struct _InfdFilesystemAccountStorageLog {
+  /* Both the account file and the log header carry this number, so that a
+   * log left over from before the account file was last written is not
+   * replayed on top of it. */
+  guint serial;
+  guint n_entries;
+  /* Whether new entries can be appended to the log. If not, the next change
+   * rewrites the account file and starts a new log. */
+  gboolean valid;
+};
+
 typedef struct _InfdFilesystemAccountStoragePrivate InfdFilesystemAccountStoragePrivate;
 struct _InfdFilesystemAccountStoragePrivate {
   InfdFilesystemStorage* filesystem;
@@ -68,8 +91,22 @@ struct _InfdFilesystemAccountStoragePrivate {
   GHashTable* accounts_by_certificate; /* by certificate DN */
   GHashTable* accounts_by_name; /* by name */
   /* Note that we require names to be unique */
+
+  InfdFilesystemAccountStorageLog log;
 };
 
+/* The log is stored next to the account file with this identifier */
+static const gchar INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_IDENTIFIER[] = "log";
+
+/* The first line of the log. It is followed by the serial of the account
+ * file that the log applies to. */
+static const gchar INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MAGIC[] =
+  "inf-acl-account-log 1 ";
+
+/* The log is merged into the account file when it has more entries than
+ * this, or than there are accounts, whichever is more. */
+#define INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MIN_ENTRIES 256
+
 enum {
   PROP_0,
 
@@ -468,8 +505,227 @@ infd_filesystem_account_storage_hash_password(const gchar* password,
   return hash;
 }
 
+static void
+infd_filesystem_account_storage_system_error(int code,
+                                             GError** error)
+{
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
+static gboolean
+infd_filesystem_account_storage_parse_uint(const gchar* str,
+                                           guint* result)
+{
+  guint64 value;
+  gchar* endptr;
+
+  if(*str < '0' || *str > '9')
+    return FALSE;
+
+  errno = 0;
+  value = g_ascii_strtoull(str, &endptr, 10);
+  if(errno != 0 || *endptr != '\0' || value > G_MAXUINT)
+    return FALSE;
+
+  *result = (guint)value;
+  return TRUE;
+}
+
+/* Applies the log entry at *pos to table, and advances *pos behind it. An
+ * entry is the length of an XML node on a line of its own, followed by the
+ * node and a newline character. Returns FALSE if the entry is incomplete or
+ * cannot be parsed. */
+static gboolean
+infd_filesystem_account_storage_replay_log_entry(const gchar** pos,
+                                                 const gchar* end,
+                                                 GHashTable* table)
+{
+  const gchar* newline;
+  const gchar* payload;
+  gchar* line;
+  guint bytes;
+  gboolean result;
+
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlChar* id;
+  InfdFilesystemAccountStorageAccountInfo* info;
+
+  newline = memchr(*pos, '\n', end - *pos);
+  if(newline == NULL)
+    return FALSE;
+
+  line = g_strndup(*pos, newline - *pos);
+  result = infd_filesystem_account_storage_parse_uint(line, &bytes);
+  g_free(line);
+
+  payload = newline + 1;
+  if(!result || (gsize)(end - payload) <= bytes || payload[bytes] != '\n')
+    return FALSE;
+
+  doc = xmlReadMemory(
+    payload,
+    bytes,
+    NULL,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  );
+
+  if(doc == NULL)
+    return FALSE;
+
+  result = FALSE;
+  root = xmlDocGetRootElement(doc);
+
+  if(root != NULL && strcmp((const char*)root->name, "account") == 0)
+  {
+    info = infd_filesystem_account_storage_account_info_from_xml(root, NULL);
+    if(info != NULL)
+    {
+      g_hash_table_replace(
+        table,
+        INF_ACL_ACCOUNT_ID_TO_POINTER(info->id),
+        info
+      );
+
+      result = TRUE;
+    }
+  }
+  else if(root != NULL && strcmp((const char*)root->name, "removed") == 0)
+  {
+    id = inf_xml_util_get_attribute(root, "id");
+    if(id != NULL)
+    {
+      g_hash_table_remove(
+        table,
+        INF_ACL_ACCOUNT_ID_TO_POINTER(
+          inf_acl_account_id_from_string((const gchar*)id)
+        )
+      );
+
+      xmlFree(id);
+      result = TRUE;
+    }
+  }
+
+  xmlFreeDoc(doc);
+
+  if(result == TRUE)
+    *pos = payload + bytes + 1;
+  return result;
+}
+
+/* Applies the changes recorded in the log to table, if the log belongs to
+ * the account file with the given serial. An incomplete entry at the end of
+ * the log is ignored, but no further entries are appended to such a log. */
+static gboolean
+infd_filesystem_account_storage_replay_log(InfdFilesystemStorage* storage,
+                                           GHashTable* table,
+                                           gboolean has_serial,
+                                           guint serial,
+                                           InfdFilesystemAccountStorageLog* log,
+                                           GError** error)
+{
+  GError* local_error;
+  FILE* stream;
+  GString* content;
+  gchar chunk[4096];
+  gsize bytes;
+  const gchar* pos;
+  const gchar* end;
+  const gchar* newline;
+  gsize magic_len;
+  gchar* log_serial_str;
+  guint log_serial;
+
+  log->serial = serial;
+  log->n_entries = 0;
+  log->valid = FALSE;
+
+  local_error = NULL;
+  stream = infd_filesystem_storage_open(
+    storage,
+    INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_IDENTIFIER,
+    "/accounts",
+    "r",
+    NULL,
+    &local_error
+  );
+
+  if(stream == NULL)
+  {
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  content = g_string_new(NULL);
+  do
+  {
+    bytes = infd_filesystem_storage_stream_read(stream, chunk, sizeof(chunk));
+    g_string_append_len(content, chunk, bytes);
+  } while(bytes == sizeof(chunk));
+
+  if(ferror(stream))
+  {
+    infd_filesystem_account_storage_system_error(errno, error);
+    infd_filesystem_storage_stream_close(stream);
+    g_string_free(content, TRUE);
+    return FALSE;
+  }
+
+  infd_filesystem_storage_stream_close(stream);
+
+  pos = content->str;
+  end = content->str + content->len;
+  magic_len = strlen(INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MAGIC);
+
+  newline = memchr(pos, '\n', end - pos);
+  if(has_serial && newline != NULL && (gsize)(newline - pos) > magic_len &&
+     strncmp(pos, INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MAGIC, magic_len) == 0)
+  {
+    log_serial_str = g_strndup(pos + magic_len, newline - pos - magic_len);
+
+    if(infd_filesystem_account_storage_parse_uint(log_serial_str,
+                                                  &log_serial) &&
+       log_serial == serial)
+    {
+      pos = newline + 1;
+      while(pos < end)
+      {
+        if(!infd_filesystem_account_storage_replay_log_entry(&pos, end,
+                                                             table))
+        {
+          break;
+        }
+
+        ++log->n_entries;
+      }
+
+      log->valid = (pos == end);
+    }
+
+    g_free(log_serial_str);
+  }
+
+  g_string_free(content, TRUE);
+  return TRUE;
+}
+
 static GHashTable*
 infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
+                                          InfdFilesystemAccountStorageLog* log,
                                           GError** error)
 {
   GHashTable* table;
@@ -479,6 +735,8 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
   xmlNodePtr child;
   InfdFilesystemAccountStorageAccountInfo* info;
   gpointer id_ptr;
+  gboolean has_serial;
+  guint serial;
 
   table = g_hash_table_new_full(
     NULL,
@@ -505,6 +763,10 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
       /* The account file does not exist. This is not an error, but just means
        * the account list is empty. */
       g_error_free(local_error);
+
+      log->serial = 0;
+      log->n_entries = 0;
+      log->valid = FALSE;
       return table;
     }
 
@@ -551,7 +813,25 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
     }
   }
 
+  has_serial = inf_xml_util_get_attribute_uint(
+    root,
+    "log-serial",
+    &serial,
+    NULL
+  );
+
   xmlFreeDoc(doc);
+
+  if(!has_serial)
+    serial = 0;
+
+  if(!infd_filesystem_account_storage_replay_log(storage, table, has_serial,
+                                                 serial, log, error))
+  {
+    g_hash_table_destroy(table);
+    return NULL;
+  }
+
   return table;
 }
 
@@ -623,6 +903,7 @@ infd_filesystem_account_storage_xref_account_table(GHashTable* accounts,
 static gboolean
 infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
                                            GHashTable* table,
+                                           guint serial,
                                            GError** error)
 {
   xmlNodePtr root;
@@ -636,6 +917,7 @@ infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
   gboolean result;
 
   root = xmlNewNode(NULL, (const xmlChar*)"inf-acl-account-list");
+  inf_xml_util_set_attribute_uint(root, "log-serial", serial);
 
   g_hash_table_iter_init(&hash_iter, table);
   while(g_hash_table_iter_next(&hash_iter, NULL, &value))
@@ -660,6 +942,185 @@ infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
   return result;
 }
 
+/* Rewrites the account file with all accounts, and starts a new, empty
+ * log for it. */
+static gboolean
+infd_filesystem_account_storage_compact_log(
+  InfdFilesystemAccountStorage* storage,
+  GError** error)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  guint serial;
+  FILE* stream;
+  gchar* header;
+  gsize bytes;
+  gsize written;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+  serial = priv->log.serial + 1;
+
+  if(!infd_filesystem_account_storage_store_file(priv->filesystem,
+                                                 priv->accounts,
+                                                 serial,
+                                                 error))
+  {
+    return FALSE;
+  }
+
+  /* The account file is written, so the change is not lost even if we
+   * cannot start the new log. Until then, every change rewrites the whole
+   * account file. */
+  priv->log.serial = serial;
+  priv->log.n_entries = 0;
+  priv->log.valid = FALSE;
+
+  stream = infd_filesystem_storage_open(
+    priv->filesystem,
+    INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_IDENTIFIER,
+    "/accounts",
+    "w",
+    NULL,
+    NULL
+  );
+
+  if(stream != NULL)
+  {
+    header = g_strdup_printf(
+      "%s%u\n",
+      INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MAGIC,
+      serial
+    );
+
+    bytes = strlen(header);
+    written = infd_filesystem_storage_stream_write(stream, header, bytes);
+    g_free(header);
+
+    if(written == bytes && infd_filesystem_storage_stream_sync(stream) == 0)
+      priv->log.valid = TRUE;
+
+    infd_filesystem_storage_stream_close(stream);
+  }
+
+  return TRUE;
+}
+
+/* Records a change to the accounts on disk, which has already been made
+ * in priv->accounts. The node is appended to the log, with a single write
+ * call, so that a crash can only cut off the last entry. If that fails,
+ * the whole account file is rewritten instead. */
+static gboolean
+infd_filesystem_account_storage_log_append(
+  InfdFilesystemAccountStorage* storage,
+  xmlNodePtr xml,
+  GError** error)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  xmlBufferPtr buffer;
+  GString* entry;
+  FILE* stream;
+  gsize written;
+  gboolean success;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+  if(!priv->log.valid)
+    return infd_filesystem_account_storage_compact_log(storage, error);
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, xml, 0, 0);
+
+  entry = g_string_sized_new(xmlBufferLength(buffer) + 16);
+  g_string_printf(entry, "%d\n", xmlBufferLength(buffer));
+  g_string_append_len(
+    entry,
+    (const gchar*)xmlBufferContent(buffer),
+    xmlBufferLength(buffer)
+  );
+  g_string_append_c(entry, '\n');
+  xmlBufferFree(buffer);
+
+  success = FALSE;
+  stream = infd_filesystem_storage_open(
+    priv->filesystem,
+    INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_IDENTIFIER,
+    "/accounts",
+    "a",
+    NULL,
+    NULL
+  );
+
+  if(stream != NULL)
+  {
+    written = infd_filesystem_storage_stream_write(
+      stream,
+      entry->str,
+      entry->len
+    );
+
+    if(written == entry->len &&
+       infd_filesystem_storage_stream_sync(stream) == 0)
+    {
+      success = TRUE;
+    }
+
+    infd_filesystem_storage_stream_close(stream);
+  }
+
+  g_string_free(entry, TRUE);
+
+  if(!success)
+  {
+    priv->log.valid = FALSE;
+    return infd_filesystem_account_storage_compact_log(storage, error);
+  }
+
+  ++priv->log.n_entries;
+  if(priv->log.n_entries > INFD_FILESYSTEM_ACCOUNT_STORAGE_LOG_MIN_ENTRIES &&
+     priv->log.n_entries > g_hash_table_size(priv->accounts))
+  {
+    /* The entry is in the log already, so it does not matter whether this
+     * succeeds. */
+    infd_filesystem_account_storage_compact_log(storage, NULL);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infd_filesystem_account_storage_log_account(
+  InfdFilesystemAccountStorage* storage,
+  const InfdFilesystemAccountStorageAccountInfo* info,
+  GError** error)
+{
+  xmlNodePtr xml;
+  gboolean result;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"account");
+  infd_filesystem_account_storage_account_info_to_xml(info, xml);
+
+  result = infd_filesystem_account_storage_log_append(storage, xml, error);
+  xmlFreeNode(xml);
+
+  return result;
+}
+
+static gboolean
+infd_filesystem_account_storage_log_removal(
+  InfdFilesystemAccountStorage* storage,
+  InfAclAccountId account,
+  GError** error)
+{
+  xmlNodePtr xml;
+  gboolean result;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"removed");
+  inf_xml_util_set_attribute(xml, "id", inf_acl_account_id_to_string(account));
+
+  result = infd_filesystem_account_storage_log_append(storage, xml, error);
+  xmlFreeNode(xml);
+
+  return result;
+}
+
 static gboolean
 infd_filesystem_account_storage_set_filesystem_impl(
     InfdFilesystemAccountStorage* s,
@@ -682,12 +1143,18 @@ infd_filesystem_account_storage_set_filesystem_impl(
   gpointer value;
   InfdFilesystemAccountStorageAccountInfo* info;
   InfAclAccount notify_account;
+  InfdFilesystemAccountStorageLog new_log;
 
   priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(s);
   if(priv->filesystem == fs) return TRUE;
 
   /* Load the new accounts */
-  new_accounts = infd_filesystem_account_storage_load_file(fs, error);
+  new_accounts = infd_filesystem_account_storage_load_file(
+    fs,
+    &new_log,
+    error
+  );
+
   if(new_accounts == NULL) return FALSE;
 
   new_accounts_by_certificate = g_hash_table_new(g_str_hash, g_str_equal);
@@ -727,6 +1194,7 @@ infd_filesystem_account_storage_set_filesystem_impl(
   priv->accounts = new_accounts;
   priv->accounts_by_name = new_accounts_by_name;
   priv->accounts_by_certificate = new_accounts_by_certificate;
+  priv->log = new_log;
 
   /* Notify about changed accounts */
   g_hash_table_iter_init(&hash_iter, old_accounts);
@@ -821,6 +1289,9 @@ infd_filesystem_account_storage_init(InfdFilesystemAccountStorage* storage)
   priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
 
   priv->filesystem = NULL;
+  priv->log.serial = 0;
+  priv->log.n_entries = 0;
+  priv->log.valid = FALSE;
 
   priv->accounts = g_hash_table_new_full(
     NULL,
@@ -1058,6 +1529,77 @@ infd_filesystem_account_storage_list_accounts(InfdAccountStorage* s,
   return result;
 }
 
+static int
+infd_filesystem_account_storage_account_info_cmp(gconstpointer first,
+                                                 gconstpointer second)
+{
+  const InfdFilesystemAccountStorageAccountInfo* first_info;
+  const InfdFilesystemAccountStorageAccountInfo* second_info;
+
+  first_info = *(const InfdFilesystemAccountStorageAccountInfo* const*)first;
+  second_info = *(const InfdFilesystemAccountStorageAccountInfo* const*)second;
+
+  /* Names are unique, so there is no need for a secondary key */
+  return strcmp(first_info->name, second_info->name);
+}
+
+static InfAclAccount*
+infd_filesystem_account_storage_query_accounts(InfdAccountStorage* s,
+                                               const gchar* prefix,
+                                               guint offset,
+                                               guint limit,
+                                               guint* n_accounts,
+                                               guint* n_total,
+                                               GError** error)
+{
+  InfdFilesystemAccountStorage* storage;
+  InfdFilesystemAccountStoragePrivate* priv;
+  GHashTableIter hash_iter;
+  gpointer value;
+  InfdFilesystemAccountStorageAccountInfo* info;
+  GPtrArray* matching;
+  InfAclAccount* result;
+  guint i;
+
+  storage = INFD_FILESYSTEM_ACCOUNT_STORAGE(s);
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
+  /* Only the accounts in the requested range are copied, the others are
+   * only looked at to sort them. */
+  matching = g_ptr_array_new();
+  g_hash_table_iter_init(&hash_iter, priv->accounts_by_name);
+  while(g_hash_table_iter_next(&hash_iter, NULL, &value))
+  {
+    info = (InfdFilesystemAccountStorageAccountInfo*)value;
+    if(g_str_has_prefix(info->name, prefix))
+      g_ptr_array_add(matching, info);
+  }
+
+  g_ptr_array_sort(
+    matching,
+    infd_filesystem_account_storage_account_info_cmp
+  );
+
+  *n_total = matching->len;
+  if(offset > matching->len) offset = matching->len;
+  *n_accounts = MIN(limit, matching->len - offset);
+
+  result = NULL;
+  if(*n_accounts > 0)
+  {
+    result = g_malloc(*n_accounts * sizeof(InfAclAccount));
+    for(i = 0; i < *n_accounts; ++i)
+    {
+      info = matching->pdata[offset + i];
+      result[i].id = info->id;
+      result[i].name = g_strdup(info->name);
+    }
+  }
+
+  g_ptr_array_free(matching, TRUE);
+  return result;
+}
+
 static InfAclAccountId
 infd_filesystem_account_storage_add_account(InfdAccountStorage* s,
                                             const gchar* name,
@@ -1220,9 +1762,9 @@ infd_filesystem_account_storage_add_account(InfdAccountStorage* s,
 
   infd_filesystem_account_storage_add_info(storage, info);
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_log_account(
+    storage,
+    info,
     error
   );
 
@@ -1270,9 +1812,9 @@ infd_filesystem_account_storage_remove_account(InfdAccountStorage* s,
 
   infd_filesystem_account_storage_remove_info(storage, info);
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_log_removal(
+    storage,
+    info->id,
     error
   );
 
@@ -1348,11 +1890,7 @@ infd_filesystem_account_storage_login_by_certificate(InfdAccountStorage* s,
 
   /* Try to save the fingerprint/DN and time change to disk, but if it does
    * not work, that's okay for now, we still keep the login functional. */
-  infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
-  );
+  infd_filesystem_account_storage_log_account(storage, info, NULL);
 
   return info->id;
 }
@@ -1402,11 +1940,7 @@ infd_filesystem_account_storage_login_by_password(InfdAccountStorage* s,
 
   /* Try to save the fingerprint/DN and time change to disk, but if it does
    * not work, that's okay for now, we still keep the login functional. */
-  infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
-  );
+  infd_filesystem_account_storage_log_account(storage, info, NULL);
 
   return info->id;
 }
@@ -1493,9 +2027,9 @@ infd_filesystem_account_storage_set_certificate(InfdAccountStorage* s,
    * do so, we write the accounts file -- if that files, we need to
    * rollback */
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_log_account(
+    storage,
+    info,
     NULL
   );
 
@@ -1594,9 +2128,9 @@ infd_filesystem_account_storage_set_password(InfdAccountStorage* s,
 
   /* Try to write the updated password to disk */
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_log_account(
+    storage,
+    info,
     NULL
   );
 
@@ -1649,6 +2183,7 @@ infd_filesystem_account_storage_account_storage_iface_init(
   iface->lookup_accounts_by_name =
     infd_filesystem_account_storage_lookup_accounts_by_name;
   iface->list_accounts = infd_filesystem_account_storage_list_accounts;
+  iface->query_accounts = infd_filesystem_account_storage_query_accounts;
   iface->add_account = infd_filesystem_account_storage_add_account;
   iface->remove_account = infd_filesystem_account_storage_remove_account;
   iface->login_by_certificate =
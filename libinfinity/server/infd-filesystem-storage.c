@@ -17,12 +17,20 @@
  * MA 02110-1301, USA.
  */
 
+/* For syncfs() */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include "config.h"
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-async-operation-private.h>
 #include <libinfinity/common/inf-file-util.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-define-enum.h>
 #include <libinfinity/inf-i18n.h>
 
 #include <libxml/tree.h>
@@ -41,21 +49,156 @@
 # include <unistd.h>
 #endif
 
+#ifdef HAVE_FICLONE
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+#ifdef G_OS_WIN32
+# include <io.h>
+# include <fcntl.h>
+#endif
+
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+
+  /* All asynchronous writes that have not yet finished */
+  GSList* writes;
+  /* The most recent pending write for each full path */
+  GHashTable* latest_writes;
+
+  /* Group commit, see InfdFilesystemStorageDurability. Writes that have
+   * been written to their temporary file and wait for the next commit, and
+   * writes that are part of the commit that is currently running. */
+  InfdFilesystemStorageDurability durability;
+  guint commit_interval;
+  GSList* commits;
+  GSList* commit_writes;
+  InfIo* commit_io;
+  InfIoTimeout* commit_timeout;
+  InfAsyncOperation* commit_operation;
+
+  /* The names of the nodes with an ACL file in the directory that was last
+   * listed, so that reading the ACLs of all its children, which is what
+   * InfdDirectory does when exploring it, does not need to try opening a
+   * file for every single child. The values are the ACLs that have been
+   * read in advance, or NULL. */
+  gchar* acl_listing_path;
+  GHashTable* acl_listing;
+};
+
+/* An ACL file that is read in advance by the worker threads */
+typedef struct _InfdFilesystemStorageAclFile InfdFilesystemStorageAclFile;
+struct _InfdFilesystemStorageAclFile {
+  gchar* full_path;
+  GSList* acl;
+  GError* error;
+};
+
+/* The ACL files of a directory that are being read in advance. It is
+ * shared between the main thread and the worker jobs, the last one to
+ * drop its reference frees it. Jobs that start after all files have been
+ * read do not touch the files or the storage anymore. */
+typedef struct _InfdFilesystemStorageAclPrefetch
+  InfdFilesystemStorageAclPrefetch;
+struct _InfdFilesystemStorageAclPrefetch {
+  InfdFilesystemStorage* storage;
+  gint ref_count;
+
+  InfdFilesystemStorageAclFile** files;
+  guint n_files;
+  gint next_file;
+
+  GMutex mutex;
+  GCond cond;
+  guint n_done;
+};
+
+typedef struct _InfdFilesystemStorageListData InfdFilesystemStorageListData;
+struct _InfdFilesystemStorageListData {
+  GSList* list;
+  GHashTable* acls;
+};
+
+typedef struct _InfdFilesystemStorageWrite InfdFilesystemStorageWrite;
+struct _InfdFilesystemStorageWrite {
+  InfdFilesystemStorage* storage;
+  InfIo* io;
+  InfAsyncOperation* operation;
+  /* Set while the write waits for a group commit, see
+   * infd_filesystem_storage_defer_write(). */
+  gboolean deferred;
+  InfdFilesystemStorageDurability durability;
+
+  /* These are only accessed by the worker thread until it is done */
+  gchar* full_path;
+  gchar* temp_path;
+  xmlDocPtr doc;
+  gchar* data;
+  gsize len;
+  GError* error;
+
+  InfdFilesystemStorageWriteFunc func;
+  gpointer user_data;
+};
+
+/* The temporary files of a group commit, which are flushed to disk by a
+ * worker thread. This is owned by the worker thread while it runs. */
+typedef struct _InfdFilesystemStorageCommit InfdFilesystemStorageCommit;
+struct _InfdFilesystemStorageCommit {
+  gchar** paths;
+  int* errnos;
+  guint n_paths;
 };
 
 enum {
   PROP_0,
 
-  PROP_ROOT_DIRECTORY
+  PROP_ROOT_DIRECTORY,
+  PROP_DURABILITY,
+  PROP_COMMIT_INTERVAL
 };
 
 #define INFD_FILESYSTEM_STORAGE_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_FILESYSTEM_STORAGE, InfdFilesystemStoragePrivate))
 
+/* Number of ACL files in a directory from which on they are read in
+ * parallel when the directory is listed, and the number of files per
+ * worker job. */
+static const guint INFD_FILESYSTEM_STORAGE_ACL_PREFETCH_FILES = 16;
+/* Maximum number of worker jobs reading ACL files of a directory, in
+ * addition to the main thread */
+static const guint INFD_FILESYSTEM_STORAGE_ACL_PREFETCH_JOBS = 7;
+
+/* Name prefix of the directories in the root directory that hold removed
+ * subdirectories until they have been deleted in the background. Such
+ * directories are not listed as nodes. */
+#define INFD_FILESYSTEM_STORAGE_REMOVED_PREFIX ".infd-removed-"
+
 static GQuark infd_filesystem_storage_error_quark;
 
+static const GEnumValue infd_filesystem_storage_durability_values[] = {
+  {
+    INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE,
+    "INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE",
+    "write"
+  }, {
+    INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL,
+    "INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL",
+    "interval"
+  }, {
+    INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM,
+    "INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM",
+    "system"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
+INF_DEFINE_ENUM_TYPE(InfdFilesystemStorageDurability, infd_filesystem_storage_durability, infd_filesystem_storage_durability_values)
+
 static void infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface);
 G_DEFINE_TYPE_WITH_CODE(InfdFilesystemStorage, infd_filesystem_storage, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdFilesystemStorage)
@@ -101,6 +244,62 @@ infd_filesystem_storage_verify_path(const gchar* path,
   return TRUE;
 }
 
+static void
+infd_filesystem_storage_delete_removed_job_func(gpointer data)
+{
+  gchar* full_path;
+  GError* error;
+
+  full_path = (gchar*)data;
+  error = NULL;
+
+  if(!inf_file_util_delete(full_path, &error))
+  {
+    g_warning(
+      _("Failed to delete removed directory \"%s\": %s"),
+      full_path,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_free(full_path);
+}
+
+static gboolean
+infd_filesystem_storage_purge_removed_list_func(const gchar* name,
+                                                const gchar* path,
+                                                InfFileType type,
+                                                gpointer data,
+                                                GError** error)
+{
+  if(type == INF_FILE_TYPE_DIR &&
+     g_str_has_prefix(name, INFD_FILESYSTEM_STORAGE_REMOVED_PREFIX))
+  {
+    _inf_async_operation_push_job(
+      infd_filesystem_storage_delete_removed_job_func,
+      g_strdup(path)
+    );
+  }
+
+  return TRUE;
+}
+
+/* Deletes removed subdirectories in root_directory in the background that
+ * have not been deleted completely before, for example because the server
+ * was shut down meanwhile. */
+static void
+infd_filesystem_storage_purge_removed(const gchar* root_directory)
+{
+  inf_file_util_list_directory(
+    root_directory,
+    infd_filesystem_storage_purge_removed_list_func,
+    NULL,
+    NULL
+  );
+}
+
 static void
 infd_filesystem_storage_set_root_directory(InfdFilesystemStorage* storage,
                                            const gchar* root_directory)
@@ -148,6 +347,8 @@ infd_filesystem_storage_set_root_directory(InfdFilesystemStorage* storage,
 
     g_free(priv->root_directory);
     priv->root_directory = converted;
+
+    infd_filesystem_storage_purge_removed(converted);
   }
 }
 
@@ -192,6 +393,7 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
                                   const gchar* mode,
                                   GError** error)
 {
+  InfdFilesystemStoragePrivate* priv;
   FILE* res;
   int save_errno;
 #ifndef G_OS_WIN32
@@ -199,11 +401,18 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
   int open_mode;
 #endif
 
+  /* A pending asynchronous write to the same file must not replace what
+   * is written now once it finishes. */
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  if(strcmp(mode, "w") == 0)
+    g_hash_table_remove(priv->latest_writes, path);
+
 #ifdef G_OS_WIN32
   res = g_fopen(path, mode);
 #else
   if(strcmp(mode, "r") == 0) open_mode = O_RDONLY;
   else if(strcmp(mode, "w") == 0) open_mode = O_CREAT | O_WRONLY | O_TRUNC;
+  else if(strcmp(mode, "a") == 0) open_mode = O_CREAT | O_WRONLY | O_APPEND;
   else g_assert_not_reached();
   fd = open(path, O_NOFOLLOW | open_mode, 0644);
   if(fd == -1)
@@ -338,186 +547,1113 @@ infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
   return TRUE;
 }
 
-static gchar*
-infd_filesystem_storage_get_acl_path(InfdFilesystemStorage* storage,
-                                     const gchar* path,
-                                     GError** error)
+/* Runs in the worker thread, or in the main thread if the write is
+ * cancelled after the worker thread has finished. */
+static void
+infd_filesystem_storage_write_free(gpointer data)
 {
-  gchar* full_path;
+  InfdFilesystemStorageWrite* write;
+  write = (InfdFilesystemStorageWrite*)data;
 
-  if(strcmp(path, "/") != 0)
-  {
-    full_path =
-      infd_filesystem_storage_get_path(storage, "xml.acl", path, error);
-  }
-  else
+  /* The write is kept until it has been committed */
+  if(write->deferred == TRUE)
+    return;
+
+  /* The temporary file is still there if the write has
+   * failed, has been cancelled, or has been superseded. */
+  if(write->temp_path != NULL)
   {
-    full_path =
-      infd_filesystem_storage_get_path(storage, "xml", "/global-acl", error);
+    g_unlink(write->temp_path);
+    g_free(write->temp_path);
   }
 
-  return full_path;
+  if(write->error != NULL)
+    g_error_free(write->error);
+
+  if(write->doc != NULL)
+    xmlFreeDoc(write->doc);
+  g_free(write->data);
+  g_free(write->full_path);
+  g_slice_free(InfdFilesystemStorageWrite, write);
 }
 
 static void
-infd_filesystem_storage_init(InfdFilesystemStorage* storage)
+infd_filesystem_storage_write_run_func(gpointer* run_data,
+                                       GDestroyNotify* run_notify,
+                                       gpointer user_data)
 {
-  InfdFilesystemStoragePrivate* priv;
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  InfdFilesystemStorageWrite* write;
+  int fd;
+  FILE* file;
+  int save_errno;
+  xmlErrorPtr xmlerror;
 
-  priv->root_directory = NULL;
-}
+  write = (InfdFilesystemStorageWrite*)user_data;
+  *run_data = write;
+  *run_notify = infd_filesystem_storage_write_free;
 
-static void
-infd_filesystem_storage_finalize(GObject* object)
-{
-  InfdFilesystemStorage* storage;
-  InfdFilesystemStoragePrivate* priv;
+  /* The document is written to a temporary file next to the target, which
+   * is then renamed in the main thread, so that the file is replaced
+   * atomically, and so that a newer write to the same file from the main
+   * thread cannot be overwritten by this one. */
+  write->temp_path = g_strconcat(write->full_path, ".tmp-XXXXXX", NULL);
+  fd = g_mkstemp_full(write->temp_path, O_WRONLY, 0644);
+  if(fd == -1)
+  {
+    save_errno = errno;
+    infd_filesystem_storage_system_error(save_errno, &write->error);
+    g_free(write->temp_path);
+    write->temp_path = NULL;
+    return;
+  }
 
-  storage = INFD_FILESYSTEM_STORAGE(object);
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  file = fdopen(fd, "w");
+  if(file == NULL)
+  {
+    save_errno = errno;
+    close(fd);
+    infd_filesystem_storage_system_error(save_errno, &write->error);
+    return;
+  }
 
-  g_free(priv->root_directory);
+  if(write->doc != NULL && xmlDocFormatDump(file, write->doc, 1) == -1)
+  {
+    xmlerror = xmlGetLastError();
+    fclose(file);
 
-  G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
-}
+    g_set_error_literal(
+      &write->error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
 
-static void
-infd_filesystem_storage_set_property(GObject* object,
-                                     guint prop_id,
-                                     const GValue* value,
-                                     GParamSpec* pspec)
-{
-  InfdFilesystemStorage* storage;
-  InfdFilesystemStoragePrivate* priv;
+    return;
+  }
 
-  storage = INFD_FILESYSTEM_STORAGE(object);
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  if(write->doc == NULL &&
+     infd_filesystem_storage_stream_write(file, write->data, write->len) !=
+     write->len)
+  {
+    save_errno = errno;
+    fclose(file);
+    infd_filesystem_storage_system_error(save_errno, &write->error);
+    return;
+  }
 
-  switch(prop_id)
+  /* With other durability levels, the file is flushed to disk later, or
+   * not at all. */
+  if(write->durability == INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE &&
+     infd_filesystem_storage_stream_sync(file) != 0)
   {
-  case PROP_ROOT_DIRECTORY:
-    infd_filesystem_storage_set_root_directory(
-      storage,
-      g_value_get_string(value)
-    );
+    save_errno = errno;
+    fclose(file);
+    infd_filesystem_storage_system_error(save_errno, &write->error);
+    return;
+  }
 
-    break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-    break;
+  if(fclose(file) != 0)
+  {
+    save_errno = errno;
+    infd_filesystem_storage_system_error(save_errno, &write->error);
+    return;
   }
 }
 
+/* Replaces the file with the temporary file of write, unless it has been
+ * written again since, and calls the write's callback if notify is TRUE. */
 static void
-infd_filesystem_storage_get_property(GObject* object,
-                                     guint prop_id,
-                                     GValue* value,
-                                     GParamSpec* pspec)
+infd_filesystem_storage_write_complete(InfdFilesystemStorageWrite* write,
+                                       gboolean notify)
 {
-  InfdFilesystemStorage* storage;
   InfdFilesystemStoragePrivate* priv;
+  int save_errno;
 
-  storage = INFD_FILESYSTEM_STORAGE(object);
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(write->storage);
 
-  switch(prop_id)
+  priv->writes = g_slist_remove(priv->writes, write);
+
+  /* If the file has been written again since this write was started, then
+   * the newer content is kept, and the write counts as successful. */
+  if(g_hash_table_lookup(priv->latest_writes, write->full_path) == write)
   {
-  case PROP_ROOT_DIRECTORY:
-    g_value_set_string(value, priv->root_directory);
-    break;
-  default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-    break;
+    g_hash_table_remove(priv->latest_writes, write->full_path);
+
+    if(write->error == NULL)
+    {
+#ifdef G_OS_WIN32
+      /* rename() does not replace existing files on Windows */
+      g_unlink(write->full_path);
+#endif
+      if(g_rename(write->temp_path, write->full_path) == 0)
+      {
+        g_free(write->temp_path);
+        write->temp_path = NULL;
+      }
+      else
+      {
+        save_errno = errno;
+        infd_filesystem_storage_system_error(save_errno, &write->error);
+      }
+    }
+  }
+  else if(write->error != NULL)
+  {
+    g_error_free(write->error);
+    write->error = NULL;
   }
+
+  if(notify == TRUE && write->func != NULL)
+    write->func(write->storage, write->error, write->user_data);
+
+  g_object_unref(write->io);
+  write->io = NULL;
 }
 
-static gboolean
-infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
-                                                            const gchar* path,
-                                                            InfFileType type,
-                                                            gpointer data,
-                                                            GError** error)
+/* Flushes the file at path to disk. Returns 0 on success, or the errno
+ * value of the failure. This is called from worker threads. */
+static int
+infd_filesystem_storage_sync_path(const gchar* path)
 {
-  GSList** list;
-  gchar* converted_name;
-  gsize name_len;
-  gchar* separator;
+  int fd;
+  int save_errno;
 
-  list = (GSList**)data;
-  converted_name = g_filename_to_utf8(name, -1, NULL, &name_len, error);
-  if(converted_name == NULL) return FALSE;
+  fd = g_open(path, O_RDWR, 0);
+  if(fd == -1)
+    return errno;
 
-  if(type == INF_FILE_TYPE_DIR)
-  {
-    *list = g_slist_prepend(
-      *list,
-      infd_storage_node_new_subdirectory(converted_name)
-    );
-  }
-  else if(type == INF_FILE_TYPE_REG)
-  {
-    /* The note type identifier is behind the last '.'. Only note
-     * types starting with "Inf" are recognized, other files are
-     * auxiliary files in the directory. */
-    separator = g_strrstr_len(converted_name, name_len, ".");
-    if(separator != NULL && strncmp(separator + 1, "Inf", 3) == 0)
-    {
-      *separator = '\0';
-      *list = g_slist_prepend(
-        *list,
-        infd_storage_node_new_note(converted_name, separator + 1)
-      );
-    }
-  }
+  save_errno = 0;
+#ifdef G_OS_WIN32
+  if(_commit(fd) == -1)
+    save_errno = errno;
+#else
+  if(fsync(fd) == -1)
+    save_errno = errno;
+#endif
 
-  g_free(converted_name);
-  return TRUE;
+  close(fd);
+  return save_errno;
 }
 
-static GSList*
-infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
-                                                  const gchar* path,
-                                                  GError** error)
+static void
+infd_filesystem_storage_commit_free(gpointer data)
 {
-  InfdFilesystemStorage* fs_storage;
-  InfdFilesystemStoragePrivate* priv;
-  GSList* list;
-  gchar* converted_name;
-  gchar* full_name;
-  gboolean result;
+  InfdFilesystemStorageCommit* commit;
+  commit = (InfdFilesystemStorageCommit*)data;
 
-  fs_storage = INFD_FILESYSTEM_STORAGE(storage);
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
+  g_strfreev(commit->paths);
+  g_free(commit->errnos);
+  g_slice_free(InfdFilesystemStorageCommit, commit);
+}
 
-  if(infd_filesystem_storage_verify_path(path, error) == FALSE)
-    return NULL;
+static void
+infd_filesystem_storage_commit_run_func(gpointer* run_data,
+                                        GDestroyNotify* run_notify,
+                                        gpointer user_data)
+{
+  InfdFilesystemStorageCommit* commit;
+  guint i;
+#ifdef HAVE_SYNCFS
+  /* Filesystems that have been flushed already, and the result */
+  GArray* devices;
+  GArray* results;
+  struct stat st;
+  int fd;
+  guint j;
+#endif
 
-  converted_name = g_filename_from_utf8(path, -1, NULL, NULL, error);
-  if(converted_name == NULL)
-    return NULL;
+  commit = (InfdFilesystemStorageCommit*)user_data;
+  *run_data = commit;
+  *run_notify = infd_filesystem_storage_commit_free;
 
-  full_name = g_build_filename(priv->root_directory, converted_name, NULL);
-  g_free(converted_name);
+#ifdef HAVE_SYNCFS
+  /* All files of the commit have been written completely, so flushing
+   * their filesystem once covers all of them that are on it. */
+  devices = g_array_new(FALSE, FALSE, sizeof(dev_t));
+  results = g_array_new(FALSE, FALSE, sizeof(int));
 
-  list = NULL;
+  for(i = 0; i < commit->n_paths; ++i)
+  {
+    fd = open(commit->paths[i], O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1)
+    {
+      commit->errnos[i] = errno;
+      if(fd != -1) close(fd);
+      continue;
+    }
+
+    for(j = 0; j < devices->len; ++j)
+      if(g_array_index(devices, dev_t, j) == st.st_dev)
+        break;
+
+    if(j == devices->len)
+    {
+      commit->errnos[i] = (syncfs(fd) == -1) ? errno : 0;
+      g_array_append_val(devices, st.st_dev);
+      g_array_append_val(results, commit->errnos[i]);
+    }
+    else
+    {
+      commit->errnos[i] = g_array_index(results, int, j);
+    }
+
+    close(fd);
+  }
+
+  g_array_free(devices, TRUE);
+  g_array_free(results, TRUE);
+#else
+  for(i = 0; i < commit->n_paths; ++i)
+    commit->errnos[i] = infd_filesystem_storage_sync_path(commit->paths[i]);
+#endif
+}
+
+static void
+infd_filesystem_storage_schedule_commit(InfdFilesystemStorage* storage,
+                                        InfIo* io);
+
+/* Completes the writes of a group commit once their temporary files have
+ * been flushed to disk. errnos holds the result for each of them. */
+static void
+infd_filesystem_storage_finish_commit(InfdFilesystemStorage* storage,
+                                      GSList* writes,
+                                      const int* errnos,
+                                      gboolean notify)
+{
+  InfdFilesystemStorageWrite* write;
+  GSList* item;
+  guint i;
+
+  for(item = writes, i = 0; item != NULL; item = item->next, ++i)
+  {
+    write = (InfdFilesystemStorageWrite*)item->data;
+    if(errnos[i] != 0 && write->error == NULL)
+      infd_filesystem_storage_system_error(errnos[i], &write->error);
+
+    infd_filesystem_storage_write_complete(write, notify);
+
+    write->deferred = FALSE;
+    infd_filesystem_storage_write_free(write);
+  }
+
+  g_slist_free(writes);
+}
+
+static void
+infd_filesystem_storage_commit_done_func(gpointer run_data,
+                                         gpointer user_data)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommit* commit;
+  GSList* writes;
+
+  storage = INFD_FILESYSTEM_STORAGE(user_data);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  commit = (InfdFilesystemStorageCommit*)run_data;
+
+  writes = priv->commit_writes;
+  priv->commit_writes = NULL;
+  priv->commit_operation = NULL;
+
+  /* The callbacks can start new writes, so hold a reference */
+  g_object_ref(storage);
+
+  infd_filesystem_storage_finish_commit(
+    storage,
+    writes,
+    commit->errnos,
+    TRUE
+  );
+
+  if(priv->commits != NULL)
+  {
+    infd_filesystem_storage_schedule_commit(storage, priv->commit_io);
+  }
+  else if(priv->commit_timeout == NULL && priv->commit_io != NULL)
+  {
+    g_object_unref(priv->commit_io);
+    priv->commit_io = NULL;
+  }
+
+  g_object_unref(storage);
+}
+
+/* Flushes the temporary files of all writes waiting for a commit to disk
+ * in a worker thread. */
+static void
+infd_filesystem_storage_start_commit(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  InfdFilesystemStorageCommit* commit;
+  GSList* item;
+  guint i;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  g_assert(priv->commit_operation == NULL);
+  g_assert(priv->commit_io != NULL);
+
+  /* The list is built by prepending, so reverse it to complete the writes
+   * in the order in which they were made. */
+  priv->commit_writes = g_slist_reverse(priv->commits);
+  priv->commits = NULL;
+
+  commit = g_slice_new(InfdFilesystemStorageCommit);
+  commit->n_paths = g_slist_length(priv->commit_writes);
+  commit->paths = g_new(gchar*, commit->n_paths + 1);
+  commit->errnos = g_new0(int, commit->n_paths);
+
+  for(item = priv->commit_writes, i = 0; item != NULL; item = item->next, ++i)
+  {
+    write = (InfdFilesystemStorageWrite*)item->data;
+    commit->paths[i] = g_strdup(write->temp_path);
+  }
+
+  commit->paths[commit->n_paths] = NULL;
+
+  priv->commit_operation = inf_async_operation_new(
+    priv->commit_io,
+    infd_filesystem_storage_commit_run_func,
+    infd_filesystem_storage_commit_done_func,
+    commit
+  );
+
+  /* This never fails currently, see inf_async_operation_start() */
+  inf_async_operation_start(priv->commit_operation, NULL);
+}
+
+static void
+infd_filesystem_storage_commit_timeout_func(gpointer user_data)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(user_data);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  priv->commit_timeout = NULL;
+  infd_filesystem_storage_start_commit(storage);
+}
+
+/* Makes sure that a commit is started for the writes in priv->commits,
+ * after the commit interval, or right away if the durability has been
+ * changed in the meanwhile. */
+static void
+infd_filesystem_storage_schedule_commit(InfdFilesystemStorage* storage,
+                                        InfIo* io)
+{
+  InfdFilesystemStoragePrivate* priv;
+  guint interval;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  /* A commit that is running schedules the next one when it is done */
+  if(priv->commit_timeout != NULL || priv->commit_operation != NULL)
+    return;
+
+  if(priv->commit_io == NULL)
+    priv->commit_io = g_object_ref(io);
+
+  interval = 0;
+  if(priv->durability == INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL)
+    interval = priv->commit_interval;
+
+  priv->commit_timeout = inf_io_add_timeout(
+    priv->commit_io,
+    interval,
+    infd_filesystem_storage_commit_timeout_func,
+    storage,
+    NULL
+  );
+}
+
+/* Keeps a write whose temporary file has been written until the next group
+ * commit, instead of replacing the file with it right away. */
+static void
+infd_filesystem_storage_defer_write(InfdFilesystemStorageWrite* write)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(write->storage);
+
+  /* The operation frees itself after this dispatch */
+  write->operation = NULL;
+  write->deferred = TRUE;
+
+  priv->commits = g_slist_prepend(priv->commits, write);
+  infd_filesystem_storage_schedule_commit(write->storage, write->io);
+}
+
+/* Commits all writes that wait for a group commit synchronously, without
+ * calling their callbacks. */
+static void
+infd_filesystem_storage_flush_commits(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  GSList* writes;
+  GSList* item;
+  int* errnos;
+  guint i;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  if(priv->commit_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->commit_io, priv->commit_timeout);
+    priv->commit_timeout = NULL;
+  }
+
+  /* The worker thread only accesses its own copy of the paths, so the
+   * writes of a running commit can be completed here. */
+  if(priv->commit_operation != NULL)
+  {
+    inf_async_operation_free(priv->commit_operation);
+    priv->commit_operation = NULL;
+  }
+
+  writes = g_slist_concat(priv->commit_writes, g_slist_reverse(priv->commits));
+  priv->commit_writes = NULL;
+  priv->commits = NULL;
+
+  errnos = g_new0(int, g_slist_length(writes));
+  for(item = writes, i = 0; item != NULL; item = item->next, ++i)
+  {
+    write = (InfdFilesystemStorageWrite*)item->data;
+    errnos[i] = infd_filesystem_storage_sync_path(write->temp_path);
+  }
+
+  infd_filesystem_storage_finish_commit(storage, writes, errnos, FALSE);
+  g_free(errnos);
+
+  if(priv->commit_io != NULL)
+  {
+    g_object_unref(priv->commit_io);
+    priv->commit_io = NULL;
+  }
+}
+
+static void
+infd_filesystem_storage_write_done_func(gpointer run_data,
+                                        gpointer user_data)
+{
+  InfdFilesystemStorageWrite* write;
+  InfdFilesystemStoragePrivate* priv;
+
+  write = (InfdFilesystemStorageWrite*)run_data;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(write->storage);
+
+  if(write->durability == INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL &&
+     write->error == NULL &&
+     g_hash_table_lookup(priv->latest_writes, write->full_path) == write)
+  {
+    infd_filesystem_storage_defer_write(write);
+  }
+  else
+  {
+    infd_filesystem_storage_write_complete(write, TRUE);
+  }
+}
+
+static void
+infd_filesystem_storage_cancel_all_writes(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  InfIo* io;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  /* Writes that have been written completely are not lost */
+  infd_filesystem_storage_flush_commits(storage);
+
+  g_hash_table_remove_all(priv->latest_writes);
+
+  while(priv->writes != NULL)
+  {
+    write = (InfdFilesystemStorageWrite*)priv->writes->data;
+    priv->writes = g_slist_delete_link(priv->writes, priv->writes);
+
+    /* This might free the write already */
+    io = write->io;
+    inf_async_operation_free(write->operation);
+    g_object_unref(io);
+  }
+}
+
+static void
+infd_filesystem_storage_clear_acl_listing(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  if(priv->acl_listing != NULL)
+  {
+    g_hash_table_destroy(priv->acl_listing);
+    g_free(priv->acl_listing_path);
+
+    priv->acl_listing = NULL;
+    priv->acl_listing_path = NULL;
+  }
+}
+
+/* Returns the name of the node at path if its parent directory is the one
+ * that was last listed, or NULL otherwise. */
+static const gchar*
+infd_filesystem_storage_acl_listing_name(InfdFilesystemStorage* storage,
+                                         const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  const gchar* separator;
+  gsize parent_len;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  if(priv->acl_listing == NULL)
+    return NULL;
+
+  separator = strrchr(path, '/');
+  if(separator == NULL || separator[1] == '\0')
+    return NULL;
+
+  /* The parent of "/name" is "/", the parent of "/dir/name" is "/dir" */
+  parent_len = separator - path;
+  if(parent_len == 0) parent_len = 1;
+
+  if(strlen(priv->acl_listing_path) != parent_len ||
+     strncmp(priv->acl_listing_path, path, parent_len) != 0)
+  {
+    return NULL;
+  }
+
+  return separator + 1;
+}
+
+/* Returns TRUE if path is known not to have an ACL file, from the
+ * listing of its parent directory. */
+static gboolean
+infd_filesystem_storage_acl_listing_lacks(InfdFilesystemStorage* storage,
+                                          const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  const gchar* name;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  name = infd_filesystem_storage_acl_listing_name(storage, path);
+  if(name == NULL)
+    return FALSE;
+
+  return !g_hash_table_contains(priv->acl_listing, name);
+}
+
+/* Returns the ACL file of path that has been read in advance, if any */
+static InfdFilesystemStorageAclFile*
+infd_filesystem_storage_acl_listing_lookup(InfdFilesystemStorage* storage,
+                                           const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  const gchar* name;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  name = infd_filesystem_storage_acl_listing_name(storage, path);
+  if(name == NULL)
+    return NULL;
+
+  return g_hash_table_lookup(priv->acl_listing, name);
+}
+
+static gchar*
+infd_filesystem_storage_get_acl_path(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     GError** error)
+{
+  gchar* full_path;
+
+  if(strcmp(path, "/") != 0)
+  {
+    full_path =
+      infd_filesystem_storage_get_path(storage, "xml.acl", path, error);
+  }
+  else
+  {
+    full_path =
+      infd_filesystem_storage_get_path(storage, "xml", "/global-acl", error);
+  }
+
+  return full_path;
+}
+
+static void
+infd_filesystem_storage_init(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  priv->root_directory = NULL;
+  priv->writes = NULL;
+  priv->latest_writes = g_hash_table_new(g_str_hash, g_str_equal);
+  priv->durability = INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE;
+  priv->commit_interval = 1000;
+  priv->commits = NULL;
+  priv->commit_writes = NULL;
+  priv->commit_io = NULL;
+  priv->commit_timeout = NULL;
+  priv->commit_operation = NULL;
+  priv->acl_listing_path = NULL;
+  priv->acl_listing = NULL;
+}
+
+static void
+infd_filesystem_storage_dispose(GObject* object)
+{
+  InfdFilesystemStorage* storage;
+  storage = INFD_FILESYSTEM_STORAGE(object);
+
+  infd_filesystem_storage_cancel_all_writes(storage);
+
+  G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->dispose(object);
+}
+
+static void
+infd_filesystem_storage_finalize(GObject* object)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(object);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  infd_filesystem_storage_clear_acl_listing(storage);
+  g_free(priv->root_directory);
+  g_hash_table_destroy(priv->latest_writes);
+
+  G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
+}
+
+static void
+infd_filesystem_storage_set_property(GObject* object,
+                                     guint prop_id,
+                                     const GValue* value,
+                                     GParamSpec* pspec)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(object);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  switch(prop_id)
+  {
+  case PROP_ROOT_DIRECTORY:
+    infd_filesystem_storage_set_root_directory(
+      storage,
+      g_value_get_string(value)
+    );
+
+    break;
+  case PROP_DURABILITY:
+    infd_filesystem_storage_set_durability(
+      storage,
+      g_value_get_enum(value),
+      priv->commit_interval
+    );
+
+    break;
+  case PROP_COMMIT_INTERVAL:
+    priv->commit_interval = g_value_get_uint(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_filesystem_storage_get_property(GObject* object,
+                                     guint prop_id,
+                                     GValue* value,
+                                     GParamSpec* pspec)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(object);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  switch(prop_id)
+  {
+  case PROP_ROOT_DIRECTORY:
+    g_value_set_string(value, priv->root_directory);
+    break;
+  case PROP_DURABILITY:
+    g_value_set_enum(value, priv->durability);
+    break;
+  case PROP_COMMIT_INTERVAL:
+    g_value_set_uint(value, priv->commit_interval);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/* Reads the ACL file at full_path. This is also called from worker threads,
+ * so it must not access the storage other than for opening the file. */
+static GSList*
+infd_filesystem_storage_read_acl_file(InfdFilesystemStorage* storage,
+                                      const gchar* full_path,
+                                      GError** error)
+{
+  GError* local_error;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  GSList* list;
+  InfdStorageAcl* acl;
+  xmlChar* account_id;
+
+  local_error = NULL;
+  doc = infd_filesystem_storage_read_xml_file_impl(
+    storage,
+    full_path,
+    "inf-acl",
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      /* The ACL file does not exist. This is not an error, but just means
+       * the ACL is empty. */
+      g_error_free(local_error);
+      return NULL;
+    }
+
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  root = xmlDocGetRootElement(doc);
+  list = NULL;
+
+  for(child = root->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+
+    if(strcmp((const char*)child->name, "sheet") == 0)
+    {
+      account_id =
+        inf_xml_util_get_attribute_required(child, "account", error);
+      if(account_id == NULL)
+      {
+        infd_storage_acl_list_free(list);
+        xmlFreeDoc(doc);
+        return NULL;
+      }
+
+      acl = g_slice_new(InfdStorageAcl);
+      acl->account_id = g_strdup((const gchar*)account_id);
+      xmlFree(account_id);
+      
+      if(!inf_acl_sheet_perms_from_xml(child, &acl->mask, &acl->perms, error))
+      {
+        g_free(acl->account_id);
+        g_slice_free(InfdStorageAcl, acl);
+        infd_storage_acl_list_free(list);
+        xmlFreeDoc(doc);
+        return NULL;
+      }
+
+      if(!inf_acl_mask_empty(&acl->mask))
+      {
+        list = g_slist_prepend(list, acl);
+      }
+      else
+      {
+        g_free(acl->account_id);
+        g_slice_free(InfdStorageAcl, acl);
+      }
+    }
+  }
+
+  xmlFreeDoc(doc);
+  return list;
+}
+
+static void
+infd_filesystem_storage_acl_file_free(gpointer data)
+{
+  InfdFilesystemStorageAclFile* file;
+  file = (InfdFilesystemStorageAclFile*)data;
+
+  if(file != NULL)
+  {
+    g_free(file->full_path);
+    infd_storage_acl_list_free(file->acl);
+    if(file->error != NULL) g_error_free(file->error);
+    g_slice_free(InfdFilesystemStorageAclFile, file);
+  }
+}
+
+static void
+infd_filesystem_storage_acl_prefetch_unref(
+  InfdFilesystemStorageAclPrefetch* prefetch)
+{
+  if(g_atomic_int_dec_and_test(&prefetch->ref_count))
+  {
+    /* The files themselves are owned by the ACL listing */
+    g_free(prefetch->files);
+    g_mutex_clear(&prefetch->mutex);
+    g_cond_clear(&prefetch->cond);
+    g_slice_free(InfdFilesystemStorageAclPrefetch, prefetch);
+  }
+}
+
+/* Reads files of the prefetch until there are none left. This runs both
+ * in the main thread and in the worker jobs. */
+static void
+infd_filesystem_storage_acl_prefetch_run(
+  InfdFilesystemStorageAclPrefetch* prefetch)
+{
+  InfdFilesystemStorageAclFile* file;
+  guint index;
+
+  for(;;)
+  {
+    index = (guint)g_atomic_int_add(&prefetch->next_file, 1);
+    if(index >= prefetch->n_files)
+      break;
+
+    file = prefetch->files[index];
+    file->acl = infd_filesystem_storage_read_acl_file(
+      prefetch->storage,
+      file->full_path,
+      &file->error
+    );
+
+    g_mutex_lock(&prefetch->mutex);
+    if(++prefetch->n_done == prefetch->n_files)
+      g_cond_signal(&prefetch->cond);
+    g_mutex_unlock(&prefetch->mutex);
+  }
+}
+
+static void
+infd_filesystem_storage_acl_prefetch_job_func(gpointer data)
+{
+  InfdFilesystemStorageAclPrefetch* prefetch;
+  prefetch = (InfdFilesystemStorageAclPrefetch*)data;
+
+  infd_filesystem_storage_acl_prefetch_run(prefetch);
+  infd_filesystem_storage_acl_prefetch_unref(prefetch);
+}
+
+/* Reads all ACL files of the directory that has just been listed in
+ * parallel, since InfdDirectory is going to read them one after the other
+ * right away when exploring the directory. This function returns when all
+ * of them have been read. The main thread reads files as well meanwhile,
+ * so that this does not wait for jobs that have not started yet because
+ * the worker threads are busy otherwise. */
+static void
+infd_filesystem_storage_prefetch_acls(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageAclPrefetch* prefetch;
+  InfdFilesystemStorageAclFile* file;
+  GHashTableIter iter;
+  gpointer key;
+  const gchar* separator;
+  gchar* path;
+  gchar* full_path;
+  guint n_jobs;
+  guint i;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  prefetch = g_slice_new(InfdFilesystemStorageAclPrefetch);
+  prefetch->storage = storage;
+  prefetch->ref_count = 1;
+  prefetch->files = g_new(
+    InfdFilesystemStorageAclFile*,
+    g_hash_table_size(priv->acl_listing)
+  );
+  prefetch->n_files = 0;
+  prefetch->next_file = 0;
+  g_mutex_init(&prefetch->mutex);
+  g_cond_init(&prefetch->cond);
+  prefetch->n_done = 0;
+
+  separator = "/";
+  if(g_str_has_suffix(priv->acl_listing_path, "/"))
+    separator = "";
+
+  g_hash_table_iter_init(&iter, priv->acl_listing);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    path = g_strconcat(priv->acl_listing_path, separator, key, NULL);
+
+    /* If the path is invalid, the error is reported when the ACL is read
+     * for real. */
+    full_path = infd_filesystem_storage_get_acl_path(storage, path, NULL);
+    g_free(path);
+
+    if(full_path != NULL)
+    {
+      file = g_slice_new(InfdFilesystemStorageAclFile);
+      file->full_path = full_path;
+      file->acl = NULL;
+      file->error = NULL;
+
+      g_hash_table_iter_replace(&iter, file);
+      prefetch->files[prefetch->n_files++] = file;
+    }
+  }
+
+  /* libxml2 needs to be initialized in the main thread before parsing in
+   * other threads. */
+  xmlInitParser();
+
+  n_jobs = MIN(
+    prefetch->n_files / INFD_FILESYSTEM_STORAGE_ACL_PREFETCH_FILES,
+    INFD_FILESYSTEM_STORAGE_ACL_PREFETCH_JOBS
+  );
+
+  for(i = 0; i < n_jobs; ++i)
+  {
+    g_atomic_int_inc(&prefetch->ref_count);
+    _inf_async_operation_push_job(
+      infd_filesystem_storage_acl_prefetch_job_func,
+      prefetch
+    );
+  }
+
+  infd_filesystem_storage_acl_prefetch_run(prefetch);
+
+  g_mutex_lock(&prefetch->mutex);
+  while(prefetch->n_done < prefetch->n_files)
+    g_cond_wait(&prefetch->cond, &prefetch->mutex);
+  g_mutex_unlock(&prefetch->mutex);
+
+  infd_filesystem_storage_acl_prefetch_unref(prefetch);
+}
+
+static gboolean
+infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
+                                                            const gchar* path,
+                                                            InfFileType type,
+                                                            gpointer data,
+                                                            GError** error)
+{
+  InfdFilesystemStorageListData* list_data;
+  gchar* converted_name;
+  gsize name_len;
+  gchar* separator;
+
+  list_data = (InfdFilesystemStorageListData*)data;
+  converted_name = g_filename_to_utf8(name, -1, NULL, &name_len, error);
+  if(converted_name == NULL) return FALSE;
+
+  if(type == INF_FILE_TYPE_DIR)
+  {
+    if(g_str_has_prefix(converted_name,
+                        INFD_FILESYSTEM_STORAGE_REMOVED_PREFIX))
+    {
+      g_free(converted_name);
+      return TRUE;
+    }
+
+    list_data->list = g_slist_prepend(
+      list_data->list,
+      infd_storage_node_new_subdirectory(converted_name)
+    );
+  }
+  else if(type == INF_FILE_TYPE_REG)
+  {
+    /* The note type identifier is behind the last '.'. Only note
+     * types starting with "Inf" are recognized, other files are
+     * auxiliary files in the directory. */
+    separator = g_strrstr_len(converted_name, name_len, ".");
+    if(separator != NULL && strncmp(separator + 1, "Inf", 3) == 0)
+    {
+      *separator = '\0';
+      list_data->list = g_slist_prepend(
+        list_data->list,
+        infd_storage_node_new_note(converted_name, separator + 1)
+      );
+    }
+    else if(g_str_has_suffix(converted_name, ".xml.acl"))
+    {
+      converted_name[name_len - strlen(".xml.acl")] = '\0';
+      g_hash_table_insert(list_data->acls, converted_name, NULL);
+      converted_name = NULL;
+    }
+  }
+
+  g_free(converted_name);
+  return TRUE;
+}
+
+static GSList*
+infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
+                                                  const gchar* path,
+                                                  GError** error)
+{
+  InfdFilesystemStorage* fs_storage;
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageListData list_data;
+  gchar* converted_name;
+  gchar* full_name;
+  gboolean result;
+
+  fs_storage = INFD_FILESYSTEM_STORAGE(storage);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
+
+  if(infd_filesystem_storage_verify_path(path, error) == FALSE)
+    return NULL;
+
+  converted_name = g_filename_from_utf8(path, -1, NULL, NULL, error);
+  if(converted_name == NULL)
+    return NULL;
+
+  full_name = g_build_filename(priv->root_directory, converted_name, NULL);
+  g_free(converted_name);
+
+  list_data.list = NULL;
+  list_data.acls = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    infd_filesystem_storage_acl_file_free
+  );
 
   result = inf_file_util_list_directory(
     full_name,
     infd_filesystem_storage_storage_read_subdirectory_list_func,
-    &list,
+    &list_data,
     error
   );
 
   g_free(full_name);
+  infd_filesystem_storage_clear_acl_listing(fs_storage);
 
   if(result == FALSE)
   {
-    infd_storage_node_list_free(list);
+    g_hash_table_destroy(list_data.acls);
+    infd_storage_node_list_free(list_data.list);
     return NULL;
   }
 
-  return list;
+  priv->acl_listing_path = g_strdup(path);
+  priv->acl_listing = list_data.acls;
+
+  if(g_hash_table_size(list_data.acls) >=
+     INFD_FILESYSTEM_STORAGE_ACL_PREFETCH_FILES)
+  {
+    infd_filesystem_storage_prefetch_acls(fs_storage);
+  }
+
+  return list_data.list;
 }
 
 static gboolean
@@ -550,6 +1686,51 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   return result;
 }
 
+/* Moves the directory at full_path out of the way, and deletes it in a
+ * worker thread, so that removing a large subdirectory does not block the
+ * main loop. Falls back to deleting it right away if it cannot be moved. */
+static gboolean
+infd_filesystem_storage_delete_directory(InfdFilesystemStorage* storage,
+                                         const gchar* full_path,
+                                         GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  gchar* removed_path;
+  gchar* removed_name;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  removed_path = g_build_filename(
+    priv->root_directory,
+    INFD_FILESYSTEM_STORAGE_REMOVED_PREFIX "XXXXXX",
+    NULL
+  );
+
+  if(g_mkdtemp(removed_path) == NULL)
+  {
+    g_free(removed_path);
+    return inf_file_util_delete(full_path, error);
+  }
+
+  removed_name = g_build_filename(removed_path, "node", NULL);
+  if(g_rename(full_path, removed_name) == -1)
+  {
+    g_rmdir(removed_path);
+    g_free(removed_path);
+    g_free(removed_name);
+    return inf_file_util_delete(full_path, error);
+  }
+
+  g_free(removed_name);
+
+  _inf_async_operation_push_job(
+    infd_filesystem_storage_delete_removed_job_func,
+    removed_path
+  );
+
+  return TRUE;
+}
+
 static gboolean
 infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
                                             const gchar* identifier,
@@ -570,6 +1751,8 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   if(infd_filesystem_storage_verify_path(path, error) == FALSE)
     return FALSE;
 
+  infd_filesystem_storage_clear_acl_listing(fs_storage);
+
   converted_name = g_filename_from_utf8(path, -1, NULL, NULL, error);
   if(converted_name == NULL)
     return FALSE;
@@ -583,32 +1766,399 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
     disk_name = converted_name;
   }
 
-  full_name = g_build_filename(priv->root_directory, disk_name, NULL);
-  if(disk_name != converted_name) g_free(disk_name);
+  full_name = g_build_filename(priv->root_directory, disk_name, NULL);
+  if(disk_name != converted_name) g_free(disk_name);
+
+  if(identifier != NULL)
+    result = inf_file_util_delete(full_name, error);
+  else
+    result = infd_filesystem_storage_delete_directory(
+      fs_storage,
+      full_name,
+      error
+    );
+  g_free(full_name);
+
+  if(result == TRUE)
+  {
+    disk_name = g_strconcat(converted_name, ".xml.acl", NULL);
+    full_name = g_build_filename(priv->root_directory, disk_name, NULL);
+    g_free(disk_name);
+
+    if(g_unlink(full_name) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        infd_filesystem_storage_system_error(save_errno, error);
+        result = FALSE;
+      }
+    }
+
+    g_free(full_name);
+  }
+
+  g_free(converted_name);
+  return result;
+}
+
+/* Returns whether there is an asynchronous write pending to full_path, or
+ * to a file within it if it is a directory. */
+static gboolean
+infd_filesystem_storage_has_pending_write(InfdFilesystemStorage* storage,
+                                          const gchar* full_path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  GHashTableIter iter;
+  gpointer key;
+  gsize len;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  len = strlen(full_path);
+
+  g_hash_table_iter_init(&iter, priv->latest_writes);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    if(strncmp((const gchar*)key, full_path, len) == 0 &&
+       (((const gchar*)key)[len] == '\0' ||
+        G_IS_DIR_SEPARATOR(((const gchar*)key)[len])))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gboolean
+infd_filesystem_storage_storage_move_node(InfdStorage* storage,
+                                          const gchar* identifier,
+                                          const gchar* path,
+                                          const gchar* new_path,
+                                          GError** error)
+{
+  InfdFilesystemStorage* fs_storage;
+  InfdFilesystemStoragePrivate* priv;
+  gchar* converted_name;
+  gchar* full_name;
+  gchar* new_full_name;
+  gchar* acl_name;
+  gchar* new_acl_name;
+  gboolean result;
+  int save_errno;
+
+  fs_storage = INFD_FILESYSTEM_STORAGE(storage);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
+
+  if(identifier != NULL)
+  {
+    full_name =
+      infd_filesystem_storage_get_path(fs_storage, identifier, path, error);
+    if(full_name == NULL)
+      return FALSE;
+
+    new_full_name = infd_filesystem_storage_get_path(
+      fs_storage,
+      identifier,
+      new_path,
+      error
+    );
+
+    if(new_full_name == NULL)
+    {
+      g_free(full_name);
+      return FALSE;
+    }
+  }
+  else
+  {
+    if(infd_filesystem_storage_verify_path(path, error) == FALSE ||
+       infd_filesystem_storage_verify_path(new_path, error) == FALSE)
+    {
+      return FALSE;
+    }
+
+    converted_name = g_filename_from_utf8(path, -1, NULL, NULL, error);
+    if(converted_name == NULL)
+      return FALSE;
+
+    full_name = g_build_filename(priv->root_directory, converted_name, NULL);
+    g_free(converted_name);
+
+    converted_name = g_filename_from_utf8(new_path, -1, NULL, NULL, error);
+    if(converted_name == NULL)
+    {
+      g_free(full_name);
+      return FALSE;
+    }
+
+    new_full_name =
+      g_build_filename(priv->root_directory, converted_name, NULL);
+    g_free(converted_name);
+  }
+
+  /* A write that finishes after the move would recreate the old file, or
+   * fail because its directory is gone. */
+  if(infd_filesystem_storage_has_pending_write(fs_storage, full_name))
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      G_FILE_ERROR_AGAIN,
+      _("The node is still being written to disk")
+    );
+
+    g_free(full_name);
+    g_free(new_full_name);
+    return FALSE;
+  }
+
+  /* rename() replaces existing files on POSIX systems */
+  if(g_file_test(new_full_name, G_FILE_TEST_EXISTS))
+  {
+    infd_filesystem_storage_system_error(EEXIST, error);
+    g_free(full_name);
+    g_free(new_full_name);
+    return FALSE;
+  }
+
+  infd_filesystem_storage_clear_acl_listing(fs_storage);
+
+  result = TRUE;
+  if(g_rename(full_name, new_full_name) == -1)
+  {
+    infd_filesystem_storage_system_error(errno, error);
+    result = FALSE;
+  }
+
+  if(result == TRUE)
+  {
+    acl_name =
+      infd_filesystem_storage_get_path(fs_storage, "xml.acl", path, NULL);
+    new_acl_name =
+      infd_filesystem_storage_get_path(fs_storage, "xml.acl", new_path, NULL);
+
+    if(g_rename(acl_name, new_acl_name) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        /* Move the node back, so that it does not lose its ACL */
+        g_rename(new_full_name, full_name);
+        infd_filesystem_storage_system_error(save_errno, error);
+        result = FALSE;
+      }
+    }
+
+    g_free(acl_name);
+    g_free(new_acl_name);
+  }
+
+  g_free(full_name);
+  g_free(new_full_name);
+  return result;
+}
+
+/* Copies the file at from to the new file to. If the filesystem supports
+ * it, the copy shares its data with the original until either of them is
+ * modified. If from does not exist and may_not_exist is TRUE, nothing is
+ * done and TRUE is returned. */
+static gboolean
+infd_filesystem_storage_copy_file(const gchar* from,
+                                  const gchar* to,
+                                  gboolean may_not_exist,
+                                  GError** error)
+{
+#ifdef G_OS_WIN32
+  gchar* contents;
+  gsize length;
+  GError* local_error;
+  gboolean result;
+
+  if(g_file_test(to, G_FILE_TEST_EXISTS))
+  {
+    infd_filesystem_storage_system_error(EEXIST, error);
+    return FALSE;
+  }
+
+  local_error = NULL;
+  if(!g_file_get_contents(from, &contents, &length, &local_error))
+  {
+    if(may_not_exist == TRUE &&
+       local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  result = g_file_set_contents(to, contents, length, error);
+  g_free(contents);
+  return result;
+#else
+  char buf[65536];
+  int from_fd;
+  int to_fd;
+  ssize_t n_read;
+  ssize_t n_written;
+  ssize_t offset;
+  int save_errno;
+
+  from_fd = open(from, O_NOFOLLOW | O_RDONLY);
+  if(from_fd == -1)
+  {
+    save_errno = errno;
+    if(may_not_exist == TRUE && save_errno == ENOENT)
+      return TRUE;
+
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  to_fd = open(to, O_NOFOLLOW | O_CREAT | O_EXCL | O_WRONLY, 0644);
+  if(to_fd == -1)
+  {
+    infd_filesystem_storage_system_error(errno, error);
+    close(from_fd);
+    return FALSE;
+  }
+
+  save_errno = 0;
+
+#ifdef HAVE_FICLONE
+  if(ioctl(to_fd, FICLONE, from_fd) == 0)
+  {
+    close(from_fd);
+    if(close(to_fd) == 0) return TRUE;
+
+    save_errno = errno;
+    g_unlink(to);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+#endif
+
+  /* Not supported by the filesystem, so copy the data */
+  while(save_errno == 0 && (n_read = read(from_fd, buf, sizeof(buf))) != 0)
+  {
+    if(n_read == -1)
+    {
+      if(errno != EINTR) save_errno = errno;
+      continue;
+    }
+
+    for(offset = 0; offset < n_read; offset += n_written)
+    {
+      n_written = write(to_fd, buf + offset, n_read - offset);
+      if(n_written == -1)
+      {
+        if(errno == EINTR)
+        {
+          n_written = 0;
+          continue;
+        }
+
+        save_errno = errno;
+        break;
+      }
+    }
+  }
+
+  close(from_fd);
+  if(close(to_fd) == -1 && save_errno == 0)
+    save_errno = errno;
+
+  if(save_errno != 0)
+  {
+    g_unlink(to);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  return TRUE;
+#endif
+}
+
+static gboolean
+infd_filesystem_storage_storage_copy_node(InfdStorage* storage,
+                                          const gchar* identifier,
+                                          const gchar* path,
+                                          const gchar* new_path,
+                                          GError** error)
+{
+  InfdFilesystemStorage* fs_storage;
+  gchar* full_name;
+  gchar* new_full_name;
+  gchar* acl_name;
+  gchar* new_acl_name;
+  gboolean result;
+
+  fs_storage = INFD_FILESYSTEM_STORAGE(storage);
+
+  full_name =
+    infd_filesystem_storage_get_path(fs_storage, identifier, path, error);
+  if(full_name == NULL)
+    return FALSE;
+
+  new_full_name =
+    infd_filesystem_storage_get_path(fs_storage, identifier, new_path, error);
+  if(new_full_name == NULL)
+  {
+    g_free(full_name);
+    return FALSE;
+  }
+
+  /* The copy would miss the content that is still being written */
+  if(infd_filesystem_storage_has_pending_write(fs_storage, full_name))
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      G_FILE_ERROR_AGAIN,
+      _("The node is still being written to disk")
+    );
+
+    g_free(full_name);
+    g_free(new_full_name);
+    return FALSE;
+  }
+
+  infd_filesystem_storage_clear_acl_listing(fs_storage);
 
-  result = inf_file_util_delete(full_name, error);
-  g_free(full_name);
+  result = infd_filesystem_storage_copy_file(
+    full_name,
+    new_full_name,
+    FALSE,
+    error
+  );
 
   if(result == TRUE)
   {
-    disk_name = g_strconcat(converted_name, ".xml.acl", NULL);
-    full_name = g_build_filename(priv->root_directory, disk_name, NULL);
-    g_free(disk_name);
+    acl_name =
+      infd_filesystem_storage_get_path(fs_storage, "xml.acl", path, NULL);
+    new_acl_name =
+      infd_filesystem_storage_get_path(fs_storage, "xml.acl", new_path, NULL);
+
+    result = infd_filesystem_storage_copy_file(
+      acl_name,
+      new_acl_name,
+      TRUE,
+      error
+    );
 
-    if(g_unlink(full_name) == -1)
-    {
-      save_errno = errno;
-      if(save_errno != ENOENT)
-      {
-        infd_filesystem_storage_system_error(save_errno, error);
-        result = FALSE;
-      }
-    }
+    if(result == FALSE)
+      g_unlink(new_full_name);
 
-    g_free(full_name);
+    g_free(acl_name);
+    g_free(new_acl_name);
   }
 
-  g_free(converted_name);
+  g_free(full_name);
+  g_free(new_full_name);
   return result;
 }
 
@@ -619,91 +2169,45 @@ infd_filesystem_storage_storage_read_acl(InfdStorage* storage,
 {
   InfdFilesystemStorage* fs_storage;
   InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageAclFile* file;
   gchar* full_path;
-  GError* local_error;
-
-  xmlDocPtr doc;
-  xmlNodePtr root;
-  xmlNodePtr child;
   GSList* list;
-  InfdStorageAcl* acl;
-  xmlChar* account_id;
 
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
-  full_path = infd_filesystem_storage_get_acl_path(fs_storage, path, error);
-  if(full_path == NULL) return NULL;
-
-  local_error = NULL;
-  doc = infd_filesystem_storage_read_xml_file_impl(
-    fs_storage,
-    full_path,
-    "inf-acl",
-    &local_error
-  );
-
-  g_free(full_path);
-
-  if(local_error != NULL)
-  {
-    if(local_error->domain == G_FILE_ERROR &&
-       local_error->code == G_FILE_ERROR_NOENT)
-    {
-      /* The ACL file does not exist. This is not an error, but just means
-       * the ACL is empty. */
-      g_error_free(local_error);
-      return NULL;
-    }
-
-    g_propagate_error(error, local_error);
+  if(infd_filesystem_storage_acl_listing_lacks(fs_storage, path))
     return NULL;
-  }
-
-  root = xmlDocGetRootElement(doc);
-  list = NULL;
 
-  for(child = root->children; child != NULL; child = child->next)
+  /* Use the ACL read in advance if there is one. It is only used once,
+   * reading the ACL again goes to the file. */
+  file = infd_filesystem_storage_acl_listing_lookup(fs_storage, path);
+  if(file != NULL)
   {
-    if(child->type != XML_ELEMENT_NODE) continue;
+    list = file->acl;
+    file->acl = NULL;
 
-    if(strcmp((const char*)child->name, "sheet") == 0)
+    if(file->error != NULL)
     {
-      account_id =
-        inf_xml_util_get_attribute_required(child, "account", error);
-      if(account_id == NULL)
-      {
-        infd_storage_acl_list_free(list);
-        xmlFreeDoc(doc);
-        return NULL;
-      }
+      g_propagate_error(error, file->error);
+      file->error = NULL;
+    }
 
-      acl = g_slice_new(InfdStorageAcl);
-      acl->account_id = g_strdup((const gchar*)account_id);
-      xmlFree(account_id);
-      
-      if(!inf_acl_sheet_perms_from_xml(child, &acl->mask, &acl->perms, error))
-      {
-        g_free(acl->account_id);
-        g_slice_free(InfdStorageAcl, acl);
-        infd_storage_acl_list_free(list);
-        xmlFreeDoc(doc);
-        return NULL;
-      }
+    g_hash_table_insert(
+      priv->acl_listing,
+      g_strdup(strrchr(path, '/') + 1),
+      NULL
+    );
 
-      if(!inf_acl_mask_empty(&acl->mask))
-      {
-        list = g_slist_prepend(list, acl);
-      }
-      else
-      {
-        g_free(acl->account_id);
-        g_slice_free(InfdStorageAcl, acl);
-      }
-    }
+    return list;
   }
 
-  xmlFreeDoc(doc);
+  full_path = infd_filesystem_storage_get_acl_path(fs_storage, path, error);
+  if(full_path == NULL) return NULL;
+
+  list = infd_filesystem_storage_read_acl_file(fs_storage, full_path, error);
+  g_free(full_path);
+
   return list;
 }
 
@@ -727,6 +2231,8 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
+  infd_filesystem_storage_clear_acl_listing(fs_storage);
+
   full_path = infd_filesystem_storage_get_acl_path(fs_storage, path, error);
   if(full_path == NULL) return FALSE;
 
@@ -806,6 +2312,7 @@ infd_filesystem_storage_class_init(
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(filesystem_storage_class);
 
+  object_class->dispose = infd_filesystem_storage_dispose;
   object_class->finalize = infd_filesystem_storage_finalize;
   object_class->set_property = infd_filesystem_storage_set_property;
   object_class->get_property = infd_filesystem_storage_get_property;
@@ -825,6 +2332,34 @@ infd_filesystem_storage_class_init(
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_DURABILITY,
+    g_param_spec_enum(
+      "durability",
+      "Durability",
+      "How asynchronous writes are flushed to disk",
+      INFD_TYPE_FILESYSTEM_STORAGE_DURABILITY,
+      INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMMIT_INTERVAL,
+    g_param_spec_uint(
+      "commit-interval",
+      "Commit interval",
+      "Time in milliseconds for which asynchronous writes are collected "
+      "before they are flushed to disk together",
+      0,
+      G_MAXUINT,
+      1000,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 static void
@@ -836,6 +2371,10 @@ infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface)
     infd_filesystem_storage_storage_create_subdirectory;
   iface->remove_node =
     infd_filesystem_storage_storage_remove_node;
+  iface->move_node =
+    infd_filesystem_storage_storage_move_node;
+  iface->copy_node =
+    infd_filesystem_storage_storage_copy_node;
   iface->read_acl =
     infd_filesystem_storage_storage_read_acl;
   iface->write_acl =
@@ -918,13 +2457,16 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * @storage: A #InfdFilesystemStorage.
  * @identifier: The type of node to open.
  * @path: The path to open, in UTF-8.
- * @mode: Either "r" for reading or "w" for writing.
+ * @mode: Either "r" for reading, "w" for writing or "a" for appending.
  * @full_path: (out) (type filename) (transfer full): Return location
  * of the full filename, or %NULL.
  * @error: Location to store error information, if any.
  *
  * Opens a file in the given path within the storage's root directory. If
  * the file exists already, and @mode is set to "w", the file is overwritten.
+ * If @mode is set to "a", then all data written to the stream is appended
+ * to the end of the file, even if the file has been truncated in the
+ * meanwhile.
  *
  * If @full_path is not %NULL, then it will be set to a newly allocated
  * string which contains the full name of the opened file, in the Glib file
@@ -1086,6 +2628,305 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
   return result;
 }
 
+static gboolean
+infd_filesystem_storage_start_write(InfdFilesystemStorage* storage,
+                                    InfIo* io,
+                                    const gchar* identifier,
+                                    const gchar* path,
+                                    xmlDocPtr doc,
+                                    gchar* data,
+                                    gsize len,
+                                    InfdFilesystemStorageWriteFunc func,
+                                    gpointer user_data,
+                                    GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  gchar* full_name;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  full_name = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_name == NULL)
+  {
+    if(doc != NULL)
+      xmlFreeDoc(doc);
+    g_free(data);
+    return FALSE;
+  }
+
+  write = g_slice_new(InfdFilesystemStorageWrite);
+  write->storage = storage;
+  write->io = io;
+  write->deferred = FALSE;
+  write->durability = priv->durability;
+  write->full_path = full_name;
+  write->temp_path = NULL;
+  write->doc = doc;
+  write->data = data;
+  write->len = len;
+  write->error = NULL;
+  write->func = func;
+  write->user_data = user_data;
+
+  write->operation = inf_async_operation_new(
+    io,
+    infd_filesystem_storage_write_run_func,
+    infd_filesystem_storage_write_done_func,
+    write
+  );
+
+  if(!inf_async_operation_start(write->operation, error))
+  {
+    infd_filesystem_storage_write_free(write);
+    return FALSE;
+  }
+
+  g_object_ref(io);
+
+  priv->writes = g_slist_prepend(priv->writes, write);
+  g_hash_table_replace(priv->latest_writes, write->full_path, write);
+  return TRUE;
+}
+
+/**
+ * infd_filesystem_storage_write_xml_file_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the main thread.
+ * @identifier: The type of node to write.
+ * @path: The path to write to, in UTF-8.
+ * @doc: (transfer full): The XML document to write.
+ * @func: (scope async): Function to be called when the document has been
+ * written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Writes the XML document in @doc into a file like
+ * infd_filesystem_storage_write_xml_file(), but does so in a worker thread,
+ * so that a slow disk does not block the main loop. The function takes
+ * ownership of @doc, which must not be accessed anymore afterwards.
+ *
+ * The document is written to a temporary file first, which replaces the
+ * actual file only once it has been written completely. When this has
+ * happened, or when writing the document has failed, @func is called in
+ * the thread of @io. If the same file has been written again in the
+ * meanwhile, synchronously or asynchronously, then the older content is
+ * discarded, and @func is called without error.
+ *
+ * When the file is flushed to disk, and therefore when @func is called,
+ * depends on the durability level set with
+ * infd_filesystem_storage_set_durability().
+ *
+ * If @func can no longer be called, for example because @user_data is
+ * being freed, use infd_filesystem_storage_cancel_write(). The document is
+ * still written in that case.
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error, in
+ * which case @func is not called.
+ **/
+gboolean
+infd_filesystem_storage_write_xml_file_async(InfdFilesystemStorage* storage,
+                                             InfIo* io,
+                                             const gchar* identifier,
+                                             const gchar* path,
+                                             xmlDocPtr doc,
+                                             InfdFilesystemStorageWriteFunc func,
+                                             gpointer user_data,
+                                             GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(doc != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  return infd_filesystem_storage_start_write(
+    storage,
+    io,
+    identifier,
+    path,
+    doc,
+    NULL,
+    0,
+    func,
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_filesystem_storage_write_file_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the main thread.
+ * @identifier: The type of node to write.
+ * @path: The path to write to, in UTF-8.
+ * @data: (transfer full) (array length=len): The content to write.
+ * @len: The number of bytes in @data.
+ * @func: (scope async): Function to be called when the file has been
+ * written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Writes @data into a file in a worker thread, in the same way as
+ * infd_filesystem_storage_write_xml_file_async() writes an XML document.
+ * This can be used for files that are not stored as XML. The function
+ * takes ownership of @data, which is freed with g_free() when it has been
+ * written.
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error, in
+ * which case @func is not called.
+ **/
+gboolean
+infd_filesystem_storage_write_file_async(InfdFilesystemStorage* storage,
+                                         InfIo* io,
+                                         const gchar* identifier,
+                                         const gchar* path,
+                                         gchar* data,
+                                         gsize len,
+                                         InfdFilesystemStorageWriteFunc func,
+                                         gpointer user_data,
+                                         GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(data != NULL || len == 0, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  return infd_filesystem_storage_start_write(
+    storage,
+    io,
+    identifier,
+    path,
+    NULL,
+    data,
+    len,
+    func,
+    user_data,
+    error
+  );
+}
+
+/**
+ * infd_filesystem_storage_cancel_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @func: (scope async): The function passed to
+ * infd_filesystem_storage_write_xml_file_async().
+ * @user_data: The user data passed to
+ * infd_filesystem_storage_write_xml_file_async().
+ *
+ * Makes sure that @func is not called anymore for any pending write
+ * started with infd_filesystem_storage_write_xml_file_async() or
+ * infd_filesystem_storage_write_file_async() with the given @func and
+ * @user_data. The writes themselves continue.
+ **/
+void
+infd_filesystem_storage_cancel_write(InfdFilesystemStorage* storage,
+                                     InfdFilesystemStorageWriteFunc func,
+                                     gpointer user_data)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  GSList* item;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_return_if_fail(func != NULL);
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  for(item = priv->writes; item != NULL; item = item->next)
+  {
+    write = (InfdFilesystemStorageWrite*)item->data;
+    if(write->func == func && write->user_data == user_data)
+      write->func = NULL;
+  }
+}
+
+/**
+ * infd_filesystem_storage_set_durability:
+ * @storage: A #InfdFilesystemStorage.
+ * @durability: How asynchronous writes are flushed to disk.
+ * @commit_interval: The time in milliseconds for which writes are collected
+ * with %INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL.
+ *
+ * Sets how files written with infd_filesystem_storage_write_xml_file_async()
+ * and infd_filesystem_storage_write_file_async() are flushed to disk.
+ *
+ * By default, every write is flushed to disk on its own before it replaces
+ * the previous version of its file. With many documents being saved, this
+ * means many small flushes. With %INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL,
+ * writes from all sessions are collected for @commit_interval milliseconds,
+ * and then flushed to disk together, where possible with a single syncfs()
+ * call per filesystem. Each write still replaces its file atomically, and
+ * only after it has reached the disk, but its callback is called up to
+ * @commit_interval milliseconds later. With
+ * %INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM, writes replace their files
+ * right away, and the operating system flushes them to disk whenever it
+ * sees fit, so a crash can lose recently saved content.
+ *
+ * Writes that wait for a commit when the durability is changed are
+ * committed right away.
+ **/
+void
+infd_filesystem_storage_set_durability(InfdFilesystemStorage* storage,
+                                       InfdFilesystemStorageDurability durability,
+                                       guint commit_interval)
+{
+  InfdFilesystemStoragePrivate* priv;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  if(priv->commit_interval != commit_interval)
+  {
+    priv->commit_interval = commit_interval;
+    g_object_notify(G_OBJECT(storage), "commit-interval");
+  }
+
+  if(priv->durability != durability)
+  {
+    priv->durability = durability;
+
+    if(priv->commit_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->commit_io, priv->commit_timeout);
+      priv->commit_timeout = NULL;
+      infd_filesystem_storage_schedule_commit(storage, priv->commit_io);
+    }
+
+    g_object_notify(G_OBJECT(storage), "durability");
+  }
+}
+
+/**
+ * infd_filesystem_storage_get_durability:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Returns how asynchronous writes are flushed to disk, see
+ * infd_filesystem_storage_set_durability().
+ *
+ * Returns: The durability level of @storage.
+ **/
+InfdFilesystemStorageDurability
+infd_filesystem_storage_get_durability(InfdFilesystemStorage* storage)
+{
+  g_return_val_if_fail(
+    INFD_IS_FILESYSTEM_STORAGE(storage),
+    INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE
+  );
+
+  return INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->durability;
+}
+
 /**
  * infd_filesystem_storage_stream_close:
  * @file: A #FILE opened with infd_filesystem_storage_open().
@@ -1146,4 +2987,29 @@ infd_filesystem_storage_stream_write(FILE* file,
   return fwrite(buffer, 1, len, file);
 }
 
+/**
+ * infd_filesystem_storage_stream_sync:
+ * @file: A #FILE opened with infd_filesystem_storage_open().
+ *
+ * Flushes the data written to @file and makes sure that it has reached
+ * the disk, using fflush() and fsync(). Use this function instead of
+ * calling these directly if you have opened the file with
+ * infd_filesystem_storage_open(), to make sure that the same C runtime is
+ * used that has opened it.
+ *
+ * Returns: 0 on success, or -1 on error, in which case errno is set.
+ */
+int
+infd_filesystem_storage_stream_sync(FILE* file)
+{
+  if(fflush(file) != 0)
+    return -1;
+
+#ifdef G_OS_WIN32
+  return _commit(_fileno(file));
+#else
+  return fsync(fileno(file));
+#endif
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -20,6 +20,8 @@
 #ifndef __INFD_FILESYSTEM_STORAGE_H__
 #define __INFD_FILESYSTEM_STORAGE_H__
 
+#include <libinfinity/common/inf-io.h>
+
 #include <glib-object.h>
 
 #include <libxml/tree.h>
@@ -35,6 +37,8 @@ G_BEGIN_DECLS
 #define INFD_IS_FILESYSTEM_STORAGE_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_FILESYSTEM_STORAGE))
 #define INFD_FILESYSTEM_STORAGE_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_FILESYSTEM_STORAGE, InfdFilesystemStorageClass))
 
+#define INFD_TYPE_FILESYSTEM_STORAGE_DURABILITY      (infd_filesystem_storage_durability_get_type())
+
 typedef struct _InfdFilesystemStorage InfdFilesystemStorage;
 typedef struct _InfdFilesystemStorageClass InfdFilesystemStorageClass;
 
@@ -49,6 +53,28 @@ typedef enum _InfdFilesystemStorageError {
   INFD_FILESYSTEM_STORAGE_ERROR_FAILED
 } InfdFilesystemStorageError;
 
+/**
+ * InfdFilesystemStorageDurability:
+ * @INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE: Every asynchronous write is
+ * flushed to disk before it replaces the previous version of the file.
+ * @INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL: Asynchronous writes are
+ * collected for the #InfdFilesystemStorage:commit-interval, and then
+ * flushed to disk together before they replace the previous versions of
+ * their files.
+ * @INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM: Asynchronous writes replace
+ * the previous versions of their files right away, and the operating
+ * system decides when they are flushed to disk.
+ *
+ * Specifies how #InfdFilesystemStorage makes sure that files written with
+ * infd_filesystem_storage_write_xml_file_async() and
+ * infd_filesystem_storage_write_file_async() have reached the disk.
+ */
+typedef enum _InfdFilesystemStorageDurability {
+  INFD_FILESYSTEM_STORAGE_DURABILITY_WRITE,
+  INFD_FILESYSTEM_STORAGE_DURABILITY_INTERVAL,
+  INFD_FILESYSTEM_STORAGE_DURABILITY_SYSTEM
+} InfdFilesystemStorageDurability;
+
 struct _InfdFilesystemStorageClass {
   GObjectClass parent_class;
 };
@@ -57,6 +83,24 @@ struct _InfdFilesystemStorage {
   GObject parent;
 };
 
+/**
+ * InfdFilesystemStorageWriteFunc:
+ * @storage: The #InfdFilesystemStorage that has written a file.
+ * @error: Reason why writing the file failed, or %NULL on success.
+ * @user_data: Additional data passed to
+ * infd_filesystem_storage_write_xml_file_async().
+ *
+ * This function is called in the main thread when a file written with
+ * infd_filesystem_storage_write_xml_file_async() or
+ * infd_filesystem_storage_write_file_async() has been written.
+ */
+typedef void(*InfdFilesystemStorageWriteFunc)(InfdFilesystemStorage* storage,
+                                              const GError* error,
+                                              gpointer user_data);
+
+GType
+infd_filesystem_storage_durability_get_type(void) G_GNUC_CONST;
+
 GType
 infd_filesystem_storage_get_type(void) G_GNUC_CONST;
 
@@ -91,6 +135,40 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
                                        xmlDocPtr doc,
                                        GError** error);
 
+gboolean
+infd_filesystem_storage_write_xml_file_async(InfdFilesystemStorage* storage,
+                                             InfIo* io,
+                                             const gchar* identifier,
+                                             const gchar* path,
+                                             xmlDocPtr doc,
+                                             InfdFilesystemStorageWriteFunc func,
+                                             gpointer user_data,
+                                             GError** error);
+
+gboolean
+infd_filesystem_storage_write_file_async(InfdFilesystemStorage* storage,
+                                         InfIo* io,
+                                         const gchar* identifier,
+                                         const gchar* path,
+                                         gchar* data,
+                                         gsize len,
+                                         InfdFilesystemStorageWriteFunc func,
+                                         gpointer user_data,
+                                         GError** error);
+
+void
+infd_filesystem_storage_cancel_write(InfdFilesystemStorage* storage,
+                                     InfdFilesystemStorageWriteFunc func,
+                                     gpointer user_data);
+
+void
+infd_filesystem_storage_set_durability(InfdFilesystemStorage* storage,
+                                       InfdFilesystemStorageDurability durability,
+                                       guint commit_interval);
+
+InfdFilesystemStorageDurability
+infd_filesystem_storage_get_durability(InfdFilesystemStorage* storage);
+
 int
 infd_filesystem_storage_stream_close(FILE* file);
 
@@ -104,6 +182,9 @@ infd_filesystem_storage_stream_write(FILE* file,
                                      gconstpointer buffer,
                                      gsize len);
 
+int
+infd_filesystem_storage_stream_sync(FILE* file);
+
 G_END_DECLS
 
 #endif /* __INFD_FILESYSTEM_STORAGE_H__ */
@@ -53,6 +53,18 @@ typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               gpointer,
                                               GError**);
 
+typedef void(*InfdNotePluginWriteFunc)(const GError*,
+                                       gpointer);
+
+typedef gboolean(*InfdNotePluginSessionWriteAsync)(InfdStorage*,
+                                                   InfIo*,
+                                                   InfSession*,
+                                                   const gchar*,
+                                                   gpointer,
+                                                   InfdNotePluginWriteFunc,
+                                                   gpointer,
+                                                   GError**);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +79,11 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Optional. Takes a snapshot of the session right away, and writes it to
+   * the storage in the background. The function is called in the thread
+   * of the InfIo when done, unless starting the write fails. */
+  InfdNotePluginSessionWriteAsync session_write_async;
 };
 
 G_END_DECLS
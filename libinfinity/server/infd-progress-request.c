@@ -30,6 +30,8 @@
  */
 
 #include <libinfinity/server/infd-progress-request.h>
+#include <libinfinity/server/infd-request-private.h>
+#include <libinfinity/inf-signals.h>
 
 typedef struct _InfdProgressRequestPrivate InfdProgressRequestPrivate;
 struct _InfdProgressRequestPrivate {
@@ -176,6 +178,40 @@ infd_progress_request_class_init(InfdProgressRequestClass* request_class)
   g_object_class_override_property(object_class, PROP_PROGRESS, "progress");
 }
 
+/**
+ * infd_progress_request_new: (constructor)
+ * @type: The type of the request, such as "explore-node".
+ * @node_id: The ID of the node affected by the request, or %G_MAXUINT.
+ * @requestor: (allow-none): The connection making the request, or %NULL
+ * for a local request.
+ *
+ * Creates a new #InfdProgressRequest, in the same way as infd_request_new()
+ * does for #InfdRequest.
+ *
+ * Returns: (transfer full): A new #InfdProgressRequest. Free with
+ * g_object_unref().
+ **/
+InfdProgressRequest*
+infd_progress_request_new(const gchar* type,
+                          guint node_id,
+                          InfXmlConnection* requestor)
+{
+  InfdProgressRequest* request;
+
+  g_return_val_if_fail(type != NULL, NULL);
+  g_return_val_if_fail(
+    requestor == NULL || INF_IS_XML_CONNECTION(requestor),
+    NULL
+  );
+
+  request = INFD_PROGRESS_REQUEST(
+    g_object_new(INFD_TYPE_PROGRESS_REQUEST, NULL)
+  );
+
+  _infd_request_setup(INFD_REQUEST(request), type, node_id, requestor);
+  return request;
+}
+
 /**
  * infd_progress_request_initiated:
  * @request: A #InfdProgressRequest.
@@ -199,9 +235,9 @@ infd_progress_request_initiated(InfdProgressRequest* request,
   priv->total = total;
   priv->initiated = TRUE;
 
-  g_object_notify(G_OBJECT(request), "total");
+  inf_signal_notify_if_connected(request, "total");
   if(priv->total == 0)
-    g_object_notify(G_OBJECT(request), "progress");
+    inf_signal_notify_if_connected(request, "progress");
 }
 
 /**
@@ -223,8 +259,8 @@ infd_progress_request_progress(InfdProgressRequest* request)
   g_return_if_fail(priv->current < priv->total);
 
   ++priv->current;
-  g_object_notify(G_OBJECT(request), "current");
-  g_object_notify(G_OBJECT(request), "progress");
+  inf_signal_notify_if_connected(request, "current");
+  inf_signal_notify_if_connected(request, "progress");
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -59,6 +59,11 @@ struct _InfdProgressRequest {
 GType
 infd_progress_request_get_type(void) G_GNUC_CONST;
 
+InfdProgressRequest*
+infd_progress_request_new(const gchar* type,
+                          guint node_id,
+                          InfXmlConnection* requestor);
+
 void
 infd_progress_request_initiated(InfdProgressRequest* request,
                                 guint total);
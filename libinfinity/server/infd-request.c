@@ -31,12 +31,15 @@
  */
 
 #include <libinfinity/server/infd-request.h>
+#include <libinfinity/server/infd-request-private.h>
 #include <libinfinity/common/inf-request.h>
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/inf-signals.h>
 
 typedef struct _InfdRequestPrivate InfdRequestPrivate;
 struct _InfdRequestPrivate {
-  gchar* type;
+  /* Interned, since there are only a handful of request types */
+  const gchar* type;
   guint node_id;
   InfXmlConnection* requestor;
   gboolean finished;
@@ -88,20 +91,6 @@ infd_request_dispose(GObject* object)
   G_OBJECT_CLASS(infd_request_parent_class)->dispose(object);
 }
 
-static void
-infd_request_finalize(GObject* object)
-{
-  InfdRequest* request;
-  InfdRequestPrivate* priv;
-
-  request = INFD_REQUEST(object);
-  priv = INFD_REQUEST_PRIVATE(request);
-
-  g_free(priv->type);
-
-  G_OBJECT_CLASS(infd_request_parent_class)->finalize(object);
-}
-
 static void
 infd_request_set_property(GObject* object,
                           guint prop_id,
@@ -118,7 +107,7 @@ infd_request_set_property(GObject* object,
   {
   case PROP_TYPE:
     g_assert(priv->type == NULL); /* construct only */
-    priv->type = g_value_dup_string(value);
+    priv->type = g_intern_string(g_value_get_string(value));
     break;
   case PROP_NODE_ID:
     g_assert(priv->node_id == G_MAXUINT); /* construct only */
@@ -151,7 +140,7 @@ infd_request_get_property(GObject* object,
   switch(prop_id)
   {
   case PROP_TYPE:
-    g_value_set_string(value, priv->type);
+    g_value_set_static_string(value, priv->type);
     break;
   case PROP_NODE_ID:
     g_value_set_uint(value, priv->node_id);
@@ -180,7 +169,7 @@ infd_request_request_finished(InfRequest* request,
   priv = INFD_REQUEST_PRIVATE(request);
 
   priv->finished = TRUE;
-  g_object_notify(G_OBJECT(request), "progress");
+  inf_signal_notify_if_connected(request, "progress");
 }
 
 static gboolean
@@ -203,7 +192,6 @@ infd_request_class_init(InfdRequestClass* request_class)
   object_class = G_OBJECT_CLASS(request_class);
 
   object_class->dispose = infd_request_dispose;
-  object_class->finalize = infd_request_finalize;
   object_class->set_property = infd_request_set_property;
   object_class->get_property = infd_request_get_property;
 
@@ -244,4 +232,64 @@ infd_request_request_iface_init(InfRequestInterface* iface)
   iface->is_local = infd_request_request_is_local;
 }
 
+/*
+ * Private API
+ */
+
+/* Sets the construct-only properties of a request that was created without
+ * them. This avoids going through the GValue machinery of g_object_new()
+ * for each of the many requests that a directory creates. */
+void
+_infd_request_setup(InfdRequest* request,
+                    const gchar* type,
+                    guint node_id,
+                    InfXmlConnection* requestor)
+{
+  InfdRequestPrivate* priv;
+  priv = INFD_REQUEST_PRIVATE(request);
+
+  g_assert(priv->type == NULL);
+
+  priv->type = g_intern_string(type);
+  priv->node_id = node_id;
+
+  if(requestor != NULL)
+    priv->requestor = g_object_ref(requestor);
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * infd_request_new: (constructor)
+ * @type: The type of the request, such as "add-node".
+ * @node_id: The ID of the node affected by the request, or %G_MAXUINT.
+ * @requestor: (allow-none): The connection making the request, or %NULL
+ * for a local request.
+ *
+ * Creates a new #InfdRequest. This is equivalent to creating the request
+ * with g_object_new() and setting the #InfRequest:type,
+ * #InfdRequest:node-id and #InfdRequest:requestor properties, but cheaper.
+ *
+ * Returns: (transfer full): A new #InfdRequest. Free with g_object_unref().
+ */
+InfdRequest*
+infd_request_new(const gchar* type,
+                 guint node_id,
+                 InfXmlConnection* requestor)
+{
+  InfdRequest* request;
+
+  g_return_val_if_fail(type != NULL, NULL);
+  g_return_val_if_fail(
+    requestor == NULL || INF_IS_XML_CONNECTION(requestor),
+    NULL
+  );
+
+  request = INFD_REQUEST(g_object_new(INFD_TYPE_REQUEST, NULL));
+  _infd_request_setup(request, type, node_id, requestor);
+  return request;
+}
+
 /* vim:set et sw=2 ts=2: */
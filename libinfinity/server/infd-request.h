@@ -20,6 +20,8 @@
 #ifndef __INFD_REQUEST_H__
 #define __INFD_REQUEST_H__
 
+#include <libinfinity/common/inf-xml-connection.h>
+
 #include <glib-object.h>
 
 G_BEGIN_DECLS
@@ -59,6 +61,11 @@ struct _InfdRequest {
 GType
 infd_request_get_type(void) G_GNUC_CONST;
 
+InfdRequest*
+infd_request_new(const gchar* type,
+                 guint node_id,
+                 InfXmlConnection* requestor);
+
 G_END_DECLS
 
 #endif /* __INFD_REQUEST_H__ */
@@ -46,17 +46,51 @@
 #include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
 #include <string.h>
 
+/* A token bucket for rate limiting. Each processed message takes one token,
+ * and tokens are refilled continuously up to a maximum. */
+typedef struct _InfdSessionProxyBucket InfdSessionProxyBucket;
+struct _InfdSessionProxyBucket {
+  gdouble tokens;
+  gint64 time; /* Of the last refill, or 0 if the bucket was never used */
+};
+
 typedef struct _InfdSessionProxySubscription InfdSessionProxySubscription;
 struct _InfdSessionProxySubscription {
   InfXmlConnection* connection;
   guint seq_id;
 
   GSList* users; /* Available users joined via this connection */
+
+  InfdSessionProxyBucket bucket;
+  GHashTable* user_buckets; /* user ID -> InfdSessionProxyBucket */
+  /* Messages that are held back because of rate limiting, in order */
+  GQueue queue;
+  gsize queue_bytes; /* see infd_session_proxy_xml_size() */
+
+  /* Monotonic time of the last message received from the connection */
+  gint64 last_activity;
+};
+
+/* A request that does not affect the buffer, such as a caret move, whose
+ * relay to the other subscriptions is delayed so that it can be replaced
+ * by a later request of the same kind from the same user. */
+typedef struct _InfdSessionProxyPendingRequest InfdSessionProxyPendingRequest;
+struct _InfdSessionProxyPendingRequest {
+  InfXmlConnection* connection;
+  InfAdoptedUser* user;
+
+  /* The user's vector before the first of the coalesced requests, which is
+   * what the subscriptions have seen last, and the vector of the newest
+   * request. The time attribute is rewritten to the diff of the two. */
+  InfAdoptedStateVector* base;
+  InfAdoptedStateVector* vector;
+  xmlNodePtr xml;
 };
 
 typedef struct _InfdSessionProxyPrivate InfdSessionProxyPrivate;
@@ -67,11 +101,27 @@ struct _InfdSessionProxyPrivate {
 
   GSList* subscriptions;
   guint user_id_counter;
+  /* Random number to tell this proxy apart from others for the same
+   * document when a connection subscribes again */
+  guint instance;
 
   /* Local users that do not belong to a particular connection */
   GSList* local_users;
   /* Whether there are any subscriptions / synchronizations */
   gboolean idle;
+
+  guint coalesce_interval;
+  GSList* pending_requests;
+  InfIoTimeout* coalesce_timeout;
+
+  guint rate_limit;
+  guint user_rate_limit;
+  guint rate_burst;
+  InfIoTimeout* dispatch_timeout;
+  gint64 dispatch_time;
+
+  guint dormant_timeout;
+  InfIoTimeout* dormant_check;
 };
 
 enum {
@@ -82,6 +132,13 @@ enum {
   PROP_SESSION,
   PROP_SUBSCRIPTION_GROUP,
 
+  /* read/write */
+  PROP_COALESCE_INTERVAL,
+  PROP_RATE_LIMIT,
+  PROP_USER_RATE_LIMIT,
+  PROP_RATE_BURST,
+  PROP_DORMANT_TIMEOUT,
+
   /* read/only */
   PROP_IDLE
 };
@@ -94,6 +151,10 @@ enum {
   LAST_SIGNAL
 };
 
+/* The maximum number of held back messages that are processed in one main
+ * loop iteration, across all connections. */
+#define INFD_SESSION_PROXY_DISPATCH_BUDGET 64
+
 #define INFD_SESSION_PROXY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_SESSION_PROXY, InfdSessionProxyPrivate))
 
 static guint session_proxy_signals[LAST_SIGNAL];
@@ -120,13 +181,33 @@ infd_session_proxy_subscription_new(InfXmlConnection* connection,
   subscription->seq_id = seq_id;
   subscription->users = NULL;
 
+  subscription->bucket.tokens = 0.0;
+  subscription->bucket.time = 0;
+  subscription->user_buckets = NULL;
+  g_queue_init(&subscription->queue);
+  subscription->queue_bytes = 0;
+  subscription->last_activity = g_get_monotonic_time();
+
   g_object_ref(G_OBJECT(connection));
   return subscription;
 }
 
+static void
+infd_session_proxy_bucket_free(gpointer bucket)
+{
+  g_slice_free(InfdSessionProxyBucket, bucket);
+}
+
 static void
 infd_session_proxy_subscription_free(InfdSessionProxySubscription* subscr)
 {
+  /* Messages that were held back are dropped with the subscription */
+  while(!g_queue_is_empty(&subscr->queue))
+    xmlFreeNode(g_queue_pop_head(&subscr->queue));
+
+  if(subscr->user_buckets != NULL)
+    g_hash_table_destroy(subscr->user_buckets);
+
   g_object_unref(G_OBJECT(subscr->connection));
   g_slist_free(subscr->users);
   g_slice_free(InfdSessionProxySubscription, subscr);
@@ -257,6 +338,304 @@ infd_session_proxy_make_seq(InfdSessionProxy* proxy,
   return TRUE;
 }
 
+/*
+ * Request coalescing.
+ */
+
+static void
+infd_session_proxy_pending_request_free(InfdSessionProxyPendingRequest* req)
+{
+  g_object_unref(req->connection);
+  g_object_unref(req->user);
+  inf_adopted_state_vector_free(req->base);
+  inf_adopted_state_vector_free(req->vector);
+  xmlFreeNode(req->xml);
+  g_slice_free(InfdSessionProxyPendingRequest, req);
+}
+
+static InfdSessionProxyPendingRequest*
+infd_session_proxy_find_pending_request(InfdSessionProxy* proxy,
+                                        InfAdoptedUser* user)
+{
+  InfdSessionProxyPrivate* priv;
+  GSList* item;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  for(item = priv->pending_requests; item != NULL; item = item->next)
+    if( ((InfdSessionProxyPendingRequest*)item->data)->user == user)
+      return (InfdSessionProxyPendingRequest*)item->data;
+
+  return NULL;
+}
+
+static const xmlChar*
+infd_session_proxy_get_operation_name(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+
+  for(child = xml->children; child != NULL; child = child->next)
+    if(child->type == XML_ELEMENT_NODE)
+      return child->name;
+
+  return NULL;
+}
+
+/* Sends a copy of xml to all subscriptions except the one it was received
+ * from, as the communication manager does for messages whose scope is
+ * INF_COMMUNICATION_SCOPE_GROUP. */
+static void
+infd_session_proxy_relay(InfdSessionProxy* proxy,
+                         InfXmlConnection* connection,
+                         xmlNodePtr xml)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  GSList* connections;
+  GSList* item;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  /* Sending can cause callbacks, so do not rely on the subscription list
+   * staying the same. */
+  connections = NULL;
+  for(item = priv->subscriptions; item != NULL; item = item->next)
+  {
+    subscription = (InfdSessionProxySubscription*)item->data;
+    if(subscription->connection != connection)
+    {
+      connections = g_slist_prepend(connections, subscription->connection);
+      g_object_ref(subscription->connection);
+    }
+  }
+
+  while(connections != NULL)
+  {
+    if(priv->subscription_group != NULL &&
+       infd_session_proxy_find_subscription(proxy, connections->data) != NULL)
+    {
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->subscription_group),
+        INF_XML_CONNECTION(connections->data),
+        xmlCopyNode(xml, 1)
+      );
+    }
+
+    g_object_unref(connections->data);
+    connections = g_slist_delete_link(connections, connections);
+  }
+}
+
+/* Relays a pending request to all subscriptions except the one it was
+ * received from, and frees it. */
+static void
+infd_session_proxy_send_pending_request(InfdSessionProxy* proxy,
+                                        InfdSessionProxyPendingRequest* req)
+{
+  InfdSessionProxyPrivate* priv;
+  gchar* time;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  priv->pending_requests = g_slist_remove(priv->pending_requests, req);
+
+  time = inf_adopted_state_vector_to_string_diff(req->vector, req->base);
+  inf_xml_util_set_attribute(req->xml, "time", time);
+  g_free(time);
+
+  infd_session_proxy_relay(proxy, req->connection, req->xml);
+  infd_session_proxy_pending_request_free(req);
+}
+
+/* Relays all pending requests received from connection, or all pending
+ * requests if connection is NULL. This needs to be done before anything
+ * else is sent on behalf of the users involved, so that the subscriptions
+ * see their requests in order. */
+static void
+infd_session_proxy_flush_pending_requests(InfdSessionProxy* proxy,
+                                          InfXmlConnection* connection)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxyPendingRequest* req;
+  GSList* item;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  item = priv->pending_requests;
+
+  while(item != NULL)
+  {
+    req = (InfdSessionProxyPendingRequest*)item->data;
+    if(connection == NULL || req->connection == connection)
+    {
+      infd_session_proxy_send_pending_request(proxy, req);
+      item = priv->pending_requests;
+    }
+    else
+    {
+      item = item->next;
+    }
+  }
+
+  if(priv->pending_requests == NULL && priv->coalesce_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->coalesce_timeout);
+    priv->coalesce_timeout = NULL;
+  }
+}
+
+static void
+infd_session_proxy_discard_pending_requests(InfdSessionProxy* proxy)
+{
+  InfdSessionProxyPrivate* priv;
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  if(priv->coalesce_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->coalesce_timeout);
+    priv->coalesce_timeout = NULL;
+  }
+
+  while(priv->pending_requests != NULL)
+  {
+    infd_session_proxy_pending_request_free(priv->pending_requests->data);
+
+    priv->pending_requests = g_slist_delete_link(
+      priv->pending_requests,
+      priv->pending_requests
+    );
+  }
+}
+
+static void
+infd_session_proxy_coalesce_timeout_func(gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  priv->coalesce_timeout = NULL;
+
+  infd_session_proxy_flush_pending_requests(proxy, NULL);
+}
+
+/* Passes a request to the session, and delays relaying it to the other
+ * subscriptions if it does not affect the buffer. If there is already such
+ * a request of the same kind from the same user waiting, it is dropped in
+ * favor of the new one. A request that affects the buffer first flushes the
+ * pending request of its user, and is then relayed as usual. */
+static InfCommunicationScope
+infd_session_proxy_process_request(InfdSessionProxy* proxy,
+                                   InfXmlConnection* connection,
+                                   xmlNodePtr xml)
+{
+  InfdSessionProxyPrivate* priv;
+  InfAdoptedUser* user;
+  InfdSessionProxyPendingRequest* pending;
+  InfAdoptedStateVector* base;
+  InfCommunicationScope scope;
+  const xmlChar* name;
+  xmlChar* num;
+  guint user_id;
+  guint component;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  user = inf_adopted_session_user_from_request_xml(
+    INF_ADOPTED_SESSION(priv->session),
+    xml,
+    NULL
+  );
+
+  /* Let the session report the error if the user is not valid */
+  if(user == NULL || inf_user_get_connection(INF_USER(user)) != connection)
+  {
+    infd_session_proxy_flush_pending_requests(proxy, connection);
+
+    return inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(priv->session),
+      connection,
+      xml
+    );
+  }
+
+  g_object_ref(user);
+  user_id = inf_user_get_id(INF_USER(user));
+
+  pending = infd_session_proxy_find_pending_request(proxy, user);
+  name = infd_session_proxy_get_operation_name(xml);
+  if(pending != NULL &&
+     (name == NULL || !xmlStrEqual(
+        name, infd_session_proxy_get_operation_name(pending->xml))))
+  {
+    infd_session_proxy_send_pending_request(proxy, pending);
+    pending = NULL;
+  }
+
+  base = inf_adopted_state_vector_copy(inf_adopted_user_get_vector(user));
+  component = inf_adopted_state_vector_get(base, user_id);
+
+  scope = inf_communication_object_received(
+    INF_COMMUNICATION_OBJECT(priv->session),
+    connection,
+    xml
+  );
+
+  num = xmlGetProp(xml, (const xmlChar*)"num");
+
+  if(scope == INF_COMMUNICATION_SCOPE_GROUP && num == NULL &&
+     inf_user_get_connection(INF_USER(user)) == connection &&
+     inf_adopted_state_vector_get(inf_adopted_user_get_vector(user),
+                                  user_id) == component)
+  {
+    if(pending == NULL)
+    {
+      pending = g_slice_new(InfdSessionProxyPendingRequest);
+      pending->connection = connection;
+      pending->user = user;
+      pending->base = base;
+      g_object_ref(connection);
+      g_object_ref(user);
+
+      priv->pending_requests =
+        g_slist_prepend(priv->pending_requests, pending);
+    }
+    else
+    {
+      inf_adopted_state_vector_free(pending->vector);
+      xmlFreeNode(pending->xml);
+      inf_adopted_state_vector_free(base);
+    }
+
+    pending->vector =
+      inf_adopted_state_vector_copy(inf_adopted_user_get_vector(user));
+    pending->xml = xmlCopyNode(xml, 1);
+
+    if(priv->coalesce_timeout == NULL)
+    {
+      priv->coalesce_timeout = inf_io_add_timeout(
+        priv->io,
+        priv->coalesce_interval,
+        infd_session_proxy_coalesce_timeout_func,
+        proxy,
+        NULL
+      );
+    }
+
+    /* Relayed later by ourselves */
+    scope = INF_COMMUNICATION_SCOPE_PTP;
+  }
+  else
+  {
+    /* The relay of this request needs to come after the pending one. */
+    inf_adopted_state_vector_free(base);
+    if(pending != NULL)
+      infd_session_proxy_send_pending_request(proxy, pending);
+  }
+
+  if(num != NULL) xmlFree(num);
+  g_object_unref(user);
+  return scope;
+}
+
 /* Performs a user join on the given proxy. If connection is not null, the
  * user join is made from that connection, otherwise a local user join is
  * performed. seq is the seq of the user join request and used in
@@ -489,83 +868,255 @@ infd_session_proxy_perform_user_join(InfdSessionProxy* proxy,
   return user;
 }
 
-/*
- * Signal handlers.
- */
-
+/* Removes a subscription, telling the remote site with a session-close
+ * message. dormant is set as an attribute of it, so that the remote site
+ * can tell a demotion apart from a regular unsubscription. Older clients
+ * ignore the attribute and simply keep their copy of the session. */
 static void
-infd_session_proxy_member_removed_cb(InfCommunicationGroup* group,
-                                     InfXmlConnection* connection,
-                                     gpointer user_data)
+infd_session_proxy_remove_member(InfdSessionProxy* proxy,
+                                 InfdSessionProxySubscription* subscription,
+                                 gboolean dormant)
 {
-  InfdSessionProxy* proxy;
   InfdSessionProxyPrivate* priv;
-  InfdSessionProxySubscription* subscription;
+  InfSessionSyncStatus status;
   xmlNodePtr xml;
-  GSList* item;
-  InfUser* user;
 
-  proxy = INFD_SESSION_PROXY(user_data);
   priv = INFD_SESSION_PROXY_PRIVATE(proxy);
 
-  subscription = infd_session_proxy_find_subscription(proxy, connection);
-  g_assert(subscription != NULL);
+  status = inf_session_get_synchronization_status(
+    priv->session,
+    subscription->connection
+  );
 
-  /* TODO: Only send user-status-change to users that don't have a direct
-   * connection to the closed connection. */
-  for(item = subscription->users; item != NULL; item = g_slist_next(item))
-  {
-    user = INF_USER(item->data);
+  /* If synchronization is still in progress, the default handler of
+   * InfSession will cancel the synchronization in which case we do
+   * not need to send an extra session-close message. */
 
-    /* Send user-status-change to remaining subscriptions. */
-    /* Note: We cannot simply use inf_session_set_user_status because it
-     * would also try to send the status change to the subscription we are
-     * removing, and because it only works for local users. */
-    xml = xmlNewNode(NULL, (const xmlChar*)"user-status-change");
-    inf_xml_util_set_attribute_uint(xml, "id", inf_user_get_id(user));
+  /* We send session_close when we are in AWAITING_ACK status. In
+   * AWAITING_ACK status we cannot cancel the synchronization anymore
+   * because everything has already been sent out. Therefore the client
+   * will eventuelly get in RUNNING state when it receives this message,
+   * and process it correctly. */
+  if(status != INF_SESSION_SYNC_IN_PROGRESS)
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"session-close");
+    if(dormant)
+      inf_xml_util_set_attribute(xml, "reason", "dormant");
 
-    inf_xml_util_set_attribute(
-      xml,
-      "status",
-      inf_user_status_to_string(INF_USER_UNAVAILABLE)
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->subscription_group),
+      subscription->connection,
+      xml
+    );
+  }
+  else
+  {
+    /* In case we are synchronizing the client */
+    inf_session_cancel_synchronization(
+      priv->session,
+      subscription->connection
     );
-
-    /* The actual status change is performed in the default signal handler
-     * of the remove-subscription signal. */
-    inf_session_send_to_subscriptions(priv->session, xml);
   }
 
-  g_signal_emit(
-    proxy,
-    session_proxy_signals[REMOVE_SUBSCRIPTION],
-    0,
-    connection
+  inf_communication_hosted_group_remove_member(
+    priv->subscription_group,
+    subscription->connection
   );
 }
 
 static void
-infd_session_proxy_add_user_cb(InfUserTable* user_table,
-                               InfUser* user,
-                               gpointer user_data)
+infd_session_proxy_dormant_check_func(gpointer user_data);
+
+/* Schedules the next check for idle subscriptions, at the time the
+ * subscription that has been idle longest reaches dormant-timeout. */
+static void
+infd_session_proxy_schedule_dormant_check(InfdSessionProxy* proxy)
 {
-  InfdSessionProxy* proxy;
   InfdSessionProxyPrivate* priv;
-  InfXmlConnection* sync_conn;
   InfdSessionProxySubscription* subscription;
+  GSList* item;
+  gint64 oldest;
+  gint64 wait;
 
-  proxy = INFD_SESSION_PROXY(user_data);
   priv = INFD_SESSION_PROXY_PRIVATE(proxy);
 
-  /* Make sure that we generate a non-existing user ID for the next user. */
-  if(priv->user_id_counter <= inf_user_get_id(user))
-    priv->user_id_counter = inf_user_get_id(user) + 1;
+  if(priv->dormant_check != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->dormant_check);
+    priv->dormant_check = NULL;
+  }
 
-  if(inf_session_get_status(priv->session) == INF_SESSION_SYNCHRONIZING)
+  if(priv->dormant_timeout == 0 || priv->subscriptions == NULL)
+    return;
+
+  oldest = G_MAXINT64;
+  for(item = priv->subscriptions; item != NULL; item = item->next)
   {
-    if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
-    {
-      g_object_get(
-        G_OBJECT(priv->session),
+    subscription = (InfdSessionProxySubscription*)item->data;
+    if(subscription->last_activity < oldest)
+      oldest = subscription->last_activity;
+  }
+
+  wait = oldest + (gint64)priv->dormant_timeout * G_USEC_PER_SEC -
+    g_get_monotonic_time();
+  if(wait < 0) wait = 0;
+
+  priv->dormant_check = inf_io_add_timeout(
+    priv->io,
+    (guint)MIN(wait / 1000 + 1, G_MAXUINT),
+    infd_session_proxy_dormant_check_func,
+    proxy,
+    NULL
+  );
+}
+
+static void
+infd_session_proxy_dormant_check_func(gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  GSList* item;
+  GSList* dormant;
+  gint64 limit;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  priv->dormant_check = NULL;
+
+  limit = g_get_monotonic_time() -
+    (gint64)priv->dormant_timeout * G_USEC_PER_SEC;
+
+  dormant = NULL;
+  for(item = priv->subscriptions; item != NULL; item = item->next)
+  {
+    subscription = (InfdSessionProxySubscription*)item->data;
+    if(subscription->last_activity > limit)
+      continue;
+
+    /* A subscription that is still being synchronized is not idle; it
+     * counts as active from the time the synchronization finished. */
+    if(inf_session_get_synchronization_status(priv->session,
+                                              subscription->connection) !=
+       INF_SESSION_SYNC_NONE)
+    {
+      subscription->last_activity = g_get_monotonic_time();
+      continue;
+    }
+
+    /* Messages held back by rate limiting are not handled yet */
+    if(!g_queue_is_empty(&subscription->queue))
+      continue;
+
+    dormant = g_slist_prepend(dormant, subscription->connection);
+  }
+
+  g_object_ref(proxy);
+
+  /* Removing a member removes its subscription, so do not iterate over the
+   * subscription list meanwhile. */
+  for(item = dormant; item != NULL; item = item->next)
+  {
+    subscription = infd_session_proxy_find_subscription(
+      proxy,
+      INF_XML_CONNECTION(item->data)
+    );
+
+    if(subscription != NULL)
+      infd_session_proxy_remove_member(proxy, subscription, TRUE);
+  }
+
+  g_slist_free(dormant);
+
+  if(priv->session != NULL &&
+     inf_session_get_status(priv->session) == INF_SESSION_RUNNING)
+  {
+    infd_session_proxy_schedule_dormant_check(proxy);
+  }
+
+  g_object_unref(proxy);
+}
+
+/*
+ * Signal handlers.
+ */
+
+static void
+infd_session_proxy_member_removed_cb(InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  xmlNodePtr xml;
+  GSList* item;
+  InfUser* user;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  subscription = infd_session_proxy_find_subscription(proxy, connection);
+  g_assert(subscription != NULL);
+
+  /* Relay what the users of this connection did before they leave */
+  infd_session_proxy_flush_pending_requests(proxy, connection);
+
+  /* TODO: Only send user-status-change to users that don't have a direct
+   * connection to the closed connection. */
+  for(item = subscription->users; item != NULL; item = g_slist_next(item))
+  {
+    user = INF_USER(item->data);
+
+    /* Send user-status-change to remaining subscriptions. */
+    /* Note: We cannot simply use inf_session_set_user_status because it
+     * would also try to send the status change to the subscription we are
+     * removing, and because it only works for local users. */
+    xml = xmlNewNode(NULL, (const xmlChar*)"user-status-change");
+    inf_xml_util_set_attribute_uint(xml, "id", inf_user_get_id(user));
+
+    inf_xml_util_set_attribute(
+      xml,
+      "status",
+      inf_user_status_to_string(INF_USER_UNAVAILABLE)
+    );
+
+    /* The actual status change is performed in the default signal handler
+     * of the remove-subscription signal. */
+    inf_session_send_to_subscriptions(priv->session, xml);
+  }
+
+  g_signal_emit(
+    proxy,
+    session_proxy_signals[REMOVE_SUBSCRIPTION],
+    0,
+    connection
+  );
+}
+
+static void
+infd_session_proxy_add_user_cb(InfUserTable* user_table,
+                               InfUser* user,
+                               gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+  InfXmlConnection* sync_conn;
+  InfdSessionProxySubscription* subscription;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  /* Make sure that we generate a non-existing user ID for the next user. */
+  if(priv->user_id_counter <= inf_user_get_id(user))
+    priv->user_id_counter = inf_user_get_id(user) + 1;
+
+  if(inf_session_get_status(priv->session) == INF_SESSION_SYNCHRONIZING)
+  {
+    if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
+    {
+      g_object_get(
+        G_OBJECT(priv->session),
         "sync-connection",
         &sync_conn,
         NULL
@@ -710,6 +1261,22 @@ infd_session_proxy_session_close_cb(InfSession* session,
     proxy
   );
 
+  /* No point in relaying anything anymore */
+  infd_session_proxy_discard_pending_requests(proxy);
+
+  /* Held back messages are dropped with the subscriptions below */
+  if(priv->dispatch_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->dispatch_timeout);
+    priv->dispatch_timeout = NULL;
+  }
+
+  if(priv->dormant_check != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->dormant_check);
+    priv->dormant_check = NULL;
+  }
+
   while(priv->subscriptions != NULL)
   {
     subscription = (InfdSessionProxySubscription*)priv->subscriptions->data;
@@ -756,8 +1323,22 @@ infd_session_proxy_init(InfdSessionProxy* session_proxy)
   priv->subscriptions = NULL;
   priv->subscription_group = NULL;
   priv->user_id_counter = 1;
+  priv->instance = g_random_int();
   priv->local_users = NULL;
   priv->idle = TRUE;
+
+  priv->coalesce_interval = 0;
+  priv->pending_requests = NULL;
+  priv->coalesce_timeout = NULL;
+
+  priv->rate_limit = 0;
+  priv->user_rate_limit = 0;
+  priv->rate_burst = 0;
+  priv->dispatch_timeout = NULL;
+  priv->dispatch_time = 0;
+
+  priv->dormant_timeout = 0;
+  priv->dormant_check = NULL;
 }
 
 static void
@@ -853,6 +1434,10 @@ infd_session_proxy_dispose(GObject* object)
 
   g_assert(priv->subscription_group == NULL);
   g_assert(priv->subscriptions == NULL);
+  g_assert(priv->pending_requests == NULL);
+  g_assert(priv->coalesce_timeout == NULL);
+  g_assert(priv->dispatch_timeout == NULL);
+  g_assert(priv->dormant_check == NULL);
 
   g_object_unref(priv->io);
   priv->io = NULL;
@@ -965,6 +1550,31 @@ infd_session_proxy_set_property(GObject* object,
       proxy
     );
 
+    break;
+  case PROP_COALESCE_INTERVAL:
+    priv->coalesce_interval = g_value_get_uint(value);
+    if(priv->coalesce_interval == 0 && priv->session != NULL)
+      infd_session_proxy_flush_pending_requests(proxy, NULL);
+    break;
+  case PROP_RATE_LIMIT:
+    priv->rate_limit = g_value_get_uint(value);
+    /* Have another look at held back messages with the new limit */
+    if(priv->session != NULL) infd_session_proxy_dispatch(proxy);
+    break;
+  case PROP_USER_RATE_LIMIT:
+    priv->user_rate_limit = g_value_get_uint(value);
+    if(priv->session != NULL) infd_session_proxy_dispatch(proxy);
+    break;
+  case PROP_RATE_BURST:
+    priv->rate_burst = g_value_get_uint(value);
+    break;
+  case PROP_DORMANT_TIMEOUT:
+    priv->dormant_timeout = g_value_get_uint(value);
+    if(priv->session != NULL &&
+       inf_session_get_status(priv->session) != INF_SESSION_CLOSED)
+    {
+      infd_session_proxy_schedule_dormant_check(proxy);
+    }
     break;
   case PROP_IDLE:
     /* read/only */
@@ -997,6 +1607,21 @@ infd_session_proxy_get_property(GObject* object,
   case PROP_SUBSCRIPTION_GROUP:
     g_value_set_object(value, priv->subscription_group);
     break;
+  case PROP_COALESCE_INTERVAL:
+    g_value_set_uint(value, priv->coalesce_interval);
+    break;
+  case PROP_RATE_LIMIT:
+    g_value_set_uint(value, priv->rate_limit);
+    break;
+  case PROP_USER_RATE_LIMIT:
+    g_value_set_uint(value, priv->user_rate_limit);
+    break;
+  case PROP_RATE_BURST:
+    g_value_set_uint(value, priv->rate_burst);
+    break;
+  case PROP_DORMANT_TIMEOUT:
+    g_value_set_uint(value, priv->dormant_timeout);
+    break;
   case PROP_IDLE:
     g_value_set_boolean(value, priv->idle);
     break;
@@ -1024,6 +1649,9 @@ infd_session_proxy_add_subscription(InfdSessionProxy* proxy,
   subscription = infd_session_proxy_subscription_new(connection, seq_id);
   priv->subscriptions = g_slist_prepend(priv->subscriptions, subscription);
 
+  if(priv->dormant_timeout > 0 && priv->dormant_check == NULL)
+    infd_session_proxy_schedule_dormant_check(proxy);
+
   if(priv->idle == TRUE)
   {
     priv->idle = FALSE;
@@ -1060,6 +1688,12 @@ infd_session_proxy_remove_subscription(InfdSessionProxy* proxy,
   priv->subscriptions = g_slist_remove(priv->subscriptions, subscr);
   infd_session_proxy_subscription_free(subscr);
 
+  if(priv->subscriptions == NULL && priv->dormant_check != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->dormant_check);
+    priv->dormant_check = NULL;
+  }
+
   if(priv->idle == FALSE && infd_session_proxy_check_idle(proxy) == TRUE)
   {
     priv->idle = TRUE;
@@ -1193,64 +1827,57 @@ infd_session_proxy_communication_object_enqueued(InfCommunicationObject* obj,
   );
 }
 
+/* Processes a message from a subscribed connection that is not being
+ * synchronized. */
 static InfCommunicationScope
-infd_session_proxy_communication_object_received(InfCommunicationObject* obj,
-                                                 InfXmlConnection* connection,
-                                                 xmlNodePtr node)
+infd_session_proxy_handle_message(InfdSessionProxy* proxy,
+                                  InfXmlConnection* connection,
+                                  xmlNodePtr node)
 {
-  InfdSessionProxy* proxy;
   InfdSessionProxyPrivate* priv;
-  InfSessionSyncStatus status;
   GError* local_error;
   xmlNodePtr reply_xml;
   gchar* seq;
 
-  proxy = INFD_SESSION_PROXY(obj);
   priv = INFD_SESSION_PROXY_PRIVATE(proxy);
-
-  /* TODO: Don't forward for messages the proxy issued */
-
-  g_assert(priv->session != NULL);
-  status = inf_session_get_synchronization_status(priv->session, connection);
   local_error = NULL;
 
-  if(status != INF_SESSION_SYNC_NONE)
+  if(strcmp((const char*)node->name, "user-join") == 0)
   {
-    return inf_communication_object_received(
-      INF_COMMUNICATION_OBJECT(priv->session),
+    infd_session_proxy_flush_pending_requests(proxy, connection);
+    infd_session_proxy_handle_user_join(
+      proxy,
       connection,
-      node
+      node,
+      &local_error
     );
   }
+  else if(strcmp((const char*)node->name, "session-unsubscribe") == 0)
+  {
+    /* TODO: Handle this in InfSession, if possible */
+    infd_session_proxy_flush_pending_requests(proxy, connection);
+    infd_session_proxy_handle_session_unsubscribe(
+      proxy,
+      connection,
+      node,
+      &local_error
+    );
+  }
+  else if(priv->coalesce_interval > 0 &&
+          INF_ADOPTED_IS_SESSION(priv->session) &&
+          strcmp((const char*)node->name, "request") == 0)
+  {
+    return infd_session_proxy_process_request(proxy, connection, node);
+  }
   else
   {
-    if(strcmp((const char*)node->name, "user-join") == 0)
-    {
-      infd_session_proxy_handle_user_join(
-        proxy,
-        connection,
-        node,
-        &local_error
-      );
-    }
-    else if(strcmp((const char*)node->name, "session-unsubscribe") == 0)
-    {
-      /* TODO: Handle this in InfSession, if possible */
-      infd_session_proxy_handle_session_unsubscribe(
-        proxy,
-        connection,
-        node,
-        &local_error
-      );
-    }
-    else
-    {
-      return inf_communication_object_received(
-        INF_COMMUNICATION_OBJECT(priv->session),
-        connection,
-        node
-      );
-    }
+    infd_session_proxy_flush_pending_requests(proxy, connection);
+
+    return inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(priv->session),
+      connection,
+      node
+    );
   }
 
   if(local_error != NULL)
@@ -1280,70 +1907,429 @@ infd_session_proxy_communication_object_received(InfCommunicationObject* obj,
 }
 
 /*
- * InfSessionProxy implementation
+ * Rate limiting.
  */
 
-static InfRequest*
-infd_session_proxy_session_proxy_join_user(InfSessionProxy* proxy,
-                                           guint n_params,
-                                           const GParameter* params,
-                                           InfRequestFunc func,
-                                           gpointer user_data)
+static void
+infd_session_proxy_bucket_refill(InfdSessionProxyBucket* bucket,
+                                 guint rate,
+                                 guint burst,
+                                 gint64 now)
 {
-  InfdRequest* request;
-  GArray* array;
+  if(bucket->time == 0)
+  {
+    bucket->tokens = burst;
+  }
+  else
+  {
+    bucket->tokens += (gdouble)(now - bucket->time) * rate / G_USEC_PER_SEC;
+    if(bucket->tokens > burst) bucket->tokens = burst;
+  }
 
-  guint i;
-  GParameter param;
+  bucket->time = now;
+}
 
-  GError* error;
-  InfUser* user;
+/* Returns the number of microseconds until a token is available in
+ * bucket, or 0 if there is one. */
+static gint64
+infd_session_proxy_bucket_get_wait(const InfdSessionProxyBucket* bucket,
+                                   guint rate)
+{
+  if(bucket->tokens >= 1.0) return 0;
+  return (gint64)((1.0 - bucket->tokens) * G_USEC_PER_SEC / rate) + 1;
+}
 
-  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), NULL);
+/* Checks whether xml, received from subscription, can be processed now
+ * without exceeding the rate limits. If yes, 0 is returned, and if consume
+ * is TRUE, the message is accounted for. Otherwise, the function returns
+ * the number of microseconds after which the message can be processed. */
+static gint64
+infd_session_proxy_admit(InfdSessionProxy* proxy,
+                         InfdSessionProxySubscription* subscription,
+                         xmlNodePtr xml,
+                         gboolean consume)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxyBucket* user_bucket;
+  gint64 now;
+  gint64 wait;
+  guint user_id;
 
-  request = g_object_new(
-    INFD_TYPE_REQUEST,
-    "type", "user-join",
-    NULL
-  );
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  if(priv->rate_limit == 0 && priv->user_rate_limit == 0)
+    return 0;
 
-  if(func != NULL)
+  now = g_get_monotonic_time();
+  wait = 0;
+
+  if(priv->rate_limit > 0)
   {
-    g_signal_connect_after(
-      G_OBJECT(request),
-      "finished",
-      G_CALLBACK(func),
-      user_data
+    infd_session_proxy_bucket_refill(
+      &subscription->bucket,
+      priv->rate_limit,
+      priv->rate_burst > 0 ? priv->rate_burst : priv->rate_limit,
+      now
+    );
+
+    wait = infd_session_proxy_bucket_get_wait(
+      &subscription->bucket,
+      priv->rate_limit
     );
   }
 
-  array = g_array_sized_new(
-    FALSE,
-    FALSE,
-    sizeof(GParameter),
-    n_params
-  );
+  /* Only messages made on behalf of a user, such as requests, count towards
+   * the user's limit. */
+  user_bucket = NULL;
+  if(priv->user_rate_limit > 0 &&
+     inf_xml_util_get_attribute_uint(xml, "user", &user_id, NULL))
+  {
+    if(subscription->user_buckets == NULL)
+    {
+      subscription->user_buckets = g_hash_table_new_full(
+        NULL,
+        NULL,
+        NULL,
+        infd_session_proxy_bucket_free
+      );
+    }
 
-  g_array_append_vals(array, params, n_params);
+    user_bucket = g_hash_table_lookup(
+      subscription->user_buckets,
+      GUINT_TO_POINTER(user_id)
+    );
 
-  error = NULL;
-  user = infd_session_proxy_perform_user_join(
-    INFD_SESSION_PROXY(proxy),
-    NULL,
-    NULL,
-    array,
-    &error
-  );
+    if(user_bucket == NULL)
+    {
+      user_bucket = g_slice_new0(InfdSessionProxyBucket);
+      g_hash_table_insert(
+        subscription->user_buckets,
+        GUINT_TO_POINTER(user_id),
+        user_bucket
+      );
+    }
 
-  /* Remove only those parameters that were added by the
-   * infd_session_proxy_perform_user_join function */
-  for(i = n_params; i < array->len; ++i)
-    g_value_unset(&g_array_index(array, GParameter, i).value);
-  g_array_free(array, TRUE);
+    infd_session_proxy_bucket_refill(
+      user_bucket,
+      priv->user_rate_limit,
+      priv->rate_burst > 0 ? priv->rate_burst : priv->user_rate_limit,
+      now
+    );
 
-  if(error != NULL)
+    wait = MAX(
+      wait,
+      infd_session_proxy_bucket_get_wait(user_bucket, priv->user_rate_limit)
+    );
+  }
+
+  if(wait == 0 && consume)
   {
-    inf_request_fail(INF_REQUEST(request), error);
+    if(priv->rate_limit > 0) subscription->bucket.tokens -= 1.0;
+    if(user_bucket != NULL) user_bucket->tokens -= 1.0;
+  }
+
+  return wait;
+}
+
+/* Approximates how much memory xml occupies, by adding up the size of the
+ * strings in it. This is only used for memory accounting. */
+static gsize
+infd_session_proxy_xml_size(xmlNodePtr xml)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  gsize size;
+
+  size = sizeof(xmlNode);
+  if(xml->name != NULL) size += strlen((const char*)xml->name);
+  if(xml->content != NULL) size += strlen((const char*)xml->content);
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    size += sizeof(xmlAttr) + strlen((const char*)attr->name);
+    for(child = attr->children; child != NULL; child = child->next)
+      size += infd_session_proxy_xml_size(child);
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+    size += infd_session_proxy_xml_size(child);
+
+  return size;
+}
+
+/* Holds back a copy of xml, to be processed by infd_session_proxy_dispatch()
+ * later. */
+static void
+infd_session_proxy_hold_back(InfdSessionProxySubscription* subscription,
+                             xmlNodePtr xml)
+{
+  xml = xmlCopyNode(xml, 1);
+  g_queue_push_tail(&subscription->queue, xml);
+  subscription->queue_bytes += infd_session_proxy_xml_size(xml);
+}
+
+static void
+infd_session_proxy_dispatch_timeout_func(gpointer user_data);
+
+/* Makes sure that held back messages are looked at again after at most
+ * wait microseconds. */
+static void
+infd_session_proxy_schedule_dispatch(InfdSessionProxy* proxy,
+                                     gint64 wait)
+{
+  InfdSessionProxyPrivate* priv;
+  gint64 time;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  time = g_get_monotonic_time() + wait;
+
+  if(priv->dispatch_timeout != NULL)
+  {
+    if(priv->dispatch_time <= time) return;
+    inf_io_remove_timeout(priv->io, priv->dispatch_timeout);
+  }
+
+  priv->dispatch_time = time;
+  priv->dispatch_timeout = inf_io_add_timeout(
+    priv->io,
+    (wait + 999) / 1000,
+    infd_session_proxy_dispatch_timeout_func,
+    proxy,
+    NULL
+  );
+}
+
+/* Processes held back messages in a round-robin fashion, taking one message
+ * from each connection in turn, so that a connection with a large backlog
+ * does not hold up the others. At most INFD_SESSION_PROXY_DISPATCH_BUDGET
+ * messages are processed before returning to the main loop. */
+static void
+infd_session_proxy_dispatch(InfdSessionProxy* proxy)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  InfCommunicationScope scope;
+  GSList* connections;
+  GSList* item;
+  guint budget;
+  gboolean progress;
+  gint64 wait;
+  gint64 min_wait;
+  xmlNodePtr xml;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  budget = INFD_SESSION_PROXY_DISPATCH_BUDGET;
+
+  do
+  {
+    progress = FALSE;
+
+    /* Processing a message can add or remove subscriptions */
+    connections = NULL;
+    for(item = priv->subscriptions; item != NULL; item = item->next)
+    {
+      subscription = (InfdSessionProxySubscription*)item->data;
+      if(!g_queue_is_empty(&subscription->queue))
+      {
+        connections = g_slist_prepend(connections, subscription->connection);
+        g_object_ref(subscription->connection);
+      }
+    }
+
+    while(connections != NULL)
+    {
+      subscription = infd_session_proxy_find_subscription(
+        proxy,
+        INF_XML_CONNECTION(connections->data)
+      );
+
+      if(budget > 0 && subscription != NULL &&
+         !g_queue_is_empty(&subscription->queue) &&
+         infd_session_proxy_admit(proxy, subscription,
+                                  g_queue_peek_head(&subscription->queue),
+                                  TRUE) == 0)
+      {
+        xml = g_queue_pop_head(&subscription->queue);
+        subscription->queue_bytes -= infd_session_proxy_xml_size(xml);
+
+        scope = infd_session_proxy_handle_message(
+          proxy,
+          INF_XML_CONNECTION(connections->data),
+          xml
+        );
+
+        /* The communication manager has seen this message already, so we
+         * need to relay it ourselves. */
+        if(scope == INF_COMMUNICATION_SCOPE_GROUP)
+          infd_session_proxy_relay(proxy, connections->data, xml);
+
+        xmlFreeNode(xml);
+        --budget;
+        progress = TRUE;
+      }
+
+      g_object_unref(connections->data);
+      connections = g_slist_delete_link(connections, connections);
+    }
+  } while(progress && budget > 0);
+
+  /* Find out when to continue */
+  min_wait = -1;
+  for(item = priv->subscriptions; item != NULL; item = item->next)
+  {
+    subscription = (InfdSessionProxySubscription*)item->data;
+    if(!g_queue_is_empty(&subscription->queue))
+    {
+      if(budget == 0)
+      {
+        wait = 0;
+      }
+      else
+      {
+        wait = infd_session_proxy_admit(
+          proxy,
+          subscription,
+          g_queue_peek_head(&subscription->queue),
+          FALSE
+        );
+      }
+
+      if(min_wait < 0 || wait < min_wait)
+        min_wait = wait;
+    }
+  }
+
+  if(min_wait >= 0)
+    infd_session_proxy_schedule_dispatch(proxy, min_wait);
+}
+
+static void
+infd_session_proxy_dispatch_timeout_func(gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  priv->dispatch_timeout = NULL;
+
+  infd_session_proxy_dispatch(proxy);
+}
+
+static InfCommunicationScope
+infd_session_proxy_communication_object_received(InfCommunicationObject* obj,
+                                                 InfXmlConnection* connection,
+                                                 xmlNodePtr node)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  InfSessionSyncStatus status;
+  gint64 wait;
+
+  proxy = INFD_SESSION_PROXY(obj);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  /* TODO: Don't forward for messages the proxy issued */
+
+  g_assert(priv->session != NULL);
+  status = inf_session_get_synchronization_status(priv->session, connection);
+
+  if(status != INF_SESSION_SYNC_NONE)
+  {
+    return inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(priv->session),
+      connection,
+      node
+    );
+  }
+
+  subscription = infd_session_proxy_find_subscription(proxy, connection);
+  if(subscription != NULL)
+  {
+    subscription->last_activity = g_get_monotonic_time();
+
+    /* Messages of a connection are processed in order, so once one of them
+     * is held back, all following ones are as well. The connection is not
+     * closed, its messages are only processed later. */
+    if(!g_queue_is_empty(&subscription->queue))
+    {
+      infd_session_proxy_hold_back(subscription, node);
+      return INF_COMMUNICATION_SCOPE_PTP;
+    }
+
+    wait = infd_session_proxy_admit(proxy, subscription, node, TRUE);
+    if(wait > 0)
+    {
+      infd_session_proxy_hold_back(subscription, node);
+      infd_session_proxy_schedule_dispatch(proxy, wait);
+      return INF_COMMUNICATION_SCOPE_PTP;
+    }
+  }
+
+  return infd_session_proxy_handle_message(proxy, connection, node);
+}
+
+/*
+ * InfSessionProxy implementation
+ */
+
+static InfRequest*
+infd_session_proxy_session_proxy_join_user(InfSessionProxy* proxy,
+                                           guint n_params,
+                                           const GParameter* params,
+                                           InfRequestFunc func,
+                                           gpointer user_data)
+{
+  InfdRequest* request;
+  GArray* array;
+
+  guint i;
+  GParameter param;
+
+  GError* error;
+  InfUser* user;
+
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), NULL);
+
+  request = infd_request_new("user-join", G_MAXUINT, NULL);
+
+  if(func != NULL)
+  {
+    g_signal_connect_after(
+      G_OBJECT(request),
+      "finished",
+      G_CALLBACK(func),
+      user_data
+    );
+  }
+
+  array = g_array_sized_new(
+    FALSE,
+    FALSE,
+    sizeof(GParameter),
+    n_params
+  );
+
+  g_array_append_vals(array, params, n_params);
+
+  error = NULL;
+  user = infd_session_proxy_perform_user_join(
+    INFD_SESSION_PROXY(proxy),
+    NULL,
+    NULL,
+    array,
+    &error
+  );
+
+  /* Remove only those parameters that were added by the
+   * infd_session_proxy_perform_user_join function */
+  for(i = n_params; i < array->len; ++i)
+    g_value_unset(&g_array_index(array, GParameter, i).value);
+  g_array_free(array, TRUE);
+
+  if(error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), error);
   }
   else
   {
@@ -1401,6 +2387,85 @@ infd_session_proxy_class_init(InfdSessionProxyClass* proxy_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COALESCE_INTERVAL,
+    g_param_spec_uint(
+      "coalesce-interval",
+      "Coalesce interval",
+      "Number of milliseconds for which requests not affecting the buffer, "
+      "such as caret moves, are held back before being relayed, so that "
+      "superseded ones can be dropped. 0 relays them immediately",
+      0,
+      G_MAXUINT,
+      100,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_RATE_LIMIT,
+    g_param_spec_uint(
+      "rate-limit",
+      "Rate limit",
+      "The number of messages per second that are processed from each "
+      "subscribed connection. Further messages are held back until they "
+      "fit in. 0 means no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_USER_RATE_LIMIT,
+    g_param_spec_uint(
+      "user-rate-limit",
+      "User rate limit",
+      "The number of messages per second that are processed on behalf of "
+      "each user. Further messages are held back until they fit in. 0 means "
+      "no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_RATE_BURST,
+    g_param_spec_uint(
+      "rate-burst",
+      "Rate burst",
+      "The number of messages that can be processed at once before the rate "
+      "limits apply. 0 means the number of messages allowed per second",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_DORMANT_TIMEOUT,
+    g_param_spec_uint(
+      "dormant-timeout",
+      "Dormant timeout",
+      "The number of seconds after which a subscribed connection that has "
+      "not sent anything to the session is demoted to a dormant one, see "
+      "infd_session_proxy_demote(). 0 means subscriptions are never demoted",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_IDLE,
@@ -1574,6 +2639,11 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
     (synchronize == FALSE)
   );
 
+  /* The new subscription is synchronized to the current state of the
+   * users, which already includes the pending requests, so relay them to
+   * the existing subscriptions first. */
+  infd_session_proxy_flush_pending_requests(proxy, NULL);
+
   /* Note we can't do this in the default signal handler since it doesn't
    * know the parent group. TODO: We can, meanwhile. */
   inf_communication_hosted_group_add_member(
@@ -1607,6 +2677,82 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
   }
 }
 
+/**
+ * infd_session_proxy_resubscribe_to:
+ * @proxy: A #InfdSessionProxy whose session is in state %INF_SESSION_RUNNING.
+ * @connection: A #InfXmlConnection that is not yet subscribed.
+ * @seq_id: The sequence identifier for @connection.
+ * @vector: The state of @connection's copy of the session.
+ *
+ * Subscribes @connection to @proxy's session like
+ * infd_session_proxy_subscribe_to(), for a remote site that still has a copy
+ * of the session from an earlier subscription to @proxy, for example after
+ * its connection was lost and has been re-established. Instead of
+ * synchronizing the whole session, only the users and the requests that
+ * @connection has not seen yet at state @vector are sent to it, in a single
+ * &lt;session-resync&gt; message within the subscription group. This
+ * requires the session to be an #InfAdoptedSession.
+ *
+ * Use infd_session_proxy_can_resync() to find out whether this is possible
+ * before telling the remote site to expect it. If the request logs do not
+ * cover @vector anymore when this function is called, for example because
+ * requests have been removed from them in the meanwhile, then @connection
+ * is unsubscribed again right away and %FALSE is returned. The remote site
+ * needs to subscribe again with a full synchronization in that case.
+ *
+ * Returns: %TRUE if @connection was subscribed, or %FALSE if it was
+ * unsubscribed again.
+ **/
+gboolean
+infd_session_proxy_resubscribe_to(InfdSessionProxy* proxy,
+                                  InfXmlConnection* connection,
+                                  guint seq_id,
+                                  const InfAdoptedStateVector* vector)
+{
+  InfdSessionProxyPrivate* priv;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), FALSE);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+  g_return_val_if_fail(vector != NULL, FALSE);
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(priv->session), FALSE);
+
+  g_return_val_if_fail(
+    inf_session_get_status(priv->session) == INF_SESSION_RUNNING,
+    FALSE
+  );
+
+  infd_session_proxy_subscribe_to(proxy, connection, seq_id, FALSE);
+
+  if(!inf_adopted_session_can_resync(INF_ADOPTED_SESSION(priv->session),
+                                     vector))
+  {
+    infd_session_proxy_unsubscribe(proxy, connection);
+    return FALSE;
+  }
+
+  /* The connection was added to the group right before, so this is the
+   * first message it receives in it. Everything after it is relative to
+   * the state the resync brings it to. */
+  xml = xmlNewNode(NULL, (const xmlChar*)"session-resync");
+
+  inf_adopted_session_resync_to_xml(
+    INF_ADOPTED_SESSION(priv->session),
+    vector,
+    xml
+  );
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->subscription_group),
+    connection,
+    xml
+  );
+
+  return TRUE;
+}
+
 /**
  * infd_session_proxy_unsubscribe:
  * @proxy: A #InfdSessionProxy.
@@ -1623,8 +2769,6 @@ infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
 {
   InfdSessionProxyPrivate* priv;
   InfdSessionProxySubscription* subscription;
-  InfSessionSyncStatus status;
-  xmlNodePtr xml;
 
   g_return_if_fail(INFD_IS_SESSION_PROXY(proxy));
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
@@ -1638,43 +2782,52 @@ infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
   subscription = infd_session_proxy_find_subscription(proxy, connection);
   g_return_if_fail(subscription != NULL);
 
-  status = inf_session_get_synchronization_status(
-    priv->session,
-    subscription->connection
-  );
+  infd_session_proxy_remove_member(proxy, subscription, FALSE);
+}
 
-  /* If synchronization is still in progress, the default handler of
-   * InfSession will cancel the synchronization in which case we do
-   * not need to send an extra session-close message. */
+/**
+ * infd_session_proxy_demote:
+ * @proxy: A #InfdSessionProxy whose session is in state %INF_SESSION_RUNNING.
+ * @connection: A subscribed #InfXmlConnection.
+ *
+ * Demotes the subscription of @connection to a dormant one. This is meant
+ * for clients that keep a document open without working on it, for
+ * example in a background tab. Like infd_session_proxy_unsubscribe(), it
+ * removes @connection from the subscription group, so that it does not
+ * receive the requests and caret updates of the other users anymore, and
+ * makes the users joined via @connection unavailable, so that their state
+ * does not hold back the removal of old requests from the request logs.
+ *
+ * The remote site is told that it has become dormant, and keeps its copy of
+ * the session. When it becomes active again, it can catch up with
+ * infc_browser_iter_resubscribe_session(), which only transfers the
+ * requests it has missed, as long as the request logs still cover them and
+ * the session has not been unloaded in the meanwhile. Otherwise it is
+ * synchronized again as a whole.
+ *
+ * This is done automatically for subscriptions that have been idle for
+ * longer than #InfdSessionProxy:dormant-timeout.
+ */
+void
+infd_session_proxy_demote(InfdSessionProxy* proxy,
+                          InfXmlConnection* connection)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
 
-  /* We send session_close when we are in AWAITING_ACK status. In
-   * AWAITING_ACK status we cannot cancel the synchronization anymore
-   * because everything has already been sent out. Therefore the client
-   * will eventuelly get in RUNNING state when it receives this message,
-   * and process it correctly. */
-  if(status != INF_SESSION_SYNC_IN_PROGRESS)
-  {
-    xml = xmlNewNode(NULL, (const xmlChar*)"session-close");
+  g_return_if_fail(INFD_IS_SESSION_PROXY(proxy));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
 
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->subscription_group),
-      subscription->connection,
-      xml
-    );
-  }
-  else
-  {
-    /* In case we are synchronizing the client */
-    inf_session_cancel_synchronization(
-      priv->session,
-      subscription->connection
-    );
-  }
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
 
-  inf_communication_hosted_group_remove_member(
-    priv->subscription_group,
-    subscription->connection
+  g_return_if_fail(
+    inf_session_get_status(priv->session) == INF_SESSION_RUNNING
   );
+
+  subscription = infd_session_proxy_find_subscription(proxy, connection);
+  g_return_if_fail(subscription != NULL);
+
+  infd_session_proxy_remove_member(proxy, subscription, TRUE);
 }
 
 /**
@@ -1738,4 +2891,169 @@ infd_session_proxy_is_idle(InfdSessionProxy* proxy)
   return INFD_SESSION_PROXY_PRIVATE(proxy)->idle;
 }
 
+/**
+ * infd_session_proxy_get_instance:
+ * @proxy: A #InfdSessionProxy.
+ *
+ * Returns a random number that is chosen when @proxy is created. State
+ * vectors are only meaningful for one instance of a session: if the session
+ * is stored and loaded again later, or the server restarts, then the state
+ * starts from scratch. A remote site can send this number back together with
+ * its state when it subscribes again, to make sure that its copy of the
+ * session was synchronized from @proxy, see
+ * infd_session_proxy_resubscribe_to().
+ *
+ * Returns: The instance number of @proxy.
+ **/
+guint
+infd_session_proxy_get_instance(InfdSessionProxy* proxy)
+{
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), 0);
+  return INFD_SESSION_PROXY_PRIVATE(proxy)->instance;
+}
+
+/**
+ * infd_session_proxy_can_resync:
+ * @proxy: A #InfdSessionProxy.
+ * @vector: The state of a remote copy of @proxy's session.
+ *
+ * Returns whether a remote site whose copy of the session is at state
+ * @vector can be subscribed with infd_session_proxy_resubscribe_to(), i.e.
+ * whether the session is a running #InfAdoptedSession that still has all
+ * the requests the remote site is missing, see
+ * inf_adopted_session_can_resync(). The caller needs to make sure that the
+ * remote copy was synchronized from @proxy, for example by comparing
+ * infd_session_proxy_get_instance().
+ *
+ * Returns: Whether the remote site can be resynchronized.
+ **/
+gboolean
+infd_session_proxy_can_resync(InfdSessionProxy* proxy,
+                              const InfAdoptedStateVector* vector)
+{
+  InfdSessionProxyPrivate* priv;
+
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), FALSE);
+  g_return_val_if_fail(vector != NULL, FALSE);
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  if(!INF_ADOPTED_IS_SESSION(priv->session))
+    return FALSE;
+  if(inf_session_get_status(priv->session) != INF_SESSION_RUNNING)
+    return FALSE;
+
+  return inf_adopted_session_can_resync(
+    INF_ADOPTED_SESSION(priv->session),
+    vector
+  );
+}
+
+static void
+infd_session_proxy_get_memory_usage_foreach_func(InfUser* user,
+                                                 gpointer user_data)
+{
+  InfdSessionProxyMemoryUsage* usage;
+  gsize log_bytes;
+  gsize cache_bytes;
+
+  usage = (InfdSessionProxyMemoryUsage*)user_data;
+
+  inf_adopted_request_log_get_memory_usage(
+    inf_adopted_user_get_request_log(INF_ADOPTED_USER(user)),
+    &log_bytes,
+    &cache_bytes
+  );
+
+  usage->request_log_bytes += log_bytes;
+  usage->transformation_cache_bytes += cache_bytes;
+}
+
+/**
+ * infd_session_proxy_get_memory_usage:
+ * @proxy: A #InfdSessionProxy.
+ * @usage: (out caller-allocates): Location to store the memory usage of
+ * @proxy.
+ *
+ * Estimates how much memory the session of @proxy uses, split up by what
+ * the memory is used for. See #InfdSessionProxyMemoryUsage. The values are
+ * approximations which are meant to find out which sessions are
+ * responsible for most of the memory use of a server. Messages that are
+ * waiting to be sent to subscribed connections are not included, see
+ * inf_communication_group_get_queue_status() for those.
+ */
+void
+infd_session_proxy_get_memory_usage(InfdSessionProxy* proxy,
+                                    InfdSessionProxyMemoryUsage* usage)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  GSList* item;
+
+  g_return_if_fail(INFD_IS_SESSION_PROXY(proxy));
+  g_return_if_fail(usage != NULL);
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  usage->buffer_bytes = inf_buffer_get_size(
+    inf_session_get_buffer(priv->session)
+  );
+
+  usage->request_log_bytes = 0;
+  usage->transformation_cache_bytes = 0;
+  if(INF_ADOPTED_IS_SESSION(priv->session))
+  {
+    inf_user_table_foreach_user(
+      inf_session_get_user_table(priv->session),
+      infd_session_proxy_get_memory_usage_foreach_func,
+      usage
+    );
+  }
+
+  usage->held_back_bytes = 0;
+  usage->synchronizations = 0;
+  if(inf_session_get_status(priv->session) == INF_SESSION_SYNCHRONIZING)
+    ++usage->synchronizations;
+
+  for(item = priv->subscriptions; item != NULL; item = item->next)
+  {
+    subscription = (InfdSessionProxySubscription*)item->data;
+    usage->held_back_bytes += subscription->queue_bytes;
+
+    if(inf_session_get_synchronization_status(priv->session,
+                                              subscription->connection) !=
+       INF_SESSION_SYNC_NONE)
+    {
+      ++usage->synchronizations;
+    }
+  }
+}
+
+/**
+ * infd_session_proxy_get_held_back_bytes:
+ * @proxy: A #InfdSessionProxy.
+ * @connection: A #InfXmlConnection subscribed to @proxy.
+ *
+ * Returns the approximate size of the messages from @connection that are
+ * held back because of the #InfdSessionProxy:rate-limit or
+ * #InfdSessionProxy:user-rate-limit properties, and have not been
+ * processed yet.
+ *
+ * Returns: The size of the held back messages of @connection, in bytes.
+ */
+gsize
+infd_session_proxy_get_held_back_bytes(InfdSessionProxy* proxy,
+                                       InfXmlConnection* connection)
+{
+  InfdSessionProxySubscription* subscription;
+
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), 0);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), 0);
+
+  subscription = infd_session_proxy_find_subscription(proxy, connection);
+  g_return_val_if_fail(subscription != NULL, 0);
+
+  return subscription->queue_bytes;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -20,6 +20,7 @@
 #ifndef __INFD_SESSION_PROXY_H__
 #define __INFD_SESSION_PROXY_H__
 
+#include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-session.h>
 
 #include <glib-object.h>
@@ -79,6 +80,32 @@ struct _InfdSessionProxy {
   GObject parent;
 };
 
+/**
+ * InfdSessionProxyMemoryUsage:
+ * @buffer_bytes: The size of the document content, see
+ * inf_buffer_get_size().
+ * @request_log_bytes: The content size of the requests in the request logs
+ * of all users, see inf_adopted_request_log_get_memory_usage().
+ * @transformation_cache_bytes: The content size of the cached
+ * transformations in the request logs of all users.
+ * @held_back_bytes: The size of the messages from subscribed connections
+ * that are held back because of rate limiting.
+ * @synchronizations: The number of synchronizations from or to the session
+ * that are in progress.
+ *
+ * This structure is filled by infd_session_proxy_get_memory_usage(). All
+ * sizes are approximate and in bytes. The request log fields are zero for
+ * sessions that are not #InfAdoptedSession<!-- -->s.
+ */
+typedef struct _InfdSessionProxyMemoryUsage InfdSessionProxyMemoryUsage;
+struct _InfdSessionProxyMemoryUsage {
+  gsize buffer_bytes;
+  gsize request_log_bytes;
+  gsize transformation_cache_bytes;
+  gsize held_back_bytes;
+  guint synchronizations;
+};
+
 GType
 infd_session_proxy_get_type(void) G_GNUC_CONST;
 
@@ -88,10 +115,20 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
                                 guint seq_id,
                                 gboolean synchronize);
 
+gboolean
+infd_session_proxy_resubscribe_to(InfdSessionProxy* proxy,
+                                  InfXmlConnection* connection,
+                                  guint seq_id,
+                                  const InfAdoptedStateVector* vector);
+
 void
 infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
                                InfXmlConnection* connection);
 
+void
+infd_session_proxy_demote(InfdSessionProxy* proxy,
+                          InfXmlConnection* connection);
+
 gboolean
 infd_session_proxy_has_subscriptions(InfdSessionProxy* proxy);
 
@@ -102,6 +139,21 @@ infd_session_proxy_is_subscribed(InfdSessionProxy* proxy,
 gboolean
 infd_session_proxy_is_idle(InfdSessionProxy* proxy);
 
+guint
+infd_session_proxy_get_instance(InfdSessionProxy* proxy);
+
+gboolean
+infd_session_proxy_can_resync(InfdSessionProxy* proxy,
+                              const InfAdoptedStateVector* vector);
+
+void
+infd_session_proxy_get_memory_usage(InfdSessionProxy* proxy,
+                                    InfdSessionProxyMemoryUsage* usage);
+
+gsize
+infd_session_proxy_get_held_back_bytes(InfdSessionProxy* proxy,
+                                       InfXmlConnection* connection);
+
 G_END_DECLS
 
 #endif /* __INFD_SESSION_PROXY_H__ */
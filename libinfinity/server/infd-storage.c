@@ -18,7 +18,9 @@
  */
 
 #include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-define-enum.h>
+#include <libinfinity/inf-i18n.h>
 
 static const GEnumValue infd_storage_node_type_values[] = {
   {
@@ -319,6 +321,104 @@ infd_storage_remove_node(InfdStorage* storage,
   return iface->remove_node(storage, identifier, path, error);
 }
 
+/**
+ * infd_storage_move_node:
+ * @storage: A #InfdStorage
+ * @identifier: The type of the node to move, or %NULL to move a
+ * subdirectory.
+ * @path: A path pointing to an existing node.
+ * @new_path: The path to move the node to.
+ * @error: Location to store error information.
+ *
+ * Moves the node at @path to @new_path, together with its ACL. If it is a
+ * subdirectory node, all the nodes it contains are moved with it. The
+ * parent of @new_path must exist, and @new_path itself must not.
+ *
+ * Not all storages support moving nodes. If @storage does not, the
+ * function fails with %INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED.
+ *
+ * Returns: %TRUE on success.
+ **/
+gboolean
+infd_storage_move_node(InfdStorage* storage,
+                       const gchar* identifier,
+                       const gchar* path,
+                       const gchar* new_path,
+                       GError** error)
+{
+  InfdStorageInterface* iface;
+
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(new_path != NULL, FALSE);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+  if(iface->move_node == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("The storage does not support moving nodes")
+    );
+
+    return FALSE;
+  }
+
+  return iface->move_node(storage, identifier, path, new_path, error);
+}
+
+/**
+ * infd_storage_copy_node:
+ * @storage: A #InfdStorage
+ * @identifier: The type of the note to copy.
+ * @path: A path pointing to an existing note.
+ * @new_path: The path at which to create the copy.
+ * @error: Location to store error information.
+ *
+ * Creates a copy of the note at @path at @new_path, together with its ACL.
+ * Subdirectories cannot be copied. The parent of @new_path must exist, and
+ * @new_path itself must not.
+ *
+ * Storages implement this without parsing the note, and where possible
+ * without duplicating its data, so that it is much cheaper than reading the
+ * note and writing it again.
+ *
+ * Not all storages support copying nodes. If @storage does not, the
+ * function fails with %INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED.
+ *
+ * Returns: %TRUE on success.
+ **/
+gboolean
+infd_storage_copy_node(InfdStorage* storage,
+                       const gchar* identifier,
+                       const gchar* path,
+                       const gchar* new_path,
+                       GError** error)
+{
+  InfdStorageInterface* iface;
+
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(new_path != NULL, FALSE);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+  if(iface->copy_node == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("The storage does not support copying nodes")
+    );
+
+    return FALSE;
+  }
+
+  return iface->copy_node(storage, identifier, path, new_path, error);
+}
+
 /**
  * infd_storage_read_acl:
  * @storage: A #InfdStorage.
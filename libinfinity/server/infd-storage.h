@@ -64,7 +64,9 @@ struct _InfdStorageInterface {
   /* All these calls are supposed to be synchronous, e.g. completly perform
    * the required task. Some day, we could implement asynchronous
    * behaviour in InfdDirectory (e.g. it caches operations and executes
-   * them via the storage in the background). */
+   * them via the storage in the background). For now, documents can be
+   * written in the background with
+   * infd_filesystem_storage_write_xml_file_async(). */
 
   /* Virtual Table */
   GSList* (*read_subdirectory)(InfdStorage* storage,
@@ -81,7 +83,21 @@ struct _InfdStorageInterface {
                           const gchar* path,
                           GError** error);
 
-  /* TODO: Add further methods to copy, move and expunge nodes */
+  /* Optional, infd_storage_move_node() fails if not implemented */
+  gboolean (*move_node)(InfdStorage* storage,
+                        const gchar* identifier,
+                        const gchar* path,
+                        const gchar* new_path,
+                        GError** error);
+
+  /* Optional, infd_storage_copy_node() fails if not implemented */
+  gboolean (*copy_node)(InfdStorage* storage,
+                        const gchar* identifier,
+                        const gchar* path,
+                        const gchar* new_path,
+                        GError** error);
+
+  /* TODO: Add a further method to expunge nodes */
 
   GSList* (*read_acl)(InfdStorage* storage,
                       const gchar* path,
@@ -146,6 +162,20 @@ infd_storage_remove_node(InfdStorage* storage,
                          const gchar* path,
                          GError** error);
 
+gboolean
+infd_storage_move_node(InfdStorage* storage,
+                       const gchar* identifier,
+                       const gchar* path,
+                       const gchar* new_path,
+                       GError** error);
+
+gboolean
+infd_storage_copy_node(InfdStorage* storage,
+                       const gchar* identifier,
+                       const gchar* path,
+                       const gchar* new_path,
+                       GError** error);
+
 GSList*
 infd_storage_read_acl(InfdStorage* storage,
                       const gchar* path,
@@ -17,6 +17,11 @@
  * MA 02110-1301, USA.
  */
 
+/* For accept4() */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include <libinfinity/server/infd-tcp-server.h>
 #include <libinfinity/common/inf-tcp-connection-private.h>
 #include <libinfinity/common/inf-ip-address.h>
@@ -28,6 +33,8 @@
 #ifndef G_OS_WIN32
 # include <sys/types.h>
 # include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
 # include <netinet/in.h>
 # include <arpa/inet.h>
 # include <unistd.h>
@@ -55,6 +62,12 @@ static const GEnumValue infd_tcp_server_status_values[] = {
   }
 };
 
+/* Maximum number of connections accepted per readiness event. The listening
+ * socket is watched level-triggered, so remaining connections are picked up
+ * in the next main loop iteration, after data for established connections
+ * has been processed. */
+#define INFD_TCP_SERVER_ACCEPT_BATCH 32
+
 typedef struct _InfdTcpServerPrivate InfdTcpServerPrivate;
 struct _InfdTcpServerPrivate {
   InfIo* io;
@@ -65,8 +78,18 @@ struct _InfdTcpServerPrivate {
 
   InfIpAddress* local_address;
   guint local_port;
+  /* Path of a Unix domain socket to listen on instead, or NULL */
+  gchar* local_path;
 
   InfKeepalive keepalive;
+  /* Whether keepalive is set on the listening socket, so that accepted
+   * sockets inherit it */
+  gboolean keepalive_inherited;
+
+  /* Send buffer limits for accepted connections, see
+   * inf_tcp_connection_set_watermarks() */
+  guint high_watermark;
+  guint low_watermark;
 };
 
 enum {
@@ -78,6 +101,7 @@ enum {
 
   PROP_LOCAL_ADDRESS,
   PROP_LOCAL_PORT,
+  PROP_LOCAL_PATH,
 
   PROP_KEEPALIVE
 };
@@ -154,6 +178,45 @@ infd_tcp_server_system_error(InfdTcpServer* server,
   g_error_free(error);
 }
 
+/* On Linux, sockets returned by accept() inherit the keepalive settings of
+ * the listening socket, so they are set only once there instead of with
+ * several system calls for every accepted connection. */
+static void
+infd_tcp_server_update_keepalive(InfdTcpServer* server,
+                                 const InfKeepalive* keepalive)
+{
+  InfdTcpServerPrivate* priv;
+#ifdef __linux__
+  InfKeepaliveMask current_mask;
+  GError* error;
+#endif
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+#ifdef __linux__
+  /* Keepalive is a TCP feature, Unix domain sockets do not support it */
+  if(priv->socket != INVALID_SOCKET && priv->local_path == NULL)
+  {
+    current_mask = 0;
+    if(priv->keepalive_inherited)
+      current_mask = priv->keepalive.mask;
+
+    error = NULL;
+    priv->keepalive_inherited =
+      inf_keepalive_apply(keepalive, &priv->socket, current_mask, &error);
+
+    if(error != NULL)
+    {
+      /* Not fatal, it is then set for each accepted socket */
+      g_warning("Failed to set keepalive on socket: %s", error->message);
+      g_error_free(error);
+    }
+  }
+#endif
+
+  priv->keepalive = *keepalive;
+}
+
 static void
 infd_tcp_server_io(InfNativeSocket* socket,
                    InfIoEvent events,
@@ -171,10 +234,17 @@ infd_tcp_server_io(InfNativeSocket* socket,
     struct sockaddr in_generic;
     struct sockaddr_in in;
     struct sockaddr_in6 in6;
+#ifndef G_OS_WIN32
+    struct sockaddr_un un;
+#endif
   } native_addr;
 
   InfIpAddress* address;
   guint port;
+  const InfKeepalive* keepalive;
+  InfKeepalive no_keepalive;
+  gboolean configured;
+  guint n_accepted;
 
   server = INFD_TCP_SERVER(user_data);
   priv = INFD_TCP_SERVER_PRIVATE(server);
@@ -193,6 +263,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
   }
   else if(events & INF_IO_INCOMING)
   {
+    n_accepted = 0;
+
     do
     {
       /* Note that we do not do anything with native_addr and len. This is
@@ -206,7 +278,16 @@ infd_tcp_server_io(InfNativeSocket* socket,
       errno = 0;
 #endif
       len = sizeof(native_addr);
+#ifdef HAVE_ACCEPT4
+      new_socket = accept4(
+        priv->socket,
+        &native_addr.in_generic,
+        &len,
+        SOCK_NONBLOCK
+      );
+#else
       new_socket = accept(priv->socket, &native_addr.in_generic, &len);
+#endif
       errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
       if(new_socket == INVALID_SOCKET &&
@@ -217,6 +298,13 @@ infd_tcp_server_io(InfNativeSocket* socket,
       }
       else if(new_socket != INVALID_SOCKET)
       {
+        keepalive = &priv->keepalive;
+#ifdef HAVE_ACCEPT4
+        configured = priv->keepalive_inherited;
+#else
+        configured = FALSE;
+#endif
+
         switch(native_addr.in_generic.sa_family)
         {
         case AF_INET:
@@ -227,6 +315,20 @@ infd_tcp_server_io(InfNativeSocket* socket,
           address = inf_ip_address_new_raw6(native_addr.in6.sin6_addr.s6_addr);
           port = ntohs(native_addr.in6.sin6_port);
           break;
+#ifndef G_OS_WIN32
+        case AF_UNIX:
+          /* The peer is on the same host, but has no address or port.
+           * Keepalive does not apply to Unix domain sockets. */
+          address = inf_ip_address_new_loopback4();
+          port = 0;
+
+          no_keepalive.mask = 0;
+          keepalive = &no_keepalive;
+#ifdef HAVE_ACCEPT4
+          configured = TRUE;
+#endif
+          break;
+#endif
         default:
           g_assert_not_reached();
           break;
@@ -238,7 +340,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
           new_socket,
           address,
           port,
-          &priv->keepalive,
+          keepalive,
+          configured,
           &error
         );
 
@@ -246,6 +349,15 @@ infd_tcp_server_io(InfNativeSocket* socket,
 
         if(connection != NULL)
         {
+          if(priv->high_watermark > 0)
+          {
+            inf_tcp_connection_set_watermarks(
+              connection,
+              priv->high_watermark,
+              priv->low_watermark
+            );
+          }
+
           g_signal_emit(
             G_OBJECT(server),
             tcp_server_signals[NEW_CONNECTION],
@@ -267,11 +379,14 @@ infd_tcp_server_io(InfNativeSocket* socket,
           g_error_free(error);
           closesocket(new_socket);
         }
+
+        ++n_accepted;
       }
     } while( (new_socket != INVALID_SOCKET ||
               (new_socket == INVALID_SOCKET &&
                errcode == INF_NATIVE_SOCKET_EINTR)) &&
-             (priv->socket != INVALID_SOCKET));
+             (priv->socket != INVALID_SOCKET) &&
+             (n_accepted < INFD_TCP_SERVER_ACCEPT_BATCH));
   }
 
   g_object_unref(G_OBJECT(server));
@@ -290,8 +405,13 @@ infd_tcp_server_init(InfdTcpServer* server)
 
   priv->local_address = NULL;
   priv->local_port = 0;
+  priv->local_path = NULL;
 
   priv->keepalive.mask = 0;
+  priv->keepalive_inherited = FALSE;
+
+  priv->high_watermark = 0;
+  priv->low_watermark = 0;
 }
 
 static void
@@ -326,6 +446,7 @@ infd_tcp_server_finalize(GObject* object)
 
   if(priv->local_address != NULL)
     inf_ip_address_free(priv->local_address);
+  g_free(priv->local_path);
 
   G_OBJECT_CLASS(infd_tcp_server_parent_class)->finalize(object);
 }
@@ -359,9 +480,17 @@ infd_tcp_server_set_property(GObject* object,
     g_assert(priv->status == INFD_TCP_SERVER_CLOSED);
     priv->local_port = g_value_get_uint(value);
     break;
+  case PROP_LOCAL_PATH:
+    g_assert(priv->status == INFD_TCP_SERVER_CLOSED);
+    g_free(priv->local_path);
+    priv->local_path = g_value_dup_string(value);
+    break;
   case PROP_KEEPALIVE:
     g_assert(g_value_get_boxed(value) != NULL);
-    priv->keepalive = *(const InfKeepalive*)g_value_get_boxed(value);
+    infd_tcp_server_update_keepalive(
+      server,
+      (const InfKeepalive*)g_value_get_boxed(value)
+    );
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -395,6 +524,9 @@ infd_tcp_server_get_property(GObject* object,
   case PROP_LOCAL_PORT:
     g_value_set_uint(value, priv->local_port);
     break;
+  case PROP_LOCAL_PATH:
+    g_value_set_string(value, priv->local_path);
+    break;
   case PROP_KEEPALIVE:
     g_value_set_boxed(value, &priv->keepalive);
     break;
@@ -496,6 +628,29 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
     )
   );
 
+  /**
+   * InfdTcpServer:local-path:
+   *
+   * If set, the server listens on a Unix domain socket at this path instead
+   * of on a TCP port, and #InfdTcpServer:local-address and
+   * #InfdTcpServer:local-port are ignored. This allows processes on the
+   * same host to connect without going through the network stack, with
+   * access controlled by the permissions of the socket file. Accepted
+   * connections have the loopback address and port 0 as their remote
+   * address. Not supported on Windows.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_LOCAL_PATH,
+    g_param_spec_string(
+      "local-path",
+      "Local path",
+      "Path of a Unix domain socket to bind to",
+      NULL,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_KEEPALIVE,
@@ -544,6 +699,10 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
  * is 0, a random available port will be assigned. If the function fails,
  * %FALSE is returned and an error is set.
  *
+ * If #InfdTcpServer:local-path is set, the server is bound to a Unix domain
+ * socket at that path instead. A socket left behind at that path, for
+ * example by a server that crashed, is removed first.
+ *
  * @server must be in %INFD_TCP_SERVER_CLOSED state for this function to be
  * called.
  *
@@ -558,11 +717,18 @@ infd_tcp_server_bind(InfdTcpServer* server,
   union {
     struct sockaddr_in in;
     struct sockaddr_in6 in6;
+#ifndef G_OS_WIN32
+    struct sockaddr_un un;
+#endif
   } native_address;
 
   struct sockaddr* addr;
   socklen_t addrlen;
 
+#ifndef G_OS_WIN32
+  struct stat st;
+#endif
+
 #if !defined(G_OS_WIN32) && defined(HAVE_SO_REUSEADDR)
   int value;
 #endif
@@ -572,6 +738,30 @@ infd_tcp_server_bind(InfdTcpServer* server,
 
   g_return_val_if_fail(priv->status == INFD_TCP_SERVER_CLOSED, FALSE);
 
+#ifdef G_OS_WIN32
+  g_return_val_if_fail(priv->local_path == NULL, FALSE);
+#else
+  if(priv->local_path != NULL)
+  {
+    if(strlen(priv->local_path) >= sizeof(native_address.un.sun_path))
+    {
+      inf_native_socket_make_error(ENAMETOOLONG, error);
+      return FALSE;
+    }
+
+    if(lstat(priv->local_path, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(priv->local_path);
+
+    priv->socket = socket(PF_UNIX, SOCK_STREAM, 0);
+    addr = (struct sockaddr*)&native_address.un;
+    addrlen = sizeof(struct sockaddr_un);
+
+    memset(&native_address.un, 0, sizeof(struct sockaddr_un));
+    native_address.un.sun_family = AF_UNIX;
+    strcpy(native_address.un.sun_path, priv->local_path);
+  }
+  else
+#endif
   if(priv->local_address == NULL)
   {
     priv->socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -652,13 +842,19 @@ infd_tcp_server_bind(InfdTcpServer* server,
     return FALSE;
   }
 
+  infd_tcp_server_update_keepalive(server, &priv->keepalive);
+
   g_object_freeze_notify(G_OBJECT(server));
 
   /* Is assigned a few lines below, but notifications are frozen currently
    * anyway... this saves us a temporary variable here. */
   if(priv->local_port == 0) g_object_notify(G_OBJECT(server), "local-port");
 
-  if(priv->local_address != NULL)
+  if(priv->local_path != NULL)
+  {
+    /* There is no address or port for a Unix domain socket */
+  }
+  else if(priv->local_address != NULL)
   {
     infd_tcp_server_addr_info(
       priv->socket,
@@ -688,6 +884,115 @@ infd_tcp_server_bind(InfdTcpServer* server,
   return TRUE;
 }
 
+/**
+ * infd_tcp_server_bind_native:
+ * @server: A #InfdTcpServer.
+ * @socket: A socket that is bound already.
+ * @error: Location to store error information, if any.
+ *
+ * Makes @server use @socket instead of creating and binding a new socket
+ * as infd_tcp_server_bind() does. This allows to accept connections on a
+ * socket that has been passed from another process, for example from a
+ * server that is being replaced. @socket may already be listening.
+ *
+ * The #InfdTcpServer:local-address and #InfdTcpServer:local-port properties
+ * are set to the address @socket is bound to. If @socket is a Unix domain
+ * socket, #InfdTcpServer:local-path must be set to its path before. @server
+ * takes ownership of @socket, also if the function fails.
+ *
+ * @server must be in %INFD_TCP_SERVER_CLOSED state for this function to be
+ * called.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurred.
+ */
+gboolean
+infd_tcp_server_bind_native(InfdTcpServer* server,
+                            InfNativeSocket socket,
+                            GError** error)
+{
+  InfdTcpServerPrivate* priv;
+
+  union {
+    struct sockaddr in_generic;
+    struct sockaddr_in in;
+    struct sockaddr_in6 in6;
+#ifndef G_OS_WIN32
+    struct sockaddr_un un;
+#endif
+  } native_address;
+
+  socklen_t len;
+  gboolean family_ok;
+
+  g_return_val_if_fail(INFD_IS_TCP_SERVER(server), FALSE);
+  g_return_val_if_fail(socket != INVALID_SOCKET, FALSE);
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+  g_return_val_if_fail(priv->status == INFD_TCP_SERVER_CLOSED, FALSE);
+
+  len = sizeof(native_address);
+  if(getsockname(socket, &native_address.in_generic, &len) == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    closesocket(socket);
+    return FALSE;
+  }
+
+  switch(native_address.in_generic.sa_family)
+  {
+  case AF_INET:
+  case AF_INET6:
+    family_ok = (priv->local_path == NULL);
+    break;
+#ifndef G_OS_WIN32
+  case AF_UNIX:
+    family_ok = (priv->local_path != NULL);
+    break;
+#endif
+  default:
+    family_ok = FALSE;
+    break;
+  }
+
+  if(!family_ok)
+  {
+#ifdef G_OS_WIN32
+    inf_native_socket_make_error(WSAEAFNOSUPPORT, error);
+#else
+    inf_native_socket_make_error(EAFNOSUPPORT, error);
+#endif
+    closesocket(socket);
+    return FALSE;
+  }
+
+  priv->socket = socket;
+  infd_tcp_server_update_keepalive(server, &priv->keepalive);
+
+  g_object_freeze_notify(G_OBJECT(server));
+
+  if(priv->local_path == NULL)
+  {
+    if(priv->local_address != NULL)
+      inf_ip_address_free(priv->local_address);
+
+    infd_tcp_server_addr_info(
+      priv->socket,
+      TRUE,
+      &priv->local_address,
+      &priv->local_port
+    );
+
+    g_object_notify(G_OBJECT(server), "local-address");
+    g_object_notify(G_OBJECT(server), "local-port");
+  }
+
+  priv->status = INFD_TCP_SERVER_BOUND;
+  g_object_notify(G_OBJECT(server), "status");
+
+  g_object_thaw_notify(G_OBJECT(server));
+  return TRUE;
+}
+
 /**
  * infd_tcp_server_open:
  * @server: A #InfdTcpServer.
@@ -769,7 +1074,7 @@ infd_tcp_server_open(InfdTcpServer* server,
   }
 #endif
 
-  if(listen(priv->socket, 5) == -1)
+  if(listen(priv->socket, SOMAXCONN) == -1)
   {
     inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
     if(!was_bound)
@@ -795,21 +1100,12 @@ infd_tcp_server_open(InfdTcpServer* server,
   return TRUE;
 }
 
-/**
- * infd_tcp_server_close:
- * @server: A #InfdTcpServer.
- *
- * Closes a TCP server that is open or bound.
- **/
-void
-infd_tcp_server_close(InfdTcpServer* server)
+static void
+infd_tcp_server_close_socket(InfdTcpServer* server,
+                             gboolean unlink_path)
 {
   InfdTcpServerPrivate* priv;
-
-  g_return_if_fail(INFD_IS_TCP_SERVER(server));
-
   priv = INFD_TCP_SERVER_PRIVATE(server);
-  g_return_if_fail(priv->status != INFD_TCP_SERVER_CLOSED);
 
   if(priv->status == INFD_TCP_SERVER_OPEN)
   {
@@ -820,17 +1116,83 @@ infd_tcp_server_close(InfdTcpServer* server)
 
   closesocket(priv->socket);
   priv->socket = INVALID_SOCKET;
+  priv->keepalive_inherited = FALSE;
+
+#ifndef G_OS_WIN32
+  if(priv->local_path != NULL && unlink_path)
+    unlink(priv->local_path);
+#endif
 
   priv->status = INFD_TCP_SERVER_CLOSED;
   g_object_notify(G_OBJECT(server), "status");
 }
 
+/**
+ * infd_tcp_server_close:
+ * @server: A #InfdTcpServer.
+ *
+ * Closes a TCP server that is open or bound.
+ **/
+void
+infd_tcp_server_close(InfdTcpServer* server)
+{
+  g_return_if_fail(INFD_IS_TCP_SERVER(server));
+
+  g_return_if_fail(
+    INFD_TCP_SERVER_PRIVATE(server)->status != INFD_TCP_SERVER_CLOSED
+  );
+
+  infd_tcp_server_close_socket(server, TRUE);
+}
+
+/**
+ * infd_tcp_server_hand_over:
+ * @server: A #InfdTcpServer.
+ *
+ * Closes @server after its socket has been passed to another process, which
+ * goes on accepting connections on it. Connections that arrive in the
+ * meanwhile are queued by the operating system, so none of them is refused.
+ * Unlike infd_tcp_server_close(), this does not remove the socket file of a
+ * Unix domain socket, since the other process is still using it.
+ */
+void
+infd_tcp_server_hand_over(InfdTcpServer* server)
+{
+  g_return_if_fail(INFD_IS_TCP_SERVER(server));
+
+  g_return_if_fail(
+    INFD_TCP_SERVER_PRIVATE(server)->status != INFD_TCP_SERVER_CLOSED
+  );
+
+  infd_tcp_server_close_socket(server, FALSE);
+}
+
+/**
+ * infd_tcp_server_get_native_socket:
+ * @server: A #InfdTcpServer.
+ *
+ * Returns the socket @server accepts connections on, for example to pass it
+ * to another process with infd_tcp_server_bind_native(). The socket is
+ * owned by @server and must not be closed.
+ *
+ * Returns: The socket of @server, or %INVALID_SOCKET if @server is closed.
+ */
+InfNativeSocket
+infd_tcp_server_get_native_socket(InfdTcpServer* server)
+{
+  g_return_val_if_fail(INFD_IS_TCP_SERVER(server), INVALID_SOCKET);
+  return INFD_TCP_SERVER_PRIVATE(server)->socket;
+}
+
 /**
  * infd_tcp_server_set_keepalive:
  * @server: A #InfdTcpServer.
  * @keepalive: The keepalive settings for accepted connections.
  *
  * Sets the keepalive settings for new connections accepted by the server.
+ * On Linux, the settings are also applied to the listening socket from which
+ * the accepted sockets inherit them, so that they do not need to be set for
+ * each new connection separately.
  */
 void
 infd_tcp_server_set_keepalive(InfdTcpServer* server,
@@ -839,7 +1201,7 @@ infd_tcp_server_set_keepalive(InfdTcpServer* server,
   g_return_if_fail(INFD_IS_TCP_SERVER(server));
   g_return_if_fail(keepalive != NULL);
 
-  INFD_TCP_SERVER_PRIVATE(server)->keepalive = *keepalive;
+  infd_tcp_server_update_keepalive(server, keepalive);
 }
 
 /**
@@ -858,4 +1220,32 @@ infd_tcp_server_get_keepalive(InfdTcpServer* server)
   return &INFD_TCP_SERVER_PRIVATE(server)->keepalive;
 }
 
+/**
+ * infd_tcp_server_set_watermarks:
+ * @server: A #InfdTcpServer.
+ * @high_watermark: The number of buffered bytes at which to stop reading
+ * from a connection, or 0 for no limit.
+ * @low_watermark: The number of buffered bytes at which to resume reading.
+ *
+ * Sets the send buffer limits for new connections accepted by the server,
+ * so that a client which does not read the data sent to it cannot make the
+ * server buffer an unbounded amount of data. See
+ * inf_tcp_connection_set_watermarks() for details. Connections that have
+ * already been accepted are not affected.
+ */
+void
+infd_tcp_server_set_watermarks(InfdTcpServer* server,
+                               guint high_watermark,
+                               guint low_watermark)
+{
+  InfdTcpServerPrivate* priv;
+
+  g_return_if_fail(INFD_IS_TCP_SERVER(server));
+  g_return_if_fail(high_watermark == 0 || low_watermark < high_watermark);
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+  priv->high_watermark = high_watermark;
+  priv->low_watermark = low_watermark;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -21,6 +21,7 @@
 #define __INFD_TCP_SERVER_H__
 
 #include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-native-socket.h>
 
 #include <glib-object.h>
 
@@ -69,6 +70,11 @@ gboolean
 infd_tcp_server_bind(InfdTcpServer* server,
                      GError** error);
 
+gboolean
+infd_tcp_server_bind_native(InfdTcpServer* server,
+                            InfNativeSocket socket,
+                            GError** error);
+
 gboolean
 infd_tcp_server_open(InfdTcpServer* server,
                      GError** error);
@@ -76,6 +82,12 @@ infd_tcp_server_open(InfdTcpServer* server,
 void
 infd_tcp_server_close(InfdTcpServer* server);
 
+void
+infd_tcp_server_hand_over(InfdTcpServer* server);
+
+InfNativeSocket
+infd_tcp_server_get_native_socket(InfdTcpServer* server);
+
 void
 infd_tcp_server_set_keepalive(InfdTcpServer* server,
                               const InfKeepalive* keepalive);
@@ -83,6 +95,11 @@ infd_tcp_server_set_keepalive(InfdTcpServer* server,
 const InfKeepalive*
 infd_tcp_server_get_keepalive(InfdTcpServer* server);
 
+void
+infd_tcp_server_set_watermarks(InfdTcpServer* server,
+                               guint high_watermark,
+                               guint low_watermark);
+
 G_END_DECLS
 
 #endif /* __INFD_TCP_SERVER_H__ */
@@ -21,6 +21,7 @@
 #include <libinfinity/server/infd-tcp-server.h>
 #include <libinfinity/server/infd-xml-server.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection-private.h>
 #include <libinfinity/inf-signals.h>
 
 /* Some Windows header #defines ERROR for no good */
@@ -35,18 +36,46 @@ typedef enum InfdXmppServerStatus_ {
   INFD_XMPP_SERVER_OPEN
 } InfdXmppServerStatus;
 
+/* A handshake that has not released its slot after this many milliseconds
+ * stops counting towards max-handshakes, so that clients which stall in the
+ * middle of their handshake cannot block the queue. */
+#define INFD_XMPP_SERVER_HANDSHAKE_SLOT_TIMEOUT 10000
+
+/* Maximum number of remote addresses remembered as known clients */
+#define INFD_XMPP_SERVER_MAX_KNOWN_ADDRESSES 4096
+
+typedef struct _InfdXmppServerHandshake InfdXmppServerHandshake;
+struct _InfdXmppServerHandshake {
+  InfdXmppServer* server;
+  InfXmppConnection* connection;
+  InfIo* io;
+  InfIoTimeout* timeout;
+};
+
 typedef struct _InfdXmppServerPrivate InfdXmppServerPrivate;
 struct _InfdXmppServerPrivate {
   InfdTcpServer* tcp;
   InfdXmppServerStatus status;
   gchar* local_hostname;
   InfXmppConnectionSecurityPolicy security_policy;
+  guint compression_level;
+  gboolean kernel_tls;
 
   InfCertificateCredentials* tls_creds;
 
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
   gchar* sasl_mechanisms;
+
+  /* Handshakes currently holding a slot, and accepted TCP connections
+   * waiting for one. The first n_queued_known entries of the queue are
+   * from known clients. */
+  guint max_handshakes;
+  GSList* handshakes;
+  guint n_handshakes;
+  GQueue queue;
+  guint n_queued_known;
+  GHashTable* known_addresses;
 };
 
 enum {
@@ -60,6 +89,9 @@ enum {
   PROP_SASL_MECHANISMS,
 
   PROP_SECURITY_POLICY,
+  PROP_COMPRESSION_LEVEL,
+  PROP_KERNEL_TLS,
+  PROP_MAX_HANDSHAKES,
 
   /* Overridden from XML server */
   PROP_STATUS
@@ -80,25 +112,118 @@ G_DEFINE_TYPE_WITH_CODE(InfdXmppServer, infd_xmpp_server, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdXmppServer)
   G_IMPLEMENT_INTERFACE(INFD_TYPE_XML_SERVER, infd_xmpp_server_xml_server_iface_init))
 
+static gchar*
+infd_xmpp_server_get_address_string(InfTcpConnection* tcp_connection)
+{
+  InfIpAddress* addr;
+  gchar* addr_str;
+
+  g_object_get(G_OBJECT(tcp_connection), "remote-address", &addr, NULL);
+  addr_str = inf_ip_address_to_string(addr);
+  inf_ip_address_free(addr);
+
+  return addr_str;
+}
+
 static void
-infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
-                                   InfTcpConnection* tcp_connection,
-                                   gpointer user_data)
+infd_xmpp_server_dequeue(InfdXmppServer* xmpp);
+
+static void
+infd_xmpp_server_connection_notify_status_cb(GObject* object,
+                                             GParamSpec* pspec,
+                                             gpointer user_data);
+
+/* Releases the slot of a handshake. The connection itself stays open. */
+static void
+infd_xmpp_server_release_handshake(InfdXmppServerHandshake* handshake)
+{
+  InfdXmppServerPrivate* priv;
+  priv = INFD_XMPP_SERVER_PRIVATE(handshake->server);
+
+  if(handshake->timeout != NULL)
+    inf_io_remove_timeout(handshake->io, handshake->timeout);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(handshake->connection),
+    G_CALLBACK(infd_xmpp_server_connection_notify_status_cb),
+    handshake
+  );
+
+  priv->handshakes = g_slist_remove(priv->handshakes, handshake);
+  --priv->n_handshakes;
+
+  g_object_unref(handshake->io);
+  g_object_unref(handshake->connection);
+  g_slice_free(InfdXmppServerHandshake, handshake);
+}
+
+static void
+infd_xmpp_server_handshake_timeout_func(gpointer user_data)
+{
+  InfdXmppServerHandshake* handshake;
+  InfdXmppServer* xmpp;
+
+  handshake = (InfdXmppServerHandshake*)user_data;
+  xmpp = handshake->server;
+
+  handshake->timeout = NULL;
+  infd_xmpp_server_release_handshake(handshake);
+  infd_xmpp_server_dequeue(xmpp);
+}
+
+static void
+infd_xmpp_server_connection_notify_status_cb(GObject* object,
+                                             GParamSpec* pspec,
+                                             gpointer user_data)
+{
+  InfdXmppServerHandshake* handshake;
+  InfdXmppServer* xmpp;
+  InfdXmppServerPrivate* priv;
+  InfXmlConnectionStatus status;
+  gchar* remote_hostname;
+
+  handshake = (InfdXmppServerHandshake*)user_data;
+  xmpp = handshake->server;
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  g_object_get(object, "status", &status, NULL);
+  if(status == INF_XML_CONNECTION_OPENING)
+    return;
+
+  if(status == INF_XML_CONNECTION_OPEN)
+  {
+    /* Remember the client, so that it is preferred over unknown ones when
+     * it reconnects during a connect storm. Its TLS session can then
+     * usually be resumed with a session ticket, which is much cheaper than
+     * a full handshake. */
+    if(g_hash_table_size(priv->known_addresses) >=
+       INFD_XMPP_SERVER_MAX_KNOWN_ADDRESSES)
+    {
+      g_hash_table_remove_all(priv->known_addresses);
+    }
+
+    g_object_get(object, "remote-hostname", &remote_hostname, NULL);
+    g_hash_table_add(priv->known_addresses, remote_hostname);
+  }
+
+  infd_xmpp_server_release_handshake(handshake);
+  infd_xmpp_server_dequeue(xmpp);
+}
+
+static void
+infd_xmpp_server_start_handshake(InfdXmppServer* xmpp_server,
+                                 InfTcpConnection* tcp_connection)
 {
-  InfdXmppServer* xmpp_server;
   InfdXmppServerPrivate* priv;
   InfXmppConnection* xmpp_connection;
-  InfIpAddress* addr;
+  InfdXmppServerHandshake* handshake;
   gchar* addr_str;
 
-  xmpp_server = INFD_XMPP_SERVER(user_data);
   priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
 
   /* TODO: We could perform a reverse DNS lookup to find the client hostname
    * here. */
-  g_object_get(G_OBJECT(tcp_connection), "remote-address", &addr, NULL);
-  addr_str = inf_ip_address_to_string(addr);
-  inf_ip_address_free(addr);
+  addr_str = infd_xmpp_server_get_address_string(tcp_connection);
 
   xmpp_connection = inf_xmpp_connection_new(
     tcp_connection,
@@ -113,6 +238,47 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
 
   g_free(addr_str);
 
+  if(priv->compression_level > 0)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "compression-level", priv->compression_level,
+      NULL
+    );
+  }
+
+  if(priv->kernel_tls)
+    g_object_set(G_OBJECT(xmpp_connection), "kernel-tls", TRUE, NULL);
+
+  handshake = g_slice_new(InfdXmppServerHandshake);
+  handshake->server = xmpp_server;
+  handshake->connection = xmpp_connection;
+  g_object_ref(xmpp_connection);
+
+  g_object_get(G_OBJECT(priv->tcp), "io", &handshake->io, NULL);
+
+  handshake->timeout = inf_io_add_timeout(
+    handshake->io,
+    INFD_XMPP_SERVER_HANDSHAKE_SLOT_TIMEOUT,
+    infd_xmpp_server_handshake_timeout_func,
+    handshake,
+    NULL
+  );
+
+  priv->handshakes = g_slist_prepend(priv->handshakes, handshake);
+  ++priv->n_handshakes;
+
+  g_signal_connect(
+    G_OBJECT(xmpp_connection),
+    "notify::status",
+    G_CALLBACK(infd_xmpp_server_connection_notify_status_cb),
+    handshake
+  );
+
+  /* Data that arrived while the connection was queued has been left in
+   * the kernel, so the XMPP connection sees all of it. */
+  _inf_tcp_connection_set_held(tcp_connection, FALSE);
+
   /* We could, alternatively, keep the connection around until authentication
    * has completed and emit the new_connection signal after that, to guarantee
    * that the connection is open when new_connection is emitted. */
@@ -124,6 +290,146 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
   g_object_unref(G_OBJECT(xmpp_connection));
 }
 
+static void
+infd_xmpp_server_queued_notify_status_cb(GObject* object,
+                                         GParamSpec* pspec,
+                                         gpointer user_data)
+{
+  InfdXmppServer* xmpp;
+  InfdXmppServerPrivate* priv;
+  InfTcpConnectionStatus status;
+  GList* item;
+
+  xmpp = INFD_XMPP_SERVER(user_data);
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  g_object_get(object, "status", &status, NULL);
+  if(status != INF_TCP_CONNECTION_CLOSED)
+    return;
+
+  /* The client gave up waiting */
+  item = g_queue_find(&priv->queue, object);
+  g_assert(item != NULL);
+
+  if(g_queue_link_index(&priv->queue, item) < (gint)priv->n_queued_known)
+    --priv->n_queued_known;
+
+  inf_signal_handlers_disconnect_by_func(
+    object,
+    G_CALLBACK(infd_xmpp_server_queued_notify_status_cb),
+    xmpp
+  );
+
+  g_queue_delete_link(&priv->queue, item);
+  g_object_unref(object);
+}
+
+static InfTcpConnection*
+infd_xmpp_server_pop_queued(InfdXmppServer* xmpp)
+{
+  InfdXmppServerPrivate* priv;
+  InfTcpConnection* tcp_connection;
+
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  tcp_connection = g_queue_pop_head(&priv->queue);
+  if(tcp_connection == NULL)
+    return NULL;
+
+  if(priv->n_queued_known > 0)
+    --priv->n_queued_known;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(tcp_connection),
+    G_CALLBACK(infd_xmpp_server_queued_notify_status_cb),
+    xmpp
+  );
+
+  return tcp_connection;
+}
+
+/* Starts queued handshakes for as long as there are free slots */
+static void
+infd_xmpp_server_dequeue(InfdXmppServer* xmpp)
+{
+  InfdXmppServerPrivate* priv;
+  InfTcpConnection* tcp_connection;
+
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  while(priv->max_handshakes == 0 ||
+        priv->n_handshakes < priv->max_handshakes)
+  {
+    tcp_connection = infd_xmpp_server_pop_queued(xmpp);
+    if(tcp_connection == NULL)
+      break;
+
+    infd_xmpp_server_start_handshake(xmpp, tcp_connection);
+    g_object_unref(tcp_connection);
+  }
+}
+
+/* Closes all connections still waiting for a handshake slot */
+static void
+infd_xmpp_server_clear_queue(InfdXmppServer* xmpp)
+{
+  InfTcpConnection* tcp_connection;
+
+  while( (tcp_connection = infd_xmpp_server_pop_queued(xmpp)) != NULL)
+  {
+    inf_tcp_connection_close(tcp_connection);
+    g_object_unref(tcp_connection);
+  }
+}
+
+static void
+infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
+                                   InfTcpConnection* tcp_connection,
+                                   gpointer user_data)
+{
+  InfdXmppServer* xmpp_server;
+  InfdXmppServerPrivate* priv;
+  gchar* addr_str;
+  gboolean known;
+
+  xmpp_server = INFD_XMPP_SERVER(user_data);
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
+
+  if(priv->max_handshakes == 0 || priv->n_handshakes < priv->max_handshakes)
+  {
+    infd_xmpp_server_start_handshake(xmpp_server, tcp_connection);
+    return;
+  }
+
+  /* All slots are taken, so the connection has to wait. Stop reading from
+   * it in the meanwhile, so that nothing the client sends gets lost. Known
+   * clients are queued before unknown ones. */
+  addr_str = infd_xmpp_server_get_address_string(tcp_connection);
+  known = g_hash_table_contains(priv->known_addresses, addr_str);
+  g_free(addr_str);
+
+  _inf_tcp_connection_set_held(tcp_connection, TRUE);
+
+  g_signal_connect(
+    G_OBJECT(tcp_connection),
+    "notify::status",
+    G_CALLBACK(infd_xmpp_server_queued_notify_status_cb),
+    xmpp_server
+  );
+
+  g_object_ref(tcp_connection);
+
+  if(known)
+  {
+    g_queue_push_nth(&priv->queue, tcp_connection, priv->n_queued_known);
+    ++priv->n_queued_known;
+  }
+  else
+  {
+    g_queue_push_tail(&priv->queue, tcp_connection);
+  }
+}
+
 static void
 infd_xmpp_server_error_cb(InfdTcpServer* tcp_server,
                           GError* error,
@@ -154,6 +460,8 @@ infd_xmpp_server_notify_status_cb(InfdTcpServer* tcp_server,
   {
   case INFD_TCP_SERVER_CLOSED:
   case INFD_TCP_SERVER_BOUND:
+    infd_xmpp_server_clear_queue(xmpp);
+
     if(priv->status != INFD_XMPP_SERVER_CLOSED)
     {
       priv->status = INFD_XMPP_SERVER_CLOSED;
@@ -353,11 +661,22 @@ infd_xmpp_server_init(InfdXmppServer* xmpp)
   priv->status = INFD_XMPP_SERVER_CLOSED;
   priv->local_hostname = g_strdup(g_get_host_name());
   priv->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  priv->compression_level = 0;
+  priv->kernel_tls = FALSE;
 
   priv->tls_creds = NULL;
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_mechanisms = NULL;
+
+  priv->max_handshakes = 0;
+  priv->handshakes = NULL;
+  priv->n_handshakes = 0;
+  g_queue_init(&priv->queue);
+  priv->n_queued_known = 0;
+
+  priv->known_addresses =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -372,6 +691,10 @@ infd_xmpp_server_dispose(GObject* object)
   if(priv->status != INFD_XMPP_SERVER_CLOSED)
     infd_xml_server_close(INFD_XML_SERVER(xmpp));
 
+  infd_xmpp_server_clear_queue(xmpp);
+  while(priv->handshakes != NULL)
+    infd_xmpp_server_release_handshake(priv->handshakes->data);
+
   infd_xmpp_server_set_tcp(xmpp, NULL);
 
   if(priv->sasl_own_context != NULL)
@@ -406,6 +729,7 @@ infd_xmpp_server_finalize(GObject* object)
 
   g_free(priv->local_hostname);
   g_free(priv->sasl_mechanisms);
+  g_hash_table_destroy(priv->known_addresses);
 
   G_OBJECT_CLASS(infd_xmpp_server_parent_class)->finalize(object);
 }
@@ -462,6 +786,16 @@ infd_xmpp_server_set_property(GObject* object,
   case PROP_SECURITY_POLICY:
     infd_xmpp_server_set_security_policy(xmpp, g_value_get_enum(value));
     break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_uint(value);
+    break;
+  case PROP_KERNEL_TLS:
+    priv->kernel_tls = g_value_get_boolean(value);
+    break;
+  case PROP_MAX_HANDSHAKES:
+    priv->max_handshakes = g_value_get_uint(value);
+    infd_xmpp_server_dequeue(xmpp);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -515,6 +849,15 @@ infd_xmpp_server_get_property(GObject* object,
   case PROP_SECURITY_POLICY:
     g_value_set_enum(value, priv->security_policy);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_uint(value, priv->compression_level);
+    break;
+  case PROP_KERNEL_TLS:
+    g_value_set_boolean(value, priv->kernel_tls);
+    break;
+  case PROP_MAX_HANDSHAKES:
+    g_value_set_uint(value, priv->max_handshakes);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -628,6 +971,51 @@ infd_xmpp_server_class_init(InfdXmppServerClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_uint(
+      "compression-level",
+      "Compression level",
+      "Level of stream compression offered to new connections, from 1 "
+      "(fastest) to 9 (best), or 0 to not offer compression",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_KERNEL_TLS,
+    g_param_spec_boolean(
+      "kernel-tls",
+      "Kernel TLS",
+      "Whether new connections let the kernel encrypt outgoing data, if "
+      "supported",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_HANDSHAKES,
+    g_param_spec_uint(
+      "max-handshakes",
+      "Maximum handshakes",
+      "Maximum number of connections performing their TLS and SASL "
+      "handshake at the same time, or 0 for no limit. Further connections "
+      "wait in a queue, in which clients that connected successfully before "
+      "are served first",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 
   xmpp_server_signals[ERROR] = g_signal_new(
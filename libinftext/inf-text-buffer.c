@@ -52,9 +52,101 @@ enum {
 
 static guint text_buffer_signals[LAST_SIGNAL];
 
+typedef struct _InfTextBufferObserver InfTextBufferObserver;
+struct _InfTextBufferObserver {
+  InfTextBufferTextFunc inserted_func;
+  InfTextBufferTextFunc erased_func;
+  gpointer user_data;
+};
+
+typedef struct _InfTextBufferObservers InfTextBufferObservers;
+struct _InfTextBufferObservers {
+  GArray* observers;
+
+  /* While observers are being called, removed observers are only cleared,
+   * and taken out of the array once the last call has returned. */
+  guint dispatching;
+  gboolean removed;
+};
+
+static GQuark inf_text_buffer_observers_quark;
+
+static void
+inf_text_buffer_observers_free(gpointer data)
+{
+  InfTextBufferObservers* observers;
+  observers = (InfTextBufferObservers*)data;
+
+  g_array_free(observers->observers, TRUE);
+  g_slice_free(InfTextBufferObservers, observers);
+}
+
+static void
+inf_text_buffer_notify_observers(InfTextBuffer* buffer,
+                                 gboolean inserted,
+                                 guint pos,
+                                 InfTextChunk* chunk,
+                                 InfUser* user)
+{
+  InfTextBufferObservers* observers;
+  InfTextBufferObserver* observer;
+  InfTextBufferTextFunc func;
+  guint n_observers;
+  guint i;
+
+  observers = g_object_get_qdata(
+    G_OBJECT(buffer),
+    inf_text_buffer_observers_quark
+  );
+
+  if(observers == NULL)
+    return;
+
+  /* Keep the array alive in case an observer drops the last reference */
+  g_object_ref(buffer);
+  ++observers->dispatching;
+
+  /* Observers added while dispatching are called for the next change
+   * only. The array might be reallocated by them, so do not keep pointers
+   * into it across the calls. */
+  n_observers = observers->observers->len;
+  for(i = 0; i < n_observers; ++i)
+  {
+    observer = &g_array_index(observers->observers, InfTextBufferObserver, i);
+    if(inserted)
+      func = observer->inserted_func;
+    else
+      func = observer->erased_func;
+
+    if(func != NULL)
+      func(buffer, pos, chunk, user, observer->user_data);
+  }
+
+  if(--observers->dispatching == 0 && observers->removed)
+  {
+    i = observers->observers->len;
+    while(i > 0)
+    {
+      --i;
+      observer =
+        &g_array_index(observers->observers, InfTextBufferObserver, i);
+
+      if(observer->inserted_func == NULL && observer->erased_func == NULL)
+        g_array_remove_index(observers->observers, i);
+    }
+
+    observers->removed = FALSE;
+  }
+
+  g_object_unref(buffer);
+}
+
 static void
 inf_text_buffer_default_init(InfTextBufferInterface* iface)
 {
+  inf_text_buffer_observers_quark =
+    g_quark_from_static_string("inf-text-buffer-observers");
+
   text_buffer_signals[TEXT_INSERTED] = g_signal_new(
     "text-inserted",
     INF_TEXT_TYPE_BUFFER,
@@ -154,6 +246,56 @@ inf_text_buffer_get_slice(InfTextBuffer* buffer,
   return iface->get_slice(buffer, pos, len);
 }
 
+/**
+ * inf_text_buffer_view:
+ * @buffer: A #InfTextBuffer.
+ * @pos: Character offset of where to start.
+ * @len: Number of characters to look at.
+ * @func: (scope call): The function to call for each segment.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Calls @func for each segment of text between @pos and @pos + @len, in
+ * order, similar to inf_text_chunk_view(). Unlike with
+ * inf_text_buffer_get_slice(), the text does not need to be copied, so this
+ * is the cheapest way to read text from the buffer, for example to write it
+ * into a file or to a socket. The text passed to @func is only valid until
+ * @func returns, and @buffer must not be modified from within @func.
+ *
+ * Returns: %FALSE if @func stopped the iteration, or %TRUE otherwise.
+ **/
+gboolean
+inf_text_buffer_view(InfTextBuffer* buffer,
+                     guint pos,
+                     guint len,
+                     InfTextChunkViewFunc func,
+                     gpointer user_data)
+{
+  InfTextBufferInterface* iface;
+  InfTextChunk* chunk;
+  gboolean result;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+  if(iface->view != NULL)
+    return iface->view(buffer, pos, len, func, user_data);
+
+  g_return_val_if_fail(iface->get_slice != NULL, FALSE);
+
+  chunk = iface->get_slice(buffer, pos, len);
+  result = inf_text_chunk_view(
+    chunk,
+    0,
+    inf_text_chunk_get_length(chunk),
+    func,
+    user_data
+  );
+
+  inf_text_chunk_free(chunk);
+  return result;
+}
+
 /**
  * inf_text_buffer_insert_text:
  * @buffer: A #InfTextBuffer.
@@ -542,6 +684,8 @@ inf_text_buffer_text_inserted(InfTextBuffer* buffer,
     chunk,
     user
   );
+
+  inf_text_buffer_notify_observers(buffer, TRUE, pos, chunk, user);
 }
 
 /**
@@ -573,6 +717,127 @@ inf_text_buffer_text_erased(InfTextBuffer* buffer,
     chunk,
     user
   );
+
+  inf_text_buffer_notify_observers(buffer, FALSE, pos, chunk, user);
+}
+
+/**
+ * inf_text_buffer_add_observer:
+ * @buffer: A #InfTextBuffer.
+ * @inserted_func: (allow-none): Function to call when text has been
+ * inserted into @buffer, or %NULL.
+ * @erased_func: (allow-none): Function to call when text has been erased
+ * from @buffer, or %NULL.
+ * @user_data: Additional data to pass to the functions.
+ *
+ * Registers functions that are called directly whenever text is inserted
+ * into or erased from @buffer. This is a cheaper alternative to connecting
+ * to the #InfTextBuffer::text-inserted and #InfTextBuffer::text-erased
+ * signals, for code within the same process that needs to look at every
+ * change, since no signal emission and no marshalling of the arguments is
+ * involved.
+ *
+ * The functions are called after all handlers of the corresponding signal
+ * have run, in the order in which they were added. They must not modify
+ * @buffer. Use inf_text_buffer_remove_observer() with the same arguments to
+ * unregister them again. At least one of @inserted_func and @erased_func
+ * must not be %NULL.
+ **/
+void
+inf_text_buffer_add_observer(InfTextBuffer* buffer,
+                             InfTextBufferTextFunc inserted_func,
+                             InfTextBufferTextFunc erased_func,
+                             gpointer user_data)
+{
+  InfTextBufferObservers* observers;
+  InfTextBufferObserver observer;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(inserted_func != NULL || erased_func != NULL);
+
+  observers = g_object_get_qdata(
+    G_OBJECT(buffer),
+    inf_text_buffer_observers_quark
+  );
+
+  if(observers == NULL)
+  {
+    observers = g_slice_new(InfTextBufferObservers);
+    observers->observers =
+      g_array_new(FALSE, FALSE, sizeof(InfTextBufferObserver));
+    observers->dispatching = 0;
+    observers->removed = FALSE;
+
+    g_object_set_qdata_full(
+      G_OBJECT(buffer),
+      inf_text_buffer_observers_quark,
+      observers,
+      inf_text_buffer_observers_free
+    );
+  }
+
+  observer.inserted_func = inserted_func;
+  observer.erased_func = erased_func;
+  observer.user_data = user_data;
+  g_array_append_val(observers->observers, observer);
+}
+
+/**
+ * inf_text_buffer_remove_observer:
+ * @buffer: A #InfTextBuffer.
+ * @inserted_func: (allow-none): The function passed as @inserted_func to
+ * inf_text_buffer_add_observer().
+ * @erased_func: (allow-none): The function passed as @erased_func to
+ * inf_text_buffer_add_observer().
+ * @user_data: The user data passed to inf_text_buffer_add_observer().
+ *
+ * Unregisters functions that were registered with
+ * inf_text_buffer_add_observer(). They are not called anymore, even if
+ * this is called from within one of the observers.
+ **/
+void
+inf_text_buffer_remove_observer(InfTextBuffer* buffer,
+                                InfTextBufferTextFunc inserted_func,
+                                InfTextBufferTextFunc erased_func,
+                                gpointer user_data)
+{
+  InfTextBufferObservers* observers;
+  InfTextBufferObserver* observer;
+  guint i;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(inserted_func != NULL || erased_func != NULL);
+
+  observers = g_object_get_qdata(
+    G_OBJECT(buffer),
+    inf_text_buffer_observers_quark
+  );
+
+  g_return_if_fail(observers != NULL);
+
+  for(i = 0; i < observers->observers->len; ++i)
+  {
+    observer = &g_array_index(observers->observers, InfTextBufferObserver, i);
+    if(observer->inserted_func == inserted_func &&
+       observer->erased_func == erased_func &&
+       observer->user_data == user_data)
+    {
+      if(observers->dispatching > 0)
+      {
+        observer->inserted_func = NULL;
+        observer->erased_func = NULL;
+        observers->removed = TRUE;
+      }
+      else
+      {
+        g_array_remove_index(observers->observers, i);
+      }
+
+      return;
+    }
+  }
+
+  g_return_if_reached();
 }
 
 /* vim:set et sw=2 ts=2: */
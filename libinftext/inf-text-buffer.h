@@ -57,6 +57,8 @@ typedef struct _InfTextBufferIter InfTextBufferIter;
  * @get_length: Virtual function to return the total length of the text in
  * the buffer, in characters.
  * @get_slice: Virtual function to extract a slice of text from the buffer.
+ * @view: Virtual function to look at a range of text in the buffer without
+ * copying it. If not implemented, the text is taken from @get_slice.
  * @insert_text: Virtual function to insert text into the buffer.
  * @erase_text: Virtual function to remove text from the buffer.
  * @create_begin_iter: Virtual function to create a #InfTextBufferIter at the
@@ -102,6 +104,12 @@ struct _InfTextBufferInterface {
                             guint pos,
                             guint len);
 
+  gboolean(*view)(InfTextBuffer* buffer,
+                  guint pos,
+                  guint len,
+                  InfTextChunkViewFunc func,
+                  gpointer user_data);
+
   void(*insert_text)(InfTextBuffer* buffer,
                      guint pos,
                      InfTextChunk* chunk,
@@ -152,6 +160,23 @@ struct _InfTextBufferInterface {
                      InfUser* user);
 };
 
+/**
+ * InfTextBufferTextFunc:
+ * @buffer: The #InfTextBuffer that changed.
+ * @pos: The character offset at which text was inserted or erased.
+ * @chunk: The inserted or erased text.
+ * @user: (allow-none): The #InfUser that made the change, or %NULL.
+ * @user_data: User data passed to inf_text_buffer_add_observer().
+ *
+ * This is the signature of the functions registered with
+ * inf_text_buffer_add_observer().
+ */
+typedef void(*InfTextBufferTextFunc)(InfTextBuffer* buffer,
+                                     guint pos,
+                                     InfTextChunk* chunk,
+                                     InfUser* user,
+                                     gpointer user_data);
+
 GType
 inf_text_buffer_get_type(void) G_GNUC_CONST;
 
@@ -166,6 +191,13 @@ inf_text_buffer_get_slice(InfTextBuffer* buffer,
                           guint pos,
                           guint len);
 
+gboolean
+inf_text_buffer_view(InfTextBuffer* buffer,
+                     guint pos,
+                     guint len,
+                     InfTextChunkViewFunc func,
+                     gpointer user_data);
+
 void
 inf_text_buffer_insert_text(InfTextBuffer* buffer,
                             guint pos,
@@ -236,6 +268,18 @@ inf_text_buffer_text_erased(InfTextBuffer* buffer,
                             InfTextChunk* chunk,
                             InfUser* user);
 
+void
+inf_text_buffer_add_observer(InfTextBuffer* buffer,
+                             InfTextBufferTextFunc inserted_func,
+                             InfTextBufferTextFunc erased_func,
+                             gpointer user_data);
+
+void
+inf_text_buffer_remove_observer(InfTextBuffer* buffer,
+                                InfTextBufferTextFunc inserted_func,
+                                InfTextBufferTextFunc erased_func,
+                                gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_BUFFER_H__ */
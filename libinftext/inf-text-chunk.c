@@ -43,9 +43,21 @@
  * offsets where necessary. For a small set of selected encodings which are
  * very popular, most notably UTF-8, there exist more optimized code paths to
  * do the conversion.
+ *
+ * Text inserted with inf_text_chunk_insert_bytes() is not copied. Instead,
+ * the chunk keeps a reference to the #GBytes, which can for example be
+ * backed by a memory-mapped file, and the text is only copied into memory
+ * owned by the chunk once it is modified.
+ *
+ * A document that many users have been editing at the same time can consist
+ * of a large number of small segments. inf_text_chunk_compact() merges
+ * neighbouring segments written by the same author, and moves the text of
+ * the remaining small segments into a single allocation, which is shared
+ * between them.
  */
 
 #include <libinftext/inf-text-chunk.h>
+#include <libinftext/inf-text-iconv-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 
 #include <string.h>
@@ -58,14 +70,27 @@ G_DEFINE_BOXED_TYPE(InfTextChunk, inf_text_chunk, inf_text_chunk_copy, inf_text_
 
 typedef struct _InfTextChunkPath InfTextChunkPath;
 struct _InfTextChunkPath {
+  /* Returns the byte index of the character at offset in text, which is
+   * bytes bytes and length characters long. */
   gsize (*get_byte_index)(InfTextChunk* chunk,
                           gchar* text,
                           gsize bytes,
+                          guint length,
                           guint offset);
 };
 
-struct _InfTextChunk {
+/* The segments of a chunk are shared between copies of the chunk, and only
+ * duplicated when one of the copies is modified. Operations are copied on
+ * every transformation, and they all copy their chunk, so this avoids
+ * duplicating (possibly large) texts many times in the request log. */
+typedef struct _InfTextChunkStorage InfTextChunkStorage;
+struct _InfTextChunkStorage {
+  gint ref_count;
   GSequence* segments;
+};
+
+struct _InfTextChunk {
+  InfTextChunkStorage* storage;
   guint length; /* in characters */
   GQuark encoding;
 
@@ -81,66 +106,138 @@ struct _InfTextChunkSegment {
   gchar* text;
   gsize length; /* in bytes */
   guint offset; /* absolute to chunk begin in characters, sort criteria */
+  /* If not NULL, text points into the data of this, and is not owned by
+   * the segment. It must not be modified then. */
+  GBytes* mapping;
 };
 
+/* Text inserted with inf_text_chunk_insert_bytes() is split into segments
+ * of at most this many characters, so that modifying it only requires to
+ * copy a small part of it. */
+#define INF_TEXT_CHUNK_MAPPED_SEGMENT_LENGTH 16384
+
+/* Segments of at most this many bytes share a common allocation after
+ * inf_text_chunk_compact(). Larger segments keep their own one, so that
+ * modifying them does not copy more than necessary. */
+#define INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE 256
+
 /*
  * get_byte_index paths
  */
 
+/* Skips offset characters of UTF-8 text, which is bytes long. Instead of
+ * looking at every character, this counts the continuation bytes in blocks
+ * of eight bytes, which is considerably faster for long segments. */
+static const gchar*
+inf_text_chunk_utf8_skip(const gchar* text,
+                         gsize bytes,
+                         guint offset)
+{
+  const gchar* end;
+  guint64 block;
+  guint64 continuation;
+  guint n_characters;
+
+  end = text + bytes;
+
+  /* A block of eight bytes contains at most eight characters, so as long as
+   * at least eight characters are left to skip we cannot overshoot. */
+  while(offset >= 8)
+  {
+    memcpy(&block, text, 8);
+
+    /* Continuation bytes have the form 10xxxxxx. Shifting by one moves
+     * bit 6 of each byte into bit 7 of the same byte. */
+    continuation =
+      block & ~(block << 1) & G_GUINT64_CONSTANT(0x8080808080808080);
+    n_characters = 8 - (guint)(
+      ((continuation >> 7) * G_GUINT64_CONSTANT(0x0101010101010101)) >> 56
+    );
+
+    text += 8;
+    offset -= n_characters;
+
+    /* Skip the rest of a character which started in the block */
+    while(text < end && (*text & 0xc0) == 0x80)
+      ++text;
+  }
+
+  return g_utf8_offset_to_pointer(text, offset);
+}
+
 gsize inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
                                          gchar* text,
                                          gsize bytes,
+                                         guint length,
                                          guint offset)
 {
 #ifdef CHUNK_CHECK_INTEGRITY
-  g_assert(offset <= g_utf8_strlen(text, bytes));
+  g_assert(length == g_utf8_strlen(text, bytes));
+  g_assert(offset <= length);
 #endif
 
-  return g_utf8_offset_to_pointer(text, offset) - text;
+  /* Pure ASCII text, which is common for source code */
+  if(bytes == length)
+    return offset;
+
+  /* Walk backwards from the end if that is shorter */
+  if(offset > length / 2)
+  {
+    return g_utf8_offset_to_pointer(
+      text + bytes,
+      -(glong)(length - offset)
+    ) - text;
+  }
+
+  return inf_text_chunk_utf8_skip(text, bytes, offset) - text;
 }
 
 gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
                                           gchar* text,
                                           gsize bytes,
+                                          guint length,
                                           guint offset)
 {
-  /* We convert the segment's text into UCS-4, character by character.
-   * This assumes every UCS-4 character is 4 bytes in length */
-
-  /* This is quite inefficient, but a general-purpose solution. It looks like
-   * libicu has a function, UCharIteratorMove, which would allow us to move
-   * directly N characters ahead and get the new byte index.
-   * TODO: We could profile it, and if it brings a benefit, we could use it,
-   * maybe with an option to fall back to iconv at configure time */
+  /* We convert the segment's text into UCS-4, into an output buffer which
+   * has room for exactly the number of characters we want to skip, so that
+   * iconv stops right at the character we are looking for. This assumes
+   * every UCS-4 character is 4 bytes in length. Large offsets are handled
+   * in several steps, to keep the buffer on the stack. libicu would offer
+   * UCharIteratorMove for this, but it is not worth a dependency as long as
+   * all common encodings go through a specialized path. */
 
   GIConv cd;
-  gchar buffer[4];
+  gchar buffer[4 * 256];
 
   gchar* inbuf;
   gchar* outbuf;
   gsize inlen;
   gsize outlen;
   guint count;
-  gsize result;
 
-  cd = g_iconv_open("UCS-4", g_quark_to_string(self->encoding));
+  cd = _inf_text_iconv_open("UCS-4", g_quark_to_string(self->encoding));
   g_assert(cd != (GIConv)-1);
 
   inbuf = text;
   inlen = bytes;
 
-  for(count = 0; count < offset; ++count)
+  while(offset > 0)
   {
     g_assert(inlen > 0);
 
+    count = MIN(offset, sizeof(buffer) / 4);
     outbuf = buffer;
-    outlen = 4;
+    outlen = count * 4;
+
+    /* This stops with E2BIG once the output buffer is full, unless the
+     * input was used up at the same time. */
+    g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
+    g_assert(outlen == 0);
 
-    result = g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
-    g_assert(result == (size_t)(-1)); /* errno == E2BIG */
+    offset -= count;
   }
 
-  g_iconv_close(cd);
+  _inf_text_iconv_close("UCS-4", g_quark_to_string(self->encoding), cd);
   return bytes - inlen;
 }
 
@@ -159,10 +256,145 @@ const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
 static void
 inf_text_chunk_segment_free(InfTextChunkSegment* segment)
 {
-  g_free(segment->text);
+  if(segment->mapping != NULL)
+    g_bytes_unref(segment->mapping);
+  else
+    g_free(segment->text);
+
   g_slice_free(InfTextChunkSegment, segment);
 }
 
+/* Copies the text of a segment that refers to a mapping, so that it can be
+ * modified. This needs to be called before any modification of the text of
+ * a segment. */
+static void
+inf_text_chunk_segment_own(InfTextChunkSegment* segment)
+{
+  if(segment->mapping != NULL)
+  {
+    segment->text = g_memdup(segment->text, segment->length);
+    g_bytes_unref(segment->mapping);
+    segment->mapping = NULL;
+  }
+}
+
+/* Sets the text of dest to length bytes of the text of src, starting at
+ * index. If src refers to a mapping, then dest refers to it as well. */
+static void
+inf_text_chunk_segment_copy_text(InfTextChunkSegment* dest,
+                                 const InfTextChunkSegment* src,
+                                 gsize index,
+                                 gsize length)
+{
+  if(src->mapping != NULL)
+  {
+    dest->text = src->text + index;
+    dest->mapping = g_bytes_ref(src->mapping);
+  }
+  else
+  {
+    dest->text = g_memdup(src->text + index, length);
+    dest->mapping = NULL;
+  }
+}
+
+/* Appends the text of next to segment, if both are written by the same
+ * author, and returns whether it did. Text of large segments referring to a
+ * mapping is not copied. */
+static gboolean
+inf_text_chunk_segment_merge(InfTextChunkSegment* segment,
+                             const InfTextChunkSegment* next)
+{
+  if(segment->author != next->author)
+    return FALSE;
+
+  if(segment->mapping != NULL &&
+     segment->length > INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE)
+  {
+    return FALSE;
+  }
+
+  if(next->mapping != NULL &&
+     next->length > INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE)
+  {
+    return FALSE;
+  }
+
+  /* No need to copy anything if the two are adjacent in the same mapping
+   * anyway, but don't let the result grow so large that it would no longer
+   * be moved into a new arena by the next compaction. */
+  if(segment->mapping != NULL && segment->mapping == next->mapping &&
+     segment->text + segment->length == next->text &&
+     segment->length + next->length <= INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE)
+  {
+    segment->length += next->length;
+    return TRUE;
+  }
+
+  inf_text_chunk_segment_own(segment);
+  segment->text = g_realloc(segment->text, segment->length + next->length);
+  memcpy(segment->text + segment->length, next->text, next->length);
+  segment->length += next->length;
+  return TRUE;
+}
+
+static InfTextChunkStorage*
+inf_text_chunk_storage_new(void)
+{
+  InfTextChunkStorage* storage;
+
+  storage = g_slice_new(InfTextChunkStorage);
+  storage->ref_count = 1;
+  storage->segments = g_sequence_new(
+    (GDestroyNotify)inf_text_chunk_segment_free
+  );
+
+  return storage;
+}
+
+static void
+inf_text_chunk_storage_unref(InfTextChunkStorage* storage)
+{
+  if(g_atomic_int_dec_and_test(&storage->ref_count))
+  {
+    g_sequence_free(storage->segments);
+    g_slice_free(InfTextChunkStorage, storage);
+  }
+}
+
+/* Makes sure that the segments of self are not shared with another chunk,
+ * so that they can be modified. This needs to be called before any
+ * modification of the segments. */
+static void
+inf_text_chunk_make_writable(InfTextChunk* self)
+{
+  InfTextChunkStorage* storage;
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+
+  if(g_atomic_int_get(&self->storage->ref_count) == 1)
+    return;
+
+  storage = inf_text_chunk_storage_new();
+
+  for(iter = g_sequence_get_begin_iter(self->storage->segments);
+      iter != g_sequence_get_end_iter(self->storage->segments);
+      iter = g_sequence_iter_next(iter))
+  {
+    segment = g_sequence_get(iter);
+    new_segment = g_slice_new0(InfTextChunkSegment);
+    new_segment->author = segment->author;
+    inf_text_chunk_segment_copy_text(new_segment, segment, 0, segment->length);
+    new_segment->length = segment->length;
+    new_segment->offset = segment->offset;
+    g_sequence_append(storage->segments, new_segment);
+  }
+
+  inf_text_chunk_storage_unref(self->storage);
+  self->storage = storage;
+}
+
 static int
 inf_text_chunk_segment_cmp(gconstpointer first,
                            gconstpointer second,
@@ -217,10 +449,10 @@ inf_text_chunk_next_offset(InfTextChunk* self,
 {
   GSequenceIter* next_iter;
 
-  g_assert(iter != g_sequence_get_end_iter(self->segments));
+  g_assert(iter != g_sequence_get_end_iter(self->storage->segments));
   
   next_iter = g_sequence_iter_next(iter);
-  if(next_iter == g_sequence_get_end_iter(self->segments))
+  if(next_iter == g_sequence_get_end_iter(self->storage->segments))
     return self->length;
   else
     return ((InfTextChunkSegment*)g_sequence_get(next_iter))->offset;
@@ -237,8 +469,8 @@ inf_text_chunk_check_integrity(InfTextChunk* self)
 
   offset = 0;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
+  for(iter = g_sequence_get_begin_iter(self->storage->segments);
+      iter != g_sequence_get_end_iter(self->storage->segments);
       iter = g_sequence_iter_next(iter))
   {
     segment = (InfTextChunkSegment*)g_sequence_get(iter);
@@ -275,7 +507,7 @@ inf_text_chunk_get_segment(InfTextChunk* self,
 
   /* TODO: Verify this does binary search */
   iter = g_sequence_search(
-    self->segments,
+    self->storage->segments,
     &key,
     inf_text_chunk_segment_cmp_for_get_segment,
     NULL
@@ -283,7 +515,7 @@ inf_text_chunk_get_segment(InfTextChunk* self,
 
   if(self->length > 0)
   {
-    g_assert(iter != g_sequence_get_begin_iter(self->segments));
+    g_assert(iter != g_sequence_get_begin_iter(self->storage->segments));
 
     iter = g_sequence_iter_prev(iter);
     found = g_sequence_get(iter);
@@ -309,6 +541,7 @@ inf_text_chunk_get_segment(InfTextChunk* self,
           self,
           found->text,
           found->length,
+          inf_text_chunk_next_offset(self, iter) - found->offset,
           pos - found->offset
         );
       }
@@ -373,10 +606,7 @@ InfTextChunk*
 inf_text_chunk_new(const gchar* encoding)
 {
   InfTextChunk* chunk = g_slice_new(InfTextChunk);
-  
-  chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
+  chunk->storage = inf_text_chunk_storage_new();
 
   chunk->length = 0;
   chunk->encoding = g_quark_from_string(encoding);
@@ -393,7 +623,8 @@ inf_text_chunk_new(const gchar* encoding)
  * inf_text_chunk_copy:
  * @self: A #InfTextChunk.
  *
- * Returns a copy of @self.
+ * Returns a copy of @self. The text is not actually copied until either
+ * @self or the copy is modified, so this is a cheap operation.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -401,27 +632,12 @@ InfTextChunk*
 inf_text_chunk_copy(InfTextChunk* self)
 {
   InfTextChunk* new_chunk;
-  GSequenceIter* iter;
 
   g_return_val_if_fail(self != NULL, NULL);
 
   new_chunk = g_slice_new(InfTextChunk);
-  new_chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
-  
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    InfTextChunkSegment* segment = g_sequence_get(iter);
-    InfTextChunkSegment* new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(segment->text, segment->length);
-    new_segment->length = segment->length;
-    new_segment->offset = segment->offset;
-    g_sequence_append(new_chunk->segments, new_segment);
-  }
+  new_chunk->storage = self->storage;
+  g_atomic_int_inc(&self->storage->ref_count);
 
   new_chunk->length = self->length;
   new_chunk->encoding = self->encoding;
@@ -441,7 +657,7 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
+  inf_text_chunk_storage_unref(self->storage);
   g_slice_free(InfTextChunk, self);
 }
 
@@ -475,6 +691,38 @@ inf_text_chunk_get_length(InfTextChunk* self)
   return self->length;
 }
 
+/**
+ * inf_text_chunk_get_bytes:
+ * @self: A #InfTextChunk.
+ *
+ * Returns the number of bytes of text contained in @self, in the encoding
+ * of @self. Note that copies of a chunk share their text until one of them
+ * is modified, so this is an upper bound for the memory that @self uses on
+ * its own.
+ *
+ * Returns: The number of bytes of text in @self.
+ **/
+gsize
+inf_text_chunk_get_bytes(InfTextChunk* self)
+{
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  gsize bytes;
+
+  g_return_val_if_fail(self != NULL, 0);
+
+  bytes = 0;
+  for(iter = g_sequence_get_begin_iter(self->storage->segments);
+      iter != g_sequence_get_end_iter(self->storage->segments);
+      iter = g_sequence_iter_next(iter))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    bytes += segment->length;
+  }
+
+  return bytes;
+}
+
 /**
  * inf_text_chunk_substring:
  * @self: A #InfTextChunk.
@@ -504,6 +752,10 @@ inf_text_chunk_substring(InfTextChunk* self,
   g_return_val_if_fail(self != NULL, NULL);
   g_return_val_if_fail(begin + length <= self->length, NULL);
 
+  /* Share the segments if the whole chunk is requested */
+  if(begin == 0 && length == self->length)
+    return inf_text_chunk_copy(self);
+
   if(self->length > 0 && length > 0)
   {
     begin_iter = inf_text_chunk_get_segment(self, begin, &begin_index);
@@ -511,7 +763,7 @@ inf_text_chunk_substring(InfTextChunk* self,
 
     if(end_index == 0)
     {
-      g_assert(end_iter != g_sequence_get_end_iter(self->segments));
+      g_assert(end_iter != g_sequence_get_end_iter(self->storage->segments));
       end_iter = g_sequence_iter_prev(end_iter);
       end_index = ((InfTextChunkSegment*)g_sequence_get(end_iter))->length;
     }
@@ -523,14 +775,16 @@ inf_text_chunk_substring(InfTextChunk* self,
 
     while(begin_iter != end_iter)
     {
-      new_segment = g_slice_new(InfTextChunkSegment);
+      new_segment = g_slice_new0(InfTextChunkSegment);
       new_segment->author = segment->author;
 
-      new_segment->text = g_memdup(
-        segment->text + begin_index,
+      inf_text_chunk_segment_copy_text(
+        new_segment,
+        segment,
+        begin_index,
         segment->length - begin_index
       );
-      
+
       new_segment->length = segment->length - begin_index;
       new_segment->offset = current_length;
 
@@ -545,21 +799,23 @@ inf_text_chunk_substring(InfTextChunk* self,
       begin_index = 0;
     /*  begin = new_segment->offset;*/
       
-      g_sequence_append(result->segments, new_segment);
+      g_sequence_append(result->storage->segments, new_segment);
     }
 
     /* Don't forget last segment */
-    new_segment = g_slice_new(InfTextChunkSegment);
+    new_segment = g_slice_new0(InfTextChunkSegment);
     new_segment->author = segment->author;
-    new_segment->text = g_memdup(
-      segment->text + begin_index,
+    inf_text_chunk_segment_copy_text(
+      new_segment,
+      segment,
+      begin_index,
       end_index - begin_index
     );
-    
+
     new_segment->length = end_index - begin_index;
     new_segment->offset = current_length;
     
-    g_sequence_append(result->segments, new_segment);
+    g_sequence_append(result->storage->segments, new_segment);
 
     result->length = length;
     result->encoding = self->encoding;
@@ -609,6 +865,8 @@ inf_text_chunk_insert_text(InfTextChunk* self,
   g_return_if_fail(self != NULL);
   g_return_if_fail(offset <= self->length);
 
+  inf_text_chunk_make_writable(self);
+
   if(self->length > 0)
   {
     iter = inf_text_chunk_get_segment(self, offset, &offset_index);
@@ -618,7 +876,7 @@ inf_text_chunk_insert_text(InfTextChunk* self,
      * case we can perhaps append to the previous. */
     if(segment->author != author && offset > 0 && offset_index == 0)
     {
-      g_assert(iter != g_sequence_get_begin_iter(self->segments));
+      g_assert(iter != g_sequence_get_begin_iter(self->storage->segments));
 
       iter = g_sequence_iter_prev(iter);
       segment = (InfTextChunkSegment*)g_sequence_get(iter);
@@ -630,10 +888,12 @@ inf_text_chunk_insert_text(InfTextChunk* self,
       /* No luck, split if necessary */
       if(offset_index > 0 && offset_index < segment->length)
       {
-        new_segment = g_slice_new(InfTextChunkSegment);
+        new_segment = g_slice_new0(InfTextChunkSegment);
         new_segment->author = segment->author;
-        new_segment->text = g_memdup(
-          segment->text + offset_index,
+        inf_text_chunk_segment_copy_text(
+          new_segment,
+          segment,
+          offset_index,
           segment->length - offset_index
         );
 
@@ -653,7 +913,7 @@ inf_text_chunk_insert_text(InfTextChunk* self,
         iter = g_sequence_iter_next(iter);
       }
 
-      new_segment = g_slice_new(InfTextChunkSegment);
+      new_segment = g_slice_new0(InfTextChunkSegment);
       new_segment->author = author;
       new_segment->text = g_memdup(text, bytes);
       new_segment->length = bytes;
@@ -663,6 +923,7 @@ inf_text_chunk_insert_text(InfTextChunk* self,
     else
     {
       /* TODO: g_malloc + g_free + 2*memcpy? */
+      inf_text_chunk_segment_own(segment);
       segment->text = g_realloc(segment->text, segment->length + bytes);
       if(offset_index < segment->length)
       {
@@ -679,7 +940,7 @@ inf_text_chunk_insert_text(InfTextChunk* self,
     }
 
     /* Adjust offsets */
-    while(iter != g_sequence_get_end_iter(self->segments))
+    while(iter != g_sequence_get_end_iter(self->storage->segments))
     {
       segment = (InfTextChunkSegment*)g_sequence_get(iter);
       segment->offset += length;
@@ -690,13 +951,13 @@ inf_text_chunk_insert_text(InfTextChunk* self,
   }
   else
   {
-    new_segment = g_slice_new(InfTextChunkSegment);
+    new_segment = g_slice_new0(InfTextChunkSegment);
     new_segment->author = author;
     new_segment->text = g_memdup(text, bytes);
     new_segment->length = bytes;
     new_segment->offset = 0;
 
-    g_sequence_append(self->segments, new_segment);
+    g_sequence_append(self->storage->segments, new_segment);
     self->length = length;
   }
 
@@ -705,6 +966,144 @@ inf_text_chunk_insert_text(InfTextChunk* self,
 #endif
 }
 
+/**
+ * inf_text_chunk_insert_bytes:
+ * @self: A #InfTextChunk.
+ * @offset: Character offset at which to insert text.
+ * @bytes: The text to insert.
+ * @length: Number of characters contained in @bytes.
+ * @author: User that wrote the text.
+ *
+ * Inserts the text in @bytes, written by @author, into @self, like
+ * inf_text_chunk_insert_text(). The text is expected to be in the chunk's
+ * encoding. Instead of copying the text, @self keeps a reference to
+ * @bytes. Only the parts of the text that are modified afterwards are
+ * copied. This allows to keep large texts, for example from a file mapped
+ * with g_mapped_file_get_bytes(), without having them in memory twice.
+ *
+ * The text is never merged with adjacent text by the same author, and it
+ * is also not merged when the chunk is modified later, except for the
+ * part close to the modification. The data of @bytes must not change while
+ * it is in use by @self or one of its copies.
+ **/
+void
+inf_text_chunk_insert_bytes(InfTextChunk* self,
+                            guint offset,
+                            GBytes* bytes,
+                            guint length,
+                            guint author)
+{
+  GSequenceIter* iter;
+  gsize offset_index;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+
+  const gchar* text;
+  gsize n_bytes;
+  guint total_length;
+  guint current_offset;
+  guint segment_length;
+  gsize segment_bytes;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(offset <= self->length);
+  g_return_if_fail(bytes != NULL);
+
+  text = g_bytes_get_data(bytes, &n_bytes);
+  if(length == 0 || n_bytes == 0)
+    return;
+
+  inf_text_chunk_make_writable(self);
+
+  if(self->length > 0)
+  {
+    iter = inf_text_chunk_get_segment(self, offset, &offset_index);
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+
+    if(offset_index == segment->length)
+    {
+      /* Insert behind segment */
+      iter = g_sequence_iter_next(iter);
+    }
+    else if(offset_index > 0)
+    {
+      /* Split segment */
+      new_segment = g_slice_new0(InfTextChunkSegment);
+      new_segment->author = segment->author;
+      inf_text_chunk_segment_copy_text(
+        new_segment,
+        segment,
+        offset_index,
+        segment->length - offset_index
+      );
+
+      new_segment->length = segment->length - offset_index;
+      new_segment->offset = offset;
+
+      iter = g_sequence_iter_next(iter);
+      iter = g_sequence_insert_before(iter, new_segment);
+
+      /* Don't realloc to make smaller */
+      segment->length = offset_index;
+    }
+  }
+  else
+  {
+    iter = g_sequence_get_end_iter(self->storage->segments);
+  }
+
+  /* iter now points to the segment before which to insert the new text,
+   * which is also the first segment whose offset needs to be adjusted. */
+  total_length = length;
+  current_offset = offset;
+
+  while(length > 0)
+  {
+    segment_length = MIN(length, INF_TEXT_CHUNK_MAPPED_SEGMENT_LENGTH);
+    if(segment_length < length)
+    {
+      segment_bytes = self->path->get_byte_index(
+        self,
+        *(gchar**)(gpointer)&text, /* cast const away without warning */
+        n_bytes,
+        length,
+        segment_length
+      );
+    }
+    else
+    {
+      segment_bytes = n_bytes;
+    }
+
+    new_segment = g_slice_new0(InfTextChunkSegment);
+    new_segment->author = author;
+    new_segment->text = *(gchar**)(gpointer)&text;
+    new_segment->length = segment_bytes;
+    new_segment->offset = current_offset;
+    new_segment->mapping = g_bytes_ref(bytes);
+    g_sequence_insert_before(iter, new_segment);
+
+    text += segment_bytes;
+    n_bytes -= segment_bytes;
+    length -= segment_length;
+    current_offset += segment_length;
+  }
+
+  /* Adjust offsets */
+  while(iter != g_sequence_get_end_iter(self->storage->segments))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    segment->offset += total_length;
+    iter = g_sequence_iter_next(iter);
+  }
+
+  self->length += total_length;
+
+#ifdef CHUNK_CHECK_INTEGRITY
+  g_assert(inf_text_chunk_check_integrity(self) == TRUE);
+#endif
+}
+
 /**
  * inf_text_chunk_insert_chunk:
  * @self: A #InfTextChunk.
@@ -739,11 +1138,13 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
   g_return_if_fail(text != NULL);
   g_return_if_fail(self->encoding == text->encoding);
 
+  inf_text_chunk_make_writable(self);
+
   if(self->length > 0 && text->length > 0)
   {
-    if(g_sequence_get_length(text->segments) == 1)
+    if(g_sequence_get_length(text->storage->segments) == 1)
     {
-      segment = g_sequence_get(g_sequence_get_begin_iter(text->segments));
+      segment = g_sequence_get(g_sequence_get_begin_iter(text->storage->segments));
 
       inf_text_chunk_insert_text(
         self,
@@ -762,9 +1163,9 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
       /* First, we insert the first and last segment of text into self,
        * possibly merging with adjacent segments. Then, the rest is
        * copied. */
-      first_iter = g_sequence_get_begin_iter(text->segments);
+      first_iter = g_sequence_get_begin_iter(text->storage->segments);
       last_iter = g_sequence_iter_prev(
-        g_sequence_get_end_iter(text->segments)
+        g_sequence_get_end_iter(text->storage->segments)
       );
 
       first = (InfTextChunkSegment*)g_sequence_get(first_iter);
@@ -784,7 +1185,7 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
        * segments. */
       if(offset_index == 0 && offset > 0)
       {
-        g_assert(iter != g_sequence_get_begin_iter(self->segments));
+        g_assert(iter != g_sequence_get_begin_iter(self->storage->segments));
 
         iter = g_sequence_iter_prev(iter);
         first_merge = (InfTextChunkSegment*)g_sequence_get(iter);
@@ -797,6 +1198,7 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
         if(first_merge->author == first->author && offset > 0)
         {
           /* Can merge first segment */
+          inf_text_chunk_segment_own(first_merge);
           first_merge->length += first->length;
 
           first_merge->text = g_realloc(
@@ -817,6 +1219,7 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
         if(last_merge->author == last->author && offset < self->length)
         {
           /* Can merge last segment */
+          inf_text_chunk_segment_own(last_merge);
           last_merge->length += last->length;
           last_merge->text = g_realloc(last_merge->text, last_merge->length);
 
@@ -854,7 +1257,7 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
       {
         /* Insert within a segment, split segment */
 
-        new_segment = g_slice_new(InfTextChunkSegment);
+        new_segment = g_slice_new0(InfTextChunkSegment);
         new_segment->author = last_merge->author;
 
         if(last_merge->author == last->author)
@@ -878,11 +1281,11 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
         {
           /* Split up last part */
           new_segment->length = last_merge->length - offset_index;
-          new_segment->text = g_malloc(new_segment->length);
 
-          memcpy(
-            new_segment->text,
-            last_merge->text + offset_index,
+          inf_text_chunk_segment_copy_text(
+            new_segment,
+            last_merge,
+            offset_index,
             new_segment->length
           );
 
@@ -903,6 +1306,7 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
         if(first_merge->author == first->author)
         {
           /* Merge into first */
+          inf_text_chunk_segment_own(first_merge);
           if(first_merge->length < offset_index + first->length)
           {
             first_merge->text = g_realloc(
@@ -937,17 +1341,23 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
           text_iter = g_sequence_iter_next(text_iter))
       {
         segment = g_sequence_get(text_iter);
-        new_segment = g_slice_new(InfTextChunkSegment);
+        new_segment = g_slice_new0(InfTextChunkSegment);
 
         new_segment->author = segment->author;
-        new_segment->text = g_memdup(segment->text, segment->length);
+        inf_text_chunk_segment_copy_text(
+          new_segment,
+          segment,
+          0,
+          segment->length
+        );
+
         new_segment->length = segment->length;
         new_segment->offset = offset + segment->offset;
         g_sequence_insert_before(iter, new_segment);
       }
 
       for(iter = beyond;
-          iter != g_sequence_get_end_iter(self->segments);
+          iter != g_sequence_get_end_iter(self->storage->segments);
           iter = g_sequence_iter_next(iter))
       {
         segment = g_sequence_get(iter);
@@ -959,19 +1369,25 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
   }
   else
   {
-    for(text_iter = g_sequence_get_begin_iter(text->segments);
-        text_iter != g_sequence_get_end_iter(text->segments);
+    for(text_iter = g_sequence_get_begin_iter(text->storage->segments);
+        text_iter != g_sequence_get_end_iter(text->storage->segments);
         text_iter = g_sequence_iter_next(text_iter))
     {
       segment = (InfTextChunkSegment*)g_sequence_get(text_iter);
-      new_segment = g_slice_new(InfTextChunkSegment);
+      new_segment = g_slice_new0(InfTextChunkSegment);
 
       new_segment->author = segment->author;
-      new_segment->text = g_memdup(segment->text, segment->length);
+      inf_text_chunk_segment_copy_text(
+        new_segment,
+        segment,
+        0,
+        segment->length
+      );
+
       new_segment->length = segment->length;
       new_segment->offset = segment->offset;
 
-      g_sequence_append(self->segments, new_segment);
+      g_sequence_append(self->storage->segments, new_segment);
     }
 
     self->length += text->length;
@@ -1006,6 +1422,8 @@ inf_text_chunk_erase(InfTextChunk* self,
   g_return_if_fail(self != NULL);
   g_return_if_fail(begin + length <= self->length);
 
+  inf_text_chunk_make_writable(self);
+
   if(self->length > 0 && length > 0)
   {
     first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
@@ -1018,7 +1436,7 @@ inf_text_chunk_erase(InfTextChunk* self,
     {
       if(first_index == 0)
       {
-        g_assert(first_iter != g_sequence_get_end_iter(self->segments));
+        g_assert(first_iter != g_sequence_get_end_iter(self->storage->segments));
         first_iter = g_sequence_iter_prev(first_iter);
         first = (InfTextChunkSegment*)g_sequence_get(first_iter);
         first_index = first->length;
@@ -1030,6 +1448,7 @@ inf_text_chunk_erase(InfTextChunk* self,
         if(first == last)
         {
           /* Remove within a segment */
+          inf_text_chunk_segment_own(first);
           g_memmove(
             first->text + first_index,
             first->text + last_index,
@@ -1041,6 +1460,7 @@ inf_text_chunk_erase(InfTextChunk* self,
         }
         else
         {
+          inf_text_chunk_segment_own(first);
           if(first->length < first_index + last->length - last_index)
           {
             first->text = g_realloc(
@@ -1074,11 +1494,18 @@ inf_text_chunk_erase(InfTextChunk* self,
 
         if(last_index > 0)
         {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
+          if(last->mapping != NULL)
+          {
+            last->text += last_index;
+          }
+          else
+          {
+            g_memmove(
+              last->text,
+              last->text + last_index,
+              last->length - last_index
+            );
+          }
         }
 
         last->length -= last_index;
@@ -1097,7 +1524,7 @@ inf_text_chunk_erase(InfTextChunk* self,
       {
         /* Erase everything */
         last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
+        g_assert(last_iter == g_sequence_get_end_iter(self->storage->segments));
 
         beyond = last_iter;
       }
@@ -1108,11 +1535,18 @@ inf_text_chunk_erase(InfTextChunk* self,
         /* Erase from beginning */
         if(last_index > 0)
         {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
+          if(last->mapping != NULL)
+          {
+            last->text += last_index;
+          }
+          else
+          {
+            g_memmove(
+              last->text,
+              last->text + last_index,
+              last->length - last_index
+            );
+          }
 
           last->length -= last_index;
           last->offset = 0;
@@ -1143,7 +1577,7 @@ inf_text_chunk_erase(InfTextChunk* self,
         }
         
         last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
+        g_assert(last_iter == g_sequence_get_end_iter(self->storage->segments));
 
         beyond = last_iter;
       }
@@ -1157,7 +1591,7 @@ inf_text_chunk_erase(InfTextChunk* self,
 
     /* adjust offsets */
     for(first_iter = beyond;
-        first_iter != g_sequence_get_end_iter(self->segments);
+        first_iter != g_sequence_get_end_iter(self->storage->segments);
         first_iter = g_sequence_iter_next(first_iter))
     {
       first = (InfTextChunkSegment*)g_sequence_get(first_iter);
@@ -1172,6 +1606,103 @@ inf_text_chunk_erase(InfTextChunk* self,
 #endif
 }
 
+/**
+ * inf_text_chunk_compact:
+ * @self: A #InfTextChunk.
+ *
+ * Reduces the number of segments and allocations that make up @self,
+ * without changing its content. Neighbouring segments which are written by
+ * the same author are merged into one, and the text of segments that are
+ * only a few bytes long is moved into one allocation that these segments
+ * share.
+ *
+ * This makes copying and iterating over @self faster and reduces its memory
+ * overhead. When one of the small segments is modified, its text is copied
+ * again, and the shared allocation is only released when none of the
+ * segments refers to it anymore. Therefore, this is best called
+ * periodically on chunks that are modified a lot, or once after a chunk has
+ * been built up from many small pieces.
+ **/
+void
+inf_text_chunk_compact(InfTextChunk* self)
+{
+  GSequenceIter* iter;
+  GSequenceIter* next;
+  InfTextChunkSegment* segment;
+  gsize arena_size;
+  guint n_small;
+  gchar* arena_data;
+  GBytes* arena;
+  gsize pos;
+
+  g_return_if_fail(self != NULL);
+
+  inf_text_chunk_make_writable(self);
+
+  arena_size = 0;
+  n_small = 0;
+
+  iter = g_sequence_get_begin_iter(self->storage->segments);
+  while(!g_sequence_iter_is_end(iter))
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    next = g_sequence_iter_next(iter);
+
+    /* Merge as many of the following segments as possible, then look at
+     * where the merged segment goes. */
+    if(!g_sequence_iter_is_end(next) &&
+       inf_text_chunk_segment_merge(segment, g_sequence_get(next)))
+    {
+      g_sequence_remove(next);
+      continue;
+    }
+
+    if(segment->length <= INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE)
+    {
+      arena_size += segment->length;
+      ++n_small;
+    }
+
+    iter = next;
+  }
+
+  /* Segments in an arena from a previous compaction are moved into the new
+   * one as well, so that the previous arena is released. */
+  if(n_small >= 2)
+  {
+    arena_data = g_malloc(arena_size);
+    arena = g_bytes_new_take(arena_data, arena_size);
+    pos = 0;
+
+    for(iter = g_sequence_get_begin_iter(self->storage->segments);
+        !g_sequence_iter_is_end(iter);
+        iter = g_sequence_iter_next(iter))
+    {
+      segment = (InfTextChunkSegment*)g_sequence_get(iter);
+      if(segment->length <= INF_TEXT_CHUNK_ARENA_SEGMENT_SIZE)
+      {
+        memcpy(arena_data + pos, segment->text, segment->length);
+
+        if(segment->mapping != NULL)
+          g_bytes_unref(segment->mapping);
+        else
+          g_free(segment->text);
+
+        segment->text = arena_data + pos;
+        segment->mapping = g_bytes_ref(arena);
+        pos += segment->length;
+      }
+    }
+
+    g_assert(pos == arena_size);
+    g_bytes_unref(arena);
+  }
+
+#ifdef CHUNK_CHECK_INTEGRITY
+  g_assert(inf_text_chunk_check_integrity(self) == TRUE);
+#endif
+}
+
 /**
  * inf_text_chunk_get_text:
  * @self: A #InfTextChunk.
@@ -1198,8 +1729,8 @@ inf_text_chunk_get_text(InfTextChunk* self,
   bytes = 0;
 
   /* First pass, determine size */
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
+  for(iter = g_sequence_get_begin_iter(self->storage->segments);
+      iter != g_sequence_get_end_iter(self->storage->segments);
       iter = g_sequence_iter_next(iter))
   {
     segment = (InfTextChunkSegment*)g_sequence_get(iter);
@@ -1210,8 +1741,8 @@ inf_text_chunk_get_text(InfTextChunk* self,
   result = g_malloc(bytes);
   cur = 0;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
+  for(iter = g_sequence_get_begin_iter(self->storage->segments);
+      iter != g_sequence_get_end_iter(self->storage->segments);
       iter = g_sequence_iter_next(iter))
   {
     segment = (InfTextChunkSegment*)g_sequence_get(iter);
@@ -1223,13 +1754,104 @@ inf_text_chunk_get_text(InfTextChunk* self,
   return result;
 }
 
+/**
+ * inf_text_chunk_view:
+ * @self: A #InfTextChunk.
+ * @begin: A character offset into @self.
+ * @length: The number of characters to look at.
+ * @func: (scope call): The function to call for each segment.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Calls @func for each segment of @self that overlaps the range of @length
+ * characters starting at @begin, in order. For the segments at the borders
+ * of the range, only the part inside the range is passed. In contrast to
+ * inf_text_chunk_substring() and inf_text_chunk_get_text(), the text is not
+ * copied but @func gets to see the text stored in @self.
+ *
+ * Returns: %FALSE if @func stopped the iteration, or %TRUE otherwise.
+ **/
+gboolean
+inf_text_chunk_view(InfTextChunk* self,
+                    guint begin,
+                    guint length,
+                    InfTextChunkViewFunc func,
+                    gpointer user_data)
+{
+  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
+  gsize begin_index;
+  gsize end_index;
+  guint segment_begin;
+  guint next_offset;
+  guint end;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(begin + length <= self->length, FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+
+  if(length == 0)
+    return TRUE;
+
+  end = begin + length;
+  iter = inf_text_chunk_get_segment(self, begin, &begin_index);
+  segment_begin = begin;
+
+  for(;;)
+  {
+    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+    next_offset = inf_text_chunk_next_offset(self, iter);
+
+    if(next_offset >= end)
+      break;
+
+    if(!func(segment->text + begin_index,
+             segment->length - begin_index,
+             next_offset - segment_begin,
+             segment->author,
+             user_data))
+    {
+      return FALSE;
+    }
+
+    iter = g_sequence_iter_next(iter);
+    begin_index = 0;
+    segment_begin = next_offset;
+  }
+
+  /* Last segment, which might end behind the range */
+  if(next_offset == end)
+  {
+    end_index = segment->length;
+  }
+  else
+  {
+    end_index = self->path->get_byte_index(
+      self,
+      segment->text,
+      segment->length,
+      next_offset - segment->offset,
+      end - segment->offset
+    );
+  }
+
+  return func(
+    segment->text + begin_index,
+    end_index - begin_index,
+    end - segment_begin,
+    segment->author,
+    user_data
+  );
+}
+
 /**
  * inf_text_chunk_equal:
  * @self: A #InfTextChunk.
  * @other: Another #InfTextChunk.
  *
  * Returns whether the two text chunks contain the same text and the same
- * segments were written by the same authors.
+ * segments were written by the same authors. How the text is split into
+ * segments internally, for example whether it has been compacted with
+ * inf_text_chunk_compact(), does not matter.
  *
  * Returns: Whether the two chunks are equal.
  **/
@@ -1241,32 +1863,57 @@ inf_text_chunk_equal(InfTextChunk* self,
   GSequenceIter* iter2;
   InfTextChunkSegment* segment1;
   InfTextChunkSegment* segment2;
+  gsize index1;
+  gsize index2;
+  gsize length;
 
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(other != NULL, FALSE);
   g_return_val_if_fail(self->encoding == other->encoding, FALSE);
 
-  iter1 = g_sequence_get_begin_iter(self->segments);
-  iter2 = g_sequence_get_begin_iter(other->segments);
+  /* Copies of each other, and neither of them has been modified since */
+  if(self->storage == other->storage)
+    return TRUE;
 
-  while(iter1 != g_sequence_get_end_iter(self->segments) &&
-        iter2 != g_sequence_get_end_iter(other->segments))
+  if(self->length != other->length)
+    return FALSE;
+
+  iter1 = g_sequence_get_begin_iter(self->storage->segments);
+  iter2 = g_sequence_get_begin_iter(other->storage->segments);
+  index1 = 0;
+  index2 = 0;
+
+  /* Compare byte ranges in which neither of the chunks changes segments, so
+   * that it does not matter where segments written by the same author are
+   * split. */
+  while(iter1 != g_sequence_get_end_iter(self->storage->segments) &&
+        iter2 != g_sequence_get_end_iter(other->storage->segments))
   {
     segment1 = (InfTextChunkSegment*)g_sequence_get(iter1);
     segment2 = (InfTextChunkSegment*)g_sequence_get(iter2);
 
-    if(segment1->length != segment2->length)
+    length = MIN(segment1->length - index1, segment2->length - index2);
+    if(memcmp(segment1->text + index1, segment2->text + index2, length) != 0)
       return FALSE;
 
-    if(memcmp(segment1->text, segment2->text, segment1->length) != 0)
-      return FALSE;
+    index1 += length;
+    index2 += length;
 
-    iter1 = g_sequence_iter_next(iter1);
-    iter2 = g_sequence_iter_next(iter2);
+    if(index1 == segment1->length)
+    {
+      iter1 = g_sequence_iter_next(iter1);
+      index1 = 0;
+    }
+
+    if(index2 == segment2->length)
+    {
+      iter2 = g_sequence_iter_next(iter2);
+      index2 = 0;
+    }
   }
 
-  if(iter1 != g_sequence_get_end_iter(self->segments) ||
-     iter2 != g_sequence_get_end_iter(other->segments))
+  if(iter1 != g_sequence_get_end_iter(self->storage->segments) ||
+     iter2 != g_sequence_get_end_iter(other->storage->segments))
   {
     return FALSE;
   }
@@ -1295,7 +1942,7 @@ inf_text_chunk_iter_init_begin(InfTextChunk* self,
   if(self->length > 0)
   {
     iter->chunk = self;
-    iter->first = g_sequence_get_begin_iter(self->segments);
+    iter->first = g_sequence_get_begin_iter(self->storage->segments);
     iter->second = g_sequence_iter_next(iter->first);
     return TRUE;
   }
@@ -1326,7 +1973,7 @@ inf_text_chunk_iter_init_end(InfTextChunk* self,
   if(self->length > 0)
   {
     iter->chunk = self;
-    iter->second = g_sequence_get_end_iter(self->segments);
+    iter->second = g_sequence_get_end_iter(self->storage->segments);
     iter->first = g_sequence_iter_prev(iter->second);
     return TRUE;
   }
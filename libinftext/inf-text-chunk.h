@@ -56,6 +56,29 @@ struct _InfTextChunkIter {
   GSequenceIter* second;
 };
 
+/**
+ * InfTextChunkViewFunc:
+ * @text: (array length=bytes) (element-type guint8): The text of the
+ * segment, or the part of it that lies in the requested range.
+ * @bytes: The number of bytes of @text.
+ * @length: The number of characters of @text.
+ * @author: The ID of the user who wrote @text.
+ * @user_data: User data passed to inf_text_chunk_view() or
+ * inf_text_buffer_view().
+ *
+ * This is the prototype of the callback function for inf_text_chunk_view()
+ * and inf_text_buffer_view(). @text is not zero-terminated, it is owned by
+ * the chunk or buffer and must not be used after the callback returned.
+ * The chunk or buffer must not be modified from within the callback.
+ *
+ * Returns: %TRUE to continue with the next segment, or %FALSE to stop.
+ */
+typedef gboolean(*InfTextChunkViewFunc)(gconstpointer text,
+                                        gsize bytes,
+                                        guint length,
+                                        guint author,
+                                        gpointer user_data);
+
 GType
 inf_text_chunk_iter_get_type(void) G_GNUC_CONST;
 
@@ -83,6 +106,9 @@ inf_text_chunk_get_encoding(InfTextChunk* self);
 guint
 inf_text_chunk_get_length(InfTextChunk* self);
 
+gsize
+inf_text_chunk_get_bytes(InfTextChunk* self);
+
 InfTextChunk*
 inf_text_chunk_substring(InfTextChunk* self,
                          guint begin,
@@ -96,6 +122,13 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author);
 
+void
+inf_text_chunk_insert_bytes(InfTextChunk* self,
+                            guint offset,
+                            GBytes* bytes,
+                            guint length,
+                            guint author);
+
 void
 inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
@@ -106,10 +139,20 @@ inf_text_chunk_erase(InfTextChunk* self,
                      guint begin,
                      guint length);
 
+void
+inf_text_chunk_compact(InfTextChunk* self);
+
 gpointer
 inf_text_chunk_get_text(InfTextChunk* self,
                         gsize* length);
 
+gboolean
+inf_text_chunk_view(InfTextChunk* self,
+                    guint begin,
+                    guint length,
+                    InfTextChunkViewFunc func,
+                    gpointer user_data);
+
 gboolean
 inf_text_chunk_equal(InfTextChunk* self,
                      InfTextChunk* other);
@@ -31,8 +31,14 @@ struct _InfTextDefaultBufferPrivate {
   gchar* encoding;
   InfTextChunk* chunk;
   gboolean modified;
+  guint n_changes;
 };
 
+/* The text chunk is compacted every time this many changes have been made
+ * to the buffer, so that a document edited by many users at the same time
+ * does not fall apart into a large number of tiny segments. */
+#define INF_TEXT_DEFAULT_BUFFER_COMPACT_INTERVAL 4096
+
 enum {
   PROP_0,
 
@@ -51,6 +57,19 @@ G_DEFINE_TYPE_WITH_CODE(InfTextDefaultBuffer, inf_text_default_buffer, G_TYPE_OB
   G_IMPLEMENT_INTERFACE(INF_TYPE_BUFFER, inf_text_default_buffer_buffer_iface_init)
   G_IMPLEMENT_INTERFACE(INF_TEXT_TYPE_BUFFER, inf_text_default_buffer_text_buffer_iface_init))
 
+static void
+inf_text_default_buffer_changed(InfTextDefaultBuffer* buffer)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+
+  if(++priv->n_changes == INF_TEXT_DEFAULT_BUFFER_COMPACT_INTERVAL)
+  {
+    inf_text_chunk_compact(priv->chunk);
+    priv->n_changes = 0;
+  }
+}
+
 static void
 inf_text_default_buffer_init(InfTextDefaultBuffer* buffer)
 {
@@ -60,6 +79,7 @@ inf_text_default_buffer_init(InfTextDefaultBuffer* buffer)
   priv->encoding = NULL;
   priv->chunk = NULL;
   priv->modified = FALSE;
+  priv->n_changes = 0;
 }
 
 static void
@@ -157,6 +177,15 @@ inf_text_default_buffer_buffer_set_modified(InfBuffer* buffer,
   }
 }
 
+static gsize
+inf_text_default_buffer_buffer_get_size(InfBuffer* buffer)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+
+  return inf_text_chunk_get_bytes(priv->chunk);
+}
+
 static const gchar*
 inf_text_default_buffer_buffer_get_encoding(InfTextBuffer* buffer)
 {
@@ -181,6 +210,18 @@ inf_text_default_buffer_buffer_get_slice(InfTextBuffer* buffer,
   return inf_text_chunk_substring(priv->chunk, pos, len);
 }
 
+static gboolean
+inf_text_default_buffer_buffer_view(InfTextBuffer* buffer,
+                                    guint pos,
+                                    guint len,
+                                    InfTextChunkViewFunc func,
+                                    gpointer user_data)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+  return inf_text_chunk_view(priv->chunk, pos, len, func, user_data);
+}
+
 static void
 inf_text_default_buffer_buffer_insert_text(InfTextBuffer* buffer,
                                            guint pos,
@@ -191,6 +232,7 @@ inf_text_default_buffer_buffer_insert_text(InfTextBuffer* buffer,
   priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
 
   inf_text_chunk_insert_chunk(priv->chunk, pos, chunk);
+  inf_text_default_buffer_changed(INF_TEXT_DEFAULT_BUFFER(buffer));
 
   inf_text_buffer_text_inserted(buffer, pos, chunk, user);
 
@@ -214,6 +256,7 @@ inf_text_default_buffer_buffer_erase_text(InfTextBuffer* buffer,
 
   chunk = inf_text_chunk_substring(priv->chunk, pos, len);
   inf_text_chunk_erase(priv->chunk, pos, len);
+  inf_text_default_buffer_changed(INF_TEXT_DEFAULT_BUFFER(buffer));
 
   inf_text_buffer_text_erased(buffer, pos, chunk, user);
   inf_text_chunk_free(chunk);
@@ -355,6 +398,7 @@ inf_text_default_buffer_buffer_iface_init(InfBufferInterface* iface)
 {
   iface->get_modified = inf_text_default_buffer_buffer_get_modified;
   iface->set_modified = inf_text_default_buffer_buffer_set_modified;
+  iface->get_size = inf_text_default_buffer_buffer_get_size;
 }
 
 static void
@@ -363,6 +407,7 @@ inf_text_default_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->get_encoding = inf_text_default_buffer_buffer_get_encoding;
   iface->get_length = inf_text_default_buffer_get_length;
   iface->get_slice = inf_text_default_buffer_buffer_get_slice;
+  iface->view = inf_text_default_buffer_buffer_view;
   iface->insert_text = inf_text_default_buffer_buffer_insert_text;
   iface->erase_text = inf_text_default_buffer_buffer_erase_text;
   iface->create_begin_iter = inf_text_default_buffer_buffer_create_begin_iter;
@@ -22,6 +22,7 @@
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-operations-private.h>
 
 #include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
@@ -173,6 +174,25 @@ inf_text_default_delete_operation_get_property(GObject* object,
   }
 }
 
+/* Creates a new operation without setting the construct properties via
+ * g_object_new(), which is comparatively expensive for an object that is
+ * created for every transformation. Takes ownership of chunk. */
+static InfTextDefaultDeleteOperation*
+inf_text_default_delete_operation_new_internal(guint position,
+                                               InfTextChunk* chunk)
+{
+  GObject* object;
+  InfTextDefaultDeleteOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION, NULL);
+  priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return INF_TEXT_DEFAULT_DELETE_OPERATION(object);
+}
+
 static gboolean
 inf_text_default_delete_operation_need_concurrency_id(
   InfAdoptedOperation* operation,
@@ -195,25 +215,14 @@ inf_text_default_delete_operation_transform(InfAdoptedOperation* operation,
 {
   g_assert(INF_TEXT_IS_DEFAULT_DELETE_OPERATION(operation));
 
-  if(INF_TEXT_IS_INSERT_OPERATION(against))
-  {
-    return inf_text_delete_operation_transform_insert(
-      INF_TEXT_DELETE_OPERATION(operation),
-      INF_TEXT_INSERT_OPERATION(against)
-    );
-  }
-  else if(INF_TEXT_IS_DELETE_OPERATION(against))
-  {
-    return inf_text_delete_operation_transform_delete(
-      INF_TEXT_DELETE_OPERATION(operation),
-      INF_TEXT_DELETE_OPERATION(against)
-    );
-  }
-  else
-  {
-    g_assert_not_reached();
-    return NULL;
-  }
+  return _inf_text_operations_transform(
+    operation,
+    INF_TEXT_OPERATION_KIND_DELETE,
+    against,
+    op_lcs,
+    against_lcs,
+    cid
+  );
 }
 
 static InfAdoptedOperation*
@@ -223,11 +232,9 @@ inf_text_default_delete_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_delete_operation_new_internal(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -300,6 +307,27 @@ inf_text_default_delete_operation_revert(InfAdoptedOperation* operation)
   );
 }
 
+static gsize
+inf_text_default_delete_operation_get_size(InfAdoptedOperation* operation)
+{
+  return inf_text_chunk_get_bytes(
+    INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation)->chunk
+  );
+}
+
+static gboolean
+inf_text_default_delete_operation_get_range(InfAdoptedOperation* operation,
+                                            guint* begin,
+                                            guint* end)
+{
+  InfTextDefaultDeleteOperationPrivate* priv;
+  priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
+
+  *begin = priv->position;
+  *end = priv->position + inf_text_chunk_get_length(priv->chunk);
+  return TRUE;
+}
+
 static guint
 inf_text_default_delete_operation_get_position(
   InfTextDeleteOperation* operation)
@@ -325,11 +353,9 @@ inf_text_default_delete_operation_transform_position(
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
   return INF_TEXT_DELETE_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-      "position", position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_delete_operation_new_internal(
+      position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -345,21 +371,14 @@ inf_text_default_delete_operation_transform_overlap(
 {
   InfTextDefaultDeleteOperationPrivate* priv;
   InfTextChunk* chunk;
-  GObject* result;
 
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
   chunk = inf_text_chunk_copy(priv->chunk);
   inf_text_chunk_erase(chunk, begin, length);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  return INF_TEXT_DELETE_OPERATION(
+    inf_text_default_delete_operation_new_internal(position, chunk)
   );
-
-  inf_text_chunk_free(chunk);
-  return INF_TEXT_DELETE_OPERATION(result);
 }
 
 static InfAdoptedSplitOperation*
@@ -369,38 +388,26 @@ inf_text_default_delete_operation_transform_split(
   guint split_len)
 {
   InfTextDefaultDeleteOperationPrivate* priv;
-  InfTextChunk* first_chunk;
-  InfTextChunk* second_chunk;
-  GObject* first;
-  GObject* second;
+  InfTextDefaultDeleteOperation* first;
+  InfTextDefaultDeleteOperation* second;
   InfAdoptedSplitOperation* result;
 
   priv = INF_TEXT_DEFAULT_DELETE_OPERATION_PRIVATE(operation);
 
-  first_chunk = inf_text_chunk_substring(priv->chunk, 0, split_pos);
-  second_chunk = inf_text_chunk_substring(
-    priv->chunk,
-    split_pos,
-    inf_text_chunk_get_length(priv->chunk) - split_pos
-  );
-
-  first = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position,
-    "chunk", first_chunk,
-    NULL
+  first = inf_text_default_delete_operation_new_internal(
+    priv->position,
+    inf_text_chunk_substring(priv->chunk, 0, split_pos)
   );
 
-  second = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", priv->position + split_len,
-    "chunk", second_chunk,
-    NULL
+  second = inf_text_default_delete_operation_new_internal(
+    priv->position + split_len,
+    inf_text_chunk_substring(
+      priv->chunk,
+      split_pos,
+      inf_text_chunk_get_length(priv->chunk) - split_pos
+    )
   );
 
-  inf_text_chunk_free(first_chunk);
-  inf_text_chunk_free(second_chunk);
-
   result = inf_adopted_split_operation_new(
     INF_ADOPTED_OPERATION(first),
     INF_ADOPTED_OPERATION(second)
@@ -461,6 +468,8 @@ inf_text_default_delete_operation_operation_iface_init(
   iface->apply = inf_text_default_delete_operation_apply;
   iface->apply_transformed = NULL;
   iface->revert = inf_text_default_delete_operation_revert;
+  iface->get_size = inf_text_default_delete_operation_get_size;
+  iface->get_range = inf_text_default_delete_operation_get_range;
 }
 
 static void
@@ -492,18 +501,12 @@ InfTextDefaultDeleteOperation*
 inf_text_default_delete_operation_new(guint position,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION,
-    "position", position,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_delete_operation_new_internal(
+    position,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_DELETE_OPERATION(object);
 }
 
 /**
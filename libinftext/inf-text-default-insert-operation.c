@@ -22,6 +22,7 @@
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-operations-private.h>
 
 #include <libinfinity/adopted/inf-adopted-operation.h>
 #include <libinfinity/inf-i18n.h>
@@ -127,6 +128,25 @@ inf_text_default_insert_operation_get_property(GObject* object,
   }
 }
 
+/* Creates a new operation without setting the construct properties via
+ * g_object_new(), which is comparatively expensive for an object that is
+ * created for every transformation. Takes ownership of chunk. */
+static InfTextDefaultInsertOperation*
+inf_text_default_insert_operation_new_internal(guint position,
+                                               InfTextChunk* chunk)
+{
+  GObject* object;
+  InfTextDefaultInsertOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, NULL);
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
+}
+
 static gboolean
 inf_text_default_insert_operation_need_concurrency_id(
   InfAdoptedOperation* operation,
@@ -149,33 +169,14 @@ inf_text_default_insert_operation_transform(InfAdoptedOperation* operation,
 {
   g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation));
 
-  if(INF_TEXT_IS_INSERT_OPERATION(against))
-  {
-    g_assert(op_lcs == NULL ||
-             INF_TEXT_IS_INSERT_OPERATION(op_lcs));
-    g_assert(against_lcs == NULL ||
-             INF_TEXT_IS_INSERT_OPERATION(against_lcs));
-
-    return inf_text_insert_operation_transform_insert(
-      INF_TEXT_INSERT_OPERATION(operation),
-      INF_TEXT_INSERT_OPERATION(against),
-      INF_TEXT_INSERT_OPERATION(op_lcs),
-      INF_TEXT_INSERT_OPERATION(against_lcs),
-      cid
-    );
-  }
-  else if(INF_TEXT_IS_DELETE_OPERATION(against))
-  {
-    return inf_text_insert_operation_transform_delete(
-      INF_TEXT_INSERT_OPERATION(operation),
-      INF_TEXT_DELETE_OPERATION(against)
-    );
-  }
-  else
-  {
-    g_assert_not_reached();
-    return NULL;
-  }
+  return _inf_text_operations_transform(
+    operation,
+    INF_TEXT_OPERATION_KIND_INSERT,
+    against,
+    op_lcs,
+    against_lcs,
+    cid
+  );
 }
 
 static InfAdoptedOperation*
@@ -185,11 +186,9 @@ inf_text_default_insert_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_insert_operation_new_internal(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -249,6 +248,28 @@ inf_text_default_insert_operation_revert(InfAdoptedOperation* operation)
   );
 }
 
+static gsize
+inf_text_default_insert_operation_get_size(InfAdoptedOperation* operation)
+{
+  return inf_text_chunk_get_bytes(
+    INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation)->chunk
+  );
+}
+
+static gboolean
+inf_text_default_insert_operation_get_range(InfAdoptedOperation* operation,
+                                            guint* begin,
+                                            guint* end)
+{
+  InfTextDefaultInsertOperationPrivate* priv;
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
+
+  /* Text after the insertion position is only shifted */
+  *begin = priv->position;
+  *end = priv->position;
+  return TRUE;
+}
+
 static guint
 inf_text_default_insert_operation_get_position(InfTextInsertOperation* op)
 {
@@ -270,18 +291,14 @@ inf_text_default_insert_operation_transform_position(
   guint position)
 {
   InfTextDefaultInsertOperationPrivate* priv;
-  GObject* result;
-
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", position,
-    "chunk", priv->chunk,
-    NULL
+  return INF_TEXT_INSERT_OPERATION(
+    inf_text_default_insert_operation_new_internal(
+      position,
+      inf_text_chunk_copy(priv->chunk)
+    )
   );
-
-  return INF_TEXT_INSERT_OPERATION(result);
 }
 
 static void
@@ -336,6 +353,8 @@ inf_text_default_insert_operation_operation_iface_init(
   iface->apply = inf_text_default_insert_operation_apply;
   iface->apply_transformed = NULL;
   iface->revert = inf_text_default_insert_operation_revert;
+  iface->get_size = inf_text_default_insert_operation_get_size;
+  iface->get_range = inf_text_default_insert_operation_get_range;
 }
 
 static void
@@ -362,18 +381,12 @@ InfTextDefaultInsertOperation*
 inf_text_default_insert_operation_new(guint pos,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", pos,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_insert_operation_new_internal(
+    pos,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
 }
 
 /**
@@ -39,6 +39,7 @@
 
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
+#include <libinftext/inf-text-operations-private.h>
 
 G_DEFINE_INTERFACE(InfTextDeleteOperation, inf_text_delete_operation, INF_ADOPTED_TYPE_OPERATION)
 
@@ -110,37 +111,26 @@ inf_text_delete_operation_need_concurrency_id(InfTextDeleteOperation* op,
   return FALSE;
 }
 
-/**
- * inf_text_delete_operation_transform_insert:
- * @operation: A #InfTextDeleteOperation.
- * @against: A #InfTextInsertOperation.
- *
- * Returns a new operation that includes the effect of @against into
- * @operation.
- *
- * Returns: (transfer full): A new #InfAdoptedOperation.
- **/
+/* Like inf_text_delete_operation_transform_insert(), but without checking the
+ * arguments, which the caller has made sure of. */
 InfAdoptedOperation*
-inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
-                                           InfTextInsertOperation* against)
+_inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
+                                            InfTextInsertOperation* against)
 {
   InfTextDeleteOperationInterface* iface;
+  InfTextInsertOperationInterface* against_iface;
   guint own_pos;
   guint own_len;
   guint other_pos;
   guint other_len;
 
-  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(operation), NULL);
-  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(against), NULL);
-
   iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(operation);
-  g_return_val_if_fail(iface->transform_position != NULL, NULL);
-  g_return_val_if_fail(iface->transform_split != NULL, NULL);
+  against_iface = INF_TEXT_INSERT_OPERATION_GET_IFACE(against);
 
-  own_pos = inf_text_delete_operation_get_position(operation);
-  own_len = inf_text_delete_operation_get_length(operation);
-  other_pos = inf_text_insert_operation_get_position(against);
-  other_len = inf_text_insert_operation_get_length(against);
+  own_pos = iface->get_position(operation);
+  own_len = iface->get_length(operation);
+  other_pos = against_iface->get_position(against);
+  other_len = against_iface->get_length(against);
 
   if(other_pos >= own_pos + own_len)
   {
@@ -161,9 +151,9 @@ inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
 }
 
 /**
- * inf_text_delete_operation_transform_delete:
+ * inf_text_delete_operation_transform_insert:
  * @operation: A #InfTextDeleteOperation.
- * @against: Another #InfTextDeleteOperation.
+ * @against: A #InfTextInsertOperation.
  *
  * Returns a new operation that includes the effect of @against into
  * @operation.
@@ -171,26 +161,41 @@ inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
  * Returns: (transfer full): A new #InfAdoptedOperation.
  **/
 InfAdoptedOperation*
-inf_text_delete_operation_transform_delete(InfTextDeleteOperation* operation,
-                                           InfTextDeleteOperation* against)
+inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
+                                           InfTextInsertOperation* against)
+{
+  InfTextDeleteOperationInterface* iface;
+
+  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(operation), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(against), NULL);
+
+  iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(operation);
+  g_return_val_if_fail(iface->transform_position != NULL, NULL);
+  g_return_val_if_fail(iface->transform_split != NULL, NULL);
+
+  return _inf_text_delete_operation_transform_insert(operation, against);
+}
+
+/* Like inf_text_delete_operation_transform_delete(), but without checking the
+ * arguments, which the caller has made sure of. */
+InfAdoptedOperation*
+_inf_text_delete_operation_transform_delete(InfTextDeleteOperation* operation,
+                                            InfTextDeleteOperation* against)
 {
   InfTextDeleteOperationInterface* iface;
+  InfTextDeleteOperationInterface* against_iface;
   guint own_pos;
   guint own_len;
   guint other_pos;
   guint other_len;
 
-  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(operation), NULL);
-  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(against), NULL);
-
   iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(operation);
-  g_return_val_if_fail(iface->transform_position != NULL, NULL);
-  g_return_val_if_fail(iface->transform_overlap != NULL, NULL);
+  against_iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(against);
 
-  own_pos = inf_text_delete_operation_get_position(operation);
-  own_len = inf_text_delete_operation_get_length(operation);
-  other_pos = inf_text_delete_operation_get_position(against);
-  other_len = inf_text_delete_operation_get_length(against);
+  own_pos = iface->get_position(operation);
+  own_len = iface->get_length(operation);
+  other_pos = against_iface->get_position(against);
+  other_len = against_iface->get_length(against);
 
   if(own_pos + own_len <= other_pos)
   {
@@ -257,4 +262,30 @@ inf_text_delete_operation_transform_delete(InfTextDeleteOperation* operation,
   }
 }
 
+/**
+ * inf_text_delete_operation_transform_delete:
+ * @operation: A #InfTextDeleteOperation.
+ * @against: Another #InfTextDeleteOperation.
+ *
+ * Returns a new operation that includes the effect of @against into
+ * @operation.
+ *
+ * Returns: (transfer full): A new #InfAdoptedOperation.
+ **/
+InfAdoptedOperation*
+inf_text_delete_operation_transform_delete(InfTextDeleteOperation* operation,
+                                           InfTextDeleteOperation* against)
+{
+  InfTextDeleteOperationInterface* iface;
+
+  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(operation), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(against), NULL);
+
+  iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(operation);
+  g_return_val_if_fail(iface->transform_position != NULL, NULL);
+  g_return_val_if_fail(iface->transform_overlap != NULL, NULL);
+
+  return _inf_text_delete_operation_transform_delete(operation, against);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -29,20 +29,70 @@
  * The functions in this section are utility functions that can be used when
  * implementing a #InfdNotePlugin to handle #InfTextSession<!-- -->s. These
  * functions implement reading and writing the content of an #InfTextSession
- * to an XML file in the storage.
+ * to an XML file in the storage. Alternatively, documents can be written in
+ * a compact binary format with inf_text_filesystem_format_write_binary(),
+ * which can be loaded much faster. When such a document is read into a
+ * buffer in UTF-8, its text is not copied but stays in the mapped file
+ * until it is modified, so that large documents which are mostly read
+ * require little memory.
+ *
+ * In addition, an #InfTextFilesystemJournal can be attached to a session to
+ * append every change made to the document to a journal file next to it.
+ * When the document is read again with inf_text_filesystem_format_read(),
+ * the changes in the journal are applied to it, so that no changes are lost
+ * if the process did not get a chance to save the document, for example
+ * because it crashed. Writing the document with
+ * inf_text_filesystem_format_write() empties the journal again.
+ *
+ * An #InfTextFilesystemHistory records the changes to a document as well,
+ * but keeps them forever, together with the time they were made at and
+ * regular snapshots of the full document. It can be used to show the
+ * document as it was at any time in the past, with
+ * inf_text_filesystem_history_get_text().
  */
 
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-iconv-private.h>
+#include <libinftext/inf-text-utf8-private.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <libxml/xmlreader.h>
+
+#include <glib/gstdio.h>
+
 #include <string.h>
+#include <errno.h>
 
 typedef struct _InfTextFilesystemFormatWriteData {
   xmlNodePtr root;
   GHashTable* encountered_authors;
 } InfTextFilesystemFormatWriteData;
 
+typedef struct _InfTextFilesystemFormatStreamData {
+  xmlTextWriterPtr writer;
+  GHashTable* encountered_authors;
+  int result;
+} InfTextFilesystemFormatStreamData;
+
+struct _InfTextFilesystemJournal {
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  FILE* stream;
+
+  gboolean dirty;
+  GError* error;
+};
+
+/* The journal is stored next to the document with this identifier. It does
+ * not start with "Inf", so that it is not listed as a note of its own. */
+static const gchar INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER[] = "text-journal";
+
+/* The first line of a journal. It is followed by the length of the document
+ * that the journal applies to. */
+static const gchar INF_TEXT_FILESYSTEM_JOURNAL_MAGIC[] = "inf-text-journal 1 ";
+
 static GQuark
 inf_text_filesystem_format_error_quark()
 {
@@ -69,6 +119,70 @@ inf_text_filesystem_format_read_close_func(void* context)
   return infd_filesystem_storage_stream_close((FILE*)context);
 }
 
+static int
+inf_text_filesystem_format_write_write_func(void* context,
+                                            const char* buffer,
+                                            int len)
+{
+  gsize res;
+  res = infd_filesystem_storage_stream_write((FILE*)context, buffer, len);
+
+  if(res != (gsize)len)
+    return -1;
+
+  return (int)res;
+}
+
+static gboolean
+inf_text_filesystem_format_add_user(InfUserTable* user_table,
+                                    guint id,
+                                    const gchar* name,
+                                    gdouble hue,
+                                    GError** error)
+{
+  InfUser* user;
+
+  if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+      _("User with ID %u exists already"),
+      id
+    );
+
+    return FALSE;
+  }
+
+  if(inf_user_table_lookup_user_by_name(user_table, name))
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+      _("User with name \"%s\" exists already"),
+      name
+    );
+
+    return FALSE;
+  }
+
+  user = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", id,
+      "name", name,
+      "hue", hue,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, user);
+  g_object_unref(user);
+  return TRUE;
+}
+
 static gboolean
 inf_text_filesystem_format_read_user(InfUserTable* user_table,
                                      xmlNodePtr node,
@@ -78,7 +192,6 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
   gdouble hue;
   xmlChar* name;
   gboolean result;
-  InfUser* user;
 
   if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
     return FALSE;
@@ -90,169 +203,150 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
   if(name == NULL)
     return FALSE;
 
-  if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
-  {
-    g_set_error(
-      error,
-      inf_text_filesystem_format_error_quark(),
-      INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-      _("User with ID %u exists already"),
-      id
-    );
+  result = inf_text_filesystem_format_add_user(
+    user_table,
+    id,
+    (const gchar*)name,
+    hue,
+    error
+  );
 
-    result = FALSE;
-  }
-  else
+  xmlFree(name);
+  return result;
+}
+
+/* Looks up the author of a segment. Author 0 means no author, for which
+ * user is set to NULL. */
+static gboolean
+inf_text_filesystem_format_lookup_author(InfUserTable* user_table,
+                                         guint author,
+                                         InfUser** user,
+                                         GError** error)
+{
+  if(author != 0)
   {
-    if(inf_user_table_lookup_user_by_name(user_table, (const gchar*)name))
+    *user = inf_user_table_lookup_user_by_id(user_table, author);
+
+    if(*user == NULL)
     {
       g_set_error(
         error,
-        inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-        _("User with name \"%s\" exists already"),
-        (const gchar*)name
-      );
-
-      result = FALSE;
-    }
-    else
-    {
-      user = INF_USER(
-        g_object_new(
-          INF_TEXT_TYPE_USER,
-          "id", id,
-          "name", name,
-          "hue", hue,
-          NULL
-        )
+        g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
       );
 
-      inf_user_table_add_user(user_table, user);
-      g_object_unref(user);
-      result = TRUE;
+      return FALSE;
     }
   }
+  else
+  {
+    *user = NULL;
+  }
 
-  xmlFree(name);
-  return result;
+  return TRUE;
 }
 
+/* Appends text, in UTF-8, written by the user with ID author to the end of
+ * buffer. */
 static gboolean
-inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
-                                       InfUserTable* user_table,
-                                       xmlNodePtr node,
-                                       GError** error)
+inf_text_filesystem_format_insert_segment(InfTextBuffer* buffer,
+                                          InfUserTable* user_table,
+                                          guint author,
+                                          const gchar* content,
+                                          gsize bytes,
+                                          guint chars,
+                                          gboolean is_utf8,
+                                          GError** error)
 {
-  xmlNodePtr child;
-  guint author;
-  gchar* content;
-  gboolean result;
-  gboolean res;
   InfUser* user;
-  gsize bytes;
-  guint chars;
-
-  gboolean is_utf8;
   gchar* converted;
   gsize converted_bytes;
 
-  g_assert(inf_text_buffer_get_length(buffer) == 0);
-
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
-
-  for(child = node->children; child != NULL; child = child->next)
+  if(!inf_text_filesystem_format_lookup_author(user_table, author,
+                                               &user, error))
   {
-    if(child->type != XML_ELEMENT_NODE)
-      continue;
-
-    if(strcmp((const gchar*)child->name, "segment") == 0)
-    {
-      res = inf_xml_util_get_attribute_uint_required(
-        child,
-        "author",
-        &author,
-        error
-      );
-
-      if(res == FALSE)
-        return FALSE;
+    return FALSE;
+  }
 
-      if(author != 0)
-      {
-        user = inf_user_table_lookup_user_by_id(user_table, author);
+  if(bytes == 0)
+    return TRUE;
 
-        if(user == NULL)
-        {
-          g_set_error(
-            error,
-            g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
-            INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
-            _("User with ID \"%u\" does not exist"),
-            author
-          );
+  if(is_utf8)
+  {
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      content,
+      bytes,
+      chars,
+      user
+    );
+  }
+  else
+  {
+    /* Convert from UTF-8 to buffer encoding */
+    converted = _inf_text_iconv_convert(
+      content,
+      bytes,
+      inf_text_buffer_get_encoding(buffer),
+      "UTF-8",
+      NULL,
+      &converted_bytes, error
+    );
 
-          return FALSE;
-        }
-      }
-      else
-      {
-        user = NULL;
-      }
+    if(converted == NULL)
+      return FALSE;
 
-      content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
-      if(!content) return FALSE;
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      converted,
+      converted_bytes,
+      chars,
+      user
+    );
 
-      if(*content != '\0')
-      {
-        if(is_utf8)
-        {
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            content,
-            bytes,
-            chars,
-            user
-          );
+    g_free(converted);
+  }
 
-          g_free(content);
-        }
-        else
-        {
-          /* Convert from UTF-8 to buffer encoding */
-          converted = g_convert(
-            content,
-            bytes,
-            inf_text_buffer_get_encoding(buffer),
-            "UTF-8",
-            NULL,
-            &converted_bytes, error
-          );
+  return TRUE;
+}
 
-          g_free(content);
+/* Appends the text of a <segment> element to the end of buffer. */
+static gboolean
+inf_text_filesystem_format_read_segment(InfTextBuffer* buffer,
+                                        InfUserTable* user_table,
+                                        xmlNodePtr node,
+                                        gboolean is_utf8,
+                                        GError** error)
+{
+  guint author;
+  gchar* content;
+  gsize bytes;
+  guint chars;
+  gboolean result;
 
-          if(converted == NULL)
-            return FALSE;
+  if(!inf_xml_util_get_attribute_uint_required(node, "author", &author, error))
+    return FALSE;
 
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            converted,
-            converted_bytes,
-            chars,
-            user
-          );
+  content = inf_xml_util_get_child_text(node, &bytes, &chars, error);
+  if(!content) return FALSE;
 
-          g_free(converted);
-        }
-      }
-    }
-  }
+  result = inf_text_filesystem_format_insert_segment(
+    buffer,
+    user_table,
+    author,
+    content,
+    bytes,
+    chars,
+    is_utf8,
+    error
+  );
 
-  return TRUE;
+  g_free(content);
+  return result;
 }
 
 static void
@@ -281,321 +375,3442 @@ inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
   }
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static void
+inf_text_filesystem_journal_system_error(int code,
+                                         GError** error)
 {
-  FILE* stream;
-  gchar* full_path;
-  gchar* uri;
-
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  xmlNodePtr root;
-  xmlNodePtr child;
-  gboolean result;
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+static gboolean
+inf_text_filesystem_journal_write_header(FILE* stream,
+                                         guint length,
+                                         GError** error)
+{
+  gchar* header;
+  gsize bytes;
+  gsize written;
 
-  /* TODO: Use a SAX parser for better performance */
-  full_path = NULL;
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    &full_path,
-    error
+  header = g_strdup_printf(
+    "%s%u\n",
+    INF_TEXT_FILESYSTEM_JOURNAL_MAGIC,
+    length
   );
 
-  if(stream == NULL)
+  bytes = strlen(header);
+  written = infd_filesystem_storage_stream_write(stream, header, bytes);
+  g_free(header);
+
+  if(written != bytes || infd_filesystem_storage_stream_sync(stream) != 0)
   {
-    g_free(full_path);
+    inf_text_filesystem_journal_system_error(errno, error);
     return FALSE;
   }
 
-  uri = g_filename_to_uri(full_path, NULL, error);
-  g_free(full_path);
+  return TRUE;
+}
 
-  if(uri == NULL)
-    return FALSE;
+/* Entries are written with a single write call, so that a crash can only
+ * cut off the last entry, which is then ignored when replaying. */
+static void
+inf_text_filesystem_journal_append(InfTextFilesystemJournal* journal,
+                                   GString* entry)
+{
+  gsize written;
 
-  doc = xmlReadIO(
-    inf_text_filesystem_format_read_read_func,
-    inf_text_filesystem_format_read_close_func,
-    stream,
-    uri,
-    "UTF-8",
-    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  if(journal->error != NULL)
+    return;
+
+  written = infd_filesystem_storage_stream_write(
+    journal->stream,
+    entry->str,
+    entry->len
   );
 
-  g_free(uri);
+  if(written != entry->len)
+    inf_text_filesystem_journal_system_error(errno, &journal->error);
 
-  if(doc == NULL)
-  {
-    xmlerror = xmlGetLastError();
+  journal->dirty = TRUE;
+}
 
-    g_set_error(
-      error,
-      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
-      xmlerror->code,
-      _("Error parsing XML in file \"%s\": [%d]: %s"),
-      path,
-      xmlerror->line,
-      xmlerror->message
-    );
+static void
+inf_text_filesystem_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextChunkIter iter;
+  gboolean is_utf8;
+  GString* entry;
+  const gchar* text;
+  gchar* converted;
+  gsize bytes;
 
-    result = FALSE;
-  }
-  else
-  {
-    root = xmlDocGetRootElement(doc);
-    if(strcmp((const char*)root->name, "inf-text-session") != 0)
-    {
-      g_set_error(
-        error,
-        inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
-        _("Error processing file \"%s\": %s"),
-        path,
-        _("The document is not a text session")
-      );
+  journal = (InfTextFilesystemJournal*)user_data;
 
-      result = FALSE;
-    }
-    else
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  entry = g_string_new(NULL);
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
     {
-      for(child = root->children; child != NULL; child = child->next)
+      if(is_utf8)
       {
-        if(child->type != XML_ELEMENT_NODE)
-          continue;
+        converted = NULL;
+        text = inf_text_chunk_iter_get_text(&iter);
+        bytes = inf_text_chunk_iter_get_bytes(&iter);
+      }
+      else
+      {
+        converted = _inf_text_iconv_convert(
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
+          "UTF-8",
+          inf_text_chunk_get_encoding(chunk),
+          NULL,
+          &bytes,
+          NULL
+        );
 
-        if(strcmp((const char*)child->name, "user") == 0)
-        {
-          if(!inf_text_filesystem_format_read_user(user_table, child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-        else if(strcmp((const char*)child->name, "buffer") == 0)
-        {
-          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
-                                                     child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
+        /* Conversion to UTF-8 should always succeed */
+        g_assert(converted != NULL);
+        text = converted;
       }
 
-      if(child == NULL)
-        result = TRUE;
-    }
+      g_string_append_printf(
+        entry,
+        "i %u %u %" G_GSIZE_FORMAT " %u\n",
+        pos,
+        inf_text_chunk_iter_get_author(&iter),
+        bytes,
+        inf_text_chunk_iter_get_length(&iter)
+      );
 
-    xmlFreeDoc(doc);
+      g_string_append_len(entry, text, bytes);
+      g_string_append_c(entry, '\n');
+      g_free(converted);
+
+      pos += inf_text_chunk_iter_get_length(&iter);
+    } while(inf_text_chunk_iter_next(&iter));
   }
 
-  return result;
+  inf_text_filesystem_journal_append(journal, entry);
+  g_string_free(entry, TRUE);
 }
 
-/**
- * inf_text_filesystem_format_write:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+static void
+inf_text_filesystem_journal_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
 {
-  InfTextBufferIter* iter;
-  xmlNodePtr buffer_node;
-  xmlNodePtr segment_node;
+  InfTextFilesystemJournal* journal;
+  GString* entry;
 
-  guint author;
-  gchar* content;
-  gsize bytes;
-  gchar* converted;
-  gsize converted_bytes;
+  journal = (InfTextFilesystemJournal*)user_data;
 
-  FILE* stream;
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  gboolean is_utf8;
+  entry = g_string_new(NULL);
+  g_string_printf(entry, "e %u %u\n", pos, inf_text_chunk_get_length(chunk));
 
-  InfTextFilesystemFormatWriteData data;
+  inf_text_filesystem_journal_append(journal, entry);
+  g_string_free(entry, TRUE);
+}
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+static void
+inf_text_filesystem_journal_add_user_cb(InfUserTable* user_table,
+                                        InfUser* user,
+                                        gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  gchar hue[G_ASCII_DTOSTR_BUF_SIZE];
+  const gchar* name;
+  GString* entry;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+  if(!INF_TEXT_IS_USER(user))
+    return;
+
+  g_ascii_dtostr(
+    hue,
+    G_ASCII_DTOSTR_BUF_SIZE,
+    inf_text_user_get_hue(INF_TEXT_USER(user))
+  );
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+  name = inf_user_get_name(user);
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "w",
-    NULL,
-    error
+  entry = g_string_new(NULL);
+  g_string_printf(
+    entry,
+    "u %u %s %" G_GSIZE_FORMAT "\n%s\n",
+    inf_user_get_id(user),
+    hue,
+    strlen(name),
+    name
   );
 
-  if(stream == NULL)
+  inf_text_filesystem_journal_append(journal, entry);
+  g_string_free(entry, TRUE);
+}
+
+static gboolean
+inf_text_filesystem_journal_parse_uint64(const gchar* str,
+                                         guint64* result)
+{
+  gchar* endptr;
+
+  if(*str < '0' || *str > '9')
     return FALSE;
 
-  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
-  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  errno = 0;
+  *result = g_ascii_strtoull(str, &endptr, 10);
+  if(errno != 0 || *endptr != '\0')
+    return FALSE;
 
-  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_journal_parse_uint(const gchar* str,
+                                       guint* result)
+{
+  guint64 value;
+
+  if(!inf_text_filesystem_journal_parse_uint64(str, &value) ||
+     value > G_MAXUINT)
   {
-    do
+    return FALSE;
+  }
+
+  *result = (guint)value;
+  return TRUE;
+}
+
+/* Applies the entry at *pos to buffer, and advances *pos behind it. Returns
+ * FALSE if the entry is incomplete or does not fit to the document. */
+static gboolean
+inf_text_filesystem_journal_replay_entry(const gchar** pos,
+                                         const gchar* end,
+                                         InfUserTable* user_table,
+                                         InfTextBuffer* buffer)
+{
+  const gchar* newline;
+  const gchar* payload;
+  gchar* line;
+  gchar** fields;
+  guint n_fields;
+  gboolean result;
+
+  guint id;
+  gdouble hue;
+  guint offset;
+  guint bytes;
+  guint length;
+  glong n_chars;
+  gchar* text;
+  gchar* converted;
+  gsize converted_bytes;
+  InfUser* user;
+
+  newline = memchr(*pos, '\n', end - *pos);
+  if(newline == NULL)
+    return FALSE;
+
+  line = g_strndup(*pos, newline - *pos);
+  fields = g_strsplit(line, " ", 0);
+  n_fields = g_strv_length(fields);
+  g_free(line);
+
+  payload = newline + 1;
+  result = FALSE;
+
+  if(n_fields == 4 && strcmp(fields[0], "u") == 0 &&
+     inf_text_filesystem_journal_parse_uint(fields[1], &id) &&
+     inf_text_filesystem_journal_parse_uint(fields[3], &bytes) &&
+     (gsize)(end - payload) > bytes && payload[bytes] == '\n')
+  {
+    hue = g_ascii_strtod(fields[2], NULL);
+    text = g_strndup(payload, bytes);
+
+    if(g_utf8_validate(text, bytes, NULL))
     {
-      author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
-      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+      /* The user might have been stored in the document in the
+       * meanwhile. */
+      if(inf_user_table_lookup_user_by_id(user_table, id) == NULL &&
+         inf_user_table_lookup_user_by_name(user_table, text) == NULL)
+      {
+        user = INF_USER(
+          g_object_new(
+            INF_TEXT_TYPE_USER,
+            "id", id,
+            "name", text,
+            "hue", hue,
+            NULL
+          )
+        );
 
-      /* TODO: Use g_hash_table_add with glib 2.32 */
-      g_hash_table_insert(
-        data.encountered_authors,
-        GUINT_TO_POINTER(author),
-        GUINT_TO_POINTER(author)
-      );
+        inf_user_table_add_user(user_table, user);
+        g_object_unref(user);
+      }
 
-      segment_node = xmlNewChild(
-        buffer_node,
-        NULL,
-        (const xmlChar*)"segment",
-        NULL
-      );
+      *pos = payload + bytes + 1;
+      result = TRUE;
+    }
 
-      inf_xml_util_set_attribute_uint(segment_node, "author", author);
+    g_free(text);
+  }
+  else if(n_fields == 5 && strcmp(fields[0], "i") == 0 &&
+          inf_text_filesystem_journal_parse_uint(fields[1], &offset) &&
+          inf_text_filesystem_journal_parse_uint(fields[2], &id) &&
+          inf_text_filesystem_journal_parse_uint(fields[3], &bytes) &&
+          inf_text_filesystem_journal_parse_uint(fields[4], &length) &&
+          (gsize)(end - payload) > bytes && payload[bytes] == '\n' &&
+          offset <= inf_text_buffer_get_length(buffer) &&
+          _inf_text_utf8_validate_count(payload, bytes, &n_chars) &&
+          n_chars == length)
+  {
+    user = NULL;
+    if(id != 0)
+      user = inf_user_table_lookup_user_by_id(user_table, id);
 
-      if(is_utf8)
+    if(id == 0 || user != NULL)
+    {
+      if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
       {
-        /* Buffer is UTF-8, no conversion necessary */
-        inf_xml_util_add_child_text(segment_node, content, bytes);
-        g_free(content);
+        inf_text_buffer_insert_text(
+          buffer,
+          offset,
+          payload,
+          bytes,
+          length,
+          user
+        );
+
+        result = TRUE;
       }
       else
       {
-        /* Convert from buffer encoding to UTF-8 for storage */
-        converted = g_convert(
-          content,
+        converted = _inf_text_iconv_convert(
+          payload,
           bytes,
-          "UTF-8",
           inf_text_buffer_get_encoding(buffer),
+          "UTF-8",
           NULL,
           &converted_bytes,
-          error
+          NULL
         );
 
-        g_free(content);
-
-        if(converted == NULL)
+        if(converted != NULL)
         {
-          xmlFreeNode(buffer_node);
-          xmlFreeNode(data.root);
-          g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
-        }
+          inf_text_buffer_insert_text(
+            buffer,
+            offset,
+            converted,
+            converted_bytes,
+            length,
+            user
+          );
 
-        inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
-        g_free(converted);
+          g_free(converted);
+          result = TRUE;
+        }
       }
-    } while(inf_text_buffer_iter_next(buffer, iter));
 
-    inf_text_buffer_destroy_iter(buffer, iter);
+      if(result == TRUE)
+        *pos = payload + bytes + 1;
+    }
   }
+  else if(n_fields == 3 && strcmp(fields[0], "e") == 0 &&
+          inf_text_filesystem_journal_parse_uint(fields[1], &offset) &&
+          inf_text_filesystem_journal_parse_uint(fields[2], &length) &&
+          offset <= inf_text_buffer_get_length(buffer) &&
+          length <= inf_text_buffer_get_length(buffer) - offset)
+  {
+    inf_text_buffer_erase_text(buffer, offset, length, NULL);
 
-  /* After we wrote the buffer, now write the user table, but only for those
-   * users that have contributed to the document. The others we drop, to
-   * avoid cluttering the user table too much. */
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_filesystem_format_write_foreach_user_func,
-    &data
+    *pos = payload;
+    result = TRUE;
+  }
+
+  g_strfreev(fields);
+  return result;
+}
+
+/* Applies the changes recorded in the journal for path, if any, to
+ * buffer. Incomplete entries at the end of the journal, or a journal that
+ * has been written for a different version of the document, are ignored.
+ * A document written with inf_text_filesystem_format_write_async()
+ * records up to which point it contains the changes of the journal, which
+ * is given by has_position, journal_base and journal_offset. */
+static gboolean
+inf_text_filesystem_journal_replay(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   InfUserTable* user_table,
+                                   InfTextBuffer* buffer,
+                                   gboolean has_position,
+                                   guint journal_base,
+                                   guint64 journal_offset,
+                                   GError** error)
+{
+  gchar* full_path;
+  gboolean exists;
+  FILE* stream;
+  GString* content;
+  gchar chunk[4096];
+  gsize bytes;
+  const gchar* pos;
+  const gchar* end;
+  const gchar* newline;
+  gsize magic_len;
+  gchar* base;
+  guint base_length;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    error
   );
 
-  g_hash_table_destroy(data.encountered_authors);
+  if(full_path == NULL)
+    return FALSE;
 
-  /* Write the buffer after the users */
-  xmlAddChild(data.root, buffer_node);
+  exists = g_file_test(full_path, G_FILE_TEST_EXISTS);
+  g_free(full_path);
 
-  doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, data.root);
+  if(!exists)
+    return TRUE;
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
-  {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    "r",
+    NULL,
+    error
+  );
 
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
-    );
+  if(stream == NULL)
+    return FALSE;
+
+  content = g_string_new(NULL);
+  do
+  {
+    bytes = infd_filesystem_storage_stream_read(stream, chunk, sizeof(chunk));
+    g_string_append_len(content, chunk, bytes);
+  } while(bytes == sizeof(chunk));
 
+  if(ferror(stream))
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    infd_filesystem_storage_stream_close(stream);
+    g_string_free(content, TRUE);
     return FALSE;
   }
 
   infd_filesystem_storage_stream_close(stream);
-  xmlFreeDoc(doc);
+
+  pos = content->str;
+  end = content->str + content->len;
+  magic_len = strlen(INF_TEXT_FILESYSTEM_JOURNAL_MAGIC);
+
+  newline = memchr(pos, '\n', end - pos);
+  if(newline != NULL && (gsize)(newline - pos) > magic_len &&
+     strncmp(pos, INF_TEXT_FILESYSTEM_JOURNAL_MAGIC, magic_len) == 0)
+  {
+    base = g_strndup(pos + magic_len, newline - pos - magic_len);
+
+    /* Skip the journal if it does not belong to the document */
+    if(!inf_text_filesystem_journal_parse_uint(base, &base_length))
+      pos = end;
+    else if(!has_position &&
+            base_length == inf_text_buffer_get_length(buffer))
+      pos = newline + 1;
+    else if(has_position && base_length == journal_base &&
+            journal_offset > (guint64)(newline - content->str) &&
+            journal_offset <= content->len)
+      pos = content->str + journal_offset;
+    else
+      pos = end;
+
+    while(pos < end)
+    {
+      if(!inf_text_filesystem_journal_replay_entry(&pos, end,
+                                                   user_table, buffer))
+      {
+        break;
+      }
+    }
+
+    g_free(base);
+  }
+
+  g_string_free(content, TRUE);
   return TRUE;
 }
 
+/* Empties the journal for path, if there is one, after the document has
+ * been written. */
+static gboolean
+inf_text_filesystem_journal_reset(InfdFilesystemStorage* storage,
+                                  const gchar* path,
+                                  InfTextBuffer* buffer,
+                                  GError** error)
+{
+  gchar* full_path;
+  gboolean exists;
+  FILE* stream;
+  gboolean result;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  exists = g_file_test(full_path, G_FILE_TEST_EXISTS);
+  g_free(full_path);
+
+  if(!exists)
+    return TRUE;
+
+  /* An open journal keeps appending to the end of the file after it has
+   * been truncated here, see infd_filesystem_storage_open(). */
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  result = inf_text_filesystem_journal_write_header(
+    stream,
+    inf_text_buffer_get_length(buffer),
+    error
+  );
+
+  infd_filesystem_storage_stream_close(stream);
+  return result;
+}
+
+/* Reads a document in XML format from stream, which is closed afterwards.
+ * The journal position recorded in the document, if any, is stored in
+ * has_position, journal_base and journal_offset. */
+static gboolean
+inf_text_filesystem_format_read_xml(FILE* stream,
+                                    const gchar* full_path,
+                                    const gchar* path,
+                                    InfUserTable* user_table,
+                                    InfTextBuffer* buffer,
+                                    gboolean* has_position,
+                                    guint* journal_base,
+                                    guint64* journal_offset,
+                                    GError** error)
+{
+  gchar* uri;
+
+  xmlTextReaderPtr reader;
+  xmlErrorPtr xmlerror;
+  xmlNodePtr node;
+  const gchar* name;
+  xmlChar* base_str;
+  xmlChar* offset_str;
+  gboolean is_utf8;
+  gboolean has_root;
+  gboolean in_buffer;
+  gboolean result;
+  int depth;
+  int ret;
+
+  uri = g_filename_to_uri(full_path, NULL, error);
+
+  if(uri == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    return FALSE;
+  }
+
+  /* The document is not read into a DOM tree as a whole, but segment by
+   * segment, so that only the buffer itself needs to be kept in memory. The
+   * reader closes the stream, also if it cannot be created. */
+  reader = xmlReaderForIO(
+    inf_text_filesystem_format_read_read_func,
+    inf_text_filesystem_format_read_close_func,
+    stream,
+    uri,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  );
+
+  g_free(uri);
+
+  if(reader == NULL)
+  {
+    xmlerror = xmlGetLastError();
+
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      path,
+      xmlerror->line,
+      xmlerror->message
+    );
+
+    return FALSE;
+  }
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  base_str = NULL;
+  offset_str = NULL;
+  has_root = FALSE;
+  in_buffer = FALSE;
+  result = TRUE;
+  ret = 0;
+
+  while(result == TRUE && (ret = xmlTextReaderRead(reader)) == 1)
+  {
+    if(xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
+      continue;
+
+    depth = xmlTextReaderDepth(reader);
+    name = (const gchar*)xmlTextReaderConstName(reader);
+
+    if(depth == 0)
+    {
+      has_root = TRUE;
+
+      if(strcmp(name, "inf-text-session") != 0)
+      {
+        g_set_error(
+          error,
+          inf_text_filesystem_format_error_quark(),
+          INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+          _("Error processing file \"%s\": %s"),
+          path,
+          _("The document is not a text session")
+        );
+
+        result = FALSE;
+      }
+      else
+      {
+        base_str = xmlTextReaderGetAttribute(
+          reader,
+          (const xmlChar*)"journal-base"
+        );
+
+        offset_str = xmlTextReaderGetAttribute(
+          reader,
+          (const xmlChar*)"journal-offset"
+        );
+      }
+    }
+    else if(depth == 1)
+    {
+      in_buffer = (strcmp(name, "buffer") == 0);
+
+      if(strcmp(name, "user") == 0)
+      {
+        node = xmlTextReaderExpand(reader);
+        if(node == NULL)
+        {
+          ret = -1;
+          break;
+        }
+
+        if(!inf_text_filesystem_format_read_user(user_table, node, error))
+        {
+          g_prefix_error(error, _("Error processing file \"%s\": "), path);
+          result = FALSE;
+        }
+      }
+    }
+    else if(depth == 2 && in_buffer && strcmp(name, "segment") == 0)
+    {
+      /* The reader frees the expanded segment again when it advances
+       * past it. */
+      node = xmlTextReaderExpand(reader);
+      if(node == NULL)
+      {
+        ret = -1;
+        break;
+      }
+
+      if(!inf_text_filesystem_format_read_segment(buffer, user_table, node,
+                                                  is_utf8, error))
+      {
+        g_prefix_error(error, _("Error processing file \"%s\": "), path);
+        result = FALSE;
+      }
+    }
+  }
+
+  if(result == TRUE && ret == -1)
+  {
+    xmlerror = xmlGetLastError();
+
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      path,
+      xmlerror->line,
+      xmlerror->message
+    );
+
+    result = FALSE;
+  }
+  else if(result == TRUE && !has_root)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+      _("Error processing file \"%s\": %s"),
+      path,
+      _("The document is not a text session")
+    );
+
+    result = FALSE;
+  }
+
+  xmlFreeTextReader(reader);
+
+  *has_position = FALSE;
+  if(base_str != NULL && offset_str != NULL &&
+     inf_text_filesystem_journal_parse_uint((const gchar*)base_str,
+                                            journal_base) &&
+     inf_text_filesystem_journal_parse_uint64((const gchar*)offset_str,
+                                              journal_offset))
+  {
+    *has_position = TRUE;
+  }
+
+  if(base_str != NULL) xmlFree(base_str);
+  if(offset_str != NULL) xmlFree(offset_str);
+  return result;
+}
+
+/* Documents can also be stored in a binary format, which is much faster to
+ * read than XML. All integers are little endian, and all fields are
+ * aligned to their size, so that the file can be used in place after it
+ * has been mapped into memory:
+ *
+ * - The magic bytes, INF_TEXT_FILESYSTEM_BINARY_MAGIC
+ * - guint32 version (1), guint32 flags
+ * - guint32 journal base, guint32 reserved, guint64 journal offset; only
+ *   meaningful if INF_TEXT_FILESYSTEM_BINARY_HAS_POSITION is set in flags
+ * - guint32 number of users, guint32 number of segments
+ * - For each user: guint32 ID, guint32 length of the name in bytes,
+ *   guint64 hue as IEEE 754 double, and the name in UTF-8, padded with
+ *   zeros to a multiple of 8 bytes
+ * - For each segment: guint32 author ID, guint32 length in bytes, and the
+ *   text in UTF-8, padded with zeros to a multiple of 4 bytes
+ */
+#define INF_TEXT_FILESYSTEM_BINARY_MAGIC "\211inftext"
+#define INF_TEXT_FILESYSTEM_BINARY_MAGIC_LEN 8
+#define INF_TEXT_FILESYSTEM_BINARY_VERSION 1
+#define INF_TEXT_FILESYSTEM_BINARY_HEADER_LEN 40
+
+#define INF_TEXT_FILESYSTEM_BINARY_HAS_POSITION (1 << 0)
+
+static void
+inf_text_filesystem_format_binary_error(GError** error)
+{
+  g_set_error_literal(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+    _("The binary document is truncated or corrupted")
+  );
+}
+
+static guint32
+inf_text_filesystem_format_binary_get_uint32(const gchar* data)
+{
+  guint32 value;
+  memcpy(&value, data, sizeof(value));
+  return GUINT32_FROM_LE(value);
+}
+
+static guint64
+inf_text_filesystem_format_binary_get_uint64(const gchar* data)
+{
+  guint64 value;
+  memcpy(&value, data, sizeof(value));
+  return GUINT64_FROM_LE(value);
+}
+
+/* Reads a document in binary format from the file at full_path, which is
+ * mapped into memory, so that the segments can be inserted into the buffer
+ * without being copied first. If the buffer is in UTF-8, the segments are
+ * not copied at all, but keep referring to the mapped file, so that
+ * unmodified parts of the document are never read into memory owned by
+ * the process. This requires the file not to be modified in place while
+ * it is mapped, see inf_text_filesystem_format_replace_document(). On
+ * Windows, a mapped file cannot be replaced, so the text is copied
+ * there. */
+static gboolean
+inf_text_filesystem_format_read_binary(const gchar* full_path,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       gboolean* has_position,
+                                       guint* journal_base,
+                                       guint64* journal_offset,
+                                       GError** error)
+{
+  GMappedFile* file;
+  const gchar* pos;
+  const gchar* end;
+  guint32 flags;
+  guint32 n_users;
+  guint32 n_segments;
+  guint32 id;
+  guint32 bytes;
+  glong n_chars;
+  guint64 hue_bits;
+  gdouble hue;
+  gchar* name;
+  gboolean is_utf8;
+  gboolean result;
+  guint32 i;
+#ifndef G_OS_WIN32
+  GBytes* file_bytes;
+  GBytes* segment_bytes;
+  InfTextChunk* chunk;
+  InfUser* user;
+#endif
+
+  file = g_mapped_file_new(full_path, FALSE, error);
+  if(file == NULL)
+    return FALSE;
+
+  pos = g_mapped_file_get_contents(file);
+  end = pos + g_mapped_file_get_length(file);
+
+  if(end - pos < INF_TEXT_FILESYSTEM_BINARY_HEADER_LEN ||
+     inf_text_filesystem_format_binary_get_uint32(pos + 8) !=
+     INF_TEXT_FILESYSTEM_BINARY_VERSION)
+  {
+    g_mapped_file_unref(file);
+    inf_text_filesystem_format_binary_error(error);
+    g_prefix_error(error, _("Error processing file \"%s\": "), path);
+    return FALSE;
+  }
+
+  flags = inf_text_filesystem_format_binary_get_uint32(pos + 12);
+  *has_position = (flags & INF_TEXT_FILESYSTEM_BINARY_HAS_POSITION) != 0;
+  *journal_base = inf_text_filesystem_format_binary_get_uint32(pos + 16);
+  *journal_offset = inf_text_filesystem_format_binary_get_uint64(pos + 24);
+  n_users = inf_text_filesystem_format_binary_get_uint32(pos + 32);
+  n_segments = inf_text_filesystem_format_binary_get_uint32(pos + 36);
+  pos += INF_TEXT_FILESYSTEM_BINARY_HEADER_LEN;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  result = TRUE;
+  for(i = 0; i < n_users && result == TRUE; ++i)
+  {
+    if(end - pos < 16)
+    {
+      inf_text_filesystem_format_binary_error(error);
+      result = FALSE;
+      break;
+    }
+
+    id = inf_text_filesystem_format_binary_get_uint32(pos);
+    bytes = inf_text_filesystem_format_binary_get_uint32(pos + 4);
+    hue_bits = inf_text_filesystem_format_binary_get_uint64(pos + 8);
+    memcpy(&hue, &hue_bits, sizeof(hue));
+    pos += 16;
+
+    if((gsize)(end - pos) < bytes || !g_utf8_validate(pos, bytes, NULL))
+    {
+      inf_text_filesystem_format_binary_error(error);
+      result = FALSE;
+      break;
+    }
+
+    name = g_strndup(pos, bytes);
+    result = inf_text_filesystem_format_add_user(
+      user_table,
+      id,
+      name,
+      hue,
+      error
+    );
+
+    g_free(name);
+    pos += MIN((gsize)(end - pos), ((gsize)bytes + 7) & ~(gsize)7);
+  }
+
+#ifndef G_OS_WIN32
+  file_bytes = NULL;
+  chunk = NULL;
+  if(is_utf8)
+  {
+    file_bytes = g_mapped_file_get_bytes(file);
+    chunk = inf_text_chunk_new("UTF-8");
+  }
+#endif
+
+  for(i = 0; i < n_segments && result == TRUE; ++i)
+  {
+    if(end - pos < 8)
+    {
+      inf_text_filesystem_format_binary_error(error);
+      result = FALSE;
+      break;
+    }
+
+    id = inf_text_filesystem_format_binary_get_uint32(pos);
+    bytes = inf_text_filesystem_format_binary_get_uint32(pos + 4);
+    pos += 8;
+
+    if((gsize)(end - pos) < bytes ||
+       !_inf_text_utf8_validate_count(pos, bytes, &n_chars))
+    {
+      inf_text_filesystem_format_binary_error(error);
+      result = FALSE;
+      break;
+    }
+
+#ifndef G_OS_WIN32
+    if(chunk != NULL)
+    {
+      result = inf_text_filesystem_format_lookup_author(
+        user_table,
+        id,
+        &user,
+        error
+      );
+
+      if(result == TRUE)
+      {
+        segment_bytes = g_bytes_new_from_bytes(
+          file_bytes,
+          pos - g_mapped_file_get_contents(file),
+          bytes
+        );
+
+        inf_text_chunk_insert_bytes(
+          chunk,
+          inf_text_chunk_get_length(chunk),
+          segment_bytes,
+          (guint)n_chars,
+          id
+        );
+
+        g_bytes_unref(segment_bytes);
+      }
+    }
+    else
+#endif
+    {
+      result = inf_text_filesystem_format_insert_segment(
+        buffer,
+        user_table,
+        id,
+        pos,
+        bytes,
+        (guint)n_chars,
+        is_utf8,
+        error
+      );
+    }
+
+    pos += MIN((gsize)(end - pos), ((gsize)bytes + 3) & ~(gsize)3);
+  }
+
+#ifndef G_OS_WIN32
+  if(chunk != NULL)
+  {
+    if(result == TRUE)
+    {
+      inf_text_buffer_insert_chunk(
+        buffer,
+        inf_text_buffer_get_length(buffer),
+        chunk,
+        NULL
+      );
+    }
+
+    inf_text_chunk_free(chunk);
+    g_bytes_unref(file_bytes);
+  }
+#endif
+
+  if(result == FALSE)
+    g_prefix_error(error, _("Error processing file \"%s\": "), path);
+
+  g_mapped_file_unref(file);
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_read:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() before. The @user_table
+ * parameter should be an empty user table that will be used for the session,
+ * and the @buffer parameter should be an empty #InfTextBuffer, and the
+ * document will be written into this buffer. If the function succeeds, the
+ * user table and buffer can be used to create an #InfTextSession with
+ * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * Documents written with inf_text_filesystem_format_write_binary() are
+ * detected automatically.
+ *
+ * If there is a journal for @path, written by an #InfTextFilesystemJournal,
+ * then the changes recorded in it are applied to @buffer after the
+ * document has been read.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  FILE* stream;
+  gchar* full_path;
+  gchar magic[INF_TEXT_FILESYSTEM_BINARY_MAGIC_LEN];
+  gsize bytes;
+  gboolean has_position;
+  guint journal_base;
+  guint64 journal_offset;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  full_path = NULL;
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(full_path);
+    return FALSE;
+  }
+
+  bytes = infd_filesystem_storage_stream_read(stream, magic, sizeof(magic));
+
+  if(bytes == sizeof(magic) &&
+     memcmp(magic, INF_TEXT_FILESYSTEM_BINARY_MAGIC, sizeof(magic)) == 0)
+  {
+    infd_filesystem_storage_stream_close(stream);
+
+    result = inf_text_filesystem_format_read_binary(
+      full_path,
+      path,
+      user_table,
+      buffer,
+      &has_position,
+      &journal_base,
+      &journal_offset,
+      error
+    );
+  }
+  else if(ferror(stream) || fseek(stream, 0, SEEK_SET) != 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    infd_filesystem_storage_stream_close(stream);
+    result = FALSE;
+  }
+  else
+  {
+    result = inf_text_filesystem_format_read_xml(
+      stream,
+      full_path,
+      path,
+      user_table,
+      buffer,
+      &has_position,
+      &journal_base,
+      &journal_offset,
+      error
+    );
+  }
+
+  g_free(full_path);
+
+  if(result == TRUE)
+  {
+    result = inf_text_filesystem_journal_replay(
+      storage,
+      path,
+      user_table,
+      buffer,
+      has_position,
+      journal_base,
+      journal_offset,
+      error
+    );
+
+    if(result == FALSE)
+      g_prefix_error(error, _("Error reading journal of \"%s\": "), path);
+  }
+
+  return result;
+}
+
+/* Creates the XML document for the session consisting of user_table and
+ * buffer. */
+static xmlDocPtr
+inf_text_filesystem_format_write_doc(InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     GError** error)
+{
+  InfTextBufferIter* iter;
+  xmlNodePtr buffer_node;
+  xmlNodePtr segment_node;
+
+  guint author;
+  gchar* content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+
+  xmlDocPtr doc;
+  gboolean is_utf8;
+
+  InfTextFilesystemFormatWriteData data;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+
+  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+      content = inf_text_buffer_iter_get_text(buffer, iter);
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+
+      segment_node = xmlNewChild(
+        buffer_node,
+        NULL,
+        (const xmlChar*)"segment",
+        NULL
+      );
+
+      inf_xml_util_set_attribute_uint(segment_node, "author", author);
+
+      if(is_utf8)
+      {
+        /* Buffer is UTF-8, no conversion necessary */
+        inf_xml_util_add_child_text(segment_node, content, bytes);
+        g_free(content);
+      }
+      else
+      {
+        /* Convert from buffer encoding to UTF-8 for storage */
+        converted = _inf_text_iconv_convert(
+          content,
+          bytes,
+          "UTF-8",
+          inf_text_buffer_get_encoding(buffer),
+          NULL,
+          &converted_bytes,
+          error
+        );
+
+        g_free(content);
+
+        if(converted == NULL)
+        {
+          inf_text_buffer_destroy_iter(buffer, iter);
+          xmlFreeNode(buffer_node);
+          xmlFreeNode(data.root);
+          g_hash_table_destroy(data.encountered_authors);
+          return NULL;
+        }
+
+        inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
+        g_free(converted);
+      }
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  /* After we wrote the buffer, now write the user table, but only for those
+   * users that have contributed to the document. The others we drop, to
+   * avoid cluttering the user table too much. */
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_write_foreach_user_func,
+    &data
+  );
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  /* Write the buffer after the users */
+  xmlAddChild(data.root, buffer_node);
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  xmlDocSetRootElement(doc, data.root);
+
+  return doc;
+}
+
+static void
+inf_text_filesystem_format_stream_foreach_user_func(InfUser* user,
+                                                    gpointer user_data)
+{
+  InfTextFilesystemFormatStreamData* data;
+  gpointer user_id;
+  char hue[G_ASCII_DTOSTR_BUF_SIZE];
+
+  data = (InfTextFilesystemFormatStreamData*)user_data;
+  user_id = GUINT_TO_POINTER(inf_user_get_id(user));
+
+  if(data->result < 0)
+    return;
+
+  /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
+  if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
+  {
+    g_ascii_dtostr(
+      hue,
+      G_ASCII_DTOSTR_BUF_SIZE,
+      inf_text_user_get_hue(INF_TEXT_USER(user))
+    );
+
+    data->result = xmlTextWriterWriteString(
+      data->writer,
+      (const xmlChar*)"\n  "
+    );
+
+    if(data->result >= 0)
+    {
+      data->result = xmlTextWriterStartElement(
+        data->writer,
+        (const xmlChar*)"user"
+      );
+    }
+
+    if(data->result >= 0)
+    {
+      data->result = xmlTextWriterWriteFormatAttribute(
+        data->writer,
+        (const xmlChar*)"id",
+        "%u",
+        inf_user_get_id(user)
+      );
+    }
+
+    if(data->result >= 0)
+    {
+      data->result = xmlTextWriterWriteAttribute(
+        data->writer,
+        (const xmlChar*)"name",
+        (const xmlChar*)inf_user_get_name(user)
+      );
+    }
+
+    if(data->result >= 0)
+    {
+      data->result = xmlTextWriterWriteAttribute(
+        data->writer,
+        (const xmlChar*)"hue",
+        (const xmlChar*)hue
+      );
+    }
+
+    if(data->result >= 0)
+      data->result = xmlTextWriterEndElement(data->writer);
+  }
+}
+
+/* Writes the session consisting of user_table and buffer to writer in the
+ * same format as inf_text_filesystem_format_write_doc(), but without
+ * creating a copy of the whole document in memory first. */
+static gboolean
+inf_text_filesystem_format_write_stream(xmlTextWriterPtr writer,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        GError** error)
+{
+  InfTextBufferIter* iter;
+  InfTextFilesystemFormatStreamData data;
+  xmlErrorPtr xmlerror;
+
+  guint author;
+  gchar* content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+  gboolean is_utf8;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  data.writer = writer;
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  data.result = 0;
+
+  /* The users are written before the buffer, but only those that have
+   * contributed to the document, so find them out first. */
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  data.result = xmlTextWriterStartDocument(writer, NULL, NULL, NULL);
+  if(data.result >= 0)
+  {
+    data.result = xmlTextWriterStartElement(
+      writer,
+      (const xmlChar*)"inf-text-session"
+    );
+  }
+
+  if(data.result >= 0)
+  {
+    inf_user_table_foreach_user(
+      user_table,
+      inf_text_filesystem_format_stream_foreach_user_func,
+      &data
+    );
+  }
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  if(data.result >= 0)
+    data.result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n  ");
+  if(data.result >= 0)
+    data.result = xmlTextWriterStartElement(writer, (const xmlChar*)"buffer");
+
+  iter = NULL;
+  if(data.result >= 0)
+    iter = inf_text_buffer_create_begin_iter(buffer);
+
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+      content = inf_text_buffer_iter_get_text(buffer, iter);
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      if(!is_utf8)
+      {
+        /* Convert from buffer encoding to UTF-8 for storage */
+        converted = _inf_text_iconv_convert(
+          content,
+          bytes,
+          "UTF-8",
+          inf_text_buffer_get_encoding(buffer),
+          NULL,
+          &converted_bytes,
+          error
+        );
+
+        g_free(content);
+
+        if(converted == NULL)
+        {
+          inf_text_buffer_destroy_iter(buffer, iter);
+          return FALSE;
+        }
+
+        content = converted;
+        bytes = converted_bytes;
+      }
+
+      data.result = xmlTextWriterWriteString(
+        writer,
+        (const xmlChar*)"\n    "
+      );
+
+      if(data.result >= 0)
+      {
+        data.result = xmlTextWriterStartElement(
+          writer,
+          (const xmlChar*)"segment"
+        );
+      }
+
+      if(data.result >= 0)
+      {
+        data.result = xmlTextWriterWriteFormatAttribute(
+          writer,
+          (const xmlChar*)"author",
+          "%u",
+          author
+        );
+      }
+
+      if(data.result >= 0)
+        data.result = inf_xml_util_write_child_text(writer, content, bytes);
+      if(data.result >= 0)
+        data.result = xmlTextWriterEndElement(writer);
+
+      g_free(content);
+    } while(data.result >= 0 && inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  if(data.result >= 0)
+    data.result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n  ");
+  if(data.result >= 0)
+    data.result = xmlTextWriterEndElement(writer);
+  if(data.result >= 0)
+    data.result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n");
+  if(data.result >= 0)
+    data.result = xmlTextWriterEndDocument(writer);
+  if(data.result >= 0)
+    data.result = xmlTextWriterFlush(writer);
+
+  if(data.result < 0)
+  {
+    xmlerror = xmlGetLastError();
+    if(xmlerror != NULL)
+    {
+      g_set_error_literal(
+        error,
+        g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+        xmlerror->code,
+        xmlerror->message
+      );
+    }
+    else
+    {
+      inf_text_filesystem_journal_system_error(errno, error);
+    }
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Finds out the current end of the journal for path, if there is one, to
+ * be recorded in the document, so that only the changes made after this
+ * point are replayed on top of it. This is required if the journal is not
+ * reset at the same time as the document is written. */
+static gboolean
+inf_text_filesystem_journal_get_position(InfdFilesystemStorage* storage,
+                                         const gchar* path,
+                                         gboolean* has_position,
+                                         guint* journal_base,
+                                         guint64* journal_offset,
+                                         GError** error)
+{
+  gchar* full_path;
+  gboolean exists;
+  FILE* stream;
+  gchar header[64];
+  gsize magic_len;
+  gchar* newline;
+  guint base_length;
+  long offset;
+
+  *has_position = FALSE;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  exists = g_file_test(full_path, G_FILE_TEST_EXISTS);
+  g_free(full_path);
+
+  if(!exists)
+    return TRUE;
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    "r",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  magic_len = strlen(INF_TEXT_FILESYSTEM_JOURNAL_MAGIC);
+
+  if(fgets(header, sizeof(header), stream) != NULL &&
+     strncmp(header, INF_TEXT_FILESYSTEM_JOURNAL_MAGIC, magic_len) == 0 &&
+     (newline = strchr(header, '\n')) != NULL)
+  {
+    *newline = '\0';
+
+    if(inf_text_filesystem_journal_parse_uint(header + magic_len,
+                                              &base_length) &&
+       fseek(stream, 0, SEEK_END) == 0 &&
+       (offset = ftell(stream)) != -1)
+    {
+      *has_position = TRUE;
+      *journal_base = base_length;
+      *journal_offset = offset;
+    }
+  }
+
+  infd_filesystem_storage_stream_close(stream);
+  return TRUE;
+}
+
+/* Removes the document at path before it is overwritten in place, so that
+ * buffers still referring to the text of the old file because they have
+ * read it with inf_text_filesystem_format_read_binary() keep the old
+ * content which is then only unlinked, instead of seeing the file being
+ * truncated. Errors are ignored since opening the file for writing
+ * reports them anyway. */
+static void
+inf_text_filesystem_format_replace_document(InfdFilesystemStorage* storage,
+                                            const gchar* path)
+{
+#ifndef G_OS_WIN32
+  gchar* full_path;
+
+  full_path = infd_filesystem_storage_get_path(storage, "InfText", path, NULL);
+  if(full_path != NULL)
+  {
+    g_unlink(full_path);
+    g_free(full_path);
+  }
+#endif
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * If there is a journal for @path, then it is emptied after the document
+ * has been written, since all changes recorded in it are now contained in
+ * the document itself.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  FILE* stream;
+  xmlOutputBufferPtr output;
+  xmlTextWriterPtr writer;
+  xmlErrorPtr xmlerror;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  inf_text_filesystem_format_replace_document(storage, path);
+
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  /* The document is written segment by segment as it is serialized,
+   * instead of building an XML document of the whole buffer first. The
+   * stream is closed by ourselves, so that errors can be reported. */
+  output = xmlOutputBufferCreateIO(
+    inf_text_filesystem_format_write_write_func,
+    NULL,
+    stream,
+    NULL
+  );
+
+  writer = NULL;
+  if(output != NULL)
+  {
+    writer = xmlNewTextWriter(output);
+    if(writer == NULL)
+      xmlOutputBufferClose(output);
+  }
+
+  if(writer == NULL)
+  {
+    xmlerror = xmlGetLastError();
+    infd_filesystem_storage_stream_close(stream);
+
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
+
+    return FALSE;
+  }
+
+  result = inf_text_filesystem_format_write_stream(
+    writer,
+    user_table,
+    buffer,
+    error
+  );
+
+  xmlFreeTextWriter(writer);
+
+  if(infd_filesystem_storage_stream_close(stream) != 0 && result == TRUE)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    result = FALSE;
+  }
+
+  if(result == FALSE)
+    return FALSE;
+
+  return inf_text_filesystem_journal_reset(storage, path, buffer, error);
+}
+
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the main thread.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @func: (scope async): Function to be called when the session has been
+ * written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path like inf_text_filesystem_format_write(). The document is created
+ * right away, but it is written to the disk in a worker thread with
+ * infd_filesystem_storage_write_xml_file_async(). @func is called in the
+ * thread of @io when this is done. Use
+ * infd_filesystem_storage_cancel_write() if @func must not be called
+ * anymore.
+ *
+ * A journal for @path, if there is one, is not emptied by this function,
+ * since changes made while the document is being written still need to be
+ * recorded in it. Instead, the document remembers which part of the
+ * journal it contains already.
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error, in
+ * which case @func is not called.
+ */
+gboolean
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfdFilesystemStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  gboolean has_position;
+  guint journal_base;
+  guint64 journal_offset;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(!inf_text_filesystem_journal_get_position(storage, path, &has_position,
+                                               &journal_base, &journal_offset,
+                                               error))
+  {
+    return FALSE;
+  }
+
+  doc = inf_text_filesystem_format_write_doc(user_table, buffer, error);
+  if(doc == NULL)
+    return FALSE;
+
+  if(has_position)
+  {
+    root = xmlDocGetRootElement(doc);
+    inf_xml_util_set_attribute_uint(root, "journal-base", journal_base);
+    inf_xml_util_set_attribute_ulong(root, "journal-offset", journal_offset);
+  }
+
+  return infd_filesystem_storage_write_xml_file_async(
+    storage,
+    io,
+    "InfText",
+    path,
+    doc,
+    func,
+    user_data,
+    error
+  );
+}
+
+typedef struct _InfTextFilesystemFormatBinaryData {
+  GString* data;
+  GHashTable* encountered_authors;
+  guint32 n_users;
+} InfTextFilesystemFormatBinaryData;
+
+static void
+inf_text_filesystem_format_binary_set_uint32(GString* data,
+                                             gsize offset,
+                                             guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  memcpy(data->str + offset, &value, sizeof(value));
+}
+
+static void
+inf_text_filesystem_format_binary_append_uint32(GString* data,
+                                                guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  g_string_append_len(data, (const gchar*)&value, sizeof(value));
+}
+
+static void
+inf_text_filesystem_format_binary_append_uint64(GString* data,
+                                                guint64 value)
+{
+  value = GUINT64_TO_LE(value);
+  g_string_append_len(data, (const gchar*)&value, sizeof(value));
+}
+
+static void
+inf_text_filesystem_format_binary_append_text(GString* data,
+                                              const gchar* text,
+                                              gsize bytes,
+                                              gsize alignment)
+{
+  g_string_append_len(data, text, bytes);
+  while(data->len % alignment != 0)
+    g_string_append_c(data, '\0');
+}
+
+static void
+inf_text_filesystem_format_binary_foreach_user_func(InfUser* user,
+                                                    gpointer user_data)
+{
+  InfTextFilesystemFormatBinaryData* data;
+  gpointer user_id;
+  const gchar* name;
+  gdouble hue;
+  guint64 hue_bits;
+
+  data = (InfTextFilesystemFormatBinaryData*)user_data;
+  user_id = GUINT_TO_POINTER(inf_user_get_id(user));
+
+  /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
+  if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
+  {
+    name = inf_user_get_name(user);
+    hue = inf_text_user_get_hue(INF_TEXT_USER(user));
+    memcpy(&hue_bits, &hue, sizeof(hue_bits));
+
+    inf_text_filesystem_format_binary_append_uint32(
+      data->data,
+      inf_user_get_id(user)
+    );
+
+    inf_text_filesystem_format_binary_append_uint32(data->data, strlen(name));
+    inf_text_filesystem_format_binary_append_uint64(data->data, hue_bits);
+
+    inf_text_filesystem_format_binary_append_text(
+      data->data,
+      name,
+      strlen(name),
+      8
+    );
+
+    ++data->n_users;
+  }
+}
+
+/* Serializes the session consisting of user_table and buffer into the
+ * binary format described above. */
+static gchar*
+inf_text_filesystem_format_write_binary_data(InfUserTable* user_table,
+                                             InfTextBuffer* buffer,
+                                             gboolean has_position,
+                                             guint journal_base,
+                                             guint64 journal_offset,
+                                             gsize* len,
+                                             GError** error)
+{
+  InfTextFilesystemFormatBinaryData data;
+  InfTextBufferIter* iter;
+  guint32 n_segments;
+  guint author;
+  gchar* content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+  gboolean is_utf8;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  data.data = g_string_sized_new(
+    INF_TEXT_FILESYSTEM_BINARY_HEADER_LEN +
+    inf_text_buffer_get_length(buffer) + 1024
+  );
+
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  data.n_users = 0;
+
+  g_string_append_len(
+    data.data,
+    INF_TEXT_FILESYSTEM_BINARY_MAGIC,
+    INF_TEXT_FILESYSTEM_BINARY_MAGIC_LEN
+  );
+
+  inf_text_filesystem_format_binary_append_uint32(
+    data.data,
+    INF_TEXT_FILESYSTEM_BINARY_VERSION
+  );
+
+  inf_text_filesystem_format_binary_append_uint32(
+    data.data,
+    has_position ? INF_TEXT_FILESYSTEM_BINARY_HAS_POSITION : 0
+  );
+
+  inf_text_filesystem_format_binary_append_uint32(
+    data.data,
+    has_position ? journal_base : 0
+  );
+
+  inf_text_filesystem_format_binary_append_uint32(data.data, 0);
+
+  inf_text_filesystem_format_binary_append_uint64(
+    data.data,
+    has_position ? journal_offset : 0
+  );
+
+  /* The number of users and segments are filled in at the end */
+  inf_text_filesystem_format_binary_append_uint32(data.data, 0);
+  inf_text_filesystem_format_binary_append_uint32(data.data, 0);
+  g_assert(data.data->len == INF_TEXT_FILESYSTEM_BINARY_HEADER_LEN);
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_binary_foreach_user_func,
+    &data
+  );
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  n_segments = 0;
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+      content = inf_text_buffer_iter_get_text(buffer, iter);
+      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+
+      if(!is_utf8)
+      {
+        /* Convert from buffer encoding to UTF-8 for storage */
+        converted = _inf_text_iconv_convert(
+          content,
+          bytes,
+          "UTF-8",
+          inf_text_buffer_get_encoding(buffer),
+          NULL,
+          &converted_bytes,
+          error
+        );
+
+        g_free(content);
+
+        if(converted == NULL)
+        {
+          inf_text_buffer_destroy_iter(buffer, iter);
+          g_string_free(data.data, TRUE);
+          return NULL;
+        }
+
+        content = converted;
+        bytes = converted_bytes;
+      }
+
+      inf_text_filesystem_format_binary_append_uint32(data.data, author);
+      inf_text_filesystem_format_binary_append_uint32(data.data, bytes);
+      inf_text_filesystem_format_binary_append_text(
+        data.data,
+        content,
+        bytes,
+        4
+      );
+
+      g_free(content);
+      ++n_segments;
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  inf_text_filesystem_format_binary_set_uint32(data.data, 32, data.n_users);
+  inf_text_filesystem_format_binary_set_uint32(data.data, 36, n_segments);
+
+  *len = data.data->len;
+  return g_string_free(data.data, FALSE);
+}
+
+/**
+ * inf_text_filesystem_format_write_binary:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path like inf_text_filesystem_format_write(), but uses a compact binary
+ * format instead of XML. Such documents can be read much faster, since
+ * they do not need to be parsed. inf_text_filesystem_format_read()
+ * detects the format automatically.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write_binary(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        GError** error)
+{
+  FILE* stream;
+  gchar* data;
+  gsize len;
+  gsize written;
+  int save_errno;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  data = inf_text_filesystem_format_write_binary_data(
+    user_table,
+    buffer,
+    FALSE,
+    0,
+    0,
+    &len,
+    error
+  );
+
+  if(data == NULL)
+    return FALSE;
+
+  inf_text_filesystem_format_replace_document(storage, path);
+
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(data);
+    return FALSE;
+  }
+
+  written = infd_filesystem_storage_stream_write(stream, data, len);
+  save_errno = errno;
+  g_free(data);
+
+  if(written != len)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    inf_text_filesystem_journal_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  if(infd_filesystem_storage_stream_close(stream) != 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    return FALSE;
+  }
+
+  return inf_text_filesystem_journal_reset(storage, path, buffer, error);
+}
+
+/**
+ * inf_text_filesystem_format_write_binary_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the main thread.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @func: (scope async): Function to be called when the session has been
+ * written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer in a worker thread like
+ * inf_text_filesystem_format_write_async(), but in the binary format of
+ * inf_text_filesystem_format_write_binary().
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error, in
+ * which case @func is not called.
+ */
+gboolean
+inf_text_filesystem_format_write_binary_async(InfdFilesystemStorage* storage,
+                                              InfIo* io,
+                                              const gchar* path,
+                                              InfUserTable* user_table,
+                                              InfTextBuffer* buffer,
+                                              InfdFilesystemStorageWriteFunc func,
+                                              gpointer user_data,
+                                              GError** error)
+{
+  gboolean has_position;
+  guint journal_base;
+  guint64 journal_offset;
+  gchar* data;
+  gsize len;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(!inf_text_filesystem_journal_get_position(storage, path, &has_position,
+                                               &journal_base, &journal_offset,
+                                               error))
+  {
+    return FALSE;
+  }
+
+  data = inf_text_filesystem_format_write_binary_data(
+    user_table,
+    buffer,
+    has_position,
+    journal_base,
+    journal_offset,
+    &len,
+    error
+  );
+
+  if(data == NULL)
+    return FALSE;
+
+  return infd_filesystem_storage_write_file_async(
+    storage,
+    io,
+    "InfText",
+    path,
+    data,
+    len,
+    func,
+    user_data,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_journal_open:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document.
+ * @session: The #InfTextSession for the document at @path.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Starts appending all changes made to the buffer of @session to a journal
+ * file next to the document at @path. When the document is read with
+ * inf_text_filesystem_format_read() the next time, these changes are
+ * applied to it. This makes it possible to save documents that are changed
+ * frequently only rarely, at the cost of a small amount of data written
+ * for every change.
+ *
+ * This function should be called right after the document has been read
+ * from or written to @path, because the journal only records the changes
+ * made after it has been opened.
+ *
+ * The journal is written without being buffered, but the data is only
+ * guaranteed to be on disk after inf_text_filesystem_journal_sync() has
+ * been called.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal, to be closed
+ * with inf_text_filesystem_journal_close(), or %NULL on error.
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfTextSession* session,
+                                 GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextBuffer* buffer;
+  gchar* full_path;
+  gboolean exists;
+  FILE* stream;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_TEXT_IS_SESSION(session), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return NULL;
+
+  exists = g_file_test(full_path, G_FILE_TEST_EXISTS);
+  g_free(full_path);
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    "a",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return NULL;
+
+  /* Each entry is written with a single call, so there is no point in
+   * buffering, and without a buffer the entries made so far are already
+   * in the file when the journal is reset. */
+  setvbuf(stream, NULL, _IONBF, 0);
+
+  if(!exists)
+  {
+    if(!inf_text_filesystem_journal_write_header(
+         stream, inf_text_buffer_get_length(buffer), error))
+    {
+      infd_filesystem_storage_stream_close(stream);
+      return NULL;
+    }
+  }
+
+  journal = g_slice_new(InfTextFilesystemJournal);
+  journal->buffer = buffer;
+  journal->user_table = inf_session_get_user_table(INF_SESSION(session));
+  journal->stream = stream;
+  journal->dirty = FALSE;
+  journal->error = NULL;
+
+  g_object_ref(journal->buffer);
+  g_object_ref(journal->user_table);
+
+  g_signal_connect_after(
+    G_OBJECT(journal->buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(journal->buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(journal->user_table),
+    "add-user",
+    G_CALLBACK(inf_text_filesystem_journal_add_user_cb),
+    journal
+  );
+
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_sync:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Makes sure that all changes recorded in @journal so far have reached the
+ * disk. This is comparatively expensive, so it should not be called for
+ * every change, but for example periodically. If writing any of the changes
+ * to the journal failed since the last call, the error is reported here.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_sync(InfTextFilesystemJournal* journal,
+                                 GError** error)
+{
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(journal->error != NULL)
+  {
+    g_propagate_error(error, journal->error);
+    journal->error = NULL;
+    return FALSE;
+  }
+
+  if(journal->dirty == FALSE)
+    return TRUE;
+
+  if(infd_filesystem_storage_stream_sync(journal->stream) != 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    return FALSE;
+  }
+
+  journal->dirty = FALSE;
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_journal_get_size:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Returns the size of the journal file, in bytes. This can be used to
+ * decide when to write the full document again, with
+ * inf_text_filesystem_format_write(), which empties the journal.
+ *
+ * Returns: The size of the journal file.
+ */
+gsize
+inf_text_filesystem_journal_get_size(InfTextFilesystemJournal* journal)
+{
+  long size;
+
+  g_return_val_if_fail(journal != NULL, 0);
+
+  /* The stream is in append mode, so the position is always at the end of
+   * the file after having written to it. */
+  size = ftell(journal->stream);
+  if(size < 0)
+    return 0;
+
+  return (gsize)size;
+}
+
+/**
+ * inf_text_filesystem_journal_close:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Stops recording changes in @journal and closes the journal file. The
+ * changes recorded so far are not removed from the journal, so they are
+ * still applied when the document is read the next time, unless it is
+ * written before. Call inf_text_filesystem_journal_sync() before this
+ * function to make sure all changes have reached the disk.
+ */
+void
+inf_text_filesystem_journal_close(InfTextFilesystemJournal* journal)
+{
+  g_return_if_fail(journal != NULL);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->user_table),
+    G_CALLBACK(inf_text_filesystem_journal_add_user_cb),
+    journal
+  );
+
+  infd_filesystem_storage_stream_close(journal->stream);
+
+  if(journal->error != NULL)
+    g_error_free(journal->error);
+
+  g_object_unref(journal->buffer);
+  g_object_unref(journal->user_table);
+  g_slice_free(InfTextFilesystemJournal, journal);
+}
+
+/* The history is stored next to the document with these identifiers, one
+ * for the entries and one for the index of its snapshots. */
+static const gchar INF_TEXT_FILESYSTEM_HISTORY_IDENTIFIER[] = "text-history";
+static const gchar INF_TEXT_FILESYSTEM_HISTORY_INDEX_IDENTIFIER[] =
+  "text-history-index";
+
+/* The first line of a history file */
+static const gchar INF_TEXT_FILESYSTEM_HISTORY_MAGIC[] =
+  "inf-text-history 1\n";
+
+/* Each snapshot has an index record with its time and its offset in the
+ * history file, both as 64 bit little endian numbers. */
+#define INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN 16
+
+/* A snapshot is written when the entries written since the last one are
+ * larger than the snapshot itself, but at least this many bytes. This
+ * bounds the work for reconstructing the document at any point in time by
+ * the size of the document, while the history file grows at most twice as
+ * fast as without snapshots. */
+#define INF_TEXT_FILESYSTEM_HISTORY_MIN_SNAPSHOT_DISTANCE (64 * 1024)
+
+struct _InfTextFilesystemHistory {
+  InfTextBuffer* buffer;
+  FILE* stream;
+  FILE* index;
+
+  guint64 offset; /* size of the history file */
+  guint64 snapshot_size;
+  guint64 since_snapshot;
+  gint64 last_time;
+
+  gboolean dirty;
+  GError* error;
+};
+
+static gint64
+inf_text_filesystem_history_now(InfTextFilesystemHistory* history)
+{
+  gint64 now;
+
+  /* Keep the times increasing even if the clock is adjusted, since the
+   * index is searched by time. */
+  now = g_get_real_time();
+  if(now < history->last_time)
+    now = history->last_time;
+
+  history->last_time = now;
+  return now;
+}
+
+/* Appends the segments of chunk to entry, each as a line with its author,
+ * its size in bytes and its length, followed by the text in UTF-8. Returns
+ * the number of segments. */
+static guint
+inf_text_filesystem_history_append_segments(GString* entry,
+                                            InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  gboolean is_utf8;
+  const gchar* text;
+  gchar* converted;
+  gsize bytes;
+  guint n_segments;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  n_segments = 0;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      if(is_utf8)
+      {
+        converted = NULL;
+        text = inf_text_chunk_iter_get_text(&iter);
+        bytes = inf_text_chunk_iter_get_bytes(&iter);
+      }
+      else
+      {
+        converted = _inf_text_iconv_convert(
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
+          "UTF-8",
+          inf_text_chunk_get_encoding(chunk),
+          NULL,
+          &bytes,
+          NULL
+        );
+
+        /* Conversion to UTF-8 should always succeed */
+        g_assert(converted != NULL);
+        text = converted;
+      }
+
+      g_string_append_printf(
+        entry,
+        "%u %" G_GSIZE_FORMAT " %u\n",
+        inf_text_chunk_iter_get_author(&iter),
+        bytes,
+        inf_text_chunk_iter_get_length(&iter)
+      );
+
+      g_string_append_len(entry, text, bytes);
+      g_string_append_c(entry, '\n');
+      g_free(converted);
+
+      ++n_segments;
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  return n_segments;
+}
+
+/* Like the journal, every entry is written with a single call, so that a
+ * crash can only cut off the last one. Reading stops there, but since a
+ * snapshot is written whenever the history is opened, the index still
+ * leads to the entries made after the crash. */
+static void
+inf_text_filesystem_history_append(InfTextFilesystemHistory* history,
+                                   GString* entry)
+{
+  gsize written;
+
+  if(history->error != NULL)
+    return;
+
+  written = infd_filesystem_storage_stream_write(
+    history->stream,
+    entry->str,
+    entry->len
+  );
+
+  if(written != entry->len)
+  {
+    inf_text_filesystem_journal_system_error(errno, &history->error);
+    return;
+  }
+
+  history->offset += entry->len;
+  history->since_snapshot += entry->len;
+  history->dirty = TRUE;
+}
+
+static void
+inf_text_filesystem_history_write_snapshot(InfTextFilesystemHistory* history,
+                                           gint64 time)
+{
+  InfTextChunk* chunk;
+  GString* segments;
+  GString* entry;
+  GString* record;
+  guint n_segments;
+  guint64 offset;
+  gsize written;
+
+  if(history->error != NULL)
+    return;
+
+  chunk = inf_text_buffer_get_slice(
+    history->buffer,
+    0,
+    inf_text_buffer_get_length(history->buffer)
+  );
+
+  segments = g_string_new(NULL);
+  n_segments = inf_text_filesystem_history_append_segments(segments, chunk);
+  inf_text_chunk_free(chunk);
+
+  entry = g_string_new(NULL);
+  g_string_printf(
+    entry,
+    "s %" G_GINT64_FORMAT " %u\n",
+    time,
+    n_segments
+  );
+
+  g_string_append_len(entry, segments->str, segments->len);
+  g_string_free(segments, TRUE);
+
+  offset = history->offset;
+  inf_text_filesystem_history_append(history, entry);
+  history->snapshot_size = entry->len;
+  history->since_snapshot = 0;
+  g_string_free(entry, TRUE);
+
+  if(history->error != NULL)
+    return;
+
+  /* The record is only written once the snapshot is complete, so that it
+   * never points to a partial snapshot. */
+  record = g_string_sized_new(INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN);
+  inf_text_filesystem_format_binary_append_uint64(record, (guint64)time);
+  inf_text_filesystem_format_binary_append_uint64(record, offset);
+
+  written = infd_filesystem_storage_stream_write(
+    history->index,
+    record->str,
+    record->len
+  );
+
+  if(written != record->len)
+    inf_text_filesystem_journal_system_error(errno, &history->error);
+
+  g_string_free(record, TRUE);
+}
+
+static void
+inf_text_filesystem_history_check_snapshot(InfTextFilesystemHistory* history,
+                                           gint64 time)
+{
+  if(history->since_snapshot >=
+     MAX(history->snapshot_size,
+         INF_TEXT_FILESYSTEM_HISTORY_MIN_SNAPSHOT_DISTANCE))
+  {
+    inf_text_filesystem_history_write_snapshot(history, time);
+  }
+}
+
+static void
+inf_text_filesystem_history_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemHistory* history;
+  GString* segments;
+  GString* entry;
+  guint n_segments;
+  gint64 time;
+
+  history = (InfTextFilesystemHistory*)user_data;
+  time = inf_text_filesystem_history_now(history);
+
+  segments = g_string_new(NULL);
+  n_segments = inf_text_filesystem_history_append_segments(segments, chunk);
+
+  entry = g_string_new(NULL);
+  g_string_printf(
+    entry,
+    "i %" G_GINT64_FORMAT " %u %u\n",
+    time,
+    pos,
+    n_segments
+  );
+
+  g_string_append_len(entry, segments->str, segments->len);
+  g_string_free(segments, TRUE);
+
+  inf_text_filesystem_history_append(history, entry);
+  g_string_free(entry, TRUE);
+
+  inf_text_filesystem_history_check_snapshot(history, time);
+}
+
+static void
+inf_text_filesystem_history_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
+{
+  InfTextFilesystemHistory* history;
+  GString* entry;
+  gint64 time;
+
+  history = (InfTextFilesystemHistory*)user_data;
+  time = inf_text_filesystem_history_now(history);
+
+  entry = g_string_new(NULL);
+  g_string_printf(
+    entry,
+    "e %" G_GINT64_FORMAT " %u %u\n",
+    time,
+    pos,
+    inf_text_chunk_get_length(chunk)
+  );
+
+  inf_text_filesystem_history_append(history, entry);
+  g_string_free(entry, TRUE);
+
+  inf_text_filesystem_history_check_snapshot(history, time);
+}
+
+static void
+inf_text_filesystem_history_no_history_error(const gchar* path,
+                                             GError** error)
+{
+  g_set_error(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_HISTORY,
+    _("There is no history of document \"%s\" for the requested time"),
+    path
+  );
+}
+
+/* Maps the file with the given identifier next to the document at path.
+ * If the file does not exist, *file is set to NULL and TRUE is returned. */
+static gboolean
+inf_text_filesystem_history_map(InfdFilesystemStorage* storage,
+                                const gchar* identifier,
+                                const gchar* path,
+                                GMappedFile** file,
+                                GError** error)
+{
+  GError* local_error;
+  gchar* full_path;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  local_error = NULL;
+  *file = g_mapped_file_new(full_path, FALSE, &local_error);
+  g_free(full_path);
+
+  if(local_error != NULL)
+  {
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns the offset of the last snapshot in the history of the document
+ * at path that was taken at or before time, or of the first entry if
+ * there is no such snapshot in the index. */
+static gboolean
+inf_text_filesystem_history_lookup(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   gint64 time,
+                                   guint64* offset,
+                                   GError** error)
+{
+  GMappedFile* index;
+  const gchar* records;
+  gsize n_records;
+  gsize begin;
+  gsize end;
+  gsize mid;
+
+  if(!inf_text_filesystem_history_map(
+       storage,
+       INF_TEXT_FILESYSTEM_HISTORY_INDEX_IDENTIFIER,
+       path,
+       &index,
+       error))
+  {
+    return FALSE;
+  }
+
+  *offset = sizeof(INF_TEXT_FILESYSTEM_HISTORY_MAGIC) - 1;
+  if(index == NULL)
+    return TRUE;
+
+  records = g_mapped_file_get_contents(index);
+  n_records = g_mapped_file_get_length(index) /
+    INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN;
+
+  /* Find the first record after time */
+  begin = 0;
+  end = n_records;
+  while(begin < end)
+  {
+    mid = begin + (end - begin) / 2;
+
+    if((gint64)inf_text_filesystem_format_binary_get_uint64(
+         records + mid * INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN) <= time)
+    {
+      begin = mid + 1;
+    }
+    else
+    {
+      end = mid;
+    }
+  }
+
+  if(begin > 0)
+  {
+    *offset = inf_text_filesystem_format_binary_get_uint64(
+      records + (begin - 1) * INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN + 8
+    );
+  }
+
+  g_mapped_file_unref(index);
+  return TRUE;
+}
+
+/* Reads the segments following an entry header at *pos into chunk at
+ * offset pos, and advances *pos behind them. If chunk is NULL, the
+ * segments are only skipped. Returns FALSE if the segments are incomplete
+ * or invalid. */
+static gboolean
+inf_text_filesystem_history_read_segments(const gchar** pos,
+                                          const gchar* end,
+                                          guint n_segments,
+                                          InfTextChunk* chunk,
+                                          guint offset)
+{
+  const gchar* newline;
+  gchar* line;
+  gchar** fields;
+  guint author;
+  guint bytes;
+  guint length;
+  glong n_chars;
+  gboolean result;
+  guint i;
+
+  for(i = 0; i < n_segments; ++i)
+  {
+    newline = memchr(*pos, '\n', end - *pos);
+    if(newline == NULL)
+      return FALSE;
+
+    line = g_strndup(*pos, newline - *pos);
+    fields = g_strsplit(line, " ", 0);
+    g_free(line);
+
+    result = g_strv_length(fields) == 3 &&
+      inf_text_filesystem_journal_parse_uint(fields[0], &author) &&
+      inf_text_filesystem_journal_parse_uint(fields[1], &bytes) &&
+      inf_text_filesystem_journal_parse_uint(fields[2], &length);
+    g_strfreev(fields);
+
+    *pos = newline + 1;
+    if(!result || (gsize)(end - *pos) <= bytes || (*pos)[bytes] != '\n')
+      return FALSE;
+
+    if(chunk != NULL)
+    {
+      if(!_inf_text_utf8_validate_count(*pos, bytes, &n_chars) ||
+         n_chars != length ||
+         offset > inf_text_chunk_get_length(chunk))
+      {
+        return FALSE;
+      }
+
+      inf_text_chunk_insert_text(chunk, offset, *pos, bytes, length, author);
+      offset += length;
+    }
+
+    *pos += bytes + 1;
+  }
+
+  return TRUE;
+}
+
+/* Reads the entry at *pos and advances *pos behind it. If its time is after
+ * end_time, or it is incomplete, FALSE is returned. If chunk is not NULL,
+ * the entry is applied to *chunk, which is replaced by the content of
+ * snapshots, and changes are only applied once a snapshot has been read.
+ * If func is not NULL and the entry is a change after begin_time, func is
+ * called for it. */
+static gboolean
+inf_text_filesystem_history_read_entry(const gchar** pos,
+                                       const gchar* end,
+                                       gint64 begin_time,
+                                       gint64 end_time,
+                                       InfTextChunk** chunk,
+                                       InfTextFilesystemHistoryFunc func,
+                                       gpointer user_data)
+{
+  const gchar* newline;
+  const gchar* payload;
+  gchar* line;
+  gchar** fields;
+  guint n_fields;
+  guint64 time;
+  guint offset;
+  guint count;
+  gboolean report;
+  gboolean result;
+  InfTextChunk* inserted;
+
+  newline = memchr(*pos, '\n', end - *pos);
+  if(newline == NULL)
+    return FALSE;
+
+  line = g_strndup(*pos, newline - *pos);
+  fields = g_strsplit(line, " ", 0);
+  n_fields = g_strv_length(fields);
+  g_free(line);
+
+  payload = newline + 1;
+  result = FALSE;
+
+  if(n_fields < 3 ||
+     !inf_text_filesystem_journal_parse_uint64(fields[1], &time) ||
+     (gint64)time > end_time)
+  {
+    g_strfreev(fields);
+    return FALSE;
+  }
+
+  report = func != NULL && (gint64)time > begin_time;
+
+  if(strcmp(fields[0], "s") == 0 && n_fields == 3 &&
+     inf_text_filesystem_journal_parse_uint(fields[2], &count))
+  {
+    if(chunk != NULL)
+    {
+      if(*chunk != NULL)
+        inf_text_chunk_free(*chunk);
+      *chunk = inf_text_chunk_new("UTF-8");
+    }
+
+    result = inf_text_filesystem_history_read_segments(
+      &payload,
+      end,
+      count,
+      chunk != NULL ? *chunk : NULL,
+      0
+    );
+  }
+  else if(strcmp(fields[0], "i") == 0 && n_fields == 4 &&
+          inf_text_filesystem_journal_parse_uint(fields[2], &offset) &&
+          inf_text_filesystem_journal_parse_uint(fields[3], &count))
+  {
+    inserted = NULL;
+    if((chunk != NULL && *chunk != NULL) || report)
+      inserted = inf_text_chunk_new("UTF-8");
+
+    result = inf_text_filesystem_history_read_segments(
+      &payload,
+      end,
+      count,
+      inserted,
+      0
+    );
+
+    if(result == TRUE && inserted != NULL)
+    {
+      if(chunk != NULL && *chunk != NULL)
+      {
+        if(offset > inf_text_chunk_get_length(*chunk))
+          result = FALSE;
+        else
+          inf_text_chunk_insert_chunk(*chunk, offset, inserted);
+      }
+
+      if(result == TRUE && report)
+      {
+        func(
+          (gint64)time,
+          offset,
+          inf_text_chunk_get_length(inserted),
+          inserted,
+          user_data
+        );
+      }
+    }
+
+    if(inserted != NULL)
+      inf_text_chunk_free(inserted);
+  }
+  else if(strcmp(fields[0], "e") == 0 && n_fields == 4 &&
+          inf_text_filesystem_journal_parse_uint(fields[2], &offset) &&
+          inf_text_filesystem_journal_parse_uint(fields[3], &count))
+  {
+    result = TRUE;
+    if(chunk != NULL && *chunk != NULL)
+    {
+      if(offset + count > inf_text_chunk_get_length(*chunk))
+        result = FALSE;
+      else
+        inf_text_chunk_erase(*chunk, offset, count);
+    }
+
+    if(result == TRUE && report)
+      func((gint64)time, offset, count, NULL, user_data);
+  }
+
+  g_strfreev(fields);
+
+  if(result == TRUE)
+    *pos = payload;
+
+  return result;
+}
+
+/* Reads the history of the document at path from the last snapshot at or
+ * before begin_time up to end_time. See
+ * inf_text_filesystem_history_read_entry() for chunk, func and
+ * user_data. */
+static gboolean
+inf_text_filesystem_history_read(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 gint64 begin_time,
+                                 gint64 end_time,
+                                 InfTextChunk** chunk,
+                                 InfTextFilesystemHistoryFunc func,
+                                 gpointer user_data,
+                                 GError** error)
+{
+  GMappedFile* file;
+  guint64 offset;
+  const gchar* pos;
+  const gchar* end;
+
+  if(!inf_text_filesystem_history_lookup(
+       storage, path, begin_time, &offset, error))
+  {
+    return FALSE;
+  }
+
+  if(!inf_text_filesystem_history_map(
+       storage,
+       INF_TEXT_FILESYSTEM_HISTORY_IDENTIFIER,
+       path,
+       &file,
+       error))
+  {
+    return FALSE;
+  }
+
+  if(file == NULL)
+  {
+    inf_text_filesystem_history_no_history_error(path, error);
+    return FALSE;
+  }
+
+  pos = g_mapped_file_get_contents(file);
+  end = pos + g_mapped_file_get_length(file);
+
+  if((gsize)(end - pos) < offset ||
+     strncmp(pos, INF_TEXT_FILESYSTEM_HISTORY_MAGIC,
+             MIN((gsize)(end - pos),
+                 sizeof(INF_TEXT_FILESYSTEM_HISTORY_MAGIC) - 1)) != 0)
+  {
+    g_mapped_file_unref(file);
+    inf_text_filesystem_history_no_history_error(path, error);
+    return FALSE;
+  }
+
+  /* Entries behind a corrupted one cannot be found without the index, so
+   * stop there. */
+  pos += offset;
+  while(pos < end)
+  {
+    if(!inf_text_filesystem_history_read_entry(
+         &pos, end, begin_time, end_time, chunk, func, user_data))
+    {
+      break;
+    }
+  }
+
+  g_mapped_file_unref(file);
+  return TRUE;
+}
+
+/* A crash while writing a record can leave a partial one at the end of the
+ * index, which would shift all records appended behind it. This cuts it
+ * off and opens the index for appending again. */
+static FILE*
+inf_text_filesystem_history_repair_index(InfdFilesystemStorage* storage,
+                                         const gchar* path,
+                                         FILE* index,
+                                         const gchar* full_path,
+                                         GError** error)
+{
+  gchar* contents;
+  gsize length;
+  gboolean result;
+
+  infd_filesystem_storage_stream_close(index);
+
+  if(!g_file_get_contents(full_path, &contents, &length, error))
+    return NULL;
+
+  result = g_file_set_contents(
+    full_path,
+    contents,
+    length - length % INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN,
+    error
+  );
+
+  g_free(contents);
+  if(result == FALSE)
+    return NULL;
+
+  return infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_HISTORY_INDEX_IDENTIFIER,
+    path,
+    "a",
+    NULL,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_history_open:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document.
+ * @session: The #InfTextSession for the document at @path.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Starts recording the history of the document at @path. Every change made
+ * to the buffer of @session is appended to a history file next to the
+ * document, together with the time at which it was made, and the full
+ * document is stored in the history from time to time. Unlike the journal,
+ * the history is never emptied, and it can be used to look at the document
+ * as it was at any point in time since the history has been recorded, with
+ * inf_text_filesystem_history_get_text() and
+ * inf_text_filesystem_history_foreach_change().
+ *
+ * The current content of the document is stored in the history when it is
+ * opened, so the history stays correct even if the document has been
+ * changed while no history was recorded.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemHistory, to be closed
+ * with inf_text_filesystem_history_close(), or %NULL on error.
+ */
+InfTextFilesystemHistory*
+inf_text_filesystem_history_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfTextSession* session,
+                                 GError** error)
+{
+  InfTextFilesystemHistory* history;
+  FILE* stream;
+  FILE* index;
+  gchar* index_path;
+  long size;
+  gsize written;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_TEXT_IS_SESSION(session), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_HISTORY_IDENTIFIER,
+    path,
+    "a",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return NULL;
+
+  index_path = NULL;
+  index = infd_filesystem_storage_open(
+    storage,
+    INF_TEXT_FILESYSTEM_HISTORY_INDEX_IDENTIFIER,
+    path,
+    "a",
+    &index_path,
+    error
+  );
+
+  if(index == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    g_free(index_path);
+    return NULL;
+  }
+
+  size = -1;
+  if(fseek(index, 0, SEEK_END) == 0)
+    size = ftell(index);
+
+  if(size < 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    infd_filesystem_storage_stream_close(index);
+    infd_filesystem_storage_stream_close(stream);
+    g_free(index_path);
+    return NULL;
+  }
+
+  if(size % INF_TEXT_FILESYSTEM_HISTORY_INDEX_RECORD_LEN != 0)
+  {
+    index = inf_text_filesystem_history_repair_index(
+      storage,
+      path,
+      index,
+      index_path,
+      error
+    );
+
+    if(index == NULL)
+    {
+      infd_filesystem_storage_stream_close(stream);
+      g_free(index_path);
+      return NULL;
+    }
+  }
+
+  g_free(index_path);
+
+  setvbuf(stream, NULL, _IONBF, 0);
+  setvbuf(index, NULL, _IONBF, 0);
+
+  size = -1;
+  if(fseek(stream, 0, SEEK_END) == 0)
+    size = ftell(stream);
+
+  if(size < 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    infd_filesystem_storage_stream_close(index);
+    infd_filesystem_storage_stream_close(stream);
+    return NULL;
+  }
+
+  if(size == 0)
+  {
+    written = infd_filesystem_storage_stream_write(
+      stream,
+      INF_TEXT_FILESYSTEM_HISTORY_MAGIC,
+      sizeof(INF_TEXT_FILESYSTEM_HISTORY_MAGIC) - 1
+    );
+
+    if(written != sizeof(INF_TEXT_FILESYSTEM_HISTORY_MAGIC) - 1)
+    {
+      inf_text_filesystem_journal_system_error(errno, error);
+      infd_filesystem_storage_stream_close(index);
+      infd_filesystem_storage_stream_close(stream);
+      return NULL;
+    }
+
+    size = written;
+  }
+
+  history = g_slice_new(InfTextFilesystemHistory);
+  history->buffer =
+    INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  history->stream = stream;
+  history->index = index;
+  history->offset = (guint64)size;
+  history->snapshot_size = 0;
+  history->since_snapshot = 0;
+  history->last_time = 0;
+  history->dirty = FALSE;
+  history->error = NULL;
+
+  g_object_ref(history->buffer);
+
+  inf_text_filesystem_history_write_snapshot(
+    history,
+    inf_text_filesystem_history_now(history)
+  );
+
+  if(history->error != NULL)
+  {
+    g_propagate_error(error, history->error);
+    history->error = NULL;
+
+    inf_text_filesystem_history_close(history);
+    return NULL;
+  }
+
+  g_signal_connect_after(
+    G_OBJECT(history->buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_history_text_inserted_cb),
+    history
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(history->buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_history_text_erased_cb),
+    history
+  );
+
+  return history;
+}
+
+/**
+ * inf_text_filesystem_history_sync:
+ * @history: A #InfTextFilesystemHistory.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Makes sure that all changes recorded in @history so far have reached the
+ * disk, see inf_text_filesystem_journal_sync().
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_history_sync(InfTextFilesystemHistory* history,
+                                 GError** error)
+{
+  g_return_val_if_fail(history != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(history->error != NULL)
+  {
+    g_propagate_error(error, history->error);
+    history->error = NULL;
+    return FALSE;
+  }
+
+  if(history->dirty == FALSE)
+    return TRUE;
+
+  if(infd_filesystem_storage_stream_sync(history->stream) != 0 ||
+     infd_filesystem_storage_stream_sync(history->index) != 0)
+  {
+    inf_text_filesystem_journal_system_error(errno, error);
+    return FALSE;
+  }
+
+  history->dirty = FALSE;
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_history_close:
+ * @history: A #InfTextFilesystemHistory.
+ *
+ * Stops recording changes in @history and closes the history files. Call
+ * inf_text_filesystem_history_sync() before this function to make sure all
+ * changes have reached the disk.
+ */
+void
+inf_text_filesystem_history_close(InfTextFilesystemHistory* history)
+{
+  g_return_if_fail(history != NULL);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(history->buffer),
+    G_CALLBACK(inf_text_filesystem_history_text_inserted_cb),
+    history
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(history->buffer),
+    G_CALLBACK(inf_text_filesystem_history_text_erased_cb),
+    history
+  );
+
+  infd_filesystem_storage_stream_close(history->index);
+  infd_filesystem_storage_stream_close(history->stream);
+
+  if(history->error != NULL)
+    g_error_free(history->error);
+
+  g_object_unref(history->buffer);
+  g_slice_free(InfTextFilesystemHistory, history);
+}
+
+/**
+ * inf_text_filesystem_history_get_text:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document.
+ * @time: The point in time, in microseconds since the epoch, as returned by
+ * g_get_real_time().
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Returns the content of the document at @path as it was at @time,
+ * according to its history as recorded by #InfTextFilesystemHistory. Only
+ * the changes since the last snapshot of the document before @time need to
+ * be read, which are found with an index by time, so this does not depend
+ * on the length of the history. If the history does not reach back to
+ * @time, an error with code %INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_HISTORY is
+ * returned.
+ *
+ * Returns: (transfer full): A new #InfTextChunk in UTF-8 with the content
+ * of the document, to be freed with inf_text_chunk_free(), or %NULL on
+ * error.
+ */
+InfTextChunk*
+inf_text_filesystem_history_get_text(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     gint64 time,
+                                     GError** error)
+{
+  InfTextChunk* chunk;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  chunk = NULL;
+  if(!inf_text_filesystem_history_read(
+       storage, path, time, time, &chunk, NULL, NULL, error))
+  {
+    return NULL;
+  }
+
+  if(chunk == NULL)
+    inf_text_filesystem_history_no_history_error(path, error);
+
+  return chunk;
+}
+
+/**
+ * inf_text_filesystem_history_foreach_change:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document.
+ * @begin_time: Changes made after this time are reported.
+ * @end_time: Changes made up to this time are reported.
+ * @func: (scope call): The function to call for each change.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Calls @func for every change that has been made to the document at @path
+ * after @begin_time and up to @end_time, in the order in which they were
+ * made, according to its history as recorded by #InfTextFilesystemHistory.
+ * Together with inf_text_filesystem_history_get_text() for @begin_time,
+ * this shows how the document changed between the two points in time.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_history_foreach_change(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           gint64 begin_time,
+                                           gint64 end_time,
+                                           InfTextFilesystemHistoryFunc func,
+                                           gpointer user_data,
+                                           GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  return inf_text_filesystem_history_read(
+    storage,
+    path,
+    begin_time,
+    end_time,
+    NULL,
+    func,
+    user_data,
+    error
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
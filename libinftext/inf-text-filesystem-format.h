@@ -35,6 +35,8 @@ G_BEGIN_DECLS
  * session contains users with duplicate ID or duplicate name.
  * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER: A segment of the text
  * document is written by a user which does not exist.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_HISTORY: The history of the document
+ * does not reach back to the requested point in time.
  *
  * Errors that can occur when reading a #InfTextSession from a
  * #InfdFilesystemStorage.
@@ -42,9 +44,45 @@ G_BEGIN_DECLS
 typedef enum _InfTextFilesystemFormatError {
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_HISTORY
 } InfTextFilesystemFormatError;
 
+/**
+ * InfTextFilesystemJournal:
+ *
+ * #InfTextFilesystemJournal is an opaque data type. You should only access
+ * it via the public API functions.
+ */
+typedef struct _InfTextFilesystemJournal InfTextFilesystemJournal;
+
+/**
+ * InfTextFilesystemHistory:
+ *
+ * #InfTextFilesystemHistory is an opaque data type. You should only access
+ * it via the public API functions.
+ */
+typedef struct _InfTextFilesystemHistory InfTextFilesystemHistory;
+
+/**
+ * InfTextFilesystemHistoryFunc:
+ * @time: The time at which the change was made, in microseconds since the
+ * epoch.
+ * @pos: The character offset at which the change was made.
+ * @len: The number of characters inserted or erased.
+ * @text: (allow-none): The inserted text, or %NULL if text was erased.
+ * @user_data: User data passed to
+ * inf_text_filesystem_history_foreach_change().
+ *
+ * This is the prototype of the callback function passed to
+ * inf_text_filesystem_history_foreach_change().
+ */
+typedef void(*InfTextFilesystemHistoryFunc)(gint64 time,
+                                            guint pos,
+                                            guint len,
+                                            InfTextChunk* text,
+                                            gpointer user_data);
+
 gboolean
 inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
                                 const gchar* path,
@@ -59,6 +97,77 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
                                  InfTextBuffer* buffer,
                                  GError** error);
 
+gboolean
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfdFilesystemStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
+gboolean
+inf_text_filesystem_format_write_binary(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        GError** error);
+
+gboolean
+inf_text_filesystem_format_write_binary_async(InfdFilesystemStorage* storage,
+                                              InfIo* io,
+                                              const gchar* path,
+                                              InfUserTable* user_table,
+                                              InfTextBuffer* buffer,
+                                              InfdFilesystemStorageWriteFunc func,
+                                              gpointer user_data,
+                                              GError** error);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfTextSession* session,
+                                 GError** error);
+
+gboolean
+inf_text_filesystem_journal_sync(InfTextFilesystemJournal* journal,
+                                 GError** error);
+
+gsize
+inf_text_filesystem_journal_get_size(InfTextFilesystemJournal* journal);
+
+void
+inf_text_filesystem_journal_close(InfTextFilesystemJournal* journal);
+
+InfTextFilesystemHistory*
+inf_text_filesystem_history_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfTextSession* session,
+                                 GError** error);
+
+gboolean
+inf_text_filesystem_history_sync(InfTextFilesystemHistory* history,
+                                 GError** error);
+
+void
+inf_text_filesystem_history_close(InfTextFilesystemHistory* history);
+
+InfTextChunk*
+inf_text_filesystem_history_get_text(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     gint64 time,
+                                     GError** error);
+
+gboolean
+inf_text_filesystem_history_foreach_change(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           gint64 begin_time,
+                                           gint64 end_time,
+                                           InfTextFilesystemHistoryFunc func,
+                                           gpointer user_data,
+                                           GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_FILESYSTEM_FORMAT_H__ */
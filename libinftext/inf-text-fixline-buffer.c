@@ -1081,6 +1081,18 @@ inf_text_fixline_buffer_buffer_set_modified(InfBuffer* buffer,
   inf_buffer_set_modified(INF_BUFFER(priv->buffer), modified);
 }
 
+static gsize
+inf_text_fixline_buffer_buffer_get_size(InfBuffer* buffer)
+{
+  InfTextFixlineBuffer* fixline_buffer;
+  InfTextFixlineBufferPrivate* priv;
+
+  fixline_buffer = INF_TEXT_FIXLINE_BUFFER(buffer);
+  priv = INF_TEXT_FIXLINE_BUFFER_PRIVATE(fixline_buffer);
+
+  return inf_buffer_get_size(INF_BUFFER(priv->buffer));
+}
+
 static const gchar*
 inf_text_fixline_buffer_buffer_get_encoding(InfTextBuffer* buffer)
 {
@@ -1777,6 +1789,7 @@ inf_text_fixline_buffer_buffer_iface_init(InfBufferInterface* iface)
 {
   iface->get_modified = inf_text_fixline_buffer_buffer_get_modified;
   iface->set_modified = inf_text_fixline_buffer_buffer_set_modified;
+  iface->get_size = inf_text_fixline_buffer_buffer_get_size;
 }
 
 static void
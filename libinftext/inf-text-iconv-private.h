@@ -0,0 +1,55 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_ICONV_PRIVATE_H__
+#define __INF_TEXT_ICONV_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Conversion descriptors are kept around after use, so that converting
+ * text of a request does not need to open a new one every time. A
+ * descriptor obtained with _inf_text_iconv_open() is used by only one
+ * thread at a time, and it is returned with _inf_text_iconv_close(), with
+ * the same codesets. */
+
+GIConv
+_inf_text_iconv_open(const gchar* to_codeset,
+                     const gchar* from_codeset);
+
+void
+_inf_text_iconv_close(const gchar* to_codeset,
+                      const gchar* from_codeset,
+                      GIConv cd);
+
+gchar*
+_inf_text_iconv_convert(const gchar* str,
+                        gsize len,
+                        const gchar* to_codeset,
+                        const gchar* from_codeset,
+                        gsize* bytes_read,
+                        gsize* bytes_written,
+                        GError** error);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_ICONV_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
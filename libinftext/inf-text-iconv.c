@@ -0,0 +1,201 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-iconv-private.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <string.h>
+
+/* Number of unused conversion descriptors that are kept per pair of
+ * codesets. More than one is only needed when several threads convert text
+ * at the same time. */
+#define INF_TEXT_ICONV_MAX_IDLE 4
+
+/* Codeset pairs whose names do not fit are not cached. */
+#define INF_TEXT_ICONV_KEY_SIZE 64
+
+typedef struct _InfTextIconvPool InfTextIconvPool;
+struct _InfTextIconvPool {
+  GIConv idle[INF_TEXT_ICONV_MAX_IDLE];
+  guint n_idle;
+};
+
+/* Maps "to:from" to InfTextIconvPool. The pools live until the process
+ * exits, each holding at most INF_TEXT_ICONV_MAX_IDLE descriptors, and
+ * only few different codesets are used in practice. */
+static GHashTable* inf_text_iconv_pools;
+G_LOCK_DEFINE_STATIC(inf_text_iconv_pools);
+
+static gboolean
+inf_text_iconv_make_key(gchar* key,
+                        const gchar* to_codeset,
+                        const gchar* from_codeset)
+{
+  gint len;
+
+  len = g_snprintf(
+    key,
+    INF_TEXT_ICONV_KEY_SIZE,
+    "%s:%s",
+    to_codeset,
+    from_codeset
+  );
+
+  return len < INF_TEXT_ICONV_KEY_SIZE;
+}
+
+GIConv
+_inf_text_iconv_open(const gchar* to_codeset,
+                     const gchar* from_codeset)
+{
+  gchar key[INF_TEXT_ICONV_KEY_SIZE];
+  InfTextIconvPool* pool;
+  GIConv cd;
+
+  cd = (GIConv)-1;
+
+  if(inf_text_iconv_make_key(key, to_codeset, from_codeset))
+  {
+    G_LOCK(inf_text_iconv_pools);
+
+    if(inf_text_iconv_pools != NULL)
+    {
+      pool = g_hash_table_lookup(inf_text_iconv_pools, key);
+      if(pool != NULL && pool->n_idle > 0)
+        cd = pool->idle[--pool->n_idle];
+    }
+
+    G_UNLOCK(inf_text_iconv_pools);
+  }
+
+  if(cd == (GIConv)-1)
+    cd = g_iconv_open(to_codeset, from_codeset);
+
+  return cd;
+}
+
+void
+_inf_text_iconv_close(const gchar* to_codeset,
+                      const gchar* from_codeset,
+                      GIConv cd)
+{
+  gchar key[INF_TEXT_ICONV_KEY_SIZE];
+  InfTextIconvPool* pool;
+
+  /* Reset the conversion state for the next user */
+  g_iconv(cd, NULL, NULL, NULL, NULL);
+
+  if(inf_text_iconv_make_key(key, to_codeset, from_codeset))
+  {
+    G_LOCK(inf_text_iconv_pools);
+
+    if(inf_text_iconv_pools == NULL)
+    {
+      inf_text_iconv_pools =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    pool = g_hash_table_lookup(inf_text_iconv_pools, key);
+    if(pool == NULL)
+    {
+      pool = g_new0(InfTextIconvPool, 1);
+      g_hash_table_insert(inf_text_iconv_pools, g_strdup(key), pool);
+    }
+
+    if(pool->n_idle < INF_TEXT_ICONV_MAX_IDLE)
+    {
+      pool->idle[pool->n_idle++] = cd;
+      cd = (GIConv)-1;
+    }
+
+    G_UNLOCK(inf_text_iconv_pools);
+  }
+
+  if(cd != (GIConv)-1)
+    g_iconv_close(cd);
+}
+
+/* Works like g_convert(), but uses a cached conversion descriptor, and does
+ * not look at iconv at all if both codesets are UTF-8. */
+gchar*
+_inf_text_iconv_convert(const gchar* str,
+                        gsize len,
+                        const gchar* to_codeset,
+                        const gchar* from_codeset,
+                        gsize* bytes_read,
+                        gsize* bytes_written,
+                        GError** error)
+{
+  const gchar* end;
+  GIConv cd;
+  gchar* result;
+
+  if(strcmp(to_codeset, "UTF-8") == 0 && strcmp(from_codeset, "UTF-8") == 0)
+  {
+    if(!g_utf8_validate(str, len, &end))
+    {
+      if(bytes_read != NULL)
+        *bytes_read = end - str;
+
+      g_set_error_literal(
+        error,
+        G_CONVERT_ERROR,
+        G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+        _("Invalid byte sequence in conversion input")
+      );
+
+      return NULL;
+    }
+
+    if(bytes_read != NULL) *bytes_read = len;
+    if(bytes_written != NULL) *bytes_written = len;
+    return g_strndup(str, len);
+  }
+
+  cd = _inf_text_iconv_open(to_codeset, from_codeset);
+  if(cd == (GIConv)-1)
+  {
+    g_set_error(
+      error,
+      G_CONVERT_ERROR,
+      G_CONVERT_ERROR_NO_CONVERSION,
+      _("Conversion from character set \"%s\" to \"%s\" is not supported"),
+      from_codeset,
+      to_codeset
+    );
+
+    if(bytes_read != NULL) *bytes_read = 0;
+    if(bytes_written != NULL) *bytes_written = 0;
+    return NULL;
+  }
+
+  result = g_convert_with_iconv(
+    str,
+    len,
+    cd,
+    bytes_read,
+    bytes_written,
+    error
+  );
+
+  _inf_text_iconv_close(to_codeset, from_codeset, cd);
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
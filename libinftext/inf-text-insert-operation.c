@@ -19,6 +19,7 @@
 
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
+#include <libinftext/inf-text-operations-private.h>
 
 G_DEFINE_INTERFACE(InfTextInsertOperation, inf_text_insert_operation, INF_ADOPTED_TYPE_OPERATION)
 
@@ -102,41 +103,28 @@ inf_text_insert_operation_need_concurrency_id(InfTextInsertOperation* op,
   return FALSE;
 }
 
-/**
- * inf_text_insert_operation_transform_insert:
- * @operation: A #InfTextInsertOperation.
- * @against: Another #InfTextInsertOperation.
- * @op_lcs: The given operation in a previous state, or %NULL.
- * @ag_lcs: The @against operation in a previous state, or %NULL.
- * @cid: The concurrency ID for the transformation.
- *
- * Returns a new operation that includes the effect of @against into
- * @operation.
- *
- * Returns: (transfer full): A new #InfAdoptedOperation.
- **/
+/* Like inf_text_insert_operation_transform_insert(), but without checking the
+ * arguments, which the caller has made sure of. */
 InfAdoptedOperation*
-inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
-                                           InfTextInsertOperation* against,
-                                           InfTextInsertOperation* op_lcs,
-                                           InfTextInsertOperation* ag_lcs,
-                                           InfAdoptedConcurrencyId cid)
+_inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
+                                            InfTextInsertOperation* against,
+                                            InfTextInsertOperation* op_lcs,
+                                            InfTextInsertOperation* ag_lcs,
+                                            InfAdoptedConcurrencyId cid)
 {
   InfTextInsertOperationInterface* iface;
+  InfTextInsertOperationInterface* against_iface;
   guint op_pos;
   guint against_pos;
   guint op_lcs_pos;
   guint against_lcs_pos;
   guint against_length;
 
-  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(operation), NULL);
-  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(against), NULL);
-
   iface = INF_TEXT_INSERT_OPERATION_GET_IFACE(operation);
-  g_return_val_if_fail(iface->transform_position != NULL, NULL);
+  against_iface = INF_TEXT_INSERT_OPERATION_GET_IFACE(against);
 
-  op_pos = inf_text_insert_operation_get_position(operation);
-  against_pos = inf_text_insert_operation_get_position(against);
+  op_pos = iface->get_position(operation);
+  against_pos = against_iface->get_position(against);
 
   if(op_pos < against_pos)
   {
@@ -144,7 +132,7 @@ inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
   }
   else if(op_pos > against_pos)
   {
-    against_length = inf_text_insert_operation_get_length(against);
+    against_length = against_iface->get_length(against);
 
     return INF_ADOPTED_OPERATION(
       iface->transform_position(operation, op_pos + against_length)
@@ -168,7 +156,7 @@ inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
             (op_lcs_pos == against_lcs_pos &&
              cid == INF_ADOPTED_CONCURRENCY_SELF))
     {
-      against_length = inf_text_insert_operation_get_length(against);
+      against_length = against_iface->get_length(against);
 
       return INF_ADOPTED_OPERATION(
         iface->transform_position(operation, op_pos + against_length)
@@ -183,9 +171,12 @@ inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
 }
 
 /**
- * inf_text_insert_operation_transform_delete:
+ * inf_text_insert_operation_transform_insert:
  * @operation: A #InfTextInsertOperation.
- * @against: A #InfTextDeleteOperation.
+ * @against: Another #InfTextInsertOperation.
+ * @op_lcs: The given operation in a previous state, or %NULL.
+ * @ag_lcs: The @against operation in a previous state, or %NULL.
+ * @cid: The concurrency ID for the transformation.
  *
  * Returns a new operation that includes the effect of @against into
  * @operation.
@@ -193,23 +184,46 @@ inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
  * Returns: (transfer full): A new #InfAdoptedOperation.
  **/
 InfAdoptedOperation*
-inf_text_insert_operation_transform_delete(InfTextInsertOperation* operation,
-                                           InfTextDeleteOperation* against)
+inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
+                                           InfTextInsertOperation* against,
+                                           InfTextInsertOperation* op_lcs,
+                                           InfTextInsertOperation* ag_lcs,
+                                           InfAdoptedConcurrencyId cid)
+{
+  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(operation), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(against), NULL);
+  g_return_val_if_fail(
+    INF_TEXT_INSERT_OPERATION_GET_IFACE(operation)->transform_position != NULL,
+    NULL
+  );
+
+  return _inf_text_insert_operation_transform_insert(
+    operation,
+    against,
+    op_lcs,
+    ag_lcs,
+    cid
+  );
+}
+
+/* Like inf_text_insert_operation_transform_delete(), but without checking the
+ * arguments, which the caller has made sure of. */
+InfAdoptedOperation*
+_inf_text_insert_operation_transform_delete(InfTextInsertOperation* operation,
+                                            InfTextDeleteOperation* against)
 {
   InfTextInsertOperationInterface* iface;
+  InfTextDeleteOperationInterface* against_iface;
   guint own_pos;
   guint other_pos;
   guint other_len;
 
-  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(operation), NULL);
-  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(against), NULL);
-
   iface = INF_TEXT_INSERT_OPERATION_GET_IFACE(operation);
-  g_return_val_if_fail(iface->transform_position != NULL, NULL);
+  against_iface = INF_TEXT_DELETE_OPERATION_GET_IFACE(against);
 
-  own_pos = inf_text_insert_operation_get_position(operation);
-  other_pos = inf_text_delete_operation_get_position(against);
-  other_len = inf_text_delete_operation_get_length(against);
+  own_pos = iface->get_position(operation);
+  other_pos = against_iface->get_position(against);
+  other_len = against_iface->get_length(against);
 
   if(own_pos >= other_pos + other_len)
   {
@@ -229,4 +243,28 @@ inf_text_insert_operation_transform_delete(InfTextInsertOperation* operation,
   }
 }
 
+/**
+ * inf_text_insert_operation_transform_delete:
+ * @operation: A #InfTextInsertOperation.
+ * @against: A #InfTextDeleteOperation.
+ *
+ * Returns a new operation that includes the effect of @against into
+ * @operation.
+ *
+ * Returns: (transfer full): A new #InfAdoptedOperation.
+ **/
+InfAdoptedOperation*
+inf_text_insert_operation_transform_delete(InfTextInsertOperation* operation,
+                                           InfTextDeleteOperation* against)
+{
+  g_return_val_if_fail(INF_TEXT_IS_INSERT_OPERATION(operation), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_DELETE_OPERATION(against), NULL);
+  g_return_val_if_fail(
+    INF_TEXT_INSERT_OPERATION_GET_IFACE(operation)->transform_position != NULL,
+    NULL
+  );
+
+  return _inf_text_insert_operation_transform_delete(operation, against);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -0,0 +1,848 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-text-line-index
+ * @title: InfTextLineIndex
+ * @short_description: Conversion between offsets and lines
+ * @include: libinftext/inf-text-line-index.h
+ * @see_also: #InfTextBuffer
+ * @stability: Unstable
+ *
+ * #InfTextLineIndex keeps track of where the lines of a #InfTextBuffer
+ * start, and allows to convert a character offset into a line and column,
+ * and back. It connects to the #InfTextBuffer::text-inserted and
+ * #InfTextBuffer::text-erased signals of the buffer and updates itself
+ * with the changed text only, so that neither the conversions nor keeping
+ * the index up to date need to look at the whole buffer. All conversions
+ * run in logarithmic time in the number of lines.
+ *
+ * Lines are separated by newline characters ('\n'), which belong to the
+ * line they terminate. The last line has no newline character, so a buffer
+ * always has one line more than it has newline characters. The buffer
+ * needs to be encoded in UTF-8.
+ **/
+
+#include <libinftext/inf-text-line-index.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinfinity/inf-signals.h>
+
+#include <string.h>
+
+/* The lines are kept in a treap which is ordered by line number and heap
+ * ordered by a random priority, like the segments in InfTextRopeBuffer.
+ * Every node stores the length of one line, and the total length and
+ * number of lines of its subtree, so that both a line number and a
+ * character offset can be found by descending from the root. */
+typedef struct _InfTextLineIndexNode InfTextLineIndexNode;
+struct _InfTextLineIndexNode {
+  InfTextLineIndexNode* left;
+  InfTextLineIndexNode* right;
+  guint32 priority;
+
+  guint length; /* in characters, including the newline character */
+
+  /* Totals for the subtree rooted at this node, including the node */
+  guint total_length;
+  guint total_nodes;
+};
+
+typedef struct _InfTextLineIndexPrivate InfTextLineIndexPrivate;
+struct _InfTextLineIndexPrivate {
+  InfTextBuffer* buffer;
+  InfTextLineIndexNode* root;
+};
+
+enum {
+  PROP_0,
+
+  PROP_BUFFER
+};
+
+#define INF_TEXT_LINE_INDEX_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_LINE_INDEX, InfTextLineIndexPrivate))
+
+G_DEFINE_TYPE_WITH_CODE(InfTextLineIndex, inf_text_line_index, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfTextLineIndex))
+
+/*
+ * Tree management
+ */
+
+static InfTextLineIndexNode*
+inf_text_line_index_node_new(guint length)
+{
+  InfTextLineIndexNode* node;
+
+  node = g_slice_new(InfTextLineIndexNode);
+  node->left = NULL;
+  node->right = NULL;
+  node->priority = g_random_int();
+  node->length = length;
+  node->total_length = length;
+  node->total_nodes = 1;
+
+  return node;
+}
+
+static void
+inf_text_line_index_node_free(InfTextLineIndexNode* node)
+{
+  if(node != NULL)
+  {
+    inf_text_line_index_node_free(node->left);
+    inf_text_line_index_node_free(node->right);
+    g_slice_free(InfTextLineIndexNode, node);
+  }
+}
+
+static void
+inf_text_line_index_node_update(InfTextLineIndexNode* node)
+{
+  node->total_length = node->length;
+  node->total_nodes = 1;
+
+  if(node->left != NULL)
+  {
+    node->total_length += node->left->total_length;
+    node->total_nodes += node->left->total_nodes;
+  }
+
+  if(node->right != NULL)
+  {
+    node->total_length += node->right->total_length;
+    node->total_nodes += node->right->total_nodes;
+  }
+}
+
+/* Concatenates the two trees, all lines of first coming before second */
+static InfTextLineIndexNode*
+inf_text_line_index_merge(InfTextLineIndexNode* first,
+                          InfTextLineIndexNode* second)
+{
+  if(first == NULL) return second;
+  if(second == NULL) return first;
+
+  if(first->priority > second->priority)
+  {
+    first->right = inf_text_line_index_merge(first->right, second);
+    inf_text_line_index_node_update(first);
+    return first;
+  }
+  else
+  {
+    second->left = inf_text_line_index_merge(first, second->left);
+    inf_text_line_index_node_update(second);
+    return second;
+  }
+}
+
+/* Splits the tree into one holding the first n_lines lines, and one holding
+ * the rest. */
+static void
+inf_text_line_index_split(InfTextLineIndexNode* node,
+                          guint n_lines,
+                          InfTextLineIndexNode** first,
+                          InfTextLineIndexNode** second)
+{
+  guint left_nodes;
+
+  if(node == NULL)
+  {
+    *first = NULL;
+    *second = NULL;
+    return;
+  }
+
+  left_nodes = node->left != NULL ? node->left->total_nodes : 0;
+  if(n_lines <= left_nodes)
+  {
+    inf_text_line_index_split(node->left, n_lines, first, &node->left);
+    inf_text_line_index_node_update(node);
+    *second = node;
+  }
+  else
+  {
+    inf_text_line_index_split(
+      node->right,
+      n_lines - left_nodes - 1,
+      &node->right,
+      second
+    );
+
+    inf_text_line_index_node_update(node);
+    *first = node;
+  }
+}
+
+/* Returns the node of the line containing the character at offset, and
+ * sets line and column accordingly. If offset is the length of the buffer,
+ * this is the last line. */
+static InfTextLineIndexNode*
+inf_text_line_index_node_find(InfTextLineIndexNode* node,
+                              guint offset,
+                              guint* line,
+                              guint* column)
+{
+  guint left_length;
+  guint left_nodes;
+
+  *line = 0;
+  for(;;)
+  {
+    left_length = node->left != NULL ? node->left->total_length : 0;
+    left_nodes = node->left != NULL ? node->left->total_nodes : 0;
+
+    if(offset < left_length)
+    {
+      node = node->left;
+    }
+    else if(offset < left_length + node->length || node->right == NULL)
+    {
+      *line += left_nodes;
+      *column = offset - left_length;
+      return node;
+    }
+    else
+    {
+      *line += left_nodes + 1;
+      offset -= left_length + node->length;
+      node = node->right;
+    }
+  }
+}
+
+/* Returns the node of the given line, and sets offset to where it
+ * starts. */
+static InfTextLineIndexNode*
+inf_text_line_index_node_nth(InfTextLineIndexNode* node,
+                             guint line,
+                             guint* offset)
+{
+  guint left_nodes;
+
+  *offset = 0;
+  for(;;)
+  {
+    left_nodes = node->left != NULL ? node->left->total_nodes : 0;
+
+    if(line < left_nodes)
+    {
+      node = node->left;
+    }
+    else
+    {
+      if(node->left != NULL)
+        *offset += node->left->total_length;
+
+      if(line == left_nodes)
+        return node;
+
+      *offset += node->length;
+      line -= left_nodes + 1;
+      node = node->right;
+    }
+  }
+}
+
+/* Changes the length of the line containing offset by delta characters.
+ * This does not change the shape of the tree, so it just updates the totals
+ * on the way down. */
+static void
+inf_text_line_index_node_resize(InfTextLineIndexNode* node,
+                                guint offset,
+                                gint delta)
+{
+  guint left_length;
+
+  for(;;)
+  {
+    left_length = node->left != NULL ? node->left->total_length : 0;
+    node->total_length += delta;
+
+    if(offset < left_length)
+    {
+      node = node->left;
+    }
+    else if(offset < left_length + node->length || node->right == NULL)
+    {
+      node->length += delta;
+      return;
+    }
+    else
+    {
+      offset -= left_length + node->length;
+      node = node->right;
+    }
+  }
+}
+
+/* Appends the lengths of all lines that are terminated within text to
+ * lengths, the first one being continued from current. Afterwards,
+ * current is the length of the unterminated rest. */
+static void
+inf_text_line_index_scan(const gchar* text,
+                         gsize bytes,
+                         GArray* lengths,
+                         guint* current)
+{
+  const gchar* end;
+  const gchar* newline;
+
+  end = text + bytes;
+  while((newline = memchr(text, '\n', end - text)) != NULL)
+  {
+    *current += g_utf8_strlen(text, newline - text) + 1;
+    g_array_append_val(lengths, *current);
+
+    *current = 0;
+    text = newline + 1;
+  }
+
+  *current += g_utf8_strlen(text, end - text);
+}
+
+static void
+inf_text_line_index_scan_chunk(InfTextChunk* chunk,
+                               GArray* lengths,
+                               guint* current)
+{
+  InfTextChunkIter iter;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      inf_text_line_index_scan(
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter),
+        lengths,
+        current
+      );
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+}
+
+static InfTextLineIndexNode*
+inf_text_line_index_tree_from_lengths(const guint* lengths,
+                                      guint n_lengths)
+{
+  InfTextLineIndexNode* tree;
+  guint i;
+
+  tree = NULL;
+  for(i = 0; i < n_lengths; ++i)
+  {
+    tree = inf_text_line_index_merge(
+      tree,
+      inf_text_line_index_node_new(lengths[i])
+    );
+  }
+
+  return tree;
+}
+
+static void
+inf_text_line_index_build(InfTextLineIndex* index)
+{
+  InfTextLineIndexPrivate* priv;
+  InfTextBufferIter* iter;
+  GArray* lengths;
+  guint current;
+  gchar* text;
+
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+  lengths = g_array_new(FALSE, FALSE, sizeof(guint));
+  current = 0;
+
+  iter = inf_text_buffer_create_begin_iter(priv->buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      text = inf_text_buffer_iter_get_text(priv->buffer, iter);
+
+      inf_text_line_index_scan(
+        text,
+        inf_text_buffer_iter_get_bytes(priv->buffer, iter),
+        lengths,
+        &current
+      );
+
+      g_free(text);
+    } while(inf_text_buffer_iter_next(priv->buffer, iter));
+
+    inf_text_buffer_destroy_iter(priv->buffer, iter);
+  }
+
+  g_array_append_val(lengths, current);
+
+  inf_text_line_index_node_free(priv->root);
+  priv->root = inf_text_line_index_tree_from_lengths(
+    (const guint*)lengths->data,
+    lengths->len
+  );
+
+  g_array_free(lengths, TRUE);
+}
+
+/*
+ * Signal handlers
+ */
+
+static void
+inf_text_line_index_text_inserted_cb(InfTextBuffer* buffer,
+                                     guint pos,
+                                     InfTextChunk* chunk,
+                                     InfUser* user,
+                                     gpointer user_data)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+  InfTextLineIndexNode* before;
+  InfTextLineIndexNode* line_node;
+  InfTextLineIndexNode* after;
+  InfTextLineIndexNode* middle;
+  GArray* lengths;
+  guint current;
+  guint line;
+  guint column;
+  guint rest;
+
+  index = INF_TEXT_LINE_INDEX(user_data);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  lengths = g_array_new(FALSE, FALSE, sizeof(guint));
+  current = 0;
+  inf_text_line_index_scan_chunk(chunk, lengths, &current);
+
+  if(lengths->len == 0)
+  {
+    /* No newline inserted, which is the common case when typing */
+    inf_text_line_index_node_resize(priv->root, pos, current);
+  }
+  else
+  {
+    /* The line at pos is split into the part before pos, which is
+     * continued by the first inserted line, and the part after it, which
+     * continues the unterminated rest of the inserted text. */
+    inf_text_line_index_node_find(priv->root, pos, &line, &column);
+    inf_text_line_index_split(priv->root, line, &before, &after);
+    inf_text_line_index_split(after, 1, &line_node, &after);
+
+    rest = line_node->length - column;
+    line_node->length = column + g_array_index(lengths, guint, 0);
+    inf_text_line_index_node_update(line_node);
+
+    middle = inf_text_line_index_tree_from_lengths(
+      (const guint*)lengths->data + 1,
+      lengths->len - 1
+    );
+
+    middle = inf_text_line_index_merge(
+      middle,
+      inf_text_line_index_node_new(current + rest)
+    );
+
+    priv->root = inf_text_line_index_merge(
+      inf_text_line_index_merge(before, line_node),
+      inf_text_line_index_merge(middle, after)
+    );
+  }
+
+  g_array_free(lengths, TRUE);
+}
+
+static void
+inf_text_line_index_text_erased_cb(InfTextBuffer* buffer,
+                                   guint pos,
+                                   InfTextChunk* chunk,
+                                   InfUser* user,
+                                   gpointer user_data)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+  InfTextLineIndexNode* before;
+  InfTextLineIndexNode* erased;
+  InfTextLineIndexNode* after;
+  InfTextLineIndexNode* last;
+  guint len;
+  guint first_line;
+  guint first_column;
+  guint last_line;
+  guint last_column;
+  guint length;
+
+  index = INF_TEXT_LINE_INDEX(user_data);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+  len = inf_text_chunk_get_length(chunk);
+  if(len == 0) return;
+
+  /* The index still describes the text before the erasure */
+  inf_text_line_index_node_find(priv->root, pos, &first_line, &first_column);
+  inf_text_line_index_node_find(
+    priv->root,
+    pos + len,
+    &last_line,
+    &last_column
+  );
+
+  if(first_line == last_line)
+  {
+    inf_text_line_index_node_resize(priv->root, pos, -(gint)len);
+  }
+  else
+  {
+    /* Join the beginning of the first line with the end of the last one */
+    inf_text_line_index_split(priv->root, first_line, &before, &after);
+    inf_text_line_index_split(
+      after,
+      last_line - first_line + 1,
+      &erased,
+      &after
+    );
+
+    last = erased;
+    while(last->right != NULL)
+      last = last->right;
+
+    length = first_column + last->length - last_column;
+    inf_text_line_index_node_free(erased);
+
+    priv->root = inf_text_line_index_merge(
+      inf_text_line_index_merge(
+        before,
+        inf_text_line_index_node_new(length)
+      ),
+      after
+    );
+  }
+}
+
+/*
+ * GObject overrides
+ */
+
+static void
+inf_text_line_index_init(InfTextLineIndex* index)
+{
+  InfTextLineIndexPrivate* priv;
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  priv->buffer = NULL;
+  priv->root = inf_text_line_index_node_new(0);
+}
+
+static void
+inf_text_line_index_dispose(GObject* object)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+
+  index = INF_TEXT_LINE_INDEX(object);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  if(priv->buffer != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->buffer),
+      G_CALLBACK(inf_text_line_index_text_inserted_cb),
+      index
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->buffer),
+      G_CALLBACK(inf_text_line_index_text_erased_cb),
+      index
+    );
+
+    g_object_unref(priv->buffer);
+    priv->buffer = NULL;
+  }
+
+  G_OBJECT_CLASS(inf_text_line_index_parent_class)->dispose(object);
+}
+
+static void
+inf_text_line_index_finalize(GObject* object)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+
+  index = INF_TEXT_LINE_INDEX(object);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  inf_text_line_index_node_free(priv->root);
+
+  G_OBJECT_CLASS(inf_text_line_index_parent_class)->finalize(object);
+}
+
+static void
+inf_text_line_index_set_property(GObject* object,
+                                 guint prop_id,
+                                 const GValue* value,
+                                 GParamSpec* pspec)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+
+  index = INF_TEXT_LINE_INDEX(object);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  switch(prop_id)
+  {
+  case PROP_BUFFER:
+    /* construct only */
+    g_assert(priv->buffer == NULL);
+    priv->buffer = INF_TEXT_BUFFER(g_value_dup_object(value));
+
+    g_assert(
+      strcmp(inf_text_buffer_get_encoding(priv->buffer), "UTF-8") == 0
+    );
+
+    inf_text_line_index_build(index);
+
+    g_signal_connect(
+      G_OBJECT(priv->buffer),
+      "text-inserted",
+      G_CALLBACK(inf_text_line_index_text_inserted_cb),
+      index
+    );
+
+    g_signal_connect(
+      G_OBJECT(priv->buffer),
+      "text-erased",
+      G_CALLBACK(inf_text_line_index_text_erased_cb),
+      index
+    );
+
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_text_line_index_get_property(GObject* object,
+                                 guint prop_id,
+                                 GValue* value,
+                                 GParamSpec* pspec)
+{
+  InfTextLineIndex* index;
+  InfTextLineIndexPrivate* priv;
+
+  index = INF_TEXT_LINE_INDEX(object);
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+
+  switch(prop_id)
+  {
+  case PROP_BUFFER:
+    g_value_set_object(value, priv->buffer);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * GType registration
+ */
+
+static void
+inf_text_line_index_class_init(InfTextLineIndexClass* line_index_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(line_index_class);
+
+  object_class->dispose = inf_text_line_index_dispose;
+  object_class->finalize = inf_text_line_index_finalize;
+  object_class->set_property = inf_text_line_index_set_property;
+  object_class->get_property = inf_text_line_index_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BUFFER,
+    g_param_spec_object(
+      "buffer",
+      "Buffer",
+      "The buffer whose lines to keep track of",
+      INF_TEXT_TYPE_BUFFER,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * inf_text_line_index_new: (constructor)
+ * @buffer: A #InfTextBuffer encoded in UTF-8.
+ *
+ * Creates a new #InfTextLineIndex for @buffer. This needs to look at the
+ * whole content of @buffer once. Afterwards, the index is kept up to date
+ * as the content of @buffer changes.
+ *
+ * Returns: (transfer full): A #InfTextLineIndex.
+ **/
+InfTextLineIndex*
+inf_text_line_index_new(InfTextBuffer* buffer)
+{
+  GObject* object;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+
+  g_return_val_if_fail(
+    strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0,
+    NULL
+  );
+
+  object = g_object_new(INF_TEXT_TYPE_LINE_INDEX, "buffer", buffer, NULL);
+  return INF_TEXT_LINE_INDEX(object);
+}
+
+/**
+ * inf_text_line_index_get_buffer:
+ * @index: A #InfTextLineIndex.
+ *
+ * Returns the buffer whose lines @index keeps track of.
+ *
+ * Returns: (transfer none): The #InfTextBuffer of @index.
+ **/
+InfTextBuffer*
+inf_text_line_index_get_buffer(InfTextLineIndex* index)
+{
+  g_return_val_if_fail(INF_TEXT_IS_LINE_INDEX(index), NULL);
+  return INF_TEXT_LINE_INDEX_PRIVATE(index)->buffer;
+}
+
+/**
+ * inf_text_line_index_get_n_lines:
+ * @index: A #InfTextLineIndex.
+ *
+ * Returns the number of lines in the buffer of @index, which is one more
+ * than the number of newline characters it contains.
+ *
+ * Returns: The number of lines in the buffer.
+ **/
+guint
+inf_text_line_index_get_n_lines(InfTextLineIndex* index)
+{
+  g_return_val_if_fail(INF_TEXT_IS_LINE_INDEX(index), 0);
+  return INF_TEXT_LINE_INDEX_PRIVATE(index)->root->total_nodes;
+}
+
+/**
+ * inf_text_line_index_get_line_offset:
+ * @index: A #InfTextLineIndex.
+ * @line: A line number, counting from 0.
+ *
+ * Returns the character offset at which @line starts in the buffer of
+ * @index.
+ *
+ * Returns: The offset of the first character of @line.
+ **/
+guint
+inf_text_line_index_get_line_offset(InfTextLineIndex* index,
+                                    guint line)
+{
+  InfTextLineIndexPrivate* priv;
+  guint offset;
+
+  g_return_val_if_fail(INF_TEXT_IS_LINE_INDEX(index), 0);
+
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+  g_return_val_if_fail(line < priv->root->total_nodes, 0);
+
+  inf_text_line_index_node_nth(priv->root, line, &offset);
+  return offset;
+}
+
+/**
+ * inf_text_line_index_get_line_length:
+ * @index: A #InfTextLineIndex.
+ * @line: A line number, counting from 0.
+ *
+ * Returns the number of characters in @line, not counting the newline
+ * character that terminates it.
+ *
+ * Returns: The length of @line.
+ **/
+guint
+inf_text_line_index_get_line_length(InfTextLineIndex* index,
+                                    guint line)
+{
+  InfTextLineIndexPrivate* priv;
+  InfTextLineIndexNode* node;
+  guint offset;
+
+  g_return_val_if_fail(INF_TEXT_IS_LINE_INDEX(index), 0);
+
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+  g_return_val_if_fail(line < priv->root->total_nodes, 0);
+
+  node = inf_text_line_index_node_nth(priv->root, line, &offset);
+  if(line + 1 < priv->root->total_nodes)
+    return node->length - 1;
+  return node->length;
+}
+
+/**
+ * inf_text_line_index_get_position:
+ * @index: A #InfTextLineIndex.
+ * @offset: A character offset into the buffer of @index.
+ * @line: (out) (allow-none): Location to store the line of @offset, or
+ * %NULL.
+ * @column: (out) (allow-none): Location to store the column of @offset,
+ * or %NULL.
+ *
+ * Finds the line which contains the character at @offset, and the offset
+ * of that character within the line. A newline character belongs to the
+ * line it terminates, and @offset may be the length of the buffer, which
+ * is a position at the end of the last line.
+ **/
+void
+inf_text_line_index_get_position(InfTextLineIndex* index,
+                                 guint offset,
+                                 guint* line,
+                                 guint* column)
+{
+  InfTextLineIndexPrivate* priv;
+  guint found_line;
+  guint found_column;
+
+  g_return_if_fail(INF_TEXT_IS_LINE_INDEX(index));
+
+  priv = INF_TEXT_LINE_INDEX_PRIVATE(index);
+  g_return_if_fail(offset <= priv->root->total_length);
+
+  inf_text_line_index_node_find(
+    priv->root,
+    offset,
+    &found_line,
+    &found_column
+  );
+
+  if(line != NULL) *line = found_line;
+  if(column != NULL) *column = found_column;
+}
+
+/* vim:set et sw=2 ts=2: */
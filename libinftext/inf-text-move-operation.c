@@ -21,6 +21,7 @@
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-operations-private.h>
 #include <libinftext/inf-text-user.h>
 
 #include <libinfinity/adopted/inf-adopted-operation.h>
@@ -133,8 +134,9 @@ inf_text_move_operation_transform(InfAdoptedOperation* operation,
   new_pos = priv->position;
   new_len = priv->length;
 
-  if(INF_TEXT_IS_INSERT_OPERATION(against))
+  switch(_inf_text_operations_get_kind(against))
   {
+  case INF_TEXT_OPERATION_KIND_INSERT:
     inf_text_move_operation_transform_insert(
       inf_text_insert_operation_get_position(
         INF_TEXT_INSERT_OPERATION(against)
@@ -146,9 +148,9 @@ inf_text_move_operation_transform(InfAdoptedOperation* operation,
       &new_len,
       TRUE /* left gravity */
     );
-  }
-  else if(INF_TEXT_IS_DELETE_OPERATION(against))
-  {
+
+    break;
+  case INF_TEXT_OPERATION_KIND_DELETE:
     inf_text_move_operation_transform_delete(
       inf_text_delete_operation_get_position(
         INF_TEXT_DELETE_OPERATION(against)
@@ -159,9 +161,9 @@ inf_text_move_operation_transform(InfAdoptedOperation* operation,
       &new_pos,
       &new_len
     );
-  }
-  else
-  {
+
+    break;
+  default:
     g_assert_not_reached();
     return NULL;
   }
@@ -293,6 +295,7 @@ inf_text_move_operation_operation_iface_init(
   iface->apply = inf_text_move_operation_apply;
   iface->apply_transformed = NULL;
   iface->revert = NULL;
+  iface->get_size = NULL;
 }
 
 /**
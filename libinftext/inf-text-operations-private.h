@@ -0,0 +1,77 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_OPERATIONS_PRIVATE_H__
+#define __INF_TEXT_OPERATIONS_PRIVATE_H__
+
+#include <libinftext/inf-text-insert-operation.h>
+#include <libinftext/inf-text-delete-operation.h>
+#include <libinfinity/adopted/inf-adopted-operation.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* What a text operation does to the buffer, as far as transformation is
+ * concerned. The built-in operation types are recognized by their exact
+ * type, and only other types are looked up through the GObject type
+ * system. */
+typedef enum _InfTextOperationKind {
+  INF_TEXT_OPERATION_KIND_OTHER,
+  INF_TEXT_OPERATION_KIND_INSERT,
+  INF_TEXT_OPERATION_KIND_DELETE,
+
+  INF_TEXT_OPERATION_KIND_COUNT
+} InfTextOperationKind;
+
+InfTextOperationKind
+_inf_text_operations_get_kind(InfAdoptedOperation* operation);
+
+InfAdoptedOperation*
+_inf_text_operations_transform(InfAdoptedOperation* operation,
+                               InfTextOperationKind kind,
+                               InfAdoptedOperation* against,
+                               InfAdoptedOperation* operation_lcs,
+                               InfAdoptedOperation* against_lcs,
+                               InfAdoptedConcurrencyId concurrency_id);
+
+InfAdoptedOperation*
+_inf_text_insert_operation_transform_insert(InfTextInsertOperation* operation,
+                                            InfTextInsertOperation* against,
+                                            InfTextInsertOperation* op_lcs,
+                                            InfTextInsertOperation* ag_lcs,
+                                            InfAdoptedConcurrencyId cid);
+
+InfAdoptedOperation*
+_inf_text_insert_operation_transform_delete(InfTextInsertOperation* operation,
+                                            InfTextDeleteOperation* against);
+
+InfAdoptedOperation*
+_inf_text_delete_operation_transform_insert(InfTextDeleteOperation* operation,
+                                            InfTextInsertOperation* against);
+
+InfAdoptedOperation*
+_inf_text_delete_operation_transform_delete(InfTextDeleteOperation* operation,
+                                            InfTextDeleteOperation* against);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_OPERATIONS_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,160 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-operations-private.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-remote-delete-operation.h>
+
+typedef InfAdoptedOperation*(*InfTextOperationsTransformFunc)(
+  InfAdoptedOperation* operation,
+  InfAdoptedOperation* against,
+  InfAdoptedOperation* operation_lcs,
+  InfAdoptedOperation* against_lcs,
+  InfAdoptedConcurrencyId concurrency_id
+);
+
+/* The kinds of both operations have been determined already, so plain
+ * casts are enough here. */
+
+static InfAdoptedOperation*
+inf_text_operations_transform_insert_insert(InfAdoptedOperation* operation,
+                                            InfAdoptedOperation* against,
+                                            InfAdoptedOperation* op_lcs,
+                                            InfAdoptedOperation* against_lcs,
+                                            InfAdoptedConcurrencyId cid)
+{
+  g_assert(op_lcs == NULL || INF_TEXT_IS_INSERT_OPERATION(op_lcs));
+  g_assert(against_lcs == NULL || INF_TEXT_IS_INSERT_OPERATION(against_lcs));
+
+  return _inf_text_insert_operation_transform_insert(
+    (InfTextInsertOperation*)operation,
+    (InfTextInsertOperation*)against,
+    (InfTextInsertOperation*)op_lcs,
+    (InfTextInsertOperation*)against_lcs,
+    cid
+  );
+}
+
+static InfAdoptedOperation*
+inf_text_operations_transform_insert_delete(InfAdoptedOperation* operation,
+                                            InfAdoptedOperation* against,
+                                            InfAdoptedOperation* op_lcs,
+                                            InfAdoptedOperation* against_lcs,
+                                            InfAdoptedConcurrencyId cid)
+{
+  return _inf_text_insert_operation_transform_delete(
+    (InfTextInsertOperation*)operation,
+    (InfTextDeleteOperation*)against
+  );
+}
+
+static InfAdoptedOperation*
+inf_text_operations_transform_delete_insert(InfAdoptedOperation* operation,
+                                            InfAdoptedOperation* against,
+                                            InfAdoptedOperation* op_lcs,
+                                            InfAdoptedOperation* against_lcs,
+                                            InfAdoptedConcurrencyId cid)
+{
+  return _inf_text_delete_operation_transform_insert(
+    (InfTextDeleteOperation*)operation,
+    (InfTextInsertOperation*)against
+  );
+}
+
+static InfAdoptedOperation*
+inf_text_operations_transform_delete_delete(InfAdoptedOperation* operation,
+                                            InfAdoptedOperation* against,
+                                            InfAdoptedOperation* op_lcs,
+                                            InfAdoptedOperation* against_lcs,
+                                            InfAdoptedConcurrencyId cid)
+{
+  return _inf_text_delete_operation_transform_delete(
+    (InfTextDeleteOperation*)operation,
+    (InfTextDeleteOperation*)against
+  );
+}
+
+static const InfTextOperationsTransformFunc
+INF_TEXT_OPERATIONS_TRANSFORM_FUNCS[INF_TEXT_OPERATION_KIND_COUNT]
+                                   [INF_TEXT_OPERATION_KIND_COUNT] = {
+  /* INF_TEXT_OPERATION_KIND_OTHER */
+  { NULL, NULL, NULL },
+  /* INF_TEXT_OPERATION_KIND_INSERT */
+  {
+    NULL,
+    inf_text_operations_transform_insert_insert,
+    inf_text_operations_transform_insert_delete
+  },
+  /* INF_TEXT_OPERATION_KIND_DELETE */
+  {
+    NULL,
+    inf_text_operations_transform_delete_insert,
+    inf_text_operations_transform_delete_delete
+  }
+};
+
+/* Returns whether operation inserts or deletes text. This is called for
+ * every pair of operations transformed against each other, so the built-in
+ * types are compared directly, which is much cheaper than checking whether
+ * an instance implements an interface. */
+InfTextOperationKind
+_inf_text_operations_get_kind(InfAdoptedOperation* operation)
+{
+  GType type;
+  type = G_TYPE_FROM_INSTANCE(operation);
+
+  if(type == INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION)
+    return INF_TEXT_OPERATION_KIND_INSERT;
+  if(type == INF_TEXT_TYPE_DEFAULT_DELETE_OPERATION ||
+     type == INF_TEXT_TYPE_REMOTE_DELETE_OPERATION)
+  {
+    return INF_TEXT_OPERATION_KIND_DELETE;
+  }
+
+  /* Operations implemented outside of libinftext */
+  if(INF_TEXT_IS_INSERT_OPERATION(operation))
+    return INF_TEXT_OPERATION_KIND_INSERT;
+  if(INF_TEXT_IS_DELETE_OPERATION(operation))
+    return INF_TEXT_OPERATION_KIND_DELETE;
+
+  return INF_TEXT_OPERATION_KIND_OTHER;
+}
+
+/* Transforms operation, which is of the given kind, against against, by
+ * looking up the formula for the pair of kinds in a table. This is used by
+ * the transform implementations of all built-in text operations. */
+InfAdoptedOperation*
+_inf_text_operations_transform(InfAdoptedOperation* operation,
+                               InfTextOperationKind kind,
+                               InfAdoptedOperation* against,
+                               InfAdoptedOperation* operation_lcs,
+                               InfAdoptedOperation* against_lcs,
+                               InfAdoptedConcurrencyId concurrency_id)
+{
+  InfTextOperationsTransformFunc func;
+
+  func = INF_TEXT_OPERATIONS_TRANSFORM_FUNCS
+    [kind][_inf_text_operations_get_kind(against)];
+  g_assert(func != NULL);
+
+  return func(operation, against, operation_lcs, against_lcs, concurrency_id);
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -22,6 +22,7 @@
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-operations-private.h>
 
 #include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/adopted/inf-adopted-operation.h>
@@ -302,25 +303,14 @@ inf_text_remote_delete_operation_transform(InfAdoptedOperation* operation,
 {
   g_assert(INF_TEXT_IS_REMOTE_DELETE_OPERATION(operation));
 
-  if(INF_TEXT_IS_INSERT_OPERATION(against))
-  {
-    return inf_text_delete_operation_transform_insert(
-      INF_TEXT_DELETE_OPERATION(operation),
-      INF_TEXT_INSERT_OPERATION(against)
-    );
-  }
-  else if(INF_TEXT_IS_DELETE_OPERATION(against))
-  {
-    return inf_text_delete_operation_transform_delete(
-      INF_TEXT_DELETE_OPERATION(operation),
-      INF_TEXT_DELETE_OPERATION(against)
-    );
-  }
-  else
-  {
-    g_assert_not_reached();
-    return NULL;
-  }
+  return _inf_text_operations_transform(
+    operation,
+    INF_TEXT_OPERATION_KIND_DELETE,
+    against,
+    operation_lcs,
+    against_lcs,
+    cid
+  );
 }
 
 static InfAdoptedOperation*
@@ -721,6 +711,7 @@ inf_text_remote_delete_operation_operation_iface_init(
     inf_text_remote_delete_operation_apply_transformed;
   /* RemoteDeleteOperation is not reversible */
   iface->revert = NULL;
+  iface->get_size = NULL;
 }
 
 static void
@@ -0,0 +1,1027 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+/**
+ * SECTION:inf-text-rope-buffer
+ * @title: InfTextRopeBuffer
+ * @short_description: Text buffer for large documents
+ * @include: libinftext/inf-text-rope-buffer.h
+ * @see_also: #InfTextBuffer, #InfTextDefaultBuffer
+ * @stability: Unstable
+ *
+ * #InfTextRopeBuffer is an implementation of the #InfTextBuffer interface
+ * which, like #InfTextDefaultBuffer, just stores the text without any
+ * user interface. Instead of a single #InfTextChunk, it keeps the text
+ * segments in a balanced binary tree in which every node caches the number
+ * of characters, bytes and lines of its subtree. Inserting, erasing and
+ * extracting text is therefore logarithmic in the number of segments,
+ * instead of linear as with #InfTextDefaultBuffer. This makes a difference
+ * for large documents, for example on a server.
+ *
+ * #InfTextRopeBuffer only supports the UTF-8 encoding.
+ **/
+
+#include <libinftext/inf-text-rope-buffer.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinfinity/common/inf-buffer.h>
+
+#include <string.h>
+
+/* Text inserted in one go is split into segments of at most this many
+ * bytes, so that splitting a segment later on is cheap even for huge
+ * pastes. Typing is appended to an existing segment of the same author as
+ * long as it stays below this size. */
+#define INF_TEXT_ROPE_BUFFER_MAX_SEGMENT_BYTES 4096
+
+/* The tree is a treap: it is ordered by position in the text and heap
+ * ordered by a random priority, which keeps it balanced in expectation.
+ * Nodes do not store their offset, which is only implied by the sizes of
+ * the subtrees before them, so that inserting or removing text only
+ * touches the nodes on the path to the root. */
+typedef struct _InfTextRopeNode InfTextRopeNode;
+struct _InfTextRopeNode {
+  InfTextRopeNode* parent;
+  InfTextRopeNode* left;
+  InfTextRopeNode* right;
+  guint32 priority;
+
+  guint author;
+  gchar* text;
+  gsize bytes;
+  guint length; /* in characters */
+  guint lines; /* number of newline characters */
+
+  /* Totals for the subtree rooted at this node, including the node */
+  gsize total_bytes;
+  guint total_length;
+  guint total_lines;
+  guint total_nodes;
+};
+
+struct _InfTextBufferIter {
+  InfTextRopeNode* node;
+};
+
+typedef struct _InfTextRopeBufferPrivate InfTextRopeBufferPrivate;
+struct _InfTextRopeBufferPrivate {
+  InfTextRopeNode* root;
+  gboolean modified;
+};
+
+enum {
+  PROP_0,
+
+  /* overwritten */
+  PROP_MODIFIED
+};
+
+#define INF_TEXT_ROPE_BUFFER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_ROPE_BUFFER, InfTextRopeBufferPrivate))
+
+static void inf_text_rope_buffer_buffer_iface_init(InfBufferInterface* iface);
+static void inf_text_rope_buffer_text_buffer_iface_init(InfTextBufferInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfTextRopeBuffer, inf_text_rope_buffer, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfTextRopeBuffer)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_BUFFER, inf_text_rope_buffer_buffer_iface_init)
+  G_IMPLEMENT_INTERFACE(INF_TEXT_TYPE_BUFFER, inf_text_rope_buffer_text_buffer_iface_init))
+
+/*
+ * Tree management
+ */
+
+static guint
+inf_text_rope_buffer_count_lines(const gchar* text,
+                                 gsize bytes)
+{
+  const gchar* end;
+  guint lines;
+
+  end = text + bytes;
+  lines = 0;
+
+  while((text = memchr(text, '\n', end - text)) != NULL)
+  {
+    ++lines;
+    ++text;
+  }
+
+  return lines;
+}
+
+/* Takes ownership of text */
+static InfTextRopeNode*
+inf_text_rope_buffer_node_new(guint author,
+                              gchar* text,
+                              gsize bytes,
+                              guint length,
+                              guint32 priority)
+{
+  InfTextRopeNode* node;
+
+  node = g_slice_new(InfTextRopeNode);
+  node->parent = NULL;
+  node->left = NULL;
+  node->right = NULL;
+  node->priority = priority;
+
+  node->author = author;
+  node->text = text;
+  node->bytes = bytes;
+  node->length = length;
+  node->lines = inf_text_rope_buffer_count_lines(text, bytes);
+
+  node->total_bytes = bytes;
+  node->total_length = length;
+  node->total_lines = node->lines;
+  node->total_nodes = 1;
+
+  return node;
+}
+
+static void
+inf_text_rope_buffer_node_free(InfTextRopeNode* node)
+{
+  if(node != NULL)
+  {
+    inf_text_rope_buffer_node_free(node->left);
+    inf_text_rope_buffer_node_free(node->right);
+
+    g_free(node->text);
+    g_slice_free(InfTextRopeNode, node);
+  }
+}
+
+/* Recomputes the totals of node from its children, and makes the children
+ * point back to it. */
+static void
+inf_text_rope_buffer_node_update(InfTextRopeNode* node)
+{
+  node->total_bytes = node->bytes;
+  node->total_length = node->length;
+  node->total_lines = node->lines;
+  node->total_nodes = 1;
+
+  if(node->left != NULL)
+  {
+    node->left->parent = node;
+    node->total_bytes += node->left->total_bytes;
+    node->total_length += node->left->total_length;
+    node->total_lines += node->left->total_lines;
+    node->total_nodes += node->left->total_nodes;
+  }
+
+  if(node->right != NULL)
+  {
+    node->right->parent = node;
+    node->total_bytes += node->right->total_bytes;
+    node->total_length += node->right->total_length;
+    node->total_lines += node->right->total_lines;
+    node->total_nodes += node->right->total_nodes;
+  }
+}
+
+/* Updates the totals of node and all of its ancestors */
+static void
+inf_text_rope_buffer_node_update_path(InfTextRopeNode* node)
+{
+  while(node != NULL)
+  {
+    inf_text_rope_buffer_node_update(node);
+    node = node->parent;
+  }
+}
+
+/* Concatenates the two trees, all of first coming before second */
+static InfTextRopeNode*
+inf_text_rope_buffer_merge(InfTextRopeNode* first,
+                           InfTextRopeNode* second)
+{
+  if(first == NULL) return second;
+  if(second == NULL) return first;
+
+  if(first->priority > second->priority)
+  {
+    first->right = inf_text_rope_buffer_merge(first->right, second);
+    inf_text_rope_buffer_node_update(first);
+    first->parent = NULL;
+    return first;
+  }
+  else
+  {
+    second->left = inf_text_rope_buffer_merge(first, second->left);
+    inf_text_rope_buffer_node_update(second);
+    second->parent = NULL;
+    return second;
+  }
+}
+
+/* Splits the tree at node into one tree holding the first pos characters,
+ * and one holding the rest. A segment containing pos is split into two
+ * nodes. */
+static void
+inf_text_rope_buffer_split(InfTextRopeNode* node,
+                           guint pos,
+                           InfTextRopeNode** first,
+                           InfTextRopeNode** second)
+{
+  InfTextRopeNode* new_node;
+  guint left_length;
+  gsize index;
+
+  if(node == NULL)
+  {
+    *first = NULL;
+    *second = NULL;
+    return;
+  }
+
+  left_length = node->left != NULL ? node->left->total_length : 0;
+
+  if(pos <= left_length)
+  {
+    inf_text_rope_buffer_split(node->left, pos, first, &node->left);
+    inf_text_rope_buffer_node_update(node);
+    node->parent = NULL;
+    *second = node;
+  }
+  else if(pos >= left_length + node->length)
+  {
+    inf_text_rope_buffer_split(
+      node->right,
+      pos - left_length - node->length,
+      &node->right,
+      second
+    );
+
+    inf_text_rope_buffer_node_update(node);
+    node->parent = NULL;
+    *first = node;
+  }
+  else
+  {
+    /* pos is inside this segment. The second half gets the same priority
+     * as the node, which is at least the priority of the node's right
+     * subtree, so the heap order is kept. */
+    index = g_utf8_offset_to_pointer(node->text, pos - left_length) -
+      node->text;
+
+    new_node = inf_text_rope_buffer_node_new(
+      node->author,
+      g_memdup(node->text + index, node->bytes - index),
+      node->bytes - index,
+      node->length - (pos - left_length),
+      node->priority
+    );
+
+    new_node->right = node->right;
+    inf_text_rope_buffer_node_update(new_node);
+
+    node->right = NULL;
+    node->bytes = index;
+    node->length = pos - left_length;
+    node->lines = inf_text_rope_buffer_count_lines(node->text, index);
+    inf_text_rope_buffer_node_update(node);
+
+    node->parent = NULL;
+    new_node->parent = NULL;
+
+    *first = node;
+    *second = new_node;
+  }
+}
+
+static InfTextRopeNode*
+inf_text_rope_buffer_node_first(InfTextRopeNode* node)
+{
+  if(node != NULL)
+    while(node->left != NULL)
+      node = node->left;
+  return node;
+}
+
+static InfTextRopeNode*
+inf_text_rope_buffer_node_last(InfTextRopeNode* node)
+{
+  if(node != NULL)
+    while(node->right != NULL)
+      node = node->right;
+  return node;
+}
+
+static InfTextRopeNode*
+inf_text_rope_buffer_node_next(InfTextRopeNode* node)
+{
+  if(node->right != NULL)
+    return inf_text_rope_buffer_node_first(node->right);
+
+  while(node->parent != NULL && node->parent->right == node)
+    node = node->parent;
+  return node->parent;
+}
+
+static InfTextRopeNode*
+inf_text_rope_buffer_node_prev(InfTextRopeNode* node)
+{
+  if(node->left != NULL)
+    return inf_text_rope_buffer_node_last(node->left);
+
+  while(node->parent != NULL && node->parent->left == node)
+    node = node->parent;
+  return node->parent;
+}
+
+/* Returns the character offset at which node starts */
+static guint
+inf_text_rope_buffer_node_get_offset(InfTextRopeNode* node)
+{
+  guint offset;
+
+  offset = node->left != NULL ? node->left->total_length : 0;
+  while(node->parent != NULL)
+  {
+    if(node->parent->right == node)
+    {
+      offset += node->parent->length;
+      if(node->parent->left != NULL)
+        offset += node->parent->left->total_length;
+    }
+
+    node = node->parent;
+  }
+
+  return offset;
+}
+
+/* Returns the node containing the character at pos, and the character
+ * offset of pos within that node. */
+static InfTextRopeNode*
+inf_text_rope_buffer_node_find(InfTextRopeNode* node,
+                               guint pos,
+                               guint* node_pos)
+{
+  guint left_length;
+
+  while(node != NULL)
+  {
+    left_length = node->left != NULL ? node->left->total_length : 0;
+    if(pos < left_length)
+    {
+      node = node->left;
+    }
+    else if(pos < left_length + node->length)
+    {
+      *node_pos = pos - left_length;
+      return node;
+    }
+    else
+    {
+      pos -= left_length + node->length;
+      node = node->right;
+    }
+  }
+
+  return NULL;
+}
+
+/* Builds a tree from the segments of chunk */
+static InfTextRopeNode*
+inf_text_rope_buffer_tree_from_chunk(InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  InfTextRopeNode* tree;
+  InfTextRopeNode* node;
+  const gchar* text;
+  const gchar* end;
+  const gchar* piece_end;
+
+  tree = NULL;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      text = inf_text_chunk_iter_get_text(&iter);
+      end = text + inf_text_chunk_iter_get_bytes(&iter);
+
+      while(text < end)
+      {
+        piece_end = end;
+        if(piece_end - text > INF_TEXT_ROPE_BUFFER_MAX_SEGMENT_BYTES)
+        {
+          /* Do not cut in the middle of a character */
+          piece_end = text + INF_TEXT_ROPE_BUFFER_MAX_SEGMENT_BYTES;
+          while((*piece_end & 0xc0) == 0x80)
+            --piece_end;
+        }
+
+        node = inf_text_rope_buffer_node_new(
+          inf_text_chunk_iter_get_author(&iter),
+          g_memdup(text, piece_end - text),
+          piece_end - text,
+          g_utf8_strlen(text, piece_end - text),
+          g_random_int()
+        );
+
+        tree = inf_text_rope_buffer_merge(tree, node);
+        text = piece_end;
+      }
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  return tree;
+}
+
+/* Tries to append chunk to the last segment of tree, to avoid creating a
+ * new node for every typed character. */
+static gboolean
+inf_text_rope_buffer_try_append(InfTextRopeNode* tree,
+                                InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  InfTextRopeNode* last;
+  gsize bytes;
+
+  last = inf_text_rope_buffer_node_last(tree);
+  if(last == NULL)
+    return FALSE;
+
+  if(!inf_text_chunk_iter_init_begin(chunk, &iter))
+    return FALSE;
+
+  /* Only single-segment chunks by the same author */
+  if(inf_text_chunk_iter_get_author(&iter) != last->author)
+    return FALSE;
+  if(inf_text_chunk_iter_get_length(&iter) != inf_text_chunk_get_length(chunk))
+    return FALSE;
+
+  bytes = inf_text_chunk_iter_get_bytes(&iter);
+  if(last->bytes + bytes > INF_TEXT_ROPE_BUFFER_MAX_SEGMENT_BYTES)
+    return FALSE;
+
+  last->text = g_realloc(last->text, last->bytes + bytes);
+  memcpy(last->text + last->bytes, inf_text_chunk_iter_get_text(&iter), bytes);
+  last->lines += inf_text_rope_buffer_count_lines(
+    last->text + last->bytes,
+    bytes
+  );
+
+  last->bytes += bytes;
+  last->length += inf_text_chunk_iter_get_length(&iter);
+
+  inf_text_rope_buffer_node_update_path(last);
+  return TRUE;
+}
+
+/*
+ * GObject overrides
+ */
+
+static void
+inf_text_rope_buffer_init(InfTextRopeBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  priv->root = NULL;
+  priv->modified = FALSE;
+}
+
+static void
+inf_text_rope_buffer_finalize(GObject* object)
+{
+  InfTextRopeBuffer* rope_buffer;
+  InfTextRopeBufferPrivate* priv;
+
+  rope_buffer = INF_TEXT_ROPE_BUFFER(object);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(rope_buffer);
+
+  inf_text_rope_buffer_node_free(priv->root);
+
+  G_OBJECT_CLASS(inf_text_rope_buffer_parent_class)->finalize(object);
+}
+
+static void
+inf_text_rope_buffer_set_property(GObject* object,
+                                  guint prop_id,
+                                  const GValue* value,
+                                  GParamSpec* pspec)
+{
+  InfTextRopeBuffer* rope_buffer;
+  InfTextRopeBufferPrivate* priv;
+
+  rope_buffer = INF_TEXT_ROPE_BUFFER(object);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(rope_buffer);
+
+  switch(prop_id)
+  {
+  case PROP_MODIFIED:
+    priv->modified = g_value_get_boolean(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_text_rope_buffer_get_property(GObject* object,
+                                  guint prop_id,
+                                  GValue* value,
+                                  GParamSpec* pspec)
+{
+  InfTextRopeBuffer* rope_buffer;
+  InfTextRopeBufferPrivate* priv;
+
+  rope_buffer = INF_TEXT_ROPE_BUFFER(object);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(rope_buffer);
+
+  switch(prop_id)
+  {
+  case PROP_MODIFIED:
+    g_value_set_boolean(value, priv->modified);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * InfBuffer and InfTextBuffer implementation
+ */
+
+static gboolean
+inf_text_rope_buffer_buffer_get_modified(InfBuffer* buffer)
+{
+  return INF_TEXT_ROPE_BUFFER_PRIVATE(buffer)->modified;
+}
+
+static void
+inf_text_rope_buffer_buffer_set_modified(InfBuffer* buffer,
+                                         gboolean modified)
+{
+  InfTextRopeBuffer* rope_buffer;
+  InfTextRopeBufferPrivate* priv;
+
+  rope_buffer = INF_TEXT_ROPE_BUFFER(buffer);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(rope_buffer);
+
+  if(priv->modified != modified)
+  {
+    priv->modified = modified;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
+static gsize
+inf_text_rope_buffer_buffer_get_size(InfBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  if(priv->root == NULL)
+    return 0;
+
+  return priv->root->total_bytes +
+    priv->root->total_nodes * sizeof(InfTextRopeNode);
+}
+
+static const gchar*
+inf_text_rope_buffer_buffer_get_encoding(InfTextBuffer* buffer)
+{
+  return "UTF-8";
+}
+
+static guint
+inf_text_rope_buffer_buffer_get_length(InfTextBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  if(priv->root == NULL)
+    return 0;
+  return priv->root->total_length;
+}
+
+static InfTextChunk*
+inf_text_rope_buffer_buffer_get_slice(InfTextBuffer* buffer,
+                                      guint pos,
+                                      guint len)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextChunk* chunk;
+  InfTextRopeNode* node;
+  guint node_pos;
+  guint chunk_len;
+  gsize begin;
+  gsize end;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+  chunk = inf_text_chunk_new("UTF-8");
+
+  g_return_val_if_fail(
+    pos + len <= inf_text_rope_buffer_buffer_get_length(buffer),
+    chunk
+  );
+
+  node = NULL;
+  if(len > 0)
+    node = inf_text_rope_buffer_node_find(priv->root, pos, &node_pos);
+
+  chunk_len = 0;
+  while(chunk_len < len)
+  {
+    g_assert(node != NULL);
+
+    begin = g_utf8_offset_to_pointer(node->text, node_pos) - node->text;
+    if(len - chunk_len >= node->length - node_pos)
+    {
+      end = node->bytes;
+
+      inf_text_chunk_insert_text(
+        chunk,
+        chunk_len,
+        node->text + begin,
+        end - begin,
+        node->length - node_pos,
+        node->author
+      );
+
+      chunk_len += node->length - node_pos;
+    }
+    else
+    {
+      end = g_utf8_offset_to_pointer(
+        node->text + begin,
+        len - chunk_len
+      ) - node->text;
+
+      inf_text_chunk_insert_text(
+        chunk,
+        chunk_len,
+        node->text + begin,
+        end - begin,
+        len - chunk_len,
+        node->author
+      );
+
+      chunk_len = len;
+    }
+
+    node = inf_text_rope_buffer_node_next(node);
+    node_pos = 0;
+  }
+
+  return chunk;
+}
+
+static gboolean
+inf_text_rope_buffer_buffer_view(InfTextBuffer* buffer,
+                                 guint pos,
+                                 guint len,
+                                 InfTextChunkViewFunc func,
+                                 gpointer user_data)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextRopeNode* node;
+  guint node_pos;
+  guint node_len;
+  const gchar* begin;
+  const gchar* end;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  g_return_val_if_fail(
+    pos + len <= inf_text_rope_buffer_buffer_get_length(buffer),
+    FALSE
+  );
+
+  node = NULL;
+  if(len > 0)
+    node = inf_text_rope_buffer_node_find(priv->root, pos, &node_pos);
+
+  while(len > 0)
+  {
+    g_assert(node != NULL);
+
+    begin = g_utf8_offset_to_pointer(node->text, node_pos);
+    node_len = MIN(len, node->length - node_pos);
+
+    if(node_len == node->length - node_pos)
+      end = node->text + node->bytes;
+    else
+      end = g_utf8_offset_to_pointer(begin, node_len);
+
+    if(!func(begin, end - begin, node_len, node->author, user_data))
+      return FALSE;
+
+    len -= node_len;
+    node = inf_text_rope_buffer_node_next(node);
+    node_pos = 0;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_text_rope_buffer_buffer_insert_text(InfTextBuffer* buffer,
+                                        guint pos,
+                                        InfTextChunk* chunk,
+                                        InfUser* user)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextRopeNode* first;
+  InfTextRopeNode* second;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  g_return_if_fail(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") == 0);
+  g_return_if_fail(pos <= inf_text_rope_buffer_buffer_get_length(buffer));
+
+  inf_text_rope_buffer_split(priv->root, pos, &first, &second);
+
+  if(!inf_text_rope_buffer_try_append(first, chunk))
+  {
+    first = inf_text_rope_buffer_merge(
+      first,
+      inf_text_rope_buffer_tree_from_chunk(chunk)
+    );
+  }
+
+  priv->root = inf_text_rope_buffer_merge(first, second);
+
+  inf_text_buffer_text_inserted(buffer, pos, chunk, user);
+
+  if(priv->modified == FALSE)
+  {
+    priv->modified = TRUE;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
+static void
+inf_text_rope_buffer_buffer_erase_text(InfTextBuffer* buffer,
+                                       guint pos,
+                                       guint len,
+                                       InfUser* user)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextChunk* chunk;
+  InfTextRopeNode* first;
+  InfTextRopeNode* middle;
+  InfTextRopeNode* last;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  g_return_if_fail(pos + len <= inf_text_rope_buffer_buffer_get_length(buffer));
+
+  chunk = inf_text_rope_buffer_buffer_get_slice(buffer, pos, len);
+
+  inf_text_rope_buffer_split(priv->root, pos, &first, &middle);
+  inf_text_rope_buffer_split(middle, len, &middle, &last);
+  inf_text_rope_buffer_node_free(middle);
+  priv->root = inf_text_rope_buffer_merge(first, last);
+
+  inf_text_buffer_text_erased(buffer, pos, chunk, user);
+  inf_text_chunk_free(chunk);
+
+  if(priv->modified == FALSE)
+  {
+    priv->modified = TRUE;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
+static InfTextBufferIter*
+inf_text_rope_buffer_buffer_create_begin_iter(InfTextBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextBufferIter* iter;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+  if(priv->root == NULL)
+    return NULL;
+
+  iter = g_slice_new(InfTextBufferIter);
+  iter->node = inf_text_rope_buffer_node_first(priv->root);
+  return iter;
+}
+
+static InfTextBufferIter*
+inf_text_rope_buffer_buffer_create_end_iter(InfTextBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+  InfTextBufferIter* iter;
+
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+  if(priv->root == NULL)
+    return NULL;
+
+  iter = g_slice_new(InfTextBufferIter);
+  iter->node = inf_text_rope_buffer_node_last(priv->root);
+  return iter;
+}
+
+static void
+inf_text_rope_buffer_buffer_destroy_iter(InfTextBuffer* buffer,
+                                         InfTextBufferIter* iter)
+{
+  g_slice_free(InfTextBufferIter, iter);
+}
+
+static gboolean
+inf_text_rope_buffer_buffer_iter_next(InfTextBuffer* buffer,
+                                      InfTextBufferIter* iter)
+{
+  InfTextRopeNode* next;
+
+  next = inf_text_rope_buffer_node_next(iter->node);
+  if(next == NULL)
+    return FALSE;
+
+  iter->node = next;
+  return TRUE;
+}
+
+static gboolean
+inf_text_rope_buffer_buffer_iter_prev(InfTextBuffer* buffer,
+                                      InfTextBufferIter* iter)
+{
+  InfTextRopeNode* prev;
+
+  prev = inf_text_rope_buffer_node_prev(iter->node);
+  if(prev == NULL)
+    return FALSE;
+
+  iter->node = prev;
+  return TRUE;
+}
+
+static gpointer
+inf_text_rope_buffer_buffer_iter_get_text(InfTextBuffer* buffer,
+                                          InfTextBufferIter* iter)
+{
+  return g_memdup(iter->node->text, iter->node->bytes);
+}
+
+static guint
+inf_text_rope_buffer_buffer_iter_get_offset(InfTextBuffer* buffer,
+                                            InfTextBufferIter* iter)
+{
+  return inf_text_rope_buffer_node_get_offset(iter->node);
+}
+
+static guint
+inf_text_rope_buffer_buffer_iter_get_length(InfTextBuffer* buffer,
+                                            InfTextBufferIter* iter)
+{
+  return iter->node->length;
+}
+
+static gsize
+inf_text_rope_buffer_buffer_iter_get_bytes(InfTextBuffer* buffer,
+                                           InfTextBufferIter* iter)
+{
+  return iter->node->bytes;
+}
+
+static guint
+inf_text_rope_buffer_buffer_iter_get_author(InfTextBuffer* buffer,
+                                            InfTextBufferIter* iter)
+{
+  return iter->node->author;
+}
+
+/*
+ * GType registration
+ */
+
+static void
+inf_text_rope_buffer_class_init(InfTextRopeBufferClass* rope_buffer_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(rope_buffer_class);
+
+  object_class->finalize = inf_text_rope_buffer_finalize;
+  object_class->set_property = inf_text_rope_buffer_set_property;
+  object_class->get_property = inf_text_rope_buffer_get_property;
+
+  g_object_class_override_property(object_class, PROP_MODIFIED, "modified");
+}
+
+static void
+inf_text_rope_buffer_buffer_iface_init(InfBufferInterface* iface)
+{
+  iface->get_modified = inf_text_rope_buffer_buffer_get_modified;
+  iface->set_modified = inf_text_rope_buffer_buffer_set_modified;
+  iface->get_size = inf_text_rope_buffer_buffer_get_size;
+}
+
+static void
+inf_text_rope_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
+{
+  iface->get_encoding = inf_text_rope_buffer_buffer_get_encoding;
+  iface->get_length = inf_text_rope_buffer_buffer_get_length;
+  iface->get_slice = inf_text_rope_buffer_buffer_get_slice;
+  iface->view = inf_text_rope_buffer_buffer_view;
+  iface->insert_text = inf_text_rope_buffer_buffer_insert_text;
+  iface->erase_text = inf_text_rope_buffer_buffer_erase_text;
+  iface->create_begin_iter = inf_text_rope_buffer_buffer_create_begin_iter;
+  iface->create_end_iter = inf_text_rope_buffer_buffer_create_end_iter;
+  iface->destroy_iter = inf_text_rope_buffer_buffer_destroy_iter;
+  iface->iter_next = inf_text_rope_buffer_buffer_iter_next;
+  iface->iter_prev = inf_text_rope_buffer_buffer_iter_prev;
+  iface->iter_get_text = inf_text_rope_buffer_buffer_iter_get_text;
+  iface->iter_get_offset = inf_text_rope_buffer_buffer_iter_get_offset;
+  iface->iter_get_length = inf_text_rope_buffer_buffer_iter_get_length;
+  iface->iter_get_bytes = inf_text_rope_buffer_buffer_iter_get_bytes;
+  iface->iter_get_author = inf_text_rope_buffer_buffer_iter_get_author;
+  iface->text_inserted = NULL;
+  iface->text_erased = NULL;
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * inf_text_rope_buffer_new: (constructor)
+ *
+ * Creates a new, empty #InfTextRopeBuffer. Its content is encoded in
+ * UTF-8.
+ *
+ * Returns: (transfer full): A #InfTextRopeBuffer.
+ **/
+InfTextRopeBuffer*
+inf_text_rope_buffer_new(void)
+{
+  GObject* object;
+
+  object = g_object_new(INF_TEXT_TYPE_ROPE_BUFFER, NULL);
+
+  return INF_TEXT_ROPE_BUFFER(object);
+}
+
+/**
+ * inf_text_rope_buffer_get_n_lines:
+ * @buffer: A #InfTextRopeBuffer.
+ *
+ * Returns the number of lines in @buffer, which is one more than the number
+ * of newline characters it contains. The value is cached, so this function
+ * runs in constant time.
+ *
+ * Returns: The number of lines in @buffer.
+ **/
+guint
+inf_text_rope_buffer_get_n_lines(InfTextRopeBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+
+  g_return_val_if_fail(INF_TEXT_IS_ROPE_BUFFER(buffer), 0);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  if(priv->root == NULL)
+    return 1;
+  return priv->root->total_lines + 1;
+}
+
+/**
+ * inf_text_rope_buffer_get_n_segments:
+ * @buffer: A #InfTextRopeBuffer.
+ *
+ * Returns the number of segments @buffer currently stores its text in. This
+ * is mostly useful for testing and profiling. Adjacent segments might have
+ * the same author.
+ *
+ * Returns: The number of segments in @buffer.
+ **/
+guint
+inf_text_rope_buffer_get_n_segments(InfTextRopeBuffer* buffer)
+{
+  InfTextRopeBufferPrivate* priv;
+
+  g_return_val_if_fail(INF_TEXT_IS_ROPE_BUFFER(buffer), 0);
+  priv = INF_TEXT_ROPE_BUFFER_PRIVATE(buffer);
+
+  if(priv->root == NULL)
+    return 0;
+  return priv->root->total_nodes;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,72 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_ROPE_BUFFER_H__
+#define __INF_TEXT_ROPE_BUFFER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TEXT_TYPE_ROPE_BUFFER                 (inf_text_rope_buffer_get_type())
+#define INF_TEXT_ROPE_BUFFER(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TEXT_TYPE_ROPE_BUFFER, InfTextRopeBuffer))
+#define INF_TEXT_ROPE_BUFFER_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INF_TEXT_TYPE_ROPE_BUFFER, InfTextRopeBufferClass))
+#define INF_TEXT_IS_ROPE_BUFFER(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INF_TEXT_TYPE_ROPE_BUFFER))
+#define INF_TEXT_IS_ROPE_BUFFER_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TEXT_TYPE_ROPE_BUFFER))
+#define INF_TEXT_ROPE_BUFFER_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TEXT_TYPE_ROPE_BUFFER, InfTextRopeBufferClass))
+
+typedef struct _InfTextRopeBuffer InfTextRopeBuffer;
+typedef struct _InfTextRopeBufferClass InfTextRopeBufferClass;
+
+/**
+ * InfTextRopeBufferClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfTextRopeBufferClass {
+  GObjectClass parent_class;
+};
+
+/**
+ * InfTextRopeBuffer:
+ *
+ * #InfTextRopeBuffer is an opaque data type. You should only access it via
+ * the public API functions.
+ */
+struct _InfTextRopeBuffer {
+  GObject parent;
+};
+
+GType
+inf_text_rope_buffer_get_type(void) G_GNUC_CONST;
+
+InfTextRopeBuffer*
+inf_text_rope_buffer_new(void);
+
+guint
+inf_text_rope_buffer_get_n_lines(InfTextRopeBuffer* buffer);
+
+guint
+inf_text_rope_buffer_get_n_segments(InfTextRopeBuffer* buffer);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_ROPE_BUFFER_H__ */
+
+/* vim:set et sw=2 ts=2: */
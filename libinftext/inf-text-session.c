@@ -26,7 +26,10 @@
 #include <libinftext/inf-text-move-operation.h>
 #include <libinftext/inf-text-chunk.h>
 #include <libinftext/inf-text-user.h>
+#include <libinftext/inf-text-iconv-private.h>
+#include <libinftext/inf-text-utf8-private.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
@@ -37,7 +40,17 @@
 #include <errno.h>
 
 /* TODO: Optionally broadcast operations delayed to merge adjacent operations
- * and send as a single request. */
+ * and send as a single request. Note that merging cannot be done on the
+ * wire alone: the receivers number the requests of a user consecutively, so
+ * the merged request must also be a single request in our own request log.
+ * This means that a local change could only be logged once it can no longer
+ * be merged, while the buffer has already been modified. Until then, remote
+ * requests would need to be transformed against the pending change before
+ * being applied, inf_adopted_algorithm_get_current() would not reflect the
+ * buffer content, and synchronizations and undo would need to flush the
+ * pending change first. Practically all text sent in one go (e.g. pasted
+ * text) already ends up in a single request though, and outgoing messages
+ * are sent in batches by the communication layer. */
 
 typedef struct _InfTextSessionLocalUser InfTextSessionLocalUser;
 struct _InfTextSessionLocalUser {
@@ -47,10 +60,29 @@ struct _InfTextSessionLocalUser {
   InfIoTimeout* caret_timeout;
 };
 
+/* Every user's selection, ordered by its end, i.e. the larger one of caret
+ * position and selection bound. Text changes can only affect selections
+ * which end at or behind the position of the change. */
+typedef struct _InfTextSessionCaret InfTextSessionCaret;
+struct _InfTextSessionCaret {
+  InfTextUser* user;
+  guint end;
+  GSequenceIter* iter;
+};
+
 typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
   GSList* local_users;
+
+  GSequence* carets;
+  GHashTable* caret_table; /* InfTextUser -> InfTextSessionCaret */
+
+  /* The sync-segment messages for the current buffer content, kept around
+   * between synchronizations until the buffer changes. When several users
+   * join a session shortly after each other, which is common for example
+   * after a server restart, the buffer only needs to be serialized once. */
+  xmlNodePtr sync_snapshot;
 };
 
 enum {
@@ -66,7 +98,7 @@ typedef struct _InfTextSessionEraseForeachData
 
 struct _InfTextSessionInsertForeachData {
   guint position;
-  InfTextChunk* chunk;
+  guint length;
   InfUser* user;
 };
 
@@ -76,6 +108,22 @@ struct _InfTextSessionEraseForeachData {
   InfUser* user;
 };
 
+/* An edit found by inf_text_session_replace_text(), replacing a_len
+ * characters at a_pos in the old text by b_len characters at b_pos in the
+ * new text. */
+typedef struct _InfTextSessionDiffEdit InfTextSessionDiffEdit;
+struct _InfTextSessionDiffEdit {
+  guint a_pos;
+  guint a_len;
+  guint b_pos;
+  guint b_len;
+};
+
+/* The maximum number of characters inf_text_session_replace_text() inserts
+ * or erases before it falls back to replacing everything in between the
+ * first and last difference. */
+static const gint INF_TEXT_SESSION_DIFF_MAX_COST = 1000;
+
 #define INF_TEXT_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_SESSION, InfTextSessionPrivate))
 
 static GQuark inf_text_session_error_quark;
@@ -87,6 +135,19 @@ G_DEFINE_TYPE_WITH_CODE(InfTextSession, inf_text_session, INF_ADOPTED_TYPE_SESSI
  * Utility functions
  */
 
+static void
+inf_text_session_invalidate_sync_snapshot(InfTextSession* session)
+{
+  InfTextSessionPrivate* priv;
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  if(priv->sync_snapshot != NULL)
+  {
+    xmlFreeNode(priv->sync_snapshot);
+    priv->sync_snapshot = NULL;
+  }
+}
+
 /* Returns the difference between two GTimeVal, in milliseconds */
 static guint
 inf_text_session_timeval_diff(GTimeVal* first,
@@ -101,17 +162,23 @@ inf_text_session_timeval_diff(GTimeVal* first,
          (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
 }
 
+/* Maximum number of UTF-8 bytes in a single <sync-segment> */
+#define INF_TEXT_SESSION_SYNC_SEGMENT_SIZE 65536
+
 /* Converts at most *bytes bytes with cd and writes the result, which are
- * at most 1024 bytes, into xml, setting the given author. *bytes will be
- * set to the number of bytes not yet processed. */
+ * at most INF_TEXT_SESSION_SYNC_SEGMENT_SIZE bytes, into xml, setting the
+ * given author. *bytes will be set to the number of bytes not yet processed.
+ * If cd is NULL, then text is in UTF-8 already and is written as-is, and
+ * utf8_text is not used. Otherwise, utf8_text is used as conversion buffer
+ * and must be INF_TEXT_SESSION_SYNC_SEGMENT_SIZE bytes long. */
 static void
 inf_text_session_segment_to_xml(GIConv* cd,
+                                gchar* utf8_text,
                                 xmlNodePtr xml,
                                 gconstpointer text,
                                 gsize* bytes, /* in/out */
                                 guint author)
 {
-  gchar utf8_text[1024];
   gsize result;
 
   gsize bytes_left;
@@ -119,26 +186,49 @@ inf_text_session_segment_to_xml(GIConv* cd,
   gchar* inbuf;
   gchar* outbuf;
 
-  bytes_left = 1024;
+  if(cd == NULL)
+  {
+    inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
+    bytes_left = MIN(*bytes, INF_TEXT_SESSION_SYNC_SEGMENT_SIZE);
 
-  inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
-  outbuf = utf8_text;
+    /* Do not split a character between two segments */
+    if(bytes_left < *bytes)
+      while((inbuf[bytes_left] & 0xc0) == 0x80)
+        --bytes_left;
 
-  result = g_iconv(
-    *cd,
-    &inbuf,
-    bytes,
-    &outbuf,
-    &bytes_left
-  );
+    inf_xml_util_add_child_text(xml, inbuf, bytes_left);
+    *bytes -= bytes_left;
+  }
+  else
+  {
+    bytes_left = INF_TEXT_SESSION_SYNC_SEGMENT_SIZE;
+
+    inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
+    outbuf = utf8_text;
+
+    result = g_iconv(
+      *cd,
+      &inbuf,
+      bytes,
+      &outbuf,
+      &bytes_left
+    );
 
-  /* Conversion into UTF-8 should always succeed */
-  g_assert(result == 0 || errno == E2BIG);
+    /* Conversion into UTF-8 should always succeed */
+    g_assert(result == 0 || errno == E2BIG);
+
+    inf_xml_util_add_child_text(
+      xml,
+      utf8_text,
+      INF_TEXT_SESSION_SYNC_SEGMENT_SIZE - bytes_left
+    );
+  }
 
-  inf_xml_util_add_child_text(xml, utf8_text, 1024 - bytes_left);
   inf_xml_util_set_attribute_uint(xml, "author", author);
 }
 
+/* Reads the text of a segment from xml and converts it with cd. If cd is
+ * NULL, then the text is returned in UTF-8. */
 static gpointer
 inf_text_session_segment_from_xml(GIConv* cd,
                                   xmlNodePtr xml,
@@ -158,6 +248,12 @@ inf_text_session_segment_from_xml(GIConv* cd,
   if(!utf8_text)
     return NULL;
 
+  if(cd == NULL)
+  {
+    *bytes = bytes_read;
+    return utf8_text;
+  }
+
   text = g_convert_with_iconv(
     utf8_text,
     bytes_read,
@@ -457,11 +553,183 @@ inf_text_session_unblock_local_users_selection_changed(InfTextSession* sess)
   }
 }
 
+static gint
+inf_text_session_caret_cmp(gconstpointer first,
+                           gconstpointer second,
+                           gpointer user_data)
+{
+  const InfTextSessionCaret* first_caret;
+  const InfTextSessionCaret* second_caret;
+
+  first_caret = (const InfTextSessionCaret*)first;
+  second_caret = (const InfTextSessionCaret*)second;
+
+  if(first_caret->end < second_caret->end) return -1;
+  if(first_caret->end > second_caret->end) return 1;
+
+  /* A caret without user is used as a search key, which goes in front of
+   * all carets with the same end. */
+  if(first_caret->user == second_caret->user) return 0;
+  if(first_caret->user == NULL) return -1;
+  if(second_caret->user == NULL) return 1;
+  return first_caret->user < second_caret->user ? -1 : 1;
+}
+
+static guint
+inf_text_session_caret_get_end(InfTextUser* user)
+{
+  guint position;
+  gint length;
+
+  position = inf_text_user_get_caret_position(user);
+  length = inf_text_user_get_selection_length(user);
+
+  if(length > 0)
+    return position + length;
+  return position;
+}
+
+static void
+inf_text_session_caret_selection_changed_cb(InfTextUser* user,
+                                            guint position,
+                                            gint length,
+                                            gboolean by_request,
+                                            gpointer user_data)
+{
+  InfTextSessionPrivate* priv;
+  InfTextSessionCaret* caret;
+  guint end;
+
+  priv = INF_TEXT_SESSION_PRIVATE(user_data);
+  caret = g_hash_table_lookup(priv->caret_table, user);
+  g_assert(caret != NULL);
+
+  end = inf_text_session_caret_get_end(user);
+  if(caret->end != end)
+  {
+    caret->end = end;
+    g_sequence_sort_changed(caret->iter, inf_text_session_caret_cmp, NULL);
+  }
+}
+
+static void
+inf_text_session_add_caret(InfTextSession* session,
+                           InfTextUser* user)
+{
+  InfTextSessionPrivate* priv;
+  InfTextSessionCaret* caret;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  g_assert(g_hash_table_lookup(priv->caret_table, user) == NULL);
+
+  caret = g_slice_new(InfTextSessionCaret);
+  caret->user = user;
+  caret->end = inf_text_session_caret_get_end(user);
+  caret->iter = g_sequence_insert_sorted(
+    priv->carets,
+    caret,
+    inf_text_session_caret_cmp,
+    NULL
+  );
+
+  g_hash_table_insert(priv->caret_table, user, caret);
+
+  g_signal_connect_after(
+    G_OBJECT(user),
+    "selection-changed",
+    G_CALLBACK(inf_text_session_caret_selection_changed_cb),
+    session
+  );
+}
+
+static void
+inf_text_session_remove_caret(InfTextSession* session,
+                              InfTextSessionCaret* caret)
+{
+  InfTextSessionPrivate* priv;
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(caret->user),
+    G_CALLBACK(inf_text_session_caret_selection_changed_cb),
+    session
+  );
+
+  g_hash_table_remove(priv->caret_table, caret->user);
+  g_sequence_remove(caret->iter);
+  g_slice_free(InfTextSessionCaret, caret);
+}
+
+static void
+inf_text_session_user_added_cb(InfUserTable* user_table,
+                               InfUser* user,
+                               gpointer user_data)
+{
+  g_assert(INF_TEXT_IS_USER(user));
+
+  inf_text_session_add_caret(
+    INF_TEXT_SESSION(user_data),
+    INF_TEXT_USER(user)
+  );
+}
+
+static void
+inf_text_session_user_removed_cb(InfUserTable* user_table,
+                                 InfUser* user,
+                                 gpointer user_data)
+{
+  InfTextSessionPrivate* priv;
+  InfTextSessionCaret* caret;
+
+  priv = INF_TEXT_SESSION_PRIVATE(user_data);
+  caret = g_hash_table_lookup(priv->caret_table, user);
+  g_assert(caret != NULL);
+
+  inf_text_session_remove_caret(INF_TEXT_SESSION(user_data), caret);
+}
+
+/* Returns the users whose selection might be affected by a change of the
+ * text at position, in no particular order. Selections which end before
+ * position are never affected, so they are not even looked at. */
+static GSList*
+inf_text_session_get_carets_from(InfTextSession* session,
+                                 guint position)
+{
+  InfTextSessionPrivate* priv;
+  InfTextSessionCaret key;
+  GSequenceIter* iter;
+  GSList* list;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  key.user = NULL;
+  key.end = position;
+  key.iter = NULL;
+
+  iter = g_sequence_search(
+    priv->carets,
+    &key,
+    inf_text_session_caret_cmp,
+    NULL
+  );
+
+  list = NULL;
+  while(!g_sequence_iter_is_end(iter))
+  {
+    list = g_slist_prepend(list, g_sequence_get(iter));
+    iter = g_sequence_iter_next(iter);
+  }
+
+  return list;
+}
+
 static void
 inf_text_session_buffer_text_inserted_cb_foreach_func(InfUser* user,
                                                       gpointer user_data)
 {
   InfTextSessionInsertForeachData* data;
+  guint old_position;
+  gint old_length;
   guint position;
   gint length;
 
@@ -469,18 +737,24 @@ inf_text_session_buffer_text_inserted_cb_foreach_func(InfUser* user,
   if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
   {
     /* TODO: Handle separately if insert-caret */
-    position = inf_text_user_get_caret_position(INF_TEXT_USER(user));
-    length = inf_text_user_get_selection_length(INF_TEXT_USER(user));
+    old_position = inf_text_user_get_caret_position(INF_TEXT_USER(user));
+    old_length = inf_text_user_get_selection_length(INF_TEXT_USER(user));
+    position = old_position;
+    length = old_length;
 
     inf_text_move_operation_transform_insert(
       data->position,
-      inf_text_chunk_get_length(data->chunk),
+      data->length,
       &position,
       &length,
       /* Right gravity for local insertions, left gravity for remote ones */
       user == data->user ? FALSE : TRUE
     );
 
+    /* Only notify about selections that actually moved */
+    if(position == old_position && length == old_length)
+      return;
+
     inf_text_user_set_selection(
       INF_TEXT_USER(user),
       position,
@@ -495,6 +769,8 @@ inf_text_session_buffer_text_erased_cb_foreach_func(InfUser* user,
                                                     gpointer user_data)
 {
   InfTextSessionEraseForeachData* data;
+  guint old_position;
+  gint old_length;
   guint position;
   gint length;
 
@@ -502,8 +778,10 @@ inf_text_session_buffer_text_erased_cb_foreach_func(InfUser* user,
   if(inf_user_get_status(user) != INF_USER_UNAVAILABLE)
   {
     /* TODO: Handle separately if erase-caret */
-    position = inf_text_user_get_caret_position(INF_TEXT_USER(user));
-    length = inf_text_user_get_selection_length(INF_TEXT_USER(user));
+    old_position = inf_text_user_get_caret_position(INF_TEXT_USER(user));
+    old_length = inf_text_user_get_selection_length(INF_TEXT_USER(user));
+    position = old_position;
+    length = old_length;
 
     inf_text_move_operation_transform_delete(
       data->position,
@@ -512,6 +790,9 @@ inf_text_session_buffer_text_erased_cb_foreach_func(InfUser* user,
       &length
     );
 
+    if(position == old_position && length == old_length)
+      return;
+
     inf_text_user_set_selection(
       INF_TEXT_USER(user),
       position,
@@ -532,22 +813,24 @@ inf_text_session_buffer_text_inserted_cb(InfTextBuffer* buffer,
 {
   InfTextSession* session;
   InfTextSessionPrivate* priv;
-  InfUserTable* user_table;
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedRequest* execute_request;
 
   InfAdoptedOperation* operation;
   InfAdoptedRequest* request;
   InfTextSessionInsertForeachData data;
+  GSList* carets;
+  GSList* item;
 
   g_assert(INF_TEXT_IS_USER(user));
 
   session = INF_TEXT_SESSION(user_data);
   priv = INF_TEXT_SESSION_PRIVATE(session);
-  user_table = inf_session_get_user_table(INF_SESSION(session));
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
   execute_request = inf_adopted_algorithm_get_execute_request(algorithm);
 
+  inf_text_session_invalidate_sync_snapshot(session);
+
   if(execute_request == NULL)
   {
     operation = INF_ADOPTED_OPERATION(
@@ -574,16 +857,24 @@ inf_text_session_buffer_text_inserted_cb(InfTextBuffer* buffer,
   }
 
   data.position = pos;
-  data.chunk = chunk;
+  data.length = inf_text_chunk_get_length(chunk);
   data.user = user;
 
+  /* Collect the affected carets first, since changing a selection
+   * reorders the caret sequence. */
+  carets = inf_text_session_get_carets_from(session, pos);
+
   inf_text_session_block_local_users_selection_changed(session);
 
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_session_buffer_text_inserted_cb_foreach_func,
-    &data
-  );
+  for(item = carets; item != NULL; item = g_slist_next(item))
+  {
+    inf_text_session_buffer_text_inserted_cb_foreach_func(
+      INF_USER(((InfTextSessionCaret*)item->data)->user),
+      &data
+    );
+  }
+
+  g_slist_free(carets);
 
 #if 0
   /* TODO: If that was an insert-caret request, then do this: */
@@ -610,22 +901,24 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
 {
   InfTextSession* session;
   InfTextSessionPrivate* priv;
-  InfUserTable* user_table;
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedRequest* execute_request;
 
   InfAdoptedOperation* operation;
   InfAdoptedRequest* request;
   InfTextSessionEraseForeachData data;
+  GSList* carets;
+  GSList* item;
 
   g_assert(INF_TEXT_IS_USER(user));
 
   session = INF_TEXT_SESSION(user_data);
   priv = INF_TEXT_SESSION_PRIVATE(session);
-  user_table = inf_session_get_user_table(INF_SESSION(session));
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
   execute_request = inf_adopted_algorithm_get_execute_request(algorithm);
 
+  inf_text_session_invalidate_sync_snapshot(session);
+
   if(execute_request == NULL)
   {
     operation = INF_ADOPTED_OPERATION(
@@ -655,13 +948,19 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
   data.length = inf_text_chunk_get_length(chunk);
   data.user = user;
 
+  carets = inf_text_session_get_carets_from(session, pos);
+
   inf_text_session_block_local_users_selection_changed(session);
 
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_session_buffer_text_erased_cb_foreach_func,
-    &data
-  );
+  for(item = carets; item != NULL; item = g_slist_next(item))
+  {
+    inf_text_session_buffer_text_erased_cb_foreach_func(
+      INF_USER(((InfTextSessionCaret*)item->data)->user),
+      &data
+    );
+  }
+
+  g_slist_free(carets);
 
   /* TODO: If that was an erase-caret request, then do this: */
 #if 0
@@ -672,6 +971,18 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
   inf_text_session_unblock_local_users_selection_changed(session);
 }
 
+static void
+inf_text_session_init_text_handlers_caret_foreach_func(InfUser* user,
+                                                       gpointer user_data)
+{
+  g_assert(INF_TEXT_IS_USER(user));
+
+  inf_text_session_add_caret(
+    INF_TEXT_SESSION(user_data),
+    INF_TEXT_USER(user)
+  );
+}
+
 static void
 inf_text_session_init_text_handlers_user_foreach_func(InfUser* user,
                                                       gpointer user_data)
@@ -709,6 +1020,20 @@ inf_text_session_init_text_handlers(InfTextSession* session)
     session
   );
 
+  g_signal_connect(
+    G_OBJECT(user_table),
+    "add-user",
+    G_CALLBACK(inf_text_session_user_added_cb),
+    session
+  );
+
+  g_signal_connect(
+    G_OBJECT(user_table),
+    "remove-user",
+    G_CALLBACK(inf_text_session_user_removed_cb),
+    session
+  );
+
   g_signal_connect(
     G_OBJECT(user_table),
     "add-local-user",
@@ -723,6 +1048,12 @@ inf_text_session_init_text_handlers(InfTextSession* session)
     session
   );
 
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_session_init_text_handlers_caret_foreach_func,
+    session
+  );
+
   inf_user_table_foreach_local_user(
     user_table,
     inf_text_session_init_text_handlers_user_foreach_func,
@@ -730,6 +1061,214 @@ inf_text_session_init_text_handlers(InfTextSession* session)
   );
 }
 
+/* Converts text in the given encoding into an array of characters. Returns
+ * NULL if text is not valid in that encoding. */
+static gunichar*
+inf_text_session_text_to_ucs4(const gchar* encoding,
+                              gconstpointer text,
+                              gsize bytes,
+                              glong* length)
+{
+  gchar* utf8_text;
+  gsize bytes_read;
+  gsize bytes_written;
+  gunichar* result;
+  const gchar* pos;
+  glong n;
+  glong i;
+
+  if(strcmp(encoding, "UTF-8") == 0)
+  {
+    if(!_inf_text_utf8_validate_count(text, bytes, &n))
+      return NULL;
+
+    /* The length is known already, so decode directly instead of letting
+     * g_utf8_to_ucs4_fast() count the characters once more */
+    result = g_new(gunichar, n + 1);
+    for(i = 0, pos = text; i < n; ++i, pos = g_utf8_next_char(pos))
+      result[i] = g_utf8_get_char(pos);
+    result[n] = 0;
+
+    if(length != NULL) *length = n;
+    return result;
+  }
+
+  utf8_text = _inf_text_iconv_convert(
+    text,
+    bytes,
+    "UTF-8",
+    encoding,
+    &bytes_read,
+    &bytes_written,
+    NULL
+  );
+
+  if(utf8_text == NULL)
+    return NULL;
+
+  result = g_utf8_to_ucs4_fast(utf8_text, bytes_written, length);
+  g_free(utf8_text);
+  return result;
+}
+
+static gpointer
+inf_text_session_ucs4_to_text(const gchar* encoding,
+                              const gunichar* text,
+                              glong length,
+                              gsize* bytes)
+{
+  gchar* utf8_text;
+  glong bytes_written;
+  gsize converted_bytes;
+  gchar* result;
+
+  utf8_text = g_ucs4_to_utf8(text, length, NULL, &bytes_written, NULL);
+  g_assert(utf8_text != NULL);
+
+  if(strcmp(encoding, "UTF-8") == 0)
+  {
+    *bytes = bytes_written;
+    return utf8_text;
+  }
+
+  /* The text was in that encoding before it was converted to characters */
+  result = _inf_text_iconv_convert(
+    utf8_text,
+    bytes_written,
+    encoding,
+    "UTF-8",
+    NULL,
+    &converted_bytes,
+    NULL
+  );
+
+  g_assert(result != NULL);
+  g_free(utf8_text);
+
+  *bytes = converted_bytes;
+  return result;
+}
+
+/* Adds the edit erasing a[a_pos] or inserting b[b_pos] to the diff. The diff
+ * is built from the end towards the beginning, so edit is either merged
+ * into the last edit in diff or added in front of it. */
+static void
+inf_text_session_diff_add(GArray* diff,
+                          guint a_pos,
+                          guint b_pos,
+                          gboolean insert)
+{
+  InfTextSessionDiffEdit* last;
+  InfTextSessionDiffEdit edit;
+
+  if(diff->len > 0)
+  {
+    last = &g_array_index(diff, InfTextSessionDiffEdit, diff->len - 1);
+    if(last->a_pos == a_pos + (insert ? 0 : 1) &&
+       last->b_pos == b_pos + (insert ? 1 : 0))
+    {
+      last->a_pos = a_pos;
+      last->b_pos = b_pos;
+      if(insert) ++last->b_len;
+      else ++last->a_len;
+      return;
+    }
+  }
+
+  edit.a_pos = a_pos;
+  edit.a_len = insert ? 0 : 1;
+  edit.b_pos = b_pos;
+  edit.b_len = insert ? 1 : 0;
+  g_array_append_val(diff, edit);
+}
+
+/* Computes a shortest edit script from a to b with the algorithm from "An
+ * O(ND) Difference Algorithm and Its Variations" by Eugene W. Myers. The
+ * edits are appended to diff in reverse order. The state of every round is
+ * kept for backtracking, which needs quadratic memory in the number of
+ * edited characters. Therefore, this gives up and returns FALSE if more than
+ * max_cost characters would need to be inserted or erased. */
+static gboolean
+inf_text_session_diff_myers(const gunichar* a,
+                            gint n,
+                            const gunichar* b,
+                            gint m,
+                            gint max_cost,
+                            GArray* diff)
+{
+  GArray* trace;
+  gint* v;
+  gint* prev;
+  gint offset;
+  gint d;
+  gint k;
+  gint x;
+  gint y;
+  gint prev_k;
+  gboolean insert;
+
+  /* v[offset + k] is the furthest x reached on diagonal k = x - y */
+  offset = max_cost + 1;
+  v = g_new0(gint, 2 * max_cost + 3);
+  trace = g_array_new(FALSE, FALSE, sizeof(gint));
+
+  for(d = 0; d <= max_cost; ++d)
+  {
+    for(k = -d; k <= d; k += 2)
+    {
+      if(k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+        x = v[offset + k + 1];
+      else
+        x = v[offset + k - 1] + 1;
+
+      y = x - k;
+      while(x < n && y < m && a[x] == b[y])
+      {
+        ++x;
+        ++y;
+      }
+
+      v[offset + k] = x;
+      if(x >= n && y >= m)
+        break;
+    }
+
+    if(k <= d)
+      break;
+
+    /* The state after round d, for diagonals -d to d, starts at index d^2 */
+    g_array_append_vals(trace, v + offset - d, 2 * d + 1);
+  }
+
+  g_free(v);
+
+  if(d > max_cost)
+  {
+    g_array_free(trace, TRUE);
+    return FALSE;
+  }
+
+  /* Walk back from the end to the beginning, one edit per round */
+  x = n;
+  y = m;
+  for(; d > 0; --d)
+  {
+    prev = &g_array_index(trace, gint, (d - 1) * (d - 1) + (d - 1));
+    k = x - y;
+
+    insert = (k == -d || (k != d && prev[k - 1] < prev[k + 1]));
+    prev_k = insert ? k + 1 : k - 1;
+
+    x = prev[prev_k];
+    y = x - prev_k;
+
+    inf_text_session_diff_add(diff, x, y, insert);
+  }
+
+  g_array_free(trace, TRUE);
+  return TRUE;
+}
+
 /*
  * GObject overrides.
  */
@@ -741,6 +1280,9 @@ inf_text_session_init(InfTextSession* session)
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
   priv->caret_update_interval = 500;
+  priv->carets = g_sequence_new(NULL);
+  priv->caret_table = g_hash_table_new(NULL, NULL);
+  priv->sync_snapshot = NULL;
 }
 
 static void
@@ -815,6 +1357,14 @@ inf_text_session_dispose(GObject* object)
     );
   }
 
+  while(!g_sequence_is_empty(priv->carets))
+  {
+    inf_text_session_remove_caret(
+      session,
+      g_sequence_get(g_sequence_get_begin_iter(priv->carets))
+    );
+  }
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(buffer),
     G_CALLBACK(inf_text_session_buffer_text_inserted_cb),
@@ -829,18 +1379,32 @@ inf_text_session_dispose(GObject* object)
 
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(user_table),
-    G_CALLBACK(inf_text_session_local_user_added_cb),
+    G_CALLBACK(inf_text_session_user_added_cb),
     session
   );
 
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(user_table),
-    G_CALLBACK(inf_text_session_local_user_removed_cb),
+    G_CALLBACK(inf_text_session_user_removed_cb),
     session
   );
 
-  G_OBJECT_CLASS(inf_text_session_parent_class)->dispose(object);
-}
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(user_table),
+    G_CALLBACK(inf_text_session_local_user_added_cb),
+    session
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(user_table),
+    G_CALLBACK(inf_text_session_local_user_removed_cb),
+    session
+  );
+
+  inf_text_session_invalidate_sync_snapshot(session);
+
+  G_OBJECT_CLASS(inf_text_session_parent_class)->dispose(object);
+}
 
 static void
 inf_text_session_finalize(GObject* object)
@@ -851,6 +1415,9 @@ inf_text_session_finalize(GObject* object)
   session = INF_TEXT_SESSION(object);
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
+  g_sequence_free(priv->carets);
+  g_hash_table_destroy(priv->caret_table);
+
   G_OBJECT_CLASS(inf_text_session_parent_class)->finalize(object);
 }
 
@@ -976,10 +1543,9 @@ inf_text_session_handle_user_color_change(InfTextSession* session,
  */
 
 static void
-inf_text_session_to_xml_sync(InfSession* session,
-                             xmlNodePtr parent)
+inf_text_session_buffer_to_xml_sync(InfTextBuffer* buffer,
+                                    xmlNodePtr parent)
 {
-  InfTextBuffer* buffer;
   InfTextBufferIter* iter;
   xmlNodePtr xml;
   gboolean result;
@@ -987,15 +1553,23 @@ inf_text_session_to_xml_sync(InfSession* session,
   gchar* text;
   gsize total_bytes;
   gsize bytes_left;
+  gboolean is_utf8;
   GIConv cd;
+  gchar* utf8_text;
 
-  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
-    session,
-    parent
-  );
-
-  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-  cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
+  /* Skip the conversion if the buffer is in UTF-8 already, which is the
+   * common case. */
+  is_utf8 = strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0;
+  if(!is_utf8)
+  {
+    cd = _inf_text_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
+    utf8_text = g_malloc(INF_TEXT_SESSION_SYNC_SEGMENT_SIZE);
+  }
+  else
+  {
+    cd = NULL;
+    utf8_text = NULL;
+  }
 
   iter = inf_text_buffer_create_begin_iter(buffer);
   if(iter != NULL)
@@ -1003,7 +1577,7 @@ inf_text_session_to_xml_sync(InfSession* session,
     result = TRUE;
     while(result == TRUE)
     {
-      /* Write segment in 1024 byte chunks */
+      /* Write segment in chunks of at most 64 KiB */
       text = inf_text_buffer_iter_get_text(buffer, iter);
       total_bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
       bytes_left = total_bytes;
@@ -1012,7 +1586,8 @@ inf_text_session_to_xml_sync(InfSession* session,
       {
         xml = xmlNewChild(parent, NULL, (const xmlChar*)"sync-segment", NULL);
         inf_text_session_segment_to_xml(
-          &cd,
+          is_utf8 ? NULL : &cd,
+          utf8_text,
           xml,
           text + total_bytes - bytes_left,
           &bytes_left,
@@ -1027,7 +1602,50 @@ inf_text_session_to_xml_sync(InfSession* session,
     inf_text_buffer_destroy_iter(buffer, iter);
   }
 
-  g_iconv_close(cd);
+  if(!is_utf8)
+  {
+    _inf_text_iconv_close("UTF-8", inf_text_buffer_get_encoding(buffer), cd);
+    g_free(utf8_text);
+  }
+}
+
+static void
+inf_text_session_to_xml_sync(InfSession* session,
+                             xmlNodePtr parent)
+{
+  InfTextSessionPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+
+  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
+    session,
+    parent
+  );
+
+  /* The snapshot is invalidated by the text-inserted and text-erased
+   * handlers, which are only connected while the session is running. */
+  if(inf_session_get_status(session) != INF_SESSION_RUNNING)
+  {
+    inf_text_session_buffer_to_xml_sync(
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      parent
+    );
+
+    return;
+  }
+
+  if(priv->sync_snapshot == NULL)
+  {
+    priv->sync_snapshot = xmlNewNode(NULL, (const xmlChar*)"sync-snapshot");
+    inf_text_session_buffer_to_xml_sync(
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      priv->sync_snapshot
+    );
+  }
+
+  for(xml = priv->sync_snapshot->children; xml != NULL; xml = xml->next)
+    xmlAddChild(parent, xmlCopyNode(xml, 1));
 }
 
 static gboolean
@@ -1037,6 +1655,7 @@ inf_text_session_process_xml_sync(InfSession* session,
                                   GError** error)
 {
   InfTextBuffer* buffer;
+  const gchar* encoding;
   GIConv cd;
 
   gpointer text;
@@ -1048,18 +1667,35 @@ inf_text_session_process_xml_sync(InfSession* session,
   if(strcmp((const char*)xml->name, "sync-segment") == 0)
   {
     buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-    cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
+    encoding = inf_text_buffer_get_encoding(buffer);
 
-    text = inf_text_session_segment_from_xml(
-      &cd,
-      xml,
-      &length,
-      &bytes,
-      &author,
-      error
-    );
+    if(strcmp(encoding, "UTF-8") == 0)
+    {
+      text = inf_text_session_segment_from_xml(
+        NULL,
+        xml,
+        &length,
+        &bytes,
+        &author,
+        error
+      );
+    }
+    else
+    {
+      cd = _inf_text_iconv_open(encoding, "UTF-8");
+
+      text = inf_text_session_segment_from_xml(
+        &cd,
+        xml,
+        &length,
+        &bytes,
+        &author,
+        error
+      );
+
+      _inf_text_iconv_close(encoding, "UTF-8", cd);
+    }
 
-    g_iconv_close(cd);
     if(text == NULL) return FALSE;
 
     if(author != 0)
@@ -1090,6 +1726,9 @@ inf_text_session_process_xml_sync(InfSession* session,
       user = NULL;
     }
 
+    /* The segments arrive in document order. Inserting each of them right
+     * away, instead of collecting them until sync-end, lets views of the
+     * buffer show the text while the rest is still being received. */
     inf_text_buffer_insert_text(
       buffer,
       inf_text_buffer_get_length(buffer),
@@ -1319,12 +1958,9 @@ inf_text_session_synchronization_complete(InfSession* session,
  * InfAdoptedSession overrides
  */
 
-static void
-inf_text_session_request_to_xml(InfAdoptedSession* session,
-                                xmlNodePtr xml,
-                                InfAdoptedRequest* request,
-                                InfAdoptedStateVector* diff_vec,
-                                gboolean for_sync)
+static xmlNodePtr
+inf_text_session_operation_to_xml(InfAdoptedOperation* operation,
+                                  gboolean for_sync)
 {
   InfTextChunk* chunk;
   InfTextChunkIter iter;
@@ -1336,40 +1972,50 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
   gsize bytes_written;
 
   GIConv cd;
+  gboolean is_utf8;
   xmlNodePtr child;
   const gchar* text;
   gsize total_bytes;
   gsize bytes_left;
 
-  InfAdoptedOperation* operation;
+  GSList* parts;
+  GSList* item;
 
-  switch(inf_adopted_request_get_request_type(request))
+  if(INF_TEXT_IS_INSERT_OPERATION(operation))
   {
-  case INF_ADOPTED_REQUEST_DO:
-    operation = inf_adopted_request_get_operation(request);
-    if(INF_TEXT_IS_INSERT_OPERATION(operation))
-    {
-      op_xml = xmlNewNode(NULL, (const xmlChar*)"insert-caret");
+    op_xml = xmlNewNode(NULL, (const xmlChar*)"insert-caret");
 
-      inf_xml_util_set_attribute_uint(
-        op_xml,
-        "pos",
-        inf_text_insert_operation_get_position(
-          INF_TEXT_INSERT_OPERATION(operation)
-        )
-      );
+    inf_xml_util_set_attribute_uint(
+      op_xml,
+      "pos",
+      inf_text_insert_operation_get_position(
+        INF_TEXT_INSERT_OPERATION(operation)
+      )
+    );
 
-      /* Must be default insert operation so we get the inserted text */
-      g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation));
+    /* Must be default insert operation so we get the inserted text */
+    g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation));
 
-      chunk = inf_text_default_insert_operation_get_chunk(
-        INF_TEXT_DEFAULT_INSERT_OPERATION(operation)
-      );
+    chunk = inf_text_default_insert_operation_get_chunk(
+      INF_TEXT_DEFAULT_INSERT_OPERATION(operation)
+    );
 
-      result = inf_text_chunk_iter_init_begin(chunk, &iter);
-      g_assert(result == TRUE);
+    result = inf_text_chunk_iter_init_begin(chunk, &iter);
+    g_assert(result == TRUE);
 
-      utf8_text = g_convert(
+    /* This runs for every keystroke, so avoid the conversion if the text
+     * is in UTF-8 already, which is the common case. */
+    if(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") == 0)
+    {
+      inf_xml_util_add_child_text(
+        op_xml,
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter)
+      );
+    }
+    else
+    {
+      utf8_text = _inf_text_iconv_convert(
         inf_text_chunk_iter_get_text(&iter),
         inf_text_chunk_iter_get_bytes(&iter),
         "UTF-8",
@@ -1385,99 +2031,161 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
 
       inf_xml_util_add_child_text(op_xml, utf8_text, bytes_written);
       g_free(utf8_text);
-
-      /* We only allow a single segment because the whole inserted text must
-       * be written by a single user. */
-      g_assert(inf_text_chunk_iter_next(&iter) == FALSE);
     }
-    else if(INF_TEXT_IS_DELETE_OPERATION(operation))
+
+    /* We only allow a single segment because the whole inserted text must
+     * be written by a single user. */
+    g_assert(inf_text_chunk_iter_next(&iter) == FALSE);
+  }
+  else if(INF_TEXT_IS_DELETE_OPERATION(operation))
+  {
+    op_xml = xmlNewNode(NULL, (const xmlChar*)"delete-caret");
+
+    inf_xml_util_set_attribute_uint(
+      op_xml,
+      "pos",
+      inf_text_delete_operation_get_position(
+        INF_TEXT_DELETE_OPERATION(operation)
+      )
+    );
+
+    if(for_sync == TRUE)
     {
-      op_xml = xmlNewNode(NULL, (const xmlChar*)"delete-caret");
+      /* Must be default delete operation so we get chunk */
+      g_assert(INF_TEXT_IS_DEFAULT_DELETE_OPERATION(operation));
 
-      inf_xml_util_set_attribute_uint(
-        op_xml,
-        "pos",
-        inf_text_delete_operation_get_position(
-          INF_TEXT_DELETE_OPERATION(operation)
-        )
+      chunk = inf_text_default_delete_operation_get_chunk(
+        INF_TEXT_DEFAULT_DELETE_OPERATION(operation)
       );
 
-      if(for_sync == TRUE)
+      /* Need to transmit all deleted data */
+      is_utf8 = strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") == 0;
+      if(!is_utf8)
       {
-        /* Must be default delete operation so we get chunk */
-        g_assert(INF_TEXT_IS_DEFAULT_DELETE_OPERATION(operation));
+        cd = _inf_text_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
+        utf8_text = g_malloc(INF_TEXT_SESSION_SYNC_SEGMENT_SIZE);
+      }
+      else
+      {
+        cd = NULL;
+        utf8_text = NULL;
+      }
 
-        chunk = inf_text_default_delete_operation_get_chunk(
-          INF_TEXT_DEFAULT_DELETE_OPERATION(operation)
-        );
+      result = inf_text_chunk_iter_init_begin(chunk, &iter);
 
-        /* Need to transmit all deleted data */
-        cd = g_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
-        result = inf_text_chunk_iter_init_begin(chunk, &iter);
+      while(result == TRUE)
+      {
+        text = inf_text_chunk_iter_get_text(&iter);
+        total_bytes = inf_text_chunk_iter_get_bytes(&iter);
+        bytes_left = total_bytes;
+        child = xmlNewChild(op_xml, NULL, (const xmlChar*)"segment", NULL);
 
-        while(result == TRUE)
+        while(bytes_left > 0)
         {
-          text = inf_text_chunk_iter_get_text(&iter);
-          total_bytes = inf_text_chunk_iter_get_bytes(&iter);
-          bytes_left = total_bytes;
-          child = xmlNewChild(op_xml, NULL, (const xmlChar*)"segment", NULL);
-
-          while(bytes_left > 0)
-          {
-            inf_text_session_segment_to_xml(
-              &cd,
-              child,
-              text + total_bytes - bytes_left,
-              &bytes_left,
-              inf_text_chunk_iter_get_author(&iter)
-            );
-          }
-
-          result = inf_text_chunk_iter_next(&iter);
+          inf_text_session_segment_to_xml(
+            is_utf8 ? NULL : &cd,
+            utf8_text,
+            child,
+            text + total_bytes - bytes_left,
+            &bytes_left,
+            inf_text_chunk_iter_get_author(&iter)
+          );
         }
 
-        g_iconv_close(cd);
+        result = inf_text_chunk_iter_next(&iter);
       }
-      else
+
+      if(!is_utf8)
       {
-        /* Just transmit position and length, the other site generates a
-         * InfTextRemoteDeleteOperation from that and is able to restore the
-         * deleted text for potential Undo. */
-        inf_xml_util_set_attribute_uint(
-          op_xml,
-          "len",
-          inf_text_delete_operation_get_length(
-            INF_TEXT_DELETE_OPERATION(operation)
-          )
+        _inf_text_iconv_close(
+          "UTF-8",
+          inf_text_chunk_get_encoding(chunk),
+          cd
         );
+
+        g_free(utf8_text);
       }
     }
-    else if(for_sync == FALSE && INF_TEXT_IS_MOVE_OPERATION(operation))
+    else
     {
-      op_xml = xmlNewNode(NULL, (const xmlChar*)"move");
-
+      /* Just transmit position and length, the other site generates a
+       * InfTextRemoteDeleteOperation from that and is able to restore the
+       * deleted text for potential Undo. */
       inf_xml_util_set_attribute_uint(
         op_xml,
-        "caret",
-        inf_text_move_operation_get_position(
-          INF_TEXT_MOVE_OPERATION(operation)
+        "len",
+        inf_text_delete_operation_get_length(
+          INF_TEXT_DELETE_OPERATION(operation)
         )
       );
+    }
+  }
+  else if(for_sync == FALSE && INF_TEXT_IS_MOVE_OPERATION(operation))
+  {
+    op_xml = xmlNewNode(NULL, (const xmlChar*)"move");
 
-      inf_xml_util_set_attribute_int(
+    inf_xml_util_set_attribute_uint(
+      op_xml,
+      "caret",
+      inf_text_move_operation_get_position(
+        INF_TEXT_MOVE_OPERATION(operation)
+      )
+    );
+
+    inf_xml_util_set_attribute_int(
+      op_xml,
+      "selection",
+      inf_text_move_operation_get_length(INF_TEXT_MOVE_OPERATION(operation))
+    );
+  }
+  else if(for_sync == FALSE && INF_ADOPTED_IS_NO_OPERATION(operation))
+  {
+    op_xml = xmlNewNode(NULL, (const xmlChar*)"no-op");
+  }
+  else if(INF_ADOPTED_IS_SPLIT_OPERATION(operation))
+  {
+    /* Several operations that are applied at once, for example edits of
+     * several regions made with inf_text_session_apply_edits(). */
+    op_xml = xmlNewNode(NULL, (const xmlChar*)"split");
+
+    parts = inf_adopted_split_operation_unsplit(
+      INF_ADOPTED_SPLIT_OPERATION(operation)
+    );
+
+    for(item = parts; item != NULL; item = item->next)
+    {
+      xmlAddChild(
         op_xml,
-        "selection",
-        inf_text_move_operation_get_length(INF_TEXT_MOVE_OPERATION(operation))
+        inf_text_session_operation_to_xml(item->data, for_sync)
       );
     }
-    else if(for_sync == FALSE && INF_ADOPTED_IS_NO_OPERATION(operation))
-    {
-      op_xml = xmlNewNode(NULL, (const xmlChar*)"no-op");
-    }
-    else
-    {
-      g_assert_not_reached();
-    }
+
+    g_slist_free(parts);
+  }
+  else
+  {
+    g_assert_not_reached();
+  }
+
+  return op_xml;
+}
+
+static void
+inf_text_session_request_to_xml(InfAdoptedSession* session,
+                                xmlNodePtr xml,
+                                InfAdoptedRequest* request,
+                                InfAdoptedStateVector* diff_vec,
+                                gboolean for_sync)
+{
+  xmlNodePtr op_xml;
+
+  switch(inf_adopted_request_get_request_type(request))
+  {
+  case INF_ADOPTED_REQUEST_DO:
+    op_xml = inf_text_session_operation_to_xml(
+      inf_adopted_request_get_operation(request),
+      for_sync
+    );
 
     break;
   case INF_ADOPTED_REQUEST_UNDO:
@@ -1502,21 +2210,14 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
   );
 }
 
-static InfAdoptedRequest*
-inf_text_session_xml_to_request(InfAdoptedSession* session,
-                                xmlNodePtr xml,
-                                InfAdoptedStateVector* diff_vec,
-                                gboolean for_sync,
-                                GError** error)
+static InfAdoptedOperation*
+inf_text_session_operation_from_xml(InfTextBuffer* buffer,
+                                    xmlNodePtr op_xml,
+                                    guint user_id,
+                                    gboolean for_sync,
+                                    GError** error)
 {
-  InfTextBuffer* buffer;
-  InfAdoptedUser* user;
-  guint user_id;
-  InfAdoptedStateVector* vector;
-  xmlNodePtr op_xml;
   InfAdoptedOperation* operation;
-  InfAdoptedRequestType type;
-  InfAdoptedRequest* request;
 
   guint pos;
   gchar* text;
@@ -1528,40 +2229,28 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   guint length;
 
   xmlNodePtr child;
+  const gchar* encoding;
+  gboolean is_utf8;
   GIConv cd;
   guint author;
   gboolean cmp;
 
   gint selection;
 
-  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
-
-  cmp = inf_adopted_session_read_request_info(
-    session,
-    xml,
-    diff_vec,
-    &user,
-    &vector,
-    &op_xml,
-    error
-  );
-
-  if(cmp == FALSE) return FALSE;
-  user_id = (user == NULL) ? 0 : inf_user_get_id(INF_USER(user));
+  GPtrArray* parts;
+  guint i;
 
   if(strcmp((const char*)op_xml->name, "insert") == 0 ||
      strcmp((const char*)op_xml->name, "insert-caret") == 0)
   {
-    type = INF_ADOPTED_REQUEST_DO;
-
     if(!inf_xml_util_get_attribute_uint_required(op_xml, "pos", &pos, error))
-      goto fail;
+      return NULL;
 
     utf8_text = inf_xml_util_get_child_text(op_xml, &in_bytes, &length, error);
     if(!utf8_text)
-      goto fail;
+      return NULL;
 
-    text = g_convert(
+    text = _inf_text_iconv_convert(
       utf8_text,
       in_bytes,
       inf_text_buffer_get_encoding(buffer),
@@ -1572,7 +2261,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     );
 
     g_free(utf8_text);
-    if(text == NULL) goto fail;
+    if(text == NULL) return NULL;
 
     chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
     inf_text_chunk_insert_text(chunk, 0, text, bytes, length, user_id);
@@ -1587,23 +2276,26 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   else if(strcmp((const char*)op_xml->name, "delete") == 0 ||
           strcmp((const char*)op_xml->name, "delete-caret") == 0)
   {
-    type = INF_ADOPTED_REQUEST_DO;
-
     if(!inf_xml_util_get_attribute_uint_required(op_xml, "pos", &pos, error))
-      goto fail;
+      return NULL;
 
     if(for_sync == TRUE)
     {
       chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
-      cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
-      g_assert(cd != (GIConv)(-1));
+      encoding = inf_text_buffer_get_encoding(buffer);
+      is_utf8 = strcmp(encoding, "UTF-8") == 0;
+      if(!is_utf8)
+      {
+        cd = _inf_text_iconv_open(encoding, "UTF-8");
+        g_assert(cd != (GIConv)(-1));
+      }
 
       for(child = op_xml->children; child != NULL; child = child->next)
       {
         if(strcmp((const char*)child->name, "segment") == 0)
         {
           text = inf_text_session_segment_from_xml(
-            &cd,
+            is_utf8 ? NULL : &cd,
             child,
             &length,
             &bytes,
@@ -1614,8 +2306,8 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
           if(text == NULL)
           {
             inf_text_chunk_free(chunk);
-            g_iconv_close(cd);
-            goto fail;
+            if(!is_utf8) _inf_text_iconv_close(encoding, "UTF-8", cd);
+            return NULL;
           }
           else
           {
@@ -1637,7 +2329,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
         }
       }
 
-      g_iconv_close(cd);
+      if(!is_utf8) _inf_text_iconv_close(encoding, "UTF-8", cd);
 
       operation = INF_ADOPTED_OPERATION(
         inf_text_default_delete_operation_new(pos, chunk)
@@ -1654,7 +2346,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
         error
       );
 
-      if(cmp == FALSE) goto fail;
+      if(cmp == FALSE) return NULL;
 
       operation = INF_ADOPTED_OPERATION(
         inf_text_remote_delete_operation_new(pos, length)
@@ -1663,8 +2355,6 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   }
   else if(strcmp((const char*)op_xml->name, "move") == 0)
   {
-    type = INF_ADOPTED_REQUEST_DO;
-
     cmp = inf_xml_util_get_attribute_uint_required(
       op_xml,
       "caret",
@@ -1672,7 +2362,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
       error
     );
 
-    if(cmp == FALSE) goto fail;
+    if(cmp == FALSE) return NULL;
 
     cmp = inf_xml_util_get_attribute_int_required(
       op_xml,
@@ -1681,7 +2371,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
       error
     );
 
-    if(cmp == FALSE) goto fail;
+    if(cmp == FALSE) return NULL;
 
     operation = INF_ADOPTED_OPERATION(
       inf_text_move_operation_new(pos, selection)
@@ -1689,11 +2379,101 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   }
   else if(strcmp((const char*)op_xml->name, "no-op") == 0)
   {
-    type = INF_ADOPTED_REQUEST_DO;
     operation = INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
   }
-  else if(strcmp((const char*)op_xml->name, "undo") == 0 ||
-          strcmp((const char*)op_xml->name, "undo-caret") == 0)
+  else if(strcmp((const char*)op_xml->name, "split") == 0)
+  {
+    parts = g_ptr_array_new();
+
+    for(child = op_xml->children; child != NULL; child = child->next)
+    {
+      if(child->type != XML_ELEMENT_NODE)
+        continue;
+
+      operation = inf_text_session_operation_from_xml(
+        buffer,
+        child,
+        user_id,
+        for_sync,
+        error
+      );
+
+      if(operation == NULL)
+        break;
+
+      g_ptr_array_add(parts, operation);
+    }
+
+    operation = NULL;
+    if(child == NULL)
+    {
+      if(parts->len >= 2)
+      {
+        operation = INF_ADOPTED_OPERATION(
+          inf_adopted_split_operation_new_multiple(
+            (InfAdoptedOperation**)parts->pdata,
+            parts->len
+          )
+        );
+      }
+      else
+      {
+        g_set_error_literal(
+          error,
+          inf_text_session_error_quark,
+          INF_TEXT_SESSION_ERROR_FAILED,
+          _("A split operation must contain at least two operations")
+        );
+      }
+    }
+
+    for(i = 0; i < parts->len; ++i)
+      g_object_unref(g_ptr_array_index(parts, i));
+    g_ptr_array_free(parts, TRUE);
+  }
+  else
+  {
+    /* TODO: Error */
+    operation = NULL;
+  }
+
+  return operation;
+}
+
+static InfAdoptedRequest*
+inf_text_session_xml_to_request(InfAdoptedSession* session,
+                                xmlNodePtr xml,
+                                InfAdoptedStateVector* diff_vec,
+                                gboolean for_sync,
+                                GError** error)
+{
+  InfTextBuffer* buffer;
+  InfAdoptedUser* user;
+  guint user_id;
+  InfAdoptedStateVector* vector;
+  xmlNodePtr op_xml;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequestType type;
+  InfAdoptedRequest* request;
+  gboolean cmp;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+
+  cmp = inf_adopted_session_read_request_info(
+    session,
+    xml,
+    diff_vec,
+    &user,
+    &vector,
+    &op_xml,
+    error
+  );
+
+  if(cmp == FALSE) return FALSE;
+  user_id = (user == NULL) ? 0 : inf_user_get_id(INF_USER(user));
+
+  if(strcmp((const char*)op_xml->name, "undo") == 0 ||
+     strcmp((const char*)op_xml->name, "undo-caret") == 0)
   {
     type = INF_ADOPTED_REQUEST_UNDO;
   }
@@ -1704,8 +2484,18 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   }
   else
   {
-    /* TODO: Error */
-    goto fail;
+    type = INF_ADOPTED_REQUEST_DO;
+
+    operation = inf_text_session_operation_from_xml(
+      buffer,
+      op_xml,
+      user_id,
+      for_sync,
+      error
+    );
+
+    if(operation == NULL)
+      goto fail;
   }
 
   switch(type)
@@ -2009,6 +2799,333 @@ inf_text_session_flush_requests_for_user(InfTextSession* session,
   }
 }
 
+/**
+ * inf_text_session_apply_edits:
+ * @session: A #InfTextSession.
+ * @user: A local #InfTextUser from @session's user table.
+ * @edits: (array length=n_edits): The edits to make.
+ * @n_edits: The number of elements in @edits.
+ *
+ * Makes all edits in @edits to the document in the name of @user, as a
+ * single request. This is much cheaper than inserting and erasing the text
+ * of each edit with inf_text_buffer_insert_text() and
+ * inf_text_buffer_erase_text(), which creates, transforms and sends one
+ * request for every call. Also, a single undo reverts all of the edits.
+ *
+ * The edits need to be sorted by position, and must not overlap, i.e. an
+ * edit must not begin before the text erased by the previous one ends. All
+ * positions refer to the document as it is before this call.
+ *
+ * @user must have the %INF_USER_LOCAL flag set.
+ */
+void
+inf_text_session_apply_edits(InfTextSession* session,
+                             InfTextUser* user,
+                             const InfTextSessionEdit* edits,
+                             guint n_edits)
+{
+  InfTextBuffer* buffer;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedOperation** operations;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfTextChunk* chunk;
+  const InfTextSessionEdit* edit;
+  guint n_operations;
+  guint end;
+  guint i;
+  gboolean result;
+
+  g_return_if_fail(INF_TEXT_IS_SESSION(session));
+  g_return_if_fail(INF_TEXT_IS_USER(user));
+  g_return_if_fail(edits != NULL || n_edits == 0);
+
+  g_return_if_fail(
+    inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE
+  );
+  g_return_if_fail(
+    (inf_user_get_flags(INF_USER(user)) & INF_USER_LOCAL) != 0
+  );
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+  end = 0;
+  for(i = 0; i < n_edits; ++i)
+  {
+    g_return_if_fail(edits[i].position >= end);
+    g_return_if_fail(edits[i].text != NULL || edits[i].length == 0);
+    end = edits[i].position + edits[i].erase_length;
+  }
+
+  g_return_if_fail(end <= inf_text_buffer_get_length(buffer));
+
+  /* Make the edits from the end of the document towards the beginning, so
+   * that the positions of the edits still to be made do not change. */
+  operations = g_new(InfAdoptedOperation*, n_edits * 2);
+  n_operations = 0;
+
+  for(i = n_edits; i > 0; --i)
+  {
+    edit = &edits[i - 1];
+
+    if(edit->erase_length > 0)
+    {
+      chunk = inf_text_buffer_get_slice(
+        buffer,
+        edit->position,
+        edit->erase_length
+      );
+
+      operations[n_operations++] = INF_ADOPTED_OPERATION(
+        inf_text_default_delete_operation_new(edit->position, chunk)
+      );
+
+      inf_text_chunk_free(chunk);
+    }
+
+    if(edit->length > 0)
+    {
+      chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
+
+      inf_text_chunk_insert_text(
+        chunk,
+        0,
+        edit->text,
+        edit->bytes,
+        edit->length,
+        inf_user_get_id(INF_USER(user))
+      );
+
+      operations[n_operations++] = INF_ADOPTED_OPERATION(
+        inf_text_default_insert_operation_new(edit->position, chunk)
+      );
+
+      inf_text_chunk_free(chunk);
+    }
+  }
+
+  if(n_operations == 0)
+  {
+    g_free(operations);
+    return;
+  }
+
+  if(n_operations == 1)
+  {
+    operation = operations[0];
+  }
+  else
+  {
+    operation = INF_ADOPTED_OPERATION(
+      inf_adopted_split_operation_new_multiple(operations, n_operations)
+    );
+
+    for(i = 0; i < n_operations; ++i)
+      g_object_unref(operations[i]);
+  }
+
+  g_free(operations);
+
+  request = inf_adopted_algorithm_generate_request(
+    algorithm,
+    INF_ADOPTED_REQUEST_DO,
+    INF_ADOPTED_USER(user),
+    operation
+  );
+
+  /* The buffer's signal handlers do not create requests of their own while
+   * the request is executed. */
+  result = inf_adopted_algorithm_execute_request(
+    algorithm,
+    request,
+    TRUE,
+    NULL
+  );
+
+  /* This cannot fail if the input parameters have been checked before. */
+  g_assert(result == TRUE);
+
+  inf_adopted_session_broadcast_request(INF_ADOPTED_SESSION(session), request);
+
+  g_object_unref(request);
+  g_object_unref(operation);
+}
+
+/**
+ * inf_text_session_replace_text:
+ * @session: A #InfTextSession.
+ * @user: A local #InfTextUser from @session's user table.
+ * @text: (type guint8*) (array length=bytes): The new content of the
+ * document, in the buffer's encoding.
+ * @bytes: The number of bytes of @text.
+ *
+ * Replaces the content of the document with @text in the name of @user,
+ * for example when a file has been reloaded from disk. Instead of erasing
+ * all the text and inserting @text, only the differences between the
+ * current content and @text are edited, as a single request made with
+ * inf_text_session_apply_edits(). This keeps requests small and keeps the
+ * authorship of the text that did not change.
+ *
+ * When the two texts differ too much for the differences to be found in a
+ * reasonable time, the region between their common beginning and end is
+ * replaced as a whole.
+ *
+ * @user must have the %INF_USER_LOCAL flag set.
+ */
+void
+inf_text_session_replace_text(InfTextSession* session,
+                              InfTextUser* user,
+                              gconstpointer text,
+                              gsize bytes)
+{
+  InfTextBuffer* buffer;
+  const gchar* encoding;
+  InfTextChunk* chunk;
+  gpointer old_text;
+  gsize old_bytes;
+  gunichar* a;
+  gunichar* b;
+  glong n;
+  glong m;
+  glong prefix;
+  glong suffix;
+  GArray* diff;
+  InfTextSessionDiffEdit* diff_edit;
+  InfTextSessionDiffEdit whole;
+  InfTextSessionEdit* edits;
+  guint i;
+
+  g_return_if_fail(INF_TEXT_IS_SESSION(session));
+  g_return_if_fail(INF_TEXT_IS_USER(user));
+  g_return_if_fail(text != NULL || bytes == 0);
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  encoding = inf_text_buffer_get_encoding(buffer);
+
+  b = inf_text_session_text_to_ucs4(encoding, text, bytes, &m);
+  g_return_if_fail(b != NULL);
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  old_text = inf_text_chunk_get_text(chunk, &old_bytes);
+  inf_text_chunk_free(chunk);
+
+  a = inf_text_session_text_to_ucs4(encoding, old_text, old_bytes, &n);
+  g_assert(a != NULL);
+  g_free(old_text);
+
+  /* Changes are usually local, so strip the common beginning and end
+   * before running the actual diff. */
+  prefix = 0;
+  while(prefix < n && prefix < m && a[prefix] == b[prefix])
+    ++prefix;
+
+  suffix = 0;
+  while(suffix < n - prefix && suffix < m - prefix &&
+        a[n - suffix - 1] == b[m - suffix - 1])
+  {
+    ++suffix;
+  }
+
+  diff = g_array_new(FALSE, FALSE, sizeof(InfTextSessionDiffEdit));
+
+  if(prefix + suffix < n || prefix + suffix < m)
+  {
+    if(!inf_text_session_diff_myers(
+         a + prefix,
+         n - prefix - suffix,
+         b + prefix,
+         m - prefix - suffix,
+         INF_TEXT_SESSION_DIFF_MAX_COST,
+         diff))
+    {
+      whole.a_pos = 0;
+      whole.a_len = n - prefix - suffix;
+      whole.b_pos = 0;
+      whole.b_len = m - prefix - suffix;
+      g_array_append_val(diff, whole);
+    }
+  }
+
+  /* The diff is in reverse order */
+  edits = g_new(InfTextSessionEdit, diff->len);
+  for(i = 0; i < diff->len; ++i)
+  {
+    diff_edit = &g_array_index(
+      diff,
+      InfTextSessionDiffEdit,
+      diff->len - i - 1
+    );
+
+    edits[i].position = prefix + diff_edit->a_pos;
+    edits[i].erase_length = diff_edit->a_len;
+    edits[i].length = diff_edit->b_len;
+
+    if(diff_edit->b_len > 0)
+    {
+      edits[i].text = inf_text_session_ucs4_to_text(
+        encoding,
+        b + prefix + diff_edit->b_pos,
+        diff_edit->b_len,
+        &edits[i].bytes
+      );
+    }
+    else
+    {
+      edits[i].text = NULL;
+      edits[i].bytes = 0;
+    }
+  }
+
+  inf_text_session_apply_edits(session, user, edits, diff->len);
+
+  for(i = 0; i < diff->len; ++i)
+    g_free((gpointer)edits[i].text);
+
+  g_free(edits);
+  g_array_free(diff, TRUE);
+  g_free(a);
+  g_free(b);
+}
+
+/**
+ * inf_text_session_create_snapshot:
+ * @session: A running #InfTextSession.
+ *
+ * Creates a #InfTextSnapshot of the document in @session, together with
+ * the state vector of the document, i.e. the current state of the
+ * session's #InfAdoptedAlgorithm. The snapshot can be passed to a worker
+ * thread, for example to export or index the document, while the session
+ * keeps processing requests. See inf_text_snapshot_new() for details.
+ *
+ * Returns: (transfer full): A new #InfTextSnapshot. Free with
+ * inf_text_snapshot_unref() when no longer needed.
+ */
+InfTextSnapshot*
+inf_text_session_create_snapshot(InfTextSession* session)
+{
+  InfAdoptedAlgorithm* algorithm;
+
+  g_return_val_if_fail(INF_TEXT_IS_SESSION(session), NULL);
+
+  g_return_val_if_fail(
+    inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING,
+    NULL
+  );
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+  return inf_text_snapshot_new(
+    INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session))),
+    inf_adopted_algorithm_get_current(algorithm)
+  );
+}
+
 /**
  * inf_text_session_join_user:
  * @proxy: A #InfSessionProxy with a #InfTextSession session.
@@ -22,6 +22,7 @@
 
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-snapshot.h>
 #include <libinftext/inf-text-user.h>
 #include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/common/inf-session-proxy.h>
@@ -47,6 +48,29 @@ typedef enum _InfTextSessionError {
   INF_TEXT_SESSION_ERROR_FAILED
 } InfTextSessionError;
 
+/**
+ * InfTextSessionEdit:
+ * @position: The character offset at which to edit the document. It refers
+ * to the document as it is before any of the edits is made.
+ * @erase_length: The number of characters to erase at @position.
+ * @text: (type guint8*) (array length=bytes) (allow-none): The text to
+ * insert at @position after erasing, in the buffer's encoding, or %NULL.
+ * @bytes: The number of bytes of @text.
+ * @length: The number of characters of @text.
+ *
+ * This structure describes one of the edits made with
+ * inf_text_session_apply_edits(), which replaces @erase_length characters
+ * at @position with @text.
+ */
+typedef struct _InfTextSessionEdit InfTextSessionEdit;
+struct _InfTextSessionEdit {
+  guint position;
+  guint erase_length;
+  gconstpointer text;
+  gsize bytes;
+  guint length;
+};
+
 struct _InfTextSessionClass {
   InfAdoptedSessionClass parent_class;
 };
@@ -84,6 +108,21 @@ void
 inf_text_session_flush_requests_for_user(InfTextSession* session,
                                          InfTextUser* user);
 
+void
+inf_text_session_apply_edits(InfTextSession* session,
+                             InfTextUser* user,
+                             const InfTextSessionEdit* edits,
+                             guint n_edits);
+
+void
+inf_text_session_replace_text(InfTextSession* session,
+                              InfTextUser* user,
+                              gconstpointer text,
+                              gsize bytes);
+
+InfTextSnapshot*
+inf_text_session_create_snapshot(InfTextSession* session);
+
 InfRequest*
 inf_text_session_join_user(InfSessionProxy* proxy,
                            const gchar* name,
@@ -0,0 +1,249 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-text-snapshot
+ * @title: InfTextSnapshot
+ * @short_description: Immutable copy of a text document
+ * @include: libinftext/inf-text-snapshot.h
+ * @see_also: #InfTextBuffer, #InfTextChunk
+ * @stability: Unstable
+ *
+ * #InfTextSnapshot holds the content of a #InfTextBuffer at a certain point
+ * in time, together with the state vector describing which requests had
+ * been applied to it. In contrast to the buffer itself, a snapshot cannot
+ * be modified, and it can be read from any thread. This allows tasks like
+ * exporting or indexing a document to be done in a worker thread while the
+ * document keeps being edited in the main thread.
+ *
+ * The segments of a #InfTextChunk are only copied when the chunk is
+ * modified, so for #InfTextDefaultBuffer creating a snapshot is a constant
+ * time operation. The buffer then copies its text the next time it is
+ * modified while the snapshot is still alive, on the main thread, so that
+ * the snapshot is not affected. Text loaded with
+ * inf_text_chunk_insert_bytes() is shared even then. Other buffer
+ * implementations copy their text when the snapshot is created.
+ *
+ * A snapshot is reference counted. inf_text_snapshot_ref() and
+ * inf_text_snapshot_unref() can be called from any thread.
+ */
+
+#include <libinftext/inf-text-snapshot.h>
+
+struct _InfTextSnapshot {
+  gint ref_count;
+  InfTextChunk* chunk;
+  InfAdoptedStateVector* vector;
+};
+
+G_DEFINE_BOXED_TYPE(InfTextSnapshot, inf_text_snapshot, inf_text_snapshot_ref, inf_text_snapshot_unref)
+
+/**
+ * inf_text_snapshot_new: (constructor)
+ * @buffer: A #InfTextBuffer.
+ * @vector: (allow-none): The state vector of @buffer, or %NULL.
+ *
+ * Creates a snapshot of the current content of @buffer. @vector is stored
+ * with it to describe the state of the document. Typically it is the
+ * current state of the #InfAdoptedAlgorithm operating on @buffer. It is
+ * copied, so that it can be modified afterwards. If @vector is %NULL, an
+ * empty state vector is used.
+ *
+ * This function must be called from the thread that @buffer is used in.
+ * The resulting snapshot can then be passed to other threads.
+ *
+ * Returns: (transfer full): A new #InfTextSnapshot. Free with
+ * inf_text_snapshot_unref() when no longer needed.
+ **/
+InfTextSnapshot*
+inf_text_snapshot_new(InfTextBuffer* buffer,
+                      InfAdoptedStateVector* vector)
+{
+  InfTextSnapshot* snapshot;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+
+  snapshot = g_slice_new(InfTextSnapshot);
+  snapshot->ref_count = 1;
+
+  /* Getting the whole buffer shares the chunk's segments with the buffer
+   * for InfTextDefaultBuffer */
+  snapshot->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  if(vector != NULL)
+    snapshot->vector = inf_adopted_state_vector_copy(vector);
+  else
+    snapshot->vector = inf_adopted_state_vector_new();
+
+  return snapshot;
+}
+
+/**
+ * inf_text_snapshot_ref:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Increases the reference count of @snapshot by one. This function is
+ * thread-safe.
+ *
+ * Returns: The passed snapshot, @snapshot.
+ **/
+InfTextSnapshot*
+inf_text_snapshot_ref(InfTextSnapshot* snapshot)
+{
+  g_return_val_if_fail(snapshot != NULL, NULL);
+
+  g_atomic_int_inc(&snapshot->ref_count);
+  return snapshot;
+}
+
+/**
+ * inf_text_snapshot_unref:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Decreases the reference count of @snapshot by one. When the reference
+ * count reaches zero, the snapshot is freed. This function is thread-safe.
+ **/
+void
+inf_text_snapshot_unref(InfTextSnapshot* snapshot)
+{
+  g_return_if_fail(snapshot != NULL);
+
+  if(g_atomic_int_dec_and_test(&snapshot->ref_count))
+  {
+    inf_text_chunk_free(snapshot->chunk);
+    inf_adopted_state_vector_free(snapshot->vector);
+    g_slice_free(InfTextSnapshot, snapshot);
+  }
+}
+
+/**
+ * inf_text_snapshot_get_vector:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Returns the state vector that describes the state of the document
+ * in @snapshot. It must not be modified.
+ *
+ * Returns: (transfer none): The state vector of @snapshot.
+ **/
+InfAdoptedStateVector*
+inf_text_snapshot_get_vector(InfTextSnapshot* snapshot)
+{
+  g_return_val_if_fail(snapshot != NULL, NULL);
+  return snapshot->vector;
+}
+
+/**
+ * inf_text_snapshot_get_chunk:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Returns the text of @snapshot. The chunk must not be modified, but it can
+ * be copied with inf_text_chunk_copy(), which is cheap, if a modifiable
+ * version is required.
+ *
+ * Returns: (transfer none): The text of @snapshot.
+ **/
+InfTextChunk*
+inf_text_snapshot_get_chunk(InfTextSnapshot* snapshot)
+{
+  g_return_val_if_fail(snapshot != NULL, NULL);
+  return snapshot->chunk;
+}
+
+/**
+ * inf_text_snapshot_get_encoding:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Returns the character encoding of the text in @snapshot, which is the
+ * encoding of the buffer it was created from.
+ *
+ * Returns: The character encoding of @snapshot.
+ **/
+const gchar*
+inf_text_snapshot_get_encoding(InfTextSnapshot* snapshot)
+{
+  g_return_val_if_fail(snapshot != NULL, NULL);
+  return inf_text_chunk_get_encoding(snapshot->chunk);
+}
+
+/**
+ * inf_text_snapshot_get_length:
+ * @snapshot: A #InfTextSnapshot.
+ *
+ * Returns the number of characters in @snapshot.
+ *
+ * Returns: The length of @snapshot.
+ **/
+guint
+inf_text_snapshot_get_length(InfTextSnapshot* snapshot)
+{
+  g_return_val_if_fail(snapshot != NULL, 0);
+  return inf_text_chunk_get_length(snapshot->chunk);
+}
+
+/**
+ * inf_text_snapshot_get_slice:
+ * @snapshot: A #InfTextSnapshot.
+ * @pos: Character offset of where to start extracting.
+ * @len: Number of characters to extract.
+ *
+ * Reads @len characters, starting at @pos, from @snapshot, and returns them
+ * in a #InfTextChunk, like inf_text_buffer_get_slice() does for a buffer.
+ *
+ * Returns: (transfer full): A #InfTextChunk. Free with inf_text_chunk_free()
+ * when done using it.
+ **/
+InfTextChunk*
+inf_text_snapshot_get_slice(InfTextSnapshot* snapshot,
+                            guint pos,
+                            guint len)
+{
+  g_return_val_if_fail(snapshot != NULL, NULL);
+  return inf_text_chunk_substring(snapshot->chunk, pos, len);
+}
+
+/**
+ * inf_text_snapshot_view:
+ * @snapshot: A #InfTextSnapshot.
+ * @pos: Character offset of where to start looking.
+ * @len: Number of characters to look at.
+ * @func: (scope call): The function to call for each piece of text.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Calls @func for each piece of text in the range of @len characters
+ * starting at @pos in @snapshot, without copying the text, like
+ * inf_text_buffer_view() does for a buffer.
+ *
+ * Returns: %FALSE if @func stopped the iteration, or %TRUE otherwise.
+ **/
+gboolean
+inf_text_snapshot_view(InfTextSnapshot* snapshot,
+                       guint pos,
+                       guint len,
+                       InfTextChunkViewFunc func,
+                       gpointer user_data)
+{
+  g_return_val_if_fail(snapshot != NULL, FALSE);
+  return inf_text_chunk_view(snapshot->chunk, pos, len, func, user_data);
+}
+
+/* vim:set et sw=2 ts=2: */
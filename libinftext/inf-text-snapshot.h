@@ -0,0 +1,82 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_SNAPSHOT_H__
+#define __INF_TEXT_SNAPSHOT_H__
+
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+#include <libinfinity/adopted/inf-adopted-state-vector.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TEXT_TYPE_SNAPSHOT            (inf_text_snapshot_get_type())
+
+/**
+ * InfTextSnapshot:
+ *
+ * #InfTextSnapshot is an opaque data type. You should only access it
+ * via the public API functions.
+ */
+typedef struct _InfTextSnapshot InfTextSnapshot;
+
+GType
+inf_text_snapshot_get_type(void) G_GNUC_CONST;
+
+InfTextSnapshot*
+inf_text_snapshot_new(InfTextBuffer* buffer,
+                      InfAdoptedStateVector* vector);
+
+InfTextSnapshot*
+inf_text_snapshot_ref(InfTextSnapshot* snapshot);
+
+void
+inf_text_snapshot_unref(InfTextSnapshot* snapshot);
+
+InfAdoptedStateVector*
+inf_text_snapshot_get_vector(InfTextSnapshot* snapshot);
+
+InfTextChunk*
+inf_text_snapshot_get_chunk(InfTextSnapshot* snapshot);
+
+const gchar*
+inf_text_snapshot_get_encoding(InfTextSnapshot* snapshot);
+
+guint
+inf_text_snapshot_get_length(InfTextSnapshot* snapshot);
+
+InfTextChunk*
+inf_text_snapshot_get_slice(InfTextSnapshot* snapshot,
+                            guint pos,
+                            guint len);
+
+gboolean
+inf_text_snapshot_view(InfTextSnapshot* snapshot,
+                       guint pos,
+                       guint len,
+                       InfTextChunkViewFunc func,
+                       gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_SNAPSHOT_H__ */
+
+/* vim:set et sw=2 ts=2: */
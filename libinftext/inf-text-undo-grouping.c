@@ -41,6 +41,9 @@
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinftext/inf-text-move-operation.h>
 #include <libinftext/inf-text-chunk.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
+
+#include <string.h>
 
 #define INF_TEXT_UNDO_GROUPING_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_UNDO_GROUPING, InfTextUndoGroupingPrivate))
 
@@ -59,10 +62,16 @@ inf_text_undo_grouping_get_char_from_chunk(InfTextChunk* chunk)
   size_t result;
   gchar buffer[6];
 
-  cd = g_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
+  inf_text_chunk_iter_init_begin(chunk, &iter);
+
+  /* This is called for every character typed, so avoid setting up a
+   * conversion in the common case. */
+  if(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") == 0)
+    return g_utf8_get_char(inf_text_chunk_iter_get_text(&iter));
+
+  cd = _inf_text_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
   g_assert(cd != (GIConv)-1);
 
-  inf_text_chunk_iter_init_begin(chunk, &iter);
   /* cast const away without warning */ /* more or less */
   *(gconstpointer*) &inbuf = inf_text_chunk_iter_get_text(&iter);
   inlen = inf_text_chunk_iter_get_bytes(&iter);
@@ -73,7 +82,7 @@ inf_text_undo_grouping_get_char_from_chunk(InfTextChunk* chunk)
   /* we expect exactly one char in chunk, so there should be enough space */
   g_assert(result == 0);/* || (result == (size_t)(-1) && errno == E2BIG));*/
 
-  g_iconv_close(cd);
+  _inf_text_iconv_close("UTF-8", inf_text_chunk_get_encoding(chunk), cd);
   return g_utf8_get_char(buffer);
 }
 
@@ -174,6 +183,14 @@ inf_text_undo_grouping_group_requests(InfAdoptedUndoGrouping* grouping,
   first_op = inf_adopted_request_get_operation(first);
   second_op = inf_adopted_request_get_operation(second);
 
+  /* Edits of several regions made at once, see
+   * inf_text_session_apply_edits(), are always undone on their own. */
+  if(INF_ADOPTED_IS_SPLIT_OPERATION(first_op) ||
+     INF_ADOPTED_IS_SPLIT_OPERATION(second_op))
+  {
+    return FALSE;
+  }
+
   g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(first_op) ||
            INF_TEXT_IS_DEFAULT_DELETE_OPERATION(first_op));
   g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(second_op) ||
@@ -31,7 +31,9 @@ enum {
 
   PROP_CARET,
   PROP_SELECTION,
-  PROP_HUE
+  PROP_HUE,
+
+  LAST_PROP
 };
 
 enum {
@@ -44,6 +46,10 @@ enum {
 
 static guint user_signals[LAST_SIGNAL] = { 0 };
 
+/* The caret and selection change with almost every request, so these are
+ * kept around to notify without looking up the property by name. */
+static GParamSpec* user_properties[LAST_PROP] = { NULL };
+
 G_DEFINE_TYPE_WITH_CODE(InfTextUser, inf_text_user, INF_ADOPTED_TYPE_USER,
   G_ADD_PRIVATE(InfTextUser))
 
@@ -125,11 +131,29 @@ inf_text_user_selection_changed(InfTextUser* user,
   InfTextUserPrivate* priv;
   priv = INF_TEXT_USER_PRIVATE(user);
 
-  priv->caret = position;
-  priv->selection = length;
+  /* Only notify about what actually changed. Carets of other users are
+   * usually only shifted by a request, leaving the selection length as is.
+   * If both changed, the notifications are emitted together. */
+  if(priv->caret != position && priv->selection != (gint)length)
+  {
+    priv->caret = position;
+    priv->selection = length;
 
-  g_object_notify(G_OBJECT(user), "caret-position");
-  g_object_notify(G_OBJECT(user), "selection-length");
+    g_object_freeze_notify(G_OBJECT(user));
+    g_object_notify_by_pspec(G_OBJECT(user), user_properties[PROP_CARET]);
+    g_object_notify_by_pspec(G_OBJECT(user), user_properties[PROP_SELECTION]);
+    g_object_thaw_notify(G_OBJECT(user));
+  }
+  else if(priv->caret != position)
+  {
+    priv->caret = position;
+    g_object_notify_by_pspec(G_OBJECT(user), user_properties[PROP_CARET]);
+  }
+  else if(priv->selection != (gint)length)
+  {
+    priv->selection = length;
+    g_object_notify_by_pspec(G_OBJECT(user), user_properties[PROP_SELECTION]);
+  }
 }
 
 static void
@@ -143,32 +167,36 @@ inf_text_user_class_init(InfTextUserClass* user_class)
 
   user_class->selection_changed = inf_text_user_selection_changed;
 
+  user_properties[PROP_CARET] = g_param_spec_uint(
+    "caret-position",
+    "Caret position",
+    "The position of this user's caret",
+    0,
+    G_MAXUINT,
+    0,
+    G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CARET,
-    g_param_spec_uint(
-      "caret-position",
-      "Caret position",
-      "The position of this user's caret",
-      0,
-      G_MAXUINT,
-      0,
-      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
-    )
+    user_properties[PROP_CARET]
+  );
+
+  user_properties[PROP_SELECTION] = g_param_spec_int(
+    "selection-length",
+    "Selection length",
+    "The number of characters of this user's selection",
+    G_MININT,
+    G_MAXINT,
+    0,
+    G_PARAM_READWRITE | G_PARAM_CONSTRUCT
   );
 
   g_object_class_install_property(
     object_class,
     PROP_SELECTION,
-    g_param_spec_int(
-      "selection-length",
-      "Selection length",
-      "The number of characters of this user's selection",
-      G_MININT,
-      G_MAXINT,
-      0,
-      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
-    )
+    user_properties[PROP_SELECTION]
   );
 
   g_object_class_install_property(
@@ -0,0 +1,107 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-utf8-private.h>
+
+#include <string.h>
+
+/* Text is mostly ASCII, so it is scanned a machine word at a time until a
+ * byte with the high bit set (or a NUL byte, which g_utf8_validate() does
+ * not accept either) shows up, and only then decoded byte by byte. */
+#define INF_TEXT_UTF8_LOW_BITS G_GUINT64_CONSTANT(0x0101010101010101)
+#define INF_TEXT_UTF8_HIGH_BITS G_GUINT64_CONSTANT(0x8080808080808080)
+
+gboolean
+_inf_text_utf8_validate_count(const gchar* text,
+                              gsize bytes,
+                              glong* length)
+{
+  const guchar* pos;
+  const guchar* end;
+  guint64 word;
+  glong count;
+  guchar c;
+  gsize n;
+  gsize i;
+
+  pos = (const guchar*)text;
+  end = pos + bytes;
+  count = 0;
+
+  while(pos < end)
+  {
+    while((gsize)(end - pos) >= sizeof(word))
+    {
+      memcpy(&word, pos, sizeof(word));
+
+      /* If no byte has its high bit set, then subtracting one from each
+       * byte only sets a high bit if the byte was zero. */
+      if((word & INF_TEXT_UTF8_HIGH_BITS) != 0 ||
+         ((word - INF_TEXT_UTF8_LOW_BITS) & INF_TEXT_UTF8_HIGH_BITS) != 0)
+      {
+        break;
+      }
+
+      pos += sizeof(word);
+      count += sizeof(word);
+    }
+
+    if(pos == end)
+      break;
+
+    c = *pos;
+    if(c < 0x80)
+    {
+      if(c == 0x00) return FALSE;
+      ++pos;
+      ++count;
+      continue;
+    }
+
+    /* Continuation bytes, and lead bytes that can only start overlong
+     * sequences or code points beyond U+10FFFF, are never valid here */
+    if(c < 0xc2) return FALSE;
+    else if(c < 0xe0) n = 1;
+    else if(c < 0xf0) n = 2;
+    else if(c < 0xf5) n = 3;
+    else return FALSE;
+
+    if((gsize)(end - pos) <= n) return FALSE;
+    for(i = 1; i <= n; ++i)
+      if((pos[i] & 0xc0) != 0x80)
+        return FALSE;
+
+    /* Reject the remaining overlong forms, surrogates, and code points
+     * beyond U+10FFFF, which all depend on the second byte */
+    if(c == 0xe0 && pos[1] < 0xa0) return FALSE;
+    if(c == 0xed && pos[1] > 0x9f) return FALSE;
+    if(c == 0xf0 && pos[1] < 0x90) return FALSE;
+    if(c == 0xf4 && pos[1] > 0x8f) return FALSE;
+
+    pos += n + 1;
+    ++count;
+  }
+
+  if(length != NULL)
+    *length = count;
+
+  return TRUE;
+}
+
+/* vim:set et sw=2 ts=2: */
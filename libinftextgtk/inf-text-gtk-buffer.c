@@ -40,6 +40,12 @@
  * If there is no local user in the session, no modifications to the buffer
  * must be made because they cannot be synchronized to other participants.
  *
+ * While a session is being synchronized, the text is appended to the
+ * #GtkTextBuffer piece by piece as it arrives, so a #GtkTextView showing the
+ * buffer displays the beginning of a large document long before the
+ * synchronization has finished. The document can only be edited once the
+ * synchronization is complete, though.
+ *
  * This class also takes care of setting background colors for the text to
  * indicate which user wrote what text, by adding corresponding
  * #GtkTextTag<!-- -->s to the document. The function
@@ -98,6 +104,8 @@ struct _InfTextGtkBufferPrivate {
   InfTextGtkBufferRecord* record;
 
   gboolean show_user_colors;
+  guint user_colors_limit;
+  gboolean user_colors_suppressed;
 
   InfTextUser* active_user;
   gboolean wake_on_cursor_movement;
@@ -115,6 +123,7 @@ enum {
   PROP_ACTIVE_USER,
   PROP_WAKE_ON_CURSOR_MOVEMENT,
   PROP_SHOW_USER_COLORS,
+  PROP_USER_COLORS_LIMIT,
 
   PROP_SATURATION,
   PROP_VALUE,
@@ -479,6 +488,70 @@ inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func(GtkTextTag* tag,
   }
 }
 
+/* Whether newly written text is shown in the author's color */
+static gboolean
+inf_text_gtk_buffer_use_user_colors(InfTextGtkBuffer* buffer)
+{
+  InfTextGtkBufferPrivate* priv;
+  priv = INF_TEXT_GTK_BUFFER_PRIVATE(buffer);
+
+  return priv->show_user_colors && !priv->user_colors_suppressed;
+}
+
+static void
+inf_text_gtk_buffer_check_user_colors_limit(InfTextGtkBuffer* buffer)
+{
+  InfTextGtkBufferPrivate* priv;
+  GtkTextIter start;
+  GtkTextIter end;
+
+  priv = INF_TEXT_GTK_BUFFER_PRIVATE(buffer);
+
+  if(priv->buffer != NULL && priv->user_colors_limit > 0 &&
+     !priv->user_colors_suppressed &&
+     (guint)gtk_text_buffer_get_char_count(priv->buffer) >
+       priv->user_colors_limit)
+  {
+    /* The author tags stay in place with no background color, so that
+     * authorship can still be queried. */
+    priv->user_colors_suppressed = TRUE;
+
+    gtk_text_buffer_get_bounds(priv->buffer, &start, &end);
+    inf_text_gtk_buffer_show_user_colors(buffer, FALSE, &start, &end);
+  }
+}
+
+static void
+inf_text_gtk_buffer_remove_foreign_tags(InfTextGtkBufferTagRemove* tag_remove)
+{
+  GtkTextIter iter;
+  GSList* tags;
+  GSList* item;
+
+  /* Only try to remove the tags that actually occur in the range, instead
+   * of all tags in the tag table. There are two of them for every user that
+   * ever joined the session, but freshly inserted text usually carries only
+   * the tags it inherited from the insertion point. */
+  tags = gtk_text_iter_get_tags(&tag_remove->begin_iter);
+
+  iter = tag_remove->begin_iter;
+  while(gtk_text_iter_forward_to_tag_toggle(&iter, NULL) &&
+        gtk_text_iter_compare(&iter, &tag_remove->end_iter) < 0)
+  {
+    tags = g_slist_concat(gtk_text_iter_get_toggled_tags(&iter, TRUE), tags);
+  }
+
+  for(item = tags; item != NULL; item = item->next)
+  {
+    inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func(
+      GTK_TEXT_TAG(item->data),
+      tag_remove
+    );
+  }
+
+  g_slist_free(tags);
+}
+
 /* Record tracking:
  * This is to allow and correctly handle nested emissions of GtkTextBuffer's
  * insert-text/delete-range signals. The text-inserted and text-erased
@@ -696,7 +769,7 @@ inf_text_gtk_buffer_record_signal(InfTextGtkBuffer* buffer,
     tag = inf_text_gtk_buffer_get_user_tag(
       buffer,
       tag_remove.ignore_tags,
-      priv->show_user_colors
+      inf_text_gtk_buffer_use_user_colors(buffer)
     );
 
     /* Remove other user tags, if any */
@@ -712,11 +785,7 @@ inf_text_gtk_buffer_record_signal(InfTextGtkBuffer* buffer,
       record->position + inf_text_chunk_get_length(record->chunk)
     );
 
-    gtk_text_tag_table_foreach(
-      gtk_text_buffer_get_tag_table(tag_remove.buffer),
-      inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func,
-      &tag_remove
-    );
+    inf_text_gtk_buffer_remove_foreign_tags(&tag_remove);
 
     /* Apply tag for this particular user */
     gtk_text_buffer_apply_tag(
@@ -732,6 +801,8 @@ inf_text_gtk_buffer_record_signal(InfTextGtkBuffer* buffer,
       G_CALLBACK(inf_text_gtk_buffer_apply_tag_cb),
       buffer
     );
+
+    inf_text_gtk_buffer_check_user_colors_limit(buffer);
   }
 
   /* Block the notify_status signal handler of the active user. That signal
@@ -1334,6 +1405,8 @@ inf_text_gtk_buffer_init(InfTextGtkBuffer* buffer)
   );
 
   priv->show_user_colors = TRUE;
+  priv->user_colors_limit = 0;
+  priv->user_colors_suppressed = FALSE;
 
   priv->active_user = NULL;
   priv->wake_on_cursor_movement = FALSE;
@@ -1414,6 +1487,12 @@ inf_text_gtk_buffer_set_property(GObject* object,
   case PROP_SHOW_USER_COLORS:
     priv->show_user_colors = g_value_get_boolean(value);
     break;
+  case PROP_USER_COLORS_LIMIT:
+    inf_text_gtk_buffer_set_user_colors_limit(
+      buffer,
+      g_value_get_uint(value)
+    );
+    break;
   case PROP_MODIFIED:
     inf_text_gtk_buffer_set_modified(buffer, g_value_get_boolean(value));
     break;
@@ -1469,6 +1548,9 @@ inf_text_gtk_buffer_get_property(GObject* object,
   case PROP_SHOW_USER_COLORS:
     g_value_set_boolean(value, priv->show_user_colors);
     break;
+  case PROP_USER_COLORS_LIMIT:
+    g_value_set_uint(value, priv->user_colors_limit);
+    break;
   case PROP_MODIFIED:
     if(priv->buffer != NULL)
       g_value_set_boolean(value, gtk_text_buffer_get_modified(priv->buffer));
@@ -1647,7 +1729,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
         tag = inf_text_gtk_buffer_get_user_tag(
           INF_TEXT_GTK_BUFFER(buffer),
           tag_remove.ignore_tags,
-          priv->show_user_colors
+          inf_text_gtk_buffer_use_user_colors(INF_TEXT_GTK_BUFFER(buffer))
         );
       }
       else
@@ -1668,19 +1750,13 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
        * user's text, GtkTextBuffer automatically applies that tag to the
        * new text. */
 
-      /* TODO: We could probably look for the tag that we have to remove
-       * before inserting text, to optimize this a bit. */
       tag_remove.begin_iter = tag_remove.end_iter;
       gtk_text_iter_backward_chars(
         &tag_remove.begin_iter,
         inf_text_chunk_iter_get_length(&chunk_iter)
       );
 
-      gtk_text_tag_table_foreach(
-        gtk_text_buffer_get_tag_table(tag_remove.buffer),
-        inf_text_gtk_buffer_buffer_insert_text_tag_table_foreach_func,
-        &tag_remove
-      );
+      inf_text_gtk_buffer_remove_foreign_tags(&tag_remove);
     } while(inf_text_chunk_iter_next(&chunk_iter));
 
     /* Fix left gravity of own cursor on remote insert */
@@ -1764,6 +1840,7 @@ inf_text_gtk_buffer_buffer_insert_text(InfTextBuffer* buffer,
     buffer
   );
 
+  inf_text_gtk_buffer_check_user_colors_limit(INF_TEXT_GTK_BUFFER(buffer));
   inf_text_buffer_text_inserted(buffer, pos, chunk, user);
 }
 
@@ -2078,6 +2155,21 @@ inf_text_gtk_buffer_class_init(InfTextGtkBufferClass* text_gtk_buffer_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_USER_COLORS_LIMIT,
+    g_param_spec_uint(
+      "user-colors-limit",
+      "User colors limit",
+      "Document length in characters above which user colors are hidden, "
+      "or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_SATURATION,
@@ -2761,4 +2853,57 @@ inf_text_gtk_buffer_show_user_colors(InfTextGtkBuffer* buffer,
   }
 }
 
+/**
+ * inf_text_gtk_buffer_set_user_colors_limit:
+ * @buffer: A #InfTextGtkBuffer.
+ * @limit: Document length in characters, or 0.
+ *
+ * Rendering the background color of many small author runs is slow for
+ * large documents. If @limit is nonzero, then as soon as the document
+ * becomes longer than @limit characters, user colors are hidden in the
+ * whole document, as if inf_text_gtk_buffer_show_user_colors() was called
+ * with @show being %FALSE, and newly written text is not colored anymore.
+ * The text is still tagged with its author, so that
+ * inf_text_gtk_buffer_get_author() keeps working.
+ *
+ * User colors are not shown again automatically when the document becomes
+ * shorter again, but inf_text_gtk_buffer_show_user_colors() can be used to
+ * show them explicitly. Setting a new limit re-enables coloring of newly
+ * written text until the document exceeds the new limit.
+ */
+void
+inf_text_gtk_buffer_set_user_colors_limit(InfTextGtkBuffer* buffer,
+                                          guint limit)
+{
+  InfTextGtkBufferPrivate* priv;
+
+  g_return_if_fail(INF_TEXT_GTK_IS_BUFFER(buffer));
+  priv = INF_TEXT_GTK_BUFFER_PRIVATE(buffer);
+
+  if(priv->user_colors_limit != limit)
+  {
+    priv->user_colors_limit = limit;
+    priv->user_colors_suppressed = FALSE;
+    inf_text_gtk_buffer_check_user_colors_limit(buffer);
+
+    g_object_notify(G_OBJECT(buffer), "user-colors-limit");
+  }
+}
+
+/**
+ * inf_text_gtk_buffer_get_user_colors_limit:
+ * @buffer: A #InfTextGtkBuffer.
+ *
+ * Returns the document length above which user colors are hidden, see
+ * inf_text_gtk_buffer_set_user_colors_limit().
+ *
+ * Returns: The limit in characters, or 0 if there is no limit.
+ */
+guint
+inf_text_gtk_buffer_get_user_colors_limit(InfTextGtkBuffer* buffer)
+{
+  g_return_val_if_fail(INF_TEXT_GTK_IS_BUFFER(buffer), 0);
+  return INF_TEXT_GTK_BUFFER_PRIVATE(buffer)->user_colors_limit;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -141,6 +141,13 @@ inf_text_gtk_buffer_show_user_colors(InfTextGtkBuffer* buffer,
                                      GtkTextIter* start,
                                      GtkTextIter* end);
 
+void
+inf_text_gtk_buffer_set_user_colors_limit(InfTextGtkBuffer* buffer,
+                                          guint limit);
+
+guint
+inf_text_gtk_buffer_get_user_colors_limit(InfTextGtkBuffer* buffer);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_GTK_BUFFER_H__ */
@@ -56,6 +56,13 @@ struct _InfTextGtkViewUser {
   gboolean cursor_visible;
   InfIoTimeout* timeout; /* TODO: Use glib for that; remove InfIo property */
   guint revalidate_idle;
+  /* Monotonic time at which the cursor stops blinking */
+  gint64 blink_end;
+
+  /* Whether the rectangles below are up to date. They are only computed
+   * for users in the visible part of the textview, since finding the
+   * location of text outside of it requires laying out that text. */
+  gboolean area_valid;
 
   /* All in buffer coordinates: */
 
@@ -134,6 +141,65 @@ inf_text_gtk_view_find_user(InfTextGtkView* view,
   return NULL;
 }
 
+/* Returns whether the caret or selection of view_user is in the currently
+ * visible part of the textview. This only uses character offsets and the
+ * layout of the visible lines, so it is cheap. */
+static gboolean
+inf_text_gtk_view_user_is_visible(InfTextGtkViewUser* view_user)
+{
+  InfTextGtkViewPrivate* priv;
+  GdkRectangle visible_rect;
+  GtkTextIter iter;
+  guint visible_begin;
+  guint visible_end;
+  guint begin;
+  guint end;
+  gint sel;
+
+  priv = INF_TEXT_GTK_VIEW_PRIVATE(view_user->view);
+
+  if(!gtk_widget_get_realized(GTK_WIDGET(priv->textview)))
+    return FALSE;
+
+  gtk_text_view_get_visible_rect(priv->textview, &visible_rect);
+
+  gtk_text_view_get_iter_at_location(
+    priv->textview,
+    &iter,
+    visible_rect.x,
+    visible_rect.y
+  );
+
+  /* The first visible line might be partly visible only */
+  gtk_text_iter_set_line_offset(&iter, 0);
+  visible_begin = gtk_text_iter_get_offset(&iter);
+
+  gtk_text_view_get_iter_at_location(
+    priv->textview,
+    &iter,
+    visible_rect.x + visible_rect.width,
+    visible_rect.y + visible_rect.height
+  );
+
+  gtk_text_iter_forward_to_line_end(&iter);
+  visible_end = gtk_text_iter_get_offset(&iter);
+
+  begin = inf_text_user_get_caret_position(view_user->user);
+  sel = inf_text_user_get_selection_length(view_user->user);
+
+  if(sel >= 0 || !priv->show_remote_selections)
+  {
+    end = begin + (priv->show_remote_selections ? sel : 0);
+  }
+  else
+  {
+    end = begin;
+    begin = (begin >= (guint)-sel) ? begin + sel : 0;
+  }
+
+  return end >= visible_begin && begin <= visible_end;
+}
+
 /* Compute cursor_rect, selection_bound_rect */
 static void
 inf_text_gtk_view_user_compute_user_area(InfTextGtkViewUser* view_user)
@@ -197,6 +263,36 @@ inf_text_gtk_view_user_compute_user_area(InfTextGtkViewUser* view_user)
     (int)(view_user->selection_bound_rect.height * cursor_aspect_ratio),
     1
   );
+
+  view_user->area_valid = TRUE;
+}
+
+static void
+inf_text_gtk_view_user_reset_timeout(InfTextGtkViewUser* view_user);
+
+/* Computes the area of all users that have become visible since their
+ * area was last computed, for example because the view was scrolled. */
+static void
+inf_text_gtk_view_validate_users(InfTextGtkView* view)
+{
+  InfTextGtkViewPrivate* priv;
+  GSList* item;
+  InfTextGtkViewUser* view_user;
+
+  priv = INF_TEXT_GTK_VIEW_PRIVATE(view);
+
+  for(item = priv->users; item != NULL; item = item->next)
+  {
+    view_user = (InfTextGtkViewUser*)item->data;
+    if(!view_user->area_valid &&
+       inf_text_gtk_view_user_is_visible(view_user))
+    {
+      inf_text_gtk_view_user_compute_user_area(view_user);
+
+      if(view_user->timeout == NULL)
+        inf_text_gtk_view_user_reset_timeout(view_user);
+    }
+  }
 }
 
 static guint
@@ -263,6 +359,10 @@ inf_text_gtk_view_user_invalidate_user_area(InfTextGtkViewUser* view_user)
 
   priv = INF_TEXT_GTK_VIEW_PRIVATE(view_user->view);
 
+  /* Users whose area is not known have not been drawn */
+  if(!view_user->area_valid)
+    return;
+
   if(gtk_widget_get_realized(GTK_WIDGET(priv->textview)))
   {
     /* Invalidate cursors/selections */
@@ -524,6 +624,8 @@ inf_text_gtk_view_draw_before_cb(GtkWidget* widget,
     return FALSE;
   }
 
+  inf_text_gtk_view_validate_users(view);
+
   if(priv->show_remote_current_lines)
   {
     gtk_cairo_transform_to_window(cr, GTK_WIDGET(priv->textview), text_window);
@@ -543,7 +645,12 @@ inf_text_gtk_view_draw_before_cb(GtkWidget* widget,
     v = MAX(v, 0.3);
     s = MAX(s, 0.1 + 0.3*(1 - v));
 
-    sort_users = g_slist_copy(priv->users);
+    /* Users without valid area are outside of the visible region */
+    sort_users = NULL;
+    for(item = priv->users; item != NULL; item = item->next)
+      if( ((InfTextGtkViewUser*)item->data)->area_valid)
+        sort_users = g_slist_prepend(sort_users, item->data);
+
     sort_users =
       g_slist_sort(sort_users, inf_text_gtk_view_user_line_position_cmp);
 
@@ -764,7 +871,8 @@ inf_text_gtk_view_draw_after_cb(GtkWidget* widget,
     for(item = priv->users; item != NULL; item = item->next)
     {
       view_user = (InfTextGtkViewUser*)item->data;
-      if(inf_text_user_get_selection_length(view_user->user) != 0)
+      if(view_user->area_valid &&
+         inf_text_user_get_selection_length(view_user->user) != 0)
       {
         begin = inf_text_user_get_caret_position(view_user->user);
         sel = inf_text_user_get_selection_length(view_user->user);
@@ -1067,7 +1175,7 @@ inf_text_gtk_view_draw_after_cb(GtkWidget* widget,
     for(item = priv->users; item != NULL; item = item->next)
     {
       view_user = (InfTextGtkViewUser*)item->data;
-      if(view_user->cursor_visible)
+      if(view_user->area_valid && view_user->cursor_visible)
       {
         gtk_text_view_buffer_to_window_coords(
           priv->textview,
@@ -1107,10 +1215,12 @@ inf_text_gtk_view_style_updated_cb(GtkWidget* widget,
   view = INF_TEXT_GTK_VIEW(user_data);
   priv = INF_TEXT_GTK_VIEW_PRIVATE(view);
 
+  /* The whole textview is redrawn anyway, which recomputes the areas of
+   * the visible users. */
   for(item = priv->users; item != NULL; item = item->next)
   {
     view_user = (InfTextGtkViewUser*)item->data;
-    inf_text_gtk_view_user_compute_user_area(view_user);
+    view_user->area_valid = FALSE;
   }
 }
 
@@ -1127,10 +1237,12 @@ inf_text_gtk_view_size_allocate_cb(GtkWidget* widget,
   view = INF_TEXT_GTK_VIEW(user_data);
   priv = INF_TEXT_GTK_VIEW_PRIVATE(view);
 
+  /* The whole textview is redrawn anyway, which recomputes the areas of
+   * the visible users. */
   for(item = priv->users; item != NULL; item = item->next)
   {
     view_user = (InfTextGtkViewUser*)item->data;
-    inf_text_gtk_view_user_compute_user_area(view_user);
+    view_user->area_valid = FALSE;
   }
 }
 
@@ -1142,17 +1254,39 @@ inf_text_gtk_view_user_cursor_blink_timeout_func(gpointer user_data)
   GtkSettings* settings;
   gboolean cursor_blink;
   gint cursor_blink_time;
+  gboolean visible;
 
   view_user = (InfTextGtkViewUser*)user_data;
   priv = INF_TEXT_GTK_VIEW_PRIVATE(view_user->view);
 
+  /* Stop blinking when the blink timeout has passed, or when the cursor
+   * cannot be seen anyway, leaving the cursor shown. It starts blinking
+   * again when the user moves it, or comes into view. */
+  visible = view_user->area_valid &&
+    inf_text_gtk_view_user_is_visible(view_user);
+
+  if(!visible || g_get_monotonic_time() >= view_user->blink_end)
+  {
+    view_user->timeout = NULL;
+
+    if(!view_user->cursor_visible)
+    {
+      view_user->cursor_visible = TRUE;
+      inf_text_gtk_view_user_invalidate_user_area(view_user);
+    }
+
+    if(!visible)
+      view_user->area_valid = FALSE;
+
+    return;
+  }
+
   view_user->cursor_visible = !view_user->cursor_visible;
   inf_text_gtk_view_user_invalidate_user_area(view_user);
 
   /* Schedule next cursor blink */
   settings = gtk_widget_get_settings(GTK_WIDGET(priv->textview));
 
-  /* TODO: Handle gtk-cursor-blink-timeout */
   g_object_get(
     G_OBJECT(settings),
     "gtk-cursor-blink", &cursor_blink,
@@ -1188,6 +1322,7 @@ inf_text_gtk_view_user_reset_timeout(InfTextGtkViewUser* view_user)
   GtkSettings* settings;
   gboolean cursor_blink;
   gint cursor_blink_time;
+  gint cursor_blink_timeout;
 
   priv = INF_TEXT_GTK_VIEW_PRIVATE(view_user->view);
 
@@ -1212,9 +1347,13 @@ inf_text_gtk_view_user_reset_timeout(InfTextGtkViewUser* view_user)
     G_OBJECT(settings),
     "gtk-cursor-blink", &cursor_blink,
     "gtk-cursor-blink-time", &cursor_blink_time,
+    "gtk-cursor-blink-timeout", &cursor_blink_timeout,
     NULL
   );
 
+  view_user->blink_end =
+    g_get_monotonic_time() + (gint64)cursor_blink_timeout * G_USEC_PER_SEC;
+
   if(cursor_blink)
   {
     view_user->timeout = inf_io_add_timeout(
@@ -1274,6 +1413,23 @@ inf_text_gtk_view_user_selection_changed_cb(InfTextUser* user,
     inf_text_gtk_view_user_invalidate_user_area(view_user);
   }
 
+  /* Don't compute the area of users outside of the visible region, and
+   * don't let their cursor blink. This is done once they become visible,
+   * in inf_text_gtk_view_validate_users(). */
+  if(!inf_text_gtk_view_user_is_visible(view_user))
+  {
+    view_user->area_valid = FALSE;
+    view_user->cursor_visible = TRUE;
+
+    if(view_user->timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, view_user->timeout);
+      view_user->timeout = NULL;
+    }
+
+    return;
+  }
+
   inf_text_gtk_view_user_compute_user_area(view_user);
 
   if(by_request)
@@ -1303,14 +1459,10 @@ inf_text_gtk_view_user_notify_hue_cb(GObject* object,
                                      gpointer user_data)
 {
   InfTextGtkViewUser* view_user;
-  InfTextGtkViewPrivate* priv;
-
   view_user = (InfTextGtkViewUser*)user_data;
-  priv = INF_TEXT_GTK_VIEW_PRIVATE(view_user->view);
 
-  /* TODO: Might restrict this on current lines,
-   * cursor rects and selection rects */
-  gtk_widget_queue_draw(GTK_WIDGET(priv->textview));
+  /* Only the user's own cursor, selection and current line change color */
+  inf_text_gtk_view_user_invalidate_user_area(view_user);
 }
 
 static void
@@ -1328,8 +1480,15 @@ inf_text_gtk_view_add_user(InfTextGtkView* view,
   view_user->cursor_visible = TRUE;
   view_user->timeout = NULL;
   view_user->revalidate_idle = 0;
-  inf_text_gtk_view_user_compute_user_area(view_user);
-  inf_text_gtk_view_user_reset_timeout(view_user);
+  view_user->blink_end = 0;
+  view_user->area_valid = FALSE;
+
+  if(inf_text_gtk_view_user_is_visible(view_user))
+  {
+    inf_text_gtk_view_user_compute_user_area(view_user);
+    inf_text_gtk_view_user_reset_timeout(view_user);
+  }
+
   priv->users = g_slist_prepend(priv->users, view_user);
 
   g_signal_connect_after(
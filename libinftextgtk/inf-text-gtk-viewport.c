@@ -41,11 +41,35 @@
 
 #include <gtk/gtk.h>
 
+/* Height of the slices of the scrollbar, in pixels, into which user markers
+ * are sorted, so that redrawing a part of the scrollbar does not need to
+ * look at all users. */
+#define INF_TEXT_GTK_VIEWPORT_BUCKET_SIZE 32
+
+/* Marker is not in any bucket because it is not visible */
+#define INF_TEXT_GTK_VIEWPORT_NO_BUCKET G_MAXUINT
+
 typedef struct _InfTextGtkViewportUser InfTextGtkViewportUser;
 struct _InfTextGtkViewportUser {
   InfTextGtkViewport* viewport;
   InfTextUser* user;
   GdkRectangle rectangle;
+
+  gboolean dirty;
+  guint bucket;
+};
+
+/* Scrollbar geometry which is the same for all users. This is computed
+ * once for every batch of marker updates. */
+typedef struct _InfTextGtkViewportLayout InfTextGtkViewportLayout;
+struct _InfTextGtkViewportLayout {
+  GtkTextView* textview;
+  gint end_y;
+
+  gint slider_size;
+  gint scroll_x;
+  gint scroll_y;
+  gint scroll_height;
 };
 
 typedef struct _InfTextGtkViewportPrivate InfTextGtkViewportPrivate;
@@ -55,6 +79,15 @@ struct _InfTextGtkViewportPrivate {
   InfTextUser* active_user;
   GSList* users;
 
+  /* Users whose marker needs to be recomputed in the next update */
+  GSList* dirty_users;
+  guint update_idle;
+
+  /* Array of GSList*, containing the users whose marker starts in the
+   * respective slice of the scrollbar. */
+  GPtrArray* buckets;
+  gint max_marker_height;
+
   gboolean show_user_markers;
 };
 
@@ -91,90 +124,104 @@ inf_text_gtk_viewport_find_user(InfTextGtkViewport* viewport,
   return NULL;
 }
 
-static void
-inf_text_gtk_viewport_user_compute_user_area(InfTextGtkViewportUser* user)
+static gboolean
+inf_text_gtk_viewport_compute_layout(InfTextGtkViewport* viewport,
+                                     InfTextGtkViewportLayout* layout)
 {
   InfTextGtkViewportPrivate* priv;
   GtkWidget* textview;
   GtkWidget* scrollbar;
   GtkTextIter iter;
   GdkRectangle rect;
-  gint y;
-  gint end_y;
 
-  gint scroll_height;
-  gint slider_size;
   gint stepper_size;
   gint stepper_spacing;
   gint border;
   GdkRectangle allocation;
-  gint scroll_ox;
-  gint scroll_oy;
-  gint dy;
 
-  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(user->viewport);
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
 
   /* TODO: We might want to skip this if show-user-markers is false. */
 
   textview = gtk_bin_get_child(GTK_BIN(priv->scroll));
   scrollbar = gtk_scrolled_window_get_vscrollbar(priv->scroll);
-  if(GTK_IS_TEXT_VIEW(textview) && scrollbar != NULL &&
-     gtk_widget_get_realized(textview))
+  if(!GTK_IS_TEXT_VIEW(textview) || scrollbar == NULL ||
+     !gtk_widget_get_realized(textview))
   {
-    gtk_text_buffer_get_iter_at_offset(
-      gtk_text_view_get_buffer(GTK_TEXT_VIEW(textview)),
-      &iter,
-      inf_text_user_get_caret_position(user->user)
-    );
+    return FALSE;
+  }
 
-    gtk_text_view_get_iter_location(GTK_TEXT_VIEW(textview), &iter, &rect);
-    y = rect.y;
+  layout->textview = GTK_TEXT_VIEW(textview);
 
-    gtk_text_buffer_get_end_iter(
-      gtk_text_view_get_buffer(GTK_TEXT_VIEW(textview)),
-      &iter
-    );
+  gtk_text_buffer_get_end_iter(
+    gtk_text_view_get_buffer(layout->textview),
+    &iter
+  );
 
-    gtk_text_view_get_iter_location(GTK_TEXT_VIEW(textview), &iter, &rect);
-    end_y = rect.y;
+  gtk_text_view_get_iter_location(layout->textview, &iter, &rect);
+  layout->end_y = rect.y;
 
-    g_assert(end_y > 0 || y == 0);
+  gtk_widget_style_get(
+    scrollbar,
+    "slider-width", &layout->slider_size,
+    "stepper-size", &stepper_size,
+    "stepper-spacing", &stepper_spacing,
+    "trough-border", &border,
+    NULL
+  );
 
-    gtk_widget_style_get(
-      scrollbar,
-      "slider-width", &slider_size,
-      "stepper-size", &stepper_size,
-      "stepper-spacing", &stepper_spacing,
-      "trough-border", &border,
-      NULL
-    );
+  gtk_widget_get_allocation(scrollbar, &allocation);
 
-    gtk_widget_get_allocation(scrollbar, &allocation);
+  layout->scroll_x = allocation.x + border;
+  layout->scroll_y = allocation.y + border + stepper_size + stepper_spacing;
+  layout->scroll_height =
+    allocation.height - 2 * (border + stepper_size + stepper_spacing);
 
-    scroll_ox = border;
-    scroll_oy = border + stepper_size + stepper_spacing;
-    scroll_height = allocation.height - 2*scroll_oy;
+  return TRUE;
+}
 
-    if(end_y > 0)
-      y = y * scroll_height / end_y;
+static void
+inf_text_gtk_viewport_user_compute_user_area(
+  InfTextGtkViewportUser* user,
+  const InfTextGtkViewportLayout* layout)
+{
+  GtkTextIter iter;
+  GdkRectangle rect;
+  gint y;
+  gint dy;
+
+  if(layout != NULL)
+  {
+    gtk_text_buffer_get_iter_at_offset(
+      gtk_text_view_get_buffer(layout->textview),
+      &iter,
+      inf_text_user_get_caret_position(user->user)
+    );
+
+    gtk_text_view_get_iter_location(layout->textview, &iter, &rect);
+    y = rect.y;
+
+    g_assert(layout->end_y > 0 || y == 0);
+    if(layout->end_y > 0)
+      y = y * layout->scroll_height / layout->end_y;
 
-    user->rectangle.x = scroll_ox + allocation.x;
-    user->rectangle.y = scroll_oy + allocation.y + y - slider_size/3;
-    user->rectangle.width = slider_size;
-    user->rectangle.height = slider_size*2/3;
+    user->rectangle.x = layout->scroll_x;
+    user->rectangle.y = layout->scroll_y + y - layout->slider_size/3;
+    user->rectangle.width = layout->slider_size;
+    user->rectangle.height = layout->slider_size*2/3;
 
-    if(user->rectangle.y < scroll_oy + allocation.y)
+    if(user->rectangle.y < layout->scroll_y)
     {
-      dy = scroll_oy + allocation.y - user->rectangle.y;
+      dy = layout->scroll_y - user->rectangle.y;
       user->rectangle.y += dy;
       user->rectangle.height -= dy;
     }
 
     if(user->rectangle.y + user->rectangle.height >
-       scroll_oy + allocation.y + scroll_height)
+       layout->scroll_y + layout->scroll_height)
     {
       user->rectangle.height =
-        scroll_oy + allocation.y + scroll_height - user->rectangle.y;
+        layout->scroll_y + layout->scroll_height - user->rectangle.y;
     }
   }
   else
@@ -185,15 +232,53 @@ inf_text_gtk_viewport_user_compute_user_area(InfTextGtkViewportUser* user)
 }
 
 static void
-inf_text_gtk_viewport_user_invalidate_user_area(InfTextGtkViewportUser* user)
+inf_text_gtk_viewport_user_remove_from_bucket(InfTextGtkViewportUser* user)
 {
   InfTextGtkViewportPrivate* priv;
-  GtkWidget* scrollbar;
+  GSList** bucket;
 
   priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(user->viewport);
 
+  if(user->bucket != INF_TEXT_GTK_VIEWPORT_NO_BUCKET)
+  {
+    bucket = (GSList**)&g_ptr_array_index(priv->buckets, user->bucket);
+    *bucket = g_slist_remove(*bucket, user);
+    user->bucket = INF_TEXT_GTK_VIEWPORT_NO_BUCKET;
+  }
+}
+
+static void
+inf_text_gtk_viewport_user_add_to_bucket(InfTextGtkViewportUser* user)
+{
+  InfTextGtkViewportPrivate* priv;
+  GSList** bucket;
+
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(user->viewport);
+  g_assert(user->bucket == INF_TEXT_GTK_VIEWPORT_NO_BUCKET);
+
+  if(user->rectangle.width > 0 && user->rectangle.height > 0)
+  {
+    user->bucket =
+      MAX(user->rectangle.y, 0) / INF_TEXT_GTK_VIEWPORT_BUCKET_SIZE;
+    if(user->bucket >= priv->buckets->len)
+      g_ptr_array_set_size(priv->buckets, user->bucket + 1);
+
+    bucket = (GSList**)&g_ptr_array_index(priv->buckets, user->bucket);
+    *bucket = g_slist_prepend(*bucket, user);
+  }
+}
+
+static void
+inf_text_gtk_viewport_invalidate_area(InfTextGtkViewport* viewport,
+                                      const GdkRectangle* rectangle)
+{
+  InfTextGtkViewportPrivate* priv;
+  GtkWidget* scrollbar;
+
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
+
   if(priv->show_user_markers &&
-     user->rectangle.width > 0 && user->rectangle.height > 0)
+     rectangle->width > 0 && rectangle->height > 0)
   {
     scrollbar = gtk_scrolled_window_get_vscrollbar(priv->scroll);
 
@@ -203,15 +288,115 @@ inf_text_gtk_viewport_user_invalidate_user_area(InfTextGtkViewportUser* user)
     {
       gtk_widget_queue_draw_area(
         scrollbar,
-        user->rectangle.x,
-        user->rectangle.y,
-        user->rectangle.width,
-        user->rectangle.height
+        rectangle->x,
+        rectangle->y,
+        rectangle->width,
+        rectangle->height
       );
     }
   }
 }
 
+static void
+inf_text_gtk_viewport_user_invalidate_user_area(InfTextGtkViewportUser* user)
+{
+  inf_text_gtk_viewport_invalidate_area(user->viewport, &user->rectangle);
+}
+
+static gboolean
+inf_text_gtk_viewport_update_idle_func(gpointer user_data)
+{
+  InfTextGtkViewport* viewport;
+  InfTextGtkViewportPrivate* priv;
+  InfTextGtkViewportLayout layout;
+  gboolean have_layout;
+  InfTextGtkViewportUser* viewport_user;
+  GdkRectangle old_rectangle;
+  GSList* item;
+
+  viewport = INF_TEXT_GTK_VIEWPORT(user_data);
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
+
+  priv->update_idle = 0;
+
+  have_layout = inf_text_gtk_viewport_compute_layout(viewport, &layout);
+  if(have_layout)
+    priv->max_marker_height = layout.slider_size*2/3;
+
+  for(item = priv->dirty_users; item != NULL; item = item->next)
+  {
+    viewport_user = (InfTextGtkViewportUser*)item->data;
+    viewport_user->dirty = FALSE;
+
+    old_rectangle = viewport_user->rectangle;
+
+    inf_text_gtk_viewport_user_compute_user_area(
+      viewport_user,
+      have_layout ? &layout : NULL
+    );
+
+    /* Only redraw markers that actually moved */
+    if(old_rectangle.x != viewport_user->rectangle.x ||
+       old_rectangle.y != viewport_user->rectangle.y ||
+       old_rectangle.width != viewport_user->rectangle.width ||
+       old_rectangle.height != viewport_user->rectangle.height)
+    {
+      inf_text_gtk_viewport_invalidate_area(viewport, &old_rectangle);
+      inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
+
+      inf_text_gtk_viewport_user_remove_from_bucket(viewport_user);
+      inf_text_gtk_viewport_user_add_to_bucket(viewport_user);
+    }
+  }
+
+  g_slist_free(priv->dirty_users);
+  priv->dirty_users = NULL;
+
+  return FALSE;
+}
+
+static void
+inf_text_gtk_viewport_user_queue_update(InfTextGtkViewportUser* user)
+{
+  InfTextGtkViewportPrivate* priv;
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(user->viewport);
+
+  /* Recomputing the marker position requires a layout lookup in the text
+   * view, so collect all changes until the text view has revalidated its
+   * lines, and then handle them all at once. */
+  if(!user->dirty)
+  {
+    user->dirty = TRUE;
+    priv->dirty_users = g_slist_prepend(priv->dirty_users, user);
+  }
+
+  if(priv->update_idle == 0)
+  {
+    priv->update_idle = g_idle_add_full(
+      GTK_TEXT_VIEW_PRIORITY_VALIDATE + 1,
+      inf_text_gtk_viewport_update_idle_func,
+      user->viewport,
+      NULL
+    );
+  }
+}
+
+static void
+inf_text_gtk_viewport_queue_update_all(InfTextGtkViewport* viewport)
+{
+  InfTextGtkViewportPrivate* priv;
+  GSList* item;
+
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
+
+  for(item = priv->users; item != NULL; item = item->next)
+  {
+    inf_text_gtk_viewport_user_queue_update(
+      (InfTextGtkViewportUser*)item->data
+    );
+  }
+}
+
 static gboolean
 inf_text_gtk_viewport_scrollbar_draw_cb(GtkWidget* scrollbar,
                                         cairo_t* cr,
@@ -229,6 +414,9 @@ inf_text_gtk_viewport_scrollbar_draw_cb(GtkWidget* scrollbar,
   double line_width;
 
   GdkRectangle clip_area;
+  guint first_bucket;
+  guint last_bucket;
+  guint i;
 
   viewport = INF_TEXT_GTK_VIEWPORT(user_data);
   priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
@@ -257,31 +445,45 @@ inf_text_gtk_viewport_scrollbar_draw_cb(GtkWidget* scrollbar,
 
     gdk_cairo_get_clip_rectangle(cr, &clip_area);
 
+    /* Only look at the buckets of markers which can intersect the clip
+     * area. Markers are sorted by their upper edge, so also look at the
+     * buckets above the clip area that markers can reach down from. */
+    first_bucket = MAX(clip_area.y - priv->max_marker_height, 0) /
+      INF_TEXT_GTK_VIEWPORT_BUCKET_SIZE;
+    last_bucket = MAX(clip_area.y + clip_area.height, 0) /
+      INF_TEXT_GTK_VIEWPORT_BUCKET_SIZE;
+    if(last_bucket >= priv->buckets->len)
+      last_bucket = priv->buckets->len - 1;
+
     line_width = cairo_get_line_width(cr);
-    for(item = priv->users; item != NULL; item = item->next)
+    for(i = first_bucket; i <= last_bucket && i < priv->buckets->len; ++i)
     {
-      viewport_user = (InfTextGtkViewportUser*)item->data;
-      rectangle = &viewport_user->rectangle;
-
-      if(gdk_rectangle_intersect(&clip_area, rectangle, NULL))
+      item = (GSList*)g_ptr_array_index(priv->buckets, i);
+      for(; item != NULL; item = item->next)
       {
-        h = inf_text_user_get_hue(viewport_user->user);
-
-        cairo_rectangle(
-          cr,
-          rectangle->x + line_width/2,
-          rectangle->y + line_width/2,
-          rectangle->width - line_width,
-          rectangle->height - line_width
-        );
-
-        gtk_hsv_to_rgb(h, s, v/2.0, &r, &g, &b);
-        cairo_set_source_rgba(cr, r, g, b, 0.6);
-        cairo_stroke_preserve(cr);
-
-        gtk_hsv_to_rgb(h, s, v, &r, &g, &b);
-        cairo_set_source_rgba(cr, r, g, b, 0.6);
-        cairo_fill(cr);
+        viewport_user = (InfTextGtkViewportUser*)item->data;
+        rectangle = &viewport_user->rectangle;
+
+        if(gdk_rectangle_intersect(&clip_area, rectangle, NULL))
+        {
+          h = inf_text_user_get_hue(viewport_user->user);
+
+          cairo_rectangle(
+            cr,
+            rectangle->x + line_width/2,
+            rectangle->y + line_width/2,
+            rectangle->width - line_width,
+            rectangle->height - line_width
+          );
+
+          gtk_hsv_to_rgb(h, s, v/2.0, &r, &g, &b);
+          cairo_set_source_rgba(cr, r, g, b, 0.6);
+          cairo_stroke_preserve(cr);
+
+          gtk_hsv_to_rgb(h, s, v, &r, &g, &b);
+          cairo_set_source_rgba(cr, r, g, b, 0.6);
+          cairo_fill(cr);
+        }
       }
     }
   }
@@ -294,63 +496,21 @@ inf_text_gtk_viewport_scrollbar_size_allocate_cb(GtkWidget* scrollbar,
                                                  GtkAllocation* allocation,
                                                  gpointer user_data)
 {
-  InfTextGtkViewport* viewport;
-  InfTextGtkViewportPrivate* priv;
-  GSList* item;
-  InfTextGtkViewportUser* viewport_user;
-
-  viewport = INF_TEXT_GTK_VIEWPORT(user_data);
-  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
-
-  for(item = priv->users; item != NULL; item = item->next)
-  {
-    viewport_user = (InfTextGtkViewportUser*)item->data;
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-    inf_text_gtk_viewport_user_compute_user_area(viewport_user);
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-  }
+  inf_text_gtk_viewport_queue_update_all(INF_TEXT_GTK_VIEWPORT(user_data));
 }
 
 static void
 inf_text_gtk_viewport_adjustment_changed_cb(GtkAdjustment* adjustment,
                                             gpointer user_data)
 {
-  InfTextGtkViewport* viewport;
-  InfTextGtkViewportPrivate* priv;
-  GSList* item;
-  InfTextGtkViewportUser* viewport_user;
-
-  viewport = INF_TEXT_GTK_VIEWPORT(user_data);
-  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
-
-  for(item = priv->users; item != NULL; item = item->next)
-  {
-    viewport_user = (InfTextGtkViewportUser*)item->data;
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-    inf_text_gtk_viewport_user_compute_user_area(viewport_user);
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-  }
+  inf_text_gtk_viewport_queue_update_all(INF_TEXT_GTK_VIEWPORT(user_data));
 }
 
 static void
 inf_text_gtk_viewport_scrollbar_style_updated_cb(GtkWidget* scrollbar,
                                                  gpointer user_data)
 {
-  InfTextGtkViewport* viewport;
-  InfTextGtkViewportPrivate* priv;
-  GSList* item;
-  InfTextGtkViewportUser* viewport_user;
-
-  viewport = INF_TEXT_GTK_VIEWPORT(user_data);
-  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
-
-  for(item = priv->users; item != NULL; item = item->next)
-  {
-    viewport_user = (InfTextGtkViewportUser*)item->data;
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-    inf_text_gtk_viewport_user_compute_user_area(viewport_user);
-    inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-  }
+  inf_text_gtk_viewport_queue_update_all(INF_TEXT_GTK_VIEWPORT(user_data));
 }
 
 static void
@@ -360,19 +520,9 @@ inf_text_gtk_viewport_user_selection_changed_cb(InfTextUser* user,
                                                 gboolean by_request,
                                                 gpointer user_data)
 {
-  InfTextGtkViewportUser* viewport_user;
-  InfTextGtkViewportPrivate* priv;
-
-  viewport_user = (InfTextGtkViewportUser*)user_data;
-  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport_user->viewport);
-
-  /* TODO: Just invalidate the region that really changed, by comparing
-   * old and new rectangle's coordinates */
-  inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
-
-  /* Recompute and revalidate */
-  inf_text_gtk_viewport_user_compute_user_area(viewport_user);
-  inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
+  inf_text_gtk_viewport_user_queue_update(
+    (InfTextGtkViewportUser*)user_data
+  );
 }
 
 static void
@@ -401,10 +551,12 @@ inf_text_gtk_viewport_add_user(InfTextGtkViewport* viewport,
 
   viewport_user->viewport = viewport;
   viewport_user->user = INF_TEXT_USER(user);
+  viewport_user->rectangle.x = viewport_user->rectangle.y = 0;
+  viewport_user->rectangle.width = viewport_user->rectangle.height = 0;
+  viewport_user->dirty = FALSE;
+  viewport_user->bucket = INF_TEXT_GTK_VIEWPORT_NO_BUCKET;
   priv->users = g_slist_prepend(priv->users, viewport_user);
 
-  inf_text_gtk_viewport_user_compute_user_area(viewport_user);
-
   g_signal_connect_after(
     user,
     "selection-changed",
@@ -419,7 +571,7 @@ inf_text_gtk_viewport_add_user(InfTextGtkViewport* viewport,
     viewport_user
   );
 
-  inf_text_gtk_viewport_user_invalidate_user_area(viewport_user);
+  inf_text_gtk_viewport_user_queue_update(viewport_user);
 }
 
 static void
@@ -442,6 +594,10 @@ inf_text_gtk_viewport_remove_user(InfTextGtkViewportUser* viewport_user)
     viewport_user
   );
 
+  if(viewport_user->dirty)
+    priv->dirty_users = g_slist_remove(priv->dirty_users, viewport_user);
+  inf_text_gtk_viewport_user_remove_from_bucket(viewport_user);
+
   priv->users = g_slist_remove(priv->users, viewport_user);
   g_slice_free(InfTextGtkViewportUser, viewport_user);
 }
@@ -733,6 +889,11 @@ inf_text_gtk_viewport_init(InfTextGtkViewport* viewport)
   priv->active_user = NULL;
   priv->users = NULL;
 
+  priv->dirty_users = NULL;
+  priv->update_idle = 0;
+  priv->buckets = g_ptr_array_new();
+  priv->max_marker_height = 0;
+
   priv->show_user_markers = TRUE;
 }
 
@@ -750,10 +911,32 @@ inf_text_gtk_viewport_dispose(GObject* object)
 
   g_assert(priv->active_user == NULL);
   g_assert(priv->users == NULL);
+  g_assert(priv->dirty_users == NULL);
+
+  if(priv->update_idle != 0)
+  {
+    g_source_remove(priv->update_idle);
+    priv->update_idle = 0;
+  }
 
   G_OBJECT_CLASS(inf_text_gtk_viewport_parent_class)->dispose(object);
 }
 
+static void
+inf_text_gtk_viewport_finalize(GObject* object)
+{
+  InfTextGtkViewport* viewport;
+  InfTextGtkViewportPrivate* priv;
+
+  viewport = INF_TEXT_GTK_VIEWPORT(object);
+  priv = INF_TEXT_GTK_VIEWPORT_PRIVATE(viewport);
+
+  /* All users have been removed from their buckets in dispose */
+  g_ptr_array_free(priv->buckets, TRUE);
+
+  G_OBJECT_CLASS(inf_text_gtk_viewport_parent_class)->finalize(object);
+}
+
 static void
 inf_text_gtk_viewport_set_property(GObject* object,
                                    guint prop_id,
@@ -845,6 +1028,7 @@ inf_text_gtk_viewport_class_init(InfTextGtkViewportClass* viewport_class)
   object_class = G_OBJECT_CLASS(viewport_class);
 
   object_class->dispose = inf_text_gtk_viewport_dispose;
+  object_class->finalize = inf_text_gtk_viewport_finalize;
   object_class->set_property = inf_text_gtk_viewport_set_property;
   object_class->get_property = inf_text_gtk_viewport_get_property;
 
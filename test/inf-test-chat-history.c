@@ -0,0 +1,431 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinfinity/common/inf-chat-session.h>
+#include <libinfinity/common/inf-chat-buffer.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Pages through the history of a chat session with
+ * inf_chat_session_request_history(), between a publisher and a subscriber
+ * connected by simulated connections. The subscriber starts out with the
+ * most recent messages only, as if they had been synchronized with
+ * InfChatSession:sync-history. */
+
+/* Messages only have a resolution of one second, so several of them share
+ * the same time, which pages must not split. */
+static const time_t TEST_HISTORY_TIMES[] = {
+  100, 101, 102, 102, 102, 103, 104, 104, 105, 106
+};
+
+typedef struct _TestHistory TestHistory;
+struct _TestHistory {
+  const gchar* name;
+
+  InfCommunicationManager* server_manager;
+  InfCommunicationManager* client_manager;
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+  InfCommunicationHostedGroup* server_group;
+  InfCommunicationJoinedGroup* client_group;
+
+  InfChatSession* server;
+  InfChatSession* client;
+
+  gboolean failed;
+};
+
+static void
+test_history_error_cb(InfSession* session,
+                      InfXmlConnection* connection,
+                      xmlNodePtr xml,
+                      const GError* error,
+                      gpointer user_data)
+{
+  TestHistory* test;
+  test = (TestHistory*)user_data;
+
+  printf("%s: session error: %s\n", test->name, error->message);
+  test->failed = TRUE;
+}
+
+/* Creates a session whose buffer can hold size messages, and which contains
+ * the messages from first to the newest one. */
+static InfChatSession*
+test_history_session_new(TestHistory* test,
+                         InfCommunicationManager* manager,
+                         guint size,
+                         guint first)
+{
+  InfChatBuffer* buffer;
+  InfChatSession* session;
+  InfUser* user;
+  gchar* text;
+  guint i;
+
+  user = INF_USER(
+    g_object_new(
+      INF_TYPE_USER,
+      "id", 1,
+      "name", "Alice",
+      "status", INF_USER_UNAVAILABLE,
+      NULL
+    )
+  );
+
+  buffer = inf_chat_buffer_new(size);
+  for(i = first; i < G_N_ELEMENTS(TEST_HISTORY_TIMES); ++i)
+  {
+    text = g_strdup_printf("m%u", i);
+
+    inf_chat_buffer_add_message(
+      buffer,
+      user,
+      text,
+      strlen(text),
+      TEST_HISTORY_TIMES[i],
+      INF_CHAT_BUFFER_MESSAGE_BACKLOG
+    );
+
+    g_free(text);
+  }
+
+  session = inf_chat_session_new(
+    manager,
+    buffer,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  inf_user_table_add_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    user
+  );
+
+  g_signal_connect(
+    G_OBJECT(session),
+    "error",
+    G_CALLBACK(test_history_error_cb),
+    test
+  );
+
+  g_object_unref(user);
+  g_object_unref(buffer);
+  return session;
+}
+
+static void
+test_history_init(TestHistory* test,
+                  const gchar* name,
+                  guint server_size,
+                  guint client_size,
+                  guint client_first)
+{
+  static const gchar* const methods[] = { "central", NULL };
+
+  test->name = name;
+  test->failed = FALSE;
+
+  test->server_manager = inf_communication_manager_new();
+  test->client_manager = inf_communication_manager_new();
+
+  test->server_connection = inf_simulated_connection_new();
+  test->client_connection = inf_simulated_connection_new();
+
+  inf_simulated_connection_connect(
+    test->server_connection,
+    test->client_connection
+  );
+
+  test->server = test_history_session_new(
+    test,
+    test->server_manager,
+    server_size,
+    0
+  );
+
+  test->client = test_history_session_new(
+    test,
+    test->client_manager,
+    client_size,
+    client_first
+  );
+
+  test->server_group = inf_communication_manager_open_group(
+    test->server_manager,
+    "InfChat",
+    methods
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->server_group),
+    INF_COMMUNICATION_OBJECT(test->server)
+  );
+
+  inf_communication_hosted_group_add_member(
+    test->server_group,
+    INF_XML_CONNECTION(test->server_connection)
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(test->server),
+    INF_COMMUNICATION_GROUP(test->server_group)
+  );
+
+  test->client_group = inf_communication_manager_join_group(
+    test->client_manager,
+    "InfChat",
+    INF_XML_CONNECTION(test->client_connection),
+    "central"
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->client_group),
+    INF_COMMUNICATION_OBJECT(test->client)
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(test->client),
+    INF_COMMUNICATION_GROUP(test->client_group)
+  );
+}
+
+static void
+test_history_deinit(TestHistory* test)
+{
+  g_object_unref(test->client);
+  g_object_unref(test->server);
+  g_object_unref(test->client_group);
+  g_object_unref(test->server_group);
+  g_object_unref(test->client_connection);
+  g_object_unref(test->server_connection);
+  g_object_unref(test->client_manager);
+  g_object_unref(test->server_manager);
+}
+
+/* Requests count messages and checks the subscriber's buffer against the
+ * names of the messages it should contain afterwards, and whether it should
+ * know that there are no older ones left. */
+static void
+test_history_request(TestHistory* test,
+                     guint count,
+                     const gchar* expected,
+                     gboolean expected_complete)
+{
+  InfChatBuffer* buffer;
+  const InfChatBufferMessage* message;
+  GString* str;
+  gboolean complete;
+  guint i;
+
+  inf_chat_session_request_history(test->client, count);
+
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(INF_SESSION(test->client)));
+  str = g_string_new(NULL);
+
+  for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
+  {
+    message = inf_chat_buffer_get_message(buffer, i);
+    if(i > 0) g_string_append_c(str, ' ');
+    g_string_append_len(str, message->text, message->length);
+
+    if((message->flags & INF_CHAT_BUFFER_MESSAGE_BACKLOG) == 0)
+    {
+      printf(
+        "%s: message \"%.*s\" is not a backlog message\n",
+        test->name,
+        (int)message->length,
+        message->text
+      );
+
+      test->failed = TRUE;
+    }
+  }
+
+  if(strcmp(str->str, expected) != 0)
+  {
+    printf(
+      "%s: after requesting %u messages, buffer is \"%s\" instead of "
+      "\"%s\"\n",
+      test->name,
+      count,
+      str->str,
+      expected
+    );
+
+    test->failed = TRUE;
+  }
+
+  g_object_get(G_OBJECT(test->client), "history-complete", &complete, NULL);
+  if(complete != expected_complete)
+  {
+    printf(
+      "%s: after requesting %u messages, history is %s\n",
+      test->name,
+      count,
+      complete ? "complete" : "not complete"
+    );
+
+    test->failed = TRUE;
+  }
+
+  g_string_free(str, TRUE);
+}
+
+/* The subscriber has m6 to m9, which is what a sync-history of 3 yields
+ * since m6 and m7 have the same time. The first page of 3 grows to 4 so as
+ * not to split m2, m3 and m4. */
+static gboolean
+test_history_pages(void)
+{
+  TestHistory test;
+
+  test_history_init(&test, "pages", 16, 16, 6);
+
+  test_history_request(
+    &test,
+    3,
+    "m2 m3 m4 m5 m6 m7 m8 m9",
+    FALSE
+  );
+
+  test_history_request(
+    &test,
+    3,
+    "m0 m1 m2 m3 m4 m5 m6 m7 m8 m9",
+    TRUE
+  );
+
+  test_history_deinit(&test);
+  return !test.failed;
+}
+
+/* Requests beyond the end of the history yield what is there, and then
+ * nothing at all. A subscriber without any messages gets the newest ones. */
+static gboolean
+test_history_beyond_end(void)
+{
+  TestHistory test;
+  gboolean result;
+
+  test_history_init(&test, "beyond-end", 16, 16, 8);
+
+  test_history_request(
+    &test,
+    100,
+    "m0 m1 m2 m3 m4 m5 m6 m7 m8 m9",
+    TRUE
+  );
+
+  test_history_request(
+    &test,
+    1,
+    "m0 m1 m2 m3 m4 m5 m6 m7 m8 m9",
+    TRUE
+  );
+
+  test_history_deinit(&test);
+  result = !test.failed;
+
+  test_history_init(&test, "empty", 16, 16, 10);
+  test_history_request(&test, 2, "m8 m9", FALSE);
+  test_history_request(&test, 1, "m6 m7 m8 m9", FALSE);
+  test_history_deinit(&test);
+  if(test.failed) result = FALSE;
+
+  return result;
+}
+
+/* The publisher's buffer has dropped m0 to m3 already, so that its history
+ * is complete after m4. */
+static gboolean
+test_history_server_trimmed(void)
+{
+  TestHistory test;
+
+  test_history_init(&test, "server-trimmed", 6, 16, 8);
+  test_history_request(&test, 10, "m4 m5 m6 m7 m8 m9", TRUE);
+  test_history_deinit(&test);
+
+  return !test.failed;
+}
+
+/* The subscriber's buffer does not grow beyond its size, and messages from
+ * the history never push out newer ones. */
+static gboolean
+test_history_client_trimmed(void)
+{
+  TestHistory test;
+  gboolean result;
+
+  test_history_init(&test, "client-full", 16, 4, 6);
+  test_history_request(&test, 3, "m6 m7 m8 m9", FALSE);
+  test_history_deinit(&test);
+  result = !test.failed;
+
+  test_history_init(&test, "client-space", 16, 6, 6);
+  test_history_request(&test, 3, "m4 m5 m6 m7 m8 m9", FALSE);
+  test_history_request(&test, 3, "m4 m5 m6 m7 m8 m9", FALSE);
+  test_history_deinit(&test);
+  if(test.failed) result = FALSE;
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_history_pages()) ++passed;
+  ++total;
+  if(test_history_beyond_end()) ++passed;
+  ++total;
+  if(test_history_server_trimmed()) ++passed;
+  ++total;
+  if(test_history_client_trimmed()) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -19,10 +19,419 @@
 
 #include <libinftext/inf-text-chunk.h>
 
-int main()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Checks that every character of a long segment can be found, which goes
+ * through the byte index lookup of the encoding's code path. */
+static void
+test_long_segment(const gchar* encoding)
+{
+  static const gchar* const CHARACTERS[] = { "a", "\xc3\xbc", "\xe2\x82\xac" };
+
+  GString* utf8;
+  InfTextChunk* chunk;
+  InfTextChunk* sub;
+  gchar* text;
+  gchar* converted;
+  gsize bytes;
+  gsize converted_bytes;
+  guint i;
+
+  utf8 = g_string_new(NULL);
+  for(i = 0; i < 1000; ++i)
+    g_string_append(utf8, CHARACTERS[(i * 7 + i / 13) % 3]);
+
+  converted = g_convert(
+    utf8->str,
+    utf8->len,
+    encoding,
+    "UTF-8",
+    NULL,
+    &converted_bytes,
+    NULL
+  );
+
+  g_assert(converted != NULL);
+
+  chunk = inf_text_chunk_new(encoding);
+  inf_text_chunk_insert_text(chunk, 0, converted, converted_bytes, 1000, 1);
+  g_free(converted);
+
+  for(i = 0; i < 1000; ++i)
+  {
+    sub = inf_text_chunk_substring(chunk, i, 1);
+    text = inf_text_chunk_get_text(sub, &bytes);
+    converted = g_convert(text, bytes, "UTF-8", encoding, NULL, NULL, NULL);
+
+    g_assert(converted != NULL);
+    g_assert(strcmp(converted, CHARACTERS[(i * 7 + i / 13) % 3]) == 0);
+
+    g_free(converted);
+    g_free(text);
+    inf_text_chunk_free(sub);
+  }
+
+  inf_text_chunk_free(chunk);
+  g_string_free(utf8, TRUE);
+}
+
+/* Benchmark mode, used with --benchmark. Each operation is timed on chunks
+ * with different numbers and lengths of segments, and with a different
+ * encoding, since UTF-8 is handled by libinfinity itself while other
+ * encodings go through iconv. The results are printed as JSON to stdout,
+ * always in the same order and format, so that they can be compared
+ * between runs. */
+
+static const gchar* const BENCHMARK_ENCODINGS[] = { "UTF-8", "UTF-16LE" };
+static const guint BENCHMARK_SEGMENTS[] = { 1, 16, 256 };
+static const guint BENCHMARK_SEGMENT_LENGTHS[] = { 16, 256 };
+
+/* Operations per measurement */
+static const guint BENCHMARK_OPERATIONS = 1000;
+
+static gboolean benchmark_first_result = TRUE;
+
+static void
+benchmark_result(const gchar* encoding,
+                 guint segments,
+                 guint segment_length,
+                 const gchar* operation,
+                 guint rounds,
+                 gint64 usecs)
+{
+  double ns_per_op;
+
+  ns_per_op = 1000.0 * usecs / ((double)rounds * BENCHMARK_OPERATIONS);
+
+  printf(
+    "%s    {\"encoding\": \"%s\", \"segments\": %u, "
+    "\"segment_length\": %u, \"operation\": \"%s\", "
+    "\"ns_per_op\": %.1f}",
+    benchmark_first_result ? "" : ",\n",
+    encoding,
+    segments,
+    segment_length,
+    operation,
+    ns_per_op
+  );
+
+  benchmark_first_result = FALSE;
+}
+
+/* Creates a chunk with the given number of segments, each written by a
+ * different author than the one before, so that they are not merged. */
+static InfTextChunk*
+benchmark_create_chunk(const gchar* encoding,
+                       guint segments,
+                       guint segment_length)
+{
+  static const gchar* const CHARACTERS[] = { "a", "\xc3\xbc", "\xe2\x82\xac" };
+
+  GString* utf8;
+  InfTextChunk* chunk;
+  gchar* converted;
+  gsize converted_bytes;
+  guint i;
+
+  utf8 = g_string_new(NULL);
+  for(i = 0; i < segment_length; ++i)
+    g_string_append(utf8, CHARACTERS[(i * 7 + i / 13) % 3]);
+
+  converted = g_convert(
+    utf8->str,
+    utf8->len,
+    encoding,
+    "UTF-8",
+    NULL,
+    &converted_bytes,
+    NULL
+  );
+
+  g_assert(converted != NULL);
+
+  chunk = inf_text_chunk_new(encoding);
+  for(i = 0; i < segments; ++i)
+  {
+    inf_text_chunk_insert_text(
+      chunk,
+      i * segment_length,
+      converted,
+      converted_bytes,
+      segment_length,
+      1 + i % 2
+    );
+  }
+
+  g_free(converted);
+  g_string_free(utf8, TRUE);
+  return chunk;
+}
+
+static void
+benchmark_chunk(const gchar* encoding,
+                guint segments,
+                guint segment_length,
+                guint rounds)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* other;
+  InfTextChunk* copy;
+  InfTextChunk* sub;
+  gchar* text;
+  gsize text_bytes;
+  guint length;
+  guint round;
+  guint i;
+  gint64 begin;
+  gint64 insert_time;
+  gint64 erase_time;
+  gint64 substring_time;
+  gint64 equal_time;
+
+  chunk = benchmark_create_chunk(encoding, segments, segment_length);
+  other = benchmark_create_chunk(encoding, segments, segment_length);
+  length = inf_text_chunk_get_length(chunk);
+
+  text = g_convert("x", 1, encoding, "UTF-8", NULL, &text_bytes, NULL);
+  g_assert(text != NULL);
+
+  insert_time = 0;
+  erase_time = 0;
+  substring_time = 0;
+  equal_time = 0;
+
+  for(round = 0; round < rounds; ++round)
+  {
+    /* Insert characters by a third author at spread out positions, which
+     * splits segments, and then erase as many characters again. */
+    copy = inf_text_chunk_copy(chunk);
+
+    begin = g_get_monotonic_time();
+    for(i = 0; i < BENCHMARK_OPERATIONS; ++i)
+    {
+      inf_text_chunk_insert_text(
+        copy,
+        (i * 7919) % (length + i + 1),
+        text,
+        text_bytes,
+        1,
+        3
+      );
+    }
+    insert_time += g_get_monotonic_time() - begin;
+
+    begin = g_get_monotonic_time();
+    for(i = 0; i < BENCHMARK_OPERATIONS; ++i)
+    {
+      inf_text_chunk_erase(
+        copy,
+        (i * 7919) % (length + BENCHMARK_OPERATIONS - i),
+        1
+      );
+    }
+    erase_time += g_get_monotonic_time() - begin;
+
+    g_assert(inf_text_chunk_get_length(copy) == length);
+    inf_text_chunk_free(copy);
+
+    begin = g_get_monotonic_time();
+    for(i = 0; i < BENCHMARK_OPERATIONS; ++i)
+    {
+      sub = inf_text_chunk_substring(
+        chunk,
+        (i * 7919) % (length / 2 + 1),
+        length / 2
+      );
+
+      inf_text_chunk_free(sub);
+    }
+    substring_time += g_get_monotonic_time() - begin;
+
+    /* The two chunks do not share their text, so that the content is
+     * actually compared. */
+    begin = g_get_monotonic_time();
+    for(i = 0; i < BENCHMARK_OPERATIONS; ++i)
+      g_assert(inf_text_chunk_equal(chunk, other));
+    equal_time += g_get_monotonic_time() - begin;
+  }
+
+  benchmark_result(
+    encoding, segments, segment_length, "insert", rounds, insert_time
+  );
+  benchmark_result(
+    encoding, segments, segment_length, "erase", rounds, erase_time
+  );
+  benchmark_result(
+    encoding, segments, segment_length, "substring", rounds, substring_time
+  );
+  benchmark_result(
+    encoding, segments, segment_length, "equal", rounds, equal_time
+  );
+
+  g_free(text);
+  inf_text_chunk_free(other);
+  inf_text_chunk_free(chunk);
+}
+
+static int
+benchmark(guint rounds)
+{
+  guint e;
+  guint s;
+  guint l;
+
+  printf("{\n  \"benchmark\": \"inf-test-chunk\",\n");
+  printf("  \"operations\": %u,\n", rounds * BENCHMARK_OPERATIONS);
+  printf("  \"results\": [\n");
+
+  for(e = 0; e < G_N_ELEMENTS(BENCHMARK_ENCODINGS); ++e)
+  {
+    for(s = 0; s < G_N_ELEMENTS(BENCHMARK_SEGMENTS); ++s)
+    {
+      for(l = 0; l < G_N_ELEMENTS(BENCHMARK_SEGMENT_LENGTHS); ++l)
+      {
+        benchmark_chunk(
+          BENCHMARK_ENCODINGS[e],
+          BENCHMARK_SEGMENTS[s],
+          BENCHMARK_SEGMENT_LENGTHS[l],
+          rounds
+        );
+      }
+    }
+  }
+
+  printf("\n  ]\n}\n");
+  return 0;
+}
+
+typedef struct _TestViewData TestViewData;
+struct _TestViewData {
+  GString* text;
+  guint length;
+};
+
+static gboolean
+test_view_func(gconstpointer text,
+               gsize bytes,
+               guint length,
+               guint author,
+               gpointer user_data)
+{
+  TestViewData* data;
+  data = (TestViewData*)user_data;
+
+  g_assert(length > 0);
+  g_string_append_len(data->text, text, bytes);
+  data->length += length;
+  return TRUE;
+}
+
+/* Checks that viewing a range of a chunk shows the same text as copying
+ * it, also for ranges that begin or end within a segment. */
+static void
+test_view(const gchar* encoding)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* sub;
+  TestViewData data;
+  gchar* text;
+  gsize bytes;
+  guint begin;
+  guint length;
+
+  chunk = benchmark_create_chunk(encoding, 16, 16);
+  data.text = g_string_new(NULL);
+
+  for(begin = 0; begin < 256; begin += 7)
+  {
+    for(length = 0; begin + length <= 256; length += 11)
+    {
+      g_string_truncate(data.text, 0);
+      data.length = 0;
+
+      g_assert(
+        inf_text_chunk_view(chunk, begin, length, test_view_func, &data)
+      );
+
+      sub = inf_text_chunk_substring(chunk, begin, length);
+      text = inf_text_chunk_get_text(sub, &bytes);
+
+      g_assert(data.length == length);
+      g_assert(data.text->len == bytes);
+      g_assert(bytes == 0 || memcmp(data.text->str, text, bytes) == 0);
+
+      g_free(text);
+      inf_text_chunk_free(sub);
+    }
+  }
+
+  g_string_free(data.text, TRUE);
+  inf_text_chunk_free(chunk);
+}
+
+/* Checks that compacting a chunk does not change its content, and that it
+ * can still be modified afterwards. */
+static void
+test_compact(const gchar* encoding)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* compacted;
+  InfTextChunk* sub;
+  guint pos;
+
+  chunk = benchmark_create_chunk(encoding, 64, 4);
+  compacted = inf_text_chunk_copy(chunk);
+
+  inf_text_chunk_compact(compacted);
+  g_assert(inf_text_chunk_equal(chunk, compacted));
+
+  /* Leave segments of the same author next to each other */
+  for(pos = 4; pos + 4 <= inf_text_chunk_get_length(chunk); pos += 4)
+  {
+    inf_text_chunk_erase(chunk, pos, 4);
+    inf_text_chunk_erase(compacted, pos, 4);
+    g_assert(inf_text_chunk_equal(chunk, compacted));
+  }
+
+  inf_text_chunk_compact(compacted);
+  g_assert(inf_text_chunk_equal(chunk, compacted));
+
+  sub = inf_text_chunk_substring(chunk, 3, 10);
+  inf_text_chunk_insert_chunk(chunk, 17, sub);
+  inf_text_chunk_insert_chunk(compacted, 17, sub);
+  inf_text_chunk_erase(chunk, 2, 3);
+  inf_text_chunk_erase(compacted, 2, 3);
+  g_assert(inf_text_chunk_equal(chunk, compacted));
+
+  inf_text_chunk_compact(compacted);
+  g_assert(inf_text_chunk_equal(chunk, compacted));
+
+  inf_text_chunk_free(sub);
+  inf_text_chunk_free(compacted);
+  inf_text_chunk_free(chunk);
+}
+
+int main(int argc, char* argv[])
 {
   InfTextChunk* chunk;
   InfTextChunk* chunk2;
+  int rounds;
+
+  if(argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+  {
+    rounds = 20;
+    if(argc > 2) rounds = atoi(argv[2]);
+
+    if(rounds <= 0)
+    {
+      fprintf(stderr, "Usage: %s [--benchmark [<rounds>]]\n", argv[0]);
+      return -1;
+    }
+
+    return benchmark(rounds);
+  }
 
   chunk2 = inf_text_chunk_new("UTF-8");
 
@@ -32,8 +441,37 @@ int main()
   inf_text_chunk_insert_text(chunk2, 3, "ü", 2, 1, 503);
   chunk = inf_text_chunk_substring(chunk2, 0, 3);
 
+  inf_text_chunk_free(chunk);
+
+  /* Copies share their text until one of them is modified */
+  chunk = inf_text_chunk_copy(chunk2);
+  g_assert(inf_text_chunk_equal(chunk, chunk2));
+
+  inf_text_chunk_insert_text(chunk, 1, "d", 1, 1, 504);
+  g_assert(inf_text_chunk_get_length(chunk) == 5);
+  g_assert(inf_text_chunk_get_length(chunk2) == 4);
+  g_assert(!inf_text_chunk_equal(chunk, chunk2));
+
+  inf_text_chunk_erase(chunk, 1, 1);
+  g_assert(inf_text_chunk_equal(chunk, chunk2));
+
+  inf_text_chunk_free(chunk2);
+  chunk2 = inf_text_chunk_substring(chunk, 0, 4);
+  inf_text_chunk_erase(chunk, 0, 2);
+  g_assert(inf_text_chunk_get_length(chunk) == 2);
+  g_assert(inf_text_chunk_get_length(chunk2) == 4);
+
   inf_text_chunk_free(chunk);
   inf_text_chunk_free(chunk2);
 
+  test_long_segment("UTF-8");
+  test_long_segment("UTF-16LE");
+
+  test_view("UTF-8");
+  test_view("UTF-16LE");
+
+  test_compact("UTF-8");
+  test_compact("UTF-16LE");
+
   return 0;
 }
@@ -0,0 +1,1017 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures how InfdDirectory behaves with large directory trees. A
+ * synthetic tree is generated in a temporary InfdFilesystemStorage: every
+ * directory up to the given depth contains the given number of
+ * subdirectories and documents. The documents are empty files of type
+ * InfText; no note plugin is loaded, so they are never opened. The server
+ * and a number of InfcBrowser clients run in this process and are connected
+ * with InfSimulatedConnection. The benchmark then runs these phases:
+ *
+ *   load     The server explores the whole tree from the storage.
+ *   explore  All clients explore the whole tree concurrently.
+ *   add      Every client adds subdirectories below the root, one at a time.
+ *   remove   Every client removes the subdirectories it added again.
+ *   acl      The server checks the permissions of the default account for
+ *            every node, and then changes the ACL of the top level
+ *            directories, which is sent to all clients.
+ *
+ * ./inf-test-directory-benchmark -d 3 -w 10 -n 10 -c 8
+ *
+ * Options:
+ *   -d <depth>        Depth of the tree [Default=3]
+ *   -w <width>        Subdirectories per directory [Default=10]
+ *   -n <documents>    Documents per directory [Default=10]
+ *   -c <clients>      Number of clients [Default=4]
+ *   -o <operations>   Nodes each client adds and removes [Default=100]
+ *   -r <rounds>       Rounds of ACL checks over the whole tree [Default=10]
+ *   -t                Print one tab-separated line to stdout instead
+ *
+ * The tab-separated line has the columns depth, width, documents, clients,
+ * nodes, load-seconds, explore-seconds, explore-avg-latency-us,
+ * explore-p99-latency-us, adds-per-sec, removes-per-sec,
+ * check-acl-ns-per-node, set-acl-us, server-bytes-per-node and
+ * client-bytes-per-node. Memory is measured as the growth of the resident
+ * set size during the load and explore phases, which is only available on
+ * Linux; it is reported as -1 elsewhere. The client figure is per node and
+ * per client.
+ */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-init.h>
+#include <libinfinity/inf-signals.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+# include <unistd.h>
+#endif
+
+typedef struct _InfTestDirectoryBenchmark InfTestDirectoryBenchmark;
+struct _InfTestDirectoryBenchmark {
+  InfStandaloneIo* io;
+  InfdDirectory* directory;
+
+  guint n_clients;
+  guint n_operations;
+
+  GSList* clients;
+  guint n_open;
+
+  /* Requests that have not finished yet in the current phase. The main
+   * loop runs until this drops to zero. */
+  guint n_pending;
+  gboolean failed;
+
+  /* Latencies of explore requests in microseconds, of all clients */
+  GArray* latencies;
+};
+
+typedef struct _InfTestDirectoryBenchmarkClient
+  InfTestDirectoryBenchmarkClient;
+struct _InfTestDirectoryBenchmarkClient {
+  InfTestDirectoryBenchmark* benchmark;
+  guint index;
+
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+  InfcBrowser* browser;
+  gboolean open;
+
+  /* Nodes added in the add phase, to be removed in the remove phase */
+  GArray* added;
+  guint n_done;
+};
+
+typedef struct _InfTestDirectoryBenchmarkExplore
+  InfTestDirectoryBenchmarkExplore;
+struct _InfTestDirectoryBenchmarkExplore {
+  InfTestDirectoryBenchmark* benchmark;
+  InfBrowser* browser;
+  gint64 begin;
+};
+
+/* Returns the resident set size of this process in bytes, or -1 if it is
+ * not known. */
+static gint64
+inf_test_directory_benchmark_get_rss(void)
+{
+#ifdef __linux__
+  gchar* contents;
+  gchar** fields;
+  gint64 rss;
+
+  if(!g_file_get_contents("/proc/self/statm", &contents, NULL, NULL))
+    return -1;
+
+  rss = -1;
+  fields = g_strsplit(contents, " ", 3);
+  if(fields[0] != NULL && fields[1] != NULL)
+    rss = g_ascii_strtoll(fields[1], NULL, 10) * sysconf(_SC_PAGESIZE);
+
+  g_strfreev(fields);
+  g_free(contents);
+  return rss;
+#else
+  return -1;
+#endif
+}
+
+static void
+inf_test_directory_benchmark_finish_one(InfTestDirectoryBenchmark* benchmark)
+{
+  g_assert(benchmark->n_pending > 0);
+
+  /* Requests on the server side can finish synchronously, before the main
+   * loop is started. */
+  --benchmark->n_pending;
+  if(benchmark->n_pending == 0 &&
+     inf_standalone_io_loop_running(benchmark->io))
+  {
+    inf_standalone_io_loop_quit(benchmark->io);
+  }
+}
+
+/* Runs the main loop until all requests of the current phase are done */
+static void
+inf_test_directory_benchmark_wait(InfTestDirectoryBenchmark* benchmark)
+{
+  if(benchmark->n_pending > 0)
+    inf_standalone_io_loop(benchmark->io);
+}
+
+static void
+inf_test_directory_benchmark_remove_tree(const gchar* path)
+{
+  GDir* dir;
+  const gchar* name;
+  gchar* child;
+
+  dir = g_dir_open(path, 0, NULL);
+  if(dir != NULL)
+  {
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+      child = g_build_filename(path, name, NULL);
+      if(g_file_test(child, G_FILE_TEST_IS_DIR))
+        inf_test_directory_benchmark_remove_tree(child);
+      else
+        g_unlink(child);
+      g_free(child);
+    }
+
+    g_dir_close(dir);
+  }
+
+  g_rmdir(path);
+}
+
+/* Creates the synthetic tree below path, and returns the number of nodes
+ * created, or 0 on error. */
+static guint
+inf_test_directory_benchmark_generate(InfdFilesystemStorage* storage,
+                                      const gchar* path,
+                                      guint depth,
+                                      guint width,
+                                      guint n_documents,
+                                      GError** error)
+{
+  gchar* child;
+  gchar* full_path;
+  guint n_nodes;
+  guint n_children;
+  guint i;
+
+  n_nodes = 0;
+
+  for(i = 0; i < n_documents; ++i)
+  {
+    child = g_strdup_printf("%s/document%u", path, i);
+    full_path = infd_filesystem_storage_get_path(
+      storage,
+      "InfText",
+      child,
+      error
+    );
+    g_free(child);
+
+    if(full_path == NULL)
+      return 0;
+
+    if(!g_file_set_contents(full_path, "", 0, error))
+    {
+      g_free(full_path);
+      return 0;
+    }
+
+    g_free(full_path);
+    ++n_nodes;
+  }
+
+  for(i = 0; i < width; ++i)
+  {
+    child = g_strdup_printf("%s/directory%u", path, i);
+    if(!infd_storage_create_subdirectory(INFD_STORAGE(storage), child, error))
+    {
+      g_free(child);
+      return 0;
+    }
+
+    ++n_nodes;
+
+    if(depth > 1)
+    {
+      n_children = inf_test_directory_benchmark_generate(
+        storage,
+        child,
+        depth - 1,
+        width,
+        n_documents,
+        error
+      );
+
+      if(n_children == 0 && (width > 0 || n_documents > 0))
+      {
+        g_free(child);
+        return 0;
+      }
+
+      n_nodes += n_children;
+    }
+
+    g_free(child);
+  }
+
+  return n_nodes;
+}
+
+static void
+inf_test_directory_benchmark_explore(InfTestDirectoryBenchmark* benchmark,
+                                     InfBrowser* browser,
+                                     const InfBrowserIter* iter);
+
+/* Explores all subdirectories below iter that are not explored yet */
+static void
+inf_test_directory_benchmark_explore_children(
+  InfTestDirectoryBenchmark* benchmark,
+  InfBrowser* browser,
+  const InfBrowserIter* iter)
+{
+  InfBrowserIter child;
+  gboolean has_child;
+
+  child = *iter;
+  for(has_child = inf_browser_get_child(browser, &child);
+      has_child;
+      has_child = inf_browser_get_next(browser, &child))
+  {
+    if(inf_browser_is_subdirectory(browser, &child))
+      inf_test_directory_benchmark_explore(benchmark, browser, &child);
+  }
+}
+
+static void
+inf_test_directory_benchmark_explore_finished_cb(InfRequest* request,
+                                                 const InfRequestResult* res,
+                                                 const GError* error,
+                                                 gpointer user_data)
+{
+  InfTestDirectoryBenchmarkExplore* explore;
+  InfTestDirectoryBenchmark* benchmark;
+  const InfBrowserIter* iter;
+  gint64 latency;
+
+  explore = (InfTestDirectoryBenchmarkExplore*)user_data;
+  benchmark = explore->benchmark;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to explore node: %s\n", error->message);
+    benchmark->failed = TRUE;
+  }
+  else
+  {
+    latency = g_get_monotonic_time() - explore->begin;
+    g_array_append_val(benchmark->latencies, latency);
+
+    inf_request_result_get_explore_node(res, NULL, &iter);
+    inf_test_directory_benchmark_explore_children(
+      benchmark,
+      explore->browser,
+      iter
+    );
+  }
+
+  g_slice_free(InfTestDirectoryBenchmarkExplore, explore);
+  inf_test_directory_benchmark_finish_one(benchmark);
+}
+
+static void
+inf_test_directory_benchmark_explore(InfTestDirectoryBenchmark* benchmark,
+                                     InfBrowser* browser,
+                                     const InfBrowserIter* iter)
+{
+  InfTestDirectoryBenchmarkExplore* explore;
+
+  if(inf_browser_get_explored(browser, iter))
+  {
+    inf_test_directory_benchmark_explore_children(benchmark, browser, iter);
+    return;
+  }
+
+  explore = g_slice_new(InfTestDirectoryBenchmarkExplore);
+  explore->benchmark = benchmark;
+  explore->browser = browser;
+  explore->begin = g_get_monotonic_time();
+
+  ++benchmark->n_pending;
+  inf_browser_explore(
+    browser,
+    iter,
+    inf_test_directory_benchmark_explore_finished_cb,
+    explore
+  );
+}
+
+static void
+inf_test_directory_benchmark_add_next(InfTestDirectoryBenchmarkClient* client);
+
+static void
+inf_test_directory_benchmark_add_finished_cb(InfRequest* request,
+                                             const InfRequestResult* result,
+                                             const GError* error,
+                                             gpointer user_data)
+{
+  InfTestDirectoryBenchmarkClient* client;
+  const InfBrowserIter* iter;
+
+  client = (InfTestDirectoryBenchmarkClient*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to add node: %s\n", error->message);
+    client->benchmark->failed = TRUE;
+    inf_test_directory_benchmark_finish_one(client->benchmark);
+  }
+  else
+  {
+    inf_request_result_get_add_node(result, NULL, NULL, &iter);
+    g_array_append_val(client->added, *iter);
+    inf_test_directory_benchmark_add_next(client);
+  }
+}
+
+static void
+inf_test_directory_benchmark_add_next(InfTestDirectoryBenchmarkClient* client)
+{
+  InfBrowserIter root;
+  gchar* name;
+
+  if(client->added->len == client->benchmark->n_operations)
+  {
+    inf_test_directory_benchmark_finish_one(client->benchmark);
+    return;
+  }
+
+  name = g_strdup_printf(
+    "benchmark%u-%u",
+    client->index,
+    client->added->len
+  );
+
+  inf_browser_get_root(INF_BROWSER(client->browser), &root);
+  inf_browser_add_subdirectory(
+    INF_BROWSER(client->browser),
+    &root,
+    name,
+    NULL,
+    inf_test_directory_benchmark_add_finished_cb,
+    client
+  );
+
+  g_free(name);
+}
+
+static void
+inf_test_directory_benchmark_remove_next(
+  InfTestDirectoryBenchmarkClient* client);
+
+static void
+inf_test_directory_benchmark_remove_finished_cb(InfRequest* request,
+                                                const InfRequestResult* res,
+                                                const GError* error,
+                                                gpointer user_data)
+{
+  InfTestDirectoryBenchmarkClient* client;
+  client = (InfTestDirectoryBenchmarkClient*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to remove node: %s\n", error->message);
+    client->benchmark->failed = TRUE;
+    inf_test_directory_benchmark_finish_one(client->benchmark);
+  }
+  else
+  {
+    ++client->n_done;
+    inf_test_directory_benchmark_remove_next(client);
+  }
+}
+
+static void
+inf_test_directory_benchmark_remove_next(
+  InfTestDirectoryBenchmarkClient* client)
+{
+  if(client->n_done == client->added->len)
+  {
+    inf_test_directory_benchmark_finish_one(client->benchmark);
+    return;
+  }
+
+  inf_browser_remove_node(
+    INF_BROWSER(client->browser),
+    &g_array_index(client->added, InfBrowserIter, client->n_done),
+    inf_test_directory_benchmark_remove_finished_cb,
+    client
+  );
+}
+
+static void
+inf_test_directory_benchmark_browser_notify_status_cb(GObject* object,
+                                                      GParamSpec* pspec,
+                                                      gpointer user_data)
+{
+  InfTestDirectoryBenchmarkClient* client;
+  InfBrowserStatus status;
+
+  client = (InfTestDirectoryBenchmarkClient*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_BROWSER_OPEN && !client->open)
+  {
+    client->open = TRUE;
+    inf_test_directory_benchmark_finish_one(client->benchmark);
+  }
+  else if(status == INF_BROWSER_CLOSED && client->benchmark->n_pending > 0)
+  {
+    fprintf(stderr, "Browser closed before the benchmark finished\n");
+    client->benchmark->failed = TRUE;
+    if(inf_standalone_io_loop_running(client->benchmark->io))
+      inf_standalone_io_loop_quit(client->benchmark->io);
+  }
+}
+
+static void
+inf_test_directory_benchmark_browser_error_cb(InfBrowser* browser,
+                                              const GError* error,
+                                              gpointer user_data)
+{
+  fprintf(stderr, "Browser error: %s\n", error->message);
+}
+
+/* Returns the time in nanoseconds of checking the permissions of the
+ * default account for one node. */
+static double
+inf_test_directory_benchmark_check_acl(InfBrowser* browser,
+                                       guint rounds)
+{
+  const InfAclAccount* account;
+  InfBrowserIter iter;
+  InfAclMask mask;
+  gboolean has_next;
+  guint64 n_checks;
+  gint64 begin;
+  guint i;
+
+  account = inf_browser_get_acl_default_account(browser);
+  n_checks = 0;
+  begin = g_get_monotonic_time();
+
+  for(i = 0; i < rounds; ++i)
+  {
+    /* Depth-first walk over all nodes, without recursion */
+    inf_browser_get_root(browser, &iter);
+    has_next = TRUE;
+    while(has_next)
+    {
+      inf_browser_check_acl(
+        browser,
+        &iter,
+        account->id,
+        &INF_ACL_MASK_ALL,
+        &mask
+      );
+
+      ++n_checks;
+
+      if(inf_browser_is_subdirectory(browser, &iter) &&
+         inf_browser_get_explored(browser, &iter) &&
+         inf_browser_get_child(browser, &iter))
+      {
+        continue;
+      }
+
+      while(!inf_browser_get_next(browser, &iter))
+      {
+        if(!inf_browser_get_parent(browser, &iter))
+        {
+          has_next = FALSE;
+          break;
+        }
+      }
+    }
+  }
+
+  if(n_checks == 0)
+    return 0.0;
+  return (g_get_monotonic_time() - begin) * 1000.0 / n_checks;
+}
+
+/* Changes the ACL of all top level directories, and returns the time in
+ * microseconds per change. */
+static double
+inf_test_directory_benchmark_set_acl(InfBrowser* browser)
+{
+  const InfAclAccount* account;
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  InfBrowserIter iter;
+  gboolean has_child;
+  guint n_changes;
+  gint64 begin;
+
+  account = inf_browser_get_acl_default_account(browser);
+
+  sheet_set = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(sheet_set, account->id);
+  inf_acl_mask_set1(&sheet->mask, INF_ACL_CAN_JOIN_USER);
+
+  n_changes = 0;
+  begin = g_get_monotonic_time();
+
+  inf_browser_get_root(browser, &iter);
+  for(has_child = inf_browser_get_child(browser, &iter);
+      has_child;
+      has_child = inf_browser_get_next(browser, &iter))
+  {
+    if(inf_browser_is_subdirectory(browser, &iter))
+    {
+      inf_browser_set_acl(browser, &iter, sheet_set, NULL, NULL);
+      ++n_changes;
+    }
+  }
+
+  inf_acl_sheet_set_free(sheet_set);
+
+  if(n_changes == 0)
+    return 0.0;
+  return (double)(g_get_monotonic_time() - begin) / n_changes;
+}
+
+static gint
+inf_test_directory_benchmark_latency_compare(gconstpointer first,
+                                             gconstpointer second)
+{
+  gint64 a;
+  gint64 b;
+
+  a = *(const gint64*)first;
+  b = *(const gint64*)second;
+  return (a > b) - (a < b);
+}
+
+static double
+inf_test_directory_benchmark_per_node(gint64 before,
+                                      gint64 after,
+                                      guint n_nodes)
+{
+  if(before < 0 || after < 0 || n_nodes == 0)
+    return -1.0;
+  return (double)(after - before) / n_nodes;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestDirectoryBenchmark benchmark;
+  InfTestDirectoryBenchmarkClient* client;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* server_manager;
+  InfCommunicationManager* client_manager;
+  InfBrowserIter root;
+  gchar* root_directory;
+  GError* error;
+  GSList* item;
+  gboolean tabular;
+  guint depth;
+  guint width;
+  guint n_documents;
+  guint n_rounds;
+  guint n_nodes;
+  guint i;
+  int arg;
+
+  gint64 begin;
+  gint64 rss_begin;
+  gint64 rss_end;
+  double load_seconds;
+  double server_bytes_per_node;
+  double explore_seconds;
+  double avg_latency;
+  gint64 p99_latency;
+  double client_bytes_per_node;
+  double adds_per_sec;
+  double removes_per_sec;
+  double check_acl_ns;
+  double set_acl_us;
+
+  depth = 3;
+  width = 10;
+  n_documents = 10;
+  n_rounds = 10;
+  benchmark.n_clients = 4;
+  benchmark.n_operations = 100;
+  tabular = FALSE;
+
+  for(arg = 1; arg < argc; ++arg)
+  {
+    if(strcmp(argv[arg], "-d") == 0 && arg + 1 < argc)
+      depth = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-w") == 0 && arg + 1 < argc)
+      width = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+      n_documents = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+      benchmark.n_clients = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+      benchmark.n_operations = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-r") == 0 && arg + 1 < argc)
+      n_rounds = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-t") == 0)
+      tabular = TRUE;
+    else
+      break;
+  }
+
+  if(arg < argc || depth == 0 || benchmark.n_clients == 0)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [-d <depth>] [-w <width>] [-n <documents>] "
+      "[-c <clients>] [-o <operations>] [-r <rounds>] [-t]\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  root_directory =
+    g_dir_make_tmp("inf-test-directory-benchmark-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  storage = infd_filesystem_storage_new(root_directory);
+
+  begin = g_get_monotonic_time();
+  n_nodes = inf_test_directory_benchmark_generate(
+    storage,
+    "",
+    depth,
+    width,
+    n_documents,
+    &error
+  );
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to generate tree: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(storage);
+    inf_test_directory_benchmark_remove_tree(root_directory);
+    g_free(root_directory);
+    return -1;
+  }
+
+  if(!tabular)
+  {
+    fprintf(
+      stderr,
+      "generated %u nodes in %.3f s\n",
+      n_nodes,
+      (g_get_monotonic_time() - begin) / 1000000.0
+    );
+  }
+
+  benchmark.io = inf_standalone_io_new();
+  benchmark.clients = NULL;
+  benchmark.n_open = 0;
+  benchmark.n_pending = 0;
+  benchmark.failed = FALSE;
+  benchmark.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+  server_manager = inf_communication_manager_new();
+  client_manager = inf_communication_manager_new();
+
+  benchmark.directory = infd_directory_new(
+    INF_IO(benchmark.io),
+    INFD_STORAGE(storage),
+    server_manager
+  );
+
+  /* Phase 1: Load the whole tree into the server */
+  rss_begin = inf_test_directory_benchmark_get_rss();
+  begin = g_get_monotonic_time();
+
+  inf_browser_get_root(INF_BROWSER(benchmark.directory), &root);
+  inf_test_directory_benchmark_explore(
+    &benchmark,
+    INF_BROWSER(benchmark.directory),
+    &root
+  );
+
+  inf_test_directory_benchmark_wait(&benchmark);
+
+  load_seconds = (g_get_monotonic_time() - begin) / 1000000.0;
+  rss_end = inf_test_directory_benchmark_get_rss();
+  server_bytes_per_node =
+    inf_test_directory_benchmark_per_node(rss_begin, rss_end, n_nodes);
+
+  /* The latencies of the server's own explores are not interesting */
+  g_array_set_size(benchmark.latencies, 0);
+
+  /* Connect the clients */
+  for(i = 0; i < benchmark.n_clients && !benchmark.failed; ++i)
+  {
+    client = g_slice_new(InfTestDirectoryBenchmarkClient);
+    client->benchmark = &benchmark;
+    client->index = i;
+    client->open = FALSE;
+    client->added = g_array_new(FALSE, FALSE, sizeof(InfBrowserIter));
+    client->n_done = 0;
+
+    client->server_connection =
+      inf_simulated_connection_new_with_io(INF_IO(benchmark.io));
+    client->client_connection =
+      inf_simulated_connection_new_with_io(INF_IO(benchmark.io));
+
+    inf_simulated_connection_set_mode(
+      client->server_connection,
+      INF_SIMULATED_CONNECTION_IO_CONTROLLED
+    );
+
+    inf_simulated_connection_set_mode(
+      client->client_connection,
+      INF_SIMULATED_CONNECTION_IO_CONTROLLED
+    );
+
+    inf_simulated_connection_connect(
+      client->server_connection,
+      client->client_connection
+    );
+
+    client->browser = infc_browser_new(
+      INF_IO(benchmark.io),
+      client_manager,
+      INF_XML_CONNECTION(client->client_connection)
+    );
+
+    g_signal_connect(
+      G_OBJECT(client->browser),
+      "notify::status",
+      G_CALLBACK(inf_test_directory_benchmark_browser_notify_status_cb),
+      client
+    );
+
+    g_signal_connect(
+      G_OBJECT(client->browser),
+      "error",
+      G_CALLBACK(inf_test_directory_benchmark_browser_error_cb),
+      &benchmark
+    );
+
+    benchmark.clients = g_slist_prepend(benchmark.clients, client);
+
+    ++benchmark.n_pending;
+    infd_directory_add_connection(
+      benchmark.directory,
+      INF_XML_CONNECTION(client->server_connection)
+    );
+  }
+
+  inf_test_directory_benchmark_wait(&benchmark);
+
+  /* Phase 2: Explore the whole tree with all clients */
+  rss_begin = inf_test_directory_benchmark_get_rss();
+  begin = g_get_monotonic_time();
+
+  for(item = benchmark.clients; item != NULL; item = item->next)
+  {
+    client = (InfTestDirectoryBenchmarkClient*)item->data;
+
+    inf_browser_get_root(INF_BROWSER(client->browser), &root);
+    inf_test_directory_benchmark_explore(
+      &benchmark,
+      INF_BROWSER(client->browser),
+      &root
+    );
+  }
+
+  inf_test_directory_benchmark_wait(&benchmark);
+
+  explore_seconds = (g_get_monotonic_time() - begin) / 1000000.0;
+  rss_end = inf_test_directory_benchmark_get_rss();
+  client_bytes_per_node = inf_test_directory_benchmark_per_node(
+    rss_begin,
+    rss_end,
+    n_nodes * benchmark.n_clients
+  );
+
+  /* Phase 3: Add nodes with all clients */
+  begin = g_get_monotonic_time();
+
+  for(item = benchmark.clients; item != NULL; item = item->next)
+  {
+    ++benchmark.n_pending;
+    inf_test_directory_benchmark_add_next(item->data);
+  }
+
+  inf_test_directory_benchmark_wait(&benchmark);
+
+  adds_per_sec = 0.0;
+  if(g_get_monotonic_time() > begin)
+  {
+    adds_per_sec = benchmark.n_operations * benchmark.n_clients * 1000000.0 /
+      (g_get_monotonic_time() - begin);
+  }
+
+  /* Phase 4: Remove them again */
+  begin = g_get_monotonic_time();
+
+  for(item = benchmark.clients; item != NULL; item = item->next)
+  {
+    ++benchmark.n_pending;
+    inf_test_directory_benchmark_remove_next(item->data);
+  }
+
+  inf_test_directory_benchmark_wait(&benchmark);
+
+  removes_per_sec = 0.0;
+  if(g_get_monotonic_time() > begin)
+  {
+    removes_per_sec = benchmark.n_operations * benchmark.n_clients *
+      1000000.0 / (g_get_monotonic_time() - begin);
+  }
+
+  /* Phase 5: ACL checks and changes on the server */
+  check_acl_ns = inf_test_directory_benchmark_check_acl(
+    INF_BROWSER(benchmark.directory),
+    n_rounds
+  );
+
+  set_acl_us = inf_test_directory_benchmark_set_acl(
+    INF_BROWSER(benchmark.directory)
+  );
+
+  if(!benchmark.failed)
+  {
+    avg_latency = 0.0;
+    p99_latency = 0;
+
+    if(benchmark.latencies->len > 0)
+    {
+      for(i = 0; i < benchmark.latencies->len; ++i)
+        avg_latency += g_array_index(benchmark.latencies, gint64, i);
+      avg_latency /= benchmark.latencies->len;
+
+      g_array_sort(
+        benchmark.latencies,
+        inf_test_directory_benchmark_latency_compare
+      );
+
+      p99_latency = g_array_index(
+        benchmark.latencies,
+        gint64,
+        (guint)((benchmark.latencies->len - 1) * 0.99)
+      );
+    }
+
+    if(tabular)
+    {
+      printf(
+        "%u\t%u\t%u\t%u\t%u\t%.3f\t%.3f\t%.1f\t%" G_GINT64_FORMAT
+        "\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n",
+        depth,
+        width,
+        n_documents,
+        benchmark.n_clients,
+        n_nodes,
+        load_seconds,
+        explore_seconds,
+        avg_latency,
+        p99_latency,
+        adds_per_sec,
+        removes_per_sec,
+        check_acl_ns,
+        set_acl_us,
+        server_bytes_per_node,
+        client_bytes_per_node
+      );
+    }
+    else
+    {
+      fprintf(
+        stderr,
+        "load: %u nodes in %.3f s, %.1f bytes per node\n"
+        "explore: %u clients in %.3f s, latency avg %.1f us, "
+        "p99 %" G_GINT64_FORMAT " us, %.1f bytes per node and client\n"
+        "add: %.1f nodes/s\n"
+        "remove: %.1f nodes/s\n"
+        "acl: %.1f ns per check, %.1f us per change\n",
+        n_nodes,
+        load_seconds,
+        server_bytes_per_node,
+        benchmark.n_clients,
+        explore_seconds,
+        avg_latency,
+        p99_latency,
+        client_bytes_per_node,
+        adds_per_sec,
+        removes_per_sec,
+        check_acl_ns,
+        set_acl_us
+      );
+    }
+  }
+
+  for(item = benchmark.clients; item != NULL; item = item->next)
+  {
+    client = (InfTestDirectoryBenchmarkClient*)item->data;
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(client->browser),
+      G_CALLBACK(inf_test_directory_benchmark_browser_notify_status_cb),
+      client
+    );
+
+    inf_xml_connection_close(INF_XML_CONNECTION(client->server_connection));
+    g_object_unref(client->browser);
+    g_object_unref(client->server_connection);
+    g_object_unref(client->client_connection);
+    g_array_free(client->added, TRUE);
+    g_slice_free(InfTestDirectoryBenchmarkClient, client);
+  }
+
+  g_slist_free(benchmark.clients);
+  g_array_free(benchmark.latencies, TRUE);
+
+  g_object_unref(benchmark.directory);
+  g_object_unref(server_manager);
+  g_object_unref(client_manager);
+  g_object_unref(storage);
+  g_object_unref(benchmark.io);
+
+  inf_test_directory_benchmark_remove_tree(root_directory);
+  g_free(root_directory);
+
+  return benchmark.failed ? -1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -18,7 +18,9 @@
  */
 
 /* Cuts away front and back of a replay, so that it still fails. It's very
- * primitive, and more sophisticated methods can still be implemented. */
+ * primitive, and more sophisticated methods can still be implemented.
+ * Candidate reductions are tested in parallel, by default with one replay
+ * process per processor. */
 
 /* TODO: Break as soon as either (stderr) output or exit status changes */
 
@@ -40,6 +42,23 @@
 
 static const gchar REPLAY[] = ".libs/inf-test-text-replay";
 
+/* A reduced record that is waiting to be tested */
+typedef struct _InfTestReduceReplayCandidate InfTestReduceReplayCandidate;
+struct _InfTestReduceReplayCandidate {
+  xmlDocPtr doc;
+  guint step;
+};
+
+/* A test that is being run in a child process */
+typedef struct _InfTestReduceReplayTest InfTestReduceReplayTest;
+struct _InfTestReduceReplayTest {
+  gchar* filename;
+  GPid pid;
+  gboolean passed;
+  GMainLoop* loop;
+  guint* n_running;
+};
+
 typedef struct _InfTestReduceReplayValidateUserData
   InfTestReduceReplayValidateUserData;
 struct _InfTestReduceReplayValidateUserData {
@@ -374,51 +393,19 @@ inf_test_reduce_replay_validate_test(xmlDocPtr doc,
 }
 
 static gboolean
-inf_test_reduce_replay_run_test(xmlDocPtr doc)
+inf_test_reduce_replay_test_passed(gint status)
 {
-  GError* error;
-  gchar* cmd;
-  gchar* stdout_buf;
-  gchar* stderr_buf;
-  int ret;
-
-  xmlSaveFile("test.xml", doc);
-  /*cmd = g_strdup_printf("(%s %s 2>&1) > /dev/null", REPLAY, "test.xml");*/
-  cmd = g_strdup_printf("%s %s", REPLAY, "test.xml");
-
-  /* make it die on algorithm errors */
-  g_setenv("G_DEBUG", "fatal-warnings", TRUE);
-
-  error = NULL;
-  if(!g_spawn_command_line_sync(cmd, &stdout_buf, &stderr_buf, &ret, &error))
-  {
-    g_unlink("test.xml");
-    g_free(cmd);
-    fprintf(stderr, "Failed to run test: %s\n", error->message);
-    g_error_free(error);
-    return FALSE;
-  }
-
-  /* Reset, so that we don't die ourselves */
-  g_setenv("G_DEBUG", "", TRUE);
-
-  /* These are just dummy variables to suppress the console output */
-  g_free(stdout_buf);
-  g_free(stderr_buf);
-
-  /*g_unlink("test.xml");*/
-
 #ifndef G_OS_WIN32
-  if(WIFSIGNALED(ret) &&
-     (WTERMSIG(ret) == SIGABRT ||
-      WTERMSIG(ret) == SIGSEGV ||
-      WTERMSIG(ret) == SIGTRAP))
+  if(WIFSIGNALED(status) &&
+     (WTERMSIG(status) == SIGABRT ||
+      WTERMSIG(status) == SIGSEGV ||
+      WTERMSIG(status) == SIGTRAP))
   {
     return FALSE;
   }
-  else if(WIFEXITED(ret))
+  else if(WIFEXITED(status))
   {
-    if(WEXITSTATUS(ret))
+    if(WEXITSTATUS(status))
       return FALSE;
     else
       return TRUE;
@@ -431,6 +418,179 @@ inf_test_reduce_replay_run_test(xmlDocPtr doc)
   }
 }
 
+static void
+inf_test_reduce_replay_child_watch_func(GPid pid,
+                                        gint status,
+                                        gpointer user_data)
+{
+  InfTestReduceReplayTest* test;
+  test = (InfTestReduceReplayTest*)user_data;
+
+  test->passed = inf_test_reduce_replay_test_passed(status);
+  g_spawn_close_pid(pid);
+
+  g_assert(*test->n_running > 0);
+  if(--*test->n_running == 0)
+    g_main_loop_quit(test->loop);
+}
+
+/* Runs the replay tool for all of the n_docs documents at the same time,
+ * each in its own process, and returns the index of the first document for
+ * which it succeeds, or -1 if it fails for all of them. */
+static gint
+inf_test_reduce_replay_run_tests(xmlDocPtr* docs,
+                                 guint n_docs)
+{
+  InfTestReduceReplayTest* tests;
+  GMainLoop* loop;
+  GError* error;
+  gchar** envp;
+  gchar* argv[3];
+  guint n_running;
+  gint passed;
+  guint i;
+
+  tests = g_new(InfTestReduceReplayTest, n_docs);
+  loop = g_main_loop_new(NULL, FALSE);
+  n_running = 0;
+
+  /* make it die on algorithm errors */
+  envp = g_environ_setenv(g_get_environ(), "G_DEBUG", "fatal-warnings", TRUE);
+
+  for(i = 0; i < n_docs; ++i)
+  {
+    tests[i].filename = g_strdup_printf("test-%u.xml", i);
+    tests[i].passed = FALSE;
+    tests[i].loop = loop;
+    tests[i].n_running = &n_running;
+
+    xmlSaveFile(tests[i].filename, docs[i]);
+
+    argv[0] = (gchar*)REPLAY;
+    argv[1] = tests[i].filename;
+    argv[2] = NULL;
+
+    /* The output is not needed, so don't show it on the console */
+    error = NULL;
+    if(!g_spawn_async(NULL, argv, envp,
+                      G_SPAWN_DO_NOT_REAP_CHILD |
+                      G_SPAWN_STDOUT_TO_DEV_NULL |
+                      G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, &tests[i].pid, &error))
+    {
+      fprintf(stderr, "Failed to run test: %s\n", error->message);
+      g_error_free(error);
+    }
+    else
+    {
+      ++n_running;
+      g_child_watch_add(
+        tests[i].pid,
+        inf_test_reduce_replay_child_watch_func,
+        &tests[i]
+      );
+    }
+  }
+
+  if(n_running > 0)
+    g_main_loop_run(loop);
+
+  passed = -1;
+  for(i = 0; i < n_docs; ++i)
+  {
+    if(passed == -1 && tests[i].passed)
+      passed = i;
+    /*g_unlink(tests[i].filename);*/
+    g_free(tests[i].filename);
+  }
+
+  g_strfreev(envp);
+  g_main_loop_unref(loop);
+  g_free(tests);
+  return passed;
+}
+
+static gboolean
+inf_test_reduce_replay_run_test(xmlDocPtr doc)
+{
+  return inf_test_reduce_replay_run_tests(&doc, 1) == 0;
+}
+
+/* Tests all candidates in the queue and empties it. Candidates up to the
+ * first one for which the test succeeds are reported, and the last of them
+ * that still fails becomes last_fail. Returns whether the test succeeded
+ * for any of them. */
+static gboolean
+inf_test_reduce_replay_run_queue(GArray* queue,
+                                 xmlDocPtr* last_fail)
+{
+  InfTestReduceReplayCandidate* candidate;
+  xmlDocPtr* docs;
+  gint passed;
+  guint i;
+
+  if(queue->len == 0)
+    return FALSE;
+
+  docs = g_new(xmlDocPtr, queue->len);
+  for(i = 0; i < queue->len; ++i)
+    docs[i] = g_array_index(queue, InfTestReduceReplayCandidate, i).doc;
+
+  passed = inf_test_reduce_replay_run_tests(docs, queue->len);
+  g_free(docs);
+
+  for(i = 0; i < queue->len; ++i)
+  {
+    candidate = &g_array_index(queue, InfTestReduceReplayCandidate, i);
+
+    if(passed == -1 || i <= (guint)passed)
+    {
+      fprintf(
+        stderr,
+        "%.6u... %s\n",
+        candidate->step,
+        i == (guint)passed ? "OK!" : "FAIL"
+      );
+    }
+
+    if(passed == -1 || i < (guint)passed)
+    {
+      xmlFreeDoc(*last_fail);
+      *last_fail = candidate->doc;
+    }
+    else
+    {
+      xmlFreeDoc(candidate->doc);
+    }
+  }
+
+  g_array_set_size(queue, 0);
+  return passed != -1;
+}
+
+/* Adds a candidate to the queue, and tests the whole queue once it contains
+ * one candidate per job. */
+static gboolean
+inf_test_reduce_replay_enqueue(GArray* queue,
+                               guint jobs,
+                               xmlDocPtr doc,
+                               guint step,
+                               xmlDocPtr* last_fail)
+{
+  InfTestReduceReplayCandidate candidate;
+
+  candidate.doc = xmlCopyDoc(doc, 1);
+  candidate.step = step;
+  g_array_append_val(queue, candidate);
+
+  fprintf(stderr, "QUEUED\n");
+
+  if(queue->len < jobs)
+    return FALSE;
+
+  return inf_test_reduce_replay_run_queue(queue, last_fail);
+}
+
 static void
 inf_test_reduce_replay_remove_sync_requests(xmlNodePtr initial)
 {
@@ -468,16 +628,38 @@ inf_test_reduce_replay_remove_sync_requests(xmlNodePtr initial)
   inf_xml_util_set_attribute_uint(sync_begin, "num-messages", count);
 }
 
+/* Checkpoints would no longer match the record once requests are removed,
+ * and InfAdoptedSessionReplay skips them when playing sequentially. */
+static void
+inf_test_reduce_replay_remove_checkpoints(xmlNodePtr root)
+{
+  xmlNodePtr child;
+  xmlNodePtr next;
+
+  for(child = inf_test_reduce_replay_first_node(root->children);
+      child != NULL; child = next)
+  {
+    next = inf_test_reduce_replay_next_node(child);
+    if(strcmp((const char*)child->name, "checkpoint") == 0)
+    {
+      xmlUnlinkNode(child);
+      xmlFreeNode(child);
+    }
+  }
+}
+
 static gboolean
 inf_test_reduce_replay_reduce(xmlDocPtr doc,
                               const char* filename,
-                              guint skip)
+                              guint skip,
+                              guint jobs)
 {
   InfAdoptedSessionReplay* local_replay;
   InfAdoptedSession* session;
   InfSessionClass* session_class;
   xmlDocPtr last_fail;
   xmlDocPtr back_doc;
+  GArray* queue;
   gboolean result;
 
   xmlNodePtr root;
@@ -490,6 +672,8 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
 
   error = NULL;
   root = xmlDocGetRootElement(doc);
+  inf_test_reduce_replay_remove_checkpoints(root);
+
   if(inf_test_reduce_replay_run_test(doc) == TRUE)
   {
     fprintf(stderr, "Test does not initially fail\n");
@@ -540,6 +724,11 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
     return FALSE;
   }
 
+  /* Candidates are generated in order, and tested in batches of one per
+   * job. The first candidate for which the test passes ends the reduction,
+   * just as if they had been tested one after another. */
+  queue = g_array_new(FALSE, FALSE, sizeof(InfTestReduceReplayCandidate));
+
   last_fail = xmlCopyDoc(doc, 1);
   request = inf_test_reduce_replay_next_node(initial);
 
@@ -596,18 +785,12 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
             /* Simply continue */
             fprintf(stderr, "SKIP\n");
           }
-          else if(inf_test_reduce_replay_run_test(doc))
+          else if(inf_test_reduce_replay_enqueue(queue, jobs, doc, i,
+                                                 &last_fail))
           {
-            fprintf(stderr, "OK!\n");
             result = TRUE;
             break;
           }
-          else
-          {
-            fprintf(stderr, "FAIL\n");
-            xmlFreeDoc(last_fail);
-            last_fail = xmlCopyDoc(doc, 1);
-          }
         }
         else
         {
@@ -622,6 +805,14 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
     }
     else
     {
+      /* The candidates that are still queued come before the end */
+      if(inf_test_reduce_replay_run_queue(queue, &last_fail))
+      {
+        if(error) g_error_free(error);
+        result = TRUE;
+        break;
+      }
+
       if(error)
       {
         fprintf(stderr, "Playing local replay failed: %s\n", error->message);
@@ -680,18 +871,12 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
           /* Simply continue */
           fprintf(stderr, "SKIP\n");
         }
-        else if(inf_test_reduce_replay_run_test(back_doc))
+        else if(inf_test_reduce_replay_enqueue(queue, jobs, back_doc, i,
+                                               &last_fail))
         {
-          fprintf(stderr, "OK!\n");
           result = TRUE;
           break;
         }
-        else
-        {
-          fprintf(stderr, "FAIL\n");
-          xmlFreeDoc(last_fail);
-          last_fail = xmlCopyDoc(back_doc, 1);
-        }
       }
       else
       {
@@ -699,7 +884,7 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
         g_error_free(error);
         error = NULL;
 
-        result = FALSE;
+        result = inf_test_reduce_replay_run_queue(queue, &last_fail);
         break;
       }
     }
@@ -707,6 +892,8 @@ inf_test_reduce_replay_reduce(xmlDocPtr doc,
     xmlFreeDoc(back_doc);
   }
 
+  g_array_free(queue, TRUE);
+
   /* Save last failing record in each case */
   xmlSaveFile("last_fail.record.xml", last_fail);
   printf("Last failing record in last_fail.record.xml\n");
@@ -720,6 +907,7 @@ int main(int argc, char* argv[])
   xmlDocPtr doc;
   gboolean ret;
   guint skip;
+  guint jobs;
 
   if(!inf_init(&error))
   {
@@ -735,7 +923,7 @@ int main(int argc, char* argv[])
 
   if(argc < 2)
   {
-    fprintf(stderr, "Usage: %s <record-file> [<skip>]\n", argv[0]);
+    fprintf(stderr, "Usage: %s <record-file> [<skip> [<jobs>]]\n", argv[0]);
     return -1;
   }
 
@@ -750,7 +938,11 @@ int main(int argc, char* argv[])
   skip = 1;
   if(argc > 2) skip = strtol(argv[2], NULL, 10);
 
-  ret = inf_test_reduce_replay_reduce(doc, argv[1], skip);
+  jobs = g_get_num_processors();
+  if(argc > 3) jobs = strtol(argv[3], NULL, 10);
+  if(jobs == 0) jobs = 1;
+
+  ret = inf_test_reduce_replay_reduce(doc, argv[1], skip, jobs);
 
   xmlFreeDoc(doc);
   return ret ? 0 : -1;
@@ -0,0 +1,527 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Subscribes two connections to an InfdSessionProxy for a text session.
+ * Alice joins via the first and Bob via the second one, so that they get
+ * the user IDs 1 and 2. The requests that the proxy relays to Bob's
+ * connection are recorded as "<user>/<operation>/<time>;", where the
+ * operation contains the caret position of a move or the text of an
+ * insertion. */
+
+typedef struct _TestProxyClient TestProxyClient;
+struct _TestProxyClient {
+  InfCommunicationManager* manager;
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+  InfCommunicationJoinedGroup* group;
+};
+
+typedef struct _TestProxy TestProxy;
+struct _TestProxy {
+  const gchar* name;
+
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfTextSession* session;
+  InfdSessionProxy* proxy;
+
+  TestProxyClient alice;
+  TestProxyClient bob;
+
+  /* Requests relayed to Bob */
+  GString* relayed;
+  gboolean failed;
+};
+
+static void
+test_proxy_received_cb(InfXmlConnection* connection,
+                       xmlNodePtr xml,
+                       gpointer user_data)
+{
+  TestProxy* test;
+  xmlNodePtr child;
+  xmlNodePtr op;
+  xmlChar* user;
+  xmlChar* time;
+  xmlChar* content;
+
+  test = (TestProxy*)user_data;
+
+  /* Several messages can be sent in one group container */
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "request") != 0) continue;
+
+    for(op = child->children; op != NULL; op = op->next)
+      if(op->type == XML_ELEMENT_NODE)
+        break;
+
+    user = xmlGetProp(child, (const xmlChar*)"user");
+    time = xmlGetProp(child, (const xmlChar*)"time");
+
+    g_string_append_printf(
+      test->relayed,
+      "%s/%s",
+      user != NULL ? (const char*)user : "",
+      op != NULL ? (const char*)op->name : ""
+    );
+
+    if(op != NULL && strcmp((const char*)op->name, "move") == 0)
+    {
+      content = xmlGetProp(op, (const xmlChar*)"caret");
+      g_string_append_printf(test->relayed, ":%s", (const char*)content);
+      xmlFree(content);
+    }
+    else if(op != NULL && strcmp((const char*)op->name, "insert") == 0)
+    {
+      content = xmlNodeGetContent(op);
+      g_string_append_printf(test->relayed, ":%s", (const char*)content);
+      xmlFree(content);
+    }
+
+    g_string_append_printf(
+      test->relayed,
+      "/%s;",
+      time != NULL ? (const char*)time : ""
+    );
+
+    if(user != NULL) xmlFree(user);
+    if(time != NULL) xmlFree(time);
+  }
+}
+
+static void
+test_proxy_client_init(TestProxy* test,
+                       TestProxyClient* client,
+                       guint seq_id)
+{
+  client->manager = inf_communication_manager_new();
+  client->server_connection = inf_simulated_connection_new();
+  client->client_connection = inf_simulated_connection_new();
+
+  inf_simulated_connection_connect(
+    client->server_connection,
+    client->client_connection
+  );
+
+  infd_session_proxy_subscribe_to(
+    test->proxy,
+    INF_XML_CONNECTION(client->server_connection),
+    seq_id,
+    FALSE
+  );
+
+  client->group = inf_communication_manager_join_group(
+    client->manager,
+    "InfSession_Test",
+    INF_XML_CONNECTION(client->client_connection),
+    "central"
+  );
+}
+
+static void
+test_proxy_client_deinit(TestProxyClient* client)
+{
+  g_object_unref(client->group);
+  g_object_unref(client->client_connection);
+  g_object_unref(client->server_connection);
+  g_object_unref(client->manager);
+}
+
+static void
+test_proxy_send(TestProxyClient* client,
+                xmlNodePtr xml)
+{
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(client->group),
+    INF_XML_CONNECTION(client->client_connection),
+    xml
+  );
+}
+
+static void
+test_proxy_join(TestProxyClient* client,
+                const gchar* name)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"user-join");
+  inf_xml_util_set_attribute(xml, "name", name);
+  inf_xml_util_set_attribute(xml, "time", "");
+  inf_xml_util_set_attribute_uint(xml, "caret", 0);
+  inf_xml_util_set_attribute_int(xml, "selection", 0);
+  inf_xml_util_set_attribute_double(xml, "hue", 0.5);
+
+  test_proxy_send(client, xml);
+}
+
+/* Sends a request of the given user, with time relative to the vector of
+ * the user. If text is NULL, the request moves the caret to pos, otherwise
+ * it inserts text at pos. */
+static void
+test_proxy_request(TestProxyClient* client,
+                   guint user,
+                   const gchar* time,
+                   guint pos,
+                   const gchar* text)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute_uint(xml, "user", user);
+  inf_xml_util_set_attribute(xml, "time", time);
+
+  if(text == NULL)
+  {
+    child = xmlNewChild(xml, NULL, (const xmlChar*)"move", NULL);
+    inf_xml_util_set_attribute_uint(child, "caret", pos);
+    inf_xml_util_set_attribute_int(child, "selection", 0);
+  }
+  else
+  {
+    child = xmlNewChild(
+      xml,
+      NULL,
+      (const xmlChar*)"insert",
+      (const xmlChar*)text
+    );
+
+    inf_xml_util_set_attribute_uint(child, "pos", pos);
+  }
+
+  test_proxy_send(client, xml);
+}
+
+static void
+test_proxy_init(TestProxy* test,
+                const gchar* name)
+{
+  static const gchar* const methods[] = { "central", NULL };
+  InfTextBuffer* buffer;
+
+  test->name = name;
+  test->failed = FALSE;
+  test->relayed = g_string_new(NULL);
+
+  test->io = inf_standalone_io_new();
+  test->manager = inf_communication_manager_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  test->session = inf_text_session_new(
+    test->manager,
+    buffer,
+    INF_IO(test->io),
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(buffer);
+
+  test->group = inf_communication_manager_open_group(
+    test->manager,
+    "InfSession_Test",
+    methods
+  );
+
+  test->proxy = INFD_SESSION_PROXY(
+    g_object_new(
+      INFD_TYPE_SESSION_PROXY,
+      "io", test->io,
+      "session", test->session,
+      "subscription-group", test->group,
+      NULL
+    )
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->group),
+    INF_COMMUNICATION_OBJECT(test->proxy)
+  );
+
+  test_proxy_client_init(test, &test->alice, 1);
+  test_proxy_client_init(test, &test->bob, 2);
+
+  g_signal_connect(
+    G_OBJECT(test->bob.client_connection),
+    "received",
+    G_CALLBACK(test_proxy_received_cb),
+    test
+  );
+
+  test_proxy_join(&test->alice, "Alice");
+  test_proxy_join(&test->bob, "Bob");
+}
+
+static void
+test_proxy_deinit(TestProxy* test)
+{
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->group),
+    NULL
+  );
+
+  g_object_unref(test->proxy);
+  g_object_unref(test->group);
+  g_object_unref(test->session);
+
+  test_proxy_client_deinit(&test->bob);
+  test_proxy_client_deinit(&test->alice);
+
+  g_object_unref(test->manager);
+  g_object_unref(test->io);
+  g_string_free(test->relayed, TRUE);
+}
+
+/* Runs the main loop for the given number of milliseconds, so that the
+ * proxy's timeouts can elapse. */
+static void
+test_proxy_run(TestProxy* test,
+               guint msecs)
+{
+  gint64 end;
+  gint64 now;
+
+  end = g_get_monotonic_time() + (gint64)msecs * 1000;
+  while((now = g_get_monotonic_time()) < end)
+    inf_standalone_io_iteration_timeout(test->io, (end - now + 999) / 1000);
+}
+
+static void
+test_proxy_check_relayed(TestProxy* test,
+                         const gchar* when,
+                         const gchar* expected)
+{
+  if(strcmp(test->relayed->str, expected) != 0)
+  {
+    printf(
+      "%s: %s, relayed requests are \"%s\" instead of \"%s\"\n",
+      test->name,
+      when,
+      test->relayed->str,
+      expected
+    );
+
+    test->failed = TRUE;
+  }
+}
+
+static void
+test_proxy_check_buffer(TestProxy* test,
+                        const gchar* expected)
+{
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(test->session)));
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  if(bytes != strlen(expected) || strncmp(text, expected, bytes) != 0)
+  {
+    printf(
+      "%s: buffer is \"%.*s\" instead of \"%s\"\n",
+      test->name,
+      (int)bytes,
+      text,
+      expected
+    );
+
+    test->failed = TRUE;
+  }
+
+  g_free(text);
+  inf_text_chunk_free(chunk);
+}
+
+/* Caret moves of Alice are held back for InfdSessionProxy:coalesce-interval,
+ * which is left at its default. A move that is superseded by another one in
+ * that time is dropped, and the time of the one that is relayed covers the
+ * requests that Alice has seen for both of them. A request that affects the
+ * buffer relays the move right away, in front of itself. */
+static gboolean
+test_proxy_coalesce(void)
+{
+  TestProxy test;
+
+  test_proxy_init(&test, "coalesce");
+
+  test_proxy_request(&test.bob, 2, "", 0, "XYZ");
+  test_proxy_request(&test.alice, 1, "2:1", 1, NULL);
+  test_proxy_request(&test.alice, 1, "", 2, NULL);
+  test_proxy_check_relayed(&test, "before the interval elapsed", "");
+
+  test_proxy_run(&test, 500);
+  test_proxy_check_relayed(&test, "after the interval", "1/move:2/2:1;");
+
+  test_proxy_request(&test.alice, 1, "", 3, NULL);
+  test_proxy_request(&test.alice, 1, "", 0, "!");
+
+  test_proxy_check_relayed(
+    &test,
+    "after an insertion",
+    "1/move:2/2:1;1/move:3/;1/insert:!/;"
+  );
+
+  test_proxy_check_buffer(&test, "!XYZ");
+  test_proxy_deinit(&test);
+
+  return !test.failed;
+}
+
+/* With InfdSessionProxy:rate-limit, only the first of Alice's insertions is
+ * processed right away. The others are held back and processed, and
+ * relayed, in the order in which they were received. */
+static gboolean
+test_proxy_rate_limit(void)
+{
+  TestProxy test;
+
+  test_proxy_init(&test, "rate-limit");
+  g_object_set(
+    G_OBJECT(test.proxy),
+    "rate-limit", 50,
+    "rate-burst", 1,
+    NULL
+  );
+
+  test_proxy_request(&test.alice, 1, "", 0, "a");
+  test_proxy_request(&test.alice, 1, "", 1, "b");
+  test_proxy_request(&test.alice, 1, "", 2, "c");
+
+  test_proxy_check_relayed(&test, "right away", "1/insert:a/;");
+  test_proxy_check_buffer(&test, "a");
+
+  if(infd_session_proxy_get_held_back_bytes(
+       test.proxy,
+       INF_XML_CONNECTION(test.alice.server_connection)) == 0)
+  {
+    printf("%s: no messages are held back\n", test.name);
+    test.failed = TRUE;
+  }
+
+  test_proxy_run(&test, 500);
+
+  test_proxy_check_relayed(
+    &test,
+    "later",
+    "1/insert:a/;1/insert:b/;1/insert:c/;"
+  );
+
+  test_proxy_check_buffer(&test, "abc");
+
+  if(infd_session_proxy_get_held_back_bytes(
+       test.proxy,
+       INF_XML_CONNECTION(test.alice.server_connection)) != 0)
+  {
+    printf("%s: messages are still held back\n", test.name);
+    test.failed = TRUE;
+  }
+
+  test_proxy_deinit(&test);
+  return !test.failed;
+}
+
+/* Messages that are held back when Alice's connection is unsubscribed are
+ * discarded, and never processed. */
+static gboolean
+test_proxy_rate_limit_unsubscribe(void)
+{
+  TestProxy test;
+
+  test_proxy_init(&test, "rate-limit-unsubscribe");
+  g_object_set(
+    G_OBJECT(test.proxy),
+    "rate-limit", 50,
+    "rate-burst", 1,
+    NULL
+  );
+
+  test_proxy_request(&test.alice, 1, "", 0, "a");
+  test_proxy_request(&test.alice, 1, "", 1, "b");
+  test_proxy_request(&test.alice, 1, "", 2, "c");
+
+  infd_session_proxy_unsubscribe(
+    test.proxy,
+    INF_XML_CONNECTION(test.alice.server_connection)
+  );
+
+  test_proxy_run(&test, 200);
+
+  test_proxy_check_relayed(&test, "after unsubscription", "1/insert:a/;");
+  test_proxy_check_buffer(&test, "a");
+
+  test_proxy_deinit(&test);
+  return !test.failed;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_proxy_coalesce()) ++passed;
+  ++total;
+  if(test_proxy_rate_limit()) ++passed;
+  ++total;
+  if(test_proxy_rate_limit_unsubscribe()) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -19,6 +19,8 @@
 
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-user.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
@@ -50,7 +52,7 @@ static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
 #define apply(op, args) inf_adopted_state_vector_##op args
 
 static void l_test() {
-  InfAdoptedStateVector* vec, * vec_;
+  InfAdoptedStateVector* vec, * vec_, * vec__;
   int i;
   char* str;
 
@@ -111,6 +113,22 @@ static void l_test() {
   cmp("1:13", vec_);
   apply(free, (vec_));
 
+  vec_ = apply(from_string, ("1:10;3:5;7:2", NULL));
+  vec__ = apply(from_string_diff, ("2:4;3:1;9:3", vec_, NULL));
+  g_assert(vec__ != NULL);
+  cmp("1:10;2:4;3:6;7:2;9:3", vec__);
+
+  str = apply(to_string_diff, (vec__, vec_));
+  g_assert(strcmp("2:4;3:1;9:3", str) == 0);
+  g_free(str);
+
+  apply(free, (vec__));
+  apply(free, (vec_));
+
+  vec_ = apply(from_string, ("4:1;2:3", NULL));
+  cmp("2:3;4:1", vec_);
+  apply(free, (vec_));
+
   for (i = 0; i < 100; ++i) {
     apply(set, (vec, rand(), i));
   }
@@ -127,11 +145,201 @@ static void l_test() {
   apply(free, (vec_));
 }
 
+static void merge_test() {
+  InfAdoptedStateVector* vec, * vec_, * res;
+
+  vec  = apply(from_string, ("1:10;3:5;7:2", NULL));
+  vec_ = apply(from_string, ("2:4;3:8;7:1;9:3", NULL));
+
+  res = apply(least_common_successor, (vec, vec_));
+  cmp("1:10;2:4;3:8;7:2;9:3", res);
+  g_assert(apply(causally_before, (vec, res)));
+  g_assert(apply(causally_before, (vec_, res)));
+  apply(free, (res));
+
+  res = apply(least_common_predecessor, (vec, vec_));
+  cmp("3:5;7:1", res);
+  g_assert(apply(causally_before, (res, vec)));
+  g_assert(apply(causally_before, (res, vec_)));
+  apply(free, (res));
+
+  g_assert(apply(vdiff, (vec, vec)) == 0);
+  res = apply(from_string, ("1:12;2:1;3:5;7:2;8:4", NULL));
+  g_assert(apply(vdiff, (vec, res)) == 7);
+  apply(free, (res));
+
+  /* In-place variants, including an empty vector */
+  res = apply(new, ());
+  apply(max, (res, vec));
+  cmp("1:10;3:5;7:2", res);
+  apply(max, (res, vec_));
+  cmp("1:10;2:4;3:8;7:2;9:3", res);
+  apply(min, (res, vec));
+  cmp("1:10;3:5;7:2", res);
+  apply(min, (res, vec_));
+  cmp("3:5;7:1", res);
+  apply(free, (res));
+
+  apply(free, (vec));
+  apply(free, (vec_));
+}
+
+static void scratch_test() {
+  InfAdoptedStateVector scratch;
+  InfAdoptedStateVector* vec;
+  InfAdoptedStateVector* copy;
+  guint i;
+
+  /* Enough components to spill out of the inline storage */
+  vec = apply(new, ());
+  for(i = 1; i <= 12; ++i)
+    apply(set, (vec, i * 2, i));
+  cmp("2:1;4:2;6:3;8:4;10:5;12:6;14:7;16:8;18:9;20:10;22:11;24:12", vec);
+
+  apply(init, (&scratch));
+  cmp("", &scratch);
+  apply(set, (&scratch, 3, 1));
+  apply(set, (&scratch, 1, 2));
+  cmp("1:2;3:1", &scratch);
+
+  /* Grow the scratch vector past its inline storage */
+  apply(max, (&scratch, vec));
+  cmp("1:2;2:1;3:1;4:2;6:3;8:4;10:5;12:6;14:7;16:8;18:9;20:10;22:11;24:12",
+      &scratch);
+
+  copy = apply(copy, (&scratch));
+  apply(clear, (&scratch));
+  cmp("", &scratch);
+
+  apply(assign, (&scratch, copy));
+  apply(min, (&scratch, vec));
+  cmp("2:1;4:2;6:3;8:4;10:5;12:6;14:7;16:8;18:9;20:10;22:11;24:12",
+      &scratch);
+
+  apply(clear, (&scratch));
+  apply(free, (copy));
+  apply(free, (vec));
+}
+
+/* Benchmark mode, used with --benchmark. The results are printed as JSON
+ * to stdout, always in the same order and format, so that they can be
+ * compared between runs. */
+
+static const guint BENCHMARK_COMPONENTS[] = { 2, 10, 50, 100, 500 };
+
+/* Number of component visits per measurement. The number of operations is
+ * chosen to match, so that each measurement takes about as long. */
+static const guint BENCHMARK_VISITS = 2000000;
+
+static gboolean benchmark_first_result = TRUE;
+
+static void benchmark_result(guint components,
+                             const char* operation,
+                             guint operations,
+                             gint64 usecs) {
+  printf("%s    {\"components\": %u, \"operation\": \"%s\", "
+         "\"ns_per_op\": %.1f}",
+         benchmark_first_result ? "" : ",\n",
+         components,
+         operation,
+         1000.0 * usecs / operations);
+
+  benchmark_first_result = FALSE;
+}
+
+static void benchmark_vector(guint components, guint rounds) {
+  InfAdoptedStateVector* vec, * vec_, * res;
+  guint operations;
+  guint i;
+  gint64 begin;
+  char* str;
+
+  /* vec_ is causally after vec and differs from it in the last component
+   * only, so that all operations need to look at all components. */
+  vec  = apply(new, ());
+  vec_ = apply(new, ());
+  for (i = 1; i <= components; ++i) {
+    apply(set, (vec,  i * 3, i * 10));
+    apply(set, (vec_, i * 3, i * 10 + (i == components ? 1 : 0)));
+  }
+
+  operations = rounds * (BENCHMARK_VISITS / components);
+
+  begin = g_get_monotonic_time();
+  for (i = 0; i < operations; ++i)
+    g_assert(apply(compare, (vec, vec_)) != 0);
+  benchmark_result(components, "compare", operations,
+                   g_get_monotonic_time() - begin);
+
+  begin = g_get_monotonic_time();
+  for (i = 0; i < operations; ++i)
+    g_assert(apply(causally_before, (vec, vec_)));
+  benchmark_result(components, "causally_before", operations,
+                   g_get_monotonic_time() - begin);
+
+  begin = g_get_monotonic_time();
+  for (i = 0; i < operations; ++i)
+    g_assert(apply(vdiff, (vec, vec_)) == 1);
+  benchmark_result(components, "vdiff", operations,
+                   g_get_monotonic_time() - begin);
+
+  /* String conversion is much slower per component, so do fewer */
+  operations /= 10;
+
+  begin = g_get_monotonic_time();
+  for (i = 0; i < operations; ++i)
+    g_free(apply(to_string_diff, (vec_, vec)));
+  benchmark_result(components, "to_string_diff", operations,
+                   g_get_monotonic_time() - begin);
+
+  str = apply(to_string_diff, (vec_, vec));
+  begin = g_get_monotonic_time();
+  for (i = 0; i < operations; ++i) {
+    res = apply(from_string_diff, (str, vec, NULL));
+    g_assert(res != NULL);
+    apply(free, (res));
+  }
+  benchmark_result(components, "from_string_diff", operations,
+                   g_get_monotonic_time() - begin);
+
+  g_free(str);
+  apply(free, (vec));
+  apply(free, (vec_));
+}
+
+static int benchmark(guint rounds) {
+  guint i;
+
+  printf("{\n  \"benchmark\": \"inf-test-state-vector\",\n");
+  printf("  \"results\": [\n");
+
+  for (i = 0; i < G_N_ELEMENTS(BENCHMARK_COMPONENTS); ++i)
+    benchmark_vector(BENCHMARK_COMPONENTS[i], rounds);
+
+  printf("\n  ]\n}\n");
+  return 0;
+}
+
 int main(int argc, char* argv[])
 {
   guint users[2];
   InfAdoptedStateVector* vec;
   InfAdoptedStateVector* vec2;
+  int rounds;
+
+  if(argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+  {
+    rounds = 1;
+    if(argc > 2) rounds = atoi(argv[2]);
+
+    if(rounds <= 0)
+    {
+      fprintf(stderr, "Usage: %s [--benchmark [<rounds>]]\n", argv[0]);
+      return -1;
+    }
+
+    return benchmark(rounds);
+  }
 
   users[0] = 1;
   users[1] = 2;
@@ -158,6 +366,8 @@ int main(int argc, char* argv[])
 
   inf_adopted_state_vector_free(vec);
   l_test();
+  merge_test();
+  scratch_test();
   return 0;
 }
 
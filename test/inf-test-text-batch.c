@@ -0,0 +1,481 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Executes requests in batches, both directly with
+ * inf_adopted_algorithm_execute_requests() and via InfAdoptedSession, which
+ * executes buffered requests that become ready at the same time as one
+ * batch. */
+
+typedef struct _TestBatch TestBatch;
+struct _TestBatch {
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+
+  /* "x" for each executed request, "u" for each change of can-undo */
+  GString* events;
+};
+
+static void
+test_batch_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                    InfAdoptedUser* user,
+                                    InfAdoptedRequest* request,
+                                    gpointer user_data)
+{
+  g_string_append_c(((TestBatch*)user_data)->events, 'x');
+}
+
+static void
+test_batch_can_undo_changed_cb(InfAdoptedAlgorithm* algorithm,
+                               InfAdoptedUser* user,
+                               gboolean can_undo,
+                               gpointer user_data)
+{
+  g_string_append_c(((TestBatch*)user_data)->events, 'u');
+}
+
+/* If local is TRUE, then user 1 is local, so that can-undo is tracked for
+ * it. Users 2 and 3 are never local. */
+static void
+test_batch_init(TestBatch* batch,
+                gboolean local)
+{
+  InfTextUser* user;
+  gchar* user_name;
+  guint i;
+
+  batch->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  inf_text_buffer_insert_text(batch->buffer, 0, "xyz", 3, 3, NULL);
+
+  batch->user_table = inf_user_table_new();
+  batch->events = g_string_new(NULL);
+
+  for(i = 1; i <= 3; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", (local && i == 1) ? INF_USER_LOCAL : 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(batch->user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+}
+
+static void
+test_batch_finalize(TestBatch* batch)
+{
+  g_string_free(batch->events, TRUE);
+  g_object_unref(batch->user_table);
+  g_object_unref(batch->buffer);
+}
+
+static gboolean
+test_batch_check(const gchar* name,
+                 TestBatch* batch,
+                 const gchar* expected_text,
+                 const gchar* expected_events)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+  gboolean result;
+
+  chunk = inf_text_buffer_get_slice(
+    batch->buffer,
+    0,
+    inf_text_buffer_get_length(batch->buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  result = TRUE;
+  if(bytes != strlen(expected_text) || memcmp(text, expected_text, bytes))
+  {
+    printf(
+      "%s: buffer is \"%.*s\" instead of \"%s\"\n",
+      name,
+      (int)bytes,
+      text,
+      expected_text
+    );
+
+    result = FALSE;
+  }
+
+  if(expected_events != NULL && strcmp(batch->events->str, expected_events))
+  {
+    printf(
+      "%s: events are \"%s\" instead of \"%s\"\n",
+      name,
+      batch->events->str,
+      expected_events
+    );
+
+    result = FALSE;
+  }
+
+  g_free(text);
+  return result;
+}
+
+/* Creates a request of user_id to insert text at pos, made after n1
+ * requests of user 1 and n2 requests of user 2 have been executed */
+static InfAdoptedRequest*
+test_batch_insert(guint user_id,
+                  guint n1,
+                  guint n2,
+                  guint pos,
+                  const gchar* text)
+{
+  InfAdoptedStateVector* vector;
+  InfTextChunk* chunk;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+
+  vector = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vector, 1, n1);
+  inf_adopted_state_vector_set(vector, 2, n2);
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, text, strlen(text), strlen(text), 0);
+
+  operation = INF_ADOPTED_OPERATION(
+    inf_text_default_insert_operation_new(pos, chunk)
+  );
+
+  request = inf_adopted_request_new_do(vector, user_id, operation, 0);
+
+  g_object_unref(operation);
+  inf_text_chunk_free(chunk);
+  inf_adopted_state_vector_free(vector);
+  return request;
+}
+
+static InfAdoptedAlgorithm*
+test_batch_algorithm_new(TestBatch* batch)
+{
+  InfAdoptedAlgorithm* algorithm;
+
+  algorithm = inf_adopted_algorithm_new(
+    batch->user_table,
+    INF_BUFFER(batch->buffer)
+  );
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "begin-execute-request",
+    G_CALLBACK(test_batch_begin_execute_request_cb),
+    batch
+  );
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "can-undo-changed",
+    G_CALLBACK(test_batch_can_undo_changed_cb),
+    batch
+  );
+
+  return algorithm;
+}
+
+/* can-undo of the local user changes with the first request already, but
+ * is only re-evaluated once the whole batch has been executed */
+static gboolean
+test_batch_algorithm(void)
+{
+  TestBatch batch;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedRequest* requests[3];
+  GError* error;
+  guint n_executed;
+  gboolean result;
+  guint i;
+
+  test_batch_init(&batch, TRUE);
+  algorithm = test_batch_algorithm_new(&batch);
+
+  requests[0] = test_batch_insert(1, 0, 0, 0, "a");
+  requests[1] = test_batch_insert(1, 1, 0, 1, "b");
+  requests[2] = test_batch_insert(2, 2, 0, 5, "C");
+
+  error = NULL;
+  result = inf_adopted_algorithm_execute_requests(
+    algorithm,
+    requests,
+    3,
+    TRUE,
+    &n_executed,
+    &error
+  );
+
+  if(!result)
+  {
+    printf("batch: %s\n", error->message);
+    g_error_free(error);
+  }
+  else if(n_executed != 3)
+  {
+    printf("batch: %u requests executed\n", n_executed);
+    result = FALSE;
+  }
+
+  if(!test_batch_check("batch", &batch, "abxyzC", "xxxu"))
+    result = FALSE;
+
+  for(i = 0; i < 3; ++i)
+    g_object_unref(requests[i]);
+
+  g_object_unref(algorithm);
+  test_batch_finalize(&batch);
+  return result;
+}
+
+/* A request that fails stops the batch */
+static gboolean
+test_batch_algorithm_error(void)
+{
+  TestBatch batch;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequest* requests[3];
+  GError* error;
+  guint n_executed;
+  gboolean result;
+  guint i;
+
+  test_batch_init(&batch, TRUE);
+  algorithm = test_batch_algorithm_new(&batch);
+
+  /* User 2 has nothing to undo */
+  vector = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vector, 1, 1);
+
+  requests[0] = test_batch_insert(1, 0, 0, 0, "a");
+  requests[1] = inf_adopted_request_new_undo(vector, 2, 0);
+  requests[2] = test_batch_insert(1, 1, 0, 1, "b");
+
+  inf_adopted_state_vector_free(vector);
+
+  error = NULL;
+  result = TRUE;
+
+  if(inf_adopted_algorithm_execute_requests(algorithm, requests, 3, TRUE,
+                                            &n_executed, &error))
+  {
+    printf("batch-error: undo without request to undo was executed\n");
+    result = FALSE;
+  }
+  else
+  {
+    if(error == NULL || error->code != INF_ADOPTED_ALGORITHM_ERROR_NO_UNDO)
+    {
+      printf("batch-error: unexpected error\n");
+      result = FALSE;
+    }
+
+    if(n_executed != 1)
+    {
+      printf("batch-error: %u requests executed\n", n_executed);
+      result = FALSE;
+    }
+
+    if(error != NULL)
+      g_error_free(error);
+  }
+
+  if(!test_batch_check("batch-error", &batch, "axyz", NULL))
+    result = FALSE;
+
+  for(i = 0; i < 3; ++i)
+    g_object_unref(requests[i]);
+
+  g_object_unref(algorithm);
+  test_batch_finalize(&batch);
+  return result;
+}
+
+static gboolean
+test_batch_check_request_cb(InfAdoptedSession* session,
+                            InfAdoptedRequest* request,
+                            InfAdoptedUser* user,
+                            gpointer user_data)
+{
+  /* Reject all requests of user 3 */
+  return inf_user_get_id(INF_USER(user)) == 3;
+}
+
+static void
+test_batch_receive(InfTextSession* session,
+                   guint user_id,
+                   const gchar* time,
+                   guint pos,
+                   const gchar* text)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute_uint(xml, "user", user_id);
+  inf_xml_util_set_attribute(xml, "time", time);
+
+  child = xmlNewChild(
+    xml,
+    NULL,
+    (const xmlChar*)"insert",
+    (const xmlChar*)text
+  );
+
+  inf_xml_util_set_attribute_uint(child, "pos", pos);
+
+  inf_communication_object_received(
+    INF_COMMUNICATION_OBJECT(session),
+    NULL,
+    xml
+  );
+
+  xmlFreeNode(xml);
+}
+
+/* The requests of users 2 and 3 both depend on the one of user 1, but
+ * arrive before it. They are buffered, and executed together once the
+ * request of user 1 has arrived. */
+static gboolean
+test_batch_session(const gchar* name,
+                   gboolean reject)
+{
+  TestBatch batch;
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfTextSession* session;
+  gboolean result;
+
+  test_batch_init(&batch, FALSE);
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    batch.buffer,
+    io,
+    batch.user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))),
+    "begin-execute-request",
+    G_CALLBACK(test_batch_begin_execute_request_cb),
+    &batch
+  );
+
+  if(reject)
+  {
+    g_signal_connect(
+      G_OBJECT(session),
+      "check-request",
+      G_CALLBACK(test_batch_check_request_cb),
+      NULL
+    );
+  }
+
+  test_batch_receive(session, 2, "1:1", 4, "B");
+  test_batch_receive(session, 3, "1:1", 1, "C");
+
+  result = test_batch_check(name, &batch, "xyz", "");
+
+  test_batch_receive(session, 1, "", 0, "a");
+
+  if(reject)
+  {
+    if(!test_batch_check(name, &batch, "axyzB", "xx"))
+      result = FALSE;
+  }
+  else
+  {
+    if(!test_batch_check(name, &batch, "aCxyzB", "xxx"))
+      result = FALSE;
+  }
+
+  g_object_unref(session);
+  g_object_unref(io);
+  g_object_unref(manager);
+  test_batch_finalize(&batch);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_batch_algorithm()) ++passed;
+  ++total;
+  if(test_batch_algorithm_error()) ++passed;
+  ++total;
+  if(test_batch_session("session", FALSE)) ++passed;
+  ++total;
+  if(test_batch_session("session-reject", TRUE)) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,634 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Writes a document with inf_text_filesystem_format_write_binary() and
+ * reads it back, checking that all segments keep their text and author
+ * and that all authors are restored. Then the written file is truncated at
+ * every possible length and corrupted in various ways, each of which must
+ * make inf_text_filesystem_format_read() fail with an error. */
+
+typedef struct _TestBinaryUser TestBinaryUser;
+struct _TestBinaryUser {
+  guint id;
+  const gchar* name;
+  gdouble hue;
+};
+
+typedef struct _TestBinarySegment TestBinarySegment;
+struct _TestBinarySegment {
+  guint author;
+  const gchar* text;
+};
+
+/* All names are shorter than 8 bytes, so that each user takes 24 bytes in
+ * the file, and the segments start at TEST_BINARY_SEGMENTS_OFFSET. */
+static const TestBinaryUser TEST_BINARY_USERS[] = {
+  { 1, "Alice", 0.25 },
+  { 2, "Bob", 0.75 },
+  { 3, "Zo\xc3\xab", 0.125 }
+};
+
+#define TEST_BINARY_USERS_OFFSET 40
+#define TEST_BINARY_SEGMENTS_OFFSET (40 + 3 * 24)
+
+/* The last segment is a multiple of 4 bytes long, so that there is no
+ * padding at the end of the file, and no truncation of it is valid. */
+static const TestBinarySegment TEST_BINARY_SEGMENTS[] = {
+  { 1, "Gr\xc3\xbc\xc3\x9f" "e, " },
+  { 2, "\xe2\x82\xac" "uro " },
+  { 0, "plain " },
+  { 3, "\xe6\x97\xa5\xe6\x9c\xac" "ab" }
+};
+
+typedef enum _TestBinaryCorruption {
+  TEST_BINARY_VERSION,
+  TEST_BINARY_USER_COUNT,
+  TEST_BINARY_SEGMENT_COUNT,
+  TEST_BINARY_NAME_LENGTH,
+  TEST_BINARY_DUPLICATE_USER,
+  TEST_BINARY_SEGMENT_LENGTH,
+  TEST_BINARY_INVALID_UTF8,
+  TEST_BINARY_UNKNOWN_AUTHOR
+} TestBinaryCorruption;
+
+typedef struct _TestBinaryCorruptionCase TestBinaryCorruptionCase;
+struct _TestBinaryCorruptionCase {
+  const gchar* name;
+  TestBinaryCorruption corruption;
+};
+
+static const TestBinaryCorruptionCase TEST_BINARY_CORRUPTIONS[] = {
+  { "version", TEST_BINARY_VERSION },
+  { "user-count", TEST_BINARY_USER_COUNT },
+  { "segment-count", TEST_BINARY_SEGMENT_COUNT },
+  { "name-length", TEST_BINARY_NAME_LENGTH },
+  { "duplicate-user", TEST_BINARY_DUPLICATE_USER },
+  { "segment-length", TEST_BINARY_SEGMENT_LENGTH },
+  { "invalid-utf8", TEST_BINARY_INVALID_UTF8 },
+  { "unknown-author", TEST_BINARY_UNKNOWN_AUTHOR }
+};
+
+static guint32
+test_binary_get_uint32(const gchar* data,
+                       gsize offset)
+{
+  guint32 value;
+  memcpy(&value, data + offset, sizeof(value));
+  return GUINT32_FROM_LE(value);
+}
+
+static void
+test_binary_set_uint32(gchar* data,
+                       gsize offset,
+                       guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  memcpy(data + offset, &value, sizeof(value));
+}
+
+/* Describes the content of buffer as "<author>:<text>" for every run of
+ * text by the same author, separated by "|". */
+static gchar*
+test_binary_describe(InfTextBuffer* buffer)
+{
+  InfTextBufferIter* iter;
+  GString* str;
+  gchar* text;
+  guint author;
+  guint prev_author;
+
+  str = g_string_new(NULL);
+  prev_author = G_MAXUINT;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+      text = inf_text_buffer_iter_get_text(buffer, iter);
+
+      if(author != prev_author)
+      {
+        if(str->len > 0)
+          g_string_append_c(str, '|');
+        g_string_append_printf(str, "%u:", author);
+        prev_author = author;
+      }
+
+      g_string_append_len(
+        str,
+        text,
+        inf_text_buffer_iter_get_bytes(buffer, iter)
+      );
+
+      g_free(text);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return g_string_free(str, FALSE);
+}
+
+static gchar*
+test_binary_describe_expected(gboolean empty)
+{
+  GString* str;
+  guint i;
+
+  str = g_string_new(NULL);
+  for(i = 0; !empty && i < G_N_ELEMENTS(TEST_BINARY_SEGMENTS); ++i)
+  {
+    if(str->len > 0)
+      g_string_append_c(str, '|');
+
+    g_string_append_printf(
+      str,
+      "%u:%s",
+      TEST_BINARY_SEGMENTS[i].author,
+      TEST_BINARY_SEGMENTS[i].text
+    );
+  }
+
+  return g_string_free(str, FALSE);
+}
+
+static gboolean
+test_binary_write(InfdFilesystemStorage* storage,
+                  const gchar* path,
+                  gboolean empty)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUser* user;
+  GError* error;
+  const gchar* text;
+  gboolean result;
+  guint i;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  for(i = 0; !empty && i < G_N_ELEMENTS(TEST_BINARY_USERS); ++i)
+  {
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", TEST_BINARY_USERS[i].id,
+        "name", TEST_BINARY_USERS[i].name,
+        "hue", TEST_BINARY_USERS[i].hue,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  for(i = 0; !empty && i < G_N_ELEMENTS(TEST_BINARY_SEGMENTS); ++i)
+  {
+    text = TEST_BINARY_SEGMENTS[i].text;
+
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      text,
+      strlen(text),
+      g_utf8_strlen(text, -1),
+      inf_user_table_lookup_user_by_id(
+        user_table,
+        TEST_BINARY_SEGMENTS[i].author
+      )
+    );
+  }
+
+  error = NULL;
+  result = inf_text_filesystem_format_write_binary(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to write document: %s\n", path, error->message);
+    g_error_free(error);
+  }
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+static void
+test_binary_count_users_func(InfUser* user,
+                             gpointer user_data)
+{
+  ++*(guint*)user_data;
+}
+
+static gboolean
+test_binary_check_users(const gchar* path,
+                        InfUserTable* user_table,
+                        gboolean empty)
+{
+  InfUser* user;
+  guint n_users;
+  guint i;
+
+  n_users = 0;
+  inf_user_table_foreach_user(
+    user_table,
+    test_binary_count_users_func,
+    &n_users
+  );
+
+  /* Only users that wrote some of the text are stored */
+  if(n_users != (empty ? 0 : G_N_ELEMENTS(TEST_BINARY_USERS)))
+  {
+    printf("%s: %u users restored\n", path, n_users);
+    return FALSE;
+  }
+
+  for(i = 0; !empty && i < G_N_ELEMENTS(TEST_BINARY_USERS); ++i)
+  {
+    user = inf_user_table_lookup_user_by_id(
+      user_table,
+      TEST_BINARY_USERS[i].id
+    );
+
+    if(user == NULL ||
+       strcmp(inf_user_get_name(user), TEST_BINARY_USERS[i].name) != 0 ||
+       inf_text_user_get_hue(INF_TEXT_USER(user)) != TEST_BINARY_USERS[i].hue)
+    {
+      printf("%s: user %u not restored\n", path, TEST_BINARY_USERS[i].id);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+test_binary_round_trip(InfdFilesystemStorage* storage,
+                       const gchar* path,
+                       gboolean empty)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+  gchar* content;
+  gchar* expected;
+  gboolean result;
+
+  if(!test_binary_write(storage, path, empty))
+    return FALSE;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  error = NULL;
+  result = inf_text_filesystem_format_read(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to read document: %s\n", path, error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    content = test_binary_describe(buffer);
+    expected = test_binary_describe_expected(empty);
+
+    if(strcmp(content, expected) != 0)
+    {
+      printf(
+        "%s: document is \"%s\" instead of \"%s\"\n",
+        path,
+        content,
+        expected
+      );
+
+      result = FALSE;
+    }
+
+    g_free(expected);
+    g_free(content);
+
+    if(!test_binary_check_users(path, user_table, empty))
+      result = FALSE;
+  }
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+/* Stores data as the document at path and checks that reading it fails.
+ * If domain is not 0, the error needs to be in that domain. */
+static gboolean
+test_binary_expect_error(InfdFilesystemStorage* storage,
+                         const gchar* path,
+                         const gchar* data,
+                         gsize len,
+                         GQuark domain)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+  gchar* full_path;
+  gboolean result;
+
+  error = NULL;
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    path,
+    &error
+  );
+
+  if(full_path == NULL ||
+     !g_file_set_contents(full_path, data, len, &error))
+  {
+    printf("%s: failed to write document: %s\n", path, error->message);
+    g_error_free(error);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  g_free(full_path);
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &error
+  );
+
+  if(result == TRUE)
+  {
+    printf("%s: %" G_GSIZE_FORMAT " bytes read successfully\n", path, len);
+    result = FALSE;
+  }
+  else if(error == NULL)
+  {
+    printf("%s: read failed without error\n", path);
+    result = FALSE;
+  }
+  else if(domain != 0 && error->domain != domain)
+  {
+    printf("%s: unexpected error: %s\n", path, error->message);
+    result = FALSE;
+  }
+  else
+  {
+    result = TRUE;
+  }
+
+  if(error != NULL)
+    g_error_free(error);
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+static gboolean
+test_binary_read_file(InfdFilesystemStorage* storage,
+                      const gchar* path,
+                      gchar** data,
+                      gsize* len)
+{
+  GError* error;
+  gchar* full_path;
+
+  error = NULL;
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    path,
+    &error
+  );
+
+  if(full_path == NULL || !g_file_get_contents(full_path, data, len, &error))
+  {
+    printf("%s: failed to read file: %s\n", path, error->message);
+    g_error_free(error);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  g_free(full_path);
+  return TRUE;
+}
+
+/* Checks every truncation of the file that still starts with the magic
+ * bytes. Shorter files are not recognized as binary documents. */
+static gboolean
+test_binary_truncated(InfdFilesystemStorage* storage)
+{
+  GQuark domain;
+  gchar* data;
+  gsize len;
+  gsize i;
+  gboolean result;
+
+  if(!test_binary_write(storage, "/truncated", FALSE))
+    return FALSE;
+  if(!test_binary_read_file(storage, "/truncated", &data, &len))
+    return FALSE;
+
+  domain = g_quark_from_static_string("INF_TEXT_FILESYSTEM_FORMAT_ERROR");
+  result = TRUE;
+
+  for(i = 8; i < len && result == TRUE; ++i)
+    result = test_binary_expect_error(storage, "/truncated", data, i, domain);
+
+  g_free(data);
+  return result;
+}
+
+static gboolean
+test_binary_corrupted(InfdFilesystemStorage* storage,
+                      const TestBinaryCorruptionCase* test)
+{
+  gchar* path;
+  gchar* data;
+  gsize len;
+  gsize offset;
+  guint i;
+  gboolean result;
+
+  path = g_strconcat("/", test->name, NULL);
+
+  if(!test_binary_write(storage, path, FALSE) ||
+     !test_binary_read_file(storage, path, &data, &len))
+  {
+    g_free(path);
+    return FALSE;
+  }
+
+  switch(test->corruption)
+  {
+  case TEST_BINARY_VERSION:
+    test_binary_set_uint32(data, 8, 2);
+    break;
+  case TEST_BINARY_USER_COUNT:
+    test_binary_set_uint32(data, 32, G_MAXUINT32);
+    break;
+  case TEST_BINARY_SEGMENT_COUNT:
+    test_binary_set_uint32(data, 36, G_N_ELEMENTS(TEST_BINARY_SEGMENTS) + 1);
+    break;
+  case TEST_BINARY_NAME_LENGTH:
+    test_binary_set_uint32(data, TEST_BINARY_USERS_OFFSET + 4, G_MAXINT32);
+    break;
+  case TEST_BINARY_DUPLICATE_USER:
+    /* The order of the users in the file is not defined */
+    for(i = 0; i < G_N_ELEMENTS(TEST_BINARY_USERS); ++i)
+    {
+      offset = TEST_BINARY_USERS_OFFSET + i * 24;
+      if(test_binary_get_uint32(data, offset) == 2)
+        test_binary_set_uint32(data, offset, 1);
+    }
+
+    break;
+  case TEST_BINARY_SEGMENT_LENGTH:
+    test_binary_set_uint32(data, TEST_BINARY_SEGMENTS_OFFSET + 4, G_MAXINT32);
+    break;
+  case TEST_BINARY_INVALID_UTF8:
+    data[TEST_BINARY_SEGMENTS_OFFSET + 8] = '\xff';
+    break;
+  case TEST_BINARY_UNKNOWN_AUTHOR:
+    test_binary_set_uint32(data, TEST_BINARY_SEGMENTS_OFFSET, 99);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  result = test_binary_expect_error(storage, path, data, len, 0);
+
+  g_free(data);
+  g_free(path);
+  return result;
+}
+
+static void
+test_binary_remove_directory(const gchar* directory)
+{
+  GDir* dir;
+  const gchar* name;
+  gchar* path;
+
+  dir = g_dir_open(directory, 0, NULL);
+  if(dir != NULL)
+  {
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+      path = g_build_filename(directory, name, NULL);
+      g_unlink(path);
+      g_free(path);
+    }
+
+    g_dir_close(dir);
+  }
+
+  g_rmdir(directory);
+}
+
+int main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  gchar* root_directory;
+  GError* error;
+  guint passed;
+  guint total;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root_directory = g_dir_make_tmp("inf-test-text-binary-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    inf_deinit();
+    return 1;
+  }
+
+  storage = infd_filesystem_storage_new(root_directory);
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_binary_round_trip(storage, "/round-trip", FALSE)) ++passed;
+  ++total;
+  if(test_binary_round_trip(storage, "/empty", TRUE)) ++passed;
+  ++total;
+  if(test_binary_truncated(storage)) ++passed;
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_BINARY_CORRUPTIONS); ++i)
+  {
+    ++total;
+    if(test_binary_corrupted(storage, &TEST_BINARY_CORRUPTIONS[i])) ++passed;
+  }
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  g_object_unref(storage);
+  test_binary_remove_directory(root_directory);
+  g_free(root_directory);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
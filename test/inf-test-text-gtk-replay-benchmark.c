@@ -0,0 +1,581 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays records through an InfTextGtkBuffer that is shown in a
+ * GtkTextView, and measures how long it takes to apply remote operations on
+ * the client side. The text view is put into a GtkOffscreenWindow, so that
+ * nothing shows up on screen, but GTK+ still needs a display. To run it
+ * without one, use a virtual X server or the broadway backend:
+ *
+ * xvfb-run ./inf-test-text-gtk-replay-benchmark replay/replay-*.record.xml
+ *
+ * Every record is played twice, once with author highlighting turned on
+ * and once with it turned off. For each run, the following is measured:
+ *
+ *   insert    Time per request that inserted text, including the
+ *             transformation by the algorithm.
+ *   erase     Time per request that erased text, likewise.
+ *   buffer    Time per insertion and deletion in the GtkTextBuffer itself,
+ *             including the handlers of InfTextGtkBuffer.
+ *   tags      Time per request spent applying and removing tags, most of
+ *             which are the author tags.
+ *   relayout  Time per batch of requests for the main loop to process the
+ *             pending events, which includes validating the layout of the
+ *             text view and drawing it.
+ *
+ * Options:
+ *   -b <requests>   Requests played between two relayouts [Default=1]
+ *   -t              Print tab-separated lines to stdout instead
+ *
+ * With -t, one line is printed per record and run, with the columns file,
+ * colors, requests, insert-us, erase-us, buffer-insert-us, buffer-erase-us,
+ * tags-us, relayout-us and total-ms.
+ */
+
+#include <libinftextgtk/inf-text-gtk-buffer.h>
+#include <libinftextgtk/inf-text-gtk-view.h>
+#include <libinftext/inf-text-session.h>
+#include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <gtk/gtk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _InfTestTextGtkReplayBenchmarkResult
+  InfTestTextGtkReplayBenchmarkResult;
+struct _InfTestTextGtkReplayBenchmarkResult {
+  guint n_requests;
+
+  /* Requests that only inserted, or only erased text */
+  guint n_inserts;
+  gint64 insert_time;
+  guint n_erases;
+  gint64 erase_time;
+
+  /* Modifications of the GtkTextBuffer */
+  guint n_buffer_inserts;
+  gint64 buffer_insert_time;
+  guint n_buffer_erases;
+  gint64 buffer_erase_time;
+
+  gint64 tag_time;
+
+  guint n_relayouts;
+  gint64 relayout_time;
+
+  gint64 total_time;
+
+  /* Scratch values while playing */
+  guint step_inserts;
+  guint step_erases;
+  gint64 buffer_begin;
+  gint64 tag_begin;
+};
+
+static InfSession*
+inf_test_text_gtk_replay_benchmark_session_new(
+  InfIo* io,
+  InfCommunicationManager* manager,
+  InfSessionStatus status,
+  InfCommunicationGroup* sync_group,
+  InfXmlConnection* sync_connection,
+  const gchar* path,
+  gpointer user_data)
+{
+  InfTextGtkBuffer* buffer;
+  InfUserTable* user_table;
+  GtkTextBuffer* textbuffer;
+  InfTextSession* session;
+
+  textbuffer = gtk_text_buffer_new(NULL);
+  user_table = inf_user_table_new();
+  buffer = inf_text_gtk_buffer_new(textbuffer, user_table);
+  g_object_unref(textbuffer);
+
+  /* Set this before synchronization, so that it applies to the initial
+   * text as well */
+  inf_text_gtk_buffer_set_show_user_colors(
+    buffer,
+    *(const gboolean*)user_data
+  );
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    user_table,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_text_inserted_cb(InfTextBuffer* buffer,
+                                                    guint pos,
+                                                    InfTextChunk* chunk,
+                                                    InfUser* user,
+                                                    gpointer user_data)
+{
+  ++((InfTestTextGtkReplayBenchmarkResult*)user_data)->step_inserts;
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_text_erased_cb(InfTextBuffer* buffer,
+                                                  guint pos,
+                                                  InfTextChunk* chunk,
+                                                  InfUser* user,
+                                                  gpointer user_data)
+{
+  ++((InfTestTextGtkReplayBenchmarkResult*)user_data)->step_erases;
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_insert_text_cb(GtkTextBuffer* buffer,
+                                                  GtkTextIter* location,
+                                                  gchar* text,
+                                                  gint len,
+                                                  gpointer user_data)
+{
+  ((InfTestTextGtkReplayBenchmarkResult*)user_data)->buffer_begin =
+    g_get_monotonic_time();
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_insert_text_after_cb(GtkTextBuffer* buf,
+                                                        GtkTextIter* location,
+                                                        gchar* text,
+                                                        gint len,
+                                                        gpointer user_data)
+{
+  InfTestTextGtkReplayBenchmarkResult* result;
+  result = (InfTestTextGtkReplayBenchmarkResult*)user_data;
+
+  ++result->n_buffer_inserts;
+  result->buffer_insert_time += g_get_monotonic_time() - result->buffer_begin;
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_delete_range_cb(GtkTextBuffer* buffer,
+                                                   GtkTextIter* start,
+                                                   GtkTextIter* end,
+                                                   gpointer user_data)
+{
+  ((InfTestTextGtkReplayBenchmarkResult*)user_data)->buffer_begin =
+    g_get_monotonic_time();
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_delete_range_after_cb(GtkTextBuffer* buf,
+                                                         GtkTextIter* start,
+                                                         GtkTextIter* end,
+                                                         gpointer user_data)
+{
+  InfTestTextGtkReplayBenchmarkResult* result;
+  result = (InfTestTextGtkReplayBenchmarkResult*)user_data;
+
+  ++result->n_buffer_erases;
+  result->buffer_erase_time += g_get_monotonic_time() - result->buffer_begin;
+}
+
+/* Used for both apply-tag and remove-tag */
+static void
+inf_test_text_gtk_replay_benchmark_tag_cb(GtkTextBuffer* buffer,
+                                          GtkTextTag* tag,
+                                          GtkTextIter* start,
+                                          GtkTextIter* end,
+                                          gpointer user_data)
+{
+  ((InfTestTextGtkReplayBenchmarkResult*)user_data)->tag_begin =
+    g_get_monotonic_time();
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_tag_after_cb(GtkTextBuffer* buffer,
+                                                GtkTextTag* tag,
+                                                GtkTextIter* start,
+                                                GtkTextIter* end,
+                                                gpointer user_data)
+{
+  InfTestTextGtkReplayBenchmarkResult* result;
+  result = (InfTestTextGtkReplayBenchmarkResult*)user_data;
+
+  result->tag_time += g_get_monotonic_time() - result->tag_begin;
+}
+
+static void
+inf_test_text_gtk_replay_benchmark_connect(
+  GtkTextBuffer* textbuffer,
+  InfTestTextGtkReplayBenchmarkResult* result)
+{
+  g_signal_connect(
+    G_OBJECT(textbuffer),
+    "insert-text",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_insert_text_cb),
+    result
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(textbuffer),
+    "insert-text",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_insert_text_after_cb),
+    result
+  );
+
+  g_signal_connect(
+    G_OBJECT(textbuffer),
+    "delete-range",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_delete_range_cb),
+    result
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(textbuffer),
+    "delete-range",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_delete_range_after_cb),
+    result
+  );
+
+  g_signal_connect(
+    G_OBJECT(textbuffer),
+    "apply-tag",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_tag_cb),
+    result
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(textbuffer),
+    "apply-tag",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_tag_after_cb),
+    result
+  );
+
+  g_signal_connect(
+    G_OBJECT(textbuffer),
+    "remove-tag",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_tag_cb),
+    result
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(textbuffer),
+    "remove-tag",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_tag_after_cb),
+    result
+  );
+}
+
+/* Processes all pending events, which includes validating the layout of
+ * the text view and drawing it, and returns the time that took. */
+static gint64
+inf_test_text_gtk_replay_benchmark_relayout(void)
+{
+  gint64 begin;
+
+  begin = g_get_monotonic_time();
+  while(gtk_events_pending())
+    gtk_main_iteration_do(FALSE);
+
+  return g_get_monotonic_time() - begin;
+}
+
+/* Plays the record in filename once and stores the measurements in
+ * result. Loading the initial document is not measured. */
+static gboolean
+inf_test_text_gtk_replay_benchmark_play(
+  const gchar* filename,
+  gboolean show_user_colors,
+  guint batch_size,
+  InfTestTextGtkReplayBenchmarkResult* result,
+  GError** error)
+{
+  InfcNotePlugin plugin;
+  InfAdoptedSessionReplay* replay;
+  InfAdoptedSession* session;
+  InfTextGtkBuffer* buffer;
+  GtkTextBuffer* textbuffer;
+  InfTextGtkView* view;
+  GtkWidget* window;
+  GtkWidget* scroll;
+  GtkWidget* textview;
+  GError* local_error;
+  gint64 begin;
+  gint64 step_begin;
+  gint64 step_time;
+  guint n_batch;
+
+  memset(result, 0, sizeof(*result));
+
+  plugin.user_data = &show_user_colors;
+  plugin.note_type = "InfText";
+  plugin.session_new = inf_test_text_gtk_replay_benchmark_session_new;
+
+  replay = inf_adopted_session_replay_new();
+  if(!inf_adopted_session_replay_set_record(replay, filename, &plugin, error))
+  {
+    g_object_unref(replay);
+    return FALSE;
+  }
+
+  session = inf_adopted_session_replay_get_session(replay);
+  buffer = INF_TEXT_GTK_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  textbuffer = inf_text_gtk_buffer_get_text_buffer(buffer);
+
+  window = gtk_offscreen_window_new();
+  scroll = gtk_scrolled_window_new(NULL, NULL);
+  textview = gtk_text_view_new_with_buffer(textbuffer);
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(textview), FALSE);
+  gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(textview), GTK_WRAP_WORD_CHAR);
+  gtk_container_add(GTK_CONTAINER(scroll), textview);
+  gtk_container_add(GTK_CONTAINER(window), scroll);
+  gtk_window_set_default_size(GTK_WINDOW(window), 800, 600);
+
+  view = inf_text_gtk_view_new(
+    inf_adopted_session_get_io(session),
+    GTK_TEXT_VIEW(textview),
+    inf_session_get_user_table(INF_SESSION(session))
+  );
+
+  gtk_widget_show_all(window);
+  inf_test_text_gtk_replay_benchmark_relayout();
+
+  g_signal_connect(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_text_inserted_cb),
+    result
+  );
+
+  g_signal_connect(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(inf_test_text_gtk_replay_benchmark_text_erased_cb),
+    result
+  );
+
+  inf_test_text_gtk_replay_benchmark_connect(textbuffer, result);
+
+  local_error = NULL;
+  n_batch = 0;
+  begin = g_get_monotonic_time();
+
+  for(;;)
+  {
+    result->step_inserts = 0;
+    result->step_erases = 0;
+
+    step_begin = g_get_monotonic_time();
+    if(!inf_adopted_session_replay_play_next(replay, &local_error))
+      break;
+    step_time = g_get_monotonic_time() - step_begin;
+
+    ++result->n_requests;
+
+    /* Requests that are not causally ready yet are executed together with
+     * a later one, so only count steps that did one kind of operation. */
+    if(result->step_inserts > 0 && result->step_erases == 0)
+    {
+      ++result->n_inserts;
+      result->insert_time += step_time;
+    }
+    else if(result->step_erases > 0 && result->step_inserts == 0)
+    {
+      ++result->n_erases;
+      result->erase_time += step_time;
+    }
+
+    if(++n_batch == batch_size)
+    {
+      ++result->n_relayouts;
+      result->relayout_time += inf_test_text_gtk_replay_benchmark_relayout();
+      n_batch = 0;
+    }
+  }
+
+  if(n_batch > 0)
+  {
+    ++result->n_relayouts;
+    result->relayout_time += inf_test_text_gtk_replay_benchmark_relayout();
+  }
+
+  result->total_time = g_get_monotonic_time() - begin;
+
+  g_signal_handlers_disconnect_by_data(G_OBJECT(buffer), result);
+  g_signal_handlers_disconnect_by_data(G_OBJECT(textbuffer), result);
+
+  g_object_unref(view);
+  gtk_widget_destroy(window);
+  g_object_unref(replay);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static double
+inf_test_text_gtk_replay_benchmark_average(gint64 time,
+                                           guint count)
+{
+  if(count == 0) return 0.0;
+  return (double)time / count;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestTextGtkReplayBenchmarkResult result;
+  GError* error;
+  gboolean tabular;
+  guint batch_size;
+  int first_file;
+  int i;
+  int j;
+  int ret;
+
+  batch_size = 1;
+  tabular = FALSE;
+  first_file = 1;
+
+  while(first_file < argc)
+  {
+    if(strcmp(argv[first_file], "-b") == 0 && first_file + 1 < argc)
+    {
+      batch_size = atoi(argv[first_file + 1]);
+      first_file += 2;
+    }
+    else if(strcmp(argv[first_file], "-t") == 0)
+    {
+      tabular = TRUE;
+      ++first_file;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if(argc <= first_file || batch_size == 0)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [-b <requests>] [-t] <record-file1> <record-file2> ...\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
+  if(!gtk_init_check(&argc, &argv))
+  {
+    fprintf(stderr, "Failed to initialize GTK+, is a display available?\n");
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  ret = 0;
+
+  for(i = first_file; i < argc; ++i)
+  {
+    /* First with author highlighting, then without */
+    for(j = 1; j >= 0; --j)
+    {
+      if(!inf_test_text_gtk_replay_benchmark_play(argv[i], j, batch_size,
+                                                  &result, &error))
+      {
+        fprintf(stderr, "%s: %s\n", argv[i], error->message);
+        g_error_free(error);
+        error = NULL;
+
+        ret = -1;
+        break;
+      }
+
+      if(tabular)
+      {
+        printf(
+          "%s\t%s\t%u\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.3f\n",
+          argv[i],
+          j ? "yes" : "no",
+          result.n_requests,
+          inf_test_text_gtk_replay_benchmark_average(
+            result.insert_time, result.n_inserts),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.erase_time, result.n_erases),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.buffer_insert_time, result.n_buffer_inserts),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.buffer_erase_time, result.n_buffer_erases),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.tag_time, result.n_requests),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.relayout_time, result.n_relayouts),
+          result.total_time / 1000.0
+        );
+      }
+      else
+      {
+        fprintf(
+          stderr,
+          "%s, author colors %s: %u requests in %.3f ms\n"
+          "  insert %.1f us, erase %.1f us per request\n"
+          "  buffer insert %.1f us, buffer erase %.1f us\n"
+          "  tags %.1f us per request, relayout %.1f us per batch\n",
+          argv[i],
+          j ? "on" : "off",
+          result.n_requests,
+          result.total_time / 1000.0,
+          inf_test_text_gtk_replay_benchmark_average(
+            result.insert_time, result.n_inserts),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.erase_time, result.n_erases),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.buffer_insert_time, result.n_buffer_inserts),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.buffer_erase_time, result.n_buffer_erases),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.tag_time, result.n_requests),
+          inf_test_text_gtk_replay_benchmark_average(
+            result.relayout_time, result.n_relayouts)
+        );
+      }
+    }
+  }
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,652 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Looks at a document history written by hand at the times of its entries
+ * and snapshots, just before and after them, and before and after the
+ * whole history. An incomplete entry at the end of the history, as left by
+ * a crash, and an incomplete index record must not keep the history from
+ * being recorded further. */
+
+#define TEST_HISTORY_MAGIC "inf-text-history 1\n"
+
+/* A snapshot of "hello" by user 1 at time 100, user 2 appending " world"
+ * at time 200, and erasing "hello " at time 300, which is followed by a
+ * snapshot. User 1 appends "!" at time 400. */
+#define TEST_HISTORY_SNAPSHOT_100 "s 100 1\n1 5 5\nhello\n"
+#define TEST_HISTORY_ENTRIES \
+  "i 200 5 1\n2 6 6\n world\n" \
+  "e 300 0 6\n"
+#define TEST_HISTORY_SNAPSHOT_300 "s 300 1\n2 5 5\nworld\n"
+#define TEST_HISTORY_ENTRY_400 "i 400 5 1\n1 1 1\n!\n"
+
+/* The beginning of an entry that was not written completely */
+#define TEST_HISTORY_PARTIAL_ENTRY "i 500 6 1\n1 1"
+
+typedef struct _TestHistoryTextCase TestHistoryTextCase;
+struct _TestHistoryTextCase {
+  gint64 time;
+  const gchar* expected; /* NULL if there is no history at that time */
+};
+
+static const TestHistoryTextCase TEST_HISTORY_TEXT_CASES[] = {
+  { 99, NULL },
+  { 100, "1:hello" },
+  { 199, "1:hello" },
+  { 200, "1:hello|2: world" },
+  { 299, "1:hello|2: world" },
+  { 300, "2:world" },
+  { 350, "2:world" },
+  { 400, "2:world|1:!" },
+  { G_MAXINT64, "2:world|1:!" }
+};
+
+typedef struct _TestHistoryChangeCase TestHistoryChangeCase;
+struct _TestHistoryChangeCase {
+  gint64 begin_time;
+  gint64 end_time;
+  const gchar* expected;
+};
+
+static const TestHistoryChangeCase TEST_HISTORY_CHANGE_CASES[] = {
+  { 0, G_MAXINT64, "i200@5: world;e300@0+6;i400@5:!;" },
+  { 100, 400, "i200@5: world;e300@0+6;i400@5:!;" },
+  { 200, 300, "e300@0+6;" },
+  { 300, G_MAXINT64, "i400@5:!;" },
+  { 400, G_MAXINT64, "" },
+  { 0, 99, "" }
+};
+
+/* Describes the text of chunk together with its authors. Adjacent segments
+ * by the same author are described as one. */
+static gchar*
+test_history_describe_chunk(InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  GString* str;
+  guint author;
+
+  str = g_string_new(NULL);
+  author = 0;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      if(str->len == 0 || inf_text_chunk_iter_get_author(&iter) != author)
+      {
+        author = inf_text_chunk_iter_get_author(&iter);
+        if(str->len > 0) g_string_append_c(str, '|');
+        g_string_append_printf(str, "%u:", author);
+      }
+
+      g_string_append_len(
+        str,
+        (const gchar*)inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter)
+      );
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  return g_string_free(str, FALSE);
+}
+
+static void
+test_history_change_func(gint64 time,
+                         guint pos,
+                         guint len,
+                         InfTextChunk* text,
+                         gpointer user_data)
+{
+  GString* str;
+  gchar* inserted;
+  gsize bytes;
+
+  str = (GString*)user_data;
+
+  if(text != NULL)
+  {
+    inserted = inf_text_chunk_get_text(text, &bytes);
+
+    g_string_append_printf(
+      str,
+      "i%" G_GINT64_FORMAT "@%u:%.*s;",
+      time,
+      pos,
+      (int)bytes,
+      inserted
+    );
+
+    g_free(inserted);
+  }
+  else
+  {
+    g_string_append_printf(
+      str,
+      "e%" G_GINT64_FORMAT "@%u+%u;",
+      time,
+      pos,
+      len
+    );
+  }
+}
+
+static void
+test_history_append_record(GString* index,
+                           guint64 time,
+                           guint64 offset)
+{
+  time = GUINT64_TO_LE(time);
+  offset = GUINT64_TO_LE(offset);
+
+  g_string_append_len(index, (const gchar*)&time, 8);
+  g_string_append_len(index, (const gchar*)&offset, 8);
+}
+
+static gboolean
+test_history_write_file(InfdFilesystemStorage* storage,
+                        const gchar* identifier,
+                        const gchar* path,
+                        const gchar* contents,
+                        gssize length)
+{
+  GError* error;
+  gchar* full_path;
+
+  error = NULL;
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    &error
+  );
+
+  if(full_path == NULL ||
+     !g_file_set_contents(full_path, contents, length, &error))
+  {
+    printf("%s: failed to write %s: %s\n", path, identifier, error->message);
+    g_error_free(error);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  g_free(full_path);
+  return TRUE;
+}
+
+/* Writes the history and its index, optionally with an incomplete entry and
+ * an incomplete index record at the end. */
+static gboolean
+test_history_write(InfdFilesystemStorage* storage,
+                   const gchar* path,
+                   gboolean partial)
+{
+  GString* history;
+  GString* index;
+  gboolean result;
+
+  history = g_string_new(TEST_HISTORY_MAGIC);
+  index = g_string_new(NULL);
+
+  test_history_append_record(index, 100, history->len);
+  g_string_append(history, TEST_HISTORY_SNAPSHOT_100);
+  g_string_append(history, TEST_HISTORY_ENTRIES);
+  test_history_append_record(index, 300, history->len);
+  g_string_append(history, TEST_HISTORY_SNAPSHOT_300);
+  g_string_append(history, TEST_HISTORY_ENTRY_400);
+
+  if(partial)
+  {
+    g_string_append(history, TEST_HISTORY_PARTIAL_ENTRY);
+    g_string_append_len(index, "\x01\x02\x03\x04\x05", 5);
+  }
+
+  result = test_history_write_file(
+    storage,
+    "text-history",
+    path,
+    history->str,
+    history->len
+  );
+
+  if(result == TRUE)
+  {
+    result = test_history_write_file(
+      storage,
+      "text-history-index",
+      path,
+      index->str,
+      index->len
+    );
+  }
+
+  g_string_free(history, TRUE);
+  g_string_free(index, TRUE);
+  return result;
+}
+
+static gboolean
+test_history_check_text(InfdFilesystemStorage* storage,
+                        const gchar* path,
+                        gint64 time,
+                        const gchar* expected)
+{
+  InfTextChunk* chunk;
+  GError* error;
+  gchar* description;
+  gboolean result;
+
+  error = NULL;
+  chunk = inf_text_filesystem_history_get_text(storage, path, time, &error);
+
+  result = TRUE;
+  if(chunk == NULL)
+  {
+    if(expected != NULL ||
+       error->domain != g_quark_from_static_string(
+         "INF_TEXT_FILESYSTEM_FORMAT_ERROR") ||
+       error->code != INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_HISTORY)
+    {
+      printf(
+        "%s: failed to get text at %" G_GINT64_FORMAT ": %s\n",
+        path,
+        time,
+        error->message
+      );
+
+      result = FALSE;
+    }
+
+    g_error_free(error);
+  }
+  else
+  {
+    description = test_history_describe_chunk(chunk);
+    if(expected == NULL || strcmp(description, expected) != 0)
+    {
+      printf(
+        "%s: text at %" G_GINT64_FORMAT " is \"%s\" instead of \"%s\"\n",
+        path,
+        time,
+        description,
+        expected != NULL ? expected : "(no history)"
+      );
+
+      result = FALSE;
+    }
+
+    g_free(description);
+    inf_text_chunk_free(chunk);
+  }
+
+  return result;
+}
+
+static gboolean
+test_history_check_changes(InfdFilesystemStorage* storage,
+                           const gchar* path,
+                           const TestHistoryChangeCase* test)
+{
+  GString* str;
+  GError* error;
+  gboolean result;
+
+  str = g_string_new(NULL);
+  error = NULL;
+
+  result = inf_text_filesystem_history_foreach_change(
+    storage,
+    path,
+    test->begin_time,
+    test->end_time,
+    test_history_change_func,
+    str,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to read changes: %s\n", path, error->message);
+    g_error_free(error);
+  }
+  else if(strcmp(str->str, test->expected) != 0)
+  {
+    printf(
+      "%s: changes from %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT " are "
+      "\"%s\" instead of \"%s\"\n",
+      path,
+      test->begin_time,
+      test->end_time,
+      str->str,
+      test->expected
+    );
+
+    result = FALSE;
+  }
+
+  g_string_free(str, TRUE);
+  return result;
+}
+
+/* Checks all times and ranges against the hand-written history at path */
+static gboolean
+test_history_check(InfdFilesystemStorage* storage,
+                   const gchar* path)
+{
+  gboolean result;
+  guint i;
+
+  result = TRUE;
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_HISTORY_TEXT_CASES); ++i)
+  {
+    if(!test_history_check_text(storage, path,
+                                TEST_HISTORY_TEXT_CASES[i].time,
+                                TEST_HISTORY_TEXT_CASES[i].expected))
+    {
+      result = FALSE;
+    }
+  }
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_HISTORY_CHANGE_CASES); ++i)
+  {
+    if(!test_history_check_changes(storage, path,
+                                   &TEST_HISTORY_CHANGE_CASES[i]))
+    {
+      result = FALSE;
+    }
+  }
+
+  return result;
+}
+
+static gboolean
+test_history_read(InfdFilesystemStorage* storage)
+{
+  if(!test_history_write(storage, "/read", FALSE))
+    return FALSE;
+
+  return test_history_check(storage, "/read");
+}
+
+/* Without an index, the history is read from the beginning */
+static gboolean
+test_history_no_index(InfdFilesystemStorage* storage)
+{
+  gchar* full_path;
+
+  if(!test_history_write(storage, "/no-index", FALSE))
+    return FALSE;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "text-history-index",
+    "/no-index",
+    NULL
+  );
+
+  g_unlink(full_path);
+  g_free(full_path);
+
+  return test_history_check(storage, "/no-index");
+}
+
+/* Lets the session receive a request of user 1 that inserts text at pos */
+static void
+test_history_receive_insert(InfTextSession* session,
+                            guint pos,
+                            const gchar* text)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute_uint(xml, "user", 1);
+  inf_xml_util_set_attribute(xml, "time", "");
+
+  child = xmlNewChild(
+    xml,
+    NULL,
+    (const xmlChar*)"insert",
+    (const xmlChar*)text
+  );
+
+  inf_xml_util_set_attribute_uint(child, "pos", pos);
+
+  inf_communication_object_received(
+    INF_COMMUNICATION_OBJECT(session),
+    NULL,
+    xml
+  );
+
+  xmlFreeNode(xml);
+}
+
+/* Records further changes into the history at path, after an incomplete
+ * entry and an incomplete index record left behind by a crash. The old
+ * history stays readable, and the new changes are found via the index. */
+static gboolean
+test_history_record(InfdFilesystemStorage* storage)
+{
+  static const gchar path[] = "/record";
+
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfTextSession* session;
+  InfTextFilesystemHistory* history;
+  InfUser* user;
+  GError* error;
+  gchar* full_path;
+  gchar* contents;
+  gsize length;
+  gint64 time;
+  gboolean result;
+
+  if(!test_history_write(storage, path, TRUE))
+    return FALSE;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  inf_text_buffer_insert_text(buffer, 0, "world!", 6, 6, NULL);
+
+  user_table = inf_user_table_new();
+  user = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 1,
+      "name", "Alice",
+      "status", INF_USER_ACTIVE,
+      "flags", 0,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, user);
+  g_object_unref(user);
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  error = NULL;
+  history = inf_text_filesystem_history_open(storage, path, session, &error);
+  result = TRUE;
+
+  if(history == NULL)
+  {
+    printf("%s: failed to open history: %s\n", path, error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+  else
+  {
+    test_history_receive_insert(session, 6, " again");
+
+    /* Make sure that the second change has a later time */
+    time = g_get_real_time();
+    g_usleep(1000);
+
+    test_history_receive_insert(session, 12, "!");
+
+    if(!inf_text_filesystem_history_sync(history, &error))
+    {
+      printf("%s: failed to sync history: %s\n", path, error->message);
+      g_error_free(error);
+      result = FALSE;
+    }
+
+    inf_text_filesystem_history_close(history);
+  }
+
+  g_object_unref(session);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+
+  if(result == FALSE)
+    return FALSE;
+
+  if(!test_history_check_text(storage, path, 450, "2:world|1:!"))
+    result = FALSE;
+  if(!test_history_check_text(storage, path, time, "0:world!|1: again"))
+    result = FALSE;
+  if(!test_history_check_text(storage, path, G_MAXINT64,
+                              "0:world!|1: again!"))
+  {
+    result = FALSE;
+  }
+
+  /* The incomplete index record has been cut off */
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "text-history-index",
+    path,
+    NULL
+  );
+
+  contents = NULL;
+  if(!g_file_get_contents(full_path, &contents, &length, NULL) ||
+     length != 3 * 16)
+  {
+    printf("%s: index has an unexpected size\n", path);
+    result = FALSE;
+  }
+
+  g_free(contents);
+  g_free(full_path);
+  return result;
+}
+
+static void
+test_history_remove_directory(const gchar* directory)
+{
+  GDir* dir;
+  const gchar* name;
+  gchar* path;
+
+  dir = g_dir_open(directory, 0, NULL);
+  if(dir != NULL)
+  {
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+      path = g_build_filename(directory, name, NULL);
+      g_unlink(path);
+      g_free(path);
+    }
+
+    g_dir_close(dir);
+  }
+
+  g_rmdir(directory);
+}
+
+int main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  gchar* root_directory;
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root_directory = g_dir_make_tmp("inf-test-text-history-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    inf_deinit();
+    return 1;
+  }
+
+  storage = infd_filesystem_storage_new(root_directory);
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_history_read(storage)) ++passed;
+  ++total;
+  if(test_history_no_index(storage)) ++passed;
+  ++total;
+  if(test_history_record(storage)) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  g_object_unref(storage);
+  test_history_remove_directory(root_directory);
+  g_free(root_directory);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,525 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Writes a document, and then either makes changes to it with an
+ * InfTextFilesystemJournal attached, or writes a journal by hand, and
+ * checks the content of the document when it is read again. Journal
+ * entries which do not fit to the document, an incomplete entry at the end
+ * of the journal and a journal written for a different version of the
+ * document must not be applied. */
+
+#define TEST_JOURNAL_DOCUMENT "hello world"
+
+/* The journal header for TEST_JOURNAL_DOCUMENT */
+#define TEST_JOURNAL_HEADER "inf-text-journal 1 11\n"
+
+typedef struct _TestJournalCase TestJournalCase;
+struct _TestJournalCase {
+  const gchar* name;
+  const gchar* journal;
+  const gchar* expected;
+};
+
+static const TestJournalCase TEST_JOURNAL_CASES[] = {
+  {
+    /* An insertion and an erasure, the erasure of the insertion as written
+     * when it is undone, and a user joining before making a change */
+    "replay",
+    TEST_JOURNAL_HEADER
+    "i 6 1 6 6\nbrave \n"
+    "e 0 6\n"
+    "i 11 1 1 1\n!\n"
+    "e 11 1\n"
+    "u 2 0.5 3\nBob\n"
+    "i 0 2 4 2\n\xe2\x82\xac \n",
+    "\xe2\x82\xac brave world"
+  }, {
+    "truncated-text",
+    TEST_JOURNAL_HEADER
+    "i 6 1 6 6\nbrave \n"
+    "i 0 1 4 4\nwo",
+    "hello brave world"
+  }, {
+    "truncated-line",
+    TEST_JOURNAL_HEADER
+    "i 6 1 6 6\nbrave \n"
+    "e 0 ",
+    "hello brave world"
+  }, {
+    /* Everything from the first entry that does not fit is dropped */
+    "out-of-range",
+    TEST_JOURNAL_HEADER
+    "e 0 6\n"
+    "e 3 10\n"
+    "i 0 1 1 1\nx\n",
+    "world"
+  }, {
+    "unknown-author",
+    TEST_JOURNAL_HEADER
+    "i 0 7 1 1\nx\n",
+    TEST_JOURNAL_DOCUMENT
+  }, {
+    "length-mismatch",
+    TEST_JOURNAL_HEADER
+    "i 0 1 3 2\nxyz\n",
+    TEST_JOURNAL_DOCUMENT
+  }, {
+    "base-mismatch",
+    "inf-text-journal 1 12\n"
+    "e 0 6\n",
+    TEST_JOURNAL_DOCUMENT
+  }, {
+    "bad-magic",
+    "inf-text-journal 2 11\n"
+    "e 0 6\n",
+    TEST_JOURNAL_DOCUMENT
+  }
+};
+
+static InfUserTable*
+test_journal_create_user_table(void)
+{
+  InfUserTable* user_table;
+  InfUser* user;
+
+  user_table = inf_user_table_new();
+
+  user = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 1,
+      "name", "Alice",
+      "hue", 0.25,
+      "status", INF_USER_ACTIVE,
+      "flags", INF_USER_LOCAL,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, user);
+  g_object_unref(user);
+
+  return user_table;
+}
+
+/* Writes TEST_JOURNAL_DOCUMENT to path, and stores the buffer and user table
+ * of the document in buffer and user_table if they are not NULL. */
+static gboolean
+test_journal_write_document(InfdFilesystemStorage* storage,
+                            const gchar* path,
+                            InfTextBuffer** buffer,
+                            InfUserTable** user_table)
+{
+  InfTextBuffer* document;
+  InfUserTable* users;
+  GError* error;
+  gboolean result;
+
+  users = test_journal_create_user_table();
+  document = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  inf_text_buffer_insert_text(
+    document,
+    0,
+    TEST_JOURNAL_DOCUMENT,
+    strlen(TEST_JOURNAL_DOCUMENT),
+    strlen(TEST_JOURNAL_DOCUMENT),
+    inf_user_table_lookup_user_by_id(users, 1)
+  );
+
+  error = NULL;
+  result = inf_text_filesystem_format_write(
+    storage,
+    path,
+    users,
+    document,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to write document: %s\n", path, error->message);
+    g_error_free(error);
+  }
+
+  if(buffer != NULL)
+    *buffer = document;
+  else
+    g_object_unref(document);
+
+  if(user_table != NULL)
+    *user_table = users;
+  else
+    g_object_unref(users);
+
+  return result;
+}
+
+/* Reads the document at path, including its journal, and checks that its
+ * content is expected. If user_table is not NULL, it is set to the user
+ * table of the document. */
+static gboolean
+test_journal_check_document(InfdFilesystemStorage* storage,
+                            const gchar* path,
+                            const gchar* expected,
+                            InfUserTable** user_table)
+{
+  InfTextBuffer* buffer;
+  InfUserTable* users;
+  InfTextChunk* chunk;
+  GError* error;
+  gchar* text;
+  gsize bytes;
+  gboolean result;
+
+  users = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  error = NULL;
+  result = inf_text_filesystem_format_read(
+    storage,
+    path,
+    users,
+    buffer,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to read document: %s\n", path, error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    text = inf_text_chunk_get_text(chunk, &bytes);
+    inf_text_chunk_free(chunk);
+
+    if(bytes != strlen(expected) || memcmp(text, expected, bytes) != 0)
+    {
+      printf(
+        "%s: document is \"%.*s\" instead of \"%s\"\n",
+        path,
+        (int)bytes,
+        text,
+        expected
+      );
+
+      result = FALSE;
+    }
+
+    g_free(text);
+  }
+
+  if(user_table != NULL && result == TRUE)
+    *user_table = users;
+  else
+    g_object_unref(users);
+
+  g_object_unref(buffer);
+  return result;
+}
+
+/* Makes changes to a session with a journal attached, without writing the
+ * document afterwards, and checks that they are recovered from the
+ * journal. Writing the document then empties the journal, so that the
+ * changes are not applied twice. */
+static gboolean
+test_journal_write(InfdFilesystemStorage* storage)
+{
+  static const gchar* const methods[] = { "central", NULL };
+  static const gchar path[] = "/write";
+
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfIo* io;
+  InfTextSession* session;
+  InfTextFilesystemJournal* journal;
+  InfUser* user;
+  GError* error;
+  gboolean result;
+
+  if(!test_journal_write_document(storage, path, &buffer, &user_table))
+    return FALSE;
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  /* Requests made by the local user are sent to the subscription group */
+  group = inf_communication_manager_open_group(
+    manager,
+    "InfTestTextJournal",
+    methods
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(session),
+    INF_COMMUNICATION_GROUP(group)
+  );
+
+  error = NULL;
+  journal = inf_text_filesystem_journal_open(storage, path, session, &error);
+  result = TRUE;
+
+  if(journal == NULL)
+  {
+    printf("%s: failed to open journal: %s\n", path, error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+  else
+  {
+    user = inf_user_table_lookup_user_by_id(user_table, 1);
+
+    inf_text_buffer_insert_text(buffer, 6, "brave ", 6, 6, user);
+    inf_text_buffer_erase_text(buffer, 0, 6, user);
+    inf_text_buffer_insert_text(buffer, 11, "!", 1, 1, user);
+    inf_adopted_session_undo(
+      INF_ADOPTED_SESSION(session),
+      INF_ADOPTED_USER(user),
+      1
+    );
+
+    if(!inf_text_filesystem_journal_sync(journal, &error))
+    {
+      printf("%s: failed to sync journal: %s\n", path, error->message);
+      g_error_free(error);
+      result = FALSE;
+    }
+
+    inf_text_filesystem_journal_close(journal);
+  }
+
+  g_object_unref(session);
+  g_object_unref(group);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  if(result == FALSE)
+    return FALSE;
+
+  if(!test_journal_check_document(storage, path, "brave world", NULL))
+    return FALSE;
+
+  user_table = test_journal_create_user_table();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    "brave world",
+    11,
+    11,
+    inf_user_table_lookup_user_by_id(user_table, 1)
+  );
+
+  result = inf_text_filesystem_format_write(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &error
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  if(result == FALSE)
+  {
+    printf("%s: failed to write document: %s\n", path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  return test_journal_check_document(storage, path, "brave world", NULL);
+}
+
+static gboolean
+test_journal_replay(InfdFilesystemStorage* storage,
+                    const TestJournalCase* test)
+{
+  InfUserTable* user_table;
+  InfUser* user;
+  GError* error;
+  gchar* path;
+  gchar* full_path;
+  gboolean result;
+
+  path = g_strconcat("/", test->name, NULL);
+  error = NULL;
+
+  if(!test_journal_write_document(storage, path, NULL, NULL))
+  {
+    g_free(path);
+    return FALSE;
+  }
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "text-journal",
+    path,
+    &error
+  );
+
+  if(full_path == NULL ||
+     !g_file_set_contents(full_path, test->journal, -1, &error))
+  {
+    printf("%s: failed to write journal: %s\n", path, error->message);
+    g_error_free(error);
+    g_free(full_path);
+    g_free(path);
+    return FALSE;
+  }
+
+  g_free(full_path);
+
+  user_table = NULL;
+  result = test_journal_check_document(
+    storage,
+    path,
+    test->expected,
+    &user_table
+  );
+
+  /* The user that joined in the journal is added to the user table */
+  if(result == TRUE && strcmp(test->name, "replay") == 0)
+  {
+    user = inf_user_table_lookup_user_by_id(user_table, 2);
+    if(user == NULL || strcmp(inf_user_get_name(user), "Bob") != 0)
+    {
+      printf("%s: user from journal is missing\n", path);
+      result = FALSE;
+    }
+  }
+
+  if(user_table != NULL)
+    g_object_unref(user_table);
+
+  g_free(path);
+  return result;
+}
+
+static void
+test_journal_remove_directory(const gchar* directory)
+{
+  GDir* dir;
+  const gchar* name;
+  gchar* path;
+
+  dir = g_dir_open(directory, 0, NULL);
+  if(dir != NULL)
+  {
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+      path = g_build_filename(directory, name, NULL);
+      g_unlink(path);
+      g_free(path);
+    }
+
+    g_dir_close(dir);
+  }
+
+  g_rmdir(directory);
+}
+
+int main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  gchar* root_directory;
+  GError* error;
+  guint passed;
+  guint total;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root_directory = g_dir_make_tmp("inf-test-text-journal-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    inf_deinit();
+    return 1;
+  }
+
+  storage = infd_filesystem_storage_new(root_directory);
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_journal_write(storage)) ++passed;
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_JOURNAL_CASES); ++i)
+  {
+    ++total;
+    if(test_journal_replay(storage, &TEST_JOURNAL_CASES[i])) ++passed;
+  }
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  g_object_unref(storage);
+  test_journal_remove_directory(root_directory);
+  g_free(root_directory);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
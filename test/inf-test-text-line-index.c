@@ -0,0 +1,202 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-line-index.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Performs random edits on an InfTextDefaultBuffer and checks after each of
+ * them that an InfTextLineIndex for it agrees with the lines computed from
+ * the buffer content. */
+
+static const gchar* const CHARACTERS[] = {
+  "a", "b", "\n", "\n", "\xc3\xa4" /* a umlaut */, "\xe2\x82\xac" /* euro */
+};
+
+static InfTextChunk*
+test_line_index_random_chunk(guint max_length)
+{
+  InfTextChunk* chunk;
+  guint length;
+  guint i;
+  const gchar* c;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  length = g_random_int_range(1, max_length + 1);
+
+  for(i = 0; i < length; ++i)
+  {
+    c = CHARACTERS[g_random_int_range(0, G_N_ELEMENTS(CHARACTERS))];
+    inf_text_chunk_insert_text(chunk, i, c, strlen(c), 1, 0);
+  }
+
+  return chunk;
+}
+
+static gboolean
+test_line_index_check(InfTextLineIndex* index,
+                      InfTextBuffer* buffer)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gchar* pos;
+  gsize bytes;
+  GArray* starts;
+  guint offset;
+  guint length;
+  guint line;
+  guint column;
+  guint next;
+  guint i;
+
+  length = inf_text_buffer_get_length(buffer);
+  chunk = inf_text_buffer_get_slice(buffer, 0, length);
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  starts = g_array_new(FALSE, FALSE, sizeof(guint));
+  offset = 0;
+  g_array_append_val(starts, offset);
+
+  for(pos = text; pos < text + bytes; pos = g_utf8_next_char(pos))
+  {
+    ++offset;
+    if(*pos == '\n')
+      g_array_append_val(starts, offset);
+  }
+
+  g_free(text);
+
+  if(inf_text_line_index_get_n_lines(index) != starts->len)
+  {
+    printf("Line count mismatch\n");
+    g_array_free(starts, TRUE);
+    return FALSE;
+  }
+
+  for(i = 0; i < starts->len; ++i)
+  {
+    next = i + 1 < starts->len ?
+      g_array_index(starts, guint, i + 1) - 1 : length;
+
+    if(inf_text_line_index_get_line_offset(index, i) !=
+       g_array_index(starts, guint, i))
+    {
+      printf("Offset mismatch for line %u\n", i);
+      g_array_free(starts, TRUE);
+      return FALSE;
+    }
+
+    if(inf_text_line_index_get_line_length(index, i) !=
+       next - g_array_index(starts, guint, i))
+    {
+      printf("Length mismatch for line %u\n", i);
+      g_array_free(starts, TRUE);
+      return FALSE;
+    }
+  }
+
+  /* Check a few random positions, and the end of the buffer */
+  for(i = 0; i < 8; ++i)
+  {
+    offset = i == 0 ? length : g_random_int_range(0, length + 1);
+    inf_text_line_index_get_position(index, offset, &line, &column);
+
+    if(line >= starts->len ||
+       g_array_index(starts, guint, line) + column != offset ||
+       (line + 1 < starts->len &&
+        offset >= g_array_index(starts, guint, line + 1)))
+    {
+      printf("Position mismatch for offset %u\n", offset);
+      g_array_free(starts, TRUE);
+      return FALSE;
+    }
+  }
+
+  g_array_free(starts, TRUE);
+  return TRUE;
+}
+
+int main()
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextLineIndex* index;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  guint len;
+  guint i;
+
+  g_random_set_seed(42);
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  chunk = test_line_index_random_chunk(500);
+  inf_text_buffer_insert_chunk(INF_TEXT_BUFFER(buffer), 0, chunk, NULL);
+  inf_text_chunk_free(chunk);
+
+  /* The index needs to pick up the initial content of the buffer */
+  index = inf_text_line_index_new(INF_TEXT_BUFFER(buffer));
+  if(!test_line_index_check(index, INF_TEXT_BUFFER(buffer)))
+  {
+    printf("Failed for initial content\n");
+    return 1;
+  }
+
+  for(i = 0; i < 2000; ++i)
+  {
+    length = inf_text_buffer_get_length(INF_TEXT_BUFFER(buffer));
+
+    if(length == 0 || g_random_int_range(0, 3) != 0)
+    {
+      if(g_random_int_range(0, 50) == 0)
+        chunk = test_line_index_random_chunk(200);
+      else
+        chunk = test_line_index_random_chunk(4);
+
+      pos = g_random_int_range(0, length + 1);
+      inf_text_buffer_insert_chunk(INF_TEXT_BUFFER(buffer), pos, chunk, NULL);
+      inf_text_chunk_free(chunk);
+    }
+    else
+    {
+      pos = g_random_int_range(0, length);
+      len = g_random_int_range(1, MIN(length - pos, 64) + 1);
+      inf_text_buffer_erase_text(INF_TEXT_BUFFER(buffer), pos, len, NULL);
+    }
+
+    if(!test_line_index_check(index, INF_TEXT_BUFFER(buffer)))
+    {
+      printf("Failed after operation %u\n", i);
+      return 1;
+    }
+  }
+
+  printf("%u lines for %u characters\n",
+    inf_text_line_index_get_n_lines(index),
+    inf_text_buffer_get_length(INF_TEXT_BUFFER(buffer)));
+
+  g_object_unref(index);
+  g_object_unref(buffer);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,963 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Puts synthetic load on a running infinoted, in the way
+ * inf-test-mass-join does, but lets the joined users edit the documents.
+ * Each connection subscribes to one of the given documents (round-robin),
+ * joins a user and then types, pastes and undoes with random think times
+ * between the operations, until the test duration is over:
+ *
+ * ./inf-test-text-load -c 64 -t 60 -m 90,5,5 Test1 Test2
+ *
+ * The documents need to exist on the server already. The latency of an
+ * operation is the time from its local execution until another connection
+ * subscribed to the same document executes it, so it includes the time the
+ * server takes to process and relay the request. Since all connections run
+ * in this process, make sure it is not the bottleneck itself, for example
+ * by running several instances on different machines.
+ */
+
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-session.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/adopted/inf-adopted-state-vector.h>
+#include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-protocol.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Time to wait for outstanding requests after the test is over, in
+ * milliseconds */
+#define INF_TEST_TEXT_LOAD_GRACE_TIME 2000
+
+typedef struct _InfTestTextLoadIssued InfTestTextLoadIssued;
+struct _InfTestTextLoadIssued {
+  gint64 time;
+  guint pending;
+};
+
+typedef struct _InfTestTextLoadDocument InfTestTextLoadDocument;
+struct _InfTestTextLoadDocument {
+  gchar* name;
+  guint n_joined;
+
+  /* (user ID << 32 | request index) -> InfTestTextLoadIssued */
+  GHashTable* issued;
+};
+
+typedef struct _InfTestTextLoad InfTestTextLoad;
+
+typedef struct _InfTestTextLoadJoiner InfTestTextLoadJoiner;
+struct _InfTestTextLoadJoiner {
+  InfTestTextLoad* load;
+  InfTestTextLoadDocument* document;
+  gchar* username;
+
+  InfCommunicationManager* communication_manager;
+  InfcBrowser* browser;
+  InfSessionProxy* proxy;
+  InfSession* session;
+  InfTextBuffer* buffer;
+  InfUser* user;
+
+  guint caret;
+  InfIoTimeout* timeout;
+};
+
+struct _InfTestTextLoad {
+  InfIo* io;
+
+  /* options */
+  gint duration;
+  gint think_time;
+  gint paste_size;
+  gint weight_typing;
+  gint weight_paste;
+  gint weight_undo;
+
+  InfTestTextLoadDocument* documents;
+  guint n_documents;
+  GSList* joiners;
+  guint n_starting;
+
+  gboolean stopped;
+  gint64 start_time;
+  gint64 stop_time;
+
+  guint n_typed;
+  guint n_pasted;
+  guint n_undone;
+  guint n_delivered;
+  GArray* latencies;
+};
+
+static const gchar INF_TEST_TEXT_LOAD_CHARACTERS[] =
+  "abcdefghijklmnopqrstuvwxyz     \n";
+
+static InfSession*
+inf_test_text_load_session_new(InfIo* io,
+                               InfCommunicationManager* manager,
+                               InfSessionStatus status,
+                               InfCommunicationGroup* sync_group,
+                               InfXmlConnection* sync_connection,
+                               const gchar* path,
+                               gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INF_TEST_TEXT_LOAD_TEXT_PLUGIN = {
+  NULL, "InfText", inf_test_text_load_session_new
+};
+
+static void
+inf_test_text_load_issued_free(gpointer issued)
+{
+  g_slice_free(InfTestTextLoadIssued, issued);
+}
+
+static gint
+inf_test_text_load_latency_compare(gconstpointer first,
+                                   gconstpointer second)
+{
+  gint64 a;
+  gint64 b;
+
+  a = *(const gint64*)first;
+  b = *(const gint64*)second;
+  return (a > b) - (a < b);
+}
+
+static double
+inf_test_text_load_percentile(GArray* latencies,
+                              double p)
+{
+  guint index;
+
+  if(latencies->len == 0)
+    return 0.0;
+
+  index = (guint)(p * (latencies->len - 1));
+  return g_array_index(latencies, gint64, index) / 1000.0;
+}
+
+static void
+inf_test_text_load_report(InfTestTextLoad* load)
+{
+  double secs;
+  guint n_issued;
+
+  g_array_sort(load->latencies, inf_test_text_load_latency_compare);
+
+  secs = (load->stop_time - load->start_time) / 1000000.0;
+  n_issued = load->n_typed + load->n_pasted + load->n_undone;
+
+  printf(
+    "Duration: %.1f s\n"
+    "Issued: %u requests (%.1f/s): %u typed, %u pasted, %u undone\n"
+    "Delivered: %u requests (%.1f/s)\n"
+    "Latency: p50 %.3f ms, p99 %.3f ms, p999 %.3f ms, max %.3f ms\n",
+    secs,
+    n_issued,
+    secs > 0.0 ? n_issued / secs : 0.0,
+    load->n_typed,
+    load->n_pasted,
+    load->n_undone,
+    load->n_delivered,
+    secs > 0.0 ? load->n_delivered / secs : 0.0,
+    inf_test_text_load_percentile(load->latencies, 0.5),
+    inf_test_text_load_percentile(load->latencies, 0.99),
+    inf_test_text_load_percentile(load->latencies, 0.999),
+    inf_test_text_load_percentile(load->latencies, 1.0)
+  );
+}
+
+static void
+inf_test_text_load_joiner_remove(InfTestTextLoadJoiner* joiner)
+{
+  InfTestTextLoad* load;
+  load = joiner->load;
+
+  if(joiner->timeout != NULL)
+  {
+    inf_io_remove_timeout(load->io, joiner->timeout);
+    joiner->timeout = NULL;
+  }
+
+  load->joiners = g_slist_remove(load->joiners, joiner);
+  if(load->joiners == NULL)
+    inf_standalone_io_loop_quit(INF_STANDALONE_IO(load->io));
+}
+
+static void
+inf_test_text_load_schedule_next(InfTestTextLoadJoiner* joiner);
+
+static void
+inf_test_text_load_type(InfTestTextLoadJoiner* joiner)
+{
+  guint length;
+  gchar c;
+
+  length = inf_text_buffer_get_length(joiner->buffer);
+  if(joiner->caret > length)
+    joiner->caret = length;
+
+  /* Every tenth keystroke is a backspace */
+  if(joiner->caret > 0 && g_random_int_range(0, 10) == 0)
+  {
+    inf_text_buffer_erase_text(
+      joiner->buffer,
+      joiner->caret - 1,
+      1,
+      joiner->user
+    );
+
+    --joiner->caret;
+  }
+  else
+  {
+    c = INF_TEST_TEXT_LOAD_CHARACTERS[
+      g_random_int_range(0, sizeof(INF_TEST_TEXT_LOAD_CHARACTERS) - 1)
+    ];
+
+    inf_text_buffer_insert_text(
+      joiner->buffer,
+      joiner->caret,
+      &c,
+      1,
+      1,
+      joiner->user
+    );
+
+    ++joiner->caret;
+  }
+
+  ++joiner->load->n_typed;
+}
+
+static void
+inf_test_text_load_paste(InfTestTextLoadJoiner* joiner)
+{
+  gchar* text;
+  gint i;
+
+  text = g_malloc(joiner->load->paste_size);
+  for(i = 0; i < joiner->load->paste_size; ++i)
+  {
+    text[i] = INF_TEST_TEXT_LOAD_CHARACTERS[
+      g_random_int_range(0, sizeof(INF_TEST_TEXT_LOAD_CHARACTERS) - 1)
+    ];
+  }
+
+  /* Paste somewhere in the document, and continue typing there */
+  joiner->caret = g_random_int_range(
+    0,
+    inf_text_buffer_get_length(joiner->buffer) + 1
+  );
+
+  inf_text_buffer_insert_text(
+    joiner->buffer,
+    joiner->caret,
+    text,
+    joiner->load->paste_size,
+    joiner->load->paste_size,
+    joiner->user
+  );
+
+  joiner->caret += joiner->load->paste_size;
+  ++joiner->load->n_pasted;
+
+  g_free(text);
+}
+
+static void
+inf_test_text_load_next_cb(gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  InfTestTextLoad* load;
+  InfAdoptedAlgorithm* algorithm;
+  gint action;
+
+  joiner = (InfTestTextLoadJoiner*)user_data;
+  load = joiner->load;
+  joiner->timeout = NULL;
+
+  if(load->stopped)
+    return;
+
+  action = g_random_int_range(
+    0,
+    load->weight_typing + load->weight_paste + load->weight_undo
+  );
+
+  algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(joiner->session));
+
+  if(action < load->weight_typing)
+  {
+    inf_test_text_load_type(joiner);
+  }
+  else if(action < load->weight_typing + load->weight_paste)
+  {
+    inf_test_text_load_paste(joiner);
+  }
+  else if(inf_adopted_algorithm_can_undo(
+            algorithm,
+            INF_ADOPTED_USER(joiner->user)))
+  {
+    inf_adopted_session_undo(
+      INF_ADOPTED_SESSION(joiner->session),
+      INF_ADOPTED_USER(joiner->user),
+      1
+    );
+
+    ++load->n_undone;
+  }
+  else
+  {
+    inf_test_text_load_type(joiner);
+  }
+
+  inf_test_text_load_schedule_next(joiner);
+}
+
+static void
+inf_test_text_load_schedule_next(InfTestTextLoadJoiner* joiner)
+{
+  guint msecs;
+
+  /* Think times are uniformly distributed around the configured mean,
+   * with an occasional long pause in between. */
+  msecs = g_random_int_range(0, 2 * joiner->load->think_time + 1);
+  if(g_random_int_range(0, 20) == 0)
+    msecs *= 10;
+
+  joiner->timeout = inf_io_add_timeout(
+    joiner->load->io,
+    msecs,
+    inf_test_text_load_next_cb,
+    joiner,
+    NULL
+  );
+}
+
+static void
+inf_test_text_load_report_cb(gpointer user_data)
+{
+  InfTestTextLoad* load;
+  load = (InfTestTextLoad*)user_data;
+
+  inf_test_text_load_report(load);
+  inf_standalone_io_loop_quit(INF_STANDALONE_IO(load->io));
+}
+
+static void
+inf_test_text_load_stop_cb(gpointer user_data)
+{
+  InfTestTextLoad* load;
+  GSList* item;
+  InfTestTextLoadJoiner* joiner;
+
+  load = (InfTestTextLoad*)user_data;
+  load->stopped = TRUE;
+  load->stop_time = g_get_monotonic_time();
+
+  for(item = load->joiners; item != NULL; item = item->next)
+  {
+    joiner = (InfTestTextLoadJoiner*)item->data;
+    if(joiner->timeout != NULL)
+    {
+      inf_io_remove_timeout(load->io, joiner->timeout);
+      joiner->timeout = NULL;
+    }
+  }
+
+  fprintf(stderr, "Waiting for outstanding requests...\n");
+
+  inf_io_add_timeout(
+    load->io,
+    INF_TEST_TEXT_LOAD_GRACE_TIME,
+    inf_test_text_load_report_cb,
+    load,
+    NULL
+  );
+}
+
+static void
+inf_test_text_load_start_cb(gpointer user_data)
+{
+  InfTestTextLoad* load;
+  GSList* item;
+  InfTestTextLoadJoiner* joiner;
+
+  load = (InfTestTextLoad*)user_data;
+  load->start_time = g_get_monotonic_time();
+
+  fprintf(
+    stderr,
+    "%u users joined, starting load\n",
+    g_slist_length(load->joiners)
+  );
+
+  for(item = load->joiners; item != NULL; item = item->next)
+  {
+    joiner = (InfTestTextLoadJoiner*)item->data;
+    if(joiner->user != NULL)
+      inf_test_text_load_schedule_next(joiner);
+  }
+
+  inf_io_add_timeout(
+    load->io,
+    load->duration * 1000,
+    inf_test_text_load_stop_cb,
+    load,
+    NULL
+  );
+}
+
+/* Called when a joiner has either joined its user or failed to. The load
+ * starts only once all of them are done, so that the join phase does not
+ * distort the latency measurements. */
+static void
+inf_test_text_load_joiner_ready(InfTestTextLoad* load)
+{
+  g_assert(load->n_starting > 0);
+  --load->n_starting;
+
+  if(load->n_starting == 0 && load->joiners != NULL)
+    inf_test_text_load_start_cb(load);
+}
+
+static void
+inf_test_text_load_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                            InfAdoptedUser* user,
+                                            InfAdoptedRequest* request,
+                                            gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  InfTestTextLoadDocument* document;
+  InfTestTextLoadIssued* issued;
+  guint user_id;
+  gint64 key;
+  gint64* new_key;
+  gint64 latency;
+
+  joiner = (InfTestTextLoadJoiner*)user_data;
+  document = joiner->document;
+
+  user_id = inf_adopted_request_get_user_id(request);
+  key = ((gint64)user_id << 32) |
+    inf_adopted_state_vector_get(
+      inf_adopted_request_get_vector(request),
+      user_id
+    );
+
+  if(INF_USER(user) == joiner->user)
+  {
+    if(document->n_joined > 1)
+    {
+      issued = g_slice_new(InfTestTextLoadIssued);
+      issued->time = g_get_monotonic_time();
+      issued->pending = document->n_joined - 1;
+
+      new_key = g_new(gint64, 1);
+      *new_key = key;
+      g_hash_table_replace(document->issued, new_key, issued);
+    }
+  }
+  else
+  {
+    issued = g_hash_table_lookup(document->issued, &key);
+    if(issued != NULL)
+    {
+      ++joiner->load->n_delivered;
+      if(!joiner->load->stopped)
+      {
+        latency = g_get_monotonic_time() - issued->time;
+        g_array_append_val(joiner->load->latencies, latency);
+      }
+
+      if(--issued->pending == 0)
+        g_hash_table_remove(document->issued, &key);
+    }
+  }
+}
+
+static void
+inf_test_text_load_user_join_finished_cb(InfRequest* request,
+                                         const InfRequestResult* result,
+                                         const GError* error,
+                                         gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  joiner = (InfTestTextLoadJoiner*)user_data;
+
+  if(error == NULL)
+  {
+    inf_request_result_get_join_user(result, NULL, &joiner->user);
+    g_object_ref(joiner->user);
+
+    joiner->buffer = INF_TEXT_BUFFER(inf_session_get_buffer(joiner->session));
+    joiner->caret = inf_text_buffer_get_length(joiner->buffer);
+    ++joiner->document->n_joined;
+
+    inf_test_text_load_joiner_ready(joiner->load);
+  }
+  else
+  {
+    fprintf(
+      stderr,
+      "Joiner %s: User join failed: %s\n",
+      joiner->username,
+      error->message
+    );
+
+    inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
+  }
+}
+
+static void
+inf_test_text_load_join_user(InfTestTextLoadJoiner* joiner)
+{
+  g_signal_connect(
+    G_OBJECT(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(joiner->session))
+    ),
+    "begin-execute-request",
+    G_CALLBACK(inf_test_text_load_begin_execute_request_cb),
+    joiner
+  );
+
+  inf_text_session_join_user(
+    joiner->proxy,
+    joiner->username,
+    INF_USER_ACTIVE,
+    g_random_double(),
+    0,
+    0,
+    inf_test_text_load_user_join_finished_cb,
+    joiner
+  );
+}
+
+static void
+inf_test_text_load_session_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  joiner = (InfTestTextLoadJoiner*)user_data;
+
+  switch(inf_session_get_status(joiner->session))
+  {
+  case INF_SESSION_PRESYNC:
+  case INF_SESSION_SYNCHRONIZING:
+    break;
+  case INF_SESSION_RUNNING:
+    inf_test_text_load_join_user(joiner);
+    break;
+  case INF_SESSION_CLOSED:
+    fprintf(stderr, "Joiner %s: Session closed\n", joiner->username);
+    inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
+    break;
+  }
+}
+
+static void
+inf_test_text_load_subscribe_finished_cb(InfRequest* request,
+                                         const InfRequestResult* result,
+                                         const GError* error,
+                                         gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  joiner = (InfTestTextLoadJoiner*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(
+      stderr,
+      "Joiner %s: Subscription failed: %s\n",
+      joiner->username,
+      error->message
+    );
+
+    inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
+    return;
+  }
+
+  inf_request_result_get_subscribe_session(result, NULL, NULL, &joiner->proxy);
+  g_object_ref(joiner->proxy);
+
+  g_object_get(G_OBJECT(joiner->proxy), "session", &joiner->session, NULL);
+
+  g_signal_connect(
+    G_OBJECT(joiner->session),
+    "notify::status",
+    G_CALLBACK(inf_test_text_load_session_notify_status_cb),
+    joiner
+  );
+
+  if(inf_session_get_status(joiner->session) == INF_SESSION_RUNNING)
+    inf_test_text_load_join_user(joiner);
+}
+
+static void
+inf_test_text_load_explore_finished_cb(InfRequest* request,
+                                       const InfRequestResult* result,
+                                       const GError* error,
+                                       gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  gboolean have_iter;
+
+  joiner = (InfTestTextLoadJoiner*)user_data;
+  browser = INF_BROWSER(joiner->browser);
+
+  inf_browser_get_root(browser, &iter);
+  for(have_iter = inf_browser_get_child(browser, &iter);
+      have_iter == TRUE;
+      have_iter = inf_browser_get_next(browser, &iter))
+  {
+    if(strcmp(inf_browser_get_node_name(browser, &iter),
+              joiner->document->name) == 0)
+    {
+      inf_browser_subscribe(
+        browser,
+        &iter,
+        inf_test_text_load_subscribe_finished_cb,
+        joiner
+      );
+
+      break;
+    }
+  }
+
+  if(have_iter == FALSE)
+  {
+    fprintf(
+      stderr,
+      "Joiner %s: Document %s does not exist\n",
+      joiner->username,
+      joiner->document->name
+    );
+
+    inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
+  }
+}
+
+static void
+inf_test_text_load_browser_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfTestTextLoadJoiner* joiner;
+  InfBrowserStatus status;
+  InfBrowserIter iter;
+
+  joiner = (InfTestTextLoadJoiner*)user_data;
+
+  g_object_get(object, "status", &status, NULL);
+  switch(status)
+  {
+  case INF_BROWSER_OPENING:
+    /* nothing to do */
+    break;
+  case INF_BROWSER_OPEN:
+    inf_browser_get_root(INF_BROWSER(joiner->browser), &iter);
+
+    inf_browser_explore(
+      INF_BROWSER(joiner->browser),
+      &iter,
+      inf_test_text_load_explore_finished_cb,
+      joiner
+    );
+
+    break;
+  case INF_BROWSER_CLOSED:
+    fprintf(stderr, "Joiner %s: Disconnected\n", joiner->username);
+
+    if(joiner->user != NULL)
+      --joiner->document->n_joined;
+    else
+      inf_test_text_load_joiner_ready(joiner->load);
+
+    inf_test_text_load_joiner_remove(joiner);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+inf_test_text_load_connect(InfTestTextLoad* load,
+                           const char* hostname,
+                           guint port,
+                           InfTestTextLoadDocument* document,
+                           const char* username)
+{
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  InfTestTextLoadJoiner* joiner;
+  GError* error;
+
+  addr = inf_ip_address_new_from_string(hostname);
+  tcp = inf_tcp_connection_new(load->io, addr, port);
+  xmpp = inf_xmpp_connection_new(
+    tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    g_get_host_name(),
+    hostname,
+    INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  joiner = g_slice_new(InfTestTextLoadJoiner);
+  joiner->load = load;
+  joiner->document = document;
+  joiner->username = g_strdup(username);
+  joiner->communication_manager = inf_communication_manager_new();
+  joiner->browser = infc_browser_new(
+    load->io,
+    joiner->communication_manager,
+    INF_XML_CONNECTION(xmpp)
+  );
+  joiner->proxy = NULL;
+  joiner->session = NULL;
+  joiner->buffer = NULL;
+  joiner->user = NULL;
+  joiner->caret = 0;
+  joiner->timeout = NULL;
+
+  g_object_unref(xmpp);
+  g_object_unref(tcp);
+  inf_ip_address_free(addr);
+
+  load->joiners = g_slist_prepend(load->joiners, joiner);
+  ++load->n_starting;
+  infc_browser_add_plugin(joiner->browser, &INF_TEST_TEXT_LOAD_TEXT_PLUGIN);
+
+  g_signal_connect(
+    G_OBJECT(joiner->browser),
+    "notify::status",
+    G_CALLBACK(inf_test_text_load_browser_notify_status_cb),
+    joiner
+  );
+
+  error = NULL;
+  if(!inf_xml_connection_open(infc_browser_get_connection(joiner->browser),
+                              &error))
+  {
+    fprintf(
+      stderr,
+      "Joiner %s: Failed to connect to %s: %s\n",
+      joiner->username,
+      hostname,
+      error->message
+    );
+
+    g_error_free(error);
+    inf_test_text_load_joiner_ready(load);
+    inf_test_text_load_joiner_remove(joiner);
+  }
+}
+
+static gboolean
+inf_test_text_load_parse_mix(InfTestTextLoad* load,
+                             const gchar* mix)
+{
+  gchar** weights;
+  gboolean result;
+
+  weights = g_strsplit(mix, ",", 3);
+  result = FALSE;
+
+  if(g_strv_length(weights) == 3)
+  {
+    load->weight_typing = atoi(weights[0]);
+    load->weight_paste = atoi(weights[1]);
+    load->weight_undo = atoi(weights[2]);
+
+    result = load->weight_typing >= 0 && load->weight_paste >= 0 &&
+      load->weight_undo >= 0 &&
+      load->weight_typing + load->weight_paste + load->weight_undo > 0;
+  }
+
+  g_strfreev(weights);
+  return result;
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfTestTextLoad load;
+  GError* error;
+  GOptionContext* context;
+  gchar* name;
+  int i;
+
+  gchar* hostname;
+  gint port;
+  gint n_connections;
+  gchar* mix;
+
+  GOptionEntry entries[] = {
+    { "host", 'H', 0, G_OPTION_ARG_STRING, &hostname,
+      "IP address of the server to connect to", "ADDRESS" },
+    { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+      "Port of the server to connect to", "PORT" },
+    { "connections", 'c', 0, G_OPTION_ARG_INT, &n_connections,
+      "Number of connections to open", "N" },
+    { "duration", 't', 0, G_OPTION_ARG_INT, &load.duration,
+      "Duration of the test, in seconds", "SECS" },
+    { "think-time", 'w', 0, G_OPTION_ARG_INT, &load.think_time,
+      "Mean time between two operations of the same user, in milliseconds",
+      "MSECS" },
+    { "paste-size", 's', 0, G_OPTION_ARG_INT, &load.paste_size,
+      "Number of characters inserted by a paste", "N" },
+    { "mix", 'm', 0, G_OPTION_ARG_STRING, &mix,
+      "Relative weights of typing, pasting and undoing", "TYPE,PASTE,UNDO" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  hostname = NULL;
+  port = inf_protocol_get_default_port();
+  n_connections = 16;
+  load.duration = 60;
+  mix = NULL;
+
+  load.think_time = 200;
+  load.paste_size = 256;
+  load.weight_typing = 90;
+  load.weight_paste = 5;
+  load.weight_undo = 5;
+
+  error = NULL;
+  context = g_option_context_new("<document1> <document2> ...");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_set_help_enabled(context, TRUE);
+
+  if(!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return -1;
+  }
+
+  g_option_context_free(context);
+
+  if(argc < 2 || n_connections <= 0 || load.duration <= 0 ||
+     load.think_time < 0 || load.paste_size <= 0 || port <= 0 ||
+     port > 65535 || (mix != NULL && !inf_test_text_load_parse_mix(&load, mix)))
+  {
+    fprintf(stderr, "Invalid arguments, see --help\n");
+    return -1;
+  }
+
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  load.io = INF_IO(inf_standalone_io_new());
+  load.n_documents = argc - 1;
+  load.documents = g_new(InfTestTextLoadDocument, load.n_documents);
+  load.joiners = NULL;
+  load.n_starting = 0;
+  load.stopped = FALSE;
+  load.start_time = 0;
+  load.stop_time = 0;
+  load.n_typed = 0;
+  load.n_pasted = 0;
+  load.n_undone = 0;
+  load.n_delivered = 0;
+  load.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+  for(i = 0; i < (int)load.n_documents; ++i)
+  {
+    load.documents[i].name = argv[i + 1];
+    load.documents[i].n_joined = 0;
+    load.documents[i].issued = g_hash_table_new_full(
+      g_int64_hash,
+      g_int64_equal,
+      g_free,
+      inf_test_text_load_issued_free
+    );
+  }
+
+  for(i = 0; i < n_connections; ++i)
+  {
+    name = g_strdup_printf("Load%03d", i);
+
+    inf_test_text_load_connect(
+      &load,
+      hostname != NULL ? hostname : "127.0.0.1",
+      port,
+      &load.documents[i % load.n_documents],
+      name
+    );
+
+    g_free(name);
+  }
+
+  if(load.joiners != NULL)
+    inf_standalone_io_loop(INF_STANDALONE_IO(load.io));
+
+  for(i = 0; i < (int)load.n_documents; ++i)
+    g_hash_table_destroy(load.documents[i].issued);
+  g_free(load.documents);
+  g_array_free(load.latencies, TRUE);
+  g_free(hostname);
+  g_free(mix);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
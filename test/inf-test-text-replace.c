@@ -0,0 +1,433 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-delete-operation.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-split-operation.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Replaces the content of a session with inf_text_session_replace_text()
+ * and checks both the resulting buffer and the operations of the request
+ * that was made. Operations are written as "i<pos>:<text>" for insertions
+ * and "d<pos>:<len>" for deletions, in the order in which they are
+ * applied. */
+
+typedef struct _TestReplaceCase TestReplaceCase;
+struct _TestReplaceCase {
+  const gchar* name;
+  const gchar* encoding;
+  const gchar* old_text;
+  const gchar* new_text;
+  const gchar* operations;
+};
+
+static const TestReplaceCase TEST_REPLACE_CASES[] = {
+  {
+    "insertion",
+    "UTF-8",
+    "hello world",
+    "hello brave world",
+    "i6:brave "
+  }, {
+    "deletion",
+    "UTF-8",
+    "hello brave world",
+    "hello world",
+    "d6:6"
+  }, {
+    "interleaved",
+    "UTF-8",
+    "the quick brown fox",
+    "the quack brown box!",
+    "i19:! d16:1 i16:b d6:1 i6:a"
+  }, {
+    "interleaved-multibyte",
+    "UTF-8",
+    "a\xc3\xa4" "bc\xe2\x82\xac" "d",
+    "a\xe2\x82\xac" "bcd",
+    "d4:1 d1:1 i1:\xe2\x82\xac"
+  }, {
+    "identical",
+    "UTF-8",
+    "unchanged",
+    "unchanged",
+    ""
+  }, {
+    "latin-1",
+    "ISO-8859-1",
+    "Gr\xfc\xdf" "e Welt",
+    "Gr\xfc\xdf" "e, sch\xf6" "ne Welt",
+    "i5:, sch\xf6" "ne"
+  }
+};
+
+typedef struct _TestReplaceRecord TestReplaceRecord;
+struct _TestReplaceRecord {
+  guint n_requests;
+  GString* operations;
+};
+
+static void
+test_replace_describe(GString* str,
+                      InfAdoptedOperation* operation)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+  GSList* parts;
+  GSList* item;
+
+  if(INF_ADOPTED_IS_SPLIT_OPERATION(operation))
+  {
+    parts = inf_adopted_split_operation_unsplit(
+      INF_ADOPTED_SPLIT_OPERATION(operation)
+    );
+
+    for(item = parts; item != NULL; item = item->next)
+      test_replace_describe(str, INF_ADOPTED_OPERATION(item->data));
+
+    g_slist_free(parts);
+    return;
+  }
+
+  if(str->len > 0)
+    g_string_append_c(str, ' ');
+
+  if(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation))
+  {
+    chunk = inf_text_default_insert_operation_get_chunk(
+      INF_TEXT_DEFAULT_INSERT_OPERATION(operation)
+    );
+
+    text = inf_text_chunk_get_text(chunk, &bytes);
+
+    g_string_append_printf(
+      str,
+      "i%u:",
+      inf_text_insert_operation_get_position(
+        INF_TEXT_INSERT_OPERATION(operation)
+      )
+    );
+
+    g_string_append_len(str, text, bytes);
+    g_free(text);
+  }
+  else if(INF_TEXT_IS_DELETE_OPERATION(operation))
+  {
+    g_string_append_printf(
+      str,
+      "d%u:%u",
+      inf_text_delete_operation_get_position(
+        INF_TEXT_DELETE_OPERATION(operation)
+      ),
+      inf_text_delete_operation_get_length(
+        INF_TEXT_DELETE_OPERATION(operation)
+      )
+    );
+  }
+  else
+  {
+    g_string_append(str, "?");
+  }
+}
+
+static void
+test_replace_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                      InfAdoptedUser* user,
+                                      InfAdoptedRequest* request,
+                                      gpointer user_data)
+{
+  TestReplaceRecord* record;
+  record = (TestReplaceRecord*)user_data;
+
+  ++record->n_requests;
+
+  test_replace_describe(
+    record->operations,
+    inf_adopted_request_get_operation(request)
+  );
+}
+
+static guint
+test_replace_length(const gchar* encoding,
+                    const gchar* text,
+                    gsize bytes)
+{
+  /* The other encodings used in the tests use one byte per character */
+  if(strcmp(encoding, "UTF-8") == 0)
+    return g_utf8_strlen(text, bytes);
+  return bytes;
+}
+
+static gboolean
+test_replace(const gchar* name,
+             const gchar* encoding,
+             const gchar* old_text,
+             const gchar* new_text,
+             const gchar* operations)
+{
+  static const gchar* const methods[] = { "central", NULL };
+
+  InfTextBuffer* buffer;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  InfTextSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  TestReplaceRecord record;
+
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+  gboolean result;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new(encoding));
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    old_text,
+    strlen(old_text),
+    test_replace_length(encoding, old_text, strlen(old_text)),
+    NULL
+  );
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  user = INF_TEXT_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 1,
+      "name", "User_1",
+      "status", INF_USER_ACTIVE,
+      "flags", INF_USER_LOCAL,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, INF_USER(user));
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  /* Requests made by the local user are sent to the subscription group */
+  group = inf_communication_manager_open_group(
+    manager,
+    "InfTestTextReplace",
+    methods
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(session),
+    INF_COMMUNICATION_GROUP(group)
+  );
+
+  record.n_requests = 0;
+  record.operations = g_string_new(NULL);
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "begin-execute-request",
+    G_CALLBACK(test_replace_begin_execute_request_cb),
+    &record
+  );
+
+  inf_text_session_replace_text(
+    session,
+    user,
+    new_text,
+    strlen(new_text)
+  );
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  result = TRUE;
+
+  if(bytes != strlen(new_text) || memcmp(text, new_text, bytes) != 0)
+  {
+    printf("%s: buffer is \"%.*s\"\n", name, (int)bytes, text);
+    result = FALSE;
+  }
+
+  /* No request at all is made if there is nothing to change */
+  if(record.n_requests != (operations[0] != '\0' ? 1 : 0))
+  {
+    printf("%s: %u requests made\n", name, record.n_requests);
+    result = FALSE;
+  }
+
+  if(strcmp(record.operations->str, operations) != 0)
+  {
+    printf(
+      "%s: operations are \"%s\" instead of \"%s\"\n",
+      name,
+      record.operations->str,
+      operations
+    );
+
+    result = FALSE;
+  }
+
+  g_free(text);
+  g_string_free(record.operations, TRUE);
+
+  g_object_unref(session);
+  g_object_unref(group);
+  g_object_unref(user);
+  g_object_unref(user_table);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(buffer);
+
+  return result;
+}
+
+/* Tests the fallback for texts that differ in more characters than the diff
+ * is allowed to examine, and a text just below that limit, which is still
+ * diffed character by character. */
+static gboolean
+test_replace_max_cost(guint repeat,
+                      gboolean fallback)
+{
+  GString* old_text;
+  GString* new_text;
+  GString* operations;
+  gchar* name;
+  guint i;
+  gboolean result;
+
+  old_text = g_string_new("<");
+  new_text = g_string_new("<");
+
+  for(i = 0; i < repeat; ++i)
+  {
+    g_string_append(old_text, "ac");
+    g_string_append(new_text, "bc");
+  }
+
+  g_string_append_c(old_text, '>');
+  g_string_append_c(new_text, '>');
+
+  /* The common "<" and "c>" are stripped before the diff runs */
+  operations = g_string_new(NULL);
+  if(fallback)
+  {
+    g_string_append_printf(operations, "d1:%u i1:", 2 * repeat - 1);
+    g_string_append_len(operations, new_text->str + 1, 2 * repeat - 1);
+  }
+  else
+  {
+    for(i = repeat; i > 0; --i)
+    {
+      if(operations->len > 0)
+        g_string_append_c(operations, ' ');
+      g_string_append_printf(operations, "d%u:1 i%u:b", 2*i - 1, 2*i - 1);
+    }
+  }
+
+  name = g_strdup_printf("max-cost-%u", repeat);
+
+  result = test_replace(
+    name,
+    "UTF-8",
+    old_text->str,
+    new_text->str,
+    operations->str
+  );
+
+  g_free(name);
+  g_string_free(operations, TRUE);
+  g_string_free(new_text, TRUE);
+  g_string_free(old_text, TRUE);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  const TestReplaceCase* test;
+  guint passed;
+  guint total;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_REPLACE_CASES); ++i)
+  {
+    test = &TEST_REPLACE_CASES[i];
+
+    ++total;
+    if(test_replace(test->name, test->encoding, test->old_text,
+                    test->new_text, test->operations))
+    {
+      ++passed;
+    }
+  }
+
+  /* 800 characters to insert or erase, and 1200 for the fallback */
+  ++total;
+  if(test_replace_max_cost(400, FALSE)) ++passed;
+  ++total;
+  if(test_replace_max_cost(600, TRUE)) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,342 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays records like inf-test-text-replay, but without any consistency
+ * checks, and measures how long it takes to play them. This is meant to
+ * compare the performance of the algorithm before and after a change, for
+ * example with the records in the replay/ subdirectory:
+ *
+ * ./inf-test-text-replay-benchmark -n 10 replay/replay-*.record.xml
+ *
+ * With -t, one tab-separated line is printed to stdout per record instead,
+ * with the columns file, iterations, avg-ms, best-ms, requests,
+ * requests-per-sec, cache-hits, cache-misses, peak-rss-kb and untranslated,
+ * so that the results can be compared by a script. untranslated is the
+ * number of requests that could be applied without transformation. Peak
+ * RSS is that of the whole process so far, so run one record per process to
+ * measure it per record.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef G_OS_UNIX
+# include <sys/resource.h>
+#endif
+
+typedef struct _InfTestTextReplayBenchmarkResult
+  InfTestTextReplayBenchmarkResult;
+struct _InfTestTextReplayBenchmarkResult {
+  gint64 elapsed;
+  guint n_requests;
+  guint cache_hits;
+  guint cache_misses;
+  guint n_untranslated;
+};
+
+static InfSession*
+inf_test_text_replay_benchmark_session_new(InfIo* io,
+                                           InfCommunicationManager* manager,
+                                           InfSessionStatus status,
+                                           InfCommunicationGroup* sync_group,
+                                           InfXmlConnection* sync_connection,
+                                           const gchar* path,
+                                           gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INF_TEST_TEXT_REPLAY_BENCHMARK_TEXT_PLUGIN = {
+  NULL, "InfText", inf_test_text_replay_benchmark_session_new
+};
+
+static void
+inf_test_text_replay_benchmark_begin_execute_request_cb(
+  InfAdoptedAlgorithm* algorithm,
+  InfAdoptedUser* user,
+  InfAdoptedRequest* request,
+  gpointer user_data)
+{
+  ++((InfTestTextReplayBenchmarkResult*)user_data)->n_requests;
+}
+
+static void
+inf_test_text_replay_benchmark_add_cache_statistics_func(InfUser* user,
+                                                         gpointer user_data)
+{
+  InfTestTextReplayBenchmarkResult* result;
+  guint hits;
+  guint misses;
+
+  result = (InfTestTextReplayBenchmarkResult*)user_data;
+
+  inf_adopted_request_log_get_cache_statistics(
+    inf_adopted_user_get_request_log(INF_ADOPTED_USER(user)),
+    &hits,
+    &misses
+  );
+
+  result->cache_hits += hits;
+  result->cache_misses += misses;
+}
+
+static glong
+inf_test_text_replay_benchmark_get_peak_rss(void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return -1;
+}
+
+/* Plays the record in filename once, and stores the time it took in
+ * microseconds, not counting loading the initial document, and the number
+ * of executed requests and cache statistics in result. */
+static gboolean
+inf_test_text_replay_benchmark_play(const gchar* filename,
+                                    InfTestTextReplayBenchmarkResult* result,
+                                    GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+  InfAdoptedSession* session;
+  gint64 begin;
+  gint64 end;
+
+  result->elapsed = 0;
+  result->n_requests = 0;
+  result->cache_hits = 0;
+  result->cache_misses = 0;
+  result->n_untranslated = 0;
+
+  replay = inf_adopted_session_replay_new();
+  if(!inf_adopted_session_replay_set_record(
+       replay,
+       filename,
+       &INF_TEST_TEXT_REPLAY_BENCHMARK_TEXT_PLUGIN,
+       error))
+  {
+    g_object_unref(replay);
+    return FALSE;
+  }
+
+  session = inf_adopted_session_replay_get_session(replay);
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(session)),
+    "begin-execute-request",
+    G_CALLBACK(inf_test_text_replay_benchmark_begin_execute_request_cb),
+    result
+  );
+
+  begin = g_get_monotonic_time();
+  if(!inf_adopted_session_replay_play_to_end(replay, error))
+  {
+    g_object_unref(replay);
+    return FALSE;
+  }
+
+  end = g_get_monotonic_time();
+  result->elapsed = end - begin;
+
+  inf_adopted_algorithm_get_statistics(
+    inf_adopted_session_get_algorithm(session),
+    NULL,
+    &result->n_untranslated
+  );
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_test_text_replay_benchmark_add_cache_statistics_func,
+    result
+  );
+
+  g_object_unref(replay);
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  int n_iterations;
+  gboolean tabular;
+  int first_file;
+  int i;
+  int j;
+  int ret;
+
+  InfTestTextReplayBenchmarkResult result;
+  gint64 file_total;
+  gint64 file_best;
+  gint64 total;
+  double requests_per_sec;
+
+  n_iterations = 5;
+  tabular = FALSE;
+  first_file = 1;
+
+  while(first_file < argc)
+  {
+    if(strcmp(argv[first_file], "-n") == 0 && first_file + 1 < argc)
+    {
+      n_iterations = atoi(argv[first_file + 1]);
+      first_file += 2;
+    }
+    else if(strcmp(argv[first_file], "-t") == 0)
+    {
+      tabular = TRUE;
+      ++first_file;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if(argc <= first_file || n_iterations <= 0)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [-n <iterations>] [-t] <record-file1> <record-file2> ...\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  ret = 0;
+  total = 0;
+
+  for(i = first_file; i < argc; ++ i)
+  {
+    if(!tabular)
+    {
+      fprintf(stderr, "%s... ", argv[i]);
+      fflush(stderr);
+    }
+
+    file_total = 0;
+    file_best = G_MAXINT64;
+
+    for(j = 0; j < n_iterations; ++ j)
+    {
+      if(!inf_test_text_replay_benchmark_play(argv[i], &result, &error))
+        break;
+
+      file_total += result.elapsed;
+      if(result.elapsed < file_best)
+        file_best = result.elapsed;
+    }
+
+    if(error != NULL)
+    {
+      if(tabular)
+        fprintf(stderr, "%s: ", argv[i]);
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      error = NULL;
+
+      ret = -1;
+    }
+    else
+    {
+      /* All iterations execute the same requests, so the requests per
+       * second are computed from the best run. */
+      requests_per_sec = 0.0;
+      if(file_best > 0)
+        requests_per_sec = result.n_requests * 1000000.0 / file_best;
+
+      if(tabular)
+      {
+        printf(
+          "%s\t%d\t%.3f\t%.3f\t%u\t%.1f\t%u\t%u\t%ld\t%u\n",
+          argv[i],
+          n_iterations,
+          file_total / (double)n_iterations / 1000.0,
+          file_best / 1000.0,
+          result.n_requests,
+          requests_per_sec,
+          result.cache_hits,
+          result.cache_misses,
+          inf_test_text_replay_benchmark_get_peak_rss(),
+          result.n_untranslated
+        );
+      }
+      else
+      {
+        fprintf(
+          stderr,
+          "avg %.3f ms, best %.3f ms, %u requests (%.1f/s), "
+          "cache %u hits / %u misses, %u untranslated\n",
+          file_total / (double)n_iterations / 1000.0,
+          file_best / 1000.0,
+          result.n_requests,
+          requests_per_sec,
+          result.cache_hits,
+          result.cache_misses,
+          result.n_untranslated
+        );
+      }
+
+      total += file_total;
+    }
+  }
+
+  if(!tabular)
+  {
+    fprintf(
+      stderr,
+      "Total: %.3f ms per iteration, peak RSS %ld kB\n",
+      total / (double)n_iterations / 1000.0,
+      inf_test_text_replay_benchmark_get_peak_rss()
+    );
+  }
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
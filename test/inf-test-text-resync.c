@@ -0,0 +1,425 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Creates a server and a client copy of the same session, and lets the
+ * client miss some of the requests that the server executes, as if its
+ * connection had been lost in between. The client is then brought up to
+ * date with inf_adopted_session_resync_to_xml() and
+ * inf_adopted_session_resync_from_xml(), after which its buffer and its
+ * state vector need to be the same as the ones of the server. */
+
+#define TEST_RESYNC_INITIAL "xyz"
+
+static InfTextSession*
+test_resync_session_new(void)
+{
+  InfTextBuffer* buffer;
+  InfCommunicationManager* manager;
+  InfStandaloneIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  InfTextSession* session;
+  gchar* user_name;
+  guint i;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    TEST_RESYNC_INITIAL,
+    strlen(TEST_RESYNC_INITIAL),
+    strlen(TEST_RESYNC_INITIAL),
+    NULL
+  );
+
+  manager = inf_communication_manager_new();
+  io = inf_standalone_io_new();
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= 3; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    INF_IO(io),
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(buffer);
+
+  return session;
+}
+
+/* Lets session receive a request of the given user. The time is given
+ * relative to the vector of the user, and operation is either "insert",
+ * "delete" or "undo". */
+static void
+test_resync_receive(InfTextSession* session,
+                    guint user,
+                    const gchar* time,
+                    const gchar* operation,
+                    guint pos,
+                    const gchar* text,
+                    guint len)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute_uint(xml, "user", user);
+  inf_xml_util_set_attribute(xml, "time", time);
+
+  child = xmlNewChild(
+    xml,
+    NULL,
+    (const xmlChar*)operation,
+    (const xmlChar*)text
+  );
+
+  if(strcmp(operation, "undo") != 0)
+    inf_xml_util_set_attribute_uint(child, "pos", pos);
+  if(strcmp(operation, "delete") == 0)
+    inf_xml_util_set_attribute_uint(child, "len", len);
+
+  inf_communication_object_received(
+    INF_COMMUNICATION_OBJECT(session),
+    NULL,
+    xml
+  );
+
+  xmlFreeNode(xml);
+}
+
+static void
+test_resync_receive_shared(InfTextSession* session)
+{
+  test_resync_receive(session, 1, "", "insert", 0, "a", 0);
+  test_resync_receive(session, 2, "", "insert", 3, "B", 0);
+}
+
+/* Requests that only the server receives. They include a deletion, an undo,
+ * a request made after having seen one of the other requests, and a request
+ * of a user that joined only after the client was disconnected. */
+static void
+test_resync_receive_missed(InfTextSession* session)
+{
+  InfTextUser* user;
+
+  test_resync_receive(session, 3, "", "insert", 1, "c", 0);
+  test_resync_receive(session, 1, "", "delete", 0, NULL, 1);
+  test_resync_receive(session, 2, "", "undo", 0, NULL, 0);
+
+  user = INF_TEXT_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 4,
+      "name", "User_4",
+      "status", INF_USER_ACTIVE,
+      "flags", 0,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    INF_USER(user)
+  );
+
+  g_object_unref(user);
+
+  test_resync_receive(session, 4, "", "insert", 0, "E", 0);
+  test_resync_receive(session, 3, "1:1", "insert", 4, "D", 0);
+}
+
+static InfAdoptedStateVector*
+test_resync_get_current(InfTextSession* session)
+{
+  return inf_adopted_algorithm_get_current(
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+  );
+}
+
+static gboolean
+test_resync_check(const gchar* name,
+                  InfTextSession* server,
+                  InfTextSession* client)
+{
+  InfTextBuffer* server_buffer;
+  InfTextBuffer* client_buffer;
+  InfTextChunk* server_chunk;
+  InfTextChunk* client_chunk;
+  gchar* server_text;
+  gchar* client_text;
+  gsize server_bytes;
+  gsize client_bytes;
+  gchar* server_str;
+  gchar* client_str;
+  gboolean result;
+
+  server_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(server)));
+  client_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(client)));
+
+  server_chunk = inf_text_buffer_get_slice(
+    server_buffer,
+    0,
+    inf_text_buffer_get_length(server_buffer)
+  );
+
+  client_chunk = inf_text_buffer_get_slice(
+    client_buffer,
+    0,
+    inf_text_buffer_get_length(client_buffer)
+  );
+
+  result = TRUE;
+  if(!inf_text_chunk_equal(server_chunk, client_chunk))
+  {
+    server_text = inf_text_chunk_get_text(server_chunk, &server_bytes);
+    client_text = inf_text_chunk_get_text(client_chunk, &client_bytes);
+
+    printf(
+      "%s: client buffer is \"%.*s\" while server buffer is \"%.*s\"\n",
+      name,
+      (int)client_bytes,
+      client_text,
+      (int)server_bytes,
+      server_text
+    );
+
+    g_free(server_text);
+    g_free(client_text);
+    result = FALSE;
+  }
+
+  inf_text_chunk_free(server_chunk);
+  inf_text_chunk_free(client_chunk);
+
+  if(inf_adopted_state_vector_compare(
+       test_resync_get_current(server),
+       test_resync_get_current(client)) != 0)
+  {
+    server_str = inf_adopted_state_vector_to_string(
+      test_resync_get_current(server)
+    );
+
+    client_str = inf_adopted_state_vector_to_string(
+      test_resync_get_current(client)
+    );
+
+    printf(
+      "%s: client is at state \"%s\" while server is at state \"%s\"\n",
+      name,
+      client_str,
+      server_str
+    );
+
+    g_free(server_str);
+    g_free(client_str);
+    result = FALSE;
+  }
+
+  if(inf_user_table_lookup_user_by_id(
+       inf_session_get_user_table(INF_SESSION(server)), 4) != NULL &&
+     inf_user_table_lookup_user_by_id(
+       inf_session_get_user_table(INF_SESSION(client)), 4) == NULL)
+  {
+    printf("%s: client does not know the user that joined\n", name);
+    result = FALSE;
+  }
+
+  return result;
+}
+
+static gboolean
+test_resync(const gchar* name,
+            gboolean missed)
+{
+  InfTextSession* server;
+  InfTextSession* client;
+  InfSimulatedConnection* connection;
+  InfAdoptedStateVector* vector;
+  xmlNodePtr xml;
+  GError* error;
+  gboolean result;
+
+  server = test_resync_session_new();
+  client = test_resync_session_new();
+
+  test_resync_receive_shared(server);
+  test_resync_receive_shared(client);
+
+  if(missed)
+    test_resync_receive_missed(server);
+
+  result = TRUE;
+  vector = inf_adopted_state_vector_copy(test_resync_get_current(client));
+
+  if(missed &&
+     inf_adopted_state_vector_compare(
+       vector,
+       test_resync_get_current(server)) == 0)
+  {
+    printf("%s: client did not miss any requests\n", name);
+    result = FALSE;
+  }
+
+  if(!inf_adopted_session_can_resync(INF_ADOPTED_SESSION(server), vector))
+  {
+    printf("%s: server refuses to resync the client\n", name);
+    result = FALSE;
+  }
+  else
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"session-resync");
+
+    inf_adopted_session_resync_to_xml(
+      INF_ADOPTED_SESSION(server),
+      vector,
+      xml
+    );
+
+    connection = inf_simulated_connection_new();
+
+    error = NULL;
+    if(!inf_adopted_session_resync_from_xml(
+         INF_ADOPTED_SESSION(client),
+         INF_XML_CONNECTION(connection),
+         xml,
+         &error))
+    {
+      printf("%s: resync failed: %s\n", name, error->message);
+      g_error_free(error);
+      result = FALSE;
+    }
+    else if(!test_resync_check(name, server, client))
+    {
+      result = FALSE;
+    }
+
+    g_object_unref(connection);
+    xmlFreeNode(xml);
+  }
+
+  inf_adopted_state_vector_free(vector);
+  g_object_unref(client);
+  g_object_unref(server);
+
+  return result;
+}
+
+/* A client that has executed a request which the server does not know about
+ * cannot be resynchronized. */
+static gboolean
+test_resync_diverged(const gchar* name)
+{
+  InfTextSession* server;
+  InfTextSession* client;
+  gboolean result;
+
+  server = test_resync_session_new();
+  client = test_resync_session_new();
+
+  test_resync_receive_shared(server);
+  test_resync_receive_shared(client);
+  test_resync_receive(client, 3, "", "insert", 0, "F", 0);
+
+  result = TRUE;
+  if(inf_adopted_session_can_resync(
+       INF_ADOPTED_SESSION(server),
+       test_resync_get_current(client)))
+  {
+    printf("%s: server accepts to resync a diverged client\n", name);
+    result = FALSE;
+  }
+
+  g_object_unref(client);
+  g_object_unref(server);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_resync("missed", TRUE)) ++passed;
+  ++total;
+  if(test_resync("up-to-date", FALSE)) ++passed;
+  ++total;
+  if(test_resync_diverged("diverged")) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
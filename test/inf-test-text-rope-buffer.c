@@ -0,0 +1,294 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-rope-buffer.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-chunk.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Performs random edits on both an InfTextRopeBuffer and an
+ * InfTextDefaultBuffer and checks that they hold the same text, with the
+ * same authors, after each of them. */
+
+static const gchar* const CHARACTERS[] = {
+  "a", "b", "\n", "\xc3\xa4" /* a umlaut */, "\xe2\x82\xac" /* euro sign */
+};
+
+static InfTextChunk*
+test_rope_buffer_random_chunk(guint max_length)
+{
+  InfTextChunk* chunk;
+  guint length;
+  guint author;
+  guint i;
+  const gchar* c;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  length = g_random_int_range(1, max_length + 1);
+  author = g_random_int_range(1, 4);
+
+  for(i = 0; i < length; ++i)
+  {
+    /* Mostly keep the author, to get longer segments */
+    if(g_random_int_range(0, 16) == 0)
+      author = g_random_int_range(1, 4);
+
+    c = CHARACTERS[g_random_int_range(0, G_N_ELEMENTS(CHARACTERS))];
+    inf_text_chunk_insert_text(chunk, i, c, strlen(c), 1, author);
+  }
+
+  return chunk;
+}
+
+/* Appends the author of every character in chunk to authors */
+static void
+test_rope_buffer_get_authors(InfTextChunk* chunk,
+                             GArray* authors)
+{
+  InfTextChunkIter iter;
+  guint author;
+  guint i;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
+      for(i = 0; i < inf_text_chunk_iter_get_length(&iter); ++i)
+        g_array_append_val(authors, author);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+}
+
+static gboolean
+test_rope_buffer_chunk_equal(InfTextChunk* first,
+                             InfTextChunk* second)
+{
+  gchar* first_text;
+  gchar* second_text;
+  gsize first_bytes;
+  gsize second_bytes;
+  GArray* first_authors;
+  GArray* second_authors;
+  gboolean result;
+
+  first_text = inf_text_chunk_get_text(first, &first_bytes);
+  second_text = inf_text_chunk_get_text(second, &second_bytes);
+
+  first_authors = g_array_new(FALSE, FALSE, sizeof(guint));
+  second_authors = g_array_new(FALSE, FALSE, sizeof(guint));
+  test_rope_buffer_get_authors(first, first_authors);
+  test_rope_buffer_get_authors(second, second_authors);
+
+  result = first_bytes == second_bytes &&
+    memcmp(first_text, second_text, first_bytes) == 0 &&
+    first_authors->len == second_authors->len &&
+    memcmp(
+      first_authors->data,
+      second_authors->data,
+      first_authors->len * sizeof(guint)
+    ) == 0;
+
+  g_array_free(first_authors, TRUE);
+  g_array_free(second_authors, TRUE);
+  g_free(first_text);
+  g_free(second_text);
+
+  return result;
+}
+
+/* Checks that the segments reported by the iterators cover the whole
+ * buffer without gaps. */
+static gboolean
+test_rope_buffer_check_iters(InfTextBuffer* buffer)
+{
+  InfTextBufferIter* iter;
+  guint offset;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter == NULL)
+    return inf_text_buffer_get_length(buffer) == 0;
+
+  offset = 0;
+  do
+  {
+    if(inf_text_buffer_iter_get_offset(buffer, iter) != offset)
+    {
+      inf_text_buffer_destroy_iter(buffer, iter);
+      return FALSE;
+    }
+
+    offset += inf_text_buffer_iter_get_length(buffer, iter);
+  } while(inf_text_buffer_iter_next(buffer, iter));
+
+  inf_text_buffer_destroy_iter(buffer, iter);
+  return offset == inf_text_buffer_get_length(buffer);
+}
+
+static gboolean
+test_rope_buffer_check(InfTextRopeBuffer* rope,
+                       InfTextDefaultBuffer* reference)
+{
+  InfTextChunk* rope_chunk;
+  InfTextChunk* reference_chunk;
+  gchar* text;
+  gsize bytes;
+  guint length;
+  guint pos;
+  guint len;
+  guint lines;
+  gsize i;
+  gboolean result;
+
+  length = inf_text_buffer_get_length(INF_TEXT_BUFFER(reference));
+  if(inf_text_buffer_get_length(INF_TEXT_BUFFER(rope)) != length)
+  {
+    printf("Length mismatch\n");
+    return FALSE;
+  }
+
+  reference_chunk = inf_text_buffer_get_slice(
+    INF_TEXT_BUFFER(reference),
+    0,
+    length
+  );
+
+  rope_chunk = inf_text_buffer_get_slice(INF_TEXT_BUFFER(rope), 0, length);
+  result = test_rope_buffer_chunk_equal(rope_chunk, reference_chunk);
+  inf_text_chunk_free(rope_chunk);
+
+  if(!result)
+  {
+    printf("Content mismatch\n");
+    inf_text_chunk_free(reference_chunk);
+    return FALSE;
+  }
+
+  text = inf_text_chunk_get_text(reference_chunk, &bytes);
+  inf_text_chunk_free(reference_chunk);
+
+  lines = 1;
+  for(i = 0; i < bytes; ++i)
+    if(text[i] == '\n')
+      ++lines;
+  g_free(text);
+
+  if(inf_text_rope_buffer_get_n_lines(rope) != lines)
+  {
+    printf("Line count mismatch\n");
+    return FALSE;
+  }
+
+  if(!test_rope_buffer_check_iters(INF_TEXT_BUFFER(rope)))
+  {
+    printf("Iterators do not cover the buffer\n");
+    return FALSE;
+  }
+
+  /* Also compare a random slice */
+  pos = g_random_int_range(0, length + 1);
+  len = g_random_int_range(0, length - pos + 1);
+
+  reference_chunk = inf_text_buffer_get_slice(
+    INF_TEXT_BUFFER(reference),
+    pos,
+    len
+  );
+
+  rope_chunk = inf_text_buffer_get_slice(INF_TEXT_BUFFER(rope), pos, len);
+  result = test_rope_buffer_chunk_equal(rope_chunk, reference_chunk);
+  inf_text_chunk_free(rope_chunk);
+  inf_text_chunk_free(reference_chunk);
+
+  if(!result)
+  {
+    printf("Slice mismatch at %u, length %u\n", pos, len);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int main()
+{
+  InfTextRopeBuffer* rope;
+  InfTextDefaultBuffer* reference;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  guint len;
+  guint i;
+
+  g_random_set_seed(42);
+
+  rope = inf_text_rope_buffer_new();
+  reference = inf_text_default_buffer_new("UTF-8");
+
+  for(i = 0; i < 2000; ++i)
+  {
+    length = inf_text_buffer_get_length(INF_TEXT_BUFFER(reference));
+
+    if(length == 0 || g_random_int_range(0, 3) != 0)
+    {
+      /* Every now and then insert a large chunk, so that it has to be
+       * split into several segments, otherwise type a few characters. */
+      if(g_random_int_range(0, 100) == 0)
+        chunk = test_rope_buffer_random_chunk(5000);
+      else
+        chunk = test_rope_buffer_random_chunk(8);
+
+      pos = g_random_int_range(0, length + 1);
+      inf_text_buffer_insert_chunk(INF_TEXT_BUFFER(rope), pos, chunk, NULL);
+      inf_text_buffer_insert_chunk(
+        INF_TEXT_BUFFER(reference),
+        pos,
+        chunk,
+        NULL
+      );
+
+      inf_text_chunk_free(chunk);
+    }
+    else
+    {
+      pos = g_random_int_range(0, length);
+      len = g_random_int_range(1, MIN(length - pos, 64) + 1);
+
+      inf_text_buffer_erase_text(INF_TEXT_BUFFER(rope), pos, len, NULL);
+      inf_text_buffer_erase_text(INF_TEXT_BUFFER(reference), pos, len, NULL);
+    }
+
+    if(!test_rope_buffer_check(rope, reference))
+    {
+      printf("Failed after operation %u\n", i);
+      return 1;
+    }
+  }
+
+  printf("%u segments for %u characters\n",
+    inf_text_rope_buffer_get_n_segments(rope),
+    inf_text_buffer_get_length(INF_TEXT_BUFFER(rope)));
+
+  g_object_unref(rope);
+  g_object_unref(reference);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
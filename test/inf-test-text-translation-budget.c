@@ -0,0 +1,284 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Receives requests with InfAdoptedSession:translation-budget set, and
+ * checks that a request concurrent to more requests than the budget is held
+ * back together with the requests received after it, and that all of them
+ * are executed in order later, either from the main loop or because the
+ * budget is reset to 0. */
+
+/* User 1 inserts "a" and "b" at the start of "xyz", then user 2 inserts "C"
+ * at the end and user 3 inserts "D" before "z", both without having seen
+ * the requests of user 1, and user 3 also without having seen the one of
+ * user 2. */
+#define TEST_BUDGET_INITIAL "xyz"
+#define TEST_BUDGET_HELD "abxyz"
+#define TEST_BUDGET_FINAL "abxyDzC"
+#define TEST_BUDGET_ORDER "1123"
+
+typedef struct _TestBudgetRequest TestBudgetRequest;
+struct _TestBudgetRequest {
+  guint user;
+  guint pos;
+  const gchar* text;
+};
+
+static const TestBudgetRequest TEST_BUDGET_REQUESTS[] = {
+  { 1, 0, "a" },
+  { 1, 1, "b" },
+  { 2, 3, "C" },
+  { 3, 2, "D" }
+};
+
+static void
+test_budget_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                               InfAdoptedUser* user,
+                               InfAdoptedRequest* request,
+                               gpointer user_data)
+{
+  g_string_append_printf(
+    (GString*)user_data,
+    "%u",
+    inf_adopted_request_get_user_id(request)
+  );
+}
+
+static gboolean
+test_budget_check_buffer(const gchar* name,
+                         InfTextBuffer* buffer,
+                         const gchar* expected)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+  gboolean result;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  result = TRUE;
+  if(bytes != strlen(expected) || memcmp(text, expected, bytes) != 0)
+  {
+    printf(
+      "%s: buffer is \"%.*s\" instead of \"%s\"\n",
+      name,
+      (int)bytes,
+      text,
+      expected
+    );
+
+    result = FALSE;
+  }
+
+  g_free(text);
+  return result;
+}
+
+static gboolean
+test_budget(const gchar* name,
+            gboolean reset_budget)
+{
+  InfTextBuffer* buffer;
+  InfCommunicationManager* manager;
+  InfStandaloneIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  InfTextSession* session;
+  GString* order;
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  gchar* user_name;
+  guint i;
+  gboolean result;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    TEST_BUDGET_INITIAL,
+    strlen(TEST_BUDGET_INITIAL),
+    strlen(TEST_BUDGET_INITIAL),
+    NULL
+  );
+
+  manager = inf_communication_manager_new();
+  io = inf_standalone_io_new();
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= 3; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    INF_IO(io),
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_set(G_OBJECT(session), "translation-budget", 1, NULL);
+
+  order = g_string_new(NULL);
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))),
+    "begin-execute-request",
+    G_CALLBACK(test_budget_execute_request_cb),
+    order
+  );
+
+  for(i = 0; i < G_N_ELEMENTS(TEST_BUDGET_REQUESTS); ++i)
+  {
+    /* The time of each request is given relative to the requests of its
+     * user that have been received already, and no other requests have
+     * been seen by any of the users. */
+    xml = xmlNewNode(NULL, (const xmlChar*)"request");
+    inf_xml_util_set_attribute_uint(xml, "user", TEST_BUDGET_REQUESTS[i].user);
+    inf_xml_util_set_attribute(xml, "time", "");
+
+    child = xmlNewChild(
+      xml,
+      NULL,
+      (const xmlChar*)"insert",
+      (const xmlChar*)TEST_BUDGET_REQUESTS[i].text
+    );
+
+    inf_xml_util_set_attribute_uint(child, "pos", TEST_BUDGET_REQUESTS[i].pos);
+
+    inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(session),
+      NULL,
+      xml
+    );
+
+    xmlFreeNode(xml);
+  }
+
+  result = TRUE;
+
+  /* The request of user 2 is concurrent to both requests of user 1, which
+   * exceeds the budget, and the request of user 3 has to wait for it. */
+  if(!test_budget_check_buffer(name, buffer, TEST_BUDGET_HELD))
+    result = FALSE;
+
+  if(reset_budget)
+  {
+    g_object_set(G_OBJECT(session), "translation-budget", 0, NULL);
+  }
+  else
+  {
+    /* Each iteration translates the held request across one other request,
+     * so a few iterations are enough to execute everything. */
+    for(i = 0; i < 100 && order->len < strlen(TEST_BUDGET_ORDER); ++i)
+      inf_standalone_io_iteration_timeout(io, 0);
+  }
+
+  if(!test_budget_check_buffer(name, buffer, TEST_BUDGET_FINAL))
+    result = FALSE;
+
+  if(strcmp(order->str, TEST_BUDGET_ORDER) != 0)
+  {
+    printf(
+      "%s: requests executed in order \"%s\" instead of \"%s\"\n",
+      name,
+      order->str,
+      TEST_BUDGET_ORDER
+    );
+
+    result = FALSE;
+  }
+
+  g_string_free(order, TRUE);
+
+  g_object_unref(session);
+  g_object_unref(user_table);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(buffer);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+
+  ++total;
+  if(test_budget("main-loop", FALSE)) ++passed;
+  ++total;
+  if(test_budget("reset-budget", TRUE)) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -17,6 +17,26 @@
  * MA 02110-1301, USA.
  */
 
+/* Replays traffic logs written by the traffic-logging plugin of infinoted
+ * against a server, one connection per log file, and checks that the server
+ * sends the same messages as recorded.
+ *
+ * With -b, the replay is run as a benchmark: no messages are printed, and
+ * the number of messages per second and the queueing delay are reported at
+ * the end. The queueing delay is the time the replay has to wait for an
+ * expected message from the server after all messages preceding it in the
+ * logs have been processed. With -s, messages are sent at the given
+ * multiple of the originally recorded speed instead of as fast as
+ * possible. With -p, the CPU time used by the server process with the
+ * given PID during the replay is reported as well (only on Linux):
+ *
+ * ./inf-test-traffic-replay -b -s 2 -p `pidof infinoted-0.7` log1 log2 log3
+ *
+ * Both the text logs and the binary capture files written by the plugin
+ * with format=binary can be replayed; the format is detected from the
+ * beginning of each file.
+ */
+
 #define _XOPEN_SOURCE 700
 #include "util/inf-test-util.h"
 
@@ -33,9 +53,14 @@
 
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <assert.h>
 
+#ifdef __linux__
+# include <unistd.h>
+#endif
+
 typedef struct _InfTestTrafficReplay InfTestTrafficReplay;
 struct _InfTestTrafficReplay {
   InfStandaloneIo* io;
@@ -43,6 +68,19 @@ struct _InfTestTrafficReplay {
   InfdXmppServer* xmpp;
   const gchar* filename;
   GSList* conns;
+
+  /* Benchmark mode */
+  gboolean benchmark;
+  gdouble speed; /* 0.0 means as fast as possible */
+  gint server_pid;
+
+  gint64 first_timestamp;
+  gint64 start_time;
+  InfIoTimeout* timeout;
+
+  guint n_sent;
+  guint n_received;
+  GArray* delays;
 };
 
 typedef enum _InfTestTrafficReplayMessageType {
@@ -68,15 +106,25 @@ struct _InfTestTrafficReplayConnection {
   InfCertificateCredentials* creds;
   InfXmppConnection* xmpp;
   FILE* file;
+  gboolean binary;
   InfTestTrafficReplayMessage* message;
   GHashTable* group_queues; /* group name -> GQueue */
+
+  /* Time since which the current incoming message is being waited for,
+   * or 0 */
+  gint64 expected_since;
 };
 
 typedef enum _InfTestTrafficReplayError {
   INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_LINE,
+  INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_RECORD,
   INF_TEST_TRAFFIC_REPLAY_ERROR_UNEXPECTED_EOF
 } InfTestTrafficReplayError;
 
+/* See infinoted-plugin-traffic-logging.c for the binary capture format */
+static const char INF_TEST_TRAFFIC_REPLAY_BINARY_MAGIC[8] = "INFTRAF1";
+static const guint32 INF_TEST_TRAFFIC_REPLAY_MAX_RECORD_SIZE = 64 << 20;
+
 static GQuark
 inf_test_traffic_replay_error_quark()
 {
@@ -111,6 +159,35 @@ inf_test_traffic_replay_message_free(InfTestTrafficReplayMessage* message)
   g_slice_free(InfTestTrafficReplayMessage, message);
 }
 
+static void
+inf_test_traffic_replay_set_read_error(InfTestTrafficReplayConnection* conn,
+                                       GError** error)
+{
+  int err;
+
+  if(feof(conn->file))
+  {
+    /* TODO: We should treat this is a "log closed" event */
+    g_set_error(
+      error,
+      inf_test_traffic_replay_error_quark(),
+      INF_TEST_TRAFFIC_REPLAY_ERROR_UNEXPECTED_EOF,
+      "Unexpected end of file"
+    );
+  }
+  else
+  {
+    err = ferror(conn->file);
+
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(err),
+      strerror(err)
+    );
+  }
+}
+
 static char*
 inf_test_traffic_replay_get_next_line(InfTestTrafficReplayConnection* conn,
                                       size_t* len,
@@ -119,7 +196,6 @@ inf_test_traffic_replay_get_next_line(InfTestTrafficReplayConnection* conn,
   char* line;
   size_t n;
   ssize_t len_;
-  int err;
 
   line = NULL;
   n = 0;
@@ -132,30 +208,156 @@ inf_test_traffic_replay_get_next_line(InfTestTrafficReplayConnection* conn,
   }
   else
   {
-    if(feof(conn->file))
+    inf_test_traffic_replay_set_read_error(conn, error);
+    return NULL;
+  }
+}
+
+/* Checks whether conn->file is a binary capture file, and skips its header
+ * if so. Other files are read as text logs from the beginning. */
+static void
+inf_test_traffic_replay_detect_format(InfTestTrafficReplayConnection* conn)
+{
+  char magic[sizeof(INF_TEST_TRAFFIC_REPLAY_BINARY_MAGIC)];
+
+  conn->binary =
+    fread(magic, 1, sizeof(magic), conn->file) == sizeof(magic) &&
+    memcmp(magic, INF_TEST_TRAFFIC_REPLAY_BINARY_MAGIC, sizeof(magic)) == 0;
+
+  if(!conn->binary)
+    rewind(conn->file);
+}
+
+static InfTestTrafficReplayMessage*
+inf_test_traffic_replay_message_new(gint64 timestamp,
+                                    InfTestTrafficReplayMessageType type,
+                                    xmlDocPtr xml)
+{
+  InfTestTrafficReplayMessage* message;
+
+  message = g_slice_new(InfTestTrafficReplayMessage);
+  message->timestamp = timestamp;
+  message->type = type;
+  if(type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING ||
+     type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_OUTGOING)
+  {
+    message->xml = xmlCopyNode(xmlDocGetRootElement(xml), 1);
+    if(type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING)
+      message->xml_iter = message->xml->children;
+    xmlFreeDoc(xml);
+  }
+
+  return message;
+}
+
+static InfTestTrafficReplayMessage*
+inf_test_traffic_replay_get_next_record(InfTestTrafficReplayConnection* conn,
+                                        GError** error)
+{
+  guchar header[13];
+  gint64 timestamp;
+  guint32 len;
+  gchar* payload;
+  InfTestTrafficReplayMessageType type;
+  xmlDocPtr xml;
+  guint i;
+
+  if(fread(header, 1, sizeof(header), conn->file) != sizeof(header))
+  {
+    inf_test_traffic_replay_set_read_error(conn, error);
+    return NULL;
+  }
+
+  timestamp = 0;
+  for(i = 1; i < 9; ++i)
+    timestamp = (timestamp << 8) | header[i];
+
+  len = 0;
+  for(i = 9; i < 13; ++i)
+    len = (len << 8) | header[i];
+
+  switch(header[0])
+  {
+  case '<':
+    /* received by the server */
+    type = INF_TEST_TRAFFIC_REPLAY_MESSAGE_OUTGOING;
+    break;
+  case '>':
+    /* sent by the server */
+    type = INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING;
+    break;
+  case 'C':
+    type = INF_TEST_TRAFFIC_REPLAY_MESSAGE_CONNECT;
+    break;
+  case 'D':
+    type = INF_TEST_TRAFFIC_REPLAY_MESSAGE_DISCONNECT;
+    break;
+  case 'E':
+    type = INF_TEST_TRAFFIC_REPLAY_MESSAGE_ERROR;
+    break;
+  default:
+    g_set_error(
+      error,
+      inf_test_traffic_replay_error_quark(),
+      INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_RECORD,
+      "Unknown record type \"%c\" (%d)",
+      header[0],
+      (int)header[0]
+    );
+
+    return NULL;
+  }
+
+  if(len > INF_TEST_TRAFFIC_REPLAY_MAX_RECORD_SIZE)
+  {
+    g_set_error(
+      error,
+      inf_test_traffic_replay_error_quark(),
+      INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_RECORD,
+      "Record of %u bytes is too large",
+      (guint)len
+    );
+
+    return NULL;
+  }
+
+  payload = g_malloc(len);
+  if(fread(payload, 1, len, conn->file) != len)
+  {
+    inf_test_traffic_replay_set_read_error(conn, error);
+    g_free(payload);
+    return NULL;
+  }
+
+  xml = NULL;
+  if(type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING ||
+     type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_OUTGOING)
+  {
+    xml = xmlReadMemory(
+      payload,
+      len,
+      NULL,
+      "UTF-8",
+      XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+    );
+
+    if(xml == NULL)
     {
-      /* TODO: We should treat this is a "log closed" event */
       g_set_error(
         error,
         inf_test_traffic_replay_error_quark(),
-        INF_TEST_TRAFFIC_REPLAY_ERROR_UNEXPECTED_EOF,
-        "Unexpected end of file"
+        INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_RECORD,
+        "Failed to parse XML of a %u byte record",
+        (guint)len
       );
-    }
-    else
-    {
-      err = ferror(conn->file);
 
-      g_set_error_literal(
-        error,
-        G_FILE_ERROR,
-        g_file_error_from_errno(err),
-        strerror(err)
-      );
+      g_free(payload);
+      return NULL;
     }
-
-    return NULL;
   }
+
+  g_free(payload);
+  return inf_test_traffic_replay_message_new(timestamp, type, xml);
 }
 
 static InfTestTrafficReplayMessage*
@@ -175,7 +377,8 @@ inf_test_traffic_replay_get_next_message(InfTestTrafficReplayConnection* conn,
   xmlDocPtr xml;
   GString* str;
 
-  InfTestTrafficReplayMessage* message;
+  if(conn->binary)
+    return inf_test_traffic_replay_get_next_record(conn, error);
 
   line = inf_test_traffic_replay_get_next_line(conn, &len, error);
   if(!line) return NULL;
@@ -232,6 +435,7 @@ inf_test_traffic_replay_get_next_message(InfTestTrafficReplayConnection* conn,
   tm.tm_isdst = 1;
 
   /* interpret message */
+  xml = NULL;
   n = (end - line) + 1;
   if(line[n] == '!')
   {
@@ -312,19 +516,11 @@ inf_test_traffic_replay_get_next_message(InfTestTrafficReplayConnection* conn,
 
   free(line);
 
-  message = g_slice_new(InfTestTrafficReplayMessage);
-  message->timestamp = (gint64)mktime(&tm) * 1000000 + msecs;
-  message->type = type;
-  if(type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING ||
-     type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_OUTGOING)
-  {
-    message->xml = xmlCopyNode(xmlDocGetRootElement(xml), 1);
-    if(type == INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING)
-      message->xml_iter = message->xml->children;
-    xmlFreeDoc(xml);
-  }
-
-  return message;
+  return inf_test_traffic_replay_message_new(
+    (gint64)mktime(&tm) * 1000000 + msecs,
+    type,
+    xml
+  );
 }
 
 static void
@@ -373,6 +569,17 @@ inf_test_traffic_replay_connection_close(InfTestTrafficReplayConnection* conn)
   g_slice_free(InfTestTrafficReplayConnection, conn);
 }
 
+static void
+inf_test_traffic_replay_connection_received(
+  InfTestTrafficReplayConnection* conn,
+  gint64 delay)
+{
+  ++conn->replay->n_received;
+  if(conn->replay->benchmark)
+    g_array_append_val(conn->replay->delays, delay);
+  conn->expected_since = 0;
+}
+
 static void
 inf_test_traffic_replay_connection_check_message(
   InfTestTrafficReplayConnection* conn,
@@ -503,7 +710,10 @@ inf_test_traffic_replay_connection_process_next_message(
   case INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING:
     g_assert(conn->xmpp != NULL);
     group = xmlGetProp(conn->message->xml, "name");
-    fprintf(stderr, "[%s] Expecting data (%s, %s)\n", conn->name, group, conn->message->xml_iter->name); /* TODO: write what data? */
+    if(!conn->replay->benchmark)
+      fprintf(stderr, "[%s] Expecting data (%s, %s)\n", conn->name, group, conn->message->xml_iter->name); /* TODO: write what data? */
+    if(conn->expected_since == 0)
+      conn->expected_since = g_get_monotonic_time();
     queue = g_hash_table_lookup(conn->group_queues, group);
     xmlFree(group);
 
@@ -516,7 +726,8 @@ inf_test_traffic_replay_connection_process_next_message(
     g_assert(conn->xmpp != NULL);
 
     group = xmlGetProp(conn->message->xml, "name");
-    fprintf(stderr, "[%s] Sending data (%s, %s)\n", conn->name, group, conn->message->xml->children->name); /* TODO: write what data? */
+    if(!conn->replay->benchmark)
+      fprintf(stderr, "[%s] Sending data (%s, %s)\n", conn->name, group, conn->message->xml->children->name); /* TODO: write what data? */
     xmlFree(group);
 
     /* send the data */
@@ -526,6 +737,7 @@ inf_test_traffic_replay_connection_process_next_message(
     );
 
     conn->message->xml = NULL;
+    ++conn->replay->n_sent;
     return TRUE;
   default:
     g_assert_not_reached();
@@ -589,7 +801,12 @@ inf_test_traffic_replay_connection_fetch_next_message(
     {
       xml = g_queue_pop_head(queue);
 
-      fprintf(stderr, "[%s] Replay data (%s, %s)\n", conn->name, group, xml->name);
+      if(!conn->replay->benchmark)
+        fprintf(stderr, "[%s] Replay data (%s, %s)\n", conn->name, group, xml->name);
+
+      /* The message arrived before it was expected, so there was no
+       * queueing delay. */
+      inf_test_traffic_replay_connection_received(conn, 0);
 
       inf_test_traffic_replay_connection_check_message(conn, xml);
       inf_test_traffic_replay_connection_fetch_next_message(conn);
@@ -604,6 +821,16 @@ inf_test_traffic_replay_connection_fetch_next_message(
   inf_test_traffic_replay_process_next_message(conn->replay);
 }
 
+static void
+inf_test_traffic_replay_timeout_func(gpointer user_data)
+{
+  InfTestTrafficReplay* replay;
+  replay = (InfTestTrafficReplay*)user_data;
+
+  replay->timeout = NULL;
+  inf_test_traffic_replay_process_next_message(replay);
+}
+
 static void
 inf_test_traffic_replay_process_next_message(InfTestTrafficReplay* replay)
 {
@@ -611,10 +838,18 @@ inf_test_traffic_replay_process_next_message(InfTestTrafficReplay* replay)
   GSList* item;
   InfTestTrafficReplayConnection* conn;
   InfTestTrafficReplayConnection* low;
+  gint64 due;
+  gint64 now;
 
   if(!inf_standalone_io_loop_running(replay->io))
     return;
 
+  if(replay->timeout != NULL)
+  {
+    inf_io_remove_timeout(INF_IO(replay->io), replay->timeout);
+    replay->timeout = NULL;
+  }
+
   low = NULL;
   for(item = replay->conns; item != NULL; item = item->next)
   {
@@ -633,6 +868,31 @@ inf_test_traffic_replay_process_next_message(InfTestTrafficReplay* replay)
     }
   }
 
+  /* In timed mode, wait with sending messages and opening connections
+   * until their time has come. Incoming messages are processed right away,
+   * since it is up to the server when they arrive. */
+  if(replay->speed > 0.0 &&
+     low->message->type != INF_TEST_TRAFFIC_REPLAY_MESSAGE_INCOMING)
+  {
+    due = replay->start_time +
+      (gint64)((low->message->timestamp - replay->first_timestamp) /
+               replay->speed);
+    now = g_get_monotonic_time();
+
+    if(due > now)
+    {
+      replay->timeout = inf_io_add_timeout(
+        INF_IO(replay->io),
+        (due - now + 999) / 1000,
+        inf_test_traffic_replay_timeout_func,
+        replay,
+        NULL
+      );
+
+      return;
+    }
+  }
+
   if(inf_test_traffic_replay_connection_process_next_message(low))
   {
     if(g_slist_find(replay->conns, low))
@@ -688,14 +948,17 @@ inf_test_traffic_replay_received_cb(InfXmppConnection* connection,
     received_group = xmlGetProp(xml, "name");
     expected_group = xmlGetProp(conn->message->xml, "name");
 
-    fprintf(
-      stderr,
-      "[%s] Received data (%s, %s), expected %s\n",
-      conn->name,
-      received_group,
-      child->name,
-      expected_group
-    );
+    if(!conn->replay->benchmark)
+    {
+      fprintf(
+        stderr,
+        "[%s] Received data (%s, %s), expected %s\n",
+        conn->name,
+        received_group,
+        child->name,
+        expected_group
+      );
+    }
 
     /* TODO: Figure out why this assertion fires */
     queue = g_hash_table_lookup(conn->group_queues, expected_group);
@@ -730,6 +993,18 @@ inf_test_traffic_replay_received_cb(InfXmppConnection* connection,
       xmlFree(received_group);
       xmlFree(expected_group);
 
+      if(conn->expected_since != 0)
+      {
+        inf_test_traffic_replay_connection_received(
+          conn,
+          g_get_monotonic_time() - conn->expected_since
+        );
+      }
+      else
+      {
+        inf_test_traffic_replay_connection_received(conn, 0);
+      }
+
       inf_test_traffic_replay_connection_check_message(conn, child);
       inf_test_traffic_replay_connection_fetch_next_message(conn);
     }
@@ -782,7 +1057,9 @@ inf_test_traffic_replay_new_connection_cb(InfdXmppServer* server,
   conn->replay = replay;
   conn->creds = NULL;
   conn->xmpp = xmpp;
-  
+  conn->binary = FALSE;
+  conn->expected_since = 0;
+
   conn->group_queues = g_hash_table_new_full(
     g_str_hash,
     g_str_equal,
@@ -821,7 +1098,7 @@ inf_test_traffic_replay_new_connection_cb(InfdXmppServer* server,
     conn
   );
 
-  conn->file = fopen(replay->filename, "r");
+  conn->file = fopen(replay->filename, "rb");
   if(!conn->file)
   {
     fprintf(
@@ -835,6 +1112,8 @@ inf_test_traffic_replay_new_connection_cb(InfdXmppServer* server,
   }
   else
   {
+    inf_test_traffic_replay_detect_format(conn);
+
     g_object_get(G_OBJECT(conn->xmpp), "status", &status, NULL);
     if(status == INF_XML_CONNECTION_OPEN)
     {
@@ -948,10 +1227,120 @@ inf_test_traffic_replay_load_client_credentials(const gchar* path,
   return creds;
 }
 
+static gboolean
+inf_test_traffic_replay_get_cpu_time(gint pid,
+                                     gint64* cpu_time)
+{
+#ifdef __linux__
+  gchar* filename;
+  gchar* contents;
+  gchar* pos;
+  gboolean result;
+  unsigned long utime;
+  unsigned long stime;
+
+  filename = g_strdup_printf("/proc/%d/stat", pid);
+  result = g_file_get_contents(filename, &contents, NULL, NULL);
+  g_free(filename);
+
+  if(!result)
+    return FALSE;
+
+  /* utime and stime are the 14th and 15th field. The second field is the
+   * command name in parentheses, which might contain spaces. */
+  pos = strrchr(contents, ')');
+  result = pos != NULL &&
+    sscanf(pos + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+           &utime, &stime) == 2;
+  g_free(contents);
+
+  if(result)
+    *cpu_time = (gint64)(utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+  return result;
+#else
+  return FALSE;
+#endif
+}
+
+static gint
+inf_test_traffic_replay_delay_compare(gconstpointer first,
+                                      gconstpointer second)
+{
+  gint64 a;
+  gint64 b;
+
+  a = *(const gint64*)first;
+  b = *(const gint64*)second;
+  return (a > b) - (a < b);
+}
+
+static double
+inf_test_traffic_replay_delay_percentile(GArray* delays,
+                                         double p)
+{
+  if(delays->len == 0)
+    return 0.0;
+
+  return g_array_index(
+    delays,
+    gint64,
+    (guint)(p * (delays->len - 1))
+  ) / 1000.0;
+}
+
+static void
+inf_test_traffic_replay_report(InfTestTrafficReplay* replay,
+                               gint64 cpu_time)
+{
+  double secs;
+  guint n_messages;
+
+  secs = (g_get_monotonic_time() - replay->start_time) / 1000000.0;
+  n_messages = replay->n_sent + replay->n_received;
+  g_array_sort(replay->delays, inf_test_traffic_replay_delay_compare);
+
+  printf(
+    "Duration: %.3f s\n"
+    "Messages: %u sent, %u received (%.1f/s)\n"
+    "Queueing delay: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+    secs,
+    replay->n_sent,
+    replay->n_received,
+    secs > 0.0 ? n_messages / secs : 0.0,
+    inf_test_traffic_replay_delay_percentile(replay->delays, 0.5),
+    inf_test_traffic_replay_delay_percentile(replay->delays, 0.99),
+    inf_test_traffic_replay_delay_percentile(replay->delays, 1.0)
+  );
+
+  if(cpu_time >= 0)
+  {
+    printf(
+      "Server CPU: %.3f s (%.1f us per message)\n",
+      cpu_time / 1000000.0,
+      n_messages > 0 ? cpu_time / (double)n_messages : 0.0
+    );
+  }
+}
+
 static void
 inf_test_traffic_replay_start_func(gpointer user_data)
 {
-  inf_test_traffic_replay_process_next_message(user_data);
+  InfTestTrafficReplay* replay;
+  GSList* item;
+  InfTestTrafficReplayConnection* conn;
+
+  replay = (InfTestTrafficReplay*)user_data;
+
+  replay->first_timestamp = G_MAXINT64;
+  for(item = replay->conns; item != NULL; item = item->next)
+  {
+    conn = (InfTestTrafficReplayConnection*)item->data;
+    if(conn->message->timestamp < replay->first_timestamp)
+      replay->first_timestamp = conn->message->timestamp;
+  }
+
+  replay->start_time = g_get_monotonic_time();
+  inf_test_traffic_replay_process_next_message(replay);
 }
 
 int main(int argc, char* argv[])
@@ -964,15 +1353,51 @@ int main(int argc, char* argv[])
   guint port;
 
   int i;
+  int first_file;
   FILE* f;
   InfTestTrafficReplayConnection* conn;
+  gint64 cpu_begin;
+  gint64 cpu_end;
 
   as_server = FALSE;
   port = 6524;
 
-  if(argc < 2)
+  replay.benchmark = FALSE;
+  replay.speed = 0.0;
+  replay.server_pid = 0;
+
+  first_file = 1;
+  while(first_file < argc)
   {
-    fprintf(stderr, "Usage: %s <traffic-log>\n", argv[0]);
+    if(strcmp(argv[first_file], "-b") == 0)
+    {
+      replay.benchmark = TRUE;
+      ++first_file;
+    }
+    else if(strcmp(argv[first_file], "-s") == 0 && first_file + 1 < argc)
+    {
+      replay.speed = g_ascii_strtod(argv[first_file + 1], NULL);
+      first_file += 2;
+    }
+    else if(strcmp(argv[first_file], "-p") == 0 && first_file + 1 < argc)
+    {
+      replay.server_pid = atoi(argv[first_file + 1]);
+      first_file += 2;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if(argc <= first_file || replay.speed < 0.0)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [-b] [-s <speed>] [-p <server-pid>] <traffic-log> ...\n",
+      argv[0]
+    );
+
     return -1;
   }
 
@@ -988,10 +1413,16 @@ int main(int argc, char* argv[])
   replay.port = port;
   replay.xmpp = NULL;
   replay.conns = NULL;
+  replay.first_timestamp = 0;
+  replay.start_time = 0;
+  replay.timeout = NULL;
+  replay.n_sent = 0;
+  replay.n_received = 0;
+  replay.delays = g_array_new(FALSE, FALSE, sizeof(gint64));
 
   if(as_server == TRUE)
   {
-    replay.filename = argv[1];
+    replay.filename = argv[first_file];
 
     creds = inf_test_traffic_replay_load_server_credentials(&error);
     if(!creds)
@@ -1040,9 +1471,9 @@ int main(int argc, char* argv[])
   {
     replay.filename = NULL;
 
-    for(i = 1; i < argc; ++i)
+    for(i = first_file; i < argc; ++i)
     {
-      f = fopen(argv[i], "r");
+      f = fopen(argv[i], "rb");
       if(!f)
       {
         fprintf(
@@ -1060,6 +1491,8 @@ int main(int argc, char* argv[])
       conn->name = g_strdup_printf("client %d (%s)", i, argv[i]);
       conn->xmpp = NULL;
       conn->file = f;
+      conn->expected_since = 0;
+      inf_test_traffic_replay_detect_format(conn);
 
       conn->group_queues = g_hash_table_new_full(
         g_str_hash,
@@ -1120,9 +1553,34 @@ int main(int argc, char* argv[])
     );
   }
 
+  cpu_begin = -1;
+  if(replay.server_pid > 0 &&
+     !inf_test_traffic_replay_get_cpu_time(replay.server_pid, &cpu_begin))
+  {
+    fprintf(stderr, "Cannot read CPU time of process %d\n", replay.server_pid);
+    cpu_begin = -1;
+  }
+
   inf_standalone_io_loop(replay.io);
 
+  if(replay.benchmark)
+  {
+    cpu_end = -1;
+    if(cpu_begin >= 0 &&
+       inf_test_traffic_replay_get_cpu_time(replay.server_pid, &cpu_end))
+    {
+      cpu_end -= cpu_begin;
+    }
+    else
+    {
+      cpu_end = -1;
+    }
+
+    inf_test_traffic_replay_report(&replay, cpu_end);
+  }
+
   /* TODO: cleanup... */
+  g_array_free(replay.delays, TRUE);
 
   return 0;
 }
@@ -0,0 +1,723 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the throughput and latency of InfXmppConnection over loopback.
+ * A server and a number of clients run in this process, on the same
+ * InfStandaloneIo. Each client sends messages with a text payload of the
+ * given size, keeping up to the given number of them in flight, and the
+ * server echoes every message back. This is meant to compare the
+ * performance of the network code before and after a change, for example
+ * to send coalescing or buffer sizes:
+ *
+ * ./inf-test-xmpp-benchmark -n 100000 -s 64 -d 16
+ * ./inf-test-xmpp-benchmark -T -n 100000 -s 64 -d 16
+ *
+ * Options:
+ *   -n <messages>     Messages per connection [Default=10000]
+ *   -s <bytes>        Payload size of each message [Default=64]
+ *   -d <depth>        Messages in flight per connection [Default=1]
+ *   -c <connections>  Number of client connections [Default=1]
+ *   -z <level>        Stream compression level, 0 to disable [Default=0]
+ *   -T                Use TLS, with key.pem and cert.pem from the current
+ *                     directory as the server's key and certificate
+ *   -t                Print one tab-separated line to stdout instead
+ *
+ * The tab-separated line has the columns tls, compression, size, depth,
+ * connections, messages, seconds, messages-per-sec, mb-per-sec,
+ * avg-latency-us, p99-latency-us, cpu-us-per-message and
+ * syscalls-per-message. A message is one round trip, and MB/s counts the
+ * payload in both directions. CPU time and syscalls are those of the whole
+ * process, so they include both the client and the server side. The number
+ * of syscalls is the number of read and write calls, which is only
+ * available on Linux; it is reported as -1 elsewhere.
+ */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-cert-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef G_OS_UNIX
+# include <sys/resource.h>
+#endif
+
+typedef struct _InfTestXmppBenchmark InfTestXmppBenchmark;
+struct _InfTestXmppBenchmark {
+  InfStandaloneIo* io;
+  xmlNodePtr message;
+
+  guint n_messages;
+  guint depth;
+  guint n_clients;
+
+  GSList* clients;
+  GSList* server_connections;
+  guint n_open;
+  guint n_finished;
+  gboolean failed;
+
+  /* Round trip times in microseconds, of all connections */
+  GArray* latencies;
+
+  gint64 begin;
+  gint64 end;
+  gint64 cpu_begin;
+  gint64 cpu_end;
+  gint64 syscalls_begin;
+  gint64 syscalls_end;
+};
+
+typedef struct _InfTestXmppBenchmarkClient InfTestXmppBenchmarkClient;
+struct _InfTestXmppBenchmarkClient {
+  InfTestXmppBenchmark* benchmark;
+  InfXmppConnection* xmpp;
+  gboolean open;
+
+  guint n_sent;
+  guint n_received;
+  /* Send times of the messages in flight. Replies arrive in order, so the
+   * reply to message i is for the entry at i % depth. */
+  gint64* send_times;
+};
+
+static gint64
+inf_test_xmpp_benchmark_get_cpu_time(void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+    return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+      + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  }
+#endif
+  return 0;
+}
+
+/* Returns the number of read and write system calls made by this process
+ * so far, or -1 if it is not known. */
+static gint64
+inf_test_xmpp_benchmark_get_syscalls(void)
+{
+#ifdef __linux__
+  gchar* contents;
+  gchar* pos;
+  gint64 syscr;
+  gint64 syscw;
+
+  if(!g_file_get_contents("/proc/self/io", &contents, NULL, NULL))
+    return -1;
+
+  syscr = -1;
+  syscw = -1;
+
+  pos = strstr(contents, "syscr:");
+  if(pos != NULL)
+    syscr = g_ascii_strtoll(pos + 6, NULL, 10);
+
+  pos = strstr(contents, "syscw:");
+  if(pos != NULL)
+    syscw = g_ascii_strtoll(pos + 6, NULL, 10);
+
+  g_free(contents);
+
+  if(syscr < 0 || syscw < 0)
+    return -1;
+  return syscr + syscw;
+#else
+  return -1;
+#endif
+}
+
+static xmlNodePtr
+inf_test_xmpp_benchmark_create_message(guint size)
+{
+  static const gchar chars[] =
+    "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789\n";
+
+  xmlNodePtr message;
+  GRand* rand;
+  gchar* text;
+  guint i;
+
+  /* Use random text, so that compression does not make the payload
+   * vanish, but the same text in every run, so that results are
+   * comparable. */
+  rand = g_rand_new_with_seed(size);
+  text = g_malloc(size + 1);
+  for(i = 0; i < size; ++i)
+    text[i] = chars[g_rand_int_range(rand, 0, sizeof(chars) - 1)];
+  text[size] = '\0';
+  g_rand_free(rand);
+
+  message = xmlNewNode(NULL, (const xmlChar*)"benchmark");
+  xmlNodeAddContentLen(message, (const xmlChar*)text, size);
+  g_free(text);
+
+  return message;
+}
+
+static void
+inf_test_xmpp_benchmark_send(InfTestXmppBenchmarkClient* client)
+{
+  client->send_times[client->n_sent % client->benchmark->depth] =
+    g_get_monotonic_time();
+  ++client->n_sent;
+
+  inf_xml_connection_send(
+    INF_XML_CONNECTION(client->xmpp),
+    xmlCopyNode(client->benchmark->message, 1)
+  );
+}
+
+static void
+inf_test_xmpp_benchmark_start(InfTestXmppBenchmark* benchmark)
+{
+  InfTestXmppBenchmarkClient* client;
+  GSList* item;
+  guint i;
+
+  benchmark->begin = g_get_monotonic_time();
+  benchmark->cpu_begin = inf_test_xmpp_benchmark_get_cpu_time();
+  benchmark->syscalls_begin = inf_test_xmpp_benchmark_get_syscalls();
+
+  for(item = benchmark->clients; item != NULL; item = item->next)
+  {
+    client = (InfTestXmppBenchmarkClient*)item->data;
+    for(i = 0; i < benchmark->depth && i < benchmark->n_messages; ++i)
+      inf_test_xmpp_benchmark_send(client);
+  }
+}
+
+static void
+inf_test_xmpp_benchmark_stop(InfTestXmppBenchmark* benchmark)
+{
+  benchmark->end = g_get_monotonic_time();
+  benchmark->cpu_end = inf_test_xmpp_benchmark_get_cpu_time();
+  benchmark->syscalls_end = inf_test_xmpp_benchmark_get_syscalls();
+
+  inf_standalone_io_loop_quit(benchmark->io);
+}
+
+static void
+inf_test_xmpp_benchmark_client_received_cb(InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           gpointer user_data)
+{
+  InfTestXmppBenchmarkClient* client;
+  InfTestXmppBenchmark* benchmark;
+  gint64 latency;
+
+  client = (InfTestXmppBenchmarkClient*)user_data;
+  benchmark = client->benchmark;
+
+  g_assert(client->n_received < client->n_sent);
+
+  latency = g_get_monotonic_time() -
+    client->send_times[client->n_received % benchmark->depth];
+  g_array_append_val(benchmark->latencies, latency);
+  ++client->n_received;
+
+  if(client->n_sent < benchmark->n_messages)
+    inf_test_xmpp_benchmark_send(client);
+
+  if(client->n_received == benchmark->n_messages)
+  {
+    ++benchmark->n_finished;
+    if(benchmark->n_finished == benchmark->n_clients)
+      inf_test_xmpp_benchmark_stop(benchmark);
+  }
+}
+
+static void
+inf_test_xmpp_benchmark_client_notify_status_cb(GObject* object,
+                                                GParamSpec* pspec,
+                                                gpointer user_data)
+{
+  InfTestXmppBenchmarkClient* client;
+  InfTestXmppBenchmark* benchmark;
+  InfXmlConnectionStatus status;
+
+  client = (InfTestXmppBenchmarkClient*)user_data;
+  benchmark = client->benchmark;
+
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_OPEN && !client->open)
+  {
+    client->open = TRUE;
+    ++benchmark->n_open;
+
+    if(benchmark->n_open == benchmark->n_clients)
+      inf_test_xmpp_benchmark_start(benchmark);
+  }
+  else if(status == INF_XML_CONNECTION_CLOSED &&
+          client->n_received < benchmark->n_messages)
+  {
+    fprintf(stderr, "Connection closed before the benchmark finished\n");
+    benchmark->failed = TRUE;
+    inf_standalone_io_loop_quit(benchmark->io);
+  }
+}
+
+static void
+inf_test_xmpp_benchmark_error_cb(InfXmlConnection* connection,
+                                 const GError* error,
+                                 gpointer user_data)
+{
+  fprintf(stderr, "Connection error: %s\n", error->message);
+}
+
+static void
+inf_test_xmpp_benchmark_server_received_cb(InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           gpointer user_data)
+{
+  inf_xml_connection_send(connection, xmlCopyNode(xml, 1));
+}
+
+static void
+inf_test_xmpp_benchmark_new_connection_cb(InfdXmlServer* server,
+                                          InfXmlConnection* connection,
+                                          gpointer user_data)
+{
+  InfTestXmppBenchmark* benchmark;
+  benchmark = (InfTestXmppBenchmark*)user_data;
+
+  g_object_ref(connection);
+  benchmark->server_connections =
+    g_slist_prepend(benchmark->server_connections, connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_xmpp_benchmark_server_received_cb),
+    benchmark
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "error",
+    G_CALLBACK(inf_test_xmpp_benchmark_error_cb),
+    benchmark
+  );
+}
+
+static InfCertificateCredentials*
+inf_test_xmpp_benchmark_load_credentials(GError** error)
+{
+  GPtrArray* array;
+  gnutls_x509_privkey_t key;
+  InfCertificateCredentials* creds;
+  gnutls_certificate_credentials_t gcreds;
+  guint i;
+
+  key = inf_cert_util_read_private_key("key.pem", error);
+  if(!key) return NULL;
+
+  array = inf_cert_util_read_certificate("cert.pem", NULL, error);
+  if(!array)
+  {
+    gnutls_x509_privkey_deinit(key);
+    return NULL;
+  }
+
+  creds = inf_certificate_credentials_new();
+  gcreds = inf_certificate_credentials_get(creds);
+
+  gnutls_certificate_set_x509_key(
+    gcreds,
+    (gnutls_x509_crt_t*)array->pdata,
+    array->len,
+    key
+  );
+
+  gnutls_x509_privkey_deinit(key);
+  for(i = 0; i < array->len; ++i)
+    gnutls_x509_crt_deinit(array->pdata[i]);
+  g_ptr_array_free(array, TRUE);
+
+  return creds;
+}
+
+static gint
+inf_test_xmpp_benchmark_latency_compare(gconstpointer first,
+                                        gconstpointer second)
+{
+  gint64 a;
+  gint64 b;
+
+  a = *(const gint64*)first;
+  b = *(const gint64*)second;
+  return (a > b) - (a < b);
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestXmppBenchmark benchmark;
+  InfTestXmppBenchmarkClient* client;
+  InfXmppConnectionSecurityPolicy policy;
+  InfCertificateCredentials* creds;
+  InfdTcpServer* tcp_server;
+  InfdXmppServer* xmpp_server;
+  InfTcpConnection* tcp;
+  InfIpAddress* addr;
+  GError* error;
+  GSList* item;
+  gboolean tls;
+  gboolean tabular;
+  guint size;
+  guint compression_level;
+  guint port;
+  guint i;
+  int arg;
+
+  guint n_total;
+  double seconds;
+  double messages_per_sec;
+  double mb_per_sec;
+  double avg_latency;
+  gint64 p99_latency;
+  double cpu_per_message;
+  double syscalls_per_message;
+  guint64 bytes_sent;
+  guint64 bytes_sent_compressed;
+  guint64 all_sent;
+  guint64 all_sent_compressed;
+
+  benchmark.n_messages = 10000;
+  benchmark.depth = 1;
+  benchmark.n_clients = 1;
+  size = 64;
+  compression_level = 0;
+  tls = FALSE;
+  tabular = FALSE;
+
+  for(arg = 1; arg < argc; ++arg)
+  {
+    if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+      benchmark.n_messages = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+      size = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-d") == 0 && arg + 1 < argc)
+      benchmark.depth = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+      benchmark.n_clients = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-z") == 0 && arg + 1 < argc)
+      compression_level = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-T") == 0)
+      tls = TRUE;
+    else if(strcmp(argv[arg], "-t") == 0)
+      tabular = TRUE;
+    else
+      break;
+  }
+
+  if(arg < argc || benchmark.n_messages == 0 || benchmark.depth == 0 ||
+     benchmark.n_clients == 0 || compression_level > 9)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [-n <messages>] [-s <bytes>] [-d <depth>] "
+      "[-c <connections>] [-z <level>] [-T] [-t]\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  creds = NULL;
+  policy = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  if(tls)
+  {
+    creds = inf_test_xmpp_benchmark_load_credentials(&error);
+    if(creds == NULL)
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return -1;
+    }
+
+    policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
+  }
+
+  benchmark.io = inf_standalone_io_new();
+  benchmark.message = inf_test_xmpp_benchmark_create_message(size);
+  benchmark.clients = NULL;
+  benchmark.server_connections = NULL;
+  benchmark.n_open = 0;
+  benchmark.n_finished = 0;
+  benchmark.failed = FALSE;
+  benchmark.latencies = g_array_sized_new(
+    FALSE,
+    FALSE,
+    sizeof(gint64),
+    benchmark.n_messages * benchmark.n_clients
+  );
+
+  /* Let the system choose a free port */
+  addr = inf_ip_address_new_loopback4();
+  tcp_server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", benchmark.io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  xmpp_server = infd_xmpp_server_new(tcp_server, policy, creds, NULL, NULL);
+  g_object_set(
+    G_OBJECT(xmpp_server),
+    "compression-level", compression_level,
+    NULL
+  );
+
+  if(creds != NULL)
+    inf_certificate_credentials_unref(creds);
+
+  g_signal_connect(
+    G_OBJECT(xmpp_server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_benchmark_new_connection_cb),
+    &benchmark
+  );
+
+  if(!infd_tcp_server_open(tcp_server, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  g_object_get(G_OBJECT(tcp_server), "local-port", &port, NULL);
+
+  for(i = 0; i < benchmark.n_clients; ++i)
+  {
+    client = g_slice_new(InfTestXmppBenchmarkClient);
+    client->benchmark = &benchmark;
+    client->open = FALSE;
+    client->n_sent = 0;
+    client->n_received = 0;
+    client->send_times = g_new(gint64, benchmark.depth);
+
+    tcp = inf_tcp_connection_new(INF_IO(benchmark.io), addr, port);
+
+    client->xmpp = inf_xmpp_connection_new(
+      tcp,
+      INF_XMPP_CONNECTION_CLIENT,
+      NULL,
+      "localhost",
+      policy,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    g_object_set(
+      G_OBJECT(client->xmpp),
+      "compression-level", compression_level,
+      NULL
+    );
+
+    g_signal_connect(
+      G_OBJECT(client->xmpp),
+      "received",
+      G_CALLBACK(inf_test_xmpp_benchmark_client_received_cb),
+      client
+    );
+
+    g_signal_connect(
+      G_OBJECT(client->xmpp),
+      "notify::status",
+      G_CALLBACK(inf_test_xmpp_benchmark_client_notify_status_cb),
+      client
+    );
+
+    g_signal_connect(
+      G_OBJECT(client->xmpp),
+      "error",
+      G_CALLBACK(inf_test_xmpp_benchmark_error_cb),
+      &benchmark
+    );
+
+    benchmark.clients = g_slist_prepend(benchmark.clients, client);
+
+    if(!inf_tcp_connection_open(tcp, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return -1;
+    }
+
+    g_object_unref(tcp);
+  }
+
+  inf_ip_address_free(addr);
+
+  inf_standalone_io_loop(benchmark.io);
+
+  if(!benchmark.failed)
+  {
+    n_total = benchmark.n_messages * benchmark.n_clients;
+    seconds = (benchmark.end - benchmark.begin) / 1000000.0;
+
+    messages_per_sec = 0.0;
+    mb_per_sec = 0.0;
+    if(seconds > 0.0)
+    {
+      messages_per_sec = n_total / seconds;
+      mb_per_sec = 2.0 * size * n_total / seconds / 1000000.0;
+    }
+
+    avg_latency = 0.0;
+    for(i = 0; i < benchmark.latencies->len; ++i)
+      avg_latency += g_array_index(benchmark.latencies, gint64, i);
+    avg_latency /= benchmark.latencies->len;
+
+    g_array_sort(
+      benchmark.latencies,
+      inf_test_xmpp_benchmark_latency_compare
+    );
+
+    p99_latency = g_array_index(
+      benchmark.latencies,
+      gint64,
+      (guint)((benchmark.latencies->len - 1) * 0.99)
+    );
+
+    cpu_per_message =
+      (double)(benchmark.cpu_end - benchmark.cpu_begin) / n_total;
+
+    syscalls_per_message = -1.0;
+    if(benchmark.syscalls_begin >= 0 && benchmark.syscalls_end >= 0)
+    {
+      syscalls_per_message =
+        (double)(benchmark.syscalls_end - benchmark.syscalls_begin) / n_total;
+    }
+
+    all_sent = 0;
+    all_sent_compressed = 0;
+    for(item = benchmark.clients; item != NULL; item = item->next)
+    {
+      client = (InfTestXmppBenchmarkClient*)item->data;
+      if(inf_xmpp_connection_get_compression_stats(client->xmpp,
+                                                   &bytes_sent,
+                                                   &bytes_sent_compressed,
+                                                   NULL,
+                                                   NULL))
+      {
+        all_sent += bytes_sent;
+        all_sent_compressed += bytes_sent_compressed;
+      }
+    }
+
+    if(tabular)
+    {
+      printf(
+        "%s\t%u\t%u\t%u\t%u\t%u\t%.3f\t%.1f\t%.3f\t%.1f\t%" G_GINT64_FORMAT
+        "\t%.2f\t%.2f\n",
+        tls ? "yes" : "no",
+        compression_level,
+        size,
+        benchmark.depth,
+        benchmark.n_clients,
+        n_total,
+        seconds,
+        messages_per_sec,
+        mb_per_sec,
+        avg_latency,
+        p99_latency,
+        cpu_per_message,
+        syscalls_per_message
+      );
+    }
+    else
+    {
+      fprintf(
+        stderr,
+        "%u messages of %u bytes in %.3f s: %.1f messages/s, %.3f MB/s\n"
+        "latency avg %.1f us, p99 %" G_GINT64_FORMAT " us\n"
+        "%.2f us CPU and %.2f syscalls per message\n",
+        n_total,
+        size,
+        seconds,
+        messages_per_sec,
+        mb_per_sec,
+        avg_latency,
+        p99_latency,
+        cpu_per_message,
+        syscalls_per_message
+      );
+
+      if(all_sent > 0)
+      {
+        fprintf(
+          stderr,
+          "client data compressed to %.1f%%\n",
+          100.0 * all_sent_compressed / all_sent
+        );
+      }
+    }
+  }
+
+  for(item = benchmark.clients; item != NULL; item = item->next)
+  {
+    client = (InfTestXmppBenchmarkClient*)item->data;
+    g_object_unref(client->xmpp);
+    g_free(client->send_times);
+    g_slice_free(InfTestXmppBenchmarkClient, client);
+  }
+
+  for(item = benchmark.server_connections; item != NULL; item = item->next)
+    g_object_unref(item->data);
+
+  g_slist_free(benchmark.clients);
+  g_slist_free(benchmark.server_connections);
+  g_array_free(benchmark.latencies, TRUE);
+  xmlFreeNode(benchmark.message);
+
+  infd_xml_server_close(INFD_XML_SERVER(xmpp_server));
+  g_object_unref(xmpp_server);
+  g_object_unref(tcp_server);
+  g_object_unref(benchmark.io);
+
+  return benchmark.failed ? -1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,736 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Tests XEP-0138 stream compression of InfXmppConnection over loopback. A
+ * client and a server that both have compression enabled negotiate it, and
+ * messages are echoed back by the server through the compressed stream. If
+ * either site has compression disabled, the stream stays uncompressed.
+ * Finally, a client that asks for a compression method the server does not
+ * support, written by hand on top of a plain InfTcpConnection, is told so
+ * by the server and can go on with authentication on the uncompressed
+ * stream. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* How long to wait for a test to finish, in milliseconds */
+#define TEST_COMPRESSION_TIMEOUT 10000
+
+typedef enum _TestCompressionRawState {
+  TEST_COMPRESSION_RAW_AWAITING_FEATURES,
+  TEST_COMPRESSION_RAW_AWAITING_FAILURE,
+  TEST_COMPRESSION_RAW_AWAITING_AUTH_REPLY,
+  TEST_COMPRESSION_RAW_DONE
+} TestCompressionRawState;
+
+typedef struct _TestCompression TestCompression;
+struct _TestCompression {
+  InfStandaloneIo* io;
+  InfIoTimeout* timeout;
+  gboolean failed;
+
+  InfdTcpServer* tcp_server;
+  InfdXmppServer* xmpp_server;
+  guint port;
+  GSList* server_connections;
+
+  /* Client using InfXmppConnection */
+  InfXmppConnection* client;
+  GPtrArray* messages;
+  guint n_received;
+
+  /* Client speaking XMPP by hand */
+  InfTcpConnection* raw;
+  GString* raw_data;
+  gsize raw_offset;
+  TestCompressionRawState raw_state;
+  gboolean offers_compression;
+};
+
+static void
+test_compression_quit(TestCompression* test)
+{
+  if(inf_standalone_io_loop_running(test->io))
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+test_compression_fail(TestCompression* test,
+                      const gchar* name,
+                      const gchar* message)
+{
+  printf("%s: %s\n", name, message);
+
+  test->failed = TRUE;
+  test_compression_quit(test);
+}
+
+static void
+test_compression_timeout_func(gpointer user_data)
+{
+  TestCompression* test;
+  test = (TestCompression*)user_data;
+
+  test->timeout = NULL;
+  test_compression_fail(test, "timeout", "test did not finish in time");
+}
+
+static void
+test_compression_error_cb(GObject* object,
+                          const GError* error,
+                          gpointer user_data)
+{
+  test_compression_fail((TestCompression*)user_data, "error", error->message);
+}
+
+static void
+test_compression_server_received_cb(InfXmlConnection* connection,
+                                    xmlNodePtr xml,
+                                    gpointer user_data)
+{
+  inf_xml_connection_send(connection, xmlCopyNode(xml, 1));
+}
+
+static void
+test_compression_new_connection_cb(InfdXmlServer* server,
+                                   InfXmlConnection* connection,
+                                   gpointer user_data)
+{
+  TestCompression* test;
+  test = (TestCompression*)user_data;
+
+  g_object_ref(connection);
+  test->server_connections =
+    g_slist_prepend(test->server_connections, connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(test_compression_server_received_cb),
+    test
+  );
+}
+
+static gboolean
+test_compression_init(TestCompression* test,
+                      guint server_level)
+{
+  InfIpAddress* addr;
+  GError* error;
+
+  test->io = inf_standalone_io_new();
+  test->failed = FALSE;
+  test->server_connections = NULL;
+  test->client = NULL;
+  test->messages = NULL;
+  test->n_received = 0;
+  test->raw = NULL;
+  test->raw_data = NULL;
+  test->raw_offset = 0;
+  test->raw_state = TEST_COMPRESSION_RAW_AWAITING_FEATURES;
+  test->offers_compression = FALSE;
+
+  test->timeout = inf_io_add_timeout(
+    INF_IO(test->io),
+    TEST_COMPRESSION_TIMEOUT,
+    test_compression_timeout_func,
+    test,
+    NULL
+  );
+
+  /* Let the system choose a free port */
+  addr = inf_ip_address_new_loopback4();
+  test->tcp_server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test->io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  inf_ip_address_free(addr);
+
+  test->xmpp_server = infd_xmpp_server_new(
+    test->tcp_server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_object_set(
+    G_OBJECT(test->xmpp_server),
+    "compression-level", server_level,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->xmpp_server),
+    "new-connection",
+    G_CALLBACK(test_compression_new_connection_cb),
+    test
+  );
+
+  error = NULL;
+  if(!infd_tcp_server_open(test->tcp_server, &error))
+  {
+    printf("Failed to open server: %s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  g_object_get(G_OBJECT(test->tcp_server), "local-port", &test->port, NULL);
+  return TRUE;
+}
+
+static void
+test_compression_finalize(TestCompression* test)
+{
+  InfTcpConnectionStatus status;
+  InfdXmlServerStatus server_status;
+  GSList* item;
+
+  /* Closing the connections must not count as a failure */
+  if(test->client != NULL)
+  {
+    g_signal_handlers_disconnect_matched(
+      G_OBJECT(test->client),
+      G_SIGNAL_MATCH_DATA,
+      0,
+      0,
+      NULL,
+      NULL,
+      test
+    );
+
+    g_object_unref(test->client);
+  }
+
+  if(test->raw != NULL)
+  {
+    g_signal_handlers_disconnect_matched(
+      G_OBJECT(test->raw),
+      G_SIGNAL_MATCH_DATA,
+      0,
+      0,
+      NULL,
+      NULL,
+      test
+    );
+
+    g_object_get(G_OBJECT(test->raw), "status", &status, NULL);
+    if(status != INF_TCP_CONNECTION_CLOSED)
+      inf_tcp_connection_close(test->raw);
+
+    g_object_unref(test->raw);
+  }
+
+  if(test->raw_data != NULL)
+    g_string_free(test->raw_data, TRUE);
+  if(test->messages != NULL)
+    g_ptr_array_free(test->messages, TRUE);
+
+  for(item = test->server_connections; item != NULL; item = item->next)
+    g_object_unref(item->data);
+  g_slist_free(test->server_connections);
+
+  if(test->timeout != NULL)
+    inf_io_remove_timeout(INF_IO(test->io), test->timeout);
+
+  g_object_get(G_OBJECT(test->xmpp_server), "status", &server_status, NULL);
+  if(server_status != INFD_XML_SERVER_CLOSED)
+    infd_xml_server_close(INFD_XML_SERVER(test->xmpp_server));
+
+  g_object_unref(test->xmpp_server);
+  g_object_unref(test->tcp_server);
+  g_object_unref(test->io);
+}
+
+static void
+test_compression_client_received_cb(InfXmlConnection* connection,
+                                    xmlNodePtr xml,
+                                    gpointer user_data)
+{
+  TestCompression* test;
+  xmlChar* content;
+  const gchar* expected;
+
+  test = (TestCompression*)user_data;
+
+  if(test->n_received >= test->messages->len)
+  {
+    test_compression_fail(test, "round-trip", "too many messages received");
+    return;
+  }
+
+  expected = g_ptr_array_index(test->messages, test->n_received);
+  content = xmlNodeGetContent(xml);
+
+  if(content == NULL || strcmp((const char*)content, expected) != 0)
+  {
+    test_compression_fail(test, "round-trip", "message was garbled");
+  }
+  else
+  {
+    ++test->n_received;
+    if(test->n_received == test->messages->len)
+      test_compression_quit(test);
+  }
+
+  if(content != NULL)
+    xmlFree(content);
+}
+
+static void
+test_compression_client_notify_status_cb(GObject* object,
+                                         GParamSpec* pspec,
+                                         gpointer user_data)
+{
+  TestCompression* test;
+  InfXmlConnectionStatus status;
+  xmlNodePtr xml;
+  guint i;
+
+  test = (TestCompression*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_OPEN)
+  {
+    for(i = 0; i < test->messages->len; ++i)
+    {
+      xml = xmlNewNode(NULL, (const xmlChar*)"message");
+      xmlNodeAddContent(
+        xml,
+        (const xmlChar*)g_ptr_array_index(test->messages, i)
+      );
+
+      inf_xml_connection_send(INF_XML_CONNECTION(object), xml);
+    }
+  }
+  else if(status == INF_XML_CONNECTION_CLOSED)
+  {
+    test_compression_fail(test, "round-trip", "connection was closed");
+  }
+}
+
+/* Messages that compress well, that compress poorly, and that contain
+ * multibyte characters. The larger ones span several reads and writes. */
+static GPtrArray*
+test_compression_create_messages(void)
+{
+  GPtrArray* messages;
+  GString* str;
+  GRand* rand;
+  guint i;
+
+  messages = g_ptr_array_new_with_free_func(g_free);
+  g_ptr_array_add(messages, g_strdup("hello"));
+
+  str = g_string_new(NULL);
+  for(i = 0; i < 4096; ++i)
+    g_string_append(str, "all work and no play ");
+  g_ptr_array_add(messages, g_string_free(str, FALSE));
+
+  str = g_string_new(NULL);
+  rand = g_rand_new_with_seed(42);
+  for(i = 0; i < 16384; ++i)
+    g_string_append_c(str, 'a' + g_rand_int_range(rand, 0, 26));
+  g_rand_free(rand);
+  g_ptr_array_add(messages, g_string_free(str, FALSE));
+
+  str = g_string_new(NULL);
+  for(i = 0; i < 1024; ++i)
+    g_string_append(str, "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac \xe6\x97\xa5 ");
+  g_ptr_array_add(messages, g_string_free(str, FALSE));
+
+  g_ptr_array_add(messages, g_strdup("bye"));
+  return messages;
+}
+
+static gboolean
+test_compression_round_trip(const gchar* name,
+                            guint server_level,
+                            guint client_level,
+                            gboolean compressed)
+{
+  TestCompression test;
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* server_connection;
+  const gchar* method;
+  const gchar* server_method;
+  guint64 bytes_sent;
+  guint64 bytes_sent_compressed;
+  guint64 bytes_received;
+  guint64 bytes_received_compressed;
+  gboolean has_stats;
+  GError* error;
+  gboolean result;
+
+  if(!test_compression_init(&test, server_level))
+  {
+    test_compression_finalize(&test);
+    return FALSE;
+  }
+
+  test.messages = test_compression_create_messages();
+
+  addr = inf_ip_address_new_loopback4();
+  tcp = inf_tcp_connection_new(INF_IO(test.io), addr, test.port);
+  inf_ip_address_free(addr);
+
+  test.client = inf_xmpp_connection_new(
+    tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    NULL,
+    "localhost",
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_object_set(
+    G_OBJECT(test.client),
+    "compression-level", client_level,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "received",
+    G_CALLBACK(test_compression_client_received_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "notify::status",
+    G_CALLBACK(test_compression_client_notify_status_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "error",
+    G_CALLBACK(test_compression_error_cb),
+    &test
+  );
+
+  error = NULL;
+  if(!inf_tcp_connection_open(tcp, &error))
+  {
+    printf("%s: failed to connect: %s\n", name, error->message);
+    g_error_free(error);
+    g_object_unref(tcp);
+    test_compression_finalize(&test);
+    return FALSE;
+  }
+
+  g_object_unref(tcp);
+  inf_standalone_io_loop(test.io);
+
+  result = !test.failed;
+
+  if(result == TRUE)
+  {
+    method = inf_xmpp_connection_get_compression_method(test.client);
+
+    has_stats = inf_xmpp_connection_get_compression_stats(
+      test.client,
+      &bytes_sent,
+      &bytes_sent_compressed,
+      &bytes_received,
+      &bytes_received_compressed
+    );
+
+    server_method = NULL;
+    if(test.server_connections != NULL)
+    {
+      server_connection = INF_XMPP_CONNECTION(test.server_connections->data);
+      server_method =
+        inf_xmpp_connection_get_compression_method(server_connection);
+    }
+
+    if(compressed)
+    {
+      if(method == NULL || server_method == NULL ||
+         strcmp(method, server_method) != 0)
+      {
+        printf("%s: compression was not negotiated\n", name);
+        result = FALSE;
+      }
+      else if(!has_stats || bytes_sent == 0 ||
+              bytes_sent_compressed >= bytes_sent ||
+              bytes_received_compressed >= bytes_received)
+      {
+        printf("%s: data was not compressed\n", name);
+        result = FALSE;
+      }
+    }
+    else
+    {
+      if(method != NULL || server_method != NULL || has_stats)
+      {
+        printf("%s: stream is compressed\n", name);
+        result = FALSE;
+      }
+    }
+  }
+
+  test_compression_finalize(&test);
+  return result;
+}
+
+static void
+test_compression_raw_send(TestCompression* test,
+                          const gchar* data)
+{
+  inf_tcp_connection_send(test->raw, data, strlen(data));
+  test->raw_offset = test->raw_data->len;
+}
+
+static void
+test_compression_raw_received_cb(InfTcpConnection* connection,
+                                 gconstpointer data,
+                                 guint len,
+                                 gpointer user_data)
+{
+  TestCompression* test;
+  const gchar* pending;
+  const gchar* end;
+
+  test = (TestCompression*)user_data;
+  g_string_append_len(test->raw_data, data, len);
+  pending = test->raw_data->str + test->raw_offset;
+
+  switch(test->raw_state)
+  {
+  case TEST_COMPRESSION_RAW_AWAITING_FEATURES:
+    end = strstr(pending, "</stream:features>");
+    if(end != NULL)
+    {
+      test->offers_compression =
+        g_strstr_len(pending, end - pending,
+                     "http://jabber.org/features/compress") != NULL;
+
+      test->raw_state = TEST_COMPRESSION_RAW_AWAITING_FAILURE;
+      test_compression_raw_send(
+        test,
+        "<compress xmlns=\"http://jabber.org/protocol/compress\">"
+        "<method>inf-test-unsupported</method></compress>"
+      );
+    }
+
+    break;
+  case TEST_COMPRESSION_RAW_AWAITING_FAILURE:
+    end = strstr(pending, "</failure>");
+    if(end != NULL)
+    {
+      if(g_strstr_len(pending, end - pending,
+                      test->offers_compression ?
+                      "<unsupported-method/>" : "<setup-failed/>") == NULL)
+      {
+        test_compression_fail(test, "unsupported-method", "wrong failure");
+        break;
+      }
+
+      /* The server replies in plain text to an uncompressed request */
+      test->raw_state = TEST_COMPRESSION_RAW_AWAITING_AUTH_REPLY;
+      test_compression_raw_send(
+        test,
+        "<auth xmlns=\"urn:ietf:params:xml:ns:xmpp-sasl\" "
+        "mechanism=\"ANONYMOUS\"/>"
+      );
+    }
+    else if(strstr(pending, "<compressed") != NULL)
+    {
+      test_compression_fail(
+        test,
+        "unsupported-method",
+        "unsupported method was accepted"
+      );
+    }
+
+    break;
+  case TEST_COMPRESSION_RAW_AWAITING_AUTH_REPLY:
+    if(strstr(pending, "urn:ietf:params:xml:ns:xmpp-sasl") != NULL)
+    {
+      test->raw_state = TEST_COMPRESSION_RAW_DONE;
+      test_compression_quit(test);
+    }
+    else if(strstr(pending, "<stream:error") != NULL)
+    {
+      test_compression_fail(test, "unsupported-method", "stream error");
+    }
+
+    break;
+  case TEST_COMPRESSION_RAW_DONE:
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+test_compression_raw_notify_status_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
+{
+  TestCompression* test;
+  InfTcpConnectionStatus status;
+
+  test = (TestCompression*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_TCP_CONNECTION_CONNECTED)
+  {
+    test_compression_raw_send(
+      test,
+      "<stream:stream version=\"1.0\" xmlns=\"jabber:client\" "
+      "xmlns:stream=\"http://etherx.jabber.org/streams\" to=\"localhost\">"
+    );
+  }
+  else if(status == INF_TCP_CONNECTION_CLOSED &&
+          test->raw_state != TEST_COMPRESSION_RAW_DONE)
+  {
+    test_compression_fail(
+      test,
+      "unsupported-method",
+      "connection was closed"
+    );
+  }
+}
+
+/* Returns whether the server offered stream compression in
+ * offers_compression, so that the round trip test can be skipped if
+ * libinfinity was built without any compression method. */
+static gboolean
+test_compression_unsupported_method(gboolean* offers_compression)
+{
+  TestCompression test;
+  InfIpAddress* addr;
+  GError* error;
+  gboolean result;
+
+  if(!test_compression_init(&test, 6))
+  {
+    test_compression_finalize(&test);
+    return FALSE;
+  }
+
+  test.raw_data = g_string_new(NULL);
+
+  addr = inf_ip_address_new_loopback4();
+  test.raw = inf_tcp_connection_new(INF_IO(test.io), addr, test.port);
+  inf_ip_address_free(addr);
+
+  g_signal_connect(
+    G_OBJECT(test.raw),
+    "received",
+    G_CALLBACK(test_compression_raw_received_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.raw),
+    "notify::status",
+    G_CALLBACK(test_compression_raw_notify_status_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.raw),
+    "error",
+    G_CALLBACK(test_compression_error_cb),
+    &test
+  );
+
+  error = NULL;
+  if(!inf_tcp_connection_open(test.raw, &error))
+  {
+    printf("unsupported-method: failed to connect: %s\n", error->message);
+    g_error_free(error);
+    test_compression_finalize(&test);
+    return FALSE;
+  }
+
+  inf_standalone_io_loop(test.io);
+
+  result = !test.failed;
+  *offers_compression = test.offers_compression;
+
+  test_compression_finalize(&test);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  gboolean offers_compression;
+  guint passed;
+  guint total;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  passed = 0;
+  total = 0;
+  offers_compression = FALSE;
+
+  ++total;
+  if(test_compression_unsupported_method(&offers_compression)) ++passed;
+
+  if(offers_compression)
+  {
+    ++total;
+    if(test_compression_round_trip("compressed", 6, 6, TRUE)) ++passed;
+  }
+  else
+  {
+    printf("No compression method available, skipping round trip\n");
+  }
+
+  ++total;
+  if(test_compression_round_trip("server-disabled", 0, 6, FALSE)) ++passed;
+  ++total;
+  if(test_compression_round_trip("client-disabled", 6, 0, FALSE)) ++passed;
+
+  printf("%u out of %u tests passed\n", passed, total);
+
+  inf_deinit();
+  return passed < total ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */